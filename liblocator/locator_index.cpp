@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+#include "locator_index.h"
+
+namespace facebook {
+
+constexpr const uint32_t ClassLocatorIndex::magic;
+constexpr const uint32_t ClassLocatorIndex::version;
+constexpr const uint32_t ClassLocatorIndex::direct_slot;
+constexpr const uint32_t ClassLocatorIndex::header_words;
+constexpr const uint32_t ClassLocatorIndex::entry_words;
+
+bool
+ClassLocatorIndex::init(const void* buf, size_t size) noexcept
+{
+  const uint32_t* words = (const uint32_t*)buf;
+  if (size < header_words * sizeof(uint32_t) || words[0] != magic ||
+      words[1] != version) {
+    return false;
+  }
+  uint64_t num_classes = words[2];
+  uint64_t num_buckets = words[3];
+  uint64_t strings_size = words[4];
+  uint64_t expected = (header_words + num_buckets + num_classes * entry_words) *
+                          sizeof(uint32_t) +
+                      strings_size;
+  if (expected != size || (num_classes != 0 && num_buckets == 0)) {
+    return false;
+  }
+  displacements_ = words + header_words;
+  entries_ = displacements_ + num_buckets;
+  strings_ = (const char*)(entries_ + num_classes * entry_words);
+  if (strings_size != 0 && strings_[strings_size - 1] != '\0') {
+    return false;
+  }
+  num_classes_ = num_classes;
+  num_buckets_ = num_buckets;
+  strings_size_ = strings_size;
+  return true;
+}
+
+std::string
+ClassLocatorIndex::build(
+    const std::vector<std::pair<std::string, Locator>>& classes)
+{
+  const uint32_t num_classes = classes.size();
+  // About two classes per bucket finds displacements quickly, and keeps the
+  // table at two words per class including the entries.
+  const uint32_t num_buckets = num_classes / 2 + 1;
+
+  std::vector<std::vector<uint32_t>> buckets(num_buckets);
+  {
+    std::unordered_set<std::string> seen;
+    for (uint32_t i = 0; i < num_classes; i++) {
+      const auto& name = classes[i].first;
+      if (!seen.insert(name).second) {
+        throw std::runtime_error("class " + name + " is indexed twice");
+      }
+      buckets[hash(0, name.c_str()) % num_buckets].push_back(i);
+    }
+  }
+
+  // Place the biggest buckets first, while most of the slots are still free.
+  std::vector<uint32_t> order(num_buckets);
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    order[b] = b;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  std::vector<uint32_t> displacements(num_buckets, 0);
+  std::vector<uint32_t> slot_of(num_classes);
+  std::vector<bool> taken(num_classes, false);
+  uint32_t next_free = 0;
+  std::vector<uint32_t> slots;
+  for (auto b : order) {
+    const auto& bucket = buckets[b];
+    if (bucket.empty()) {
+      break;
+    }
+    if (bucket.size() == 1) {
+      while (taken[next_free]) {
+        next_free++;
+      }
+      taken[next_free] = true;
+      slot_of[bucket[0]] = next_free;
+      displacements[b] = direct_slot | next_free;
+      continue;
+    }
+    for (uint32_t d = 1;; d++) {
+      if (d == direct_slot) {
+        throw std::runtime_error("cannot build the locator index");
+      }
+      slots.clear();
+      for (auto i : bucket) {
+        uint32_t slot = hash(d, classes[i].first.c_str()) % num_classes;
+        if (taken[slot] ||
+            std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+          break;
+        }
+        slots.push_back(slot);
+      }
+      if (slots.size() == bucket.size()) {
+        for (size_t k = 0; k < bucket.size(); k++) {
+          taken[slots[k]] = true;
+          slot_of[bucket[k]] = slots[k];
+        }
+        displacements[b] = d;
+        break;
+      }
+    }
+  }
+
+  std::vector<uint32_t> entries(num_classes * entry_words);
+  std::string strings;
+  for (uint32_t i = 0; i < num_classes; i++) {
+    const auto& locator = classes[i].second;
+    uint32_t* entry = &entries[slot_of[i] * entry_words];
+    entry[0] = strings.size();
+    entry[1] = locator.clsnr;
+    entry[2] = locator.strnr << 8 | locator.dexnr;
+    strings.append(classes[i].first.c_str(), classes[i].first.size() + 1);
+  }
+
+  std::vector<uint32_t> header{
+      magic, version, num_classes, num_buckets, (uint32_t)strings.size()};
+  std::string out;
+  auto append = [&](const std::vector<uint32_t>& words) {
+    out.append((const char*)words.data(), words.size() * sizeof(uint32_t));
+  };
+  append(header);
+  append(displacements);
+  append(entries);
+  out += strings;
+  return out;
+}
+
+} // namespace facebook
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "locator.h"
+
+namespace facebook {
+
+//
+// A class locator index maps the type descriptor of every class in the app's
+// dexes to its locator, with a minimal perfect hash: a class loader that has
+// the index mapped can find any class with two hashes and one string
+// comparison, whether or not it was renamed or has a locator string.
+//
+// Redex writes it when "emit_class_locator_index" is set. The layout, in
+// little-endian 32-bit words, is
+//
+//   magic, version, num_classes, num_buckets, strings_size
+//   displacements[num_buckets]
+//   entries[num_classes]: name offset, clsnr, strnr << 8 | dexnr
+//   strings[strings_size]: NUL-terminated type descriptors
+//
+// A descriptor hashes with seed 0 to a bucket. If the bucket's displacement
+// has the high bit set, the rest of it is the class' slot; otherwise the
+// descriptor hashes with the displacement as the seed to its slot.
+//
+class ClassLocatorIndex {
+ public:
+  constexpr static const uint32_t magic = 0x58494c52; // "RLIX"
+  constexpr static const uint32_t version = 1;
+
+  // Returns false if buf doesn't hold a locator index.
+  bool init(const void* buf, size_t size) noexcept;
+
+  // The locator of the class, or (0, 0, 0) if the class isn't in any of
+  // the app's dexes, which is to search the system class loader.
+  inline Locator find(const char* descriptor) const noexcept;
+
+  uint32_t size() const noexcept { return num_classes_; }
+
+  static inline uint32_t hash(uint32_t seed, const char* str) noexcept;
+
+  // Builds an index of the given classes. Throws if a class is given twice.
+  static std::string build(
+      const std::vector<std::pair<std::string, Locator>>& classes);
+
+ private:
+  constexpr static const uint32_t direct_slot = 0x80000000;
+  constexpr static const uint32_t header_words = 5;
+  constexpr static const uint32_t entry_words = 3;
+
+  const uint32_t* displacements_ = nullptr;
+  const uint32_t* entries_ = nullptr;
+  const char* strings_ = nullptr;
+  uint32_t num_classes_ = 0;
+  uint32_t num_buckets_ = 0;
+  uint32_t strings_size_ = 0;
+};
+
+uint32_t ClassLocatorIndex::hash(uint32_t seed, const char* str) noexcept {
+  // FNV-1a, with a final mix so that the low bits depend on all the input.
+  uint32_t h = 0x811c9dc5 ^ (seed * 0x9e3779b1);
+  for (const uint8_t* p = (const uint8_t*)str; *p != '\0'; p++) {
+    h = (h ^ *p) * 0x01000193;
+  }
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  return h;
+}
+
+Locator ClassLocatorIndex::find(const char* descriptor) const noexcept {
+  if (num_classes_ == 0) {
+    return Locator(0, 0, 0);
+  }
+  uint32_t displacement = displacements_[hash(0, descriptor) % num_buckets_];
+  uint32_t slot = (displacement & direct_slot)
+                      ? displacement & ~direct_slot
+                      : hash(displacement, descriptor) % num_classes_;
+  if (slot >= num_classes_) {
+    return Locator(0, 0, 0);
+  }
+  // init() checked that the strings end with a NUL.
+  const uint32_t* entry = entries_ + slot * entry_words;
+  if (entry[0] >= strings_size_ ||
+      strcmp(strings_ + entry[0], descriptor) != 0) {
+    return Locator(0, 0, 0);
+  }
+  return Locator(entry[2] >> 8, entry[2] & 0xff, entry[1]);
+}
+
+} // namespace facebook
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisCache.h"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "DexHasher.h"
+#include "Show.h"
+#include "Trace.h"
+#include "Walkers.h"
+
+namespace analysis_cache {
+
+namespace {
+
+std::vector<const DexMethod*> get_callees(const call_graph::Graph& call_graph,
+                                          const DexMethod* method) {
+  std::vector<const DexMethod*> callees;
+  if (!call_graph.has_node(method)) {
+    return callees;
+  }
+  for (const auto& edge : call_graph.node(method).callees()) {
+    if (edge->callee() != nullptr) {
+      callees.push_back(edge->callee());
+    }
+  }
+  return callees;
+}
+
+} // namespace
+
+MethodSummaryCache::MethodSummaryCache(std::string path,
+                                       const Scope& scope,
+                                       const call_graph::Graph& call_graph,
+                                       size_t salt)
+    : m_path(std::move(path)), m_call_graph(call_graph), m_salt(salt) {
+  ConcurrentMap<const DexMethod*, size_t> keys;
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    auto class_hash = hashing::DexClassHasher(cls).run();
+    size_t cls_key = 0;
+    boost::hash_combine(cls_key, class_hash.registers_hash);
+    boost::hash_combine(cls_key, class_hash.code_hash);
+    boost::hash_combine(cls_key, class_hash.signature_hash);
+    auto methods = cls->get_dmethods();
+    methods.insert(methods.end(), cls->get_vmethods().begin(),
+                   cls->get_vmethods().end());
+    for (auto* method : methods) {
+      if (method->get_code() == nullptr) {
+        continue;
+      }
+      std::vector<std::string> callee_names;
+      for (auto* callee : get_callees(call_graph, method)) {
+        callee_names.push_back(show(callee));
+      }
+      std::sort(callee_names.begin(), callee_names.end());
+      auto key = cls_key;
+      boost::hash_combine(key, callee_names);
+      keys.emplace(method, key);
+    }
+  });
+  m_keys.insert(keys.begin(), keys.end());
+}
+
+void MethodSummaryCache::load_reusable_entries(
+    std::unordered_map<const DexMethod*, sparta::s_expr>* entries) const {
+  std::ifstream input(m_path);
+  if (!input) {
+    TRACE(LIB, 1, "No analysis cache at %s", m_path.c_str());
+    return;
+  }
+  sparta::s_expr_istream s_expr_input(input);
+  sparta::s_expr header;
+  s_expr_input >> header;
+  if (s_expr_input.fail() || !header.is_string() ||
+      header.get_string() != std::to_string(m_salt)) {
+    TRACE(LIB, 1, "Ignoring the stale analysis cache at %s", m_path.c_str());
+    return;
+  }
+  while (s_expr_input.good()) {
+    sparta::s_expr expr;
+    s_expr_input >> expr;
+    if (s_expr_input.eoi()) {
+      break;
+    }
+    always_assert_log(!s_expr_input.fail(), "%s\n",
+                      s_expr_input.what().c_str());
+    auto* method_ref = DexMethod::get_method(expr[0].get_string());
+    if (method_ref == nullptr || !method_ref->is_def()) {
+      continue;
+    }
+    auto* method = method_ref->as_def();
+    auto it = m_keys.find(method);
+    if (it != m_keys.end() &&
+        std::to_string(it->second) == expr[1].get_string()) {
+      entries->emplace(method, expr[2]);
+    }
+  }
+
+  // A summary can only be reused if all the summaries it was derived from are
+  // reused as well.
+  std::vector<const DexMethod*> stale;
+  for (const auto& pair : m_keys) {
+    if (!entries->count(pair.first)) {
+      stale.push_back(pair.first);
+    }
+  }
+  while (!stale.empty()) {
+    auto* method = stale.back();
+    stale.pop_back();
+    if (!m_call_graph.has_node(method)) {
+      continue;
+    }
+    for (const auto& edge : m_call_graph.node(method).callers()) {
+      auto* caller = edge->caller();
+      if (caller != nullptr && entries->erase(caller)) {
+        stale.push_back(caller);
+      }
+    }
+  }
+  TRACE(LIB, 1, "Reusing %zu of %zu summaries from %s", entries->size(),
+        m_keys.size(), m_path.c_str());
+}
+
+void MethodSummaryCache::store_entries(
+    const std::map<const DexMethod*, sparta::s_expr, dexmethods_comparator>&
+        entries) const {
+  // Write to a temporary file first, so that an interrupted run doesn't leave
+  // a truncated cache behind.
+  auto tmp_path = m_path + ".tmp";
+  {
+    std::ofstream output(tmp_path);
+    always_assert_log(output, "Cannot write to %s", tmp_path.c_str());
+    output << sparta::s_expr(std::to_string(m_salt)) << std::endl;
+    for (const auto& pair : entries) {
+      output << sparta::s_expr({sparta::s_expr(show(pair.first)),
+                                sparta::s_expr(std::to_string(
+                                    m_keys.at(pair.first))),
+                                pair.second})
+             << std::endl;
+    }
+  }
+  always_assert_log(std::rename(tmp_path.c_str(), m_path.c_str()) == 0,
+                    "Cannot write to %s", m_path.c_str());
+}
+
+} // namespace analysis_cache
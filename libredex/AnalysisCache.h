@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "CallGraph.h"
+#include "DexClass.h"
+#include "S_Expression.h"
+
+/*
+ * This module lets the summaries that an interprocedural analysis computes
+ * for the methods of the scope be reused by later runs of redex, e.g. on an
+ * APK that only differs from the previous one in a few classes.
+ */
+
+namespace analysis_cache {
+
+/*
+ * A cache file of method summaries, as produced by the analysis of a scope.
+ *
+ * The summary that a previous run cached for a method is only reused if, since
+ * that run:
+ *   - the class of the method hashes to the same value, as computed by
+ *     hashing::DexClassHasher;
+ *   - the method has the same callees in the call graph;
+ *   - the summaries of its callees in the scope are reused too.
+ * Anything else that the summaries depend on, e.g. the summaries of the
+ * external methods, must be folded into the `salt` of the cache, which
+ * invalidates it as a whole.
+ *
+ * The summary type V must provide `static V from_s_expr(const s_expr&)`, and
+ * there must be a `to_s_expr(const V&)`, as for summary_serialization.
+ */
+class MethodSummaryCache final {
+ public:
+  MethodSummaryCache(std::string path,
+                     const Scope& scope,
+                     const call_graph::Graph& call_graph,
+                     size_t salt);
+
+  /*
+   * Adds the reusable summaries to `summaries`, and returns their number. A
+   * missing or stale cache file is not an error: nothing gets reused then.
+   */
+  template <typename V>
+  size_t read(std::unordered_map<const DexMethodRef*, V>* summaries) const {
+    std::unordered_map<const DexMethod*, sparta::s_expr> entries;
+    load_reusable_entries(&entries);
+    for (const auto& pair : entries) {
+      summaries->emplace(pair.first, V::from_s_expr(pair.second));
+    }
+    return entries.size();
+  }
+
+  /*
+   * Replaces the cache file with the summaries of the methods of the scope.
+   */
+  template <typename V>
+  void write(const std::unordered_map<const DexMethodRef*, V>& summaries) const {
+    // Sort the entries so that the output is deterministic.
+    std::map<const DexMethod*, sparta::s_expr, dexmethods_comparator> entries;
+    for (const auto& pair : m_keys) {
+      auto it = summaries.find(pair.first);
+      if (it != summaries.end()) {
+        entries.emplace(pair.first, to_s_expr(it->second));
+      }
+    }
+    store_entries(entries);
+  }
+
+ private:
+  void load_reusable_entries(
+      std::unordered_map<const DexMethod*, sparta::s_expr>* entries) const;
+
+  void store_entries(const std::map<const DexMethod*,
+                                    sparta::s_expr,
+                                    dexmethods_comparator>& entries) const;
+
+  std::string m_path;
+  const call_graph::Graph& m_call_graph;
+  size_t m_salt;
+  // The methods of the scope that have code, along with a hash of their class
+  // and the names of their callees.
+  std::unordered_map<const DexMethod*, size_t> m_keys;
+};
+
+} // namespace analysis_cache
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisRegistry.h"
+
+#include "DexUtil.h"
+
+Scope AnalysisRegistry::build_scope(const DexStoresVector& stores) {
+  return build_class_scope(stores);
+}
+
+void AnalysisRegistry::invalidate(const PreservedAnalyses& preserved) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (auto it = m_analyses.begin(); it != m_analyses.end();) {
+    if (preserved.preserves(it->first)) {
+      ++it;
+    } else {
+      it = m_analyses.erase(it);
+    }
+  }
+}
+
+size_t AnalysisRegistry::size() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_analyses.size();
+}
+
+size_t AnalysisRegistry::num_builds() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_num_builds;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexClass.h"
+#include "DexStore.h"
+
+/*
+ * How the AnalysisRegistry computes an analysis of type `Analysis`. By
+ * default, the analysis is constructed from the scope of all the stores.
+ * Analyses that are built differently specialize this next to their
+ * declaration.
+ */
+template <typename Analysis>
+struct AnalysisBuilder {
+  static std::shared_ptr<const Analysis> build(const Scope& scope) {
+    return std::make_shared<const Analysis>(scope);
+  }
+};
+
+/*
+ * The cached analyses that a pass keeps valid, identified by their type.
+ */
+class PreservedAnalyses {
+ public:
+  static PreservedAnalyses all() {
+    PreservedAnalyses preserved;
+    preserved.m_all = true;
+    return preserved;
+  }
+
+  static PreservedAnalyses none() { return PreservedAnalyses(); }
+
+  template <typename Analysis>
+  PreservedAnalyses& preserve() {
+    m_preserved.emplace(typeid(Analysis));
+    return *this;
+  }
+
+  bool preserves(const std::type_index& analysis) const {
+    return m_all || m_preserved.count(analysis) > 0;
+  }
+
+  template <typename Analysis>
+  bool preserves() const {
+    return preserves(typeid(Analysis));
+  }
+
+ private:
+  bool m_all{false};
+  std::unordered_set<std::type_index> m_preserved;
+};
+
+/*
+ * A cache of whole-program analyses, such as the method override graph,
+ * shared by all the passes. An analysis is computed on first request and kept
+ * until a pass that does not preserve it has run.
+ *
+ * Requests are thread-safe. An analysis handed out stays alive for as long as
+ * the requester holds on to it, even once invalidated.
+ */
+class AnalysisRegistry {
+ public:
+  template <typename Analysis>
+  std::shared_ptr<const Analysis> get(const DexStoresVector& stores) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto& analysis = m_analyses[typeid(Analysis)];
+    if (analysis == nullptr) {
+      analysis = AnalysisBuilder<Analysis>::build(build_scope(stores));
+      ++m_num_builds;
+    }
+    return std::static_pointer_cast<const Analysis>(analysis);
+  }
+
+  // Drops the analyses that are not preserved.
+  void invalidate(const PreservedAnalyses& preserved);
+
+  // The number of analyses currently cached.
+  size_t size() const;
+
+  // The number of times any analysis was computed.
+  size_t num_builds() const;
+
+ private:
+  static Scope build_scope(const DexStoresVector& stores);
+
+  mutable std::mutex m_lock;
+  std::unordered_map<std::type_index, std::shared_ptr<const void>> m_analyses;
+  size_t m_num_builds{0};
+};
@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ApkRepack.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include "Debug.h"
+#include "Util.h"
+#include "WorkQueue.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+const uint16_t kCompMethodStored = 0;
+const uint16_t kCompMethodDeflate = 8;
+const uint16_t kFlagEncrypted = 1 << 0;
+const uint16_t kFlagDataDescriptor = 1 << 3;
+
+const uint32_t kLFileSignature = 0x04034b50;
+const uint32_t kCDFileSignature = 0x02014b50;
+const uint32_t kCDirEndSignature = 0x06054b50;
+
+// The end of central directory record is followed by a comment of at most
+// 64k.
+const size_t kMaxCDirEndSearch = 0xffff;
+
+const size_t kDefaultAlignment = 4;
+const size_t kPageAlignment = 4096;
+
+// "Made by" UNIX, version 2.0, and rw-r--r-- regular files.
+const uint16_t kVersionMadeBy = (3 << 8) | 20;
+const uint32_t kDefaultExternalAttr = 0100644u << 16;
+// 1980-01-01 00:00:00, the earliest DOS date, for new files. The mtime of
+// the extracted files isn't used so that the output is deterministic.
+const uint16_t kDefaultDosDate = (0 << 9) | (1 << 5) | 1;
+const uint16_t kDefaultDosTime = 0;
+
+PACKED(struct pk_lfile {
+  uint32_t signature;
+  uint16_t vextract;
+  uint16_t flags;
+  uint16_t comp_method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint16_t fname_len;
+  uint16_t extra_len;
+});
+
+PACKED(struct pk_cd_file {
+  uint32_t signature;
+  uint16_t vmade;
+  uint16_t vextract;
+  uint16_t flags;
+  uint16_t comp_method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint16_t fname_len;
+  uint16_t extra_len;
+  uint16_t comment_len;
+  uint16_t diskno;
+  uint16_t internal_attr;
+  uint32_t external_attr;
+  uint32_t disk_offset;
+});
+
+PACKED(struct pk_cdir_end {
+  uint32_t signature;
+  uint16_t diskno;
+  uint16_t cd_diskno;
+  uint16_t cd_disk_entries;
+  uint16_t cd_entries;
+  uint32_t cd_size;
+  uint32_t cd_disk_offset;
+  uint16_t comment_len;
+});
+
+struct ZipEntry {
+  std::string name;
+  pk_cd_file cd_entry;
+  // The compressed data, within the mapping of the archive.
+  const uint8_t* data;
+};
+
+/*
+ * A read-only view of the entries of a zip archive.
+ */
+class ZipArchive {
+ public:
+  explicit ZipArchive(const std::string& path) : m_path(path) {
+    try {
+      m_file.open(path);
+    } catch (const std::exception& e) {
+      always_assert_log(false, "Cannot open %s: %s", path.c_str(), e.what());
+    }
+    read_central_directory();
+  }
+
+  const std::vector<ZipEntry>& entries() const { return m_entries; }
+
+ private:
+  const uint8_t* begin() const {
+    return reinterpret_cast<const uint8_t*>(m_file.data());
+  }
+
+  void read_central_directory() {
+    auto size = m_file.size();
+    always_assert_log(size >= sizeof(pk_cdir_end), "%s is not a zip file",
+                      m_path.c_str());
+    size_t end_offset = size - sizeof(pk_cdir_end);
+    size_t search_end =
+        end_offset > kMaxCDirEndSearch ? end_offset - kMaxCDirEndSearch : 0;
+    pk_cdir_end pce;
+    bool found = false;
+    for (size_t offset = end_offset + 1; offset-- > search_end;) {
+      memcpy(&pce, begin() + offset, sizeof(pce));
+      if (pce.signature == kCDirEndSignature) {
+        found = true;
+        break;
+      }
+    }
+    always_assert_log(found, "%s: end of central directory not found",
+                      m_path.c_str());
+    always_assert_log(pce.diskno == 0 && pce.cd_diskno == 0 &&
+                          pce.cd_entries == pce.cd_disk_entries,
+                      "%s: disk spanning is not supported", m_path.c_str());
+    always_assert_log(
+        (size_t)pce.cd_disk_offset + pce.cd_size <= size,
+        "%s: central directory out of bounds", m_path.c_str());
+
+    const uint8_t* cdir = begin() + pce.cd_disk_offset;
+    const uint8_t* cdir_end = cdir + pce.cd_size;
+    m_entries.resize(pce.cd_entries);
+    for (auto& entry : m_entries) {
+      always_assert_log(cdir + sizeof(pk_cd_file) <= cdir_end,
+                        "%s: central directory overflow", m_path.c_str());
+      memcpy(&entry.cd_entry, cdir, sizeof(pk_cd_file));
+      const auto& cd = entry.cd_entry;
+      always_assert_log(cd.signature == kCDFileSignature,
+                        "%s: invalid central directory entry",
+                        m_path.c_str());
+      cdir += sizeof(pk_cd_file);
+      always_assert_log(cdir + cd.fname_len + cd.extra_len + cd.comment_len <=
+                            cdir_end,
+                        "%s: central directory overflow", m_path.c_str());
+      entry.name.assign(reinterpret_cast<const char*>(cdir), cd.fname_len);
+      cdir += cd.fname_len + cd.extra_len + cd.comment_len;
+      entry.data = local_data(entry);
+    }
+  }
+
+  const uint8_t* local_data(const ZipEntry& entry) const {
+    const auto& cd = entry.cd_entry;
+    always_assert_log(!(cd.flags & kFlagEncrypted),
+                      "%s: encrypted entry %s is not supported",
+                      m_path.c_str(), entry.name.c_str());
+    always_assert_log(cd.comp_method == kCompMethodStored ||
+                          cd.comp_method == kCompMethodDeflate,
+                      "%s: unknown compression method %d for %s",
+                      m_path.c_str(), cd.comp_method, entry.name.c_str());
+    always_assert_log(
+        (size_t)cd.disk_offset + sizeof(pk_lfile) <= m_file.size(),
+        "%s: local header of %s out of bounds", m_path.c_str(),
+        entry.name.c_str());
+    pk_lfile pkf;
+    memcpy(&pkf, begin() + cd.disk_offset, sizeof(pk_lfile));
+    always_assert_log(pkf.signature == kLFileSignature,
+                      "%s: invalid local header for %s", m_path.c_str(),
+                      entry.name.c_str());
+    // The sizes in the local header may be zero when they're given by a data
+    // descriptor instead, so only trust those of the central directory.
+    size_t data_offset = (size_t)cd.disk_offset + sizeof(pk_lfile) +
+                         pkf.fname_len + pkf.extra_len;
+    always_assert_log(data_offset + cd.comp_size <= m_file.size(),
+                      "%s: data of %s out of bounds", m_path.c_str(),
+                      entry.name.c_str());
+    return begin() + data_offset;
+  }
+
+  std::string m_path;
+  boost::iostreams::mapped_file_source m_file;
+  std::vector<ZipEntry> m_entries;
+};
+
+void check_entry_name(const std::string& name) {
+  always_assert_log(!name.empty() && name[0] != '/',
+                    "Invalid entry name '%s'", name.c_str());
+  size_t begin = 0;
+  while (begin <= name.size()) {
+    auto end = name.find('/', begin);
+    if (end == std::string::npos) {
+      end = name.size();
+    }
+    always_assert_log(name.compare(begin, end - begin, "..") != 0,
+                      "Entry '%s' is outside of the archive", name.c_str());
+    begin = end + 1;
+  }
+}
+
+uint32_t compute_crc(const std::vector<uint8_t>& data) {
+  return crc32(crc32(0, nullptr, 0), data.data(), data.size());
+}
+
+std::vector<uint8_t> inflate_entry(const ZipEntry& entry) {
+  const auto& cd = entry.cd_entry;
+  if (cd.comp_method == kCompMethodStored) {
+    return std::vector<uint8_t>(entry.data, entry.data + cd.comp_size);
+  }
+  // zlib rejects a null output buffer, even for empty entries.
+  std::vector<uint8_t> result(std::max<size_t>(cd.ucomp_size, 1));
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.next_in = const_cast<Bytef*>(entry.data);
+  stream.avail_in = cd.comp_size;
+  stream.next_out = result.data();
+  stream.avail_out = result.size();
+  always_assert(inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+  auto err = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+  always_assert_log(err == Z_STREAM_END && stream.total_out == cd.ucomp_size,
+                    "Cannot inflate %s: %d", entry.name.c_str(), err);
+  result.resize(cd.ucomp_size);
+  return result;
+}
+
+std::vector<uint8_t> deflate_data(const std::vector<uint8_t>& data,
+                                  int level) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  always_assert(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                             Z_DEFAULT_STRATEGY) == Z_OK);
+  std::vector<uint8_t> result(deflateBound(&stream, data.size()));
+  stream.next_in = const_cast<Bytef*>(data.data());
+  stream.avail_in = data.size();
+  stream.next_out = result.data();
+  stream.avail_out = result.size();
+  auto err = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  always_assert_log(err == Z_STREAM_END, "deflate failed: %d", err);
+  result.resize(stream.total_out);
+  return result;
+}
+
+std::vector<uint8_t> read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  always_assert_log(in, "Cannot read %s", path.c_str());
+  std::vector<uint8_t> data(in.tellg());
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(data.data()), data.size());
+  always_assert_log(in, "Cannot read %s", path.c_str());
+  return data;
+}
+
+void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(data.data()), data.size());
+  always_assert_log(out, "Cannot write %s", path.c_str());
+}
+
+/*
+ * The archive paths of the regular files under `root`, in the order of a
+ * top-down walk that visits the files of a directory before its
+ * subdirectories, both sorted by name.
+ */
+void list_files(const fs::path& root,
+                const std::string& prefix,
+                std::vector<std::string>* files) {
+  std::vector<std::string> file_names;
+  std::vector<std::string> dir_names;
+  for (fs::directory_iterator it(root), end; it != end; ++it) {
+    auto name = it->path().filename().string();
+    if (fs::is_directory(it->status())) {
+      dir_names.push_back(name);
+    } else if (fs::is_regular_file(it->status())) {
+      file_names.push_back(name);
+    }
+  }
+  std::sort(file_names.begin(), file_names.end());
+  std::sort(dir_names.begin(), dir_names.end());
+  for (const auto& name : file_names) {
+    files->push_back(prefix + name);
+  }
+  for (const auto& name : dir_names) {
+    list_files(root / name, prefix + name + "/", files);
+  }
+}
+
+bool ends_with(const std::string& str, const char* suffix) {
+  size_t len = strlen(suffix);
+  return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+/*
+ * A file of the directory, ready to be written out.
+ */
+struct OutputEntry {
+  std::string name;
+  const ZipEntry* original{nullptr};
+  // Whether the compressed data of the original entry can be reused.
+  bool copy{false};
+  uint16_t comp_method{kCompMethodDeflate};
+  uint32_t crc{0};
+  uint32_t ucomp_size{0};
+  std::vector<uint8_t> data;
+};
+
+class ApkWriter {
+ public:
+  ApkWriter(const std::string& path, const apk_repack::Options& options)
+      : m_path(path), m_options(options) {
+    m_out.open(path, std::ios::binary | std::ios::trunc);
+    always_assert_log(m_out, "Cannot write %s", path.c_str());
+  }
+
+  void add(const OutputEntry& entry) {
+    const uint8_t* data = entry.copy ? entry.original->data : entry.data.data();
+    size_t comp_size =
+        entry.copy ? entry.original->cd_entry.comp_size : entry.data.size();
+    always_assert_log(entry.name.size() <= 0xffff, "Name too long: %s",
+                      entry.name.c_str());
+    always_assert_log(m_offset + comp_size < 0xffffffffu,
+                      "Zip64 is not supported, %s is too large",
+                      m_path.c_str());
+
+    pk_cd_file cd;
+    memset(&cd, 0, sizeof(cd));
+    cd.signature = kCDFileSignature;
+    if (entry.original != nullptr) {
+      const auto& orig = entry.original->cd_entry;
+      cd.vmade = orig.vmade;
+      cd.flags = orig.flags & ~kFlagDataDescriptor;
+      cd.mod_time = orig.mod_time;
+      cd.mod_date = orig.mod_date;
+      cd.internal_attr = orig.internal_attr;
+      cd.external_attr = orig.external_attr;
+    } else {
+      cd.vmade = kVersionMadeBy;
+      cd.mod_time = kDefaultDosTime;
+      cd.mod_date = kDefaultDosDate;
+      cd.external_attr = kDefaultExternalAttr;
+    }
+    cd.vextract = entry.comp_method == kCompMethodDeflate ? 20 : 10;
+    cd.comp_method = entry.comp_method;
+    cd.crc32 = entry.crc;
+    cd.comp_size = comp_size;
+    cd.ucomp_size = entry.ucomp_size;
+    cd.fname_len = entry.name.size();
+    cd.disk_offset = m_offset;
+
+    size_t padding = 0;
+    if (entry.comp_method == kCompMethodStored) {
+      size_t alignment =
+          m_options.page_align_libs && ends_with(entry.name, ".so")
+              ? kPageAlignment
+              : kDefaultAlignment;
+      size_t data_offset = m_offset + sizeof(pk_lfile) + entry.name.size();
+      padding = (alignment - data_offset % alignment) % alignment;
+    }
+
+    pk_lfile pkf;
+    pkf.signature = kLFileSignature;
+    pkf.vextract = cd.vextract;
+    pkf.flags = cd.flags;
+    pkf.comp_method = cd.comp_method;
+    pkf.mod_time = cd.mod_time;
+    pkf.mod_date = cd.mod_date;
+    pkf.crc32 = cd.crc32;
+    pkf.comp_size = cd.comp_size;
+    pkf.ucomp_size = cd.ucomp_size;
+    pkf.fname_len = cd.fname_len;
+    pkf.extra_len = padding;
+
+    static const char zeros[kPageAlignment] = {};
+    write(&pkf, sizeof(pkf));
+    write(entry.name.data(), entry.name.size());
+    write(zeros, padding);
+    write(data, comp_size);
+    m_central_directory.emplace_back(cd, entry.name);
+  }
+
+  void finish() {
+    always_assert_log(m_central_directory.size() < 0xffff,
+                      "Zip64 is not supported, %s has too many entries",
+                      m_path.c_str());
+    size_t cd_offset = m_offset;
+    for (const auto& pair : m_central_directory) {
+      write(&pair.first, sizeof(pk_cd_file));
+      write(pair.second.data(), pair.second.size());
+    }
+    always_assert_log(m_offset < 0xffffffffu,
+                      "Zip64 is not supported, %s is too large",
+                      m_path.c_str());
+    pk_cdir_end pce;
+    memset(&pce, 0, sizeof(pce));
+    pce.signature = kCDirEndSignature;
+    pce.cd_disk_entries = m_central_directory.size();
+    pce.cd_entries = m_central_directory.size();
+    pce.cd_size = m_offset - cd_offset;
+    pce.cd_disk_offset = cd_offset;
+    write(&pce, sizeof(pce));
+    m_out.close();
+    always_assert_log(m_out, "Cannot write %s", m_path.c_str());
+  }
+
+ private:
+  void write(const void* data, size_t size) {
+    m_out.write(reinterpret_cast<const char*>(data), size);
+    m_offset += size;
+  }
+
+  std::string m_path;
+  const apk_repack::Options& m_options;
+  std::ofstream m_out;
+  size_t m_offset{0};
+  std::vector<std::pair<pk_cd_file, std::string>> m_central_directory;
+};
+
+void prepare_entry(const std::string& directory,
+                   int compression_level,
+                   OutputEntry* entry) {
+  auto contents = read_file((fs::path(directory) / entry->name).string());
+  always_assert_log(contents.size() < 0xffffffffu,
+                    "Zip64 is not supported, %s is too large",
+                    entry->name.c_str());
+  entry->crc = compute_crc(contents);
+  entry->ucomp_size = contents.size();
+  if (entry->original != nullptr) {
+    const auto& orig = entry->original->cd_entry;
+    entry->comp_method = orig.comp_method;
+    if (orig.ucomp_size == entry->ucomp_size && orig.crc32 == entry->crc) {
+      entry->copy = true;
+      return;
+    }
+  }
+  if (entry->comp_method == kCompMethodStored) {
+    entry->data = std::move(contents);
+  } else {
+    entry->data = deflate_data(contents, compression_level);
+  }
+}
+
+} // namespace
+
+namespace apk_repack {
+
+void unpack(const std::string& apk, const std::string& directory) {
+  ZipArchive archive(apk);
+  const auto& entries = archive.entries();
+  fs::path root(directory);
+
+  // Create the directories up front, so that the entries can be written out
+  // in parallel.
+  std::vector<const ZipEntry*> files;
+  for (const auto& entry : entries) {
+    check_entry_name(entry.name);
+    auto path = root / entry.name;
+    if (entry.name.back() == '/') {
+      fs::create_directories(path);
+      continue;
+    }
+    fs::create_directories(path.parent_path());
+    files.push_back(&entry);
+  }
+
+  redex_parallel::parallel_for(0, files.size(), [&](size_t i) {
+    const auto& entry = *files[i];
+    auto contents = inflate_entry(entry);
+    always_assert_log(compute_crc(contents) == entry.cd_entry.crc32,
+                      "CRC mismatch for %s in %s", entry.name.c_str(),
+                      apk.c_str());
+    write_file((root / entry.name).string(), contents);
+  });
+}
+
+Stats repack(const std::string& original_apk,
+             const std::string& directory,
+             const std::string& output_apk,
+             const Options& options) {
+  always_assert(options.window_size > 0);
+  std::unique_ptr<ZipArchive> original;
+  std::unordered_map<std::string, const ZipEntry*> original_entries;
+  if (!original_apk.empty()) {
+    original = std::make_unique<ZipArchive>(original_apk);
+    for (const auto& entry : original->entries()) {
+      original_entries.emplace(entry.name, &entry);
+    }
+  }
+
+  std::vector<std::string> names;
+  list_files(fs::path(directory), "", &names);
+
+  Stats stats;
+  ApkWriter writer(output_apk, options);
+  std::vector<OutputEntry> window;
+  for (size_t begin = 0; begin < names.size();
+       begin += options.window_size) {
+    size_t end = std::min(names.size(), begin + options.window_size);
+    window.clear();
+    window.resize(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      auto& entry = window[i - begin];
+      entry.name = names[i];
+      auto it = original_entries.find(entry.name);
+      if (it != original_entries.end()) {
+        entry.original = it->second;
+      }
+    }
+    redex_parallel::parallel_for(0, window.size(), [&](size_t i) {
+      prepare_entry(directory, options.compression_level, &window[i]);
+    });
+    for (const auto& entry : window) {
+      writer.add(entry);
+      if (entry.copy) {
+        ++stats.copied;
+      } else if (entry.comp_method == kCompMethodStored) {
+        ++stats.stored;
+      } else {
+        ++stats.compressed;
+      }
+    }
+  }
+  writer.finish();
+  return stats;
+}
+
+} // namespace apk_repack
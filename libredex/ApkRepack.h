@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <zlib.h>
+
+/*
+ * Native replacement for the zipfile + zipalign steps of redex.py.
+ *
+ * unpack() extracts every entry of an APK into a directory, inflating the
+ * entries on parallel threads.
+ *
+ * repack() builds an aligned APK out of such a directory in a single pass.
+ * Files that still match the entry of the same name in the original APK
+ * (same size and CRC) have their compressed bytes copied as-is, without
+ * being inflated or deflated again. The other files are compressed on
+ * parallel threads, with the compression method of their original entry, or
+ * deflate for new files. Stored entries are aligned the way `zipalign 4` (or
+ * `zipalign -p 4` with page_align_libs) would align them, so the output
+ * doesn't need to go through zipalign unless it is signed with jarsigner
+ * afterwards.
+ *
+ * Entries are written in the order in which redex.py used to add them: the
+ * files of a directory sorted by name, followed by its subdirectories sorted
+ * by name. Zip64 and encrypted entries are not supported.
+ */
+namespace apk_repack {
+
+struct Options {
+  // Align stored .so files to pages, like `zipalign -p`.
+  bool page_align_libs{false};
+  int compression_level{Z_DEFAULT_COMPRESSION};
+  // The most entries that are compressed before they are written out, which
+  // bounds the memory held by compressed data.
+  size_t window_size{64};
+};
+
+struct Stats {
+  size_t copied{0};
+  size_t compressed{0};
+  size_t stored{0};
+};
+
+void unpack(const std::string& apk, const std::string& directory);
+
+/*
+ * `original_apk` may be empty, in which case every file is compressed.
+ */
+Stats repack(const std::string& original_apk,
+             const std::string& directory,
+             const std::string& output_apk,
+             const Options& options = Options());
+
+} // namespace apk_repack
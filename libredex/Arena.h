@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+#include "Thread.h"
+
+/*
+ * A bump-pointer allocator for objects that all live until the arena itself is
+ * destroyed. Allocations are carved out of large blocks, so that objects
+ * created together end up next to each other in memory, and releasing the
+ * arena frees a handful of blocks instead of every object individually.
+ *
+ * The arena never runs destructors; owners of non-trivially destructible
+ * objects have to do that themselves before the arena goes away.
+ *
+ * Not thread-safe; see ConcurrentArena.
+ */
+class Arena {
+ public:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t alignment) {
+    always_assert(alignment <= alignof(std::max_align_t) &&
+                  (alignment & (alignment - 1)) == 0);
+    auto cur = align_up(m_cur, alignment);
+    if (m_cur == nullptr || cur > m_end ||
+        size > static_cast<size_t>(m_end - cur)) {
+      if (size > kBlockSize / 4) {
+        // Large allocations get a block of their own, so that they don't waste
+        // the remainder of the current one.
+        return new_block(size);
+      }
+      m_cur = new_block(kBlockSize);
+      m_end = m_cur + kBlockSize;
+      cur = m_cur;
+    }
+    m_cur = cur + size;
+    m_bytes_allocated += size;
+    return cur;
+  }
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Total size of all allocations handed out, excluding padding.
+  size_t bytes_allocated() const { return m_bytes_allocated; }
+
+  // Total size of all blocks obtained from the system allocator.
+  size_t bytes_reserved() const { return m_bytes_reserved; }
+
+  size_t num_blocks() const { return m_blocks.size(); }
+
+ private:
+  static char* align_up(char* p, size_t alignment) {
+    auto addr = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((addr + alignment - 1) & ~(alignment - 1));
+  }
+
+  char* new_block(size_t size) {
+    m_blocks.emplace_back(new char[size]);
+    m_bytes_reserved += size;
+    return m_blocks.back().get();
+  }
+
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  char* m_cur{nullptr};
+  char* m_end{nullptr};
+  size_t m_bytes_allocated{0};
+  size_t m_bytes_reserved{0};
+};
+
+/*
+ * A thread-safe Arena. Allocation requests are spread over a number of
+ * individually-locked sub-arenas, with each thread sticking to one of them, so
+ * that threads allocating at the same time rarely contend on a lock.
+ */
+template <size_t n_shards = 16>
+class ConcurrentArena {
+ public:
+  void* allocate(size_t size, size_t alignment) {
+    auto& shard = m_shards[shard_index()];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    return shard.arena.allocate(size, alignment);
+  }
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Not thread-safe with respect to concurrent allocations.
+  size_t bytes_allocated() const {
+    size_t result = 0;
+    for (const auto& shard : m_shards) {
+      result += shard.arena.bytes_allocated();
+    }
+    return result;
+  }
+
+  // Not thread-safe with respect to concurrent allocations.
+  size_t bytes_reserved() const {
+    size_t result = 0;
+    for (const auto& shard : m_shards) {
+      result += shard.arena.bytes_reserved();
+    }
+    return result;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    Arena arena;
+    // Keeps neighbouring shards' locks off this shard's cache lines, without
+    // requiring over-aligned allocations of the enclosing object.
+    char padding[CACHE_LINE_SIZE];
+  };
+
+  // Threads are assigned to shards round-robin, the first time they allocate.
+  static size_t shard_index() {
+    static std::atomic<size_t> s_next_index{0};
+    static thread_local size_t s_index =
+        s_next_index.fetch_add(1, std::memory_order_relaxed) % n_shards;
+    return s_index;
+  }
+
+  Shard m_shards[n_shards];
+};
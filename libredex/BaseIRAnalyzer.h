@@ -18,6 +18,12 @@ namespace ir_analyzer {
 // holds the second component of the result.
 constexpr reg_t RESULT_REGISTER = std::numeric_limits<reg_t>::max() - 1;
 
+// Methods with at least this many blocks are analyzed concurrently by the
+// analyzers whose transformers are thread-safe, see
+// MonotonicFixpointIterator::set_parallel_threshold(). A few generated methods
+// of that size would otherwise dominate the tail of whole-program analyses.
+constexpr size_t kParallelAnalysisMinBlocks = 10000;
+
 template <typename Domain>
 class BaseIRAnalyzer
     : public sparta::MonotonicFixpointIterator<cfg::GraphInterface, Domain> {
@@ -26,7 +32,7 @@ class BaseIRAnalyzer
 
   explicit BaseIRAnalyzer(const cfg::ControlFlowGraph& cfg)
       : sparta::MonotonicFixpointIterator<cfg::GraphInterface, Domain>(
-            cfg, cfg.blocks().size()) {}
+            cfg, cfg.num_blocks()) {}
 
   void analyze_node(const NodeId& node, Domain* current_state) const override {
     for (auto& mie : InstructionIterable(node)) {
@@ -54,7 +60,7 @@ class BaseBackwardsIRAnalyzer
   explicit BaseBackwardsIRAnalyzer(const cfg::ControlFlowGraph& cfg)
       : sparta::MonotonicFixpointIterator<
             sparta::BackwardsFixpointIterationAdaptor<cfg::GraphInterface>,
-            Domain>(cfg, cfg.blocks().size()) {}
+            Domain>(cfg, cfg.num_blocks()) {}
 
   void analyze_node(const NodeId& node, Domain* current_state) const override {
     for (auto it = node->rbegin(); it != node->rend(); ++it) {
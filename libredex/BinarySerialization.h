@@ -5,11 +5,12 @@
  * LICENSE file in the root directory of this source tree.
  */
 
-#include <boost/bimap/bimap.hpp>
-#include <boost/bimap/unordered_set_of.hpp>
+#include <functional>
 #include <limits>
 #include <ostream>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "Debug.h"
 
@@ -55,18 +56,13 @@ inline void write_header(std::ostream& os, uint32_t version) {
  *   <serialized label for node><E1><E2>...<Em>
  *
  * The node on line n has ID n. E1 ... Em are the IDs of its neighbors.
+ *
+ * The nodes get their IDs in depth-first preorder from the given nodes. The
+ * successors of each node are computed once, and the traversal uses an
+ * explicit stack, so that large graphs with long chains can be written too.
  */
 template <class Node, class NodeHash = std::hash<Node>>
 class GraphWriter {
-
-  struct Id {};
-
-  using NodeIdBiMap = boost::bimaps::bimap<
-      boost::bimaps::unordered_set_of<boost::bimaps::tagged<Node, Node>,
-                                      NodeHash>,
-      boost::bimaps::unordered_set_of<boost::bimaps::tagged<uint32_t, Id>>>;
-
-  using NodeIdPair = typename NodeIdBiMap::value_type;
   using SuccessorFunction = std::function<std::vector<Node>(const Node&)>;
   using NodeWriter = std::function<void(std::ostream&, const Node&)>;
 
@@ -81,34 +77,63 @@ class GraphWriter {
   void write(std::ostream& os, const NodeContainer& nodes) {
     // Give each node a unique ID.
     for (const auto& node : nodes) {
-      number_node_recursive(node);
+      number_nodes_from(node);
     }
     // Emit the node label and adjacency list.
-    uint32_t nodes_count = m_node_ids.size();
+    uint32_t nodes_count = m_nodes.size();
     binary_serialization::write(os, nodes_count);
     for (uint32_t i = 0; i < nodes_count; ++i) {
-      const auto& node = m_node_ids.template by<Id>().at(i);
-      m_node_writer(os, node);
-      std::vector<uint32_t> succ_ids;
-      for (const auto& succ : m_successors(node)) {
-        succ_ids.emplace_back(m_node_ids.template by<Node>().at(succ));
-      }
-      write_array(os, succ_ids);
+      m_node_writer(os, m_nodes[i]);
+      write_array(os, m_succ_ids[i]);
     }
   }
 
  private:
-  void number_node_recursive(const Node& node) {
-    if (m_node_ids.template by<Node>().count(node)) {
+  // Returns whether the node was numbered just now.
+  bool number_node(const Node& node) {
+    always_assert(m_nodes.size() < std::numeric_limits<uint32_t>::max());
+    if (!m_node_ids.emplace(node, m_nodes.size()).second) {
+      return false;
+    }
+    m_nodes.push_back(node);
+    m_succ_ids.emplace_back();
+    return true;
+  }
+
+  void number_nodes_from(const Node& root) {
+    struct Frame {
+      uint32_t id;
+      std::vector<Node> succs;
+      size_t next_succ;
+    };
+    if (!number_node(root)) {
       return;
     }
-    m_node_ids.insert(NodeIdPair(node, m_node_ids.size()));
-    for (const auto& succ : m_successors(node)) {
-      number_node_recursive(succ);
+    std::vector<Frame> stack;
+    stack.push_back(Frame{m_node_ids.at(root), m_successors(root), 0});
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      if (frame.next_succ < frame.succs.size()) {
+        const auto& succ = frame.succs[frame.next_succ++];
+        if (number_node(succ)) {
+          uint32_t id = m_nodes.size() - 1;
+          stack.push_back(Frame{id, m_successors(succ), 0});
+        }
+        continue;
+      }
+      // All the successors have their IDs by now.
+      auto& succ_ids = m_succ_ids[frame.id];
+      succ_ids.reserve(frame.succs.size());
+      for (const auto& succ : frame.succs) {
+        succ_ids.push_back(m_node_ids.at(succ));
+      }
+      stack.pop_back();
     }
   }
 
-  NodeIdBiMap m_node_ids;
+  std::unordered_map<Node, uint32_t, NodeHash> m_node_ids;
+  std::vector<Node> m_nodes;
+  std::vector<std::vector<uint32_t>> m_succ_ids;
   NodeWriter m_node_writer;
   SuccessorFunction m_successors;
 };
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BlockProfiles.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Trace.h"
+
+namespace block_profiles {
+
+bool BlockProfiles::initialize(const std::string& csv_filename) {
+  m_initialized = true;
+  std::ifstream in(csv_filename);
+  if (!in) {
+    std::cerr << "FAILED to open " << csv_filename << "\n";
+    return false;
+  }
+  return parse(in);
+}
+
+bool BlockProfiles::parse(std::istream& in) {
+  m_initialized = true;
+  std::string line;
+  if (!std::getline(in, line) || line != "name,num_opcodes,block_counts") {
+    std::cerr << "Unexpected block profile header: " << line << "\n";
+    return false;
+  }
+  size_t unresolved = 0;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto name_end = line.find(',');
+    auto opcodes_end =
+        name_end == std::string::npos ? name_end : line.find(',', name_end + 1);
+    if (opcodes_end == std::string::npos) {
+      std::cerr << "FAILED to parse block profile line: " << line << "\n";
+      m_method_blocks.clear();
+      return false;
+    }
+    MethodBlocks blocks;
+    std::istringstream cells(line.substr(name_end + 1));
+    char comma = 0;
+    uint64_t count;
+    cells >> blocks.num_opcodes >> comma;
+    while (cells >> count) {
+      blocks.counts.push_back(count);
+    }
+    if (comma != ',' || !cells.eof()) {
+      std::cerr << "FAILED to parse block profile line: " << line << "\n";
+      m_method_blocks.clear();
+      return false;
+    }
+    auto ref = DexMethod::get_method(line.substr(0, name_end));
+    if (ref == nullptr) {
+      TRACE(BBPROFILE, 4, "failed to resolve %s",
+            line.substr(0, name_end).c_str());
+      ++unresolved;
+      continue;
+    }
+    m_method_blocks[ref] = std::move(blocks);
+  }
+  TRACE(BBPROFILE, 1,
+        "Read block profiles of %zu methods, %zu methods were not found",
+        m_method_blocks.size(), unresolved);
+  return true;
+}
+
+} // namespace block_profiles
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+
+namespace block_profiles {
+
+/*
+ * The execution counts of the blocks of a method, in ascending order of the
+ * ids of the blocks of the editable CFG that was built from its code when the
+ * profile was taken. Simplifying the CFG leaves gaps in the ids, so the i-th
+ * count goes with the i-th block rather than with block i. The number of
+ * opcodes of the code then tells whether the method changed since, which
+ * would make the counts meaningless.
+ */
+struct MethodBlocks {
+  uint32_t num_opcodes{0};
+  std::vector<uint64_t> counts;
+};
+
+/*
+ * Basic-block profiles are csv files of the form
+ *
+ *   name,num_opcodes,block_counts
+ *   Lcom/foo/Bar;.baz:(I)V,42,1000 998 2 0
+ *
+ * where the counts are separated by spaces, and may only be 0 or 1 for a
+ * coverage profile.
+ */
+class BlockProfiles {
+ public:
+  bool initialize(const std::string& csv_filename);
+
+  // Exposed for testing.
+  bool parse(std::istream& in);
+
+  bool is_initialized() const { return m_initialized; }
+
+  bool has_stats() const { return !m_method_blocks.empty(); }
+
+  // The counts of the method, or null if there are none.
+  const MethodBlocks* get(const DexMethodRef* method) const {
+    auto it = m_method_blocks.find(method);
+    return it == m_method_blocks.end() ? nullptr : &it->second;
+  }
+
+ private:
+  std::unordered_map<const DexMethodRef*, MethodBlocks> m_method_blocks;
+  bool m_initialized{false};
+};
+
+} // namespace block_profiles
@@ -15,9 +15,23 @@ void CFGMutation::clear() {
   }
 
   m_changes.clear();
+  m_retargets.clear();
 }
 
 void CFGMutation::flush() {
+  bool retargeted = !m_retargets.empty();
+  for (const auto& pair : m_retargets) {
+    m_cfg.set_edge_target(pair.first, pair.second);
+  }
+  m_retargets.clear();
+
+  if (m_changes.empty()) {
+    if (retargeted) {
+      m_cfg.remove_unreachable_blocks();
+    }
+    return;
+  }
+
   auto ii = InstructionIterable(m_cfg);
   for (auto it = ii.begin(); !it.is_end();) {
     auto c = m_changes.find(it->insn);
@@ -32,12 +46,21 @@ void CFGMutation::flush() {
     // The anchor can be encountered again.  Erase the change to avoid it being
     // applied again.
     m_changes.erase(c);
+    if (m_changes.empty()) {
+      // Nothing left to apply, no need to walk the rest of the CFG.
+      break;
+    }
   }
 
   // The effect of one change can erase the anchor for another.  The changes
   // left behind are the ones whose anchors were removed. They will never be
   // applied so clear them.
   clear();
+
+  // Clean up once for all the retargets, rather than after each of them.
+  if (retargeted) {
+    m_cfg.remove_unreachable_blocks();
+  }
 }
 
 void CFGMutation::ChangeSet::apply(ControlFlowGraph& cfg,
@@ -15,10 +15,11 @@
 
 namespace cfg {
 
-/// Gathers requests to insert \c IRInstructions into a \c ControlFlowGraph that
-/// can be flushed out in batches.  This offers an alternative to modifying the
-/// IR in a CFG whilst iterating over its instructions which is not supported in
-/// general as a modification to the IR could invalidate the iterator.
+/// Gathers requests to insert \c IRInstructions into a \c ControlFlowGraph, or
+/// to retarget its edges, that can be flushed out in batches.  This offers an
+/// alternative to modifying the IR in a CFG whilst iterating over its
+/// instructions which is not supported in general as a modification to the IR
+/// could invalidate the iterator.
 ///
 /// TODO(T59235117) Flush mutation in the destructor.
 class CFGMutation {
@@ -94,12 +95,21 @@ class CFGMutation {
   ///  - It's not possible to have two remove instructions for a single anchor.
   void remove(const cfg::InstructionIterator& anchor);
 
+  /// Make \p edge go to \p new_target instead.
+  /// Retargets are applied before the changes to the instructions, so \p edge
+  /// must still be in the CFG at the time of the flush, and the changes to the
+  /// instructions must not remove it (e.g. by replacing its branch).
+  /// Blocks that are unreachable once all the edges are retargeted are removed
+  /// at the end of the flush.
+  void retarget(Edge* edge, Block* new_target);
+
   /// Remove all pending changes without applying them.
   void clear();
 
   /// Apply all the changes that have been added since the last flush or clear
-  /// (or since the mutation was created).  Changes are applied in the order
-  /// they are added to the mutation.
+  /// (or since the mutation was created), in a single walk over the
+  /// instructions of the CFG.  Changes anchored at the same instruction are
+  /// applied in the order they are added to the mutation.
   void flush();
 
  private:
@@ -134,6 +144,7 @@ class CFGMutation {
 
   cfg::ControlFlowGraph& m_cfg;
   std::unordered_map<IRInstruction*, ChangeSet> m_changes;
+  std::vector<std::pair<Edge*, Block*>> m_retargets;
 };
 
 inline CFGMutation::CFGMutation(cfg::ControlFlowGraph& cfg) : m_cfg(cfg) {}
@@ -185,6 +196,11 @@ inline void CFGMutation::remove(const cfg::InstructionIterator& anchor) {
   m_changes[anchor->insn].add_change(ChangeSet::Insert::Replacing, {});
 }
 
+inline void CFGMutation::retarget(Edge* edge, Block* new_target) {
+  always_assert(edge != nullptr && new_target != nullptr);
+  m_retargets.emplace_back(edge, new_target);
+}
+
 inline bool CFGMutation::is_terminal(IROpcode op) {
   return is_branch(op) || is_throw(op) || is_return(op);
 }
@@ -7,6 +7,8 @@
 
 #include "CallGraph.h"
 
+#include <algorithm>
+
 #include "MethodOverrideGraph.h"
 #include "Walkers.h"
 
@@ -129,4 +131,51 @@ void Graph::add_edge(const DexMethod* caller,
   make_node(callee).m_predecessors.emplace_back(edge);
 }
 
+namespace {
+
+void erase_edge(Edges& edges, const Edge* edge) {
+  auto it = std::find_if(edges.begin(), edges.end(),
+                         [&](const auto& e) { return e.get() == edge; });
+  always_assert(it != edges.end());
+  edges.erase(it);
+}
+
+} // namespace
+
+bool Graph::remove_edge(const DexMethod* caller,
+                        const IRList::iterator& invoke_it) {
+  auto& callees = mutable_node(caller).m_successors;
+  auto it = std::find_if(callees.begin(), callees.end(), [&](const auto& e) {
+    return e->invoke_iterator() == invoke_it;
+  });
+  if (it == callees.end()) {
+    return false;
+  }
+  auto edge = *it;
+  callees.erase(it);
+  erase_edge(mutable_node(edge->callee()).m_predecessors, edge.get());
+  return true;
+}
+
+void Graph::remove_node(const DexMethod* m) {
+  always_assert(m != nullptr);
+  auto it = m_nodes.find(m);
+  if (it == m_nodes.end()) {
+    return;
+  }
+  const auto& node = it->second;
+  for (const auto& edge : node.m_predecessors) {
+    // The edges of recursive calls go away with the node itself.
+    if (edge->caller() != m) {
+      erase_edge(mutable_node(edge->caller()).m_successors, edge.get());
+    }
+  }
+  for (const auto& edge : node.m_successors) {
+    if (edge->callee() != m) {
+      erase_edge(mutable_node(edge->callee()).m_predecessors, edge.get());
+    }
+  }
+  m_nodes.erase(it);
+}
+
 } // namespace call_graph
@@ -121,13 +121,34 @@ class Graph final {
     return m_nodes.at(m);
   }
 
- private:
-  Node& make_node(const DexMethod*);
-
+  /*
+   * Edits, for the code that changes calls -- e.g. by inlining or deleting
+   * methods -- and would rather keep its graph up to date than build it
+   * again. The edges are shared with the analyses iterating over the graph,
+   * so it must not be edited while one is running.
+   */
   void add_edge(const DexMethod* caller,
                 const DexMethod* callee,
                 const IRList::iterator& invoke_it);
 
+  /*
+   * Removes the edge of the invoke at `invoke_it` in `caller`, and returns
+   * whether there was one.
+   */
+  bool remove_edge(const DexMethod* caller, const IRList::iterator& invoke_it);
+
+  /*
+   * Removes a method and all the edges from and to it.
+   */
+  void remove_node(const DexMethod* m);
+
+ private:
+  Node& make_node(const DexMethod*);
+
+  Node& mutable_node(const DexMethod* m) {
+    return m == nullptr ? m_entry : m_nodes.at(m);
+  }
+
   Node m_entry = Node(nullptr);
   std::unordered_map<const DexMethod*, Node, boost::hash<Node>> m_nodes;
 };
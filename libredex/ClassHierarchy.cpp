@@ -7,9 +7,12 @@
 
 #include "ClassHierarchy.h"
 
+#include <unordered_set>
+
 #include "DexUtil.h"
 #include "Resolver.h"
 #include "Timer.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -92,15 +95,14 @@ void gather_intf_extenders(const Scope& scope,
   }
 }
 
-void build_interface_map(InterfaceMap& interfaces,
-                         const ClassHierarchy& hierarchy,
-                         const DexClass* current,
-                         const TypeSet& implementors) {
+// The interfaces that `current` implements, including the ones they extend.
+void gather_interfaces(const DexClass* current,
+                       std::unordered_set<const DexType*>& intfs) {
   for (const auto& intf : current->get_interfaces()->get_type_list()) {
-    interfaces[intf].insert(implementors.begin(), implementors.end());
+    if (!intfs.insert(intf).second) continue;
     const auto intf_cls = type_class(intf);
     if (intf_cls == nullptr) continue;
-    build_interface_map(interfaces, hierarchy, intf_cls, implementors);
+    gather_interfaces(intf_cls, intfs);
   }
 }
 
@@ -118,17 +120,38 @@ ClassHierarchy build_type_hierarchy(const Scope& scope) {
 }
 
 InterfaceMap build_interface_map(const ClassHierarchy& hierarchy) {
-  InterfaceMap interfaces;
-  // build the type hierarchy
+  // The classes that declare each interface, directly or through the
+  // interfaces they implement. The implementors of an interface are these
+  // classes and all their children.
+  std::unordered_map<const DexType*, std::vector<const DexType*>> declarers;
   for (const auto& cls_it : hierarchy) {
     const auto cls = type_class(cls_it.first);
     if (cls == nullptr) continue;
     if (is_interface(cls)) continue;
-    TypeSet implementors;
-    get_all_children(hierarchy, cls->get_type(), implementors);
-    implementors.insert(cls->get_type());
-    build_interface_map(interfaces, hierarchy, cls, implementors);
+    std::unordered_set<const DexType*> intfs;
+    gather_interfaces(cls, intfs);
+    for (const auto& intf : intfs) {
+      declarers[intf].push_back(cls->get_type());
+    }
+  }
+
+  // Collecting the children of the declarers is the expensive part, and each
+  // interface gets its own set, so the interfaces are done in parallel.
+  InterfaceMap interfaces;
+  for (const auto& declarers_it : declarers) {
+    interfaces[declarers_it.first];
+  }
+  auto wq = workqueue_foreach<const DexType*>([&](const DexType* intf) {
+    auto& implementors = interfaces.at(intf);
+    for (const auto& cls : declarers.at(intf)) {
+      implementors.insert(cls);
+      get_all_children(hierarchy, cls, implementors);
+    }
+  });
+  for (const auto& declarers_it : declarers) {
+    wq.add_item(declarers_it.first);
   }
+  wq.run_all();
   return interfaces;
 }
 
@@ -7,23 +7,65 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <boost/thread.hpp>
 
 #include "Debug.h"
+#include "WorkQueue.h"
+
+/*
+ * Optional statistics about the slot locks of a concurrent container, for the
+ * operations that accept them. An operation counts as contended when the slot
+ * lock it needed was held by another thread at the time.
+ */
+struct ConcurrentContainerStats {
+  std::atomic<size_t> num_operations{0};
+  std::atomic<size_t> num_contended{0};
+  std::atomic<size_t> num_insertions{0};
+};
 
-// Forward declaration.
 namespace cc_impl {
 
-template <typename Container, size_t n_slots>
+// Forward declaration.
+template <typename Container>
 class ConcurrentContainerIterator;
 
+/*
+ * The number of slots of the containers that don't pick one: the smallest
+ * prime that is at least 31 and twice the default number of threads.
+ */
+inline size_t default_num_slots() {
+  static const size_t num_slots = []() {
+    size_t n = std::max<size_t>(31, 2 * redex_parallel::default_num_threads());
+    const auto is_prime = [](size_t x) {
+      for (size_t d = 2; d * d <= x; ++d) {
+        if (x % d == 0) {
+          return false;
+        }
+      }
+      return true;
+    };
+    while (!is_prime(n)) {
+      ++n;
+    }
+    return n;
+  }();
+  return num_slots;
+}
+
 } // namespace cc_impl
 
 /*
@@ -36,7 +78,8 @@ class ConcurrentContainerIterator;
  * reasonable performance in practice. A high number of slots may help reduce
  * thread contention at the expense of a larger memory footprint. It is advised
  * to use a prime number for `n_slots`, so as to ensure a more even spread of
- * elements across slots.
+ * elements across slots. When `n_slots` is 0, the default, the number of slots
+ * is scaled to the number of threads (see cc_impl::default_num_slots()).
  *
  * There are two major modes in which a concurrent container is thread-safe:
  *  - Read only: multiple threads access the contents of the container but do
@@ -49,12 +92,9 @@ class ConcurrentContainerIterator;
 template <typename Container, typename Key, typename Hash, size_t n_slots>
 class ConcurrentContainer {
  public:
-  static_assert(n_slots > 0, "The concurrent container has no slots");
-
-  using iterator = cc_impl::ConcurrentContainerIterator<Container, n_slots>;
+  using iterator = cc_impl::ConcurrentContainerIterator<Container>;
 
-  using const_iterator =
-      cc_impl::ConcurrentContainerIterator<const Container, n_slots>;
+  using const_iterator = cc_impl::ConcurrentContainerIterator<const Container>;
 
   virtual ~ConcurrentContainer() {}
 
@@ -63,57 +103,61 @@ class ConcurrentContainer {
    * modified will result in undefined behavior.
    */
 
-  iterator begin() { return iterator(&m_slots[0], 0, m_slots[0].begin()); }
+  iterator begin() {
+    return iterator(&m_slots[0], m_num_slots, 0, m_slots[0].begin());
+  }
 
-  iterator end() { return iterator(&m_slots[0]); }
+  iterator end() { return iterator(&m_slots[0], m_num_slots); }
 
   const_iterator begin() const {
-    return const_iterator(&m_slots[0], 0, m_slots[0].begin());
+    return const_iterator(&m_slots[0], m_num_slots, 0, m_slots[0].begin());
   }
 
-  const_iterator end() const { return const_iterator(&m_slots[0]); }
+  const_iterator end() const {
+    return const_iterator(&m_slots[0], m_num_slots);
+  }
 
   const_iterator cbegin() const { return begin(); }
 
   const_iterator cend() const { return end(); }
 
   iterator find(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = slot_of(key);
     const auto& it = m_slots[slot].find(key);
     if (it == m_slots[slot].end()) {
       return end();
     }
-    return iterator(&m_slots[0], slot, it);
+    return iterator(&m_slots[0], m_num_slots, slot, it);
   }
 
   const_iterator find(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = slot_of(key);
     const auto& it = m_slots[slot].find(key);
     if (it == m_slots[slot].end()) {
       return end();
     }
-    return const_iterator(&m_slots[0], slot, it);
+    return const_iterator(&m_slots[0], m_num_slots, slot, it);
   }
 
   size_t size() const {
     size_t s = 0;
-    for (size_t slot = 0; slot < n_slots; ++slot) {
+    for (size_t slot = 0; slot < m_num_slots; ++slot) {
       s += m_slots[slot].size();
     }
     return s;
   }
 
   void reserve(size_t capacity) {
-    size_t slot_capacity = capacity / n_slots;
+    size_t slot_capacity = capacity / m_num_slots;
     if (slot_capacity > 0) {
-      for (size_t i = 0; i < n_slots; ++i) {
+      for (size_t i = 0; i < m_num_slots; ++i) {
         m_slots[i].reserve(slot_capacity);
       }
     }
   }
 
   void clear() {
-    for (size_t slot = 0; slot < n_slots; ++slot) {
+    for (size_t slot = 0; slot < m_num_slots; ++slot) {
       m_slots[slot].clear();
     }
   }
@@ -122,13 +166,13 @@ class ConcurrentContainer {
    * This operation is always thread-safe.
    */
   size_t count(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = slot_of(key);
     boost::lock_guard<boost::mutex> lock(m_locks[slot]);
     return m_slots[slot].count(key);
   }
 
   size_t count_unsafe(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = slot_of(key);
     return m_slots[slot].count(key);
   }
 
@@ -136,7 +180,7 @@ class ConcurrentContainer {
    * This operation is always thread-safe.
    */
   size_t erase(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = slot_of(key);
     boost::lock_guard<boost::mutex> lock(m_locks[slot]);
     return m_slots[slot].erase(key);
   }
@@ -145,26 +189,75 @@ class ConcurrentContainer {
    * This operation is not thread-safe.
    */
   size_t bucket_size(size_t i) const {
-    always_assert(i < n_slots);
+    always_assert(i < m_num_slots);
     return m_slots[i].size();
   }
 
+  size_t slot_count() const { return m_num_slots; }
+
+  /*
+   * Calls `f` on every element, on up to `num_threads` threads. Each slot is
+   * visited by a single thread without taking its lock, so the container must
+   * not be modified concurrently, except by `f` modifying the elements it is
+   * given in place.
+   */
+  template <typename Fn>
+  void parallel_for_each(
+      const Fn& f,
+      size_t num_threads = redex_parallel::default_num_threads()) {
+    redex_parallel::parallel_for(
+        0, m_num_slots,
+        [&](size_t slot) {
+          for (auto& element : m_slots[slot]) {
+            f(element);
+          }
+        },
+        num_threads);
+  }
+
+  template <typename Fn>
+  void parallel_for_each(
+      const Fn& f,
+      size_t num_threads = redex_parallel::default_num_threads()) const {
+    redex_parallel::parallel_for(
+        0, m_num_slots,
+        [&](size_t slot) {
+          for (const auto& element : m_slots[slot]) {
+            f(element);
+          }
+        },
+        num_threads);
+  }
+
  protected:
   // Only derived classes may be instantiated or copied.
-  ConcurrentContainer() = default;
-
-  ConcurrentContainer(const ConcurrentContainer& container) {
-    for (size_t i = 0; i < n_slots; ++i) {
+  ConcurrentContainer()
+      : m_num_slots(n_slots > 0 ? n_slots : cc_impl::default_num_slots()),
+        m_locks(new boost::mutex[m_num_slots]),
+        m_slots(new Container[m_num_slots]) {}
+
+  ConcurrentContainer(const ConcurrentContainer& container)
+      : m_num_slots(container.m_num_slots),
+        m_locks(new boost::mutex[m_num_slots]),
+        m_slots(new Container[m_num_slots]) {
+    for (size_t i = 0; i < m_num_slots; ++i) {
       m_slots[i] = container.m_slots[i];
     }
   }
 
-  ConcurrentContainer(ConcurrentContainer&& container) noexcept {
-    for (size_t i = 0; i < n_slots; ++i) {
+  // The moved-from container keeps its (empty) slots, so that it remains
+  // usable.
+  ConcurrentContainer(ConcurrentContainer&& container) noexcept
+      : m_num_slots(container.m_num_slots),
+        m_locks(new boost::mutex[m_num_slots]),
+        m_slots(new Container[m_num_slots]) {
+    for (size_t i = 0; i < m_num_slots; ++i) {
       m_slots[i] = std::move(container.m_slots[i]);
     }
   }
 
+  size_t slot_of(const Key& key) const { return Hash()(key) % m_num_slots; }
+
   Container& get_container(size_t slot) { return m_slots[slot]; }
 
   const Container& get_container(size_t slot) const { return m_slots[slot]; }
@@ -172,15 +265,16 @@ class ConcurrentContainer {
   boost::mutex& get_lock(size_t slot) const { return m_locks[slot]; }
 
  private:
-  mutable boost::mutex m_locks[n_slots];
-  Container m_slots[n_slots];
+  const size_t m_num_slots;
+  std::unique_ptr<boost::mutex[]> m_locks;
+  std::unique_ptr<Container[]> m_slots;
 };
 
 template <typename MapContainer,
           typename Key,
           typename Value,
           typename Hash = std::hash<Key>,
-          size_t n_slots = 31>
+          size_t n_slots = 0>
 class ConcurrentMapContainer
     : public ConcurrentContainer<MapContainer, Key, Hash, n_slots> {
  public:
@@ -206,18 +300,18 @@ class ConcurrentMapContainer
    * `find()` or `at_unsafe()` to avoid the copy.
    */
   Value at(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     return this->get_container(slot).at(key);
   }
 
   const Value& at_unsafe(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     return this->get_container(slot).at(key);
   }
 
   Value get(const Key& key, Value default_value) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     const auto& map = this->get_container(slot);
     const auto& it = map.find(key);
@@ -237,7 +331,7 @@ class ConcurrentMapContainer
    * thread-safe.
    */
   bool insert(const std::pair<Key, Value>& entry) {
-    size_t slot = Hash()(entry.first) % n_slots;
+    size_t slot = this->slot_of(entry.first);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& map = this->get_container(slot);
     return map.insert(entry).second;
@@ -266,7 +360,7 @@ class ConcurrentMapContainer
    * This operation is always thread-safe.
    */
   void insert_or_assign(const std::pair<Key, Value>& entry) {
-    size_t slot = Hash()(entry.first) % n_slots;
+    size_t slot = this->slot_of(entry.first);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& map = this->get_container(slot);
     map[entry.first] = entry.second;
@@ -278,12 +372,49 @@ class ConcurrentMapContainer
   template <typename... Args>
   bool emplace(Args&&... args) {
     std::pair<Key, Value> entry(std::forward<Args>(args)...);
-    size_t slot = Hash()(entry.first) % n_slots;
+    size_t slot = this->slot_of(entry.first);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& map = this->get_container(slot);
     return map.emplace(std::move(entry)).second;
   }
 
+  /*
+   * Returns the value associated with `key`. If there is none yet,
+   * `make_entry()` is called to create the entry to insert; its key must be
+   * equal to `key` (it may be a different object, e.g. a pointer to a copy
+   * owned by the new value). The lookup and the insertion happen under a
+   * single acquisition of the slot lock, so `make_entry` is invoked at most
+   * once per key, and never needlessly. It must not access this container.
+   *
+   * This operation is always thread-safe.
+   */
+  template <typename MakeEntry>
+  Value get_or_emplace(const Key& key,
+                       const MakeEntry& make_entry,
+                       ConcurrentContainerStats* stats = nullptr) {
+    size_t slot = this->slot_of(key);
+    boost::unique_lock<boost::mutex> lock(this->get_lock(slot),
+                                          boost::defer_lock);
+    if (stats == nullptr) {
+      lock.lock();
+    } else {
+      stats->num_operations.fetch_add(1, std::memory_order_relaxed);
+      if (!lock.try_lock()) {
+        stats->num_contended.fetch_add(1, std::memory_order_relaxed);
+        lock.lock();
+      }
+    }
+    auto& map = this->get_container(slot);
+    auto it = map.find(key);
+    if (it != map.end()) {
+      return it->second;
+    }
+    if (stats != nullptr) {
+      stats->num_insertions.fetch_add(1, std::memory_order_relaxed);
+    }
+    return map.emplace(make_entry()).first->second;
+  }
+
   /*
    * This operation atomically modifies an entry in the map. If the entry
    * doesn't exist, it is created. The third argument of the updater function is
@@ -291,7 +422,7 @@ class ConcurrentMapContainer
    */
   void update(const Key& key,
               const std::function<void(const Key&, Value&, bool)>& updater) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& map = this->get_container(slot);
     auto it = map.find(key);
@@ -307,7 +438,7 @@ template <typename Key,
           typename Value,
           typename Hash = std::hash<Key>,
           typename Equal = std::equal_to<Key>,
-          size_t n_slots = 31>
+          size_t n_slots = 0>
 using ConcurrentMap =
     ConcurrentMapContainer<std::unordered_map<Key, Value, Hash, Equal>,
                            Key,
@@ -318,7 +449,7 @@ using ConcurrentMap =
 template <typename Key,
           typename Hash = std::hash<Key>,
           typename Equal = std::equal_to<Key>,
-          size_t n_slots = 31>
+          size_t n_slots = 0>
 class ConcurrentSet final
     : public ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
                                  Key,
@@ -344,7 +475,7 @@ class ConcurrentSet final
    * This operation is always thread-safe.
    */
   bool insert(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& set = this->get_container(slot);
     return set.insert(key).second;
@@ -365,16 +496,394 @@ class ConcurrentSet final
   template <typename... Args>
   bool emplace(Args&&... args) {
     Key key(std::forward<Args>(args)...);
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->slot_of(key);
     boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
     auto& set = this->get_container(slot);
     return set.emplace(std::move(key)).second;
   }
 };
 
+/*
+ * A concurrent hash map for workloads that mix lookups with insertions and
+ * updates, which ConcurrentMap only supports one at a time. All operations
+ * are thread-safe with respect to each other, except the ones documented
+ * otherwise:
+ *  - Lookups never lock. The map is an open-addressing table of atomic
+ *    pointers to entries with linear probing. The cells of a table only ever
+ *    go from empty to occupied, so a lookup sees either an entry or nothing.
+ *  - Insertions claim an empty cell with a compare-and-swap. Once the table
+ *    is half full, the inserting thread copies its entries into a table twice
+ *    as large. Insertions wait for the copy to finish; lookups don't, as they
+ *    can keep reading the old table, which is kept until the map is cleared.
+ *  - `update()` modifies a value in place under one of `n_locks` locks, picked
+ *    by the hash code of the key.
+ * Entries are constructed in segments that double in size instead of being
+ * allocated one by one, and never move. Pointers to values thus remain valid
+ * until the map is cleared or destroyed. Entries cannot be erased.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          size_t n_locks = 31>
+class ConcurrentHashMap final {
+  struct Entry;
+  struct Table;
+
+ public:
+  static_assert(n_locks > 0, "The concurrent hash map has no locks");
+
+  using value_type = std::pair<const Key, Value>;
+
+  class const_iterator;
+
+  explicit ConcurrentHashMap(size_t capacity = 0) { init(capacity); }
+
+  ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+
+  ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+  ~ConcurrentHashMap() { destroy(); }
+
+  size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+  bool empty() const { return size() == 0; }
+
+  /*
+   * Returns a pointer to the value associated with `key`, or nullptr. This
+   * operation never locks. Reading the value while another thread updates it
+   * is a data race; use `at()` for values that are updated concurrently.
+   */
+  const Value* get(const Key& key) const {
+    auto entry = find_entry(key);
+    return entry == nullptr ? nullptr : &entry->data.second;
+  }
+
+  /*
+   * This operation never locks.
+   */
+  size_t count(const Key& key) const { return find_entry(key) != nullptr; }
+
+  /*
+   * Returns a copy of the value associated with `key`, which is consistent
+   * with concurrent calls to `update()`.
+   */
+  Value at(const Key& key) const {
+    auto entry = find_entry(key);
+    if (entry == nullptr) {
+      throw std::out_of_range("ConcurrentHashMap::at");
+    }
+    boost::lock_guard<boost::mutex> lock(m_locks[entry->hash % n_locks]);
+    return entry->data.second;
+  }
+
+  /*
+   * Returns the value associated with the key of `entry` and whether the
+   * insertion took place.
+   */
+  std::pair<const Value*, bool> insert(const value_type& entry) {
+    return emplace(entry.first, entry.second);
+  }
+
+  /*
+   * Constructs the value from `args` if there is no value associated with
+   * `key` yet. Returns the value associated with `key` and whether the
+   * insertion took place.
+   */
+  template <typename... Args>
+  std::pair<const Value*, bool> emplace(const Key& key, Args&&... args) {
+    auto result = find_or_emplace(key, std::forward<Args>(args)...);
+    return {&result.first->data.second, result.second};
+  }
+
+  /*
+   * This operation atomically modifies an entry in the map. If the entry
+   * doesn't exist, it is created with a default-constructed value. The third
+   * argument of the updater function is a Boolean flag denoting whether the
+   * entry existed before. The updater must not access this map.
+   */
+  void update(const Key& key,
+              const std::function<void(const Key&, Value&, bool)>& updater) {
+    boost::lock_guard<boost::mutex> lock(m_locks[Hash()(key) % n_locks]);
+    auto result = find_or_emplace(key);
+    updater(result.first->data.first, result.first->data.second,
+            !result.second);
+  }
+
+  /*
+   * Iterating over the map while it is concurrently modified will result in
+   * undefined behavior.
+   */
+
+  const_iterator begin() const {
+    return const_iterator(m_table.load(std::memory_order_acquire), 0);
+  }
+
+  const_iterator end() const {
+    auto table = m_table.load(std::memory_order_acquire);
+    return const_iterator(table, table->mask + 1);
+  }
+
+  /*
+   * This operation is not thread-safe.
+   */
+  void clear() {
+    destroy();
+    init(0);
+  }
+
+  class const_iterator final {
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename ConcurrentHashMap::value_type;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+    using iterator_category = std::forward_iterator_tag;
+
+    const_iterator(const Table* table, size_t index)
+        : m_table(table), m_index(index) {
+      skip_empty_cells();
+    }
+
+    const_iterator& operator++() {
+      always_assert(m_index <= m_table->mask);
+      ++m_index;
+      skip_empty_cells();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return m_table == other.m_table && m_index == other.m_index;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+    reference operator*() const { return entry()->data; }
+
+    pointer operator->() const { return &entry()->data; }
+
+   private:
+    const Entry* entry() const {
+      always_assert(m_index <= m_table->mask);
+      return m_table->cells[m_index].load(std::memory_order_relaxed);
+    }
+
+    void skip_empty_cells() {
+      while (m_index <= m_table->mask &&
+             m_table->cells[m_index].load(std::memory_order_relaxed) ==
+                 nullptr) {
+        ++m_index;
+      }
+    }
+
+    const Table* m_table;
+    size_t m_index;
+  };
+
+ private:
+  struct Entry {
+    template <typename... Args>
+    Entry(size_t hash, const Key& key, Args&&... args)
+        : hash(hash),
+          data(std::piecewise_construct,
+               std::forward_as_tuple(key),
+               std::forward_as_tuple(std::forward<Args>(args)...)) {}
+
+    size_t hash;
+    value_type data;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1), cells(new std::atomic<Entry*>[capacity]) {
+      for (size_t i = 0; i < capacity; ++i) {
+        cells[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<Entry*>[]> cells;
+    // The table that replaced this one, set before its cells get frozen.
+    std::atomic<Table*> next{nullptr};
+  };
+
+  using EntryStorage =
+      typename std::aligned_storage<sizeof(Entry), alignof(Entry)>::type;
+
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr size_t kFirstSegmentSize = 64;
+  static constexpr size_t kMaxSegments = 48;
+
+  // Marks the empty cells of a table that is being replaced.
+  static Entry* frozen() { return reinterpret_cast<Entry*>(alignof(Entry)); }
+
+  void init(size_t capacity) {
+    size_t table_capacity = kMinCapacity;
+    while (table_capacity < 2 * capacity) {
+      table_capacity *= 2;
+    }
+    m_tables.emplace_back(new Table(table_capacity));
+    m_table.store(m_tables.back().get(), std::memory_order_release);
+    for (auto& segment : m_segments) {
+      segment.store(nullptr, std::memory_order_relaxed);
+    }
+    m_num_entries.store(0, std::memory_order_relaxed);
+    m_size.store(0, std::memory_order_relaxed);
+  }
+
+  void destroy() {
+    size_t num_entries = m_num_entries.load(std::memory_order_relaxed);
+    for (size_t segment = 0; segment < kMaxSegments; ++segment) {
+      auto storage = m_segments[segment].load(std::memory_order_relaxed);
+      if (storage == nullptr) {
+        continue;
+      }
+      size_t begin = kFirstSegmentSize * ((size_t(1) << segment) - 1);
+      size_t end = std::min(num_entries, 2 * begin + kFirstSegmentSize);
+      for (size_t i = begin; i < end; ++i) {
+        reinterpret_cast<Entry*>(&storage[i - begin])->~Entry();
+      }
+      delete[] storage;
+    }
+    m_tables.clear();
+  }
+
+  // Constructs an entry that no other thread can see yet.
+  template <typename... Args>
+  Entry* allocate_entry(size_t hash, const Key& key, Args&&... args) {
+    size_t index = m_num_entries.fetch_add(1, std::memory_order_relaxed);
+    // Segment `s` holds the entries from kFirstSegmentSize * (2^s - 1) on.
+    size_t segment = 0;
+    while (index >= kFirstSegmentSize * ((size_t(2) << segment) - 1)) {
+      ++segment;
+    }
+    always_assert(segment < kMaxSegments);
+    auto storage = m_segments[segment].load(std::memory_order_acquire);
+    if (storage == nullptr) {
+      auto fresh = new EntryStorage[kFirstSegmentSize << segment];
+      if (m_segments[segment].compare_exchange_strong(
+              storage, fresh, std::memory_order_acq_rel)) {
+        storage = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    auto offset = index - kFirstSegmentSize * ((size_t(1) << segment) - 1);
+    return new (&storage[offset])
+        Entry(hash, key, std::forward<Args>(args)...);
+  }
+
+  Entry* find_entry(const Key& key) const {
+    size_t hash = Hash()(key);
+    for (auto table = m_table.load(std::memory_order_acquire);
+         table != nullptr;
+         table = table->next.load(std::memory_order_acquire)) {
+      for (size_t probes = 0, i = hash & table->mask; probes <= table->mask;
+           ++probes, i = (i + 1) & table->mask) {
+        auto entry = table->cells[i].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+          return nullptr;
+        }
+        if (entry == frozen()) {
+          // Keys inserted since then are in the next table.
+          break;
+        }
+        if (entry->hash == hash && Equal()(entry->data.first, key)) {
+          return entry;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename... Args>
+  std::pair<Entry*, bool> find_or_emplace(const Key& key, Args&&... args) {
+    size_t hash = Hash()(key);
+    // Only used if the key is found missing, and wasted if another thread
+    // inserts it first.
+    Entry* fresh = nullptr;
+    while (true) {
+      auto table = m_table.load(std::memory_order_acquire);
+      bool is_frozen = false;
+      for (size_t probes = 0, i = hash & table->mask; probes <= table->mask;
+           ++probes, i = (i + 1) & table->mask) {
+        auto& cell = table->cells[i];
+        auto entry = cell.load(std::memory_order_acquire);
+        if (entry == nullptr) {
+          if (fresh == nullptr) {
+            fresh = allocate_entry(hash, key, std::forward<Args>(args)...);
+          }
+          if (cell.compare_exchange_strong(
+                  entry, fresh, std::memory_order_acq_rel)) {
+            if (m_size.fetch_add(1, std::memory_order_relaxed) >=
+                (table->mask + 1) / 2) {
+              grow(table);
+            }
+            return {fresh, true};
+          }
+        }
+        if (entry == frozen()) {
+          is_frozen = true;
+          break;
+        }
+        if (entry->hash == hash && Equal()(entry->data.first, key)) {
+          return {entry, false};
+        }
+      }
+      if (is_frozen) {
+        // Wait for the thread that is growing the table.
+        boost::lock_guard<boost::mutex> lock(m_grow_lock);
+      } else {
+        grow(table);
+      }
+    }
+  }
+
+  void grow(Table* table) {
+    boost::lock_guard<boost::mutex> lock(m_grow_lock);
+    if (m_table.load(std::memory_order_relaxed) != table) {
+      return;
+    }
+    m_tables.emplace_back(new Table(2 * (table->mask + 1)));
+    auto bigger = m_tables.back().get();
+    table->next.store(bigger, std::memory_order_release);
+    for (size_t i = 0; i <= table->mask; ++i) {
+      Entry* entry = nullptr;
+      if (table->cells[i].compare_exchange_strong(
+              entry, frozen(), std::memory_order_acq_rel)) {
+        continue;
+      }
+      size_t j = entry->hash & bigger->mask;
+      while (bigger->cells[j].load(std::memory_order_relaxed) != nullptr) {
+        j = (j + 1) & bigger->mask;
+      }
+      bigger->cells[j].store(entry, std::memory_order_release);
+    }
+    m_table.store(bigger, std::memory_order_release);
+  }
+
+  std::atomic<Table*> m_table;
+  // All the tables the map ever had, since lookups may still be reading the
+  // ones that were replaced. Only modified under m_grow_lock.
+  std::vector<std::unique_ptr<Table>> m_tables;
+  boost::mutex m_grow_lock;
+  std::atomic<EntryStorage*> m_segments[kMaxSegments];
+  std::atomic<size_t> m_num_entries;
+  std::atomic<size_t> m_size;
+  mutable boost::mutex m_locks[n_locks];
+};
+
 namespace cc_impl {
 
-template <typename Container, size_t n_slots>
+template <typename Container>
 class ConcurrentContainerIterator final {
  public:
   using base_iterator = std::conditional_t<std::is_const<Container>::value,
@@ -386,22 +895,27 @@ class ConcurrentContainerIterator final {
   using reference = typename base_iterator::reference;
   using iterator_category = std::forward_iterator_tag;
 
-  explicit ConcurrentContainerIterator(Container* slots)
+  ConcurrentContainerIterator(Container* slots, size_t num_slots)
       : m_slots(slots),
-        m_slot(n_slots - 1),
-        m_position(m_slots[n_slots - 1].end()) {
+        m_num_slots(num_slots),
+        m_slot(num_slots - 1),
+        m_position(m_slots[num_slots - 1].end()) {
     skip_empty_slots();
   }
 
   ConcurrentContainerIterator(Container* slots,
+                              size_t num_slots,
                               size_t slot,
                               const base_iterator& position)
-      : m_slots(slots), m_slot(slot), m_position(position) {
+      : m_slots(slots),
+        m_num_slots(num_slots),
+        m_slot(slot),
+        m_position(position) {
     skip_empty_slots();
   }
 
   ConcurrentContainerIterator& operator++() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_num_slots - 1].end());
     ++m_position;
     skip_empty_slots();
     return *this;
@@ -423,33 +937,34 @@ class ConcurrentContainerIterator final {
   }
 
   reference operator*() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_num_slots - 1].end());
     return *m_position;
   }
 
   pointer operator->() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_num_slots - 1].end());
     return m_position.operator->();
   }
 
   const reference operator*() const {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_num_slots - 1].end());
     return *m_position;
   }
 
   const pointer operator->() const {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_num_slots - 1].end());
     return m_position.operator->();
   }
 
  private:
   void skip_empty_slots() {
-    while (m_position == m_slots[m_slot].end() && m_slot < n_slots - 1) {
+    while (m_position == m_slots[m_slot].end() && m_slot < m_num_slots - 1) {
       m_position = m_slots[++m_slot].begin();
     }
   }
 
   Container* m_slots;
+  size_t m_num_slots;
   size_t m_slot;
   base_iterator m_position;
 };
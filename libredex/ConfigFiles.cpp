@@ -14,6 +14,7 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "TextTokenizer.h"
 
 ConfigFiles::ConfigFiles(const Json::Value& config, const std::string& outdir)
     : m_json(config),
@@ -21,6 +22,10 @@ ConfigFiles::ConfigFiles(const Json::Value& config, const std::string& outdir)
       m_proguard_map(config.get("proguard_map", "").asString()),
       m_profiled_methods_filename(
           config.get("profiled_methods_file", "").asString()),
+      m_agg_method_stats_filename(
+          config.get("agg_method_stats_file", "").asString()),
+      m_block_profile_filename(
+          config.get("block_profile_file", "").asString()),
       m_printseeds(config.get("printseeds", "").asString()) {
 
   m_coldstart_class_filename = config.get("coldstart_classes", "").asString();
@@ -48,7 +53,8 @@ ConfigFiles::ConfigFiles(const Json::Value& config) : ConfigFiles(config, "") {}
  * This function relies on the g_redex.
  */
 const std::unordered_set<DexType*>& ConfigFiles::get_no_optimizations_annos() {
-  if (m_no_optimizations_annos.empty()) {
+  if (!m_no_optimizations_annos_loaded) {
+    m_no_optimizations_annos_loaded = true;
     Json::Value no_optimizations_anno;
     m_json.get("no_optimizations_annotations", Json::nullValue,
                no_optimizations_anno);
@@ -67,7 +73,8 @@ const std::unordered_set<DexType*>& ConfigFiles::get_no_optimizations_annos() {
  * This function relies on the g_redex.
  */
 const std::unordered_set<DexMethodRef*>& ConfigFiles::get_pure_methods() {
-  if (m_pure_methods.empty()) {
+  if (!m_pure_methods_loaded) {
+    m_pure_methods_loaded = true;
     Json::Value pure_methods;
     m_json.get("pure_methods", Json::nullValue, pure_methods);
     if (pure_methods != Json::nullValue) {
@@ -92,19 +99,21 @@ std::vector<std::string> ConfigFiles::load_coldstart_classes() {
 
   std::vector<std::string> coldstart_classes;
 
-  std::ifstream input(file);
-  if (!input) {
+  text::MappedTextFile input(file);
+  if (!input.is_open()) {
     return std::vector<std::string>();
   }
+  text::Tokenizer tokens(input.contents());
+  boost::string_view word;
   std::string clzname;
-  while (input >> clzname) {
-    long position = clzname.length() - lentail;
-    always_assert_log(position >= 0,
+  while (tokens.next_word(&word)) {
+    always_assert_log(word.size() >= lentail,
                       "Bailing, invalid class spec '%s' in interdex file %s\n",
-                      clzname.c_str(), file);
-    clzname.replace(position, lentail, ";");
-    coldstart_classes.emplace_back(
-        m_proguard_map.translate_class("L" + clzname));
+                      word.to_string().c_str(), file);
+    clzname.assign("L");
+    clzname.append(word.data(), word.size() - lentail);
+    clzname.push_back(';');
+    coldstart_classes.emplace_back(m_proguard_map.translate_class(clzname));
   }
   return coldstart_classes;
 }
@@ -146,18 +155,22 @@ ConfigFiles::load_class_lists() {
 }
 
 void ConfigFiles::load_method_to_weight() {
-  std::ifstream infile(m_profiled_methods_filename.c_str());
-  assert_log(infile, "Can't open method profile file: %s\n",
+  text::MappedTextFile infile(m_profiled_methods_filename);
+  assert_log(infile.is_open(), "Can't open method profile file: %s\n",
              m_profiled_methods_filename.c_str());
 
-  std::string deobfuscated_name;
-  unsigned int weight;
   TRACE(CUSTOMSORT, 2, "Setting sort start file %s",
         m_profiled_methods_filename.c_str());
 
+  text::Tokenizer tokens(infile.contents());
+  boost::string_view deobfuscated_name;
+  boost::string_view weight_str;
+  uint32_t weight;
   unsigned int count = 0;
-  while (infile >> deobfuscated_name >> weight) {
-    m_method_to_weight[deobfuscated_name] = weight;
+  while (tokens.next_word(&deobfuscated_name) &&
+         tokens.next_word(&weight_str) &&
+         text::parse_uint32(weight_str, &weight)) {
+    m_method_to_weight[deobfuscated_name.to_string()] = weight;
     count++;
   }
 
@@ -167,7 +180,7 @@ void ConfigFiles::load_method_to_weight() {
 }
 
 void ConfigFiles::load_method_sorting_whitelisted_substrings() {
-  const auto json_cfg = get_json_config();
+  const auto& json_cfg = get_json_config();
   Json::Value json_result;
   json_cfg.get("method_sorting_whitelisted_substrings", Json::nullValue,
                json_result);
@@ -179,18 +192,26 @@ void ConfigFiles::load_method_sorting_whitelisted_substrings() {
 }
 
 void ConfigFiles::ensure_agg_method_stats_loaded() {
-  const std::string& empty_str = "";
-  const std::string& csv_filename =
-      get_json_config().get("agg_method_stats_file", empty_str);
-  if (csv_filename == empty_str || m_method_profiles.is_initialized()) {
+  if (m_agg_method_stats_filename.empty() ||
+      m_method_profiles.is_initialized()) {
     return;
   }
-  bool success = m_method_profiles.initialize(csv_filename);
+  bool success = m_method_profiles.initialize(m_agg_method_stats_filename);
   if (!success) {
     std::cerr << "WARNING: Unable to initialize method stats!\n";
   }
 }
 
+void ConfigFiles::ensure_block_profiles_loaded() {
+  if (m_block_profile_filename.empty() || m_block_profiles.is_initialized()) {
+    return;
+  }
+  bool success = m_block_profiles.initialize(m_block_profile_filename);
+  if (!success) {
+    std::cerr << "WARNING: Unable to initialize block profiles!\n";
+  }
+}
+
 void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
   Json::Value config;
   m_json.get("inliner", Json::nullValue, config);
@@ -221,6 +242,9 @@ void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
   jw.get("run_local_dce", false, inliner_config->run_local_dce);
   jw.get("run_dedup_blocks", false, inliner_config->run_dedup_blocks);
   jw.get("debug", false, inliner_config->debug);
+  jw.get("speed_inline_budget", (size_t)0,
+         inliner_config->speed_inline_budget);
+  jw.get("log_inline_decisions", false, inliner_config->log_inline_decisions);
   jw.get("black_list", {}, inliner_config->m_black_list);
   jw.get("caller_black_list", {}, inliner_config->m_caller_black_list);
 
@@ -252,4 +276,23 @@ void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
 void ConfigFiles::load(const Scope& scope) {
   get_inliner_config();
   m_inliner_config->populate(scope);
+
+  // The profiles are resolved against the initial names of the methods, so
+  // the dex layout must not wait until the dexes get written.
+  bool uses_method_access_order =
+      m_json.get("string_sort_mode", std::string()) == "method_access_order" ||
+      m_json.get("startup_page_report", false);
+  Json::Value bytecode_sort_mode;
+  m_json.get("bytecode_sort_mode", Json::nullValue, bytecode_sort_mode);
+  if (bytecode_sort_mode.isString()) {
+    uses_method_access_order |=
+        bytecode_sort_mode.asString() == "method_access_order";
+  } else if (bytecode_sort_mode.isArray()) {
+    for (const auto& mode : bytecode_sort_mode) {
+      uses_method_access_order |= mode.asString() == "method_access_order";
+    }
+  }
+  if (uses_method_access_order) {
+    ensure_agg_method_stats_loaded();
+  }
 }
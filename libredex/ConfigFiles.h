@@ -14,6 +14,7 @@
 
 #include <json/json.h>
 
+#include "BlockProfiles.h"
 #include "DexClass.h"
 #include "FrameworkApi.h"
 #include "InlinerConfig.h"
@@ -67,6 +68,17 @@ struct ConfigFiles {
     return m_method_profiles;
   }
 
+  const block_profiles::BlockProfiles& get_block_profiles() {
+    ensure_block_profiles_loaded();
+    return m_block_profiles;
+  }
+
+  // The method profiles as loaded by load(), for the dex layout and its page
+  // touch report.
+  const method_profiles::MethodProfiles& get_loaded_method_profiles() const {
+    return m_method_profiles;
+  }
+
   const std::unordered_set<DexType*>& get_no_optimizations_annos();
   const std::unordered_set<DexMethodRef*>& get_pure_methods();
 
@@ -142,7 +154,12 @@ struct ConfigFiles {
       always_assert(m_min_sdk_api_level == 0); // not set
       m_min_sdk_api_level = min_sdk_api;
       auto api_file = get_android_sdk_api_file(min_sdk_api);
-      m_android_min_sdk_api = std::make_unique<api::AndroidSDK>(api_file);
+      // A directory in which the API file is indexed once for later runs.
+      std::string cache_dir;
+      m_json.get("android_sdk_api_cache_dir", "", cache_dir);
+      m_android_min_sdk_api = std::make_unique<api::AndroidSDK>(
+          api_file, cache_dir.empty() ? boost::none
+                                      : boost::optional<std::string>(cache_dir));
     }
 
     always_assert(min_sdk_api == m_min_sdk_api_level);
@@ -163,26 +180,32 @@ struct ConfigFiles {
   void load_method_to_weight();
   void load_method_sorting_whitelisted_substrings();
   void ensure_agg_method_stats_loaded();
+  void ensure_block_profiles_loaded();
   void load_inliner_config(inliner::InlinerConfig*);
 
   bool m_load_class_lists_attempted{false};
   ProguardMap m_proguard_map;
   std::string m_coldstart_class_filename;
   std::string m_profiled_methods_filename;
+  std::string m_agg_method_stats_filename;
+  std::string m_block_profile_filename;
   std::vector<std::string> m_coldstart_classes;
   std::unordered_map<std::string, std::vector<std::string>> m_class_lists;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
   std::string m_printseeds; // Filename to dump computed seeds.
   method_profiles::MethodProfiles m_method_profiles;
+  block_profiles::BlockProfiles m_block_profiles;
 
   // limits the output instruction size of any DexMethod to 2^n
   // 0 when limit is not present
   uint32_t m_instruction_size_bitwidth_limit;
 
   // global no optimizations annotations
+  bool m_no_optimizations_annos_loaded{false};
   std::unordered_set<DexType*> m_no_optimizations_annos;
   // global pure methods
+  bool m_pure_methods_loaded{false};
   std::unordered_set<DexMethodRef*> m_pure_methods;
   // Global inliner config.
   std::unique_ptr<inliner::InlinerConfig> m_inliner_config{nullptr};
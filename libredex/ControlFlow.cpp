@@ -7,6 +7,7 @@
 
 #include "ControlFlow.h"
 
+#include <algorithm>
 #include <boost/dynamic_bitset.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 #include <iterator>
@@ -18,6 +19,10 @@
 #include "Transform.h"
 #include "WeakTopologicalOrdering.h"
 
+namespace cfg {
+REDEX_DEFINE_POOLED_NEW_DELETE(Edge)
+} // namespace cfg
+
 namespace {
 
 // return true if `it` should be the last instruction of this block
@@ -60,16 +65,6 @@ bool end_of_block(const IRList* ir, const IRList::iterator& it, bool in_try) {
   return false;
 }
 
-bool ends_with_may_throw(cfg::Block* p) {
-  for (auto last = p->rbegin(); last != p->rend(); ++last) {
-    if (last->type != MFLOW_OPCODE) {
-      continue;
-    }
-    return opcode::can_throw(last->insn->opcode());
-  }
-  return false;
-}
-
 bool cannot_throw(cfg::Block* b) {
   for (const auto& mie : InstructionIterable(b)) {
     auto op = mie.insn->opcode();
@@ -192,7 +187,7 @@ void Block::free() {
       mie.insn = nullptr;
       break;
     case MFLOW_DEX_OPCODE:
-      delete mie.dex_insn;
+      DexInstruction::destroy(mie.dex_insn);
       mie.dex_insn = nullptr;
       break;
     default:
@@ -573,13 +568,13 @@ ControlFlowGraph::ControlFlowGraph(IRList* ir,
   always_assert_log(ir->size() > 0, "IRList contains no instructions");
 
   BranchToTargets branch_to_targets;
-  TryEnds try_ends;
+  ThrowingBlocks throwing_blocks;
   TryCatches try_catches;
 
-  find_block_boundaries(ir, branch_to_targets, try_ends, try_catches);
+  find_block_boundaries(ir, branch_to_targets, throwing_blocks, try_catches);
 
   connect_blocks(branch_to_targets);
-  add_catch_edges(try_ends, try_catches);
+  add_catch_edges(throwing_blocks, try_catches);
 
   if (m_editable) {
     remove_try_catch_markers();
@@ -601,7 +596,7 @@ ControlFlowGraph::ControlFlowGraph(IRList* ir,
 
 void ControlFlowGraph::find_block_boundaries(IRList* ir,
                                              BranchToTargets& branch_to_targets,
-                                             TryEnds& try_ends,
+                                             ThrowingBlocks& throwing_blocks,
                                              TryCatches& try_catches) {
   // create the entry block
   auto* block = create_block();
@@ -614,6 +609,12 @@ void ControlFlowGraph::find_block_boundaries(IRList* ir,
   set_entry_block(block);
 
   bool in_try = false;
+  // The first catch marker of the try region that the current block is in, if
+  // any. It outlives in_try for the block that ends with the TRY_END.
+  MethodItemEntry* catch_start = nullptr;
+  size_t region_begin = 0;
+  // The last instruction of the current block so far.
+  IRInstruction* last_insn = nullptr;
   IRList::iterator next;
   DexPosition* current_position = nullptr;
   DexPosition* last_pos_before_this_block = nullptr;
@@ -625,8 +626,11 @@ void ControlFlowGraph::find_block_boundaries(IRList* ir,
         always_assert(!m_editable || it == block_begin);
         always_assert(m_editable || it == block->m_begin);
         in_try = true;
+        catch_start = it->tentry->catch_start;
+        region_begin = throwing_blocks.size();
       } else if (it->tentry->type == TRY_END) {
-        try_ends.emplace_back(it->tentry, block);
+        always_assert_log(it->tentry->catch_start == catch_start,
+                          "TRY_END without a matching TRY_START");
         in_try = false;
       }
     } else if (it->type == MFLOW_CATCH) {
@@ -635,12 +639,27 @@ void ControlFlowGraph::find_block_boundaries(IRList* ir,
       branch_to_targets[it->target->src].push_back(block);
     } else if (it->type == MFLOW_POSITION) {
       current_position = it->pos.get();
+    } else if (it->type == MFLOW_OPCODE) {
+      last_insn = it->insn;
     }
 
     if (!end_of_block(ir, it, in_try)) {
       continue;
     }
 
+    if (catch_start != nullptr && last_insn != nullptr &&
+        opcode::can_throw(last_insn->opcode())) {
+      throwing_blocks.emplace_back(block, catch_start);
+    }
+    if (!in_try && catch_start != nullptr) {
+      // Keep the order in which the catch blocks used to get their
+      // predecessors: by region, from the end of each region.
+      std::reverse(throwing_blocks.begin() + region_begin,
+                   throwing_blocks.end());
+      catch_start = nullptr;
+    }
+    last_insn = nullptr;
+
     // End the current block.
     if (m_editable) {
       // Steal the code from the ir and put it into the block.
@@ -735,45 +754,25 @@ void ControlFlowGraph::connect_blocks(BranchToTargets& branch_to_targets) {
   TRACE(CFG, 5, "  build: edges added");
 }
 
-void ControlFlowGraph::add_catch_edges(TryEnds& try_ends,
-                                       TryCatches& try_catches) {
+void ControlFlowGraph::add_catch_edges(const ThrowingBlocks& throwing_blocks,
+                                       const TryCatches& try_catches) {
   /*
-   * Every block inside a try-start/try-end region
+   * Every block inside a try-start/try-end region that may throw
    * gets an edge to every catch block.  This simplifies dataflow analysis
    * since you can always get the exception state by looking at successors,
    * without any additional analysis.
    *
-   * NB: This algorithm assumes that a try-start/try-end region will consist of
-   * sequentially-numbered blocks, which is guaranteed because catch regions
-   * are contiguous in the bytecode, and we generate blocks in bytecode order.
+   * find_block_boundaries already recorded these blocks in the order of the
+   * code, so the try regions don't need to be walked again.
    */
-  for (auto tep : try_ends) {
-    auto try_end = tep.first;
-    auto tryendblock = tep.second;
-    size_t bid = tryendblock->id();
-    while (true) {
-      Block* block = m_blocks.at(bid);
-      if (ends_with_may_throw(block)) {
-        uint32_t i = 0;
-        for (auto mie = try_end->catch_start; mie != nullptr;
-             mie = mie->centry->next) {
-          auto catchblock = try_catches.at(mie->centry);
-          // Create a throw edge with the information from this catch entry
-          add_edge(block, catchblock, mie->centry->catch_type, i);
-          ++i;
-        }
-      }
-      auto block_begin = block->begin();
-      if (block_begin != block->end() && block_begin->type == MFLOW_TRY) {
-        auto tentry = block_begin->tentry;
-        if (tentry->type == TRY_START) {
-          always_assert_log(tentry->catch_start == try_end->catch_start, "%s",
-                            SHOW(*this));
-          break;
-        }
-      }
-      always_assert_log(bid > 0, "No beginning of try region found");
-      --bid;
+  for (const auto& pair : throwing_blocks) {
+    auto block = pair.first;
+    uint32_t i = 0;
+    for (auto mie = pair.second; mie != nullptr; mie = mie->centry->next) {
+      auto catchblock = try_catches.at(mie->centry);
+      // Create a throw edge with the information from this catch entry
+      add_edge(block, catchblock, mie->centry->catch_type, i);
+      ++i;
     }
   }
   TRACE(CFG, 5, "  build: catch edges added");
@@ -782,8 +781,7 @@ void ControlFlowGraph::add_catch_edges(TryEnds& try_ends,
 BlockId ControlFlowGraph::next_block_id() const {
   // Choose the next largest id. Note that we can't use m_block.size() because
   // we may have deleted some blocks from the cfg.
-  const auto& rbegin = m_blocks.rbegin();
-  return (rbegin == m_blocks.rend()) ? 0 : (rbegin->first + 1);
+  return m_blocks.end_id();
 }
 
 void ControlFlowGraph::remove_unreachable_succ_edges() {
@@ -841,6 +839,7 @@ void ControlFlowGraph::simplify() {
 
 // remove blocks with no predecessors
 uint32_t ControlFlowGraph::remove_unreachable_blocks() {
+  invalidate_analyses();
   uint32_t num_insns_removed = 0;
   remove_unreachable_succ_edges();
   std::unordered_set<DexPosition*> deleted_positions;
@@ -902,6 +901,7 @@ void ControlFlowGraph::remove_dangling_parents(
 }
 void ControlFlowGraph::remove_empty_blocks() {
   always_assert(editable());
+  invalidate_analyses();
   std::unordered_set<DexPosition*> keep_positions;
   for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
     Block* b = it->second;
@@ -1387,8 +1387,13 @@ std::vector<Block*> ControlFlowGraph::order() {
   std::unordered_map<Block*, Chain*> block_to_chain;
   block_to_chain.reserve(m_blocks.size());
 
+  if (!m_block_weights.empty()) {
+    invert_cold_fallthroughs();
+  }
   build_chains(&chains, &block_to_chain);
-  const auto& result = wto_chains(block_to_chain);
+  const auto& result = m_block_weights.empty()
+                           ? wto_chains(block_to_chain)
+                           : weighted_chains(chains, block_to_chain);
 
   always_assert_log(result.size() == m_blocks.size(),
                     "result has %lu blocks, m_blocks has %lu", result.size(),
@@ -1444,6 +1449,28 @@ void ControlFlowGraph::build_chains(
   }
 }
 
+std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>>
+ControlFlowGraph::wto() {
+  using Wto = sparta::WeakTopologicalOrdering<Block*>;
+  auto& cached = m_analyses[std::type_index(typeid(Wto))];
+  if (cached == nullptr) {
+    // Block ids are dense, so the construction can index by them.
+    cached = std::make_shared<Wto>(
+        entry_block(),
+        [](Block* const& block) {
+          std::vector<Block*> succs;
+          succs.reserve(block->succs().size());
+          for (auto* edge : block->succs()) {
+            succs.push_back(edge->target());
+          }
+          return succs;
+        },
+        next_block_id(),
+        [](Block* const& block) { return block->id(); });
+  }
+  return std::static_pointer_cast<const Wto>(cached);
+}
+
 std::vector<Block*> ControlFlowGraph::wto_chains(
     const std::unordered_map<Block*, Chain*>& block_to_chain) {
   sparta::WeakTopologicalOrdering<Chain*> wto(
@@ -1496,6 +1523,99 @@ std::vector<Block*> ControlFlowGraph::wto_chains(
   return wto_order;
 }
 
+void ControlFlowGraph::invert_cold_fallthroughs() {
+  auto weight = [this](const Block* b) {
+    auto it = m_block_weights.find(b->id());
+    return it == m_block_weights.end() ? 0 : it->second;
+  };
+  for (const auto& entry : m_blocks) {
+    Block* b = entry.second;
+    auto branch_it = b->get_conditional_branch();
+    if (branch_it == b->end() || is_switch(branch_it->insn->opcode())) {
+      continue;
+    }
+    Edge* branch = get_succ_edge_of_type(b, EDGE_BRANCH);
+    Edge* fallthrough = get_succ_edge_of_type(b, EDGE_GOTO);
+    if (branch == nullptr || fallthrough == nullptr ||
+        weight(branch->target()) <= weight(fallthrough->target())) {
+      continue;
+    }
+    auto insn = branch_it->insn;
+    insn->set_opcode(opcode::invert_conditional_branch(insn->opcode()));
+    branch->m_type = EDGE_GOTO;
+    fallthrough->m_type = EDGE_BRANCH;
+  }
+}
+
+std::vector<Block*> ControlFlowGraph::weighted_chains(
+    const std::vector<std::unique_ptr<Chain>>& chains,
+    const std::unordered_map<Block*, Chain*>& block_to_chain) {
+  auto weight = [this](const Block* b) {
+    auto it = m_block_weights.find(b->id());
+    return it == m_block_weights.end() ? 0 : it->second;
+  };
+  std::unordered_map<const Chain*, uint64_t> chain_weights;
+  std::vector<Chain*> hot_chains;
+  for (const auto& chain : chains) {
+    uint64_t w = 0;
+    for (Block* b : *chain) {
+      w = std::max(w, weight(b));
+    }
+    chain_weights.emplace(chain.get(), w);
+    if (w > 0) {
+      hot_chains.push_back(chain.get());
+    }
+  }
+  // Chains are built in the order of their first blocks, which keeps ties in
+  // the original order.
+  std::stable_sort(hot_chains.begin(), hot_chains.end(),
+                   [&](const Chain* a, const Chain* b) {
+                     return chain_weights.at(a) > chain_weights.at(b);
+                   });
+
+  std::vector<Block*> result;
+  result.reserve(m_blocks.size());
+  std::unordered_set<const Chain*> placed;
+  auto next_hot = hot_chains.begin();
+  Chain* chain = block_to_chain.at(entry_block());
+  while (chain != nullptr) {
+    placed.insert(chain);
+    result.insert(result.end(), chain->begin(), chain->end());
+
+    // Follow the hottest successor of the last block, preferring the
+    // fallthrough on ties, and otherwise start over from the hottest chain
+    // that's left.
+    Chain* next = nullptr;
+    uint64_t next_weight = 0;
+    for (Edge* e : chain->back()->succs()) {
+      Chain* succ = block_to_chain.at(e->target());
+      auto w = weight(e->target());
+      if (placed.count(succ) || w == 0) {
+        continue;
+      }
+      if (w > next_weight || (w == next_weight && e->type() == EDGE_GOTO)) {
+        next = succ;
+        next_weight = w;
+      }
+    }
+    while (next == nullptr && next_hot != hot_chains.end()) {
+      if (!placed.count(*next_hot)) {
+        next = *next_hot;
+      }
+      ++next_hot;
+    }
+    chain = next;
+  }
+
+  // The blocks that never ran go at the end, in their original order.
+  for (const auto& c : chains) {
+    if (!placed.count(c.get())) {
+      result.insert(result.end(), c->begin(), c->end());
+    }
+  }
+  return result;
+}
+
 // Add an MFLOW_TARGET at the end of each edge.
 // Insert GOTOs where necessary.
 void ControlFlowGraph::insert_branches_and_targets(
@@ -1758,6 +1878,7 @@ ControlFlowGraph::~ControlFlowGraph() {
 }
 
 Block* ControlFlowGraph::create_block() {
+  invalidate_analyses();
   size_t id = next_block_id();
   Block* b = new Block(this, id);
   m_blocks.emplace(id, b);
@@ -1992,6 +2113,7 @@ Block* ControlFlowGraph::split_block(Block* old_block,
                                      const IRList::iterator& raw_it) {
   always_assert(raw_it != old_block->end());
   always_assert(editable());
+  invalidate_analyses();
 
   // new_block will be the successor
   Block* new_block = create_block();
@@ -2024,6 +2146,7 @@ Block* ControlFlowGraph::split_block(const cfg::InstructionIterator& it) {
 }
 
 void ControlFlowGraph::merge_blocks(Block* pred, Block* succ) {
+  invalidate_analyses();
   const auto& not_throws = [](const Edge* e) {
     return e->type() != EDGE_THROW;
   };
@@ -2071,6 +2194,7 @@ void ControlFlowGraph::set_edge_source(Edge* edge, Block* new_source) {
 void ControlFlowGraph::move_edge(Edge* edge,
                                  Block* new_source,
                                  Block* new_target) {
+  invalidate_analyses();
   // remove this edge from the graph temporarily but do not delete it because
   // we're going to move it elsewhere
   remove_edge(edge, /* cleanup */ false);
@@ -2117,6 +2241,7 @@ bool ControlFlowGraph::replace_insn(const InstructionIterator& it,
 
 void ControlFlowGraph::remove_insn(const InstructionIterator& it) {
   always_assert(m_editable);
+  invalidate_analyses();
 
   MethodItemEntry& mie = *it;
   auto insn = mie.insn;
@@ -2303,6 +2428,7 @@ bool ControlFlowGraph::push_back(Block* b, IRInstruction* insn) {
 }
 
 void ControlFlowGraph::remove_block(Block* block) {
+  invalidate_analyses();
   if (block == entry_block()) {
     always_assert(block->succs().size() == 1);
     set_entry_block(block->succs()[0]->target());
@@ -9,13 +9,18 @@
 
 #include <boost/dynamic_bitset.hpp>
 #include <boost/optional/optional.hpp>
+#include <boost/range/adaptor/map.hpp>
 #include <boost/range/sub_range.hpp>
+#include <memory>
 #include <type_traits>
+#include <typeindex>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "IRCode.h"
+#include "WeakTopologicalOrdering.h"
 
 /**
  * A Control Flow Graph is a directed graph of Basic Blocks.
@@ -115,6 +120,10 @@ class Edge final {
   friend class CFGInliner;
 
  public:
+  // Edges are allocated from a FixedSizePool, as they are created and deleted
+  // in bulk every time a CFG is built.
+  REDEX_DECLARE_POOLED_NEW_DELETE();
+
   Edge(Block* src, Block* target, EdgeType type)
       : m_src(src), m_target(target), m_type(type) {
     always_assert_log(m_type != EDGE_THROW,
@@ -348,6 +357,150 @@ struct DominatorInfo {
   size_t postorder;
 };
 
+/*
+ * The blocks of a ControlFlowGraph, indexed by id. Block ids are handed out
+ * densely, so the blocks live in a flat vector, with holes for deleted
+ * blocks, in place of a tree map. Iteration is in id order and skips the
+ * holes.
+ *
+ * Iterators are index-based: creating blocks doesn't invalidate them, and
+ * deleting a block only invalidates iterators pointing at it.
+ */
+class BlockMap {
+ public:
+  using value_type = std::pair<BlockId, Block*>;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = BlockMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator() = default;
+
+    reference operator*() const { return (*m_slots)[m_index]; }
+    pointer operator->() const { return &(*m_slots)[m_index]; }
+
+    const_iterator& operator++() {
+      do {
+        ++m_index;
+      } while (m_index < m_slots->size() &&
+               (*m_slots)[m_index].second == nullptr);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto result = *this;
+      ++(*this);
+      return result;
+    }
+    const_iterator& operator--() {
+      do {
+        --m_index;
+      } while ((*m_slots)[m_index].second == nullptr);
+      return *this;
+    }
+    const_iterator operator--(int) {
+      auto result = *this;
+      --(*this);
+      return result;
+    }
+
+    bool operator==(const const_iterator& that) const {
+      return m_index == that.m_index;
+    }
+    bool operator!=(const const_iterator& that) const {
+      return !(*this == that);
+    }
+
+   private:
+    friend class BlockMap;
+    const_iterator(const std::vector<value_type>* slots, size_t index)
+        : m_slots(slots), m_index(index) {}
+
+    const std::vector<value_type>* m_slots{nullptr};
+    size_t m_index{0};
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  const_iterator begin() const {
+    size_t index = 0;
+    while (index < m_slots.size() && m_slots[index].second == nullptr) {
+      ++index;
+    }
+    return const_iterator(&m_slots, index);
+  }
+  const_iterator end() const {
+    return const_iterator(&m_slots, m_slots.size());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  // One past the largest id in use.
+  BlockId end_id() const { return m_slots.size(); }
+
+  size_t count(BlockId id) const {
+    return id < m_slots.size() && m_slots[id].second != nullptr;
+  }
+  Block* at(BlockId id) const {
+    always_assert_log(count(id), "No block with id %zu", id);
+    return m_slots[id].second;
+  }
+  const_iterator find(BlockId id) const {
+    return count(id) ? const_iterator(&m_slots, id) : end();
+  }
+
+  void emplace(BlockId id, Block* block) {
+    if (id >= m_slots.size()) {
+      auto old_size = m_slots.size();
+      m_slots.resize(id + 1);
+      for (auto i = old_size; i <= id; ++i) {
+        m_slots[i].first = i;
+      }
+    }
+    always_assert_log(m_slots[id].second == nullptr, "Duplicate block %zu", id);
+    m_slots[id].second = block;
+    ++m_size;
+  }
+
+  size_t erase(BlockId id) {
+    if (!count(id)) {
+      return 0;
+    }
+    m_slots[id].second = nullptr;
+    --m_size;
+    // Keep end_id() tight, so that ids get reused as they would with a map.
+    while (!m_slots.empty() && m_slots.back().second == nullptr) {
+      m_slots.pop_back();
+    }
+    return 1;
+  }
+  const_iterator erase(const_iterator it) {
+    auto next = std::next(it);
+    auto next_id = next == end() ? m_slots.size() : next->first;
+    erase(it->first);
+    return next_id >= m_slots.size() ? end()
+                                     : const_iterator(&m_slots, next_id);
+  }
+
+  void clear() {
+    m_slots.clear();
+    m_size = 0;
+  }
+
+ private:
+  std::vector<value_type> m_slots;
+  size_t m_size{0};
+};
+
 class ControlFlowGraph {
 
  public:
@@ -375,12 +528,17 @@ class ControlFlowGraph {
   // copy is now stale. That stale copy may have a pointer to a deleted block or
   // it may be incomplete (not iterating over the newly creating block).
   //
-  // TODO: We should probably have an API to offer iterators into the blocks map
-  // instead for reads or some mutations since insertion and erasure of elements
-  // stored in std::map will not invalidate the iterators referencing other
-  // elements.
+  // Use block_range() instead to read the blocks without copying them.
   std::vector<Block*> blocks() const;
 
+  // The blocks of this CFG in id order, as a range over the block storage.
+  // Creating blocks doesn't invalidate it, though the new blocks are past the
+  // end of a range taken before. Deleting the block that an iterator is at
+  // does invalidate it, so use blocks() to delete blocks while iterating.
+  using BlockRange =
+      decltype(boost::adaptors::values(std::declval<const BlockMap&>()));
+  BlockRange block_range() const { return boost::adaptors::values(m_blocks); }
+
   // Return vector of blocks in reverse post order (RPO). If there is a path
   // from Block A to Block B, then A appears before B in this vector.
   //
@@ -399,8 +557,22 @@ class ControlFlowGraph {
 
   Block* entry_block() const { return m_entry_block; }
   Block* exit_block() const { return m_exit_block; }
-  void set_entry_block(Block* b) { m_entry_block = b; }
-  void set_exit_block(Block* b) { m_exit_block = b; }
+  void set_entry_block(Block* b) {
+    invalidate_analyses();
+    m_entry_block = b;
+  }
+  void set_exit_block(Block* b) {
+    invalidate_analyses();
+    m_exit_block = b;
+  }
+
+  // The execution counts of the blocks, e.g. from a basic-block profile. Once
+  // set, linearize() lays the blocks out so that each one is followed by its
+  // hottest successor, and those that never ran, or have no count, come last,
+  // rather than in weak topological order.
+  void set_block_weights(std::unordered_map<BlockId, uint64_t> weights) {
+    m_block_weights = std::move(weights);
+  }
 
   /*
    * If there is a single method exit point, this returns a vector holding the
@@ -431,6 +603,7 @@ class ControlFlowGraph {
   }
 
   void add_edge(Edge* e) {
+    invalidate_analyses();
     m_edges.insert(e);
     e->src()->m_succs.emplace_back(e);
     e->target()->m_preds.emplace_back(e);
@@ -745,22 +918,55 @@ class ControlFlowGraph {
   // choose an order of blocks for output
   std::vector<Block*> order();
 
+  /*
+   * Derived data, like dominators or liveness, cached on the CFG so that it
+   * is only computed again once the CFG changed. `make` returns a
+   * std::unique_ptr<Analysis> and is only called on a cache miss.
+   *
+   * The cache is dropped whenever blocks, edges or instructions are added or
+   * removed through the CFG's API. Changes made to an instruction in place,
+   * e.g. with set_src(), are not seen here: whoever makes them must call
+   * invalidate_analyses() if they can affect the cached data.
+   */
+  template <class Analysis, class MakeFn>
+  const Analysis& get_cached_analysis(const MakeFn& make) {
+    auto& cached = m_analyses[std::type_index(typeid(Analysis))];
+    if (cached == nullptr) {
+      cached = std::shared_ptr<Analysis>(make());
+    }
+    return *static_cast<const Analysis*>(cached.get());
+  }
+
+  void invalidate_analyses() { m_analyses.clear(); }
+
+  /*
+   * The weak topological ordering of the blocks reachable from the entry
+   * block, cached like get_cached_analysis() so that the analyses of an
+   * unchanged CFG share it. Holding on to the pointer keeps it alive (but
+   * stale) if the CFG changes.
+   */
+  std::shared_ptr<const sparta::WeakTopologicalOrdering<Block*>> wto();
+
  private:
   using BranchToTargets =
       std::unordered_map<MethodItemEntry*, std::vector<Block*>>;
-  using TryEnds = std::vector<std::pair<TryEntry*, Block*>>;
+  // The blocks inside try regions that end with an instruction that may
+  // throw, along with the first catch marker of their regions.
+  using ThrowingBlocks = std::vector<std::pair<Block*, MethodItemEntry*>>;
   using TryCatches = std::unordered_map<CatchEntry*, Block*>;
-  using Blocks = std::map<BlockId, Block*>;
+  using Blocks = BlockMap;
   friend class InstructionIteratorImpl<false>;
   friend class InstructionIteratorImpl<true>;
   friend class CFGInliner;
 
-  // Find block boundaries in IRCode and create the blocks
+  // Find block boundaries in IRCode and create the blocks, recording the
+  // branch targets, the throwing blocks and the catch blocks on the way, so
+  // that the edges can be added without walking the code again.
   // For use by the constructor. You probably don't want to call this from
   // elsewhere
   void find_block_boundaries(IRList* ir,
                              BranchToTargets& branch_to_targets,
-                             TryEnds& try_ends,
+                             ThrowingBlocks& throwing_blocks,
                              TryCatches& try_catches);
 
   // Add edges between blocks created by `find_block_boundaries`
@@ -771,7 +977,8 @@ class ControlFlowGraph {
   // Add edges from try blocks to their catch handlers.
   // For use by the constructor. You probably don't want to call this from
   // elsewhere
-  void add_catch_edges(TryEnds& try_ends, TryCatches& try_catches);
+  void add_catch_edges(const ThrowingBlocks& throwing_blocks,
+                       const TryCatches& try_catches);
 
   // For use by the constructor. You probably don't want to call this from
   // elsewhere
@@ -788,6 +995,13 @@ class ControlFlowGraph {
                     std::unordered_map<Block*, Chain*>* block_to_chain);
   std::vector<Block*> wto_chains(
       const std::unordered_map<Block*, Chain*>& block_to_chain);
+  // The order of the chains according to m_block_weights.
+  std::vector<Block*> weighted_chains(
+      const std::vector<std::unique_ptr<Chain>>& chains,
+      const std::unordered_map<Block*, Chain*>& block_to_chain);
+  // Flips the conditional branches whose target ran more often than their
+  // fallthrough, so that the hot path can fall through.
+  void invert_cold_fallthroughs();
 
   // Materialize target instructions and gotos corresponding to control-flow
   // edges. Used while turning back into a linear representation.
@@ -852,6 +1066,7 @@ class ControlFlowGraph {
                          Block* target,
                          EdgePredicate predicate,
                          bool cleanup = true) {
+    invalidate_analyses();
     auto& forward_edges = source->m_succs;
     EdgeSet to_remove;
     forward_edges.erase(
@@ -884,6 +1099,7 @@ class ControlFlowGraph {
   EdgeSet remove_pred_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    invalidate_analyses();
     auto& reverse_edges = block->m_preds;
 
     std::vector<Block*> source_blocks;
@@ -920,6 +1136,7 @@ class ControlFlowGraph {
   EdgeSet remove_succ_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    invalidate_analyses();
     auto& forward_edges = block->m_succs;
 
     std::vector<Block*> target_blocks;
@@ -986,6 +1203,10 @@ class ControlFlowGraph {
   Block* m_entry_block{nullptr};
   Block* m_exit_block{nullptr};
   bool m_editable{true};
+  std::unordered_map<BlockId, uint64_t> m_block_weights;
+
+  // Keyed by the type of the analysis.
+  std::unordered_map<std::type_index, std::shared_ptr<void>> m_analyses;
 };
 
 // A static-method-only API for use with the monotonic fixpoint iterator.
@@ -1197,6 +1418,7 @@ bool ControlFlowGraph::insert(const InstructionIterator& position,
                               const ForwardIt& begin_index,
                               const ForwardIt& end_index,
                               bool before) {
+  invalidate_analyses();
   // Convert to the before case by moving the position forward one.
   Block* b = position.block();
   if (position.unwrap() == b->end()) {
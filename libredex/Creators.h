@@ -562,15 +562,52 @@ struct ClassCreator {
    */
   void add_field(DexField* field) { m_cls->add_field(field); }
 
+  /**
+   * Add DexFields to the DexClass, all at once.
+   */
+  void add_fields(const std::vector<DexField*>& fields) {
+    m_cls->add_fields(fields);
+  }
+
   /**
    * Add a DexMethod to the DexClass.
    */
   void add_method(DexMethod* method) { m_cls->add_method(method); }
 
+  /**
+   * Add DexMethods to the DexClass, all at once.
+   */
+  void add_methods(const std::vector<DexMethod*>& methods) {
+    m_cls->add_methods(methods);
+  }
+
   /**
    * Create the DexClass. The creator should not be used after this call.
    */
   DexClass* create() {
+    finish();
+    g_redex->publish_class(m_cls);
+    return m_cls;
+  }
+
+  /**
+   * Create the DexClasses of many creators, which are published all at once.
+   * The creators should not be used after this call.
+   */
+  static std::vector<DexClass*> create_all(
+      std::vector<ClassCreator>& creators) {
+    std::vector<DexClass*> classes;
+    classes.reserve(creators.size());
+    for (auto& creator : creators) {
+      creator.finish();
+      classes.push_back(creator.m_cls);
+    }
+    g_redex->publish_classes(classes);
+    return classes;
+  }
+
+ private:
+  void finish() {
     always_assert_log(m_cls->m_self, "Self cannot be null in a DexClass");
     if (m_cls->m_super_class == NULL) {
       if (m_cls->m_self != type::java_lang_Object()) {
@@ -579,11 +616,8 @@ struct ClassCreator {
       }
     }
     m_cls->m_interfaces = DexTypeList::make_type_list(std::move(m_interfaces));
-    g_redex->publish_class(m_cls);
-    return m_cls;
   }
 
- private:
   DexClass* m_cls;
   std::deque<DexType*> m_interfaces;
 };
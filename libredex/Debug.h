@@ -83,5 +83,6 @@ void crash_backtrace_handler(int sig);
 struct VmStats {
   uint64_t vm_peak = 0; // "Peak virtual memory size."
   uint64_t vm_hwm = 0; // "Peak resident set size ("high water mark")."
+  uint64_t vm_rss = 0; // "Resident set size."
 };
 VmStats get_mem_stats();
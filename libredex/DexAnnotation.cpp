@@ -675,8 +675,8 @@ void DexAnnotationDirectory::gather_annotations(
 void DexAnnotationDirectory::vencode(
     DexOutputIdx* dodx,
     std::vector<uint32_t>& annodirout,
-    std::map<ParamAnnotations*, uint32_t>& xrefmap,
-    std::map<DexAnnotationSet*, uint32_t>& asetmap) {
+    const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+    const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap) {
   uint32_t classoff = 0;
   uint32_t cntaf = 0;
   uint32_t cntam = 0;
@@ -684,7 +684,7 @@ void DexAnnotationDirectory::vencode(
   if (m_class) {
     always_assert_log(asetmap.count(m_class) != 0, "Uninitialized aset %p '%s'",
                       m_class, show(m_class).c_str());
-    classoff = asetmap[m_class];
+    classoff = asetmap.at(m_class);
   }
   if (m_field) {
     cntaf = (uint32_t)m_field->size();
@@ -710,7 +710,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(dodx->fieldidx(p.first));
       always_assert_log(asetmap.count(das) != 0, "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method) {
@@ -722,7 +722,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(midx);
       always_assert_log(asetmap.count(das) != 0, "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method_param) {
@@ -734,7 +734,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(dodx->methodidx(p.first));
       always_assert_log(xrefmap.count(pa) != 0,
                         "Uninitialized ParamAnnotations %p", pa);
-      annodirout.push_back(xrefmap[pa]);
+      annodirout.push_back(xrefmap.at(pa));
     }
   }
 }
@@ -745,9 +745,10 @@ void DexAnnotationSet::gather_annotations(std::vector<DexAnnotation*>& list) {
   }
 }
 
-void DexAnnotationSet::vencode(DexOutputIdx* dodx,
-                               std::vector<uint32_t>& asetout,
-                               std::map<DexAnnotation*, uint32_t>& annoout) {
+void DexAnnotationSet::vencode(
+    DexOutputIdx* dodx,
+    std::vector<uint32_t>& asetout,
+    const std::unordered_map<DexAnnotation*, uint32_t>& annoout) {
   asetout.push_back((uint32_t)m_annotations.size());
   std::sort(m_annotations.begin(), m_annotations.end(),
             type_annotation_compare);
@@ -756,7 +757,7 @@ void DexAnnotationSet::vencode(DexOutputIdx* dodx,
                       "Uninitialized annotation %p '%s', bailing\n",
                       anno,
                       show(anno).c_str());
-    asetout.push_back(annoout[anno]);
+    asetout.push_back(annoout.at(anno));
   }
 }
 
@@ -12,6 +12,7 @@
 #include <list>
 #include <map>
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "Gatherable.h"
@@ -481,7 +482,7 @@ class DexAnnotationSet : public Gatherable {
   void add_annotation(DexAnnotation* anno) { m_annotations.emplace_back(anno); }
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& asetout,
-               std::map<DexAnnotation*, uint32_t>& annoout);
+               const std::unordered_map<DexAnnotation*, uint32_t>& annoout);
   void gather_annotations(std::vector<DexAnnotation*>& alist);
 };
 
@@ -551,8 +552,8 @@ class DexAnnotationDirectory {
   void gather_xrefs(std::vector<ParamAnnotations*>& xrefs);
   void vencode(DexOutputIdx* dodx,
                std::vector<uint32_t>& annodirout,
-               std::map<ParamAnnotations*, uint32_t>& xrefmap,
-               std::map<DexAnnotationSet*, uint32_t>& asetmap);
+               const std::unordered_map<ParamAnnotations*, uint32_t>& xrefmap,
+               const std::unordered_map<DexAnnotationSet*, uint32_t>& asetmap);
 
   friend std::string show(const DexAnnotationDirectory*);
 };
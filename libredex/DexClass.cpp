@@ -27,8 +27,27 @@
 #include <boost/optional.hpp>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 
+const std::string& DexString::copy_mapped() const {
+  auto state = m_size_and_state.load(std::memory_order_acquire);
+  while (state & kMapped) {
+    if (!(state & kCopying) &&
+        m_size_and_state.compare_exchange_weak(state, state | kCopying,
+                                               std::memory_order_acquire)) {
+      m_storage.assign(m_data, state & kSizeMask);
+      m_size_and_state.store(state & kSizeMask, std::memory_order_release);
+      break;
+    }
+    if (state & kCopying) {
+      std::this_thread::yield();
+      state = m_size_and_state.load(std::memory_order_acquire);
+    }
+  }
+  return m_storage;
+}
+
 uint32_t DexString::length() const {
   if (is_simple()) {
     return size();
@@ -286,6 +305,27 @@ std::vector<std::unique_ptr<DexDebugInstruction>> generate_debug_instructions(
   return dbgops;
 }
 
+std::vector<uint32_t> map_debug_positions(DexDebugItem* debugitem,
+                                          PositionMapper* pos_mapper) {
+  std::vector<uint32_t> lines;
+  auto& entries = debugitem->get_entries();
+  for (auto it = entries.begin(); it != entries.end();) {
+    auto addr = it->addr;
+    DexPosition* last_position = nullptr;
+    for (; it != entries.end() && it->addr == addr; ++it) {
+      if (it->type == DexDebugEntryType::Position &&
+          it->pos->file != nullptr) {
+        pos_mapper->register_position(it->pos.get());
+        last_position = it->pos.get();
+      }
+    }
+    if (last_position != nullptr) {
+      lines.push_back(pos_mapper->position_to_line(last_position));
+    }
+  }
+  return lines;
+}
+
 int DexDebugItem::encode(
     DexOutputIdx* dodx,
     uint8_t* output,
@@ -359,6 +399,8 @@ std::unique_ptr<DexCode> DexCode::get_dex_code(DexIdx* idx, uint32_t offset) {
   uint32_t tries = code->tries_size;
   if (code->insns_size) {
     const uint16_t* end = cdata + code->insns_size;
+    // Most instructions take one or two code units.
+    dc->m_insns->reserve(code->insns_size / 2);
     while (cdata < end) {
       DexInstruction* dop = DexInstruction::make_instruction(idx, &cdata);
       always_assert_log(dop != nullptr,
@@ -522,21 +564,55 @@ std::string DexMethod::get_fully_deobfuscated_name() const {
 }
 
 void DexMethod::set_code(std::unique_ptr<IRCode> code) {
+  if (is_balloon_pending()) {
+    m_dex_code.reset();
+    m_balloon_pending = false;
+  }
   m_code = std::move(code);
 }
 
 void DexMethod::balloon() {
   redex_assert(m_code == nullptr);
   m_code = std::make_unique<IRCode>(this);
+  m_code->set_modified_epoch(m_synced_epoch);
   m_dex_code.reset();
+  m_balloon_pending = false;
 }
 
 void DexMethod::sync() {
   redex_assert(m_dex_code == nullptr);
+  m_synced_epoch = m_code->modified_epoch();
   m_dex_code = m_code->sync(this);
   m_code.reset();
 }
 
+void DexMethod::balloon_lazily() {
+  redex_assert(m_code == nullptr && m_dex_code != nullptr);
+  m_balloon_pending = true;
+}
+
+namespace {
+
+// Any thread may be the first one to access a method's code, e.g. when
+// several callers look at the same callee.
+constexpr size_t kBalloonLockStripes = 127;
+std::mutex s_balloon_locks[kBalloonLockStripes];
+
+} // namespace
+
+void DexMethod::balloon_pending_code() {
+  auto& lock =
+      s_balloon_locks[reinterpret_cast<uintptr_t>(this) % kBalloonLockStripes];
+  std::lock_guard<std::mutex> guard(lock);
+  if (!is_balloon_pending()) {
+    return;
+  }
+  m_code = std::make_unique<IRCode>(this);
+  m_code->set_modified_epoch(m_synced_epoch);
+  m_dex_code.reset();
+  m_balloon_pending.store(false, std::memory_order_release);
+}
+
 size_t hash_value(const DexMethodSpec& r) {
   size_t seed = boost::hash<DexType*>()(r.cls);
   boost::hash_combine(seed, r.name);
@@ -646,6 +722,8 @@ void DexClass::remove_method(const DexMethod* m) {
     meths.erase(it);
   }
   redex_assert(erased);
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
 }
 
 void DexMethod::become_virtual() {
@@ -656,6 +734,7 @@ void DexMethod::become_virtual() {
   m_virtual = true;
   auto& vmethods = cls->get_vmethods();
   insert_sorted(vmethods, this, compare_dexmethods);
+  g_redex->report_class_hierarchy_change();
 }
 
 DexMethod* DexMethodRef::make_concrete(DexAccessFlags access,
@@ -687,6 +766,10 @@ DexMethod* DexMethodRef::make_concrete(DexAccessFlags access, bool is_virtual) {
 void DexMethod::make_non_concrete() {
   m_access = static_cast<DexAccessFlags>(0);
   m_concrete = false;
+  if (is_balloon_pending()) {
+    m_dex_code.reset();
+    m_balloon_pending = false;
+  }
   m_code.reset();
   m_virtual = false;
   m_param_anno.clear();
@@ -764,7 +847,10 @@ void DexClass::load_class_data_item(DexIdx* idx,
   }
 }
 
-std::unique_ptr<IRCode> DexMethod::release_code() { return std::move(m_code); }
+std::unique_ptr<IRCode> DexMethod::release_code() {
+  balloon_if_pending();
+  return std::move(m_code);
+}
 
 void DexClass::add_method(DexMethod* m) {
   always_assert_log(m->is_concrete() || m->is_external(),
@@ -776,6 +862,26 @@ void DexClass::add_method(DexMethod* m) {
   } else {
     insert_sorted(m_dmethods, m, compare_dexmethods);
   }
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
+}
+
+void DexClass::add_methods(const std::vector<DexMethod*>& methods) {
+  std::vector<DexMethod*> vmethods;
+  std::vector<DexMethod*> dmethods;
+  for (auto* m : methods) {
+    always_assert_log(m->is_concrete() || m->is_external(),
+                      "Method %s must be concrete",
+                      SHOW(m));
+    always_assert(m->get_class() == get_type());
+    (m->is_virtual() ? vmethods : dmethods).push_back(m);
+  }
+  insert_all_sorted(
+      m_vmethods, vmethods.begin(), vmethods.end(), compare_dexmethods);
+  insert_all_sorted(
+      m_dmethods, dmethods.begin(), dmethods.end(), compare_dexmethods);
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
 }
 
 void DexClass::add_field(DexField* f) {
@@ -789,6 +895,27 @@ void DexClass::add_field(DexField* f) {
   } else {
     insert_sorted(m_ifields, f, compare_dexfields);
   }
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
+}
+
+void DexClass::add_fields(const std::vector<DexField*>& fields) {
+  std::vector<DexField*> sfields;
+  std::vector<DexField*> ifields;
+  for (auto* f : fields) {
+    always_assert_log(f->is_concrete() || f->is_external(),
+                      "Field %s must be concrete",
+                      SHOW(f));
+    always_assert(f->get_class() == get_type());
+    bool is_static = f->get_access() & DexAccessFlags::ACC_STATIC;
+    (is_static ? sfields : ifields).push_back(f);
+  }
+  insert_all_sorted(
+      m_sfields, sfields.begin(), sfields.end(), compare_dexfields);
+  insert_all_sorted(
+      m_ifields, ifields.begin(), ifields.end(), compare_dexfields);
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
 }
 
 void DexClass::remove_field(const DexField* f) {
@@ -801,6 +928,8 @@ void DexClass::remove_field(const DexField* f) {
     fields.erase(it);
   }
   redex_assert(erase);
+  invalidate_member_index();
+  g_redex->report_class_hierarchy_change();
 }
 
 void DexClass::sort_fields() {
@@ -808,6 +937,7 @@ void DexClass::sort_fields() {
   auto& ifields = this->get_ifields();
   std::sort(sfields.begin(), sfields.end(), compare_dexfields);
   std::sort(ifields.begin(), ifields.end(), compare_dexfields);
+  invalidate_member_index();
 }
 
 void DexClass::sort_methods() {
@@ -815,6 +945,7 @@ void DexClass::sort_methods() {
   auto& dmeths = this->get_dmethods();
   std::sort(vmeths.begin(), vmeths.end(), compare_dexmethods);
   std::sort(dmeths.begin(), dmeths.end(), compare_dexmethods);
+  invalidate_member_index();
 }
 
 DexField* DexClass::find_field(const char* name,
@@ -828,6 +959,157 @@ DexField* DexClass::find_field(const char* name,
   return nullptr;
 }
 
+namespace {
+
+// Below this many members, a scan is as fast as the index and needs no memory.
+constexpr size_t kMemberIndexThreshold = 16;
+
+using MemberKey = std::pair<uintptr_t, uintptr_t>;
+
+MemberKey member_key(const void* name, const void* proto_or_type) {
+  return {reinterpret_cast<uintptr_t>(name),
+          reinterpret_cast<uintptr_t>(proto_or_type)};
+}
+
+MemberKey member_key(const DexMethod* m) {
+  return member_key(m->get_name(), m->get_proto());
+}
+
+MemberKey member_key(const DexField* f) {
+  return member_key(f->get_name(), f->get_type());
+}
+
+template <class Member>
+struct MemberEntry {
+  MemberKey key;
+  Member* member;
+  // The position of the member in its vector when the table was built.
+  size_t pos;
+};
+
+template <class Member>
+using MemberTable = std::vector<MemberEntry<Member>>;
+
+template <class Member>
+MemberTable<Member> make_member_table(const std::vector<Member*>& members) {
+  MemberTable<Member> table;
+  if (members.size() < kMemberIndexThreshold) {
+    return table;
+  }
+  table.reserve(members.size());
+  for (size_t pos = 0; pos < members.size(); ++pos) {
+    auto* m = members[pos];
+    table.push_back({member_key(m), m, pos});
+  }
+  // Members are sorted by name, not by interned pointer; stable so that
+  // (broken) duplicates resolve to the first one, like a scan does.
+  std::stable_sort(
+      table.begin(), table.end(),
+      [](const MemberEntry<Member>& a, const MemberEntry<Member>& b) {
+        return a.key < b.key;
+      });
+  return table;
+}
+
+template <class Member>
+Member* find_member(const std::vector<Member*>& members,
+                    const MemberTable<Member>* table,
+                    const MemberKey& key) {
+  if (table != nullptr && table->size() == members.size()) {
+    auto it = std::lower_bound(
+        table->begin(), table->end(), key,
+        [](const MemberEntry<Member>& entry, const MemberKey& k) {
+          return entry.key < k;
+        });
+    // Only trust a hit that is still where the table saw it, under the same
+    // name: members may have been swapped in the vectors directly, or renamed
+    // without reporting it. Scan on a miss too.
+    if (it != table->end() && it->key == key &&
+        members[it->pos] == it->member && member_key(it->member) == key) {
+      return it->member;
+    }
+  }
+  for (auto* m : members) {
+    if (member_key(m) == key) {
+      return m;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+struct DexClass::MemberIndex {
+  size_t version;
+  MemberTable<DexMethod> vmethods;
+  MemberTable<DexMethod> dmethods;
+  MemberTable<DexField> ifields;
+  MemberTable<DexField> sfields;
+};
+
+std::shared_ptr<const DexClass::MemberIndex> DexClass::get_member_index()
+    const {
+  auto version = g_redex->class_hierarchy_version();
+  auto index = std::atomic_load(&m_member_index);
+  if (index != nullptr && index->version == version) {
+    return index;
+  }
+  // Concurrent lookups may each build one; they are all equivalent.
+  auto fresh = std::make_shared<MemberIndex>();
+  fresh->version = version;
+  fresh->vmethods = make_member_table(m_vmethods);
+  fresh->dmethods = make_member_table(m_dmethods);
+  fresh->ifields = make_member_table(m_ifields);
+  fresh->sfields = make_member_table(m_sfields);
+  index = std::move(fresh);
+  std::atomic_store(&m_member_index, index);
+  return index;
+}
+
+void DexClass::invalidate_member_index() {
+  std::atomic_store(&m_member_index, std::shared_ptr<const MemberIndex>());
+}
+
+DexMethod* DexClass::find_vmethod(const DexString* name,
+                                  const DexProto* proto) const {
+  auto key = member_key(name, proto);
+  if (m_vmethods.size() < kMemberIndexThreshold) {
+    return find_member<DexMethod>(m_vmethods, nullptr, key);
+  }
+  auto index = get_member_index();
+  return find_member(m_vmethods, &index->vmethods, key);
+}
+
+DexMethod* DexClass::find_dmethod(const DexString* name,
+                                  const DexProto* proto) const {
+  auto key = member_key(name, proto);
+  if (m_dmethods.size() < kMemberIndexThreshold) {
+    return find_member<DexMethod>(m_dmethods, nullptr, key);
+  }
+  auto index = get_member_index();
+  return find_member(m_dmethods, &index->dmethods, key);
+}
+
+DexField* DexClass::find_ifield(const DexString* name,
+                                const DexType* type) const {
+  auto key = member_key(name, type);
+  if (m_ifields.size() < kMemberIndexThreshold) {
+    return find_member<DexField>(m_ifields, nullptr, key);
+  }
+  auto index = get_member_index();
+  return find_member(m_ifields, &index->ifields, key);
+}
+
+DexField* DexClass::find_sfield(const DexString* name,
+                                const DexType* type) const {
+  auto key = member_key(name, type);
+  if (m_sfields.size() < kMemberIndexThreshold) {
+    return find_member<DexField>(m_sfields, nullptr, key);
+  }
+  auto index = get_member_index();
+  return find_member(m_sfields, &index->sfields, key);
+}
+
 bool DexClass::has_class_data() const {
   return !m_vmethods.empty() || !m_dmethods.empty() || !m_ifields.empty() ||
          !m_sfields.empty();
@@ -1033,9 +1315,8 @@ DexClass* DexClass::create(DexIdx* idx,
                            const std::string& location) {
   DexClass* cls = new DexClass(idx, cdef, location);
   if (g_redex->class_already_loaded(cls)) {
-    // FIXME: This isn't deterministic. We're keeping whichever class we loaded
-    // first, which may not always be from the same dex (if we load them in
-    // parallel, for example).
+    // We keep whichever class got here first. DexLoader makes that the first
+    // definition in load order, even when loading in parallel.
     delete cls;
     return nullptr;
   }
@@ -1270,7 +1551,11 @@ void DexField::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
 
 void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
   gather_types_shallow(ltype); // Handle DexMethodRef parts.
-  if (m_code) m_code->gather_types(ltype);
+  if (auto code = get_code()) {
+    code->gather_types(ltype);
+  } else if (m_dex_code) {
+    m_dex_code->gather_types(ltype);
+  }
   if (m_anno) m_anno->gather_types(ltype);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1283,18 +1568,32 @@ void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
 
 void DexMethod::gather_callsites(std::vector<DexCallSite*>& lcallsite) const {
   // We handle m_spec.cls and proto in the first-layer gather.
-  if (m_code) m_code->gather_callsites(lcallsite);
+  if (auto code = get_code()) {
+    code->gather_callsites(lcallsite);
+  } else if (m_dex_code) {
+    m_dex_code->gather_callsites(lcallsite);
+  }
 }
 
 void DexMethod::gather_methodhandles(
     std::vector<DexMethodHandle*>& lmethodhandle) const {
   // We handle m_spec.cls and proto in the first-layer gather.
-  if (m_code) m_code->gather_methodhandles(lmethodhandle);
+  if (auto code = get_code()) {
+    code->gather_methodhandles(lmethodhandle);
+  } else if (m_dex_code) {
+    m_dex_code->gather_methodhandles(lmethodhandle);
+  }
 }
 void DexMethod::gather_strings(std::vector<DexString*>& lstring,
                                bool exclude_loads) const {
   // We handle m_name and proto in the first-layer gather.
-  if (m_code && !exclude_loads) m_code->gather_strings(lstring);
+  if (!exclude_loads) {
+    if (auto code = get_code()) {
+      code->gather_strings(lstring);
+    } else if (m_dex_code) {
+      m_dex_code->gather_strings(lstring);
+    }
+  }
   if (m_anno) m_anno->gather_strings(lstring);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1306,7 +1605,11 @@ void DexMethod::gather_strings(std::vector<DexString*>& lstring,
 }
 
 void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
-  if (m_code) m_code->gather_fields(lfield);
+  if (auto code = get_code()) {
+    code->gather_fields(lfield);
+  } else if (m_dex_code) {
+    m_dex_code->gather_fields(lfield);
+  }
   if (m_anno) m_anno->gather_fields(lfield);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1318,7 +1621,11 @@ void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
 }
 
 void DexMethod::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
-  if (m_code) m_code->gather_methods(lmethod);
+  if (auto code = get_code()) {
+    code->gather_methods(lmethod);
+  } else if (m_dex_code) {
+    m_dex_code->gather_methods(lmethod);
+  }
   if (m_anno) m_anno->gather_methods(lmethod);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1366,6 +1673,52 @@ uint32_t DexCode::size() const {
   return size;
 }
 
+void DexCode::gather_types(std::vector<DexType*>& ltype) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_types(ltype);
+  }
+  for (const auto& tri : m_tries) {
+    for (const auto& catch_pair : tri->m_catches) {
+      if (catch_pair.first != nullptr) {
+        ltype.push_back(catch_pair.first);
+      }
+    }
+  }
+  if (m_dbg) m_dbg->gather_types(ltype);
+}
+
+void DexCode::gather_strings(std::vector<DexString*>& lstring) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_strings(lstring);
+  }
+  if (m_dbg) m_dbg->gather_strings(lstring);
+}
+
+void DexCode::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_fields(lfield);
+  }
+}
+
+void DexCode::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_methods(lmethod);
+  }
+}
+
+void DexCode::gather_callsites(std::vector<DexCallSite*>& lcallsite) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_callsites(lcallsite);
+  }
+}
+
+void DexCode::gather_methodhandles(
+    std::vector<DexMethodHandle*>& lmethodhandle) const {
+  for (auto insn : get_instructions()) {
+    insn->gather_methodhandles(lmethodhandle);
+  }
+}
+
 DexProto* DexType::get_non_overlapping_proto(DexString* method_name,
                                              DexProto* orig_proto) {
   auto methodref_in_context =
@@ -1430,6 +1783,31 @@ void IRInstruction::gather_types(std::vector<DexType*>& ltype) const {
   }
 }
 
+namespace {
+
+// The references gathered by one worker of gather_components().
+struct GatheredComponents {
+  std::vector<DexString*> strings;
+  std::vector<DexType*> types;
+  std::vector<DexFieldRef*> fields;
+  std::vector<DexMethodRef*> methods;
+  std::vector<DexCallSite*> callsites;
+  std::vector<DexMethodHandle*> methodhandles;
+};
+
+template <class T>
+void parallel_sort_unique(std::vector<T>& vec) {
+  redex_parallel::sort(vec.begin(), vec.end(), std::less<T>());
+  vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+}
+
+template <class T>
+void append(std::vector<T>& vec, const std::vector<T>& elements) {
+  vec.insert(vec.end(), elements.begin(), elements.end());
+}
+
+} // namespace
+
 void gather_components(std::vector<DexString*>& lstring,
                        std::vector<DexType*>& ltype,
                        std::vector<DexFieldRef*>& lfield,
@@ -1438,40 +1816,66 @@ void gather_components(std::vector<DexString*>& lstring,
                        std::vector<DexMethodHandle*>& lmethodhandle,
                        const DexClasses& classes,
                        bool exclude_loads) {
-  // Gather references reachable from each class.
-  for (auto const& cls : classes) {
-    cls->gather_strings(lstring, exclude_loads);
-    cls->gather_types(ltype);
-    cls->gather_fields(lfield);
-    cls->gather_methods(lmethod);
-    cls->gather_callsites(lcallsite);
-    cls->gather_methodhandles(lmethodhandle);
-  }
+  // Gather references reachable from each class, into vectors of each worker.
+  auto num_threads = redex_parallel::default_num_threads();
+  WorkerLocal<GatheredComponents> gathered(num_threads);
+  redex_parallel::parallel_for(
+      0, classes.size(),
+      [&](size_t i) {
+        auto& local = gathered.get();
+        auto const& cls = classes[i];
+        cls->gather_strings(local.strings, exclude_loads);
+        cls->gather_types(local.types);
+        cls->gather_fields(local.fields);
+        cls->gather_methods(local.methods);
+        cls->gather_callsites(local.callsites);
+        cls->gather_methodhandles(local.methodhandles);
+      },
+      num_threads, /* chunk_size */ 16);
+
+  // Remove the duplicates of each worker before merging them.
+  redex_parallel::parallel_for(0, num_threads, [&](size_t worker) {
+    auto& local = gathered[worker];
+    sort_unique(local.strings);
+    sort_unique(local.types);
+    sort_unique(local.fields);
+    sort_unique(local.methods);
+    sort_unique(local.callsites);
+    sort_unique(local.methodhandles);
+  });
+  gathered.for_each([&](const GatheredComponents& local) {
+    append(lstring, local.strings);
+    append(ltype, local.types);
+    append(lfield, local.fields);
+    append(lmethod, local.methods);
+    append(lcallsite, local.callsites);
+    append(lmethodhandle, local.methodhandles);
+  });
 
   // Remove duplicates to speed up the later loops.
-  sort_unique(lstring);
-  sort_unique(ltype);
-  sort_unique(lmethodhandle);
-  sort_unique(lcallsite);
+  parallel_sort_unique(lstring);
+  parallel_sort_unique(ltype);
+  parallel_sort_unique(lmethodhandle);
+  parallel_sort_unique(lcallsite);
 
   // Gather types and strings needed for field and method refs.
-  sort_unique(lmethod);
+  parallel_sort_unique(lmethod);
   for (auto meth : lmethod) {
     meth->gather_types_shallow(ltype);
     meth->gather_strings_shallow(lstring);
   }
 
-  sort_unique(lfield);
+  parallel_sort_unique(lfield);
   for (auto field : lfield) {
     field->gather_types_shallow(ltype);
     field->gather_strings_shallow(lstring);
   }
 
   // Gather strings needed for each type.
-  sort_unique(ltype);
+  parallel_sort_unique(ltype);
   for (auto type : ltype) {
     if (type) lstring.push_back(type->get_name());
   }
 
-  sort_unique(lstring);
+  parallel_sort_unique(lstring);
 }
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -68,15 +69,46 @@ extern "C" bool strcmp_less(const char* str1, const char* str2);
 class DexString {
   friend struct RedexContext;
 
-  std::string m_storage;
+  // The contents of a mapped string are not copied into m_storage until
+  // str() is first called. While the copy is being made, kCopying is set as
+  // well.
+  static constexpr uint32_t kMapped = 1u << 31;
+  static constexpr uint32_t kCopying = 1u << 30;
+  static constexpr uint32_t kSizeMask = kCopying - 1;
+
+  // Null-terminated contents: either m_storage, or the string data of a dex
+  // file that stays mapped for the lifetime of the RedexContext.
+  const char* m_data;
+  mutable std::atomic<uint32_t> m_size_and_state;
   uint32_t m_utfsize;
+  size_t m_hash;
+  mutable std::string m_storage;
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
-  DexString(std::string nstr, uint32_t utfsize)
-      : m_storage(std::move(nstr)), m_utfsize(utfsize) {}
+  DexString(std::string nstr, uint32_t utfsize, size_t hash)
+      : m_size_and_state(static_cast<uint32_t>(nstr.size())),
+        m_utfsize(utfsize),
+        m_hash(hash),
+        m_storage(std::move(nstr)) {
+    m_data = m_storage.c_str();
+  }
+
+  DexString(const char* mapped, uint32_t size, uint32_t utfsize, size_t hash)
+      : m_data(mapped),
+        m_size_and_state(size | kMapped),
+        m_utfsize(utfsize),
+        m_hash(hash) {}
+
+  const std::string& copy_mapped() const;
 
  public:
-  uint32_t size() const { return static_cast<uint32_t>(m_storage.size()); }
+  uint32_t size() const {
+    return m_size_and_state.load(std::memory_order_relaxed) & kSizeMask;
+  }
+
+  // Hash of the contents, as computed when the string was interned. Unlike
+  // java_hashcode(), this is not stable across Redex versions.
+  size_t hash() const { return m_hash; }
 
   // UTF-aware length
   uint32_t length() const;
@@ -99,6 +131,13 @@ class DexString {
     return make_string(nstr.c_str());
   }
 
+  // Like make_string, but a new DexString refers to `nstr` instead of copying
+  // it. `nstr` must outlive the RedexContext; see
+  // RedexContext::retain_dex_mapping().
+  static DexString* make_mapped_string(const char* nstr, uint32_t utfsize) {
+    return g_redex->make_string(nstr, utfsize, /* mapped */ true);
+  }
+
   // Return an existing DexString or nullptr if one does not exist.
   static DexString* get_string(const char* nstr, uint32_t utfsize) {
     return g_redex->get_string(nstr, utfsize);
@@ -115,8 +154,18 @@ class DexString {
  public:
   bool is_simple() const { return size() == m_utfsize; }
 
-  const char* c_str() const { return m_storage.c_str(); }
-  const std::string& str() const { return m_storage; }
+  const char* c_str() const { return m_data; }
+  const std::string& str() const {
+    if (m_size_and_state.load(std::memory_order_acquire) & kMapped) {
+      return copy_mapped();
+    }
+    return m_storage;
+  }
+
+  // Whether the contents still live in a mapped dex file only.
+  bool is_mapped() const {
+    return m_size_and_state.load(std::memory_order_acquire) & kMapped;
+  }
 
   uint32_t get_entry_size() const {
     uint32_t len = uleb128_encoding_size(m_utfsize);
@@ -182,6 +231,8 @@ class DexType {
   friend struct RedexContext;
 
   DexString* m_name;
+  // See RedexContext::num_type_ids().
+  uint32_t m_id{0};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexType(DexString* dstring) { m_name = dstring; }
@@ -226,6 +277,7 @@ class DexType {
   DexString* get_name() const { return m_name; }
   const char* c_str() const { return get_name()->c_str(); }
   const std::string& str() const { return get_name()->str(); }
+  uint32_t get_id() const { return m_id; }
   DexProto* get_non_overlapping_proto(DexString*, DexProto*);
 };
 
@@ -263,6 +315,8 @@ class DexFieldRef {
   DexFieldSpec m_spec;
   bool m_concrete;
   bool m_external;
+  // See RedexContext::num_field_ids().
+  uint32_t m_id{0};
 
   ~DexFieldRef() {}
   DexFieldRef(DexType* container, DexString* name, DexType* type) {
@@ -285,6 +339,7 @@ class DexFieldRef {
   const char* c_str() const { return get_name()->c_str(); }
   const std::string& str() const { return get_name()->str(); }
   DexType* get_type() const { return m_spec.type; }
+  uint32_t get_id() const { return m_id; }
 
   void gather_types_shallow(std::vector<DexType*>& ltype) const;
   void gather_strings_shallow(std::vector<DexString*>& lstring) const;
@@ -680,6 +735,14 @@ std::vector<std::unique_ptr<DexDebugInstruction>> generate_debug_instructions(
     uint32_t* line_start,
     std::vector<DebugLineItem>* line_info);
 
+/*
+ * Registers the positions of `debugitem` with `pos_mapper` and maps them to
+ * lines, making the same calls in the same order as
+ * generate_debug_instructions() would. Returns the lines, in order.
+ */
+std::vector<uint32_t> map_debug_positions(DexDebugItem* debugitem,
+                                          PositionMapper* pos_mapper);
+
 typedef std::vector<std::pair<DexType*, uint32_t>> DexCatches;
 
 struct DexTryItem {
@@ -703,6 +766,8 @@ class DexCode {
   uint16_t m_registers_size;
   uint16_t m_ins_size;
   uint16_t m_outs_size;
+  // Where the instructions of lowered code live, if they were pooled.
+  std::unique_ptr<DexInstructionPool> m_insn_pool;
   std::unique_ptr<std::vector<DexInstruction*>> m_insns;
   std::vector<std::unique_ptr<DexTryItem>> m_tries;
   std::unique_ptr<DexDebugItem> m_dbg;
@@ -723,7 +788,7 @@ class DexCode {
   ~DexCode() {
     if (m_insns) {
       for (auto const& op : *m_insns) {
-        delete op;
+        DexInstruction::destroy(op);
       }
     }
   }
@@ -755,6 +820,10 @@ class DexCode {
   void set_instructions(std::vector<DexInstruction*>* insns) {
     m_insns.reset(insns);
   }
+  // Takes over the pool that (some of) the instructions were allocated from.
+  void set_instruction_pool(std::unique_ptr<DexInstructionPool> pool) {
+    m_insn_pool = std::move(pool);
+  }
   std::vector<std::unique_ptr<DexTryItem>>& get_tries() { return m_tries; }
   const std::vector<std::unique_ptr<DexTryItem>>& get_tries() const {
     return m_tries;
@@ -780,6 +849,17 @@ class DexCode {
    */
   uint32_t size() const;
 
+  /*
+   * The references of code that was never ballooned, like those of the IRCode
+   * it would balloon to.
+   */
+  void gather_types(std::vector<DexType*>& ltype) const;
+  void gather_strings(std::vector<DexString*>& lstring) const;
+  void gather_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
+  void gather_callsites(std::vector<DexCallSite*>& lcallsite) const;
+  void gather_methodhandles(std::vector<DexMethodHandle*>& lmethodhandle) const;
+
   friend std::string show(const DexCode*);
 };
 
@@ -806,6 +886,8 @@ class DexMethodRef {
   DexMethodSpec m_spec;
   bool m_concrete;
   bool m_external;
+  // See RedexContext::num_method_ids().
+  uint32_t m_id{0};
 
   ~DexMethodRef() {}
   DexMethodRef(DexType* type, DexString* name, DexProto* proto)
@@ -826,6 +908,7 @@ class DexMethodRef {
   const char* c_str() const { return get_name()->c_str(); }
   const std::string& str() const { return get_name()->str(); }
   DexProto* get_proto() const { return m_spec.proto; }
+  uint32_t get_id() const { return m_id; }
 
   void gather_types_shallow(std::vector<DexType*>& ltype) const;
   void gather_strings_shallow(std::vector<DexString*>& lstring) const;
@@ -858,6 +941,12 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* m_anno;
   std::unique_ptr<DexCode> m_dex_code;
   std::unique_ptr<IRCode> m_code;
+  // Set while m_dex_code has yet to be ballooned into m_code; see
+  // balloon_lazily().
+  std::atomic<bool> m_balloon_pending{false};
+  // The IRCode::modified_epoch() of the code that m_dex_code was synced from,
+  // for the code it gets ballooned into.
+  size_t m_synced_epoch{0};
   DexAccessFlags m_access;
   bool m_virtual;
   ParamAnnotations m_param_anno;
@@ -867,11 +956,6 @@ class DexMethod : public DexMethodRef {
   DexMethod(DexType* type, DexString* name, DexProto* proto);
   ~DexMethod();
 
-  // For friend classes to use with smart pointers.
-  struct Deleter {
-    void operator()(DexMethod* m) { delete m; }
-  };
-
  public:
   // Tracks whether this method can be deleted or renamed
   ReferencedState rstate;
@@ -962,8 +1046,14 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* get_anno_set() { return m_anno; }
   const DexCode* get_dex_code() const { return m_dex_code.get(); }
   DexCode* get_dex_code() { return m_dex_code.get(); }
-  IRCode* get_code() { return m_code.get(); }
-  const IRCode* get_code() const { return m_code.get(); }
+  IRCode* get_code() {
+    balloon_if_pending();
+    return m_code.get();
+  }
+  const IRCode* get_code() const {
+    balloon_if_pending();
+    return m_code.get();
+  }
   std::unique_ptr<IRCode> release_code();
   bool is_virtual() const { return m_virtual; }
   DexAccessFlags get_access() const {
@@ -1005,6 +1095,7 @@ class DexMethod : public DexMethodRef {
     always_assert_log(!m_external, "Unexpected external method %s\n",
                       SHOW(this));
     m_virtual = is_virtual;
+    g_redex->report_class_hierarchy_change();
   }
 
   void set_external() {
@@ -1087,6 +1178,24 @@ class DexMethod : public DexMethodRef {
    */
   void balloon();
   void sync();
+
+  /*
+   * Defers ballooning to the first time the code is accessed through
+   * get_code(), so that the IR of methods that no pass looks at is never
+   * materialized. Until then, the method keeps its DexCode.
+   */
+  void balloon_lazily();
+  bool is_balloon_pending() const {
+    return m_balloon_pending.load(std::memory_order_acquire);
+  }
+
+ private:
+  void balloon_if_pending() const {
+    if (is_balloon_pending()) {
+      const_cast<DexMethod*>(this)->balloon_pending_code();
+    }
+  }
+  void balloon_pending_code();
 };
 
 using dexcode_to_offset = std::unordered_map<DexCode*, uint32_t>;
@@ -1107,6 +1216,9 @@ class DexClass {
   std::vector<DexField*> m_ifields;
   std::vector<DexMethod*> m_dmethods;
   std::vector<DexMethod*> m_vmethods;
+  // Lookup index of the members of large classes, see find_vmethod().
+  struct MemberIndex;
+  mutable std::shared_ptr<const MemberIndex> m_member_index;
 
   DexClass(const std::string& location) : m_location(location){};
   void load_class_annotations(DexIdx* idx, uint32_t anno_off);
@@ -1170,6 +1282,8 @@ class DexClass {
   }
 
   void add_method(DexMethod* m);
+  // Adds many methods at once, which is cheaper than adding them one by one.
+  void add_methods(const std::vector<DexMethod*>& methods);
   // Removes the method from this class
   void remove_method(const DexMethod* m);
   const std::vector<DexField*>& get_sfields() const { return m_sfields; }
@@ -1183,10 +1297,26 @@ class DexClass {
     return m_ifields;
   }
   void add_field(DexField* f);
+  // Adds many fields at once, which is cheaper than adding them one by one.
+  void add_fields(const std::vector<DexField*>& fields);
   // Removes the field from this class
   void remove_field(const DexField* f);
   DexField* find_field(const char* name, const DexType* field_type) const;
 
+  /*
+   * The member of this class (not of its superclasses) with the given name
+   * and proto or type, or nullptr. Small classes are scanned; large ones
+   * (R classes, generated models) are looked up by binary search in an index
+   * that is built on first use and rebuilt after the class hierarchy changes
+   * (see RedexContext::report_class_hierarchy_change()) or members are added
+   * or removed. As passes may also edit the member vectors directly, misses
+   * in the index fall back to a scan.
+   */
+  DexMethod* find_vmethod(const DexString* name, const DexProto* proto) const;
+  DexMethod* find_dmethod(const DexString* name, const DexProto* proto) const;
+  DexField* find_ifield(const DexString* name, const DexType* type) const;
+  DexField* find_sfield(const DexString* name, const DexType* type) const;
+
   DexAnnotationDirectory* get_annotation_directory();
   DexAccessFlags get_access() const { return m_access_flags; }
   DexType* get_super_class() const { return m_super_class; }
@@ -1221,12 +1351,14 @@ class DexClass {
     always_assert_log(!m_external, "Unexpected external class %s\n",
                       SHOW(m_self));
     m_access_flags = access;
+    g_redex->report_class_hierarchy_change();
   }
 
   void set_super_class(DexType* super_class) {
     always_assert_log(!m_external, "Unexpected external class %s\n",
                       SHOW(m_self));
     m_super_class = super_class;
+    g_redex->report_class_hierarchy_change();
   }
 
   void combine_annotations_with(DexClass* other) {
@@ -1244,6 +1376,7 @@ class DexClass {
     always_assert_log(!m_external, "Unexpected external class %s\n",
                       SHOW(m_self));
     m_interfaces = intfs;
+    g_redex->report_class_hierarchy_change();
   }
 
   void clear_annotations() {
@@ -1277,6 +1410,10 @@ class DexClass {
  private:
   void sort_methods();
   void sort_fields();
+  std::shared_ptr<const MemberIndex> get_member_index() const;
+  // Drops the index when the members change, whether or not the change is
+  // reported to the class hierarchy.
+  void invalidate_member_index();
 };
 
 inline bool compare_dexclasses(const DexClass* a, const DexClass* b) {
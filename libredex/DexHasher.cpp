@@ -14,9 +14,115 @@
 #include "IROpcode.h"
 #include "Show.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace hashing {
 
+namespace {
+
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl(acc, 31);
+  return acc * PRIME64_1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t lane) {
+  acc ^= xxh_round(0, lane);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+inline void consume_stripe(uint64_t (&lanes)[4], const uint8_t* p) {
+  lanes[0] = xxh_round(lanes[0], read64(p));
+  lanes[1] = xxh_round(lanes[1], read64(p + 8));
+  lanes[2] = xxh_round(lanes[2], read64(p + 16));
+  lanes[3] = xxh_round(lanes[3], read64(p + 24));
+}
+
+} // namespace
+
+StreamingHash::StreamingHash()
+    : m_lanes{PRIME64_1 + PRIME64_2, PRIME64_2, 0, 0 - PRIME64_1} {}
+
+void StreamingHash::update(const void* data, size_t size) {
+  auto p = static_cast<const uint8_t*>(data);
+  auto end = p + size;
+  m_total_size += size;
+  if (m_buffered + size < sizeof(m_buffer)) {
+    memcpy(m_buffer + m_buffered, p, size);
+    m_buffered += size;
+    return;
+  }
+  if (m_buffered > 0) {
+    auto fill = sizeof(m_buffer) - m_buffered;
+    memcpy(m_buffer + m_buffered, p, fill);
+    consume_stripe(m_lanes, m_buffer);
+    p += fill;
+    m_buffered = 0;
+  }
+  for (; p + sizeof(m_buffer) <= end; p += sizeof(m_buffer)) {
+    consume_stripe(m_lanes, p);
+  }
+  m_buffered = end - p;
+  memcpy(m_buffer, p, m_buffered);
+}
+
+uint64_t StreamingHash::digest() const {
+  uint64_t h;
+  if (m_total_size >= sizeof(m_buffer)) {
+    h = rotl(m_lanes[0], 1) + rotl(m_lanes[1], 7) + rotl(m_lanes[2], 12) +
+        rotl(m_lanes[3], 18);
+    for (auto lane : m_lanes) {
+      h = merge_round(h, lane);
+    }
+  } else {
+    h = m_lanes[2] + PRIME64_5;
+  }
+  h += m_total_size;
+
+  auto p = m_buffer;
+  auto end = m_buffer + m_buffered;
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh_round(0, read64(p));
+    h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= read32(p) * PRIME64_1;
+    h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * PRIME64_5;
+    h = rotl(h, 11) * PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
 std::string hash_to_string(size_t hash) {
   std::ostringstream result;
   result << std::hex << std::setfill('0') << std::setw(sizeof(size_t) * 2)
@@ -24,57 +130,68 @@ std::string hash_to_string(size_t hash) {
   return result.str();
 }
 
+size_t hash_code(const IRCode* code) {
+  DexClassHasher hasher(nullptr);
+  hasher.hash(code);
+  StreamingHash hash;
+  hash.update(hasher.m_code_hash.digest());
+  hash.update(hasher.m_registers_hash.digest());
+  return hash.digest();
+}
+
 DexHash DexScopeHasher::run() {
-  std::unordered_map<DexClass*, size_t> class_indices;
-  walk::classes(m_scope, [&](DexClass* cls) {
-    class_indices.emplace(cls, class_indices.size());
-  });
-  std::vector<size_t> class_registers_hashes(class_indices.size());
-  std::vector<size_t> class_code_hashes(class_indices.size());
-  std::vector<size_t> class_signature_hashes(class_indices.size());
-  walk::parallel::classes(m_scope, [&](DexClass* cls) {
-    DexClassHasher class_hasher(cls);
-    DexHash class_hash = class_hasher.run();
-    auto index = class_indices.at(cls);
-    class_registers_hashes.at(index) = class_hash.registers_hash;
-    class_code_hashes.at(index) = class_hash.code_hash;
-    class_signature_hashes.at(index) = class_hash.signature_hash;
+  std::vector<DexHash> class_hashes(m_scope.size());
+  redex_parallel::parallel_for(0, m_scope.size(), [&](size_t i) {
+    class_hashes[i] = DexClassHasher(m_scope[i]).run();
   });
 
-  return DexHash{boost::hash_value(class_registers_hashes),
-                 boost::hash_value(class_code_hashes),
-                 boost::hash_value(class_signature_hashes)};
+  // The classes are combined in scope order, whichever thread hashed them.
+  StreamingHash registers_hash;
+  StreamingHash code_hash;
+  StreamingHash signature_hash;
+  for (const auto& class_hash : class_hashes) {
+    registers_hash.update(class_hash.registers_hash);
+    code_hash.update(class_hash.code_hash);
+    signature_hash.update(class_hash.signature_hash);
+  }
+  return DexHash{registers_hash.digest(), code_hash.digest(),
+                 signature_hash.digest()};
+}
+
+void DexClassHasher::hash(const char* str, size_t size) {
+  TRACE(HASHER, 4, "[hasher] %s", str);
+  m_current->update(size);
+  m_current->update(str, size);
 }
 
 void DexClassHasher::hash(const std::string& str) {
-  TRACE(HASHER, 4, "[hasher] %s", str.c_str());
-  boost::hash_combine(m_hash, str);
+  hash(str.c_str(), str.size());
 }
 
-void DexClassHasher::hash(const DexString* s) { hash(s->str()); }
+void DexClassHasher::hash(const DexString* s) { hash(s->c_str(), s->size()); }
 
 void DexClassHasher::hash(bool value) {
   TRACE(HASHER, 4, "[hasher] %u", value);
-  boost::hash_combine(m_hash, value);
+  m_current->update(value);
 }
 void DexClassHasher::hash(uint8_t value) {
   TRACE(HASHER, 4, "[hasher] %u", value);
-  boost::hash_combine(m_hash, value);
+  m_current->update(value);
 }
 
 void DexClassHasher::hash(uint16_t value) {
   TRACE(HASHER, 4, "[hasher] %u", value);
-  boost::hash_combine(m_hash, value);
+  m_current->update(value);
 }
 
 void DexClassHasher::hash(uint32_t value) {
   TRACE(HASHER, 4, "[hasher] %u", value);
-  boost::hash_combine(m_hash, value);
+  m_current->update(value);
 }
 
 void DexClassHasher::hash(uint64_t value) {
   TRACE(HASHER, 4, "[hasher] %lu", value);
-  boost::hash_combine(m_hash, value);
+  m_current->update(value);
 }
 
 void DexClassHasher::hash(int value) { hash((uint)value); }
@@ -82,14 +199,13 @@ void DexClassHasher::hash(int value) { hash((uint)value); }
 void DexClassHasher::hash(const IRInstruction* insn) {
   hash((uint16_t)insn->opcode());
 
-  auto old_hash = m_hash;
-  m_hash = 0;
+  auto old_current = m_current;
+  m_current = &m_registers_hash;
   hash(insn->srcs_vec());
   if (insn->has_dest()) {
     hash(insn->dest());
   }
-  boost::hash_combine(m_registers_hash, m_hash);
-  m_hash = old_hash;
+  m_current = old_current;
 
   if (insn->has_literal()) {
     hash((uint64_t)insn->get_literal());
@@ -119,8 +235,8 @@ void DexClassHasher::hash(const IRCode* c) {
     return;
   }
 
-  auto old_hash = m_hash;
-  m_hash = 0;
+  auto old_current = m_current;
+  m_current = &m_code_hash;
 
   std::unordered_map<MethodItemEntry*, uint32_t> ids;
   auto get_id = [&ids](MethodItemEntry* mie) {
@@ -169,8 +285,7 @@ void DexClassHasher::hash(const IRCode* c) {
     }
   }
 
-  boost::hash_combine(m_code_hash, m_hash);
-  m_hash = old_hash;
+  m_current = old_current;
 }
 
 void DexClassHasher::hash(const DexProto* p) {
@@ -315,7 +430,8 @@ DexHash DexClassHasher::run() {
   TRACE(HASHER, 3, "[hasher] === ifields: %zu", m_cls->get_ifields().size());
   hash(m_cls->get_ifields());
 
-  return DexHash{m_registers_hash, m_code_hash, m_hash};
+  return DexHash{m_registers_hash.digest(), m_code_hash.digest(),
+                 m_hash.digest()};
 }
 
 } // namespace hashing
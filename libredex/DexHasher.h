@@ -9,7 +9,7 @@
  * This hashing functionality captures all details of a scope. By running this
  * after each pass, it makes it easy to find non-determinism build-over-build.
  * Look for the ~result~hash~ info that's added to each pass metrics.
- * We use boost hashes for performance.
+ * The details are streamed through a 64-bit XXH64 hash for performance.
  *
  */
 
@@ -29,6 +29,38 @@ namespace hashing {
 
 std::string hash_to_string(size_t hash);
 
+/*
+ * Streaming XXH64. Bytes are buffered into 32-byte stripes, each of which goes
+ * through four independent lanes.
+ */
+class StreamingHash final {
+ public:
+  StreamingHash();
+
+  void update(const void* data, size_t size);
+
+  template <typename T>
+  void update(T value) {
+    update(&value, sizeof(T));
+  }
+
+  uint64_t digest() const;
+
+ private:
+  uint64_t m_lanes[4];
+  uint64_t m_total_size{0};
+  uint8_t m_buffer[32];
+  size_t m_buffered{0};
+};
+
+/*
+ * Hashes the instructions of `code`, along with their registers and the
+ * structure of the try/catch regions. Like the other hashes here, this only
+ * depends on the names of the referenced classes and members, so it is stable
+ * across runs.
+ */
+size_t hash_code(const IRCode* code);
+
 struct DexHash {
   size_t registers_hash;
   size_t code_hash;
@@ -50,6 +82,7 @@ class DexClassHasher final {
   DexHash run();
 
  private:
+  void hash(const char* str, size_t size);
   void hash(const std::string& str);
   void hash(int value);
   void hash(uint64_t value);
@@ -95,10 +128,14 @@ class DexClassHasher final {
       hash(p.second);
     }
   }
+  friend size_t hash_code(const IRCode* code);
+
   DexClass* m_cls;
-  size_t m_hash{0};
-  size_t m_code_hash{0};
-  size_t m_registers_hash{0};
+  StreamingHash m_hash;
+  StreamingHash m_code_hash;
+  StreamingHash m_registers_hash;
+  // Where the hash() overloads write to, one of the above.
+  StreamingHash* m_current{&m_hash};
 };
 
 } // namespace hashing
@@ -27,6 +27,7 @@ class DexMethodHandle;
 class DexIdx {
  private:
   const uint8_t* m_dexbase;
+  bool m_map_strings;
 
   dex_string_id* m_string_ids;
   uint32_t m_string_ids_size;
@@ -60,9 +61,13 @@ class DexIdx {
   DexMethodHandle* get_methodhandleidx_fromdex(uint32_t mhidx);
 
  public:
-  explicit DexIdx(const dex_header* dh);
+  // With `map_strings`, new DexStrings refer to the string data of the dex,
+  // which must then outlive the RedexContext.
+  explicit DexIdx(const dex_header* dh, bool map_strings = false);
   ~DexIdx();
 
+  bool maps_strings() const { return m_map_strings; }
+
   DexString* get_stringidx(uint32_t stridx) {
     if (m_string_cache[stridx] == nullptr) {
       m_string_cache[stridx] = get_stringidx_fromdex(stridx);
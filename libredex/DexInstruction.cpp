@@ -14,6 +14,10 @@
 #include "DexOutput.h"
 #include "Warning.h"
 
+#include <algorithm>
+#include <array>
+#include <memory>
+
 unsigned DexInstruction::count_from_opcode() const {
   static int args[] = {
       0, /* FMT_f00x   */
@@ -770,30 +774,32 @@ void DexInstruction::encode(DexOutputIdx* dodx, uint16_t*& insns) {
 
 uint16_t DexInstruction::size() const { return m_count + 1; }
 
-DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
-                                                 const uint16_t** insns_ptr) {
-  auto& insns = *insns_ptr;
-  auto fopcode = static_cast<DexOpcode>(*insns++);
-  DexOpcode opcode = static_cast<DexOpcode>(fopcode & 0xff);
+namespace {
+
+/*
+ * How make_instruction() decodes an opcode: the number of code units that
+ * follow it and the kind of index they hold, if any.
+ */
+enum class DecodeKind : uint8_t {
+  UNKNOWN,
+  FMT10,
+  FMT20,
+  FMT30,
+  FMT50,
+  FIELD,
+  METHOD,
+  METHODHANDLE,
+  CALLSITE,
+  STRING,
+  STRING_JUMBO,
+  TYPE,
+  TYPE_ARG,
+};
+
+DecodeKind decode_kind(DexOpcode opcode) {
   switch (opcode) {
-  case DOPCODE_NOP: {
-    if (fopcode == FOPCODE_PACKED_SWITCH) {
-      int count = (*insns--) * 2 + 4;
-      insns += count;
-      return new DexOpcodeData(insns - count, count - 1);
-    } else if (fopcode == FOPCODE_SPARSE_SWITCH) {
-      int count = (*insns--) * 4 + 2;
-      insns += count;
-      return new DexOpcodeData(insns - count, count - 1);
-    } else if (fopcode == FOPCODE_FILLED_ARRAY) {
-      uint16_t ewidth = *insns++;
-      uint32_t size = *((uint32_t*)insns);
-      int count = (ewidth * size + 1) / 2 + 4;
-      insns += count - 2;
-      return new DexOpcodeData(insns - count, count - 1);
-    }
-  }
-  /* Format 10, fall through for NOP */
+  case DOPCODE_NOP:
+  /* Format 10 */
   case DOPCODE_MOVE:
   case DOPCODE_MOVE_WIDE:
   case DOPCODE_MOVE_OBJECT:
@@ -864,7 +870,7 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
   case DOPCODE_DIV_DOUBLE_2ADDR:
   case DOPCODE_REM_DOUBLE_2ADDR:
   case DOPCODE_ARRAY_LENGTH:
-    return new DexInstruction(fopcode);
+    return DecodeKind::FMT10;
   /* Format 20 */
   case DOPCODE_MOVE_FROM16:
   case DOPCODE_MOVE_WIDE_FROM16:
@@ -955,10 +961,8 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
   case DOPCODE_XOR_INT_LIT8:
   case DOPCODE_SHL_INT_LIT8:
   case DOPCODE_SHR_INT_LIT8:
-  case DOPCODE_USHR_INT_LIT8: {
-    uint16_t arg = *insns++;
-    return new DexInstruction(fopcode, arg);
-  }
+  case DOPCODE_USHR_INT_LIT8:
+    return DecodeKind::FMT20;
 
   /* Format 30 */
   case DOPCODE_MOVE_16:
@@ -969,15 +973,11 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
   case DOPCODE_FILL_ARRAY_DATA:
   case DOPCODE_GOTO_32:
   case DOPCODE_PACKED_SWITCH:
-  case DOPCODE_SPARSE_SWITCH: {
-    insns += 2;
-    return new DexInstruction(insns - 3, 2);
-  }
+  case DOPCODE_SPARSE_SWITCH:
+    return DecodeKind::FMT30;
   /* Format 50 */
-  case DOPCODE_CONST_WIDE: {
-    insns += 4;
-    return new DexInstruction(insns - 5, 4);
-  }
+  case DOPCODE_CONST_WIDE:
+    return DecodeKind::FMT50;
   /* Field ref: */
   case DOPCODE_IGET:
   case DOPCODE_IGET_WIDE:
@@ -1006,11 +1006,8 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
   case DOPCODE_SPUT_BOOLEAN:
   case DOPCODE_SPUT_BYTE:
   case DOPCODE_SPUT_CHAR:
-  case DOPCODE_SPUT_SHORT: {
-    uint16_t fidx = *insns++;
-    DexFieldRef* field = idx->get_fieldidx(fidx);
-    return new DexOpcodeField(fopcode, field);
-  }
+  case DOPCODE_SPUT_SHORT:
+    return DecodeKind::FIELD;
   /* MethodRef: */
   case DOPCODE_INVOKE_VIRTUAL:
   case DOPCODE_INVOKE_SUPER:
@@ -1021,60 +1018,142 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
   case DOPCODE_INVOKE_SUPER_RANGE:
   case DOPCODE_INVOKE_DIRECT_RANGE:
   case DOPCODE_INVOKE_STATIC_RANGE:
-  case DOPCODE_INVOKE_INTERFACE_RANGE: {
+  case DOPCODE_INVOKE_INTERFACE_RANGE:
+    return DecodeKind::METHOD;
+  /* MethodHandle: */
+  case DOPCODE_INVOKE_POLYMORPHIC:
+  case DOPCODE_INVOKE_POLYMORPHIC_RANGE:
+    return DecodeKind::METHODHANDLE;
+  /* CallSite: */
+  case DOPCODE_INVOKE_CUSTOM:
+  case DOPCODE_INVOKE_CUSTOM_RANGE:
+    return DecodeKind::CALLSITE;
+  /* StringRef: */
+  case DOPCODE_CONST_STRING:
+    return DecodeKind::STRING;
+  case DOPCODE_CONST_STRING_JUMBO:
+    return DecodeKind::STRING_JUMBO;
+  case DOPCODE_CONST_CLASS:
+  case DOPCODE_CHECK_CAST:
+  case DOPCODE_INSTANCE_OF:
+  case DOPCODE_NEW_INSTANCE:
+  case DOPCODE_NEW_ARRAY:
+    return DecodeKind::TYPE;
+  case DOPCODE_FILLED_NEW_ARRAY:
+  case DOPCODE_FILLED_NEW_ARRAY_RANGE:
+    return DecodeKind::TYPE_ARG;
+  default:
+    return DecodeKind::UNKNOWN;
+  }
+}
+
+
+/*
+ * The decode kinds of all 256 opcodes, computed once, so that decoding an
+ * instruction is a table load and a jump over a dozen dense cases rather than
+ * a search over the full opcode switch.
+ */
+const std::array<DecodeKind, 256>& decode_kinds() {
+  static const std::array<DecodeKind, 256> kinds = [] {
+    std::array<DecodeKind, 256> kinds;
+    for (size_t op = 0; op < kinds.size(); ++op) {
+      kinds[op] = decode_kind(static_cast<DexOpcode>(op));
+    }
+    return kinds;
+  }();
+  return kinds;
+}
+
+} // namespace
+
+DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
+                                                 const uint16_t** insns_ptr) {
+  const auto& kinds = decode_kinds();
+  auto& insns = *insns_ptr;
+  auto fopcode = static_cast<DexOpcode>(*insns++);
+  DexOpcode opcode = static_cast<DexOpcode>(fopcode & 0xff);
+  switch (kinds[opcode]) {
+  case DecodeKind::FMT10:
+    if (opcode == DOPCODE_NOP) {
+      if (fopcode == FOPCODE_PACKED_SWITCH) {
+        int count = (*insns--) * 2 + 4;
+        insns += count;
+        return new DexOpcodeData(insns - count, count - 1);
+      } else if (fopcode == FOPCODE_SPARSE_SWITCH) {
+        int count = (*insns--) * 4 + 2;
+        insns += count;
+        return new DexOpcodeData(insns - count, count - 1);
+      } else if (fopcode == FOPCODE_FILLED_ARRAY) {
+        uint16_t ewidth = *insns++;
+        uint32_t size = *((uint32_t*)insns);
+        int count = (ewidth * size + 1) / 2 + 4;
+        insns += count - 2;
+        return new DexOpcodeData(insns - count, count - 1);
+      }
+    }
+    return new DexInstruction(fopcode);
+  case DecodeKind::FMT20: {
+    uint16_t arg = *insns++;
+    return new DexInstruction(fopcode, arg);
+  }
+  case DecodeKind::FMT30: {
+    insns += 2;
+    return new DexInstruction(insns - 3, 2);
+  }
+  case DecodeKind::FMT50: {
+    insns += 4;
+    return new DexInstruction(insns - 5, 4);
+  }
+  case DecodeKind::FIELD: {
+    uint16_t fidx = *insns++;
+    DexFieldRef* field = idx->get_fieldidx(fidx);
+    return new DexOpcodeField(fopcode, field);
+  }
+  case DecodeKind::METHOD: {
     uint16_t midx = *insns++;
     uint16_t arg = *insns++;
     DexMethodRef* meth = idx->get_methodidx(midx);
     return new DexOpcodeMethod(fopcode, meth, arg);
   }
-  /* MethodHandle: */
-  case DOPCODE_INVOKE_POLYMORPHIC:
-  case DOPCODE_INVOKE_POLYMORPHIC_RANGE: {
+  case DecodeKind::METHODHANDLE: {
     uint16_t csidx = *insns++;
     uint16_t arg = *insns++;
     DexMethodHandle* methodhandle = idx->get_methodhandleidx(csidx);
     return new DexOpcodeMethodHandle(fopcode, methodhandle, arg);
   }
-  /* CallSite: */
-  case DOPCODE_INVOKE_CUSTOM:
-  case DOPCODE_INVOKE_CUSTOM_RANGE: {
+  case DecodeKind::CALLSITE: {
     uint16_t csidx = *insns++;
     uint16_t arg = *insns++;
     DexCallSite* callsite = idx->get_callsiteidx(csidx);
     return new DexOpcodeCallSite(fopcode, callsite, arg);
   }
-  /* StringRef: */
-  case DOPCODE_CONST_STRING: {
+  case DecodeKind::STRING: {
     uint16_t sidx = *insns++;
     DexString* str = idx->get_stringidx(sidx);
     return new DexOpcodeString(fopcode, str);
   }
-  case DOPCODE_CONST_STRING_JUMBO: {
+  case DecodeKind::STRING_JUMBO: {
     uint32_t sidx = *insns++;
     sidx |= (*insns++) << 16;
     DexString* str = idx->get_stringidx(sidx);
     return new DexOpcodeString(fopcode, str);
   }
-  case DOPCODE_CONST_CLASS:
-  case DOPCODE_CHECK_CAST:
-  case DOPCODE_INSTANCE_OF:
-  case DOPCODE_NEW_INSTANCE:
-  case DOPCODE_NEW_ARRAY: {
+  case DecodeKind::TYPE: {
     uint16_t tidx = *insns++;
     DexType* type = idx->get_typeidx(tidx);
     return new DexOpcodeType(fopcode, type);
   }
-  case DOPCODE_FILLED_NEW_ARRAY:
-  case DOPCODE_FILLED_NEW_ARRAY_RANGE: {
+  case DecodeKind::TYPE_ARG: {
     uint16_t tidx = *insns++;
     uint16_t arg = *insns++;
     DexType* type = idx->get_typeidx(tidx);
     return new DexOpcodeType(fopcode, type, arg);
   }
-  default:
-    fprintf(stderr, "Unknown opcode %02x\n", opcode);
-    return nullptr;
+  case DecodeKind::UNKNOWN:
+    break;
   }
+  fprintf(stderr, "Unknown opcode %02x\n", opcode);
+  return nullptr;
 }
 
 DexInstruction* DexInstruction::make_instruction(DexOpcode op) {
@@ -1187,3 +1266,35 @@ bool DexInstruction::operator==(const DexInstruction& that) const {
   }
   }
 }
+
+namespace {
+
+// Large enough for any pooled instruction.
+constexpr size_t kPooledInsnSize = sizeof(DexOpcodeMethod);
+constexpr size_t kMinPoolChunkSize = 256;
+
+} // namespace
+
+DexInstructionPool::DexInstructionPool(size_t expected_count)
+    : m_next_chunk_size(
+          std::max(expected_count * kPooledInsnSize, kMinPoolChunkSize)) {}
+
+void* DexInstructionPool::allocate(size_t size, size_t align) {
+  auto space = static_cast<size_t>(m_end - m_cur);
+  void* p = m_cur;
+  if (m_cur == nullptr || std::align(align, size, p, space) == nullptr) {
+    // The first chunk is sized for the whole method; lowering rarely adds
+    // more than a few instructions beyond that, so grow by small chunks.
+    auto chunk_size = std::max(m_next_chunk_size, size + align);
+    m_chunks.emplace_back(new char[chunk_size]);
+    m_cur = m_chunks.back().get();
+    m_end = m_cur + chunk_size;
+    m_next_chunk_size = kMinPoolChunkSize;
+    p = m_cur;
+    space = chunk_size;
+    p = std::align(align, size, p, space);
+    always_assert(p != nullptr);
+  }
+  m_cur = static_cast<char*>(p) + size;
+  return p;
+}
@@ -10,9 +10,11 @@
 #include <assert.h>
 #include <cstring>
 #include <list>
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "Debug.h"
 #include "DexDefs.h"
@@ -23,11 +25,12 @@
 #define MAX_ARG_COUNT (4)
 
 class DexIdx;
+class DexInstructionPool;
 class DexOutputIdx;
 
 class DexInstruction : public Gatherable {
  protected:
-  enum {
+  enum : uint8_t {
     REF_NONE,
     REF_STRING,
     REF_TYPE,
@@ -38,14 +41,31 @@ class DexInstruction : public Gatherable {
   } m_ref_type{REF_NONE};
 
  private:
+  // Whether the instruction lives in a DexInstructionPool rather than on the
+  // heap. Fits in the padding after m_ref_type.
+  bool m_pooled{false};
   uint16_t m_opcode = OPCODE_NOP;
   uint16_t m_arg[MAX_ARG_COUNT] = {};
 
  protected:
   uint16_t m_count = 0;
 
-  // use clone() instead
-  DexInstruction(const DexInstruction&) = default;
+  // use clone() instead. Copies are always heap-allocated.
+  DexInstruction(const DexInstruction& that)
+      : Gatherable(),
+        m_ref_type(that.m_ref_type),
+        m_opcode(that.m_opcode),
+        m_count(that.m_count) {
+    memcpy(m_arg, that.m_arg, sizeof(m_arg));
+  }
+
+  DexInstruction& operator=(const DexInstruction& that) {
+    m_ref_type = that.m_ref_type;
+    m_opcode = that.m_opcode;
+    memcpy(m_arg, that.m_arg, sizeof(m_arg));
+    m_count = that.m_count;
+    return *this;
+  }
 
   // Ref-less opcodes, largest size is 5 insns.
   // If the constructor is called with a non-numeric
@@ -94,6 +114,21 @@ class DexInstruction : public Gatherable {
   virtual DexInstruction* clone() const { return new DexInstruction(*this); }
   bool operator==(const DexInstruction&) const;
 
+  /*
+   * Use this rather than `delete` on instructions that may come from a
+   * DexInstructionPool, i.e. those of lowered code: their memory goes away
+   * with the pool.
+   */
+  static void destroy(DexInstruction* insn) {
+    if (insn == nullptr) {
+      return;
+    } else if (insn->m_pooled) {
+      insn->~DexInstruction();
+    } else {
+      delete insn;
+    }
+  }
+
   bool has_string() const { return m_ref_type == REF_STRING; }
   bool has_type() const { return m_ref_type == REF_TYPE; }
   bool has_field() const { return m_ref_type == REF_FIELD; }
@@ -142,6 +177,7 @@ class DexInstruction : public Gatherable {
   uint16_t count() { return m_count; }
 
   friend std::string show(const DexInstruction* op);
+  friend class DexInstructionPool;
 
  private:
   unsigned count_from_opcode() const;
@@ -362,6 +398,40 @@ DexOpcodeData* encode_fill_array_data_payload(const std::vector<IntType>& vec) {
   return new DexOpcodeData(data);
 }
 
+/*
+ * A bump allocator for the DexInstructions of one method, so that lowering
+ * doesn't pay for a heap allocation (and its header) per instruction. The
+ * memory of all the instructions goes away with the pool; they must be
+ * released with DexInstruction::destroy(), never deleted.
+ *
+ * Payloads aren't pooled: they own a data array, and IRInstructions take over
+ * their ownership when code is ballooned.
+ */
+class DexInstructionPool {
+ public:
+  // Sized for about `expected_count` instructions; it grows as needed.
+  explicit DexInstructionPool(size_t expected_count);
+
+  template <class T, class... Args>
+  T* make(Args&&... args) {
+    static_assert(std::is_base_of<DexInstruction, T>::value &&
+                      !std::is_base_of<DexOpcodeData, T>::value,
+                  "only payload-less instructions can be pooled");
+    auto* insn = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    insn->m_pooled = true;
+    return insn;
+  }
+
+ private:
+  void* allocate(size_t size, size_t align);
+
+  std::vector<std::unique_ptr<char[]>> m_chunks;
+  char* m_cur{nullptr};
+  char* m_end{nullptr};
+  size_t m_next_chunk_size;
+};
+
 /**
  * Return a copy of the instruction passed in.
  */
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "ConcurrentContainers.h"
 #include "DexAccess.h"
 #include "DexCallSite.h"
 #include "DexDefs.h"
@@ -17,6 +18,7 @@
 
 #include <exception>
 #include <stdexcept>
+#include <unordered_set>
 #include <vector>
 
 DexLoader::DexLoader(const char* location)
@@ -24,6 +26,14 @@ DexLoader::DexLoader(const char* location)
       m_file(new boost::iostreams::mapped_file()),
       m_dex_location(location) {}
 
+DexLoader::~DexLoader() {
+  // Strings loaded with RedexContext::map_dex_strings() point into the
+  // mapping of the dex.
+  if (m_idx != nullptr && m_idx->maps_strings()) {
+    g_redex->retain_dex_mapping(std::move(m_file));
+  }
+}
+
 static void validate_dex_header(const dex_header* dh,
                                 size_t dexsize,
                                 int support_dex_version) {
@@ -62,11 +72,6 @@ static void validate_dex_header(const dex_header* dh,
   always_assert_log(limit <= dexsize, "invalid class_defs_size");
 }
 
-struct class_load_work {
-  DexLoader* dl;
-  int num;
-};
-
 void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
   if (!stats) {
     return;
@@ -479,49 +484,124 @@ DexClasses DexLoader::load_dex(const char* location,
   return load_dex(dh, stats);
 }
 
-DexClasses DexLoader::load_dex(const dex_header* dh, dex_stats_t* stats) {
-  if (dh->class_defs_size == 0) {
-    return DexClasses(0);
-  }
-  m_idx = std::make_unique<DexIdx>(dh);
+void DexLoader::init_classes(const dex_header* dh, DexClasses* classes) {
+  // Only map the strings of dexes that this loader mapped itself, as it can
+  // keep the mapping alive.
+  bool map_strings = RedexContext::map_dex_strings() && m_file->is_open() &&
+                     m_file->const_data() == reinterpret_cast<const char*>(dh);
+  m_idx = std::make_unique<DexIdx>(dh, map_strings);
   auto off = (uint64_t)dh->class_defs_off;
   m_class_defs =
       reinterpret_cast<const dex_class_def*>((const uint8_t*)dh + off);
-  DexClasses classes(dh->class_defs_size);
-  m_classes = &classes;
+  classes->resize(dh->class_defs_size);
+  m_classes = classes;
+}
 
-  auto lwork = new class_load_work[dh->class_defs_size];
+/*
+ * Load the classes of the given dexes, all set up by init_classes(), as a
+ * single parallel job.
+ *
+ * Only the first definition of each type, in the order of the dexes and of
+ * their class defs, is loaded. Each class def claims its type concurrently,
+ * the earliest one winning, and the loading workers skip the class defs that
+ * lost. Those are duplicates, which we check afterwards (see
+ * RedexContext::class_already_loaded) against the definitions we keep. This
+ * makes both the surviving classes and the reported duplicates independent of
+ * thread scheduling.
+ */
+void DexLoader::load_classes(const std::vector<DexLoader*>& loaders) {
   auto num_threads = redex_parallel::default_num_threads();
-  std::vector<std::vector<std::exception_ptr>> exceptions_vec(num_threads);
-  auto wq = workqueue_foreach<class_load_work*>(
-      [&exceptions_vec](class_load_work* clw) {
+  auto ordinal = [](size_t dex, size_t def) -> uint64_t {
+    return (static_cast<uint64_t>(dex) << 32) | def;
+  };
+
+  // Resolving the type of a class def interns it. Do it one dex per task, so
+  // that each DexIdx's cache is only filled in by a single thread.
+  std::vector<std::vector<const DexType*>> def_types(loaders.size());
+  ConcurrentMap<const DexType*, uint64_t> first_defs;
+  auto types_wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        auto dl = loaders[i];
+        auto& types = def_types[i];
+        types.reserve(dl->m_classes->size());
+        for (size_t j = 0; j < dl->m_classes->size(); ++j) {
+          auto type = dl->m_idx->get_typeidx(dl->m_class_defs[j].typeidx);
+          types.push_back(type);
+          auto ord = ordinal(i, j);
+          first_defs.update(
+              type, [ord](const DexType*, uint64_t& first, bool exists) {
+                if (!exists || ord < first) {
+                  first = ord;
+                }
+              });
+        }
+      },
+      num_threads);
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    types_wq.add_item(i);
+  }
+  types_wq.run_all();
+
+  // Indexed like def_types.
+  std::vector<std::vector<uint8_t>> is_duplicate(loaders.size());
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    is_duplicate[i].resize(def_types[i].size());
+  }
+  WorkerLocal<std::vector<std::exception_ptr>> exceptions_vec(num_threads);
+  auto wq = workqueue_foreach<std::pair<size_t, size_t>>(
+      [&](std::pair<size_t, size_t> def) {
+        size_t i = def.first;
+        size_t j = def.second;
+        if (first_defs.at_unsafe(def_types[i][j]) != ordinal(i, j)) {
+          is_duplicate[i][j] = true;
+          return;
+        }
         try {
-          clw->dl->load_dex_class(clw->num);
+          loaders[i]->load_dex_class(j);
         } catch (const std::exception& exc) {
           TRACE(MAIN, 1, "Worker throw the exception:%s", exc.what());
-          exceptions_vec[redex_parallel::get_worker_id()].emplace_back(
-              std::current_exception());
+          exceptions_vec.get().emplace_back(std::current_exception());
         }
       },
       num_threads);
-  for (uint32_t i = 0; i < dh->class_defs_size; i++) {
-    lwork[i].dl = this;
-    lwork[i].num = i;
-    wq.add_item(&lwork[i]);
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    for (size_t j = 0; j < def_types[i].size(); ++j) {
+      wq.add_item(std::make_pair(i, j));
+    }
   }
   wq.run_all();
-  delete[] lwork;
 
   std::vector<std::exception_ptr> all_exceptions;
-  for (auto& exceptions : exceptions_vec) {
+  exceptions_vec.for_each([&](std::vector<std::exception_ptr>& exceptions) {
     all_exceptions.insert(
         all_exceptions.end(), exceptions.begin(), exceptions.end());
+  });
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    for (size_t j = 0; j < is_duplicate[i].size(); ++j) {
+      if (!is_duplicate[i][j]) {
+        continue;
+      }
+      try {
+        loaders[i]->load_dex_class(j);
+      } catch (const std::exception&) {
+        all_exceptions.emplace_back(std::current_exception());
+      }
+    }
   }
   if (!all_exceptions.empty()) {
     // At least one of the workers raised an exception
     aggregate_exception ae(all_exceptions);
     throw ae;
   }
+}
+
+DexClasses DexLoader::load_dex(const dex_header* dh, dex_stats_t* stats) {
+  if (dh->class_defs_size == 0) {
+    return DexClasses(0);
+  }
+  DexClasses classes;
+  init_classes(dh, &classes);
+  load_classes({this});
 
   gather_input_stats(stats, dh);
 
@@ -533,9 +613,54 @@ DexClasses DexLoader::load_dex(const dex_header* dh, dex_stats_t* stats) {
   return classes;
 }
 
+std::vector<DexClasses> DexLoader::load_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    int support_dex_version) {
+  std::vector<std::unique_ptr<DexLoader>> loaders;
+  std::vector<const dex_header*> headers;
+  std::vector<DexClasses> dexes(locations.size());
+  std::vector<DexLoader*> nonempty_loaders;
+  for (size_t i = 0; i < locations.size(); ++i) {
+    const auto& location = locations[i];
+    TRACE(MAIN, 1, "Loading classes from dex from %s", location.c_str());
+    loaders.emplace_back(std::make_unique<DexLoader>(location.c_str()));
+    auto dl = loaders.back().get();
+    const dex_header* dh = dl->get_dex_header(location.c_str());
+    validate_dex_header(dh, dl->m_file->size(), support_dex_version);
+    headers.push_back(dh);
+    if (dh->class_defs_size != 0) {
+      dl->init_classes(dh, &dexes[i]);
+      nonempty_loaders.push_back(dl);
+    }
+  }
+
+  load_classes(nonempty_loaders);
+
+  for (size_t i = 0; i < locations.size(); ++i) {
+    dex_stats_t dex_stats;
+    if (headers[i]->class_defs_size != 0) {
+      loaders[i]->gather_input_stats(&dex_stats, headers[i]);
+    }
+    stats->push_back(dex_stats);
+    auto& classes = dexes[i];
+    classes.erase(std::remove(classes.begin(), classes.end(), nullptr),
+                  classes.end());
+  }
+  return dexes;
+}
+
 static void mt_balloon(DexMethod* method) { method->balloon(); }
 
 static void balloon_all(const Scope& scope) {
+  if (RedexContext::lazy_balloon()) {
+    walk::methods(scope, [](DexMethod* m) {
+      if (m->get_dex_code()) {
+        m->balloon_lazily();
+      }
+    });
+    return;
+  }
   auto wq = workqueue_foreach<DexMethod*>(mt_balloon);
   walk::methods(scope, [&](DexMethod* m) {
     if (m->get_dex_code()) {
@@ -576,6 +701,22 @@ DexClasses load_classes_from_dex(const dex_header* dh,
   return classes;
 }
 
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    int support_dex_version) {
+  auto dexes = DexLoader::load_dexes(locations, stats, support_dex_version);
+  if (balloon) {
+    Scope all_classes;
+    for (const auto& classes : dexes) {
+      all_classes.insert(all_classes.end(), classes.begin(), classes.end());
+    }
+    balloon_all(all_classes);
+  }
+  return dexes;
+}
+
 const std::string load_dex_magic_from_dex(const char* location) {
   DexLoader dl(location);
   auto dh = dl.get_dex_header(location);
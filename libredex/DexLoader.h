@@ -22,14 +22,29 @@ class DexLoader {
   std::unique_ptr<boost::iostreams::mapped_file> m_file;
   std::string m_dex_location;
 
+  void init_classes(const dex_header* dh, DexClasses* classes);
+  static void load_classes(const std::vector<DexLoader*>& loaders);
+
  public:
   explicit DexLoader(const char* location);
+  ~DexLoader();
 
   const dex_header* get_dex_header(const char* location);
   DexClasses load_dex(const char* location,
                       dex_stats_t* stats,
                       int support_dex_version);
   DexClasses load_dex(const dex_header* hdr, dex_stats_t* stats);
+
+  /*
+   * Load several dex files at once, as a single parallel job over the classes
+   * of all of them. This keeps all threads busy even when most dexes are small.
+   * Returns the classes of each dex, in the order of `locations`, and appends
+   * the stats of each dex to `stats`.
+   */
+  static std::vector<DexClasses> load_dexes(
+      const std::vector<std::string>& locations,
+      std::vector<dex_stats_t>* stats,
+      int support_dex_version);
   void load_dex_class(int num);
   void gather_input_stats(dex_stats_t* stats, const dex_header* dh);
   DexIdx* get_idx() { return m_idx.get(); }
@@ -45,6 +60,16 @@ DexClasses load_classes_from_dex(const char* location,
 DexClasses load_classes_from_dex(const dex_header* dh,
                                  const char* location,
                                  bool balloon = true);
+/*
+ * Like load_classes_from_dex, for several dexes loaded in parallel. If a class
+ * is defined more than once, we keep the first definition in the order of
+ * `locations`, as if the dexes had been loaded one after the other.
+ */
+std::vector<DexClasses> load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon = true,
+    int support_dex_version = 35);
 const std::string load_dex_magic_from_dex(const char* location);
 void balloon_for_test(const Scope& scope);
 
@@ -7,16 +7,23 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <boost/functional/hash.hpp>
 #include <exception>
 #include <fcntl.h>
 #include <fstream>
 #include <functional>
 #include <list>
 #include <memory>
+#include <numeric>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unordered_set>
 
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #ifdef _MSC_VER
 // TODO: Rewrite open/write/close with C/C++ standards. But it works for now.
 #include <io.h>
@@ -28,6 +35,7 @@
 #define O_CREAT _O_CREAT
 #define O_TRUNC _O_TRUNC
 #define O_WRONLY _O_WRONLY
+#define unlink _unlink
 #endif
 
 #include "Debug.h"
@@ -44,9 +52,12 @@
 #include "Trace.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
+#include "locator_index.h"
+#include "mmap.h"
 
 /*
- * For adler32...
+ * For adler32, deflate for the compressed size stats, and gzip for the symbol
+ * files...
  */
 #include <zlib.h>
 
@@ -116,6 +127,53 @@ std::vector<DexString*> GatheredTypes::keep_cls_strings_together_emitlist() {
       CustomSort<DexString, cmp_dstring>(m_cls_strings, compare_dexstrings));
 }
 
+std::vector<DexString*> GatheredTypes::get_access_order_dexstring_emitlist() {
+  return get_dexstring_emitlist(CustomSort<DexString, cmp_dstring>(
+      m_access_order_strings, compare_dexstrings));
+}
+
+namespace {
+
+// Descriptors first, then the strings that could be shorties, then the rest,
+// so that the strings sharing the most bytes end up next to each other.
+int compression_category(const DexString* str) {
+  auto len = str->size();
+  auto s = str->c_str();
+  if (len > 0 &&
+      (s[0] == '[' || (s[0] == 'L' && len > 1 && s[len - 1] == ';'))) {
+    return 0;
+  }
+  if (len > 0 && std::all_of(s, s + len, [](char c) {
+        return strchr("ZBSCIJFDLV", c) != nullptr;
+      })) {
+    return 1;
+  }
+  return 2;
+}
+
+} // namespace
+
+std::vector<DexString*>
+GatheredTypes::get_compression_order_dexstring_emitlist() {
+  // Startup strings keep their access order, so that they still take as few
+  // pages as possible.
+  auto strings = get_access_order_dexstring_emitlist();
+  auto rest = std::find_if(strings.begin(), strings.end(),
+                           [this](const DexString* str) {
+                             return !is_startup_string(str);
+                           });
+  std::stable_sort(rest, strings.end(),
+                   [](const DexString* a, const DexString* b) {
+                     auto a_category = compression_category(a);
+                     auto b_category = compression_category(b);
+                     if (a_category != b_category) {
+                       return a_category < b_category;
+                     }
+                     return strcmp(a->c_str(), b->c_str()) < 0;
+                   });
+  return strings;
+}
+
 std::vector<DexMethodHandle*> GatheredTypes::get_dexmethodhandle_emitlist() {
   return m_lmethodhandle;
 }
@@ -168,6 +226,59 @@ void GatheredTypes::sort_dexmethod_emitlist_profiled_order(
                                      &cache));
 }
 
+void GatheredTypes::sort_dexmethod_emitlist_access_order(
+    std::vector<DexMethod*>& lmeth) {
+  // Methods without a profile keep the order of the previous sorts.
+  std::stable_sort(lmeth.begin(), lmeth.end(),
+                   [this](const DexMethod* a, const DexMethod* b) {
+                     auto a_it = m_methods_in_access_order.find(a);
+                     auto b_it = m_methods_in_access_order.find(b);
+                     if (b_it == m_methods_in_access_order.end()) {
+                       return a_it != m_methods_in_access_order.end();
+                     }
+                     return a_it != m_methods_in_access_order.end() &&
+                            a_it->second < b_it->second;
+                   });
+}
+
+void GatheredTypes::set_method_access_order(
+    const std::unordered_map<const DexMethodRef*, method_profiles::Stats>&
+        method_stats) {
+  std::vector<std::pair<const DexMethod*, double>> startup_methods;
+  for (const auto& cls : *m_classes) {
+    auto add = [&](const DexMethod* m) {
+      auto it = method_stats.find(m);
+      if (it != method_stats.end() && it->second.appear_percent > 0) {
+        startup_methods.emplace_back(m, it->second.order_percent);
+      }
+    };
+    for (const auto& m : cls->get_dmethods()) {
+      add(m);
+    }
+    for (const auto& m : cls->get_vmethods()) {
+      add(m);
+    }
+  }
+  std::stable_sort(startup_methods.begin(), startup_methods.end(),
+                   [](const std::pair<const DexMethod*, double>& a,
+                      const std::pair<const DexMethod*, double>& b) {
+                     return a.second < b.second;
+                   });
+  m_methods_in_access_order.clear();
+  m_access_order_strings.clear();
+  for (const auto& p : startup_methods) {
+    m_methods_in_access_order.emplace(p.first,
+                                      m_methods_in_access_order.size());
+    std::vector<DexString*> method_strings;
+    p.first->gather_strings(method_strings);
+    for (const auto& s : method_strings) {
+      m_access_order_strings.emplace(s, m_access_order_strings.size());
+    }
+  }
+  TRACE(CUSTOMSORT, 2, "%zu startup methods using %zu strings",
+        m_methods_in_access_order.size(), m_access_order_strings.size());
+}
+
 void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
     std::vector<DexMethod*>& lmeth) {
   std::stable_sort(lmeth.begin(), lmeth.end(),
@@ -204,7 +315,7 @@ DexOutputIdx* GatheredTypes::get_dodx(const uint8_t* base) {
 }
 
 dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
-  std::sort(m_lstring.begin(), m_lstring.end(), cmp);
+  redex_parallel::sort(m_lstring.begin(), m_lstring.end(), cmp);
   dexstring_to_idx* sidx = new dexstring_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lstring.begin(); it != m_lstring.end(); it++) {
@@ -214,7 +325,7 @@ dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
 }
 
 dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
-  std::sort(m_ltype.begin(), m_ltype.end(), cmp);
+  redex_parallel::sort(m_ltype.begin(), m_ltype.end(), cmp);
   dextype_to_idx* sidx = new dextype_to_idx();
   uint32_t idx = 0;
   for (auto it = m_ltype.begin(); it != m_ltype.end(); it++) {
@@ -224,7 +335,7 @@ dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
 }
 
 dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
-  std::sort(m_lfield.begin(), m_lfield.end(), cmp);
+  redex_parallel::sort(m_lfield.begin(), m_lfield.end(), cmp);
   dexfield_to_idx* sidx = new dexfield_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lfield.begin(); it != m_lfield.end(); it++) {
@@ -234,7 +345,7 @@ dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
 }
 
 dexmethod_to_idx* GatheredTypes::get_method_index(cmp_dmethod cmp) {
-  std::sort(m_lmethod.begin(), m_lmethod.end(), cmp);
+  redex_parallel::sort(m_lmethod.begin(), m_lmethod.end(), cmp);
   dexmethod_to_idx* sidx = new dexmethod_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lmethod.begin(); it != m_lmethod.end(); it++) {
@@ -292,7 +403,7 @@ std::vector<DexTypeList*>* GatheredTypes::get_typelist_list(
 }
 
 dexcallsite_to_idx* GatheredTypes::get_callsite_index(cmp_callsite cmp) {
-  std::sort(m_lcallsite.begin(), m_lcallsite.end(), cmp);
+  redex_parallel::sort(m_lcallsite.begin(), m_lcallsite.end(), cmp);
   dexcallsite_to_idx* csidx = new dexcallsite_to_idx();
   uint32_t idx = 0;
   for (auto it = m_lcallsite.begin(); it != m_lcallsite.end(); it++) {
@@ -444,18 +555,26 @@ DexOutput::DexOutput(
     : m_config_files(config_files) {
   m_classes = classes;
   m_iodi_metadata = iodi_metadata;
-  m_output = (uint8_t*)malloc(k_max_dex_size);
-  memset(m_output, 0, k_max_dex_size);
+  m_filename = path;
+  bool mmap_output = config_files.get_json_config().get("mmap_dex_output",
+                                                        false);
+  if (!mmap_output || !map_output_file()) {
+    m_output = (uint8_t*)malloc(k_max_dex_size);
+    memset(m_output, 0, k_max_dex_size);
+  }
   m_offset = 0;
   m_force_class_data_end_of_file = post_lowering != nullptr;
   m_gtypes = new GatheredTypes(classes, post_lowering);
   dodx = m_gtypes->get_dodx(m_output);
-  m_filename = path;
   m_pos_mapper = pos_mapper;
   m_method_to_id = method_to_id;
   m_code_debug_lines = code_debug_lines;
-  m_method_mapping_filename = config_files.metafile(METHOD_MAPPING);
-  m_class_mapping_filename = config_files.metafile(CLASS_MAPPING);
+  m_compress_symbol_files =
+      config_files.get_json_config().get("compress_symbol_files", false);
+  auto gz_suffix = m_compress_symbol_files ? ".gz" : "";
+  m_method_mapping_filename =
+      config_files.metafile(METHOD_MAPPING) + gz_suffix;
+  m_class_mapping_filename = config_files.metafile(CLASS_MAPPING) + gz_suffix;
   m_pg_mapping_filename = config_files.metafile(REDEX_PG_MAPPING);
   m_bytecode_offset_filename = config_files.metafile(BYTECODE_OFFSET_MAPPING);
   m_store_number = store_number;
@@ -468,7 +587,63 @@ DexOutput::DexOutput(
 DexOutput::~DexOutput() {
   delete m_gtypes;
   delete dodx;
-  free(m_output);
+  if (m_mapped_output != nullptr) {
+    // Never written out.
+    delete m_mapped_output;
+    close(m_mapped_output_fd);
+  } else {
+    free(m_output);
+  }
+}
+
+/*
+ * Open the output dex. The file at that path may be an input dex that
+ * DexStrings still point into (see RedexContext::map_dex_strings()):
+ * truncating it would pull their contents from under them, so it is unlinked
+ * instead, which leaves the mapping intact.
+ */
+static int open_output_dex(const char* filename, int flags) {
+  if (RedexContext::map_dex_strings()) {
+    unlink(filename);
+  }
+  return open(filename, O_CREAT | O_TRUNC | flags, 0660);
+}
+
+/*
+ * Set up the output buffer as a shared mapping of the output file itself,
+ * sized for the largest dex we can emit. The file is sparse, so only the pages
+ * we actually write to take up room, and they start out zeroed like the
+ * malloc'ed buffer. This saves both the upfront memset and the final copy of
+ * the image into the file, and lets the kernel write back finished pages
+ * instead of keeping them all in anonymous memory.
+ */
+bool DexOutput::map_output_file() {
+#ifdef _MSC_VER
+  return false;
+#else
+  int fd = open_output_dex(m_filename, O_RDWR);
+  if (fd == -1) {
+    return false;
+  }
+  if (ftruncate(fd, k_max_dex_size) != 0) {
+    close(fd);
+    return false;
+  }
+  std::string error_msg;
+  m_mapped_output = MappedFile::mmap_file(k_max_dex_size,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_SHARED,
+                                         fd,
+                                         m_filename,
+                                         &error_msg);
+  if (m_mapped_output == nullptr) {
+    close(fd);
+    return false;
+  }
+  m_mapped_output_fd = fd;
+  m_output = m_mapped_output->begin();
+  return true;
+#endif
 }
 
 void DexOutput::insert_map_item(uint16_t maptype,
@@ -620,6 +795,29 @@ std::unique_ptr<Locator> DexOutput::locator_for_descriptor(
   return nullptr;
 }
 
+/*
+ * Count the pages that the emitted item at [offset, offset + size) touches,
+ * excluding the last page counted so far, as items are emitted in increasing
+ * offsets.
+ */
+static void count_startup_pages(uint32_t offset,
+                                uint32_t size,
+                                boost::optional<uint32_t>* last_page,
+                                int* pages) {
+  if (size == 0) {
+    return;
+  }
+  uint32_t first = offset / STARTUP_PAGE_SIZE;
+  uint32_t last = (offset + size - 1) / STARTUP_PAGE_SIZE;
+  if (*last_page && **last_page >= first) {
+    first = **last_page + 1;
+  }
+  if (first <= last) {
+    *pages += last - first + 1;
+    *last_page = last;
+  }
+}
+
 void DexOutput::generate_string_data(SortMode mode) {
   /*
    * This is a index to position within the string data.  There
@@ -636,6 +834,12 @@ void DexOutput::generate_string_data(SortMode mode) {
   } else if (mode == SortMode::CLASS_STRINGS) {
     TRACE(CUSTOMSORT, 2, "using class names pack for string pool sorting");
     string_order = m_gtypes->keep_cls_strings_together_emitlist();
+  } else if (mode == SortMode::METHOD_ACCESS_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using method access order for string pool sorting");
+    string_order = m_gtypes->get_access_order_dexstring_emitlist();
+  } else if (mode == SortMode::COMPRESSION_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using compression order for string pool sorting");
+    string_order = m_gtypes->get_compression_order_dexstring_emitlist();
   } else {
     TRACE(CUSTOMSORT, 2, "using default string pool sorting");
     string_order = m_gtypes->get_dexstring_emitlist();
@@ -661,6 +865,7 @@ void DexOutput::generate_string_data(SortMode mode) {
 
   size_t nrstr = string_order.size() + locators;
   const uint32_t str_data_start = m_offset;
+  boost::optional<uint32_t> last_startup_page;
 
   for (DexString* str : string_order) {
     // Emit lookup acceleration string if requested
@@ -685,12 +890,19 @@ void DexOutput::generate_string_data(SortMode mode) {
     TRACE(CUSTOMSORT, 3, "str emit %s", SHOW(str));
     stringids[idx].offset = m_offset;
     str->encode(m_output + m_offset);
+    if (m_gtypes->is_startup_string(str)) {
+      count_startup_pages(m_offset, str->get_entry_size(),
+                          &last_startup_page, &m_stats.startup_string_pages);
+      m_stats.startup_strings++;
+      m_stats.startup_string_bytes += str->get_entry_size();
+    }
     m_offset += str->get_entry_size();
     m_stats.num_strings++;
   }
 
   insert_map_item(TYPE_STRING_DATA_ITEM, (uint32_t)nrstr, str_data_start,
                   m_offset - str_data_start);
+  m_string_data_range = {str_data_start, m_offset};
 
   if (m_locator_index != nullptr) {
     TRACE(LOC, 2, "Used %u bytes for %u locator strings", locator_size,
@@ -905,22 +1117,29 @@ void DexOutput::generate_class_data_items() {
   insert_map_item(TYPE_CLASS_DATA_ITEM, count, cdi_start, m_offset - cdi_start);
 }
 
-static void sync_all(const Scope& scope) {
-  constexpr bool serial = false; // for debugging
-  auto wq = workqueue_foreach<DexMethod*>([](DexMethod* m) { m->sync(); });
-  walk::code(scope,
-             [](DexMethod*) { return true; },
-             [&](DexMethod* m, IRCode&) {
-               if (serial) {
-                 TRACE(MTRANS, 2, "Syncing %s", SHOW(m));
-                 m->sync();
-               } else {
-                 wq.add_item(m);
-               }
-             });
-  wq.run_all();
+namespace {
+
+/*
+ * An upper bound of the size of the code item that DexCode::encode() writes
+ * for `code`: its header, instructions and padding, tries, and handlers with
+ * LEB128 values of at most 5 bytes each.
+ */
+size_t max_code_item_size(const DexCode& code) {
+  size_t insns_units = 0;
+  for (const auto& insn : code.get_instructions()) {
+    insns_units += insn->size();
+  }
+  size_t size = sizeof(dex_code_item) + (insns_units + 1) * sizeof(uint16_t);
+  const auto& tries = code.get_tries();
+  size += tries.size() * sizeof(dex_tries_item) + 5;
+  for (const auto& dextry : tries) {
+    size += 5 + dextry->m_catches.size() * 10;
+  }
+  return size;
 }
 
+} // namespace
+
 void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
   TRACE(MAIN, 2, "generate_code_items");
   /*
@@ -929,13 +1148,13 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
    */
   align_output();
   uint32_t ci_start = m_offset;
-  sync_all(*m_classes);
 
   // Get all methods.
   std::vector<DexMethod*> lmeth = m_gtypes->get_dexmethod_emitlist();
 
   // Repeatedly perform stable sorts starting with the last (least important)
   // sorting method specified.
+  bool cluster_by_content = false;
   for (auto it = mode.rbegin(); it != mode.rend(); ++it) {
     switch (*it) {
     case SortMode::CLASS_ORDER:
@@ -946,6 +1165,16 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
       TRACE(CUSTOMSORT, 2, "using method profiled order for bytecode sorting");
       m_gtypes->sort_dexmethod_emitlist_profiled_order(lmeth);
       break;
+    case SortMode::METHOD_ACCESS_ORDER:
+      TRACE(CUSTOMSORT, 2, "using method access order for bytecode sorting");
+      m_gtypes->sort_dexmethod_emitlist_access_order(lmeth);
+      break;
+    case SortMode::COMPRESSION_ORDER:
+      TRACE(CUSTOMSORT, 2, "using compression order for bytecode sorting");
+      // The methods past the startup ones get clustered once encoded.
+      m_gtypes->sort_dexmethod_emitlist_access_order(lmeth);
+      cluster_by_content = true;
+      break;
     case SortMode::CLINIT_FIRST:
       TRACE(CUSTOMSORT, 2,
             "sorting <clinit> sections before all other bytecode");
@@ -962,7 +1191,51 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
       break;
     }
   }
-  for (DexMethod* meth : lmeth) {
+  // Sync each method and encode its code item into a buffer of its own in
+  // parallel; only laying the items out in the sorted order is serial.
+  std::vector<std::vector<uint32_t>> encoded(lmeth.size());
+  std::vector<int> encoded_sizes(lmeth.size(), 0);
+  redex_parallel::parallel_for(0, lmeth.size(), [&](size_t i) {
+    DexMethod* meth = lmeth[i];
+    if (meth->get_code() != nullptr) {
+      meth->sync();
+    }
+    DexCode* code = meth->get_dex_code();
+    if ((meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) || code == nullptr) {
+      return;
+    }
+    auto& buffer = encoded[i];
+    buffer.resize(max_code_item_size(*code) / sizeof(uint32_t) + 1);
+    encoded_sizes[i] = code->encode(dodx, buffer.data());
+    always_assert((size_t)encoded_sizes[i] <= buffer.size() * sizeof(uint32_t));
+  });
+
+  std::vector<size_t> emit_order(lmeth.size());
+  std::iota(emit_order.begin(), emit_order.end(), 0);
+  if (cluster_by_content) {
+    // Lay out the other code items by their instructions, skipping the
+    // header, so that similar methods land within the window of deflate.
+    auto rest = std::find_if(emit_order.begin(), emit_order.end(),
+                             [&](size_t i) {
+                               return !m_gtypes->is_startup_method(lmeth[i]);
+                             });
+    std::stable_sort(rest, emit_order.end(), [&](size_t a, size_t b) {
+      constexpr int header_size = sizeof(dex_code_item);
+      auto a_size = std::max(encoded_sizes[a] - header_size, 0);
+      auto b_size = std::max(encoded_sizes[b] - header_size, 0);
+      int min_size = std::min(a_size, b_size);
+      int cmp = min_size == 0
+                    ? 0
+                    : memcmp((const uint8_t*)encoded[a].data() + header_size,
+                             (const uint8_t*)encoded[b].data() + header_size,
+                             min_size);
+      return cmp != 0 ? cmp < 0 : a_size < b_size;
+    });
+  }
+
+  boost::optional<uint32_t> last_startup_page;
+  for (size_t i : emit_order) {
+    DexMethod* meth = lmeth[i];
     if (meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) {
       // There is no code item for ABSTRACT or NATIVE methods.
       continue;
@@ -975,8 +1248,16 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         "Undefined method in generate_code_items()\n\t prototype: %s\n",
         SHOW(meth));
     align_output();
-    int size = code->encode(dodx, (uint32_t*)(m_output + m_offset));
+    int size = encoded_sizes[i];
+    memcpy(m_output + m_offset, encoded[i].data(), size);
+    std::vector<uint32_t>().swap(encoded[i]);
     check_method_instruction_size_limit(m_config_files, size, SHOW(meth));
+    if (m_gtypes->is_startup_method(meth)) {
+      count_startup_pages(m_offset, size, &last_startup_page,
+                          &m_stats.startup_code_pages);
+      m_stats.startup_code_items++;
+      m_stats.startup_code_bytes += size;
+    }
     m_method_bytecode_offsets.emplace_back(meth->get_name()->c_str(), m_offset);
     m_code_item_emits.emplace_back(meth, code,
                                    (dex_code_item*)(m_output + m_offset));
@@ -987,6 +1268,7 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
   }
   insert_map_item(TYPE_CODE_ITEM, (uint32_t)m_code_item_emits.size(), ci_start,
                   m_offset - ci_start);
+  m_code_items_range = {ci_start, m_offset};
 }
 
 void DexOutput::generate_callsite_data() {
@@ -1101,21 +1383,54 @@ static bool annotation_cmp(const DexAnnotationDirectory* a,
   return (a->viz_score() < b->viz_score());
 }
 
+namespace {
+
+/*
+ * Encodes the distinct items of `items` in parallel, and returns them along
+ * with their encodings in the order of their first occurrence, so that the
+ * output doesn't depend on the scheduling.
+ */
+template <typename Item, typename Encoding, typename Encode>
+std::vector<std::pair<Item*, Encoding>> encode_in_parallel(
+    const std::vector<Item*>& items, const Encode& encode) {
+  std::vector<std::pair<Item*, Encoding>> encoded;
+  std::unordered_set<Item*> seen;
+  for (auto item : items) {
+    if (seen.insert(item).second) {
+      encoded.emplace_back(item, Encoding());
+    }
+  }
+  // Encoding a single item is cheap, so hand them out in batches.
+  redex_parallel::parallel_for(
+      0, encoded.size(),
+      [&](size_t i) { encode(encoded[i].first, encoded[i].second); },
+      redex_parallel::default_num_threads(), /* chunk_size */ 64);
+  return encoded;
+}
+
+} // namespace
+
 void DexOutput::unique_annotations(annomap_t& annomap,
                                    std::vector<DexAnnotation*>& annolist) {
   int annocnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
-  for (auto anno : annolist) {
-    if (annomap.count(anno)) continue;
-    std::vector<uint8_t> annotation_bytes;
-    anno->vencode(dodx, annotation_bytes);
-    if (annotation_byte_offsets.count(annotation_bytes)) {
-      annomap[anno] = annotation_byte_offsets[annotation_bytes];
+  auto encoded = encode_in_parallel<DexAnnotation, std::vector<uint8_t>>(
+      annolist, [&](DexAnnotation* anno, std::vector<uint8_t>& bytes) {
+        anno->vencode(dodx, bytes);
+      });
+  std::unordered_map<std::vector<uint8_t>, uint32_t,
+                     boost::hash<std::vector<uint8_t>>>
+      annotation_byte_offsets;
+  for (const auto& pair : encoded) {
+    auto anno = pair.first;
+    const auto& annotation_bytes = pair.second;
+    auto it = annotation_byte_offsets.find(annotation_bytes);
+    if (it != annotation_byte_offsets.end()) {
+      annomap[anno] = it->second;
       continue;
     }
     /* Insert new annotation in tracking structs */
-    annotation_byte_offsets[annotation_bytes] = m_offset;
+    annotation_byte_offsets.emplace(annotation_bytes, m_offset);
     annomap[anno] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* annoout = (uint8_t*)(m_output + m_offset);
@@ -1135,17 +1450,23 @@ void DexOutput::unique_asets(annomap_t& annomap,
                              std::vector<DexAnnotationSet*>& asetlist) {
   int asetcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
-  for (auto aset : asetlist) {
-    if (asetmap.count(aset)) continue;
-    std::vector<uint32_t> aset_bytes;
-    aset->vencode(dodx, aset_bytes, annomap);
-    if (aset_offsets.count(aset_bytes)) {
-      asetmap[aset] = aset_offsets[aset_bytes];
+  auto encoded = encode_in_parallel<DexAnnotationSet, std::vector<uint32_t>>(
+      asetlist, [&](DexAnnotationSet* aset, std::vector<uint32_t>& bytes) {
+        aset->vencode(dodx, bytes, annomap);
+      });
+  std::unordered_map<std::vector<uint32_t>, uint32_t,
+                     boost::hash<std::vector<uint32_t>>>
+      aset_offsets;
+  for (const auto& pair : encoded) {
+    auto aset = pair.first;
+    const auto& aset_bytes = pair.second;
+    auto it = aset_offsets.find(aset_bytes);
+    if (it != aset_offsets.end()) {
+      asetmap[aset] = it->second;
       continue;
     }
     /* Insert new aset in tracking structs */
-    aset_offsets[aset_bytes] = m_offset;
+    aset_offsets.emplace(aset_bytes, m_offset);
     asetmap[aset] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* asetout = (uint8_t*)(m_output + m_offset);
@@ -1164,7 +1485,9 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                              std::vector<ParamAnnotations*>& xreflist) {
   int xrefcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> xref_offsets;
+  std::unordered_map<std::vector<uint32_t>, uint32_t,
+                     boost::hash<std::vector<uint32_t>>>
+      xref_offsets;
   for (auto xref : xreflist) {
     if (xrefmap.count(xref)) continue;
     std::vector<uint32_t> xref_bytes;
@@ -1175,12 +1498,13 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                         das, SHOW(das));
       xref_bytes.push_back(asetmap[das]);
     }
-    if (xref_offsets.count(xref_bytes)) {
-      xrefmap[xref] = xref_offsets[xref_bytes];
+    auto it = xref_offsets.find(xref_bytes);
+    if (it != xref_offsets.end()) {
+      xrefmap[xref] = it->second;
       continue;
     }
     /* Insert new xref in tracking structs */
-    xref_offsets[xref_bytes] = m_offset;
+    xref_offsets.emplace(xref_bytes, m_offset);
     xrefmap[xref] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* xrefout = (uint8_t*)(m_output + m_offset);
@@ -1200,17 +1524,25 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
                              std::vector<DexAnnotationDirectory*>& adirlist) {
   int adircnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
-  for (auto adir : adirlist) {
-    if (adirmap.count(adir)) continue;
-    std::vector<uint32_t> adir_bytes;
-    adir->vencode(dodx, adir_bytes, xrefmap, asetmap);
-    if (adir_offsets.count(adir_bytes)) {
-      adirmap[adir] = adir_offsets[adir_bytes];
+  auto encoded =
+      encode_in_parallel<DexAnnotationDirectory, std::vector<uint32_t>>(
+          adirlist,
+          [&](DexAnnotationDirectory* adir, std::vector<uint32_t>& bytes) {
+            adir->vencode(dodx, bytes, xrefmap, asetmap);
+          });
+  std::unordered_map<std::vector<uint32_t>, uint32_t,
+                     boost::hash<std::vector<uint32_t>>>
+      adir_offsets;
+  for (const auto& pair : encoded) {
+    auto adir = pair.first;
+    const auto& adir_bytes = pair.second;
+    auto it = adir_offsets.find(adir_bytes);
+    if (it != adir_offsets.end()) {
+      adirmap[adir] = it->second;
       continue;
     }
     /* Insert new adir in tracking structs */
-    adir_offsets[adir_bytes] = m_offset;
+    adir_offsets.emplace(adir_bytes, m_offset);
     adirmap[adir] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* adirout = (uint8_t*)(m_output + m_offset);
@@ -1277,64 +1609,110 @@ void DexOutput::generate_annotations() {
 }
 
 namespace {
-struct DebugMetadata {
-  DexDebugItem* dbg;
-  dex_code_item* dci;
-  uint32_t line_start;
-  uint32_t num_params;
-  std::vector<std::unique_ptr<DexDebugInstruction>> dbgops;
+
+// The largest encoding of a single debug instruction:
+// DBG_START_LOCAL_EXTENDED, i.e. an opcode and four ULEB128s.
+constexpr size_t MAX_DEBUG_INSTRUCTION_SIZE = 1 + 4 * 5;
+
+/*
+ * Hands out the lines that map_debug_positions() computed for a method, so
+ * that its debug instructions can be generated without the real mapper.
+ */
+class PrecomputedLinesMapper final : public PositionMapper {
+ public:
+  explicit PrecomputedLinesMapper(const std::vector<uint32_t>& lines)
+      : m_lines(lines) {}
+
+  DexString* get_source_file(const DexClass*) override { not_reached(); }
+
+  uint32_t position_to_line(DexPosition*) override {
+    always_assert(m_next_line < m_lines.size());
+    return m_lines[m_next_line++];
+  }
+
+  void register_position(DexPosition*) override {}
+
+  void write_map() override { not_reached(); }
+
+ private:
+  const std::vector<uint32_t>& m_lines;
+  size_t m_next_line{0};
 };
 
-DebugMetadata calculate_debug_metadata(
-    DexDebugItem* dbg,
-    DexCode* dc,
-    dex_code_item* dci,
+struct EncodedDebugInfo {
+  const CodeItemEmit* code_item_emit;
+  std::vector<uint8_t> bytes;
+};
+
+/*
+ * Generates the debug programs of the code items that have debug info, in the
+ * order of `code_items`, and encodes them if `encode` is set. The positions
+ * are mapped to lines serially, in that order, so that the line numbers don't
+ * depend on the scheduling; the rest of the work is done in parallel.
+ */
+std::vector<EncodedDebugInfo> encode_debug_infos(
+    DexOutputIdx* dodx,
+    bool encode,
+    const std::vector<CodeItemEmit>& code_items,
     PositionMapper* pos_mapper,
-    uint32_t num_params,
     std::unordered_map<DexCode*, std::vector<DebugLineItem>>* dbg_lines) {
-  std::vector<DebugLineItem> debug_line_info;
-  DebugMetadata metadata;
-  metadata.dbg = dbg;
-  metadata.dci = dci;
-  metadata.num_params = num_params;
-  metadata.dbgops = generate_debug_instructions(
-      dbg, pos_mapper, &metadata.line_start, &debug_line_info);
+  std::vector<EncodedDebugInfo> infos;
+  std::vector<std::vector<uint32_t>> lines;
+  for (auto& it : code_items) {
+    auto dbg = it.code->get_debug_item();
+    if (dbg == nullptr) continue;
+    infos.push_back(EncodedDebugInfo{&it, {}});
+    lines.push_back(map_debug_positions(dbg, pos_mapper));
+  }
+  std::vector<std::vector<DebugLineItem>> line_infos(infos.size());
+  redex_parallel::parallel_for(0, infos.size(), [&](size_t i) {
+    auto& info = infos[i];
+    PrecomputedLinesMapper lines_mapper(lines[i]);
+    uint32_t line_start = 0;
+    auto dbgops = generate_debug_instructions(
+        info.code_item_emit->code->get_debug_item(), &lines_mapper,
+        &line_start, &line_infos[i]);
+    if (!encode) {
+      return;
+    }
+    uint32_t num_params =
+        info.code_item_emit->method->get_proto()->get_args()->size();
+    // The two ULEB128 header fields, the parameter names, the instructions,
+    // and the end of the sequence.
+    info.bytes.resize(2 * 5 + num_params * 5 +
+                      dbgops.size() * MAX_DEBUG_INSTRUCTION_SIZE + 1);
+    int size = DexDebugItem::encode(dodx, info.bytes.data(), line_start,
+                                    num_params, dbgops);
+    info.bytes.resize(size);
+  });
   if (dbg_lines != nullptr) {
-    (*dbg_lines)[dc] = debug_line_info;
+    for (size_t i = 0; i < infos.size(); ++i) {
+      (*dbg_lines)[infos[i].code_item_emit->code] = std::move(line_infos[i]);
+    }
   }
-  return metadata;
+  return infos;
 }
 
-int emit_debug_info_for_metadata(DexOutputIdx* dodx,
-                                 const DebugMetadata& metadata,
-                                 uint8_t* output,
-                                 uint32_t offset,
-                                 bool set_dci_offset = true) {
-  int size = DexDebugItem::encode(dodx, output + offset, metadata.line_start,
-                                  metadata.num_params, metadata.dbgops);
-  if (set_dci_offset) {
-    metadata.dci->debug_info_off = offset;
-  }
-  return size;
-}
+using DebugInfoOffsets =
+    std::unordered_map<std::vector<uint8_t>,
+                       uint32_t,
+                       boost::hash<std::vector<uint8_t>>>;
 
-int emit_debug_info(
-    DexOutputIdx* dodx,
-    bool emit_positions,
-    DexDebugItem* dbg,
-    DexCode* dc,
-    dex_code_item* dci,
-    PositionMapper* pos_mapper,
-    uint8_t* output,
-    uint32_t offset,
-    uint32_t num_params,
-    std::unordered_map<DexCode*, std::vector<DebugLineItem>>* dbg_lines) {
-  // No align requirement for debug items.
-  DebugMetadata metadata =
-      calculate_debug_metadata(dbg, dc, dci, pos_mapper, num_params, dbg_lines);
-  return emit_positions
-             ? emit_debug_info_for_metadata(dodx, metadata, output, offset)
-             : 0;
+// No align requirement for debug items. Code items whose debug programs are
+// identical share one debug item, which happens a lot when the lines are not
+// remapped. Returns the number of bytes written, zero if the debug item was
+// shared.
+uint32_t emit_debug_info(const EncodedDebugInfo& info,
+                         uint8_t* output,
+                         uint32_t offset,
+                         DebugInfoOffsets* emitted) {
+  auto inserted = emitted->emplace(info.bytes, offset);
+  info.code_item_emit->code_item->debug_info_off = inserted.first->second;
+  if (!inserted.second) {
+    return 0;
+  }
+  memcpy(output + offset, info.bytes.data(), info.bytes.size());
+  return info.bytes.size();
 }
 
 // Returns a DexDebugInstruction corresponding to emitting a line entry
@@ -1392,40 +1770,23 @@ uint32_t emit_instruction_offset_debug_info(
   using DebugMethodMap = std::map<MethodKey, DebugSize, Compare>;
   // 1)
   std::map<uint32_t, DebugMethodMap> param_to_sizes;
-  std::unordered_map<const DexMethod*, DebugMetadata> method_to_debug_meta;
-  // We need this to calculate the size of normal debug programs for each
-  // method. Hopefully no debug program is > 128k. Its ok to increase this
-  // in the future.
-  constexpr int TMP_SIZE = 128 * 1024;
-  uint8_t* tmp = (uint8_t*)malloc(TMP_SIZE);
-  for (auto& it : code_items) {
-    DexCode* dc = it.code;
-    const auto dbg_item = dc->get_debug_item();
-    if (!dbg_item) {
-      continue;
-    }
-    dex_code_item* dci = it.code_item;
-    DexMethod* method = it.method;
-    uint32_t param_size = method->get_proto()->get_args()->size();
-    // We still want to fill in pos_mapper and code_debug_map, so run the
-    // usual code to emit debug info. We cache this and use it later if
-    // it turns out we want to emit normal debug info for a given method.
-    DebugMetadata metadata = calculate_debug_metadata(
-        dbg_item, dc, it.code_item, pos_mapper, param_size, code_debug_map);
-
-    int debug_size =
-        emit_debug_info_for_metadata(dodx, metadata, tmp, 0, false);
-    always_assert_log(debug_size < TMP_SIZE, "Tmp buffer overrun");
-    method_to_debug_meta.emplace(method, std::move(metadata));
+  // We still want to fill in pos_mapper and code_debug_map, so run the usual
+  // code to emit debug info. We keep the encoded programs to use them later
+  // if it turns out we want to emit normal debug info for a given method.
+  auto debug_infos = encode_debug_infos(dodx, /* encode */ true, code_items,
+                                        pos_mapper, code_debug_map);
+  for (auto& info : debug_infos) {
+    DexMethod* method = info.code_item_emit->method;
     if (!iodi_metadata.can_safely_use_iodi(method)) {
       continue;
     }
-    auto res = param_to_sizes[param_size].emplace(MethodKey{method, dc->size()},
-                                                  debug_size);
+    uint32_t param_size = method->get_proto()->get_args()->size();
+    uint32_t code_size = info.code_item_emit->code->size();
+    auto res = param_to_sizes[param_size].emplace(MethodKey{method, code_size},
+                                                  info.bytes.size());
     always_assert_log(res.second, "Failed to insert %s, %d pair", SHOW(method),
-                      dc->size());
+                      code_size);
   }
-  free((void*)tmp);
   // 2)
   std::unordered_map<uint32_t, std::map<uint32_t, uint32_t>> param_size_to_oset;
   uint32_t initial_offset = offset;
@@ -1763,20 +2124,17 @@ uint32_t emit_instruction_offset_debug_info(
         post_iodi_offset - initial_offset);
   // 3)
   auto size_offset_end = param_size_to_oset.end();
-  for (auto& it : code_items) {
-    DexCode* dc = it.code;
-    const auto dbg = dc->get_debug_item();
-    if (!dbg) {
-      continue;
-    }
-    dex_code_item* dci = it.code_item;
+  DebugInfoOffsets emitted;
+  for (auto& info : debug_infos) {
+    DexCode* dc = info.code_item_emit->code;
+    dex_code_item* dci = info.code_item_emit->code_item;
     // If a method is too big then it's been marked as so internally, so this
     // will return false.
-    DexMethod* method = it.method;
+    DexMethod* method = info.code_item_emit->method;
     if (iodi_metadata.can_safely_use_iodi(method)) {
       // Here we sanity check to make sure that all IODI programs are at least
       // as long as they need to be.
-      uint32_t param_size = it.method->get_proto()->get_args()->size();
+      uint32_t param_size = method->get_proto()->get_args()->size();
       auto size_offset_it = param_size_to_oset.find(param_size);
       always_assert_log(size_offset_it != size_offset_end,
                         "Expected to find param to offset: %s", SHOW(method));
@@ -1792,9 +2150,11 @@ uint32_t emit_instruction_offset_debug_info(
                         SHOW(method), code_size);
       dci->debug_info_off = offset_it->second;
     } else {
-      offset += emit_debug_info_for_metadata(
-          dodx, method_to_debug_meta.at(method), output, offset, true);
-      *dbgcount += 1;
+      auto size = emit_debug_info(info, output, offset, &emitted);
+      if (size != 0) {
+        offset += size;
+        *dbgcount += 1;
+      }
     }
   }
   TRACE(IODI, 2, "[IODI] Non-IODI programs took up %d bytes\n",
@@ -1825,16 +2185,20 @@ void DexOutput::generate_debug_items() {
               "[IODI] WARNING: Not using IODI because no iodi metadata file was"
               " specified.\n");
     }
-    for (auto& it : m_code_item_emits) {
-      DexCode* dc = it.code;
-      dex_code_item* dci = it.code_item;
-      auto dbg = dc->get_debug_item();
-      if (dbg == nullptr) continue;
-      dbgcount++;
-      size_t num_params = it.method->get_proto()->get_args()->size();
-      m_offset +=
-          emit_debug_info(dodx, emit_positions, dbg, dc, dci, m_pos_mapper,
-                          m_output, m_offset, num_params, m_code_debug_lines);
+    auto debug_infos = encode_debug_infos(dodx, emit_positions,
+                                          m_code_item_emits, m_pos_mapper,
+                                          m_code_debug_lines);
+    if (emit_positions) {
+      DebugInfoOffsets emitted;
+      for (auto& info : debug_infos) {
+        auto size = emit_debug_info(info, m_output, m_offset, &emitted);
+        if (size != 0) {
+          m_offset += size;
+          ++dbgcount;
+        }
+      }
+    } else {
+      dbgcount += debug_infos.size();
     }
   }
   if (emit_positions) {
@@ -1867,7 +2231,21 @@ void DexOutput::generate_map() {
  */
 static void fix_method_jumbos(DexMethod* method, const DexOutputIdx* dodx) {
   auto code = method->get_code();
-  if (!code) return; // nothing to do for native methods
+  if (!code) {
+    // Code that was never ballooned can't grow, as that would move the
+    // targets of its branches; a const-string/jumbo fits any index.
+    if (auto dex_code = method->get_dex_code()) {
+      for (auto insn : dex_code->get_instructions()) {
+        if (insn->opcode() == DOPCODE_CONST_STRING) {
+          auto str = static_cast<DexOpcodeString*>(insn)->get_string();
+          always_assert_log(dodx->stringidx(str) >> 16 == 0,
+                            "%s needs a jumbo string, balloon its code",
+                            SHOW(method));
+        }
+      }
+    }
+    return; // nothing to do for native methods
+  }
 
   for (auto& mie : *code) {
     if (mie.type != MFLOW_DEX_OPCODE) {
@@ -1970,33 +2348,37 @@ void DexOutput::init_header_offsets(const std::string& dex_magic) {
 void DexOutput::finalize_header() {
   hdr.data_size = m_offset - hdr.data_off;
   hdr.file_size = m_offset;
-  int skip;
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum) + sizeof(hdr.signature);
   memcpy(m_output, &hdr, sizeof(hdr));
+  // The signature covers everything after itself, and the checksum covers
+  // everything after the magic, the signature included. Rather than making
+  // two separate trips through a buffer that's mostly out of cache by now, we
+  // feed each chunk to both while it's hot, and fold the signature into the
+  // checksum once it's known.
+  constexpr size_t kChunkSize = 64 * 1024;
+  const size_t checksum_off = sizeof(hdr.magic) + sizeof(hdr.checksum);
+  const size_t signature_end = checksum_off + sizeof(hdr.signature);
   Sha1Context context;
   sha1_init(&context);
-  sha1_update(&context, m_output + skip, hdr.file_size - skip);
+  uLong tail_adler = adler32(0L, Z_NULL, 0);
+  for (size_t off = signature_end; off < hdr.file_size; off += kChunkSize) {
+    auto len = std::min<size_t>(kChunkSize, hdr.file_size - off);
+    sha1_update(&context, m_output + off, len);
+    tail_adler = adler32(tail_adler, (const Bytef*)(m_output + off), len);
+  }
   sha1_final(hdr.signature, &context);
-  memcpy(m_output, &hdr, sizeof(hdr));
-  uint32_t adler = (uint32_t)adler32(0L, Z_NULL, 0);
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum);
-  adler = (uint32_t)adler32(adler, (const Bytef*)(m_output + skip),
-                            hdr.file_size - skip);
-  hdr.checksum = adler;
+  uLong adler = adler32(0L, Z_NULL, 0);
+  adler = adler32(adler, (const Bytef*)hdr.signature, sizeof(hdr.signature));
+  adler = adler32_combine(adler, tail_adler, hdr.file_size - signature_end);
+  hdr.checksum = (uint32_t)adler;
   memcpy(m_output, &hdr, sizeof(hdr));
 }
 
 namespace {
 
-void compute_method_to_id_map(
-    DexOutputIdx* dodx,
-    const DexClasses* classes,
-    uint8_t* dex_signature,
-    std::unordered_map<DexMethod*, uint64_t>* method_to_id) {
-  if (!method_to_id) {
-    return;
-  }
-
+std::vector<std::pair<DexMethod*, uint64_t>> compute_method_ids(
+    DexOutputIdx* dodx, const DexClasses* classes, uint8_t* dex_signature) {
+  std::vector<std::pair<DexMethod*, uint64_t>> method_ids;
+  method_ids.reserve(dodx->method_to_idx().size());
   std::unordered_set<DexClass*> dex_classes(classes->begin(), classes->end());
   for (auto& it : dodx->method_to_idx()) {
     auto method = it.first;
@@ -2027,19 +2409,19 @@ void compute_method_to_id_map(
       // Not recording it if method reference is not referring to
       // concrete method, otherwise will have key overlapped.
       auto dexmethod = static_cast<DexMethod*>(resolved_method);
-      (*method_to_id)[dexmethod] = ((uint64_t)idx << 32) | (uint64_t)signature;
+      method_ids.emplace_back(dexmethod,
+                              ((uint64_t)idx << 32) | (uint64_t)signature);
     }
   }
+  return method_ids;
 }
 
-void write_method_mapping(const std::string& filename,
-                          const DexOutputIdx* dodx,
-                          const DexClasses* classes,
-                          uint8_t* dex_signature) {
-  always_assert(!filename.empty());
-  FILE* fd = fopen(filename.c_str(), "a");
-  assert_log(fd, "Can't open method mapping file %s: %s\n", filename.c_str(),
-             strerror(errno));
+std::string format_method_mapping(const DexOutputIdx* dodx,
+                                  const DexClasses* classes,
+                                  uint8_t* dex_signature) {
+  std::string out;
+  // Most lines are a bit shorter than this.
+  out.reserve(dodx->method_to_idx().size() * 64);
   std::unordered_set<DexClass*> classes_in_dex(classes->begin(),
                                                classes->end());
   for (auto& it : dodx->method_to_idx()) {
@@ -2098,18 +2480,23 @@ void write_method_mapping(const std::string& filename,
     // in little-endian (since that's faster to compute on-device).
     uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
 
-    fprintf(fd, "%u %u %s %s\n", idx, signature, deobf_method_name.c_str(),
-            deobf_class.c_str());
+    out += std::to_string(idx);
+    out += ' ';
+    out += std::to_string(signature);
+    out += ' ';
+    out += deobf_method_name;
+    out += ' ';
+    out += deobf_class;
+    out += '\n';
   }
-  fclose(fd);
+  return out;
 }
 
-void write_class_mapping(const std::string& filename,
-                         DexClasses* classes,
-                         const size_t class_defs_size,
-                         uint8_t* dex_signature) {
-  always_assert(!filename.empty());
-  FILE* fd = fopen(filename.c_str(), "a");
+std::string format_class_mapping(DexClasses* classes,
+                                 const size_t class_defs_size,
+                                 uint8_t* dex_signature) {
+  std::string out;
+  out.reserve(class_defs_size * 64);
 
   for (uint32_t idx = 0; idx < class_defs_size; idx++) {
 
@@ -2126,10 +2513,14 @@ void write_class_mapping(const std::string& filename,
     // See write_method_mapping above for why checksum is insufficient.
     //
     uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-    fprintf(fd, "%u %u %s\n", idx, signature, deobf_class.c_str());
+    out += std::to_string(idx);
+    out += ' ';
+    out += std::to_string(signature);
+    out += ' ';
+    out += deobf_class;
+    out += '\n';
   }
-
-  fclose(fd);
+  return out;
 }
 
 const char* deobf_primitive(char type) {
@@ -2158,8 +2549,7 @@ const char* deobf_primitive(char type) {
   }
 }
 
-void write_pg_mapping(const std::string& filename, DexClasses* classes) {
-  if (filename.empty()) return;
+std::string format_pg_mapping(DexClasses* classes) {
 
   auto deobf_class = [&](DexClass* cls) {
     if (cls) {
@@ -2264,63 +2654,109 @@ void write_pg_mapping(const std::string& filename, DexClasses* classes) {
     return show(field);
   };
 
-  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::app);
+  std::ostringstream ofs;
 
   for (auto cls : *classes) {
     auto deobf_cls = deobf_class(cls);
     ofs << java_names::internal_to_external(deobf_cls) << " -> "
         << java_names::internal_to_external(cls->get_type()->c_str()) << ":"
-        << std::endl;
+        << '\n';
     for (auto field : cls->get_ifields()) {
       auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << field->c_str() << '\n';
     }
     for (auto field : cls->get_sfields()) {
       auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << field->c_str() << '\n';
     }
     for (auto meth : cls->get_dmethods()) {
       auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << meth->c_str() << '\n';
     }
     for (auto meth : cls->get_vmethods()) {
       auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      ofs << "    " << deobf << " -> " << meth->c_str() << '\n';
     }
   }
+  return ofs.str();
 }
 
-void write_bytecode_offset_mapping(
-    const std::string& filename,
+std::string format_bytecode_offset_mapping(
     const std::vector<std::pair<std::string, uint32_t>>& method_offsets) {
-  if (filename.empty()) {
-    return;
+  std::string out;
+  out.reserve(method_offsets.size() * 32);
+  for (const auto& item : method_offsets) {
+    out += std::to_string(item.second);
+    out += ' ';
+    out += item.first;
+    out += '\n';
   }
+  return out;
+}
 
-  auto fd = fopen(filename.c_str(), "a");
-  assert_log(fd, "Can't open bytecode offset file %s: %s\n", filename.c_str(),
-             strerror(errno));
+} // namespace
 
-  for (const auto& item : method_offsets) {
-    fprintf(fd, "%u %s\n", item.second, item.first.c_str());
+void write_symbol_file(const std::string& filename,
+                       const std::string& contents,
+                       bool append,
+                       bool compress) {
+  if (compress) {
+    gzFile gz = gzopen(filename.c_str(), append ? "ab" : "wb");
+    assert_log(gz, "Can't open symbol file %s: %s\n", filename.c_str(),
+               strerror(errno));
+    // gzwrite takes at most UINT_MAX bytes at a time.
+    constexpr size_t kMaxWrite = 1 << 30;
+    for (size_t pos = 0; pos < contents.size(); pos += kMaxWrite) {
+      auto size = std::min(kMaxWrite, contents.size() - pos);
+      always_assert_log(gzwrite(gz, contents.data() + pos, size) == (int)size,
+                        "Can't write symbol file %s", filename.c_str());
+    }
+    gzclose(gz);
+    return;
   }
-
+  FILE* fd = fopen(filename.c_str(), append ? "a" : "w");
+  assert_log(fd, "Can't open symbol file %s: %s\n", filename.c_str(),
+             strerror(errno));
+  fwrite(contents.data(), 1, contents.size(), fd);
   fclose(fd);
 }
 
-} // namespace
-
 void DexOutput::write_symbol_files() {
+  // The files are formatted while other dexes may be writing theirs; only
+  // appending to them goes one dex at a time.
+  std::string method_mapping;
+  std::string class_mapping;
   if (m_debug_info_kind != DebugInfoKind::NoCustomSymbolication) {
-    write_method_mapping(m_method_mapping_filename, dodx, m_classes,
-                         hdr.signature);
-    write_class_mapping(m_class_mapping_filename, m_classes,
-                        hdr.class_defs_size, hdr.signature);
+    method_mapping = format_method_mapping(dodx, m_classes, hdr.signature);
+    class_mapping = format_class_mapping(m_classes, hdr.class_defs_size,
+                                         hdr.signature);
     // XXX: should write_bytecode_offset_mapping be included here too?
   }
-  write_pg_mapping(m_pg_mapping_filename, m_classes);
-  write_bytecode_offset_mapping(m_bytecode_offset_filename,
-                                m_method_bytecode_offsets);
+  std::string pg_mapping;
+  if (!m_pg_mapping_filename.empty()) {
+    pg_mapping = format_pg_mapping(m_classes);
+  }
+  std::string bytecode_offset_mapping;
+  if (!m_bytecode_offset_filename.empty()) {
+    bytecode_offset_mapping =
+        format_bytecode_offset_mapping(m_method_bytecode_offsets);
+  }
+  in_order(DexEmissionOrder::Section::SYMBOL_FILES, [&]() {
+    if (m_debug_info_kind != DebugInfoKind::NoCustomSymbolication) {
+      write_symbol_file(m_method_mapping_filename, method_mapping,
+                        /* append */ true, m_compress_symbol_files);
+      write_symbol_file(m_class_mapping_filename, class_mapping,
+                        /* append */ true, m_compress_symbol_files);
+    }
+    if (!m_pg_mapping_filename.empty()) {
+      write_symbol_file(m_pg_mapping_filename, pg_mapping, /* append */ true,
+                        /* compress */ false);
+    }
+    if (!m_bytecode_offset_filename.empty()) {
+      write_symbol_file(m_bytecode_offset_filename, bytecode_offset_mapping,
+                        /* append */ true, /* compress */ false);
+    }
+  });
 }
 
 void GatheredTypes::set_method_sorting_whitelisted_substrings(
@@ -2338,6 +2774,12 @@ void DexOutput::prepare(SortMode string_mode,
                         const ConfigFiles& conf,
                         const std::string& dex_magic) {
 
+  // The method profiles are loaded by ConfigFiles::load if the layout or the
+  // page touch report need them.
+  const auto& method_profiles = conf.get_loaded_method_profiles();
+  if (method_profiles.has_stats()) {
+    m_gtypes->set_method_access_order(method_profiles.method_stats());
+  }
   if (std::find(code_mode.begin(), code_mode.end(),
                 SortMode::METHOD_PROFILED_ORDER) != code_mode.end()) {
     m_gtypes->set_method_to_weight(conf.get_method_to_weight());
@@ -2362,28 +2804,87 @@ void DexOutput::prepare(SortMode string_mode,
   generate_callsite_data();
   generate_methodhandle_data();
   generate_annotations();
-  generate_debug_items();
+  in_order(DexEmissionOrder::Section::DEBUG_INFO,
+           [&]() { generate_debug_items(); });
   if (m_force_class_data_end_of_file) {
     generate_class_data_items();
   }
   generate_map();
   align_output();
   finalize_header();
-  compute_method_to_id_map(dodx, m_classes, hdr.signature, m_method_to_id);
+  compute_compressed_sizes();
+  if (m_method_to_id != nullptr) {
+    auto method_ids = compute_method_ids(dodx, m_classes, hdr.signature);
+    in_order(DexEmissionOrder::Section::METHOD_IDS, [&]() {
+      for (const auto& pair : method_ids) {
+        (*m_method_to_id)[pair.first] = pair.second;
+      }
+    });
+  }
+}
+
+namespace {
+
+// The size of the given bytes once deflated, as they would be in an APK.
+int deflated_size(const uint8_t* data, size_t size) {
+  z_stream stream{};
+  always_assert(deflateInit(&stream, Z_DEFAULT_COMPRESSION) == Z_OK);
+  std::vector<uint8_t> chunk(64 * 1024);
+  stream.next_in = const_cast<uint8_t*>(data);
+  stream.avail_in = size;
+  int ret;
+  do {
+    // Only the size of the output matters; each chunk overwrites the last.
+    stream.next_out = chunk.data();
+    stream.avail_out = chunk.size();
+    ret = deflate(&stream, Z_FINISH);
+    always_assert(ret != Z_STREAM_ERROR);
+  } while (ret != Z_STREAM_END);
+  int deflated = stream.total_out;
+  deflateEnd(&stream);
+  return deflated;
+}
+
+} // namespace
+
+void DexOutput::compute_compressed_sizes() {
+  m_stats.compressed_bytes = deflated_size(m_output, m_offset);
+  auto range_size = [&](const std::pair<uint32_t, uint32_t>& range) {
+    return deflated_size(m_output + range.first,
+                         range.second - range.first);
+  };
+  m_stats.code_compressed_bytes = range_size(m_code_items_range);
+  m_stats.string_data_compressed_bytes = range_size(m_string_data_range);
 }
 
 void DexOutput::write() {
   struct stat st;
-  int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
-  if (fd == -1) {
-    perror("Error writing dex");
-    return;
+  int fd;
+  if (m_mapped_output != nullptr) {
+    // The image is already in the file. Unmapping leaves the dirty pages to
+    // the page cache; all that's left to do is trimming the file.
+    delete m_mapped_output;
+    m_mapped_output = nullptr;
+    m_output = nullptr;
+    fd = m_mapped_output_fd;
+    m_mapped_output_fd = -1;
+    auto ret = ftruncate(fd, m_offset);
+    always_assert_log(ret == 0, "Can't trim dex file %s to %u bytes: %s",
+                      m_filename, m_offset, strerror(errno));
+  } else {
+    fd = open_output_dex(m_filename, O_WRONLY);
+    if (fd == -1) {
+      perror("Error writing dex");
+    } else {
+      ::write(fd, m_output, m_offset);
+    }
   }
-  ::write(fd, m_output, m_offset);
-  if (0 == fstat(fd, &st)) {
-    m_stats.num_bytes = st.st_size;
+  if (fd != -1) {
+    if (0 == fstat(fd, &st)) {
+      m_stats.num_bytes = st.st_size;
+    }
+    close(fd);
   }
-  close(fd);
 
   write_symbol_files();
 }
@@ -2405,6 +2906,11 @@ class UniqueReferences {
 UniqueReferences s_unique_references;
 
 void DexOutput::metrics() {
+  in_order(DexEmissionOrder::Section::METRICS,
+           [&]() { accumulate_metrics(); });
+}
+
+void DexOutput::accumulate_metrics() {
   if (s_unique_references.dexes++ == 1 && !m_normal_primary_dex) {
     // clear out info from first (primary) dex
     s_unique_references.strings.clear();
@@ -2462,6 +2968,10 @@ static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
     return SortMode::CLINIT_FIRST;
   } else if (sort_bytecode == "method_profiled_order") {
     return SortMode::METHOD_PROFILED_ORDER;
+  } else if (sort_bytecode == "method_access_order") {
+    return SortMode::METHOD_ACCESS_ORDER;
+  } else if (sort_bytecode == "compression_order") {
+    return SortMode::COMPRESSION_ORDER;
   } else {
     return SortMode::DEFAULT;
   }
@@ -2480,7 +2990,9 @@ dex_stats_t write_classes_to_dex(
     std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
     IODIMetadata* iodi_metadata,
     const std::string& dex_magic,
-    PostLowering const* post_lowering) {
+    PostLowering const* post_lowering,
+    DexEmissionOrder* emission_order,
+    size_t emission_seq) {
   const JsonWrapper& json_cfg = conf.get_json_config();
   bool force_single_dex = json_cfg.get("force_single_dex", false);
   if (force_single_dex) {
@@ -2492,6 +3004,10 @@ dex_stats_t write_classes_to_dex(
     string_sort_mode = SortMode::CLASS_STRINGS;
   } else if (sort_strings == "class_order") {
     string_sort_mode = SortMode::CLASS_ORDER;
+  } else if (sort_strings == "method_access_order") {
+    string_sort_mode = SortMode::METHOD_ACCESS_ORDER;
+  } else if (sort_strings == "compression_order") {
+    string_sort_mode = SortMode::COMPRESSION_ORDER;
   }
 
   auto interdex_config = json_cfg.get("InterDexPass", Json::Value());
@@ -2526,6 +3042,7 @@ dex_stats_t write_classes_to_dex(
                              method_to_id,
                              code_debug_lines,
                              post_lowering);
+  dout.set_emission_order(emission_order, emission_seq);
 
   dout.prepare(string_sort_mode, code_sort_mode, conf, dex_magic);
   dout.write();
@@ -2570,3 +3087,20 @@ LocatorIndex make_locator_index(DexStoresVector& stores) {
 
   return index;
 }
+
+std::string make_class_locator_index(DexStoresVector& stores) {
+  std::vector<std::pair<std::string, Locator>> classes;
+  for (uint32_t strnr = 0; strnr < stores.size(); strnr++) {
+    DexClassesVector& dexen = stores[strnr].get_dexen();
+    uint32_t dexnr = 1; // Zero is reserved for Android classes
+    for (auto dexit = dexen.begin(); dexit != dexen.end(); ++dexit, ++dexnr) {
+      uint32_t clsnr = 0;
+      for (auto cls : *dexit) {
+        classes.emplace_back(cls->get_type()->get_name()->str(),
+                             Locator::make(strnr, dexnr, clsnr++));
+      }
+    }
+  }
+  TRACE(LOC, 1, "Class locator index of %zu classes", classes.size());
+  return facebook::ClassLocatorIndex::build(classes);
+}
@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
 #include <unordered_map>
 
 #include <boost/optional/optional.hpp>
@@ -37,14 +42,30 @@ typedef std::unordered_map<DexMethodHandle*, uint32_t> dexmethodhandle_to_idx;
 using LocatorIndex = std::unordered_map<DexString*, Locator>;
 LocatorIndex make_locator_index(DexStoresVector& stores);
 
+/*
+ * A perfect-hash index from the name of every class in the stores to its
+ * locator, renamed classes included; see liblocator/locator_index.h.
+ */
+std::string make_class_locator_index(DexStoresVector& stores);
+
 enum class SortMode {
   CLASS_ORDER,
   CLASS_STRINGS,
   CLINIT_FIRST,
   METHOD_PROFILED_ORDER,
+  // Startup methods (and their strings) first, by increasing first access
+  // time in the method profiles.
+  METHOD_ACCESS_ORDER,
+  // Like METHOD_ACCESS_ORDER for the startup methods and strings, followed by
+  // the other ones clustered by content, so that deflate finds more matches
+  // within its window.
+  COMPRESSION_ORDER,
   DEFAULT
 };
 
+// The page size for the simulated page touches of startup code and strings.
+constexpr uint32_t STARTUP_PAGE_SIZE = 4096;
+
 class DexOutputIdx {
  private:
   dexstring_to_idx* m_string;
@@ -124,6 +145,76 @@ class DexOutputIdx {
 };
 
 class IODIMetadata;
+class MappedFile;
+
+/*
+ * Some parts of dex emission feed state shared by all the dexes of an app,
+ * and their result depends on the order in which the dexes get there: the
+ * position mapper hands out line numbers sequentially, the method id map keeps
+ * the last id it sees for a method, the symbol files are appended to, and the
+ * reference metrics accumulate. When several dexes are written concurrently,
+ * each of those sections runs one dex at a time, in the order of the dexes'
+ * sequence numbers, so that the output is the same as when writing them one
+ * after the other.
+ *
+ * A dex only ever waits for dexes with smaller sequence numbers. Callers must
+ * thus start writing the dexes in sequence order, so that the smallest dex not
+ * yet done is always making progress.
+ */
+class DexEmissionOrder {
+ public:
+  enum class Section : size_t {
+    DEBUG_INFO,
+    METHOD_IDS,
+    SYMBOL_FILES,
+    METRICS,
+    NUM_SECTIONS,
+  };
+
+  // Run `f` once every dex numbered lower than `seq` has run this section.
+  template <typename Fn>
+  void run_in_order(Section section, size_t seq, const Fn& f) {
+    auto& turn = m_turns[static_cast<size_t>(section)];
+    {
+      std::unique_lock<std::mutex> lock(turn.mutex);
+      turn.cv.wait(lock, [&]() { return turn.next == seq || m_aborted; });
+      if (m_aborted) {
+        throw std::runtime_error("Dex emission aborted");
+      }
+    }
+    struct Leave {
+      Turn& turn;
+      ~Leave() {
+        std::lock_guard<std::mutex> guard(turn.mutex);
+        ++turn.next;
+        turn.cv.notify_all();
+      }
+    } leave{turn};
+    f();
+  }
+
+  /*
+   * Release all waiting dexes with an exception. Used when writing some dex
+   * failed, after which dexes waiting for their turn would never get it.
+   */
+  void abort() {
+    for (auto& turn : m_turns) {
+      std::lock_guard<std::mutex> guard(turn.mutex);
+      m_aborted = true;
+      turn.cv.notify_all();
+    }
+  }
+
+ private:
+  struct Turn {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next{0};
+  };
+
+  std::array<Turn, static_cast<size_t>(Section::NUM_SECTIONS)> m_turns;
+  std::atomic<bool> m_aborted{false};
+};
 
 dex_stats_t write_classes_to_dex(
     const RedexOptions&,
@@ -138,7 +229,19 @@ dex_stats_t write_classes_to_dex(
     std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
     IODIMetadata* iodi_metadata,
     const std::string& dex_magic,
-    PostLowering const* post_lowering = nullptr);
+    PostLowering const* post_lowering = nullptr,
+    DexEmissionOrder* emission_order = nullptr,
+    size_t emission_seq = 0);
+
+/*
+ * Writes the contents to the given file, or appends them to it. With compress,
+ * they become a gzip member of their own: a gzip file may hold any number of
+ * them, which decompress to the concatenation of their contents.
+ */
+void write_symbol_file(const std::string& filename,
+                       const std::string& contents,
+                       bool append,
+                       bool compress);
 
 typedef bool (*cmp_dstring)(const DexString*, const DexString*);
 typedef bool (*cmp_dtype)(const DexType*, const DexType*);
@@ -221,6 +324,10 @@ class GatheredTypes {
   std::unordered_map<const DexMethod*, unsigned int> m_methods_in_cls_order;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
+  // The methods of the method profiles, ranked by first access, and the
+  // strings they use, ranked by the first method that uses them.
+  std::unordered_map<const DexMethod*, unsigned int> m_methods_in_access_order;
+  std::unordered_map<const DexString*, unsigned int> m_access_order_strings;
 
   void gather_components(PostLowering const* post_lowering);
   dexstring_to_idx* get_string_index(cmp_dstring cmp = compare_dexstrings);
@@ -248,6 +355,8 @@ class GatheredTypes {
   std::vector<DexString*> get_dexstring_emitlist(T cmp = compare_dexstrings);
   std::vector<DexString*> get_cls_order_dexstring_emitlist();
   std::vector<DexString*> keep_cls_strings_together_emitlist();
+  std::vector<DexString*> get_access_order_dexstring_emitlist();
+  std::vector<DexString*> get_compression_order_dexstring_emitlist();
   std::vector<DexMethod*> get_dexmethod_emitlist();
   std::vector<DexMethodHandle*> get_dexmethodhandle_emitlist();
   std::vector<DexCallSite*> get_dexcallsite_emitlist();
@@ -258,6 +367,16 @@ class GatheredTypes {
   void sort_dexmethod_emitlist_cls_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_clinit_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_profiled_order(std::vector<DexMethod*>& lmeth);
+  void sort_dexmethod_emitlist_access_order(std::vector<DexMethod*>& lmeth);
+  void set_method_access_order(
+      const std::unordered_map<const DexMethodRef*, method_profiles::Stats>&
+          method_stats);
+  bool is_startup_method(const DexMethod* method) const {
+    return m_methods_in_access_order.count(method) != 0;
+  }
+  bool is_startup_string(const DexString* str) const {
+    return m_access_order_strings.count(str) != 0;
+  }
   void set_method_sorting_whitelisted_substrings(
       const std::unordered_set<std::string>& whitelisted_substrings);
   void set_method_to_weight(
@@ -273,10 +392,10 @@ std::vector<DexString*> GatheredTypes::get_dexstring_emitlist(T cmp) {
   return strlist;
 }
 
-typedef std::map<DexAnnotation*, uint32_t> annomap_t;
-typedef std::map<DexAnnotationSet*, uint32_t> asetmap_t;
-typedef std::map<ParamAnnotations*, uint32_t> xrefmap_t;
-typedef std::map<DexAnnotationDirectory*, uint32_t> adirmap_t;
+typedef std::unordered_map<DexAnnotation*, uint32_t> annomap_t;
+typedef std::unordered_map<DexAnnotationSet*, uint32_t> asetmap_t;
+typedef std::unordered_map<ParamAnnotations*, uint32_t> xrefmap_t;
+typedef std::unordered_map<DexAnnotationDirectory*, uint32_t> adirmap_t;
 
 struct CodeItemEmit {
   DexMethod* method;
@@ -298,12 +417,17 @@ class DexOutput {
   GatheredTypes* m_gtypes;
   uint8_t* m_output;
   uint32_t m_offset;
+  // The [start, end) offsets of the code items and of the string data, for
+  // the compressed size stats.
+  std::pair<uint32_t, uint32_t> m_code_items_range{0, 0};
+  std::pair<uint32_t, uint32_t> m_string_data_range{0, 0};
   const char* m_filename;
   size_t m_store_number;
   size_t m_dex_number;
   DebugInfoKind m_debug_info_kind;
   IODIMetadata* m_iodi_metadata;
   PositionMapper* m_pos_mapper;
+  bool m_compress_symbol_files;
   std::string m_method_mapping_filename;
   std::string m_class_mapping_filename;
   std::string m_pg_mapping_filename;
@@ -322,6 +446,20 @@ class DexOutput {
   const ConfigFiles& m_config_files;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
   bool m_force_class_data_end_of_file;
+  // Set when m_output maps the output file; see map_output_file().
+  MappedFile* m_mapped_output{nullptr};
+  int m_mapped_output_fd{-1};
+  DexEmissionOrder* m_emission_order{nullptr};
+  size_t m_emission_seq{0};
+
+  template <typename Fn>
+  void in_order(DexEmissionOrder::Section section, const Fn& f) {
+    if (m_emission_order == nullptr) {
+      f();
+    } else {
+      m_emission_order->run_in_order(section, m_emission_seq, f);
+    }
+  }
 
   void insert_map_item(uint16_t typeidx,
                        uint32_t size,
@@ -343,6 +481,7 @@ class DexOutput {
   // sorted by class.
   void generate_code_items(const std::vector<SortMode>& modes);
   void generate_static_values();
+  void compute_compressed_sizes();
   void unique_annotations(annomap_t& annomap,
                           std::vector<DexAnnotation*>& annolist);
   void unique_asets(annomap_t& annomap,
@@ -361,7 +500,9 @@ class DexOutput {
   void generate_map();
   void finalize_header();
   void init_header_offsets(const std::string& dex_magic);
+  bool map_output_file();
   void write_symbol_files();
+  void accumulate_metrics();
   void align_output() { m_offset = (m_offset + 3) & ~3; }
   void emit_locator(Locator locator);
   void emit_magic_locators();
@@ -386,6 +527,11 @@ class DexOutput {
                 code_debug_lines,
             PostLowering const* post_lowering = nullptr);
   ~DexOutput();
+  // Lets this dex be written concurrently with others; see DexEmissionOrder.
+  void set_emission_order(DexEmissionOrder* order, size_t seq) {
+    m_emission_order = order;
+    m_emission_seq = seq;
+  }
   void prepare(SortMode string_mode,
                const std::vector<SortMode>& code_mode,
                const ConfigFiles& conf,
@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <array>
+#include <boost/functional/hash.hpp>
 #include <fstream>
 #include <iostream>
 #include <json/json.h>
@@ -42,24 +44,98 @@ uint32_t RealPositionMapper::position_to_line(DexPosition* pos) {
   auto idx = m_positions.size();
   m_positions.emplace_back(pos);
   m_pos_line_map[pos] = idx;
-  return get_line(pos);
+  return idx + 1;
 }
 
 void RealPositionMapper::write_map() {
-  if (m_filename_v2 != "") {
+  if (m_filename.empty()) {
+    return;
+  }
+  if (m_version == 3) {
+    write_map_v3();
+  } else {
     write_map_v2();
   }
 }
 
+namespace {
+
+/*
+ * The strings referenced by a line map. Many positions share their method and
+ * file, and turning a method into the names of its class and of itself is the
+ * bulk of the work, so the ids are looked up once per distinct DexString.
+ */
+class MapStringPool {
+ public:
+  uint32_t id_of_string(const std::string& s) {
+    auto it = m_string_ids.emplace(s, m_strings.size()).first;
+    if (it->second == m_strings.size()) {
+      m_strings.push_back(s);
+    }
+    return it->second;
+  }
+
+  std::pair<uint32_t, uint32_t> ids_of_method(const DexString* method) {
+    auto it = m_method_ids.find(method);
+    if (it != m_method_ids.end()) {
+      return it->second;
+    }
+    // of the form "class_name.method_name:(arg_types)return_type"
+    const auto& full_method_name = method->str();
+    // strip out the args and return type
+    auto qualified_method_name =
+        full_method_name.substr(0, full_method_name.find(':'));
+    auto class_name = java_names::internal_to_external(
+        qualified_method_name.substr(0, qualified_method_name.rfind('.')));
+    auto method_name =
+        qualified_method_name.substr(qualified_method_name.rfind('.') + 1);
+    auto class_id = id_of_string(class_name);
+    auto method_id = id_of_string(method_name);
+    return m_method_ids.emplace(method, std::make_pair(class_id, method_id))
+        .first->second;
+  }
+
+  uint32_t id_of_file(const DexString* file) {
+    auto it = m_file_ids.find(file);
+    if (it != m_file_ids.end()) {
+      return it->second;
+    }
+    return m_file_ids.emplace(file, id_of_string(file->c_str()))
+        .first->second;
+  }
+
+  // Appends the class, method, file and line words of a map entry.
+  void append_frame(const DexPosition* pos, std::vector<uint32_t>* out) {
+    auto class_and_method_ids = ids_of_method(pos->method);
+    out->push_back(class_and_method_ids.first);
+    out->push_back(class_and_method_ids.second);
+    out->push_back(id_of_file(pos->file));
+    out->push_back(pos->line);
+  }
+
+  const std::vector<std::string>& strings() const { return m_strings; }
+
+ private:
+  std::unordered_map<std::string, uint32_t> m_string_ids;
+  std::vector<std::string> m_strings;
+  std::unordered_map<const DexString*, std::pair<uint32_t, uint32_t>>
+      m_method_ids;
+  std::unordered_map<const DexString*, uint32_t> m_file_ids;
+};
+
+void write_words(std::ostream& os, const std::vector<uint32_t>& words) {
+  os.write((const char*)words.data(), words.size() * sizeof(uint32_t));
+}
+
+} // namespace
+
 void RealPositionMapper::write_map_v2() {
   // to ensure that the line numbers in the Dex are as compact as possible,
   // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
+  for (auto& item : m_pos_line_map) {
+    if (item.second == -1) {
+      item.second = m_positions.size();
       m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
     }
   }
   /*
@@ -75,18 +151,11 @@ void RealPositionMapper::write_map_v2() {
    * string_length (4 bytes)
    * char[string_length]
    */
-  std::ostringstream pos_out;
-  std::unordered_map<std::string, uint32_t> string_ids;
-  std::vector<std::string> string_pool;
-
-  auto id_of_string = [&](const std::string& s) -> uint32_t {
-    if (string_ids.find(s) == string_ids.end()) {
-      string_ids[s] = string_pool.size();
-      string_pool.push_back(s);
-    }
-    return string_ids.at(s);
-  };
+  MapStringPool string_pool;
 
+  // Each position is encoded as five 32-bit words.
+  std::vector<uint32_t> pos_out;
+  pos_out.reserve(m_positions.size() * 5);
   for (auto pos : m_positions) {
     uint32_t parent_line = 0;
     try {
@@ -95,51 +164,136 @@ void RealPositionMapper::write_map_v2() {
       std::cerr << "Parent position " << show(pos->parent) << " of "
                 << show(pos) << " was not registered" << std::endl;
     }
-    // of the form "class_name.method_name:(arg_types)return_type"
-    const auto& full_method_name = pos->method->str();
-    // strip out the args and return type
-    auto qualified_method_name =
-        full_method_name.substr(0, full_method_name.find(':'));
-    auto class_name = java_names::internal_to_external(
-        qualified_method_name.substr(0, qualified_method_name.rfind('.')));
-    auto method_name =
-        qualified_method_name.substr(qualified_method_name.rfind('.') + 1);
-    auto class_id = id_of_string(class_name);
-    auto method_id = id_of_string(method_name);
-    auto file_id = id_of_string(pos->file->c_str());
-    pos_out.write((const char*)&class_id, sizeof(class_id));
-    pos_out.write((const char*)&method_id, sizeof(method_id));
-    pos_out.write((const char*)&file_id, sizeof(file_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
+    string_pool.append_frame(pos, &pos_out);
+    pos_out.push_back(parent_line);
   }
 
-  std::ofstream ofs(m_filename_v2.c_str(),
+  std::ofstream ofs(m_filename.c_str(),
                     std::ofstream::out | std::ofstream::trunc);
   uint32_t magic = 0xfaceb000; // serves as endianess check
   ofs.write((const char*)&magic, sizeof(magic));
   uint32_t version = 2;
   ofs.write((const char*)&version, sizeof(version));
-  uint32_t spool_count = string_pool.size();
+  uint32_t spool_count = string_pool.strings().size();
   ofs.write((const char*)&spool_count, sizeof(spool_count));
-  for (const auto& s : string_pool) {
+  for (const auto& s : string_pool.strings()) {
     uint32_t ssize = s.size();
     ofs.write((const char*)&ssize, sizeof(ssize));
     ofs << s;
   }
   uint32_t pos_count = m_positions.size();
   ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  write_words(ofs, pos_out);
+}
+
+void RealPositionMapper::write_map_v3() {
+  /*
+   * Map file layout, in 32-bit little-endian words unless noted:
+   * 0xfaceb000 (magic number)
+   * version (3)
+   * string_count
+   * frame_count
+   * line_count
+   * string_data_size (in bytes)
+   * string_offsets[string_count + 1], into string_data
+   * string_data[string_data_size] (bytes, zero-padded to a multiple of 4)
+   * frames[frame_count]
+   * lines[line_count]
+   *
+   * A frame is five words: class_id, method_id, file_id, line, and the index
+   * of the frame of its caller plus one, or zero for the outermost frame.
+   * Identical frames with identical callers are stored once, so all the lines
+   * that share an inlined stack share its frames. lines[n - 1] is the index
+   * of the innermost frame for line n of the Dex debug info.
+   */
+  MapStringPool string_pool;
+  std::vector<uint32_t> frames;
+  std::unordered_map<std::array<uint32_t, 5>, uint32_t,
+                     boost::hash<std::array<uint32_t, 5>>>
+      frame_ids;
+  std::unordered_map<const DexPosition*, uint32_t> frame_of_position;
+
+  // Returns the index of the frame of pos plus one, interning the frames of
+  // its callers first.
+  auto intern_stack = [&](DexPosition* pos) {
+    std::vector<DexPosition*> stack;
+    uint32_t parent = 0;
+    for (; pos != nullptr; pos = pos->parent) {
+      auto it = frame_of_position.find(pos);
+      if (it != frame_of_position.end()) {
+        parent = it->second;
+        break;
+      }
+      stack.push_back(pos);
+      if (pos->parent != nullptr && !m_pos_line_map.count(pos->parent)) {
+        std::cerr << "Parent position " << show(pos->parent) << " of "
+                  << show(pos) << " was not registered" << std::endl;
+        break;
+      }
+    }
+    std::vector<uint32_t> words;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+      words.clear();
+      string_pool.append_frame(*it, &words);
+      std::array<uint32_t, 5> frame{words[0], words[1], words[2], words[3],
+                                    parent};
+      auto inserted = frame_ids.emplace(frame, frame_ids.size() + 1);
+      if (inserted.second) {
+        frames.insert(frames.end(), frame.begin(), frame.end());
+      }
+      parent = inserted.first->second;
+      frame_of_position.emplace(*it, parent);
+    }
+    return parent;
+  };
+
+  // Only the emitted positions need a line. The others are reachable as
+  // callers of those.
+  std::vector<uint32_t> lines;
+  lines.reserve(m_positions.size());
+  for (auto pos : m_positions) {
+    lines.push_back(intern_stack(pos) - 1);
+  }
+
+  const auto& strings = string_pool.strings();
+  std::vector<uint32_t> string_offsets;
+  string_offsets.reserve(strings.size() + 1);
+  std::string string_data;
+  for (const auto& s : strings) {
+    string_offsets.push_back(string_data.size());
+    string_data += s;
+  }
+  string_offsets.push_back(string_data.size());
+  auto string_data_size = string_data.size();
+  string_data.resize((string_data_size + 3) & ~3, '\0');
+
+  std::vector<uint32_t> header{0xfaceb000, // serves as endianess check
+                               3,
+                               (uint32_t)strings.size(),
+                               (uint32_t)(frames.size() / 5),
+                               (uint32_t)lines.size(),
+                               (uint32_t)string_data_size};
+  std::ofstream ofs(m_filename.c_str(), std::ofstream::out |
+                                            std::ofstream::binary |
+                                            std::ofstream::trunc);
+  write_words(ofs, header);
+  write_words(ofs, string_offsets);
+  ofs.write(string_data.data(), string_data.size());
+  write_words(ofs, frames);
+  write_words(ofs, lines);
 }
 
-PositionMapper* PositionMapper::make(const std::string& map_filename_v2) {
-  if (map_filename_v2 == "") {
+PositionMapper* PositionMapper::make(const std::string& map_filename,
+                                     uint32_t map_version) {
+  if (map_filename == "") {
     // If no path is provided for the map, just pass the original line numbers
     // through to the output. This does mean that the line numbers will be
     // incorrect for inlined code.
     return new NoopPositionMapper();
   } else {
-    return new RealPositionMapper(map_filename_v2);
+    always_assert_log(map_version == 2 || map_version == 3,
+                      "Unsupported line map version %u", map_version);
+    return new RealPositionMapper(map_filename, map_version);
   }
 }
 
@@ -38,7 +38,8 @@ class PositionMapper {
   virtual uint32_t position_to_line(DexPosition*) = 0;
   virtual void register_position(DexPosition* pos) = 0;
   virtual void write_map() = 0;
-  static PositionMapper* make(const std::string& map_filename_v2);
+  static PositionMapper* make(const std::string& map_filename,
+                              uint32_t map_version = 2);
 };
 
 /*
@@ -47,19 +48,26 @@ class PositionMapper {
  * PositionMapper produces a text file with this data, and the line numbers in
  * the Dex debug info indicate the line in this text file at which the real
  * position can be found.
+ *
+ * Version 2 of the map lists every position, inlined frames included, after a
+ * string pool that has to be parsed first. Version 3 shares identical stacks
+ * between lines and puts every table at an offset given by its header, so
+ * that LineMapReader can look up single lines without reading the whole file.
  */
 class RealPositionMapper : public PositionMapper {
-  std::string m_filename_v2;
+  std::string m_filename;
+  uint32_t m_version;
   std::vector<DexPosition*> m_positions;
   std::unordered_map<DexPosition*, int64_t> m_pos_line_map;
 
  protected:
   uint32_t get_line(DexPosition*);
   void write_map_v2();
+  void write_map_v3();
 
  public:
-  RealPositionMapper(const std::string& filename_v2)
-      : m_filename_v2(filename_v2) {}
+  RealPositionMapper(const std::string& filename, uint32_t version = 2)
+      : m_filename(filename), m_version(version) {}
   DexString* get_source_file(const DexClass*) override;
   uint32_t position_to_line(DexPosition*) override;
   void register_position(DexPosition* pos) override;
@@ -34,6 +34,15 @@ dex_stats_t& operator+=(dex_stats_t& lhs, const dex_stats_t& rhs) {
   lhs.num_dbg_items += rhs.num_dbg_items;
   lhs.dbg_total_size += rhs.dbg_total_size;
   lhs.instruction_bytes += rhs.instruction_bytes;
+  lhs.startup_code_items += rhs.startup_code_items;
+  lhs.startup_code_bytes += rhs.startup_code_bytes;
+  lhs.startup_code_pages += rhs.startup_code_pages;
+  lhs.startup_strings += rhs.startup_strings;
+  lhs.startup_string_bytes += rhs.startup_string_bytes;
+  lhs.startup_string_pages += rhs.startup_string_pages;
+  lhs.compressed_bytes += rhs.compressed_bytes;
+  lhs.code_compressed_bytes += rhs.code_compressed_bytes;
+  lhs.string_data_compressed_bytes += rhs.string_data_compressed_bytes;
 
   lhs.header_item_count += rhs.header_item_count;
   lhs.header_item_bytes += rhs.header_item_bytes;
@@ -41,6 +41,21 @@ struct dex_stats_t {
 
   int instruction_bytes = 0;
 
+  /* Simulated cold start page touches of the methods in the method profiles
+   * and of their strings, in pages of STARTUP_PAGE_SIZE bytes. */
+  int startup_code_items = 0;
+  int startup_code_bytes = 0;
+  int startup_code_pages = 0;
+  int startup_strings = 0;
+  int startup_string_bytes = 0;
+  int startup_string_pages = 0;
+
+  /* Sizes once deflated like in an APK, of the whole dex and of the sections
+   * that the sort modes lay out. */
+  int compressed_bytes = 0;
+  int code_compressed_bytes = 0;
+  int string_data_compressed_bytes = 0;
+
   /* Stats collected from the Map List section of a Dex. */
   int header_item_count = 0;
   int header_item_bytes = 0;
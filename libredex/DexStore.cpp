@@ -60,29 +60,26 @@ void DexMetadata::parse(const std::string& path) {
 }
 
 XStoreRefs::XStoreRefs(const DexStoresVector& stores) {
-  m_xstores.push_back(std::unordered_set<const DexType*>());
+  // A class that is in several stores belongs to the first one.
+  auto add_classes = [&](const DexClasses& classes) {
+    for (const auto& cls : classes) {
+      m_store_idxs.emplace(cls->get_type(), m_stores.size() - 1);
+    }
+  };
   m_stores.push_back(&stores[0]);
-  for (const auto& cls : stores[0].get_dexen()[0]) {
-    m_xstores.back().insert(cls->get_type());
-  }
+  add_classes(stores[0].get_dexen()[0]);
   m_root_stores = 1;
   if (stores[0].get_dexen().size() > 1) {
     m_root_stores++;
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     m_stores.push_back(&stores[0]);
     for (size_t i = 1; i < stores[0].get_dexen().size(); i++) {
-      for (const auto& cls : stores[0].get_dexen()[i]) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(stores[0].get_dexen()[i]);
     }
   }
   for (size_t i = 1; i < stores.size(); i++) {
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     m_stores.push_back(&stores[i]);
     for (const auto& classes : stores[i].get_dexen()) {
-      for (const auto& cls : classes) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(classes);
     }
   }
 }
@@ -9,6 +9,7 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -128,17 +129,25 @@ class DexStoreClassesIterator
 class XStoreRefs {
  private:
   /**
-   * Set of classes in each logical store. A primary DEX goes in its own
-   * bucket (first element in the array).
+   * The logical store of each class, i.e. its index in m_stores. A primary
+   * DEX goes in its own logical store (the first one).
    */
-  std::vector<std::unordered_set<const DexType*>> m_xstores;
+  std::unordered_map<const DexType*, size_t> m_store_idxs;
 
   /**
-   * Pointers to original stores in the same order as used to populate
-   * m_xstores
+   * Pointers to original stores, by logical store.
    */
   std::vector<const DexStore*> m_stores;
 
+  /**
+   * The logical store of the type, or the number of logical stores if the
+   * type isn't in any.
+   */
+  size_t find_store_idx(const DexType* type) const {
+    auto it = m_store_idxs.find(type);
+    return it == m_store_idxs.end() ? m_stores.size() : it->second;
+  }
+
   /**
    * Number of root stores.
    */
@@ -153,10 +162,10 @@ class XStoreRefs {
    * api.
    */
   size_t get_store_idx(const DexType* type) const {
-    for (size_t store_idx = 0; store_idx < m_xstores.size(); store_idx++) {
-      if (m_xstores[store_idx].count(type) > 0) return store_idx;
-    }
-    always_assert_log(false, "type %s not in the current APK", SHOW(type));
+    size_t store_idx = find_store_idx(type);
+    always_assert_log(store_idx < m_stores.size(),
+                      "type %s not in the current APK", SHOW(type));
+    return store_idx;
   }
 
   const DexStore* get_store(size_t idx) const { return m_stores[idx]; }
@@ -186,12 +195,9 @@ class XStoreRefs {
     if (type_class_internal(type) == nullptr) return false;
     // Temporary HACK: optimizations may leave references to dead classes and
     // if we just call get_store_idx() - as we should - the assert will fire...
-    size_t type_store_idx = 0;
-    for (; type_store_idx < m_xstores.size(); type_store_idx++) {
-      if (m_xstores[type_store_idx].count(type) > 0) break;
-    }
-    if ((store_idx >= m_xstores.size()) ||
-        (type_store_idx >= m_xstores.size())) {
+    size_t type_store_idx = find_store_idx(type);
+    if ((store_idx >= m_stores.size()) ||
+        (type_store_idx >= m_stores.size())) {
       return type_store_idx > store_idx;
     }
     return illegal_ref_between_stores(store_idx, type_store_idx);
@@ -7,6 +7,9 @@
 
 #include "FieldOpTracker.h"
 
+#include <algorithm>
+#include <mutex>
+
 #include "BaseIRAnalyzer.h"
 #include "ConcurrentContainers.h"
 #include "ConstantAbstractDomain.h"
@@ -14,6 +17,7 @@
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
+#include "PatriciaTreeSetAbstractDomain.h"
 #include "Resolver.h"
 #include "Walkers.h"
 
@@ -82,6 +86,141 @@ NonZeroWrittenFields analyze_non_zero_writes(const Scope& scope) {
                               concurrent_non_zero_written_fields.end());
 }
 
+using FieldSetDomain = sparta::PatriciaTreeSetAbstractDomain<DexField*>;
+using FieldSetEnvironment =
+    sparta::PatriciaTreeMapAbstractEnvironment<reg_t, FieldSetDomain>;
+
+// Whether the result of the instruction is computed from its sources only.
+bool is_derived(IROpcode op) {
+  return is_move(op) || (op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8);
+}
+
+/*
+ * Tracks the fields whose read values flow into each register, and records
+ * where these values end up.
+ */
+class ReadUsesAnalyzer final : public BaseIRAnalyzer<FieldSetEnvironment> {
+
+ public:
+  explicit ReadUsesAnalyzer(const cfg::ControlFlowGraph& cfg)
+      : BaseIRAnalyzer(cfg), m_cfg(cfg) {
+    MonotonicFixpointIterator::run(FieldSetEnvironment::top());
+  }
+
+  void analyze_instruction(const IRInstruction* insn,
+                           FieldSetEnvironment* current_state) const override {
+    auto op = insn->opcode();
+    if (is_iget(op) || is_sget(op)) {
+      auto field = resolve_field(insn->get_field());
+      current_state->set(RESULT_REGISTER, field ? FieldSetDomain(field)
+                                                : FieldSetDomain());
+    } else if (opcode::is_move_result_any(op)) {
+      current_state->set(insn->dest(), current_state->get(RESULT_REGISTER));
+      current_state->set(RESULT_REGISTER, FieldSetDomain());
+    } else if (is_derived(op)) {
+      FieldSetDomain fields;
+      for (size_t i = 0; i < insn->srcs_size(); i++) {
+        fields.join_with(current_state->get(insn->src(i)));
+      }
+      current_state->set(insn->dest(), fields);
+    } else {
+      if (insn->has_move_result_any()) {
+        current_state->set(RESULT_REGISTER, FieldSetDomain());
+      }
+      if (insn->has_dest()) {
+        current_state->set(insn->dest(), FieldSetDomain());
+      }
+    }
+  }
+
+  void collect(FieldReadUses* read_uses) const {
+    auto escape = [&](const FieldSetDomain& fields) {
+      if (fields.is_value()) {
+        read_uses->escaping.insert(fields.elements().begin(),
+                                   fields.elements().end());
+      }
+    };
+    for (auto block : m_cfg.blocks()) {
+      auto current_state = get_entry_state_at(block);
+      for (auto& mie : InstructionIterable(block)) {
+        auto insn = mie.insn;
+        auto op = insn->opcode();
+        if (is_iput(op) || is_sput(op)) {
+          auto fields = current_state.get(insn->src(0));
+          auto field = resolve_field(insn->get_field());
+          if (field == nullptr) {
+            escape(fields);
+          } else if (fields.is_value()) {
+            for (auto f : fields.elements()) {
+              read_uses->written_to[f].insert(field);
+            }
+          }
+          if (is_iput(op)) {
+            escape(current_state.get(insn->src(1)));
+          }
+        } else if (!is_derived(op)) {
+          for (size_t i = 0; i < insn->srcs_size(); i++) {
+            escape(current_state.get(insn->src(i)));
+          }
+        }
+        analyze_instruction(insn, &current_state);
+      }
+    }
+  }
+
+ private:
+  const cfg::ControlFlowGraph& m_cfg;
+};
+
+FieldReadUses analyze_read_uses(const Scope& scope) {
+  std::mutex mutex;
+  FieldReadUses read_uses;
+  walk::parallel::code(scope, [&](const DexMethod*, const IRCode& code) {
+    FieldReadUses method_read_uses;
+    ReadUsesAnalyzer analyzer(code.cfg());
+    analyzer.collect(&method_read_uses);
+    std::lock_guard<std::mutex> lock(mutex);
+    read_uses.escaping.insert(method_read_uses.escaping.begin(),
+                              method_read_uses.escaping.end());
+    for (auto& pair : method_read_uses.written_to) {
+      read_uses.written_to[pair.first].insert(pair.second.begin(),
+                                              pair.second.end());
+    }
+  });
+  return read_uses;
+}
+
+std::unordered_set<DexField*> get_write_only_fields(
+    const FieldReadUses& read_uses,
+    const std::unordered_set<DexField*>& candidates) {
+  std::unordered_set<DexField*> write_only_fields;
+  for (auto field : candidates) {
+    if (!read_uses.escaping.count(field)) {
+      write_only_fields.insert(field);
+    }
+  }
+  // A field stops being write-only when its values get written to a field
+  // that isn't.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = write_only_fields.begin(); it != write_only_fields.end();) {
+      auto written_to = read_uses.written_to.find(*it);
+      if (written_to != read_uses.written_to.end() &&
+          std::any_of(written_to->second.begin(), written_to->second.end(),
+                      [&](DexField* field) {
+                        return !write_only_fields.count(field);
+                      })) {
+        it = write_only_fields.erase(it);
+        changed = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+  return write_only_fields;
+}
+
 FieldStatsMap analyze(const Scope& scope) {
   FieldStatsMap field_stats;
   // Gather the read/write counts.
@@ -10,6 +10,7 @@
 #include "DexClass.h"
 
 #include <unordered_map>
+#include <unordered_set>
 
 namespace field_op_tracker {
 
@@ -30,4 +31,23 @@ FieldStatsMap analyze(const Scope& scope);
 using NonZeroWrittenFields = std::unordered_set<DexField*>;
 
 NonZeroWrittenFields analyze_non_zero_writes(const Scope& scope);
-} // namespace field_op_tracker
+
+struct FieldReadUses {
+  // Fields whose read values are used other than to compute values that get
+  // written to fields.
+  std::unordered_set<DexField*> escaping;
+  // For each field, the fields that values computed from its reads get written
+  // to.
+  std::unordered_map<DexField*, std::unordered_set<DexField*>> written_to;
+};
+
+// Requires the CFGs of the scope to be built.
+FieldReadUses analyze_read_uses(const Scope& scope);
+
+// The largest subset of `candidates` whose fields' read values don't escape,
+// and only get written to fields of the subset. Once all the writes to these
+// fields are removed, all their reads are dead.
+std::unordered_set<DexField*> get_write_only_fields(
+    const FieldReadUses& read_uses,
+    const std::unordered_set<DexField*>& candidates);
+} // namespace field_op_tracker // namespace field_op_tracker
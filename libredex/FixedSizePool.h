@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#include "Debug.h"
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define REDEX_FIXED_SIZE_POOL_DISABLED
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define REDEX_FIXED_SIZE_POOL_DISABLED
+#endif
+
+/*
+ * A pool of equally-sized objects, for the small and very numerous objects
+ * that make up IR, like MethodItemEntries and IRInstructions.
+ *
+ * Objects are carved out of large slabs, so that objects created one after
+ * the other, as when ballooning or copying a method, end up next to each
+ * other instead of scattered over the heap. Freed objects go to a free list
+ * of the freeing thread and get reused by its next allocations, without any
+ * locking. Slabs are never returned to the system.
+ *
+ * Under AddressSanitizer, objects come straight from the system allocator so
+ * that use-after-free bugs are still caught.
+ */
+template <size_t kObjectSize, size_t kAlignment>
+class FixedSizePool {
+ public:
+  static constexpr size_t kSlabSize = 64 * 1024;
+
+  static void* allocate() {
+#ifdef REDEX_FIXED_SIZE_POOL_DISABLED
+    return ::operator new(kObjectSize);
+#else
+    auto& cache = thread_cache();
+    if (cache.free_list == nullptr) {
+      cache.refill();
+    }
+    auto node = cache.free_list;
+    cache.free_list = node->next;
+    return node;
+#endif
+  }
+
+  static void deallocate(void* p) {
+#ifdef REDEX_FIXED_SIZE_POOL_DISABLED
+    ::operator delete(p);
+#else
+    if (p == nullptr) {
+      return;
+    }
+    auto& cache = thread_cache();
+    auto node = static_cast<Node*>(p);
+    node->next = cache.free_list;
+    cache.free_list = node;
+#endif
+  }
+
+ private:
+  union Node {
+    Node* next;
+    alignas(kAlignment) char storage[kObjectSize];
+  };
+  static_assert(kAlignment <= alignof(std::max_align_t),
+                "Over-aligned objects are not supported");
+  static constexpr size_t kObjectsPerSlab = kSlabSize / sizeof(Node);
+
+  struct ThreadCache {
+    Node* free_list{nullptr};
+
+    // Hands the objects of exiting threads over to the next thread that runs
+    // out of them, so that short-lived threads don't strand memory.
+    ~ThreadCache() {
+      if (free_list == nullptr) {
+        return;
+      }
+      auto last = free_list;
+      while (last->next != nullptr) {
+        last = last->next;
+      }
+      std::lock_guard<std::mutex> guard(s_orphans_lock);
+      last->next = s_orphans;
+      s_orphans = free_list;
+    }
+
+    void refill() {
+      {
+        std::lock_guard<std::mutex> guard(s_orphans_lock);
+        if (s_orphans != nullptr) {
+          free_list = s_orphans;
+          s_orphans = nullptr;
+          return;
+        }
+      }
+      // Link the new slab in address order, so that consecutive allocations
+      // are adjacent.
+      auto slab = new Node[kObjectsPerSlab];
+      for (size_t i = 0; i + 1 < kObjectsPerSlab; ++i) {
+        slab[i].next = &slab[i + 1];
+      }
+      slab[kObjectsPerSlab - 1].next = nullptr;
+      free_list = slab;
+    }
+  };
+
+  static ThreadCache& thread_cache() {
+    static thread_local ThreadCache s_cache;
+    return s_cache;
+  }
+
+  static std::mutex s_orphans_lock;
+  static Node* s_orphans;
+};
+
+template <size_t kObjectSize, size_t kAlignment>
+std::mutex FixedSizePool<kObjectSize, kAlignment>::s_orphans_lock;
+
+template <size_t kObjectSize, size_t kAlignment>
+typename FixedSizePool<kObjectSize, kAlignment>::Node*
+    FixedSizePool<kObjectSize, kAlignment>::s_orphans = nullptr;
+
+/*
+ * Defines the class-specific operator new and delete of T, for use in T's
+ * translation unit, to allocate T from a FixedSizePool. T must declare them
+ * with REDEX_DECLARE_POOLED_NEW_DELETE().
+ */
+#define REDEX_DECLARE_POOLED_NEW_DELETE()   \
+  static void* operator new(size_t size);   \
+  static void operator delete(void* p)
+
+#define REDEX_DEFINE_POOLED_NEW_DELETE(T)                      \
+  void* T::operator new(size_t size) {                         \
+    always_assert(size == sizeof(T));                          \
+    return FixedSizePool<sizeof(T), alignof(T)>::allocate();   \
+  }                                                            \
+  void T::operator delete(void* p) {                           \
+    FixedSizePool<sizeof(T), alignof(T)>::deallocate(p);       \
+  }
@@ -8,8 +8,13 @@
 #include "FrameworkApi.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <cstdio>
 #include <fstream>
 
+#include "TextTokenizer.h"
+#include "Trace.h"
+
 namespace api {
 
 bool FrameworkAPI::has_method(const std::string& simple_deobfuscated_name,
@@ -45,68 +50,374 @@ bool FrameworkAPI::has_method(const std::string& simple_deobfuscated_name,
   return false;
 }
 
+namespace {
+
+// A member or class of an API file, as views into the file or its cache.
+struct RawMember {
+  boost::string_view descriptor;
+  uint32_t access_flags;
+};
+
+struct RawClass {
+  boost::string_view name;
+  boost::string_view super_name;
+  uint32_t access_flags;
+  std::vector<RawMember> methods;
+  std::vector<RawMember> fields;
+};
+
 /**
  * File format:
- *  <framework_cls> <super_cls> <num_methods> <num_fields>
- *      M <method0>
- *      M <method1>
+ *  <framework_cls> <access_flags> <super_cls> <num_methods> <num_fields>
+ *      M <method0> <access_flags>
+ *      M <method1> <access_flags>
  *      ...
- *      F <field0>
- *      F <field1>
+ *      F <field0> <access_flags>
+ *      F <field1> <access_flags>
  *      ...
  */
+std::vector<RawClass> parse_api_file(boost::string_view contents,
+                                     const std::string& filename) {
+  text::Tokenizer tokens(contents);
+  auto next_word = [&]() {
+    boost::string_view word;
+    always_assert_log(tokens.next_word(&word),
+                      "Truncated framework api file: %s\n", filename.c_str());
+    return word;
+  };
+  auto next_uint = [&]() {
+    uint32_t value;
+    auto word = next_word();
+    always_assert_log(text::parse_uint32(word, &value),
+                      "Expected a number in framework api file %s: %s\n",
+                      filename.c_str(), word.to_string().c_str());
+    return value;
+  };
+  auto next_member = [&](const char* tag) {
+    always_assert(next_word() == tag);
+    RawMember member;
+    member.descriptor = next_word();
+    member.access_flags = next_uint();
+    return member;
+  };
 
-void AndroidSDK::load_framework_classes() {
+  std::vector<RawClass> classes;
+  boost::string_view name;
+  while (tokens.next_word(&name)) {
+    RawClass cls;
+    cls.name = name;
+    cls.access_flags = next_uint();
+    cls.super_name = next_word();
+    uint32_t num_methods = next_uint();
+    uint32_t num_fields = next_uint();
+    cls.methods.reserve(num_methods);
+    while (num_methods-- > 0) {
+      cls.methods.push_back(next_member("M"));
+    }
+    cls.fields.reserve(num_fields);
+    while (num_fields-- > 0) {
+      cls.fields.push_back(next_member("F"));
+    }
+    classes.push_back(std::move(cls));
+  }
+  return classes;
+}
 
-  std::ifstream infile(m_sdk_api_file.c_str());
-  assert_log(infile, "Failed to open framework api file: %s\n",
-             m_sdk_api_file.c_str());
+FrameworkAPI resolve(const RawClass& raw) {
+  FrameworkAPI framework_api;
+  framework_api.cls = DexType::make_type(raw.name.to_string().c_str());
+  framework_api.super_cls =
+      DexType::make_type(raw.super_name.to_string().c_str());
+  framework_api.access_flags = DexAccessFlags(raw.access_flags);
+  framework_api.mrefs_info.reserve(raw.methods.size());
+  for (const auto& method : raw.methods) {
+    DexMethodRef* mref = DexMethod::make_method(method.descriptor.to_string());
+    framework_api.mrefs_info.emplace_back(mref,
+                                          DexAccessFlags(method.access_flags));
+  }
+  framework_api.frefs_info.reserve(raw.fields.size());
+  for (const auto& field : raw.fields) {
+    DexFieldRef* fref = DexField::make_field(field.descriptor.to_string());
+    framework_api.frefs_info.emplace_back(fref,
+                                          DexAccessFlags(field.access_flags));
+  }
+  return framework_api;
+}
 
-  std::string framework_cls_str;
-  std::string super_cls_str;
-  std::string class_name;
-  uint32_t num_methods;
-  uint32_t num_fields;
-  uint32_t access_flags;
+// Identifies the contents of the API file that a cache was built from.
+struct SourceStamp {
+  uint64_t size;
+  uint64_t mtime;
+};
 
-  while (infile >> framework_cls_str >> access_flags >> super_cls_str >>
-         num_methods >> num_fields) {
-    FrameworkAPI framework_api;
-    framework_api.cls = DexType::make_type(framework_cls_str.c_str());
-    always_assert_log(m_framework_classes.count(framework_api.cls) == 0,
-                      "Duplicated class name!");
-    framework_api.super_cls = DexType::make_type(super_cls_str.c_str());
-    framework_api.access_flags = DexAccessFlags(access_flags);
+SourceStamp stamp_of(const std::string& filename) {
+  boost::system::error_code ec;
+  SourceStamp stamp{0, 0};
+  stamp.size = boost::filesystem::file_size(filename, ec);
+  if (!ec) {
+    stamp.mtime = boost::filesystem::last_write_time(filename, ec);
+  }
+  return stamp;
+}
 
-    while (num_methods-- > 0) {
-      std::string method_str;
-      std::string tag;
-      uint32_t m_access_flags;
+/*
+ * The cache is a sequence of uint32_t words:
+ *
+ *   magic, version, source size (low, high), source mtime (low, high),
+ *   class_count, member_count, string_data_size
+ *   classes[class_count], sorted by name: name_offset, name_size,
+ *     super_offset, super_size, access_flags, first_member, num_methods,
+ *     num_fields
+ *   members[member_count], methods before fields in each class:
+ *     descriptor_offset, descriptor_size, access_flags
+ *   string_data[string_data_size], padded to whole words
+ */
+constexpr uint32_t CACHE_MAGIC = 0xfa9ac4e0;
+constexpr uint32_t CACHE_VERSION = 1;
+constexpr size_t HEADER_WORDS = 9;
+constexpr size_t CLASS_WORDS = 8;
+constexpr size_t MEMBER_WORDS = 3;
+
+void write_cache(const std::string& cache_file,
+                 const SourceStamp& stamp,
+                 const std::vector<RawClass>& classes) {
+  std::vector<const RawClass*> sorted;
+  sorted.reserve(classes.size());
+  for (const auto& cls : classes) {
+    sorted.push_back(&cls);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const RawClass* a, const RawClass* b) { return a->name < b->name; });
+
+  std::vector<uint32_t> class_words;
+  std::vector<uint32_t> member_words;
+  std::string strings;
+  auto add_string = [&](boost::string_view str, std::vector<uint32_t>* out) {
+    out->push_back(strings.size());
+    out->push_back(str.size());
+    strings.append(str.data(), str.size());
+  };
+  for (const auto* cls : sorted) {
+    add_string(cls->name, &class_words);
+    add_string(cls->super_name, &class_words);
+    class_words.push_back(cls->access_flags);
+    class_words.push_back(member_words.size() / MEMBER_WORDS);
+    class_words.push_back(cls->methods.size());
+    class_words.push_back(cls->fields.size());
+    for (const auto* members : {&cls->methods, &cls->fields}) {
+      for (const auto& member : *members) {
+        add_string(member.descriptor, &member_words);
+        member_words.push_back(member.access_flags);
+      }
+    }
+  }
+  strings.resize((strings.size() + 3) & ~size_t(3), '\0');
 
-      infile >> tag >> method_str >> m_access_flags;
+  std::vector<uint32_t> header = {CACHE_MAGIC,
+                                  CACHE_VERSION,
+                                  static_cast<uint32_t>(stamp.size),
+                                  static_cast<uint32_t>(stamp.size >> 32),
+                                  static_cast<uint32_t>(stamp.mtime),
+                                  static_cast<uint32_t>(stamp.mtime >> 32),
+                                  static_cast<uint32_t>(sorted.size()),
+                                  static_cast<uint32_t>(member_words.size() /
+                                                        MEMBER_WORDS),
+                                  static_cast<uint32_t>(strings.size())};
 
-      always_assert(tag == "M");
-      DexMethodRef* mref = DexMethod::make_method(method_str);
-      framework_api.mrefs_info.emplace_back(mref,
-                                            DexAccessFlags(m_access_flags));
+  // Written aside and renamed into place, so that concurrent runs only ever
+  // see a complete cache.
+  auto tmp_file =
+      cache_file + "." + boost::filesystem::unique_path().string() + ".tmp";
+  {
+    std::ofstream out(tmp_file, std::ios::binary);
+    for (const auto* words : {&header, &class_words, &member_words}) {
+      out.write(reinterpret_cast<const char*>(words->data()),
+                words->size() * sizeof(uint32_t));
     }
+    out.write(strings.data(), strings.size());
+    if (!out) {
+      TRACE(API_UTILS, 1, "Failed to write the framework api cache %s",
+            tmp_file.c_str());
+      out.close();
+      std::remove(tmp_file.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+  }
+}
 
-    while (num_fields-- > 0) {
-      std::string field_str;
-      std::string tag;
-      uint32_t f_access_flags;
+} // namespace
+
+/*
+ * A mapped cache written by write_cache(), which looks up classes by binary
+ * search over their sorted names.
+ */
+class AndroidSDKCache {
+ public:
+  // Null if the cache is missing, or wasn't built from this version of the
+  // API file.
+  static std::unique_ptr<AndroidSDKCache> open(const std::string& cache_file,
+                                               const SourceStamp& stamp) {
+    std::unique_ptr<AndroidSDKCache> cache(new AndroidSDKCache(cache_file));
+    auto contents = cache->m_file.contents();
+    if (contents.size() < HEADER_WORDS * sizeof(uint32_t)) {
+      return nullptr;
+    }
+    const auto* header = reinterpret_cast<const uint32_t*>(contents.data());
+    uint64_t size = header[2] | (uint64_t(header[3]) << 32);
+    uint64_t mtime = header[4] | (uint64_t(header[5]) << 32);
+    uint64_t class_count = header[6];
+    uint64_t member_count = header[7];
+    uint64_t words = HEADER_WORDS + class_count * CLASS_WORDS +
+                     member_count * MEMBER_WORDS + (header[8] + 3) / 4;
+    if (header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION ||
+        size != stamp.size || mtime != stamp.mtime ||
+        words * sizeof(uint32_t) != contents.size()) {
+      return nullptr;
+    }
+    cache->m_class_count = class_count;
+    cache->m_classes = header + HEADER_WORDS;
+    cache->m_members = cache->m_classes + class_count * CLASS_WORDS;
+    cache->m_strings = reinterpret_cast<const char*>(
+        cache->m_members + member_count * MEMBER_WORDS);
+    return cache;
+  }
 
-      infile >> tag >> field_str >> f_access_flags;
+  size_t class_count() const { return m_class_count; }
 
-      always_assert(tag == "F");
-      DexFieldRef* fref = DexField::make_field(field_str);
-      framework_api.frefs_info.emplace_back(fref,
-                                            DexAccessFlags(f_access_flags));
+  boost::optional<uint32_t> find(boost::string_view name) const {
+    uint32_t lo = 0;
+    uint32_t hi = m_class_count;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int cmp = string_at(m_classes + mid * CLASS_WORDS).compare(name);
+      if (cmp == 0) {
+        return mid;
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
     }
+    return boost::none;
+  }
 
+  RawClass get(uint32_t idx) const {
+    const auto* words = m_classes + idx * CLASS_WORDS;
+    RawClass cls;
+    cls.name = string_at(words);
+    cls.super_name = string_at(words + 2);
+    cls.access_flags = words[4];
+    const auto* member = m_members + words[5] * MEMBER_WORDS;
+    for (uint32_t i = 0; i < words[6] + words[7]; ++i, member += MEMBER_WORDS) {
+      auto& members = i < words[6] ? cls.methods : cls.fields;
+      members.push_back(RawMember{string_at(member), member[2]});
+    }
+    return cls;
+  }
+
+ private:
+  explicit AndroidSDKCache(const std::string& cache_file)
+      : m_file(cache_file) {}
+
+  // The string of an (offset, size) pair of words.
+  boost::string_view string_at(const uint32_t* words) const {
+    return boost::string_view(m_strings + words[0], words[1]);
+  }
+
+  text::MappedTextFile m_file;
+  size_t m_class_count{0};
+  const uint32_t* m_classes{nullptr};
+  const uint32_t* m_members{nullptr};
+  const char* m_strings{nullptr};
+};
+
+AndroidSDK::AndroidSDK(boost::optional<std::string> sdk_api_file,
+                       boost::optional<std::string> cache_dir) {
+  if (!sdk_api_file) {
+    // For missing api file, we initialize to an empty SDK.
+    m_sdk_api_file = "";
+    m_all_loaded = true;
+    return;
+  }
+  m_sdk_api_file = *sdk_api_file;
+  boost::optional<std::string> cache_file;
+  if (cache_dir) {
+    cache_file =
+        (boost::filesystem::path(*cache_dir) /
+         (boost::filesystem::path(m_sdk_api_file).filename().string() + ".bin"))
+            .string();
+    m_cache = AndroidSDKCache::open(*cache_file, stamp_of(m_sdk_api_file));
+    if (m_cache) {
+      return;
+    }
+  }
+  load_framework_classes(cache_file);
+}
+
+AndroidSDK::~AndroidSDK() = default;
+
+void AndroidSDK::load_framework_classes(
+    const boost::optional<std::string>& cache_file) {
+  text::MappedTextFile file(m_sdk_api_file);
+  assert_log(file.is_open(), "Failed to open framework api file: %s\n",
+             m_sdk_api_file.c_str());
+  auto classes = parse_api_file(file.contents(), m_sdk_api_file);
+  if (cache_file) {
+    write_cache(*cache_file, stamp_of(m_sdk_api_file), classes);
+  }
+  for (const auto& raw : classes) {
+    auto framework_api = resolve(raw);
+    always_assert_log(m_framework_classes.count(framework_api.cls) == 0,
+                      "Duplicated class name!");
     auto& map_entry = m_framework_classes[framework_api.cls];
     map_entry = std::move(framework_api);
   }
+  m_all_loaded = true;
+}
+
+const std::unordered_map<DexType*, FrameworkAPI>&
+AndroidSDK::get_framework_classes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_all_loaded) {
+    for (uint32_t i = 0; i < m_cache->class_count(); ++i) {
+      auto framework_api = resolve(m_cache->get(i));
+      m_framework_classes.emplace(framework_api.cls, std::move(framework_api));
+    }
+    m_all_loaded = true;
+  }
+  return m_framework_classes;
+}
+
+const FrameworkAPI* AndroidSDK::find_class(DexType* type) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_framework_classes.find(type);
+  if (it != m_framework_classes.end()) {
+    return &it->second;
+  }
+  if (m_all_loaded) {
+    return nullptr;
+  }
+  auto idx = m_cache->find(type->str());
+  if (!idx) {
+    return nullptr;
+  }
+  auto& api = m_framework_classes[type];
+  api = resolve(m_cache->get(*idx));
+  return &api;
+}
+
+bool AndroidSDK::has_method(DexMethod* meth) const {
+  const auto* api = find_class(meth->get_class());
+  if (api == nullptr) {
+    return false;
+  }
+  return api->has_method(meth->get_simple_deobfuscated_name(),
+                         meth->get_proto(), meth->get_access(),
+                         /* relax_access_flags_matching */ true);
 }
 
 } // namespace api
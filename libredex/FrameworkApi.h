@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+
 #include "DexClass.h"
 
 namespace api {
@@ -40,40 +43,41 @@ struct FrameworkAPI {
                   bool relax_access_flags_matching = false) const;
 };
 
+class AndroidSDKCache;
+
+/*
+ * The classes of an Android SDK API file (see load_framework_classes() for its
+ * format).
+ *
+ * With a `cache_dir`, the file is converted once into a binary index there,
+ * which later runs map instead of parsing the file: has_method() then only
+ * resolves the classes it is asked about, and the whole SDK is only resolved
+ * if get_framework_classes() is called.
+ */
 class AndroidSDK {
  public:
-  explicit AndroidSDK(boost::optional<std::string> sdk_api_file) {
-    if (sdk_api_file) {
-      m_sdk_api_file = *sdk_api_file;
-      load_framework_classes();
-    } else {
-      // For missing api file, we initialize to an empty SDK.
-      m_sdk_api_file = "";
-    }
-  }
-
-  std::unordered_map<DexType*, FrameworkAPI> get_framework_classes() {
-    return m_framework_classes;
-  }
-
-  bool has_method(DexMethod* meth) const {
-    auto type = meth->get_class();
-    const auto& it = m_framework_classes.find(type);
-    if (it == m_framework_classes.end()) {
-      return false;
-    }
-
-    const auto& api = it->second;
-    return api.has_method(meth->get_simple_deobfuscated_name(),
-                          meth->get_proto(), meth->get_access(),
-                          /* relax_access_flags_matching */ true);
-  }
+  explicit AndroidSDK(boost::optional<std::string> sdk_api_file,
+                      boost::optional<std::string> cache_dir = boost::none);
+  ~AndroidSDK();
+
+  const std::unordered_map<DexType*, FrameworkAPI>& get_framework_classes()
+      const;
+
+  bool has_method(DexMethod* meth) const;
 
  private:
-  void load_framework_classes();
+  void load_framework_classes(const boost::optional<std::string>& cache_file);
+
+  // The API of `type`, or nullptr if the SDK doesn't have it.
+  const FrameworkAPI* find_class(DexType* type) const;
 
   std::string m_sdk_api_file;
-  std::unordered_map<DexType*, FrameworkAPI> m_framework_classes;
+  std::unique_ptr<AndroidSDKCache> m_cache;
+  // All the classes of the SDK once m_all_loaded, or those looked up so far
+  // in m_cache.
+  mutable std::mutex m_mutex;
+  mutable std::unordered_map<DexType*, FrameworkAPI> m_framework_classes;
+  mutable bool m_all_loaded{false};
 };
 
 } // namespace api
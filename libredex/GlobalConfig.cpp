@@ -21,6 +21,8 @@ void InlinerConfig::bind_config() {
   bind("run_dedup_blocks", run_dedup_blocks, run_dedup_blocks);
   bind("run_copy_prop", run_copy_prop, run_copy_prop);
   bind("run_local_dce", run_local_dce, run_local_dce);
+  bind("speed_inline_budget", speed_inline_budget, speed_inline_budget);
+  bind("log_inline_decisions", log_inline_decisions, log_inline_decisions);
   bind("no_inline_annos", {}, m_no_inline_annos);
   bind("force_inline_annos", {}, m_force_inline_annos);
   bind("black_list", {}, m_black_list);
@@ -54,11 +56,13 @@ void GlobalConfig::bind_config() {
   bind("android_sdk_api_23_file", "", string_param);
   bind("android_sdk_api_25_file", "", string_param);
   bind("android_sdk_api_26_file", "", string_param);
+  bind("block_profile_file", "", string_param);
   bind("bytecode_sort_mode", {}, string_vector_param);
   bind("coldstart_classes", "", string_param);
   bind("compute_xml_reachability", false, bool_param);
   bind("debug_info_kind", "", string_param);
   bind("default_coldstart_classes", "", string_param);
+  bind("emit_class_locator_index", "", string_param);
   bind("emit_class_method_info_map", false, bool_param);
   bind("emit_locator_strings", {}, bool_param);
   bind("force_single_dex", false, bool_param);
@@ -79,5 +83,6 @@ void GlobalConfig::bind_config() {
   bind("prune_unexported_components", {}, string_vector_param);
   bind("pure_methods", {}, string_vector_param);
   bind("record_keep_reasons", {}, bool_param);
+  bind("startup_page_report", false, bool_param);
   bind("string_sort_mode", "", string_param);
 }
@@ -477,9 +477,9 @@ class CFGVisualizer : public CodeVisualizer<CFGVisualizer> {
       value<QUOTED>("name") << name;
       if (prefix) {
         Block fake_block(m_cfg, std::numeric_limits<BlockId>::max());
-        auto first_real = (!m_cfg || m_cfg->blocks().empty())
+        auto first_real = (!m_cfg || m_cfg->num_blocks() == 0)
                               ? nullptr
-                              : *m_cfg->blocks().begin();
+                              : *m_cfg->block_range().begin();
         Edge fake_edge(&fake_block, first_real ? first_real : &fake_block,
                        EDGE_GOTO);
         const_cast<std::vector<Edge*>&>(fake_block.succs())
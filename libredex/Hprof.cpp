@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Hprof.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Debug.h"
+
+namespace hprof {
+
+namespace {
+
+enum RecordTag : uint8_t {
+  STRING = 0x01,
+  LOAD_CLASS = 0x02,
+  HEAP_DUMP = 0x0C,
+  HEAP_DUMP_SEGMENT = 0x1C,
+  HEAP_DUMP_END = 0x2C,
+};
+
+enum HeapTag : uint8_t {
+  ROOT_UNKNOWN = 0xFF,
+  ROOT_JNI_GLOBAL = 0x01,
+  ROOT_JNI_LOCAL = 0x02,
+  ROOT_JAVA_FRAME = 0x03,
+  ROOT_NATIVE_STACK = 0x04,
+  ROOT_STICKY_CLASS = 0x05,
+  ROOT_THREAD_BLOCK = 0x06,
+  ROOT_MONITOR_USED = 0x07,
+  ROOT_THREAD_OBJECT = 0x08,
+  CLASS_DUMP = 0x20,
+  INSTANCE_DUMP = 0x21,
+  OBJECT_ARRAY_DUMP = 0x22,
+  PRIMITIVE_ARRAY_DUMP = 0x23,
+  // Android extensions.
+  HEAP_DUMP_INFO = 0xFE,
+  ROOT_INTERNED_STRING = 0x89,
+  ROOT_FINALIZING = 0x8A,
+  ROOT_DEBUGGER = 0x8B,
+  ROOT_REFERENCE_CLEANUP = 0x8C,
+  ROOT_VM_INTERNAL = 0x8D,
+  ROOT_JNI_MONITOR = 0x8E,
+  UNREACHABLE = 0x90,
+  PRIMITIVE_ARRAY_NODATA_DUMP = 0xC3,
+};
+
+enum BasicType : uint8_t {
+  OBJECT = 2,
+  BOOLEAN = 4,
+  CHAR = 5,
+  FLOAT = 6,
+  DOUBLE = 7,
+  BYTE = 8,
+  SHORT = 9,
+  INT = 10,
+  LONG = 11,
+};
+
+// Reads the big-endian values of the dump, keeping count of the bytes read
+// so that the records can be delimited.
+class Reader {
+ public:
+  explicit Reader(std::istream& is) : m_is(is) {}
+
+  uint64_t read(size_t size) {
+    uint8_t bytes[8];
+    always_assert(size <= sizeof(bytes));
+    read_bytes(reinterpret_cast<char*>(bytes), size);
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value = (value << 8) | bytes[i];
+    }
+    return value;
+  }
+
+  uint8_t read_u1() { return read(1); }
+  uint16_t read_u2() { return read(2); }
+  uint32_t read_u4() { return read(4); }
+  uint64_t read_id() { return read(m_id_size); }
+
+  void read_bytes(char* bytes, size_t size) {
+    m_is.read(bytes, size);
+    always_assert_log(m_is.gcount() == static_cast<std::streamsize>(size),
+                      "Truncated heap dump");
+    m_offset += size;
+  }
+
+  void skip(uint64_t size) {
+    // Large skips, e.g. over the primitive arrays, may not fit a streamsize.
+    while (size > 0) {
+      auto chunk = std::min<uint64_t>(size, 1 << 30);
+      m_is.ignore(chunk);
+      always_assert_log(m_is.gcount() == static_cast<std::streamsize>(chunk),
+                        "Truncated heap dump");
+      m_offset += chunk;
+      size -= chunk;
+    }
+  }
+
+  bool at_end() { return m_is.peek() == std::istream::traits_type::eof(); }
+
+  uint64_t offset() const { return m_offset; }
+
+  size_t id_size() const { return m_id_size; }
+
+  void set_id_size(size_t id_size) {
+    always_assert_log(id_size == 4 || id_size == 8,
+                      "Unsupported identifier size %zu", id_size);
+    m_id_size = id_size;
+  }
+
+ private:
+  std::istream& m_is;
+  uint64_t m_offset{0};
+  size_t m_id_size{4};
+};
+
+size_t basic_type_size(uint8_t type, size_t id_size) {
+  switch (type) {
+  case OBJECT:
+    return id_size;
+  case BOOLEAN:
+  case BYTE:
+    return 1;
+  case CHAR:
+  case SHORT:
+    return 2;
+  case FLOAT:
+  case INT:
+    return 4;
+  case DOUBLE:
+  case LONG:
+    return 8;
+  default:
+    always_assert_log(false, "Unknown basic type %u", type);
+  }
+  not_reached();
+}
+
+class ClassReader {
+ public:
+  explicit ClassReader(std::istream& is) : m_reader(is) {}
+
+  std::vector<LoadedClass> read() {
+    read_header();
+    while (!m_reader.at_end()) {
+      auto tag = m_reader.read_u1();
+      m_reader.read_u4(); // The time offset.
+      uint64_t length = m_reader.read_u4();
+      if (tag == HEAP_DUMP_END) {
+        break;
+      }
+      switch (tag) {
+      case STRING:
+        read_string(length);
+        break;
+      case LOAD_CLASS:
+        read_load_class(length);
+        break;
+      case HEAP_DUMP:
+      case HEAP_DUMP_SEGMENT:
+        read_heap_dump(length);
+        break;
+      default:
+        m_reader.skip(length);
+        break;
+      }
+    }
+    return loaded_classes();
+  }
+
+ private:
+  struct ClassRecord {
+    uint32_t serial;
+    uint64_t name_id;
+  };
+
+  void read_header() {
+    // A null-terminated format name, e.g. "JAVA PROFILE 1.0.3".
+    char c;
+    do {
+      m_reader.read_bytes(&c, 1);
+    } while (c != '\0');
+    m_reader.set_id_size(m_reader.read_u4());
+    m_reader.read_u4(); // The timestamp.
+    m_reader.read_u4();
+  }
+
+  void read_string(uint64_t length) {
+    always_assert_log(length >= m_reader.id_size(), "Bad string record");
+    auto id = m_reader.read_id();
+    std::string str(length - m_reader.id_size(), '\0');
+    m_reader.read_bytes(&str[0], str.size());
+    m_strings[id] = std::move(str);
+  }
+
+  void read_load_class(uint64_t length) {
+    auto start = m_reader.offset();
+    auto serial = m_reader.read_u4();
+    auto class_id = m_reader.read_id();
+    m_reader.read_u4(); // The stack trace serial number.
+    auto name_id = m_reader.read_id();
+    m_load_classes[class_id] = ClassRecord{serial, name_id};
+    m_reader.skip(length - (m_reader.offset() - start));
+  }
+
+  void read_heap_dump(uint64_t length) {
+    auto id_size = m_reader.id_size();
+    auto end = m_reader.offset() + length;
+    while (m_reader.offset() < end) {
+      auto tag = m_reader.read_u1();
+      switch (tag) {
+      case ROOT_UNKNOWN:
+      case ROOT_STICKY_CLASS:
+      case ROOT_MONITOR_USED:
+      case ROOT_INTERNED_STRING:
+      case ROOT_FINALIZING:
+      case ROOT_DEBUGGER:
+      case ROOT_REFERENCE_CLEANUP:
+      case ROOT_VM_INTERNAL:
+      case UNREACHABLE:
+        m_reader.skip(id_size);
+        break;
+      case ROOT_JNI_GLOBAL:
+        m_reader.skip(2 * id_size);
+        break;
+      case ROOT_JNI_LOCAL:
+      case ROOT_JAVA_FRAME:
+      case ROOT_JNI_MONITOR:
+      case ROOT_THREAD_OBJECT:
+        m_reader.skip(id_size + 8);
+        break;
+      case ROOT_NATIVE_STACK:
+      case ROOT_THREAD_BLOCK:
+      case HEAP_DUMP_INFO:
+        m_reader.skip(id_size + 4);
+        break;
+      case CLASS_DUMP:
+        read_class_dump();
+        break;
+      case INSTANCE_DUMP: {
+        m_reader.skip(id_size + 4 + id_size);
+        m_reader.skip(m_reader.read_u4());
+        break;
+      }
+      case OBJECT_ARRAY_DUMP: {
+        m_reader.skip(id_size + 4);
+        uint64_t num_elements = m_reader.read_u4();
+        m_reader.skip(id_size + num_elements * id_size);
+        break;
+      }
+      case PRIMITIVE_ARRAY_DUMP:
+      case PRIMITIVE_ARRAY_NODATA_DUMP: {
+        m_reader.skip(id_size + 4);
+        uint64_t num_elements = m_reader.read_u4();
+        auto type = m_reader.read_u1();
+        if (tag == PRIMITIVE_ARRAY_DUMP) {
+          m_reader.skip(num_elements * basic_type_size(type, id_size));
+        }
+        break;
+      }
+      default:
+        always_assert_log(false, "Unknown heap dump tag 0x%x", tag);
+      }
+    }
+    always_assert_log(m_reader.offset() == end, "Bad heap dump segment");
+  }
+
+  void read_class_dump() {
+    auto id_size = m_reader.id_size();
+    m_dumped_classes.insert(m_reader.read_id());
+    // The stack trace serial number, the ids of the super class, the class
+    // loader, the signers, the protection domain and two reserved ones, and
+    // the instance size.
+    m_reader.skip(4 + 6 * id_size + 4);
+    auto constant_pool_size = m_reader.read_u2();
+    for (uint16_t i = 0; i < constant_pool_size; ++i) {
+      m_reader.skip(2);
+      m_reader.skip(basic_type_size(m_reader.read_u1(), id_size));
+    }
+    auto static_fields_count = m_reader.read_u2();
+    for (uint16_t i = 0; i < static_fields_count; ++i) {
+      m_reader.skip(id_size);
+      m_reader.skip(basic_type_size(m_reader.read_u1(), id_size));
+    }
+    auto instance_fields_count = m_reader.read_u2();
+    m_reader.skip(instance_fields_count * (id_size + 1));
+  }
+
+  std::vector<LoadedClass> loaded_classes() {
+    std::vector<LoadedClass> classes;
+    std::unordered_set<std::string> names;
+    for (auto class_id : m_dumped_classes) {
+      auto it = m_load_classes.find(class_id);
+      always_assert_log(it != m_load_classes.end(),
+                        "No class load record for class 0x%llx",
+                        (unsigned long long)class_id);
+      auto name_it = m_strings.find(it->second.name_id);
+      always_assert_log(name_it != m_strings.end(),
+                        "No name for class 0x%llx",
+                        (unsigned long long)class_id);
+      const auto& name = name_it->second;
+      if (name.size() >= 2 && name.compare(name.size() - 2, 2, "[]") == 0) {
+        continue;
+      }
+      classes.push_back(LoadedClass{name, it->second.serial});
+    }
+    // Of the classes of the same name, keep the first one loaded.
+    std::sort(classes.begin(), classes.end(),
+              [](const LoadedClass& a, const LoadedClass& b) {
+                if (a.serial != b.serial) {
+                  return a.serial < b.serial;
+                }
+                return a.name < b.name;
+              });
+    classes.erase(std::remove_if(classes.begin(), classes.end(),
+                                 [&](const LoadedClass& cls) {
+                                   return !names.insert(cls.name).second;
+                                 }),
+                  classes.end());
+    return classes;
+  }
+
+  Reader m_reader;
+  std::unordered_map<uint64_t, std::string> m_strings;
+  std::unordered_map<uint64_t, ClassRecord> m_load_classes;
+  std::unordered_set<uint64_t> m_dumped_classes;
+};
+
+} // namespace
+
+std::vector<LoadedClass> read_loaded_classes(std::istream& is) {
+  return ClassReader(is).read();
+}
+
+std::string java_name_to_descriptor(const std::string& name) {
+  std::string descriptor;
+  descriptor.reserve(name.size() + 2);
+  descriptor += 'L';
+  for (auto c : name) {
+    descriptor += c == '.' ? '/' : c;
+  }
+  descriptor += ';';
+  return descriptor;
+}
+
+} // namespace hprof
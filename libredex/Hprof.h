@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/*
+ * Reads the classes out of Java heap dumps in the hprof format, e.g. those of
+ * `adb shell am dumpheap`.
+ *
+ * The dump is read as a stream, one record at a time: only the names of the
+ * classes are kept, and the contents of the objects are skipped over, so that
+ * this takes time and memory proportional to the number of classes and
+ * strings rather than to the size of the heap.
+ */
+namespace hprof {
+
+struct LoadedClass {
+  // The Java name of the class, e.g. "com.facebook.Foo".
+  std::string name;
+  // On Dalvik and ART, the serial numbers follow the order of class loading.
+  uint32_t serial;
+};
+
+/*
+ * The classes that have an object in the heap dump, except for the array
+ * classes, ordered by their serial numbers. A class that was loaded by several
+ * class loaders only appears once.
+ *
+ * Throws a RedexException when the dump is malformed.
+ */
+std::vector<LoadedClass> read_loaded_classes(std::istream& is);
+
+// "com.facebook.Foo" -> "Lcom/facebook/Foo;"
+std::string java_name_to_descriptor(const std::string& name);
+
+} // namespace hprof
@@ -57,6 +57,20 @@ reg_t reg_from_str(const std::string& reg_str) {
 
 std::string reg_to_str(reg_t reg) { return "v" + std::to_string(reg); }
 
+// Returns the last S-expression of the text.
+s_expr parse_s_expr(const std::string& s) {
+  s_expr_parser parser(s);
+  s_expr expr;
+  while (parser.good()) {
+    parser >> expr;
+    if (parser.eoi()) {
+      break;
+    }
+    always_assert_log(!parser.fail(), "%s\n", parser.what().c_str());
+  }
+  return expr;
+}
+
 s_expr to_s_expr(const IRInstruction* insn, const LabelRefs& label_refs) {
   auto op = insn->opcode();
   auto opcode_str = opcode_to_string_table.at(op);
@@ -182,25 +196,31 @@ std::unique_ptr<IRInstruction> instruction_from_s_expr(
                     opcode_str.c_str());
   auto op = op_it->second;
   auto insn = std::make_unique<IRInstruction>(op);
-  std::string reg_str;
-  s_expr tail = e;
+  // The operands are read in order by index rather than matched against
+  // patterns, which would copy the rest of the list at each step.
+  size_t next = 0;
+  auto next_string = [&](const char* expected) -> std::string {
+    always_assert_log(next < e.size() && e[next].is_string(),
+                      "%s for %s",
+                      expected,
+                      opcode_str.c_str());
+    return e[next++].get_string();
+  };
   if (insn->has_dest()) {
-    s_patn({s_patn(&reg_str)}, tail)
-        .must_match(tail, "Expected dest reg for " + opcode_str);
-    insn->set_dest(reg_from_str(reg_str));
+    insn->set_dest(reg_from_str(next_string("Expected dest reg")));
   }
   if (opcode::has_variable_srcs_size(op)) {
-    auto srcs = tail[0];
-    tail = tail.tail(1);
+    always_assert_log(next < e.size() && e[next].is_list(),
+                      "Expected list of src regs for %s",
+                      opcode_str.c_str());
+    auto srcs = e[next++];
     insn->set_srcs_size(srcs.size());
     for (size_t i = 0; i < insn->srcs_size(); ++i) {
       insn->set_src(i, reg_from_str(srcs[i].get_string()));
     }
   } else {
     for (size_t i = 0; i < insn->srcs_size(); ++i) {
-      s_patn({s_patn(&reg_str)}, tail)
-          .must_match(tail, "Expected src reg for" + opcode_str);
-      insn->set_src(i, reg_from_str(reg_str));
+      insn->set_src(i, reg_from_str(next_string("Expected src reg")));
     }
   }
   switch (opcode::ref(op)) {
@@ -210,43 +230,30 @@ std::unique_ptr<IRInstruction> instruction_from_s_expr(
     always_assert_log(false, "Not yet supported");
     break;
   case opcode::Ref::Field: {
-    std::string str;
-    s_patn({s_patn(&str)}, tail)
-        .must_match(tail, "Expecting string literal for " + opcode_str);
-    auto* dex_field = DexField::make_field(str);
+    auto* dex_field =
+        DexField::make_field(next_string("Expecting string literal"));
     insn->set_field(dex_field);
     break;
   }
   case opcode::Ref::Method: {
-    std::string str;
-    s_patn({s_patn(&str)}, tail)
-        .must_match(tail, "Expecting string literal for " + opcode_str);
-    auto* dex_method = DexMethod::make_method(str);
+    auto* dex_method =
+        DexMethod::make_method(next_string("Expecting string literal"));
     insn->set_method(dex_method);
     break;
   }
   case opcode::Ref::String: {
-    std::string str;
-    s_patn({s_patn(&str)}, tail)
-        .must_match(tail, "Expecting string literal for " + opcode_str);
-    auto* dex_str = DexString::make_string(str);
+    auto* dex_str =
+        DexString::make_string(next_string("Expecting string literal"));
     insn->set_string(dex_str);
     break;
   }
   case opcode::Ref::Literal: {
-    std::string num_str;
-    s_patn({s_patn(&num_str)}, tail)
-        .must_match(tail, "Expecting numeric literal for " + opcode_str);
-    int64_t num;
-    std::istringstream in(num_str);
-    in >> num;
-    insn->set_literal(num);
+    auto num_str = next_string("Expecting numeric literal");
+    insn->set_literal(strtoll(num_str.c_str(), nullptr, 10));
     break;
   }
   case opcode::Ref::Type: {
-    std::string type_str;
-    s_patn({s_patn(&type_str)}, tail)
-        .must_match(tail, "Expecting type specifier for " + opcode_str);
+    auto type_str = next_string("Expecting type specifier");
     DexType* ty = DexType::make_type(type_str.c_str());
     insn->set_type(ty);
     break;
@@ -262,25 +269,24 @@ std::unique_ptr<IRInstruction> instruction_from_s_expr(
   }
 
   if (is_branch(op)) {
-    std::string label_str;
+    auto& labels = (*label_refs)[insn.get()];
     if (is_switch(op)) {
-      s_expr list;
-      s_patn({s_patn(list)}, tail)
-          .must_match(tail, "Expecting list of labels for " + opcode_str);
-      while (s_patn({s_patn(&label_str)}, list).match_with(list)) {
-        (*label_refs)[insn.get()].push_back(label_str);
+      always_assert_log(next < e.size() && e[next].is_list(),
+                        "Expecting list of labels for %s",
+                        opcode_str.c_str());
+      auto list = e[next++];
+      for (size_t i = 0; i < list.size() && list[i].is_string(); ++i) {
+        labels.push_back(list[i].get_string());
       }
     } else {
-      s_patn({s_patn(&label_str)}, tail)
-          .must_match(tail, "Expecting label for " + opcode_str);
-      (*label_refs)[insn.get()].push_back(label_str);
+      labels.push_back(next_string("Expecting label"));
     }
   }
 
-  always_assert_log(tail.is_nil(),
+  always_assert_log(next == e.size(),
                     "Found unexpected trailing items when parsing %s: %s",
                     opcode_str.c_str(),
-                    tail.str().c_str());
+                    e.tail(next).str().c_str());
   return insn;
 }
 
@@ -460,22 +466,21 @@ std::unordered_map<std::string, MethodItemEntry*> get_catch_name_map(
     const s_expr& insns) {
   std::unordered_map<std::string, MethodItemEntry*> result;
   for (size_t i = 0; i < insns.size(); ++i) {
-    std::string keyword;
-    s_expr tail;
-    if (s_patn({s_patn(&keyword)}, tail).match_with(insns[i])) {
-      if (keyword == ".catch") {
-        // Catch markers look like this:
-        // (.catch (this next) "LCatchType;")
-        // where next and "LCatchType;" are optional
-        std::string this_catch;
-        s_expr maybe_next, type_expr;
-        s_patn({s_patn({s_patn(&this_catch)}, maybe_next)}, type_expr)
-            .must_match(tail, "catch marker missing a name list");
-        // FIXME?
-        result.emplace(this_catch,
-                       new MethodItemEntry(static_cast<DexType*>(nullptr)));
-      }
+    auto insn = insns[i];
+    if (!insn.is_list() || insn.size() == 0 || !insn[0].is_string() ||
+        insn[0].get_string() != ".catch") {
+      continue;
     }
+    // Catch markers look like this:
+    // (.catch (this next) "LCatchType;")
+    // where next and "LCatchType;" are optional
+    std::string this_catch;
+    s_expr maybe_next, type_expr;
+    s_patn({s_patn({s_patn(&this_catch)}, maybe_next)}, type_expr)
+        .must_match(insn.tail(1), "catch marker missing a name list");
+    // FIXME?
+    result.emplace(this_catch,
+                   new MethodItemEntry(static_cast<DexType*>(nullptr)));
   }
   return result;
 }
@@ -733,9 +738,10 @@ std::unique_ptr<IRCode> ircode_from_s_expr(const s_expr& e) {
   const auto& catches = get_catch_name_map(insns_expr);
 
   for (size_t i = 0; i < insns_expr.size(); ++i) {
-    std::string keyword;
-    s_expr tail;
-    if (s_patn({s_patn(&keyword)}, tail).match_with(insns_expr[i])) {
+    auto item = insns_expr[i];
+    if (item.is_list() && item.size() > 0 && item[0].is_string()) {
+      const std::string& keyword = item[0].get_string();
+      s_expr tail = item.tail(1);
       // check if keyword starts with ".pos"
       if (strncmp(keyword.c_str(), ".pos", 4) == 0) {
         auto pos = position_from_s_expr(tail, positions);
@@ -835,18 +841,7 @@ std::unique_ptr<IRCode> ircode_from_s_expr(const s_expr& e) {
 }
 
 std::unique_ptr<IRCode> ircode_from_string(const std::string& s) {
-  std::istringstream input(s);
-  s_expr_istream s_expr_input(input);
-  s_expr expr;
-  while (s_expr_input.good()) {
-    s_expr_input >> expr;
-    if (s_expr_input.eoi()) {
-      break;
-    }
-    always_assert_log(!s_expr_input.fail(), "%s\n",
-                      s_expr_input.what().c_str());
-  }
-  return ircode_from_s_expr(expr);
+  return ircode_from_s_expr(parse_s_expr(s));
 }
 
 #define AF(uc, lc, val) {ACC_##uc, #lc},
@@ -884,18 +879,7 @@ DexMethod* method_from_s_expr(const s_expr& e) {
 }
 
 DexMethod* method_from_string(const std::string& s) {
-  std::istringstream input(s);
-  s_expr_istream s_expr_input(input);
-  s_expr expr;
-  while (s_expr_input.good()) {
-    s_expr_input >> expr;
-    if (s_expr_input.eoi()) {
-      break;
-    }
-    always_assert_log(!s_expr_input.fail(), "%s\n",
-                      s_expr_input.what().c_str());
-  }
-  return method_from_s_expr(expr);
+  return method_from_s_expr(parse_s_expr(s));
 }
 
 DexMethod* class_with_method(const std::string& class_name,
@@ -914,9 +898,7 @@ DexClass* class_with_methods(const std::string& class_name,
   auto class_type = DexType::make_type(DexString::make_string(class_name));
   ClassCreator class_creator(class_type);
   class_creator.set_super(type::java_lang_Object());
-  for (const auto& method : methods) {
-    class_creator.add_method(method);
-  }
+  class_creator.add_methods(methods);
   class_creator.create();
   return class_creator.get_class();
 }
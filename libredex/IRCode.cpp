@@ -122,7 +122,7 @@ bool encode_offset(IRList* ir, MethodItemEntry* target_mie, int32_t offset) {
     auto goto_op = goto_for_offset(offset);
     if (goto_op != bop) {
       branch_op_mie->dex_insn = new DexInstruction(goto_op);
-      delete insn;
+      DexInstruction::destroy(insn);
       return false;
     }
   } else if (dex_opcode::is_conditional_branch(bop)) {
@@ -153,7 +153,7 @@ bool encode_offset(IRList* ir, MethodItemEntry* target_mie, int32_t offset) {
       auto next_insn_it = std::next(ir->iterator_to(*branch_op_mie));
       insert_branch_target(ir, &*next_insn_it, mei);
 
-      delete insn;
+      DexInstruction::destroy(insn);
       return false;
     }
   } else {
@@ -415,7 +415,7 @@ void translate_dex_to_ir(
 
     insn->normalize_registers();
 
-    delete it->dex_insn;
+    DexInstruction::destroy(it->dex_insn);
     it->type = MFLOW_OPCODE;
     it->insn = insn;
     if (move_result_pseudo != nullptr) {
@@ -563,6 +563,8 @@ IRList* deep_copy_ir_list(IRList* old_ir_list) {
 
 } // namespace
 
+std::atomic<size_t> IRCode::s_epoch{0};
+
 IRCode::IRCode() : m_ir_list(new IRList()) {}
 
 IRCode::~IRCode() {
@@ -584,22 +586,46 @@ IRCode::IRCode(DexMethod* method, size_t temp_regs) : m_ir_list(new IRList()) {
 }
 
 IRCode::IRCode(const IRCode& code) {
-  IRList* old_ir_list = code.m_ir_list;
-  m_ir_list = deep_copy_ir_list(old_ir_list);
-  m_registers_size = code.m_registers_size;
+  if (code.editable_cfg_built()) {
+    // The instructions are in the blocks of the CFG, not in the IRList.
+    m_ir_list = nullptr;
+    m_cfg = std::make_unique<cfg::ControlFlowGraph>();
+    code.m_cfg->deep_copy(m_cfg.get());
+    clear_cfg();
+  } else {
+    IRList* old_ir_list = code.m_ir_list;
+    m_ir_list = deep_copy_ir_list(old_ir_list);
+    m_registers_size = code.m_registers_size;
+  }
   if (code.m_dbg) {
     m_dbg = std::make_unique<DexDebugItem>(*code.m_dbg);
   }
 }
 
+IRCode::IRCode(std::unique_ptr<cfg::ControlFlowGraph> cfg) {
+  always_assert(cfg->editable());
+  m_ir_list = nullptr;
+  m_cfg = std::move(cfg);
+  clear_cfg();
+}
+
 void IRCode::build_cfg(bool editable) {
+  if (editable) {
+    mark_modified();
+  }
+  if (m_cfg_retained) {
+    if (editable) {
+      return;
+    }
+    release_cfg();
+  }
   clear_cfg();
   m_cfg = std::make_unique<cfg::ControlFlowGraph>(
       m_ir_list, m_registers_size, editable);
 }
 
 void IRCode::clear_cfg() {
-  if (!m_cfg) {
+  if (!m_cfg || m_cfg_retained) {
     return;
   }
 
@@ -622,6 +648,21 @@ void IRCode::clear_cfg() {
   }
 }
 
+void IRCode::retain_cfg() {
+  // Keeping the CFG around isn't a modification by itself.
+  auto epoch = m_modified_epoch;
+  if (!editable_cfg_built()) {
+    build_cfg(/* editable */ true);
+  }
+  m_cfg_retained = true;
+  m_modified_epoch = epoch;
+}
+
+void IRCode::release_cfg() {
+  m_cfg_retained = false;
+  clear_cfg();
+}
+
 bool IRCode::cfg_built() const { return m_cfg != nullptr; }
 
 bool IRCode::editable_cfg_built() const {
@@ -792,6 +833,7 @@ std::unique_ptr<DexCode> IRCode::sync(const DexMethod* method) {
     dex_code->set_debug_item(std::move(m_dbg));
     while (try_sync(dex_code.get()) == false)
       ;
+    dex_code->set_instruction_pool(std::move(m_dex_insn_pool));
   } catch (const std::exception& e) {
     std::cerr << "Failed to sync " << SHOW(method) << std::endl
               << SHOW(this) << std::endl;
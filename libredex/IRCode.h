@@ -41,22 +41,37 @@ class IRCode {
 
   IRList* m_ir_list;
   std::unique_ptr<cfg::ControlFlowGraph> m_cfg;
+  bool m_cfg_retained{false};
 
   reg_t m_registers_size{0};
   // TODO(jezng): we shouldn't be storing / exposing the DexDebugItem... just
   // exposing the param names should be enough
   std::unique_ptr<DexDebugItem> m_dbg;
-
-  IRList::iterator main_block() { return m_ir_list->main_block(); }
+  // The DexInstructions of the lowered code, handed over to the DexCode on
+  // sync().
+  std::unique_ptr<DexInstructionPool> m_dex_insn_pool;
+
+  static std::atomic<size_t> s_epoch;
+  // See modified_epoch(). Mutable, since some const accessors hand out
+  // mutable entries.
+  mutable size_t m_modified_epoch{current_epoch()};
+  void mark_modified() const { m_modified_epoch = current_epoch(); }
+
+  IRList::iterator main_block() {
+    mark_modified();
+    return m_ir_list->main_block();
+  }
   IRList::iterator make_if_block(const IRList::iterator& cur,
                                  IRInstruction* insn,
                                  IRList::iterator* if_block) {
+    mark_modified();
     return m_ir_list->make_if_block(cur, insn, if_block);
   }
   IRList::iterator make_if_else_block(const IRList::iterator& cur,
                                       IRInstruction* insn,
                                       IRList::iterator* if_block,
                                       IRList::iterator* else_block) {
+    mark_modified();
     return m_ir_list->make_if_else_block(cur, insn, if_block, else_block);
   }
   IRList::iterator make_switch_block(
@@ -64,6 +79,7 @@ class IRCode {
       IRInstruction* insn,
       IRList::iterator* default_block,
       std::map<SwitchIndices, IRList::iterator>& cases) {
+    mark_modified();
     return m_ir_list->make_switch_block(cur, insn, default_block, cases);
   }
 
@@ -90,6 +106,12 @@ class IRCode {
 
   IRCode(const IRCode& code);
 
+  /*
+   * Takes over an editable CFG that was built separately, e.g. from a copy of
+   * part of another method's CFG, and linearizes it.
+   */
+  explicit IRCode(std::unique_ptr<cfg::ControlFlowGraph> cfg);
+
   ~IRCode();
 
   bool structural_equals(const IRCode& other) {
@@ -104,11 +126,18 @@ class IRCode {
 
   reg_t get_registers_size() const { return m_registers_size; }
 
-  void set_registers_size(reg_t sz) { m_registers_size = sz; }
+  void set_registers_size(reg_t sz) {
+    mark_modified();
+    m_registers_size = sz;
+  }
 
-  reg_t allocate_temp() { return m_registers_size++; }
+  reg_t allocate_temp() {
+    mark_modified();
+    return m_registers_size++;
+  }
 
   reg_t allocate_wide_temp() {
+    mark_modified();
     reg_t new_reg = m_registers_size;
     m_registers_size += 2;
     return new_reg;
@@ -119,15 +148,21 @@ class IRCode {
    * always be at the beginning of the method.
    */
   boost::sub_range<IRList> get_param_instructions() const {
+    mark_modified();
     return m_ir_list->get_param_instructions();
   }
 
   void set_debug_item(std::unique_ptr<DexDebugItem> dbg) {
+    mark_modified();
     m_dbg = std::move(dbg);
   }
   const DexDebugItem* get_debug_item() const { return m_dbg.get(); }
-  DexDebugItem* get_debug_item() { return m_dbg.get(); }
+  DexDebugItem* get_debug_item() {
+    mark_modified();
+    return m_dbg.get();
+  }
   std::unique_ptr<DexDebugItem> release_debug_item() {
+    mark_modified();
     return std::move(m_dbg);
   }
 
@@ -140,7 +175,10 @@ class IRCode {
   void gather_methodhandles(std::vector<DexMethodHandle*>& lmethodhandle) const;
 
   /* Return the control flow graph of this method as a vector of blocks. */
-  cfg::ControlFlowGraph& cfg() { return *m_cfg; }
+  cfg::ControlFlowGraph& cfg() {
+    mark_modified();
+    return *m_cfg;
+  }
 
   const cfg::ControlFlowGraph& cfg() const { return *m_cfg; }
 
@@ -159,17 +197,38 @@ class IRCode {
   bool cfg_built() const;
   bool editable_cfg_built() const;
 
+  // Keep an editable CFG of this method until `release_cfg` is called, so
+  // that consecutive passes share it and its cached analyses. In the meantime,
+  // `build_cfg(true)` reuses it and `clear_cfg` leaves it in place; asking for
+  // a non-editable CFG releases it first.
+  void retain_cfg();
+  void release_cfg();
+  bool cfg_retained() const { return m_cfg_retained; }
+
+  /*
+   * The pool to allocate the DexInstructions of this code from when lowering
+   * it, sized for about `expected_count` of them when first created.
+   */
+  DexInstructionPool* dex_insn_pool(size_t expected_count = 0) {
+    if (!m_dex_insn_pool) {
+      m_dex_insn_pool = std::make_unique<DexInstructionPool>(expected_count);
+    }
+    return m_dex_insn_pool.get();
+  }
+
   /* Generate DexCode from IRCode */
   std::unique_ptr<DexCode> sync(const DexMethod*);
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* from, IRInstruction* to) {
+    mark_modified();
     m_ir_list->replace_opcode(from, to);
   }
 
   /* Passes memory ownership of "from" to callee.  It will delete it. */
   void replace_opcode(IRInstruction* to_delete,
                       const std::vector<IRInstruction*>& replacements) {
+    mark_modified();
     m_ir_list->replace_opcode(to_delete, replacements);
   }
 
@@ -178,22 +237,28 @@ class IRCode {
    * to appease the compiler in various scenarios of unreachable code.
    */
   void replace_opcode_with_infinite_loop(IRInstruction* from) {
+    mark_modified();
     m_ir_list->replace_opcode_with_infinite_loop(from);
   }
 
   /* Like replace_opcode, but both :from and :to must be branch opcodes.
    * :to will end up jumping to the same destination as :from. */
   void replace_branch(IRInstruction* from, IRInstruction* to) {
+    mark_modified();
     m_ir_list->replace_branch(from, to);
   }
 
   template <class... Args>
   void push_back(Args&&... args) {
+    mark_modified();
     m_ir_list->push_back(*(new MethodItemEntry(std::forward<Args>(args)...)));
   }
 
   /* Passes memory ownership of "mie" to callee. */
-  void push_back(MethodItemEntry& mie) { m_ir_list->push_back(mie); }
+  void push_back(MethodItemEntry& mie) {
+    mark_modified();
+    m_ir_list->push_back(mie);
+  }
 
   /*
    * Insert after instruction :position.
@@ -205,22 +270,26 @@ class IRCode {
    */
   void insert_after(IRInstruction* position,
                     const std::vector<IRInstruction*>& opcodes) {
+    mark_modified();
     m_ir_list->insert_after(position, opcodes);
   }
 
   IRList::iterator insert_before(const IRList::iterator& position,
                                  MethodItemEntry& mie) {
+    mark_modified();
     return m_ir_list->insert_before(position, mie);
   }
 
   IRList::iterator insert_after(const IRList::iterator& position,
                                 MethodItemEntry& mie) {
+    mark_modified();
     return m_ir_list->insert_after(position, mie);
   }
 
   template <class... Args>
   IRList::iterator insert_before(const IRList::iterator& position,
                                  Args&&... args) {
+    mark_modified();
     return m_ir_list->insert_before(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
   }
@@ -228,6 +297,7 @@ class IRCode {
   template <class... Args>
   IRList::iterator insert_after(const IRList::iterator& position,
                                 Args&&... args) {
+    mark_modified();
     always_assert(position != m_ir_list->end());
     return m_ir_list->insert_after(
         position, *(new MethodItemEntry(std::forward<Args>(args)...)));
@@ -236,7 +306,10 @@ class IRCode {
   /* DEPRECATED! Use the version below that passes in the iterator instead,
    * which is O(1) instead of O(n). */
   /* Memory ownership of "insn" passes to callee, it will delete it. */
-  void remove_opcode(IRInstruction* insn) { m_ir_list->remove_opcode(insn); }
+  void remove_opcode(IRInstruction* insn) {
+    mark_modified();
+    m_ir_list->remove_opcode(insn);
+  }
 
   /*
    * Remove the instruction that :it points to.
@@ -245,6 +318,7 @@ class IRCode {
    * remove both that instruction and the move-result-pseudo that follows.
    */
   void remove_opcode(const IRList::iterator& it) {
+    mark_modified();
     m_ir_list->remove_opcode(it);
   }
 
@@ -259,30 +333,76 @@ class IRCode {
    */
   size_t count_opcodes() const { return m_ir_list->count_opcodes(); }
 
+  /*
+   * The instructions, in order; see IRList::opcode_index(). Not to be used
+   * while an editable CFG is built, as the instructions live in the CFG then.
+   */
+  const std::vector<IRInstruction*>& opcode_index() {
+    mark_modified();
+    always_assert(!editable_cfg_built());
+    return m_ir_list->opcode_index();
+  }
+  bool opcode_index_valid() const { return m_ir_list->opcode_index_valid(); }
+  void invalidate_opcode_index() { m_ir_list->invalidate_opcode_index(); }
+
   void sanity_check() const { m_ir_list->sanity_check(); }
 
-  IRList::iterator begin() { return m_ir_list->begin(); }
-  IRList::iterator end() { return m_ir_list->end(); }
+  IRList::iterator begin() {
+    mark_modified();
+    return m_ir_list->begin();
+  }
+  IRList::iterator end() {
+    mark_modified();
+    return m_ir_list->end();
+  }
   IRList::const_iterator begin() const { return m_ir_list->begin(); }
   IRList::const_iterator end() const { return m_ir_list->end(); }
   IRList::const_iterator cbegin() const { return m_ir_list->cbegin(); }
   IRList::const_iterator cend() const { return m_ir_list->cend(); }
-  IRList::reverse_iterator rbegin() { return m_ir_list->rbegin(); }
-  IRList::reverse_iterator rend() { return m_ir_list->rend(); }
+  IRList::reverse_iterator rbegin() {
+    mark_modified();
+    return m_ir_list->rbegin();
+  }
+  IRList::reverse_iterator rend() {
+    mark_modified();
+    return m_ir_list->rend();
+  }
   IRList::const_reverse_iterator rbegin() const { return m_ir_list->rbegin(); }
   IRList::const_reverse_iterator rend() const { return m_ir_list->rend(); }
 
   IRList::iterator erase(const IRList::iterator& it) {
+    mark_modified();
     return m_ir_list->erase(it);
   }
   IRList::iterator erase_and_dispose(const IRList::iterator& it) {
+    mark_modified();
     return m_ir_list->erase_and_dispose(it);
   }
 
   IRList::iterator iterator_to(MethodItemEntry& mie) {
+    mark_modified();
     return m_ir_list->iterator_to(mie);
   }
 
+  /*
+   * Modification epochs. The PassManager starts a new epoch before each pass,
+   * and any access through which the code can be modified (non-const
+   * iteration, the CFG, the insertion and removal methods...) records the
+   * current epoch as the one the code was last modified in. This is
+   * conservative: the code may not have actually changed then, but it didn't
+   * change in an epoch after modified_epoch().
+   *
+   * A pass whose transformation converges after one run can use this to skip
+   * the methods that weren't modified since its previous run.
+   */
+  static size_t current_epoch() {
+    return s_epoch.load(std::memory_order_relaxed);
+  }
+  static void advance_epoch() { s_epoch.fetch_add(1); }
+  size_t modified_epoch() const { return m_modified_epoch; }
+  // E.g. to carry the epoch of code that was synced and ballooned again.
+  void set_modified_epoch(size_t epoch) { m_modified_epoch = epoch; }
+
   friend std::string show(const IRCode*);
 
   friend class MethodSplicer;
@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "IRCodeIO.h"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include "Debug.h"
+#include "DexDebugInstruction.h"
+#include "DexEncoding.h"
+#include "DexInstruction.h"
+#include "DexPosition.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Show.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace {
+constexpr const char* IRCODE_FILE_NAME = "/ircode.bin";
+
+constexpr const char* IRCODE_MAGIC_NUMBER = "rdx.code";
+
+// Bump this when the layout of the methods changes.
+constexpr uint32_t IRCODE_VERSION = 1;
+
+PACKED(struct ir_code_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t file_size;
+  uint32_t strings_count;
+  uint32_t methods_count;
+});
+
+/*
+ * The file is laid out as:
+ *   header
+ *   strings_count strings, as uleb128 length + bytes + '\0'
+ *   methods_count methods, as uleb128 size + method
+ * where a method is:
+ *   method descriptor, registers size, whether it has a debug item
+ *   its positions: method, file, line and parent index
+ *   its entries, which refer to other entries and positions by index
+ * Optional strings and indices are written as uleb128p1, with -1 for none.
+ */
+class StringTable {
+ public:
+  uint32_t id(const std::string& str) {
+    auto it = m_ids.find(str);
+    if (it != m_ids.end()) {
+      return it->second;
+    }
+    m_strings.push_back(str);
+    return m_ids.emplace(str, m_strings.size() - 1).first->second;
+  }
+
+  const std::vector<std::string>& strings() const { return m_strings; }
+
+ private:
+  std::unordered_map<std::string, uint32_t> m_ids;
+  std::vector<std::string> m_strings;
+};
+
+class Writer {
+ public:
+  explicit Writer(StringTable& strings) : m_strings(strings) {}
+
+  void u8(uint8_t v) { m_data.push_back(v); }
+
+  void uleb(uint32_t v) {
+    uint8_t buf[5];
+    auto end = write_uleb128(buf, v);
+    m_data.append(reinterpret_cast<const char*>(buf), end - buf);
+  }
+
+  void uleb_p1(uint32_t v) { uleb(v + 1); }
+
+  template <typename T>
+  void raw(T v) {
+    m_data.append(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+
+  void str(const std::string& s) { uleb(m_strings.id(s)); }
+
+  void str_p1(const DexString* s) {
+    uleb_p1(s == nullptr ? -1 : m_strings.id(s->str()));
+  }
+
+  void type_p1(const DexType* t) {
+    str_p1(t == nullptr ? nullptr : t->get_name());
+  }
+
+  const std::string& data() const { return m_data; }
+
+ private:
+  StringTable& m_strings;
+  std::string m_data;
+};
+
+void serialize_insn(const IRInstruction* insn, Writer& w) {
+  w.raw<uint16_t>(insn->opcode());
+  if (insn->has_dest()) {
+    w.uleb(insn->dest());
+  }
+  w.uleb(insn->srcs_size());
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    w.uleb(insn->src(i));
+  }
+  if (insn->has_literal()) {
+    w.raw<int64_t>(insn->get_literal());
+  } else if (insn->has_string()) {
+    w.str(insn->get_string()->str());
+  } else if (insn->has_type()) {
+    w.str(insn->get_type()->str());
+  } else if (insn->has_field()) {
+    w.str(show(insn->get_field()));
+  } else if (insn->has_method()) {
+    w.str(show(insn->get_method()));
+  } else if (insn->has_data()) {
+    auto data = insn->get_data();
+    w.raw<uint16_t>(data->opcode());
+    w.uleb(data->data_size());
+    for (size_t i = 0; i < data->data_size(); ++i) {
+      w.raw<uint16_t>(data->data()[i]);
+    }
+  } else {
+    always_assert_log(!insn->has_callsite() && !insn->has_methodhandle(),
+                      "Cannot snapshot %s", SHOW(insn));
+  }
+}
+
+void serialize_debug(const DexDebugInstruction* dbgop, Writer& w) {
+  w.u8(dbgop->opcode());
+  w.uleb(dbgop->uvalue());
+  switch (dbgop->opcode()) {
+  case DBG_SET_FILE:
+    w.str_p1(static_cast<const DexDebugOpcodeSetFile*>(dbgop)->file());
+    break;
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    auto start = static_cast<const DexDebugOpcodeStartLocal*>(dbgop);
+    w.str_p1(start->name());
+    w.type_p1(start->type());
+    w.str_p1(start->sig());
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void serialize_code(const DexMethod* method, const IRCode* code, Writer& w) {
+  // The entries of an editable CFG are in its blocks, linearize a copy.
+  std::unique_ptr<IRCode> linearized;
+  if (code->editable_cfg_built()) {
+    linearized = std::make_unique<IRCode>(*code);
+    code = linearized.get();
+  }
+
+  w.str(show(method));
+  w.uleb(code->get_registers_size());
+  w.u8(code->get_debug_item() != nullptr);
+
+  std::unordered_map<const MethodItemEntry*, uint32_t> entry_ids;
+  std::unordered_map<const DexPosition*, uint32_t> position_ids;
+  std::vector<const DexPosition*> positions;
+  for (const auto& mie : *code) {
+    entry_ids.emplace(&mie, entry_ids.size());
+    if (mie.type == MFLOW_POSITION) {
+      position_ids.emplace(mie.pos.get(), positions.size());
+      positions.push_back(mie.pos.get());
+    }
+  }
+  // Parents that were removed from the method, if any, come last.
+  for (size_t i = 0; i < positions.size(); ++i) {
+    auto parent = positions[i]->parent;
+    if (parent != nullptr && !position_ids.count(parent)) {
+      position_ids.emplace(parent, positions.size());
+      positions.push_back(parent);
+    }
+  }
+
+  w.uleb(positions.size());
+  for (auto pos : positions) {
+    w.str_p1(pos->method);
+    w.str_p1(pos->file);
+    w.uleb(pos->line);
+    w.uleb_p1(pos->parent == nullptr ? -1 : position_ids.at(pos->parent));
+  }
+
+  w.uleb(entry_ids.size());
+  for (const auto& mie : *code) {
+    w.u8(mie.type);
+    switch (mie.type) {
+    case MFLOW_TRY:
+      w.u8(mie.tentry->type);
+      w.uleb(entry_ids.at(mie.tentry->catch_start));
+      break;
+    case MFLOW_CATCH:
+      w.type_p1(mie.centry->catch_type);
+      w.uleb_p1(mie.centry->next == nullptr ? -1
+                                            : entry_ids.at(mie.centry->next));
+      break;
+    case MFLOW_OPCODE:
+      serialize_insn(mie.insn, w);
+      break;
+    case MFLOW_DEX_OPCODE:
+      always_assert_log(false, "%s holds dex instructions", SHOW(method));
+      break;
+    case MFLOW_TARGET:
+      w.u8(mie.target->type);
+      w.uleb(entry_ids.at(mie.target->src));
+      if (mie.target->type == BRANCH_MULTI) {
+        w.raw<int32_t>(mie.target->case_key);
+      }
+      break;
+    case MFLOW_DEBUG:
+      serialize_debug(mie.dbgop.get(), w);
+      break;
+    case MFLOW_POSITION:
+      w.uleb(position_ids.at(mie.pos.get()));
+      break;
+    case MFLOW_FALLTHROUGH:
+      break;
+    }
+  }
+}
+
+class Reader {
+ public:
+  Reader(const std::vector<const char*>& strings, const uint8_t* ptr)
+      : m_strings(strings), m_ptr(ptr) {}
+
+  uint8_t u8() { return *m_ptr++; }
+
+  uint32_t uleb() { return read_uleb128(&m_ptr); }
+
+  uint32_t uleb_p1() { return read_uleb128p1(&m_ptr); }
+
+  template <typename T>
+  T raw() {
+    T v;
+    memcpy(&v, m_ptr, sizeof(T));
+    m_ptr += sizeof(T);
+    return v;
+  }
+
+  const char* str() { return m_strings.at(uleb()); }
+
+  DexString* dex_str_p1() {
+    auto id = uleb_p1();
+    return id == static_cast<uint32_t>(-1)
+               ? nullptr
+               : DexString::make_string(m_strings.at(id));
+  }
+
+  DexType* type_p1() {
+    auto name = dex_str_p1();
+    return name == nullptr ? nullptr : DexType::make_type(name);
+  }
+
+ private:
+  const std::vector<const char*>& m_strings;
+  const uint8_t* m_ptr;
+};
+
+IRInstruction* deserialize_insn(Reader& r) {
+  auto insn = new IRInstruction(static_cast<IROpcode>(r.raw<uint16_t>()));
+  if (insn->has_dest()) {
+    insn->set_dest(r.uleb());
+  }
+  insn->set_srcs_size(r.uleb());
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    insn->set_src(i, r.uleb());
+  }
+  if (insn->has_literal()) {
+    insn->set_literal(r.raw<int64_t>());
+  } else if (insn->has_string()) {
+    insn->set_string(DexString::make_string(r.str()));
+  } else if (insn->has_type()) {
+    insn->set_type(DexType::make_type(r.str()));
+  } else if (insn->has_field()) {
+    insn->set_field(DexField::make_field(std::string(r.str())));
+  } else if (insn->has_method()) {
+    insn->set_method(DexMethod::make_method(std::string(r.str())));
+  } else if (insn->has_data()) {
+    std::vector<uint16_t> opcodes{r.raw<uint16_t>()};
+    auto size = r.uleb();
+    for (size_t i = 0; i < size; ++i) {
+      opcodes.push_back(r.raw<uint16_t>());
+    }
+    insn->set_data(new DexOpcodeData(opcodes));
+  }
+  return insn;
+}
+
+std::unique_ptr<DexDebugInstruction> deserialize_debug(Reader& r) {
+  auto op = static_cast<DexDebugItemOpcode>(r.u8());
+  auto value = r.uleb();
+  switch (op) {
+  case DBG_SET_FILE:
+    return std::make_unique<DexDebugOpcodeSetFile>(r.dex_str_p1());
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    auto name = r.dex_str_p1();
+    auto type = r.type_p1();
+    auto sig = r.dex_str_p1();
+    return std::make_unique<DexDebugOpcodeStartLocal>(value, name, type, sig);
+  }
+  case DBG_ADVANCE_LINE:
+    return std::make_unique<DexDebugInstruction>(op,
+                                                 static_cast<int32_t>(value));
+  default:
+    return std::make_unique<DexDebugInstruction>(op, value);
+  }
+}
+
+// Positions whose owner was removed from the method still need to outlive
+// the positions they are the parent of.
+std::mutex s_removed_parents_lock;
+std::vector<std::unique_ptr<DexPosition>> s_removed_parents;
+
+void deserialize_code(Reader& r) {
+  const char* descriptor = r.str();
+  auto ref = DexMethod::get_method(descriptor);
+  always_assert_log(ref != nullptr && ref->is_def(),
+                    "%s is not defined in the intermediate dexes", descriptor);
+  auto method = ref->as_def();
+  auto code = std::make_unique<IRCode>();
+  code->set_registers_size(r.uleb());
+  bool has_debug_item = r.u8();
+
+  std::vector<std::unique_ptr<DexPosition>> positions(r.uleb());
+  std::vector<DexPosition*> position_ptrs;
+  std::vector<uint32_t> parents;
+  for (auto& pos : positions) {
+    auto pos_method = r.dex_str_p1();
+    auto file = r.dex_str_p1();
+    pos = std::make_unique<DexPosition>(r.uleb());
+    pos->bind(pos_method, file);
+    position_ptrs.push_back(pos.get());
+    parents.push_back(r.uleb_p1());
+  }
+  for (size_t i = 0; i < positions.size(); ++i) {
+    if (parents[i] != static_cast<uint32_t>(-1)) {
+      positions[i]->parent = position_ptrs.at(parents[i]);
+    }
+  }
+
+  // All the entries exist before any of them is read, since they refer to
+  // each other in both directions.
+  std::vector<MethodItemEntry*> entries(r.uleb());
+  for (auto& mie : entries) {
+    mie = new MethodItemEntry();
+  }
+  for (auto mie : entries) {
+    auto type = static_cast<MethodItemType>(r.u8());
+    switch (type) {
+    case MFLOW_TRY: {
+      auto try_type = static_cast<TryEntryType>(r.u8());
+      mie->tentry = new TryEntry(try_type, entries.at(r.uleb()));
+      break;
+    }
+    case MFLOW_CATCH: {
+      mie->centry = new CatchEntry(r.type_p1());
+      auto next = r.uleb_p1();
+      if (next != static_cast<uint32_t>(-1)) {
+        mie->centry->next = entries.at(next);
+      }
+      break;
+    }
+    case MFLOW_OPCODE:
+      mie->insn = deserialize_insn(r);
+      break;
+    case MFLOW_TARGET: {
+      auto target_type = static_cast<BranchTargetType>(r.u8());
+      auto src = entries.at(r.uleb());
+      mie->target = target_type == BRANCH_MULTI
+                        ? new BranchTarget(src, r.raw<int32_t>())
+                        : new BranchTarget(src);
+      break;
+    }
+    case MFLOW_DEBUG:
+      new (&mie->dbgop)
+          std::unique_ptr<DexDebugInstruction>(deserialize_debug(r));
+      break;
+    case MFLOW_POSITION: {
+      auto& pos = positions.at(r.uleb());
+      always_assert(pos != nullptr);
+      new (&mie->pos) std::unique_ptr<DexPosition>(std::move(pos));
+      break;
+    }
+    case MFLOW_FALLTHROUGH:
+      break;
+    default:
+      always_assert_log(false, "Unexpected entry type %d in %s", type,
+                        descriptor);
+    }
+    mie->type = type;
+    code->push_back(*mie);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(s_removed_parents_lock);
+    for (auto& pos : positions) {
+      if (pos != nullptr) {
+        s_removed_parents.push_back(std::move(pos));
+      }
+    }
+  }
+  if (has_debug_item) {
+    code->set_debug_item(std::make_unique<DexDebugItem>());
+  }
+  method->set_code(std::move(code));
+}
+} // namespace
+
+namespace ir_code_io {
+
+void dump(const Scope& classes, const std::string& output_dir) {
+  StringTable strings;
+  std::string methods;
+  uint32_t methods_count = 0;
+  walk::code(classes, [&](const DexMethod* method, const IRCode& code) {
+    Writer w(strings);
+    serialize_code(method, &code, w);
+    Writer size(strings);
+    size.uleb(w.data().size());
+    methods += size.data();
+    methods += w.data();
+    methods_count++;
+  });
+
+  std::string output_file = output_dir + IRCODE_FILE_NAME;
+  std::ofstream ostrm(output_file, std::ios::binary | std::ios::trunc);
+  ir_code_header_t header;
+  memcpy(header.magic, IRCODE_MAGIC_NUMBER, sizeof(header.magic));
+  header.version = IRCODE_VERSION;
+  header.file_size = 0;
+  header.strings_count = strings.strings().size();
+  header.methods_count = methods_count;
+  ostrm.write((char*)&header, sizeof(header));
+  for (const auto& str : strings.strings()) {
+    uint8_t buf[5];
+    auto end = write_uleb128(buf, str.size());
+    ostrm.write((char*)buf, end - buf);
+    ostrm.write(str.c_str(), str.size() + 1);
+  }
+  ostrm.write(methods.data(), methods.size());
+
+  header.file_size = ostrm.tellp();
+  ostrm.seekp(0);
+  ostrm.write((char*)&header, sizeof(header));
+}
+
+bool load(const std::string& input_dir) {
+  std::string input_file = input_dir + IRCODE_FILE_NAME;
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(input_file);
+  } catch (const std::exception&) {
+    std::cerr << "Can not open " << input_file << std::endl;
+    return false;
+  }
+  auto begin = reinterpret_cast<const uint8_t*>(file.data());
+  ir_code_header_t header;
+  if (file.size() < sizeof(header)) {
+    std::cerr << "May be not valid IR code file\n";
+    return false;
+  }
+  memcpy(&header, begin, sizeof(header));
+  if (memcmp(header.magic, IRCODE_MAGIC_NUMBER, sizeof(header.magic)) != 0 ||
+      header.file_size != file.size()) {
+    std::cerr << "May be not valid IR code file\n";
+    return false;
+  }
+  if (header.version != IRCODE_VERSION) {
+    std::cerr << "Could not load the outdated IR code\n";
+    return false;
+  }
+
+  const uint8_t* ptr = begin + sizeof(header);
+  std::vector<const char*> strings;
+  strings.reserve(header.strings_count);
+  for (uint32_t i = 0; i < header.strings_count; ++i) {
+    auto size = read_uleb128(&ptr);
+    strings.push_back(reinterpret_cast<const char*>(ptr));
+    ptr += size + 1;
+  }
+  std::vector<const uint8_t*> methods;
+  methods.reserve(header.methods_count);
+  for (uint32_t i = 0; i < header.methods_count; ++i) {
+    auto size = read_uleb128(&ptr);
+    methods.push_back(ptr);
+    ptr += size;
+  }
+  always_assert(ptr == begin + header.file_size);
+
+  redex_parallel::parallel_for(0, methods.size(), [&](size_t i) {
+    Reader r(strings, methods[i]);
+    deserialize_code(r);
+  });
+  return true;
+}
+
+} // namespace ir_code_io
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "DexClass.h"
+
+/*
+ * A binary snapshot of the IRCode of every method, as it is between passes:
+ * registers before allocation, positions along with their parents, try and
+ * catch regions, branch targets, and debug instructions.
+ *
+ * The intermediate dexes that --stop-pass writes describe the classes, but
+ * going through dex code would need instruction lowering and register
+ * allocation. With this snapshot next to them, a run that resumes from the
+ * intermediate output starts from the same IR that the pass it stopped
+ * before would have seen.
+ *
+ * All the strings are written once in a table, which the loader reads
+ * straight out of the mapped file. Methods refer to them by index.
+ */
+namespace ir_code_io {
+
+void dump(const Scope& classes, const std::string& output_dir);
+
+/*
+ * Replaces the code of the methods in the snapshot. The classes need to be
+ * loaded already. Returns false if there is no snapshot in input_dir.
+ */
+bool load(const std::string& input_dir);
+
+} // namespace ir_code_io
@@ -31,6 +31,11 @@ bool BranchTarget::operator==(const BranchTarget& other) const {
   return *src == *other.src;
 }
 
+REDEX_DEFINE_POOLED_NEW_DELETE(TryEntry)
+REDEX_DEFINE_POOLED_NEW_DELETE(CatchEntry)
+REDEX_DEFINE_POOLED_NEW_DELETE(BranchTarget)
+REDEX_DEFINE_POOLED_NEW_DELETE(MethodItemEntry)
+
 MethodItemEntry::MethodItemEntry(const MethodItemEntry& that)
     : type(that.type) {
   switch (type) {
@@ -359,6 +364,7 @@ void IRList::replace_opcode_with_infinite_loop(IRInstruction* from) {
       if (is_branch(from->opcode())) {
         remove_branch_targets(from);
       }
+      invalidate_opcode_index();
       mentry->insn = to;
       delete from;
       break;
@@ -377,6 +383,7 @@ void IRList::replace_branch(IRInstruction* from, IRInstruction* to) {
   always_assert(is_branch(to->opcode()));
   for (auto& mentry : m_list) {
     if (mentry.type == MFLOW_OPCODE && mentry.insn == from) {
+      invalidate_opcode_index();
       mentry.insn = to;
       delete from;
       return;
@@ -406,6 +413,7 @@ void IRList::insert_after(IRInstruction* position,
           insert_at++;
         }
       }
+      invalidate_opcode_index();
       for (auto* opcode : opcodes) {
         MethodItemEntry* mentry = new MethodItemEntry(opcode);
         m_list.insert(insert_at, *mentry);
@@ -418,12 +426,14 @@ void IRList::insert_after(IRInstruction* position,
 
 IRList::iterator IRList::insert_before(const IRList::iterator& position,
                                        MethodItemEntry& mie) {
+  invalidate_opcode_index();
   return m_list.insert(position, mie);
 }
 
 IRList::iterator IRList::insert_after(const IRList::iterator& position,
                                       MethodItemEntry& mie) {
   always_assert(position != m_list.end());
+  invalidate_opcode_index();
   return m_list.insert(std::next(position), mie);
 }
 
@@ -431,6 +441,7 @@ void IRList::remove_opcode(const IRList::iterator& it) {
   always_assert(it->type == MFLOW_OPCODE);
   auto insn = it->insn;
   always_assert(!opcode::is_move_result_pseudo(insn->opcode()));
+  invalidate_opcode_index();
   if (insn->has_move_result_pseudo()) {
     auto move_it = std::next(it);
     always_assert_log(
@@ -462,6 +473,19 @@ void IRList::remove_opcode(IRInstruction* insn) {
                     SHOW(insn));
 }
 
+const std::vector<IRInstruction*>& IRList::opcode_index() {
+  if (!m_opcode_index_valid) {
+    m_opcode_index.clear();
+    for (const auto& mie : m_list) {
+      if (mie.type == MFLOW_OPCODE) {
+        m_opcode_index.push_back(mie.insn);
+      }
+    }
+    m_opcode_index_valid = true;
+  }
+  return m_opcode_index;
+}
+
 size_t IRList::sum_opcode_sizes() const {
   size_t size{0};
   for (const auto& mie : m_list) {
@@ -667,6 +691,7 @@ IRList::iterator IRList::main_block() {
 IRList::iterator IRList::make_if_block(const IRList::iterator& cur,
                                        IRInstruction* insn,
                                        IRList::iterator* false_block) {
+  invalidate_opcode_index();
   auto if_entry = new MethodItemEntry(insn);
   *false_block = m_list.insert(cur, *if_entry);
   auto bt = new BranchTarget(if_entry);
@@ -678,6 +703,7 @@ IRList::iterator IRList::make_if_else_block(const IRList::iterator& cur,
                                             IRInstruction* insn,
                                             IRList::iterator* false_block,
                                             IRList::iterator* true_block) {
+  invalidate_opcode_index();
   // if block
   auto if_entry = new MethodItemEntry(insn);
   *false_block = m_list.insert(cur, *if_entry);
@@ -704,6 +730,7 @@ IRList::iterator IRList::make_switch_block(
     IRInstruction* insn,
     IRList::iterator* default_block,
     std::map<SwitchIndices, IRList::iterator>& cases) {
+  invalidate_opcode_index();
   auto switch_entry = new MethodItemEntry(insn);
   *default_block = m_list.insert(cur, *switch_entry);
   IRList::iterator main_block = *default_block;
@@ -13,6 +13,7 @@
 
 #include "DexClass.h"
 #include "DexDebugInstruction.h"
+#include "FixedSizePool.h"
 #include "IRInstruction.h"
 
 struct MethodItemEntry;
@@ -32,6 +33,8 @@ struct TryEntry {
     always_assert(catch_start != nullptr);
   }
 
+  REDEX_DECLARE_POOLED_NEW_DELETE();
+
   bool operator==(const TryEntry& other) const;
 };
 
@@ -40,6 +43,8 @@ struct CatchEntry {
   MethodItemEntry* next; // always null for catchall
   CatchEntry(DexType* catch_type) : catch_type(catch_type), next(nullptr) {}
 
+  REDEX_DECLARE_POOLED_NEW_DELETE();
+
   bool operator==(const CatchEntry& other) const;
 };
 
@@ -80,6 +85,8 @@ struct BranchTarget {
   BranchTarget(MethodItemEntry* src, int32_t case_key)
       : src(src), type(BRANCH_MULTI), case_key(case_key) {}
 
+  REDEX_DECLARE_POOLED_NEW_DELETE();
+
   bool operator==(const BranchTarget& other) const;
 };
 
@@ -162,6 +169,9 @@ struct MethodItemEntry {
   MethodItemEntry() : type(MFLOW_FALLTHROUGH) {}
   ~MethodItemEntry();
 
+  // Entries are allocated from a FixedSizePool, as methods have many of them.
+  REDEX_DECLARE_POOLED_NEW_DELETE();
+
   /*
    * This should only ever be used by the instruction lowering step. Do NOT use
    * it in passes!
@@ -217,6 +227,10 @@ class IRList {
       boost::intrusive::list<MethodItemEntry, MethodItemMemberListOption>;
 
   IntrusiveList m_list;
+  // See opcode_index().
+  std::vector<IRInstruction*> m_opcode_index;
+  bool m_opcode_index_valid{false};
+
   void remove_branch_targets(IRInstruction* branch_inst);
 
   static void disposer(MethodItemEntry* mie) { delete mie; }
@@ -272,10 +286,16 @@ class IRList {
                          const InstructionEquality& instruction_equals) const;
 
   /* Passes memory ownership of "mie" to callee. */
-  void push_back(MethodItemEntry& mie) { m_list.push_back(mie); }
+  void push_back(MethodItemEntry& mie) {
+    invalidate_opcode_index();
+    m_list.push_back(mie);
+  }
 
   /* Passes memory ownership of "mie" to callee. */
-  void push_front(MethodItemEntry& mie) { m_list.push_front(mie); }
+  void push_front(MethodItemEntry& mie) {
+    invalidate_opcode_index();
+    m_list.push_front(mie);
+  }
 
   /*
    * Insert after instruction :position.
@@ -336,6 +356,8 @@ class IRList {
   // transfer all of `other` into `this` starting at `pos`
   // memory ownership is also transferred
   void splice(IRList::const_iterator pos, IRList& other) {
+    invalidate_opcode_index();
+    other.invalidate_opcode_index();
     m_list.splice(pos, other.m_list);
   }
 
@@ -345,14 +367,31 @@ class IRList {
                         IRList& other,
                         IRList::const_iterator begin,
                         IRList::const_iterator end) {
+    invalidate_opcode_index();
+    other.invalidate_opcode_index();
     m_list.splice(pos, other.m_list, begin, end);
   }
 
   template <typename Predicate>
   void remove_and_dispose_if(Predicate predicate) {
+    invalidate_opcode_index();
     m_list.remove_and_dispose_if(predicate, disposer);
   }
 
+  /*
+   * The instructions of the list, in order, for the scans of all of them
+   * that don't care about the other entries: walking an array beats chasing
+   * the list and checking the type of each entry.
+   *
+   * The index is built on first use and invalidated by the mutations of the
+   * list. Code that changes entries in place, e.g. turns them into
+   * fallthroughs or swaps their instruction, must invalidate it itself;
+   * changes to the instructions themselves are fine.
+   */
+  const std::vector<IRInstruction*>& opcode_index();
+  bool opcode_index_valid() const { return m_opcode_index_valid; }
+  void invalidate_opcode_index() { m_opcode_index_valid = false; }
+
   void sanity_check() const;
 
   IRList::iterator begin() { return m_list.begin(); }
@@ -375,12 +414,17 @@ class IRList {
   void gather_methodhandles(std::vector<DexMethodHandle*>& lmethodhandle) const;
 
   IRList::iterator erase(const IRList::iterator& it) {
+    invalidate_opcode_index();
     return m_list.erase(it);
   }
   IRList::iterator erase_and_dispose(const IRList::iterator& it) {
+    invalidate_opcode_index();
     return m_list.erase_and_dispose(it, disposer);
   }
-  void clear_and_dispose() { m_list.clear_and_dispose(disposer); }
+  void clear_and_dispose() {
+    invalidate_opcode_index();
+    m_list.clear_and_dispose(disposer);
+  }
 
   IRList::iterator iterator_to(MethodItemEntry& mie) {
     return m_list.iterator_to(mie);
@@ -19,6 +19,17 @@ class IRMetaIO {
   struct bit_rstate_t {
     ReferencedState::InnerStruct inner_struct;
   };
+
+  // The flags that make the meta data of a class or member worth dumping.
+  static constexpr uint16_t SERIALIZED_FLAGS =
+      ReferencedState::BY_STRING | ReferencedState::BY_RESOURCES |
+      ReferencedState::IS_SERDE | ReferencedState::KEEP |
+      ReferencedState::ASSUMENOSIDEEFFECTS | ReferencedState::WHYAREYOUKEEPING |
+      ReferencedState::SET_ALLOWSHRINKING |
+      ReferencedState::UNSET_ALLOWSHRINKING |
+      ReferencedState::SET_ALLOWOBFUSCATION |
+      ReferencedState::UNSET_ALLOWOBFUSCATION;
+
   static void serialize_rstate(const ReferencedState& rstate,
                                std::ofstream& ostrm);
   static void deserialize_rstate(const char** _ptr, ReferencedState& rstate);
@@ -29,16 +40,7 @@ class IRMetaIO {
   template <typename T>
   static bool is_default_meta(const T* obj) {
     return obj->get_deobfuscated_name() == show(obj) &&
-           !obj->rstate.inner_struct.m_by_string &&
-           !obj->rstate.inner_struct.m_by_resources &&
-           !obj->rstate.inner_struct.m_is_serde &&
-           !obj->rstate.inner_struct.m_keep &&
-           !obj->rstate.inner_struct.m_assumenosideeffects &&
-           !obj->rstate.inner_struct.m_whyareyoukeeping &&
-           !obj->rstate.inner_struct.m_set_allowshrinking &&
-           !obj->rstate.inner_struct.m_unset_allowshrinking &&
-           !obj->rstate.inner_struct.m_set_allowobfuscation &&
-           !obj->rstate.inner_struct.m_unset_allowobfuscation;
+           (obj->rstate.inner_struct.flags() & SERIALIZED_FLAGS) == 0;
   }
 };
 } // namespace ir_meta_io
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <type_traits>
+#include <vector>
+
+#include "DexClass.h"
+#include "RedexContext.h"
+
+namespace id_map_impl {
+
+inline size_t num_ids(const DexType*) { return g_redex->num_type_ids(); }
+inline size_t num_ids(const DexFieldRef*) { return g_redex->num_field_ids(); }
+inline size_t num_ids(const DexMethodRef*) {
+  return g_redex->num_method_ids();
+}
+
+} // namespace id_map_impl
+
+/*
+ * A side table of values for DexTypes, DexFieldRefs or DexMethodRefs (or
+ * their subclasses), as a vector indexed by their ids. Lookups are a single
+ * array access instead of hashing a pointer, but the table takes space for
+ * every id, so this is meant for analyses that cover most of the program.
+ *
+ * The keys that don't have a value get a default-constructed one.
+ *
+ * The table has room for all the keys that exist when it is constructed, so
+ * those can be accessed concurrently, as long as no two threads access the
+ * value of the same key. Keys created later grow the table, which then must
+ * not happen concurrently with any other access.
+ */
+template <typename Key, typename Value>
+class IdMap {
+  // std::vector<bool> doesn't hand out references.
+  static_assert(!std::is_same<Value, bool>::value,
+                "Use uint8_t values instead of bool");
+
+ public:
+  IdMap()
+      : m_values(id_map_impl::num_ids(static_cast<const Key*>(nullptr))) {}
+
+  Value& operator[](const Key* key) {
+    auto id = key->get_id();
+    if (id >= m_values.size()) {
+      m_values.resize(id + 1);
+    }
+    return m_values[id];
+  }
+
+  // The value of the key, which is a default-constructed one for the keys
+  // created after the table.
+  const Value& get(const Key* key) const {
+    auto id = key->get_id();
+    return id < m_values.size() ? m_values[id] : m_default;
+  }
+
+  void clear() { m_values.assign(m_values.size(), Value()); }
+
+ private:
+  std::vector<Value> m_values;
+  Value m_default{};
+};
@@ -321,7 +321,7 @@ class Analyzer final : public BaseIRAnalyzer<AbstractAccessPathEnvironment> {
   void populate_environments() {
     // We reserve enough space for the map in order to avoid repeated rehashing
     // during the computation.
-    m_environments.reserve(m_cfg.blocks().size() * 16);
+    m_environments.reserve(m_cfg.num_blocks() * 16);
     for (cfg::Block* block : m_cfg.blocks()) {
       AbstractAccessPathEnvironment current_state = get_entry_state_at(block);
       for (auto& mie : InstructionIterable(block)) {
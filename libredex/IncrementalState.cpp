@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "IncrementalState.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <unordered_map>
+
+#include "Debug.h"
+#include "DexHasher.h"
+#include "S_Expression.h"
+#include "Sha1.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace fs = boost::filesystem;
+
+namespace incremental {
+
+namespace {
+
+constexpr const char* kFingerprint = "fingerprint";
+constexpr const char* kOutputs = "outputs";
+
+std::string to_hex(const uint8_t (&digest)[20]) {
+  static const char* kHexDigits = "0123456789abcdef";
+  std::string hex;
+  for (auto byte : digest) {
+    hex.push_back(kHexDigits[byte >> 4]);
+    hex.push_back(kHexDigits[byte & 0xf]);
+  }
+  return hex;
+}
+
+std::string hash_string(const std::string& contents) {
+  Sha1Context context;
+  sha1_init(&context);
+  sha1_update(&context, reinterpret_cast<const uint8_t*>(contents.data()),
+              contents.size());
+  uint8_t digest[20];
+  sha1_final(digest, &context);
+  return to_hex(digest);
+}
+
+std::string hash_file(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  always_assert_log(input, "Cannot read %s", path.c_str());
+  Sha1Context context;
+  sha1_init(&context);
+  char buffer[1 << 16];
+  while (input) {
+    input.read(buffer, sizeof(buffer));
+    sha1_update(&context, reinterpret_cast<const uint8_t*>(buffer),
+                input.gcount());
+  }
+  uint8_t digest[20];
+  sha1_final(digest, &context);
+  return to_hex(digest);
+}
+
+sparta::s_expr header() {
+  return sparta::s_expr({sparta::s_expr("incremental-v1")});
+}
+
+struct Fingerprint {
+  std::map<std::string, std::string> inputs;
+  std::vector<std::array<std::string, 3>> classes;
+};
+
+bool load_fingerprint(const std::string& path, Fingerprint* fingerprint) {
+  std::ifstream input(path);
+  if (!input) {
+    return false;
+  }
+  sparta::s_expr_istream s_expr_input(input);
+  sparta::s_expr expr;
+  s_expr_input >> expr;
+  if (s_expr_input.fail() || expr != header()) {
+    return false;
+  }
+  while (s_expr_input.good()) {
+    s_expr_input >> expr;
+    if (s_expr_input.eoi()) {
+      break;
+    }
+    always_assert_log(!s_expr_input.fail(), "%s\n",
+                      s_expr_input.what().c_str());
+    if (expr.size() == 2) {
+      fingerprint->inputs.emplace(expr[0].get_string(), expr[1].get_string());
+    } else {
+      fingerprint->classes.push_back({expr[0].get_string(),
+                                      expr[1].get_string(),
+                                      expr[2].get_string()});
+    }
+  }
+  return true;
+}
+
+/*
+ * Traces what changed since the saved run, so that it is clear why its
+ * outputs weren't reused.
+ */
+void report_changes(const Fingerprint& saved,
+                    const std::map<std::string, std::string>& inputs,
+                    const std::vector<std::array<std::string, 3>>& classes) {
+  for (const auto& pair : inputs) {
+    auto it = saved.inputs.find(pair.first);
+    if (it == saved.inputs.end() || it->second != pair.second) {
+      TRACE(MAIN, 1, "Incremental: input %s changed", pair.first.c_str());
+    }
+  }
+  for (const auto& pair : saved.inputs) {
+    if (!inputs.count(pair.first)) {
+      TRACE(MAIN, 1, "Incremental: input %s was removed", pair.first.c_str());
+    }
+  }
+
+  std::unordered_map<std::string, const std::array<std::string, 3>*>
+      saved_classes;
+  for (const auto& cls : saved.classes) {
+    saved_classes.emplace(cls[1], &cls);
+  }
+  size_t num_changed = 0;
+  size_t num_added = 0;
+  size_t num_moved = 0;
+  for (const auto& cls : classes) {
+    auto it = saved_classes.find(cls[1]);
+    if (it == saved_classes.end()) {
+      TRACE(MAIN, 2, "Incremental: %s was added", cls[1].c_str());
+      num_added++;
+      continue;
+    }
+    if ((*it->second)[2] != cls[2]) {
+      TRACE(MAIN, 2, "Incremental: %s changed", cls[1].c_str());
+      num_changed++;
+    } else if ((*it->second)[0] != cls[0]) {
+      num_moved++;
+    }
+    saved_classes.erase(it);
+  }
+  TRACE(MAIN, 1,
+        "Incremental: %zu classes changed, %zu added, %zu removed, %zu moved "
+        "to another dex",
+        num_changed, num_added, saved_classes.size(), num_moved);
+}
+
+void copy_tree(const fs::path& from, const fs::path& to) {
+  fs::create_directories(to);
+  for (fs::recursive_directory_iterator it(from), end; it != end; ++it) {
+    auto target = to / fs::relative(it->path(), from);
+    if (fs::is_directory(it->path())) {
+      fs::create_directories(target);
+    } else {
+      fs::copy_file(it->path(), target, fs::copy_option::overwrite_if_exists);
+    }
+  }
+}
+
+} // namespace
+
+void State::add_input(const std::string& name, const std::string& contents) {
+  m_inputs[name] = hash_string(contents);
+}
+
+void State::add_file(const std::string& name, const std::string& path) {
+  m_inputs[name] = hash_file(path);
+}
+
+void State::add_directory(
+    const std::string& name,
+    const std::string& directory,
+    const std::function<bool(const std::string&)>& skip) {
+  std::vector<fs::path> files;
+  for (fs::recursive_directory_iterator it(directory), end; it != end; ++it) {
+    if (fs::is_regular_file(it->path()) && !skip(it->path().string())) {
+      files.push_back(it->path());
+    }
+  }
+  std::vector<std::string> hashes(files.size());
+  redex_parallel::parallel_for(0, files.size(), [&](size_t i) {
+    hashes[i] = hash_file(files[i].string());
+  });
+  for (size_t i = 0; i < files.size(); ++i) {
+    auto relative = fs::relative(files[i], directory).generic_string();
+    m_inputs[name + "/" + relative] = hashes[i];
+  }
+}
+
+void State::add_classes(const DexStoresVector& stores) {
+  std::vector<std::pair<std::string, DexClass*>> classes;
+  for (const auto& store : stores) {
+    const auto& dexen = store.get_dexen();
+    for (size_t i = 0; i < dexen.size(); ++i) {
+      auto dex = store.get_name() + "#" + std::to_string(i);
+      for (auto cls : dexen[i]) {
+        classes.emplace_back(dex, cls);
+      }
+    }
+  }
+  m_classes.resize(classes.size());
+  redex_parallel::parallel_for(0, classes.size(), [&](size_t i) {
+    auto cls = classes[i].second;
+    auto hash = hashing::DexClassHasher(cls).run();
+    m_classes[i] = {classes[i].first, cls->get_name()->str(),
+                    hashing::hash_to_string(hash.signature_hash) +
+                        hashing::hash_to_string(hash.code_hash) +
+                        hashing::hash_to_string(hash.registers_hash)};
+  });
+}
+
+bool State::restore(const std::string& output_dir) const {
+  auto state_dir = fs::path(m_state_dir);
+  Fingerprint saved;
+  if (!load_fingerprint((state_dir / kFingerprint).string(), &saved)) {
+    TRACE(MAIN, 1, "Incremental: no saved state in %s", m_state_dir.c_str());
+    return false;
+  }
+  if (saved.inputs != m_inputs || saved.classes != m_classes) {
+    report_changes(saved, m_inputs, m_classes);
+    return false;
+  }
+  copy_tree(state_dir / kOutputs, output_dir);
+  TRACE(MAIN, 1, "Incremental: reused the outputs saved in %s",
+        m_state_dir.c_str());
+  return true;
+}
+
+void State::save(const std::string& output_dir) const {
+  auto state_dir = fs::path(m_state_dir);
+  auto outputs = state_dir / kOutputs;
+  // Outputs without a fingerprint are never reused, even if saving them
+  // fails half-way.
+  fs::create_directories(state_dir);
+  fs::remove(state_dir / kFingerprint);
+  fs::remove_all(outputs);
+  fs::create_directories(outputs);
+  for (fs::directory_iterator it(output_dir), end; it != end; ++it) {
+    if (fs::is_regular_file(it->path()) && it->path().extension() == ".dex") {
+      fs::copy_file(it->path(), outputs / it->path().filename());
+    }
+  }
+  auto meta = fs::path(output_dir) / "meta";
+  if (fs::is_directory(meta)) {
+    copy_tree(meta, outputs / "meta");
+  }
+
+  auto tmp_path = (state_dir / kFingerprint).string() + ".tmp";
+  {
+    std::ofstream output(tmp_path);
+    always_assert_log(output, "Cannot write to %s", tmp_path.c_str());
+    output << header() << std::endl;
+    for (const auto& pair : m_inputs) {
+      output << sparta::s_expr(
+                    {sparta::s_expr(pair.first), sparta::s_expr(pair.second)})
+             << std::endl;
+    }
+    for (const auto& cls : m_classes) {
+      output << sparta::s_expr({sparta::s_expr(cls[0]), sparta::s_expr(cls[1]),
+                                sparta::s_expr(cls[2])})
+             << std::endl;
+    }
+  }
+  fs::rename(tmp_path, state_dir / kFingerprint);
+}
+
+} // namespace incremental
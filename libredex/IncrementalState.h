@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DexStore.h"
+
+/*
+ * Lets redex-all reuse the output of an earlier run with the same inputs, for
+ * iteration builds that often give it an APK it has already optimized.
+ *
+ * A State fingerprints the inputs of a run: the DexClassHasher hashes of the
+ * classes of the loaded stores, in order, along with the hashes of whatever
+ * else the run depends on (config, ProGuard rules, resources...). The state
+ * directory of a run holds its fingerprint along with a copy of its outputs.
+ * When the fingerprint of the next run is the same, restore() copies those
+ * outputs back, and the passes don't need to run at all.
+ *
+ * Since passes are whole-program, and interdex moves classes across dexes, a
+ * change to any class can change any output dex, so the whole run is the only
+ * granularity at which outputs can be reused. When the fingerprint differs,
+ * restore() reports the classes that changed and everything runs as usual.
+ */
+namespace incremental {
+
+class State {
+ public:
+  explicit State(std::string state_dir) : m_state_dir(std::move(state_dir)) {}
+
+  void add_input(const std::string& name, const std::string& contents);
+
+  void add_file(const std::string& name, const std::string& path);
+
+  /*
+   * Adds the contents of the regular files under `directory`, other than the
+   * ones for which `skip` returns true.
+   */
+  void add_directory(const std::string& name,
+                     const std::string& directory,
+                     const std::function<bool(const std::string&)>& skip);
+
+  void add_classes(const DexStoresVector& stores);
+
+  /*
+   * Copies the outputs of the saved run into output_dir if the saved
+   * fingerprint matches this one. Returns whether it did.
+   */
+  bool restore(const std::string& output_dir) const;
+
+  /*
+   * Saves the fingerprint along with the outputs of the run: the dexes in
+   * output_dir and its meta directory.
+   */
+  void save(const std::string& output_dir) const;
+
+ private:
+  std::string m_state_dir;
+  std::map<std::string, std::string> m_inputs;
+  // The dex, name and hash of each class, in order.
+  std::vector<std::array<std::string, 3>> m_classes;
+};
+
+} // namespace incremental
@@ -11,7 +11,10 @@
 #include "IRCode.h"
 #include "MethodProfiles.h"
 #include "Resolver.h"
+#include "Show.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <queue>
 
 namespace inline_for_speed {
@@ -69,6 +72,11 @@ bool should_inline(const DexMethod* caller_method,
     return false;
   }
 
+  return can_inline_for_speed(caller_method, callee_method);
+}
+
+bool can_inline_for_speed(const DexMethod* caller_method,
+                          const DexMethod* callee_method) {
   auto callee_insns = callee_method->get_code()->cfg().num_opcodes();
   auto caller_insns = caller_method->get_code()->cfg().num_opcodes();
   constexpr double FUDGE_FACTOR = 0.8; // lowering usually increases # insns
@@ -94,4 +102,50 @@ bool should_inline(const DexMethod* caller_method,
   return true;
 }
 
+CalleesByCaller select_within_budget(
+    const std::vector<CallsiteCandidate>& candidates,
+    const std::unordered_map<const DexMethodRef*, Stats>& method_profile_stats,
+    size_t budget,
+    size_t* spent) {
+  std::unordered_map<const DexMethod*, size_t> calls_by_callee;
+  for (const auto& candidate : candidates) {
+    calls_by_callee[candidate.callee] += candidate.calls;
+  }
+
+  // Pairs of benefit per code unit and index of the candidate.
+  std::priority_queue<std::pair<double, size_t>> queue;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const auto& candidate = candidates[i];
+    auto caller_it = method_profile_stats.find(candidate.caller);
+    auto callee_it = method_profile_stats.find(candidate.callee);
+    if (caller_it == method_profile_stats.end() ||
+        callee_it == method_profile_stats.end() ||
+        callee_it->second.call_count <= 0) {
+      continue;
+    }
+    // Attribute the calls of the callee to its callers in proportion to their
+    // number of callsites, since the profiles don't record call edges.
+    auto benefit = callee_it->second.call_count * candidate.calls /
+                   calls_by_callee.at(candidate.callee);
+    queue.emplace(benefit / std::max<size_t>(candidate.cost, 1), i);
+  }
+
+  CalleesByCaller selected;
+  *spent = 0;
+  for (; !queue.empty(); queue.pop()) {
+    const auto& candidate = candidates[queue.top().second];
+    if (*spent + candidate.cost > budget) {
+      continue;
+    }
+    *spent += candidate.cost;
+    selected[candidate.caller].insert(candidate.callee);
+    TRACE(METH_PROF, 3, "[budget] %s -> %s: cost %zu, %f calls per unit",
+          SHOW(candidate.caller), SHOW(candidate.callee), candidate.cost,
+          queue.top().first);
+  }
+  TRACE(METH_PROF, 2, "[budget] selected %zu callers, spent %zu of %zu",
+        selected.size(), *spent, budget);
+  return selected;
+}
+
 } // namespace inline_for_speed
@@ -21,4 +21,42 @@ bool should_inline(const DexMethod* caller_method,
                    const DexMethod* callee_method,
                    const std::unordered_set<const DexMethodRef*>& hot_methods);
 
+/*
+ * The checks of should_inline that don't depend on hotness: inlining must not
+ * push the caller over the on-device compilation limit, or skip the
+ * nontrivial static initializer of another class.
+ */
+bool can_inline_for_speed(const DexMethod* caller_method,
+                          const DexMethod* callee_method);
+
+/*
+ * The calls from a caller to one of its callees, and the code size that
+ * inlining all of them would add.
+ */
+struct CallsiteCandidate {
+  const DexMethod* caller;
+  const DexMethod* callee;
+  size_t calls;
+  size_t cost;
+};
+
+using CalleesByCaller =
+    std::unordered_map<const DexMethod*,
+                       std::unordered_set<const DexMethod*>>;
+
+/*
+ * Ranks the candidates by their benefit, which is the profiled call count
+ * of the callee that comes from the caller, divided by their cost. The
+ * candidates are then selected greedily in that order, as long as their cost
+ * fits in what remains of the budget. Candidates whose caller or callee
+ * doesn't appear in the profiles have no benefit and are never selected.
+ *
+ * The cost of all the selected candidates is returned in `spent`.
+ */
+CalleesByCaller select_within_budget(
+    const std::vector<CallsiteCandidate>& candidates,
+    const std::unordered_map<const DexMethodRef*, Stats>& method_profile_stats,
+    size_t budget,
+    size_t* spent);
+
 } // namespace inline_for_speed
@@ -31,6 +31,15 @@ struct InlinerConfig {
   bool run_dedup_blocks{false};
   bool shrink_other_methods{true};
   bool debug{false};
+  // When inlining for speed with method profiles, the code size in code units
+  // that inlining may add. The callsites get ranked by profiled calls per
+  // code unit, and the best ones are inlined until the budget is spent. Zero
+  // means that there is no budget, and that all the calls between hot methods
+  // are inlined.
+  size_t speed_inline_budget{0};
+  // Write every decision of the inliner, with the size it adds to the caller
+  // and the reason of the rejected candidates, to a metafile.
+  bool log_inline_decisions{false};
   std::unordered_set<DexType*> whitelist_no_method_limit;
   // We will populate the information to rstate of classes and methods.
   std::unordered_set<DexType*> m_no_inline_annos;
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstructionIndex.h"
+
+#include "Walkers.h"
+
+const InstructionIndex::Uses InstructionIndex::s_no_uses;
+
+InstructionIndex::InstructionIndex(const Scope& scope) {
+  walk::opcodes(scope, [this](DexMethod* method, IRInstruction* insn) {
+    Use use{method, insn};
+    if (insn->has_field()) {
+      m_by_field[insn->get_field()].push_back(use);
+    } else if (insn->has_method()) {
+      m_by_method[insn->get_method()].push_back(use);
+    } else if (insn->has_type()) {
+      m_by_type[insn->get_type()].push_back(use);
+    } else {
+      return;
+    }
+    m_by_opcode[insn->opcode()].push_back(use);
+    ++m_size;
+  });
+}
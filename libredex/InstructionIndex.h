@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "IRInstruction.h"
+
+/*
+ * An index of the instructions of a scope that reference a field, a method or
+ * a type, by opcode and by referenced entity. Passes that look for, say, all
+ * the sputs or all the invokes of a method can query it instead of walking
+ * all the code of the scope.
+ *
+ * The index is a snapshot: it isn't updated when the code changes. Rather
+ * than building their own, passes should get it from
+ * PassManager::get_instruction_index(), which builds it on first use and drops
+ * it between passes; a pass that changes the indexed instructions must call
+ * PassManager::invalidate_instruction_index() before querying it again.
+ */
+class InstructionIndex {
+ public:
+  struct Use {
+    DexMethod* method;
+    IRInstruction* insn;
+  };
+  using Uses = std::vector<Use>;
+
+  explicit InstructionIndex(const Scope& scope);
+
+  // In the order of the scope and of the code of each method.
+  const Uses& get(IROpcode op) const { return m_by_opcode[op]; }
+
+  const Uses& get(const DexFieldRef* field) const {
+    return get_or_empty(m_by_field, field);
+  }
+  const Uses& get(const DexMethodRef* method) const {
+    return get_or_empty(m_by_method, method);
+  }
+  const Uses& get(const DexType* type) const {
+    return get_or_empty(m_by_type, type);
+  }
+
+  const std::unordered_map<const DexFieldRef*, Uses>& fields() const {
+    return m_by_field;
+  }
+  const std::unordered_map<const DexMethodRef*, Uses>& methods() const {
+    return m_by_method;
+  }
+  const std::unordered_map<const DexType*, Uses>& types() const {
+    return m_by_type;
+  }
+
+  size_t size() const { return m_size; }
+
+ private:
+  template <class Ref>
+  static const Uses& get_or_empty(
+      const std::unordered_map<const Ref*, Uses>& map, const Ref* ref) {
+    auto it = map.find(ref);
+    return it == map.end() ? s_no_uses : it->second;
+  }
+
+  static const Uses s_no_uses;
+  static constexpr size_t kNumOpcodes = IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1;
+
+  std::array<Uses, kNumOpcodes> m_by_opcode;
+  std::unordered_map<const DexFieldRef*, Uses> m_by_field;
+  std::unordered_map<const DexMethodRef*, Uses> m_by_method;
+  std::unordered_map<const DexType*, Uses> m_by_type;
+  size_t m_size{0};
+};
@@ -36,6 +36,16 @@ static bool signed_int_fits_high16(int64_t v) {
  * Helpers for lower()
  */
 
+/*
+ * Allocates a lowered instruction from the method's pool, or from the heap if
+ * there is none.
+ */
+template <class T, class... Args>
+static T* make_dex_insn(DexInstructionPool* pool, Args&&... args) {
+  return pool != nullptr ? pool->make<T>(std::forward<Args>(args)...)
+                         : new T(std::forward<Args>(args)...);
+}
+
 /*
  * Returns an array of move opcodes of the appropriate type, sorted by
  * increasing size.
@@ -182,24 +192,24 @@ static DexOpcode convert_3to2addr(DexOpcode op) {
   return static_cast<DexOpcode>(op + offset);
 }
 
-bool try_2addr_conversion(MethodItemEntry* mie) {
+bool try_2addr_conversion(MethodItemEntry* mie, DexInstructionPool* pool) {
   auto* insn = mie->dex_insn;
   auto op = insn->opcode();
   if (dex_opcode::is_commutative(op) && insn->dest() == insn->src(1) &&
       insn->dest() <= 0xf && insn->src(0) <= 0xf) {
-    auto* new_insn = new DexInstruction(convert_3to2addr(op));
+    auto* new_insn = make_dex_insn<DexInstruction>(pool, convert_3to2addr(op));
     new_insn->set_dest(insn->dest());
     new_insn->set_src(1, insn->src(0));
-    delete mie->dex_insn;
+    DexInstruction::destroy(mie->dex_insn);
     mie->dex_insn = new_insn;
     return true;
   } else if (op >= DOPCODE_ADD_INT && op <= DOPCODE_REM_DOUBLE &&
              insn->dest() == insn->src(0) && insn->dest() <= 0xf &&
              insn->src(1) <= 0xf) {
-    auto* new_insn = new DexInstruction(convert_3to2addr(op));
+    auto* new_insn = make_dex_insn<DexInstruction>(pool, convert_3to2addr(op));
     new_insn->set_dest(insn->dest());
     new_insn->set_src(1, insn->src(1));
-    delete mie->dex_insn;
+    DexInstruction::destroy(mie->dex_insn);
     mie->dex_insn = new_insn;
     return true;
   }
@@ -270,26 +280,27 @@ void check_load_params(DexMethod* method) {
   }
 }
 
-DexInstruction* create_dex_instruction(const IRInstruction* insn) {
+DexInstruction* create_dex_instruction(DexInstructionPool* pool,
+                                       const IRInstruction* insn) {
   auto op = opcode::to_dex_opcode(insn->opcode());
   switch (opcode::ref(insn->opcode())) {
   case opcode::Ref::None:
   case opcode::Ref::Data:
-    return new DexInstruction(op);
+    return make_dex_insn<DexInstruction>(pool, op);
   case opcode::Ref::Literal:
-    return new DexInstruction(op);
+    return make_dex_insn<DexInstruction>(pool, op);
   case opcode::Ref::String:
-    return new DexOpcodeString(op, insn->get_string());
+    return make_dex_insn<DexOpcodeString>(pool, op, insn->get_string());
   case opcode::Ref::Type:
-    return new DexOpcodeType(op, insn->get_type());
+    return make_dex_insn<DexOpcodeType>(pool, op, insn->get_type());
   case opcode::Ref::Field:
-    return new DexOpcodeField(op, insn->get_field());
+    return make_dex_insn<DexOpcodeField>(pool, op, insn->get_field());
   case opcode::Ref::Method:
-    return new DexOpcodeMethod(op, insn->get_method());
+    return make_dex_insn<DexOpcodeMethod>(pool, op, insn->get_method());
   case opcode::Ref::CallSite:
-    return new DexOpcodeCallSite(op, insn->get_callsite());
+    return make_dex_insn<DexOpcodeCallSite>(pool, op, insn->get_callsite());
   case opcode::Ref::MethodHandle:
-    return new DexOpcodeMethodHandle(op, insn->get_methodhandle());
+    return make_dex_insn<DexOpcodeMethodHandle>(pool, op, insn->get_methodhandle());
   }
 }
 
@@ -322,13 +333,15 @@ size_t lower_check_cast(DexMethod*, IRCode* code, IRList::iterator* it_) {
     auto move_template = std::make_unique<IRInstruction>(OPCODE_MOVE_OBJECT);
     move_template->set_dest(move->dest());
     move_template->set_src(0, insn->src(0));
-    auto* dex_mov = new DexInstruction(select_move_opcode(move_template.get()));
+    auto* dex_mov = make_dex_insn<DexInstruction>(
+        code->dex_insn_pool(), select_move_opcode(move_template.get()));
     dex_mov->set_dest(move->dest());
     dex_mov->set_src(0, insn->src(0));
     code->insert_before(it, dex_mov);
     ++extra_instructions;
   }
-  auto* dex_insn = new DexOpcodeType(DOPCODE_CHECK_CAST, insn->get_type());
+  auto* dex_insn = make_dex_insn<DexOpcodeType>(
+      code->dex_insn_pool(), DOPCODE_CHECK_CAST, insn->get_type());
   dex_insn->set_src(0, move->dest());
   it->replace_ir_with_dex(dex_insn);
   remove_move_result_pseudo(++it);
@@ -339,7 +352,8 @@ size_t lower_check_cast(DexMethod*, IRCode* code, IRList::iterator* it_) {
 void lower_fill_array_data(DexMethod*, IRCode* code, IRList::iterator* it_) {
   auto& it = *it_;
   const auto* insn = it->insn;
-  auto* dex_insn = new DexInstruction(DOPCODE_FILL_ARRAY_DATA);
+  auto* dex_insn = make_dex_insn<DexInstruction>(code->dex_insn_pool(),
+                                                 DOPCODE_FILL_ARRAY_DATA);
   dex_insn->set_src(0, insn->src(0));
   auto* bt = new BranchTarget(&*it);
   code->push_back(bt);
@@ -375,27 +389,31 @@ void lower_to_range_instruction(DexMethod* method,
       SHOW(insn),
       SHOW(method),
       SHOW_CONTEXT(code, insn));
-  auto* dex_insn = create_dex_instruction(insn);
+  auto* dex_insn = create_dex_instruction(code->dex_insn_pool(), insn);
   dex_insn->set_opcode(opcode::range_version(insn->opcode()));
   dex_insn->set_range_base(insn->src(0));
   dex_insn->set_range_size(insn->srcs_size());
   it->replace_ir_with_dex(dex_insn);
 }
 
-void lower_simple_instruction(DexMethod*, IRCode*, IRList::iterator* it_) {
+void lower_simple_instruction(DexMethod*,
+                              IRCode* code,
+                              IRList::iterator* it_) {
   auto& it = *it_;
   const auto* insn = it->insn;
   auto op = insn->opcode();
+  auto* pool = code->dex_insn_pool();
 
   DexInstruction* dex_insn;
   if (is_move(op)) {
-    dex_insn = new DexInstruction(select_move_opcode(insn));
+    dex_insn = make_dex_insn<DexInstruction>(pool, select_move_opcode(insn));
   } else if (op >= OPCODE_CONST && op <= OPCODE_CONST_WIDE) {
-    dex_insn = new DexInstruction(select_const_opcode(insn));
+    dex_insn = make_dex_insn<DexInstruction>(pool, select_const_opcode(insn));
   } else if (op >= OPCODE_ADD_INT_LIT16 && op <= OPCODE_USHR_INT_LIT8) {
-    dex_insn = new DexInstruction(select_binop_lit_opcode(insn));
+    dex_insn =
+        make_dex_insn<DexInstruction>(pool, select_binop_lit_opcode(insn));
   } else {
-    dex_insn = create_dex_instruction(insn);
+    dex_insn = create_dex_instruction(pool, insn);
   }
   if (insn->has_dest()) {
     dex_insn->set_dest(insn->dest());
@@ -436,6 +454,13 @@ Stats lower(DexMethod* method, bool lower_with_cfg) {
   // Check the load-param opcodes make sense before removing them
   check_load_params(method);
 
+  // Lowering mostly maps instructions one to one, so this sizes the pool.
+  size_t insn_count = 0;
+  for (const MethodItemEntry& mie : *code) {
+    insn_count += mie.type == MFLOW_OPCODE;
+  }
+  auto* pool = code->dex_insn_pool(insn_count);
+
   std::unordered_map<MethodItemEntry*, std::vector<int32_t>> case_keys;
   for (const MethodItemEntry& it : *code) {
     if (it.type == MFLOW_TARGET) {
@@ -478,12 +503,14 @@ Stats lower(DexMethod* method, bool lower_with_cfg) {
       it->dex_insn->set_opcode(dop);
     }
   }
+  // The entries were lowered in place.
+  code->invalidate_opcode_index();
   for (auto it = code->begin(); it != code->end(); ++it) {
     always_assert(it->type != MFLOW_OPCODE);
     if (it->type != MFLOW_DEX_OPCODE) {
       continue;
     }
-    stats.to_2addr += try_2addr_conversion(&*it);
+    stats.to_2addr += try_2addr_conversion(&*it, pool);
   }
   return stats;
 }
@@ -46,7 +46,9 @@ DexOpcode select_const_opcode(const IRInstruction* insn);
 
 DexOpcode select_binop_lit_opcode(const IRInstruction* insn);
 
-bool try_2addr_conversion(MethodItemEntry*);
+// The /2addr instruction comes from `pool` if given, from the heap otherwise.
+bool try_2addr_conversion(MethodItemEntry*,
+                          DexInstructionPool* pool = nullptr);
 
 } // namespace impl
 
@@ -348,6 +348,40 @@ static DexMethod* make_dexmethod(std::vector<cp_entry>& cpool,
   return method;
 }
 
+/*
+ * Report a class from a jar that is already defined, either by an earlier
+ * jar or by the dex files of the app. The first definition wins.
+ */
+static void warn_duplicate_class(DexClass* cls,
+                                 const std::string& jar_location) {
+  auto self = cls->get_type();
+  // We are seeing duplicate classes when parsing jar file
+  if (cls->is_external()) {
+    // Two external classes in .jar file has the same name
+    // Just issue an warning for now
+    TRACE(MAIN, 1,
+          "Warning: Found a duplicate class '%s' in two .jar files:\n "
+          "  Current: '%s'\n"
+          "  Previous: '%s'",
+          SHOW(self), jar_location.c_str(), cls->get_location().c_str());
+  } else if (!dup_classes::is_known_dup(cls)) {
+    TRACE(MAIN, 1,
+          "Warning: Found a duplicate class '%s' in .dex and .jar file."
+          "  Current: '%s'\n"
+          "  Previous: '%s'\n",
+          SHOW(self), jar_location.c_str(), cls->get_location().c_str());
+
+    // There are still blocking issues in instrumentation test that are
+    // blocking. We can make this throw again once they are fixed.
+
+    // throw RedexException(RedexError::DUPLICATE_CLASSES,
+    //                      "Found duplicate class in two different files.",
+    //                      {{"class", SHOW(self)},
+    //                       {"dex1", jar_location},
+    //                       {"dex2", cls->get_location()}});
+  }
+}
+
 static bool parse_class(uint8_t* buffer,
                         Scope* classes,
                         attribute_hook_t attr_hook,
@@ -377,31 +411,7 @@ static bool parse_class(uint8_t* buffer,
   DexType* self = make_dextype_from_cref(cpool, clazz);
   DexClass* cls = type_class(self);
   if (cls) {
-    // We are seeing duplicate classes when parsing jar file
-    if (cls->is_external()) {
-      // Two external classes in .jar file has the same name
-      // Just issue an warning for now
-      TRACE(MAIN, 1,
-            "Warning: Found a duplicate class '%s' in two .jar files:\n "
-            "  Current: '%s'\n"
-            "  Previous: '%s'",
-            SHOW(self), jar_location.c_str(), cls->get_location().c_str());
-    } else if (!dup_classes::is_known_dup(cls)) {
-      TRACE(MAIN, 1,
-            "Warning: Found a duplicate class '%s' in .dex and .jar file."
-            "  Current: '%s'\n"
-            "  Previous: '%s'\n",
-            SHOW(self), jar_location.c_str(), cls->get_location().c_str());
-
-      // There are still blocking issues in instrumentation test that are
-      // blocking. We can make this throw again once they are fixed.
-
-      // throw RedexException(RedexError::DUPLICATE_CLASSES,
-      //                      "Found duplicate class in two different files.",
-      //                      {{"class", SHOW(self)},
-      //                       {"dex1", jar_location},
-      //                       {"dex2", cls->get_location()}});
-    }
+    warn_duplicate_class(cls, jar_location);
     return true;
   }
 
@@ -599,13 +609,8 @@ PACKED(struct pk_lfile {
 
 struct jar_entry {
   struct pk_cd_file cd_entry;
-  uint8_t* filename;
-  ~jar_entry() {
-    if (filename != nullptr) {
-      free(filename);
-      filename = nullptr;
-    }
-  }
+  // Points into the mapping of the jar, and isn't null-terminated.
+  const uint8_t* filename;
 };
 } // namespace
 
@@ -644,19 +649,24 @@ static bool validate_pce(pk_cdir_end& pce, ssize_t size) {
   return true;
 }
 
-static bool extract_jar_entry(const uint8_t*& mapping, jar_entry& je) {
-  if (memcmp(mapping, kCDFile, kSignatureSize) != 0) {
+static bool extract_jar_entry(const uint8_t*& mapping,
+                              const uint8_t* cdir_end,
+                              jar_entry& je) {
+  if (mapping + sizeof(pk_cd_file) > cdir_end ||
+      memcmp(mapping, kCDFile, kSignatureSize) != 0) {
     fprintf(stderr, "Invalid central directory entry, bailing\n");
     return false;
   }
   memcpy(&je.cd_entry, mapping, sizeof(pk_cd_file));
   mapping += sizeof(pk_cd_file);
-  je.filename = (uint8_t*)malloc(je.cd_entry.fname_len + 1);
-  memcpy(je.filename, mapping, je.cd_entry.fname_len);
-  je.filename[je.cd_entry.fname_len] = '\0';
+  je.filename = mapping;
   mapping += je.cd_entry.fname_len;
   mapping += je.cd_entry.extra_len;
   mapping += je.cd_entry.comment_len;
+  if (mapping > cdir_end) {
+    fprintf(stderr, "Central directory entry overflow, bailing\n");
+    return false;
+  }
   return true;
 }
 
@@ -664,9 +674,10 @@ static bool get_jar_entries(const uint8_t* mapping,
                             pk_cdir_end& pce,
                             std::vector<jar_entry>& files) {
   const uint8_t* cdir = mapping + pce.cd_disk_offset;
+  const uint8_t* cdir_end = cdir + pce.cd_size;
   files.resize(pce.cd_entries);
   for (int entry = 0; entry < pce.cd_entries; entry++) {
-    if (!extract_jar_entry(cdir, files[entry])) return false;
+    if (!extract_jar_entry(cdir, cdir_end, files[entry])) return false;
   }
   return true;
 }
@@ -752,6 +763,23 @@ static bool decompress_class(jar_entry& file,
 
 static const int kStartBufferSize = 128 * 1024;
 
+/*
+ * Look up the class that a .class entry is named after, without inflating
+ * it. The entry name is only a hint: it is checked against the name in the
+ * class file itself when the entry is parsed.
+ */
+static DexClass* defined_class(const jar_entry& file) {
+  static const size_t kClassSuffixLen = strlen(".class");
+  std::string name;
+  name.reserve(file.cd_entry.fname_len);
+  name.push_back('L');
+  name.append(reinterpret_cast<const char*>(file.filename),
+              file.cd_entry.fname_len - kClassSuffixLen);
+  name.push_back(';');
+  auto type = DexType::get_type(name);
+  return type == nullptr ? nullptr : type_class(type);
+}
+
 static bool process_jar_entries(const char* location,
                                 std::vector<jar_entry>& files,
                                 const uint8_t* mapping,
@@ -767,10 +795,18 @@ static bool process_jar_entries(const char* location,
     if (file.cd_entry.fname_len < (classEndStringLen + 1)) continue;
 
     // Skip non-class files
-    uint8_t* endcomp =
+    const uint8_t* endcomp =
         file.filename + (file.cd_entry.fname_len - classEndStringLen);
     if (memcmp(endcomp, classEndString, classEndStringLen) != 0) continue;
 
+    // Don't inflate classes that are already defined, which is common for
+    // library jars that overlap with each other or with the app.
+    auto cls = defined_class(file);
+    if (cls != nullptr) {
+      warn_duplicate_class(cls, location);
+      continue;
+    }
+
     // Resize output if necessary.
     if (bufsize < file.cd_entry.ucomp_size) {
       while (bufsize < file.cd_entry.ucomp_size)
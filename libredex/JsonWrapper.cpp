@@ -30,7 +30,11 @@ const std::string JsonWrapper::get(const char* name,
 }
 
 void JsonWrapper::get(const char* name, bool dflt, bool& param) const {
-  auto val = m_config.get(name, dflt);
+  const auto& val = m_config[name];
+  if (val.isNull()) {
+    param = dflt;
+    return;
+  }
 
   // Do some simple type conversions that folly used to do
   if (val.isBool()) {
@@ -67,7 +71,7 @@ bool JsonWrapper::get(const char* name, bool dflt) const {
 void JsonWrapper::get(const char* name,
                       const std::vector<std::string>& dflt,
                       std::vector<std::string>& param) const {
-  auto it = m_config[name];
+  const auto& it = m_config[name];
   if (it == Json::nullValue) {
     param = dflt;
   } else {
@@ -81,7 +85,7 @@ void JsonWrapper::get(const char* name,
 void JsonWrapper::get(const char* name,
                       const std::vector<std::string>& dflt,
                       std::unordered_set<std::string>& param) const {
-  auto it = m_config[name];
+  const auto& it = m_config[name];
   param.clear();
   if (it == Json::nullValue) {
     param.insert(dflt.begin(), dflt.end());
@@ -96,7 +100,7 @@ void JsonWrapper::get(
     const char* name,
     const std::unordered_map<std::string, std::vector<std::string>>& dflt,
     std::unordered_map<std::string, std::vector<std::string>>& param) const {
-  auto cfg = m_config[name];
+  const auto& cfg = m_config[name];
   param.clear();
   if (cfg == Json::nullValue) {
     param = dflt;
@@ -111,12 +115,12 @@ void JsonWrapper::get(
         throw std::runtime_error("Cannot convert JSON value to string: " +
                                  key.asString());
       }
-      auto& val = *it;
+      const auto& val = *it;
       if (!val.isArray()) {
         throw std::runtime_error("Cannot convert JSON value to array: " +
                                  val.asString());
       }
-      for (auto& str : val) {
+      for (const auto& str : val) {
         if (!str.isString()) {
           throw std::runtime_error("Cannot convert JSON value to string: " +
                                    str.asString());
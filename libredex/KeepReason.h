@@ -9,7 +9,6 @@
 
 #include <boost/functional/hash.hpp>
 #include <ostream>
-#include <unordered_set>
 
 #include "Debug.h"
 
@@ -78,7 +77,4 @@ struct ReasonPtrEqual {
   }
 };
 
-using ReasonPtrSet =
-    std::unordered_set<const Reason*, ReasonPtrHash, ReasonPtrEqual>;
-
 } // namespace keep_reason
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LineMapReader.h"
+
+#include "Debug.h"
+
+namespace {
+
+constexpr uint32_t MAGIC = 0xfaceb000;
+// Both versions store frames as class_id, method_id, file_id, line, parent.
+constexpr uint32_t FRAME_WORDS = 5;
+
+} // namespace
+
+LineMapReader::LineMapReader(const std::string& filename)
+    : m_in(filename, std::ifstream::in | std::ifstream::binary) {
+  always_assert_log(m_in, "Cannot open line map %s", filename.c_str());
+  always_assert_log(read_word() == MAGIC, "Magic number mismatch in %s",
+                    filename.c_str());
+  m_version = read_word();
+  if (m_version == 2) {
+    // Version 2 has no index, so the string pool is read to find the frames
+    // behind it. Frames and lines are the same thing there.
+    m_string_count = read_word();
+    for (uint32_t id = 0; id < m_string_count; ++id) {
+      std::string s(read_word(), '\0');
+      m_in.read(&s[0], s.size());
+      m_strings.emplace(id, std::move(s));
+    }
+    m_frame_count = m_line_count = read_word();
+    m_frames_offset = m_in.tellg();
+    m_lines_offset = 0;
+  } else {
+    always_assert_log(m_version == 3, "Unsupported line map version %u in %s",
+                      m_version, filename.c_str());
+    m_string_count = read_word();
+    m_frame_count = read_word();
+    m_line_count = read_word();
+    uint64_t string_data_size = read_word();
+    m_string_offsets.resize(m_string_count + 1);
+    m_in.read((char*)m_string_offsets.data(),
+              m_string_offsets.size() * sizeof(uint32_t));
+    m_string_data_offset = m_in.tellg();
+    m_frames_offset = m_string_data_offset + ((string_data_size + 3) & ~3);
+    m_lines_offset =
+        m_frames_offset + uint64_t(m_frame_count) * FRAME_WORDS * 4;
+  }
+  always_assert_log(m_in, "Truncated line map %s", filename.c_str());
+}
+
+uint32_t LineMapReader::read_word() {
+  uint32_t word = 0;
+  m_in.read((char*)&word, sizeof(word));
+  return word;
+}
+
+uint32_t LineMapReader::read_word_at(uint64_t offset) {
+  m_in.seekg(offset);
+  return read_word();
+}
+
+const std::string& LineMapReader::get_string(uint32_t id) {
+  always_assert_log(id < m_string_count, "String id %u out of range", id);
+  auto it = m_strings.find(id);
+  if (it != m_strings.end()) {
+    return it->second;
+  }
+  auto begin = m_string_offsets[id];
+  std::string s(m_string_offsets[id + 1] - begin, '\0');
+  m_in.seekg(m_string_data_offset + begin);
+  m_in.read(&s[0], s.size());
+  always_assert_log(m_in, "Truncated string %u in line map", id);
+  return m_strings.emplace(id, std::move(s)).first->second;
+}
+
+std::vector<LineMapReader::Frame> LineMapReader::get_stack(uint32_t line) {
+  std::vector<Frame> stack;
+  if (line == 0 || line > m_line_count) {
+    return stack;
+  }
+  uint32_t frame_id = m_version == 2
+                          ? line
+                          : read_word_at(m_lines_offset + (line - 1) * 4) + 1;
+  // Parent links of a well-formed map never loop, but the map is read from
+  // disk, so walk at most as many frames as there are.
+  while (frame_id != 0 && frame_id <= m_frame_count &&
+         stack.size() < m_frame_count) {
+    uint32_t words[FRAME_WORDS];
+    m_in.seekg(m_frames_offset + uint64_t(frame_id - 1) * FRAME_WORDS * 4);
+    m_in.read((char*)words, sizeof(words));
+    always_assert_log(m_in, "Truncated frame %u in line map", frame_id - 1);
+    stack.push_back(Frame{get_string(words[0]), get_string(words[1]),
+                          get_string(words[2]), words[3]});
+    frame_id = words[4];
+  }
+  return stack;
+}
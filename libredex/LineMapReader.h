@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Reads the line maps written by RealPositionMapper, to turn the line numbers
+ * of a stack trace back into the original, possibly inlined, frames.
+ *
+ * Version 3 maps are read lazily: opening one only reads its header and string
+ * offsets, and each lookup seeks to the frames it needs. Version 2 maps are
+ * supported too, but their string pool has to be read upfront.
+ */
+class LineMapReader {
+ public:
+  struct Frame {
+    std::string class_name;
+    std::string method_name;
+    std::string file;
+    uint32_t line;
+  };
+
+  explicit LineMapReader(const std::string& filename);
+
+  uint32_t version() const { return m_version; }
+
+  // The largest line number that the map knows about.
+  uint32_t line_count() const { return m_line_count; }
+
+  /*
+   * The frames that a line number of the Dex debug info stands for, innermost
+   * first. Returns an empty stack for line numbers that are not in the map.
+   */
+  std::vector<Frame> get_stack(uint32_t line);
+
+ private:
+  uint32_t read_word();
+  uint32_t read_word_at(uint64_t offset);
+  const std::string& get_string(uint32_t id);
+
+  std::ifstream m_in;
+  uint32_t m_version;
+  uint32_t m_string_count;
+  uint32_t m_frame_count;
+  uint32_t m_line_count;
+  uint64_t m_string_data_offset;
+  uint64_t m_frames_offset;
+  uint64_t m_lines_offset;
+  std::vector<uint32_t> m_string_offsets;
+  std::unordered_map<uint32_t, std::string> m_strings;
+};
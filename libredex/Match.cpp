@@ -41,9 +41,10 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke_static() {
 
 match_t<IRInstruction> return_void() {
   return {[](const IRInstruction* insn) {
-    auto opcode = insn->opcode();
-    return opcode == OPCODE_RETURN_VOID;
-  }};
+            auto opcode = insn->opcode();
+            return opcode == OPCODE_RETURN_VOID;
+          },
+          opcode_filter<IRInstruction>({OPCODE_RETURN_VOID})};
 }
 
 match_t<IRInstruction, std::tuple<size_t>> has_n_args(size_t n) {
@@ -62,20 +63,25 @@ match_t<DexClass, std::tuple<>> is_interface() {
 }
 
 match_t<IRInstruction> has_type() {
-  return {[](const IRInstruction* insn) { return insn->has_type(); }};
+  return {[](const IRInstruction* insn) { return insn->has_type(); },
+          opcode_filter<IRInstruction>::of([](IROpcode op) {
+            return opcode::ref(op) == opcode::Ref::Type;
+          })};
 }
 
 match_t<IRInstruction> const_string() {
   return {[](const IRInstruction* insn) {
-    auto opcode = insn->opcode();
-    return opcode == OPCODE_CONST_STRING;
-  }};
+            auto opcode = insn->opcode();
+            return opcode == OPCODE_CONST_STRING;
+          },
+          opcode_filter<IRInstruction>({OPCODE_CONST_STRING})};
 }
 
 match_t<IRInstruction> move_result_pseudo() {
   return {[](const IRInstruction* insn) {
-    return opcode::is_move_result_pseudo(insn->opcode());
-  }};
+            return opcode::is_move_result_pseudo(insn->opcode());
+          },
+          opcode_filter<IRInstruction>::of(opcode::is_move_result_pseudo)};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> new_instance() {
@@ -84,9 +90,10 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> new_instance() {
 
 match_t<IRInstruction> throwex() {
   return {[](const IRInstruction* insn) {
-    auto opcode = insn->opcode();
-    return opcode == OPCODE_THROW;
-  }};
+            auto opcode = insn->opcode();
+            return opcode == OPCODE_THROW;
+          },
+          opcode_filter<IRInstruction>({OPCODE_THROW})};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke_direct() {
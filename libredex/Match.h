@@ -8,7 +8,9 @@
 #pragma once
 
 #include <algorithm>
+#include <bitset>
 #include <functional>
+#include <initializer_list>
 #include <type_traits>
 #include <vector>
 
@@ -27,9 +29,8 @@ struct insns_matcher {
                          const std::vector<IRInstruction*>& insns,
                          const T& t) {
     const auto& insn = insns.at(at);
-    typename std::tuple_element<N::value, T>::type insn_match =
-        std::get<N::value>(t);
-    return insn_match.matches(insn) &&
+    const auto& insn_match = std::get<N::value>(t);
+    return insn_match.opcodes.may_match(insn) && insn_match.matches(insn) &&
            insns_matcher<T, std::integral_constant<size_t, N::value + 1>>::
                matches_at(at + 1, insns, t);
   }
@@ -69,6 +70,60 @@ void find_matches(const std::vector<IRInstruction*>& insns,
   }
 }
 
+/**
+ * The opcodes that an instruction matcher can possibly match. Scans test it
+ * before evaluating the matcher itself, so that the instructions that can't
+ * match are skipped with a bit test instead of a chain of indirect calls.
+ * Matchers of anything but instructions carry an empty filter.
+ */
+template <typename T>
+struct opcode_filter {
+  bool may_match(const T*) const { return true; }
+  opcode_filter operator&(const opcode_filter&) const { return {}; }
+  opcode_filter operator|(const opcode_filter&) const { return {}; }
+};
+
+template <>
+struct opcode_filter<IRInstruction> {
+  // All opcodes.
+  opcode_filter() { m_opcodes.set(); }
+
+  explicit opcode_filter(std::initializer_list<IROpcode> opcodes) {
+    for (auto op : opcodes) {
+      m_opcodes.set(op);
+    }
+  }
+
+  // The opcodes for which `pred` holds.
+  template <typename Pred>
+  static opcode_filter of(const Pred& pred) {
+    opcode_filter filter({});
+    for (size_t op = 0; op < filter.m_opcodes.size(); ++op) {
+      filter.m_opcodes[op] = pred(static_cast<IROpcode>(op));
+    }
+    return filter;
+  }
+
+  bool may_match(IROpcode op) const { return m_opcodes.test(op); }
+  bool may_match(const IRInstruction* insn) const {
+    return may_match(insn->opcode());
+  }
+
+  opcode_filter operator&(const opcode_filter& that) const {
+    opcode_filter result(*this);
+    result.m_opcodes &= that.m_opcodes;
+    return result;
+  }
+  opcode_filter operator|(const opcode_filter& that) const {
+    opcode_filter result(*this);
+    result.m_opcodes |= that.m_opcodes;
+    return result;
+  }
+
+ private:
+  std::bitset<IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1> m_opcodes;
+};
+
 /** N-ary match template */
 template <typename T,
           typename P = std::tuple<>,
@@ -79,6 +134,7 @@ struct match_t;
 template <typename T, typename P>
 struct match_t<T, P, 0> {
   bool (*fn)(const T*);
+  opcode_filter<T> opcodes;
   bool matches(const T* t) const { return fn(t); }
 };
 
@@ -88,6 +144,7 @@ struct match_t<T, P, 1> {
   using P0_t = typename std::tuple_element<0, P>::type;
   bool (*fn)(const T*, const P0_t& p0);
   P0_t p0;
+  opcode_filter<T> opcodes;
   bool matches(const T* t) const { return fn(t, p0); }
 };
 
@@ -99,6 +156,7 @@ struct match_t<T, P, 2> {
   bool (*fn)(const T*, const P0_t& p0, const P1_t& p1);
   P0_t p0;
   P1_t p1;
+  opcode_filter<T> opcodes;
   bool matches(const T* t) const { return fn(t, p0, p1); }
 };
 
@@ -116,7 +174,7 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1>>> operator||(
   return {[](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
             return p0.matches(t) || p1.matches(t);
           },
-          p0, p1};
+          p0, p1, p0.opcodes | p1.opcodes};
 }
 
 /** Match two subordinate matches whose logical and is true */
@@ -126,7 +184,7 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1>>> operator&&(
   return {[](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
             return p0.matches(t) && p1.matches(t);
           },
-          p0, p1};
+          p0, p1, p0.opcodes & p1.opcodes};
 }
 
 /** Match two subordinate matches whose logical xor is true */
@@ -136,7 +194,7 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1>>> operator^(
   return {[](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
             return p0.matches(t) ^ p1.matches(t);
           },
-          p0, p1};
+          p0, p1, p0.opcodes | p1.opcodes};
 }
 
 /** Match any T (always matches) */
@@ -208,7 +266,7 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P>>> new_instance(
               return false;
             }
           },
-          p};
+          p, opcode_filter<IRInstruction>({OPCODE_NEW_INSTANCE}) & p.opcodes};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> new_instance();
@@ -228,7 +286,7 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P>>> invoke_direct(
               return false;
             }
           },
-          p};
+          p, opcode_filter<IRInstruction>({OPCODE_INVOKE_DIRECT}) & p.opcodes};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke_direct();
@@ -245,7 +303,7 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P>>> invoke_static(
               return false;
             }
           },
-          p};
+          p, opcode_filter<IRInstruction>({OPCODE_INVOKE_STATIC}) & p.opcodes};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke_static();
@@ -262,7 +320,7 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P>>> invoke_virtual(
               return false;
             }
           },
-          p};
+          p, opcode_filter<IRInstruction>({OPCODE_INVOKE_VIRTUAL}) & p.opcodes};
 }
 
 match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke_virtual();
@@ -274,7 +332,10 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P>>> invoke(
   return {[](const IRInstruction* insn, const match_t<IRInstruction, P>& p) {
             return is_invoke(insn->opcode()) && p.matches(insn);
           },
-          p};
+          p,
+          opcode_filter<IRInstruction>::of(
+              [](IROpcode op) { return is_invoke(op); }) &
+              p.opcodes};
 }
 
 inline match_t<IRInstruction, std::tuple<match_t<IRInstruction>>> invoke() {
@@ -292,7 +353,7 @@ inline match_t<IRInstruction, std::tuple<IROpcode>> is_opcode(IROpcode opcode) {
   return {[](const IRInstruction* insn, const IROpcode& opcode) {
             return insn->opcode() == opcode;
           },
-          opcode};
+          opcode, opcode_filter<IRInstruction>({opcode})};
 }
 
 /** Matchers that map from IRInstruction -> other types */
@@ -303,7 +364,10 @@ match_t<IRInstruction, std::tuple<match_t<DexMethodRef, P>>> opcode_method(
             always_assert(insn->has_method());
             return p.matches(insn->get_method());
           },
-          predicate};
+          predicate,
+          opcode_filter<IRInstruction>::of([](IROpcode op) {
+            return opcode::ref(op) == opcode::Ref::Method;
+          })};
 }
 
 template <typename P>
@@ -312,7 +376,10 @@ match_t<IRInstruction, std::tuple<match_t<DexType, P>>> opcode_type(
   return {[](const IRInstruction* insn, const match_t<DexType, P>& p) {
             return p.matches(insn->get_type());
           },
-          p};
+          p,
+          opcode_filter<IRInstruction>::of([](IROpcode op) {
+            return opcode::ref(op) == opcode::Ref::Type;
+          })};
 }
 
 /** Match types which can be assigned to the given type */
@@ -84,6 +84,7 @@ class GraphBuilder {
         analyze_non_interface(cls);
       }
     });
+    m_graph->finalize();
     return std::move(m_graph);
   }
 
@@ -203,25 +204,49 @@ class GraphBuilder {
 
 namespace method_override_graph {
 
-Node Graph::empty_node;
-
-const Node& Graph::get_node(const DexMethod* method) const {
+Node Graph::get_node(const DexMethod* method) const {
+  always_assert(m_finalized);
   auto it = m_nodes.find(method);
   if (it == m_nodes.end()) {
-    return empty_node;
+    return Node();
   }
   return it->second;
 }
 
 void Graph::add_edge(const DexMethod* overridden, const DexMethod* overriding) {
-  m_nodes.update(overridden,
-                 [&](const DexMethod*, Node& node, bool /* exists */) {
-                   node.children.insert(overriding);
-                 });
-  m_nodes.update(overriding,
-                 [&](const DexMethod*, Node& node, bool /* exists */) {
-                   node.parents.insert(overridden);
-                 });
+  always_assert(!m_finalized);
+  m_pending_edges.update(overridden,
+                         [&](const DexMethod*, PendingEdges& edges, bool) {
+                           edges.children.insert(overriding);
+                         });
+  m_pending_edges.update(overriding,
+                         [&](const DexMethod*, PendingEdges& edges, bool) {
+                           edges.parents.insert(overridden);
+                         });
+}
+
+void Graph::finalize() {
+  always_assert(!m_finalized);
+  size_t num_edges = 0;
+  for (const auto& pair : m_pending_edges) {
+    num_edges += pair.second.parents.size() + pair.second.children.size();
+  }
+  // Reserving up front keeps the ranges of the nodes valid as we fill it.
+  m_edges.reserve(num_edges);
+  m_nodes.reserve(m_pending_edges.size());
+  auto append = [&](const std::unordered_set<const DexMethod*>& methods) {
+    auto begin = m_edges.data() + m_edges.size();
+    m_edges.insert(m_edges.end(), methods.begin(), methods.end());
+    return MethodRange(begin, m_edges.data() + m_edges.size());
+  };
+  for (const auto& pair : m_pending_edges) {
+    Node node;
+    node.parents = append(pair.second.parents);
+    node.children = append(pair.second.children);
+    m_nodes.emplace(pair.first, node);
+  }
+  m_pending_edges.clear();
+  m_finalized = true;
 }
 
 void Graph::dump(std::ostream& os) const {
@@ -247,48 +272,42 @@ std::unique_ptr<const Graph> build_graph(const Scope& scope) {
   return GraphBuilder(scope).run();
 }
 
+namespace {
+
+template <MethodRange Node::*edges>
+std::unordered_set<const DexMethod*> get_reachable_methods(
+    const Graph& graph, const DexMethod* method, bool include_interfaces) {
+  std::unordered_set<const DexMethod*> reachable;
+  std::unordered_set<const DexMethod*> visited{method};
+  std::vector<const DexMethod*> worklist{method};
+  while (!worklist.empty()) {
+    auto current = worklist.back();
+    worklist.pop_back();
+    for (const auto* next : graph.get_node(current).*edges) {
+      auto next_cls = type_class(next->get_class());
+      if (include_interfaces || !is_interface(next_cls)) {
+        reachable.emplace(next);
+      }
+      if (visited.emplace(next).second) {
+        worklist.push_back(next);
+      }
+    }
+  }
+  return reachable;
+}
+
+} // namespace
+
 std::unordered_set<const DexMethod*> get_overriding_methods(
     const Graph& graph, const DexMethod* method, bool include_interfaces) {
-  std::unordered_set<const DexMethod*> overrides;
-  std::unordered_set<const DexMethod*> visited;
-  std::function<void(const DexMethod*, const Node&)> visit =
-      [&](const DexMethod* current, const Node& node) {
-        if (visited.count(current)) {
-          return;
-        }
-        visited.emplace(current);
-        for (const auto* child : node.children) {
-          auto child_cls = type_class(child->get_class());
-          if (include_interfaces || !is_interface(child_cls)) {
-            overrides.emplace(child);
-          }
-          visit(child, graph.get_node(child));
-        }
-      };
-  visit(method, graph.get_node(method));
-  return overrides;
+  return get_reachable_methods<&Node::children>(graph, method,
+                                                include_interfaces);
 }
 
 std::unordered_set<const DexMethod*> get_overridden_methods(
     const Graph& graph, const DexMethod* method, bool include_interfaces) {
-  std::unordered_set<const DexMethod*> overridden;
-  std::unordered_set<const DexMethod*> visited;
-  std::function<void(const DexMethod*, const Node&)> visit =
-      [&](const DexMethod* current, const Node& node) {
-        if (visited.count(current)) {
-          return;
-        }
-        visited.emplace(current);
-        for (const auto* parent : node.parents) {
-          auto parent_cls = type_class(parent->get_class());
-          if (include_interfaces || !is_interface(parent_cls)) {
-            overridden.emplace(parent);
-          }
-          visit(parent, graph.get_node(parent));
-        }
-      };
-  visit(method, graph.get_node(method));
-  return overridden;
+  return get_reachable_methods<&Node::parents>(graph, method,
+                                               include_interfaces);
 }
 
 bool is_true_virtual(const Graph& graph, const DexMethod* method) {
@@ -296,7 +315,7 @@ bool is_true_virtual(const Graph& graph, const DexMethod* method) {
     return true;
   }
   const auto& node = graph.get_node(method);
-  return node.parents.size() != 0 || node.children.size() != 0;
+  return !node.parents.empty() || !node.children.empty();
 }
 
 std::unordered_set<DexMethod*> get_non_true_virtuals(const Graph& graph,
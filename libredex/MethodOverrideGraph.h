@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "AnalysisRegistry.h"
 #include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexStore.h"
@@ -62,28 +67,75 @@ inline std::unordered_set<DexMethod*> get_non_true_virtuals(
   return get_non_true_virtuals(*build_graph(scope), scope);
 }
 
+/*
+ * A slice of the edges of a Graph. It is a view: it stays valid as long as
+ * the graph does.
+ */
+class MethodRange {
+ public:
+  using const_iterator = const DexMethod* const*;
+
+  MethodRange() = default;
+  MethodRange(const_iterator begin, const_iterator end)
+      : m_begin(begin), m_end(end) {}
+
+  const_iterator begin() const { return m_begin; }
+  const_iterator end() const { return m_end; }
+  size_t size() const { return m_end - m_begin; }
+  bool empty() const { return m_begin == m_end; }
+
+ private:
+  const_iterator m_begin{nullptr};
+  const_iterator m_end{nullptr};
+};
+
 /*
  * The `children` edges point to the overriders / implementors of the current
  * Node's method.
  */
 struct Node {
-  std::unordered_set<const DexMethod*> parents;
-  std::unordered_set<const DexMethod*> children;
+  MethodRange parents;
+  MethodRange children;
 };
 
+/*
+ * The edges are added concurrently as the graph is built, then finalize()
+ * packs them into a single array, where the parents and the children of each
+ * method are contiguous. Nodes can only be queried once this is done, and
+ * querying them doesn't allocate.
+ */
 class Graph {
  public:
-  const Node& get_node(const DexMethod* method) const;
+  Node get_node(const DexMethod* method) const;
 
-  const ConcurrentMap<const DexMethod*, Node>& nodes() const { return m_nodes; }
+  const std::unordered_map<const DexMethod*, Node>& nodes() const {
+    always_assert(m_finalized);
+    return m_nodes;
+  }
 
   void add_edge(const DexMethod* overridden, const DexMethod* overriding);
 
+  void finalize();
+
   void dump(std::ostream&) const;
 
  private:
-  static Node empty_node;
-  ConcurrentMap<const DexMethod*, Node> m_nodes;
+  struct PendingEdges {
+    std::unordered_set<const DexMethod*> parents;
+    std::unordered_set<const DexMethod*> children;
+  };
+  ConcurrentMap<const DexMethod*, PendingEdges> m_pending_edges;
+  std::vector<const DexMethod*> m_edges;
+  std::unordered_map<const DexMethod*, Node> m_nodes;
+  bool m_finalized{false};
 };
 
 } // namespace method_override_graph
+
+template <>
+struct AnalysisBuilder<method_override_graph::Graph> {
+  static std::shared_ptr<const method_override_graph::Graph> build(
+      const Scope& scope) {
+    return method_override_graph::build_graph(scope);
+  }
+};
@@ -7,10 +7,13 @@
 
 #include "MethodProfiles.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "Show.h"
 #include "Timer.h"
 #include "Trace.h"
 
@@ -18,97 +21,244 @@ using namespace method_profiles;
 
 extern int errno;
 
+namespace method_profiles {
+const std::string COLD_START = "ColdStart";
+} // namespace method_profiles
+
+namespace {
+
 // Methods that appear in less than this percent of traces will be excluded
 constexpr double MINIMUM_APPEAR_PERCENT = 80.0;
 
-bool MethodProfiles::parse_stats_file(const std::string& csv_filename) {
-  TRACE(METH_PROF, 3, "input csv filename: %s", csv_filename.c_str());
-  if (csv_filename == "") {
+// The names of the csv columns, indexed by our column enum.
+const char* const COLUMN_NAMES[NUM_COLUMNS] = {
+    "index",     "name",        "appear100",     "appear#",    "avg_call",
+    "avg_order", "avg_rank100", "min_api_level", "interaction"};
+
+/*
+ * The binary format, little-endian:
+ *
+ *   magic, version, string_count, interaction_count (uint32_t each)
+ *   strings[string_count]: size (uint32_t), then the bytes
+ *   interactions[interaction_count]:
+ *     name string id, row_count (uint32_t each)
+ *     rows[row_count]: method string id (uint32_t), appear_percent,
+ *       call_count, order_percent (double each), min_api_level (uint8_t)
+ *
+ * Method names are stored once however many interactions they appear in.
+ */
+constexpr uint32_t BINARY_MAGIC = 0xfa9e0f11;
+constexpr uint32_t BINARY_VERSION = 1;
+
+// Reads the fields of a binary profile in order, checking its bounds.
+class BinaryReader {
+ public:
+  explicit BinaryReader(boost::string_view contents) : m_rest(contents) {}
+
+  template <typename T>
+  bool read(T* value) {
+    if (m_rest.size() < sizeof(T)) {
+      return false;
+    }
+    memcpy(value, m_rest.data(), sizeof(T));
+    m_rest.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  bool read_string(boost::string_view* str) {
+    uint32_t size;
+    if (!read(&size) || m_rest.size() < size) {
+      return false;
+    }
+    *str = m_rest.substr(0, size);
+    m_rest.remove_prefix(size);
+    return true;
+  }
+
+ private:
+  boost::string_view m_rest;
+};
+
+bool is_binary(boost::string_view contents) {
+  uint32_t magic;
+  return BinaryReader(contents).read(&magic) && magic == BINARY_MAGIC;
+}
+
+} // namespace
+
+bool MethodProfiles::parse_stats_file(const std::string& filename) {
+  TRACE(METH_PROF, 3, "input profile filename: %s", filename.c_str());
+  if (filename == "") {
     TRACE(METH_PROF, 2, "No csv file given");
     return false;
   }
   Timer t("Parsing agg_method_stats_file");
 
-  auto cleanup = [](FILE* fp, char* line = nullptr) {
-    if (fp) {
-      fclose(fp);
-    }
-    if (line) {
-      // getline allocates buffer space and expects us to free it
-      free(line);
-    }
-  };
-
-  // Using C-style file reading and parsing because it's faster than the
-  // iostreams equivalent and we expect to read very large csv files.
-  FILE* fp = fopen(csv_filename.c_str(), "r");
-  if (fp == nullptr) {
-    std::cerr << "FAILED to open " << csv_filename << ": " << strerror(errno)
+  // The file is mapped and split in place, as we expect very large files.
+  text::MappedTextFile file(filename);
+  if (!file.is_open()) {
+    std::cerr << "FAILED to open " << filename << ": " << strerror(errno)
               << "\n";
-    cleanup(fp);
     return false;
   }
 
-  // getline will allocate a buffer and put a pointer to it here
-  char* line = nullptr;
-  size_t len = 0;
-  bool first = true;
-  while (getline(&line, &len, fp) != -1) {
-    bool success = parse_line(line, first);
-    if (!success) {
-      cleanup(fp, line);
+  if (is_binary(file.contents())) {
+    if (!parse_binary(file.contents())) {
+      std::cerr << "FAILED to parse binary method profile " << filename
+                << "\n";
       return false;
     }
-    first = false;
+  } else {
+    text::Tokenizer lines(file.contents());
+    boost::string_view line;
+    bool first = true;
+    while (lines.next_line(&line)) {
+      bool success = parse_line(line, first);
+      if (!success) {
+        return false;
+      }
+      first = false;
+    }
   }
-  if (errno != 0) {
-    std::cerr << "FAILED to read a line: " << strerror(errno) << "\n";
-    cleanup(fp, line);
-    return false;
+
+  for (const auto& pair : m_method_stats) {
+    TRACE(METH_PROF, 1,
+          "MethodProfiles successfully parsed %zu rows for interaction %s",
+          pair.second.size(), pair.first.c_str());
   }
+  return true;
+}
 
-  TRACE(METH_PROF, 1, "MethodProfiles successfully parsed %zu rows",
-        m_method_stats.size());
-  cleanup(fp, line);
+bool MethodProfiles::parse_binary(boost::string_view contents) {
+  BinaryReader reader(contents);
+  uint32_t magic, version, string_count, interaction_count;
+  if (!reader.read(&magic) || !reader.read(&version) ||
+      version != BINARY_VERSION || !reader.read(&string_count) ||
+      !reader.read(&interaction_count)) {
+    return false;
+  }
+  std::vector<boost::string_view> strings(string_count);
+  for (auto& str : strings) {
+    if (!reader.read_string(&str)) {
+      return false;
+    }
+  }
+  // The methods are only resolved once, whichever interactions they are in.
+  std::vector<DexMethodRef*> methods(string_count, nullptr);
+  std::vector<bool> resolved(string_count, false);
+  for (uint32_t i = 0; i < interaction_count; ++i) {
+    uint32_t name_id, row_count;
+    if (!reader.read(&name_id) || name_id >= string_count ||
+        !reader.read(&row_count)) {
+      return false;
+    }
+    auto& stats_map = m_method_stats[strings[name_id].to_string()];
+    stats_map.reserve(row_count);
+    for (uint32_t row = 0; row < row_count; ++row) {
+      uint32_t method_id;
+      Stats stats;
+      if (!reader.read(&method_id) || method_id >= string_count ||
+          !reader.read(&stats.appear_percent) ||
+          !reader.read(&stats.call_count) ||
+          !reader.read(&stats.order_percent) ||
+          !reader.read(&stats.min_api_level)) {
+        return false;
+      }
+      if (!resolved[method_id]) {
+        resolved[method_id] = true;
+        methods[method_id] =
+            DexMethod::get_method(strings[method_id].to_string());
+        if (methods[method_id] == nullptr) {
+          TRACE(METH_PROF, 4, "failed to resolve %s",
+                strings[method_id].to_string().c_str());
+        }
+      }
+      if (methods[method_id] != nullptr) {
+        stats_map.emplace(methods[method_id], stats);
+      }
+    }
+  }
   return true;
 }
 
-bool MethodProfiles::parse_line(char* line, bool first) {
+bool MethodProfiles::write_binary(const std::string& filename) const {
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint32_t> string_ids;
+  auto id_of = [&](const std::string& str) {
+    auto pair = string_ids.emplace(str, strings.size());
+    if (pair.second) {
+      strings.push_back(str);
+    }
+    return pair.first->second;
+  };
+  std::string rows;
+  auto append = [&](const auto& value) {
+    rows.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  for (const auto& interaction : m_method_stats) {
+    append(id_of(interaction.first));
+    append(static_cast<uint32_t>(interaction.second.size()));
+    for (const auto& pair : interaction.second) {
+      const auto& stats = pair.second;
+      append(id_of(show(pair.first)));
+      append(stats.appear_percent);
+      append(stats.call_count);
+      append(stats.order_percent);
+      append(stats.min_api_level);
+    }
+  }
+
+  std::ofstream out(filename, std::ios::binary);
+  auto write_u32 = [&](uint32_t value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write_u32(BINARY_MAGIC);
+  write_u32(BINARY_VERSION);
+  write_u32(strings.size());
+  write_u32(m_method_stats.size());
+  for (const auto& str : strings) {
+    write_u32(str.size());
+    out.write(str.data(), str.size());
+  }
+  out.write(rows.data(), rows.size());
+  return static_cast<bool>(out);
+}
+
+bool MethodProfiles::parse_line(boost::string_view line, bool first) {
   if (first) {
     return parse_header(line);
   }
 
-  auto parse_byte = [](const char* tok) -> uint8_t {
-    char* rest = nullptr;
-    const auto result = static_cast<uint8_t>(strtoul(tok, &rest, 10));
-    const auto len = strlen(rest);
-    always_assert_log(rest != tok, "can't parse %s into a uint8_t", tok);
-    always_assert_log(len == 0 || (len == 1 && rest[0] == '\n'),
-                      "can't parse %s into a uint8_t", tok);
-    return result;
+  auto parse_byte = [](boost::string_view tok) -> uint8_t {
+    uint32_t result;
+    always_assert_log(text::parse_uint32(tok, &result) && result <= UINT8_MAX,
+                      "can't parse %s into a uint8_t", tok.to_string().c_str());
+    return static_cast<uint8_t>(result);
   };
-  auto parse_double = [](const char* tok) -> double {
-    char* rest = nullptr;
-    const auto result = strtod(tok, &rest);
-    const auto len = strlen(rest);
-    always_assert_log(rest != tok, "can't parse %s into a double", tok);
-    always_assert_log(len == 0 || (len == 1 && rest[0] == '\n'),
-                      "can't parse %s into a double", tok);
+  auto parse_double = [](boost::string_view tok) -> double {
+    double result;
+    always_assert_log(text::parse_double(tok, &result),
+                      "can't parse %s into a double", tok.to_string().c_str());
     return result;
   };
 
   Stats stats;
   DexMethodRef* ref = nullptr;
-  auto parse_cell = [&](char* tok, uint32_t i) -> bool {
-    switch (i) {
+  boost::string_view interaction = COLD_START;
+  auto parse_cell = [&](boost::string_view tok, uint32_t i) -> bool {
+    if (i >= m_columns.size()) {
+      std::cerr << "FAILED to parse line. Too many columns\n";
+      return false;
+    }
+    switch (m_columns[i]) {
     case INDEX:
       // Don't need this raw data. It's an arbitrary index (the line number in
       // the file)
       return true;
     case NAME:
-      ref = DexMethod::get_method(tok);
+      ref = DexMethod::get_method(tok.to_string());
       if (ref == nullptr) {
-        TRACE(METH_PROF, 4, "failed to resolve %s", tok);
+        TRACE(METH_PROF, 4, "failed to resolve %s", tok.to_string().c_str());
       }
       return true;
     case APPEAR100:
@@ -131,9 +281,11 @@ bool MethodProfiles::parse_line(char* line, bool first) {
     case MIN_API_LEVEL:
       stats.min_api_level = parse_byte(tok);
       return true;
+    case INTERACTION:
+      interaction = tok;
+      return true;
     default:
-      std::cerr << "FAILED to parse line. Too many columns\n";
-      return false;
+      not_reached();
     }
   };
 
@@ -142,46 +294,37 @@ bool MethodProfiles::parse_line(char* line, bool first) {
     return false;
   }
   if (ref != nullptr && stats.appear_percent >= MINIMUM_APPEAR_PERCENT) {
-    TRACE(METH_PROF, 4, "%s -> {%f, %f, %f, %u}", SHOW(ref),
+    TRACE(METH_PROF, 4, "%s -> {%f, %f, %f, %u} in %s", SHOW(ref),
           stats.appear_percent, stats.call_count, stats.order_percent,
-          stats.min_api_level);
-    m_method_stats.emplace(ref, stats);
+          stats.min_api_level, interaction.to_string().c_str());
+    m_method_stats[interaction.to_string()].emplace(ref, stats);
   }
   return true;
 }
 
-bool MethodProfiles::parse_header(char* line) {
-  auto check_cell = [](const char* expected, const char* tok,
-                       uint32_t i) -> bool {
-    const size_t MAX_CELL_LENGTH = 1000;
-    if (strncmp(tok, expected, MAX_CELL_LENGTH) != 0) {
-      std::cerr << "Unexpected Header (column " << i << "): " << tok
-                << " != " << expected << "\n";
+bool MethodProfiles::parse_header(boost::string_view line) {
+  m_columns.clear();
+  std::vector<bool> seen(NUM_COLUMNS, false);
+  auto parse_cell = [&](boost::string_view tok, uint32_t i) -> bool {
+    auto begin = std::begin(COLUMN_NAMES);
+    auto it = std::find(begin, std::end(COLUMN_NAMES), tok);
+    if (it == std::end(COLUMN_NAMES) || seen[it - begin]) {
+      std::cerr << "Unexpected Header (column " << i << "): " << tok << "\n";
       return false;
     }
+    seen[it - begin] = true;
+    m_columns.push_back(it - begin);
     return true;
   };
-  auto parse_cell = [&](char* tok, uint32_t i) -> bool {
-    switch (i) {
-    case INDEX:
-      return check_cell("index", tok, i);
-    case NAME:
-      return check_cell("name", tok, i);
-    case APPEAR100:
-      return check_cell("appear100", tok, i);
-    case APPEAR_NUMBER:
-      return check_cell("appear#", tok, i);
-    case AVG_CALL:
-      return check_cell("avg_call", tok, i);
-    case AVG_ORDER:
-      return check_cell("avg_order", tok, i);
-    case AVG_RANK100:
-      return check_cell("avg_rank100", tok, i);
-    case MIN_API_LEVEL:
-      return check_cell("min_api_level", tok, i);
-    default:
-      return check_cell("\n", tok, i);
+  if (!parse_cells(line, parse_cell)) {
+    return false;
+  }
+  // Only the interaction column is optional.
+  for (uint32_t column = 0; column < INTERACTION; ++column) {
+    if (!seen[column]) {
+      std::cerr << "Missing Header column: " << COLUMN_NAMES[column] << "\n";
+      return false;
     }
-  };
-  return parse_cells(line, parse_cell);
+  }
+  return true;
 }
@@ -8,10 +8,12 @@
 #pragma once
 
 #include "DexClass.h"
+#include "TextTokenizer.h"
 
 namespace method_profiles {
 
-// These names (and their order) match the columns of the csv
+// The columns of the csv, which may come in any order. INTERACTION is
+// optional.
 enum {
   INDEX,
   NAME,
@@ -21,8 +23,14 @@ enum {
   AVG_ORDER,
   AVG_RANK100,
   MIN_API_LEVEL,
+  INTERACTION,
+  NUM_COLUMNS,
 };
 
+// The interaction (phase of the app's execution) that rows without an
+// interaction column describe.
+extern const std::string COLD_START;
+
 struct Stats {
   // The percentage of samples that this method appeared in
   double appear_percent{0.0}; // appear100
@@ -40,13 +48,25 @@ struct Stats {
   uint8_t min_api_level{0}; // min_api_level
 };
 
+using StatsMap = std::unordered_map<const DexMethodRef*, Stats>;
+// The stats of each interaction, by interaction name.
+using AllInteractions = std::unordered_map<std::string, StatsMap>;
+
+/*
+ * Method profiles, split by interaction: e.g. cold start, first frame or
+ * steady state, each with stats of their own.
+ *
+ * They are read either from a "simple" csv file (no quoted commas or extra
+ * spaces) with a header of column names, or from the binary format that
+ * write_binary() produces, which is much faster to read for large profiles.
+ */
 class MethodProfiles {
  public:
   MethodProfiles() {}
 
-  bool initialize(const std::string& csv_filename) {
+  bool initialize(const std::string& filename) {
     m_initialized = true;
-    bool success = parse_stats_file(csv_filename);
+    bool success = parse_stats_file(filename);
     if (!success) {
       m_method_stats.clear();
     }
@@ -57,37 +77,41 @@ class MethodProfiles {
 
   bool has_stats() const { return !m_method_stats.empty(); }
 
-  const std::unordered_map<const DexMethodRef*, Stats>& method_stats() const {
-    return m_method_stats;
+  // The stats of the given interaction, or empty ones if it wasn't profiled.
+  const StatsMap& method_stats(
+      const std::string& interaction = COLD_START) const {
+    static const StatsMap empty;
+    auto it = m_method_stats.find(interaction);
+    return it == m_method_stats.end() ? empty : it->second;
   }
 
+  const AllInteractions& all_interactions() const { return m_method_stats; }
+
+  // Writes the profiles in the binary format that initialize() reads.
+  bool write_binary(const std::string& filename) const;
+
  private:
-  std::unordered_map<const DexMethodRef*, Stats> m_method_stats;
+  AllInteractions m_method_stats;
   bool m_initialized{false};
-  // Read a "simple" csv file (no quoted commas or extra spaces) and populate
-  // m_method_stats
-  bool parse_stats_file(const std::string& csv_filename);
-  // Read a line fromt the "simple" csv file and put an entry into
-  // m_method_stats
-  bool parse_line(char* line, bool first);
-  // Parse the first line and make sure it matches our expectations
-  bool parse_header(char* line);
+  // The column of each cell of the csv rows, from the header.
+  std::vector<uint32_t> m_columns;
+
+  bool parse_stats_file(const std::string& filename);
+  bool parse_binary(boost::string_view contents);
+  // Read a line from the csv file and put an entry into m_method_stats
+  bool parse_line(boost::string_view line, bool first);
+  // Parse the first line and map its cells to our columns
+  bool parse_header(boost::string_view line);
 
   template <class Func>
-  bool parse_cells(char* line, const Func& parse_cell) {
-    char* save_ptr = nullptr;
-    char* tok = line;
+  bool parse_cells(boost::string_view line, const Func& parse_cell) {
     uint32_t i = 0;
-    // Assuming there are no quoted strings containing commas!
-    while ((tok = strtok_r(tok, ",", &save_ptr)) != nullptr) {
-      bool success = parse_cell(tok, i);
-      if (!success) {
-        return false;
-      }
-      tok = nullptr;
-      ++i;
-    }
-    return true;
+    // Assuming there are no quoted strings containing commas! Like strtok,
+    // this skips empty cells.
+    return text::for_each_field(
+        line, ',', [&](boost::string_view tok, uint32_t) {
+          return tok.empty() || parse_cell(tok, i++);
+        });
   }
 };
 
@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 
+#include "AnalysisRegistry.h"
 #include "ConfigFiles.h"
 #include "Configurable.h"
 #include "DexStore.h"
@@ -48,6 +49,34 @@ class Pass : public Configurable {
                         ConfigFiles& conf,
                         PassManager& mgr) = 0;
 
+  /**
+   * A CFG-friendly pass only reads and changes code through editable CFGs,
+   * i.e. between IRCode::build_cfg() and IRCode::clear_cfg() or with the
+   * editable_cfg_adapter, and never through the IRList of a method. With
+   * `keep_cfgs_between_passes`, consecutive CFG-friendly passes share the
+   * CFGs of all methods instead of building and linearizing them every time.
+   */
+  virtual bool is_cfg_friendly() const { return false; }
+
+  /**
+   * An analysis-only pass reads the dex stores but never changes them, e.g. to
+   * check invariants or to write reports. With `parallel_analysis_passes`,
+   * consecutive analysis-only passes run concurrently with one another, so
+   * any state they share besides the dex stores and the PassManager's metrics
+   * must be thread-safe.
+   */
+  virtual bool is_analysis_only() const { return false; }
+
+  /**
+   * The analyses cached by the PassManager (see PassManager::get_analysis())
+   * that are still valid after this pass. All others are recomputed on their
+   * next request.
+   */
+  virtual PreservedAnalyses get_preserved_analyses() const {
+    return is_analysis_only() ? PreservedAnalyses::all()
+                              : PreservedAnalyses::none();
+  }
+
  private:
   std::string m_name;
 };
@@ -8,9 +8,17 @@
 #include "PassManager.h"
 
 #include <boost/filesystem.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
+#include <map>
+#include <mutex>
 #include <unordered_set>
 
+#ifndef _MSC_VER
+#include <sys/resource.h>
+#endif
+
 #include "ApiLevelChecker.h"
 #include "ApkManager.h"
 #include "CommandProfiling.h"
@@ -30,7 +38,10 @@
 #include "ProguardPrintConfiguration.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
 #include "Sanitizers.h"
+#include "SpartaThreadPool.h"
+#include "Thread.h"
 #include "Timer.h"
 #include "Walkers.h"
 
@@ -40,6 +51,9 @@ const std::string PASS_ORDER_KEY = "pass_order";
 
 constexpr const char* CFG_DUMP_BASE_NAME = "redex-cfg-dumps.cfg";
 
+// Set on the threads running analysis-only passes concurrently.
+thread_local PassManager::PassInfo* t_concurrent_pass_info = nullptr;
+
 std::string get_apk_dir(const Json::Value& config) {
   auto apkdir = config["apk_dir"].asString();
   apkdir.erase(std::remove(apkdir.begin(), apkdir.end(), '"'), apkdir.end());
@@ -47,13 +61,36 @@ std::string get_apk_dir(const Json::Value& config) {
 }
 
 // TODO(fengliu): Kill the `validate_access` flag.
+/*
+ * Type checks the code of the methods of `scope`, or only the ones that were
+ * modified after `checked_epoch` if it is set. The workers stop picking up
+ * methods as soon as one of them fails; all the failures found by then are
+ * reported, in order, before exiting.
+ */
 void run_verifier(const Scope& scope,
                   bool verify_moves,
                   bool check_no_overwrite_this,
-                  bool validate_access) {
+                  bool validate_access,
+                  boost::optional<size_t> checked_epoch = boost::none) {
   TRACE(PM, 1, "Running IRTypeChecker...");
   Timer t("IRTypeChecker");
-  walk::parallel::methods(scope, [=](DexMethod* dex_method) {
+  std::atomic<bool> failed{false};
+  std::atomic<size_t> num_skipped{0};
+  std::mutex failures_lock;
+  std::map<std::string, std::string> failures;
+  walk::parallel::methods(scope, [&](DexMethod* dex_method) {
+    if (failed.load(std::memory_order_relaxed)) {
+      return;
+    }
+    const IRCode* code = dex_method->get_code();
+    if (code == nullptr) {
+      return;
+    }
+    auto modified_epoch = code->modified_epoch();
+    if (checked_epoch && modified_epoch <= *checked_epoch) {
+      num_skipped++;
+      return;
+    }
     IRTypeChecker checker(dex_method, validate_access);
     if (verify_moves) {
       checker.verify_moves();
@@ -62,16 +99,100 @@ void run_verifier(const Scope& scope,
       checker.check_no_overwrite_this();
     }
     checker.run();
+    // Checking the code doesn't modify it.
+    dex_method->get_code()->set_modified_epoch(modified_epoch);
     if (checker.fail()) {
-      std::string msg = checker.what();
-      fprintf(stderr, "ABORT! Inconsistency found in Dex code for %s.\n %s\n",
-              SHOW(dex_method), msg.c_str());
-      fprintf(stderr, "Code:\n%s\n", SHOW(dex_method->get_code()));
-      exit(EXIT_FAILURE);
+      failed = true;
+      std::lock_guard<std::mutex> lock(failures_lock);
+      failures.emplace(show(dex_method),
+                       checker.what() + "\nCode:\n" + show(code));
     }
   });
+  if (!failures.empty()) {
+    for (const auto& pair : failures) {
+      fprintf(stderr, "ABORT! Inconsistency found in Dex code for %s.\n %s\n",
+              pair.first.c_str(), pair.second.c_str());
+    }
+    exit(EXIT_FAILURE);
+  }
+  TRACE(PM, 2, "IRTypeChecker skipped %zu unmodified methods",
+        num_skipped.load());
 }
 
+/*
+ * Measures the resources used between its construction and the call to
+ * finish().
+ */
+class PassPerfRecorder {
+ public:
+  PassPerfRecorder(PassManager::PassPerf* perf, bool heap_stats)
+      : m_perf(perf),
+        m_heap_stats(heap_stats),
+        m_start(std::chrono::steady_clock::now()),
+        m_start_rss(get_mem_stats().vm_rss),
+        m_start_allocated(jemalloc_util::get_allocated_bytes()) {
+    get_cpu_times(&m_start_user_s, &m_start_sys_s);
+    if (m_heap_stats) {
+      m_perf->heap_before = get_heap_stats();
+    }
+  }
+
+  void finish() {
+    auto wall_s = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - m_start)
+                      .count();
+    double user_s, sys_s;
+    get_cpu_times(&user_s, &sys_s);
+    auto mem_stats = get_mem_stats();
+    m_perf->wall_s = wall_s;
+    m_perf->user_cpu_s = user_s - m_start_user_s;
+    m_perf->sys_cpu_s = sys_s - m_start_sys_s;
+    if (wall_s > 0) {
+      m_perf->parallel_efficiency =
+          (m_perf->user_cpu_s + m_perf->sys_cpu_s) /
+          (wall_s * redex_parallel::default_num_threads());
+    }
+    m_perf->rss_delta = int64_t(mem_stats.vm_rss) - int64_t(m_start_rss);
+    m_perf->peak_rss = mem_stats.vm_hwm;
+    m_perf->jemalloc_allocated_delta =
+        int64_t(jemalloc_util::get_allocated_bytes()) -
+        int64_t(m_start_allocated);
+    if (m_heap_stats) {
+      m_perf->heap_after = get_heap_stats();
+    }
+  }
+
+ private:
+  // User and system CPU time of all threads of the process.
+  static void get_cpu_times(double* user_s, double* sys_s) {
+#ifndef _MSC_VER
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      *user_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+      *sys_s = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+      return;
+    }
+#endif
+    *user_s = *sys_s = 0;
+  }
+
+  static boost::optional<jemalloc_util::HeapStats> get_heap_stats() {
+    jemalloc_util::HeapStats stats;
+    if (!jemalloc_util::get_heap_stats(&stats)) {
+      return boost::none;
+    }
+    return stats;
+  }
+
+  PassManager::PassPerf* m_perf;
+  bool m_heap_stats;
+  std::chrono::steady_clock::time_point m_start;
+  uint64_t m_start_rss;
+  size_t m_start_allocated;
+  double m_start_user_s;
+  double m_start_sys_s;
+};
+
 } // namespace
 
 std::unique_ptr<keep_rules::ProguardConfiguration> empty_pg_config() {
@@ -148,6 +269,59 @@ void PassManager::init(const Json::Value& config) {
   }
 }
 
+void PassManager::compact_code(DexStoresVector& stores,
+                               boost::optional<size_t> modified_before) {
+  // Only register-allocated code can be synced losslessly.
+  if (!regalloc_has_run()) {
+    TRACE(PM, 1, "Not compacting code, as registers are not allocated yet");
+    return;
+  }
+  Timer t("Compacting code");
+  walk::parallel::methods(build_class_scope(stores), [&](DexMethod* m) {
+    if (m->is_balloon_pending() || m->get_code() == nullptr) {
+      return;
+    }
+    if (modified_before &&
+        m->get_code()->modified_epoch() >= *modified_before) {
+      return;
+    }
+    instruction_lowering::lower(m);
+    m->sync();
+    m->balloon_lazily();
+  });
+}
+
+void PassManager::retain_cfgs(DexStoresVector& stores) {
+  Timer t("Building retained CFGs");
+  walk::parallel::methods(build_class_scope(stores), [](DexMethod* m) {
+    // Code that isn't ballooned yet gets its CFG when a pass asks for it.
+    if (m->is_balloon_pending() || m->get_code() == nullptr) {
+      return;
+    }
+    m->get_code()->retain_cfg();
+  });
+}
+
+void PassManager::release_cfgs(DexStoresVector& stores) {
+  Timer t("Linearizing retained CFGs");
+  walk::parallel::methods(build_class_scope(stores), [](DexMethod* m) {
+    if (m->is_balloon_pending() || m->get_code() == nullptr) {
+      return;
+    }
+    m->get_code()->release_cfg();
+  });
+}
+
+const InstructionIndex& PassManager::get_instruction_index(
+    const DexStoresVector& stores) {
+  if (m_instruction_index == nullptr) {
+    Timer t("Building instruction index");
+    m_instruction_index =
+        std::make_unique<InstructionIndex>(build_class_scope(stores));
+  }
+  return *m_instruction_index;
+}
+
 hashing::DexHash PassManager::run_hasher(const char* pass_name,
                                          const Scope& scope) {
   TRACE(PM, 2, "Running hasher...");
@@ -172,6 +346,27 @@ hashing::DexHash PassManager::run_hasher(const char* pass_name,
   return hash;
 }
 
+void PassManager::record_ir_delta(const Scope& scope,
+                                  scope_delta::Snapshot* snapshot) {
+  Timer t("IR delta");
+  auto after = scope_delta::take_snapshot(scope, snapshot);
+  auto delta = scope_delta::diff(*snapshot, after);
+  set_metric("~ir~methods~changed~", delta.methods_changed);
+  set_metric("~ir~methods~added~", delta.methods_added);
+  set_metric("~ir~methods~removed~", delta.methods_removed);
+  set_metric("~ir~classes~removed~", delta.classes_removed);
+  set_metric("~ir~instructions~added~", delta.instructions_added);
+  set_metric("~ir~instructions~removed~", delta.instructions_removed);
+  set_metric("~ir~registers~", delta.registers);
+  TRACE(PM, 2,
+        "[ir delta] %zu methods changed, %zu added, %zu removed; %zu classes "
+        "removed; %zu instructions added, %zu removed",
+        delta.methods_changed, delta.methods_added, delta.methods_removed,
+        delta.classes_removed, delta.instructions_added,
+        delta.instructions_removed);
+  *snapshot = std::move(after);
+}
+
 void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   DexStoreClassesIterator it(stores);
   Scope scope = build_class_scope(it);
@@ -244,12 +439,48 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   bool verify_moves = type_checker_args.get("verify_moves", true).asBool();
   bool check_no_overwrite_this =
       type_checker_args.get("check_no_overwrite_this", false).asBool();
+  // Only check the methods modified since the previous check after a pass.
+  bool check_only_modified_methods =
+      type_checker_args.get("only_modified_methods", false).asBool();
+  boost::optional<size_t> checked_epoch;
   std::unordered_set<std::string> type_checker_trigger_passes;
 
   for (auto& trigger_pass : type_checker_args["run_after_passes"]) {
     type_checker_trigger_passes.insert(trigger_pass.asString());
   }
 
+  // Passes after which the IR of all methods is turned back into its dex
+  // encoding; only the methods that later passes touch get ballooned again.
+  std::unordered_set<std::string> compact_code_after_passes;
+  for (auto& pass_name : conf.get_json_config()["compact_code_after_passes"]) {
+    compact_code_after_passes.insert(pass_name.asString());
+  }
+
+  // Runs of CFG-friendly passes share the CFGs of all methods, which are only
+  // linearized before a pass that works on IRLists, or whenever the hasher,
+  // the type checker or the code compaction need the IRLists between passes.
+  bool keep_cfgs_between_passes =
+      conf.get_json_config().get("keep_cfgs_between_passes", false);
+  bool cfgs_retained = false;
+
+  // Per-pass metrics of the methods and instructions a pass changed.
+  bool ir_delta_stats = conf.get_json_config().get("ir_delta_stats", false);
+  scope_delta::Snapshot ir_snapshot;
+  if (ir_delta_stats) {
+    Timer t("IR snapshot");
+    ir_snapshot = scope_delta::take_snapshot(scope, nullptr);
+  }
+
+  // The size of the app after each pass, attributing the changes in output
+  // size to the passes.
+  bool size_stats_per_pass =
+      conf.get_json_config().get("size_stats_per_pass", false);
+  size_stats::Tracker size_tracker;
+  if (size_stats_per_pass) {
+    Timer t("Size stats");
+    m_initial_size = size_tracker.sample(scope);
+  }
+
   if (run_hasher_after_each_pass) {
     m_initial_hash =
         boost::optional<hashing::DexHash>(this->run_hasher(nullptr, scope));
@@ -266,35 +497,142 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
 
   sanitizers::lsan_do_recoverable_leak_check();
 
+  // Runs of consecutive analysis-only passes may run concurrently, as none of
+  // them changes the IR the others read. The checks that follow each pass are
+  // then done in order once the whole run is over.
+  bool parallel_analysis_passes =
+      conf.get_json_config().get("parallel_analysis_passes", false);
+
+  // When the RSS gets close to the memory budget after a pass, the memory
+  // held by the IR is given back where it can be rebuilt on demand: retained
+  // CFGs and cached analyses are dropped, and the code that the last few
+  // passes didn't modify is compacted.
+  size_t memory_budget_mb = 0;
+  conf.get_json_config().get("memory_budget_mb", 0, memory_budget_mb);
+  size_t memory_budget_hot_passes = 2;
+  conf.get_json_config().get("memory_budget_hot_passes", 2,
+                             memory_budget_hot_passes);
+  uint64_t memory_budget_threshold = uint64_t(memory_budget_mb) * 1024 * 1024 /
+                                     10 * 9;
+
+  // Snapshots of the jemalloc heap before and after each pass, for the pass
+  // perf stats.
+  m_jemalloc_stats_per_pass =
+      conf.get_json_config().get("jemalloc_stats_per_pass", false);
+  const auto can_run_concurrently = [&](const Pass* pass) {
+    return pass->is_analysis_only() &&
+           !(m_profiler_info && m_profiler_info->pass == pass) &&
+           m_malloc_profile_pass != pass;
+  };
+  size_t concurrent_run_end = 0;
+
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
     Pass* pass = m_activated_passes[i];
-    TRACE(PM, 1, "Running %s...", pass->name().c_str());
-    Timer t(pass->name() + " (run)");
+    bool ran_concurrently = i < concurrent_run_end;
+    if (!ran_concurrently && parallel_analysis_passes &&
+        can_run_concurrently(pass)) {
+      size_t end = i + 1;
+      while (end < m_activated_passes.size() &&
+             can_run_concurrently(m_activated_passes[end])) {
+        ++end;
+      }
+      if (end - i > 1) {
+        if (cfgs_retained) {
+          release_cfgs(stores);
+          cfgs_retained = false;
+        }
+        run_analysis_passes(stores, conf, i, end);
+        concurrent_run_end = end;
+        ran_concurrently = true;
+      }
+    }
+    Timer t(pass->name() + (ran_concurrently ? " (checks)" : " (run)"));
     m_current_pass_info = &m_pass_info[i];
+    if (!ran_concurrently) {
+      TRACE(PM, 1, "Running %s...", pass->name().c_str());
+      IRCode::advance_epoch();
+      m_current_pass_info->epoch = IRCode::current_epoch();
+
+      bool keep_cfgs = keep_cfgs_between_passes && pass->is_cfg_friendly();
+      if (keep_cfgs && !cfgs_retained) {
+        retain_cfgs(stores);
+        cfgs_retained = true;
+      } else if (!keep_cfgs && cfgs_retained) {
+        release_cfgs(stores);
+        cfgs_retained = false;
+      }
 
-    {
       bool run_profiler = m_profiler_info && m_profiler_info->pass == pass;
       ScopedCommandProfiling cmd_prof(
           run_profiler ? boost::make_optional(m_profiler_info->command)
                        : boost::none,
           run_profiler ? m_profiler_info->post_cmd : boost::none);
       jemalloc_util::ScopedProfiling malloc_prof(m_malloc_profile_pass == pass);
+      PassPerfRecorder perf(&m_current_pass_info->perf,
+                            m_jemalloc_stats_per_pass);
+      const auto& resolver_cache = g_redex->resolver_cache();
+      auto resolver_hits = resolver_cache.hits();
+      auto resolver_misses = resolver_cache.misses();
       pass->run_pass(stores, conf, *this);
+      perf.finish();
+      set_metric("~resolver~cache~hits~",
+                 resolver_cache.hits() - resolver_hits);
+      set_metric("~resolver~cache~misses~",
+                 resolver_cache.misses() - resolver_misses);
+      m_analyses.invalidate(pass->get_preserved_analyses());
     }
+    invalidate_instruction_index();
     sanitizers::lsan_do_recoverable_leak_check();
-    walk::parallel::code(build_class_scope(stores), [](DexMethod* m,
-                                                       IRCode& code) {
+    walk::parallel::methods(build_class_scope(stores), [](DexMethod* m) {
+      // Code that's still waiting to be ballooned can't have a cfg, and
+      // checking it shouldn't balloon it.
+      if (m->is_balloon_pending() || m->get_code() == nullptr) {
+        return;
+      }
       // Ensure that pass authors deconstructed the editable CFG at the end of
       // their pass. Currently, passes assume the incoming code will be in
       // IRCode form
-      always_assert_log(!code.editable_cfg_built(), "%s has a cfg!", SHOW(m));
+      always_assert_log(!m->get_code()->editable_cfg_built() ||
+                            m->get_code()->cfg_retained(),
+                        "%s has a cfg!", SHOW(m));
     });
-
-    class_cfgs.add_pass(pass->name(), VISUALIZER_PASS_OPTIONS);
-
+    bool compact = compact_code_after_passes.count(pass->name()) > 0;
     bool run_hasher = run_hasher_after_each_pass;
     bool run_type_checker = run_type_checker_after_each_pass ||
                             type_checker_trigger_passes.count(pass->name()) > 0;
+    if (cfgs_retained && (compact || run_hasher || run_type_checker ||
+                          ir_delta_stats || size_stats_per_pass)) {
+      release_cfgs(stores);
+      cfgs_retained = false;
+    }
+    // Before the compaction, which would hide the changes of the pass.
+    if (ir_delta_stats) {
+      record_ir_delta(build_class_scope(it), &ir_snapshot);
+    }
+    if (size_stats_per_pass) {
+      Timer t("Size stats");
+      m_current_pass_info->size = size_tracker.sample(build_class_scope(it));
+    }
+    if (compact) {
+      compact_code(stores);
+    } else if (memory_budget_threshold != 0 &&
+               get_mem_stats().vm_rss >= memory_budget_threshold) {
+      TRACE(PM, 1, "RSS is close to the memory budget of %zu MB after %s",
+            memory_budget_mb, pass->name().c_str());
+      if (cfgs_retained) {
+        release_cfgs(stores);
+        cfgs_retained = false;
+      }
+      m_analyses.invalidate(PreservedAnalyses::none());
+      invalidate_instruction_index();
+      auto epoch = IRCode::current_epoch();
+      if (epoch > memory_budget_hot_passes) {
+        compact_code(stores, epoch - memory_budget_hot_passes + 1);
+      }
+      jemalloc_util::purge_arenas();
+    }
+
+    class_cfgs.add_pass(pass->name(), VISUALIZER_PASS_OPTIONS);
 
     if (run_hasher || run_type_checker) {
       scope = build_class_scope(it);
@@ -307,11 +645,17 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
         // output phase -- the register allocator can fix it up later.
         run_verifier(scope, verify_moves,
                      /* check_no_overwrite_this */ false,
-                     /* validate_access */ false);
+                     /* validate_access */ false, checked_epoch);
+        if (check_only_modified_methods) {
+          checked_epoch = IRCode::current_epoch();
+        }
       }
     }
     m_current_pass_info = nullptr;
   }
+  if (cfgs_retained) {
+    release_cfgs(stores);
+  }
 
   // Always run the type checker before generating the optimized dex code.
   scope = build_class_scope(it);
@@ -360,18 +704,61 @@ Pass* PassManager::find_pass(const std::string& pass_name) const {
   return pass_it != m_activated_passes.end() ? *pass_it : nullptr;
 }
 
+PassManager::PassInfo* PassManager::current_pass_info() const {
+  return t_concurrent_pass_info != nullptr ? t_concurrent_pass_info
+                                           : m_current_pass_info;
+}
+
+void PassManager::run_analysis_passes(DexStoresVector& stores,
+                                      ConfigFiles& conf,
+                                      size_t begin,
+                                      size_t end) {
+  Timer t("Analysis passes (run)");
+  // None of the passes changes the code, so they all share one epoch.
+  IRCode::advance_epoch();
+  for (size_t i = begin; i < end; ++i) {
+    m_pass_info[i].epoch = IRCode::current_epoch();
+  }
+  sparta::parallel::ThreadPool::get().run(end - begin, [&](size_t k) {
+    Pass* pass = m_activated_passes[begin + k];
+    TRACE(PM, 1, "Running %s concurrently...", pass->name().c_str());
+    Timer pass_timer(pass->name() + " (run)");
+    t_concurrent_pass_info = &m_pass_info[begin + k];
+    // The CPU and memory usage is that of the whole process, and thus also
+    // accounts for the passes running alongside.
+    PassPerfRecorder perf(&t_concurrent_pass_info->perf,
+                          m_jemalloc_stats_per_pass);
+    pass->run_pass(stores, conf, *this);
+    perf.finish();
+    t_concurrent_pass_info = nullptr;
+  });
+}
+
+boost::optional<size_t> PassManager::get_previous_run_epoch() const {
+  const PassInfo* current = current_pass_info();
+  always_assert(current != nullptr);
+  for (auto it = m_pass_info.rbegin(); it != m_pass_info.rend(); ++it) {
+    if (&*it < current && it->pass == current->pass && it->epoch) {
+      return it->epoch;
+    }
+  }
+  return boost::none;
+}
+
 void PassManager::incr_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] += value;
+  PassInfo* current = current_pass_info();
+  always_assert_log(current != nullptr, "No current pass!");
+  (current->metrics)[key] += value;
 }
 
 void PassManager::set_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] = value;
+  PassInfo* current = current_pass_info();
+  always_assert_log(current != nullptr, "No current pass!");
+  (current->metrics)[key] = value;
 }
 
 int PassManager::get_metric(const std::string& key) {
-  return (m_current_pass_info->metrics)[key];
+  return (current_pass_info()->metrics)[key];
 }
 
 const std::vector<PassManager::PassInfo>& PassManager::get_pass_info() const {
@@ -7,14 +7,20 @@
 
 #pragma once
 
+#include "AnalysisRegistry.h"
 #include "ApkManager.h"
 #include "DexHasher.h"
+#include "InstructionIndex.h"
+#include "JemallocUtil.h"
 #include "Pass.h"
 #include "ProguardConfiguration.h"
 #include "RedexOptions.h"
+#include "ScopeDelta.h"
+#include "SizeStats.h"
 
 #include <boost/optional.hpp>
 #include <json/json.h>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -31,6 +37,24 @@ class PassManager {
               const Json::Value& config = Json::Value(Json::objectValue),
               const RedexOptions& options = RedexOptions{});
 
+  // Resources consumed by a pass's run_pass(), so that regressions can be
+  // tracked across builds.
+  struct PassPerf {
+    double wall_s{0};
+    double user_cpu_s{0};
+    double sys_cpu_s{0};
+    // CPU time over the wall time of all worker threads; 1 means every thread
+    // was busy for the whole pass.
+    double parallel_efficiency{0};
+    int64_t rss_delta{0};
+    uint64_t peak_rss{0};
+    // Zero unless we are running on top of jemalloc.
+    int64_t jemalloc_allocated_delta{0};
+    // Only collected with jemalloc_stats_per_pass.
+    boost::optional<jemalloc_util::HeapStats> heap_before;
+    boost::optional<jemalloc_util::HeapStats> heap_after;
+  };
+
   struct PassInfo {
     const Pass* pass;
     size_t order; // zero-based
@@ -40,6 +64,11 @@ class PassManager {
     std::unordered_map<std::string, int> metrics;
     JsonWrapper config;
     boost::optional<hashing::DexHash> hash;
+    PassPerf perf;
+    // The IRCode modification epoch the pass ran in.
+    boost::optional<size_t> epoch;
+    // The size of the app after the pass, with "size_stats_per_pass".
+    boost::optional<size_stats::Sample> size;
   };
 
   void run_passes(DexStoresVector&, ConfigFiles&);
@@ -50,6 +79,10 @@ class PassManager {
   boost::optional<hashing::DexHash> get_initial_hash() const {
     return m_initial_hash;
   }
+  // The size of the app before the first pass, with "size_stats_per_pass".
+  boost::optional<size_stats::Sample> get_initial_size() const {
+    return m_initial_size;
+  }
   const RedexOptions& get_redex_options() const { return m_redex_options; }
 
   // A temporary hack to return the interdex metrics. Will be removed later.
@@ -67,7 +100,16 @@ class PassManager {
   // do not use ProGuard configuration keep rules.
   void set_testing_mode() { m_testing_mode = true; }
 
-  const PassInfo* get_current_pass_info() const { return m_current_pass_info; }
+  const PassInfo* get_current_pass_info() const {
+    return current_pass_info();
+  }
+
+  /*
+   * The IRCode modification epoch of the previous run of the current pass, if
+   * any. Only the methods whose IRCode::modified_epoch() is later may have
+   * changed since that run.
+   */
+  boost::optional<size_t> get_previous_run_epoch() const;
 
   ApkManager& apk_manager() { return m_apk_mgr; }
 
@@ -75,15 +117,58 @@ class PassManager {
 
   bool regalloc_has_run() { return m_regalloc_has_run; }
 
+  /*
+   * The InstructionIndex of the code of `stores`, shared by the queries of
+   * the current pass. It is built on first use and dropped at the end of the
+   * pass.
+   */
+  const InstructionIndex& get_instruction_index(const DexStoresVector& stores);
+
+  // To be called by passes once they change the indexed instructions.
+  void invalidate_instruction_index() { m_instruction_index.reset(); }
+
+  /*
+   * The whole-program analysis of type `Analysis` of `stores`, as cached
+   * across passes; it is only recomputed after a pass that doesn't preserve
+   * it (see Pass::get_preserved_analyses()).
+   */
+  template <typename Analysis>
+  std::shared_ptr<const Analysis> get_analysis(const DexStoresVector& stores) {
+    return m_analyses.get<Analysis>(stores);
+  }
+
  private:
   void activate_pass(const char* name, const Json::Value& cfg);
 
   Pass* find_pass(const std::string& pass_name) const;
 
+  // The info of the pass running on the calling thread, which differs from
+  // m_current_pass_info while analysis-only passes run concurrently.
+  PassInfo* current_pass_info() const;
+
+  // Runs the analysis-only passes [begin, end) concurrently.
+  void run_analysis_passes(DexStoresVector& stores,
+                           ConfigFiles& conf,
+                           size_t begin,
+                           size_t end);
+
   void init(const Json::Value& config);
 
   hashing::DexHash run_hasher(const char* name, const Scope& scope);
 
+  // Sets the ~ir~ metrics of the current pass from the changes since
+  // `snapshot`, which is then updated.
+  void record_ir_delta(const Scope& scope, scope_delta::Snapshot* snapshot);
+
+  // Syncs all ballooned code back to DexCode, to be ballooned again lazily.
+  // Only the code last modified before `modified_before`, if given.
+  void compact_code(DexStoresVector& stores,
+                    boost::optional<size_t> modified_before = boost::none);
+
+  // Keeps (or stops keeping) the editable CFGs of all methods across passes.
+  void retain_cfgs(DexStoresVector& stores);
+  void release_cfgs(DexStoresVector& stores);
+
   ApkManager m_apk_mgr;
   std::vector<Pass*> m_registered_passes;
   std::vector<Pass*> m_activated_passes;
@@ -96,6 +181,8 @@ class PassManager {
   const RedexOptions m_redex_options;
   bool m_testing_mode{false};
   bool m_regalloc_has_run{false};
+  std::unique_ptr<InstructionIndex> m_instruction_index;
+  AnalysisRegistry m_analyses;
 
   struct ProfilerInfo {
     std::string command;
@@ -109,5 +196,7 @@ class PassManager {
 
   boost::optional<ProfilerInfo> m_profiler_info;
   Pass* m_malloc_profile_pass{nullptr};
+  bool m_jemalloc_stats_per_pass{false};
   boost::optional<hashing::DexHash> m_initial_hash;
+  boost::optional<size_stats::Sample> m_initial_size;
 };
@@ -0,0 +1,819 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointsToSolver.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Resolver.h"
+#include "Trace.h"
+#include "TypeUtil.h"
+#include "WorkQueue.h"
+
+namespace points_to {
+
+namespace {
+
+constexpr uint32_t kUnvisited = std::numeric_limits<uint32_t>::max();
+
+const DexFieldRef* normalize_field(const DexFieldRef* field,
+                                   FieldSearch search) {
+  auto* def = resolve_field(field, search);
+  return def != nullptr ? def : field;
+}
+
+// Whether an instance of `type` may be cast to `base_type`. We have to be
+// conservative when part of the hierarchy is unknown.
+bool may_be_cast_to(const DexType* type, const DexType* base_type) {
+  if (type == base_type) {
+    return true;
+  }
+  if (type == type::java_lang_Object()) {
+    return false;
+  }
+  auto* cls = type_class(type);
+  if (cls == nullptr) {
+    return true;
+  }
+  auto* super_cls = cls->get_super_class();
+  if (super_cls != nullptr && may_be_cast_to(super_cls, base_type)) {
+    return true;
+  }
+  for (auto* intf : cls->get_interfaces()->get_type_list()) {
+    if (may_be_cast_to(intf, base_type)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// When the method can't be resolved, we fall back to the method reference
+// itself, which may have a stub.
+const DexMethodRef* resolve_virtual_call(const DexType* type,
+                                         DexMethodRef* method) {
+  auto* cls = type_class(type);
+  if (cls != nullptr) {
+    auto* def = resolve_method(
+        cls, method->get_name(), method->get_proto(), MethodSearch::Virtual);
+    if (def != nullptr) {
+      return def;
+    }
+  }
+  return method;
+}
+
+} // namespace
+
+size_t SparseBitSet::size() const {
+  size_t size = 0;
+  for (const auto& word : m_words) {
+    size += __builtin_popcountll(word.second);
+  }
+  return size;
+}
+
+bool SparseBitSet::contains(uint32_t element) const {
+  uint32_t idx = element / 64;
+  auto it = std::lower_bound(
+      m_words.begin(), m_words.end(), idx,
+      [](const std::pair<uint32_t, uint64_t>& word, uint32_t i) {
+        return word.first < i;
+      });
+  return it != m_words.end() && it->first == idx &&
+         (it->second & (1ULL << (element % 64))) != 0;
+}
+
+bool SparseBitSet::insert(uint32_t element) {
+  uint32_t idx = element / 64;
+  uint64_t bit = 1ULL << (element % 64);
+  auto it = std::lower_bound(
+      m_words.begin(), m_words.end(), idx,
+      [](const std::pair<uint32_t, uint64_t>& word, uint32_t i) {
+        return word.first < i;
+      });
+  if (it == m_words.end() || it->first != idx) {
+    m_words.emplace(it, idx, bit);
+    return true;
+  }
+  if ((it->second & bit) != 0) {
+    return false;
+  }
+  it->second |= bit;
+  return true;
+}
+
+bool SparseBitSet::union_with(const SparseBitSet& other, SparseBitSet* added) {
+  std::vector<std::pair<uint32_t, uint64_t>> words;
+  std::vector<std::pair<uint32_t, uint64_t>> fresh;
+  words.reserve(std::max(m_words.size(), other.m_words.size()));
+  auto it = m_words.begin();
+  auto other_it = other.m_words.begin();
+  while (it != m_words.end() || other_it != other.m_words.end()) {
+    if (other_it == other.m_words.end() ||
+        (it != m_words.end() && it->first < other_it->first)) {
+      words.push_back(*it++);
+    } else if (it == m_words.end() || other_it->first < it->first) {
+      fresh.push_back(*other_it);
+      words.push_back(*other_it++);
+    } else {
+      auto new_bits = other_it->second & ~it->second;
+      if (new_bits != 0) {
+        fresh.emplace_back(it->first, new_bits);
+      }
+      words.emplace_back(it->first, it->second | other_it->second);
+      ++it;
+      ++other_it;
+    }
+  }
+  if (fresh.empty()) {
+    return false;
+  }
+  m_words = std::move(words);
+  if (added != nullptr) {
+    SparseBitSet fresh_set;
+    fresh_set.m_words = std::move(fresh);
+    added->union_with(fresh_set);
+  }
+  return true;
+}
+
+void SparseBitSet::intersection_with(const SparseBitSet& other) {
+  std::vector<std::pair<uint32_t, uint64_t>> words;
+  auto other_it = other.m_words.begin();
+  for (const auto& word : m_words) {
+    while (other_it != other.m_words.end() && other_it->first < word.first) {
+      ++other_it;
+    }
+    if (other_it == other.m_words.end()) {
+      break;
+    }
+    if (other_it->first == word.first) {
+      auto bits = word.second & other_it->second;
+      if (bits != 0) {
+        words.emplace_back(word.first, bits);
+      }
+    }
+  }
+  m_words = std::move(words);
+}
+
+SparseBitSet SparseBitSet::difference(const SparseBitSet& other) const {
+  SparseBitSet result;
+  auto other_it = other.m_words.begin();
+  for (const auto& word : m_words) {
+    while (other_it != other.m_words.end() && other_it->first < word.first) {
+      ++other_it;
+    }
+    auto bits = word.second;
+    if (other_it != other.m_words.end() && other_it->first == word.first) {
+      bits &= ~other_it->second;
+    }
+    if (bits != 0) {
+      result.m_words.emplace_back(word.first, bits);
+    }
+  }
+  return result;
+}
+
+const DexType* AbstractObject::dynamic_type() const {
+  switch (kind) {
+  case PTS_OBJECT_STRING:
+    return type::java_lang_String();
+  case PTS_OBJECT_CLASS:
+    return type::java_lang_Class();
+  case PTS_OBJECT_ALLOCATION:
+  case PTS_OBJECT_EXCEPTION:
+    return type;
+  }
+  not_reached();
+}
+
+PointsToSolver::PointsToSolver(PointsToSemantics* semantics,
+                               const Config& config)
+    : m_semantics(semantics), m_config(config) {
+  // We number the nodes and objects in a deterministic order.
+  std::vector<const PointsToMethodSemantics*> methods;
+  for (const auto& entry : *m_semantics) {
+    methods.push_back(&entry.second);
+  }
+  std::sort(methods.begin(), methods.end(),
+            [](const PointsToMethodSemantics* a,
+               const PointsToMethodSemantics* b) {
+              return compare_dexmethods(a->get_method(), b->get_method());
+            });
+  for (const auto* method_semantics : methods) {
+    add_method(*method_semantics);
+  }
+
+  // The targets of the non-virtual calls are known statically.
+  for (size_t i = 0; i < m_call_sites.size(); ++i) {
+    auto* callee = m_call_sites[i].callee;
+    DexMethod* def;
+    switch (m_call_sites[i].kind) {
+    case PTS_INVOKE_STATIC: {
+      def = resolve_method(callee, MethodSearch::Static);
+      break;
+    }
+    case PTS_INVOKE_DIRECT: {
+      def = resolve_method(callee, MethodSearch::Direct);
+      break;
+    }
+    case PTS_INVOKE_SUPER: {
+      // The class of the method reference is the superclass of the caller.
+      def = resolve_method(callee, MethodSearch::Virtual);
+      break;
+    }
+    default: {
+      continue;
+    }
+    }
+    bind(i, def != nullptr ? def : callee);
+  }
+}
+
+void PointsToSolver::add_method(const PointsToMethodSemantics& semantics) {
+  const DexMethodRef* method = semantics.get_method();
+  auto* nodes = &m_methods[method];
+  nodes->this_node =
+      *get_variable_node(nodes, PointsToVariable::this_variable());
+  nodes->return_node = new_node();
+  auto var = [&](const PointsToVariable& v) {
+    return get_variable_node(nodes, v);
+  };
+  auto add_constraint = [&](boost::optional<NodeId> node,
+                            boost::optional<NodeId> operand,
+                            ConstraintKind kind,
+                            const DexFieldRef* field,
+                            const DexType* type) {
+    if (node && operand) {
+      m_nodes[*node].constraints.push_back(
+          Constraint{kind, *operand, field, type});
+    }
+  };
+  const auto& actions = semantics.get_points_to_actions();
+  for (size_t i = 0; i < actions.size(); ++i) {
+    const auto& action = actions[i];
+    const auto& op = action.operation();
+    switch (op.kind) {
+    case PTS_CONST_STRING: {
+      auto object = get_object(
+          PTS_OBJECT_STRING, type::java_lang_String(), nullptr, op.dex_string);
+      add_object(*var(action.dest()), object);
+      break;
+    }
+    case PTS_CONST_CLASS: {
+      auto object = get_object(PTS_OBJECT_CLASS, op.dex_type, nullptr, nullptr);
+      add_object(*var(action.dest()), object);
+      break;
+    }
+    case PTS_GET_EXCEPTION: {
+      auto object = get_object(
+          PTS_OBJECT_EXCEPTION, type::java_lang_Throwable(), nullptr, nullptr);
+      add_object(*var(action.dest()), object);
+      break;
+    }
+    case PTS_NEW_OBJECT: {
+      auto object =
+          get_object(PTS_OBJECT_ALLOCATION, op.dex_type, method, nullptr);
+      add_object(*var(action.dest()), object);
+      break;
+    }
+    case PTS_LOAD_PARAM: {
+      nodes->parameters[op.parameter] = *var(action.dest());
+      break;
+    }
+    case PTS_GET_CLASS: {
+      add_constraint(var(action.src()), var(action.dest()),
+                     PTS_CONSTRAINT_GET_CLASS, nullptr, nullptr);
+      break;
+    }
+    case PTS_CHECK_CAST: {
+      add_constraint(var(action.src()), var(action.dest()),
+                     PTS_CONSTRAINT_CHECK_CAST, nullptr, op.dex_type);
+      break;
+    }
+    case PTS_IGET: {
+      add_constraint(var(action.instance()), var(action.dest()),
+                     PTS_CONSTRAINT_LOAD,
+                     normalize_field(op.dex_field, FieldSearch::Instance),
+                     nullptr);
+      break;
+    }
+    case PTS_IGET_SPECIAL: {
+      add_constraint(var(action.instance()), var(action.dest()),
+                     PTS_CONSTRAINT_LOAD, nullptr, nullptr);
+      break;
+    }
+    case PTS_SGET: {
+      auto field = get_static_field_node(op.dex_field);
+      add_edge(field, *var(action.dest()));
+      break;
+    }
+    case PTS_IPUT: {
+      add_constraint(var(action.lhs()), var(action.rhs()),
+                     PTS_CONSTRAINT_STORE,
+                     normalize_field(op.dex_field, FieldSearch::Instance),
+                     nullptr);
+      break;
+    }
+    case PTS_IPUT_SPECIAL: {
+      add_constraint(var(action.lhs()), var(action.rhs()),
+                     PTS_CONSTRAINT_STORE, nullptr, nullptr);
+      break;
+    }
+    case PTS_SPUT: {
+      auto rhs = var(action.rhs());
+      auto field = get_static_field_node(op.dex_field);
+      if (rhs) {
+        add_edge(*rhs, field);
+      }
+      break;
+    }
+    case PTS_INVOKE_VIRTUAL:
+    case PTS_INVOKE_SUPER:
+    case PTS_INVOKE_DIRECT:
+    case PTS_INVOKE_INTERFACE:
+    case PTS_INVOKE_STATIC: {
+      CallSite call_site;
+      call_site.caller = method;
+      call_site.action_idx = i;
+      call_site.callee = op.dex_method;
+      call_site.kind = op.kind;
+      if (action.has_dest()) {
+        call_site.dest = var(action.dest());
+      }
+      if (!op.is_static_call()) {
+        call_site.instance = var(action.instance());
+      }
+      for (const auto& arg : action.get_arguments()) {
+        auto arg_node = var(arg.second);
+        if (arg_node) {
+          call_site.args.emplace_back(arg.first, *arg_node);
+        }
+      }
+      uint32_t call_idx = m_call_sites.size();
+      m_call_site_index.emplace(std::make_pair(method, i), call_idx);
+      if (op.kind == PTS_INVOKE_VIRTUAL || op.kind == PTS_INVOKE_INTERFACE) {
+        add_constraint(call_site.instance, call_idx, PTS_CONSTRAINT_CALL,
+                       nullptr, nullptr);
+      }
+      m_call_sites.push_back(std::move(call_site));
+      break;
+    }
+    case PTS_RETURN: {
+      auto src = var(action.src());
+      if (src) {
+        add_edge(*src, nodes->return_node);
+      }
+      break;
+    }
+    case PTS_DISJUNCTION: {
+      auto dest = *var(action.dest());
+      for (const auto& arg : action.get_arguments()) {
+        auto arg_node = var(arg.second);
+        if (arg_node) {
+          add_edge(*arg_node, dest);
+        }
+      }
+      break;
+    }
+    }
+  }
+}
+
+PointsToSolver::NodeId PointsToSolver::new_node() {
+  NodeId node = m_nodes.size();
+  m_nodes.emplace_back();
+  m_parent.push_back(node);
+  return node;
+}
+
+PointsToSolver::NodeId PointsToSolver::find(NodeId node) {
+  while (m_parent[node] != node) {
+    m_parent[node] = m_parent[m_parent[node]];
+    node = m_parent[node];
+  }
+  return node;
+}
+
+boost::optional<PointsToSolver::NodeId> PointsToSolver::get_variable_node(
+    MethodNodes* nodes, const PointsToVariable& v) {
+  if (v == PointsToVariable::null_variable()) {
+    return boost::none;
+  }
+  auto it = nodes->variables.find(v);
+  if (it != nodes->variables.end()) {
+    return it->second;
+  }
+  auto node = new_node();
+  nodes->variables.emplace(v, node);
+  return node;
+}
+
+boost::optional<PointsToSolver::NodeId> PointsToSolver::find_variable_node(
+    const DexMethodRef* method, const PointsToVariable& v) const {
+  auto it = m_methods.find(method);
+  if (it == m_methods.end()) {
+    return boost::none;
+  }
+  auto var_it = it->second.variables.find(v);
+  if (var_it == it->second.variables.end()) {
+    return boost::none;
+  }
+  auto node = var_it->second;
+  while (m_parent[node] != node) {
+    node = m_parent[node];
+  }
+  return node;
+}
+
+PointsToSolver::NodeId PointsToSolver::get_field_node(
+    ObjectId object, const DexFieldRef* field) {
+  auto it = m_instance_fields.find(std::make_pair(object, field));
+  if (it != m_instance_fields.end()) {
+    return it->second;
+  }
+  auto node = new_node();
+  m_instance_fields.emplace(std::make_pair(object, field), node);
+  return node;
+}
+
+PointsToSolver::NodeId PointsToSolver::get_static_field_node(
+    const DexFieldRef* field) {
+  field = normalize_field(field, FieldSearch::Static);
+  auto it = m_static_fields.find(field);
+  if (it != m_static_fields.end()) {
+    return it->second;
+  }
+  auto node = new_node();
+  m_static_fields.emplace(field, node);
+  return node;
+}
+
+PointsToSolver::ObjectId PointsToSolver::get_object(AbstractObjectKind kind,
+                                                    const DexType* type,
+                                                    const DexMethodRef* method,
+                                                    const DexString* string) {
+  ObjectId object = m_objects.size();
+  switch (kind) {
+  case PTS_OBJECT_ALLOCATION: {
+    auto it = m_allocations.emplace(std::make_pair(method, type), object);
+    if (!it.second) {
+      return it.first->second;
+    }
+    break;
+  }
+  case PTS_OBJECT_STRING: {
+    auto it = m_strings.emplace(string, object);
+    if (!it.second) {
+      return it.first->second;
+    }
+    break;
+  }
+  case PTS_OBJECT_CLASS: {
+    auto it = m_classes.emplace(type, object);
+    if (!it.second) {
+      return it.first->second;
+    }
+    break;
+  }
+  case PTS_OBJECT_EXCEPTION: {
+    if (m_exception) {
+      return *m_exception;
+    }
+    m_exception = object;
+    break;
+  }
+  }
+  m_objects.push_back(AbstractObject{kind, type, method, string});
+  return object;
+}
+
+bool PointsToSolver::add_edge(NodeId src, NodeId dst) {
+  src = find(src);
+  dst = find(dst);
+  if (src == dst ||
+      !m_edges.insert((static_cast<uint64_t>(src) << 32) | dst).second) {
+    return false;
+  }
+  m_nodes[src].succs.push_back(dst);
+  // The new edge hasn't seen any of the objects of the source yet.
+  m_nodes[dst].points_to.union_with(m_nodes[src].points_to);
+  return true;
+}
+
+bool PointsToSolver::add_object(NodeId node, ObjectId object) {
+  return m_nodes[find(node)].points_to.insert(object);
+}
+
+bool PointsToSolver::bind(size_t call_idx, const DexMethodRef* callee) {
+  auto& call_site = m_call_sites[call_idx];
+  if (!call_site.targets.insert(callee).second) {
+    return false;
+  }
+  auto it = m_methods.find(callee);
+  if (it == m_methods.end()) {
+    return false;
+  }
+  const auto& nodes = it->second;
+  bool changed = false;
+  // The receiver of a virtual call is filtered by the type of its objects, so
+  // it is bound separately.
+  if (call_site.instance && (call_site.kind == PTS_INVOKE_DIRECT ||
+                             call_site.kind == PTS_INVOKE_SUPER)) {
+    changed |= add_edge(*call_site.instance, nodes.this_node);
+  }
+  for (const auto& arg : call_site.args) {
+    auto param_it = nodes.parameters.find(arg.first);
+    if (param_it != nodes.parameters.end()) {
+      changed |= add_edge(arg.second, param_it->second);
+    }
+  }
+  if (call_site.dest) {
+    changed |= add_edge(nodes.return_node, *call_site.dest);
+  }
+  return changed;
+}
+
+void PointsToSolver::collapse_cycles(std::vector<NodeId>* topological_order) {
+  // Tarjan's algorithm, which finds the SCCs in reverse topological order.
+  size_t num_nodes = m_nodes.size();
+  std::vector<uint32_t> index(num_nodes, kUnvisited);
+  std::vector<uint32_t> low_link(num_nodes);
+  std::vector<bool> on_stack(num_nodes, false);
+  std::vector<NodeId> stack;
+  std::vector<std::pair<NodeId, size_t>> frames;
+  std::vector<NodeId> reverse_order;
+  uint32_t next_index = 0;
+  auto visit = [&](NodeId node) {
+    index[node] = low_link[node] = next_index++;
+    stack.push_back(node);
+    on_stack[node] = true;
+    frames.emplace_back(node, 0);
+  };
+  for (NodeId root = 0; root < num_nodes; ++root) {
+    if (find(root) != root || index[root] != kUnvisited) {
+      continue;
+    }
+    visit(root);
+    while (!frames.empty()) {
+      NodeId node = frames.back().first;
+      size_t succ_idx = frames.back().second;
+      const auto& succs = m_nodes[node].succs;
+      if (succ_idx < succs.size()) {
+        ++frames.back().second;
+        NodeId succ = find(succs[succ_idx]);
+        if (index[succ] == kUnvisited) {
+          visit(succ);
+        } else if (on_stack[succ]) {
+          low_link[node] = std::min(low_link[node], index[succ]);
+        }
+        continue;
+      }
+      frames.pop_back();
+      if (!frames.empty()) {
+        NodeId parent = frames.back().first;
+        low_link[parent] = std::min(low_link[parent], low_link[node]);
+      }
+      if (low_link[node] != index[node]) {
+        continue;
+      }
+      NodeId member;
+      do {
+        member = stack.back();
+        stack.pop_back();
+        on_stack[member] = false;
+        if (member != node) {
+          merge(member, node);
+        }
+      } while (member != node);
+      reverse_order.push_back(node);
+    }
+  }
+
+  // Clean up the edges of the merged nodes.
+  for (auto node : reverse_order) {
+    auto& succs = m_nodes[node].succs;
+    for (auto& succ : succs) {
+      succ = find(succ);
+    }
+    std::sort(succs.begin(), succs.end());
+    succs.erase(std::unique(succs.begin(), succs.end()), succs.end());
+    succs.erase(std::remove(succs.begin(), succs.end(), node), succs.end());
+  }
+  topological_order->assign(reverse_order.rbegin(), reverse_order.rend());
+}
+
+void PointsToSolver::merge(NodeId from, NodeId into) {
+  m_parent[from] = into;
+  auto& from_node = m_nodes[from];
+  auto& into_node = m_nodes[into];
+  into_node.points_to.union_with(from_node.points_to);
+  // The objects that were sent along the edges of both nodes, or that the
+  // constraints of both nodes were evaluated on.
+  into_node.propagated.intersection_with(from_node.propagated);
+  into_node.resolved.intersection_with(from_node.resolved);
+  into_node.succs.insert(
+      into_node.succs.end(), from_node.succs.begin(), from_node.succs.end());
+  into_node.constraints.insert(into_node.constraints.end(),
+                               from_node.constraints.begin(),
+                               from_node.constraints.end());
+  from_node = Node();
+  ++m_stats.collapsed_variables;
+}
+
+bool PointsToSolver::propagate(const std::vector<NodeId>& topological_order) {
+  bool changed = false;
+  for (auto node_id : topological_order) {
+    auto& node = m_nodes[node_id];
+    auto diff = node.points_to.difference(node.propagated);
+    if (diff.empty()) {
+      continue;
+    }
+    changed = true;
+    for (auto succ : node.succs) {
+      m_nodes[succ].points_to.union_with(diff);
+    }
+    node.propagated = node.points_to;
+  }
+  return changed;
+}
+
+bool PointsToSolver::resolve_constraints() {
+  std::vector<std::pair<NodeId, SparseBitSet>> pending;
+  for (NodeId node = 0; node < m_nodes.size(); ++node) {
+    if (m_parent[node] != node || m_nodes[node].constraints.empty()) {
+      continue;
+    }
+    auto diff = m_nodes[node].points_to.difference(m_nodes[node].resolved);
+    if (!diff.empty()) {
+      pending.emplace_back(node, std::move(diff));
+    }
+  }
+  if (pending.empty()) {
+    return false;
+  }
+
+  std::vector<std::vector<Effect>> effects(pending.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        effects[i] = evaluate(pending[i].first, pending[i].second);
+      },
+      m_config.num_threads);
+  for (size_t i = 0; i < pending.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (const auto& entry : pending) {
+    m_nodes[entry.first].resolved.union_with(entry.second);
+  }
+  bool changed = false;
+  for (const auto& node_effects : effects) {
+    for (const auto& effect : node_effects) {
+      switch (effect.kind) {
+      case Effect::LOAD: {
+        auto field = get_field_node(effect.object, effect.field);
+        changed |= add_edge(field, effect.operand);
+        break;
+      }
+      case Effect::STORE: {
+        auto field = get_field_node(effect.object, effect.field);
+        changed |= add_edge(effect.operand, field);
+        break;
+      }
+      case Effect::BIND: {
+        changed |= bind(effect.operand, effect.callee);
+        auto it = m_methods.find(effect.callee);
+        if (it != m_methods.end()) {
+          changed |= add_object(it->second.this_node, effect.object);
+        }
+        break;
+      }
+      case Effect::ADD_OBJECT: {
+        changed |= add_object(effect.operand, effect.object);
+        break;
+      }
+      case Effect::ADD_CLASS: {
+        auto object =
+            get_object(PTS_OBJECT_CLASS, effect.type, nullptr, nullptr);
+        changed |= add_object(effect.operand, object);
+        break;
+      }
+      }
+    }
+  }
+  return changed;
+}
+
+std::vector<PointsToSolver::Effect> PointsToSolver::evaluate(
+    NodeId node, const SparseBitSet& objects) const {
+  std::vector<Effect> effects;
+  for (const auto& constraint : m_nodes[node].constraints) {
+    objects.for_each([&](ObjectId object) {
+      const auto* type = m_objects[object].dynamic_type();
+      switch (constraint.kind) {
+      case PTS_CONSTRAINT_LOAD: {
+        effects.push_back(Effect{Effect::LOAD, constraint.operand, object,
+                                 constraint.field, nullptr, nullptr});
+        break;
+      }
+      case PTS_CONSTRAINT_STORE: {
+        effects.push_back(Effect{Effect::STORE, constraint.operand, object,
+                                 constraint.field, nullptr, nullptr});
+        break;
+      }
+      case PTS_CONSTRAINT_CALL: {
+        const auto& call_site = m_call_sites[constraint.operand];
+        auto* callee = resolve_virtual_call(type, call_site.callee);
+        effects.push_back(Effect{Effect::BIND, constraint.operand, object,
+                                 nullptr, callee, nullptr});
+        break;
+      }
+      case PTS_CONSTRAINT_GET_CLASS: {
+        effects.push_back(Effect{Effect::ADD_CLASS, constraint.operand, object,
+                                 nullptr, nullptr, type});
+        break;
+      }
+      case PTS_CONSTRAINT_CHECK_CAST: {
+        if (may_be_cast_to(type, constraint.type)) {
+          effects.push_back(Effect{Effect::ADD_OBJECT, constraint.operand,
+                                   object, nullptr, nullptr, nullptr});
+        }
+        break;
+      }
+      }
+    });
+  }
+  return effects;
+}
+
+void PointsToSolver::run() {
+  m_complete = false;
+  std::vector<NodeId> topological_order;
+  while (true) {
+    ++m_stats.waves;
+    collapse_cycles(&topological_order);
+    propagate(topological_order);
+    m_stats.points_to_facts = 0;
+    for (auto node : topological_order) {
+      m_stats.points_to_facts += m_nodes[node].points_to.size();
+    }
+    if (m_stats.points_to_facts > m_config.max_points_to_facts) {
+      TRACE(PTA, 1,
+            "Stopping the points-to analysis after %zu waves: %zu facts",
+            m_stats.waves, m_stats.points_to_facts);
+      break;
+    }
+    if (!resolve_constraints()) {
+      m_complete = true;
+      break;
+    }
+  }
+  m_stats.variables = m_nodes.size();
+  m_stats.objects = m_objects.size();
+  TRACE(PTA, 1,
+        "Points-to analysis: %zu variables (%zu collapsed), %zu objects, "
+        "%zu facts, %zu waves",
+        m_stats.variables, m_stats.collapsed_variables, m_stats.objects,
+        m_stats.points_to_facts, m_stats.waves);
+}
+
+std::vector<const AbstractObject*> PointsToSolver::get_points_to_set(
+    const DexMethodRef* method, const PointsToVariable& v) const {
+  std::vector<const AbstractObject*> objects;
+  auto node = find_variable_node(method, v);
+  if (node) {
+    m_nodes[*node].points_to.for_each(
+        [&](ObjectId object) { objects.push_back(&m_objects[object]); });
+  }
+  return objects;
+}
+
+std::unordered_set<const DexType*> PointsToSolver::get_dynamic_types(
+    const DexMethodRef* method, const PointsToVariable& v) const {
+  std::unordered_set<const DexType*> types;
+  for (const auto* object : get_points_to_set(method, v)) {
+    types.insert(object->dynamic_type());
+  }
+  return types;
+}
+
+std::vector<const DexMethodRef*> PointsToSolver::get_callees(
+    const DexMethodRef* method, size_t action_idx) const {
+  std::vector<const DexMethodRef*> callees;
+  auto it = m_call_site_index.find(std::make_pair(method, action_idx));
+  if (it != m_call_site_index.end()) {
+    const auto& targets = m_call_sites[it->second].targets;
+    callees.assign(targets.begin(), targets.end());
+    std::sort(callees.begin(), callees.end(), compare_dexmethods);
+  }
+  return callees;
+}
+
+} // namespace points_to
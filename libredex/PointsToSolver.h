@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
+
+#include "DexClass.h"
+#include "PointsToSemantics.h"
+#include "Thread.h"
+
+/*
+ * A context-insensitive, inclusion-based points-to analysis that solves the
+ * points-to equations generated by PointsToSemantics for a whole scope.
+ *
+ * The solver follows the wave propagation scheme described in:
+ *
+ *   F. M. Q. Pereira and D. Berlin. Wave Propagation and Deep Propagation for
+ *   Pointer Analysis. CGO 2009.
+ *
+ * Each iteration (a wave) proceeds in three steps:
+ *   1. The cycles of the graph of inclusion constraints are collapsed, since
+ *      all the variables of a cycle have the same points-to set.
+ *   2. The points-to sets are propagated once along the inclusion constraints,
+ *      in topological order. Only the difference between the current
+ *      points-to set of a variable and what it already propagated is sent
+ *      along its edges.
+ *   3. The field accesses, virtual calls and casts are evaluated on the
+ *      objects that were added to the points-to set of their operand since the
+ *      previous wave, which yields new inclusion constraints. This step is
+ *      performed in parallel, since it only reads the points-to sets.
+ * The solver stops when a wave doesn't change anything.
+ *
+ * The abstract objects are the allocations of each type in each method of the
+ * scope, the string literals, the java.lang.Class objects (one per type) and a
+ * single object that stands for all exceptions. Methods that have no points-to
+ * semantics (external methods without a stub) are assumed to have no effect on
+ * pointers, hence the results are only sound for the code that the points-to
+ * semantics covers.
+ */
+
+namespace points_to {
+
+/*
+ * A set of small integers, represented by the non-zero 64-bit words of a bit
+ * vector along with their position. This is much more compact than a dense
+ * bit vector for the points-to sets of typical programs, which are sparse,
+ * while keeping the set operations word-parallel.
+ */
+class SparseBitSet final {
+ public:
+  bool empty() const { return m_words.empty(); }
+
+  size_t size() const;
+
+  bool contains(uint32_t element) const;
+
+  // Returns whether the element was not already in the set.
+  bool insert(uint32_t element);
+
+  /*
+   * Returns whether the set changed. The elements that were not already in
+   * the set are added to `added`, if it is not null.
+   */
+  bool union_with(const SparseBitSet& other, SparseBitSet* added = nullptr);
+
+  void intersection_with(const SparseBitSet& other);
+
+  SparseBitSet difference(const SparseBitSet& other) const;
+
+  template <typename F>
+  void for_each(F f) const {
+    for (const auto& word : m_words) {
+      auto bits = word.second;
+      while (bits != 0) {
+        auto bit = __builtin_ctzll(bits);
+        f(word.first * 64 + bit);
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  bool operator==(const SparseBitSet& other) const {
+    return m_words == other.m_words;
+  }
+
+ private:
+  std::vector<std::pair<uint32_t, uint64_t>> m_words;
+};
+
+enum AbstractObjectKind {
+  PTS_OBJECT_ALLOCATION,
+  PTS_OBJECT_STRING,
+  PTS_OBJECT_CLASS,
+  PTS_OBJECT_EXCEPTION,
+};
+
+struct AbstractObject {
+  AbstractObjectKind kind;
+  // The type of the allocated instances, or the type that a java.lang.Class
+  // object stands for.
+  const DexType* type;
+  // The method that allocates the instances, for allocation sites.
+  const DexMethodRef* method;
+  // The literal, for string objects.
+  const DexString* string;
+
+  // The type that virtual calls on this object are dispatched on.
+  const DexType* dynamic_type() const;
+};
+
+class PointsToSolver final {
+ public:
+  struct Config {
+    // The solver stops once the points-to sets hold more elements than this
+    // in total, in which case the results are incomplete.
+    size_t max_points_to_facts{200000000};
+    unsigned num_threads{redex_parallel::default_num_threads()};
+  };
+
+  struct Stats {
+    size_t variables{0};
+    size_t objects{0};
+    size_t collapsed_variables{0};
+    size_t waves{0};
+    size_t points_to_facts{0};
+  };
+
+  explicit PointsToSolver(PointsToSemantics* semantics)
+      : PointsToSolver(semantics, Config()) {}
+
+  PointsToSolver(PointsToSemantics* semantics, const Config& config);
+
+  void run();
+
+  /*
+   * Whether the solver reached the fixpoint within the limits of the
+   * configuration. If not, the points-to sets are under-approximations, which
+   * must not be used to transform code.
+   */
+  bool is_complete() const { return m_complete; }
+
+  /*
+   * The abstract objects that a points-to variable of a method may point to.
+   */
+  std::vector<const AbstractObject*> get_points_to_set(
+      const DexMethodRef* method, const PointsToVariable& v) const;
+
+  /*
+   * The types that virtual calls on the objects a variable may point to are
+   * dispatched on.
+   */
+  std::unordered_set<const DexType*> get_dynamic_types(
+      const DexMethodRef* method, const PointsToVariable& v) const;
+
+  /*
+   * The methods that the call at position `action_idx` in the points-to
+   * actions of `method` may dispatch to.
+   */
+  std::vector<const DexMethodRef*> get_callees(const DexMethodRef* method,
+                                               size_t action_idx) const;
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  using NodeId = uint32_t;
+  using ObjectId = uint32_t;
+
+  enum ConstraintKind {
+    PTS_CONSTRAINT_LOAD,
+    PTS_CONSTRAINT_STORE,
+    PTS_CONSTRAINT_CALL,
+    PTS_CONSTRAINT_GET_CLASS,
+    PTS_CONSTRAINT_CHECK_CAST,
+  };
+
+  // A constraint that depends on the objects a node points to.
+  struct Constraint {
+    ConstraintKind kind;
+    // The destination of a load, a cast or a getClass(), the source of a
+    // store, or the index of a call site.
+    uint32_t operand;
+    // The field of a load or store, null for an array element.
+    const DexFieldRef* field;
+    // The type of a cast.
+    const DexType* type;
+  };
+
+  struct Node {
+    SparseBitSet points_to;
+    // The objects that were already sent along the outgoing edges.
+    SparseBitSet propagated;
+    // The objects that the constraints were already evaluated on.
+    SparseBitSet resolved;
+    std::vector<NodeId> succs;
+    std::vector<Constraint> constraints;
+  };
+
+  struct MethodNodes {
+    std::unordered_map<PointsToVariable, NodeId, boost::hash<PointsToVariable>>
+        variables;
+    std::unordered_map<size_t, NodeId> parameters;
+    NodeId this_node;
+    NodeId return_node;
+  };
+
+  struct CallSite {
+    const DexMethodRef* caller;
+    size_t action_idx;
+    DexMethodRef* callee;
+    PointsToOperationKind kind;
+    boost::optional<NodeId> dest;
+    boost::optional<NodeId> instance;
+    std::vector<std::pair<size_t, NodeId>> args;
+    std::unordered_set<const DexMethodRef*> targets;
+  };
+
+  // A new constraint found by evaluating the constraint of a node on one of
+  // its objects.
+  struct Effect {
+    enum Kind { LOAD, STORE, BIND, ADD_OBJECT, ADD_CLASS } kind;
+    uint32_t operand;
+    ObjectId object;
+    const DexFieldRef* field;
+    const DexMethodRef* callee;
+    const DexType* type;
+  };
+
+  void add_method(const PointsToMethodSemantics& semantics);
+
+  NodeId new_node();
+
+  NodeId find(NodeId node);
+
+  boost::optional<NodeId> get_variable_node(MethodNodes* nodes,
+                                            const PointsToVariable& v);
+
+  boost::optional<NodeId> find_variable_node(const DexMethodRef* method,
+                                             const PointsToVariable& v) const;
+
+  NodeId get_field_node(ObjectId object, const DexFieldRef* field);
+
+  NodeId get_static_field_node(const DexFieldRef* field);
+
+  ObjectId get_object(AbstractObjectKind kind,
+                      const DexType* type,
+                      const DexMethodRef* method,
+                      const DexString* string);
+
+  bool add_edge(NodeId src, NodeId dst);
+
+  bool add_object(NodeId node, ObjectId object);
+
+  bool bind(size_t call_idx, const DexMethodRef* callee);
+
+  void collapse_cycles(std::vector<NodeId>* topological_order);
+
+  void merge(NodeId from, NodeId into);
+
+  bool propagate(const std::vector<NodeId>& topological_order);
+
+  bool resolve_constraints();
+
+  std::vector<Effect> evaluate(NodeId node, const SparseBitSet& objects) const;
+
+  PointsToSemantics* m_semantics;
+  Config m_config;
+  bool m_complete{false};
+  Stats m_stats;
+
+  std::vector<Node> m_nodes;
+  // The union-find structure of the collapsed cycles.
+  std::vector<NodeId> m_parent;
+  std::unordered_set<uint64_t> m_edges;
+  std::unordered_map<const DexMethodRef*, MethodNodes> m_methods;
+  std::unordered_map<const DexFieldRef*, NodeId> m_static_fields;
+  std::unordered_map<std::pair<ObjectId, const DexFieldRef*>,
+                     NodeId,
+                     boost::hash<std::pair<ObjectId, const DexFieldRef*>>>
+      m_instance_fields;
+
+  std::vector<AbstractObject> m_objects;
+  using AllocationKey = std::pair<const DexMethodRef*, const DexType*>;
+  std::unordered_map<AllocationKey, ObjectId, boost::hash<AllocationKey>>
+      m_allocations;
+  std::unordered_map<const DexString*, ObjectId> m_strings;
+  std::unordered_map<const DexType*, ObjectId> m_classes;
+  boost::optional<ObjectId> m_exception;
+
+  std::vector<CallSite> m_call_sites;
+  std::unordered_map<std::pair<const DexMethodRef*, size_t>,
+                     size_t,
+                     boost::hash<std::pair<const DexMethodRef*, size_t>>>
+      m_call_site_index;
+};
+
+} // namespace points_to
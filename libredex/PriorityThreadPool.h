@@ -7,8 +7,13 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <queue>
+#include <vector>
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -30,19 +35,134 @@
  * - Work items with the highest priority are executed first.
  * - Priorities are signed integers, allowing flexibility for negative
  *   priorities.
+ * - Work items with the same priority are executed in the order in which they
+ *   were posted.
+ *
+ * The pending work items are spread over one heap per thread, each with its
+ * own lock, so that posting and picking work items doesn't serialize all the
+ * threads on a single lock. Each heap publishes its highest priority in an
+ * atomic, which lets a thread find the heap to pick from without taking any
+ * lock. When two threads race for the same heap, the loser looks again, so
+ * the order of execution may slightly deviate from the priorities under
+ * contention.
  *
  * The thread-pool must be initialized with a positive number of threads to be
  * functional.
  */
 class PriorityThreadPool {
+ public:
+  struct Stats {
+    size_t work_items{0};
+    // The time that the work items spent between being posted and starting to
+    // run, in total and at most.
+    double total_queue_seconds{0};
+    double max_queue_seconds{0};
+    // How often a thread found the heap it picked already emptied by another
+    // thread, and had to look again.
+    size_t retries{0};
+  };
+
  private:
+  using Clock = std::chrono::steady_clock;
+
+  struct WorkItem {
+    int priority;
+    size_t sequence;
+    Clock::time_point posted;
+    std::function<void()> f;
+  };
+
+  struct WorkItemLess {
+    bool operator()(const WorkItem& a, const WorkItem& b) const {
+      if (a.priority != b.priority) {
+        return a.priority < b.priority;
+      }
+      return a.sequence > b.sequence;
+    }
+  };
+
+  static constexpr int NO_PRIORITY = std::numeric_limits<int>::min();
+
+  struct alignas(CACHE_LINE_SIZE) Shard {
+    // The highest priority in the heap, or NO_PRIORITY if it is empty. Only
+    // written while holding the mutex.
+    std::atomic<int> top_priority{NO_PRIORITY};
+    std::atomic<bool> empty{true};
+    boost::mutex mutex;
+    std::priority_queue<WorkItem, std::vector<WorkItem>, WorkItemLess> items;
+
+    void update_top() {
+      if (items.empty()) {
+        top_priority = NO_PRIORITY;
+        empty = true;
+      } else {
+        top_priority = items.top().priority;
+        empty = false;
+      }
+    }
+  };
+
   std::unique_ptr<boost::asio::thread_pool> m_pool;
-  // The following data structures are guarded by this mutex.
+  std::unique_ptr<Shard[]> m_shards;
+  size_t m_num_shards{0};
+  std::atomic<size_t> m_next_sequence{0};
+  // The number of work items that were posted and didn't finish running yet.
+  std::atomic<size_t> m_outstanding_work_items{0};
+  // Guards the waiting for all the work to be done.
   boost::mutex m_mutex;
-  std::map<int, std::queue<std::function<void()>>> m_pending_work_items;
-  size_t m_running_work_items{0};
   boost::condition_variable m_condition;
-  std::chrono::duration<double> m_waited_time;
+  std::chrono::duration<double> m_waited_time{0};
+
+  std::atomic<size_t> m_executed_work_items{0};
+  std::atomic<uint64_t> m_total_queue_nanos{0};
+  std::atomic<uint64_t> m_max_queue_nanos{0};
+  std::atomic<size_t> m_retries{0};
+
+  WorkItem pop_highest_priority_item() {
+    while (true) {
+      // Find the shard with the highest priority without taking locks.
+      size_t best = m_num_shards;
+      int best_priority = NO_PRIORITY;
+      for (size_t i = 0; i < m_num_shards; ++i) {
+        auto& shard = m_shards[i];
+        if (shard.empty) {
+          continue;
+        }
+        int priority = shard.top_priority;
+        if (best == m_num_shards || priority > best_priority) {
+          best = i;
+          best_priority = priority;
+        }
+      }
+      if (best == m_num_shards) {
+        // The item that this task stands for was posted to a shard but its
+        // publication isn't visible yet; look again.
+        ++m_retries;
+        continue;
+      }
+      auto& shard = m_shards[best];
+      boost::mutex::scoped_lock lock(shard.mutex);
+      if (shard.items.empty()) {
+        ++m_retries;
+        continue;
+      }
+      auto item = shard.items.top();
+      shard.items.pop();
+      shard.update_top();
+      return item;
+    }
+  }
+
+  void record_queue_time(Clock::duration queued) {
+    uint64_t nanos =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(queued).count();
+    m_total_queue_nanos += nanos;
+    auto max = m_max_queue_nanos.load();
+    while (nanos > max &&
+           !m_max_queue_nanos.compare_exchange_weak(max, nanos)) {
+    }
+    ++m_executed_work_items;
+  }
 
  public:
   // Creates an instance with a default number of threads
@@ -55,7 +175,7 @@ class PriorityThreadPool {
 
   ~PriorityThreadPool() {
     // .join() must be manually called before the executor may be destroyed
-    always_assert(m_pending_work_items.size() == 0);
+    always_assert(m_outstanding_work_items == 0);
   }
 
   long get_waited_seconds() {
@@ -63,44 +183,47 @@ class PriorityThreadPool {
         .count();
   }
 
+  Stats get_stats() const {
+    Stats stats;
+    stats.work_items = m_executed_work_items;
+    stats.total_queue_seconds = m_total_queue_nanos / 1e9;
+    stats.max_queue_seconds = m_max_queue_nanos / 1e9;
+    stats.retries = m_retries;
+    return stats;
+  }
+
   // The number of threads may be set at most once to a positive number
   void set_num_threads(int num_threads) {
     always_assert(!m_pool);
     if (num_threads > 0) {
       m_pool = std::make_unique<boost::asio::thread_pool>(num_threads);
+      m_num_shards = num_threads;
+      m_shards = std::make_unique<Shard[]>(m_num_shards);
     }
   }
 
   // Post a work item with a priority. This method is thread safe.
   void post(int priority, const std::function<void()>& f) {
     always_assert(m_pool);
+    ++m_outstanding_work_items;
+    auto sequence = m_next_sequence++;
     {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_pending_work_items[priority].push(f);
+      auto& shard = m_shards[sequence % m_num_shards];
+      boost::mutex::scoped_lock lock(shard.mutex);
+      shard.items.push(WorkItem{priority, sequence, Clock::now(), f});
+      shard.update_top();
     }
+    // Each deferred task runs whichever pending work item has the highest
+    // priority at that time, not necessarily the one posted here.
     boost::asio::defer(*m_pool, [this]() {
-      // Find work item with highest priority
-      std::function<void()> highest_priority_f;
-      {
-        boost::mutex::scoped_lock lock(m_mutex);
-        auto& p = *m_pending_work_items.rbegin();
-        auto& queue = p.second;
-        highest_priority_f = queue.front();
-        queue.pop();
-        if (queue.size() == 0) {
-          auto highest_priority = p.first;
-          m_pending_work_items.erase(highest_priority);
-        }
-        m_running_work_items++;
-      }
+      auto item = pop_highest_priority_item();
+      record_queue_time(Clock::now() - item.posted);
       // Run!
-      highest_priority_f();
+      item.f();
       // Notify when *all* work is done, i.e. nothing is running or pending.
-      {
+      if (--m_outstanding_work_items == 0) {
         boost::mutex::scoped_lock lock(m_mutex);
-        if (--m_running_work_items == 0 && m_pending_work_items.size() == 0) {
-          m_condition.notify_one();
-        }
+        m_condition.notify_all();
       }
     });
   }
@@ -112,7 +235,7 @@ class PriorityThreadPool {
     {
       // We wait until *all* work is done, i.e. nothing is running or pending.
       boost::mutex::scoped_lock lock(m_mutex);
-      while (m_running_work_items != 0 || m_pending_work_items.size() != 0) {
+      while (m_outstanding_work_items != 0) {
         // We'll wait until the condition variable gets notified. Waiting for
         // that will first release the lock, and re-acquire it after the
         // notification came in.
@@ -121,7 +244,6 @@ class PriorityThreadPool {
     }
     auto end = std::chrono::system_clock::now();
     m_waited_time += end - start;
-    always_assert(m_pending_work_items.size() == 0);
   }
 
   void join() {
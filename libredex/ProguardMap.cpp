@@ -22,6 +22,12 @@ std::string find_or_same(
   return it->second;
 }
 
+void add_to_index(std::vector<std::pair<size_t, uint32_t>>* index,
+                  const std::string& key,
+                  uint32_t idx) {
+  index->emplace_back(std::hash<std::string>()(key), idx);
+}
+
 std::string convert_scalar_type(const std::string& type) {
   static const std::unordered_map<std::string, std::string> prim_map = {
       {"void", "V"},  {"boolean", "Z"}, {"byte", "B"},
@@ -149,54 +155,69 @@ ProguardMap::ProguardMap(const std::string& filename) {
     Timer t("Parsing proguard map");
     std::ifstream fp(filename);
     always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
-    parse_proguard_map(fp);
+    fp.seekg(0, std::ios::end);
+    // Mapping an empty file fails, and there is nothing to map anyway.
+    if (fp.tellg() > 0) {
+      m_file.open(filename);
+      always_assert_log(m_file.is_open(), "Can't map proguard map: %s\n",
+                        filename.c_str());
+    }
+    parse_proguard_map();
   }
 }
 
+ProguardMap::ProguardMap(std::istream& is) {
+  std::ostringstream ss;
+  ss << is.rdbuf();
+  m_buffer = ss.str();
+  parse_proguard_map();
+}
+
+const char* ProguardMap::data() const {
+  return m_file.is_open() ? m_file.data() : m_buffer.data();
+}
+
 std::string ProguardMap::translate_class(const std::string& cls) const {
-  return find_or_same(cls, m_classMap);
+  return ::find_or_same(cls, m_classMap);
 }
 
 std::string ProguardMap::translate_field(const std::string& field) const {
-  return find_or_same(field, m_fieldMap);
+  return find_or_same(m_field_index, Key::NAME, field);
 }
 
 std::string ProguardMap::translate_method(const std::string& method) const {
-  return find_or_same(method, m_methodMap);
+  return find_or_same(m_method_index, Key::NAME, method);
 }
 
 std::string ProguardMap::deobfuscate_class(const std::string& cls) const {
-  return find_or_same(cls, m_obfClassMap);
+  return ::find_or_same(cls, m_obfClassMap);
 }
 
 std::string ProguardMap::deobfuscate_field(const std::string& field) const {
-  return find_or_same(find_or_same(field, m_obfFieldMap), m_obfUntypedFieldMap);
+  return find_or_same(m_obf_untyped_field_index, Key::NEW_UNTYPED_NAME,
+                      find_or_same(m_obf_field_index, Key::NEW_NAME, field));
 }
 
 std::string ProguardMap::deobfuscate_method(const std::string& method) const {
-  return find_or_same(find_or_same(method, m_obfMethodMap),
-                      m_obfUntypedMethodMap);
+  return find_or_same(m_obf_untyped_method_index, Key::NEW_UNTYPED_NAME,
+                      find_or_same(m_obf_method_index, Key::NEW_NAME, method));
 }
 
 std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
     DexString* method_name, uint32_t line) const {
   std::vector<Frame> frames;
-  auto ranges_it =
-      m_obfMethodLinesMap.find(pg_impl::lines_key(method_name->str()));
-  if (ranges_it != m_obfMethodLinesMap.end()) {
-    for (const auto& range : ranges_it->second) {
-      if (!range->matches(line)) {
-        continue;
-      }
-      auto new_line = line;
-      if (range->remaps_to_single_line()) {
-        new_line = range->original_start;
-      } else if (range->remaps_to_range()) {
-        new_line = range->original_start + line - range->start;
-      }
-      frames.emplace_back(DexString::make_string(range->original_name),
-                          new_line);
+  for (const auto& range : method_lines(method_name->str())) {
+    if (!range->matches(line)) {
+      continue;
+    }
+    auto new_line = line;
+    if (range->remaps_to_single_line()) {
+      new_line = range->original_start;
+    } else if (range->remaps_to_range()) {
+      new_line = range->original_start + line - range->start;
     }
+    frames.emplace_back(DexString::make_string(range->original_name),
+                        new_line);
   }
 
   if (frames.empty()) {
@@ -205,35 +226,161 @@ std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
   return frames;
 }
 
-ProguardLineRangeVector& ProguardMap::method_lines(
-    const std::string& obfuscated_method) {
-  return m_obfMethodLinesMap.at(pg_impl::lines_key(obfuscated_method));
+ProguardLineRangeVector ProguardMap::method_lines(
+    const std::string& obfuscated_method) const {
+  ProguardLineRangeVector lines;
+  find_members(m_obf_method_lines_index, Key::LINES,
+               pg_impl::lines_key(obfuscated_method), [&](Member& member) {
+                 lines.push_back(std::move(member.lines));
+                 return false;
+               });
+  // The lines were found from the last to the first.
+  std::reverse(lines.begin(), lines.end());
+  return lines;
+}
+
+template <class F>
+void ProguardMap::find_members(const MemberIndex& index,
+                               Key key,
+                               const std::string& name,
+                               const F& f) const {
+  auto hash = std::hash<std::string>()(name);
+  auto begin = std::lower_bound(
+      index.begin(), index.end(), std::make_pair(hash, uint32_t(0)));
+  auto end = std::upper_bound(
+      begin, index.end(),
+      std::make_pair(hash, std::numeric_limits<uint32_t>::max()));
+  // Later lines take precedence, as they did when the names were put in maps
+  // in file order.
+  for (auto it = end; it != begin;) {
+    --it;
+    auto member = parse_member(it->second);
+    const std::string* member_key;
+    switch (key) {
+    case Key::NAME:
+      member_key = &member.name;
+      break;
+    case Key::NEW_NAME:
+      member_key = &member.new_name;
+      break;
+    case Key::NEW_UNTYPED_NAME:
+      member_key = &member.new_untyped_name;
+      break;
+    case Key::LINES: {
+      auto lines_key = pg_impl::lines_key(member.new_name);
+      if (lines_key == name && f(member)) {
+        return;
+      }
+      continue;
+    }
+    }
+    if (*member_key == name && f(member)) {
+      return;
+    }
+  }
 }
 
-void ProguardMap::parse_proguard_map(std::istream& fp) {
-  std::string line;
-  while (std::getline(fp, line)) {
-    parse_class(line);
-  }
-  fp.clear();
-  fp.seekg(0);
-  assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
-  while (std::getline(fp, line)) {
-    if (parse_class(line)) {
-      continue;
+std::string ProguardMap::find_or_same(const MemberIndex& index,
+                                      Key from,
+                                      const std::string& name) const {
+  std::string result = name;
+  find_members(index, from, name, [&](Member& member) {
+    result = from == Key::NAME ? member.new_name : member.name;
+    return true;
+  });
+  return result;
+}
+
+ProguardMap::Member ProguardMap::parse_member(uint32_t idx) const {
+  const auto& line = m_members[idx];
+  std::string text(data() + line.offset, line.length);
+  Member member;
+  bool parsed = line.is_method
+                    ? parse_method(text, m_classes[line.cls], &member)
+                    : parse_field(text, m_classes[line.cls], &member);
+  always_assert(parsed);
+  return member;
+}
+
+void ProguardMap::parse_proguard_map() {
+  const char* begin = data();
+  size_t size = m_file.is_open() ? m_file.size() : m_buffer.size();
+  auto for_each_line = [&](const std::function<void(uint64_t, uint32_t)>& f) {
+    uint64_t offset = 0;
+    while (offset < size) {
+      auto newline = static_cast<const char*>(
+          memchr(begin + offset, '\n', size - offset));
+      uint64_t end = newline == nullptr ? size : newline - begin;
+      f(offset, end - offset);
+      offset = end + 1;
     }
-    if (parse_field(line)) {
-      continue;
+  };
+
+  // The classes come first, as the types of the members are translated with
+  // the class names.
+  m_classes.emplace_back();
+  for_each_line([&](uint64_t offset, uint32_t length) {
+    parse_class(std::string(begin + offset, length));
+  });
+
+  // The classes are numbered from 1 in the order of the file; members that
+  // precede the first class belong to the unnamed class 0.
+  uint32_t cls = 0;
+  for_each_line([&](uint64_t offset, uint32_t length) {
+    std::string line(begin + offset, length);
+    {
+      // Only track the current class; parse_class recorded it already.
+      auto p = line.c_str();
+      std::string classname;
+      std::string newname;
+      if (id(p, classname) && literal(p, " -> ") && id(p, newname)) {
+        ++cls;
+        return;
+      }
     }
-    if (parse_method(line)) {
-      continue;
+    always_assert(m_members.size() < std::numeric_limits<uint32_t>::max());
+    auto idx = static_cast<uint32_t>(m_members.size());
+    Member member;
+    std::string coalesced_interface;
+    if (parse_field(line, m_classes[cls], &member, &coalesced_interface)) {
+      // Record interfaces that are coalesced by Proguard.
+      if (!coalesced_interface.empty()) {
+        fprintf(stderr,
+                "Type '%s' is touched by Proguard in '%s'\n",
+                coalesced_interface.c_str(),
+                member.name.c_str());
+        m_pg_coalesced_interfaces.insert(coalesced_interface);
+      }
+      m_members.push_back(MemberLine{offset, length, cls, false});
+      add_to_index(&m_field_index, member.name, idx);
+      add_to_index(&m_obf_field_index, member.new_name, idx);
+      add_to_index(&m_obf_untyped_field_index, member.new_untyped_name, idx);
+      return;
+    }
+    if (parse_method(line, m_classes[cls], &member)) {
+      m_members.push_back(MemberLine{offset, length, cls, true});
+      add_to_index(&m_method_index, member.name, idx);
+      add_to_index(&m_obf_method_index, member.new_name, idx);
+      add_to_index(&m_obf_untyped_method_index, member.new_untyped_name, idx);
+      add_to_index(&m_obf_method_lines_index,
+                   pg_impl::lines_key(member.new_name), idx);
+      return;
     }
     if (comment(line)) {
-      continue;
+      return;
     }
     always_assert_log(
         false, "Bogus line encountered in proguard map: %s\n", line.c_str());
+  });
+
+  for (auto* index : {&m_field_index, &m_method_index, &m_obf_field_index,
+                      &m_obf_method_index, &m_obf_untyped_field_index,
+                      &m_obf_untyped_method_index,
+                      &m_obf_method_lines_index}) {
+    std::sort(index->begin(), index->end());
+    index->shrink_to_fit();
   }
+  m_members.shrink_to_fit();
 }
 
 bool ProguardMap::parse_class(const std::string& line) {
@@ -243,14 +390,18 @@ bool ProguardMap::parse_class(const std::string& line) {
   if (!id(p, classname)) return false;
   if (!literal(p, " -> ")) return false;
   if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
-  m_classMap[m_currClass] = m_currNewClass;
-  m_obfClassMap[m_currNewClass] = m_currClass;
+  auto name = convert_type(classname);
+  auto new_name = convert_type(newname);
+  m_classMap[name] = new_name;
+  m_obfClassMap[new_name] = name;
+  m_classes.push_back(ClassNames{std::move(name), std::move(new_name)});
   return true;
 }
 
-bool ProguardMap::parse_field(const std::string& line) {
+bool ProguardMap::parse_field(const std::string& line,
+                              const ClassNames& cls,
+                              Member* member,
+                              std::string* coalesced_interface) const {
   std::string type;
   std::string fieldname;
   std::string newname;
@@ -265,27 +416,22 @@ bool ProguardMap::parse_field(const std::string& line) {
 
   auto ctype = convert_type(type);
   auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgnew_notype = convert_field(m_currNewClass, "", newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
-  // Record interfaces that are coalesced by Proguard.
-  if (ctype[0] == 'L' && is_maybe_proguard_generated_member(fieldname)) {
-    fprintf(stderr,
-            "Type '%s' is touched by Proguard in '%s'\n",
-            ctype.c_str(),
-            pgold.c_str());
-    m_pg_coalesced_interfaces.insert(ctype);
+  member->new_name = convert_field(cls.new_name, xtype, newname);
+  member->new_untyped_name = convert_field(cls.new_name, "", newname);
+  member->name = convert_field(cls.name, ctype, fieldname);
+  if (coalesced_interface != nullptr && ctype[0] == 'L' &&
+      is_maybe_proguard_generated_member(fieldname)) {
+    *coalesced_interface = ctype;
   }
-  m_fieldMap[pgold] = pgnew;
-  m_obfFieldMap[pgnew] = pgold;
-  m_obfUntypedFieldMap[pgnew_notype] = pgold;
   return true;
 }
 
-bool ProguardMap::parse_method(const std::string& line) {
+bool ProguardMap::parse_method(const std::string& line,
+                               const ClassNames& cls,
+                               Member* member) const {
   std::string type;
   std::string methodname;
-  std::string classname = m_currClass;
+  std::string classname = cls.name;
   std::string old_args;
   std::string new_args;
   std::string newname;
@@ -325,14 +471,13 @@ bool ProguardMap::parse_method(const std::string& line) {
 
   auto old_rtype = convert_type(type);
   auto new_rtype = translate_type(old_rtype, *this);
-  auto pgold = convert_method(classname, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  auto pgnew_no_rtype = convert_method(m_currNewClass, "", newname, new_args);
-  m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
-  m_obfUntypedMethodMap[pgnew_no_rtype] = pgold;
-  lines->original_name = pgold;
-  m_obfMethodLinesMap[pg_impl::lines_key(pgnew)].push_back(std::move(lines));
+  member->name = convert_method(classname, old_rtype, methodname, old_args);
+  member->new_name =
+      convert_method(cls.new_name, new_rtype, newname, new_args);
+  member->new_untyped_name =
+      convert_method(cls.new_name, "", newname, new_args);
+  lines->original_name = member->name;
+  member->lines = std::move(lines);
   return true;
 }
 
@@ -7,11 +7,13 @@
 
 #pragma once
 
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <cstddef>
 #include <fstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "DexClass.h"
 #include "ProguardLineRange.h"
@@ -37,6 +39,11 @@
  * For classes, this is the full descriptor.
  * For methods, it's <class descriptor>.<name>(<args descs>)<return desc> .
  * For fields,  it's <class descriptor>.<name>:<type desc> .
+ *
+ * Mapping files of large apps run into hundreds of megabytes, so only the
+ * classes are parsed up front. The file itself stays memory-mapped, and the
+ * members are indexed by the hashes of their names, pointing back at the lines
+ * that declare them; a lookup re-parses the few lines whose hash matches.
  */
 struct ProguardMap {
   /**
@@ -47,7 +54,7 @@ struct ProguardMap {
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) { parse_proguard_map(is); }
+  explicit ProguardMap(std::istream& is);
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -94,11 +101,10 @@ struct ProguardMap {
   /**
    * Obtain line range vector for a given obfuscated method name.
    */
-  ProguardLineRangeVector& method_lines(const std::string& obfuscated_method);
+  ProguardLineRangeVector method_lines(
+      const std::string& obfuscated_method) const;
 
-  bool empty() const {
-    return m_classMap.empty() && m_fieldMap.empty() && m_methodMap.empty();
-  }
+  bool empty() const { return m_classMap.empty() && m_members.empty(); }
 
   bool is_special_interface(const std::string& type) const {
     return m_pg_coalesced_interfaces.find(type) !=
@@ -106,38 +112,99 @@ struct ProguardMap {
   }
 
  private:
-  void parse_proguard_map(std::istream& fp);
+  struct ClassNames {
+    std::string name;
+    std::string new_name;
+  };
+
+  // A field or method line of the mapping file.
+  struct MemberLine {
+    uint64_t offset;
+    uint32_t length;
+    // The index of the enclosing class in m_classes.
+    uint32_t cls : 31;
+    bool is_method : 1;
+  };
+
+  // The names that a member line maps between.
+  struct Member {
+    // The unobfuscated name.
+    std::string name;
+    // The obfuscated name, with and without its (return) type.
+    std::string new_name;
+    std::string new_untyped_name;
+    std::unique_ptr<ProguardLineRange> lines;
+  };
+
+  // The hashes of names, sorted, along with the indices of the member lines
+  // that produce them in m_members.
+  using MemberIndex = std::vector<std::pair<size_t, uint32_t>>;
+
+  enum class Key { NAME, NEW_NAME, NEW_UNTYPED_NAME, LINES };
+
+  const char* data() const;
+
+  void parse_proguard_map();
 
   bool parse_class(const std::string& line);
-  bool parse_field(const std::string& line);
-  bool parse_method(const std::string& line);
+  // Also reports the type of the field if it looks like an interface that
+  // ProGuard coalesced.
+  bool parse_field(const std::string& line,
+                   const ClassNames& cls,
+                   Member* member,
+                   std::string* coalesced_interface = nullptr) const;
+  bool parse_method(const std::string& line,
+                    const ClassNames& cls,
+                    Member* member) const;
+
+  Member parse_member(uint32_t idx) const;
+
+  // Calls `f` on each member whose `key` equals `name`, from the last one in
+  // the file to the first, until `f` returns true.
+  template <class F>
+  void find_members(const MemberIndex& index,
+                    Key key,
+                    const std::string& name,
+                    const F& f) const;
+
+  std::string find_or_same(const MemberIndex& index,
+                           Key from,
+                           const std::string& name) const;
 
  private:
-  // Unobfuscated to obfuscated maps
-  std::unordered_map<std::string, std::string> m_classMap;
-  std::unordered_map<std::string, std::string> m_fieldMap;
-  std::unordered_map<std::string, std::string> m_methodMap;
+  // The contents of the mapping file, either mapped from disk or read from a
+  // stream.
+  boost::iostreams::mapped_file_source m_file;
+  std::string m_buffer;
 
-  // Obfuscated to unobfuscated maps from proguard
+  // Unobfuscated to obfuscated and obfuscated to unobfuscated class names.
+  std::unordered_map<std::string, std::string> m_classMap;
   std::unordered_map<std::string, std::string> m_obfClassMap;
-  std::unordered_map<std::string, std::string> m_obfFieldMap;
-  std::unordered_map<std::string, std::string> m_obfMethodMap;
 
-  // Field map for reflection analysis when type is unknown
-  // Stores Lcom/facebook/Class;.field -> original name without class name
-  std::unordered_map<std::string, std::string> m_obfUntypedFieldMap;
+  // The classes in the order of the file, after an unnamed one for the
+  // members that precede the first class.
+  std::vector<ClassNames> m_classes;
+  std::vector<MemberLine> m_members;
+
+  // Unobfuscated to obfuscated names
+  MemberIndex m_field_index;
+  MemberIndex m_method_index;
 
-  // Method map for reflection analysis when return type is unknown
-  // Stores Lcom/facebook/Class;.method(II) -> original name without class name
-  std::unordered_map<std::string, std::string> m_obfUntypedMethodMap;
+  // Obfuscated to unobfuscated names
+  MemberIndex m_obf_field_index;
+  MemberIndex m_obf_method_index;
 
-  std::unordered_map<std::string, ProguardLineRangeVector> m_obfMethodLinesMap;
+  // For reflection analysis when the type is unknown: the obfuscated names
+  // of fields without their types, e.g. Lcom/facebook/Class;.field, and of
+  // methods without their return types, e.g. Lcom/facebook/Class;.method(II)
+  MemberIndex m_obf_untyped_field_index;
+  MemberIndex m_obf_untyped_method_index;
+
+  // The obfuscated methods by their pg_impl::lines_key.
+  MemberIndex m_obf_method_lines_index;
 
   // Interfaces that are (most likely) coalesced by Proguard.
   std::unordered_set<std::string> m_pg_coalesced_interfaces;
-
-  std::string m_currClass;
-  std::string m_currNewClass;
 };
 
 /**
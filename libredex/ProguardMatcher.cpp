@@ -7,7 +7,9 @@
 
 #include <algorithm>
 #include <boost/regex.hpp>
+#include <chrono>
 #include <iostream>
+#include <numeric>
 #include <thread>
 
 #include "ClassHierarchy.h"
@@ -19,7 +21,6 @@
 #include "ProguardRegex.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
-#include "StringBuilder.h"
 #include "Timer.h"
 #include "WorkQueue.h"
 
@@ -45,6 +46,61 @@ std::string get_deobfuscated_name(const DexType* type) {
   return cls->get_deobfuscated_name();
 }
 
+/*
+ * The longest prefix of a converted class name pattern that every matching
+ * class name starts with, i.e. everything up to the first character that
+ * form_type_regex would turn into something other than itself.
+ */
+std::string literal_prefix(const std::string& wildcard_descriptor) {
+  size_t i = 0;
+  for (; i < wildcard_descriptor.size(); i++) {
+    const char ch = wildcard_descriptor[i];
+    if (!isalnum(ch) && ch != '/' && ch != '$' && ch != '_') {
+      break;
+    }
+  }
+  return wildcard_descriptor.substr(0, i);
+}
+
+/*
+ * Matches the dequalified name and type of a field or method against a member
+ * specification, with a plain string comparison when the specification has no
+ * wildcards.
+ */
+class MemberMatcher {
+ public:
+  explicit MemberMatcher(const MemberSpecification& spec) : m_spec(spec) {
+    if (!spec.name.empty() && !proguard_parser::has_special_char(spec.name) &&
+        is_literal_type(spec.descriptor)) {
+      m_literal = spec.name + ":" + spec.descriptor;
+    } else {
+      m_regex = std::make_unique<boost::regex>(
+          proguard_parser::form_member_regex(spec.name) + "\\:" +
+          proguard_parser::form_type_regex(spec.descriptor));
+    }
+  }
+
+  const MemberSpecification& spec() const { return m_spec; }
+
+  // Whether form_type_regex would only escape characters of the type.
+  static bool is_literal_type(const std::string& type) {
+    return !type.empty() &&
+           type.find_first_of("%?*.|+{}]^\\") == std::string::npos;
+  }
+
+  bool match(const std::string& dequalified_name) const {
+    if (m_regex == nullptr) {
+      return dequalified_name == m_literal;
+    }
+    return boost::regex_match(dequalified_name, *m_regex);
+  }
+
+ private:
+  const MemberSpecification& m_spec;
+  std::string m_literal;
+  std::unique_ptr<boost::regex> m_regex;
+};
+
 bool match_annotation_rx(const DexClass* cls, const boost::regex& annorx) {
   const auto* annos = cls->get_anno_set();
   if (!annos) return false;
@@ -224,32 +280,33 @@ class KeepRuleMatcher {
                   RegexMap& regex_map)
       : m_rule_type(rule_type),
         m_keep_rule(keep_rule),
-        m_regex_map(regex_map) {}
-
-  ~KeepRuleMatcher() {
-    TRACE(PGR, 3, "%s matched %lu classes and %lu members",
-          show_keep(m_keep_rule).c_str(), m_class_matches, m_member_matches);
+        m_regex_map(regex_map) {
+    for (const auto& spec : keep_rule.class_spec.fieldSpecifications) {
+      m_field_matchers.emplace_back(spec);
+    }
+    for (const auto& spec : keep_rule.class_spec.methodSpecifications) {
+      m_method_matchers.emplace_back(spec);
+    }
   }
 
+  size_t class_matches() const { return m_class_matches; }
+  size_t member_matches() const { return m_member_matches; }
+
   void keep_processor(DexClass*);
 
   void mark_class_and_members_for_keep(DexClass* cls);
 
   bool any_method_matches(const DexClass* cls,
-                          const MemberSpecification& method_keep,
-                          const boost::regex& method_regex);
+                          const MemberMatcher& method_matcher);
 
   // Check that each method keep matches at least one method in :cls.
-  bool all_method_keeps_match(
-      const std::vector<MemberSpecification>& method_keeps,
-      const DexClass* cls);
+  bool all_method_keeps_match(const DexClass* cls);
 
   bool any_field_matches(const DexClass* cls,
-                         const MemberSpecification& field_keep);
+                         const MemberMatcher& field_matcher);
 
   // Check that each field keep matches at least one field in :cls.
-  bool all_field_keeps_match(
-      const std::vector<MemberSpecification>& field_keeps, const DexClass* cls);
+  bool all_field_keeps_match(const DexClass* cls);
 
   void process_whyareyoukeeping(DexClass* cls);
 
@@ -266,21 +323,17 @@ class KeepRuleMatcher {
 
   template <class Container>
   void keep_fields(const Container& fields,
-                   const MemberSpecification& fieldSpecification,
-                   const boost::regex& fieldname_regex);
+                   const MemberMatcher& field_matcher);
 
   template <class Container>
-  void keep_methods(const MemberSpecification& methodSpecification,
-                    const Container& methods,
-                    const boost::regex& method_regex);
+  void keep_methods(const Container& methods,
+                    const MemberMatcher& method_matcher);
 
-  bool field_level_match(const MemberSpecification& fieldSpecification,
-                         const DexField* field,
-                         const boost::regex& fieldname_regex);
+  bool field_level_match(const MemberMatcher& field_matcher,
+                         const DexField* field);
 
-  bool method_level_match(const MemberSpecification& methodSpecification,
-                          const DexMethod* method,
-                          const boost::regex& method_regex);
+  bool method_level_match(const MemberMatcher& method_matcher,
+                          const DexMethod* method);
 
   template <class DexMember>
   bool has_annotation(const DexMember* member,
@@ -299,6 +352,9 @@ class KeepRuleMatcher {
   RuleType m_rule_type;
   const KeepSpec& m_keep_rule;
   RegexMap& m_regex_map;
+  // Compiled once per rule rather than once per class.
+  std::vector<MemberMatcher> m_field_matchers;
+  std::vector<MemberMatcher> m_method_matchers;
 };
 
 class ProguardMatcher {
@@ -314,6 +370,8 @@ class ProguardMatcher {
     // may, for instance, forbid renaming of all classes that inherit from a
     // given external class.
     build_extends_or_implements_hierarchy(m_external_classes, &m_hierarchy);
+    build_name_index(m_classes, &m_class_index);
+    build_name_index(m_external_classes, &m_external_class_index);
   }
 
   void process_proguard_rules(const ProguardConfiguration& pg_config);
@@ -326,12 +384,55 @@ class ProguardMatcher {
   DexClass* find_single_class(const std::string& descriptor) const;
 
  private:
+  // Classes sorted by their deobfuscated names, so that the classes whose
+  // names start with a given prefix form a contiguous range.
+  using NameIndex = std::vector<std::pair<std::string, DexClass*>>;
+
+  static void build_name_index(const Scope& classes, NameIndex* index);
+
+  // The range of the classes that the class name pattern of `keep_rule` may
+  // match, i.e. of the classes whose names start with the literal prefix of
+  // the pattern.
+  static std::pair<size_t, size_t> candidate_range(const NameIndex& index,
+                                                   const KeepSpec& keep_rule);
+
   const ProguardMap& m_pg_map;
   const Scope& m_classes;
   const Scope& m_external_classes;
   ClassHierarchy m_hierarchy;
+  NameIndex m_class_index;
+  NameIndex m_external_class_index;
 };
 
+void ProguardMatcher::build_name_index(const Scope& classes, NameIndex* index) {
+  index->reserve(classes.size());
+  for (auto cls : classes) {
+    index->emplace_back(cls->get_deobfuscated_name(), cls);
+  }
+  std::sort(index->begin(), index->end());
+}
+
+std::pair<size_t, size_t> ProguardMatcher::candidate_range(
+    const NameIndex& index, const KeepSpec& keep_rule) {
+  const auto& className = keep_rule.class_spec.className;
+  // These match every class without looking at its name at all.
+  if (className == "*" || className == "**") {
+    return {0, index.size()};
+  }
+  auto prefix =
+      literal_prefix(proguard_parser::convert_wildcard_type(className));
+  auto begin = std::lower_bound(
+      index.begin(), index.end(), prefix,
+      [](const std::pair<std::string, DexClass*>& entry,
+         const std::string& prefix) { return entry.first < prefix; });
+  auto end = begin;
+  while (end != index.end() &&
+         end->first.compare(0, prefix.size(), prefix) == 0) {
+    ++end;
+  }
+  return {begin - index.begin(), end - index.begin()};
+}
+
 // Updates a class, field or method to add keep modifiers.
 // Note: includedescriptorclasses and allowoptimization are not implemented.
 template <class DexMember>
@@ -408,10 +509,9 @@ std::string extract_method_name_and_type(
   return qualified_fieldname.substr(p + 2);
 }
 
-bool KeepRuleMatcher::field_level_match(
-    const MemberSpecification& fieldSpecification,
-    const DexField* field,
-    const boost::regex& fieldname_regex) {
+bool KeepRuleMatcher::field_level_match(const MemberMatcher& field_matcher,
+                                        const DexField* field) {
+  const auto& fieldSpecification = field_matcher.spec();
   // Check for annotation guards.
   if (!(fieldSpecification.annotationType.empty())) {
     if (!has_annotation(field, fieldSpecification.annotationType)) {
@@ -426,15 +526,14 @@ bool KeepRuleMatcher::field_level_match(
   }
   // Match field name against regex.
   auto dequalified_name = extract_field_name(field->get_deobfuscated_name());
-  return boost::regex_match(dequalified_name, fieldname_regex);
+  return field_matcher.match(dequalified_name);
 }
 
 template <class Container>
 void KeepRuleMatcher::keep_fields(const Container& fields,
-                                  const MemberSpecification& fieldSpecification,
-                                  const boost::regex& fieldname_regex) {
+                                  const MemberMatcher& field_matcher) {
   for (DexField* field : fields) {
-    if (!field_level_match(fieldSpecification, field, fieldname_regex)) {
+    if (!field_level_match(field_matcher, field)) {
       continue;
     }
     if (m_rule_type == RuleType::KEEP) {
@@ -444,27 +543,16 @@ void KeepRuleMatcher::keep_fields(const Container& fields,
   }
 }
 
-std::string field_regex(const MemberSpecification& field_spec) {
-  string_builders::StaticStringBuilder<3> ss;
-  ss << proguard_parser::form_member_regex(field_spec.name);
-  ss << "\\:";
-  ss << proguard_parser::form_type_regex(field_spec.descriptor);
-  return ss.str();
-}
-
 void KeepRuleMatcher::apply_field_keeps(const DexClass* cls) {
-  for (const auto& field_spec : m_keep_rule.class_spec.fieldSpecifications) {
-    auto fieldname_regex = field_regex(field_spec);
-    const boost::regex& matcher = register_matcher(fieldname_regex);
-    keep_fields(cls->get_ifields(), field_spec, matcher);
-    keep_fields(cls->get_sfields(), field_spec, matcher);
+  for (const auto& matcher : m_field_matchers) {
+    keep_fields(cls->get_ifields(), matcher);
+    keep_fields(cls->get_sfields(), matcher);
   }
 }
 
-bool KeepRuleMatcher::method_level_match(
-    const MemberSpecification& methodSpecification,
-    const DexMethod* method,
-    const boost::regex& method_regex) {
+bool KeepRuleMatcher::method_level_match(const MemberMatcher& method_matcher,
+                                         const DexMethod* method) {
+  const auto& methodSpecification = method_matcher.spec();
   // Check to see if the method match is guarded by an annotation match.
   if (!(methodSpecification.annotationType.empty())) {
     if (!has_annotation(method, methodSpecification.annotationType)) {
@@ -478,16 +566,14 @@ bool KeepRuleMatcher::method_level_match(
   }
   auto dequalified_name =
       extract_method_name_and_type(method->get_deobfuscated_name());
-  return boost::regex_match(dequalified_name.c_str(), method_regex);
+  return method_matcher.match(dequalified_name);
 }
 
 template <class Container>
-void KeepRuleMatcher::keep_methods(
-    const MemberSpecification& methodSpecification,
-    const Container& methods,
-    const boost::regex& method_regex) {
+void KeepRuleMatcher::keep_methods(const Container& methods,
+                                   const MemberMatcher& method_matcher) {
   for (DexMethod* method : methods) {
-    if (method_level_match(methodSpecification, method, method_regex)) {
+    if (method_level_match(method_matcher, method)) {
       if (m_rule_type == RuleType::KEEP) {
         apply_keep_modifiers(m_keep_rule, method);
       }
@@ -496,22 +582,10 @@ void KeepRuleMatcher::keep_methods(
   }
 }
 
-std::string method_regex(const MemberSpecification& method_spec) {
-  auto qualified_method_regex =
-      proguard_parser::form_member_regex(method_spec.name);
-  qualified_method_regex += "\\:";
-  qualified_method_regex +=
-      proguard_parser::form_type_regex(method_spec.descriptor);
-  return qualified_method_regex;
-}
-
 void KeepRuleMatcher::apply_method_keeps(const DexClass* cls) {
-  auto methodSpecifications = m_keep_rule.class_spec.methodSpecifications;
-  for (auto& method_spec : methodSpecifications) {
-    auto qualified_method_regex = method_regex(method_spec);
-    const boost::regex& method_regex = register_matcher(qualified_method_regex);
-    keep_methods(method_spec, cls->get_vmethods(), method_regex);
-    keep_methods(method_spec, cls->get_dmethods(), method_regex);
+  for (const auto& matcher : m_method_matchers) {
+    keep_methods(cls->get_vmethods(), matcher);
+    keep_methods(cls->get_dmethods(), matcher);
   }
 }
 
@@ -525,10 +599,9 @@ bool classname_contains_wildcard(const std::string& classname) {
 }
 
 bool KeepRuleMatcher::any_method_matches(const DexClass* cls,
-                                         const MemberSpecification& method_keep,
-                                         const boost::regex& method_regex) {
+                                         const MemberMatcher& method_matcher) {
   auto match = [&](const DexMethod* method) {
-    return method_level_match(method_keep, method, method_regex);
+    return method_level_match(method_matcher, method);
   };
   return std::any_of(cls->get_vmethods().begin(), cls->get_vmethods().end(),
                      match) ||
@@ -537,24 +610,18 @@ bool KeepRuleMatcher::any_method_matches(const DexClass* cls,
 }
 
 // Check that each method keep matches at least one method in :cls.
-bool KeepRuleMatcher::all_method_keeps_match(
-    const std::vector<MemberSpecification>& method_keeps, const DexClass* cls) {
-  return std::all_of(method_keeps.begin(),
-                     method_keeps.end(),
-                     [&](const MemberSpecification& method_keep) {
-                       auto qualified_method_regex = method_regex(method_keep);
-                       const boost::regex& matcher =
-                           register_matcher(qualified_method_regex);
-                       return any_method_matches(cls, method_keep, matcher);
+bool KeepRuleMatcher::all_method_keeps_match(const DexClass* cls) {
+  return std::all_of(m_method_matchers.begin(),
+                     m_method_matchers.end(),
+                     [&](const MemberMatcher& method_matcher) {
+                       return any_method_matches(cls, method_matcher);
                      });
 }
 
 bool KeepRuleMatcher::any_field_matches(const DexClass* cls,
-                                        const MemberSpecification& field_keep) {
-  auto fieldtype_regex = field_regex(field_keep);
-  const boost::regex& matcher = register_matcher(fieldtype_regex);
+                                        const MemberMatcher& field_matcher) {
   auto match = [&](const DexField* field) {
-    return field_level_match(field_keep, field, matcher);
+    return field_level_match(field_matcher, field);
   };
   return std::any_of(cls->get_ifields().begin(), cls->get_ifields().end(),
                      match) ||
@@ -563,12 +630,11 @@ bool KeepRuleMatcher::any_field_matches(const DexClass* cls,
 }
 
 // Check that each field keep matches at least one field in :cls.
-bool KeepRuleMatcher::all_field_keeps_match(
-    const std::vector<MemberSpecification>& field_keeps, const DexClass* cls) {
-  return std::all_of(field_keeps.begin(),
-                     field_keeps.end(),
-                     [&](const MemberSpecification& field_keep) {
-                       return any_field_matches(cls, field_keep);
+bool KeepRuleMatcher::all_field_keeps_match(const DexClass* cls) {
+  return std::all_of(m_field_matchers.begin(),
+                     m_field_matchers.end(),
+                     [&](const MemberMatcher& field_matcher) {
+                       return any_field_matches(cls, field_matcher);
                      });
 }
 
@@ -580,8 +646,7 @@ bool KeepRuleMatcher::process_mark_conditionally(const DexClass* cls) {
               << class_spec.className
               << " has no field or member specifications.\n";
   }
-  return all_field_keeps_match(class_spec.fieldSpecifications, cls) &&
-         all_method_keeps_match(class_spec.methodSpecifications, cls);
+  return all_field_keeps_match(cls) && all_method_keeps_match(cls);
 }
 
 // Once a match has been made against a class i.e. the class name
@@ -724,23 +789,14 @@ void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
     }
   };
 
-  // We only parallelize if keep_rule needs to be applied to all classes.
-  auto wq = workqueue_foreach<const KeepSpec*>([&](const KeepSpec* keep_rule) {
-    RegexMap regex_map;
-    ClassMatcher class_match(*keep_rule);
-    KeepRuleMatcher rule_matcher(rule_type, *keep_rule, regex_map);
-
-    for (const auto& cls : m_classes) {
-      process_single_keep(class_match, rule_matcher, cls);
-    }
-    if (process_external) {
-      for (const auto& cls : m_external_classes) {
-        process_single_keep(class_match, rule_matcher, cls);
-      }
-    }
-  });
+  auto trace_matches = [](const KeepSpec& keep_rule, size_t class_matches,
+                          size_t member_matches) {
+    TRACE(PGR, 3, "%s matched %lu classes and %lu members",
+          show_keep(keep_rule).c_str(), class_matches, member_matches);
+  };
 
   RegexMap regex_map;
+  std::vector<const KeepSpec*> slow_rules;
   for (const auto& keep_rule_ptr : keep_rules) {
     const auto& keep_rule = *keep_rule_ptr;
     ClassMatcher class_match(keep_rule);
@@ -751,6 +807,8 @@ void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
       DexClass* cls = find_single_class(className);
       KeepRuleMatcher rule_matcher(rule_type, keep_rule, regex_map);
       process_single_keep(class_match, rule_matcher, cls);
+      trace_matches(keep_rule, rule_matcher.class_matches(),
+                    rule_matcher.member_matches());
       continue;
     }
 
@@ -766,16 +824,79 @@ void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
         for (auto const* type : children) {
           process_single_keep(class_match, rule_matcher, type_class(type));
         }
+        trace_matches(keep_rule, rule_matcher.class_matches(),
+                      rule_matcher.member_matches());
       }
       continue;
     }
 
     TRACE(PGR, 2, "Slow rule: %s", show_keep(keep_rule).c_str());
-    // Otherwise, it might take a longer time. Add to the work queue.
-    wq.add_item(&keep_rule);
+    // Otherwise, it might take a longer time. Process it in parallel below.
+    slow_rules.push_back(&keep_rule);
+  }
+
+  // The slow rules are split into chunks of the classes they may match, so
+  // that a single rule that matches most of the app doesn't serialize the
+  // work. Chunks of the same rule may mark the same members concurrently,
+  // which is fine as the ReferencedState flags are updated atomically.
+  struct RuleStats {
+    std::atomic<size_t> class_matches{0};
+    std::atomic<size_t> member_matches{0};
+    std::atomic<int64_t> usecs{0};
+  };
+  struct Chunk {
+    size_t rule;
+    const NameIndex* index;
+    size_t begin;
+    size_t end;
+  };
+  constexpr size_t CHUNK_SIZE = 1024;
+  std::vector<RuleStats> stats(slow_rules.size());
+  auto wq = workqueue_foreach<Chunk>([&](const Chunk& chunk) {
+    auto start = std::chrono::steady_clock::now();
+    const auto& keep_rule = *slow_rules[chunk.rule];
+    RegexMap chunk_regex_map;
+    ClassMatcher class_match(keep_rule);
+    KeepRuleMatcher rule_matcher(rule_type, keep_rule, chunk_regex_map);
+    for (size_t i = chunk.begin; i < chunk.end; ++i) {
+      process_single_keep(class_match, rule_matcher, (*chunk.index)[i].second);
+    }
+    auto& rule_stats = stats[chunk.rule];
+    rule_stats.class_matches += rule_matcher.class_matches();
+    rule_stats.member_matches += rule_matcher.member_matches();
+    rule_stats.usecs += std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  });
+  auto add_chunks = [&](size_t rule, const NameIndex& index) {
+    auto range = candidate_range(index, *slow_rules[rule]);
+    for (size_t begin = range.first; begin < range.second;
+         begin += CHUNK_SIZE) {
+      auto end = std::min(begin + CHUNK_SIZE, range.second);
+      wq.add_item(Chunk{rule, &index, begin, end});
+    }
+  };
+  for (size_t rule = 0; rule < slow_rules.size(); ++rule) {
+    add_chunks(rule, m_class_index);
+    if (process_external) {
+      add_chunks(rule, m_external_class_index);
+    }
   }
-
   wq.run_all();
+
+  // Report the slow rules by the time spent on them, across all threads.
+  std::vector<size_t> order(slow_rules.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return stats[a].usecs > stats[b].usecs;
+  });
+  for (auto rule : order) {
+    const auto& rule_stats = stats[rule];
+    TRACE(PGR, 2, "%s took %.3fs", show_keep(*slow_rules[rule]).c_str(),
+          rule_stats.usecs / 1000000.0);
+    trace_matches(*slow_rules[rule], rule_stats.class_matches,
+                  rule_stats.member_matches);
+  }
 }
 
 void ProguardMatcher::process_proguard_rules(
@@ -12,6 +12,7 @@
 #include "ProguardMap.h"
 #include "ProguardParser.h"
 #include "ProguardRegex.h"
+#include "WorkQueue.h"
 
 namespace keep_rules {
 namespace proguard_parser {
@@ -977,10 +978,9 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
   }
 }
 
-void parse(istream& config,
+void parse(std::vector<unique_ptr<Token>> tokens,
            ProguardConfiguration* pg_config,
            const std::string& filename) {
-  std::vector<unique_ptr<Token>> tokens = lex(config);
   bool ok = true;
   // Check for bad tokens.
   for (auto& tok : tokens) {
@@ -1004,28 +1004,91 @@ void parse(istream& config,
   }
 }
 
-void parse_file(const std::string& filename, ProguardConfiguration* pg_config) {
+void parse(istream& config,
+           ProguardConfiguration* pg_config,
+           const std::string& filename) {
+  parse(lex(config), pg_config, filename);
+}
+
+struct LexedFile {
+  bool opened{false};
+  // Whether the file was looked up in the -basedirectory, which is the one
+  // in effect when the file was lexed.
+  bool in_basedirectory{false};
+  std::string basedirectory;
+  std::vector<unique_ptr<Token>> tokens;
+};
+
+LexedFile lex_file(const std::string& filename,
+                   const std::string& basedirectory) {
+  LexedFile lexed;
+  lexed.basedirectory = basedirectory;
   ifstream config(filename);
   // First try relative path.
   if (!config.is_open()) {
     // Try with -basedirectory
-    config.open(pg_config->basedirectory + "/" + filename);
+    lexed.in_basedirectory = true;
+    config.open(basedirectory + "/" + filename);
     if (!config.is_open()) {
-      cerr << "ERROR: Failed to open ProGuard configuration file " << filename
-           << endl;
-      exit(1);
+      return lexed;
     }
   }
+  lexed.opened = true;
+  lexed.tokens = lex(config);
+  return lexed;
+}
 
-  parse(config, pg_config, filename);
-  // Parse the included files.
-  for (const auto& included_filename : pg_config->includes) {
-    if (pg_config->already_included.find(included_filename) !=
-        pg_config->already_included.end()) {
-      continue;
+void parse_lexed_file(const std::string& filename,
+                      LexedFile lexed,
+                      ProguardConfiguration* pg_config) {
+  // The files before this one may have changed the -basedirectory.
+  if (lexed.in_basedirectory &&
+      lexed.basedirectory != pg_config->basedirectory) {
+    lexed = lex_file(filename, pg_config->basedirectory);
+  }
+  if (!lexed.opened) {
+    cerr << "ERROR: Failed to open ProGuard configuration file " << filename
+         << endl;
+    exit(1);
+  }
+  parse(std::move(lexed.tokens), pg_config, filename);
+}
+
+void parse_file(const std::string& filename,
+                ProguardConfiguration* pg_config,
+                size_t num_threads) {
+  parse_lexed_file(filename, lex_file(filename, pg_config->basedirectory),
+                   pg_config);
+  // The included files get parsed in the order in which they are first
+  // included, which is only known once the files before them are parsed. All
+  // the files included so far can be lexed in parallel though, and configs
+  // that aggregate the rules of many libraries include most of their files
+  // from a few ones.
+  size_t next_include = 0;
+  while (next_include < pg_config->includes.size()) {
+    std::vector<std::string> filenames;
+    for (; next_include < pg_config->includes.size(); ++next_include) {
+      const auto& included_filename = pg_config->includes[next_include];
+      if (pg_config->already_included.emplace(included_filename).second) {
+        filenames.push_back(included_filename);
+      }
+    }
+    std::vector<LexedFile> lexed(filenames.size());
+    const auto& basedirectory = pg_config->basedirectory;
+    auto lex_included_file = [&](size_t i) {
+      lexed[i] = lex_file(filenames[i], basedirectory);
+    };
+    if (num_threads > 1 && filenames.size() > 1) {
+      redex_parallel::parallel_for(0, filenames.size(), lex_included_file,
+                                   num_threads);
+    } else {
+      for (size_t i = 0; i < filenames.size(); ++i) {
+        lex_included_file(i);
+      }
+    }
+    for (size_t i = 0; i < filenames.size(); ++i) {
+      parse_lexed_file(filenames[i], std::move(lexed[i]), pg_config);
     }
-    pg_config->already_included.emplace(included_filename);
-    parse_file(included_filename, pg_config);
   }
 }
 
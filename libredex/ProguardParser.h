@@ -13,11 +13,18 @@
 
 #include "ProguardConfiguration.h"
 #include "ProguardLexer.h"
+#include "WorkQueue.h"
 
 namespace keep_rules {
 namespace proguard_parser {
 
-void parse_file(const std::string& filename, ProguardConfiguration* pg_config);
+/*
+ * Parses the file and the files it includes, which get lexed on up to
+ * `num_threads` threads.
+ */
+void parse_file(const std::string& filename,
+                ProguardConfiguration* pg_config,
+                size_t num_threads = redex_parallel::default_num_threads());
 void parse(istream& config,
            ProguardConfiguration* pg_config,
            const std::string& filename = "");
@@ -6,8 +6,12 @@
  */
 
 #include "ProguardReporting.h"
+
+#include <sstream>
+
 #include "DexClass.h"
 #include "ReachableClasses.h"
+#include "WorkQueue.h"
 
 std::string extract_suffix(std::string class_name) {
   auto i = class_name.find_last_of('.');
@@ -148,7 +152,7 @@ void redex::print_method(std::ostream& output,
         deobfuscate_type_descriptor(pg_map, return_type_desc);
     output << type_descriptor_to_java(deobfu_return_type) << " ";
   }
-  output << method_name << java_args(pg_map, args) << std::endl;
+  output << method_name << java_args(pg_map, args) << '\n';
 }
 
 template <class Container>
@@ -170,7 +174,7 @@ void redex::print_field(std::ostream& output,
       deobfuscate_type_descriptor(pg_map, field_type);
   output << class_name << ": " << type_descriptor_to_java(deobfu_field_type)
          << " " << extract_member_name(field->get_deobfuscated_name())
-         << std::endl;
+         << '\n';
 }
 
 template <class Container>
@@ -193,7 +197,7 @@ void redex::print_class(std::ostream& output,
     deob = cls->get_name()->c_str();
   }
   std::string name = java_names::internal_to_external(deob);
-  output << name << std::endl;
+  output << name << '\n';
   print_fields(output, pg_map, name, cls->get_ifields());
   print_fields(output, pg_map, name, cls->get_sfields());
   print_methods(output, pg_map, name, cls->get_dmethods());
@@ -203,9 +207,34 @@ void redex::print_class(std::ostream& output,
 void redex::print_classes(std::ostream& output,
                           const ProguardMap& pg_map,
                           const Scope& classes) {
-  for (const auto& cls : classes) {
-    if (!cls->is_external()) {
-      redex::print_class(output, pg_map, cls);
+  print_classes_in_parallel(
+      output, classes, [&](std::ostream& os, const DexClass* cls) {
+        if (!cls->is_external()) {
+          redex::print_class(os, pg_map, cls);
+        }
+      });
+}
+
+void redex::print_classes_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(std::ostream&, const DexClass*)>& print_class) {
+  // A few batches per thread balance the load, while keeping the number of
+  // buffers to construct small.
+  size_t num_batches = std::min<size_t>(
+      classes.size(), redex_parallel::default_num_threads() * 4);
+  std::vector<std::string> buffers(num_batches);
+  redex_parallel::parallel_for(0, num_batches, [&](size_t batch) {
+    std::ostringstream os;
+    size_t end = (batch + 1) * classes.size() / num_batches;
+    for (size_t i = batch * classes.size() / num_batches; i < end; ++i) {
+      print_class(os, classes[i]);
     }
+    buffers[batch] = os.str();
+  });
+  for (auto& buffer : buffers) {
+    output << buffer;
+    std::string().swap(buffer);
   }
+  output.flush();
 }
@@ -10,6 +10,7 @@
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "ProguardMap.h"
+#include <functional>
 #include <iostream>
 
 namespace redex {
@@ -43,4 +44,15 @@ void print_class(std::ostream& output,
 void print_classes(std::ostream& output,
                    const ProguardMap& pg_map,
                    const Scope& classes);
+
+/*
+ * Writes what print_class prints for each of the classes to output, in the
+ * order of the classes. The classes are split into contiguous batches that get
+ * printed in parallel, each into a buffer of its own, and the buffers are then
+ * written out in order.
+ */
+void print_classes_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(std::ostream&, const DexClass*)>& print_class);
 } // namespace redex
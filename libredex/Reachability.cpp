@@ -245,10 +245,9 @@ void TransitiveClosureMarker::push(const Parent* parent, const DexClass* cls) {
     return;
   }
   record_reachability(parent, cls);
-  if (m_reachable_objects->marked(cls)) {
+  if (!m_reachable_objects->mark(cls)) {
     return;
   }
-  m_reachable_objects->mark(cls);
   m_worker_state->push_task(ReachableObject(cls));
 }
 
@@ -259,14 +258,13 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, field);
-  if (m_reachable_objects->marked(field)) {
+  if (!m_reachable_objects->mark(field)) {
     return;
   }
   auto f = field->as_def();
   if (f) {
     gather_and_push(f);
   }
-  m_reachable_objects->mark(field);
   m_worker_state->push_task(ReachableObject(field));
 }
 
@@ -277,10 +275,9 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, method);
-  if (m_reachable_objects->marked(method)) {
+  if (!m_reachable_objects->mark(method)) {
     return;
   }
-  m_reachable_objects->mark(method);
   m_worker_state->push_task(ReachableObject(method));
 }
 
@@ -678,7 +675,27 @@ void write_reachable_object(std::ostream& os, const ReachableObject& obj) {
 } // namespace
 
 void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of) {
-  auto compare = [](const ReachableObject& lhs, const ReachableObject& rhs) {
+  // Annotations and seeds only compare by their printed form, which gets
+  // computed once for each of them rather than on every comparison.
+  std::unordered_map<ReachableObject, std::string, ReachableObjectHash> labels;
+  auto add_label = [&](const ReachableObject& obj) {
+    if (obj.type == ReachableObjectType::ANNO ||
+        obj.type == ReachableObjectType::SEED) {
+      if (!labels.count(obj)) {
+        std::ostringstream ss;
+        ss << obj;
+        labels.emplace(obj, ss.str());
+      }
+    }
+  };
+  for (const auto& pair : retainers_of) {
+    add_label(pair.first);
+    for (const auto& pred : pair.second) {
+      add_label(pred);
+    }
+  }
+
+  auto compare = [&](const ReachableObject& lhs, const ReachableObject& rhs) {
     if (lhs.type != rhs.type) {
       return lhs.type < rhs.type;
     }
@@ -691,14 +708,8 @@ void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of) {
       return compare_dexmethods(lhs.method, rhs.method);
 
     case ReachableObjectType::ANNO:
-    case ReachableObjectType::SEED: {
-      // Pretty terrible, optimize.
-      std::ostringstream oss1;
-      oss1 << lhs;
-      std::ostringstream oss2;
-      oss2 << rhs;
-      return oss1.str() < oss2.str();
-    }
+    case ReachableObjectType::SEED:
+      return labels.at(lhs) < labels.at(rhs);
     }
     __builtin_unreachable();
   };
@@ -707,10 +718,11 @@ void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of) {
   bs::GraphWriter<ReachableObject, ReachableObjectHash> gw(
       write_reachable_object,
       [&](const ReachableObject& obj) -> std::vector<ReachableObject> {
-        if (!retainers_of.count(obj)) {
+        auto it = retainers_of.find(obj);
+        if (it == retainers_of.end()) {
           return {};
         }
-        const auto& preds = retainers_of.at(obj);
+        const auto& preds = it->second;
         std::vector<ReachableObject> preds_vec(preds.begin(), preds.end());
         // Gotta sort the reachables or the output is nondeterministic.
         std::sort(preds_vec.begin(), preds_vec.end(), compare);
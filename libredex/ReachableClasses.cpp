@@ -182,7 +182,7 @@ void analyze_reflection(const Scope& scope) {
   };
 
   walk::code(scope, [&](DexMethod* method, IRCode& code) {
-    std::unique_ptr<ReflectionAnalysis> analysis = nullptr;
+    std::shared_ptr<const ReflectionAnalysis> analysis = nullptr;
     for (auto& mie : InstructionIterable(code)) {
       IRInstruction* insn = mie.insn;
       if (!is_invoke(insn->opcode())) {
@@ -204,11 +204,10 @@ void analyze_reflection(const Scope& scope) {
       }
       ReflectionType refl_type = refl_entry->second;
 
-      // Instantiating the analysis object also runs the reflection analysis
-      // on the method. So, we wait until we're sure we need it.
-      // We use a unique_ptr so that we'll still only have one per method.
+      // Getting the analysis object may run the reflection analysis on the
+      // method. So, we wait until we're sure we need it.
       if (!analysis) {
-        analysis = std::make_unique<ReflectionAnalysis>(method);
+        analysis = g_redex->reflection_analysis_cache().get(method);
       }
 
       auto arg_cls = analysis->get_abstract_object(insn->src(0), insn);
@@ -505,14 +504,15 @@ void mark_reachable_by_xml(const std::string& classname) {
 // 2) Marks candidate methods that could be called via android:onClick
 // attributes.
 void analyze_reachable_from_xml_layouts(const Scope& scope,
-                                        const std::string& apk_dir) {
+                                        const std::string& apk_dir,
+                                        const std::string& cache_path = "") {
   std::unordered_set<std::string> layout_classes;
   std::unordered_set<std::string> attrs_to_read;
   // Method names used by reflection
   attrs_to_read.emplace(ONCLICK_ATTRIBUTE);
   std::unordered_multimap<std::string, std::string> attribute_values;
   collect_layout_classes_and_attributes(apk_dir, attrs_to_read, layout_classes,
-                                        attribute_values);
+                                        attribute_values, cache_path);
   for (const std::string& classname : layout_classes) {
     TRACE(PGR, 3, "xml_layout: %s", classname.c_str());
     mark_reachable_by_xml(classname);
@@ -629,6 +629,7 @@ void init_reachable_classes(const Scope& scope, const JsonWrapper& config) {
   std::vector<std::string> reflected_package_names;
   std::vector<std::string> methods;
   std::unordered_set<std::string> prune_unexported_components;
+  std::string layout_scan_cache;
   bool compute_xml_reachability;
   bool analyze_native_lib_reachability;
 
@@ -636,6 +637,8 @@ void init_reachable_classes(const Scope& scope, const JsonWrapper& config) {
   config.get("keep_packages", {}, reflected_package_names);
   config.get("keep_methods", {}, methods);
   config.get("compute_xml_reachability", true, compute_xml_reachability);
+  // Where to keep the results of scanning the layouts, for the next run.
+  config.get("layout_scan_cache", "", layout_scan_cache);
   config.get("prune_unexported_components", {}, prune_unexported_components);
   config.get("analyze_native_lib_reachability", true,
              analyze_native_lib_reachability);
@@ -647,7 +650,7 @@ void init_reachable_classes(const Scope& scope, const JsonWrapper& config) {
       // Classes present in manifest
       analyze_reachable_from_manifest(apk_dir, prune_unexported_components);
       // Classes present in XML layouts
-      analyze_reachable_from_xml_layouts(scope, apk_dir);
+      analyze_reachable_from_xml_layouts(scope, apk_dir, layout_scan_cache);
     }
 
     if (analyze_native_lib_reachability) {
@@ -725,13 +728,13 @@ void recompute_reachable_from_xml_layouts(const Scope& scope,
 
 std::string ReferencedState::str() const {
   std::ostringstream s;
-  s << inner_struct.m_by_string;
-  s << inner_struct.m_by_resources;
-  s << inner_struct.m_is_serde;
-  s << inner_struct.m_keep;
+  s << inner_struct.test(BY_STRING);
+  s << inner_struct.test(BY_RESOURCES);
+  s << inner_struct.test(IS_SERDE);
+  s << inner_struct.test(KEEP);
   s << allowshrinking();
   s << allowobfuscation();
-  s << inner_struct.m_assumenosideeffects;
-  s << inner_struct.m_whyareyoukeeping;
+  s << inner_struct.test(ASSUMENOSIDEEFFECTS);
+  s << inner_struct.test(WHYAREYOUKEEPING);
   return s.str();
 }
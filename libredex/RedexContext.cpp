@@ -7,51 +7,51 @@
 
 #include "RedexContext.h"
 
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
 #include <exception>
 #include <mutex>
 #include <regex>
-#include <unordered_set>
+#include <type_traits>
 
 #include "Debug.h"
 #include "DexCallSite.h"
 #include "DexClass.h"
 #include "DuplicateClasses.h"
+#include "ReflectionAnalysis.h"
+#include "Resolver.h"
+#include "TypeSystem.h"
 
 RedexContext* g_redex;
 
 RedexContext::RedexContext(bool allow_class_duplicates)
-    : m_allow_class_duplicates(allow_class_duplicates) {}
+    : m_resolver_cache(std::make_unique<ResolverCache>()),
+      m_reflection_analysis_cache(
+          std::make_unique<reflection::ReflectionAnalysisCache>()),
+      m_allow_class_duplicates(allow_class_duplicates) {}
 
 RedexContext::~RedexContext() {
-  // Delete DexStrings.
+  // The interned objects below are arena-allocated: run their destructors
+  // where needed, and let the arena release their storage in bulk.
   for (auto const& p : s_string_map) {
-    delete p.second;
-  }
-  // Delete DexTypes.  NB: This table intentionally contains aliases (multiple
-  // DexStrings map to the same DexType), so we have to dedup the set of types
-  // before deleting to avoid double-frees.
-  std::unordered_set<DexType*> delete_types;
-  for (auto const& p : s_type_map) {
-    delete_types.emplace(p.second);
+    p.second->~DexString();
   }
-  for (auto const& t : delete_types) {
-    delete t;
-  }
-  // Delete DexFields.
+  // DexTypes and DexProtos hold nothing but pointers to other interned
+  // objects. Skipping them also spares us from deduplicating the type table,
+  // which intentionally contains aliases (multiple DexStrings map to the same
+  // DexType).
+  static_assert(std::is_trivially_destructible<DexType>::value,
+                "DexTypes are never destroyed");
+  static_assert(std::is_trivially_destructible<DexProto>::value,
+                "DexProtos are never destroyed");
   for (auto const& it : s_field_map) {
-    delete static_cast<DexField*>(it.second);
+    static_cast<DexField*>(it.second)->~DexField();
   }
-  // Delete DexTypeLists.
   for (auto const& p : s_typelist_map) {
-    delete p.second;
+    p.second->~DexTypeList();
   }
-  // Delete DexProtos.
-  for (auto const& p : s_proto_map) {
-    delete p.second;
-  }
-  // Delete DexMethods.
   for (auto const& it : s_method_map) {
-    delete static_cast<DexMethod*>(it.second);
+    static_cast<DexMethod*>(it.second)->~DexMethod();
   }
   // Delete DexClasses.
   for (auto const& it : m_type_to_class) {
@@ -64,58 +64,91 @@ RedexContext::~RedexContext() {
 }
 
 /*
- * Try and insert (:key, :value) into :container. This insertion may fail if
- * another thread has already inserted that key. In that case, return the
- * existing value and discard the one we were trying to insert.
- *
- * We distinguish between the types of the inserted and stored values to handle
- * DexFields and DexMethods, where we upcast the inserted value into a
- * DexFieldRef / DexMethodRef respectively when storing it.
+ * The stats to update for an interning table operation, if enabled.
+ */
+static ConcurrentContainerStats* maybe_stats(ConcurrentContainerStats& stats) {
+  return RedexContext::record_interning_stats() ? &stats : nullptr;
+}
+
+/*
+ * A fast non-cryptographic hash in the style of MurmurHash64A, consuming eight
+ * bytes per step.
  */
-template <class InsertValue,
-          class StoredValue = InsertValue,
-          class Deleter = std::default_delete<InsertValue>,
-          class Key,
-          class Container>
-static StoredValue* try_insert(Key key,
-                               InsertValue* value,
-                               Container* container) {
-  std::unique_ptr<InsertValue, Deleter> to_insert(value);
-  if (container->emplace(key, to_insert.get())) {
-    return to_insert.release();
+static size_t hash_string(const char* str, size_t size) {
+  constexpr uint64_t kMul = 0xc6a4a7935bd1e995ULL;
+  constexpr int kShift = 47;
+  auto mix = [&](uint64_t k) {
+    k *= kMul;
+    k ^= k >> kShift;
+    return k * kMul;
+  };
+  uint64_t h = 0x8445d61a4e774912ULL ^ (size * kMul);
+  const char* end = str + (size & ~size_t(7));
+  for (; str != end; str += 8) {
+    uint64_t k;
+    memcpy(&k, str, sizeof(k));
+    h = (h ^ mix(k)) * kMul;
+  }
+  if (size & 7) {
+    uint64_t k = 0;
+    memcpy(&k, str, size & 7);
+    h = (h ^ k) * kMul;
   }
-  return container->at(key);
+  h ^= h >> kShift;
+  h *= kMul;
+  h ^= h >> kShift;
+  return static_cast<size_t>(h);
 }
 
-DexString* RedexContext::make_string(const char* nstr, uint32_t utfsize) {
+DexString* RedexContext::make_string(const char* nstr,
+                                     uint32_t utfsize,
+                                     bool mapped) {
   always_assert(nstr != nullptr);
-  auto rv = s_string_map.get(nstr, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  // Note that DexStrings are keyed by the c_str() of the underlying
-  // std::string. The c_str is valid until a the string is destroyed, or until a
-  // non-const function is called on the string (but note the std::string itself
-  // is const)
-  auto dexstring = new DexString(nstr, utfsize);
-  return try_insert(dexstring->c_str(), dexstring, &s_string_map);
+  auto size = strlen(nstr);
+  StringKey key{nstr, static_cast<uint32_t>(size), hash_string(nstr, size)};
+  // Note that DexStrings are keyed by their c_str(), which is either the
+  // c_str() of the underlying std::string or the mapped contents. Both are
+  // valid until the string is destroyed: the std::string of a mapped string is
+  // only assigned once, and c_str() keeps pointing into the mapping.
+  return s_string_map.get_or_emplace(
+      key,
+      [&]() {
+        auto dexstring =
+            mapped ? arena_new<DexString>(nstr, static_cast<uint32_t>(size),
+                                          utfsize, key.hash)
+                   : arena_new<DexString>(std::string(nstr, size), utfsize,
+                                          key.hash);
+        return std::make_pair(StringKey{dexstring->c_str(), key.size, key.hash},
+                              dexstring);
+      },
+      maybe_stats(m_interning_stats.strings));
+}
+
+void RedexContext::retain_dex_mapping(
+    std::unique_ptr<boost::iostreams::mapped_file> file) {
+  std::lock_guard<std::mutex> lock(m_dex_mappings_mutex);
+  m_dex_mappings.push_back(std::move(file));
 }
 
 DexString* RedexContext::get_string(const char* nstr, uint32_t utfsize) {
   if (nstr == nullptr) {
     return nullptr;
   }
-  return s_string_map.get(nstr, nullptr);
+  auto size = strlen(nstr);
+  StringKey key{nstr, static_cast<uint32_t>(size), hash_string(nstr, size)};
+  return s_string_map.get(key, nullptr);
 }
 
 DexType* RedexContext::make_type(const DexString* dstring) {
   always_assert(dstring != nullptr);
-  auto rv = s_type_map.get(dstring, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  return try_insert(dstring, new DexType(const_cast<DexString*>(dstring)),
-                    &s_type_map);
+  return s_type_map.get_or_emplace(
+      dstring,
+      [&]() {
+        auto type = arena_new<DexType>(const_cast<DexString*>(dstring));
+        type->m_id = m_num_type_ids.fetch_add(1, std::memory_order_relaxed);
+        return std::make_pair(dstring, type);
+      },
+      maybe_stats(m_interning_stats.types));
 }
 
 DexType* RedexContext::get_type(const DexString* dstring) {
@@ -147,14 +180,17 @@ DexFieldRef* RedexContext::make_field(const DexType* container,
   DexFieldSpec r(const_cast<DexType*>(container),
                  const_cast<DexString*>(name),
                  const_cast<DexType*>(type));
-  auto rv = s_field_map.get(r, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  auto field = new DexField(const_cast<DexType*>(container),
-                            const_cast<DexString*>(name),
-                            const_cast<DexType*>(type));
-  return try_insert<DexField, DexFieldRef>(r, field, &s_field_map);
+  return s_field_map.get_or_emplace(
+      r,
+      [&]() {
+        DexFieldRef* field =
+            arena_new<DexField>(const_cast<DexType*>(container),
+                                const_cast<DexString*>(name),
+                                const_cast<DexType*>(type));
+        field->m_id = m_num_field_ids.fetch_add(1, std::memory_order_relaxed);
+        return std::make_pair(r, field);
+      },
+      maybe_stats(m_interning_stats.fields));
 }
 
 DexFieldRef* RedexContext::get_field(const DexType* container,
@@ -171,13 +207,13 @@ DexFieldRef* RedexContext::get_field(const DexType* container,
 
 void RedexContext::erase_field(DexFieldRef* field) {
   s_field_map.erase(field->m_spec);
+  report_class_hierarchy_change();
 }
 
 void RedexContext::mutate_field(DexFieldRef* field,
                                 const DexFieldSpec& ref,
                                 bool rename_on_collision,
                                 bool update_deobfuscated_name) {
-  std::lock_guard<std::mutex> lock(s_field_lock);
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
@@ -185,32 +221,36 @@ void RedexContext::mutate_field(DexFieldRef* field,
   r.type = ref.type != nullptr ? ref.type : field->m_spec.type;
   field->m_spec = r;
 
-  if (rename_on_collision && s_field_map.find(r) != s_field_map.end()) {
+  // Claiming the new signature is a single insert-if-absent, so concurrent
+  // mutations of different fields do not need to be serialized.
+  bool inserted = s_field_map.emplace(r, field);
+  if (!inserted && rename_on_collision) {
     uint32_t i = 0;
-    while (true) {
+    while (!inserted) {
       r.name = DexString::make_string(("f$" + std::to_string(i++)).c_str());
-      if (s_field_map.find(r) == s_field_map.end()) {
-        break;
-      }
+      inserted = s_field_map.emplace(r, field);
     }
   }
-  always_assert_log(s_field_map.find(r) == s_field_map.end(),
+  always_assert_log(inserted,
                     "Another field with the same signature already exists %s",
                     SHOW(s_field_map.at(r)));
-  s_field_map.emplace(r, field);
 
   if (field->is_def() && update_deobfuscated_name) {
     static_cast<DexField*>(field)->set_deobfuscated_name(show(field));
   }
+  if (field->is_def()) {
+    report_class_hierarchy_change();
+  }
 }
 
 DexTypeList* RedexContext::make_type_list(std::deque<DexType*>&& p) {
-  auto rv = s_typelist_map.get(p, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  auto typelist = new DexTypeList(std::move(p));
-  return try_insert(typelist->m_list, typelist, &s_typelist_map);
+  return s_typelist_map.get_or_emplace(
+      p,
+      [&]() {
+        auto typelist = arena_new<DexTypeList>(std::move(p));
+        return std::make_pair(typelist->m_list, typelist);
+      },
+      maybe_stats(m_interning_stats.type_lists));
 }
 
 DexTypeList* RedexContext::get_type_list(std::deque<DexType*>&& p) {
@@ -222,15 +262,15 @@ DexProto* RedexContext::make_proto(const DexType* rtype,
                                    const DexString* shorty) {
   always_assert(rtype != nullptr && args != nullptr && shorty != nullptr);
   ProtoKey key(rtype, args);
-  auto rv = s_proto_map.get(key, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  return try_insert(key,
-                    new DexProto(const_cast<DexType*>(rtype),
-                                 const_cast<DexTypeList*>(args),
-                                 const_cast<DexString*>(shorty)),
-                    &s_proto_map);
+  return s_proto_map.get_or_emplace(
+      key,
+      [&]() {
+        auto proto = arena_new<DexProto>(const_cast<DexType*>(rtype),
+                                         const_cast<DexTypeList*>(args),
+                                         const_cast<DexString*>(shorty));
+        return std::make_pair(key, proto);
+      },
+      maybe_stats(m_interning_stats.protos));
 }
 
 DexProto* RedexContext::get_proto(const DexType* rtype,
@@ -252,12 +292,15 @@ DexMethodRef* RedexContext::make_method(const DexType* type_,
   auto proto = const_cast<DexProto*>(proto_);
   always_assert(type != nullptr && name != nullptr && proto != nullptr);
   DexMethodSpec r(type, name, proto);
-  auto rv = s_method_map.get(r, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  return try_insert<DexMethod, DexMethodRef, DexMethod::Deleter>(
-      r, new DexMethod(type, name, proto), &s_method_map);
+  return s_method_map.get_or_emplace(
+      r,
+      [&]() {
+        DexMethodRef* method = arena_new<DexMethod>(type, name, proto);
+        method->m_id =
+            m_num_method_ids.fetch_add(1, std::memory_order_relaxed);
+        return std::make_pair(r, method);
+      },
+      maybe_stats(m_interning_stats.methods));
 }
 
 DexMethodRef* RedexContext::get_method(const DexType* type,
@@ -273,6 +316,7 @@ DexMethodRef* RedexContext::get_method(const DexType* type,
 
 void RedexContext::erase_method(DexMethodRef* method) {
   s_method_map.erase(method->m_spec);
+  report_class_hierarchy_change();
 }
 
 // TODO: Need a better interface.
@@ -280,7 +324,6 @@ void RedexContext::mutate_method(DexMethodRef* method,
                                  const DexMethodSpec& new_spec,
                                  bool rename_on_collision,
                                  bool update_deobfuscated_name) {
-  std::lock_guard<std::mutex> lock(s_method_lock);
   DexMethodSpec old_spec = method->m_spec;
   s_method_map.erase(method->m_spec);
 
@@ -289,7 +332,10 @@ void RedexContext::mutate_method(DexMethodRef* method,
   r.name = new_spec.name != nullptr ? new_spec.name : method->m_spec.name;
   r.proto = new_spec.proto != nullptr ? new_spec.proto : method->m_spec.proto;
 
-  if (s_method_map.count(r) && rename_on_collision) {
+  // Claiming the new signature is a single insert-if-absent, so concurrent
+  // mutations of different methods do not need to be serialized.
+  bool inserted = s_method_map.emplace(r, method);
+  if (!inserted && rename_on_collision) {
     // Never rename constructors, which causes runtime verification error:
     // "Method 42(Foo;.$init$$0) is marked constructor, but doesn't match name"
     always_assert_log(
@@ -316,7 +362,8 @@ void RedexContext::mutate_method(DexMethodRef* method,
       }
       do {
         r.name = DexString::make_string((prefix + std::to_string(i++)).c_str());
-      } while (s_method_map.count(r));
+        inserted = s_method_map.emplace(r, method);
+      } while (!inserted);
     } else {
       // We are about to change its class. Use a better name to remember its
       // original source class on a collision. Tokenize the class name into
@@ -343,7 +390,8 @@ void RedexContext::mutate_method(DexMethodRef* method,
       for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
         ss << "$" << *part;
         r.name = DexString::make_string(ss.str());
-        if (!s_method_map.count(r)) {
+        inserted = s_method_map.emplace(r, method);
+        if (inserted) {
           break;
         }
       }
@@ -351,14 +399,10 @@ void RedexContext::mutate_method(DexMethodRef* method,
   }
 
   // We might still miss name collision cases. As of now, let's just assert.
-  if (s_method_map.count(r)) {
-    auto& m = *s_method_map.find(r)->second;
-    always_assert_log(!s_method_map.count(r),
-                      "Another method of the same signature already exists %s"
-                      " %s %s",
-                      SHOW(r.cls), SHOW(r.name), SHOW(r.proto));
-  }
-  s_method_map.emplace(r, method);
+  always_assert_log(inserted,
+                    "Another method of the same signature already exists %s"
+                    " %s %s",
+                    SHOW(r.cls), SHOW(r.name), SHOW(r.proto));
 
   // We just updated DexMethodSpec, which will update this method's name.
   // But we also need to update deobfuscated names properly, except for the
@@ -369,6 +413,9 @@ void RedexContext::mutate_method(DexMethodRef* method,
     // the name from its DexMethodSpec. We can safely use here.
     static_cast<DexMethod*>(method)->set_deobfuscated_name(show(method));
   }
+  if (method->is_def()) {
+    report_class_hierarchy_change();
+  }
 }
 
 // Return false on unique classes
@@ -416,6 +463,38 @@ void RedexContext::publish_class(DexClass* cls) {
   if (cls->is_external()) {
     m_external_classes.emplace_back(cls);
   }
+  report_class_hierarchy_change();
+}
+
+void RedexContext::publish_classes(const std::vector<DexClass*>& classes) {
+  std::lock_guard<std::mutex> l(m_type_system_mutex);
+  m_type_to_class.reserve(m_type_to_class.size() + classes.size());
+  for (auto* cls : classes) {
+    bool insertion_took_place =
+        m_type_to_class.emplace(cls->get_type(), cls).second;
+    always_assert(insertion_took_place);
+    if (cls->is_external()) {
+      m_external_classes.emplace_back(cls);
+    }
+  }
+  report_class_hierarchy_change();
+}
+
+std::shared_ptr<const TypeSystem> RedexContext::get_type_system(
+    const std::vector<DexClass*>& scope) {
+  size_t scope_hash = boost::hash_range(scope.begin(), scope.end());
+  std::lock_guard<std::mutex> l(m_cached_type_system_mutex);
+  // Read the version before building, so that changes made while building
+  // (by other threads) invalidate the result.
+  size_t version = m_class_hierarchy_version;
+  if (m_cached_type_system == nullptr ||
+      m_cached_type_system_version != version ||
+      m_cached_type_system_scope_hash != scope_hash) {
+    m_cached_type_system = std::make_shared<const TypeSystem>(scope);
+    m_cached_type_system_version = version;
+    m_cached_type_system_scope_hash = scope_hash;
+  }
+  return m_cached_type_system;
 }
 
 DexClass* RedexContext::type_class(const DexType* t) {
@@ -8,17 +8,20 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <boost/functional/hash.hpp>
 #include <cstring>
 #include <deque>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
 
+#include "Arena.h"
 #include "ConcurrentContainers.h"
 #include "DexMemberRefs.h"
 #include "KeepReason.h"
@@ -33,22 +36,34 @@ class DexProto;
 class DexMethodRef;
 class DexMethodHandle;
 class DexClass;
+class ResolverCache;
+class TypeSystem;
 struct DexFieldSpec;
 struct DexDebugEntry;
 struct DexPosition;
 struct RedexContext;
 
-extern RedexContext* g_redex;
+namespace boost {
+namespace iostreams {
+class mapped_file;
+} // namespace iostreams
+} // namespace boost
+
+namespace reflection {
+class ReflectionAnalysisCache;
+} // namespace reflection
 
-#if defined(__SSE4_2__) && defined(__linux__) && defined(__STRCMP_LESS__)
-extern "C" bool strcmp_less(const char* str1, const char* str2);
-#endif
+extern RedexContext* g_redex;
 
 struct RedexContext {
   RedexContext(bool allow_class_duplicates = false);
   ~RedexContext();
 
-  DexString* make_string(const char* nstr, uint32_t utfsize);
+  // A `mapped` string refers to the given contents, when it is created, rather
+  // than copying them.
+  DexString* make_string(const char* nstr,
+                         uint32_t utfsize,
+                         bool mapped = false);
   DexString* get_string(const char* nstr, uint32_t utfsize);
 
   DexType* make_type(const DexString* dstring);
@@ -114,6 +129,23 @@ struct RedexContext {
 
   void publish_class(DexClass* cls);
 
+  /*
+   * Interned types and member references get dense ids in creation order, so
+   * that analyses can keep side tables of them in vectors; see IdMap. These
+   * are the numbers of ids given out so far.
+   */
+  uint32_t num_type_ids() const {
+    return m_num_type_ids.load(std::memory_order_relaxed);
+  }
+  uint32_t num_field_ids() const {
+    return m_num_field_ids.load(std::memory_order_relaxed);
+  }
+  uint32_t num_method_ids() const {
+    return m_num_method_ids.load(std::memory_order_relaxed);
+  }
+  // Publishes several classes under a single acquisition of the lock.
+  void publish_classes(const std::vector<DexClass*>& classes);
+
   DexClass* type_class(const DexType* t);
   template <class TypeClassWalkerFn = void(const DexType*, const DexClass*)>
   void walk_type_class(TypeClassWalkerFn walker) {
@@ -126,6 +158,33 @@ struct RedexContext {
     return m_external_classes;
   }
 
+  /*
+   * A TypeSystem of `scope`, built once and then shared by everyone asking
+   * for one of the same classes, until the class hierarchy changes. The
+   * mutators of DexClass, DexMethod and DexField that change it --
+   * superclasses, interfaces, adding, removing or renaming members -- and
+   * publish_class() report their changes themselves; code that changes the
+   * hierarchy by other means, e.g. by editing the member lists of a class in
+   * place, must call report_class_hierarchy_change().
+   *
+   * Holders of a TypeSystem keep it alive, but it doesn't follow the changes
+   * made after they got it.
+   */
+  std::shared_ptr<const TypeSystem> get_type_system(
+      const std::vector<DexClass*>& scope);
+
+  void report_class_hierarchy_change() { ++m_class_hierarchy_version; }
+
+  size_t class_hierarchy_version() const { return m_class_hierarchy_version; }
+
+  // See Resolver.h.
+  ResolverCache& resolver_cache() { return *m_resolver_cache; }
+
+  // See ReflectionAnalysis.h.
+  reflection::ReflectionAnalysisCache& reflection_analysis_cache() {
+    return *m_reflection_analysis_cache;
+  }
+
   /*
    * This returns true if we want to preserve keep reasons for better
    * diagnostics.
@@ -135,10 +194,58 @@ struct RedexContext {
     g_redex->m_record_keep_reasons = v;
   }
 
+  /*
+   * When set, loaded methods keep their DexCode until a pass first accesses
+   * their code; see DexMethod::balloon_lazily().
+   */
+  static bool lazy_balloon() { return g_redex->m_lazy_balloon; }
+  static void set_lazy_balloon(bool v) { g_redex->m_lazy_balloon = v; }
+
+  /*
+   * When set, DexStrings loaded from dex files point straight into the
+   * read-only mapping of their dex, which then stays mapped until the context
+   * is destroyed. Their contents are only copied if a caller asks for
+   * DexString::str(). The mapped pages are clean, so the kernel can drop
+   * them under memory pressure and page them back in on demand.
+   */
+  static bool map_dex_strings() { return g_redex->m_map_dex_strings; }
+  static void set_map_dex_strings(bool v) { g_redex->m_map_dex_strings = v; }
+
+  // Keep a dex mapping alive for as long as the strings that refer to it.
+  void retain_dex_mapping(std::unique_ptr<boost::iostreams::mapped_file> file);
+
+  /*
+   * Lock statistics of the interning tables, to measure contention between
+   * threads creating strings, types, and member references. These are only
+   * recorded when enabled, as the counters are shared by all threads.
+   */
+  struct InterningStats {
+    ConcurrentContainerStats strings;
+    ConcurrentContainerStats types;
+    ConcurrentContainerStats fields;
+    ConcurrentContainerStats type_lists;
+    ConcurrentContainerStats protos;
+    ConcurrentContainerStats methods;
+  };
+
+  static bool record_interning_stats() {
+    return g_redex->m_record_interning_stats;
+  }
+  static void set_record_interning_stats(bool v) {
+    g_redex->m_record_interning_stats = v;
+  }
+  const InterningStats& interning_stats() const { return m_interning_stats; }
+
   template <class... Args>
   static keep_reason::Reason* make_keep_reason(Args&&... args) {
-    auto to_insert =
-        std::make_unique<keep_reason::Reason>(std::forward<Args>(args)...);
+    // Most reasons exist already, e.g. the keep rules that match many members,
+    // so they only get allocated when they are new.
+    keep_reason::Reason key(std::forward<Args>(args)...);
+    auto existing = g_redex->s_keep_reasons.get(&key, nullptr);
+    if (existing != nullptr) {
+      return existing;
+    }
+    auto to_insert = std::make_unique<keep_reason::Reason>(key);
     if (g_redex->s_keep_reasons.emplace(to_insert.get(), to_insert.get())) {
       return to_insert.release();
     }
@@ -146,77 +253,86 @@ struct RedexContext {
   }
 
  private:
-  struct Strcmp;
-  struct TruncatedStringHash;
-
-  // We use this instead of an unordered_map-based ConcurrentMap because
-  // hashing is expensive on large strings -- it has to hash the entire key to
-  // find its bucket. An std::map (i.e. a tree) performs better with large keys
-  // in a sparse keyset because it only needs to find the first character that
-  // differs between keys when traversing the tree, meaning that it usually
-  // doesn't need to examine the entire key for insertions.
+  // The interning tables are hit by every thread creating references, so they
+  // get many more slots (and thus locks) than the default.
+  static constexpr size_t kInterningSlots = 1021;
+
+  template <typename Key,
+            typename Value,
+            typename Hash = std::hash<Key>,
+            typename Equal = std::equal_to<Key>>
+  using ConcurrentInterningMap =
+      ConcurrentMap<Key, Value, Hash, Equal, kInterningSlots>;
+
+  // Strings are interned in a hash table keyed by their full contents. The
+  // hash is computed once per lookup, word by word, and kept in the key (and
+  // in the DexString), so that neither sharding, bucketing nor rehashing need
+  // to look at the characters again. Equal keys are nearly always found on the
+  // first comparison, and differing lengths or hashes reject most others
+  // without touching the contents at all.
   //
-  // We still need to do hashing in order to shard the keys across the
-  // individually-locked std::maps, but it suffices to hash a substring for this
-  // purpose.
-  template <typename Value, size_t n_slots = 31>
-  using ConcurrentLargeStringMap =
-      ConcurrentMapContainer<std::map<const char*, Value, Strcmp>,
-                             const char*,
-                             Value,
-                             TruncatedStringHash,
-                             n_slots>;
-
-  struct Strcmp {
-    bool operator()(const char* a, const char* b) const {
-#if defined(__SSE4_2__) && defined(__linux__) && defined(__STRCMP_LESS__)
-      return strcmp_less(a, b);
-#else
-      return strcmp(a, b) < 0;
-#endif
+  // This used to be a std::map ordered by strcmp, which needs O(log n) string
+  // comparisons per lookup. No caller relies on the order of this table; the
+  // order of DexStrings is defined by compare_dexstrings.
+  struct StringKey {
+    const char* str;
+    uint32_t size;
+    size_t hash;
+
+    bool operator==(const StringKey& other) const {
+      return hash == other.hash && size == other.size &&
+             memcmp(str, other.str, size) == 0;
     }
   };
 
-  // Hash an 8-byte subsequence of a given string, offset by 32 bytes from the
-  // start. Dex files tend to contain many strings with the same prefixes,
-  // because every class / method under a given package will share the same
-  // prefix. The offset ensures that we have more unique subsequences to hash.
-  //
-  // XXX(jezng): 32 was picked fairly arbitrarily; testing showed that it was
-  // definitely better than 0, but I did not test any numbers in between.
-  struct TruncatedStringHash {
-    size_t operator()(const char* s) {
-      constexpr size_t hash_prefix_len = 8;
-      constexpr size_t offset = 32;
-      size_t len = strnlen(s, offset + hash_prefix_len);
-      size_t start = std::max<int64_t>(0, int64_t(len - hash_prefix_len));
-      return boost::hash_range(s + start, s + len);
-    }
+  struct StringKeyHash {
+    size_t operator()(const StringKey& key) const { return key.hash; }
   };
 
+  /*
+   * Interned strings, types, type lists, protos and member references live
+   * until the context is destroyed, so they are carved out of an arena rather
+   * than allocated individually. The caller constructs objects with private
+   * constructors itself, as the arena is not their friend.
+   */
+  template <typename T, typename... Args>
+  T* arena_new(Args&&... args) {
+    return new (m_arena.allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  ConcurrentArena<> m_arena;
+
   // DexString
-  ConcurrentLargeStringMap<DexString*> s_string_map;
+  ConcurrentInterningMap<StringKey, DexString*, StringKeyHash> s_string_map;
 
   // DexType
-  ConcurrentMap<const DexString*, DexType*> s_type_map;
+  ConcurrentInterningMap<const DexString*, DexType*> s_type_map;
 
   // DexFieldRef
-  ConcurrentMap<DexFieldSpec, DexFieldRef*> s_field_map;
-  std::mutex s_field_lock;
+  ConcurrentInterningMap<DexFieldSpec, DexFieldRef*> s_field_map;
 
   // DexTypeList
-  ConcurrentMap<std::deque<DexType*>,
-                DexTypeList*,
-                boost::hash<std::deque<DexType*>>>
+  ConcurrentInterningMap<std::deque<DexType*>,
+                         DexTypeList*,
+                         boost::hash<std::deque<DexType*>>>
       s_typelist_map;
 
   // DexProto
   using ProtoKey = std::pair<const DexType*, const DexTypeList*>;
-  ConcurrentMap<ProtoKey, DexProto*, boost::hash<ProtoKey>> s_proto_map;
+  ConcurrentInterningMap<ProtoKey, DexProto*, boost::hash<ProtoKey>>
+      s_proto_map;
 
   // DexMethod
-  ConcurrentMap<DexMethodSpec, DexMethodRef*> s_method_map;
-  std::mutex s_method_lock;
+  ConcurrentInterningMap<DexMethodSpec, DexMethodRef*> s_method_map;
+
+  // See num_type_ids().
+  std::atomic<uint32_t> m_num_type_ids{0};
+  std::atomic<uint32_t> m_num_field_ids{0};
+  std::atomic<uint32_t> m_num_method_ids{0};
+
+  InterningStats m_interning_stats;
+  bool m_record_interning_stats{false};
 
   // Type-to-class map
   std::mutex m_type_system_mutex;
@@ -225,6 +341,17 @@ struct RedexContext {
 
   const std::vector<const DexType*> m_empty_types;
 
+  // See get_type_system().
+  std::atomic<size_t> m_class_hierarchy_version{0};
+  std::mutex m_cached_type_system_mutex;
+  std::shared_ptr<const TypeSystem> m_cached_type_system;
+  size_t m_cached_type_system_version{0};
+  size_t m_cached_type_system_scope_hash{0};
+
+  std::unique_ptr<ResolverCache> m_resolver_cache;
+  std::unique_ptr<reflection::ReflectionAnalysisCache>
+      m_reflection_analysis_cache;
+
   ConcurrentMap<keep_reason::Reason*,
                 keep_reason::Reason*,
                 keep_reason::ReasonPtrHash,
@@ -232,6 +359,10 @@ struct RedexContext {
       s_keep_reasons;
 
   bool m_record_keep_reasons{false};
+  bool m_lazy_balloon{false};
+  bool m_map_dex_strings{false};
+  std::mutex m_dex_mappings_mutex;
+  std::vector<std::unique_ptr<boost::iostreams::mapped_file>> m_dex_mappings;
   bool m_allow_class_duplicates;
 };
 
@@ -7,6 +7,8 @@
 
 #include "RedexResources.h"
 
+#include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
@@ -46,7 +48,11 @@
 #include <json/json.h>
 
 #include "Debug.h"
+#include "S_Expression.h"
+#include "Sha1.h"
 #include "StringUtil.h"
+#include "Trace.h"
+#include "WorkQueue.h"
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
@@ -780,11 +786,13 @@ std::unordered_set<uint32_t> get_resources_by_name_prefix(
     const std::map<std::string, std::vector<uint32_t>>& name_to_ids) {
   std::unordered_set<uint32_t> found_resources;
 
-  for (const auto& pair : name_to_ids) {
-    for (const auto& prefix : prefixes) {
-      if (boost::algorithm::starts_with(pair.first, prefix)) {
-        found_resources.insert(pair.second.begin(), pair.second.end());
-      }
+  // The names that start with a prefix are adjacent in the sorted map.
+  for (const auto& prefix : prefixes) {
+    for (auto it = name_to_ids.lower_bound(prefix);
+         it != name_to_ids.end() &&
+         boost::algorithm::starts_with(it->first, prefix);
+         ++it) {
+      found_resources.insert(it->second.begin(), it->second.end());
     }
   }
 
@@ -838,16 +846,22 @@ bool is_drawable_attribute(android::ResXMLTree& parser, size_t attr_index) {
   return false;
 }
 
+namespace {
+
+/*
+ * Inlines the reference attributes of the binary XML in `data` whose values
+ * are keys of id_to_inline_value, in place. Returns the number of values
+ * inlined.
+ */
 int inline_xml_reference_attributes(
+    void* data,
+    size_t len,
     const std::string& filename,
     const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
   int num_values_inlined = 0;
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
 
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(data, len);
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -877,7 +891,6 @@ int inline_xml_reference_attributes(
             android::Res_value new_value = p->second;
             parser.setAttribute(i, new_value);
             ++num_values_inlined;
-            made_change = true;
           }
         }
       }
@@ -885,10 +898,21 @@ int inline_xml_reference_attributes(
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
 
-  if (made_change) {
+  return num_values_inlined;
+}
+
+} // namespace
+
+int inline_xml_reference_attributes(
+    const std::string& filename,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  std::string file_contents = read_entire_file(filename);
+  ensure_file_contents(file_contents, filename);
+  int num_values_inlined = inline_xml_reference_attributes(
+      &file_contents[0], file_contents.size(), filename, id_to_inline_value);
+  if (num_values_inlined > 0) {
     write_entire_file(filename, file_contents);
   }
-
   return num_values_inlined;
 }
 
@@ -988,15 +1012,190 @@ void collect_layout_classes_and_attributes_for_file(
                               out_attributes);
 }
 
+namespace {
+
+struct LayoutScanResult {
+  std::unordered_set<std::string> classes;
+  std::unordered_multimap<std::string, std::string> attributes;
+};
+
+std::string hash_contents(const std::string& contents) {
+  Sha1Context context;
+  sha1_init(&context);
+  sha1_update(&context, reinterpret_cast<const uint8_t*>(contents.data()),
+              contents.size());
+  uint8_t digest[20];
+  sha1_final(digest, &context);
+  static const char* kHexDigits = "0123456789abcdef";
+  std::string hex;
+  for (auto byte : digest) {
+    hex.push_back(kHexDigits[byte >> 4]);
+    hex.push_back(kHexDigits[byte & 0xf]);
+  }
+  return hex;
+}
+
+/*
+ * The results of scanning the layouts of a previous run, per layout path
+ * relative to the APK directory, along with the hash of the contents they
+ * were computed from. The results also depend on the attributes that were
+ * read, so a cache that was written for other attributes is ignored.
+ */
+class LayoutScanCache {
+ public:
+  LayoutScanCache(std::string path,
+                  const std::unordered_set<std::string>& attributes_to_read)
+      : m_path(std::move(path)) {
+    std::vector<std::string> attributes(attributes_to_read.begin(),
+                                        attributes_to_read.end());
+    std::sort(attributes.begin(), attributes.end());
+    std::vector<sparta::s_expr> header{sparta::s_expr("layouts-v1")};
+    for (const auto& attribute : attributes) {
+      header.emplace_back(attribute);
+    }
+    m_header = sparta::s_expr(header);
+  }
+
+  void load() {
+    std::ifstream input(m_path);
+    if (!input) {
+      TRACE(MAIN, 1, "No layout cache at %s", m_path.c_str());
+      return;
+    }
+    sparta::s_expr_istream s_expr_input(input);
+    sparta::s_expr header;
+    s_expr_input >> header;
+    if (s_expr_input.fail() || header != m_header) {
+      TRACE(MAIN, 1, "Ignoring the stale layout cache at %s", m_path.c_str());
+      return;
+    }
+    while (s_expr_input.good()) {
+      sparta::s_expr expr;
+      s_expr_input >> expr;
+      if (s_expr_input.eoi()) {
+        break;
+      }
+      always_assert_log(!s_expr_input.fail(), "%s\n",
+                        s_expr_input.what().c_str());
+      auto& entry = m_entries[expr[0].get_string()];
+      entry.first = expr[1].get_string();
+      for (size_t i = 0; i < expr[2].size(); ++i) {
+        entry.second.classes.emplace(expr[2][i].get_string());
+      }
+      for (size_t i = 0; i < expr[3].size(); ++i) {
+        entry.second.attributes.emplace(expr[3][i][0].get_string(),
+                                        expr[3][i][1].get_string());
+      }
+    }
+  }
+
+  const LayoutScanResult* find(const std::string& relative_path,
+                               const std::string& hash) const {
+    auto it = m_entries.find(relative_path);
+    if (it == m_entries.end() || it->second.first != hash) {
+      return nullptr;
+    }
+    return &it->second.second;
+  }
+
+  // Replaces the cache file with the given entries, sorted by path so that
+  // the output is deterministic.
+  void store(const std::map<std::string,
+                            std::pair<std::string, const LayoutScanResult*>>&
+                 entries) const {
+    auto tmp_path = m_path + ".tmp";
+    {
+      std::ofstream output(tmp_path);
+      always_assert_log(output, "Cannot write to %s", tmp_path.c_str());
+      output << m_header << std::endl;
+      for (const auto& pair : entries) {
+        const auto& result = *pair.second.second;
+        std::vector<std::string> classes(result.classes.begin(),
+                                         result.classes.end());
+        std::sort(classes.begin(), classes.end());
+        std::vector<sparta::s_expr> class_exprs;
+        for (const auto& cls : classes) {
+          class_exprs.emplace_back(cls);
+        }
+        std::vector<std::pair<std::string, std::string>> attributes(
+            result.attributes.begin(), result.attributes.end());
+        std::sort(attributes.begin(), attributes.end());
+        std::vector<sparta::s_expr> attribute_exprs;
+        for (const auto& attribute : attributes) {
+          attribute_exprs.emplace_back(
+              std::vector<sparta::s_expr>{sparta::s_expr(attribute.first),
+                                          sparta::s_expr(attribute.second)});
+        }
+        output << sparta::s_expr({sparta::s_expr(pair.first),
+                                  sparta::s_expr(pair.second.first),
+                                  sparta::s_expr(class_exprs),
+                                  sparta::s_expr(attribute_exprs)})
+               << std::endl;
+      }
+    }
+    always_assert_log(std::rename(tmp_path.c_str(), m_path.c_str()) == 0,
+                      "Cannot write to %s", m_path.c_str());
+  }
+
+ private:
+  std::string m_path;
+  sparta::s_expr m_header;
+  std::unordered_map<std::string, std::pair<std::string, LayoutScanResult>>
+      m_entries;
+};
+
+} // namespace
+
 void collect_layout_classes_and_attributes(
     const std::string& apk_directory,
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
-    std::unordered_multimap<std::string, std::string>& out_attributes) {
+    std::unordered_multimap<std::string, std::string>& out_attributes,
+    const std::string& cache_path) {
   std::vector<std::string> files = find_layout_files(apk_directory);
-  for (const auto& layout_file : files) {
-    collect_layout_classes_and_attributes_for_file(
-        layout_file, attributes_to_read, out_classes, out_attributes);
+  std::unique_ptr<LayoutScanCache> cache;
+  if (!cache_path.empty()) {
+    cache = std::make_unique<LayoutScanCache>(cache_path, attributes_to_read);
+    cache->load();
+  }
+
+  // The layouts are scanned in parallel, each into its own result. The
+  // results are merged in the order of the files afterwards, so that the
+  // order of the attribute values doesn't depend on thread scheduling.
+  std::vector<LayoutScanResult> results(files.size());
+  std::vector<std::string> hashes(cache ? files.size() : 0);
+  std::vector<const LayoutScanResult*> cached(files.size(), nullptr);
+  std::atomic<size_t> num_reused{0};
+  redex_parallel::parallel_for(0, files.size(), [&](size_t i) {
+    std::string contents = read_entire_file(files[i]);
+    if (cache) {
+      hashes[i] = hash_contents(contents);
+      auto relative_path = files[i].substr(apk_directory.size());
+      cached[i] = cache->find(relative_path, hashes[i]);
+      if (cached[i] != nullptr) {
+        num_reused.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    extract_classes_from_layout(contents, attributes_to_read,
+                                results[i].classes, results[i].attributes);
+  });
+
+  std::map<std::string, std::pair<std::string, const LayoutScanResult*>>
+      entries;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto& result = cached[i] != nullptr ? *cached[i] : results[i];
+    out_classes.insert(result.classes.begin(), result.classes.end());
+    out_attributes.insert(result.attributes.begin(), result.attributes.end());
+    if (cache) {
+      entries.emplace(files[i].substr(apk_directory.size()),
+                      std::make_pair(hashes[i], &result));
+    }
+  }
+  if (cache) {
+    TRACE(MAIN, 1, "Reused the scans of %zu of %zu layouts from %s",
+          num_reused.load(), files.size(), cache_path.c_str());
+    cache->store(entries);
   }
 }
 
@@ -1100,6 +1299,18 @@ size_t write_serialized_data(const android::Vector<char>& cVec,
                              void* file_pointer,
                              size_t length) {
   size_t vec_size = cVec.size();
+  if (vec_size > length) {
+    // A mapping doesn't grow with its file, so map the grown file again.
+    munmap(file_pointer, length);
+    ftruncate(file_descriptor, vec_size);
+    length = vec_size;
+    file_pointer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        file_descriptor, 0);
+    if (file_pointer == MAP_FAILED) {
+      close(file_descriptor);
+      throw std::runtime_error("Failed to mmap file");
+    }
+  }
   if (vec_size > 0) {
     memcpy(file_pointer, &(cVec[0]), vec_size);
   }
@@ -1230,6 +1441,64 @@ int rename_classes_in_layout(
   return android::OK;
 }
 
+XmlFileEditStats rewrite_xml_files(const std::vector<std::string>& files,
+                                   const XmlFileEdits& edits) {
+  std::atomic<size_t> files_changed{0};
+  std::atomic<size_t> strings_renamed{0};
+  std::atomic<size_t> values_inlined{0};
+  std::atomic<ssize_t> size_delta{0};
+  redex_parallel::parallel_for(0, files.size(), [&](size_t i) {
+    const auto& path = files[i];
+    if (is_raw_resource(path)) {
+      return;
+    }
+    int file_desc;
+    size_t len;
+    auto fp = map_file(path.c_str(), &file_desc, &len, true);
+
+    // Inlining only changes attribute values, so it is written through the
+    // mapping before the string pool is rebuilt from it.
+    size_t num_inlined = 0;
+    if (!edits.inline_values.empty()) {
+      num_inlined = inline_xml_reference_attributes(fp, len, path,
+                                                    edits.inline_values);
+    }
+    size_t num_renamed = 0;
+    android::Vector<char> serialized;
+    if (!edits.class_renames.empty()) {
+      auto status = replace_in_xml_string_pool(
+          fp, len, edits.class_renames, &serialized, &num_renamed);
+      if (status != android::OK) {
+        TRACE(MAIN, 2, "Unable to rename classes in %s: %d", path.c_str(),
+              status);
+        num_renamed = 0;
+      }
+    }
+
+    if (num_renamed > 0) {
+      write_serialized_data(serialized, file_desc, fp, len);
+      size_delta += static_cast<ssize_t>(serialized.size()) -
+                    static_cast<ssize_t>(len);
+    } else {
+      unmap_and_close(file_desc, fp, len);
+    }
+    TRACE(MAIN, 3, "Renamed %zu strings and inlined %zu values in %s",
+          num_renamed, num_inlined, path.c_str());
+    if (num_renamed > 0 || num_inlined > 0) {
+      files_changed++;
+    }
+    strings_renamed += num_renamed;
+    values_inlined += num_inlined;
+  });
+
+  XmlFileEditStats stats;
+  stats.files_changed = files_changed;
+  stats.strings_renamed = strings_renamed;
+  stats.values_inlined = values_inlined;
+  stats.size_delta = size_delta;
+  return stats;
+}
+
 ResourcesArscFile::ResourcesArscFile(const std::string& path) {
   m_arsc_ptr = map_file(path.c_str(), &m_arsc_fd, &m_arsc_len, true);
 
@@ -1241,6 +1510,7 @@ ResourcesArscFile::ResourcesArscFile(const std::string& path) {
   res_table.getResourceIds(&sorted_res_ids);
 
   // Build up maps to/from resource ID's and names
+  id_to_name.reserve(sorted_res_ids.size());
   for (size_t index = 0; index < sorted_res_ids.size(); ++index) {
     uint32_t id = sorted_res_ids[index];
     android::ResTable::resource_name name;
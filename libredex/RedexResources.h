@@ -120,11 +120,16 @@ void remap_xml_reference_attributes(
 // the output set, and allows for any specified attribute values to be returned
 // as well. Attribute names should specify their namespace, if any (so
 // android:onClick instead of just onClick)
+//
+// The layouts are scanned in parallel. With a cache_path, the results of the
+// layouts whose contents didn't change since the run that wrote the cache are
+// reused, and the cache is updated for the next run.
 void collect_layout_classes_and_attributes(
     const std::string& apk_directory,
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
-    std::unordered_multimap<std::string, std::string>& out_attributes);
+    std::unordered_multimap<std::string, std::string>& out_attributes,
+    const std::string& cache_path = "");
 
 // Same as above, for single file.
 void collect_layout_classes_and_attributes_for_file(
@@ -159,6 +164,27 @@ int rename_classes_in_layout(
     size_t* out_num_renamed,
     ssize_t* out_size_delta);
 
+// The edits that rewrite_xml_files applies to each file: reference attributes
+// are inlined as by inline_xml_reference_attributes, then the ResStringPool
+// entries are replaced as by rename_classes_in_layout.
+struct XmlFileEdits {
+  std::map<std::string, std::string> class_renames;
+  std::map<uint32_t, android::Res_value> inline_values;
+};
+
+struct XmlFileEditStats {
+  size_t files_changed{0};
+  size_t strings_renamed{0};
+  size_t values_inlined{0};
+  ssize_t size_delta{0};
+};
+
+// Applies all the edits to each of the given binary XML files in a single
+// read-modify-write of its mapping, on parallel threads. Raw resources are
+// skipped.
+XmlFileEditStats rewrite_xml_files(const std::vector<std::string>& files,
+                                   const XmlFileEdits& edits);
+
 /**
  * Follows the reference links for a resource for all configurations.
  * Outputs all the nodes visited, as well as all the string values seen.
@@ -187,7 +213,9 @@ class ResourcesArscFile {
 
   android::ResTable res_table;
   android::SortedVector<uint32_t> sorted_res_ids;
-  std::map<uint32_t, std::string> id_to_name;
+  std::unordered_map<uint32_t, std::string> id_to_name;
+  // Sorted, so that the names with a given prefix can be found without
+  // going through all of them.
   std::map<std::string, std::vector<uint32_t>> name_to_ids;
 
   explicit ResourcesArscFile(const std::string& path);
@@ -7,10 +7,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <boost/optional.hpp>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "KeepReason.h"
 #include "RedexContext.h"
@@ -27,68 +29,88 @@ class KeepState;
 
 class ReferencedState {
  private:
-  struct InnerStruct {
-    int32_t m_api_level{-1};
-
+  // The flags are bits of a single atomic word, so that passes which process
+  // classes and members in parallel can set and clear them without locks.
+  // Their order matches the bitfields that were used before, which keeps the
+  // layout of the serialized IR meta data the same.
+  enum Flag : uint16_t {
     // Whether this DexMember is referenced by one of the strings in the native
     // libraries. Note that this doesn't allow us to distinguish
     // native -> Java references from Java -> native refs.
-    bool m_by_string : 1;
+    BY_STRING = 1 << 0,
     // Whether it is referenced from an XML layout.
-    bool m_by_resources : 1;
+    BY_RESOURCES = 1 << 1,
     // Whether it is a json serializer/deserializer class for a reachable class.
-    bool m_is_serde : 1;
+    IS_SERDE = 1 << 2,
 
     // ProGuard keep settings
     //
     // Whether any keep rule has matched this. This applies for both `-keep` and
     // `-keepnames`.
-    bool m_keep : 1;
+    KEEP = 1 << 3,
     // assumenosideeffects allows certain methods to be removed.
-    bool m_assumenosideeffects : 1;
-    // If m_whyareyoukeeping is true then report debugging information
+    ASSUMENOSIDEEFFECTS = 1 << 4,
+    // If WHYAREYOUKEEPING is set then report debugging information
     // about why this class or member is being kept.
-    bool m_whyareyoukeeping : 1;
+    WHYAREYOUKEEPING = 1 << 5,
 
     // For keep modifiers: -keep,allowshrinking and -keep,allowobfuscation.
     //
-    // Instead of m_allowshrinking and m_allowobfuscation, we need to have
+    // Instead of allowshrinking and allowobfuscation, we need to have
     // set/unset pairs for easier parallelization. The unset has a high
     // priority. See the comments in apply_keep_modifiers.
-    bool m_set_allowshrinking : 1;
-    bool m_unset_allowshrinking : 1;
-    bool m_set_allowobfuscation : 1;
-    bool m_unset_allowobfuscation : 1;
+    SET_ALLOWSHRINKING = 1 << 6,
+    UNSET_ALLOWSHRINKING = 1 << 7,
+    SET_ALLOWOBFUSCATION = 1 << 8,
+    UNSET_ALLOWOBFUSCATION = 1 << 9,
 
-    bool m_no_optimizations : 1;
+    NO_OPTIMIZATIONS = 1 << 10,
 
-    bool m_generated : 1;
+    GENERATED = 1 << 11,
 
     // For inlining configurations.
-    bool m_dont_inline : 1;
-    bool m_force_inline : 1;
+    DONT_INLINE = 1 << 12,
+    FORCE_INLINE = 1 << 13,
+  };
 
-    InnerStruct() {
-      // Initializers in bit fields are C++20...
-      m_by_string = false;
-      m_by_resources = false;
-      m_is_serde = false;
+  // The flags that join_with() combines by disjunction and by conjunction
+  // respectively. Other flags are left untouched by a join.
+  static constexpr uint16_t JOIN_ANY_FLAGS =
+      BY_STRING | BY_RESOURCES | IS_SERDE | KEEP | WHYAREYOUKEEPING |
+      UNSET_ALLOWSHRINKING | UNSET_ALLOWOBFUSCATION | NO_OPTIMIZATIONS |
+      DONT_INLINE;
+  static constexpr uint16_t JOIN_ALL_FLAGS = ASSUMENOSIDEEFFECTS |
+                                             SET_ALLOWSHRINKING |
+                                             SET_ALLOWOBFUSCATION |
+                                             FORCE_INLINE;
 
-      m_keep = false;
-      m_assumenosideeffects = false;
-      m_whyareyoukeeping = false;
+  struct InnerStruct {
+    int32_t m_api_level{-1};
+    // The updates don't need to be ordered with respect to other memory
+    // accesses: passes only read the flags after the parallel phase that
+    // wrote them has been joined.
+    std::atomic<uint16_t> m_flags{0};
 
-      m_set_allowshrinking = false;
-      m_unset_allowshrinking = false;
-      m_set_allowobfuscation = false;
-      m_unset_allowobfuscation = false;
+    InnerStruct() = default;
 
-      m_no_optimizations = false;
+    InnerStruct(const InnerStruct& other)
+        : m_api_level(other.m_api_level), m_flags(other.flags()) {}
 
-      m_generated = false;
+    InnerStruct& operator=(const InnerStruct& other) {
+      m_api_level = other.m_api_level;
+      m_flags.store(other.flags(), std::memory_order_relaxed);
+      return *this;
+    }
 
-      m_dont_inline = false;
-      m_force_inline = false;
+    uint16_t flags() const { return m_flags.load(std::memory_order_relaxed); }
+
+    bool test(Flag flag) const { return (flags() & flag) != 0; }
+
+    void set(Flag flag) { m_flags.fetch_or(flag, std::memory_order_relaxed); }
+
+    void clear(Flag flag) {
+      m_flags.fetch_and(static_cast<uint16_t>(~flag),
+                        std::memory_order_relaxed);
     }
   } inner_struct;
 
@@ -97,10 +119,12 @@ class ReferencedState {
   boost::optional<size_t> m_interdex_subgroup{boost::none};
 
   // Going through hoops here to reduce the size of ReferencedState while
-  // keeping memory requirements still small in non-default case.
+  // keeping memory requirements still small in non-default case. Reasons are
+  // interned and most members have only a few, so a vector without duplicate
+  // pointers takes much less memory than a hash set.
   struct KeepReasons {
     std::mutex m_keep_reasons_mtx;
-    keep_reason::ReasonPtrSet m_keep_reasons;
+    std::vector<const keep_reason::Reason*> m_keep_reasons;
   };
   mutable std::atomic<KeepReasons*> m_keep_reasons{nullptr};
 
@@ -118,42 +142,12 @@ class ReferencedState {
 
   void join_with(const ReferencedState& other) {
     if (this != &other) {
-      this->inner_struct.m_by_string =
-          this->inner_struct.m_by_string | other.inner_struct.m_by_string;
-      this->inner_struct.m_by_resources =
-          this->inner_struct.m_by_resources | other.inner_struct.m_by_resources;
-      this->inner_struct.m_is_serde =
-          this->inner_struct.m_is_serde | other.inner_struct.m_is_serde;
-
-      this->inner_struct.m_keep =
-          this->inner_struct.m_keep | other.inner_struct.m_keep;
-      this->inner_struct.m_assumenosideeffects =
-          this->inner_struct.m_assumenosideeffects &
-          other.inner_struct.m_assumenosideeffects;
-      this->inner_struct.m_whyareyoukeeping =
-          this->inner_struct.m_whyareyoukeeping |
-          other.inner_struct.m_whyareyoukeeping;
-
-      this->inner_struct.m_set_allowshrinking =
-          this->inner_struct.m_set_allowshrinking &
-          other.inner_struct.m_set_allowshrinking;
-      this->inner_struct.m_unset_allowshrinking =
-          this->inner_struct.m_unset_allowshrinking |
-          other.inner_struct.m_unset_allowshrinking;
-      this->inner_struct.m_set_allowobfuscation =
-          this->inner_struct.m_set_allowobfuscation &
-          other.inner_struct.m_set_allowobfuscation;
-      this->inner_struct.m_unset_allowobfuscation =
-          this->inner_struct.m_unset_allowobfuscation |
-          other.inner_struct.m_unset_allowobfuscation;
-
-      this->inner_struct.m_no_optimizations =
-          this->inner_struct.m_no_optimizations |
-          other.inner_struct.m_no_optimizations;
-      this->inner_struct.m_dont_inline =
-          this->inner_struct.m_dont_inline | other.inner_struct.m_dont_inline;
-      this->inner_struct.m_force_inline =
-          this->inner_struct.m_force_inline & other.inner_struct.m_force_inline;
+      auto other_flags = other.inner_struct.flags();
+      inner_struct.m_flags.fetch_or(other_flags & JOIN_ANY_FLAGS,
+                                    std::memory_order_relaxed);
+      inner_struct.m_flags.fetch_and(
+          static_cast<uint16_t>(other_flags | ~JOIN_ALL_FLAGS),
+          std::memory_order_relaxed);
     }
   }
 
@@ -163,13 +157,14 @@ class ReferencedState {
 
   // -keep
   bool can_delete() const {
-    return (!inner_struct.m_keep || allowshrinking()) &&
-           !inner_struct.m_by_resources;
+    return (!inner_struct.test(KEEP) || allowshrinking()) &&
+           !inner_struct.test(BY_RESOURCES);
   }
 
   // -keepnames
   bool can_rename() const {
-    return can_rename_if_also_renaming_xml() && !inner_struct.m_by_resources;
+    return can_rename_if_also_renaming_xml() &&
+           !inner_struct.test(BY_RESOURCES);
   }
 
   /*
@@ -178,22 +173,24 @@ class ReferencedState {
    * will be responsible for updating the XML resources.
    */
   bool can_rename_if_also_renaming_xml() const {
-    return !inner_struct.m_keep || allowobfuscation();
+    return !inner_struct.test(KEEP) || allowobfuscation();
   }
 
   bool assumenosideeffects() const {
-    return inner_struct.m_assumenosideeffects;
+    return inner_struct.test(ASSUMENOSIDEEFFECTS);
   }
 
   bool report_whyareyoukeeping() const {
-    return inner_struct.m_whyareyoukeeping;
+    return inner_struct.test(WHYAREYOUKEEPING);
   }
 
   // For example, a classname in a layout, e.g. <com.facebook.MyCustomView /> or
   // Class c = Class.forName("com.facebook.FooBar");
-  void ref_by_string() { inner_struct.m_by_string = true; }
+  void ref_by_string() { inner_struct.set(BY_STRING); }
 
-  bool is_referenced_by_string() const { return inner_struct.m_by_string; }
+  bool is_referenced_by_string() const {
+    return inner_struct.test(BY_STRING);
+  }
 
   // A class referenced by resource XML can take the following forms in .xml
   // files under the res/ directory:
@@ -203,24 +200,24 @@ class ReferencedState {
   // This differs from "by_string" reference since it is possible to rename
   // these string references, and potentially eliminate dead resource .xml files
   void set_referenced_by_resource_xml() {
-    inner_struct.m_by_resources = true;
+    inner_struct.set(BY_RESOURCES);
     if (RedexContext::record_keep_reasons()) {
       add_keep_reason(RedexContext::make_keep_reason(keep_reason::XML));
     }
   }
 
   void unset_referenced_by_resource_xml() {
-    inner_struct.m_by_resources = false;
+    inner_struct.clear(BY_RESOURCES);
     // TODO: Remove the XML-related keep reasons
   }
 
   bool is_referenced_by_resource_xml() const {
-    return inner_struct.m_by_resources;
+    return inner_struct.test(BY_RESOURCES);
   }
 
-  void set_is_serde() { inner_struct.m_is_serde = true; }
+  void set_is_serde() { inner_struct.set(IS_SERDE); }
 
-  bool is_serde() const { return inner_struct.m_is_serde; }
+  bool is_serde() const { return inner_struct.test(IS_SERDE); }
 
   void set_root() { set_root(keep_reason::UNKNOWN); }
 
@@ -236,7 +233,7 @@ class ReferencedState {
    */
   template <class... Args>
   void set_root(Args&&... args) {
-    inner_struct.m_keep = true;
+    inner_struct.set(KEEP);
     unset_allowshrinking();
     unset_allowobfuscation();
     if (RedexContext::record_keep_reasons()) {
@@ -245,10 +242,11 @@ class ReferencedState {
     }
   }
 
-  const keep_reason::ReasonPtrSet& keep_reasons() const {
+  // In the order in which they were added.
+  const std::vector<const keep_reason::Reason*>& keep_reasons() const {
     if (!RedexContext::record_keep_reasons()) {
       // We really should not allow this.
-      static keep_reason::ReasonPtrSet SINGLETON;
+      static std::vector<const keep_reason::Reason*> SINGLETON;
       return SINGLETON;
     }
     auto& keep_reasons = ensure_keep_reasons();
@@ -269,13 +267,13 @@ class ReferencedState {
   // ProguardMatcher uses parallel processing, using this will result in race
   // condition.
   void force_unset_allowshrinking() {
-    inner_struct.m_set_allowshrinking = true;
-    inner_struct.m_unset_allowshrinking = false;
+    inner_struct.set(SET_ALLOWSHRINKING);
+    inner_struct.clear(UNSET_ALLOWSHRINKING);
   }
 
-  void set_assumenosideeffects() { inner_struct.m_assumenosideeffects = true; }
+  void set_assumenosideeffects() { inner_struct.set(ASSUMENOSIDEEFFECTS); }
 
-  void set_whyareyoukeeping() { inner_struct.m_whyareyoukeeping = true; }
+  void set_whyareyoukeeping() { inner_struct.set(WHYAREYOUKEEPING); }
 
   void set_interdex_subgroup(const boost::optional<size_t>& interdex_subgroup) {
     m_interdex_subgroup = interdex_subgroup;
@@ -289,22 +287,24 @@ class ReferencedState {
   int32_t get_api_level() const { return inner_struct.m_api_level; }
   void set_api_level(int api_level) { inner_struct.m_api_level = api_level; }
 
-  bool no_optimizations() const { return inner_struct.m_no_optimizations; }
-  void set_no_optimizations() { inner_struct.m_no_optimizations = true; }
+  bool no_optimizations() const {
+    return inner_struct.test(NO_OPTIMIZATIONS);
+  }
+  void set_no_optimizations() { inner_struct.set(NO_OPTIMIZATIONS); }
 
   // Methods and classes marked as "generated" tend to not have stable names,
   // and don't properly participate in coldstart tracking.
-  bool is_generated() const { return inner_struct.m_generated; }
-  void set_generated() { inner_struct.m_generated = true; }
+  bool is_generated() const { return inner_struct.test(GENERATED); }
+  void set_generated() { inner_struct.set(GENERATED); }
 
-  bool force_inline() const { return inner_struct.m_force_inline; }
-  void set_force_inline() { inner_struct.m_force_inline = true; }
-  bool dont_inline() const { return inner_struct.m_dont_inline; }
-  void set_dont_inline() { inner_struct.m_dont_inline = true; }
+  bool force_inline() const { return inner_struct.test(FORCE_INLINE); }
+  void set_force_inline() { inner_struct.set(FORCE_INLINE); }
+  bool dont_inline() const { return inner_struct.test(DONT_INLINE); }
+  void set_dont_inline() { inner_struct.set(DONT_INLINE); }
 
  private:
   // Does any keep rule (whether -keep or -keepnames) match this DexMember?
-  bool has_keep() const { return inner_struct.m_keep; }
+  bool has_keep() const { return inner_struct.test(KEEP); }
 
   /*
    * This should only be called from ProguardMatcher, and is used whenever we
@@ -312,7 +312,7 @@ class ReferencedState {
    */
   template <class... Args>
   void set_has_keep(Args&&... args) {
-    inner_struct.m_keep = true;
+    inner_struct.set(KEEP);
     if (RedexContext::record_keep_reasons()) {
       add_keep_reason(
           RedexContext::make_keep_reason(std::forward<Args>(args)...));
@@ -321,24 +321,24 @@ class ReferencedState {
 
   // There's generally no need to call this; use can_delete() instead.
   bool allowshrinking() const {
-    return !inner_struct.m_unset_allowshrinking &&
-           inner_struct.m_set_allowshrinking;
+    return !inner_struct.test(UNSET_ALLOWSHRINKING) &&
+           inner_struct.test(SET_ALLOWSHRINKING);
   }
 
-  void set_allowshrinking() { inner_struct.m_set_allowshrinking = true; }
+  void set_allowshrinking() { inner_struct.set(SET_ALLOWSHRINKING); }
 
-  void unset_allowshrinking() { inner_struct.m_unset_allowshrinking = true; }
+  void unset_allowshrinking() { inner_struct.set(UNSET_ALLOWSHRINKING); }
 
   // There's generally no need to call this; use can_rename() instead.
   bool allowobfuscation() const {
-    return !inner_struct.m_unset_allowobfuscation &&
-           inner_struct.m_set_allowobfuscation;
+    return !inner_struct.test(UNSET_ALLOWOBFUSCATION) &&
+           inner_struct.test(SET_ALLOWOBFUSCATION);
   }
 
-  void set_allowobfuscation() { inner_struct.m_set_allowobfuscation = true; }
+  void set_allowobfuscation() { inner_struct.set(SET_ALLOWOBFUSCATION); }
 
   void unset_allowobfuscation() {
-    inner_struct.m_unset_allowobfuscation = true;
+    inner_struct.set(UNSET_ALLOWOBFUSCATION);
   }
 
   KeepReasons& ensure_keep_reasons() const {
@@ -361,7 +361,10 @@ class ReferencedState {
     always_assert(RedexContext::record_keep_reasons());
     auto& keep_reasons = ensure_keep_reasons();
     std::lock_guard<std::mutex> lock(keep_reasons.m_keep_reasons_mtx);
-    keep_reasons.m_keep_reasons.emplace(reason);
+    auto& reasons = keep_reasons.m_keep_reasons;
+    if (std::find(reasons.begin(), reasons.end(), reason) == reasons.end()) {
+      reasons.push_back(reason);
+    }
   }
 
   friend class keep_rules::impl::KeepState;
@@ -10,10 +10,13 @@
 #include <iomanip>
 #include <unordered_map>
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 
 #include "BaseIRAnalyzer.h"
 #include "ControlFlow.h"
+#include "DexHasher.h"
 #include "DexUtil.h"
 #include "FiniteAbstractDomain.h"
 #include "IRCode.h"
@@ -972,7 +975,7 @@ class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
   void populate_environments(const cfg::ControlFlowGraph& cfg) {
     // We reserve enough space for the map in order to avoid repeated
     // rehashing during the computation.
-    m_environments.reserve(cfg.blocks().size() * 16);
+    m_environments.reserve(cfg.num_blocks() * 16);
     for (cfg::Block* block : cfg.blocks()) {
       AbstractObjectEnvironment current_state = get_entry_state_at(block);
       for (auto& mie : InstructionIterable(block)) {
@@ -1054,10 +1057,13 @@ class Analyzer final : public BaseIRAnalyzer<AbstractObjectEnvironment> {
 ReflectionAnalysis::~ReflectionAnalysis() {}
 
 ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method)
+    : ReflectionAnalysis(dex_method, /* analyze */ true) {}
+
+ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method, bool analyze)
     : m_dex_method(dex_method) {
   always_assert(dex_method != nullptr);
   IRCode* code = dex_method->get_code();
-  if (code == nullptr) {
+  if (code == nullptr || !analyze) {
     return;
   }
   code->build_cfg(/* editable */ false);
@@ -1067,6 +1073,82 @@ ReflectionAnalysis::ReflectionAnalysis(DexMethod* dex_method)
   m_analyzer->run(dex_method);
 }
 
+namespace {
+
+bool is_class_type(const DexType* type) {
+  return type::get_element_type_if_array(type) == type::java_lang_Class();
+}
+
+bool is_reflection_api(const DexMethodRef* method) {
+  if (is_class_type(method->get_class()) ||
+      is_class_type(method->get_proto()->get_rtype())) {
+    return true;
+  }
+  const auto& class_name = method->get_class()->get_name()->str();
+  return boost::starts_with(class_name, "Ljava/lang/reflect/");
+}
+
+} // namespace
+
+bool ReflectionAnalysis::may_use_reflection(const DexMethod* dex_method) {
+  // The analysis only creates Class objects out of const-class instructions,
+  // of the values of type Class (or arrays thereof) that it reads from
+  // parameters, fields, arrays or method calls, and of calls to getClass().
+  // Fields and methods only come out of calls on Class objects.
+  const auto& args = dex_method->get_proto()->get_args()->get_type_list();
+  for (const auto* type : args) {
+    if (is_class_type(type)) {
+      return true;
+    }
+  }
+  auto* code = dex_method->get_code();
+  if (code == nullptr) {
+    return false;
+  }
+  for (const auto& mie : InstructionIterable(code)) {
+    auto* insn = mie.insn;
+    if (insn->opcode() == OPCODE_CONST_CLASS ||
+        (insn->has_type() && is_class_type(insn->get_type())) ||
+        (insn->has_field() && is_class_type(insn->get_field()->get_type())) ||
+        (insn->has_method() && is_reflection_api(insn->get_method()))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<const ReflectionAnalysis> ReflectionAnalysisCache::get(
+    DexMethod* dex_method) {
+  auto* code = dex_method->get_code();
+  if (code == nullptr || code->editable_cfg_built()) {
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<const ReflectionAnalysis>(dex_method);
+  }
+  // The analysis keeps its results per instruction, so the entry is stale as
+  // soon as any instruction is replaced, even by an identical one.
+  auto hash = hashing::hash_code(code);
+  for (const auto& mie : InstructionIterable(code)) {
+    boost::hash_combine(hash, mie.insn);
+  }
+  auto cached = m_analyses.get(dex_method, std::make_pair(0, nullptr));
+  if (cached.second != nullptr && cached.first == hash) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return cached.second;
+  }
+  std::shared_ptr<const ReflectionAnalysis> analysis;
+  if (ReflectionAnalysis::may_use_reflection(dex_method)) {
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    analysis = std::make_shared<const ReflectionAnalysis>(dex_method);
+  } else {
+    m_skipped.fetch_add(1, std::memory_order_relaxed);
+    analysis = std::shared_ptr<const ReflectionAnalysis>(
+        new ReflectionAnalysis(dex_method, /* analyze */ false));
+  }
+  m_analyses.insert_or_assign(
+      std::make_pair(dex_method, std::make_pair(hash, analysis)));
+  return analysis;
+}
+
 void ReflectionAnalysis::get_reflection_site(
     const reg_t reg,
     IRInstruction* insn,
@@ -1101,7 +1183,7 @@ void ReflectionAnalysis::get_reflection_site(
 const ReflectionSites ReflectionAnalysis::get_reflection_sites() const {
   ReflectionSites reflection_sites;
   auto code = m_dex_method->get_code();
-  if (code == nullptr) {
+  if (code == nullptr || m_analyzer == nullptr) {
     return reflection_sites;
   }
   auto reg_size = code->get_registers_size();
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <ostream>
 
@@ -14,6 +15,7 @@
 #include <utility>
 
 #include "AbstractDomain.h"
+#include "ConcurrentContainers.h"
 #include "ConstantAbstractDomain.h"
 #include "DexClass.h"
 #include "IRInstruction.h"
@@ -210,6 +212,14 @@ class ReflectionAnalysis final {
 
   explicit ReflectionAnalysis(DexMethod* dex_method);
 
+  /*
+   * Whether the code has any instruction that may produce a java.lang.Class
+   * value, i.e., any reference to java.lang.Class or java.lang.reflect. The
+   * analysis of code for which this returns false finds no reflection site,
+   * so it can be skipped altogether (see ReflectionAnalysisCache).
+   */
+  static bool may_use_reflection(const DexMethod* dex_method);
+
   const ReflectionSites get_reflection_sites() const;
 
   /**
@@ -233,15 +243,45 @@ class ReflectionAnalysis final {
       size_t reg, IRInstruction* insn) const;
 
  private:
+  // Builds an analysis that knows nothing about the method.
+  ReflectionAnalysis(DexMethod* dex_method, bool analyze);
+
   const DexMethod* m_dex_method;
   std::unique_ptr<impl::Analyzer> m_analyzer;
 
+  friend class ReflectionAnalysisCache;
+
   void get_reflection_site(
       const reg_t reg,
       IRInstruction* insn,
       std::map<reg_t, ReflectionAbstractObject>* abstract_objects) const;
 };
 
+/*
+ * A memo of the analyses of methods, shared by all the passes through
+ * RedexContext::reflection_analysis_cache(). An entry only hits as long as the
+ * instructions of the method are the same as when it was analyzed. The
+ * methods for which ReflectionAnalysis::may_use_reflection() is false are not
+ * analyzed at all. All the operations are thread-safe.
+ */
+class ReflectionAnalysisCache final {
+ public:
+  std::shared_ptr<const ReflectionAnalysis> get(DexMethod* dex_method);
+
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
+  size_t skipped() const { return m_skipped; }
+
+ private:
+  // The analyses, with a hash of the code they were computed on.
+  ConcurrentMap<const DexMethod*,
+                std::pair<size_t, std::shared_ptr<const ReflectionAnalysis>>>
+      m_analyses;
+  std::atomic<size_t> m_hits{0};
+  std::atomic<size_t> m_misses{0};
+  std::atomic<size_t> m_skipped{0};
+};
+
 } // namespace reflection
 
 std::ostream& operator<<(std::ostream& out,
@@ -6,31 +6,17 @@
  */
 
 #include "Resolver.h"
+
+#include <limits>
+
 #include "DexUtil.h"
 
 namespace {
 
-inline bool match(const DexString* name,
-                  const DexProto* proto,
-                  const DexMethod* cls_meth) {
-  return name == cls_meth->get_name() && proto == cls_meth->get_proto();
-}
-
 DexMethod* resolve_intf_method_ref(const DexClass* cls,
                                    const DexString* name,
                                    const DexProto* proto) {
-
-  auto find_method = [&](const DexClass* cls) -> DexMethod* {
-    const auto& vmethods = cls->get_vmethods();
-    for (const auto vmethod : vmethods) {
-      if (vmethod->get_name() == name && vmethod->get_proto() == proto) {
-        return vmethod;
-      }
-    }
-    return nullptr;
-  };
-
-  auto method = find_method(cls);
+  auto method = cls->find_vmethod(name, proto);
   if (method) return method;
   const auto& super_intfs = cls->get_interfaces()->get_type_list();
   for (const auto& super_intf : super_intfs) {
@@ -53,18 +39,16 @@ DexMethod* resolve_method(const DexClass* cls,
   }
   while (cls) {
     if (search == MethodSearch::Virtual || search == MethodSearch::Any) {
-      for (auto& vmeth : cls->get_vmethods()) {
-        if (match(name, proto, vmeth)) {
-          return vmeth;
-        }
+      auto vmeth = cls->find_vmethod(name, proto);
+      if (vmeth != nullptr) {
+        return vmeth;
       }
     }
     if (search == MethodSearch::Direct || search == MethodSearch::Static ||
         search == MethodSearch::Any) {
-      for (auto& dmeth : cls->get_dmethods()) {
-        if (match(name, proto, dmeth)) {
-          return dmeth;
-        }
+      auto dmeth = cls->find_dmethod(name, proto);
+      if (dmeth != nullptr) {
+        return dmeth;
       }
     }
     // direct methods only look up the given class
@@ -98,24 +82,18 @@ DexField* resolve_field(const DexType* owner,
                         const DexString* name,
                         const DexType* type,
                         FieldSearch fs) {
-  auto field_eq = [&](const DexField* a) {
-    return a->get_name() == name && a->get_type() == type;
-  };
-
   const DexClass* cls = type_class(owner);
   while (cls) {
     if (fs == FieldSearch::Instance || fs == FieldSearch::Any) {
-      for (auto ifield : cls->get_ifields()) {
-        if (field_eq(ifield)) {
-          return ifield;
-        }
+      auto ifield = cls->find_ifield(name, type);
+      if (ifield != nullptr) {
+        return ifield;
       }
     }
     if (fs == FieldSearch::Static || fs == FieldSearch::Any) {
-      for (auto sfield : cls->get_sfields()) {
-        if (field_eq(sfield)) {
-          return sfield;
-        }
+      auto sfield = cls->find_sfield(name, type);
+      if (sfield != nullptr) {
+        return sfield;
       }
       // static final fields may be coming from interfaces so we
       // have to walk up the interface hierarchy too
@@ -129,15 +107,52 @@ DexField* resolve_field(const DexType* owner,
   return nullptr;
 }
 
+DexMethod* ResolverCache::resolve_method(DexMethodRef* method,
+                                         MethodSearch search) {
+  auto version = g_redex->class_hierarchy_version();
+  auto key = std::make_pair(static_cast<const DexMethodRef*>(method), search);
+  auto cached = m_methods.get(
+      key, std::make_pair(nullptr, std::numeric_limits<size_t>::max()));
+  if (cached.second == version) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return cached.first;
+  }
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+  DexMethod* def = nullptr;
+  auto cls = type_class(method->get_class());
+  if (cls != nullptr) {
+    def = resolve_method_ref(cls, method->get_name(), method->get_proto(),
+                             search);
+  }
+  m_methods.insert_or_assign(std::make_pair(key, std::make_pair(def, version)));
+  return def;
+}
+
+DexField* ResolverCache::resolve_field(const DexFieldRef* field,
+                                       FieldSearch search) {
+  auto version = g_redex->class_hierarchy_version();
+  auto key = std::make_pair(field, search);
+  auto cached = m_fields.get(
+      key, std::make_pair(nullptr, std::numeric_limits<size_t>::max()));
+  if (cached.second == version) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return cached.first;
+  }
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+  auto def = ::resolve_field(field->get_class(), field->get_name(),
+                             field->get_type(), search);
+  m_fields.insert_or_assign(std::make_pair(key, std::make_pair(def, version)));
+  return def;
+}
+
 DexMethod* find_top_impl(const DexClass* cls,
                          const DexString* name,
                          const DexProto* proto) {
   DexMethod* top_impl = nullptr;
   while (cls) {
-    for (const auto& vmeth : cls->get_vmethods()) {
-      if (match(name, proto, vmeth)) {
-        top_impl = vmeth;
-      }
+    auto vmeth = cls->find_vmethod(name, proto);
+    if (vmeth != nullptr) {
+      top_impl = vmeth;
     }
     cls = type_class(cls->get_super_class());
   }
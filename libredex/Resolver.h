@@ -11,8 +11,11 @@
 #include "DexUtil.h"
 #include "IRInstruction.h"
 
+#include <atomic>
+#include <boost/functional/hash.hpp>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 using MethodRefCache = std::unordered_map<DexMethodRef*, DexMethod*>;
 using MethodSet = std::unordered_set<DexMethod*>;
@@ -63,6 +66,51 @@ inline MethodSearch opcode_to_search(const IRInstruction* insn) {
   return opcode_to_search(insn->opcode());
 }
 
+/**
+ * Type of fields to resolve.
+ */
+enum class FieldSearch { Static, Instance, Any };
+
+/**
+ * A memo of the resolutions of method and field refs, shared by all the
+ * passes through RedexContext::resolver_cache(); resolve_method() and
+ * resolve_field() on refs go through it.
+ * A resolution depends on the members of the classes up the hierarchy of the
+ * ref, so an entry only hits as long as no change to classes was reported
+ * since it was resolved (see RedexContext::report_class_hierarchy_change()).
+ * All the operations are thread-safe.
+ */
+class ResolverCache {
+ public:
+  DexMethod* resolve_method(DexMethodRef* method, MethodSearch search);
+
+  DexField* resolve_field(const DexFieldRef* field, FieldSearch search);
+
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
+
+ private:
+  struct KeyHash {
+    template <class Ref, class Search>
+    size_t operator()(const std::pair<Ref, Search>& key) const {
+      size_t seed = std::hash<Ref>()(key.first);
+      boost::hash_combine(seed, static_cast<size_t>(key.second));
+      return seed;
+    }
+  };
+  // The definitions, with the version of the class hierarchy they were
+  // resolved against.
+  template <class Ref, class Search, class Def>
+  using Memo = ConcurrentMap<std::pair<const Ref*, Search>,
+                             std::pair<Def*, size_t>,
+                             KeyHash>;
+
+  Memo<DexMethodRef, MethodSearch, DexMethod> m_methods;
+  Memo<DexFieldRef, FieldSearch, DexField> m_fields;
+  std::atomic<size_t> m_hits{0};
+  std::atomic<size_t> m_misses{0};
+};
+
 /**
  * Given a scope defined by DexClass, a name and a proto look for a method
  * definition in scope.
@@ -136,10 +184,7 @@ inline DexMethod* resolve_method(DexMethodRef* method, MethodSearch search) {
   if (m) {
     return m;
   }
-  auto cls = type_class(method->get_class());
-  if (cls == nullptr) return nullptr;
-  return resolve_method_ref(cls, method->get_name(), method->get_proto(),
-                            search);
+  return g_redex->resolver_cache().resolve_method(method, search);
 }
 
 /**
@@ -188,11 +233,6 @@ DexMethod* find_top_intf_impl(const DexClass* cls,
                               const DexString* name,
                               const DexProto* proto);
 
-/**
- * Type of fields to resolve.
- */
-enum class FieldSearch { Static, Instance, Any };
-
 /**
  * Given a scope, a field name and a field type search the class
  * hierarchy for a definition of the field
@@ -212,6 +252,5 @@ inline DexField* resolve_field(const DexFieldRef* field,
   if (field->is_def()) {
     return const_cast<DexField*>(static_cast<const DexField*>(field));
   }
-  return resolve_field(field->get_class(), field->get_name(), field->get_type(),
-                       search);
+  return g_redex->resolver_cache().resolve_field(field, search);
 }
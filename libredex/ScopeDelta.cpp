@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ScopeDelta.h"
+
+#include "DexHasher.h"
+#include "IRCode.h"
+#include "WorkQueue.h"
+
+namespace scope_delta {
+
+Snapshot take_snapshot(const Scope& scope, const Snapshot* previous) {
+  std::vector<std::vector<std::pair<const DexMethod*, MethodState>>> states(
+      scope.size());
+  redex_parallel::parallel_for(0, scope.size(), [&](size_t i) {
+    auto cls = scope[i];
+    for (auto methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *methods) {
+        MethodState state;
+        if (method->is_balloon_pending()) {
+          state.unknown = true;
+          if (previous != nullptr) {
+            auto it = previous->methods.find(method);
+            if (it != previous->methods.end()) {
+              state = it->second;
+            }
+          }
+        } else if (method->get_code() != nullptr) {
+          auto code = method->get_code();
+          state.code_hash = hashing::hash_code(code);
+          state.instructions = code->count_opcodes();
+          state.registers = code->get_registers_size();
+        } else {
+          continue;
+        }
+        states[i].emplace_back(method, state);
+      }
+    }
+  });
+
+  Snapshot snapshot;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    snapshot.classes.insert(scope[i]);
+    snapshot.methods.insert(states[i].begin(), states[i].end());
+  }
+  return snapshot;
+}
+
+Delta diff(const Snapshot& before, const Snapshot& after) {
+  Delta delta;
+  for (const auto& pair : after.methods) {
+    const auto& state = pair.second;
+    delta.registers += state.registers;
+    auto it = before.methods.find(pair.first);
+    if (it == before.methods.end()) {
+      delta.methods_added++;
+      delta.instructions_added += state.instructions;
+      continue;
+    }
+    const auto& old_state = it->second;
+    if (old_state.unknown || state.unknown ||
+        old_state.code_hash == state.code_hash) {
+      continue;
+    }
+    delta.methods_changed++;
+    if (state.instructions > old_state.instructions) {
+      delta.instructions_added += state.instructions - old_state.instructions;
+    } else {
+      delta.instructions_removed +=
+          old_state.instructions - state.instructions;
+    }
+  }
+  for (const auto& pair : before.methods) {
+    if (!after.methods.count(pair.first)) {
+      delta.methods_removed++;
+      delta.instructions_removed += pair.second.instructions;
+    }
+  }
+  for (auto cls : before.classes) {
+    if (!after.classes.count(cls)) {
+      delta.classes_removed++;
+    }
+  }
+  return delta;
+}
+
+} // namespace scope_delta
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexClass.h"
+
+/*
+ * A compact summary of what a pass did to the IR: which methods it changed,
+ * how many instructions it added or removed, which classes it deleted. The
+ * PassManager records one per pass when "ir_delta_stats" is set, which shows
+ * the passes that do real work on an app without diffing the hashes of the
+ * whole scope.
+ *
+ * Code that is still waiting to be ballooned hasn't been touched since it was
+ * compacted (see "compact_code_after_passes"), so its state is carried over
+ * from the previous snapshot instead of being recomputed. Code that has never
+ * been ballooned has no state to compare against, and isn't counted as
+ * changed when a pass first balloons it.
+ */
+namespace scope_delta {
+
+struct MethodState {
+  size_t code_hash{0};
+  uint32_t instructions{0};
+  uint32_t registers{0};
+  // The code was never ballooned, the fields above aren't meaningful.
+  bool unknown{false};
+};
+
+struct Snapshot {
+  std::unordered_map<const DexMethod*, MethodState> methods;
+  std::unordered_set<const DexClass*> classes;
+};
+
+struct Delta {
+  size_t methods_changed{0};
+  size_t methods_added{0};
+  size_t methods_removed{0};
+  size_t classes_removed{0};
+  size_t instructions_added{0};
+  size_t instructions_removed{0};
+  // Sum of the registers sizes of all the methods, after the pass.
+  size_t registers{0};
+};
+
+/*
+ * `previous`, if any, is the snapshot that the state of the methods whose code
+ * is still pending ballooning comes from.
+ */
+Snapshot take_snapshot(const Scope& scope, const Snapshot* previous);
+
+Delta diff(const Snapshot& before, const Snapshot& after);
+
+} // namespace scope_delta
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SizeStats.h"
+
+#include <unordered_set>
+
+#include "DexInstruction.h"
+#include "IRCode.h"
+#include "WorkQueue.h"
+
+namespace {
+
+// The sizes of the items of a dex, for the estimate.
+constexpr size_t CLASS_DEF_BYTES = 32;
+constexpr size_t MEMBER_ID_BYTES = 8;
+constexpr size_t ENCODED_MEMBER_BYTES = 3;
+constexpr size_t CODE_ITEM_HEADER_BYTES = 16;
+constexpr size_t STRING_ID_BYTES = 4;
+
+} // namespace
+
+namespace size_stats {
+
+Sample Tracker::sample(const Scope& scope) {
+  std::vector<std::vector<std::pair<const DexMethod*, MethodSizes>>> sizes(
+      scope.size());
+  redex_parallel::parallel_for(0, scope.size(), [&](size_t i) {
+    auto cls = scope[i];
+    for (auto methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *methods) {
+        auto it = m_methods.find(method);
+        bool cached = it != m_methods.end();
+        if (method->is_balloon_pending()) {
+          // The code hasn't changed since it was last measured, if ever.
+          if (cached) {
+            sizes[i].emplace_back(method, it->second);
+            continue;
+          }
+          auto dex_code = method->get_dex_code();
+          if (dex_code == nullptr) {
+            continue;
+          }
+          MethodSizes method_sizes;
+          for (auto insn : dex_code->get_instructions()) {
+            if (!dex_opcode::is_fopcode(insn->opcode())) {
+              method_sizes.instructions++;
+            }
+            insn->gather_strings(method_sizes.strings);
+          }
+          method_sizes.code_units = dex_code->size();
+          sizes[i].emplace_back(method, std::move(method_sizes));
+          continue;
+        }
+        auto code = method->get_code();
+        if (code == nullptr) {
+          continue;
+        }
+        if (cached && it->second.code == code &&
+            it->second.modified_epoch == code->modified_epoch()) {
+          sizes[i].emplace_back(method, it->second);
+          continue;
+        }
+        MethodSizes method_sizes;
+        method_sizes.code = code;
+        method_sizes.modified_epoch = code->modified_epoch();
+        method_sizes.instructions = code->count_opcodes();
+        method_sizes.code_units = code->sum_opcode_sizes();
+        code->gather_strings(method_sizes.strings);
+        sizes[i].emplace_back(method, std::move(method_sizes));
+      }
+    }
+  });
+
+  // Rebuilding the cache drops the methods that were removed.
+  Sample sample;
+  std::unordered_map<const DexMethod*, MethodSizes> methods;
+  std::unordered_set<const DexString*> code_strings;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    auto cls = scope[i];
+    sample.classes++;
+    sample.methods += cls->get_dmethods().size() + cls->get_vmethods().size();
+    sample.fields += cls->get_ifields().size() + cls->get_sfields().size();
+    for (auto& pair : sizes[i]) {
+      const auto& method_sizes = pair.second;
+      sample.instructions += method_sizes.instructions;
+      sample.code_units += method_sizes.code_units;
+      sample.estimated_dex_bytes +=
+          CODE_ITEM_HEADER_BYTES + method_sizes.code_units * 2;
+      for (auto str : method_sizes.strings) {
+        if (code_strings.insert(str).second) {
+          sample.estimated_dex_bytes +=
+              STRING_ID_BYTES + str->get_entry_size();
+        }
+      }
+      methods.emplace(pair.first, std::move(pair.second));
+    }
+  }
+  sample.code_strings = code_strings.size();
+  sample.estimated_dex_bytes +=
+      sample.classes * CLASS_DEF_BYTES +
+      (sample.methods + sample.fields) *
+          (MEMBER_ID_BYTES + ENCODED_MEMBER_BYTES);
+  m_methods = std::move(methods);
+  return sample;
+}
+
+} // namespace size_stats
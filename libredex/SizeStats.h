@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+
+/*
+ * The size of the app between passes, in the terms of the dex_stats_t that
+ * are only known once the dexes are written. The PassManager samples it after
+ * each pass when "size_stats_per_pass" is set, which attributes the changes in
+ * the output size to the passes that made them.
+ *
+ * Sampling is cheap: the Tracker keeps the sizes of each method's code, and
+ * only measures again the code that was modified since it was last sampled
+ * (see IRCode::modified_epoch()), or replaced. Code that is still waiting to be
+ * ballooned is measured from its dex encoding.
+ */
+namespace size_stats {
+
+struct Sample {
+  size_t classes{0};
+  size_t methods{0};
+  size_t fields{0};
+  size_t instructions{0};
+  // In 16-bit code units, like the instructions of a dex.
+  size_t code_units{0};
+  // The distinct strings that the code loads.
+  size_t code_strings{0};
+  // A rough estimate of what the above take in the output dexes, from the
+  // sizes of their ids, definitions, code items and string data. It leaves
+  // out what passes rarely change, like the names of the members.
+  size_t estimated_dex_bytes{0};
+};
+
+class Tracker {
+ public:
+  Sample sample(const Scope& scope);
+
+ private:
+  struct MethodSizes {
+    // The IR that was measured, and its IRCode::modified_epoch(). No IR
+    // means the sizes are those of the dex code.
+    const IRCode* code{nullptr};
+    size_t modified_epoch{0};
+    uint32_t instructions{0};
+    uint32_t code_units{0};
+    std::vector<DexString*> strings;
+  };
+
+  std::unordered_map<const DexMethod*, MethodSizes> m_methods;
+};
+
+} // namespace size_stats
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TextTokenizer.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace text {
+
+MappedTextFile::MappedTextFile(const std::string& filename) {
+  std::ifstream fp(filename, std::ios::binary | std::ios::ate);
+  if (!fp) {
+    return;
+  }
+  m_is_open = true;
+  // Mapping an empty file fails, and there is nothing to map anyway.
+  if (fp.tellg() > 0) {
+    m_file.open(filename);
+    m_is_open = m_file.is_open();
+  }
+}
+
+bool Tokenizer::next_line(boost::string_view* line) {
+  if (at_end()) {
+    return false;
+  }
+  auto end = m_text.find('\n', m_pos);
+  if (end == boost::string_view::npos) {
+    end = m_text.size();
+  }
+  *line = m_text.substr(m_pos, end - m_pos);
+  if (!line->empty() && line->back() == '\r') {
+    line->remove_suffix(1);
+  }
+  m_pos = end + 1;
+  return true;
+}
+
+bool Tokenizer::next_word(boost::string_view* word) {
+  auto is_space = [](char c) { return isspace(static_cast<unsigned char>(c)); };
+  while (m_pos < m_text.size() && is_space(m_text[m_pos])) {
+    ++m_pos;
+  }
+  if (at_end()) {
+    return false;
+  }
+  auto begin = m_pos;
+  while (m_pos < m_text.size() && !is_space(m_text[m_pos])) {
+    ++m_pos;
+  }
+  *word = m_text.substr(begin, m_pos - begin);
+  return true;
+}
+
+bool parse_uint32(boost::string_view s, uint32_t* value) {
+  if (s.empty() || s.size() > 10) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    result = result * 10 + (c - '0');
+  }
+  if (result > UINT32_MAX) {
+    return false;
+  }
+  *value = static_cast<uint32_t>(result);
+  return true;
+}
+
+bool parse_double(boost::string_view s, double* value) {
+  // strtod needs a terminated string; numbers in our inputs are short.
+  char buffer[64];
+  if (s.empty() || s.size() >= sizeof(buffer)) {
+    return false;
+  }
+  memcpy(buffer, s.data(), s.size());
+  buffer[s.size()] = '\0';
+  char* rest = nullptr;
+  *value = strtod(buffer, &rest);
+  return rest == buffer + s.size();
+}
+
+} // namespace text
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <string>
+
+/*
+ * Zero-copy reading of the text inputs of Redex (SDK API listings, profiles,
+ * class lists): the file is mapped rather than read, and split into lines,
+ * words and fields that are views into the mapping.
+ */
+namespace text {
+
+/*
+ * A text file mapped read-only. Files that are empty (which can't be mapped)
+ * read as empty text, like files that can't be opened; is_open() tells them
+ * apart.
+ */
+class MappedTextFile {
+ public:
+  explicit MappedTextFile(const std::string& filename);
+
+  bool is_open() const { return m_is_open; }
+
+  boost::string_view contents() const {
+    return m_file.is_open() ? boost::string_view(m_file.data(), m_file.size())
+                            : boost::string_view();
+  }
+
+ private:
+  boost::iostreams::mapped_file_source m_file;
+  bool m_is_open{false};
+};
+
+/*
+ * Walks through `text` by lines or by whitespace-separated words. The views it
+ * returns point into `text`, which must outlive them.
+ */
+class Tokenizer {
+ public:
+  explicit Tokenizer(boost::string_view text) : m_text(text) {}
+
+  bool at_end() const { return m_pos >= m_text.size(); }
+
+  // The next line, without its "\n" or "\r\n". A last line without a newline
+  // is returned too.
+  bool next_line(boost::string_view* line);
+
+  // The next word; words may span several lines.
+  bool next_word(boost::string_view* word);
+
+ private:
+  boost::string_view m_text;
+  size_t m_pos{0};
+};
+
+/*
+ * Calls `f(field, index)` on each of the `separator`-separated fields of
+ * `line`, empty ones included, until it returns false. Returns whether all
+ * calls returned true.
+ */
+template <class Fn>
+bool for_each_field(boost::string_view line, char separator, const Fn& f) {
+  uint32_t index = 0;
+  while (true) {
+    auto end = line.find(separator);
+    if (!f(line.substr(0, end), index++)) {
+      return false;
+    }
+    if (end == boost::string_view::npos) {
+      return true;
+    }
+    line.remove_prefix(end + 1);
+  }
+}
+
+// Parse the whole of `s` as a number, without allocating; false if `s` has
+// anything else in it.
+bool parse_uint32(boost::string_view s, uint32_t* value);
+bool parse_double(boost::string_view s, double* value);
+
+} // namespace text
@@ -8,6 +8,8 @@
 #pragma once
 
 #include <boost/thread/thread.hpp>
+#include <cstddef>
+#include <utility>
 
 // As far as Intel processors are concerned...
 #define CACHE_LINE_SIZE 64
@@ -23,3 +25,33 @@ inline unsigned int default_num_threads() {
 }
 
 } // namespace redex_parallel
+
+/**
+ * A wrapper around a type which allocates it aligned to the cache line.
+ * This avoids potential cache line bouncing as different cores issue
+ * concurrent writes to distinct instances of \p T that would otherwise have
+ * occupied the same line.
+ */
+template <typename T>
+class CacheAligned {
+ public:
+  template <typename... Args>
+  CacheAligned(Args&&... args) : m_aligned(std::forward<Args>(args)...) {}
+
+  inline operator T&();
+
+ private:
+  alignas(CACHE_LINE_SIZE) T m_aligned;
+};
+
+template <typename T>
+inline CacheAligned<T>::operator T&() {
+  struct Canary {
+    int x;
+    CacheAligned<T> aligned;
+  };
+  static_assert(offsetof(Canary, aligned) % CACHE_LINE_SIZE == 0,
+                "Expecting alignment to cache line size.");
+
+  return m_aligned;
+}
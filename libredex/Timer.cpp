@@ -7,14 +7,96 @@
 
 #include "Timer.h"
 
+#include <json/json.h>
+#include <memory>
+
 #include "Trace.h"
 
-unsigned Timer::s_indent = 0;
+namespace {
+
+struct TraceEvent {
+  std::string name;
+  int64_t start_us;
+  int64_t duration_us;
+};
+
+struct ThreadBuffer {
+  size_t tid;
+  std::vector<TraceEvent> events;
+};
+
+const auto s_epoch = std::chrono::steady_clock::now();
+
+// Buffers are never freed, so that the events of threads that have exited
+// can still be written out.
+std::mutex s_buffers_lock;
+std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+ThreadBuffer& thread_buffer() {
+  static thread_local ThreadBuffer* s_buffer = []() {
+    std::lock_guard<std::mutex> guard(s_buffers_lock);
+    s_buffers.emplace_back(new ThreadBuffer{s_buffers.size(), {}});
+    return s_buffers.back().get();
+  }();
+  return *s_buffer;
+}
+
+} // namespace
+
+namespace trace_events {
+
+std::atomic<bool> g_enabled{false};
+
+void enable() { g_enabled = true; }
+
+void write_json(std::ostream& os) {
+  Json::Value events(Json::arrayValue);
+  {
+    std::lock_guard<std::mutex> guard(s_buffers_lock);
+    for (const auto& buffer : s_buffers) {
+      for (const auto& e : buffer->events) {
+        Json::Value event;
+        event["name"] = e.name;
+        event["ph"] = "X";
+        event["ts"] = (Json::Int64)e.start_us;
+        event["dur"] = (Json::Int64)e.duration_us;
+        event["pid"] = 0;
+        event["tid"] = (Json::UInt64)buffer->tid;
+        events.append(event);
+      }
+    }
+  }
+  Json::Value trace;
+  trace["traceEvents"] = events;
+  trace["displayTimeUnit"] = "ms";
+  os << trace;
+}
+
+} // namespace trace_events
+
+int64_t ScopedTraceEvent::now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - s_epoch)
+      .count();
+}
+
+ScopedTraceEvent::~ScopedTraceEvent() {
+  if (m_start_us < 0) {
+    return;
+  }
+  auto end_us = now_us();
+  thread_buffer().events.push_back(
+      {std::move(m_name), m_start_us, end_us - m_start_us});
+}
+
+thread_local unsigned Timer::s_indent = 0;
 std::mutex Timer::s_lock;
 Timer::times_t Timer::s_times;
 
 Timer::Timer(const std::string& msg)
-    : m_msg(msg), m_start(std::chrono::high_resolution_clock::now()) {
+    : m_msg(msg),
+      m_start(std::chrono::high_resolution_clock::now()),
+      m_trace_event(msg) {
   ++s_indent;
 }
 
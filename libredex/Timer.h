@@ -7,12 +7,72 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <mutex>
+#include <ostream>
 #include <string>
 #include <utility>
 #include <vector>
 
+namespace trace_events {
+
+extern std::atomic<bool> g_enabled;
+
+/*
+ * Starts recording ScopedTraceEvents (and Timers). Recording is off by
+ * default, in which case events cost little more than a relaxed load.
+ */
+void enable();
+
+inline bool is_enabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Writes all events recorded so far in the Chrome trace event format, which
+ * both chrome://tracing and Perfetto can load. There should be no event in
+ * flight on any thread when this function is called.
+ */
+void write_json(std::ostream& os);
+
+} // namespace trace_events
+
+/*
+ * Records the time spent in its scope as a trace event of the calling thread.
+ * Events are appended to a buffer owned by the thread, without any locking,
+ * so this is cheap enough to use inside parallel walks; nesting on each
+ * thread is reconstructed from the timestamps.
+ */
+class ScopedTraceEvent {
+ public:
+  explicit ScopedTraceEvent(const char* name) {
+    if (trace_events::is_enabled()) {
+      m_name = name;
+      m_start_us = now_us();
+    }
+  }
+
+  explicit ScopedTraceEvent(const std::string& name) {
+    if (trace_events::is_enabled()) {
+      m_name = name;
+      m_start_us = now_us();
+    }
+  }
+
+  ScopedTraceEvent(const ScopedTraceEvent&) = delete;
+  ScopedTraceEvent& operator=(const ScopedTraceEvent&) = delete;
+
+  ~ScopedTraceEvent();
+
+ private:
+  static int64_t now_us();
+
+  std::string m_name;
+  int64_t m_start_us{-1};
+};
+
 struct Timer {
   Timer(const std::string& msg);
   ~Timer();
@@ -24,7 +84,9 @@ struct Timer {
  private:
   static std::mutex s_lock;
   static times_t s_times;
-  static unsigned s_indent;
+  // Timers nest on each thread independently.
+  static thread_local unsigned s_indent;
   std::string m_msg;
   std::chrono::high_resolution_clock::time_point m_start;
+  ScopedTraceEvent m_trace_event;
 };
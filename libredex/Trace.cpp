@@ -7,6 +7,7 @@
 
 #include "Trace.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdarg>
 #include <cstdio>
@@ -19,6 +20,10 @@
 #include <unordered_map>
 #include <utility>
 
+// Zero-initialized before any dynamic initialization, so that traces from
+// static initializers that run before the tracer's are simply dropped.
+int trace_impl::s_module_levels[N_TRACE_MODULES];
+
 namespace {
 
 struct Tracer {
@@ -53,6 +58,10 @@ struct Tracer {
 
     init_trace_modules(traceenv);
     init_trace_file(envfile);
+    for (int i = 0; i < N_TRACE_MODULES; ++i) {
+      trace_impl::s_module_levels[i] =
+          static_cast<int>(std::max(m_level, m_traces[i]));
+    }
 
     if (show_timestamps) {
       m_show_timestamps = true;
@@ -72,10 +81,6 @@ struct Tracer {
     }
   }
 
-  bool traceEnabled(TraceModule module, int level) {
-    return level <= m_level || level <= m_traces[module];
-  }
-
   void trace(TraceModule module,
              int level,
              bool suppress_newline,
@@ -168,18 +173,12 @@ struct Tracer {
  private:
   FILE* m_file{nullptr};
   long m_level{0};
-  std::array<long, N_TRACE_MODULES> m_traces;
+  std::array<long, N_TRACE_MODULES> m_traces{};
 };
 
 static Tracer tracer;
 } // namespace
 
-#ifndef NDEBUG
-bool traceEnabled(TraceModule module, int level) {
-  return tracer.traceEnabled(module, level);
-}
-#endif
-
 void trace(TraceModule module,
            int level,
            bool suppress_newline,
@@ -32,6 +32,7 @@
   TM(CONSTP)         \
   TM(CPG)            \
   TM(CS)             \
+  TM(CSD)            \
   TM(CSE)            \
   TM(CU)             \
   TM(CUSTOMSORT)     \
@@ -73,6 +74,7 @@
   TM(MORTIROLO)      \
   TM(MTRANS)         \
   TM(OBFUSCATE)      \
+  TM(OBJLAYOUT)      \
   TM(OPTRES)         \
   TM(ORIGINALNAME)   \
   TM(OSDCE)          \
@@ -111,6 +113,7 @@
   TM(STR_SIMPLE)     \
   TM(SUPER)          \
   TM(SWITCH_EQUIV)   \
+  TM(SWSPEC)         \
   TM(SYNT)           \
   TM(TIME)           \
   TM(TRACKRESOURCES) \
@@ -143,13 +146,48 @@ enum TraceModule : int {
       N_TRACE_MODULES,
 };
 
+/*
+ * Modules listed in REDEX_DISABLED_TRACE_MODULES, a comma-separated list of
+ * TraceModule names given at build time (e.g.
+ * -DREDEX_DISABLED_TRACE_MODULES=PEEPHOLE,REG,CFG), have their TRACE calls
+ * compiled out, arguments included, regardless of the TRACE environment
+ * variable.
+ */
+#ifndef REDEX_DISABLED_TRACE_MODULES
+#define REDEX_DISABLED_TRACE_MODULES
+#endif
+
+namespace trace_impl {
+
+// N_TRACE_MODULES leads the list so that it is never empty.
+constexpr TraceModule s_disabled_modules[] = {N_TRACE_MODULES,
+                                              REDEX_DISABLED_TRACE_MODULES};
+
+constexpr bool is_compiled_out(TraceModule module) {
+  for (auto disabled : s_disabled_modules) {
+    if (disabled == module) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The effective level of each module, i.e. the maximum of its own level and
+// of the global one, set once from the TRACE environment variable.
+extern int s_module_levels[N_TRACE_MODULES];
+
+} // namespace trace_impl
+
 // To avoid "-Wunused" warnings, keep the TRACE macros in common so that the
 // compiler sees a "use." However, ensure that it is optimized away through
 // a constexpr condition in NDEBUG mode.
 #ifdef NDEBUG
 constexpr bool traceEnabled(TraceModule, int) { return false; }
 #else
-bool traceEnabled(TraceModule module, int level);
+inline bool traceEnabled(TraceModule module, int level) {
+  return !trace_impl::is_compiled_out(module) &&
+         level <= trace_impl::s_module_levels[module];
+}
 #endif // NDEBUG
 
 void trace(
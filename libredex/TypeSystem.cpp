@@ -7,38 +7,16 @@
 
 #include "TypeSystem.h"
 
+#include <algorithm>
+#include <unordered_set>
+
 #include "DexUtil.h"
 #include "Resolver.h"
 #include "Timer.h"
+#include "WorkQueue.h"
 
 namespace {
 
-void make_instanceof_table(InstanceOfTable& instance_of_table,
-                           const ClassHierarchy& hierarchy,
-                           const DexType* type,
-                           size_t depth = 1) {
-  auto& parent_chain = instance_of_table[type];
-  const auto cls = type_class(type);
-  if (cls != nullptr) {
-    const auto super = cls->get_super_class();
-    if (super != nullptr) {
-      const auto& super_chain = instance_of_table.find(super);
-      always_assert(super_chain != instance_of_table.end());
-      for (const auto& base : super_chain->second) {
-        parent_chain.emplace_back(base);
-      }
-    }
-  }
-  parent_chain.emplace_back(type);
-  always_assert(parent_chain.size() == depth);
-
-  const auto& children = hierarchy.find(type);
-  if (children == hierarchy.end()) return;
-  for (const auto& child : children->second) {
-    make_instanceof_table(instance_of_table, hierarchy, child, depth + 1);
-  }
-}
-
 void load_interface_children(ClassHierarchy& children, const DexClass* intf) {
   for (const auto& super_intf : intf->get_interfaces()->get_type_list()) {
     children[super_intf].insert(intf->get_type());
@@ -72,6 +50,8 @@ const TypeVector TypeSystem::empty_vec = TypeVector();
 TypeSystem::TypeSystem(const Scope& scope) : m_class_scopes(scope) {
   load_interface_children(scope, m_intf_children);
   make_instanceof_interfaces_table();
+  number_class_hierarchy();
+  make_implementor_ranges();
 }
 
 void TypeSystem::get_all_super_interfaces(const DexType* intf,
@@ -90,7 +70,7 @@ TypeSet TypeSystem::get_all_super_interfaces(const DexType* intf) const {
   return supers;
 }
 
-TypeSet TypeSystem::get_local_interfaces(const TypeSet& classes) {
+TypeSet TypeSystem::get_local_interfaces(const TypeSet& classes) const {
   // Collect all implemented interfaces.
   TypeSet implemented_intfs = get_implemented_interfaces(classes);
 
@@ -169,45 +149,116 @@ std::vector<const DexMethod*> TypeSystem::select_from(
 }
 
 void TypeSystem::make_instanceof_interfaces_table() {
-  TypeVector no_parents;
+  // Both tables follow the superclass chain of each type, so each type can be
+  // done on its own, in parallel.
   const auto& hierarchy = m_class_scopes.get_class_hierarchy();
+  std::vector<const DexType*> types;
+  types.reserve(hierarchy.size() + 1);
   for (const auto& children_it : hierarchy) {
-    const auto parent = children_it.first;
-    const auto parent_cls = type_class(parent);
-    if (parent_cls != nullptr) continue;
-    no_parents.emplace_back(parent);
+    types.emplace_back(children_it.first);
   }
-  no_parents.emplace_back(type::java_lang_Object());
-  for (const auto& root : no_parents) {
-    make_instanceof_table(m_instanceof_table, hierarchy, root);
+  if (hierarchy.count(type::java_lang_Object()) == 0) {
+    types.emplace_back(type::java_lang_Object());
   }
-  for (const auto& root : no_parents) {
-    make_interfaces_table(root);
+  std::vector<TypeVector> parent_chains(types.size());
+  std::vector<TypeSet> interfaces(types.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto& parent_chain = parent_chains[i];
+    auto& intfs = interfaces[i];
+    for (auto type = types[i]; type != nullptr;) {
+      parent_chain.emplace_back(type);
+      const auto cls = type_class(type);
+      if (cls == nullptr) break;
+      for (const auto& intf : cls->get_interfaces()->get_type_list()) {
+        intfs.insert(intf);
+        get_all_super_interfaces(intf, intfs);
+      }
+      type = cls->get_super_class();
+    }
+    std::reverse(parent_chain.begin(), parent_chain.end());
+  });
+  for (size_t i = 0; i < types.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (size_t i = 0; i < types.size(); ++i) {
+    m_instanceof_table.emplace(types[i], std::move(parent_chains[i]));
+    if (!interfaces[i].empty()) {
+      m_interfaces.emplace(types[i], std::move(interfaces[i]));
+    }
   }
 }
 
-void TypeSystem::make_interfaces_table(const DexType* type) {
-  const auto cls = type_class(type);
-  if (cls != nullptr) {
-    const auto super = cls->get_super_class();
-    if (super != nullptr) {
-      const auto& parent_intfs = m_interfaces.find(super);
-      if (parent_intfs != m_interfaces.end()) {
-        m_interfaces[type].insert(parent_intfs->second.begin(),
-                                  parent_intfs->second.end());
-      }
+void TypeSystem::number_class_hierarchy() {
+  const auto& hierarchy = m_class_scopes.get_class_hierarchy();
+  std::unordered_set<const DexType*> children;
+  for (const auto& children_it : hierarchy) {
+    children.insert(children_it.second.begin(), children_it.second.end());
+  }
+  TypeVector roots;
+  for (const auto& children_it : hierarchy) {
+    if (children.count(children_it.first) == 0) {
+      roots.emplace_back(children_it.first);
     }
-    for (const auto& intf : cls->get_interfaces()->get_type_list()) {
-      m_interfaces[type].insert(intf);
-      get_all_super_interfaces(intf, m_interfaces[type]);
+  }
+  if (hierarchy.count(type::java_lang_Object()) == 0) {
+    roots.emplace_back(type::java_lang_Object());
+  }
+
+  // Iterative, as the hierarchy can be deep.
+  struct Frame {
+    const DexType* type;
+    TypeSet::const_iterator next_child;
+    TypeSet::const_iterator end;
+  };
+  std::vector<Frame> stack;
+  auto visit = [&](const DexType* type) {
+    auto pre = static_cast<uint32_t>(m_preorder.size());
+    m_preorder.emplace_back(type);
+    // The depth of the type in the hierarchy is the stack size.
+    bool full_chain = parent_chain(type).size() == stack.size() + 1;
+    m_intervals.emplace(type, TypeInterval{pre, pre, full_chain});
+    const auto& type_children = get_children(type);
+    stack.push_back(Frame{type, type_children.begin(), type_children.end()});
+  };
+  for (const auto root : roots) {
+    visit(root);
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      if (frame.next_child == frame.end) {
+        m_intervals.at(frame.type).last =
+            static_cast<uint32_t>(m_preorder.size() - 1);
+        stack.pop_back();
+        continue;
+      }
+      auto child = *frame.next_child++;
+      if (m_intervals.count(child) == 0) {
+        visit(child);
+      }
     }
   }
+}
 
-  const auto& hierarchy = m_class_scopes.get_class_hierarchy();
-  const auto& children = hierarchy.find(type);
-  if (children == hierarchy.end()) return;
-  for (const auto& child : children->second) {
-    make_interfaces_table(child);
+void TypeSystem::make_implementor_ranges() {
+  for (const auto& intf_it : m_class_scopes.get_interface_map()) {
+    std::vector<uint32_t> numbers;
+    numbers.reserve(intf_it.second.size());
+    for (const auto cls : intf_it.second) {
+      const auto& interval = m_intervals.find(cls);
+      if (interval != m_intervals.end()) {
+        numbers.emplace_back(interval->second.pre);
+      }
+    }
+    std::sort(numbers.begin(), numbers.end());
+    auto& ranges = m_implementor_ranges[intf_it.first];
+    for (auto number : numbers) {
+      if (!ranges.empty() && ranges.back().second + 1 == number) {
+        ranges.back().second = number;
+      } else {
+        ranges.emplace_back(number, number);
+      }
+    }
   }
 }
 
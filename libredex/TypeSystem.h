@@ -11,7 +11,9 @@
 #include "DexClass.h"
 #include "VirtualScope.h"
 
+#include <algorithm>
 #include <unordered_map>
+#include <utility>
 
 using TypeVector = std::vector<const DexType*>;
 using InstanceOfTable = std::unordered_map<const DexType*, TypeVector>;
@@ -34,10 +36,29 @@ class TypeSystem {
   static const TypeSet empty_set;
   static const TypeVector empty_vec;
 
+  /*
+   * The position of a type in a depth-first walk of the class hierarchy: the
+   * descendants of a type are the ones numbered from `pre + 1` to `last`.
+   * The hierarchy misses the links through the classes that are neither in
+   * the scope nor external, so the ancestors in it may only be the bottom of
+   * the parent chain; `full_chain` tells when they are all of it.
+   */
+  struct TypeInterval {
+    uint32_t pre;
+    uint32_t last;
+    bool full_chain;
+  };
+  // The implementors of an interface, as sorted runs of consecutive
+  // pre-order numbers.
+  using NumberRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
   ClassScopes m_class_scopes;
   ClassHierarchy m_intf_children;
   InstanceOfTable m_instanceof_table;
   TypeToTypeSet m_interfaces;
+  std::unordered_map<const DexType*, TypeInterval> m_intervals;
+  TypeVector m_preorder;
+  std::unordered_map<const DexType*, NumberRanges> m_implementor_ranges;
 
  public:
   explicit TypeSystem(const Scope& scope);
@@ -58,8 +79,13 @@ class TypeSystem {
    * The type must be a class (not an interface).
    */
   void get_all_children(const DexType* type, TypeSet& children) const {
-    return ::get_all_children(
-        m_class_scopes.get_class_hierarchy(), type, children);
+    const auto& interval = m_intervals.find(type);
+    if (interval == m_intervals.end()) {
+      return ::get_all_children(
+          m_class_scopes.get_class_hierarchy(), type, children);
+    }
+    children.insert(m_preorder.begin() + interval->second.pre + 1,
+                    m_preorder.begin() + interval->second.last + 1);
   }
 
   /**
@@ -99,23 +125,24 @@ class TypeSystem {
    * Returns only the interfaces that are implemented by the provided
    * classes.
    */
-  TypeSet get_local_interfaces(const TypeSet& classes);
+  TypeSet get_local_interfaces(const TypeSet& classes) const;
 
   /**
    * Return true if child is a subclass or equal to parent.
    * The type must be a class (not an interface).
    */
   bool is_subtype(const DexType* parent, const DexType* child) const {
-    const auto& parent_it = m_instanceof_table.find(parent);
-    const auto& child_it = m_instanceof_table.find(child);
-    if (parent_it == m_instanceof_table.end() ||
-        child_it == m_instanceof_table.end()) {
-      return false;
+    const auto& child_it = m_intervals.find(child);
+    if (child_it == m_intervals.end()) {
+      return is_subtype_by_chain(parent, child);
     }
-    const auto& p_chain = parent_it->second;
-    const auto& c_chain = child_it->second;
-    if (p_chain.size() > c_chain.size()) return false;
-    return c_chain.at(p_chain.size() - 1) == parent;
+    const auto& parent_it = m_intervals.find(parent);
+    if (parent_it != m_intervals.end() &&
+        parent_it->second.pre <= child_it->second.pre &&
+        child_it->second.pre <= parent_it->second.last) {
+      return true;
+    }
+    return !child_it->second.full_chain && is_subtype_by_chain(parent, child);
   }
 
   /**
@@ -124,9 +151,21 @@ class TypeSystem {
    * or an interface DAG.
    */
   bool implements(const DexType* cls, const DexType* intf) const {
-    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
-    if (implementors == m_class_scopes.get_interface_map().end()) return false;
-    return implementors->second.count(cls) > 0;
+    const auto& ranges_it = m_implementor_ranges.find(intf);
+    if (ranges_it == m_implementor_ranges.end()) return false;
+    const auto& interval = m_intervals.find(cls);
+    if (interval == m_intervals.end()) {
+      return get_implementors(intf).count(cls) > 0;
+    }
+    // The last run that starts at or before the class.
+    const auto& ranges = ranges_it->second;
+    auto pre = interval->second.pre;
+    auto range = std::upper_bound(
+        ranges.begin(), ranges.end(), pre,
+        [](uint32_t pre, const std::pair<uint32_t, uint32_t>& range) {
+          return pre < range.first;
+        });
+    return range != ranges.begin() && pre <= std::prev(range)->second;
   }
 
   /**
@@ -221,6 +260,20 @@ class TypeSystem {
                                             const DexType* type) const;
 
  private:
+  bool is_subtype_by_chain(const DexType* parent, const DexType* child) const {
+    const auto& parent_it = m_instanceof_table.find(parent);
+    const auto& child_it = m_instanceof_table.find(child);
+    if (parent_it == m_instanceof_table.end() ||
+        child_it == m_instanceof_table.end()) {
+      return false;
+    }
+    const auto& p_chain = parent_it->second;
+    const auto& c_chain = child_it->second;
+    if (p_chain.size() > c_chain.size()) return false;
+    return c_chain.at(p_chain.size() - 1) == parent;
+  }
+
   void make_instanceof_interfaces_table();
-  void make_interfaces_table(const DexType* type);
+  void number_class_hierarchy();
+  void make_implementor_ranges();
 };
@@ -12,12 +12,18 @@
 #include "ReachableClasses.h"
 #include "Timer.h"
 #include "Trace.h"
+#include "WorkQueue.h"
 
 #include <map>
 #include <set>
+#include <vector>
 
 namespace {
 
+// Below this, the children of a type are visited sequentially: spinning up a
+// work queue for a handful of small subtrees costs more than it saves.
+constexpr size_t MIN_CHILDREN_TO_PARALLELIZE = 8;
+
 /**
  * Create a DexClass for Object, which may be missing if no
  * jar files were specified on the command line
@@ -163,9 +169,7 @@ void create_object_class() {
     ClassCreator cc(type);
     cc.set_access(ACC_PUBLIC);
     auto object_class = cc.create();
-    for (auto const& m : object_methods) {
-      object_class->add_method(m);
-    }
+    object_class->add_methods(object_methods);
   }
 }
 
@@ -665,16 +669,43 @@ bool build_signature_map(const ClassHierarchy& hierarchy,
   // recurse through every child to collect all methods
   // and interface methods under type
   bool escape_up = false;
-  for (const auto& child : children) {
-    SignatureMap child_sig_map;
-    escape_up =
-        build_signature_map(hierarchy, child, child_sig_map) || escape_up;
-    TRACE(VIRT,
-          3,
-          "* Merging sig map of %s with child %s",
-          SHOW(type),
-          SHOW(child));
-    merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+  if (children.size() < MIN_CHILDREN_TO_PARALLELIZE) {
+    for (const auto& child : children) {
+      SignatureMap child_sig_map;
+      escape_up =
+          build_signature_map(hierarchy, child, child_sig_map) || escape_up;
+      TRACE(VIRT,
+            3,
+            "* Merging sig map of %s with child %s",
+            SHOW(type),
+            SHOW(child));
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+    }
+  } else {
+    // The subtrees of the children don't share anything, so they can be
+    // built in parallel. They are still merged in order, which keeps the
+    // scopes the same as a sequential build.
+    std::vector<const DexType*> child_types(children.begin(), children.end());
+    std::vector<SignatureMap> child_sig_maps(child_types.size());
+    std::vector<char> child_escapes(child_types.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      child_escapes[i] =
+          build_signature_map(hierarchy, child_types[i], child_sig_maps[i]);
+    });
+    for (size_t i = 0; i < child_types.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    for (size_t i = 0; i < child_types.size(); ++i) {
+      escape_up = child_escapes[i] || escape_up;
+      TRACE(VIRT,
+            3,
+            "* Merging sig map of %s with child %s",
+            SHOW(type),
+            SHOW(child_types[i]));
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_maps[i]);
+      SignatureMap().swap(child_sig_maps[i]);
+    }
   }
 
   TRACE(VIRT, 3, "* Marking methods at %s", SHOW(type));
@@ -21,36 +21,6 @@
 #include "VirtualScope.h"
 #include "WorkQueue.h"
 
-/**
- * A wrapper around a type which allocates it aligned to the cache line.
- * This avoids potential cache line bouncing as different cores issue
- * concurrent writes to distinct instances of \p T that would otherwise have
- * occupied the same line.
- */
-template <typename T>
-class CacheAligned {
- public:
-  template <typename... Args>
-  CacheAligned(Args&&... args) : m_aligned(std::forward<Args>(args)...) {}
-
-  inline operator T&();
-
- private:
-  alignas(CACHE_LINE_SIZE) T m_aligned;
-};
-
-template <typename T>
-inline CacheAligned<T>::operator T&() {
-  struct Canary {
-    int x;
-    CacheAligned<T> aligned;
-  };
-  static_assert(offsetof(Canary, aligned) % CACHE_LINE_SIZE == 0,
-                "Expecting alignment to cache line size.");
-
-  return m_aligned;
-}
-
 /**
  * A collection of methods useful for iterating over elements of DexClasses.
  *
@@ -284,10 +254,21 @@ class walk {
                               MethodFilterFn filter,
                               InsnWalkerFn walker) {
     iterate_code(cls, filter, [&walker](DexMethod* m, IRCode& code) {
-      editable_cfg_adapter::iterate(&code, [&walker, &m](MethodItemEntry& mie) {
-        walker(m, mie.insn);
-        return editable_cfg_adapter::LOOP_CONTINUE;
-      });
+      if (code.editable_cfg_built()) {
+        editable_cfg_adapter::iterate(&code, [&](MethodItemEntry& mie) {
+          walker(m, mie.insn);
+          return editable_cfg_adapter::LOOP_CONTINUE;
+        });
+        return;
+      }
+      // The walkers only look at the instructions, so the cached index of
+      // the code saves going through all of its entries.
+      const auto& insns = code.opcode_index();
+      for (size_t i = 0; i < insns.size(); ++i) {
+        walker(m, insns[i]);
+        always_assert_log(code.opcode_index_valid(),
+                          "Code was changed while walking its opcodes");
+      }
     });
   }
 
@@ -358,6 +339,18 @@ class walk {
                                             IRCode& ir_code,
                                             const Predicate& predicate,
                                             MatchingInBlockWalkerFn walker) {
+    // Don't build a CFG for code that can't match anyway.
+    const auto& first = std::get<0>(predicate);
+    bool may_match = false;
+    for (const auto& mie : InstructionIterable(ir_code)) {
+      if (first.opcodes.may_match(mie.insn)) {
+        may_match = true;
+        break;
+      }
+    }
+    if (!may_match) {
+      return;
+    }
     std::vector<std::pair<cfg::Block*, std::vector<IRInstruction*>>>
         block_matches;
     ir_code.build_cfg(/* editable */ false);
@@ -408,6 +401,20 @@ class walk {
     parallel() = delete;
     ~parallel() = delete;
 
+    /**
+     * How the method-level walkers below hand out work.
+     *
+     * BY_CLASS: one task per class, in the order of `classes`.
+     *
+     * BY_COST: tasks are ordered by decreasing estimated cost (the sum of the
+     * opcode sizes of the methods' code), so that the largest classes do not
+     * end up as the long tail of the run. Classes whose cost exceeds a fraction
+     * of a worker's fair share are split into one task per method. This is
+     * only safe when the walker does not touch class-level state (e.g. the
+     * method lists) of the classes being walked.
+     */
+    enum class Schedule { BY_CLASS, BY_COST };
+
     /**
      * Call walker on all classes in `classes` in parallel.
      */
@@ -429,11 +436,19 @@ class walk {
     static void methods(
         const Classes& classes,
         MethodWalkerFn walker,
-        size_t num_threads = redex_parallel::default_num_threads()) {
-      auto wq = workqueue_foreach<DexClass*>(
-          [&walker](DexClass* cls) { walk::iterate_methods(cls, walker); },
+        size_t num_threads = redex_parallel::default_num_threads(),
+        Schedule schedule = Schedule::BY_CLASS) {
+      if (schedule == Schedule::BY_CLASS) {
+        auto wq = workqueue_foreach<DexClass*>(
+            [&walker](DexClass* cls) { walk::iterate_methods(cls, walker); },
+            num_threads);
+        run_all(wq, classes);
+        return;
+      }
+      auto wq = workqueue_foreach<Task>(
+          [&walker](Task task) { task.iterate_methods(walker); },
           num_threads);
-      run_all(wq, classes);
+      run_all(wq, schedule_by_cost(classes, num_threads));
     }
 
     /**
@@ -450,28 +465,25 @@ class walk {
         const Classes& classes,
         const std::function<void(DexMethod*, Accumulator*)>& walker,
         size_t num_threads = redex_parallel::default_num_threads(),
-        Accumulator init = Accumulator()) {
-      std::vector<CacheAligned<Accumulator>> acc_vec(num_threads, init);
-
-      auto wq = workqueue_foreach<DexClass*>(
-          [&](DexClass* cls) {
-            Accumulator& acc = acc_vec[redex_parallel::get_worker_id()];
-            for (auto dmethod : cls->get_dmethods()) {
-              TraceContext context(dmethod->get_deobfuscated_name());
-              walker(dmethod, &acc);
-            }
-            for (auto vmethod : cls->get_vmethods()) {
-              TraceContext context(vmethod->get_deobfuscated_name());
-              walker(vmethod, &acc);
-            }
+        Accumulator init = Accumulator(),
+        Schedule schedule = Schedule::BY_CLASS) {
+      WorkerLocal<Accumulator> acc_vec(num_threads, init);
+
+      WorkQueue<Task> wq(
+          [&](WorkerState<Task>* state, Task task) {
+            Accumulator& acc = acc_vec.get(*state);
+            task.iterate_methods(
+                [&walker, &acc](DexMethod* method) { walker(method, &acc); });
           },
           num_threads);
-      run_all(wq, classes);
+      if (schedule == Schedule::BY_CLASS) {
+        run_all(wq, classes);
+      } else {
+        run_all(wq, schedule_by_cost(classes, num_threads));
+      }
 
       auto reduce = Reduce();
-      for (Accumulator& acc : acc_vec) {
-        reduce(acc, &init);
-      }
+      acc_vec.for_each([&](Accumulator& acc) { reduce(acc, &init); });
       return init;
     }
 
@@ -489,13 +501,14 @@ class walk {
         const Classes& classes,
         const std::function<Accumulator(DexMethod*)>& walker,
         size_t num_threads = redex_parallel::default_num_threads(),
-        Accumulator init = Accumulator()) {
+        Accumulator init = Accumulator(),
+        Schedule schedule = Schedule::BY_CLASS) {
       auto reduce = Reduce();
       auto f = [&](DexMethod* method, Accumulator* acc) {
         reduce(walker(method), acc);
       };
       return methods<Accumulator, Reduce, Classes>(
-          classes, f, num_threads, init);
+          classes, f, num_threads, init, schedule);
     }
 
     /**
@@ -521,13 +534,30 @@ class walk {
         const Classes& classes,
         MethodFilterFn filter,
         CodeWalkerFn walker,
-        size_t num_threads = redex_parallel::default_num_threads()) {
-      auto wq = workqueue_foreach<DexClass*>(
-          [&filter, &walker](DexClass* cls) {
-            walk::iterate_code(cls, filter, walker);
+        size_t num_threads = redex_parallel::default_num_threads(),
+        Schedule schedule = Schedule::BY_CLASS) {
+      if (schedule == Schedule::BY_CLASS) {
+        auto wq = workqueue_foreach<DexClass*>(
+            [&filter, &walker](DexClass* cls) {
+              walk::iterate_code(cls, filter, walker);
+            },
+            num_threads);
+        run_all(wq, classes);
+        return;
+      }
+      auto wq = workqueue_foreach<Task>(
+          [&filter, &walker](Task task) {
+            task.iterate_methods([&filter, &walker](DexMethod* m) {
+              if (filter(m)) {
+                auto code = m->get_code();
+                if (code) {
+                  walker(m, *code);
+                }
+              }
+            });
           },
           num_threads);
-      run_all(wq, classes);
+      run_all(wq, schedule_by_cost(classes, num_threads));
     }
 
     /**
@@ -537,8 +567,10 @@ class walk {
     static void code(
         const Classes& classes,
         CodeWalkerFn walker,
-        size_t num_threads = redex_parallel::default_num_threads()) {
-      walk::parallel::code(classes, all_methods, walker, num_threads);
+        size_t num_threads = redex_parallel::default_num_threads(),
+        Schedule schedule = Schedule::BY_CLASS) {
+      walk::parallel::code(classes, all_methods, walker, num_threads,
+                           schedule);
     }
 
     /**
@@ -640,6 +672,88 @@ class walk {
       run_all(wq, virtual_scopes);
     }
 
+    /**
+     * A unit of work of a method-level walker: either all the methods of `cls`,
+     * or just `method` (of an oversized class, see Schedule::BY_COST).
+     */
+    struct Task {
+      DexClass* cls;
+      DexMethod* method;
+
+      /* implicit */ Task(DexClass* cls) : cls(cls), method(nullptr) {}
+      Task(DexClass* cls, DexMethod* method) : cls(cls), method(method) {}
+
+      template <typename Walker>
+      void iterate_methods(const Walker& walker) const {
+        if (method != nullptr) {
+          TraceContext context(method->get_deobfuscated_name());
+          walker(method);
+        } else {
+          walk::iterate_methods(cls, walker);
+        }
+      }
+    };
+
+    /**
+     * The tasks for Schedule::BY_COST, most expensive first.
+     */
+    template <class Classes>
+    static std::vector<Task> schedule_by_cost(const Classes& classes,
+                                              size_t num_threads) {
+      // Methods without code still cost something to visit.
+      auto method_cost = [](const DexMethod* m) -> size_t {
+        auto code = m->get_code();
+        return 1 + (code ? code->sum_opcode_sizes() : 0);
+      };
+
+      std::vector<std::pair<size_t, DexClass*>> class_costs;
+      size_t total_cost = 0;
+      for (const auto& cls : classes) {
+        size_t cost = 0;
+        for (auto m : cls->get_dmethods()) {
+          cost += method_cost(m);
+        }
+        for (auto m : cls->get_vmethods()) {
+          cost += method_cost(m);
+        }
+        class_costs.emplace_back(cost, cls);
+        total_cost += cost;
+      }
+
+      // A class which would take a good chunk of a worker's fair share on its
+      // own gets split up, so that it can be spread over several workers.
+      const size_t fair_share = total_cost / std::max<size_t>(1, num_threads);
+      const size_t split_threshold = std::max<size_t>(1, fair_share / 4);
+      std::vector<std::pair<size_t, Task>> tasks;
+      tasks.reserve(class_costs.size());
+      for (auto& p : class_costs) {
+        auto cls = p.second;
+        if (p.first <= split_threshold) {
+          tasks.emplace_back(p.first, Task(cls));
+          continue;
+        }
+        for (auto m : cls->get_dmethods()) {
+          tasks.emplace_back(method_cost(m), Task(cls, m));
+        }
+        for (auto m : cls->get_vmethods()) {
+          tasks.emplace_back(method_cost(m), Task(cls, m));
+        }
+      }
+      // Stable, so that equally costly tasks retain a deterministic order.
+      std::stable_sort(tasks.begin(), tasks.end(),
+                       [](const std::pair<size_t, Task>& a,
+                          const std::pair<size_t, Task>& b) {
+                         return a.first > b.first;
+                       });
+
+      std::vector<Task> result;
+      result.reserve(tasks.size());
+      for (auto& p : tasks) {
+        result.push_back(p.second);
+      }
+      return result;
+    }
+
    private:
     template <class WQ, class Classes>
     static void run_all(WQ& wq, const Classes& classes) {
@@ -8,28 +8,33 @@
 #pragma once
 
 #include "Debug.h"
+#include "SpartaThreadPool.h"
 #include "Thread.h"
+#include "WorkStealingDeque.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/optional/optional.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/thread.hpp>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <numeric>
-#include <queue>
 #include <random>
+#include <thread>
+#include <type_traits>
 
 namespace redex_parallel {
 
 constexpr int INVALID_ID{-1};
 
 /*
- * When an instance of WorkQueue is running, this will return the ID of the
- * worker for the current thread. Unlike std::this_thread::get_id(), these IDs
- * go from 0 to (num workers - 1).
+ * When a WorkQueue (or parallel_for) is running, this will return the ID of
+ * the worker for the current thread. Unlike std::this_thread::get_id(), these
+ * IDs go from 0 to (num workers - 1).
  *
- * Note that only one WorkQueue should be running at any point in time; nested /
- * concurrent instance of WorkQueues are not supported.
+ * Parallel regions may be nested or run concurrently; the ID always refers to
+ * the innermost region running on the current thread. Prefer WorkerLocal (or
+ * WorkerState::worker_id()) over indexing containers with this directly.
  */
 int get_worker_id();
 
@@ -39,6 +44,21 @@ namespace workqueue_impl {
 
 void set_worker_id(int);
 
+/*
+ * Sets the worker ID of the current thread for the duration of a parallel
+ * region, restoring the enclosing region's ID afterwards.
+ */
+class ScopedWorkerId {
+ public:
+  explicit ScopedWorkerId(int id) : m_saved(redex_parallel::get_worker_id()) {
+    set_worker_id(id);
+  }
+  ~ScopedWorkerId() { set_worker_id(m_saved); }
+
+ private:
+  int m_saved;
+};
+
 /**
  * Creates a random ordering of which threads to visit.  This prevents threads
  * from being prematurely emptied (if everyone targets thread 0, for example)
@@ -57,39 +77,137 @@ inline std::vector<int> create_permutation(int num, unsigned int thread_idx) {
   return attempts;
 }
 
+/*
+ * Tracks the tasks of a WorkQueue which have been added but not yet fully
+ * processed. Workers keep looking for work to steal until this drops to zero,
+ * as a running task may still push more. Workers that find nothing to steal
+ * park until a task gets pushed or the run ends, rather than spinning through
+ * a long tail task.
+ */
+struct Progress {
+  std::atomic<size_t> num_pending{0};
+  // Set when an executor throws, to let all the other workers bail out.
+  std::atomic<bool> aborted{false};
+
+  // Bumped on every push and at the end of the run, so that parked workers
+  // can tell whether anything happened since they last looked for work.
+  std::atomic<size_t> epoch{0};
+
+  size_t get_epoch() const { return epoch.load(); }
+
+  // Blocks until the epoch moves past `seen`.
+  void park(size_t seen) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_num_parked.fetch_add(1);
+    m_cv.wait(lock, [&] { return epoch.load() != seen; });
+    m_num_parked.fetch_sub(1);
+  }
+
+  void notify_push() {
+    epoch.fetch_add(1);
+    if (m_num_parked.load() > 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cv.notify_one();
+    }
+  }
+
+  size_t num_parked() const { return m_num_parked.load(); }
+
+  // When all the tasks are done, or the run is aborted.
+  void notify_end() {
+    epoch.fetch_add(1);
+    if (m_num_parked.load() > 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cv.notify_all();
+    }
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::atomic<size_t> m_num_parked{0};
+};
+
+/*
+ * The work-stealing deques only hold trivially copyable values. Anything else
+ * (e.g. std::string) is moved into a heap-allocated box.
+ */
+template <class Input, bool = std::is_trivially_copyable<Input>::value>
+struct TaskBox {
+  using Type = Input;
+  static Type wrap(Input task) { return task; }
+  static Input unwrap(Type boxed) { return boxed; }
+  static void discard(Type) {}
+};
+
+template <class Input>
+struct TaskBox<Input, false> {
+  using Type = Input*;
+  static Type wrap(Input task) { return new Input(std::move(task)); }
+  static Input unwrap(Type boxed) {
+    std::unique_ptr<Input> owned(boxed);
+    return std::move(*owned);
+  }
+  static void discard(Type boxed) { delete boxed; }
+};
+
 } // namespace workqueue_impl
 
 template <class Input>
 class WorkerState {
+  using Box = workqueue_impl::TaskBox<Input>;
+
  public:
-  WorkerState(size_t id) : m_id(id) {}
+  WorkerState(size_t id, workqueue_impl::Progress* progress)
+      : m_id(id), m_progress(progress) {}
+
+  ~WorkerState() {
+    // Only non-empty if an executor threw.
+    while (auto boxed = m_queue.pop()) {
+      Box::discard(*boxed);
+    }
+  }
 
   /*
    * Add more items to the queue of the currently-running worker. When a
    * WorkQueue is running, this should be used instead of WorkQueue::add_item()
-   * as the latter is not thread-safe.
+   * as the latter is not thread-safe. It must only be called on the
+   * WorkerState passed to the executor, i.e. by the thread owning this state.
    */
   void push_task(Input task) {
-    boost::lock_guard<boost::mutex> guard(m_queue_mtx);
-    m_queue.push(task);
+    m_progress->num_pending.fetch_add(1, std::memory_order_relaxed);
+    m_queue.push(Box::wrap(std::move(task)));
+    m_progress->notify_push();
   }
 
   size_t worker_id() const { return m_id; }
 
  private:
+  // Owner only; LIFO.
   boost::optional<Input> pop_task() {
-    boost::lock_guard<boost::mutex> guard(m_queue_mtx);
-    if (!m_queue.empty()) {
-      auto task = std::move(m_queue.front());
-      m_queue.pop();
-      return task;
+    auto boxed = m_queue.pop();
+    if (!boxed) {
+      return boost::none;
+    }
+    return Box::unwrap(*boxed);
+  }
+
+  // Any thread; FIFO.
+  boost::optional<Input> steal_task() {
+    auto boxed = m_queue.steal();
+    if (!boxed) {
+      return boost::none;
     }
-    return boost::none;
+    return Box::unwrap(*boxed);
   }
 
   size_t m_id;
-  std::queue<Input> m_queue;
-  boost::mutex m_queue_mtx;
+  workqueue_impl::Progress* m_progress;
+  WorkStealingDeque<typename Box::Type> m_queue;
+  // Items added via WorkQueue::add_item() before the run starts. They are
+  // moved into m_queue in reverse, so that the owner still processes them in
+  // insertion order.
+  std::vector<Input> m_initial_tasks;
 
   template <class>
   friend class WorkQueue;
@@ -102,6 +220,8 @@ class WorkQueue {
   Executor m_executor;
 
   std::vector<std::unique_ptr<WorkerState<Input>>> m_states;
+  // Heap-allocated so that WorkQueue stays movable.
+  std::unique_ptr<workqueue_impl::Progress> m_progress;
 
   const size_t m_num_threads{1};
   size_t m_insert_idx{0};
@@ -116,18 +236,31 @@ class WorkQueue {
   void add_item(Input task);
 
   /**
-   * Spawn threads and evaluate function.  This method blocks.
+   * Run the executor on threads borrowed from the process-wide
+   * sparta::parallel::ThreadPool. This method blocks.
+   *
+   * This may be called from within the executor of another WorkQueue. The
+   * calling worker then takes part in the nested run, which only uses as many
+   * other threads as are idle; executors still see worker IDs below
+   * num_threads.
    */
   void run_all();
+
+  // The number of workers of the current run that are parked, waiting for a
+  // task to be pushed or for the run to end.
+  size_t num_parked_workers() const { return m_progress->num_parked(); }
 };
 
 template <class Input>
 WorkQueue<Input>::WorkQueue(WorkQueue::Executor executor,
                             unsigned int num_threads)
-    : m_executor(executor), m_num_threads(num_threads) {
+    : m_executor(executor),
+      m_progress(std::make_unique<workqueue_impl::Progress>()),
+      m_num_threads(num_threads) {
   always_assert(num_threads >= 1);
   for (unsigned int i = 0; i < m_num_threads; ++i) {
-    m_states.emplace_back(std::make_unique<WorkerState<Input>>(i));
+    m_states.emplace_back(
+        std::make_unique<WorkerState<Input>>(i, m_progress.get()));
   }
 }
 
@@ -145,46 +278,220 @@ WorkQueue<Input> workqueue_foreach(
 template <class Input>
 void WorkQueue<Input>::add_item(Input task) {
   m_insert_idx = (m_insert_idx + 1) % m_num_threads;
-  m_states[m_insert_idx]->m_queue.push(task);
+  m_progress->num_pending.fetch_add(1, std::memory_order_relaxed);
+  m_states[m_insert_idx]->m_initial_tasks.push_back(std::move(task));
 }
 
 /*
- * Each worker thread pulls from its own queue first, and then once finished
- * looks randomly at other queues to try and steal work.
+ * Each worker thread pops from the bottom of its own deque first, and then
+ * once that is empty looks randomly at other deques to try and steal work from
+ * their top. Workers only quit once every task that was ever added has been
+ * fully processed, since a running task may still push more work. Until then,
+ * workers that keep finding nothing park (see Progress), so that they don't
+ * burn a core each through the tail of the run.
  */
 template <class Input>
 void WorkQueue<Input>::run_all() {
-  std::vector<boost::thread> all_threads;
+  // Initial tasks are published before any worker starts, so that the deques
+  // of states which end up without a worker (in nested runs) still get them.
+  for (auto& state : m_states) {
+    auto& initial_tasks = state->m_initial_tasks;
+    for (auto it = initial_tasks.rbegin(); it != initial_tasks.rend(); ++it) {
+      state->m_queue.push(workqueue_impl::TaskBox<Input>::wrap(std::move(*it)));
+    }
+    initial_tasks.clear();
+    initial_tasks.shrink_to_fit();
+  }
+
+  auto& progress = *m_progress;
   auto worker = [&](WorkerState<Input>* state, size_t state_idx) {
-    workqueue_impl::set_worker_id(state_idx);
+    workqueue_impl::ScopedWorkerId scoped_id(state_idx);
     auto attempts =
         workqueue_impl::create_permutation(m_num_threads, state_idx);
-    while (true) {
-      auto have_task = false;
-      for (auto idx : attempts) {
-        auto other_state = m_states[idx].get();
-        auto task = other_state->pop_task();
-        if (task) {
-          have_task = true;
-          consume(state, *task);
-          break;
+    // The number of rounds without finding a task to yield for before
+    // parking.
+    constexpr size_t MAX_IDLE_ROUNDS = 16;
+    size_t idle_rounds = 0;
+    while (!progress.aborted.load(std::memory_order_relaxed)) {
+      // Read before looking for work, so that a push that this misses is
+      // never slept through.
+      auto seen = progress.get_epoch();
+      auto task = state->pop_task();
+      for (size_t i = 1; !task && i < attempts.size(); ++i) {
+        task = m_states[attempts[i]]->steal_task();
+      }
+      if (task) {
+        idle_rounds = 0;
+        try {
+          consume(state, std::move(*task));
+        } catch (...) {
+          progress.aborted = true;
+          progress.notify_end();
+          throw;
         }
+        if (progress.num_pending.fetch_sub(1, std::memory_order_acq_rel) ==
+            1) {
+          progress.notify_end();
+        }
+        continue;
       }
-      if (!have_task) {
-        workqueue_impl::set_worker_id(redex_parallel::INVALID_ID);
-        return;
+      if (progress.num_pending.load(std::memory_order_acquire) == 0) {
+        break;
+      }
+      if (idle_rounds < MAX_IDLE_ROUNDS) {
+        ++idle_rounds;
+        std::this_thread::yield();
+      } else {
+        progress.park(seen);
       }
     }
   };
 
-  for (size_t i = 0; i < m_num_threads; ++i) {
-    boost::thread::attributes attrs;
-    attrs.set_stack_size(8 * 1024 * 1024);
-    all_threads.emplace_back(attrs,
-                             boost::bind<void>(worker, m_states[i].get(), i));
+  auto& pool = sparta::parallel::ThreadPool::get();
+  pool.run(pool.available_width(m_num_threads),
+           [&](size_t i) { worker(m_states[i].get(), i); });
+}
+
+/*
+ * Per-worker instances of T, for accumulating results of a parallel region
+ * without taking locks. Each instance is cache-line aligned to avoid false
+ * sharing.
+ *
+ * The number of instances must be at least the number of threads of the
+ * region (WorkQueue or parallel_for) that accesses them.
+ */
+template <class T>
+class WorkerLocal {
+ public:
+  explicit WorkerLocal(
+      size_t num_workers = redex_parallel::default_num_threads(),
+      const T& init = T()) {
+    m_values.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      m_values.emplace_back(init);
+    }
   }
 
-  for (auto& thread : all_threads) {
-    thread.join();
+  // For types which are not copyable: one instance is built per worker by
+  // calling `make()`.
+  template <class Factory>
+  static WorkerLocal<T> create(size_t num_workers, const Factory& make) {
+    WorkerLocal<T> result{Uninitialized()};
+    result.m_values.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      result.m_values.emplace_back(make());
+    }
+    return result;
   }
+
+  // The instance of the worker running on the calling thread, within the
+  // innermost parallel region.
+  T& get() {
+    auto id = redex_parallel::get_worker_id();
+    always_assert_log(id != redex_parallel::INVALID_ID,
+                      "WorkerLocal::get() called outside of a parallel region");
+    return (*this)[id];
+  }
+
+  // The instance of the given worker; unambiguous even with nesting.
+  template <class Input>
+  T& get(const WorkerState<Input>& state) {
+    return (*this)[state.worker_id()];
+  }
+
+  T& operator[](size_t worker_id) {
+    always_assert(worker_id < m_values.size());
+    return m_values[worker_id];
+  }
+
+  size_t size() const { return m_values.size(); }
+
+  template <class Fn>
+  void for_each(const Fn& f) {
+    for (auto& value : m_values) {
+      f(static_cast<T&>(value));
+    }
+  }
+
+ private:
+  struct Uninitialized {};
+  explicit WorkerLocal(Uninitialized) {}
+
+  std::vector<CacheAligned<T>> m_values;
+};
+
+namespace redex_parallel {
+
+/*
+ * Join-style parallel loop: calls `f(i)` for every i in [begin, end) on up to
+ * `num_threads` threads of the shared pool, handing out indices in chunks of
+ * `chunk_size`, and returns once all calls are done.
+ *
+ * This is meant to be usable from within WorkQueue executors (or other
+ * parallel_for bodies): the calling worker takes part in the loop, and the loop
+ * only uses the pool threads that are currently idle. Within `f`,
+ * get_worker_id() / WorkerLocal::get() refer to this loop's workers.
+ */
+template <class Fn>
+void parallel_for(size_t begin,
+                  size_t end,
+                  const Fn& f,
+                  size_t num_threads = default_num_threads(),
+                  size_t chunk_size = 1) {
+  if (begin >= end) {
+    return;
+  }
+  always_assert(chunk_size >= 1);
+  size_t num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+  auto& pool = sparta::parallel::ThreadPool::get();
+  auto width = pool.available_width(std::min(num_threads, num_chunks));
+  std::atomic<size_t> next{begin};
+  pool.run(width, [&](size_t worker_idx) {
+    workqueue_impl::ScopedWorkerId scoped_id(worker_idx);
+    while (true) {
+      auto i = next.fetch_add(chunk_size, std::memory_order_relaxed);
+      if (i >= end) {
+        return;
+      }
+      auto chunk_end = std::min(end, i + chunk_size);
+      for (; i < chunk_end; ++i) {
+        f(i);
+      }
+    }
+  });
 }
+
+/*
+ * Sorts [first, last) like std::sort(), on up to `num_threads` threads: the
+ * range is split into one run per thread, the runs are sorted in parallel and
+ * then merged pairwise, with the merges of each round in parallel. Small
+ * ranges are just sorted in place.
+ */
+template <class RandomIt, class Compare>
+void sort(RandomIt first,
+          RandomIt last,
+          const Compare& cmp,
+          size_t num_threads = default_num_threads()) {
+  constexpr size_t kMinParallelSize = 1 << 14;
+  size_t size = last - first;
+  if (num_threads <= 1 || size < kMinParallelSize) {
+    std::sort(first, last, cmp);
+    return;
+  }
+  size_t run = (size + num_threads - 1) / num_threads;
+  size_t num_runs = (size + run - 1) / run;
+  parallel_for(0, num_runs, [&](size_t i) {
+    std::sort(first + i * run, first + std::min(size, (i + 1) * run), cmp);
+  });
+  for (; run < size; run *= 2) {
+    size_t num_merges = (size + 2 * run - 1) / (2 * run);
+    parallel_for(0, num_merges, [&](size_t i) {
+      size_t begin = i * 2 * run;
+      size_t mid = std::min(size, begin + run);
+      size_t end = std::min(size, begin + 2 * run);
+      std::inplace_merge(first + begin, first + mid, first + end, cmp);
+    });
+  }
+}
+
+} // namespace redex_parallel
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <boost/optional/optional.hpp>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "Thread.h"
+
+namespace workqueue_impl {
+
+/*
+ * A slot of a WorkStealingDeque buffer. Chase-Lev thieves may read a slot that
+ * the owner is concurrently overwriting; such reads are always discarded
+ * afterwards (the thief's CAS on `top` fails), but they must not be data races.
+ * We thus store the value as a sequence of relaxed atomic words, which lets us
+ * support any trivially copyable type without relying on std::atomic<T> being
+ * lock-free (or even available without libatomic) for larger types.
+ */
+template <typename T>
+class AtomicSlot {
+  static constexpr size_t kNumWords =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+ public:
+  void store(const T& value) {
+    uint64_t words[kNumWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < kNumWords; ++i) {
+      m_words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  T load() const {
+    uint64_t words[kNumWords];
+    for (size_t i = 0; i < kNumWords; ++i) {
+      words[i] = m_words[i].load(std::memory_order_relaxed);
+    }
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+    std::memcpy(&value, words, sizeof(T));
+    return *reinterpret_cast<T*>(&value);
+  }
+
+ private:
+  std::atomic<uint64_t> m_words[kNumWords];
+};
+
+} // namespace workqueue_impl
+
+/*
+ * A lock-free work-stealing deque, following "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (Lê et al., PPoPP 2013), which refines
+ * the original Chase-Lev "Dynamic Circular Work-Stealing Deque".
+ *
+ * A single owner thread calls push() and pop(); those operate on the bottom
+ * end, so the owner processes its own work in LIFO order. Any other thread can
+ * call steal(), which takes the oldest element from the top end (FIFO).
+ *
+ * steal() returns none both when the deque is empty and when it lost a race
+ * against another thief or the owner; callers need to have their own way of
+ * telling whether there may be more work (see WorkQueue's pending counter).
+ *
+ * The buffer grows as needed. Retired buffers are kept alive until the deque is
+ * destroyed, since a slow thief might still be reading from them.
+ */
+template <typename T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "WorkStealingDeque elements must be trivially copyable");
+
+ public:
+  explicit WorkStealingDeque(size_t initial_capacity = 64) {
+    size_t capacity = 1;
+    while (capacity < initial_capacity) {
+      capacity <<= 1;
+    }
+    m_buffers.emplace_back(std::make_unique<Buffer>(capacity));
+    m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  // Owner only.
+  void push(const T& value) {
+    auto b = m_bottom.load(std::memory_order_relaxed);
+    auto t = m_top.load(std::memory_order_acquire);
+    auto buffer = m_buffer.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(buffer->capacity) - 1) {
+      buffer = grow(buffer, b, t);
+    }
+    buffer->at(b).store(value);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only.
+  boost::optional<T> pop() {
+    auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+    auto buffer = m_buffer.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      // Empty.
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return boost::none;
+    }
+    auto value = buffer->at(b).load();
+    if (t == b) {
+      // Last element: race against thieves for it.
+      bool won = m_top.compare_exchange_strong(t, t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      if (!won) {
+        return boost::none;
+      }
+    }
+    return value;
+  }
+
+  // Any thread.
+  boost::optional<T> steal() {
+    auto t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return boost::none;
+    }
+    auto buffer = m_buffer.load(std::memory_order_acquire);
+    auto value = buffer->at(t).load();
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return boost::none;
+    }
+    return value;
+  }
+
+  // A snapshot; only exact when no other thread is operating on the deque.
+  size_t size() const {
+    auto b = m_bottom.load(std::memory_order_relaxed);
+    auto t = m_top.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  struct Buffer {
+    explicit Buffer(size_t capacity)
+        : capacity(capacity),
+          slots(new workqueue_impl::AtomicSlot<T>[capacity]) {}
+
+    workqueue_impl::AtomicSlot<T>& at(int64_t i) {
+      return slots[static_cast<size_t>(i) & (capacity - 1)];
+    }
+
+    const size_t capacity;
+    std::unique_ptr<workqueue_impl::AtomicSlot<T>[]> slots;
+  };
+
+  Buffer* grow(Buffer* old_buffer, int64_t b, int64_t t) {
+    auto buffer = std::make_unique<Buffer>(old_buffer->capacity * 2);
+    for (auto i = t; i < b; ++i) {
+      buffer->at(i).store(old_buffer->at(i).load());
+    }
+    auto result = buffer.get();
+    m_buffers.emplace_back(std::move(buffer));
+    m_buffer.store(result, std::memory_order_release);
+    return result;
+  }
+
+  // Keep top and bottom on separate cache lines; thieves hammer on the former
+  // while the owner mostly touches the latter.
+  alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_top{0};
+  alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_bottom{0};
+  std::atomic<Buffer*> m_buffer{nullptr};
+  // All buffers ever allocated, including retired ones. Owner only.
+  std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
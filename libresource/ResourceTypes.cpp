@@ -7053,8 +7053,8 @@ void ResTable::deleteResource(uint32_t resID)
 
 static uint32_t getRemappedEntry(
     uint32_t reference,
-    SortedVector<uint32_t> originalIds,
-    Vector<uint32_t> newIds)
+    const SortedVector<uint32_t>& originalIds,
+    const Vector<uint32_t>& newIds)
 {
     ssize_t index = originalIds.indexOf(reference);
     if (index < 0) {
@@ -7070,15 +7070,14 @@ static uint32_t getRemappedEntry(
 // align based on index.
 void ResTable::remapReferenceValuesForResource(
     uint32_t resID,
-    SortedVector<uint32_t> originalIds,
-    Vector<uint32_t> newIds)
+    const SortedVector<uint32_t>& originalIds,
+    const Vector<uint32_t>& newIds)
 {
-    resource_name resName;
-    if (!this->getResourceName(resID, /* allowUtf8 */ true, &resName)) {
+    // Only the indices of resID are validated, its name isn't needed.
+    const ssize_t pgIndex = getResourcePackageIndex(resID);
+    if (pgIndex < 0) {
         return;
     }
-
-    const ssize_t pgIndex = getResourcePackageIndex(resID);
     const int typeIndex = Res_GETTYPE(resID);
     const int entryIndex = Res_GETENTRY(resID);
     const PackageGroup* pg = mPackageGroups[pgIndex];
@@ -7087,6 +7086,9 @@ void ResTable::remapReferenceValuesForResource(
         return;
     }
     const Type* typeConfigs = typeList[0];
+    if (static_cast<size_t>(entryIndex) >= typeConfigs->entryCount) {
+        return;
+    }
     const size_t NTC = typeConfigs->configs.size();
     for (size_t configIndex = 0; configIndex < NTC; configIndex++) {
         const ResTable_type* type = typeConfigs->configs[configIndex];
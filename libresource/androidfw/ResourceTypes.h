@@ -1891,8 +1891,8 @@ public:
     // align based on index.
     void remapReferenceValuesForResource(
         uint32_t resID,
-        SortedVector<uint32_t> originalIds,
-        Vector<uint32_t> newIds);
+        const SortedVector<uint32_t>& originalIds,
+        const Vector<uint32_t>& newIds);
 
     // For the given resource ID, looks across all configurations and inlines
     // all reference Res_value entries based on the given keys -> inline_values
@@ -7,17 +7,21 @@
 
 #include "AccessMarking.h"
 
+#include <atomic>
 #include <unordered_map>
 
 #include "ClassHierarchy.h"
+#include "ConcurrentContainers.h"
 #include "DexUtil.h"
 #include "FieldOpTracker.h"
 #include "IRCode.h"
+#include "InstructionIndex.h"
 #include "MethodOverrideGraph.h"
 #include "Mutators.h"
 #include "ReachableClasses.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace mog = method_override_graph;
 
@@ -25,10 +29,10 @@ namespace {
 
 size_t mark_classes_final(const Scope& scope) {
   ClassHierarchy ch = build_type_hierarchy(scope);
-  size_t n_classes_finalized = 0;
-  for (auto const& cls : scope) {
+  std::atomic<size_t> n_classes_finalized{0};
+  walk::parallel::classes(scope, [&](DexClass* cls) {
     if (!can_rename(cls) || is_abstract(cls) || is_final(cls)) {
-      continue;
+      return;
     }
     auto const& children = get_children(ch, cls->get_type());
     if (children.empty()) {
@@ -36,28 +40,108 @@ size_t mark_classes_final(const Scope& scope) {
       set_final(cls);
       ++n_classes_finalized;
     }
-  }
+  });
   return n_classes_finalized;
 }
 
+// The override graph is flat and read-only by now, so the classes can be
+// looked at in parallel; each only changes the flags of its own methods.
 size_t mark_methods_final(const Scope& scope,
                           const mog::Graph& override_graph) {
-  size_t n_methods_finalized = 0;
-  for (auto const& cls : scope) {
+  std::atomic<size_t> n_methods_finalized{0};
+  walk::parallel::classes(scope, [&](DexClass* cls) {
     for (auto const& method : cls->get_vmethods()) {
       if (!can_rename(method) || is_abstract(method) || is_final(method)) {
         continue;
       }
-      if (override_graph.get_node(method).children.size() == 0) {
+      if (override_graph.get_node(method).children.empty()) {
         TRACE(ACCESS, 2, "Finalizing method: %s", SHOW(method));
         set_final(method);
         ++n_methods_finalized;
       }
     }
-  }
+  });
   return n_methods_finalized;
 }
 
+bool uses_this(const DexMethod* method) {
+  auto const* code = method->get_code();
+  auto iterable = InstructionIterable(code);
+  auto const this_insn = iterable.begin()->insn;
+  always_assert(this_insn->opcode() == IOPCODE_LOAD_PARAM_OBJECT);
+  auto const this_reg = this_insn->dest();
+  for (const auto& mie : iterable) {
+    auto insn = mie.insn;
+    for (size_t i = 0; i < insn->srcs_size(); i++) {
+      if (this_reg == insn->src(i)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// The virtual methods that are neither overridden nor overriding and that
+// don't use `this`: they can be static.
+std::unordered_set<DexMethod*> find_static_methods(
+    const Scope& scope, const mog::Graph& override_graph) {
+  ConcurrentSet<DexMethod*> statics;
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    for (auto* method : cls->get_vmethods()) {
+      if (!can_rename(method) || is_abstract(method) || is_native(method) ||
+          method->is_external() || method->get_code() == nullptr ||
+          is_synchronized(method) || is_declared_synchronized(method) ||
+          mog::is_true_virtual(override_graph, method) || uses_this(method)) {
+        continue;
+      }
+      statics.insert(method);
+    }
+  });
+  return std::unordered_set<DexMethod*>(statics.begin(), statics.end());
+}
+
+size_t fix_call_sites_static(const InstructionIndex& index,
+                             const std::unordered_set<DexMethod*>& statics) {
+  std::vector<const InstructionIndex::Uses*> uses_by_ref;
+  uses_by_ref.reserve(index.methods().size());
+  for (const auto& pair : index.methods()) {
+    uses_by_ref.push_back(&pair.second);
+  }
+  // Each method reference has its own instructions.
+  std::atomic<size_t> n_calls{0};
+  redex_parallel::parallel_for(0, uses_by_ref.size(), [&](size_t i) {
+    for (const auto& use : *uses_by_ref[i]) {
+      auto insn = use.insn;
+      auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (callee == nullptr || !statics.count(callee)) {
+        continue;
+      }
+      always_assert(!is_invoke_static(insn->opcode()));
+      insn->set_opcode(OPCODE_INVOKE_STATIC);
+      insn->set_method(callee);
+      auto nargs = insn->srcs_size();
+      for (size_t j = 0; j < nargs - 1; j++) {
+        insn->set_src(j, insn->src(j + 1));
+      }
+      insn->set_srcs_size(nargs - 1);
+      ++n_calls;
+    }
+  });
+  return n_calls;
+}
+
+void make_methods_static(const std::unordered_set<DexMethod*>& statics) {
+  // Making a method static moves it to the dmethods of its class, so this is
+  // done in a deterministic order, one method at a time.
+  std::vector<DexMethod*> ordered_statics(statics.begin(), statics.end());
+  std::sort(ordered_statics.begin(), ordered_statics.end(),
+            compare_dexmethods);
+  for (auto method : ordered_statics) {
+    TRACE(ACCESS, 2, "Staticized method: %s", SHOW(method));
+    mutators::make_static(method, mutators::KeepThis::No);
+  }
+}
+
 size_t mark_fields_final(const Scope& scope) {
   field_op_tracker::FieldStatsMap field_stats =
       field_op_tracker::analyze(scope);
@@ -86,7 +170,9 @@ std::vector<DexMethod*> direct_methods(const std::vector<DexClass*>& scope) {
 }
 
 std::unordered_set<DexMethod*> find_private_methods(
-    const std::vector<DexClass*>& scope, const mog::Graph& override_graph) {
+    const std::vector<DexClass*>& scope,
+    const mog::Graph& override_graph,
+    const InstructionIndex& index) {
   auto candidates = mog::get_non_true_virtuals(override_graph, scope);
   auto dmethods = direct_methods(scope);
   for (auto* dmethod : dmethods) {
@@ -103,36 +189,26 @@ std::unordered_set<DexMethod*> find_private_methods(
     }
   }
 
-  ConcurrentSet<DexMethod*> externally_referenced;
-  walk::parallel::opcodes(
-      scope,
-      [](DexMethod*) { return true; },
-      [&](DexMethod* caller, IRInstruction* inst) {
-        if (!inst->has_method()) {
-          return;
-        }
-        auto callee =
-            resolve_method(inst->get_method(), opcode_to_search(inst));
-        if (callee == nullptr || callee->get_class() == caller->get_class()) {
-          return;
-        }
-        externally_referenced.emplace(callee);
-      });
-
-  for (auto* m : externally_referenced) {
-    candidates.erase(m);
+  for (const auto& pair : index.methods()) {
+    for (const auto& use : pair.second) {
+      auto callee =
+          resolve_method(use.insn->get_method(), opcode_to_search(use.insn));
+      if (callee == nullptr ||
+          callee->get_class() == use.method->get_class()) {
+        continue;
+      }
+      candidates.erase(callee);
+    }
   }
   return candidates;
 }
 
-void fix_call_sites_private(const std::vector<DexClass*>& scope,
+void fix_call_sites_private(const InstructionIndex& index,
                             const std::unordered_set<DexMethod*>& privates) {
-  walk::parallel::code(scope, [&](DexMethod* caller, IRCode& code) {
-    for (const MethodItemEntry& mie : InstructionIterable(code)) {
-      IRInstruction* insn = mie.insn;
-      if (!insn->has_method()) continue;
+  for (const auto& pair : index.methods()) {
+    for (const auto& use : pair.second) {
+      auto insn = use.insn;
       auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
-      // should be safe to read `privates` here because there are no writers
       if (callee != nullptr && privates.count(callee)) {
         insn->set_method(callee);
         if (!is_static(callee)) {
@@ -140,7 +216,7 @@ void fix_call_sites_private(const std::vector<DexClass*>& scope,
         }
       }
     }
-  });
+  }
 }
 
 void mark_methods_private(const std::unordered_set<DexMethod*>& privates) {
@@ -184,9 +260,21 @@ void AccessMarkingPass::run_pass(DexStoresVector& stores,
     pm.incr_metric("finalized_fields", n_fields_final);
     TRACE(ACCESS, 1, "Finalized %lu fields", n_fields_final);
   }
+  if (m_staticize_methods) {
+    auto statics = find_static_methods(scope, *override_graph);
+    auto n_calls = fix_call_sites_static(pm.get_instruction_index(stores),
+                                         statics);
+    pm.invalidate_instruction_index();
+    make_methods_static(statics);
+    pm.incr_metric("staticized_methods", statics.size());
+    pm.incr_metric("staticized_calls", n_calls);
+    TRACE(ACCESS, 1, "Staticized %lu methods", statics.size());
+  }
   if (m_privatize_methods) {
-    auto privates = find_private_methods(scope, *override_graph);
-    fix_call_sites_private(scope, privates);
+    const auto& index = pm.get_instruction_index(stores);
+    auto privates = find_private_methods(scope, *override_graph, index);
+    fix_call_sites_private(index, privates);
+    pm.invalidate_instruction_index();
     mark_methods_private(privates);
     pm.incr_metric("privatized_methods", privates.size());
     TRACE(ACCESS, 1, "Privatized %lu methods", privates.size());
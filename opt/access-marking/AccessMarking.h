@@ -16,7 +16,9 @@ class AccessMarkingPass : public Pass {
   std::string get_config_doc() override {
     return "This pass will mark class, methods, and fields final, when able to "
            "do so. This is generally advantageous for performance. It will "
-           "also mark methods private when able to do so, for the same reason.";
+           "also mark methods private when able to do so, for the same reason, "
+           "and make the virtual methods that neither override nor are "
+           "overridden static when they don't use `this`.";
   }
 
   void bind_config() override {
@@ -28,6 +30,8 @@ class AccessMarkingPass : public Pass {
          "Mark every non-final, non-volatile field as final.");
     bind("privatize_methods", true, m_privatize_methods,
          "Mark every eligible method as private.");
+    bind("staticize_methods", true, m_staticize_methods,
+         "Make every non-true-virtual method that doesn't use `this` static.");
   }
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
@@ -37,4 +41,5 @@ class AccessMarkingPass : public Pass {
   bool m_finalize_methods;
   bool m_finalize_fields;
   bool m_privatize_methods;
+  bool m_staticize_methods;
 };
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BlockLayout.h"
+
+#include <atomic>
+
+#include "BlockProfiles.h"
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Show.h"
+#include "Trace.h"
+#include "Walkers.h"
+
+void BlockLayoutPass::run_pass(DexStoresVector& stores,
+                               ConfigFiles& conf,
+                               PassManager& mgr) {
+  const auto& profiles = conf.get_block_profiles();
+  if (!profiles.has_stats()) {
+    TRACE(BBPROFILE, 1, "No block profiles, nothing to lay out");
+    return;
+  }
+
+  auto scope = build_class_scope(stores);
+  std::atomic<size_t> laid_out{0};
+  std::atomic<size_t> stale{0};
+  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
+    auto blocks = profiles.get(method);
+    if (blocks == nullptr) {
+      return;
+    }
+    if (code.count_opcodes() != blocks->num_opcodes) {
+      TRACE(BBPROFILE, 3, "Stale block profile of %s", SHOW(method));
+      ++stale;
+      return;
+    }
+    code.build_cfg(/* editable */ true);
+    auto& cfg = code.cfg();
+    auto cfg_blocks = cfg.blocks();
+    if (cfg_blocks.size() != blocks->counts.size()) {
+      TRACE(BBPROFILE, 3, "Stale block profile of %s", SHOW(method));
+      ++stale;
+      code.clear_cfg();
+      return;
+    }
+    std::unordered_map<cfg::BlockId, uint64_t> weights;
+    for (size_t i = 0; i < cfg_blocks.size(); ++i) {
+      weights.emplace(cfg_blocks[i]->id(), blocks->counts[i]);
+    }
+    cfg.set_block_weights(std::move(weights));
+    code.clear_cfg();
+    ++laid_out;
+  });
+
+  TRACE(BBPROFILE, 1, "Laid out %zu methods, %zu had stale profiles",
+        laid_out.load(), stale.load());
+  mgr.incr_metric("num_methods_laid_out", laid_out);
+  mgr.incr_metric("num_methods_with_stale_profiles", stale);
+}
+
+static BlockLayoutPass s_pass;
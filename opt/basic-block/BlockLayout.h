@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "Pass.h"
+
+/*
+ * This pass lays out the blocks of the methods that have a basic-block
+ * profile (see "block_profile_file" and BlockProfiles.h) by their execution
+ * counts: conditional branches are flipped so that the hot path falls
+ * through, and the blocks that never ran are moved to the end of the method.
+ *
+ * The block ids of a profile are those of the CFG built from the code as
+ * the instrumentation saw it, so the pass needs to run at the same point of
+ * the pipeline as the instrumentation did in the profiled build. Methods whose
+ * code has a different number of opcodes or blocks than the profile says are
+ * left alone. Passes that rebuild an editable CFG of a method afterwards go
+ * back to the default layout.
+ */
+class BlockLayoutPass : public Pass {
+ public:
+  BlockLayoutPass() : Pass("BlockLayoutPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+};
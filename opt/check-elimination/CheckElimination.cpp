@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CheckElimination.h"
+
+#include <vector>
+
+#include "CheckCastAnalysis.h"
+#include "ConstantPropagationAnalysis.h"
+#include "ConstantPropagationTransform.h"
+#include "ControlFlow.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "PatriciaTreeArena.h"
+#include "Walkers.h"
+
+using namespace constant_propagation;
+
+namespace {
+
+constexpr const char* METRIC_BRANCHES_REMOVED = "num_branches_removed";
+constexpr const char* METRIC_NULL_CHECKS_REMOVED = "num_null_checks_removed";
+constexpr const char* METRIC_CHECK_CASTS_REMOVED = "num_check_casts_removed";
+
+using CheckAnalyzer = InstructionAnalyzerCombiner<LocalArrayAnalyzer,
+                                                  HeapEscapeAnalyzer,
+                                                  StringAnalyzer,
+                                                  ConstantClassObjectAnalyzer,
+                                                  PrimitiveAnalyzer>;
+
+bool is_non_null(const ConstantValue& value) {
+  if (auto scd = value.maybe_get<SignedConstantDomain>()) {
+    return !scd->is_bottom() && !sign_domain::contains(scd->interval(), 0);
+  }
+  if (auto ptr = value.maybe_get<AbstractHeapPointer>()) {
+    return ptr->is_value();
+  }
+  if (auto str = value.maybe_get<StringDomain>()) {
+    return str->is_value();
+  }
+  if (auto cls = value.maybe_get<ConstantClassObjectDomain>()) {
+    return cls->is_value();
+  }
+  return false;
+}
+
+// The calls to null check methods on values that the analysis knows not to be
+// null.
+std::unordered_set<const IRInstruction*> find_redundant_null_checks(
+    const cfg::ControlFlowGraph& cfg,
+    const intraprocedural::FixpointIterator& fp_iter,
+    const std::unordered_set<DexMethodRef*>& null_check_methods) {
+  std::unordered_set<const IRInstruction*> null_checks;
+  for (auto block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      if (is_invoke(insn->opcode()) &&
+          null_check_methods.count(insn->get_method()) &&
+          is_non_null(env.get(insn->src(0)))) {
+        null_checks.insert(insn);
+      }
+      fp_iter.analyze_instruction(insn, &env);
+    }
+  }
+  return null_checks;
+}
+
+} // namespace
+
+std::unordered_set<DexMethodRef*>
+CheckEliminationPass::get_null_check_methods() {
+  std::unordered_set<DexMethodRef*> methods;
+  for (const char* name : {
+           "Ljava/lang/Object;.getClass:()Ljava/lang/Class;",
+           "Ljava/util/Objects;.requireNonNull:(Ljava/lang/Object;)Ljava/"
+           "lang/Object;",
+           "Lkotlin/jvm/internal/Intrinsics;.checkNotNull:(Ljava/lang/"
+           "Object;)V",
+           "Lkotlin/jvm/internal/Intrinsics;.checkParameterIsNotNull:(Ljava/"
+           "lang/Object;Ljava/lang/String;)V",
+           "Lkotlin/jvm/internal/Intrinsics;.checkNotNullParameter:(Ljava/"
+           "lang/Object;Ljava/lang/String;)V",
+           "Lkotlin/jvm/internal/Intrinsics;.checkExpressionValueIsNotNull:("
+           "Ljava/lang/Object;Ljava/lang/String;)V",
+           "Lkotlin/jvm/internal/Intrinsics;.checkNotNullExpressionValue:("
+           "Ljava/lang/Object;Ljava/lang/String;)V",
+       }) {
+    // Methods that aren't referenced aren't called either.
+    auto method = DexMethod::get_method(name);
+    if (method != nullptr) {
+      methods.insert(method);
+    }
+  }
+  return methods;
+}
+
+CheckEliminationPass::Stats CheckEliminationPass::process_method(
+    DexMethod* method,
+    const std::unordered_set<DexMethodRef*>& null_check_methods) {
+  Stats stats;
+  auto code = method->get_code();
+  std::unordered_set<const IRInstruction*> null_checks;
+  {
+    code->build_cfg(/* editable */ false);
+    auto& cfg = code->cfg();
+    // None of the abstract states outlive the analysis of the method.
+    sparta::PatriciaTreeArena arena;
+    ConstantEnvironment env;
+    if (!is_static(method)) {
+      auto this_insn = code->get_param_instructions().begin()->insn;
+      env.set(this_insn->dest(),
+              SignedConstantDomain(sign_domain::Interval::NEZ));
+    }
+    intraprocedural::FixpointIterator fp_iter(cfg, CheckAnalyzer());
+    fp_iter.run(env);
+    null_checks = find_redundant_null_checks(cfg, fp_iter, null_check_methods);
+    Transform::Config config;
+    config.replace_moves_with_consts = false;
+    Transform tf(config);
+    stats.branches_removed =
+        tf.apply(fp_iter, WholeProgramState(), code).branches_removed;
+  }
+
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  if (!null_checks.empty()) {
+    // Collect the iterators first, since the replacements may split blocks.
+    std::vector<cfg::InstructionIterator> null_check_its;
+    auto iterable = cfg::InstructionIterable(cfg);
+    for (auto it = iterable.begin(); it != iterable.end(); ++it) {
+      if (!null_checks.count(it->insn)) {
+        continue;
+      }
+      // Only the static null check methods return their argument; a call to
+      // getClass() is just a null check when its result isn't used.
+      if (it->insn->opcode() != OPCODE_INVOKE_STATIC &&
+          !cfg.move_result_of(it).is_end()) {
+        continue;
+      }
+      null_check_its.push_back(it);
+    }
+    for (const auto& it : null_check_its) {
+      auto move_result = cfg.move_result_of(it);
+      if (move_result.is_end()) {
+        cfg.remove_insn(it);
+      } else {
+        auto move = new IRInstruction(OPCODE_MOVE_OBJECT);
+        move->set_src(0, it->insn->src(0));
+        move->set_dest(move_result->insn->dest());
+        cfg.replace_insn(it, move);
+      }
+    }
+    stats.null_checks_removed = null_check_its.size();
+  }
+
+  check_casts::impl::CheckCastAnalysis analysis(method);
+  auto casts = analysis.collect_redundant_checks_replacement();
+  for (const auto& cast : casts) {
+    auto it = cfg.find_insn(cast.insn, cast.block);
+    if (cast.replacement) {
+      cfg.replace_insn(it, *cast.replacement);
+    } else {
+      cfg.remove_insn(it);
+    }
+  }
+  stats.check_casts_removed = casts.size();
+  code->clear_cfg();
+  return stats;
+}
+
+void CheckEliminationPass::run_pass(DexStoresVector& stores,
+                                    ConfigFiles&,
+                                    PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  auto null_check_methods = get_null_check_methods();
+
+  auto stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* method) {
+    if (method->get_code() == nullptr || method->rstate.no_optimizations()) {
+      return Stats{};
+    }
+    return process_method(method, null_check_methods);
+  });
+
+  mgr.incr_metric(METRIC_BRANCHES_REMOVED, stats.branches_removed);
+  mgr.incr_metric(METRIC_NULL_CHECKS_REMOVED, stats.null_checks_removed);
+  mgr.incr_metric(METRIC_CHECK_CASTS_REMOVED, stats.check_casts_removed);
+  TRACE(CONSTP, 1,
+        "[check-elimination] Removed %zu branches, %zu null checks, %zu "
+        "check-casts",
+        stats.branches_removed, stats.null_checks_removed,
+        stats.check_casts_removed);
+}
+
+static CheckEliminationPass s_pass;
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <unordered_set>
+
+#include "DexClass.h"
+#include "Pass.h"
+
+/*
+ * Removes run-time checks whose outcome is known statically:
+ *
+ *   - branches that compare against null a receiver, a freshly allocated
+ *     object, or an array known to be non-null, and branches that compare
+ *     indices with the length of an array whose length is known;
+ *   - calls that only check their argument for null (Object.getClass() with
+ *     an unused result, Objects.requireNonNull(), and Kotlin's
+ *     Intrinsics.checkNotNull* family) when the argument isn't null;
+ *   - check-casts that type inference proves always succeed.
+ *
+ * Branches and null checks are decided by intraprocedural constant
+ * propagation, which is told that `this` isn't null in instance methods and
+ * keeps track of the lengths of arrays that don't escape.
+ */
+class CheckEliminationPass : public Pass {
+ public:
+  struct Stats {
+    size_t branches_removed{0};
+    size_t null_checks_removed{0};
+    size_t check_casts_removed{0};
+
+    Stats& operator+=(const Stats& that) {
+      branches_removed += that.branches_removed;
+      null_checks_removed += that.null_checks_removed;
+      check_casts_removed += that.check_casts_removed;
+      return *this;
+    }
+  };
+
+  CheckEliminationPass() : Pass("CheckEliminationPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  // The methods whose only effect is to throw when their first argument is
+  // null. They either return nothing, or return their first argument.
+  static std::unordered_set<DexMethodRef*> get_null_check_methods();
+
+  static Stats process_method(
+      DexMethod* method,
+      const std::unordered_set<DexMethodRef*>& null_check_methods);
+};
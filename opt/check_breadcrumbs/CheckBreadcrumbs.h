@@ -29,6 +29,8 @@ class CheckBreadcrumbsPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_analysis_only() const override { return true; }
+
  private:
   bool fail;
   bool fail_if_illegal_refs;
@@ -17,11 +17,17 @@
  * Each class is filled with up to a configurable number of methods; only when
  * a class is full, another one is created. Separate classes are created for
  * distinct required api levels.
+ *
+ * With "split_cold_blocks", the cold blocks of the methods that do have a
+ * weight, e.g. the paths that end up throwing an exception, are first split
+ * off into new static methods (see MethodSplitting.h). Those have no weight,
+ * so they get relocated as well, leaving only the hot code in place.
  */
 
 #include "ClassSplitting.h"
 
 #include <algorithm>
+#include <mutex>
 #include <vector>
 
 #include "ApiLevelChecker.h"
@@ -32,6 +38,7 @@
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "InterDexPass.h"
+#include "MethodSplitting.h"
 #include "PluginRegistry.h"
 #include "Walkers.h"
 
@@ -41,17 +48,30 @@ constexpr const char* METRIC_RELOCATION_CLASSES =
     "num_class_splitting_relocation_classes";
 constexpr const char* METRIC_RELOCATED_STATIC_METHODS =
     "num_class_splitting_relocated_static_methods";
+constexpr const char* METRIC_SPLIT_METHODS =
+    "num_class_splitting_split_methods";
+constexpr const char* METRIC_COLD_METHODS = "num_class_splitting_cold_methods";
+constexpr const char* METRIC_COLD_INSTRUCTIONS =
+    "num_class_splitting_cold_instructions";
 
 struct ClassSplittingStats {
   size_t relocation_classes{0};
   size_t relocated_static_methods{0};
 };
 
+bool can_relocate_from(const DexClass* cls) {
+  return !cls->get_clinit() && !cls->is_external() &&
+         !cls->rstate.is_generated();
+}
+
 class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
  public:
-  ClassSplittingInterDexPlugin(size_t target_class_size_threshold,
-                               PassManager& mgr)
+  ClassSplittingInterDexPlugin(
+      size_t target_class_size_threshold,
+      const std::unordered_set<const DexMethod*>& cold_methods,
+      PassManager& mgr)
       : m_target_class_size_threshold(target_class_size_threshold),
+        m_cold_methods(cold_methods),
         m_mgr(mgr) {}
 
   void configure(const Scope& scope, ConfigFiles& conf) override {
@@ -93,11 +113,15 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
       if (!can_relocate(method)) {
         continue;
       }
-      unsigned int weight =
-          get_method_weight_if_available(method, m_method_to_weight);
-      if (weight == 0) {
-        weight = get_method_weight_override(
-            method, m_method_sorting_whitelisted_substrings);
+      // Cold methods are named after the methods they were split from, which
+      // may match a whitelisted substring.
+      unsigned int weight = 0;
+      if (!m_cold_methods.count(method)) {
+        weight = get_method_weight_if_available(method, m_method_to_weight);
+        if (weight == 0) {
+          weight = get_method_weight_override(
+              method, m_method_sorting_whitelisted_substrings);
+        }
       }
       if (weight > 0) {
         continue;
@@ -267,14 +291,12 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
   std::unordered_map<int32_t, TargetClassInfo> m_target_classes;
   size_t m_next_target_class_index{0};
   size_t m_target_class_size_threshold;
+  const std::unordered_set<const DexMethod*>& m_cold_methods;
   std::unordered_map<const DexClass*, SplitClass> m_split_classes;
   std::vector<std::pair<DexMethod*, DexClass*>> m_methods_to_relocate;
   ClassSplittingStats m_stats;
 
-  bool can_relocate(const DexClass* cls) {
-    return !cls->get_clinit() && !cls->is_external() &&
-           !cls->rstate.is_generated();
-  }
+  bool can_relocate(const DexClass* cls) { return can_relocate_from(cls); }
 
   bool can_relocate(const DexMethod* m) {
     if (!m->is_concrete() || m->is_external() || !m->get_code() ||
@@ -291,16 +313,73 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
 
 } // namespace
 
-void ClassSplittingPass::run_pass(DexStoresVector&,
-                                  ConfigFiles&,
+void ClassSplittingPass::split_cold_blocks(DexStoresVector& stores,
+                                           ConfigFiles& conf,
+                                           PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  const auto& method_to_weight = conf.get_method_to_weight();
+  const auto& whitelisted_substrings =
+      conf.get_method_sorting_whitelisted_substrings();
+  std::mutex mutex;
+  std::vector<std::pair<DexClass*, std::vector<DexMethod*>>> split;
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    // Methods without a weight get relocated as a whole, and the cold
+    // methods of classes that can't be relocated from would stay in place.
+    auto cls = type_class(method->get_class());
+    if (method->get_code() == nullptr || !can_relocate_from(cls) ||
+        method->rstate.no_optimizations() ||
+        !gather_invoked_methods_that_prevent_relocation(method)) {
+      return;
+    }
+    if (get_method_weight_if_available(method, &method_to_weight) == 0 &&
+        get_method_weight_override(method, &whitelisted_substrings) == 0) {
+      return;
+    }
+    auto cold_methods =
+        method_splitting::split_cold_blocks(method, m_min_cold_block_insns);
+    if (!cold_methods.empty()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      split.emplace_back(cls, std::move(cold_methods));
+    }
+  });
+
+  // The classes are only changed once they're no longer being walked, in an
+  // order that doesn't depend on the threads.
+  std::sort(split.begin(), split.end(), [](const auto& a, const auto& b) {
+    return compare_dexmethods(a.second[0], b.second[0]);
+  });
+  size_t num_cold_methods = 0;
+  size_t num_cold_insns = 0;
+  for (auto& pair : split) {
+    pair.first->add_methods(pair.second);
+    for (auto cold_method : pair.second) {
+      m_cold_methods.insert(cold_method);
+      ++num_cold_methods;
+      num_cold_insns += cold_method->get_code()->count_opcodes();
+    }
+  }
+  TRACE(CS, 1,
+        "[class splitting] Split %zu methods into %zu cold methods with %zu "
+        "instructions",
+        split.size(), num_cold_methods, num_cold_insns);
+  mgr.incr_metric(METRIC_SPLIT_METHODS, split.size());
+  mgr.incr_metric(METRIC_COLD_METHODS, num_cold_methods);
+  mgr.incr_metric(METRIC_COLD_INSTRUCTIONS, num_cold_insns);
+}
+
+void ClassSplittingPass::run_pass(DexStoresVector& stores,
+                                  ConfigFiles& conf,
                                   PassManager& mgr) {
+  if (m_split_cold_blocks) {
+    split_cold_blocks(stores, conf, mgr);
+  }
   interdex::InterDexRegistry* registry =
       static_cast<interdex::InterDexRegistry*>(
           PluginRegistry::get().pass_registry(interdex::INTERDEX_PASS_NAME));
   std::function<interdex::InterDexPassPlugin*()> fn =
       [this, &mgr]() -> interdex::InterDexPassPlugin* {
     return new ClassSplittingInterDexPlugin(
-        m_relocated_methods_per_target_class, mgr);
+        m_relocated_methods_per_target_class, m_cold_methods, mgr);
   };
   registry->register_plugin("CLASS_SPLITTING_PLUGIN", std::move(fn));
 }
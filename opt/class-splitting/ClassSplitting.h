@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <unordered_set>
+
 #include "Pass.h"
 
 class ClassSplittingPass : public Pass {
@@ -16,10 +18,18 @@ class ClassSplittingPass : public Pass {
   void bind_config() override {
     bind("relocated_methods_per_target_class", 64U,
          m_relocated_methods_per_target_class);
+    bind("split_cold_blocks", false, m_split_cold_blocks);
+    bind("min_cold_block_insns", 8U, m_min_cold_block_insns);
   }
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
  private:
+  void split_cold_blocks(DexStoresVector&, ConfigFiles&, PassManager&);
+
   unsigned int m_relocated_methods_per_target_class;
+  bool m_split_cold_blocks;
+  unsigned int m_min_cold_block_insns;
+  // The methods that cold blocks were split into.
+  std::unordered_set<const DexMethod*> m_cold_methods;
 };
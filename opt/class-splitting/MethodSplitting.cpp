@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodSplitting.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Liveness.h"
+#include "MethodUtil.h"
+#include "ReachingDefinitions.h"
+#include "Show.h"
+#include "Trace.h"
+#include "TypeInference.h"
+
+namespace {
+
+struct Arg {
+  reg_t reg;
+  DexType* type;
+};
+
+struct Region {
+  cfg::Block* entry;
+  std::vector<cfg::Block*> blocks;
+  std::vector<Arg> args;
+};
+
+bool is_ghost(const cfg::Edge* e) { return e->type() == cfg::EDGE_GHOST; }
+
+/*
+ * The blocks from which every path ends in a throw that leaves the method.
+ * Blocks in try regions are never cold, as their handlers may resume the hot
+ * code.
+ */
+std::unordered_set<cfg::Block*> find_cold_blocks(
+    const cfg::ControlFlowGraph& cfg) {
+  std::unordered_set<cfg::Block*> cold;
+  auto blocks = cfg.blocks();
+  for (bool changed = true; changed;) {
+    changed = false;
+    // Successors mostly come after their predecessors, so going backwards
+    // converges quickly.
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+      auto block = *it;
+      if (cold.count(block) || block == cfg.entry_block()) {
+        continue;
+      }
+      bool has_succs = false;
+      bool is_cold = true;
+      for (auto e : block->succs()) {
+        if (is_ghost(e)) {
+          continue;
+        }
+        has_succs = true;
+        if (e->type() == cfg::EDGE_THROW || !cold.count(e->target())) {
+          is_cold = false;
+          break;
+        }
+      }
+      if (!has_succs) {
+        auto last = block->get_last_insn();
+        is_cold = last != block->end() && last->insn->opcode() == OPCODE_THROW;
+      }
+      if (is_cold) {
+        cold.insert(block);
+        changed = true;
+      }
+    }
+  }
+  return cold;
+}
+
+/*
+ * Whether the verifier needs the int value at the `src_index`th source of
+ * `insn` to be a boolean, byte, char or short, which an int parameter can't
+ * prove.
+ */
+bool is_narrow_use(const IRInstruction* insn, size_t src_index) {
+  switch (insn->opcode()) {
+  case OPCODE_IPUT_BOOLEAN:
+  case OPCODE_IPUT_BYTE:
+  case OPCODE_IPUT_CHAR:
+  case OPCODE_IPUT_SHORT:
+  case OPCODE_SPUT_BOOLEAN:
+  case OPCODE_SPUT_BYTE:
+  case OPCODE_SPUT_CHAR:
+  case OPCODE_SPUT_SHORT:
+  case OPCODE_APUT_BOOLEAN:
+  case OPCODE_APUT_BYTE:
+  case OPCODE_APUT_CHAR:
+  case OPCODE_APUT_SHORT:
+    return src_index == 0;
+  default:
+    break;
+  }
+  if (!is_invoke(insn->opcode())) {
+    return false;
+  }
+  size_t arg_index = src_index;
+  if (insn->opcode() != OPCODE_INVOKE_STATIC) {
+    if (arg_index == 0) {
+      return false;
+    }
+    --arg_index;
+  }
+  auto type = insn->get_method()->get_proto()->get_args()->at(arg_index);
+  return type == type::_boolean() || type == type::_byte() ||
+         type == type::_char() || type == type::_short();
+}
+
+/*
+ * Collects the blocks of the cold region that starts at `entry`, and checks
+ * that they can be moved to another method.
+ */
+bool collect_region(cfg::Block* entry,
+                    size_t min_insns,
+                    const std::unordered_set<cfg::Block*>& cold,
+                    Region* region) {
+  auto first = entry->get_first_insn();
+  if (first == entry->end() ||
+      opcode::is_move_result_any(first->insn->opcode()) ||
+      first->insn->opcode() == OPCODE_MOVE_EXCEPTION) {
+    return false;
+  }
+  region->entry = entry;
+  std::unordered_set<cfg::Block*> visited{entry};
+  std::vector<cfg::Block*> work{entry};
+  while (!work.empty()) {
+    auto block = work.back();
+    work.pop_back();
+    region->blocks.push_back(block);
+    for (auto e : block->succs()) {
+      if (!is_ghost(e) && visited.insert(e->target()).second) {
+        always_assert(cold.count(e->target()));
+        work.push_back(e->target());
+      }
+    }
+  }
+  size_t insns = 0;
+  for (auto block : region->blocks) {
+    if (block != entry) {
+      // The region may only be entered through its first block.
+      for (auto e : block->preds()) {
+        if (!visited.count(e->src())) {
+          return false;
+        }
+      }
+    }
+    for (const auto& mie : InstructionIterable(block)) {
+      auto op = mie.insn->opcode();
+      if (op == OPCODE_MONITOR_ENTER || op == OPCODE_MONITOR_EXIT ||
+          op == OPCODE_INVOKE_SUPER) {
+        return false;
+      }
+      ++insns;
+    }
+  }
+  return insns >= min_insns;
+}
+
+/*
+ * Computes the parameters of the method that the region moves to, from the
+ * registers live into it.
+ */
+bool compute_args(const LivenessFixpointIterator& liveness,
+                  const type_inference::TypeInference& types,
+                  const reaching_defs::MoveAwareFixpointIterator& defs,
+                  Region* region) {
+  auto live = liveness.get_live_in_vars_at(region->entry);
+  std::vector<reg_t> regs(live.elements().begin(), live.elements().end());
+  std::sort(regs.begin(), regs.end());
+  const auto& env = types.get_entry_state_at(region->entry);
+  const auto& reg_defs = defs.get_entry_state_at(region->entry);
+  size_t words = 0;
+  for (auto reg : regs) {
+    auto type = env.get_type(reg).element();
+    DexType* arg_type;
+    if (type == REFERENCE) {
+      auto dex_type = env.get_dex_type(reg);
+      if (!dex_type) {
+        return false;
+      }
+      // The method may be relocated to another package.
+      auto cls = type_class(type::get_element_type_if_array(*dex_type));
+      if (cls != nullptr && !cls->is_external() && !is_public(cls)) {
+        return false;
+      }
+      // Uninitialized objects can't be passed to other methods.
+      const auto& def = reg_defs.get(reg);
+      if (def.is_top() || def.is_bottom()) {
+        return false;
+      }
+      for (auto insn : def.elements()) {
+        if (insn->opcode() == OPCODE_NEW_INSTANCE) {
+          return false;
+        }
+      }
+      arg_type = const_cast<DexType*>(*dex_type);
+    } else if (type == INT || type == FLOAT) {
+      for (auto block : region->blocks) {
+        for (const auto& mie : InstructionIterable(block)) {
+          for (size_t i = 0; i < mie.insn->srcs_size(); ++i) {
+            if (mie.insn->src(i) == reg && is_narrow_use(mie.insn, i)) {
+              return false;
+            }
+          }
+        }
+      }
+      arg_type = type == INT ? type::_int() : type::_float();
+    } else if (type == LONG1) {
+      arg_type = type::_long();
+    } else if (type == DOUBLE1) {
+      arg_type = type::_double();
+    } else {
+      // Constants don't tell what they'll be used as.
+      return false;
+    }
+    words += type::is_wide_type(arg_type) ? 2 : 1;
+    region->args.push_back(Arg{reg, arg_type});
+  }
+  return words <= 255;
+}
+
+DexMethod* make_cold_method(const DexMethod* method,
+                            const cfg::ControlFlowGraph& cfg,
+                            const Region& region) {
+  std::deque<DexType*> arg_types;
+  for (const auto& arg : region.args) {
+    arg_types.push_back(arg.type);
+  }
+  // It never returns, but its callers need something to throw so that the
+  // verifier sees their code end.
+  auto proto =
+      DexProto::make_proto(type::java_lang_Throwable(),
+                           DexTypeList::make_type_list(std::move(arg_types)));
+  DexMethod* cold;
+  {
+    static std::mutex s_mutex;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (size_t i = 0;; ++i) {
+      auto name = DexString::make_string(method->get_name()->str() + "$cold" +
+                                         std::to_string(i));
+      if (DexMethod::get_method(method->get_class(), name, proto) == nullptr) {
+        cold = DexMethod::make_method(method->get_class(), name, proto)
+                   ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+        break;
+      }
+    }
+  }
+
+  // Copy the whole CFG, enter it through a new block that loads the
+  // parameters into the registers the region reads, and drop the rest.
+  auto cold_cfg = std::make_unique<cfg::ControlFlowGraph>();
+  cfg.deep_copy(cold_cfg.get());
+  cfg::Block* entry = nullptr;
+  for (auto block : cold_cfg->blocks()) {
+    if (block->id() == region.entry->id()) {
+      entry = block;
+    }
+  }
+  auto params = cold_cfg->create_block();
+  std::vector<IRInstruction*> load_params;
+  std::vector<IRInstruction*> moves;
+  for (const auto& arg : region.args) {
+    bool wide = type::is_wide_type(arg.type);
+    bool object = type::is_object(arg.type);
+    // Parameters go at the end of the frame.
+    auto param =
+        wide ? cold_cfg->allocate_wide_temp() : cold_cfg->allocate_temp();
+    auto load_param = new IRInstruction(
+        wide ? IOPCODE_LOAD_PARAM_WIDE
+             : object ? IOPCODE_LOAD_PARAM_OBJECT : IOPCODE_LOAD_PARAM);
+    load_params.push_back(load_param->set_dest(param));
+    auto move = new IRInstruction(
+        wide ? OPCODE_MOVE_WIDE : object ? OPCODE_MOVE_OBJECT : OPCODE_MOVE);
+    moves.push_back(move->set_dest(arg.reg)->set_src(0, param));
+  }
+  params->push_back(load_params);
+  params->push_back(moves);
+  cold_cfg->add_edge(params, entry, cfg::EDGE_GOTO);
+  cold_cfg->set_entry_block(params);
+  cold_cfg->remove_unreachable_blocks();
+
+  auto code = std::make_unique<IRCode>(std::move(cold_cfg));
+  if (method->get_code()->get_debug_item() != nullptr) {
+    code->set_debug_item(std::make_unique<DexDebugItem>());
+  }
+  cold->set_code(std::move(code));
+  cold->set_deobfuscated_name(show(cold));
+  // Inlining it back would undo the split.
+  cold->rstate.set_dont_inline();
+  return cold;
+}
+
+} // namespace
+
+namespace method_splitting {
+
+std::vector<DexMethod*> split_cold_blocks(DexMethod* method,
+                                          size_t min_insns) {
+  std::vector<DexMethod*> cold_methods;
+  auto code = method->get_code();
+  if (code == nullptr || method::is_init(method) ||
+      method::is_clinit(method)) {
+    return cold_methods;
+  }
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  auto cold = find_cold_blocks(cfg);
+  std::vector<Region> regions;
+  for (auto block : cfg.blocks()) {
+    if (!cold.count(block)) {
+      continue;
+    }
+    bool from_hot = false;
+    for (auto e : block->preds()) {
+      from_hot |= !cold.count(e->src());
+    }
+    Region region;
+    if (from_hot && collect_region(block, min_insns, cold, &region)) {
+      regions.push_back(std::move(region));
+    }
+  }
+
+  if (!regions.empty()) {
+    cfg.calculate_exit_block();
+    LivenessFixpointIterator liveness(cfg);
+    liveness.run(LivenessDomain());
+    type_inference::TypeInference types(cfg);
+    types.run(method);
+    reaching_defs::MoveAwareFixpointIterator defs(cfg);
+    defs.run(reaching_defs::Environment());
+    regions.erase(std::remove_if(regions.begin(),
+                                 regions.end(),
+                                 [&](Region& region) {
+                                   return !compute_args(
+                                       liveness, types, defs, &region);
+                                 }),
+                  regions.end());
+
+    auto exit = cfg.exit_block();
+    if (cfg.get_pred_edge_of_type(exit, cfg::EDGE_GHOST) != nullptr) {
+      cfg.remove_block(exit);
+    }
+    cfg.set_exit_block(nullptr);
+  }
+
+  for (const auto& region : regions) {
+    auto cold_method = make_cold_method(method, cfg, region);
+    TRACE(CS, 3, "[class splitting] Split %zu cold blocks of {%s} into {%s}",
+          region.blocks.size(), SHOW(method), SHOW(cold_method));
+
+    auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+    invoke->set_method(cold_method)->set_srcs_size(region.args.size());
+    for (size_t i = 0; i < region.args.size(); ++i) {
+      invoke->set_src(i, region.args[i].reg);
+    }
+    auto exception = cfg.allocate_temp();
+    auto move_result = new IRInstruction(OPCODE_MOVE_RESULT_OBJECT);
+    auto throw_insn = new IRInstruction(OPCODE_THROW);
+    auto call = cfg.create_block();
+    call->push_back({invoke,
+                     move_result->set_dest(exception),
+                     throw_insn->set_src(0, exception)});
+    auto preds = region.entry->preds();
+    for (auto e : preds) {
+      cfg.set_edge_target(e, call);
+    }
+    cold_methods.push_back(cold_method);
+  }
+  if (!regions.empty()) {
+    cfg.remove_unreachable_blocks();
+  }
+  code->clear_cfg();
+  return cold_methods;
+}
+
+} // namespace method_splitting
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "DexClass.h"
+
+namespace method_splitting {
+
+/*
+ * Moves the cold parts of a method out into new static methods of its class,
+ * so that the hot part is all that's left to page in when the method runs.
+ *
+ * A block is cold if every path from it ends in a throw, e.g. the code that
+ * builds the message of an exception after a failed check. Each maximal
+ * region of cold blocks that is only entered through its first block, and
+ * that has at least `min_insns` instructions, becomes a method that takes the
+ * registers live into the region as parameters and never returns normally.
+ * The region is replaced with an invocation of it, and a throw of what it
+ * "returns" to keep the verifier happy.
+ *
+ * Regions are left alone if they're in a try region, if they use monitors or
+ * invoke-super, or if the types of the registers live into them aren't known
+ * precisely. Constructors aren't split.
+ *
+ * The new methods are public, so they can be relocated to other classes
+ * without changing their callers. Returns them; the caller adds them to the
+ * class.
+ */
+std::vector<DexMethod*> split_cold_blocks(DexMethod* method, size_t min_insns);
+
+} // namespace method_splitting
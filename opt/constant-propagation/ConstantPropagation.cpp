@@ -7,46 +7,93 @@
 
 #include "ConstantPropagation.h"
 
+#include <algorithm>
+
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationTransform.h"
+#include "PatriciaTreeArena.h"
 #include "Walkers.h"
 
 using namespace constant_propagation;
 
+namespace {
+
+struct Stats {
+  Transform::Stats transform;
+  size_t fixpoint_iterations{0};
+  size_t max_fixpoint_iterations{0};
+  size_t methods_over_budget{0};
+
+  Stats& operator+=(const Stats& that) {
+    transform += that.transform;
+    fixpoint_iterations += that.fixpoint_iterations;
+    max_fixpoint_iterations =
+        std::max(max_fixpoint_iterations, that.max_fixpoint_iterations);
+    methods_over_budget += that.methods_over_budget;
+    return *this;
+  }
+};
+
+} // namespace
+
 void ConstantPropagationPass::run_pass(DexStoresVector& stores,
                                        ConfigFiles&,
                                        PassManager& mgr) {
   auto scope = build_class_scope(stores);
 
-  auto stats =
-      walk::parallel::methods<Transform::Stats>(scope, [&](DexMethod* method) {
-        if (method->get_code() == nullptr) {
-          return Transform::Stats();
-        }
-
-        TRACE(CONSTP, 2, "Method: %s", SHOW(method));
-        auto& code = *method->get_code();
-        code.build_cfg(/* editable */ false);
-        auto& cfg = code.cfg();
-
-        TRACE(CONSTP, 5, "CFG: %s", SHOW(cfg));
-        intraprocedural::FixpointIterator fp_iter(cfg,
-                                                  ConstantPrimitiveAnalyzer());
-        fp_iter.run(ConstantEnvironment());
-        constant_propagation::Transform tf(m_config.transform);
-        return tf.apply(fp_iter, WholeProgramState(), &code);
-      });
-
-  mgr.incr_metric("num_branch_propagated", stats.branches_removed);
-  mgr.incr_metric("num_materialized_consts", stats.materialized_consts);
-  mgr.incr_metric("num_throws", stats.throws);
-
-  TRACE(CONSTP, 1, "num_branch_propagated: %d", stats.branches_removed);
+  auto stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* method) {
+    Stats stats;
+    if (method->get_code() == nullptr) {
+      return stats;
+    }
+
+    TRACE(CONSTP, 2, "Method: %s", SHOW(method));
+    auto& code = *method->get_code();
+    code.build_cfg(/* editable */ false);
+    auto& cfg = code.cfg();
+
+    TRACE(CONSTP, 5, "CFG: %s", SHOW(cfg));
+    // None of the abstract states outlive the analysis of the method.
+    sparta::PatriciaTreeArena arena;
+    constant_propagation::Transform tf(m_config.transform);
+    if (m_config.sparse) {
+      intraprocedural::SparseFixpointIterator sparse_iter(
+          cfg, ConstantPrimitiveAnalyzer());
+      sparse_iter.run(ConstantEnvironment());
+      stats.transform = tf.apply(sparse_iter, WholeProgramState(), &code);
+      return stats;
+    }
+    intraprocedural::FixpointIterator fp_iter(cfg, ConstantPrimitiveAnalyzer());
+    fp_iter.set_iteration_budget(m_config.fixpoint_iteration_budget);
+    fp_iter.run(ConstantEnvironment());
+    stats.fixpoint_iterations = fp_iter.get_iteration_count();
+    stats.max_fixpoint_iterations = stats.fixpoint_iterations;
+    if (fp_iter.budget_exhausted()) {
+      TRACE(CONSTP, 2, "Iteration budget exhausted for %s", SHOW(method));
+      ++stats.methods_over_budget;
+    }
+    stats.transform = tf.apply(fp_iter, WholeProgramState(), &code);
+    return stats;
+  });
+
+  mgr.incr_metric("num_branch_propagated", stats.transform.branches_removed);
+  mgr.incr_metric("num_materialized_consts",
+                  stats.transform.materialized_consts);
+  mgr.incr_metric("num_throws", stats.transform.throws);
+  mgr.incr_metric("num_fixpoint_iterations", stats.fixpoint_iterations);
+  mgr.incr_metric("max_fixpoint_iterations", stats.max_fixpoint_iterations);
+  mgr.incr_metric("num_methods_over_iteration_budget",
+                  stats.methods_over_budget);
+
+  TRACE(CONSTP, 1, "num_branch_propagated: %d",
+        stats.transform.branches_removed);
   TRACE(CONSTP,
         1,
         "num_moves_replaced_by_const_loads: %d",
-        stats.materialized_consts);
-  TRACE(CONSTP, 1, "num_throws: %d", stats.throws);
+        stats.transform.materialized_consts);
+  TRACE(CONSTP, 1, "num_throws: %d", stats.transform.throws);
+  TRACE(CONSTP, 1, "num_methods_over_iteration_budget: %d",
+        stats.methods_over_budget);
 }
 
 static ConstantPropagationPass s_pass;
@@ -7,14 +7,24 @@
 
 #pragma once
 
+#include <limits>
+
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationTransform.h"
 #include "Pass.h"
+#include "SparseConstantPropagation.h"
 
 class ConstantPropagationPass : public Pass {
  public:
   struct Config {
     constant_propagation::Transform::Config transform;
+    // The number of extrapolation steps after which the analysis of a method
+    // gives up on its loops, see MonotonicFixpointIterator.
+    uint32_t fixpoint_iteration_budget;
+    // Use the sparse analysis over def-use chains, see
+    // SparseFixpointIterator. It is faster, but approximate: it misses the
+    // constants that only the branches taken imply. Off by default.
+    bool sparse;
   };
 
   ConstantPropagationPass() : Pass("ConstantPropagationPass") {}
@@ -24,6 +34,10 @@ class ConstantPropagationPass : public Pass {
          true,
          m_config.transform.replace_moves_with_consts);
     bind("remove_dead_switch", true, m_config.transform.remove_dead_switch);
+    bind("fixpoint_iteration_budget",
+         std::numeric_limits<uint32_t>::max(),
+         m_config.fixpoint_iteration_budget);
+    bind("sparse", false, m_config.sparse);
   }
 
   void run_pass(DexStoresVector& stores,
@@ -105,6 +105,7 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
     fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
   }
   compute_analysis_stats(fp_iter->get_whole_program_state());
+  m_stats.reused_method_analyses = fp_iter->get_reused_analyses();
 
   return fp_iter;
 }
@@ -190,6 +191,7 @@ void PassImpl::run_pass(DexStoresVector& stores,
   mgr.incr_metric("added_param_const", m_transform_stats.added_param_const);
   mgr.incr_metric("constant_fields", m_stats.constant_fields);
   mgr.incr_metric("constant_methods", m_stats.constant_methods);
+  mgr.incr_metric("reused_method_analyses", m_stats.reused_method_analyses);
 }
 
 static PassImpl s_pass;
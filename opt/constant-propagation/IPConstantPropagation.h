@@ -79,6 +79,7 @@ class PassImpl : public Pass {
   struct Stats {
     size_t constant_fields{0};
     size_t constant_methods{0};
+    size_t reused_method_analyses{0};
   } m_stats;
   Transform::Stats m_transform_stats;
   Config m_config;
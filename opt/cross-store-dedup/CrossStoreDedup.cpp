@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CrossStoreDedup.h"
+
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ApiLevelChecker.h"
+#include "DexHasher.h"
+#include "DexStore.h"
+#include "DexUtil.h"
+#include "MethodUtil.h"
+#include "PassManager.h"
+#include "ReachableClasses.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace {
+
+constexpr const char* METRIC_CANDIDATES = "num_candidates";
+constexpr const char* METRIC_HOISTED_METHODS = "num_hoisted_methods";
+constexpr const char* METRIC_REMOVED_METHODS = "num_removed_methods";
+constexpr const char* METRIC_REWRITTEN_INVOKES = "num_rewritten_invokes";
+
+/*
+ * A class of the root store that can host the hoisted methods, preferably
+ * out of the primary dex, which the secondary dexes of the root store can't
+ * be referenced from.
+ */
+DexClass* find_host_class(const DexStore& root_store) {
+  const auto& dexen = root_store.get_dexen();
+  DexClass* host_cls = nullptr;
+  size_t min_size = std::numeric_limits<size_t>::max();
+  for (size_t i = dexen.size() > 1 ? 1 : 0; i < dexen.size(); ++i) {
+    for (auto cls : dexen[i]) {
+      if (!is_public(cls) || cls->is_external() || is_interface(cls) ||
+          root(cls) || cls->get_clinit() ||
+          cls->get_super_class() != type::java_lang_Object() ||
+          !cls->get_interfaces()->get_type_list().empty()) {
+        // Invoking a static method of the host must not initialize any
+        // other classes.
+        continue;
+      }
+      const auto* annos = cls->get_anno_set();
+      if (annos && annos->size() > 0) {
+        // Annotations might indicate API-level restrictions.
+        continue;
+      }
+      size_t size = cls->get_vmethods().size() + cls->get_dmethods().size() +
+                    cls->get_sfields().size();
+      if (size < min_size) {
+        min_size = size;
+        host_cls = cls;
+      }
+    }
+  }
+  return host_cls;
+}
+
+bool can_hoist(DexMethod* method,
+               const DexClass* host_cls,
+               const XStoreRefs& xstores,
+               const cross_store_dedup::Config& config) {
+  if (!is_static(method) || method::is_clinit(method) || !can_rename(method) ||
+      !can_delete(method) || method->rstate.no_optimizations() ||
+      is_synchronized(method) || is_declared_synchronized(method)) {
+    return false;
+  }
+  // Calling the method initializes its class, which must not be skipped when
+  // the calls go to the host instead.
+  auto cls = type_class(method->get_class());
+  auto clinit = cls->get_clinit();
+  if (clinit != nullptr && !method::is_trivial_clinit(clinit)) {
+    return false;
+  }
+  auto code = method->get_code();
+  if (code == nullptr || code->count_opcodes() < config.min_method_size) {
+    return false;
+  }
+  // The annotations would have to match too.
+  const auto* annos = method->get_anno_set();
+  if ((annos && annos->size() > 0) || method->get_param_anno()) {
+    return false;
+  }
+  if (host_cls->rstate.get_api_level() <
+      api::LevelChecker::get_method_level(method)) {
+    return false;
+  }
+  std::vector<DexType*> types;
+  method->get_proto()->gather_types(types);
+  code->gather_types(types);
+  for (auto type : types) {
+    if (xstores.illegal_ref(host_cls->get_type(), type)) {
+      return false;
+    }
+  }
+  return gather_invoked_methods_that_prevent_relocation(method);
+}
+
+} // namespace
+
+namespace cross_store_dedup {
+
+Stats dedup_methods(DexStoresVector& stores, const Config& config) {
+  Stats stats;
+  if (stores.size() < 2) {
+    return stats;
+  }
+  auto host_cls = find_host_class(stores[0]);
+  if (host_cls == nullptr) {
+    TRACE(CSD, 1, "No host class in the root store");
+    return stats;
+  }
+  TRACE(CSD, 2, "Host class: %s", SHOW(host_cls));
+
+  XStoreRefs xstores(stores);
+  std::vector<DexMethod*> candidates;
+  for (size_t i = 1; i < stores.size(); ++i) {
+    for (const auto& classes : stores[i].get_dexen()) {
+      for (auto cls : classes) {
+        for (auto method : cls->get_dmethods()) {
+          if (can_hoist(method, host_cls, xstores, config)) {
+            candidates.push_back(method);
+          }
+        }
+      }
+    }
+  }
+  stats.candidates = candidates.size();
+
+  std::vector<size_t> hashes(candidates.size());
+  redex_parallel::parallel_for(0, candidates.size(), [&](size_t i) {
+    hashes[i] = hashing::hash_code(candidates[i]->get_code());
+  });
+
+  // Methods of the same signature and code hash, in the order of the stores,
+  // then of the methods, so that the same ones get hoisted in every build.
+  std::unordered_map<DexProto*, std::unordered_map<size_t, size_t>> group_idxs;
+  std::vector<std::vector<DexMethod*>> groups;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    auto method = candidates[i];
+    auto it = group_idxs[method->get_proto()].emplace(hashes[i], groups.size());
+    if (it.second) {
+      groups.emplace_back();
+    }
+    groups[it.first->second].push_back(method);
+  }
+
+  std::unordered_map<const DexMethod*, DexMethod*> replacements;
+  for (auto& group : groups) {
+    while (group.size() > 1) {
+      // Hash collisions aside, the group is a single class of equal methods.
+      auto rep = group.front();
+      std::vector<DexMethod*> equal_methods;
+      std::vector<DexMethod*> others;
+      std::unordered_set<size_t> store_idxs;
+      for (auto method : group) {
+        if (method == rep ||
+            method->get_code()->structural_equals(*rep->get_code())) {
+          equal_methods.push_back(method);
+          store_idxs.insert(xstores.get_store_idx(method->get_class()));
+        } else {
+          others.push_back(method);
+        }
+      }
+      group = std::move(others);
+      // Duplicates within a single module are left alone, as it has no
+      // class that all of them could be moved to.
+      if (store_idxs.size() < 2) {
+        continue;
+      }
+      TRACE(CSD, 3, "Hoisting %s, which %zu stores duplicate", SHOW(rep),
+            store_idxs.size());
+      always_assert(relocate_method_if_no_changes(rep, host_cls->get_type()));
+      ++stats.hoisted_methods;
+      for (auto method : equal_methods) {
+        if (method != rep) {
+          replacements.emplace(method, rep);
+        }
+      }
+    }
+  }
+  if (replacements.empty()) {
+    return stats;
+  }
+
+  auto scope = build_class_scope(stores);
+  std::atomic<size_t> rewritten_invokes{0};
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
+    for (auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (insn->opcode() != OPCODE_INVOKE_STATIC) {
+        continue;
+      }
+      auto callee = resolve_method(insn->get_method(), MethodSearch::Static);
+      auto it = replacements.find(callee);
+      if (it != replacements.end()) {
+        insn->set_method(it->second);
+        ++rewritten_invokes;
+      }
+    }
+  });
+  stats.rewritten_invokes = rewritten_invokes;
+
+  for (const auto& pair : replacements) {
+    auto method = const_cast<DexMethod*>(pair.first);
+    type_class(method->get_class())->remove_method(method);
+    DexMethod::erase_method(method);
+  }
+  stats.removed_methods = replacements.size();
+  return stats;
+}
+
+void CrossStoreDedupPass::run_pass(DexStoresVector& stores,
+                                   ConfigFiles&,
+                                   PassManager& mgr) {
+  auto stats = dedup_methods(stores, m_config);
+  TRACE(CSD, 1,
+        "Hoisted %zu of %zu candidate methods into the root store, removing "
+        "%zu duplicates and rewriting %zu invokes",
+        stats.hoisted_methods, stats.candidates, stats.removed_methods,
+        stats.rewritten_invokes);
+  mgr.set_metric(METRIC_CANDIDATES, stats.candidates);
+  mgr.set_metric(METRIC_HOISTED_METHODS, stats.hoisted_methods);
+  mgr.set_metric(METRIC_REMOVED_METHODS, stats.removed_methods);
+  mgr.set_metric(METRIC_REWRITTEN_INVOKES, stats.rewritten_invokes);
+}
+
+static CrossStoreDedupPass s_pass;
+
+} // namespace cross_store_dedup
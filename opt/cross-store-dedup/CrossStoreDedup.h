@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "Pass.h"
+
+/*
+ * This pass removes the static methods that several feature modules (i.e. the
+ * stores besides the root one) each carry a copy of, typically because they
+ * were all built against the same library.
+ *
+ * The methods get hashed (see hashing::hash_code) and grouped with the ones of
+ * identical code and signature. When a group spans several stores, one of its
+ * methods is relocated to a host class of the root store, which all the
+ * stores can reference, and the invocations of the others are redirected to
+ * it. The methods only qualify when everything they reference is in the root
+ * store or the framework, as the root store can't reference the modules.
+ *
+ * Only methods of classes without a static initializer, or with a trivial
+ * one, qualify, as calling the hoisted copy doesn't initialize the class the
+ * method came from. The host class is one of the root store without a class
+ * initializer or super class, like the ones that DedupStringsPass adds its
+ * factory methods to, so that invoking the hoisted methods doesn't initialize
+ * other classes.
+ * This has to run before InterDexPass, which accounts for the methods that
+ * this adds to the root store.
+ */
+namespace cross_store_dedup {
+
+struct Config {
+  // The minimum number of instructions of the methods to dedup. Smaller ones
+  // take less space than the method references that calling a hoisted method
+  // from another dex needs.
+  size_t min_method_size{4};
+};
+
+struct Stats {
+  size_t candidates{0};
+  size_t hoisted_methods{0};
+  size_t removed_methods{0};
+  size_t rewritten_invokes{0};
+};
+
+Stats dedup_methods(DexStoresVector& stores, const Config& config);
+
+class CrossStoreDedupPass : public Pass {
+ public:
+  CrossStoreDedupPass() : Pass("CrossStoreDedupPass") {}
+
+  void bind_config() override {
+    bind("min_method_size", size_t(4), m_config.min_method_size);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  Config m_config;
+};
+
+} // namespace cross_store_dedup
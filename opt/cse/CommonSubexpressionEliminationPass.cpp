@@ -56,7 +56,7 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
   });
 
   auto pure_methods = /* Android framework */ get_pure_methods();
-  auto configured_pure_methods = conf.get_pure_methods();
+  const auto& configured_pure_methods = conf.get_pure_methods();
   pure_methods.insert(configured_pure_methods.begin(),
                       configured_pure_methods.end());
 
@@ -9,13 +9,13 @@
 
 #include <vector>
 
-#include "ConcurrentContainers.h"
 #include "Creators.h"
 #include "DexAccess.h"
 #include "DexClass.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 #include "locator.h"
 
 namespace {
@@ -28,6 +28,8 @@ constexpr const char* METRIC_PERF_SENSITIVE_METHODS =
     "num_perf_sensitive_methods";
 constexpr const char* METRIC_NON_PERF_SENSITIVE_METHODS =
     "num_non_perf_sensitive_methods";
+constexpr const char* METRIC_PROFILED_PERF_SENSITIVE_METHODS =
+    "num_profiled_perf_sensitive_methods";
 constexpr const char* METRIC_DUPLICATE_STRINGS = "num_duplicate_strings";
 constexpr const char* METRIC_DUPLICATE_STRINGS_SIZE = "duplicate_strings_size";
 constexpr const char* METRIC_DUPLICATE_STRING_LOADS =
@@ -58,17 +60,12 @@ void DedupStrings::run(DexStoresVector& stores) {
   std::unordered_set<const DexMethod*> perf_sensitive_methods =
       get_perf_sensitive_methods(dexen);
 
-  // Compute set of non-load strings in each dex
+  // For each string, figure out how many times it's loaded per dex, and
+  // compute the set of non-load strings in each dex
   std::unordered_set<const DexString*> non_load_strings[dexen.size()];
-  for (size_t i = 0; i < dexen.size(); i++) {
-    auto& strings = non_load_strings[i];
-    gather_non_load_strings(dexen[i], &strings);
-  }
-
-  // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> occurrences =
-      get_occurrences(scope, methods_to_dex, perf_sensitive_methods,
-                      non_load_strings);
+  std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>
+      occurrences =
+          get_occurrences(dexen, perf_sensitive_methods, non_load_strings);
 
   // Use heuristics to determine which strings to dedup,
   // and figure out factory method details
@@ -160,6 +157,13 @@ std::unordered_set<const DexMethod*> DedupStrings::get_perf_sensitive_methods(
     return !m_use_method_to_weight ||
            !!get_method_weight_if_available(method, &m_method_to_weight);
   };
+  // Methods that run during cold start must keep loading their strings
+  // directly, even when their class isn't perf-sensitive.
+  const auto& method_stats = m_method_profiles.method_stats();
+  auto is_profiled = [&](DexMethod* method) -> bool {
+    auto it = method_stats.find(method);
+    return it != method_stats.end() && it->second.appear_percent > 0;
+  };
   for (size_t dexnr = 0; dexnr < dexen.size(); dexnr++) {
     auto& classes = dexen[dexnr];
     for (auto cls : classes) {
@@ -169,6 +173,10 @@ std::unordered_set<const DexMethod*> DedupStrings::get_perf_sensitive_methods(
           // as well as methods marked as being perf-sensitive
           bool perf_sensitive =
               dexnr == 0 || (cls->is_perf_sensitive() && has_weight(method));
+          if (!perf_sensitive && is_profiled(method)) {
+            perf_sensitive = true;
+            m_stats.profiled_perf_sensitive_methods++;
+          }
           if (perf_sensitive) {
             perf_sensitive_methods.emplace(method);
             m_stats.perf_sensitive_methods++;
@@ -269,50 +277,57 @@ void DedupStrings::gather_non_load_strings(
   strings->insert(lstring.begin(), lstring.end());
 }
 
-ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>
+std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>
 DedupStrings::get_occurrences(
-    const Scope& scope,
-    const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
+    DexClassesVector& dexen,
     const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
     std::unordered_set<const DexString*> non_load_strings[]) {
-  // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> occurrences;
-  ConcurrentMap<DexString*, std::unordered_set<size_t>> perf_sensitive_strings;
-  walk::parallel::code(
-      scope, [&occurrences, &perf_sensitive_strings, &methods_to_dex,
-              &perf_sensitive_methods](DexMethod* method, IRCode& code) {
-        const auto dexnr = methods_to_dex.at(method);
-        const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
-        for (auto& mie : InstructionIterable(code)) {
-          const auto insn = mie.insn;
-          if (insn->opcode() == OPCODE_CONST_STRING) {
-            const auto str = insn->get_string();
-            if (perf_sensitive) {
-              perf_sensitive_strings.update(
-                  str,
-                  [dexnr](const DexString*,
-                          std::unordered_set<size_t>& s,
-                          bool /* exists */) { s.emplace(dexnr); });
-            } else {
-              occurrences.update(str,
-                                 [dexnr](const DexString*,
-                                         std::unordered_map<size_t, size_t>& m,
-                                         bool /* exists */) { ++m[dexnr]; });
-            }
+  // Each dex is gathered on its own thread into tables of its own, so that
+  // the workers don't contend on shared maps; the tables are merged below.
+  struct DexStrings {
+    std::unordered_map<DexString*, size_t> loads;
+    std::unordered_set<DexString*> perf_sensitive;
+  };
+  std::vector<DexStrings> dex_strings(dexen.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t dexnr) {
+    gather_non_load_strings(dexen[dexnr], &non_load_strings[dexnr]);
+    auto& strings = dex_strings[dexnr];
+    walk::code(dexen[dexnr], [&](DexMethod* method, IRCode& code) {
+      const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
+      for (auto& mie : InstructionIterable(code)) {
+        const auto insn = mie.insn;
+        if (insn->opcode() == OPCODE_CONST_STRING) {
+          const auto str = insn->get_string();
+          if (perf_sensitive) {
+            strings.perf_sensitive.emplace(str);
+          } else {
+            ++strings.loads[str];
           }
         }
-      });
-
-  // Also, add all the strings that occurred in perf-sensitive methods
-  // to the non_load_strings datastructure, as we won't attempt to dedup them.
-  for (const auto& it : perf_sensitive_strings) {
-    const auto str = it.first;
-    TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}", SHOW(str));
+      }
+    });
+  });
+  for (size_t dexnr = 0; dexnr < dexen.size(); dexnr++) {
+    wq.add_item(dexnr);
+  }
+  wq.run_all();
 
-    const auto& dexes = it.second;
-    for (const auto dexnr : dexes) {
-      auto& strings = non_load_strings[dexnr];
-      strings.emplace(str);
+  std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>
+      occurrences;
+  std::unordered_set<DexString*> perf_sensitive_strings;
+  for (size_t dexnr = 0; dexnr < dexen.size(); dexnr++) {
+    for (const auto& p : dex_strings[dexnr].loads) {
+      occurrences[p.first].emplace(dexnr, p.second);
+    }
+    // Also, add all the strings that occurred in perf-sensitive methods
+    // to the non_load_strings datastructure, as we won't attempt to dedup
+    // them.
+    for (const auto str : dex_strings[dexnr].perf_sensitive) {
+      if (perf_sensitive_strings.emplace(str).second) {
+        TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}",
+              SHOW(str));
+      }
+      non_load_strings[dexnr].emplace(str);
     }
   }
 
@@ -324,7 +339,7 @@ DedupStrings::get_occurrences(
 std::unordered_map<DexString*, DedupStrings::DedupStringInfo>
 DedupStrings::get_strings_to_dedup(
     DexClassesVector& dexen,
-    const ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>&
+    const std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>&
         occurrences,
     std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
     std::unordered_set<const DexMethod*>& perf_sensitive_methods,
@@ -353,7 +368,7 @@ DedupStrings::get_strings_to_dedup(
   std::sort(ordered_strings.begin(), ordered_strings.end(), compare_dexstrings);
   for (DexString* s : ordered_strings) {
     // We are going to look at the situation of a particular string here
-    const auto& m = occurrences.at_unsafe(s);
+    const auto& m = occurrences.at(s);
     always_assert(m.size() > 1);
     const auto entry_size = s->get_entry_size();
     const auto get_size_reduction = [entry_size, non_load_strings](
@@ -695,7 +710,7 @@ void DedupStringsPass::run_pass(DexStoresVector& stores,
                                 ConfigFiles& conf,
                                 PassManager& mgr) {
   DedupStrings ds(m_max_factory_methods, m_use_method_to_weight,
-                  conf.get_method_to_weight());
+                  conf.get_method_to_weight(), conf.get_method_profiles());
   ds.run(stores);
   const auto stats = ds.get_stats();
   mgr.incr_metric(METRIC_PERF_SENSITIVE_STRINGS, stats.perf_sensitive_strings);
@@ -707,8 +722,12 @@ void DedupStringsPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_PERF_SENSITIVE_METHODS, stats.perf_sensitive_methods);
   mgr.incr_metric(METRIC_NON_PERF_SENSITIVE_METHODS,
                   stats.non_perf_sensitive_methods);
-  TRACE(DS, 1, "[dedup strings] perf sensitive methods: %u vs %u",
-        stats.perf_sensitive_methods, stats.non_perf_sensitive_methods);
+  mgr.incr_metric(METRIC_PROFILED_PERF_SENSITIVE_METHODS,
+                  stats.profiled_perf_sensitive_methods);
+  TRACE(DS, 1,
+        "[dedup strings] perf sensitive methods: %u (%u from profiles) vs %u",
+        stats.perf_sensitive_methods, stats.profiled_perf_sensitive_methods,
+        stats.non_perf_sensitive_methods);
 
   mgr.incr_metric(METRIC_DUPLICATE_STRINGS, stats.duplicate_strings);
   mgr.incr_metric(METRIC_DUPLICATE_STRINGS_SIZE, stats.duplicate_strings_size);
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "InterDexPass.h"
+#include "MethodProfiles.h"
 #include "Pass.h"
 #include "PluginRegistry.h"
 
@@ -18,6 +19,7 @@ class DedupStrings {
     size_t non_perf_sensitive_strings{0};
     size_t perf_sensitive_methods{0};
     size_t non_perf_sensitive_methods{0};
+    size_t profiled_perf_sensitive_methods{0};
     size_t excluded_duplicate_non_load_strings{0};
     size_t duplicate_strings{0};
     size_t duplicate_strings_size{0};
@@ -31,10 +33,12 @@ class DedupStrings {
   DedupStrings(
       size_t max_factory_methods,
       bool use_method_to_weight,
-      const std::unordered_map<std::string, unsigned int>& method_to_weight)
+      const std::unordered_map<std::string, unsigned int>& method_to_weight,
+      const method_profiles::MethodProfiles& method_profiles)
       : m_max_factory_methods(max_factory_methods),
         m_use_method_to_weight(use_method_to_weight),
-        m_method_to_weight(method_to_weight) {}
+        m_method_to_weight(method_to_weight),
+        m_method_profiles(method_profiles) {}
 
   const Stats& get_stats() const { return m_stats; }
 
@@ -58,14 +62,14 @@ class DedupStrings {
       DexClass* host_cls, const std::vector<DexString*>& strings);
   void gather_non_load_strings(DexClasses& classes,
                                std::unordered_set<const DexString*>* strings);
-  ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> get_occurrences(
-      const Scope& scope,
-      const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
+  std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>
+  get_occurrences(
+      DexClassesVector& dexen,
       const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
       std::unordered_set<const DexString*> non_load_strings[]);
   std::unordered_map<DexString*, DedupStringInfo> get_strings_to_dedup(
       DexClassesVector& dexen,
-      const ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>>&
+      const std::unordered_map<DexString*, std::unordered_map<size_t, size_t>>&
           occurrences,
       std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
       std::unordered_set<const DexMethod*>& perf_sensitive_methods,
@@ -80,6 +84,7 @@ class DedupStrings {
   size_t m_max_factory_methods;
   bool m_use_method_to_weight;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
+  const method_profiles::MethodProfiles& m_method_profiles;
 };
 
 /**
@@ -124,7 +129,9 @@ class DedupStrings {
  * - References from the primary dex are not rewritten, as the primary dex may
  *   not include forward references to other dexes. Also, perf sensitive
  *   classes, which are those used for cold start or mixed mode as determined
- *   by the InterDex pass, are not rewritten.
+ *   by the InterDex pass, are not rewritten, and neither are the methods that
+ *   appear in the method profiles, so that no string used during cold start
+ *   ends up behind a factory method call.
  * - We perform a benefits/costs analysis for each string:
  *   - Dropping a string from a dex will save a string table entry, which
  *     consists of an encoding of the length of the string, plus the MUTF8
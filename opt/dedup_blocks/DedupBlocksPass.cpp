@@ -7,12 +7,20 @@
 
 #include "DedupBlocksPass.h"
 
+#include "ConcurrentContainers.h"
 #include "Walkers.h"
 
 namespace {
 const char* METRIC_BLOCKS_REMOVED = "blocks_removed";
 const char* METRIC_BLOCKS_SPLIT = "blocks_split";
 const char* METRIC_ELIGIBLE_BLOCKS = "eligible_blocks";
+const char* METRIC_CROSS_METHOD_DUP_BLOCKS = "cross_method_dup_blocks";
+const char* METRIC_CROSS_METHOD_DUP_INSNS = "cross_method_dup_insns";
+
+struct HashedBlocks {
+  size_t count{0};
+  size_t opcodes{0};
+};
 } // namespace
 
 void DedupBlocksPass::run_pass(DexStoresVector& stores,
@@ -20,6 +28,10 @@ void DedupBlocksPass::run_pass(DexStoresVector& stores,
                                PassManager& mgr) {
   const auto& scope = build_class_scope(stores);
 
+  // The blocks that are left after deduplicating each method, indexed by the
+  // hash of their code. Blocks that share a hash across methods are
+  // candidates for outlining.
+  ConcurrentMap<size_t, HashedBlocks> block_index;
   const auto stats = walk::parallel::methods<dedup_blocks_impl::Stats>(
       scope,
       [&](DexMethod* method) {
@@ -38,6 +50,14 @@ void DedupBlocksPass::run_pass(DexStoresVector& stores,
 
         dedup_blocks_impl::DedupBlocks impl(m_config, method);
         impl.run();
+        for (const auto& p :
+             impl.get_block_hashes(m_config.block_split_min_opcode_count)) {
+          block_index.update(p.first,
+                             [&p](size_t, HashedBlocks& blocks, bool) {
+                               ++blocks.count;
+                               blocks.opcodes = p.second;
+                             });
+        }
 
         code->clear_cfg();
         return impl.get_stats();
@@ -45,6 +65,21 @@ void DedupBlocksPass::run_pass(DexStoresVector& stores,
       m_config.debug ? 1 : redex_parallel::default_num_threads());
 
   report_stats(mgr, stats);
+
+  size_t cross_method_dup_blocks = 0;
+  size_t cross_method_dup_insns = 0;
+  for (const auto& entry : block_index) {
+    const auto& blocks = entry.second;
+    if (blocks.count > 1) {
+      cross_method_dup_blocks += blocks.count;
+      cross_method_dup_insns += (blocks.count - 1) * blocks.opcodes;
+    }
+  }
+  mgr.incr_metric(METRIC_CROSS_METHOD_DUP_BLOCKS, cross_method_dup_blocks);
+  mgr.incr_metric(METRIC_CROSS_METHOD_DUP_INSNS, cross_method_dup_insns);
+  TRACE(DEDUP_BLOCKS, 1, "%zu blocks with %zu redundant instructions "
+        "duplicated across methods", cross_method_dup_blocks,
+        cross_method_dup_insns);
 }
 
 void DedupBlocksPass::report_stats(PassManager& mgr,
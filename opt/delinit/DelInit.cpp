@@ -552,6 +552,10 @@ int DeadRefs::remove_unreachable(Scope& scope) {
             SHOW(meth->get_name()), SHOW(meth->get_proto()));
     }
 
+    if (stats.vmethodcnt || stats.ifieldcnt) {
+      // They were erased in place.
+      g_redex->report_class_hierarchy_change();
+    }
     if (stats.vmethodcnt || stats.dmethodcnt || stats.ifieldcnt ||
         stats.called_dmeths || stats.dont_delete_dmeths) {
       local_stats.emplace(cls, stats);
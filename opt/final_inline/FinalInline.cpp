@@ -149,6 +149,7 @@ class FinalInlineImpl {
                                    }),
                     sfields.end());
     }
+    g_redex->report_class_hierarchy_change();
     return smallscope.size();
   }
 
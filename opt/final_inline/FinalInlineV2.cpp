@@ -149,6 +149,7 @@ using CombinedAnalyzer =
     InstructionAnalyzerCombiner<cp::ClinitFieldAnalyzer,
                                 cp::WholeProgramAwareAnalyzer,
                                 cp::StringAnalyzer,
+                                cp::ConstantClassObjectAnalyzer,
                                 cp::PrimitiveAnalyzer>;
 
 using CombinedInitAnalyzer =
@@ -159,10 +160,15 @@ using CombinedInitAnalyzer =
 /*
  * Converts a ConstantValue into its equivalent encoded_value. Returns null if
  * no such encoding is known.
+ *
+ * Class objects are encoded as types only if `encode_class_objects` is set:
+ * ART resolves them when it initializes the class, but Dalvik only accepts
+ * primitives, strings and null in static values.
  */
 class encoding_visitor : public boost::static_visitor<DexEncodedValue*> {
  public:
-  encoding_visitor(const DexField* field) : m_field(field) {}
+  encoding_visitor(const DexField* field, bool encode_class_objects)
+      : m_field(field), m_encode_class_objects(encode_class_objects) {}
 
   DexEncodedValue* operator()(const SignedConstantDomain& dom) const {
     auto cst = dom.get_constant();
@@ -182,6 +188,15 @@ class encoding_visitor : public boost::static_visitor<DexEncodedValue*> {
     return new DexEncodedValueString(const_cast<DexString*>(*cst));
   }
 
+  DexEncodedValue* operator()(const ConstantClassObjectDomain& dom) const {
+    auto cst = dom.get_constant();
+    if (!cst || !m_encode_class_objects ||
+        m_field->get_type() != type::java_lang_Class()) {
+      return nullptr;
+    }
+    return new DexEncodedValueType(const_cast<DexType*>(*cst));
+  }
+
   template <typename Domain>
   DexEncodedValue* operator()(const Domain&) const {
     return nullptr;
@@ -189,6 +204,7 @@ class encoding_visitor : public boost::static_visitor<DexEncodedValue*> {
 
  private:
   const DexField* m_field;
+  bool m_encode_class_objects;
 };
 
 /*
@@ -221,14 +237,15 @@ std::unordered_set<const DexFieldRef*> gather_read_static_fields(
 
 void encode_values(DexClass* cls,
                    const FieldEnvironment& field_env,
-                   const std::unordered_set<const DexFieldRef*>& blacklist) {
+                   const std::unordered_set<const DexFieldRef*>& blacklist,
+                   bool encode_class_objects) {
   for (auto* field : cls->get_sfields()) {
     if (blacklist.count(field)) {
       continue;
     }
     auto value = field_env.get(field);
-    auto encoded_value =
-        ConstantValue::apply_visitor(encoding_visitor(field), value);
+    auto encoded_value = ConstantValue::apply_visitor(
+        encoding_visitor(field, encode_class_objects), value);
     if (encoded_value == nullptr) {
       continue;
     }
@@ -249,7 +266,8 @@ namespace final_inline {
  * Additionally, for static final fields, this method collects and returns them
  * as part of the WholeProgramState object.
  */
-cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope) {
+cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope,
+                                                   bool encode_class_objects) {
   const std::unordered_set<DexMethodRef*> pure_methods = get_pure_methods();
   cp::WholeProgramState wps;
   for (DexClass* cls : reverse_tsort_by_clinit_deps(scope)) {
@@ -262,13 +280,14 @@ cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope) {
       auto& cfg = code->cfg();
       cfg.calculate_exit_block();
       cp::intraprocedural::FixpointIterator intra_cp(
-          cfg, CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr));
+          cfg,
+          CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr, nullptr));
       intra_cp.run(env);
       env = intra_cp.get_exit_state_at(cfg.exit_block());
 
       // Generate the new encoded_values and re-run the analysis.
       encode_values(cls, env.get_field_environment(),
-                    gather_read_static_fields(cls));
+                    gather_read_static_fields(cls), encode_class_objects);
       auto fresh_env = ConstantEnvironment();
       cp::set_encoded_values(cls, &fresh_env);
       intra_cp.run(fresh_env);
@@ -362,7 +381,7 @@ class ThisObjectAnalysis final
   explicit ThisObjectAnalysis(cfg::ControlFlowGraph* cfg,
                               DexMethod* method,
                               size_t this_param_reg)
-      : MonotonicFixpointIterator(*cfg, cfg->blocks().size()),
+      : MonotonicFixpointIterator(*cfg, cfg->num_blocks()),
         m_method(method),
         m_this_param_reg(this_param_reg) {}
   void analyze_node(const NodeId& node, ThisEnvironment* env) const override {
@@ -586,7 +605,8 @@ ConcurrentSet<DexField*> get_ifields_read_in_callees(
     const Scope& scope,
     const std::unordered_set<std::string>& whitelist_method_names) {
   ConcurrentSet<DexField*> return_ifields;
-  TypeSystem ts(scope);
+  auto type_system = g_redex->get_type_system(scope);
+  const auto& ts = *type_system;
   walk::parallel::classes(scope, [&return_ifields, &ts,
                                   &whitelist_method_names](DexClass* cls) {
     if (cls->is_external()) {
@@ -752,7 +772,8 @@ size_t inline_final_gets(
 
 size_t FinalInlinePassV2::run(const Scope& scope, const Config& config) {
   try {
-    auto wps = final_inline::analyze_and_simplify_clinits(scope);
+    auto wps = final_inline::analyze_and_simplify_clinits(
+        scope, config.encode_class_objects);
     return inline_final_gets(scope, wps, config.black_list_types,
                              cp::FieldType::STATIC);
   } catch (final_inline::class_initialization_cycle& e) {
@@ -17,7 +17,8 @@ class FinalInlinePassV2 : public Pass {
     std::unordered_set<const DexType*> black_list_types;
     std::unordered_set<std::string> whitelist_method_names;
     bool inline_instance_field;
-    Config() : inline_instance_field(false) {}
+    bool encode_class_objects;
+    Config() : inline_instance_field(false), encode_class_objects(false) {}
   };
 
   FinalInlinePassV2() : Pass("FinalInlinePassV2") {}
@@ -33,6 +34,12 @@ class FinalInlinePassV2 : public Pass {
          m_config.whitelist_method_names,
          "List of methods names that can be ignored when checking on instance "
          "field read in methods invoked by <init>");
+    bind("encode_class_objects",
+         false,
+         m_config.encode_class_objects,
+         "Also encode the values of static java.lang.Class fields, so that "
+         "<clinit>s assigning class literals can go away. Only for apps that "
+         "run on ART.");
   }
 
   static size_t run(const Scope&, const Config& config = Config());
@@ -61,6 +68,6 @@ class class_initialization_cycle : public std::exception {
 };
 
 constant_propagation::WholeProgramState analyze_and_simplify_clinits(
-    const Scope& scope);
+    const Scope& scope, bool encode_class_objects = false);
 
 } // namespace final_inline
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "GuardedDevirtualization.h"
+
+#include <atomic>
+
+#include "CallGraph.h"
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "GlobalTypeAnalyzer.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Show.h"
+#include "Trace.h"
+#include "TypeSystem.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace guarded_devirtualization {
+
+namespace {
+
+constexpr const char* METRIC_HOT_CALLERS = "num_hot_callers";
+constexpr const char* METRIC_POLYMORPHIC_CALLSITES =
+    "num_hot_polymorphic_callsites";
+constexpr const char* METRIC_GUARDED_CALLSITES = "num_guarded_callsites";
+constexpr const char* METRIC_GUARDS = "num_guards";
+
+// A callsite to guard.
+struct Site {
+  IRInstruction* invoke;
+  std::vector<Guard> guards;
+};
+
+bool is_hot(const method_profiles::StatsMap& stats,
+            const DexMethodRef* method,
+            const Config& config) {
+  auto it = stats.find(method);
+  return it != stats.end() &&
+         it->second.appear_percent >= config.min_appear_percent;
+}
+
+// The type that the receiver of `invoke` is known to have: the type of the
+// callee, unless the type analysis found a more precise one.
+const DexType* get_receiver_type(const TypeSystem& type_system,
+                                 const IRInstruction* invoke,
+                                 const DexTypeDomain& domain) {
+  const DexType* type = invoke->get_method()->get_class();
+  auto analyzed = domain.get_dex_type();
+  if (!analyzed || *analyzed == nullptr || *analyzed == type) {
+    return type;
+  }
+  auto cls = type_class(*analyzed);
+  if (cls == nullptr || is_interface(cls)) {
+    return type;
+  }
+  bool is_refinement = invoke->opcode() == OPCODE_INVOKE_INTERFACE
+                           ? type_system.implements(*analyzed, type)
+                           : type_system.is_subtype(type, *analyzed);
+  return is_refinement ? *analyzed : type;
+}
+
+/*
+ * Runs the global type analysis, and collects the callsites of `callers` to
+ * guard, for each caller.
+ */
+std::vector<std::vector<Site>> find_sites(
+    const Scope& scope,
+    const std::vector<DexMethod*>& callers,
+    const TypeSystem& type_system,
+    const method_profiles::StatsMap& stats,
+    const Config& config) {
+  using namespace type_analyzer;
+  using namespace type_analyzer::global;
+
+  walk::parallel::code(scope, [](DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+  });
+  call_graph::Graph cg = call_graph::single_callee_graph(scope);
+  GlobalTypeAnalyzer gta(cg);
+  gta.run({{CURRENT_PARTITION_LABEL, ArgumentTypeEnvironment()}});
+  // One refinement with the field and return types is enough to type the
+  // receivers that come from factories and fields.
+  gta.set_whole_program_state(std::make_unique<WholeProgramState>(scope, gta));
+  gta.run({{CURRENT_PARTITION_LABEL, ArgumentTypeEnvironment()}});
+
+  std::vector<std::vector<Site>> sites(callers.size());
+  redex_parallel::parallel_for(0, callers.size(), [&](size_t i) {
+    auto caller = callers[i];
+    auto analysis = gta.get_local_analysis(caller);
+    for (auto* block : caller->get_code()->cfg().blocks()) {
+      auto env = analysis->get_entry_state_at(block);
+      for (auto& mie : InstructionIterable(block)) {
+        auto insn = mie.insn;
+        auto op = insn->opcode();
+        if (op == OPCODE_INVOKE_VIRTUAL || op == OPCODE_INVOKE_INTERFACE) {
+          auto receiver =
+              get_receiver_type(type_system, insn, env.get(insn->src(0)));
+          auto guards =
+              find_guards(type_system, insn, receiver, stats, config);
+          if (!guards.empty()) {
+            sites[i].push_back(Site{insn, std::move(guards)});
+          }
+        }
+        analysis->analyze_instruction(insn, &env);
+      }
+    }
+  });
+
+  walk::parallel::code(scope,
+                       [](DexMethod*, IRCode& code) { code.clear_cfg(); });
+  return sites;
+}
+
+} // namespace
+
+std::vector<Guard> find_guards(const TypeSystem& type_system,
+                               const IRInstruction* invoke,
+                               const DexType* receiver,
+                               const method_profiles::StatsMap& stats,
+                               const Config& config) {
+  auto receiver_cls = type_class(receiver);
+  if (receiver_cls == nullptr || receiver_cls->is_external()) {
+    return {};
+  }
+  TypeSet receivers;
+  if (is_interface(receiver_cls)) {
+    receivers = type_system.get_implementors(receiver);
+  } else {
+    receivers.insert(receiver);
+    type_system.get_all_children(receiver, receivers);
+  }
+
+  // The target of each class that the receiver may be an instance of.
+  auto ref = invoke->get_method();
+  std::unordered_map<const DexType*, DexMethod*> targets;
+  std::unordered_set<DexMethod*> distinct_targets;
+  for (auto type : receivers) {
+    auto cls = type_class(type);
+    if (cls == nullptr || cls->is_external()) {
+      return {};
+    }
+    if (is_abstract(cls) || is_interface(cls)) {
+      continue;
+    }
+    auto target = resolve_method(cls, ref->get_name(), ref->get_proto(),
+                                 MethodSearch::Virtual);
+    if (target == nullptr) {
+      return {};
+    }
+    targets.emplace(type, target);
+    distinct_targets.insert(target);
+  }
+  if (distinct_targets.size() < 2) {
+    // Nothing to guard for: either the call is monomorphic already, or it
+    // never happens.
+    return {};
+  }
+
+  std::vector<Guard> guards;
+  for (auto target : distinct_targets) {
+    auto type = target->get_class();
+    if (type == receiver || !receivers.count(type) ||
+        !is_hot(stats, target, config) || !is_public(target) ||
+        !is_public(type_class(type)) || target->get_code() == nullptr) {
+      continue;
+    }
+    // The guarded call must have a single target, so that it can be bound
+    // directly.
+    bool is_monomorphic = true;
+    for (const auto& pair : targets) {
+      if (pair.second != target && type_system.is_subtype(type, pair.first)) {
+        is_monomorphic = false;
+        break;
+      }
+    }
+    if (is_monomorphic) {
+      guards.push_back(Guard{type, target});
+    }
+  }
+  std::sort(guards.begin(), guards.end(),
+            [&stats](const Guard& a, const Guard& b) {
+              auto a_calls = stats.at(a.method).call_count;
+              auto b_calls = stats.at(b.method).call_count;
+              if (a_calls != b_calls) {
+                return a_calls > b_calls;
+              }
+              return compare_dexmethods(a.method, b.method);
+            });
+  // The fallback takes care of the last target.
+  auto max_guards =
+      std::min<size_t>(config.max_guards, distinct_targets.size() - 1);
+  if (guards.size() > max_guards) {
+    guards.resize(max_guards);
+  }
+  return guards;
+}
+
+bool guard_call(cfg::ControlFlowGraph& cfg,
+                IRInstruction* invoke,
+                const std::vector<Guard>& guards) {
+  always_assert(!guards.empty());
+  auto it = cfg.find_insn(invoke);
+  auto block = it.block();
+  if (cfg.get_succ_edge_of_type(block, cfg::EDGE_THROW) != nullptr) {
+    // The guarded calls would need the handlers of the invoke too; that's
+    // not worth the trouble.
+    return false;
+  }
+  auto move_result_it = cfg.move_result_of(it);
+  auto move_result = move_result_it.is_end() ? nullptr : move_result_it->insn;
+  auto receiver = invoke->src(0);
+
+  // Build the checks, which test the guards one after the other.
+  std::vector<cfg::Block*> checks;
+  std::vector<reg_t> check_regs;
+  IRInstruction* first_check_end = nullptr;
+  for (const auto& guard : guards) {
+    auto instance_of = new IRInstruction(OPCODE_INSTANCE_OF);
+    instance_of->set_type(const_cast<DexType*>(guard.type));
+    instance_of->set_src(0, receiver);
+    auto reg = cfg.allocate_temp();
+    auto move_result_pseudo = new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO);
+    move_result_pseudo->set_dest(reg);
+    check_regs.push_back(reg);
+    if (checks.empty()) {
+      // The first check ends the block of the invoke.
+      cfg.insert_before(it, {instance_of, move_result_pseudo});
+      checks.push_back(block);
+      first_check_end = move_result_pseudo;
+    } else {
+      auto check = cfg.create_block();
+      check->push_back({instance_of, move_result_pseudo});
+      checks.push_back(check);
+    }
+  }
+
+  // Split the block of the invoke into the first check, the fallback call
+  // and what comes after.
+  auto done = cfg.split_block(move_result ? cfg.find_insn(move_result, block)
+                                          : cfg.find_insn(invoke, block));
+  auto fallback = cfg.split_block(cfg.find_insn(first_check_end, block));
+
+  for (size_t i = 0; i < guards.size(); ++i) {
+    const auto& guard = guards[i];
+    auto guarded = cfg.create_block();
+    auto check_cast = new IRInstruction(OPCODE_CHECK_CAST);
+    check_cast->set_type(const_cast<DexType*>(guard.type));
+    check_cast->set_src(0, receiver);
+    auto cast_reg = cfg.allocate_temp();
+    auto move_result_pseudo =
+        new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT);
+    move_result_pseudo->set_dest(cast_reg);
+    auto guarded_invoke = new IRInstruction(*invoke);
+    guarded_invoke->set_opcode(OPCODE_INVOKE_VIRTUAL);
+    guarded_invoke->set_method(guard.method);
+    guarded_invoke->set_src(0, cast_reg);
+    std::vector<IRInstruction*> insns{check_cast, move_result_pseudo,
+                                      guarded_invoke};
+    if (move_result != nullptr) {
+      insns.push_back(new IRInstruction(*move_result));
+    }
+    guarded->push_back(insns);
+    cfg.add_edge(guarded, done, cfg::EDGE_GOTO);
+
+    auto if_insn = new IRInstruction(OPCODE_IF_NEZ);
+    if_insn->set_src(0, check_regs[i]);
+    auto next = i + 1 < checks.size() ? checks[i + 1] : fallback;
+    cfg.create_branch(checks[i], if_insn, next, guarded);
+  }
+  return true;
+}
+
+void GuardedDevirtualizationPass::run_pass(DexStoresVector& stores,
+                                           ConfigFiles& conf,
+                                           PassManager& mgr) {
+  const auto& stats =
+      conf.get_method_profiles().method_stats(m_config.interaction);
+  if (stats.empty()) {
+    TRACE(VIRT, 1, "[guarded devirt] no profiles for %s",
+          m_config.interaction.c_str());
+    return;
+  }
+  auto scope = build_class_scope(stores);
+  std::vector<DexMethod*> callers;
+  walk::methods(scope, [&](DexMethod* method) {
+    if (method->get_code() != nullptr && is_hot(stats, method, m_config)) {
+      callers.push_back(method);
+    }
+  });
+  mgr.set_metric(METRIC_HOT_CALLERS, callers.size());
+  if (callers.empty()) {
+    return;
+  }
+
+  TypeSystem type_system(scope);
+  auto sites = find_sites(scope, callers, type_system, stats, m_config);
+
+  std::atomic<size_t> num_sites{0};
+  std::atomic<size_t> num_guarded{0};
+  std::atomic<size_t> num_guards{0};
+  redex_parallel::parallel_for(0, callers.size(), [&](size_t i) {
+    if (sites[i].empty()) {
+      return;
+    }
+    num_sites += sites[i].size();
+    auto code = callers[i]->get_code();
+    code->build_cfg(/* editable */ true);
+    for (const auto& site : sites[i]) {
+      if (guard_call(code->cfg(), site.invoke, site.guards)) {
+        TRACE(VIRT, 5, "[guarded devirt] %s in %s: %zu guards",
+              SHOW(site.invoke), SHOW(callers[i]), site.guards.size());
+        ++num_guarded;
+        num_guards += site.guards.size();
+      }
+    }
+    code->clear_cfg();
+  });
+
+  TRACE(VIRT, 1, "[guarded devirt] guarded %zu of %zu callsites",
+        num_guarded.load(), num_sites.load());
+  mgr.set_metric(METRIC_POLYMORPHIC_CALLSITES, num_sites);
+  mgr.set_metric(METRIC_GUARDED_CALLSITES, num_guarded);
+  mgr.set_metric(METRIC_GUARDS, num_guards);
+}
+
+static GuardedDevirtualizationPass s_pass;
+
+} // namespace guarded_devirtualization
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "MethodProfiles.h"
+#include "Pass.h"
+
+class TypeSystem;
+
+namespace cfg {
+class ControlFlowGraph;
+} // namespace cfg
+
+/*
+ * This pass speeds up hot polymorphic virtual calls by checking for their
+ * dominant receiver classes before dispatching. A call whose receiver may be
+ * of several classes with different implementations of the callee, e.g.
+ *
+ *   invoke-virtual {v0, v1} LBase;.m:(I)V
+ *
+ * becomes, with LSub; being the class of the dominant implementation,
+ *
+ *   instance-of v0, LSub;
+ *   if-eqz ..., :fallback
+ *   check-cast v0, LSub;
+ *   invoke-virtual {v2, v1} LSub;.m:(I)V
+ *   goto :done
+ * :fallback
+ *   invoke-virtual {v0, v1} LBase;.m:(I)V
+ * :done
+ *
+ * Only classes in which the implementation isn't overridden any further are
+ * guarded for, so each guarded call has a single target, which the runtime
+ * binds directly and which the inliner can inline. Calls that fail all the
+ * guards, null receivers included, still go through the original virtual
+ * call, so the transformation never changes behavior.
+ *
+ * The receivers of a call are the subclasses of its receiver type, which the
+ * global type analysis refines. We don't have receiver profiles of callsites,
+ * so the method profiles stand in for them: the calls of hot callers are
+ * guarded for their hot implementations, the most called ones first.
+ */
+namespace guarded_devirtualization {
+
+struct Config {
+  // The profiled interaction that tells which methods are hot.
+  std::string interaction;
+  // The minimum appear100 of the hot callers and implementations.
+  float min_appear_percent{50.0};
+  // The maximum number of guards of a callsite.
+  uint32_t max_guards{2};
+};
+
+// A guarded call of `method` for receivers of class `type`.
+struct Guard {
+  const DexType* type;
+  DexMethod* method;
+};
+
+/*
+ * The guards of `invoke`, a virtual or interface call whose receiver is known
+ * to be of type `receiver`, with the most called implementation first. Empty
+ * unless the call has more than one possible target.
+ */
+std::vector<Guard> find_guards(const TypeSystem& type_system,
+                               const IRInstruction* invoke,
+                               const DexType* receiver,
+                               const method_profiles::StatsMap& stats,
+                               const Config& config);
+
+/*
+ * Rewrites `invoke`, in an editable CFG, into a chain of guarded calls that
+ * falls back to `invoke`. Returns false, without changing the code, for
+ * invokes in try regions.
+ */
+bool guard_call(cfg::ControlFlowGraph& cfg,
+                IRInstruction* invoke,
+                const std::vector<Guard>& guards);
+
+class GuardedDevirtualizationPass : public Pass {
+ public:
+  GuardedDevirtualizationPass() : Pass("GuardedDevirtualizationPass") {}
+
+  void bind_config() override {
+    bind("interaction", method_profiles::COLD_START, m_config.interaction);
+    bind("min_appear_percent", 50.0f, m_config.min_appear_percent);
+    bind("max_guards", 2u, m_config.max_guards);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  Config m_config;
+};
+
+} // namespace guarded_devirtualization
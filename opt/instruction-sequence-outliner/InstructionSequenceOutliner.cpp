@@ -0,0 +1,1138 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstructionSequenceOutliner.h"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "DexAccess.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "InterDexPass.h"
+#include "Liveness.h"
+#include "MethodProfiles.h"
+#include "MethodUtil.h"
+#include "PassManager.h"
+#include "PluginRegistry.h"
+#include "ReachingDefinitions.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "TypeInference.h"
+#include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace {
+
+// What a helper adds to the dex besides its instructions, in code units:
+// the header of its code item, its method id and its encoded method.
+constexpr size_t HELPER_OVERHEAD_CODE_UNITS = 16;
+// An invoke-static, and the move-result of the helpers that return a value.
+constexpr size_t INVOKE_CODE_UNITS = 3;
+constexpr size_t MOVE_RESULT_CODE_UNITS = 1;
+// Helpers take at most as many argument registers as invoke-static can pass
+// without its range form, which would cost extra moves.
+constexpr size_t MAX_ARG_REGISTERS = 5;
+
+using Symbol = uint32_t;
+
+/*
+ * What identifies an instruction in the text the suffix array is built on:
+ * everything but its registers.
+ */
+struct InsnKey {
+  IROpcode opcode;
+  size_t srcs_size;
+  uint64_t operand;
+
+  bool operator==(const InsnKey& other) const {
+    return opcode == other.opcode && srcs_size == other.srcs_size &&
+           operand == other.operand;
+  }
+};
+
+struct InsnKeyHash {
+  size_t operator()(const InsnKey& key) const {
+    size_t seed = 0;
+    boost::hash_combine(seed, key.opcode);
+    boost::hash_combine(seed, key.srcs_size);
+    boost::hash_combine(seed, key.operand);
+    return seed;
+  }
+};
+
+InsnKey get_key(const IRInstruction* insn) {
+  uint64_t operand = 0;
+  switch (opcode::ref(insn->opcode())) {
+  case opcode::Ref::Literal:
+    operand = insn->get_literal();
+    break;
+  case opcode::Ref::String:
+    operand = reinterpret_cast<uintptr_t>(insn->get_string());
+    break;
+  case opcode::Ref::Type:
+    operand = reinterpret_cast<uintptr_t>(insn->get_type());
+    break;
+  case opcode::Ref::Field:
+    operand = reinterpret_cast<uintptr_t>(insn->get_field());
+    break;
+  case opcode::Ref::Method:
+    operand = reinterpret_cast<uintptr_t>(insn->get_method());
+    break;
+  default:
+    break;
+  }
+  return InsnKey{insn->opcode(), insn->srcs_size(), operand};
+}
+
+bool is_accessible(const DexType* type) {
+  type = type::get_element_type_if_array(type);
+  if (type::is_primitive(type)) {
+    return true;
+  }
+  auto cls = type_class(type);
+  return cls != nullptr && is_public(cls);
+}
+
+// Whether the instruction may be moved into a static method of another
+// class.
+bool can_outline(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (opcode::is_load_param(op) || is_return(op) || op == OPCODE_THROW ||
+      op == OPCODE_GOTO || is_conditional_branch(op) || is_switch(op) ||
+      is_monitor(op) || op == OPCODE_MOVE_EXCEPTION ||
+      op == OPCODE_NEW_INSTANCE || op == OPCODE_INVOKE_DIRECT ||
+      op == OPCODE_INVOKE_SUPER || op == OPCODE_NOP) {
+    return false;
+  }
+  switch (opcode::ref(op)) {
+  case opcode::Ref::None:
+  case opcode::Ref::Literal:
+  case opcode::Ref::String:
+    return true;
+  case opcode::Ref::Type:
+    return is_accessible(insn->get_type());
+  case opcode::Ref::Field: {
+    auto field = resolve_field(insn->get_field());
+    // Final fields may only be written by their declaring class, which is
+    // never the host of the helper.
+    if (field != nullptr && is_final(field) &&
+        (is_iput(op) || is_sput(op))) {
+      return false;
+    }
+    return field != nullptr && is_public(field) &&
+           is_accessible(field->get_class()) &&
+           is_accessible(insn->get_field()->get_class());
+  }
+  case opcode::Ref::Method: {
+    auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+    return callee != nullptr && is_public(callee) &&
+           is_accessible(callee->get_class()) &&
+           is_accessible(insn->get_method()->get_class());
+  }
+  default:
+    return false;
+  }
+}
+
+// Whether the source is used as a boolean, byte, char or short, which an int
+// argument of the helper could not stand for.
+bool is_narrow_use(const IRInstruction* insn, size_t src_index) {
+  switch (insn->opcode()) {
+  case OPCODE_IPUT_BOOLEAN:
+  case OPCODE_IPUT_BYTE:
+  case OPCODE_IPUT_CHAR:
+  case OPCODE_IPUT_SHORT:
+  case OPCODE_SPUT_BOOLEAN:
+  case OPCODE_SPUT_BYTE:
+  case OPCODE_SPUT_CHAR:
+  case OPCODE_SPUT_SHORT:
+  case OPCODE_APUT_BOOLEAN:
+  case OPCODE_APUT_BYTE:
+  case OPCODE_APUT_CHAR:
+  case OPCODE_APUT_SHORT:
+    return src_index == 0;
+  default:
+    break;
+  }
+  if (!is_invoke(insn->opcode())) {
+    return false;
+  }
+  size_t arg_index = src_index;
+  if (insn->opcode() != OPCODE_INVOKE_STATIC) {
+    if (arg_index == 0) {
+      return false;
+    }
+    --arg_index;
+  }
+  auto type = insn->get_method()->get_proto()->get_args()->at(arg_index);
+  return type != type::_int() && type::is_primitive(type) &&
+         !type::is_wide_type(type) && type != type::_float();
+}
+
+/*
+ * The type of the int value that `def` writes, or null if the verifier may
+ * see it as something more precise than its declared type, e.g. a constant
+ * or the and-int of two booleans.
+ */
+const DexType* get_int_result_type(const IRInstruction* primary,
+                                   const IRInstruction* def) {
+  if (opcode::is_move_result_any(def->opcode())) {
+    if (primary == nullptr) {
+      return nullptr;
+    }
+    if (is_invoke(primary->opcode())) {
+      return primary->get_method()->get_proto()->get_rtype();
+    }
+    if (is_iget(primary->opcode()) || is_sget(primary->opcode())) {
+      return primary->get_field()->get_type();
+    }
+    switch (primary->opcode()) {
+    case OPCODE_AGET:
+    case OPCODE_ARRAY_LENGTH:
+      return type::_int();
+    case OPCODE_AGET_BOOLEAN:
+    case OPCODE_INSTANCE_OF:
+      return type::_boolean();
+    case OPCODE_AGET_BYTE:
+      return type::_byte();
+    case OPCODE_AGET_CHAR:
+      return type::_char();
+    case OPCODE_AGET_SHORT:
+      return type::_short();
+    default:
+      return nullptr;
+    }
+  }
+  switch (def->opcode()) {
+  case OPCODE_ADD_INT:
+  case OPCODE_SUB_INT:
+  case OPCODE_MUL_INT:
+  case OPCODE_DIV_INT:
+  case OPCODE_REM_INT:
+  case OPCODE_SHL_INT:
+  case OPCODE_SHR_INT:
+  case OPCODE_USHR_INT:
+  case OPCODE_ADD_INT_LIT16:
+  case OPCODE_RSUB_INT:
+  case OPCODE_MUL_INT_LIT16:
+  case OPCODE_DIV_INT_LIT16:
+  case OPCODE_REM_INT_LIT16:
+  case OPCODE_ADD_INT_LIT8:
+  case OPCODE_RSUB_INT_LIT8:
+  case OPCODE_MUL_INT_LIT8:
+  case OPCODE_DIV_INT_LIT8:
+  case OPCODE_REM_INT_LIT8:
+  case OPCODE_SHL_INT_LIT8:
+  case OPCODE_SHR_INT_LIT8:
+  case OPCODE_USHR_INT_LIT8:
+  case OPCODE_NEG_INT:
+  case OPCODE_NOT_INT:
+  case OPCODE_LONG_TO_INT:
+  case OPCODE_FLOAT_TO_INT:
+  case OPCODE_DOUBLE_TO_INT:
+    return type::_int();
+  case OPCODE_INT_TO_BYTE:
+    return type::_byte();
+  case OPCODE_INT_TO_CHAR:
+    return type::_char();
+  case OPCODE_INT_TO_SHORT:
+    return type::_short();
+  default:
+    return nullptr;
+  }
+}
+
+/*
+ * Sorts the suffixes of the text by prefix doubling, with a radix sort in
+ * each round, in O(n log n). All the symbols must be below `alphabet_size`.
+ */
+std::vector<uint32_t> build_suffix_array(const std::vector<Symbol>& text,
+                                         size_t alphabet_size) {
+  size_t n = text.size();
+  std::vector<uint32_t> sa(n);
+  if (n == 0) {
+    return sa;
+  }
+  std::vector<uint32_t> rank(text.begin(), text.end());
+  std::vector<uint32_t> by_second(n);
+  std::vector<uint32_t> next_rank(n);
+  std::vector<uint32_t> count(std::max(alphabet_size, n) + 1);
+  for (auto symbol : text) {
+    ++count[symbol];
+  }
+  for (size_t i = 1; i < count.size(); ++i) {
+    count[i] += count[i - 1];
+  }
+  for (size_t i = n; i-- > 0;) {
+    sa[--count[text[i]]] = i;
+  }
+  size_t classes = alphabet_size;
+  for (size_t k = 1;; k <<= 1) {
+    // Order the suffixes by the rank of their second half, the ones without
+    // a second half first.
+    size_t p = 0;
+    for (size_t i = n > k ? n - k : 0; i < n; ++i) {
+      by_second[p++] = i;
+    }
+    for (size_t j = 0; j < n; ++j) {
+      if (sa[j] >= k) {
+        by_second[p++] = sa[j] - k;
+      }
+    }
+    // Then stably by the rank of their first half.
+    std::fill(count.begin(), count.begin() + classes + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+      ++count[rank[i]];
+    }
+    for (size_t i = 1; i <= classes; ++i) {
+      count[i] += count[i - 1];
+    }
+    for (size_t j = n; j-- > 0;) {
+      sa[--count[rank[by_second[j]]]] = by_second[j];
+    }
+    auto second = [&](uint32_t i) -> int64_t {
+      return i + k < n ? rank[i + k] : -1;
+    };
+    next_rank[sa[0]] = 0;
+    classes = 1;
+    for (size_t j = 1; j < n; ++j) {
+      if (rank[sa[j]] != rank[sa[j - 1]] ||
+          second(sa[j]) != second(sa[j - 1])) {
+        ++classes;
+      }
+      next_rank[sa[j]] = classes - 1;
+    }
+    rank.swap(next_rank);
+    if (classes == n) {
+      break;
+    }
+  }
+  return sa;
+}
+
+// lcp[i] is the length of the longest common prefix of the suffixes at
+// sa[i - 1] and sa[i] (Kasai et al.).
+std::vector<uint32_t> build_lcp_array(const std::vector<Symbol>& text,
+                                      const std::vector<uint32_t>& sa) {
+  size_t n = text.size();
+  std::vector<uint32_t> rank(n);
+  for (size_t i = 0; i < n; ++i) {
+    rank[sa[i]] = i;
+  }
+  std::vector<uint32_t> lcp(n);
+  size_t h = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (rank[i] > 0) {
+      size_t j = sa[rank[i] - 1];
+      while (i + h < n && j + h < n && text[i + h] == text[j + h]) {
+        ++h;
+      }
+      lcp[rank[i]] = h;
+      if (h > 0) {
+        --h;
+      }
+    } else {
+      h = 0;
+    }
+  }
+  return lcp;
+}
+
+// An entry of the text. Instructions that can't be outlined and the ends of
+// blocks are separators, whose symbol occurs only once.
+struct Position {
+  uint32_t method;
+  cfg::Block* block;
+  // Null at the end of a block.
+  IRInstruction* insn;
+  bool separator;
+};
+
+struct MethodContext {
+  DexMethod* method;
+  // The `this` of a constructor, which is uninitialized for a while.
+  const IRInstruction* uninitialized_this{nullptr};
+  std::unique_ptr<type_inference::TypeInference> types;
+  std::unique_ptr<LivenessFixpointIterator> liveness;
+  std::unique_ptr<reaching_defs::MoveAwareFixpointIterator> reaching_defs;
+};
+
+struct Occurrence {
+  uint32_t start;
+  // The registers of the occurrence by the order of their first appearance
+  // in the sequence.
+  std::vector<reg_t> regs;
+};
+
+// The occurrences of a sequence that can share a helper.
+struct Candidate {
+  uint32_t length;
+  std::vector<uint32_t> arg_ids;
+  std::vector<bool> wide_ids;
+  boost::optional<uint32_t> result_id;
+  std::vector<const DexType*> arg_types;
+  const DexType* return_type;
+  std::vector<Occurrence> occurrences;
+  size_t code_units;
+  int64_t benefit;
+};
+
+int64_t get_benefit(size_t code_units, bool returns, size_t count) {
+  int64_t call_units =
+      INVOKE_CODE_UNITS + (returns ? MOVE_RESULT_CODE_UNITS : 0);
+  int64_t helper_units = code_units + 1 + HELPER_OVERHEAD_CODE_UNITS;
+  return (int64_t)count * ((int64_t)code_units - call_units) - helper_units;
+}
+
+using ShapeKey = std::vector<uintptr_t>;
+
+struct ShapeKeyHash {
+  size_t operator()(const ShapeKey& key) const {
+    return boost::hash_range(key.begin(), key.end());
+  }
+};
+
+constexpr size_t MAX_METHOD_REFS = (1 << 16) - 1;
+constexpr size_t MAX_TYPE_REFS = (1 << 16) - 1;
+
+class OutlinerInterDexPlugin : public interdex::InterDexPassPlugin {
+ public:
+  explicit OutlinerInterDexPlugin(size_t max_outlined_methods_per_dex)
+      : m_max_outlined_methods_per_dex(max_outlined_methods_per_dex) {}
+
+  size_t reserve_mrefs() override {
+    // Each helper added to a dex is a new method ref of that dex.
+    return m_max_outlined_methods_per_dex;
+  }
+
+ private:
+  size_t m_max_outlined_methods_per_dex;
+};
+
+class DexOutliner {
+ public:
+  DexOutliner(const InstructionSequenceOutlinerPass::Config& config,
+              std::vector<DexMethod*> methods)
+      : m_config(config), m_methods(std::move(methods)) {}
+
+  // Returns the number of occurrences that were outlined into at most
+  // max_helpers helpers.
+  size_t run(DexClasses* dex,
+             const std::string& host_name,
+             size_t max_helpers) {
+    analyze_methods();
+    build_text();
+    auto candidates = find_candidates();
+    auto selected = select(std::move(candidates), max_helpers);
+    if (!selected.empty()) {
+      outline(selected, dex, host_name);
+    }
+    for (auto method : m_methods) {
+      method->get_code()->clear_cfg();
+    }
+    return m_stats_occurrences;
+  }
+
+  size_t helpers() const { return m_stats_helpers; }
+  size_t insns_removed() const { return m_stats_insns; }
+  int64_t code_units_saved() const { return m_stats_saved; }
+
+ private:
+  void analyze_methods() {
+    m_contexts.resize(m_methods.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      auto method = m_methods[i];
+      auto code = method->get_code();
+      code->build_cfg(/* editable */ true);
+      auto& cfg = code->cfg();
+      cfg.calculate_exit_block();
+      auto& context = m_contexts[i];
+      context.method = method;
+      if (method::is_init(method) && !is_static(method)) {
+        context.uninitialized_this =
+            InstructionIterable(cfg.get_param_instructions()).begin()->insn;
+      }
+      context.types = std::make_unique<type_inference::TypeInference>(cfg);
+      context.types->run(method);
+      context.liveness = std::make_unique<LivenessFixpointIterator>(cfg);
+      context.liveness->run(LivenessDomain());
+      context.reaching_defs =
+          std::make_unique<reaching_defs::MoveAwareFixpointIterator>(cfg);
+      context.reaching_defs->run(reaching_defs::Environment());
+    });
+    for (size_t i = 0; i < m_methods.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+
+  void build_text() {
+    std::unordered_map<InsnKey, Symbol, InsnKeyHash> symbols;
+    auto add_separator = [&](uint32_t method, cfg::Block* block,
+                             IRInstruction* insn) {
+      m_text.push_back(m_alphabet_size++);
+      m_positions.push_back(Position{method, block, insn, true});
+    };
+    for (uint32_t m = 0; m < m_methods.size(); ++m) {
+      auto& cfg = m_methods[m]->get_code()->cfg();
+      for (auto block : cfg.blocks()) {
+        bool eligible = cfg.get_succ_edge_of_type(block, cfg::EDGE_THROW) ==
+                            nullptr &&
+                        !block->is_catch();
+        for (auto& mie : InstructionIterable(block)) {
+          auto insn = mie.insn;
+          if (!eligible || !can_outline(insn)) {
+            add_separator(m, block, insn);
+            continue;
+          }
+          auto it = symbols.find(get_key(insn));
+          if (it == symbols.end()) {
+            it = symbols.emplace(get_key(insn), m_alphabet_size++).first;
+          }
+          m_text.push_back(it->second);
+          m_positions.push_back(Position{m, block, insn, false});
+        }
+        add_separator(m, block, nullptr);
+      }
+    }
+  }
+
+  /*
+   * Enumerates the internal nodes of the suffix tree as the lcp-intervals of
+   * the suffix array. An interval with lcp L whose parent has lcp P stands
+   * for the sequences of length P+1 to L that all share its occurrences.
+   */
+  std::vector<Candidate> find_candidates() {
+    std::vector<Candidate> candidates;
+    size_t n = m_text.size();
+    if (n == 0) {
+      return candidates;
+    }
+    auto sa = build_suffix_array(m_text, m_alphabet_size);
+    auto lcp = build_lcp_array(m_text, sa);
+    struct Interval {
+      uint32_t lcp;
+      uint32_t lb;
+    };
+    std::vector<Interval> stack{{0, 0}};
+    for (size_t i = 1; i <= n; ++i) {
+      uint32_t cur = i < n ? lcp[i] : 0;
+      uint32_t lb = i - 1;
+      while (cur < stack.back().lcp) {
+        auto top = stack.back();
+        stack.pop_back();
+        lb = top.lb;
+        uint32_t parent_lcp = std::max(cur, stack.back().lcp);
+        evaluate_interval(sa, top.lb, i - 1, top.lcp, parent_lcp,
+                          &candidates);
+      }
+      if (cur > stack.back().lcp) {
+        stack.push_back({cur, lb});
+      }
+    }
+    return candidates;
+  }
+
+  void evaluate_interval(const std::vector<uint32_t>& sa,
+                         uint32_t lb,
+                         uint32_t rb,
+                         uint32_t lcp,
+                         uint32_t parent_lcp,
+                         std::vector<Candidate>* candidates) {
+    if (lcp < m_config.min_insns || parent_lcp >= m_config.max_insns) {
+      return;
+    }
+    size_t count = rb - lb + 1;
+    uint32_t longest = std::min<uint32_t>(lcp, m_config.max_insns);
+    uint32_t shortest = std::max<uint32_t>(parent_lcp + 1, m_config.min_insns);
+    std::vector<uint32_t> starts(sa.begin() + lb, sa.begin() + rb + 1);
+    std::sort(starts.begin(), starts.end());
+    for (uint32_t length = longest; length >= shortest; --length) {
+      size_t code_units = 0;
+      for (uint32_t k = 0; k < length; ++k) {
+        code_units += m_positions[starts[0] + k].insn->size();
+      }
+      // Even if every occurrence could be outlined without a result.
+      if (get_benefit(code_units, false, count) <= 0) {
+        return;
+      }
+      bool found = false;
+      std::unordered_map<ShapeKey, Candidate, ShapeKeyHash> groups;
+      for (auto start : starts) {
+        ShapeKey key;
+        Candidate shape;
+        Occurrence occurrence;
+        if (!analyze_occurrence(start, length, &key, &shape, &occurrence)) {
+          continue;
+        }
+        auto it = groups.find(key);
+        if (it == groups.end()) {
+          shape.length = length;
+          shape.code_units = code_units;
+          it = groups.emplace(std::move(key), std::move(shape)).first;
+        }
+        auto& occurrences = it->second.occurrences;
+        // Occurrences of a periodic sequence may overlap.
+        if (!occurrences.empty() &&
+            occurrences.back().start + length > start) {
+          continue;
+        }
+        occurrences.push_back(std::move(occurrence));
+      }
+      for (auto& p : groups) {
+        auto& candidate = p.second;
+        candidate.benefit =
+            get_benefit(candidate.code_units, !!candidate.result_id,
+                        candidate.occurrences.size());
+        if (candidate.occurrences.size() >= 2 && candidate.benefit > 0) {
+          candidates->push_back(std::move(candidate));
+          found = true;
+        }
+      }
+      if (found || length == shortest) {
+        return;
+      }
+    }
+  }
+
+  // The type environment right after the instruction at `pos`.
+  type_inference::TypeEnvironment get_type_env_after(
+      const MethodContext& context, uint32_t pos) {
+    const auto& next = m_positions[pos + 1];
+    if (next.insn != nullptr) {
+      return context.types->get_type_environments().at(next.insn);
+    }
+    return context.types->get_exit_state_at(next.block);
+  }
+
+  /*
+   * Checks that the sequence of `length` instructions at `start` can be
+   * outlined, and computes the shape that its helper would have.
+   */
+  bool analyze_occurrence(uint32_t start,
+                          uint32_t length,
+                          ShapeKey* key,
+                          Candidate* shape,
+                          Occurrence* occurrence) {
+    const auto& first = m_positions[start];
+    const auto& context = m_contexts[first.method];
+    uint32_t end = start + length;
+    // Keep the instructions together with their move-results.
+    if (opcode::is_move_result_any(first.insn->opcode())) {
+      return false;
+    }
+    const auto& next = m_positions[end];
+    if (next.insn != nullptr &&
+        opcode::is_move_result_any(next.insn->opcode())) {
+      return false;
+    }
+
+    std::unordered_map<reg_t, uint32_t> ids;
+    auto& regs = occurrence->regs;
+    auto get_id = [&](reg_t reg, bool wide, bool* is_new) -> boost::optional<
+                                                              uint32_t> {
+      auto it = ids.find(reg);
+      if (it != ids.end()) {
+        *is_new = false;
+        if (shape->wide_ids[it->second] != wide) {
+          return boost::none;
+        }
+        return it->second;
+      }
+      *is_new = true;
+      uint32_t id = regs.size();
+      ids.emplace(reg, id);
+      regs.push_back(reg);
+      shape->wide_ids.push_back(wide);
+      return id;
+    };
+    std::vector<bool> defined;
+    for (uint32_t pos = start; pos < end; ++pos) {
+      auto insn = m_positions[pos].insn;
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        bool is_new;
+        auto id = get_id(insn->src(i), insn->src_is_wide(i), &is_new);
+        if (!id) {
+          return false;
+        }
+        if (is_new) {
+          shape->arg_ids.push_back(*id);
+          defined.push_back(false);
+        }
+        key->push_back(*id);
+      }
+      if (insn->has_dest()) {
+        bool is_new;
+        auto id = get_id(insn->dest(), insn->dest_is_wide(), &is_new);
+        if (!id) {
+          return false;
+        }
+        if (is_new) {
+          defined.push_back(true);
+        }
+        defined[*id] = true;
+        key->push_back(*id);
+      }
+    }
+    // The helper can't reproduce a narrow register that overlaps the upper
+    // half of a wide one.
+    for (uint32_t id = 0; id < regs.size(); ++id) {
+      if (shape->wide_ids[id] && ids.count(regs[id] + 1)) {
+        return false;
+      }
+    }
+    size_t arg_registers = 0;
+    for (auto id : shape->arg_ids) {
+      arg_registers += shape->wide_ids[id] ? 2 : 1;
+    }
+    if (arg_registers > MAX_ARG_REGISTERS) {
+      return false;
+    }
+
+    // At most one of the registers written by the sequence may be read after
+    // it.
+    auto last = m_positions[end - 1].insn;
+    auto live = context.liveness->get_live_out_vars_at(first.block);
+    for (auto it = first.block->rbegin(); it != first.block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      if (it->insn == last) {
+        break;
+      }
+      context.liveness->analyze_instruction(it->insn, &live);
+    }
+    for (uint32_t id = 0; id < regs.size(); ++id) {
+      if (defined[id] && live.contains(regs[id])) {
+        if (shape->result_id) {
+          return false;
+        }
+        shape->result_id = id;
+      }
+    }
+
+    if (!analyze_arg_types(context, start, end, shape, regs)) {
+      return false;
+    }
+    shape->return_type = type::_void();
+    if (shape->result_id) {
+      auto type = get_result_type(context, start, end, regs[*shape->result_id]);
+      if (type == nullptr) {
+        return false;
+      }
+      shape->return_type = type;
+    }
+
+    key->push_back(shape->result_id ? *shape->result_id : -1);
+    key->push_back(reinterpret_cast<uintptr_t>(shape->return_type));
+    for (auto type : shape->arg_types) {
+      key->push_back(reinterpret_cast<uintptr_t>(type));
+    }
+    occurrence->start = start;
+    return true;
+  }
+
+  bool analyze_arg_types(const MethodContext& context,
+                         uint32_t start,
+                         uint32_t end,
+                         Candidate* shape,
+                         const std::vector<reg_t>& regs) {
+    auto first_insn = m_positions[start].insn;
+    const auto& env = context.types->get_type_environments().at(first_insn);
+    boost::optional<reaching_defs::Environment> defs;
+    for (auto id : shape->arg_ids) {
+      auto reg = regs[id];
+      auto type = env.get_type(reg).element();
+      if (shape->wide_ids[id]) {
+        if (type == LONG1) {
+          shape->arg_types.push_back(type::_long());
+        } else if (type == DOUBLE1) {
+          shape->arg_types.push_back(type::_double());
+        } else {
+          return false;
+        }
+        continue;
+      }
+      if (type == REFERENCE) {
+        auto dex_type = env.get_dex_type(reg);
+        if (!dex_type || !is_accessible(*dex_type)) {
+          return false;
+        }
+        // Uninitialized objects can't be passed to other methods.
+        if (!defs) {
+          defs = get_defs_before(context, m_positions[start]);
+        }
+        const auto& reg_defs = defs->get(reg);
+        if (reg_defs.is_top() || reg_defs.is_bottom()) {
+          return false;
+        }
+        for (auto def : reg_defs.elements()) {
+          if (def->opcode() == OPCODE_NEW_INSTANCE ||
+              def == context.uninitialized_this) {
+            return false;
+          }
+        }
+        shape->arg_types.push_back(*dex_type);
+        continue;
+      }
+      // Constants and scalars get their type from their first use in the
+      // sequence.
+      boost::optional<uint32_t> first_use;
+      bool narrow = false;
+      for (uint32_t pos = start; pos < end; ++pos) {
+        auto insn = m_positions[pos].insn;
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          if (insn->src(i) == reg) {
+            narrow |= is_narrow_use(insn, i);
+            if (!first_use) {
+              first_use = pos;
+            }
+          }
+        }
+      }
+      if (narrow || !first_use) {
+        return false;
+      }
+      if (type != INT && type != FLOAT) {
+        auto use = m_positions[*first_use].insn;
+        if (use->has_dest() && use->dest() == reg) {
+          return false;
+        }
+        type = get_type_env_after(context, *first_use).get_type(reg).element();
+      }
+      if (type == INT) {
+        shape->arg_types.push_back(type::_int());
+      } else if (type == FLOAT) {
+        shape->arg_types.push_back(type::_float());
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  reaching_defs::Environment get_defs_before(const MethodContext& context,
+                                             const Position& pos) {
+    auto env = context.reaching_defs->get_entry_state_at(pos.block);
+    for (auto& mie : InstructionIterable(pos.block)) {
+      if (mie.insn == pos.insn) {
+        break;
+      }
+      context.reaching_defs->analyze_instruction(mie.insn, &env);
+    }
+    return env;
+  }
+
+  const DexType* get_result_type(const MethodContext& context,
+                                 uint32_t start,
+                                 uint32_t end,
+                                 reg_t reg) {
+    auto env = get_type_env_after(context, end - 1);
+    auto type = env.get_type(reg).element();
+    switch (type) {
+    case LONG1:
+      return type::_long();
+    case DOUBLE1:
+      return type::_double();
+    case FLOAT:
+      return type::_float();
+    case REFERENCE: {
+      auto dex_type = env.get_dex_type(reg);
+      return dex_type && is_accessible(*dex_type) ? *dex_type : nullptr;
+    }
+    case INT:
+      break;
+    default:
+      return nullptr;
+    }
+    for (uint32_t pos = end; pos-- > start;) {
+      auto insn = m_positions[pos].insn;
+      if (insn->has_dest() && insn->dest() == reg) {
+        auto primary = pos > start ? m_positions[pos - 1].insn : nullptr;
+        return get_int_result_type(primary, insn);
+      }
+    }
+    return nullptr;
+  }
+
+  // Picks the candidates that save the most, among the occurrences that
+  // aren't outlined yet.
+  std::vector<Candidate> select(std::vector<Candidate> candidates,
+                                size_t max_helpers) {
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) {
+                       if (a.benefit != b.benefit) {
+                         return a.benefit > b.benefit;
+                       }
+                       return a.occurrences[0].start < b.occurrences[0].start;
+                     });
+    std::vector<bool> claimed(m_text.size());
+    std::vector<Candidate> selected;
+    for (auto& candidate : candidates) {
+      if (selected.size() >= max_helpers) {
+        break;
+      }
+      std::vector<Occurrence> remaining;
+      for (auto& occurrence : candidate.occurrences) {
+        auto begin = claimed.begin() + occurrence.start;
+        if (std::find(begin, begin + candidate.length, true) ==
+            begin + candidate.length) {
+          remaining.push_back(std::move(occurrence));
+        }
+      }
+      auto benefit = get_benefit(candidate.code_units, !!candidate.result_id,
+                                 remaining.size());
+      if (remaining.size() < 2 || benefit <= 0) {
+        continue;
+      }
+      for (const auto& occurrence : remaining) {
+        std::fill(claimed.begin() + occurrence.start,
+                  claimed.begin() + occurrence.start + candidate.length,
+                  true);
+      }
+      candidate.occurrences = std::move(remaining);
+      candidate.benefit = benefit;
+      selected.push_back(std::move(candidate));
+    }
+    return selected;
+  }
+
+  DexMethod* create_helper(const Candidate& candidate,
+                           DexType* host,
+                           size_t index) {
+    std::deque<DexType*> args;
+    for (auto type : candidate.arg_types) {
+      args.push_back(const_cast<DexType*>(type));
+    }
+    auto proto =
+        DexProto::make_proto(const_cast<DexType*>(candidate.return_type),
+                             DexTypeList::make_type_list(std::move(args)));
+    auto name = DexString::make_string("outlined$" + std::to_string(index));
+    auto helper = DexMethod::make_method(host, name, proto)
+                      ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    auto code = std::make_unique<IRCode>(helper, 0);
+
+    // Map the registers of the first occurrence to those of the helper.
+    const auto& occurrence = candidate.occurrences[0];
+    std::unordered_map<reg_t, reg_t> reg_map;
+    auto param_it = InstructionIterable(code->get_param_instructions()).begin();
+    for (auto id : candidate.arg_ids) {
+      reg_map.emplace(occurrence.regs[id], param_it->insn->dest());
+      ++param_it;
+    }
+    for (uint32_t id = 0; id < occurrence.regs.size(); ++id) {
+      if (!reg_map.count(occurrence.regs[id])) {
+        reg_map.emplace(occurrence.regs[id],
+                        candidate.wide_ids[id] ? code->allocate_wide_temp()
+                                               : code->allocate_temp());
+      }
+    }
+    for (uint32_t k = 0; k < candidate.length; ++k) {
+      auto insn = new IRInstruction(*m_positions[occurrence.start + k].insn);
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        insn->set_src(i, reg_map.at(insn->src(i)));
+      }
+      if (insn->has_dest()) {
+        insn->set_dest(reg_map.at(insn->dest()));
+      }
+      code->push_back(insn);
+    }
+    auto ret = new IRInstruction(opcode::return_opcode(candidate.return_type));
+    if (candidate.result_id) {
+      ret->set_src(0, reg_map.at(occurrence.regs[*candidate.result_id]));
+    }
+    code->push_back(ret);
+    helper->set_code(std::move(code));
+    helper->set_deobfuscated_name(show(helper));
+    // Inlining the helper back would undo the outlining.
+    helper->rstate.set_dont_inline();
+    return helper;
+  }
+
+  void replace_occurrence(const Candidate& candidate,
+                          const Occurrence& occurrence,
+                          DexMethod* helper) {
+    const auto& first = m_positions[occurrence.start];
+    auto& cfg = m_methods[first.method]->get_code()->cfg();
+    auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+    invoke->set_method(helper)->set_srcs_size(candidate.arg_ids.size());
+    for (size_t i = 0; i < candidate.arg_ids.size(); ++i) {
+      invoke->set_src(i, occurrence.regs[candidate.arg_ids[i]]);
+    }
+    std::vector<IRInstruction*> call{invoke};
+    if (candidate.result_id) {
+      auto move_result =
+          new IRInstruction(opcode::move_result_for_invoke(helper));
+      move_result->set_dest(occurrence.regs[*candidate.result_id]);
+      call.push_back(move_result);
+    }
+    cfg.insert_before(cfg.find_insn(first.insn, first.block), call);
+    for (uint32_t k = 0; k < candidate.length; ++k) {
+      auto insn = m_positions[occurrence.start + k].insn;
+      // Removing an instruction also removes its move-result.
+      if (!opcode::is_move_result_any(insn->opcode())) {
+        cfg.remove_insn(cfg.find_insn(insn, first.block));
+      }
+    }
+  }
+
+  void outline(const std::vector<Candidate>& selected,
+               DexClasses* dex,
+               const std::string& host_name) {
+    auto host = DexType::make_type(host_name.c_str());
+    ClassCreator cc(host);
+    cc.set_access(ACC_PUBLIC | ACC_FINAL);
+    cc.set_super(type::java_lang_Object());
+    std::vector<DexMethod*> helpers;
+    for (size_t i = 0; i < selected.size(); ++i) {
+      helpers.push_back(create_helper(selected[i], host, i));
+      cc.add_method(helpers.back());
+    }
+    for (size_t i = 0; i < selected.size(); ++i) {
+      const auto& candidate = selected[i];
+      TRACE(OUTLINE, 3, "outlining %zu occurrences of %u insns into %s",
+            candidate.occurrences.size(), candidate.length,
+            SHOW(helpers[i]));
+      for (const auto& occurrence : candidate.occurrences) {
+        replace_occurrence(candidate, occurrence, helpers[i]);
+      }
+      m_stats_occurrences += candidate.occurrences.size();
+      m_stats_insns += candidate.occurrences.size() * candidate.length;
+      m_stats_saved += candidate.benefit;
+    }
+    m_stats_helpers += helpers.size();
+    dex->push_back(cc.create());
+  }
+
+  const InstructionSequenceOutlinerPass::Config& m_config;
+  std::vector<DexMethod*> m_methods;
+  std::vector<MethodContext> m_contexts;
+  std::vector<Symbol> m_text;
+  std::vector<Position> m_positions;
+  size_t m_alphabet_size{0};
+
+  size_t m_stats_helpers{0};
+  size_t m_stats_occurrences{0};
+  size_t m_stats_insns{0};
+  int64_t m_stats_saved{0};
+};
+
+// Returns how many helpers fit into the dex without going over its method or
+// type ref limits. The helpers are new method refs, and their host a new type.
+size_t get_room_for_helpers(const DexClasses& dex) {
+  std::vector<DexMethodRef*> mrefs;
+  std::vector<DexType*> trefs;
+  for (auto cls : dex) {
+    cls->gather_methods(mrefs);
+    cls->gather_types(trefs);
+  }
+  sort_unique(mrefs);
+  sort_unique(trefs);
+  if (trefs.size() >= MAX_TYPE_REFS) {
+    return 0;
+  }
+  return mrefs.size() < MAX_METHOD_REFS ? MAX_METHOD_REFS - mrefs.size() : 0;
+}
+
+std::string get_host_name(size_t store, size_t dex) {
+  auto base = "Lcom/redex/Outlined$" + std::to_string(store) + "$" +
+              std::to_string(dex);
+  std::string name = base + ";";
+  for (size_t i = 1; DexType::get_type(name.c_str()) != nullptr; ++i) {
+    name = base + "$" + std::to_string(i) + ";";
+  }
+  return name;
+}
+
+} // namespace
+
+void InstructionSequenceOutlinerPass::bind_config() {
+  bind("min_insns", m_config.min_insns, m_config.min_insns);
+  bind("max_insns", m_config.max_insns, m_config.max_insns);
+  bind("max_outlined_methods_per_dex",
+       m_config.max_outlined_methods_per_dex,
+       m_config.max_outlined_methods_per_dex);
+  bind("hot_method_min_appear_percent",
+       m_config.hot_method_min_appear_percent,
+       m_config.hot_method_min_appear_percent);
+  after_configuration([this] {
+    always_assert(m_config.min_insns >= 1);
+    always_assert(m_config.min_insns <= m_config.max_insns);
+    interdex::InterDexRegistry* registry =
+        static_cast<interdex::InterDexRegistry*>(
+            PluginRegistry::get().pass_registry(interdex::INTERDEX_PASS_NAME));
+    std::function<interdex::InterDexPassPlugin*()> fn =
+        [this]() -> interdex::InterDexPassPlugin* {
+      return new OutlinerInterDexPlugin(m_config.max_outlined_methods_per_dex);
+    };
+    registry->register_plugin("INSTRUCTION_SEQUENCE_OUTLINER_PLUGIN",
+                              std::move(fn));
+  });
+}
+
+void InstructionSequenceOutlinerPass::run_pass(DexStoresVector& stores,
+                                               ConfigFiles& conf,
+                                               PassManager& mgr) {
+  always_assert_log(!mgr.regalloc_has_run(),
+                    "InstructionSequenceOutlinerPass must run before register "
+                    "allocation");
+  const auto& method_stats = conf.get_method_profiles().method_stats();
+  auto is_hot = [&](const DexMethod* method) {
+    auto it = method_stats.find(method);
+    return it != method_stats.end() &&
+           it->second.appear_percent >= m_config.hot_method_min_appear_percent;
+  };
+
+  size_t helpers = 0;
+  size_t occurrences = 0;
+  size_t insns_removed = 0;
+  int64_t code_units_saved = 0;
+  size_t hot_methods = 0;
+  for (size_t store_idx = 0; store_idx < stores.size(); ++store_idx) {
+    auto& dexen = stores[store_idx].get_dexen();
+    for (size_t dex_idx = 0; dex_idx < dexen.size(); ++dex_idx) {
+      auto& dex = dexen[dex_idx];
+      std::vector<DexMethod*> methods;
+      walk::methods(dex, [&](DexMethod* method) {
+        if (method->get_code() == nullptr ||
+            method->rstate.no_optimizations()) {
+          return;
+        }
+        if (is_hot(method)) {
+          ++hot_methods;
+          return;
+        }
+        methods.push_back(method);
+      });
+      auto max_helpers = std::min(m_config.max_outlined_methods_per_dex,
+                                  get_room_for_helpers(dex));
+      DexOutliner outliner(m_config, std::move(methods));
+      occurrences +=
+          outliner.run(&dex, get_host_name(store_idx, dex_idx), max_helpers);
+      helpers += outliner.helpers();
+      insns_removed += outliner.insns_removed();
+      code_units_saved += outliner.code_units_saved();
+    }
+  }
+
+  mgr.incr_metric("outlined_methods", helpers);
+  mgr.incr_metric("outlined_occurrences", occurrences);
+  mgr.incr_metric("outlined_insns", insns_removed);
+  mgr.incr_metric("estimated_code_units_saved", code_units_saved);
+  mgr.incr_metric("hot_methods_skipped", hot_methods);
+  TRACE(OUTLINE, 1,
+        "outlined %zu occurrences into %zu helpers, saving about %ld code "
+        "units",
+        occurrences, helpers, code_units_saved);
+}
+
+static InstructionSequenceOutlinerPass s_pass;
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "Pass.h"
+
+/*
+ * This pass moves sequences of instructions that recur across the methods of
+ * a dex into shared static helper methods, and replaces each occurrence with
+ * an invocation of its helper.
+ *
+ * Candidates are found with a suffix array built over the instructions of
+ * all the eligible methods of a dex, where each instruction is mapped to a
+ * symbol made of its opcode and its operands other than registers. Every
+ * internal node of the implied suffix tree is a sequence that occurs at least
+ * twice. The occurrences of a sequence are then partitioned by the shape of
+ * their registers (after renaming them in order of appearance) and by the
+ * types of the values that flow in and out of the sequence, so that all the
+ * occurrences of a group can share the same helper.
+ *
+ * A sequence may only be outlined if:
+ * - it lies within a single block that has no throw edges, and doesn't split
+ *   an instruction from its move-result;
+ * - it contains no control flow, monitors, constructors calls, allocations,
+ *   invoke-super, invoke-direct or payloads;
+ * - everything it references is public, as the helper lives in another
+ *   class, and it writes no final fields for the same reason;
+ * - at most one of the registers it writes is live after it, which becomes
+ *   the return value of the helper;
+ * - the types of its inputs and of its output are known precisely.
+ *
+ * The selected sequences are those that save the most code units, with the
+ * size of the invocation and of the helper itself taken into account. Hot
+ * methods, according to the method profiles, are left alone, as the extra
+ * call would slow them down.
+ *
+ * The helpers of a dex go into a new class in that dex, so that outlining
+ * never introduces cross-dex references. A dex only gets as many helpers as
+ * its method refs have room for, and an InterDex plugin reserves room for
+ * them in case InterDex runs first. The pass must run before register
+ * allocation.
+ */
+class InstructionSequenceOutlinerPass : public Pass {
+ public:
+  struct Config {
+    // The shortest and longest sequences, in instructions, to outline.
+    size_t min_insns{3};
+    size_t max_insns{64};
+    // The most helpers to add to a single dex.
+    size_t max_outlined_methods_per_dex{1024};
+    // Methods that appear in at least this percentage of the profiled
+    // samples are not outlined from.
+    float hot_method_min_appear_percent{1.0};
+  };
+
+  InstructionSequenceOutlinerPass() : Pass("InstructionSequenceOutlinerPass") {}
+
+  void bind_config() override;
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  Config m_config;
+};
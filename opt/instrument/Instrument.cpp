@@ -16,9 +16,11 @@
 #include "Show.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 #include <cmath>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -712,9 +714,12 @@ auto generate_sharded_analysis_methods(DexClass* cls,
   return std::make_pair(methods, names);
 }
 
-std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
-                                               const size_t num_shards) {
-  // Insert additional sMethodStatsN into the clinit
+std::vector<DexFieldRef*> patch_sharded_arrays(
+    DexClass* cls,
+    const size_t num_shards,
+    const std::string& deobfuscated_prefix) {
+  // Insert additional <deobfuscated_prefix>N, e.g. sMethodStatsN, into the
+  // clinit
   //
   // private static short[] sMethodStats1 = new short[0];
   // private static short[] sMethodStats2 = new short[0]; <= Add
@@ -733,7 +738,6 @@ std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
   IRCode* code = clinit->get_code();
   std::vector<DexFieldRef*> fields;
   bool patched = false;
-  const std::string deobfuscated_prefix = "sMethodStats";
   walk::matching_opcodes_in_block(
       *clinit,
       std::make_tuple(m::is_opcode(OPCODE_NEW_ARRAY),
@@ -784,8 +788,8 @@ std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
         patched = true;
       });
 
-  always_assert_log(patched, "Failed to insert sMethodStatsN:\n%s",
-                    SHOW(clinit->get_code()));
+  always_assert_log(patched, "Failed to insert %sN:\n%s",
+                    SHOW(deobfuscated_prefix), SHOW(clinit->get_code()));
 
   // static short[][] sMethodStatsArray = new short[][] {
   //   sMethodStats1, <== Add
@@ -802,8 +806,8 @@ std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
   // Add => OPCODE: APUT_OBJECT vY, vX, vN
   //        ...
   // Add => OPCODE: APUT_OBJECT vY, vX, vN
-  auto field =
-      cls->find_field_from_simple_deobfuscated_name("sMethodStatsArray");
+  const std::string array_name = deobfuscated_prefix + "Array";
+  auto field = cls->find_field_from_simple_deobfuscated_name(array_name);
   always_assert(field != nullptr);
   patch_array_size(cls, field->get_name()->str(), num_shards);
   patched = false;
@@ -816,7 +820,7 @@ std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
           cfg::Block*,
           const std::vector<IRInstruction*>& insts) {
         DexField* field = static_cast<DexField*>(insts[2]->get_field());
-        if (field->get_simple_deobfuscated_name() != "sMethodStatsArray") {
+        if (field->get_simple_deobfuscated_name() != array_name) {
           return;
         }
 
@@ -842,8 +846,8 @@ std::vector<DexFieldRef*> patch_sharded_arrays(DexClass* cls,
         patched = true;
       });
 
-  always_assert_log(patched,
-                    "Failed to insert sMethodStatsN to sMethodStatsArray:\n%s",
+  always_assert_log(patched, "Failed to insert %sN to %s:\n%s",
+                    SHOW(deobfuscated_prefix), SHOW(array_name),
                     SHOW(clinit->get_code()));
 
   return fields;
@@ -855,7 +859,8 @@ void do_simple_method_tracing(DexClass* analysis_cls,
                               PassManager& pm,
                               const InstrumentPass::Options& options) {
   const size_t NUM_SHARDS = options.num_shards;
-  const auto& array_fields = patch_sharded_arrays(analysis_cls, NUM_SHARDS);
+  const auto& array_fields =
+      patch_sharded_arrays(analysis_cls, NUM_SHARDS, "sMethodStats");
   always_assert(array_fields.size() == NUM_SHARDS);
   const auto& analysis_methods = generate_sharded_analysis_methods(
       analysis_cls, options.analysis_method_name, array_fields, NUM_SHARDS);
@@ -1051,6 +1056,42 @@ void do_simple_method_tracing(DexClass* analysis_cls,
   pm.incr_metric("Excluded", excluded);
 }
 
+std::unordered_set<std::string> load_cold_start_classes(ConfigFiles& cfg) {
+  auto interdex_list = cfg.get_coldstart_classes();
+  std::unordered_set<std::string> cold_start_classes;
+  std::string dex_end_marker0("LDexEndMarker0;");
+  for (auto class_string : interdex_list) {
+    if (class_string == dex_end_marker0) {
+      break;
+    }
+    class_string.back() = '/';
+    cold_start_classes.insert(class_string);
+  }
+  TRACE(INSTRUMENT, 7, "Number of classes: %d", cold_start_classes.size());
+  return cold_start_classes;
+}
+
+bool should_instrument_blocks(
+    const DexMethod* method,
+    const InstrumentPass::Options& options,
+    const std::unordered_set<std::string>& cold_start_classes) {
+  // Basic block tracing assumes whitelist or set of cold start classes.
+  if ((!options.whitelist.empty() && !is_included(method, options.whitelist)) ||
+      (options.only_cold_start_class &&
+       !is_included(method, cold_start_classes))) {
+    return false;
+  }
+
+  // Blacklist has priority over whitelist or cold start list.
+  if (is_included(method, options.blacklist)) {
+    TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s", SHOW(method));
+    return false;
+  }
+
+  TRACE(INSTRUMENT, 9, "Whitelist: included: %s", SHOW(method));
+  return true;
+}
+
 // A simple bit-vector basic block instrumentation algorithm
 //
 //  Example) Original CFG
@@ -1089,18 +1130,7 @@ void do_basic_block_tracing(DexClass* analysis_cls,
   std::map<int /*id*/, std::pair<std::string, int /*number of BBs*/>>
       method_id_name_map;
   auto scope = build_class_scope(stores);
-
-  auto interdex_list = cfg.get_coldstart_classes();
-  std::unordered_set<std::string> cold_start_classes;
-  std::string dex_end_marker0("LDexEndMarker0;");
-  for (auto class_string : interdex_list) {
-    if (class_string == dex_end_marker0) {
-      break;
-    }
-    class_string.back() = '/';
-    cold_start_classes.insert(class_string);
-  }
-  TRACE(INSTRUMENT, 7, "Number of classes: %d", cold_start_classes.size());
+  const auto& cold_start_classes = load_cold_start_classes(cfg);
 
   std::map<size_t /* num_vectors */, int /* count */> bb_vector_stat;
   walk::code(scope, [&](DexMethod* method, IRCode& code) {
@@ -1113,21 +1143,10 @@ void do_basic_block_tracing(DexClass* analysis_cls,
       return;
     }
 
-    // Basic block tracing assumes whitelist or set of cold start classes.
-    if ((!options.whitelist.empty() &&
-         !is_included(method, options.whitelist)) ||
-        (options.only_cold_start_class &&
-         !is_included(method, cold_start_classes))) {
+    if (!should_instrument_blocks(method, options, cold_start_classes)) {
       return;
     }
 
-    // Blacklist has priority over whitelist or cold start list.
-    if (is_included(method, options.blacklist)) {
-      TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s", SHOW(method));
-      return;
-    }
-
-    TRACE(INSTRUMENT, 9, "Whitelist: included: %s", SHOW(method));
     all_methods++;
     method_index = instrument_onBasicBlockBegin(
         &code, method, method_onMethodExit_map, method_index, all_bb_nums,
@@ -1153,6 +1172,163 @@ void do_basic_block_tracing(DexClass* analysis_cls,
         (all_method_inst - 1), all_bb_inst, all_methods, all_bb_nums);
 }
 
+// Returns where the coverage of the block can be marked: after the
+// instructions that must start it, or end() if there are no others.
+IRList::iterator find_coverage_insert_point(cfg::Block* block) {
+  for (auto it = block->begin(); it != block->end(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto op = it->insn->opcode();
+    if (!opcode::is_load_param(op) && !opcode::is_move_result_any(op) &&
+        op != OPCODE_MOVE_EXCEPTION) {
+      return it;
+    }
+  }
+  return block->end();
+}
+
+// Sets coverage[first_bit + i] when the i-th block of the method, in the
+// order of the block ids of its editable CFG, runs. That's the order the
+// counts of a block profile are listed in. Returns the ids of the blocks.
+std::vector<cfg::BlockId> instrument_block_coverage(IRCode& code,
+                                                    DexFieldRef* coverage,
+                                                    size_t first_bit) {
+  code.build_cfg(/* editable */ true);
+  auto& cfg = code.cfg();
+  const auto blocks = cfg.blocks();
+  const auto array_reg = cfg.allocate_temp();
+  const auto true_reg = cfg.allocate_temp();
+  const auto index_reg = cfg.allocate_temp();
+
+  std::vector<cfg::BlockId> block_ids;
+  for (auto block : blocks) {
+    block_ids.push_back(block->id());
+    std::vector<IRInstruction*> mark{
+        (new IRInstruction(OPCODE_CONST))
+            ->set_literal(first_bit + block_ids.size() - 1)
+            ->set_dest(index_reg),
+        (new IRInstruction(OPCODE_APUT_BOOLEAN))
+            ->set_srcs_size(3)
+            ->set_src(0, true_reg)
+            ->set_src(1, array_reg)
+            ->set_src(2, index_reg)};
+    auto it = find_coverage_insert_point(block);
+    if (it == block->end()) {
+      block->push_back(mark);
+    } else {
+      block->insert_before(block->to_cfg_instruction_iterator(it), mark);
+    }
+  }
+
+  // Load the array once, ahead of the mark of the entry block.
+  auto entry = cfg.entry_block();
+  entry->insert_before(
+      entry->to_cfg_instruction_iterator(
+          entry->get_first_non_param_loading_insn()),
+      {(new IRInstruction(OPCODE_SGET_OBJECT))->set_field(coverage),
+       (new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT))
+           ->set_dest(array_reg),
+       (new IRInstruction(OPCODE_CONST))->set_literal(1)->set_dest(true_reg)});
+  code.clear_cfg();
+  return block_ids;
+}
+
+// A low-overhead basic block coverage instrumentation
+//
+// Every dex gets a boolean array of its own, sBlockCoverageN, in which each
+// instrumented method owns a contiguous range with an element per block. The
+// method loads the array on entry, and each block marks itself with a
+// CONST/APUT_BOOLEAN pair. Nothing is called, and since a mark is a plain
+// store of true, threads racing on it lose nothing. Keeping the methods of a
+// dex together keeps the marks of code that runs together on the same pages.
+// Like sMethodStats, the arrays are cloned from sBlockCoverage and collected
+// into sBlockCoverageArray, which the analysis class must declare.
+//
+// The metadata file maps the elements back to blocks:
+//   D,<dex>,<array name>,<array size>
+//   M,<dex>,<first element>,<method>,<number of opcodes>,"<block ids>"
+// where the i-th block id goes with the element first element + i. Given the
+// number of opcodes, this is what a block profile needs (see BlockProfiles.h).
+void do_basic_block_coverage(DexClass* analysis_cls,
+                             DexStoresVector& stores,
+                             ConfigFiles& cfg,
+                             PassManager& pm,
+                             const InstrumentPass::Options& options) {
+  std::vector<DexClasses*> dexen;
+  for (auto& store : stores) {
+    for (auto& dex : store.get_dexen()) {
+      dexen.push_back(&dex);
+    }
+  }
+  const auto& array_fields =
+      patch_sharded_arrays(analysis_cls, dexen.size(), "sBlockCoverage");
+  const auto& cold_start_classes = load_cold_start_classes(cfg);
+
+  struct DexCoverage {
+    size_t num_bits{0};
+    size_t num_methods{0};
+    std::ostringstream metadata;
+  };
+  std::vector<DexCoverage> coverages(dexen.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t dexnr) {
+    auto& coverage = coverages[dexnr];
+    for (auto cls : *dexen[dexnr]) {
+      if (cls == analysis_cls) {
+        continue;
+      }
+      std::vector<DexMethod*> methods(cls->get_dmethods().begin(),
+                                      cls->get_dmethods().end());
+      methods.insert(methods.end(), cls->get_vmethods().begin(),
+                     cls->get_vmethods().end());
+      for (auto method : methods) {
+        auto code = method->get_code();
+        if (code == nullptr ||
+            !should_instrument_blocks(method, options, cold_start_classes)) {
+          continue;
+        }
+        const auto num_opcodes = code->count_opcodes();
+        const auto& block_ids = instrument_block_coverage(
+            *code, array_fields[dexnr], coverage.num_bits);
+        coverage.metadata << "M," << dexnr << "," << coverage.num_bits << ","
+                          << show(method) << "," << num_opcodes << ",\"";
+        for (size_t i = 0; i < block_ids.size(); ++i) {
+          coverage.metadata << (i == 0 ? "" : " ") << block_ids[i];
+        }
+        coverage.metadata << "\"\n";
+        coverage.num_bits += block_ids.size();
+        ++coverage.num_methods;
+      }
+    }
+  });
+  for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
+    wq.add_item(dexnr);
+  }
+  wq.run_all();
+
+  const auto& file_name = cfg.metafile(options.metadata_file_name);
+  std::ofstream ofs(file_name, std::ofstream::out | std::ofstream::trunc);
+  ofs << "#,basic-block-coverage,1.0" << std::endl;
+  size_t all_bits = 0;
+  size_t all_methods = 0;
+  for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
+    const auto& coverage = coverages[dexnr];
+    const auto& field_name = array_fields[dexnr]->get_name()->str();
+    patch_array_size(analysis_cls, field_name, coverage.num_bits);
+    ofs << "D," << dexnr << "," << field_name << "," << coverage.num_bits
+        << "\n"
+        << coverage.metadata.str();
+    all_bits += coverage.num_bits;
+    all_methods += coverage.num_methods;
+  }
+  TRACE(INSTRUMENT, 2, "Index file was written to: %s", SHOW(file_name));
+  TRACE(INSTRUMENT, 1, "Instrumented %zu blocks of %zu methods in %zu dexes",
+        all_bits, all_methods, dexen.size());
+
+  pm.incr_metric("Instrumented", all_methods);
+  pm.incr_metric("InstrumentedBlocks", all_bits);
+}
+
 std::unordered_set<std::string> load_blacklist_file(
     const std::string& file_name) {
   // Assume the file simply enumerates blacklisted names.
@@ -1276,6 +1452,8 @@ void InstrumentPass::run_pass(DexStoresVector& stores,
     do_simple_method_tracing(analysis_cls, stores, cfg, pm, m_options);
   } else if (m_options.instrumentation_strategy == "basic_block_tracing") {
     do_basic_block_tracing(analysis_cls, stores, cfg, pm, m_options);
+  } else if (m_options.instrumentation_strategy == "basic_block_coverage") {
+    do_basic_block_coverage(analysis_cls, stores, cfg, pm, m_options);
   } else {
     std::cerr << "[InstrumentPass] Unknown instrumentation strategy.\n";
   }
@@ -10,6 +10,7 @@
 
 #include "CrossDexRefMinimizer.h"
 #include "DexUtil.h"
+#include "WorkQueue.h"
 
 namespace interdex {
 
@@ -67,17 +68,25 @@ uint64_t CrossDexRefMinimizer::ClassInfo::get_priority() const {
   return (primary_priority << 24) | secondary_priority;
 }
 
-void CrossDexRefMinimizer::reprioritize(
-    const std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>&
-        affected_classes) {
+CrossDexRefMinimizer::ClassInfoDelta& CrossDexRefMinimizer::get_delta(
+    ClassIndex index) {
+  auto& delta = m_deltas[index];
+  if (!delta.affected) {
+    delta.affected = true;
+    m_affected_classes.push_back(index);
+  }
+  return delta;
+}
+
+void CrossDexRefMinimizer::reprioritize() {
   TRACE(IDEX, 4, "[dex ordering] Reprioritizing %u classes",
-        affected_classes.size());
-  for (auto p : affected_classes) {
+        m_affected_classes.size());
+  for (ClassIndex index : m_affected_classes) {
     ++m_stats.reprioritizations;
-    DexClass* affected_class = p.first;
-    CrossDexRefMinimizer::ClassInfoDelta& delta = p.second;
+    CrossDexRefMinimizer::ClassInfoDelta& delta = m_deltas[index];
     CrossDexRefMinimizer::ClassInfo& affected_class_info =
-        m_class_infos.at(affected_class);
+        m_class_infos[index];
+    always_assert(!affected_class_info.erased);
     affected_class_info.applied_refs_weight += delta.applied_refs_weight;
     for (size_t i = 0; i < INFREQUENT_REFS_COUNT; ++i) {
       affected_class_info.infrequent_refs_weight[i] +=
@@ -85,26 +94,28 @@ void CrossDexRefMinimizer::reprioritize(
     }
 
     const auto priority = affected_class_info.get_priority();
-    m_prioritized_classes.update_priority(affected_class, priority);
+    m_prioritized_classes.update_priority(index, priority);
     TRACE(
         IDEX, 5,
         "[dex ordering] Reprioritized class {%s} with priority %016lx; "
         "index %u; %u (delta %d) applied refs weight, %s (delta %s) infrequent "
         "refs weights, %u total refs",
-        SHOW(affected_class), priority, affected_class_info.index,
+        SHOW(affected_class_info.cls), priority, affected_class_info.index,
         affected_class_info.applied_refs_weight, delta.applied_refs_weight,
         format_infrequent_refs_array(affected_class_info.infrequent_refs_weight)
             .c_str(),
         format_infrequent_refs_array(delta.infrequent_refs_weight).c_str(),
         affected_class_info.refs.size());
+    delta = CrossDexRefMinimizer::ClassInfoDelta();
   }
+  m_affected_classes.clear();
 }
 
-void CrossDexRefMinimizer::gather_refs(DexClass* cls,
-                                       std::vector<DexMethodRef*>& method_refs,
-                                       std::vector<DexFieldRef*>& field_refs,
-                                       std::vector<DexType*>& types,
-                                       std::vector<DexString*>& strings) {
+void CrossDexRefMinimizer::gather_refs(DexClass* cls, ClassRefs* class_refs) {
+  auto& method_refs = class_refs->method_refs;
+  auto& field_refs = class_refs->field_refs;
+  auto& types = class_refs->types;
+  auto& strings = class_refs->strings;
   cls->gather_methods(method_refs);
   cls->gather_fields(field_refs);
   cls->gather_types(types);
@@ -123,70 +134,100 @@ void CrossDexRefMinimizer::gather_refs(DexClass* cls,
   std::sort(strings.begin(), strings.end(), compare_dexstrings);
 }
 
+const CrossDexRefMinimizer::ClassRefs& CrossDexRefMinimizer::get_refs(
+    DexClass* cls, ClassRefs* storage) const {
+  auto it = m_class_refs.find(cls);
+  if (it != m_class_refs.end()) {
+    return it->second;
+  }
+  gather_refs(cls, storage);
+  return *storage;
+}
+
+void CrossDexRefMinimizer::precompute_refs(
+    const std::vector<DexClass*>& classes) {
+  std::vector<ClassRefs> class_refs(classes.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { gather_refs(classes[i], &class_refs[i]); });
+  for (size_t i = 0; i < classes.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  m_class_refs.reserve(m_class_refs.size() + classes.size());
+  for (size_t i = 0; i < classes.size(); ++i) {
+    m_class_refs[classes[i]] = std::move(class_refs[i]);
+  }
+}
+
+CrossDexRefMinimizer::RefInfo& CrossDexRefMinimizer::get_ref_info(
+    const void* ref) {
+  auto it = m_ref_indices.emplace(ref, m_ref_infos.size()).first;
+  if (it->second == m_ref_infos.size()) {
+    m_ref_infos.emplace_back();
+  }
+  return m_ref_infos[it->second];
+}
+
 void CrossDexRefMinimizer::ignore(DexClass* cls) {
   // By setting the count to the maximum value here, the class will later appear
   // to have an extremely high frequency and thus get skipped from
   // consideration by insert/add_weight.
-  m_ref_counts[cls->get_type()] = std::numeric_limits<size_t>::max();
+  get_ref_info(cls->get_type()).count = std::numeric_limits<size_t>::max();
 }
 
 void CrossDexRefMinimizer::sample(DexClass* cls) {
-  std::vector<DexMethodRef*> method_refs;
-  std::vector<DexFieldRef*> field_refs;
-  std::vector<DexType*> types;
-  std::vector<DexString*> strings;
-  gather_refs(cls, method_refs, field_refs, types, strings);
-  auto increment = [& ref_counts = m_ref_counts,
-                    &max_ref_count = m_max_ref_count](void* ref) {
-    size_t& count = ref_counts[ref];
-    if (count < std::numeric_limits<size_t>::max() && ++count > max_ref_count) {
-      max_ref_count = count;
+  ClassRefs storage;
+  const auto& class_refs = get_refs(cls, &storage);
+  auto increment = [this](const void* ref) {
+    size_t& count = get_ref_info(ref).count;
+    if (count < std::numeric_limits<size_t>::max() &&
+        ++count > m_max_ref_count) {
+      m_max_ref_count = count;
     }
   };
-  for (auto ref : method_refs) {
+  for (auto ref : class_refs.method_refs) {
     increment(ref);
   }
-  for (auto ref : field_refs) {
+  for (auto ref : class_refs.field_refs) {
     increment(ref);
   }
-  for (auto ref : types) {
+  for (auto ref : class_refs.types) {
     increment(ref);
   }
-  for (auto ref : strings) {
+  for (auto ref : class_refs.strings) {
     increment(ref);
   }
 }
 
 void CrossDexRefMinimizer::insert(DexClass* cls) {
-  always_assert(m_class_infos.count(cls) == 0);
+  ClassIndex index = m_class_infos.size();
+  auto inserted = m_class_indices.emplace(cls, index).second;
+  always_assert(inserted);
   ++m_stats.classes;
-  CrossDexRefMinimizer::ClassInfo& class_info =
-      m_class_infos
-          .insert({cls, CrossDexRefMinimizer::ClassInfo(m_next_index++)})
-          .first->second;
+  m_class_infos.emplace_back(cls, index);
+  m_deltas.emplace_back();
+  CrossDexRefMinimizer::ClassInfo& class_info = m_class_infos.back();
 
   // Collect all relevant references that contribute to cross-dex metadata
   // entries.
   // We don't bother with protos and type_lists, as they are directly related
   // to method refs (I tried, didn't help).
-  std::vector<DexMethodRef*> method_refs;
-  std::vector<DexFieldRef*> field_refs;
-  std::vector<DexType*> types;
-  std::vector<DexString*> strings;
-  gather_refs(cls, method_refs, field_refs, types, strings);
+  ClassRefs storage;
+  const auto& class_refs = get_refs(cls, &storage);
 
   auto& refs = class_info.refs;
-  refs.reserve(method_refs.size() + field_refs.size() + types.size() +
-               strings.size());
+  refs.reserve(class_refs.method_refs.size() + class_refs.field_refs.size() +
+               class_refs.types.size() + class_refs.strings.size());
   uint64_t& refs_weight = class_info.refs_weight;
   uint64_t& seed_weight = class_info.seed_weight;
 
-  auto add_weight = [& ref_counts = m_ref_counts,
+  auto add_weight = [& ref_indices = m_ref_indices,
+                     &ref_infos = m_ref_infos,
                      max_ref_count = m_max_ref_count, &refs, &refs_weight,
-                     &seed_weight](void* ref, size_t item_weight,
+                     &seed_weight](const void* ref, size_t item_weight,
                                    size_t item_seed_weight) {
-    auto it = ref_counts.find(ref);
-    auto ref_count = it == ref_counts.end() ? 1 : it->second;
+    auto it = ref_indices.find(ref);
+    auto ref_count = it == ref_indices.end() ? 1 : ref_infos[it->second].count;
     double frequency = ref_count * 1.0 / max_ref_count;
     // We skip reference that...
     // - only ever appear once (those won't help with prioritization), and
@@ -196,7 +237,7 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
     TRACE(IDEX, 6, "[dex ordering] %zu/%zu = %lf %s", ref_count, max_ref_count,
           frequency, skipping ? "(skipping)" : "");
     if (!skipping) {
-      refs.emplace_back(ref, item_weight);
+      refs.push_back({it->second, static_cast<uint32_t>(item_weight), 0});
       refs_weight += item_weight;
       seed_weight += item_seed_weight;
     }
@@ -207,33 +248,32 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
   // different values and observing the effect on APK size.
   // We discount references that occur in many classes.
   // TODO: Try some other variations.
-  for (auto mref : method_refs) {
+  for (auto mref : class_refs.method_refs) {
     add_weight(mref, m_config.method_ref_weight, m_config.method_seed_weight);
   }
-  for (auto type : types) {
+  for (auto type : class_refs.types) {
     add_weight(type, m_config.type_ref_weight, m_config.type_seed_weight);
   }
-  for (auto string : strings) {
+  for (auto string : class_refs.strings) {
     add_weight(string, m_config.string_ref_weight, m_config.string_seed_weight);
   }
-  for (auto fref : field_refs) {
+  for (auto fref : class_refs.field_refs) {
     add_weight(fref, m_config.field_ref_weight, m_config.field_seed_weight);
   }
+  m_class_refs.erase(cls);
 
-  std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>
-      affected_classes;
-  for (const std::pair<void*, uint32_t>& p : refs) {
-    void* ref = p.first;
-    uint32_t weight = p.second;
-    auto& classes = m_ref_classes[ref];
+  for (uint32_t slot = 0; slot < refs.size(); ++slot) {
+    auto& class_ref = refs[slot];
+    uint32_t weight = class_ref.weight;
+    auto& classes = m_ref_infos[class_ref.ref].classes;
     size_t frequency = classes.size();
     // We record the need to undo (subtract weight of) a previously claimed
     // infrequent ref. The actual undoing happens later in
     // reprioritize.
     if (frequency > 0 && frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        always_assert(affected_class != cls);
-        affected_classes[affected_class]
+      for (const auto& affected_class : classes) {
+        always_assert(affected_class.first != index);
+        get_delta(affected_class.first)
             .infrequent_refs_weight[frequency - 1] -= weight;
       }
     }
@@ -244,27 +284,28 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
     // class_info.get_priority() call, while all other change requests happen
     // later in reprioritize.
     if (frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
+      for (const auto& affected_class : classes) {
+        get_delta(affected_class.first)
             .infrequent_refs_weight[frequency - 1] += weight;
       }
       class_info.infrequent_refs_weight[frequency - 1] += weight;
     }
 
-    // There's an implicit invariant that class_info and the keys of
-    // affected_classes are disjoint, so we are not going to reprioritize
-    // the class that we are adding here.
-    classes.emplace(cls);
+    // There's an implicit invariant that class_info and the affected classes
+    // are disjoint, so we are not going to reprioritize the class that we are
+    // adding here.
+    class_ref.position = classes.size();
+    classes.emplace_back(index, slot);
   }
   const auto priority = class_info.get_priority();
-  m_prioritized_classes.insert(cls, priority);
+  m_prioritized_classes.insert(index, priority);
   TRACE(IDEX, 4,
         "[dex ordering] Inserting class {%s} with priority %016lx; index %u; "
         "%s infrequent refs weights, %u total refs",
         SHOW(cls), priority, class_info.index,
         format_infrequent_refs_array(class_info.infrequent_refs_weight).c_str(),
         refs.size());
-  reprioritize(affected_classes);
+  reprioritize();
 }
 
 bool CrossDexRefMinimizer::empty() const {
@@ -272,53 +313,48 @@ bool CrossDexRefMinimizer::empty() const {
 }
 
 DexClass* CrossDexRefMinimizer::front() const {
-  return m_prioritized_classes.front();
+  return m_class_infos[m_prioritized_classes.front()].cls;
 }
 
 DexClass* CrossDexRefMinimizer::worst(bool generated) {
-  auto max_it = m_class_infos.end();
+  const CrossDexRefMinimizer::ClassInfo* max_class_info = nullptr;
   uint64_t max_value = 0;
 
-  for (auto it = m_class_infos.begin(); it != m_class_infos.end(); ++it) {
+  // The classes are visited by increasing index, so on ties, we keep the class
+  // that was inserted earlier to make things deterministic.
+  for (const auto& class_info : m_class_infos) {
     // If requested, let's skip generated classes, as they tend to be not stable
     // and may cause drastic build-over-build changes.
-    if (it->first->rstate.is_generated() != generated) {
+    if (class_info.erased ||
+        class_info.cls->rstate.is_generated() != generated) {
       continue;
     }
 
-    const CrossDexRefMinimizer::ClassInfo& class_info = it->second;
     uint64_t value = class_info.seed_weight;
 
     // Prefer the largest denominator
-    if (value < max_value) {
+    if (max_class_info != nullptr && value <= max_value) {
       continue;
     }
 
-    // If equal, prefer the class that was inserted earlier (smaller index) to
-    // make things deterministic.
-    if (value == max_value && max_it != m_class_infos.end() &&
-        class_info.index > max_it->second.index) {
-      continue;
-    }
-
-    max_it = it;
+    max_class_info = &class_info;
     max_value = value;
   }
 
-  if (max_it == m_class_infos.end()) {
+  if (max_class_info == nullptr) {
     return nullptr;
   }
 
   TRACE(IDEX, 3,
         "[dex ordering] Picked worst class {%s} with seed %u; "
         "index %u",
-        SHOW(max_it->first), max_value, max_it->second.index);
-  m_stats.worst_classes.emplace_back(max_it->first, max_value);
-  return max_it->first;
+        SHOW(max_class_info->cls), max_value, max_class_info->index);
+  m_stats.worst_classes.emplace_back(max_class_info->cls, max_value);
+  return max_class_info->cls;
 }
 
 DexClass* CrossDexRefMinimizer::worst() {
-  always_assert(!m_class_infos.empty());
+  always_assert(!m_prioritized_classes.empty());
   // We prefer to find a class that is not generated. Only when such a class
   // doesn't exist (because all classes are generated), then we pick the worst
   // generated class.
@@ -331,10 +367,12 @@ DexClass* CrossDexRefMinimizer::worst() {
 }
 
 void CrossDexRefMinimizer::erase(DexClass* cls, bool emitted, bool reset) {
-  m_prioritized_classes.erase(cls);
-  auto class_info_it = m_class_infos.find(cls);
-  always_assert(class_info_it != m_class_infos.end());
-  const CrossDexRefMinimizer::ClassInfo& class_info = class_info_it->second;
+  auto class_index_it = m_class_indices.find(cls);
+  always_assert(class_index_it != m_class_indices.end());
+  ClassIndex index = class_index_it->second;
+  m_prioritized_classes.erase(index);
+  CrossDexRefMinimizer::ClassInfo& class_info = m_class_infos[index];
+  always_assert(!class_info.erased);
   TRACE(IDEX, 3,
         "[dex ordering] Processing class {%s} with priority %016lx; "
         "index %u; %u applied refs weight, %s infrequent refs weights, %u "
@@ -344,37 +382,39 @@ void CrossDexRefMinimizer::erase(DexClass* cls, bool emitted, bool reset) {
         format_infrequent_refs_array(class_info.infrequent_refs_weight).c_str(),
         class_info.refs.size(), emitted);
 
-  // Updating m_applied_refs and m_ref_classes,
+  // Updating the applied refs and the classes of each ref,
   // and gathering information on how this affects other classes
 
   if (reset) {
     TRACE(IDEX, 3, "[dex ordering] Reset");
     ++m_stats.resets;
-    m_applied_refs.clear();
+    ++m_epoch;
+    m_applied_refs = 0;
   }
 
-  std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>
-      affected_classes;
-  const auto& refs = class_info.refs;
-  size_t old_applied_refs = m_applied_refs.size();
-  for (const std::pair<void*, uint32_t>& p : refs) {
-    void* ref = p.first;
-    uint32_t weight = p.second;
-    auto& classes = m_ref_classes.at(ref);
+  size_t old_applied_refs = m_applied_refs;
+  for (const auto& class_ref : class_info.refs) {
+    uint32_t weight = class_ref.weight;
+    auto& ref_info = m_ref_infos[class_ref.ref];
+    auto& classes = ref_info.classes;
     size_t frequency = classes.size();
     always_assert(frequency > 0);
-    const auto erased = classes.erase(cls);
-    always_assert(erased);
+    always_assert(classes[class_ref.position].first == index);
+    // Swap the last class of the ref into the position of this class.
+    const auto& last = classes.back();
+    m_class_infos[last.first].refs[last.second].position = class_ref.position;
+    classes[class_ref.position] = last;
+    classes.pop_back();
     if (frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
+      for (const auto& affected_class : classes) {
+        get_delta(affected_class.first)
             .infrequent_refs_weight[frequency - 1] -= weight;
       }
     }
     --frequency;
     if (frequency > 0 && frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
+      for (const auto& affected_class : classes) {
+        get_delta(affected_class.first)
             .infrequent_refs_weight[frequency - 1] += weight;
       }
     }
@@ -382,36 +422,40 @@ void CrossDexRefMinimizer::erase(DexClass* cls, bool emitted, bool reset) {
     if (!emitted) {
       continue;
     }
-    if (m_applied_refs.count(ref) != 0) {
+    if (ref_info.applied_epoch == m_epoch) {
       continue;
     }
-    m_applied_refs.emplace(ref);
-    for (DexClass* affected_class : classes) {
-      affected_classes[affected_class].applied_refs_weight += weight;
+    ref_info.applied_epoch = m_epoch;
+    ++m_applied_refs;
+    for (const auto& affected_class : classes) {
+      get_delta(affected_class.first).applied_refs_weight += weight;
     }
   }
 
-  // Updating m_class_infos and m_prioritized_classes
+  // Updating the class infos and m_prioritized_classes
 
-  m_class_infos.erase(class_info_it);
-  always_assert(m_class_infos.count(cls) == 0);
+  class_info.erased = true;
+  class_info.refs = std::vector<ClassRef>();
+  m_class_indices.erase(class_index_it);
+  always_assert(!m_deltas[index].affected);
 
   if (reset) {
     m_prioritized_classes.clear();
-    for (auto it = m_class_infos.begin(); it != m_class_infos.end(); ++it) {
-      DexClass* reset_class = it->first;
-      CrossDexRefMinimizer::ClassInfo& reset_class_info = it->second;
+    for (auto& reset_class_info : m_class_infos) {
+      if (reset_class_info.erased) {
+        continue;
+      }
       reset_class_info.applied_refs_weight = 0;
       const auto priority = reset_class_info.get_priority();
-      m_prioritized_classes.insert(reset_class, priority);
+      m_prioritized_classes.insert(reset_class_info.index, priority);
       always_assert(reset_class_info.applied_refs_weight == 0);
     }
   }
   if (emitted) {
     TRACE(IDEX, 4, "[dex ordering] %u + %u = %u applied refs", old_applied_refs,
-          m_applied_refs.size() - old_applied_refs, m_applied_refs.size());
+          m_applied_refs - old_applied_refs, m_applied_refs);
   }
-  reprioritize(affected_classes);
+  reprioritize();
 }
 
 } // namespace interdex
@@ -26,7 +26,6 @@ namespace interdex {
 // minimization, but also causes it to use more memory and run slower.
 constexpr uint64_t INFREQUENT_REFS_COUNT = 6;
 
-using PrioritizedDexClasses = MutablePriorityQueue<DexClass*, uint64_t>;
 struct CrossDexRefMinimizerStats {
   uint64_t classes{0};
   uint64_t resets{0};
@@ -77,52 +76,96 @@ struct CrossDexRefMinimizerConfig {
 // overflows. In any case, all of this flows into a heuristic, so it wouldn't
 // be the end of the world if an overflow ever happens.
 class CrossDexRefMinimizer {
-  PrioritizedDexClasses m_prioritized_classes;
-  std::unordered_set<void*> m_applied_refs;
+  // Classes are identified by the order in which they were inserted, and refs
+  // by the order in which they were first sampled, so that the bookkeeping of
+  // the greedy loop is done on dense arrays rather than hash maps.
+  using ClassIndex = uint32_t;
+  using RefIndex = uint32_t;
+
+  MutablePriorityQueue<ClassIndex, uint64_t> m_prioritized_classes;
+  struct ClassRef {
+    RefIndex ref;
+    uint32_t weight;
+    // The position of this class in RefInfo::classes of the ref.
+    uint32_t position;
+  };
   struct ClassInfo {
-    uint32_t index;
+    DexClass* cls;
+    ClassIndex index;
     // This array stores (the weights of) how many of the *refs of this class
     // have only one, two, ... classes left that reference them.
     std::array<uint32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight;
-    std::vector<std::pair<void*, uint32_t>> refs;
+    std::vector<ClassRef> refs;
     uint64_t refs_weight;
     uint64_t applied_refs_weight;
     uint64_t seed_weight{0};
-    ClassInfo(uint32_t i)
-        : index(i),
+    bool erased{false};
+    ClassInfo(DexClass* c, ClassIndex i)
+        : cls(c),
+          index(i),
           infrequent_refs_weight(),
           refs_weight(0),
           applied_refs_weight(0) {}
     uint64_t get_primary_priority_denominator() const;
     uint64_t get_priority() const;
   };
-  std::unordered_map<DexClass*, ClassInfo> m_class_infos;
-  uint32_t m_next_index{0};
-  std::unordered_map<void*, std::unordered_set<DexClass*>> m_ref_classes;
+  std::vector<ClassInfo> m_class_infos;
+  std::unordered_map<const DexClass*, ClassIndex> m_class_indices;
+
+  struct RefInfo {
+    // The number of sampled classes that have this ref.
+    size_t count{0};
+    // The remaining classes that have this ref, along with the index of the
+    // ref in ClassInfo::refs of each class.
+    std::vector<std::pair<ClassIndex, uint32_t>> classes;
+    // The ref has been applied to the current dex iff this is m_epoch.
+    uint32_t applied_epoch{0};
+  };
+  std::unordered_map<const void*, RefIndex> m_ref_indices;
+  std::vector<RefInfo> m_ref_infos;
+  // Incremented whenever a new dex is started, which unapplies all refs.
+  uint32_t m_epoch{1};
+  size_t m_applied_refs{0};
+  size_t m_max_ref_count{0};
   CrossDexRefMinimizerStats m_stats;
   const CrossDexRefMinimizerConfig m_config;
 
   struct ClassInfoDelta {
     std::array<int32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight{};
     int64_t applied_refs_weight{0};
+    bool affected{false};
   };
+  // The pending deltas, indexed like m_class_infos, and the classes that
+  // have one.
+  std::vector<ClassInfoDelta> m_deltas;
+  std::vector<ClassIndex> m_affected_classes;
 
-  void reprioritize(
-      const std::unordered_map<DexClass*, ClassInfoDelta>& affected_classes);
+  ClassInfoDelta& get_delta(ClassIndex index);
+  // Applies all pending deltas at once.
+  void reprioritize();
   DexClass* worst(bool generated);
 
-  std::unordered_map<void*, size_t> m_ref_counts;
-  size_t m_max_ref_count{0};
+  struct ClassRefs {
+    std::vector<DexMethodRef*> method_refs;
+    std::vector<DexFieldRef*> field_refs;
+    std::vector<DexType*> types;
+    std::vector<DexString*> strings;
+  };
+  // The refs of the classes that were passed to precompute_refs and not
+  // inserted yet.
+  std::unordered_map<const DexClass*, ClassRefs> m_class_refs;
+
+  static void gather_refs(DexClass* cls, ClassRefs* class_refs);
+  const ClassRefs& get_refs(DexClass* cls, ClassRefs* storage) const;
 
-  void gather_refs(DexClass* cls,
-                   std::vector<DexMethodRef*>& method_refs,
-                   std::vector<DexFieldRef*>& field_refs,
-                   std::vector<DexType*>& types,
-                   std::vector<DexString*>& strings);
+  RefInfo& get_ref_info(const void* ref);
 
  public:
   CrossDexRefMinimizer(const CrossDexRefMinimizerConfig& config)
       : m_config(config) {}
+  // Gathers the refs of the given classes in parallel, ahead of the calls to
+  // sample and insert for those classes.
+  void precompute_refs(const std::vector<DexClass*>& classes);
   // Gather frequency counts; must be called for relevant classes before
   // inserting them
   void sample(DexClass* cls);
@@ -25,6 +25,7 @@
 #include "InterDexPassPlugin.h"
 #include "ReachableClasses.h"
 #include "StringUtil.h"
+#include "Timer.h"
 #include "Walkers.h"
 #include "file-utils.h"
 
@@ -304,6 +305,7 @@ void InterDex::emit_primary_dex(
     const DexClasses& primary_dex,
     const std::vector<DexType*>& interdex_types,
     const std::unordered_set<DexClass*>& unreferenced_cls) {
+  ScopedTraceEvent trace_event("InterDex::emit_primary_dex");
 
   std::unordered_set<DexClass*> primary_dex_set(primary_dex.begin(),
                                                 primary_dex.end());
@@ -364,6 +366,7 @@ void InterDex::emit_interdex_classes(
     DexInfo& dex_info,
     const std::vector<DexType*>& interdex_types,
     const std::unordered_set<DexClass*>& unreferenced_classes) {
+  ScopedTraceEvent trace_event("InterDex::emit_interdex_classes");
   if (interdex_types.size() == 0) {
     TRACE(IDEX, 2, "No interdex classes passed.");
     return;
@@ -503,6 +506,7 @@ std::vector<std::vector<DexType*>> get_extra_classes_per_interdex_group(
 } // namespace
 
 std::vector<DexType*> InterDex::get_interdex_types(const Scope& scope) {
+  ScopedTraceEvent trace_event("InterDex::get_interdex_types");
   const std::vector<std::string>& interdexorder =
       m_conf.get_coldstart_classes();
 
@@ -595,6 +599,7 @@ void InterDex::update_interdexorder(const DexClasses& dex,
 
 void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
     const Scope& scope) {
+  ScopedTraceEvent trace_event("InterDex::init_cross_dex_ref_minimizer");
   TRACE(IDEX, 2,
         "[dex ordering] Cross-dex-ref-minimizer active with method ref weight "
         "%d, field ref weight %d, type ref weight %d, string ref weight %d, "
@@ -670,6 +675,7 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
   }
 
   // Initialize ref frequency counts
+  m_cross_dex_ref_minimizer.precompute_refs(classes_to_insert);
   for (DexClass* cls : classes_to_insert) {
     m_cross_dex_ref_minimizer.sample(cls);
   }
@@ -682,6 +688,7 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
 }
 
 void InterDex::emit_remaining_classes(DexInfo& dex_info, const Scope& scope) {
+  ScopedTraceEvent trace_event("InterDex::emit_remaining_classes");
   if (!m_minimize_cross_dex_refs) {
     for (DexClass* cls : scope) {
       emit_class(dex_info, cls, /* check_if_skip */ true,
@@ -888,6 +895,7 @@ void InterDex::add_dexes_from_store(const DexStore& store) {
  * This needs to be called before getting to the next dex.
  */
 void InterDex::flush_out_dex(DexInfo& dex_info) {
+  ScopedTraceEvent trace_event("InterDex::flush_out_dex");
 
   int dexnum = m_dexes_structure.get_num_dexes();
   if (dex_info.primary) {
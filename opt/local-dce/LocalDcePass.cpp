@@ -32,6 +32,7 @@ namespace {
 constexpr const char* METRIC_DEAD_INSTRUCTIONS = "num_dead_instructions";
 constexpr const char* METRIC_UNREACHABLE_INSTRUCTIONS =
     "num_unreachable_instructions";
+constexpr const char* METRIC_UNMODIFIED_METHODS = "num_unmodified_methods";
 constexpr const char* METRIC_COMPUTED_NO_SIDE_EFFECTS_METHODS =
     "num_computed_no_side_effects_methods";
 constexpr const char* METRIC_COMPUTED_NO_SIDE_EFFECTS_METHODS_ITERATIONS =
@@ -40,8 +41,9 @@ constexpr const char* METRIC_COMPUTED_NO_SIDE_EFFECTS_METHODS_ITERATIONS =
 ConcurrentSet<DexMethod*> get_no_implementor_abstract_methods(
     const Scope& scope) {
   ConcurrentSet<DexMethod*> method_set;
-  ClassScopes cs(scope);
-  TypeSystem ts(scope);
+  auto type_system = g_redex->get_type_system(scope);
+  const auto& ts = *type_system;
+  const auto& cs = ts.get_class_scopes();
   // Find non-interface abstract methods that have no implementation.
   walk::parallel::methods(scope, [&method_set, &cs](DexMethod* method) {
     DexClass* method_cls = type_class(method->get_class());
@@ -81,11 +83,23 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
                             ConfigFiles& conf,
                             PassManager& mgr) {
   auto scope = build_class_scope(stores);
+  // Before the purity analyses, which go through the code of all the methods.
+  std::unordered_set<const DexMethod*> unmodified_methods;
+  auto previous_epoch =
+      only_modified_methods ? mgr.get_previous_run_epoch() : boost::none;
+  if (previous_epoch) {
+    walk::methods(scope, [&](const DexMethod* m) {
+      auto code = m->get_code();
+      if (code != nullptr && code->modified_epoch() <= *previous_epoch) {
+        unmodified_methods.insert(m);
+      }
+    });
+  }
   auto pure_methods = find_pure_methods(scope);
-  auto configured_pure_methods = conf.get_pure_methods();
+  const auto& configured_pure_methods = conf.get_pure_methods();
   pure_methods.insert(configured_pure_methods.begin(),
                       configured_pure_methods.end());
-  auto override_graph = method_override_graph::build_graph(scope);
+  auto override_graph = mgr.get_analysis<method_override_graph::Graph>(stores);
   std::unordered_set<const DexMethod*> computed_no_side_effects_methods;
   auto computed_no_side_effects_methods_iterations =
       compute_no_side_effects_methods(scope, override_graph.get(), pure_methods,
@@ -100,6 +114,9 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
         if (code == nullptr || m->rstate.no_optimizations()) {
           return LocalDce::Stats();
         }
+        if (unmodified_methods.count(m)) {
+          return LocalDce::Stats();
+        }
 
         LocalDce ldce(pure_methods);
         ldce.dce(code);
@@ -108,6 +125,7 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_DEAD_INSTRUCTIONS, stats.dead_instruction_count);
   mgr.incr_metric(METRIC_UNREACHABLE_INSTRUCTIONS,
                   stats.unreachable_instruction_count);
+  mgr.incr_metric(METRIC_UNMODIFIED_METHODS, unmodified_methods.size());
   mgr.incr_metric(METRIC_COMPUTED_NO_SIDE_EFFECTS_METHODS,
                   computed_no_side_effects_methods.size());
   mgr.incr_metric(METRIC_COMPUTED_NO_SIDE_EFFECTS_METHODS_ITERATIONS,
@@ -117,6 +135,11 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
         stats.dead_instruction_count, stats.unreachable_instruction_count);
 }
 
+PreservedAnalyses LocalDcePass::get_preserved_analyses() const {
+  // Only instructions get removed.
+  return PreservedAnalyses::none().preserve<method_override_graph::Graph>();
+}
+
 std::unordered_set<DexMethodRef*> LocalDcePass::find_pure_methods(
     const Scope& scope) {
   auto pure_methods = get_pure_methods();
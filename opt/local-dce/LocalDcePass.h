@@ -15,14 +15,22 @@ class LocalDcePass : public Pass {
   LocalDcePass() : Pass("LocalDcePass") {}
 
   bool no_implementor_abstract_is_pure{false};
+  // Skip the methods that weren't modified since the previous run of the
+  // pass. Their dead code may still depend on the purity of their callees.
+  bool only_modified_methods{false};
 
   void bind_config() override {
     bind("no_implementor_abstract_is_pure",
          false,
          no_implementor_abstract_is_pure);
+    bind("only_modified_methods", false, only_modified_methods);
   }
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_cfg_friendly() const override { return true; }
+
+  PreservedAnalyses get_preserved_analyses() const override;
+
   std::unordered_set<DexMethodRef*> find_pure_methods(const Scope&);
 };
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * This pass hoists computations out of loops when they compute the same value
+ * in every iteration.
+ *
+ * For example:
+ *
+ *   L1: ARRAY_LENGTH v1
+ *       MOVE_RESULT_PSEUDO v2
+ *       IF_GE v0, v2, L2
+ *       CONST v3, 10
+ *       ...
+ *       GOTO L1
+ *   L2: ...
+ *
+ * becomes (if v2 and v3 aren't live into the loop)
+ *
+ *       ARRAY_LENGTH v1
+ *       MOVE_RESULT_PSEUDO v2
+ *       CONST v3, 10
+ *   L1: IF_GE v0, v2, L2
+ *       ...
+ *       GOTO L1
+ *   L2: ...
+ *
+ * which saves interpreting those instructions in every iteration.
+ */
+
+#include "LoopInvariantCodeMotion.h"
+
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRInstruction.h"
+#include "IROpcode.h"
+#include "Liveness.h"
+#include "LoopInfo.h"
+#include "MethodProfiles.h"
+#include "MethodUtil.h"
+#include "PassManager.h"
+#include "Purity.h"
+#include "Resolver.h"
+#include "Walkers.h"
+#include "WeakTopologicalOrdering.h"
+
+namespace {
+
+constexpr const char* METRIC_LOOPS = "num_loops";
+constexpr const char* METRIC_INSTRUCTIONS_HOISTED = "num_instructions_hoisted";
+constexpr const char* METRIC_THROWING_INSTRUCTIONS_HOISTED =
+    "num_throwing_instructions_hoisted";
+
+using loop_impl::Loop;
+using loop_impl::LoopInfo;
+
+// Instructions that compute their result only from their operands, can't
+// throw, and have no other side effects.
+bool is_pure_non_throwing(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  return insn->has_dest() && !opcode::may_throw(op) &&
+         !opcode::is_load_param(op) && !opcode::is_move_result_any(op) &&
+         op != OPCODE_MOVE_EXCEPTION;
+}
+
+// Instructions that may throw, but otherwise have no side effects, and that
+// always compute the same result from the same operands if they return.
+bool is_pure_throwing(const IRInstruction* insn,
+                      const std::unordered_set<DexMethodRef*>& pure_methods,
+                      bool hoist_final_field_reads) {
+  auto op = insn->opcode();
+  switch (op) {
+  case OPCODE_ARRAY_LENGTH:
+  case OPCODE_CONST_STRING:
+  case OPCODE_CONST_CLASS:
+    return true;
+  default:
+    break;
+  }
+  if (is_iget(op) || is_sget(op)) {
+    if (!hoist_final_field_reads) {
+      return false;
+    }
+    auto field = resolve_field(insn->get_field(), is_sget(op)
+                                                      ? FieldSearch::Static
+                                                      : FieldSearch::Instance);
+    return field != nullptr && is_final(field);
+  }
+  if (is_invoke(op)) {
+    auto method_ref = insn->get_method();
+    if (pure_methods.count(method_ref)) {
+      return true;
+    }
+    auto method = resolve_method(method_ref, opcode_to_search(insn));
+    return method != nullptr && pure_methods.count(method);
+  }
+  return false;
+}
+
+// LoopInfo redirects all edges that enter a loop header from outside of its
+// loop to a new preheader, throw edges included, which would separate a
+// move-exception from the catch edges. So we leave methods alone where a
+// catch handler starts a loop.
+bool has_catch_loop_header(cfg::ControlFlowGraph& cfg) {
+  auto wto = cfg.wto();
+  std::function<bool(const sparta::WtoComponent<cfg::Block*>&)> visit;
+  visit = [&visit](const sparta::WtoComponent<cfg::Block*>& comp) {
+    if (!comp.is_scc()) {
+      return false;
+    }
+    for (auto edge : comp.head_node()->preds()) {
+      if (edge->type() == cfg::EDGE_THROW) {
+        return true;
+      }
+    }
+    for (const auto& inner : comp) {
+      if (visit(inner)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  for (const auto& comp : *wto) {
+    if (visit(comp)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The blocks of a loop in order, including the preheaders of its inner loops,
+// where their invariant instructions have been hoisted to, just before their
+// headers.
+std::vector<cfg::Block*> get_loop_blocks(Loop* loop) {
+  std::unordered_map<cfg::Block*, cfg::Block*> preheaders;
+  std::function<void(Loop*)> gather_preheaders = [&](Loop* l) {
+    for (auto it = l->subloop_begin(); it != l->subloop_end(); ++it) {
+      preheaders.emplace((*it)->get_header(), (*it)->get_preheader());
+      gather_preheaders(*it);
+    }
+  };
+  gather_preheaders(loop);
+  std::vector<cfg::Block*> blocks;
+  for (auto block : *loop) {
+    auto it = preheaders.find(block);
+    if (it != preheaders.end()) {
+      blocks.push_back(it->second);
+    }
+    blocks.push_back(block);
+  }
+  return blocks;
+}
+
+struct HoistedInstruction {
+  cfg::Block* block;
+  IRInstruction* insn;
+  // The move-result(-pseudo) of an instruction that may throw
+  IRInstruction* move_result;
+};
+
+LoopInvariantCodeMotionPass::Stats process_loop(
+    cfg::ControlFlowGraph& cfg,
+    Loop* loop,
+    const std::unordered_set<DexMethodRef*>& pure_methods,
+    bool hoist_final_field_reads) {
+  LoopInvariantCodeMotionPass::Stats stats;
+  auto header = loop->get_header();
+  auto preheader = loop->get_preheader();
+  auto blocks = get_loop_blocks(loop);
+  std::unordered_set<cfg::Block*> block_set(blocks.begin(), blocks.end());
+
+  // Only the header may be entered from outside, through the preheader.
+  for (auto block : blocks) {
+    for (auto edge : block->preds()) {
+      if (!block_set.count(edge->src()) &&
+          (block != header || edge->src() != preheader)) {
+        TRACE(LOOP, 5, "[licm] giving up on irreducible loop at B%u",
+              header->id());
+        return stats;
+      }
+    }
+  }
+  stats.loops = 1;
+
+  std::unordered_map<reg_t, size_t> def_counts;
+  for (auto block : blocks) {
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      if (insn->has_dest()) {
+        def_counts[insn->dest()]++;
+        if (insn->dest_is_wide()) {
+          def_counts[insn->dest() + 1]++;
+        }
+      }
+    }
+  }
+
+  LivenessFixpointIterator liveness(cfg);
+  liveness.run(LivenessDomain());
+  auto live_into_header = liveness.get_live_in_vars_at(header);
+  LivenessDomain live_out_of_loop = LivenessDomain::bottom();
+  for (auto block : blocks) {
+    for (auto edge : block->succs()) {
+      if (!block_set.count(edge->target())) {
+        live_out_of_loop.join_with(
+            liveness.get_live_in_vars_at(edge->target()));
+      }
+    }
+  }
+  // Whether the header (and so every iteration) starts without anything
+  // that may throw to a handler.
+  bool header_may_throw =
+      !cfg.get_succ_edges_of_type(header, cfg::EDGE_THROW).empty();
+
+  std::unordered_set<reg_t> hoisted_dests;
+  std::unordered_set<const IRInstruction*> hoisted_insns;
+  std::vector<HoistedInstruction> hoisted;
+  const auto is_invariant = [&](reg_t reg) {
+    return def_counts.count(reg) == 0 || hoisted_dests.count(reg);
+  };
+  const auto can_hoist = [&](const IRInstruction* insn,
+                             const IRInstruction* dest_insn,
+                             bool in_header) {
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      auto src = insn->src(i);
+      if (!is_invariant(src) ||
+          (insn->src_is_wide(i) && !is_invariant(src + 1))) {
+        return false;
+      }
+    }
+    auto dest = dest_insn->dest();
+    auto width = dest_insn->dest_is_wide() ? 2 : 1;
+    for (reg_t reg = dest; reg < dest + width; ++reg) {
+      if (def_counts.at(reg) != 1 || live_into_header.contains(reg) ||
+          (!in_header && live_out_of_loop.contains(reg))) {
+        return false;
+      }
+    }
+    return true;
+  };
+  const auto hoist = [&](cfg::Block* block,
+                         IRInstruction* insn,
+                         IRInstruction* move_result) {
+    auto dest_insn = move_result ? move_result : insn;
+    hoisted_dests.insert(dest_insn->dest());
+    if (dest_insn->dest_is_wide()) {
+      hoisted_dests.insert(dest_insn->dest() + 1);
+    }
+    hoisted_insns.insert(insn);
+    if (move_result) {
+      hoisted_insns.insert(move_result);
+    }
+    hoisted.push_back({block, insn, move_result});
+  };
+
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto block : blocks) {
+      bool in_header = block == header && !header_may_throw;
+      // Whether everything so far in the header could be hoisted or doesn't
+      // matter, so that the next instruction is the first to run.
+      bool header_prefix = in_header;
+      auto ii = InstructionIterable(block);
+      for (auto it = ii.begin(); it != ii.end(); ++it) {
+        auto insn = it->insn;
+        if (hoisted_insns.count(insn)) {
+          continue;
+        }
+        if (is_pure_non_throwing(insn)) {
+          if (can_hoist(insn, insn, in_header)) {
+            hoist(block, insn, nullptr);
+            changed = true;
+          }
+          continue;
+        }
+        if (header_prefix &&
+            is_pure_throwing(insn, pure_methods, hoist_final_field_reads)) {
+          auto next = std::next(it);
+          if (next != ii.end() &&
+              opcode::is_move_result_any(next->insn->opcode()) &&
+              can_hoist(insn, next->insn, in_header)) {
+            hoist(block, insn, next->insn);
+            changed = true;
+            ++it;
+            continue;
+          }
+        }
+        header_prefix = false;
+      }
+    }
+  }
+
+  if (hoisted.empty()) {
+    return stats;
+  }
+
+  std::vector<IRInstruction*> new_insns;
+  for (auto& h : hoisted) {
+    new_insns.push_back(new IRInstruction(*h.insn));
+    if (h.move_result) {
+      new_insns.push_back(new IRInstruction(*h.move_result));
+      stats.throwing_instructions_hoisted++;
+    }
+    TRACE(LOOP, 4, "[licm] hoisting %s out of the loop at B%u", SHOW(h.insn),
+          header->id());
+  }
+  preheader->push_back(new_insns);
+  for (auto& h : hoisted) {
+    // Removes the move-result(-pseudo) as well
+    cfg.remove_insn(cfg.find_insn(h.insn, h.block));
+  }
+  stats.instructions_hoisted += hoisted.size();
+  return stats;
+}
+
+} // namespace
+
+LoopInvariantCodeMotionPass::Stats LoopInvariantCodeMotionPass::process_code(
+    IRCode* code,
+    const std::unordered_set<DexMethodRef*>& pure_methods,
+    bool hoist_final_field_reads) {
+  Stats stats;
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  if (!has_catch_loop_header(cfg)) {
+    LoopInfo loop_info(cfg);
+    cfg.calculate_exit_block();
+    // Inner loops come last; their invariant instructions may then be hoisted
+    // further out of their enclosing loops.
+    for (auto it = loop_info.rbegin(); it != loop_info.rend(); ++it) {
+      stats += process_loop(cfg, *it, pure_methods, hoist_final_field_reads);
+    }
+    if (loop_info.num_loops()) {
+      // Gets rid of the preheaders we didn't need
+      cfg.simplify();
+    }
+  }
+  code->clear_cfg();
+  return stats;
+}
+
+void LoopInvariantCodeMotionPass::bind_config() {
+  bind("all_methods", false, m_all_methods,
+       "Also look at the loops of methods that don't appear in the method "
+       "profiles. With no method profiles, all methods are looked at.");
+}
+
+void LoopInvariantCodeMotionPass::run_pass(DexStoresVector& stores,
+                                           ConfigFiles& conf,
+                                           PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  auto pure_methods = get_pure_methods();
+  const auto& method_profiles = conf.get_method_profiles();
+  bool only_profiled_methods = !m_all_methods && method_profiles.has_stats();
+  const auto& method_stats = method_profiles.method_stats();
+
+  Stats stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* method) {
+    const auto code = method->get_code();
+    if (!code || method->rstate.no_optimizations() ||
+        (only_profiled_methods && !method_stats.count(method))) {
+      return Stats{};
+    }
+    auto stats = process_code(code, pure_methods, !method::is_any_init(method));
+    if (stats.instructions_hoisted) {
+      TRACE(LOOP, 3, "[licm] Hoisted %u instructions out of %u loops in {%s}",
+            stats.instructions_hoisted, stats.loops, SHOW(method));
+    }
+    return stats;
+  });
+
+  mgr.incr_metric(METRIC_LOOPS, stats.loops);
+  mgr.incr_metric(METRIC_INSTRUCTIONS_HOISTED, stats.instructions_hoisted);
+  mgr.incr_metric(METRIC_THROWING_INSTRUCTIONS_HOISTED,
+                  stats.throwing_instructions_hoisted);
+  TRACE(LOOP, 1,
+        "[licm] Hoisted %u instructions (%u of which may throw) out of %u "
+        "loops in total",
+        stats.instructions_hoisted, stats.throwing_instructions_hoisted,
+        stats.loops);
+}
+
+static LoopInvariantCodeMotionPass s_pass;
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <unordered_set>
+
+#include "IRCode.h"
+#include "Pass.h"
+
+class LoopInvariantCodeMotionPass : public Pass {
+ public:
+  struct Stats {
+    size_t loops{0};
+    size_t instructions_hoisted{0};
+    size_t throwing_instructions_hoisted{0};
+
+    Stats& operator+=(const Stats& that) {
+      loops += that.loops;
+      instructions_hoisted += that.instructions_hoisted;
+      throwing_instructions_hoisted += that.throwing_instructions_hoisted;
+      return *this;
+    }
+  };
+
+  LoopInvariantCodeMotionPass() : Pass("LoopInvariantCodeMotionPass") {}
+
+  void bind_config() override;
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  /*
+   * Moves the computations of loops whose values are the same in every
+   * iteration into the loops' preheaders, innermost loops first.
+   *
+   * Instructions that can't throw and have no side effects are hoisted from
+   * anywhere in the loop. Instructions that may throw (array-length, const-
+   * string, const-class, reads of final fields, and invocations of pure
+   * methods) are only hoisted from the loop header, when nothing before them
+   * in the header can throw or have side effects and the header isn't in a
+   * try region; they then run exactly when they would have in the first
+   * iteration. Reads of final fields are only hoisted when
+   * `hoist_final_field_reads`, i.e. outside of constructors.
+   *
+   * Each hoisted instruction must be the only definition of its register in
+   * the loop, and that register must not be live into the loop header, nor,
+   * unless the instruction is in the header, live into the blocks the loop
+   * exits to.
+   */
+  static Stats process_code(
+      IRCode* code,
+      const std::unordered_set<DexMethodRef*>& pure_methods,
+      bool hoist_final_field_reads);
+
+ private:
+  bool m_all_methods;
+};
@@ -560,9 +560,7 @@ void update_after_merge(
     const std::unordered_map<const DexType*, DexType*>& intf_merge_map,
     const std::unordered_map<DexMethodRef*, DexMethodRef*>& old_to_new_method,
     const ClassHierarchy& ch) {
-  type_reference::update_method_signature_type_references(scope, intf_merge_map,
-                                                          ch);
-  type_reference::update_field_type_references(scope, intf_merge_map);
+  type_reference::update_type_references(scope, intf_merge_map, ch);
   update_reference_for_code(scope, intf_merge_map, old_to_new_method);
   remove_implements(scope, intf_merge_map);
 }
@@ -18,8 +18,8 @@ void PerfMethodInlinePass::run_pass(DexStoresVector& stores,
           "Skipping PerfMethodInlinePass because Instrumentation is enabled");
     return;
   }
-  inliner::run_inliner(
-      stores, mgr, conf, /* intra_dex */ true, /* use_method_profiles */ true);
+  inliner::run_inliner(stores, mgr, conf, /* intra_dex */ true,
+                       /* use_method_profiles */ true, m_interaction);
 }
 
 static PerfMethodInlinePass s_pass;
@@ -8,11 +8,20 @@
 #pragma once
 
 #include "DexClass.h"
+#include "MethodProfiles.h"
 #include "Pass.h"
 
 class PerfMethodInlinePass : public Pass {
  public:
   PerfMethodInlinePass() : Pass("PerfMethodInlinePass") {}
 
+  void bind_config() override {
+    bind("interaction", method_profiles::COLD_START, m_interaction,
+         "The profiled interaction whose hot methods are inlined into.");
+  }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  std::string m_interaction;
 };
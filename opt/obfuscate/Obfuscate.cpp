@@ -6,8 +6,11 @@
  */
 
 #include <list>
+#include <memory>
+#include <mutex>
 
 #include "ClassHierarchy.h"
+#include "ConfigFiles.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -19,6 +22,7 @@
 #include "Trace.h"
 #include "VirtualRenamer.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -95,9 +99,12 @@ DexMember* find_renamable_ref(
 void update_refs(Scope& scope,
                  DexFieldManager& field_name_mapping,
                  DexMethodManager& method_name_mapping) {
-  std::unordered_map<DexFieldRef*, DexField*> f_ref_def_cache;
-  std::unordered_map<DexMethodRef*, DexMethod*> m_ref_def_cache;
-  walk::opcodes(scope, [&](DexMethod*, IRInstruction* instr) {
+  // Only looks up the managers, so each worker keeps its own caches
+  WorkerLocal<std::unordered_map<DexFieldRef*, DexField*>> f_ref_def_caches;
+  WorkerLocal<std::unordered_map<DexMethodRef*, DexMethod*>> m_ref_def_caches;
+  walk::parallel::opcodes(scope, [&](DexMethod*, IRInstruction* instr) {
+    auto& f_ref_def_cache = f_ref_def_caches.get();
+    auto& m_ref_def_cache = m_ref_def_caches.get();
     auto op = instr->opcode();
     if (instr->has_field()) {
       DexFieldRef* field_ref = instr->get_field();
@@ -128,6 +135,106 @@ void update_refs(Scope& scope,
   });
 }
 
+struct ReferenceWeights {
+  MemberWeights<DexField*> fields;
+  MemberWeights<DexMethod*> methods;
+};
+
+/**
+ * Counts the references to each field and method def from the code, counting
+ * each reference as often as the method making it is called when there are
+ * method profiles (plus one, so that references from cold code still count).
+ * Method refs resolve to the def they would invoke; for virtual methods, the
+ * weights of all methods of a scope are added up by the renamer.
+ */
+ReferenceWeights get_reference_weights(
+    Scope& scope, const method_profiles::MethodProfiles* method_profiles) {
+  ReferenceWeights weights;
+  const std::unordered_map<const DexMethodRef*, method_profiles::Stats>*
+      method_stats = nullptr;
+  if (method_profiles != nullptr && method_profiles->has_stats()) {
+    method_stats = &method_profiles->method_stats();
+  }
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    uint64_t weight = 1;
+    if (method_stats != nullptr) {
+      auto it = method_stats->find(method);
+      if (it != method_stats->end()) {
+        weight += static_cast<uint64_t>(it->second.call_count);
+      }
+    }
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (insn->has_field()) {
+        auto field = resolve_field(insn->get_field());
+        if (field != nullptr) {
+          weights.fields[field] += weight;
+        }
+      } else if (insn->has_method()) {
+        auto callee =
+            resolve_method(insn->get_method(), opcode_to_search(insn));
+        if (callee != nullptr) {
+          weights.methods[callee] += weight;
+        }
+      }
+    }
+  });
+  return weights;
+}
+
+/**
+ * Choosing names for the members of a class looks at the members of its
+ * superclasses and subclasses, but nothing else, so the classes below
+ * different roots (the classes whose superclass isn't in the scope) can be
+ * renamed independently. Returns the classes below each root, in scope order.
+ */
+std::vector<std::vector<DexClass*>> get_hierarchies(const Scope& scope) {
+  std::vector<std::vector<DexClass*>> hierarchies;
+  std::unordered_map<const DexClass*, size_t> root_indices;
+  for (auto cls : scope) {
+    const DexClass* root = cls;
+    auto super_cls = type_class(root->get_super_class());
+    while (super_cls != nullptr && !super_cls->is_external()) {
+      root = super_cls;
+      super_cls = type_class(root->get_super_class());
+    }
+    auto it = root_indices.emplace(root, hierarchies.size()).first;
+    if (it->second == hierarchies.size()) {
+      hierarchies.emplace_back();
+    }
+    hierarchies[it->second].push_back(cls);
+  }
+  return hierarchies;
+}
+
+/**
+ * Creates the wrappers of all the members that renaming may look at, i.e. of
+ * the classes of the scope and their superclasses, so that the managers are
+ * only read while the hierarchies are renamed in parallel.
+ */
+void create_wrappers(const Scope& scope,
+                     DexFieldManager& field_name_manager,
+                     DexMethodManager& method_name_manager) {
+  std::unordered_set<const DexClass*> visited;
+  for (const DexClass* cls : scope) {
+    for (auto c = cls; c != nullptr && visited.insert(c).second;
+         c = type_class(c->get_super_class())) {
+      for (auto f : c->get_ifields()) {
+        field_name_manager[f];
+      }
+      for (auto f : c->get_sfields()) {
+        field_name_manager[f];
+      }
+      for (auto m : c->get_dmethods()) {
+        method_name_manager[m];
+      }
+      for (auto m : c->get_vmethods()) {
+        method_name_manager[m];
+      }
+    }
+  }
+}
+
 void get_totals(Scope& scope, RenameStats& stats) {
   for (const auto& cls : scope) {
     stats.fields_total += cls->get_ifields().size();
@@ -141,15 +248,26 @@ void get_totals(Scope& scope, RenameStats& stats) {
 
 void obfuscate(Scope& scope,
                RenameStats& stats,
-               bool avoid_colliding_debug_name) {
+               const ObfuscatePass::Config& config,
+               const method_profiles::MethodProfiles* method_profiles) {
   get_totals(scope, stats);
   ClassHierarchy ch = build_type_hierarchy(scope);
 
+  std::unique_ptr<ReferenceWeights> weights;
+  if (config.order_names_by_references) {
+    weights = std::make_unique<ReferenceWeights>(
+        get_reference_weights(scope, method_profiles));
+  }
+
   DexFieldManager field_name_manager = new_dex_field_manager();
   DexMethodManager method_name_manager = new_dex_method_manager();
 
+  create_wrappers(scope, field_name_manager, method_name_manager);
+  auto hierarchies = get_hierarchies(scope);
+
+  std::mutex next_dmethod_seeds_mutex;
   std::unordered_map<const DexClass*, int> next_dmethod_seeds;
-  for (DexClass* cls : scope) {
+  auto obfuscate_class = [&](DexClass* cls) {
     always_assert_log(!cls->is_external(),
                       "Shouldn't rename members of external classes. %s",
                       SHOW(cls));
@@ -163,8 +281,9 @@ void obfuscate(Scope& scope,
         contains_renamable_elem(cls->get_dmethods(), method_name_manager);
     if (operate_on_ifields || operate_on_sfields) {
       FieldObfuscationState f_ob_state;
-      FieldNameGenerator field_name_generator(f_ob_state.ids_to_avoid,
-                                              f_ob_state.used_ids);
+      FieldNameGenerator field_name_generator(
+          f_ob_state.ids_to_avoid, f_ob_state.used_ids,
+          weights ? &weights->fields : nullptr);
 
       TRACE(OBFUSCATE, 3, "Renaming the fields of class %s",
             SHOW(cls->get_name()));
@@ -191,8 +310,9 @@ void obfuscate(Scope& scope,
     // =========== Obfuscate Methods Below ==========
     if (operate_on_dmethods) {
       MethodObfuscationState m_ob_state;
-      MethodNameGenerator direct_method_name_gen(m_ob_state.ids_to_avoid,
-                                                 m_ob_state.used_ids);
+      MethodNameGenerator direct_method_name_gen(
+          m_ob_state.ids_to_avoid, m_ob_state.used_ids,
+          weights ? &weights->methods : nullptr);
 
       TRACE(OBFUSCATE, 3, "Renaming the methods of class %s",
             SHOW(cls->get_name()));
@@ -206,10 +326,18 @@ void obfuscate(Scope& scope,
       direct_method_name_gen.bind_names();
       auto next_ctr = direct_method_name_gen.next_ctr();
       if (next_ctr) {
-        next_dmethod_seeds.emplace(cls, direct_method_name_gen.next_ctr());
+        std::lock_guard<std::mutex> lock(next_dmethod_seeds_mutex);
+        next_dmethod_seeds.emplace(cls, next_ctr);
       }
     }
-  }
+  };
+  // The classes of a hierarchy are still renamed in scope order, so the names
+  // are the same as when renaming all classes one after the other
+  redex_parallel::parallel_for(0, hierarchies.size(), [&](size_t i) {
+    for (auto cls : hierarchies[i]) {
+      obfuscate_class(cls);
+    }
+  });
   field_name_manager.print_elements();
   method_name_manager.print_elements();
 
@@ -226,8 +354,9 @@ void obfuscate(Scope& scope,
   stats.fields_renamed = field_name_manager.commit_renamings_to_dex();
   stats.dmethods_renamed = method_name_manager.commit_renamings_to_dex();
 
-  stats.vmethods_renamed =
-      rename_virtuals(scope, avoid_colliding_debug_name, next_dmethod_seeds);
+  stats.vmethods_renamed = rename_virtuals(
+      scope, config.avoid_colliding_debug_name, next_dmethod_seeds,
+      weights ? &weights->methods : nullptr);
 
   debug_logging(scope);
 
@@ -242,7 +371,7 @@ void obfuscate(Scope& scope,
 }
 
 void ObfuscatePass::run_pass(DexStoresVector& stores,
-                             ConfigFiles& /* conf */,
+                             ConfigFiles& conf,
                              PassManager& mgr) {
   if (mgr.no_proguard_rules()) {
     TRACE(OBFUSCATE, 1,
@@ -253,7 +382,11 @@ void ObfuscatePass::run_pass(DexStoresVector& stores,
   auto scope = build_class_scope(stores);
   RenameStats stats;
   auto debug_info_kind = mgr.get_redex_options().debug_info_kind;
-  obfuscate(scope, stats, is_iodi(debug_info_kind));
+  auto config = m_config;
+  config.avoid_colliding_debug_name = is_iodi(debug_info_kind);
+  obfuscate(scope, stats, config,
+            config.order_names_by_references ? &conf.get_method_profiles()
+                                             : nullptr);
   mgr.incr_metric(METRIC_FIELD_TOTAL, static_cast<int>(stats.fields_total));
   mgr.incr_metric(METRIC_FIELD_RENAMED, static_cast<int>(stats.fields_renamed));
   mgr.incr_metric(METRIC_DMETHODS_TOTAL,
@@ -7,16 +7,25 @@
 
 #pragma once
 
+#include "MethodProfiles.h"
 #include "PassManager.h"
 
 class ObfuscatePass : public Pass {
  public:
   ObfuscatePass() : Pass("ObfuscatePass") {}
 
+  void bind_config() override {
+    bind("order_names_by_references", false, m_config.order_names_by_references,
+         "Hand out the first names to the members that are referenced the "
+         "most, weighing each reference with the call count of the method "
+         "making it when there are method profiles.");
+  }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
   struct Config {
     bool avoid_colliding_debug_name{false};
+    bool order_names_by_references{false};
   };
 
  private:
@@ -32,6 +41,8 @@ struct RenameStats {
   size_t vmethods_renamed = 0;
 };
 
-void obfuscate(Scope& classes,
-               RenameStats& stats,
-               const ObfuscatePass::Config& config);
+void obfuscate(
+    Scope& classes,
+    RenameStats& stats,
+    const ObfuscatePass::Config& config,
+    const method_profiles::MethodProfiles* method_profiles = nullptr);
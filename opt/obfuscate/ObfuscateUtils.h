@@ -24,6 +24,11 @@ typedef std::unordered_map<std::string,
                            std::unordered_map<std::string, std::string>>
     NameMapping;
 
+// How often the code refers to each member, possibly weighted by profiles;
+// the most referenced members are handed the first identifiers.
+template <class T>
+using MemberWeights = std::unordered_map<T, uint64_t>;
+
 // Renames a field in the Dex
 void rename_field(DexField* field, const std::string& new_name);
 void rename_method(DexMethod* method, const std::string& new_name);
@@ -241,6 +246,7 @@ template <class T>
 class NameGenerator {
  protected:
   int ctr{0};
+  const MemberWeights<T>* weights{nullptr};
 
   // Set of ids to avoid (these ids were marked as do not rename and we cannot
   // conflict with)
@@ -259,10 +265,33 @@ class NameGenerator {
     return res;
   }
 
+  // When there are weights, the members are named in descending order of
+  // weight, keeping the order of `elems` among members of equal weight.
+  template <class Map>
+  std::vector<DexNameWrapper<T>*> naming_order(const Map& elems) const {
+    std::vector<DexNameWrapper<T>*> res;
+    res.reserve(elems.size());
+    for (const auto& p : elems) {
+      res.push_back(p.second);
+    }
+    if (weights != nullptr) {
+      auto weight = [this](DexNameWrapper<T>* wrap) -> uint64_t {
+        auto it = weights->find(wrap->get());
+        return it == weights->end() ? 0 : it->second;
+      };
+      std::stable_sort(res.begin(), res.end(),
+                       [&](DexNameWrapper<T>* a, DexNameWrapper<T>* b) {
+                         return weight(a) > weight(b);
+                       });
+    }
+    return res;
+  }
+
  public:
   NameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-                std::unordered_set<std::string>& used_ids)
-      : ids_to_avoid(ids_to_avoid), used_ids(used_ids) {}
+                std::unordered_set<std::string>& used_ids,
+                const MemberWeights<T>* weights = nullptr)
+      : weights(weights), ids_to_avoid(ids_to_avoid), used_ids(used_ids) {}
   virtual ~NameGenerator() = default;
 
   // We want to rename the DexField pointed to by this wrapper.
@@ -307,8 +336,9 @@ class MethodNameGenerator : public NameGenerator<DexMethod*> {
 
  public:
   MethodNameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-                      std::unordered_set<std::string>& used_ids)
-      : NameGenerator<DexMethod*>(ids_to_avoid, used_ids) {}
+                      std::unordered_set<std::string>& used_ids,
+                      const MemberWeights<DexMethod*>* weights = nullptr)
+      : NameGenerator<DexMethod*>(ids_to_avoid, used_ids, weights) {}
 
   void find_new_name(DexMethodWrapper* wrap) override {
     DexMethod* method = wrap->get();
@@ -316,8 +346,7 @@ class MethodNameGenerator : public NameGenerator<DexMethod*> {
   }
 
   void bind_names() override {
-    for (auto p : methods) {
-      auto wrap = p.second;
+    for (auto wrap : this->naming_order(methods)) {
       always_assert(!wrap->is_modified());
       do {
         std::string new_name(this->next_name());
@@ -448,8 +477,9 @@ class FieldNameGenerator : public NameGenerator<DexField*> {
 
  public:
   FieldNameGenerator(const std::unordered_set<std::string>& ids_to_avoid,
-                     std::unordered_set<std::string>& used_ids)
-      : NameGenerator<DexField*>(ids_to_avoid, used_ids) {}
+                     std::unordered_set<std::string>& used_ids,
+                     const MemberWeights<DexField*>* weights = nullptr)
+      : NameGenerator<DexField*>(ids_to_avoid, used_ids, weights) {}
 
   void find_new_name(DexFieldWrapper* wrap) override {
     DexField* field = wrap->get();
@@ -457,8 +487,7 @@ class FieldNameGenerator : public NameGenerator<DexField*> {
   }
 
   void bind_names() override {
-    for (auto p : fields) {
-      auto wrap = p.second;
+    for (auto wrap : this->naming_order(fields)) {
       always_assert(!wrap->is_modified());
       do {
         std::string new_name(this->next_name());
@@ -519,9 +548,23 @@ class DexElemManager {
   // void lock_elements() { mark_all_unrenamable = true; }
   // void unlock_elements() { mark_all_unrenamable = false; }
 
-  inline bool contains_elem(DexType* cls, K sig, DexString* name) {
-    return elements.count(cls) > 0 && elements[cls].count(sig) > 0 &&
-           elements[cls][sig].count(name) > 0;
+  // Returns the wrapper of the element, or nullptr if there is none. Only
+  // reads the map, so it may be called concurrently as long as no wrappers
+  // are being created.
+  inline DexNameWrapper<T>* find_elem(DexType* cls,
+                                      K sig,
+                                      DexString* name) const {
+    auto cls_it = elements.find(cls);
+    if (cls_it == elements.end()) return nullptr;
+    auto sig_it = cls_it->second.find(sig);
+    if (sig_it == cls_it->second.end()) return nullptr;
+    auto name_it = sig_it->second.find(name);
+    if (name_it == sig_it->second.end()) return nullptr;
+    return name_it->second.get();
+  }
+
+  inline bool contains_elem(DexType* cls, K sig, DexString* name) const {
+    return find_elem(cls, sig, name) != nullptr;
   }
 
   inline bool contains_elem(R elem) {
@@ -542,10 +585,9 @@ class DexElemManager {
   // Mirrors the map get operator, but ensures we create correct wrappers
   // if they don't exist
   inline DexNameWrapper<T>* operator[](T elem) {
-    return contains_elem(elem) ? elements[elem->get_class()]
-                                         [sig_getter_fn(elem)][elem->get_name()]
-                                             .get()
-                               : emplace(elem);
+    auto wrap =
+        find_elem(elem->get_class(), sig_getter_fn(elem), elem->get_name());
+    return wrap != nullptr ? wrap : emplace(elem);
   }
 
   // Commits all the renamings in elements to the dex by modifying the
@@ -593,11 +635,9 @@ class DexElemManager {
   // Returns the def for that class and ref if it exists, nullptr otherwise
   T find_def(R ref, DexType* cls) {
     if (cls == nullptr) return nullptr;
-    if (contains_elem(cls, sig_getter_fn(ref), ref->get_name())) {
-      DexNameWrapper<T>* wrap =
-          elements[cls][sig_getter_fn(ref)][ref->get_name()].get();
-      if (wrap->is_modified()) return wrap->get();
-    }
+    DexNameWrapper<T>* wrap =
+        find_elem(cls, sig_getter_fn(ref), ref->get_name());
+    if (wrap != nullptr && wrap->is_modified()) return wrap->get();
     return nullptr;
   }
 
@@ -125,12 +125,14 @@ struct VirtualRenamer {
       const RefsMap& def_refs,
       std::unordered_map<std::string, uint32_t>* elms,
       std::unordered_map<const DexType*, std::string>* cache,
-      const std::unordered_map<const DexClass*, int>& next_dmethod_seeds)
+      const std::unordered_map<const DexClass*, int>& next_dmethod_seeds,
+      const MemberWeights<DexMethod*>* weights)
       : class_scopes(class_scopes),
         def_refs(def_refs),
         stack_trace_elements(elms),
         external_name_cache(cache),
-        next_dmethod_seeds(next_dmethod_seeds) {}
+        next_dmethod_seeds(next_dmethod_seeds),
+        weights(weights) {}
 
   int rename_virtual_scopes(const DexType* type, int& seed);
   int rename_interface_scopes(int& seed);
@@ -150,6 +152,10 @@ struct VirtualRenamer {
   std::unordered_map<const DexType*, std::string>* external_name_cache;
   const std::unordered_map<const DexClass*, int>& next_dmethod_seeds;
   mutable std::unordered_map<const VirtualScope*, int> next_virtualscope_seeds;
+  // When not null, scopes that compete for the same names are named in
+  // descending order of the summed weights of their methods.
+  const MemberWeights<DexMethod*>* weights;
+  mutable std::unordered_map<const VirtualScope*, uint64_t> scope_weights;
 
  private:
   const std::string& get_prefix(const DexType* type) const {
@@ -177,6 +183,26 @@ struct VirtualRenamer {
     return seed;
   }
 
+  uint64_t get_weight(const DexMethod* meth) const {
+    auto it = weights->find(const_cast<DexMethod*>(meth));
+    return it == weights->end() ? 0 : it->second;
+  }
+
+  // All the methods of a scope get the same name, so they are weighed
+  // together
+  uint64_t get_scope_weight(const VirtualScope* scope) const {
+    auto it = scope_weights.find(scope);
+    if (it != scope_weights.end()) {
+      return it->second;
+    }
+    uint64_t weight = 0;
+    for (auto& m : scope->methods) {
+      weight += get_weight(m.first);
+    }
+    scope_weights.emplace(scope, weight);
+    return weight;
+  }
+
   void rename(DexMethodRef* meth, DexString* name);
   int rename_scope_ref(DexMethod* meth, DexString* name);
   int rename_scope(const VirtualScope* scope, DexString* name);
@@ -327,7 +353,7 @@ DexString* VirtualRenamer::get_unescaped_name(
 
 int VirtualRenamer::rename_interface_scopes(int& seed) {
   int renamed = 0;
-  class_scopes.walk_all_intf_scopes(
+  auto rename_intf_scopes =
       [&](const DexString* name,
           const DexProto* proto,
           const std::vector<const VirtualScope*>& scopes,
@@ -392,7 +418,50 @@ int VirtualRenamer::rename_interface_scopes(int& seed) {
           rename_scope_ref(intf_meth, new_name);
           renamed++;
         }
+      };
+  if (weights == nullptr) {
+    class_scopes.walk_all_intf_scopes(rename_intf_scopes);
+    return renamed;
+  }
+
+  // All interface scopes share the seed, so the heaviest ones go first
+  struct IntfScopes {
+    const DexString* name;
+    const DexProto* proto;
+    std::vector<const VirtualScope*> scopes;
+    TypeSet intfs;
+    uint64_t weight;
+  };
+  std::vector<IntfScopes> all_intf_scopes;
+  class_scopes.walk_all_intf_scopes(
+      [&](const DexString* name,
+          const DexProto* proto,
+          const std::vector<const VirtualScope*>& scopes,
+          const TypeSet& intfs) {
+        uint64_t weight = 0;
+        for (const auto& scope : scopes) {
+          weight += get_scope_weight(scope);
+        }
+        for (const auto& intf : intfs) {
+          auto intf_cls = type_class(intf);
+          if (intf_cls == nullptr) {
+            continue;
+          }
+          auto intf_meth = find_method(intf_cls, name, proto);
+          if (intf_meth != nullptr) {
+            weight += get_weight(intf_meth);
+          }
+        }
+        all_intf_scopes.push_back({name, proto, scopes, intfs, weight});
       });
+  std::stable_sort(all_intf_scopes.begin(), all_intf_scopes.end(),
+                   [](const IntfScopes& a, const IntfScopes& b) {
+                     return a.weight > b.weight;
+                   });
+  for (const auto& intf_scopes : all_intf_scopes) {
+    rename_intf_scopes(intf_scopes.name, intf_scopes.proto, intf_scopes.scopes,
+                       intf_scopes.intfs);
+  }
   return renamed;
 }
 
@@ -415,6 +484,14 @@ int VirtualRenamer::rename_virtual_scopes(const DexType* type, int& seed) {
                 if (a_seed != b_seed) {
                   return a_seed < b_seed;
                 }
+                // then the most referenced scopes...
+                if (weights != nullptr) {
+                  auto a_weight = get_scope_weight(a);
+                  auto b_weight = get_scope_weight(b);
+                  if (a_weight != b_weight) {
+                    return a_weight > b_weight;
+                  }
+                }
                 auto a_method = a->methods[0].first;
                 auto b_method = b->methods[0].first;
                 // then sort by scopes...
@@ -511,7 +588,8 @@ void collect_refs(Scope& scope, RefsMap& def_refs) {
 size_t rename_virtuals(
     Scope& classes,
     bool avoid_stack_trace_collision,
-    const std::unordered_map<const DexClass*, int>& next_dmethod_seeds) {
+    const std::unordered_map<const DexClass*, int>& next_dmethod_seeds,
+    const MemberWeights<DexMethod*>* weights) {
   // build a ClassScope a RefsMap and a VirtualRenamer
   ClassScopes class_scopes(classes);
   scope_info(class_scopes);
@@ -542,7 +620,8 @@ size_t rename_virtuals(
                     avoid_stack_trace_collision ? &stack_trace_elements
                                                 : nullptr,
                     avoid_stack_trace_collision ? &external_cache : nullptr,
-                    next_dmethod_seeds);
+                    next_dmethod_seeds,
+                    weights);
 
   // rename virtual only first
   const auto obj_t = type::java_lang_Object();
@@ -8,11 +8,14 @@
 #pragma once
 
 #include "Obfuscate.h"
+#include "ObfuscateUtils.h"
 
 // Renames virtual methods avoiding conflicts up the class hierarchy and
 // avoiding collisions of methods printed in a stack trace when
-// avoid_stack_trace_collision is true
+// avoid_stack_trace_collision is true. When there are weights, the most
+// referenced scopes get the first names.
 size_t rename_virtuals(
     Scope& scope,
     bool avoid_stack_trace_collision = false,
-    const std::unordered_map<const DexClass*, int>& next_dmethod_seeds = {});
+    const std::unordered_map<const DexClass*, int>& next_dmethod_seeds = {},
+    const MemberWeights<DexMethod*>* weights = nullptr);
@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ObjectLayout.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "ReachableClasses.h"
+#include "ReachingDefinitions.h"
+#include "Resolver.h"
+#include "Show.h"
+#include "Trace.h"
+#include "Walkers.h"
+
+namespace object_layout {
+
+namespace {
+
+constexpr const char* METRIC_NARROWED_FIELDS = "num_narrowed_fields";
+constexpr const char* METRIC_HOT_FIELDS = "num_hot_fields";
+constexpr const char* METRIC_RENAMED_FIELDS = "num_renamed_hot_fields";
+
+// The range of the values written to a field.
+struct Range {
+  int64_t min{std::numeric_limits<int64_t>::max()};
+  int64_t max{std::numeric_limits<int64_t>::min()};
+
+  void join_with(const Range& other) {
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+
+  bool within(int64_t lower, int64_t upper) const {
+    return lower <= min && max <= upper;
+  }
+};
+
+bool is_narrowing_candidate(DexField* field) {
+  auto type = field->get_type();
+  return !is_static(field) &&
+         (type == type::_int() || type == type::_short()) &&
+         can_rename(field) && can_delete(field);
+}
+
+// The range of the values that the instruction defines, when verifiers type
+// them as narrower than int too: other values, e.g. the results of arithmetic
+// on constants, are typed as int whatever their range, and iput-byte or
+// iput-short of them would not verify.
+boost::optional<Range> get_defined_range(const IRInstruction* insn) {
+  switch (insn->opcode()) {
+  case OPCODE_CONST:
+    return Range{insn->get_literal(), insn->get_literal()};
+  case OPCODE_INT_TO_BYTE:
+  case OPCODE_IGET_BYTE:
+    return Range{std::numeric_limits<int8_t>::min(),
+                 std::numeric_limits<int8_t>::max()};
+  case OPCODE_INT_TO_SHORT:
+  case OPCODE_IGET_SHORT:
+    return Range{std::numeric_limits<int16_t>::min(),
+                 std::numeric_limits<int16_t>::max()};
+  default:
+    return boost::none;
+  }
+}
+
+// The ranges of the values that the method writes to candidate fields; no
+// range for fields to which it writes values of unknown range.
+void analyze_writes(
+    IRCode& code,
+    std::unordered_map<DexField*, boost::optional<Range>>* ranges) {
+  code.build_cfg(/* editable */ false);
+  auto& cfg = code.cfg();
+  reaching_defs::MoveAwareFixpointIterator fp_iter(cfg);
+  fp_iter.run(reaching_defs::Environment());
+  for (auto block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      if (op == OPCODE_IPUT || op == OPCODE_IPUT_SHORT) {
+        auto field = resolve_field(insn->get_field(), FieldSearch::Instance);
+        if (field != nullptr && is_narrowing_candidate(field)) {
+          const auto& defs = env.get(insn->src(0));
+          boost::optional<Range> range;
+          if (!defs.is_top() && !defs.is_bottom()) {
+            range = Range();
+            for (auto def : defs.elements()) {
+              auto def_range = get_defined_range(def);
+              if (!def_range) {
+                range = boost::none;
+                break;
+              }
+              range->join_with(*def_range);
+            }
+          }
+          auto it = ranges->emplace(field, range).first;
+          if (!range) {
+            it->second = boost::none;
+          } else if (it->second) {
+            it->second->join_with(*range);
+          }
+        }
+      }
+      fp_iter.analyze_instruction(insn, &env);
+    }
+  }
+}
+
+IROpcode narrow_opcode(IROpcode op, const DexType* type) {
+  bool is_get = is_iget(op);
+  if (type == type::_byte()) {
+    return is_get ? OPCODE_IGET_BYTE : OPCODE_IPUT_BYTE;
+  }
+  always_assert(type == type::_short());
+  return is_get ? OPCODE_IGET_SHORT : OPCODE_IPUT_SHORT;
+}
+
+// The groups in which ART lays out instance fields, in this order.
+size_t get_layout_group(const DexType* type) {
+  if (!type::is_primitive(type)) {
+    return 0;
+  }
+  if (type::is_wide_type(type)) {
+    return 1;
+  }
+  if (type == type::_int() || type == type::_float()) {
+    return 2;
+  }
+  if (type == type::_short() || type == type::_char()) {
+    return 3;
+  }
+  return 4;
+}
+
+bool is_hot(const method_profiles::StatsMap& stats,
+            const DexMethodRef* method,
+            const Config& config) {
+  auto it = stats.find(method);
+  return it != stats.end() &&
+         it->second.appear_percent >= config.min_appear_percent;
+}
+
+// Plans the renamings of the hot fields of a layout group, which is sorted in
+// field id order.
+void plan_group_renaming(const std::vector<DexField*>& group,
+                         const std::unordered_map<DexField*, double>& heat,
+                         std::unordered_map<DexField*, DexString*>* names) {
+  std::vector<DexField*> hot;
+  for (auto field : group) {
+    if (heat.count(field) && can_rename(field)) {
+      hot.push_back(field);
+    }
+  }
+  if (hot.empty()) {
+    return;
+  }
+  std::stable_sort(hot.begin(), hot.end(), [&](DexField* a, DexField* b) {
+    return heat.at(a) > heat.at(b);
+  });
+  std::vector<DexField*> desired(hot);
+  for (auto field : group) {
+    if (std::find(hot.begin(), hot.end(), field) == hot.end()) {
+      desired.push_back(field);
+    }
+  }
+  if (desired == group) {
+    return;
+  }
+
+  // Rank prefixes of the same width sort like the ranks.
+  auto width = std::to_string(hot.size() - 1).size();
+  std::unordered_map<DexField*, DexString*> group_names;
+  for (size_t rank = 0; rank < hot.size(); ++rank) {
+    auto prefix = std::to_string(rank);
+    prefix.insert(0, width - prefix.size(), '0');
+    group_names.emplace(
+        hot[rank],
+        DexString::make_string("$" + prefix + "$" + hot[rank]->str()));
+  }
+  auto get_name = [&](DexField* field) {
+    auto it = group_names.find(field);
+    return it == group_names.end() ? field->get_name() : it->second;
+  };
+  // Names of other fields, e.g. with a '$' prefix themselves, may get in the
+  // way.
+  for (size_t i = 1; i < desired.size(); ++i) {
+    if (!compare_dexstrings(get_name(desired[i - 1]), get_name(desired[i]))) {
+      return;
+    }
+  }
+  for (auto field : hot) {
+    if (DexField::get_field(field->get_class(), group_names.at(field),
+                            field->get_type()) != nullptr) {
+      return;
+    }
+  }
+  names->insert(group_names.begin(), group_names.end());
+}
+
+// Makes all the instructions that access the given fields refer to their
+// definitions, so that the fields can be changed without resolving them
+// anymore.
+void bind_field_refs(const Scope& scope,
+                     const std::function<bool(DexField*)>& is_changed,
+                     const std::function<void(IRInstruction*)>& update) {
+  walk::parallel::opcodes(scope, [&](DexMethod*, IRInstruction* insn) {
+    if (!insn->has_field()) {
+      return;
+    }
+    auto field = resolve_field(insn->get_field());
+    if (field == nullptr || !is_changed(field)) {
+      return;
+    }
+    insn->set_field(field);
+    update(insn);
+  });
+}
+
+} // namespace
+
+std::unordered_map<DexField*, DexType*> find_narrowable_fields(
+    const Scope& scope) {
+  std::mutex mutex;
+  std::unordered_map<DexField*, boost::optional<Range>> ranges;
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
+    std::unordered_map<DexField*, boost::optional<Range>> method_ranges;
+    analyze_writes(code, &method_ranges);
+    code.clear_cfg();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& pair : method_ranges) {
+      auto it = ranges.emplace(pair.first, pair.second).first;
+      if (!pair.second) {
+        it->second = boost::none;
+      } else if (it->second) {
+        it->second->join_with(*pair.second);
+      }
+    }
+  });
+
+  std::unordered_map<DexField*, DexType*> narrowable;
+  for (auto& pair : ranges) {
+    auto field = pair.first;
+    const auto& range = pair.second;
+    if (!range) {
+      continue;
+    }
+    DexType* type = nullptr;
+    if (range->within(std::numeric_limits<int8_t>::min(),
+                      std::numeric_limits<int8_t>::max())) {
+      type = type::_byte();
+    } else if (field->get_type() == type::_int() &&
+               range->within(std::numeric_limits<int16_t>::min(),
+                             std::numeric_limits<int16_t>::max())) {
+      type = type::_short();
+    }
+    if (type != nullptr &&
+        DexField::get_field(field->get_class(), field->get_name(), type) ==
+            nullptr) {
+      narrowable.emplace(field, type);
+    }
+  }
+  return narrowable;
+}
+
+void narrow_fields(const Scope& scope,
+                   const std::unordered_map<DexField*, DexType*>& fields) {
+  bind_field_refs(
+      scope, [&](DexField* field) { return fields.count(field) != 0; },
+      [&](IRInstruction* insn) {
+        auto field = static_cast<DexField*>(insn->get_field());
+        insn->set_opcode(narrow_opcode(insn->opcode(), fields.at(field)));
+      });
+  for (auto& pair : fields) {
+    auto field = pair.first;
+    TRACE(OBJLAYOUT, 3, "Narrowing %s to %s", SHOW(field), SHOW(pair.second));
+    DexFieldSpec spec;
+    spec.type = pair.second;
+    field->change(spec);
+  }
+}
+
+std::unordered_map<DexField*, double> compute_field_heat(
+    const Scope& scope,
+    const method_profiles::StatsMap& stats,
+    const Config& config) {
+  std::unordered_map<DexField*, double> heat;
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    if (!is_hot(stats, method, config)) {
+      return;
+    }
+    auto call_count = stats.at(method).call_count;
+    for (auto& mie : InstructionIterable(code)) {
+      auto op = mie.insn->opcode();
+      if (!is_iget(op) && !is_iput(op)) {
+        continue;
+      }
+      auto field =
+          resolve_field(mie.insn->get_field(), FieldSearch::Instance);
+      if (field != nullptr && field->is_concrete()) {
+        heat[field] += call_count;
+      }
+    }
+  });
+  return heat;
+}
+
+size_t order_hot_fields(const Scope& scope,
+                        const std::unordered_map<DexField*, double>& heat) {
+  std::unordered_map<DexField*, DexString*> names;
+  for (auto cls : scope) {
+    std::vector<std::vector<DexField*>> groups(5);
+    for (auto field : cls->get_ifields()) {
+      groups[get_layout_group(field->get_type())].push_back(field);
+    }
+    for (auto& group : groups) {
+      std::sort(group.begin(), group.end(), compare_dexfields);
+      plan_group_renaming(group, heat, &names);
+    }
+  }
+
+  bind_field_refs(
+      scope, [&](DexField* field) { return names.count(field) != 0; },
+      [](IRInstruction*) {});
+  std::vector<DexField*> fields;
+  for (auto& pair : names) {
+    fields.push_back(pair.first);
+  }
+  std::sort(fields.begin(), fields.end(), compare_dexfields);
+  for (auto field : fields) {
+    TRACE(OBJLAYOUT, 3, "Renaming hot field %s to %s", SHOW(field),
+          SHOW(names.at(field)));
+    DexFieldSpec spec;
+    spec.name = names.at(field);
+    field->change(spec);
+  }
+  return fields.size();
+}
+
+void ObjectLayoutPass::run_pass(DexStoresVector& stores,
+                                ConfigFiles& conf,
+                                PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  if (m_config.narrow_fields) {
+    auto narrowable = find_narrowable_fields(scope);
+    narrow_fields(scope, narrowable);
+    TRACE(OBJLAYOUT, 1, "Narrowed %zu fields", narrowable.size());
+    mgr.set_metric(METRIC_NARROWED_FIELDS, narrowable.size());
+  }
+
+  if (m_config.order_hot_fields) {
+    const auto& stats =
+        conf.get_method_profiles().method_stats(m_config.interaction);
+    if (stats.empty()) {
+      TRACE(OBJLAYOUT, 1, "No profiles for %s", m_config.interaction.c_str());
+      return;
+    }
+    auto heat = compute_field_heat(scope, stats, m_config);
+    auto renamed = order_hot_fields(scope, heat);
+    TRACE(OBJLAYOUT, 1, "Renamed %zu of %zu hot fields", renamed,
+          heat.size());
+    mgr.set_metric(METRIC_HOT_FIELDS, heat.size());
+    mgr.set_metric(METRIC_RENAMED_FIELDS, renamed);
+  }
+}
+
+static ObjectLayoutPass s_pass;
+
+} // namespace object_layout
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "MethodProfiles.h"
+#include "Pass.h"
+
+/*
+ * This pass makes instances of app classes smaller and the fields that hot
+ * code accesses denser.
+ *
+ * ART groups the instance fields of a class by size, references first, and
+ * orders them by their dex field index within each group. So:
+ *
+ * - int and short fields that are only ever written constants that fit a
+ *   narrower type, or values of that type like the results of int-to-byte,
+ *   are narrowed to short or byte. Other values count as ints whatever their
+ *   range, as the verifier types them so. Their iget and iput
+ *   instructions become the matching iget-short / iget-byte etc., which sign
+ *   extend on reads, so all the values read stay the same.
+ *
+ * - The fields that the method profiles show hot code to access are renamed,
+ *   so that they sort first within their size groups, hottest first. As field
+ *   ids are ordered by name, this only sticks when the pass runs after any
+ *   pass renaming fields, e.g. ObfuscatePass.
+ *
+ * Fields that are kept, i.e. that can't be renamed or deleted, are left alone.
+ */
+namespace object_layout {
+
+struct Config {
+  // The profiled interaction that tells which methods are hot.
+  std::string interaction;
+  // The minimum appear100 of the methods whose field accesses count.
+  float min_appear_percent{1.0};
+  bool narrow_fields{true};
+  bool order_hot_fields{true};
+};
+
+/*
+ * The instance fields whose type can be narrowed, with their narrower types:
+ * byte for int and short fields that are only ever written values within
+ * [-128, 127], short for int fields that are only ever written values within
+ * [-32768, 32767].
+ */
+std::unordered_map<DexField*, DexType*> find_narrowable_fields(
+    const Scope& scope);
+
+// Changes the types of the fields to the given narrower ones, along with the
+// instructions that access them.
+void narrow_fields(const Scope& scope,
+                   const std::unordered_map<DexField*, DexType*>& fields);
+
+// The profiled number of accesses of each instance field by hot methods.
+std::unordered_map<DexField*, double> compute_field_heat(
+    const Scope& scope,
+    const method_profiles::StatsMap& stats,
+    const Config& config);
+
+// Renames hot fields so they get laid out first, hottest first. Returns the
+// number of renamed fields.
+size_t order_hot_fields(const Scope& scope,
+                        const std::unordered_map<DexField*, double>& heat);
+
+class ObjectLayoutPass : public Pass {
+ public:
+  ObjectLayoutPass() : Pass("ObjectLayoutPass") {}
+
+  void bind_config() override {
+    bind("interaction", method_profiles::COLD_START, m_config.interaction);
+    bind("min_appear_percent", 1.0f, m_config.min_appear_percent);
+    bind("narrow_fields", true, m_config.narrow_fields);
+    bind("order_hot_fields", true, m_config.order_hot_fields);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  Config m_config;
+};
+
+} // namespace object_layout
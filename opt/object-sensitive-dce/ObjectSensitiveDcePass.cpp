@@ -7,8 +7,11 @@
 
 #include "ObjectSensitiveDcePass.h"
 
+#include <boost/functional/hash.hpp>
 #include <functional>
+#include <sstream>
 
+#include "AnalysisCache.h"
 #include "ConcurrentContainers.h"
 #include "DexUtil.h"
 #include "HierarchyUtil.h"
@@ -109,6 +112,26 @@ static side_effects::InvokeToSummaryMap build_summary_map(
   return invoke_to_summary_map;
 }
 
+/*
+ * The cached summaries also depend on the summaries of the external methods,
+ * so the cache is only valid for the same summary files.
+ */
+size_t ObjectSensitiveDcePass::get_cache_salt() const {
+  size_t salt = 0;
+  for (const auto& file : {m_external_side_effect_summaries_file,
+                           m_external_escape_summaries_file}) {
+    if (file) {
+      std::ifstream input(*file);
+      std::stringstream contents;
+      contents << input.rdbuf();
+      boost::hash_combine(salt, contents.str());
+    } else {
+      boost::hash_combine(salt, 0);
+    }
+  }
+  return salt;
+}
+
 void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
                                       ConfigFiles&,
                                       PassManager& mgr) {
@@ -137,8 +160,19 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
     std::ifstream file_input(*m_external_side_effect_summaries_file);
     summary_serialization::read(file_input, &effect_summaries);
   }
+  std::unique_ptr<analysis_cache::MethodSummaryCache> effects_cache;
+  if (m_analysis_cache_dir) {
+    effects_cache = std::make_unique<analysis_cache::MethodSummaryCache>(
+        *m_analysis_cache_dir + "/side_effect_summaries", scope, call_graph,
+        get_cache_salt());
+    mgr.set_metric("reused_side_effect_summaries",
+                   effects_cache->read(&effect_summaries));
+  }
   side_effects::analyze_scope(scope, call_graph, *ptrs_fp_iter_map,
                               &effect_summaries);
+  if (effects_cache != nullptr) {
+    effects_cache->write(effect_summaries);
+  }
 
   auto removed =
       walk::parallel::methods<size_t>(scope, [&](DexMethod* method) -> size_t {
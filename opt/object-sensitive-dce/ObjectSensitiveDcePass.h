@@ -26,6 +26,11 @@ class ObjectSensitiveDcePass final : public Pass {
     bind("escape_summaries", {boost::none}, m_external_escape_summaries_file,
          "TODO: Document me!",
          Configurable::bindflags::optionals::skip_empty_string);
+    bind("analysis_cache_dir", {boost::none}, m_analysis_cache_dir,
+         "A directory where the side-effect summaries of the methods are kept "
+         "from one run to the next, so that the methods of the classes that "
+         "didn't change aren't analyzed again.",
+         Configurable::bindflags::optionals::skip_empty_string);
 
     if (!m_external_escape_summaries_file ||
         !m_external_side_effect_summaries_file) {
@@ -38,6 +43,9 @@ class ObjectSensitiveDcePass final : public Pass {
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
  private:
+  size_t get_cache_salt() const;
+
   boost::optional<std::string> m_external_side_effect_summaries_file;
   boost::optional<std::string> m_external_escape_summaries_file;
+  boost::optional<std::string> m_analysis_cache_dir;
 };
@@ -7,6 +7,7 @@
 
 #include "EnumConfig.h"
 
+#include "CallGraph.h"
 #include "LocalPointersAnalysis.h"
 #include "Walkers.h"
 #include <utility>
@@ -60,57 +61,34 @@ void load_external_method_summaries(
     summary.print(method);
   }
 }
-} // namespace
-
-namespace optimize_enums {
-void ParamSummary::print(const DexMethodRef* method) const {
-  if (!traceEnabled(ENUM, 9)) {
-    return;
-  }
-  TRACE(ENUM, 9, "summary of %s", SHOW(method));
-  TRACE_NO_LINE(ENUM, 9, "safe_params: ");
-  for (auto param : safe_params) {
-    TRACE_NO_LINE(ENUM, 9, "%d ", param);
-  }
-  if (returned_param) {
-    TRACE(ENUM, 9, "returned: %d", returned_param.get());
-  } else {
-    TRACE(ENUM, 9, "returned: none");
-  }
-}
 
 /**
- * Return true if a method signature contains java.lang.Object type.
+ * Return the type of the register of the parameter at `index`, counting the
+ * this pointer of instance methods.
  */
-bool params_contain_object_type(const DexMethod* method,
-                                const DexType* object_type) {
-  auto args = method->get_proto()->get_args();
-  for (auto arg : *args) {
-    if (arg == object_type) {
-      return true;
+DexType* get_param_type(const DexMethod* method, uint16_t index) {
+  if (!is_static(method)) {
+    if (index == 0) {
+      return method->get_class();
     }
+    --index;
   }
-  return false;
+  return method->get_proto()->get_args()->at(index);
 }
 
-ParamSummary calculate_param_summary(DexMethod* method,
-                                     const DexType* object_type) {
-  auto& code = *method->get_code();
-  code.build_cfg(/* editable */ false);
-  auto& cfg = code.cfg();
-  cfg.calculate_exit_block();
-  ParamSummary summary;
-
-  ptrs::FixpointIterator fp_iter(cfg, ptrs::InvokeToSummaryMap(),
-                                 /*escape_check_cast*/ true);
-  fp_iter.run(ptrs::Environment());
-  auto escape_summary = ptrs::get_escape_summary(fp_iter, code);
+/**
+ * Transform the escape summary of a method to a param summary.
+ */
+optimize_enums::ParamSummary to_param_summary(
+    const DexMethod* method,
+    ptrs::EscapeSummary escape_summary,
+    const DexType* object_type) {
+  optimize_enums::ParamSummary summary;
   if (escape_summary.returned_parameters.kind() ==
       sparta::AbstractValueKind::Top) {
     return summary;
   }
 
-  auto args = method->get_proto()->get_args();
   auto& escaping_params = escape_summary.escaping_parameters;
   if (escape_summary.returned_parameters.kind() ==
       sparta::AbstractValueKind::Value) {
@@ -118,7 +96,8 @@ ParamSummary calculate_param_summary(DexMethod* method,
     if (returned_elements.size() == 1) {
       auto returned = *returned_elements.begin();
       if (returned != ptrs::FRESH_RETURN && !escaping_params.count(returned)) {
-        if (method->get_proto()->get_rtype() == *(args->begin() + returned)) {
+        if (method->get_proto()->get_rtype() ==
+            get_param_type(method, returned)) {
           // Set returned_param to the only one returned parameter index.
           summary.returned_param = returned;
         } else {
@@ -133,6 +112,7 @@ ParamSummary calculate_param_summary(DexMethod* method,
     }
   }
   // Non-escaping java.lang.Object params are stored in safe_params.
+  auto args = method->get_proto()->get_args();
   auto arg_it = args->begin();
   uint32_t index = 0;
   if (!is_static(method)) {
@@ -145,27 +125,89 @@ ParamSummary calculate_param_summary(DexMethod* method,
   }
   return summary;
 }
+} // namespace
+
+namespace optimize_enums {
+void ParamSummary::print(const DexMethodRef* method) const {
+  if (!traceEnabled(ENUM, 9)) {
+    return;
+  }
+  TRACE(ENUM, 9, "summary of %s", SHOW(method));
+  TRACE_NO_LINE(ENUM, 9, "safe_params: ");
+  for (auto param : safe_params) {
+    TRACE_NO_LINE(ENUM, 9, "%d ", param);
+  }
+  if (returned_param) {
+    TRACE(ENUM, 9, "returned: %d", returned_param.get());
+  } else {
+    TRACE(ENUM, 9, "returned: none");
+  }
+}
+
+/**
+ * Return true if a method signature contains java.lang.Object type.
+ */
+bool params_contain_object_type(const DexMethod* method,
+                                const DexType* object_type) {
+  auto args = method->get_proto()->get_args();
+  for (auto arg : *args) {
+    if (arg == object_type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ParamSummary calculate_param_summary(DexMethod* method,
+                                     const DexType* object_type) {
+  auto& code = *method->get_code();
+  code.build_cfg(/* editable */ false);
+  auto& cfg = code.cfg();
+  cfg.calculate_exit_block();
+
+  ptrs::FixpointIterator fp_iter(cfg, ptrs::InvokeToSummaryMap(),
+                                 /*escape_check_cast*/ true);
+  fp_iter.run(ptrs::Environment());
+  return to_param_summary(method, ptrs::get_escape_summary(fp_iter, code),
+                          object_type);
+}
 
 /**
- * Calculate escape summaries for static methods whose arguments contain
- * java.lang.Object type. Then convert the escape summaries to param summaries.
+ * Calculate escape summaries for the whole scope, analyzing callees before
+ * their callers so that a parameter handed on to a method that doesn't let it
+ * escape doesn't escape either. Then convert the escape summaries of the
+ * static and non-virtual methods whose arguments contain java.lang.Object
+ * type to param summaries.
  */
 void calculate_param_summaries(
     const Scope& scope,
     const method_override_graph::Graph& override_graph,
     SummaryMap* param_summary_map) {
   auto object_type = type::java_lang_Object();
+  walk::parallel::code(scope, [](DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+    code.cfg().calculate_exit_block();
+  });
+  ptrs::SummaryCMap escape_summaries;
+  ptrs::analyze_scope(scope, call_graph::single_callee_graph(scope),
+                      &escape_summaries, /*escape_check_cast*/ true);
+  walk::parallel::code(scope,
+                       [](DexMethod*, IRCode& code) { code.clear_cfg(); });
   walk::parallel::code(
       scope,
       [object_type, &override_graph](DexMethod* method) {
         return method->get_code() &&
                !method_override_graph::is_true_virtual(override_graph,
                                                        method) &&
-
                params_contain_object_type(method, object_type);
       },
-      [object_type, param_summary_map](DexMethod* method, IRCode&) {
-        auto summary = calculate_param_summary(method, object_type);
+      [object_type, param_summary_map, &escape_summaries](DexMethod* method,
+                                                          IRCode&) {
+        auto it = escape_summaries.find(method);
+        if (it == escape_summaries.end()) {
+          return;
+        }
+        auto summary = to_param_summary(method, it->second, object_type);
         if (!summary.returned_param && summary.safe_params.empty()) {
           return;
         }
@@ -58,11 +58,15 @@ bool params_contain_object_type(const DexMethod* method,
 
 /**
  * Apply escape analysis on the method and transfrom the escape summary to param
- * summary.
+ * summary. Any parameter passed to another method is treated as escaping.
  */
 ParamSummary calculate_param_summary(DexMethod* method,
                                      const DexType* object_type);
 
+/**
+ * Calculate the param summaries of the static and non-virtual methods in
+ * scope, taking the escape summaries of their callees into account.
+ */
 void calculate_param_summaries(
     const Scope& scope,
     const method_override_graph::Graph& override_graph,
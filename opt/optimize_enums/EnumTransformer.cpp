@@ -1478,6 +1478,7 @@ class EnumTransformer final {
         ++mit;
       }
     }
+    g_redex->report_class_hierarchy_change();
   }
 
   /**
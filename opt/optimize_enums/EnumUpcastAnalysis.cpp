@@ -212,7 +212,7 @@ class EnumUpcastDetector {
   /**
    * No other direct invocation allowed on candidate enums except
    * candidate enum constructor invocations in the enum classes'
-   * <clinit>.
+   * <clinit>. Other direct invocations are analyzed like static ones.
    */
   void process_direct_invocation(
       const IRInstruction* insn,
@@ -225,7 +225,11 @@ class EnumUpcastDetector {
         method::is_init(invoked) && method::is_clinit(m_method)) {
       return;
     }
-    process_general_invocation(insn, env, rejected_enums);
+    if (method::is_init(invoked)) {
+      process_general_invocation(insn, env, rejected_enums);
+      return;
+    }
+    process_summarized_invocation(insn, env, rejected_enums);
   }
 
   /**
@@ -237,9 +241,10 @@ class EnumUpcastDetector {
    * Otherwise, figure out implicit parameter upcasting by adopting param
    * summary data.
    */
-  void process_static_invocation(const IRInstruction* insn,
-                                 const EnumTypeEnvironment* env,
-                                 ConcurrentSet<DexType*>* rejected_enums) {
+  void process_static_invocation(
+      const IRInstruction* insn,
+      const EnumTypeEnvironment* env,
+      ConcurrentSet<DexType*>* rejected_enums) const {
     always_assert(insn->opcode() == OPCODE_INVOKE_STATIC);
     auto method_ref = insn->get_method();
     if (method_ref == STRING_VALUEOF_METHOD) {
@@ -251,7 +256,19 @@ class EnumUpcastDetector {
         return;
       }
     }
-    auto method = resolve_method(method_ref, MethodSearch::Static);
+    process_summarized_invocation(insn, env, rejected_enums);
+  }
+
+  /**
+   * Figure out implicit parameter upcasting of a static or direct invocation
+   * by adopting param summary data: candidate enums passed as
+   * java.lang.Object to parameters that don't escape are not upcast.
+   */
+  void process_summarized_invocation(
+      const IRInstruction* insn,
+      const EnumTypeEnvironment* env,
+      ConcurrentSet<DexType*>* rejected_enums) const {
+    auto method = resolve_method(insn->get_method(), opcode_to_search(insn));
     if (!method || !params_contain_object_type(method, OBJECT_TYPE)) {
       process_general_invocation(insn, env, rejected_enums);
       return;
@@ -263,9 +280,16 @@ class EnumUpcastDetector {
       safe_params = summary.safe_params;
     }
 
+    size_t arg_id = 0;
+    if (insn->opcode() != OPCODE_INVOKE_STATIC) {
+      reject_if_inconsistent(insn, env->get(insn->src(arg_id)),
+                             insn->get_method()->get_class(), rejected_enums,
+                             CAST_THIS_POINTER);
+      arg_id++;
+    }
     const auto args = method->get_proto()->get_args();
     auto it = args->begin();
-    for (size_t arg_id = 0; arg_id < insn->srcs_size(); ++arg_id, ++it) {
+    for (; arg_id < insn->srcs_size(); ++arg_id, ++it) {
       if (safe_params && safe_params->count(arg_id)) {
         continue;
       }
@@ -501,8 +525,9 @@ void EnumFixpointIterator::analyze_instruction(const IRInstruction* insn,
     case OPCODE_MOVE_OBJECT:
       env->set(dest, env->get(insn->src(0)));
       break;
-    case OPCODE_INVOKE_STATIC: {
-      auto method = resolve_method(insn->get_method(), MethodSearch::Static);
+    case OPCODE_INVOKE_STATIC:
+    case OPCODE_INVOKE_DIRECT: {
+      auto method = resolve_method(insn->get_method(), opcode_to_search(insn));
       if (method) {
         auto it = m_config.param_summary_map.find(method);
         if (it != m_config.param_summary_map.end()) {
@@ -519,7 +544,6 @@ void EnumFixpointIterator::analyze_instruction(const IRInstruction* insn,
       env->set(dest, EnumTypes(insn->get_method()->get_proto()->get_rtype()));
     } break;
     case OPCODE_INVOKE_SUPER:
-    case OPCODE_INVOKE_DIRECT:
     case OPCODE_INVOKE_INTERFACE:
     case OPCODE_INVOKE_VIRTUAL:
       env->set(dest, EnumTypes(insn->get_method()->get_proto()->get_rtype()));
@@ -8,9 +8,10 @@
 #include "Peephole.h"
 
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <cmath>
 #include <numeric>
-#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -263,19 +264,87 @@ struct Pattern {
         predicate(std::move(predicate)) {}
 };
 
+constexpr size_t kNumOpcodes = IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1;
+using OpcodeSet = std::bitset<kNumOpcodes>;
+
+// The arguments matched to the placeholders of one kind. Patterns only use a
+// handful of placeholders, and the state is reset on nearly every instruction,
+// so it's kept in a fixed array indexed by the placeholder.
+template <typename Key, typename Value, size_t N>
+class MatchedSlots {
+ public:
+  bool count(Key key) const { return m_set[index(key)]; }
+
+  const Value& at(Key key) const {
+    always_assert(count(key));
+    return m_values[index(key)];
+  }
+
+  // Returns false if the placeholder was matched to a different value before.
+  bool match(Key key, Value value) {
+    auto i = index(key);
+    if (m_set[i]) {
+      return m_values[i] == value;
+    }
+    m_set[i] = true;
+    m_values[i] = value;
+    return true;
+  }
+
+  void clear() { m_set.reset(); }
+
+ private:
+  static size_t index(Key key) {
+    auto i = static_cast<size_t>(key);
+    redex_assert(i < N);
+    return i;
+  }
+
+  std::bitset<N> m_set;
+  std::array<Value, N> m_values;
+};
+
 // Matcher holds the matching state for the given pattern.
 struct Matcher {
   const Pattern& pattern;
   size_t match_index;
   std::vector<IRInstruction*> matched_instructions;
+  // The opcodes of each instruction of the pattern, for lookups by opcode.
+  std::vector<OpcodeSet> match_opcodes;
+
+  MatchedSlots<Register, reg_t, static_cast<size_t>(Register::E) + 1>
+      matched_regs;
+  MatchedSlots<String,
+               DexString*,
+               static_cast<size_t>(String::Type_A_get_simple_name) + 1>
+      matched_strings;
+  MatchedSlots<Literal, int64_t, static_cast<size_t>(Literal::Zero) + 1>
+      matched_literals;
+  MatchedSlots<Type, DexType*, static_cast<size_t>(Type::B) + 1> matched_types;
+  MatchedSlots<Field, DexFieldRef*, static_cast<size_t>(Field::B) + 1>
+      matched_fields;
+
+  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {
+    for (const auto& dex_pattern : pattern.match) {
+      OpcodeSet opcodes;
+      for (auto op : dex_pattern.opcodes) {
+        always_assert(op < kNumOpcodes);
+        opcodes.set(op);
+      }
+      match_opcodes.push_back(opcodes);
+    }
+  }
 
-  std::unordered_map<Register, reg_t, EnumClassHash> matched_regs;
-  std::unordered_map<String, DexString*, EnumClassHash> matched_strings;
-  std::unordered_map<Literal, int64_t, EnumClassHash> matched_literals;
-  std::unordered_map<Type, DexType*, EnumClassHash> matched_types;
-  std::unordered_map<Field, DexFieldRef*, EnumClassHash> matched_fields;
-
-  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {}
+  // Whether the pattern can match in code made of the given opcodes, i.e.
+  // whether each of its instructions has one of its opcodes in there.
+  bool may_match(const OpcodeSet& opcodes) const {
+    for (const auto& step : match_opcodes) {
+      if ((step & opcodes).none()) {
+        return false;
+      }
+    }
+    return true;
+  }
 
   void reset() {
     match_index = 0;
@@ -291,53 +360,32 @@ struct Matcher {
   // insn matches to the last 'match' pattern.
   bool try_match(IRInstruction* insn) {
     auto match_reg = [&](Register pattern_reg, reg_t insn_reg) {
-      // This register has been observed already. Check whether they are same.
-      if (matched_regs.find(pattern_reg) != end(matched_regs)) {
-        return matched_regs.at(pattern_reg) == insn_reg;
-      }
-
-      // Newly observed. Remember it.
-      matched_regs.emplace(pattern_reg, insn_reg);
-      return true;
+      return matched_regs.match(pattern_reg, insn_reg);
     };
 
     auto match_literal = [&](Literal lit_pattern, int64_t insn_literal_val) {
-      if (matched_literals.find(lit_pattern) != end(matched_literals)) {
-        return matched_literals.at(lit_pattern) == insn_literal_val;
-      }
-      matched_literals.emplace(lit_pattern, insn_literal_val);
-      return true;
+      return matched_literals.match(lit_pattern, insn_literal_val);
     };
 
     auto match_string = [&](String str_pattern, DexString* insn_str) {
       if (str_pattern == String::empty) {
         return (insn_str->is_simple() && insn_str->size() == 0);
       }
-      if (matched_strings.find(str_pattern) != end(matched_strings)) {
-        return matched_strings.at(str_pattern) == insn_str;
-      }
-      matched_strings.emplace(str_pattern, insn_str);
-      return true;
+      return matched_strings.match(str_pattern, insn_str);
     };
 
     auto match_type = [&](Type type_pattern, DexType* insn_type) {
-      if (matched_types.find(type_pattern) != end(matched_types)) {
-        return matched_types.at(type_pattern) == insn_type;
-      }
-      matched_types.emplace(type_pattern, insn_type);
-      return true;
+      return matched_types.match(type_pattern, insn_type);
     };
 
     auto match_field = [&](Field field_pattern, DexFieldRef* insn_field) {
-      auto result = matched_fields.emplace(field_pattern, insn_field);
-      bool newly_inserted = result.second;
-      return newly_inserted ? true : result.first->second == insn_field;
+      return matched_fields.match(field_pattern, insn_field);
     };
 
     // Does 'insn' match to the given DexPattern?
-    auto match_instruction = [&](const DexPattern& dex_pattern) {
-      if (dex_pattern.opcodes.find(insn->opcode()) ==
-              end(dex_pattern.opcodes) ||
+    auto match_instruction = [&](size_t index) {
+      const DexPattern& dex_pattern = pattern.match[index];
+      if (!match_opcodes[index].test(insn->opcode()) ||
           dex_pattern.srcs.size() != insn->srcs_size() ||
           dex_pattern.dests.size() != insn->has_dest()) {
         return false;
@@ -376,7 +424,7 @@ struct Matcher {
     };
 
     redex_assert(match_index < pattern.match.size());
-    if (!match_instruction(pattern.match[match_index])) {
+    if (!match_instruction(match_index)) {
       // Okay, this is the PG's heuristic. Retry only if the failure occurs on
       // the second opcode of the pattern.
       bool retry = (match_index == 1);
@@ -389,7 +437,7 @@ struct Matcher {
       reset();
       if (retry) {
         redex_assert(match_index == 0);
-        if (!match_instruction(pattern.match[match_index])) {
+        if (!match_instruction(match_index)) {
           return false;
         }
       } else {
@@ -529,13 +577,13 @@ struct Matcher {
       if (replace_info.dests.size() > 0) {
         redex_assert(replace_info.dests.size() == 1);
         const Register dest = replace_info.dests[0];
-        always_assert(matched_regs.find(dest) != end(matched_regs));
+        always_assert(matched_regs.count(dest));
         replace->set_dest(matched_regs.at(dest));
       }
 
       for (size_t i = 0; i < replace_info.srcs.size(); ++i) {
         const Register reg = replace_info.srcs[i];
-        always_assert(matched_regs.find(reg) != end(matched_regs));
+        always_assert(matched_regs.count(reg));
         replace->set_src(i, matched_regs.at(reg));
       }
 
@@ -1727,10 +1775,22 @@ class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
     code->build_cfg(/* editable */ true);
     auto& cfg = code->cfg();
 
+    // Most patterns can't match in a given method because some of their
+    // opcodes don't appear in it at all. Those are skipped without a scan.
+    // Replacements only add opcodes to the set, so that removals can't make
+    // us skip a pattern that would match.
+    OpcodeSet opcodes;
+    for (const auto& mie : InstructionIterable(cfg)) {
+      opcodes.set(mie.insn->opcode());
+    }
+
     // do optimizations one at a time
     // so they can match on the same pattern without interfering
     for (size_t i = 0; i < m_matchers.size(); ++i) {
       auto& matcher = m_matchers[i];
+      if (!matcher.may_match(opcodes)) {
+        continue;
+      }
       std::vector<ReplacementItem> deletes;
       std::vector<ReplacementItem> inserts;
 
@@ -1759,6 +1819,7 @@ class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
           auto replace = matcher.get_replacements();
           for (const auto& r : replace) {
             TRACE(PEEPHOLE, 8, "-- %s", SHOW(r));
+            opcodes.set(r->opcode());
           }
 
           m_stats_inserted += replace.size();
@@ -1835,24 +1896,31 @@ void PeepholePass::run_pass(DexStoresVector& stores,
                             PassManager& mgr) {
   auto scope = build_class_scope(stores);
   auto num_threads = redex_parallel::default_num_threads();
-  std::vector<std::unique_ptr<PeepholeOptimizer>> peephole_optimizers;
   const std::vector<std::vector<Pattern>> pats = patterns::get_all_patterns();
-  for (size_t i = 0; i < num_threads; ++i) {
-    peephole_optimizers.emplace_back(std::make_unique<PeepholeOptimizer>(
-        mgr, pats, config.disabled_peepholes));
-  }
-
+  auto peephole_optimizers =
+      WorkerLocal<std::unique_ptr<PeepholeOptimizer>>::create(
+          num_threads, [&]() {
+            return std::make_unique<PeepholeOptimizer>(
+                mgr, pats, config.disabled_peepholes);
+          });
+
+  auto previous_epoch = config.only_modified_methods
+                            ? mgr.get_previous_run_epoch()
+                            : boost::none;
   walk::parallel::methods(
       scope,
       [&](DexMethod* method) {
-        auto& ph = peephole_optimizers[redex_parallel::get_worker_id()];
-        ph->run_method(method);
+        auto code = method->get_code();
+        if (previous_epoch && code != nullptr &&
+            code->modified_epoch() <= *previous_epoch) {
+          return;
+        }
+        peephole_optimizers.get()->run_method(method);
       },
       num_threads);
 
-  for (size_t i = 0; i < num_threads; ++i) {
-    peephole_optimizers[i]->incr_all_metrics();
-  }
+  peephole_optimizers.for_each(
+      [](std::unique_ptr<PeepholeOptimizer>& ph) { ph->incr_all_metrics(); });
 
   if (!contains<std::string>(config.disabled_peepholes,
                              RedundantCheckCastRemover::get_name())) {
@@ -18,11 +18,15 @@ class PeepholePass : public Pass {
 
   void bind_config() override {
     bind("disabled_peepholes", {}, config.disabled_peepholes);
+    bind("only_modified_methods", false, config.only_modified_methods);
   }
 
  private:
   struct Config {
     std::vector<std::string> disabled_peepholes;
+    // Skip the methods that weren't modified since the previous run of the
+    // pass, which has no patterns left to match in them.
+    bool only_modified_methods{false};
   };
   Config config;
 };
@@ -27,6 +27,8 @@ class PrintMembersPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_analysis_only() const override { return true; }
+
  private:
   void handle_method(DexMethod* m, const char* type);
   struct Config {
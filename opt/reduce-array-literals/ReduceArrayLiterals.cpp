@@ -7,6 +7,7 @@
 
 #include "ReduceArrayLiterals.h"
 
+#include <limits>
 #include <vector>
 
 #include "BaseIRAnalyzer.h"
@@ -31,6 +32,10 @@ constexpr const char* METRIC_FILLED_ARRAYS = "num_filled_arrays";
 constexpr const char* METRIC_FILLED_ARRAY_ELEMENTS =
     "num_filled_array_elements";
 constexpr const char* METRIC_FILLED_ARRAY_CHUNKS = "num_filled_array_chunks";
+constexpr const char* METRIC_FILL_ARRAY_DATA_ARRAYS =
+    "num_fill_array_data_arrays";
+constexpr const char* METRIC_FILL_ARRAY_DATA_ELEMENTS =
+    "num_fill_array_data_elements";
 constexpr const char* METRIC_REMAINING_WIDE_ARRAYS =
     "num_remaining_wide_arrays";
 constexpr const char* METRIC_REMAINING_WIDE_ARRAY_ELEMENTS =
@@ -167,12 +172,53 @@ std::vector<const IRInstruction*> get_aput_insns(const TrackedValue& array) {
   return aput_insns;
 }
 
+// The number of code units of the smallest const instruction that loads the
+// given literal.
+size_t get_const_code_units(int64_t literal) {
+  if (literal >= -8 && literal <= 7) {
+    return 1; // const/4
+  }
+  if (literal >= -32768 && literal <= 32767) {
+    return 2; // const/16
+  }
+  if ((literal & 0xffff) == 0) {
+    return 2; // const/high16
+  }
+  return 3; // const
+}
+
+// The width of the elements of a primitive, non-wide array in a
+// fill-array-data payload.
+size_t get_element_width(const DexType* element_type) {
+  if (element_type == type::_int() || element_type == type::_float()) {
+    return 4;
+  }
+  if (element_type == type::_short() || element_type == type::_char()) {
+    return 2;
+  }
+  always_assert(element_type == type::_byte() ||
+                element_type == type::_boolean());
+  return 1;
+}
+
+template <typename IntType>
+DexOpcodeData* make_payload(const std::vector<int32_t>& values) {
+  // Truncates the values just like the aput instructions did
+  std::vector<IntType> elements;
+  elements.reserve(values.size());
+  for (auto value : values) {
+    elements.push_back((IntType)value);
+  }
+  return encode_fill_array_data_payload(elements);
+}
+
 using namespace ir_analyzer;
 
 using TrackedDomain =
     sparta::HashedSetAbstractDomain<TrackedValue, TrackedValueHasher>;
 using EscapedArrayDomain =
     sparta::ConstantAbstractDomain<std::vector<const IRInstruction*>>;
+using AputValueDomain = sparta::ConstantAbstractDomain<int32_t>;
 
 /**
  * For each register that holds a relevant value, keep track of it.
@@ -283,6 +329,19 @@ class Analyzer final : public BaseIRAnalyzer<TrackedDomainEnvironment> {
     case OPCODE_APUT_SHORT:
     case OPCODE_APUT_OBJECT:
     case OPCODE_APUT_BOOLEAN: {
+      if (insn->opcode() != OPCODE_APUT_WIDE &&
+          insn->opcode() != OPCODE_APUT_OBJECT) {
+        const auto value = get_singleton(current_state->get(insn->src(0)));
+        auto aput_value = value && is_literal(*value)
+                              ? AputValueDomain((int32_t)get_literal(*value))
+                              : AputValueDomain::top();
+        auto it = m_aput_values.find(insn);
+        if (it == m_aput_values.end()) {
+          m_aput_values.emplace(insn, aput_value);
+        } else {
+          it->second.join_with(aput_value);
+        }
+      }
       escape_new_arrays(insn->src(0));
       const auto array = get_singleton(current_state->get(insn->src(1)));
       const auto index = get_singleton(current_state->get(insn->src(2)));
@@ -338,9 +397,24 @@ class Analyzer final : public BaseIRAnalyzer<TrackedDomainEnvironment> {
     return result;
   }
 
+  // The literal values stored by primitive aput instructions, if they always
+  // store the same one.
+  std::unordered_map<const IRInstruction*, int32_t> get_aput_literals() {
+    std::unordered_map<const IRInstruction*, int32_t> result;
+    for (auto& p : m_aput_values) {
+      auto constant = p.second.get_constant();
+      if (constant) {
+        result.emplace(p.first, *constant);
+      }
+    }
+    return result;
+  }
+
  private:
   mutable std::unordered_map<const IRInstruction*, EscapedArrayDomain>
       m_escaped_arrays;
+  mutable std::unordered_map<const IRInstruction*, AputValueDomain>
+      m_aput_values;
 };
 
 } // namespace
@@ -370,6 +444,7 @@ ReduceArrayLiterals::ReduceArrayLiterals(cfg::ControlFlowGraph& cfg,
 
   Analyzer analyzer(cfg);
   auto array_literals = analyzer.get_array_literals();
+  m_aput_literals = analyzer.get_aput_literals();
   // sort array literals by order of occurrence for determinism
   for (IRInstruction* new_array_insn : new_array_insns) {
     auto it = array_literals.find(new_array_insn);
@@ -392,6 +467,14 @@ void ReduceArrayLiterals::patch() {
     auto type = new_array_insn->get_type();
     auto element_type = type::get_array_component_type(type);
 
+    if (type::is_primitive(element_type) &&
+        !type::is_wide_type(element_type) &&
+        patch_fill_array_data(new_array_insn, aput_insns)) {
+      m_stats.fill_array_data_arrays++;
+      m_stats.fill_array_data_elements += aput_insns.size();
+      continue;
+    }
+
     if (m_min_sdk < 24) {
       // See T45708995.
       //
@@ -463,6 +546,80 @@ void ReduceArrayLiterals::patch() {
   }
 }
 
+bool ReduceArrayLiterals::patch_fill_array_data(
+    const IRInstruction* new_array_insn,
+    const std::vector<const IRInstruction*>& aput_insns) {
+  auto element_type =
+      type::get_array_component_type(new_array_insn->get_type());
+  auto width = get_element_width(element_type);
+
+  // The aput instructions and the consts they need, assuming that none are
+  // shared, against
+  //   fill-array-data vA, :payload
+  // with its (possibly aligned) payload. A single instruction that copies the
+  // payload is also faster to interpret than three instructions per element,
+  // so the payload is only used when it's smaller.
+  std::vector<int32_t> values;
+  values.reserve(aput_insns.size());
+  size_t aputs_code_units = 0;
+  for (size_t index = 0; index < aput_insns.size(); index++) {
+    auto it = m_aput_literals.find(aput_insns[index]);
+    if (it == m_aput_literals.end()) {
+      return false;
+    }
+    values.push_back(it->second);
+    aputs_code_units +=
+        2 + get_const_code_units(index) + get_const_code_units(it->second);
+  }
+  size_t payload_code_units = 4 + (aput_insns.size() * width + 1) / 2;
+  if (payload_code_units > std::numeric_limits<uint16_t>::max() ||
+      3 + 1 + payload_code_units >= aputs_code_units) {
+    return false;
+  }
+
+  auto it = m_cfg.find_insn(const_cast<IRInstruction*>(new_array_insn));
+  auto move_result_it = m_cfg.move_result_of(it);
+  if (move_result_it.is_end()) {
+    return false;
+  }
+  auto overall_dest = move_result_it->insn->dest();
+
+  DexOpcodeData* payload;
+  if (element_type == type::_char()) {
+    payload = make_payload<uint16_t>(values);
+  } else if (width == 4) {
+    payload = make_payload<int32_t>(values);
+  } else if (width == 2) {
+    payload = make_payload<int16_t>(values);
+  } else {
+    payload = make_payload<int8_t>(values);
+  }
+  IRInstruction* fill_array_data_insn =
+      new IRInstruction(OPCODE_FILL_ARRAY_DATA);
+  fill_array_data_insn->set_src(0, overall_dest)->set_data(payload);
+
+  // Fill the array where the last aput instruction was, and remove them all
+  auto last_aput_it =
+      m_cfg.find_insn(const_cast<IRInstruction*>(aput_insns.back()));
+  always_assert(last_aput_it->insn->src(1) == overall_dest);
+  m_cfg.insert_before(last_aput_it, fill_array_data_insn);
+
+  std::unordered_set<const IRInstruction*> aput_insns_set(aput_insns.begin(),
+                                                          aput_insns.end());
+  std::vector<cfg::InstructionIterator> aput_insns_iterators;
+  auto iterable = cfg::InstructionIterable(m_cfg);
+  for (auto insn_it = iterable.begin(); insn_it != iterable.end(); ++insn_it) {
+    if (aput_insns_set.count(insn_it->insn)) {
+      aput_insns_iterators.push_back(insn_it);
+    }
+  }
+  // removing instructions doesn't invalidate iterators
+  for (auto& aput_it : aput_insns_iterators) {
+    m_cfg.remove_insn(aput_it);
+  }
+  return true;
+}
+
 void ReduceArrayLiterals::patch_new_array(
     const IRInstruction* new_array_insn,
     const std::vector<const IRInstruction*>& aput_insns) {
@@ -681,6 +838,9 @@ void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_FILLED_ARRAYS, stats.filled_arrays);
   mgr.incr_metric(METRIC_FILLED_ARRAY_ELEMENTS, stats.filled_array_elements);
   mgr.incr_metric(METRIC_FILLED_ARRAY_CHUNKS, stats.filled_array_chunks);
+  mgr.incr_metric(METRIC_FILL_ARRAY_DATA_ARRAYS, stats.fill_array_data_arrays);
+  mgr.incr_metric(METRIC_FILL_ARRAY_DATA_ELEMENTS,
+                  stats.fill_array_data_elements);
   mgr.incr_metric(METRIC_REMAINING_WIDE_ARRAYS, stats.remaining_wide_arrays);
   mgr.incr_metric(METRIC_REMAINING_WIDE_ARRAY_ELEMENTS,
                   stats.remaining_wide_array_elements);
@@ -698,6 +858,8 @@ ReduceArrayLiterals::Stats& ReduceArrayLiterals::Stats::operator+=(
   filled_arrays += that.filled_arrays;
   filled_array_elements += that.filled_array_elements;
   filled_array_chunks += that.filled_array_chunks;
+  fill_array_data_arrays += that.fill_array_data_arrays;
+  fill_array_data_elements += that.fill_array_data_elements;
   remaining_wide_arrays += that.remaining_wide_arrays;
   remaining_wide_array_elements += that.remaining_wide_array_elements;
   remaining_unimplemented_arrays += that.remaining_unimplemented_arrays;
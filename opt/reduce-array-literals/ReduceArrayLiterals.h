@@ -16,6 +16,8 @@ class ReduceArrayLiterals {
     size_t filled_arrays{0};
     size_t filled_array_chunks{0};
     size_t filled_array_elements{0};
+    size_t fill_array_data_arrays{0};
+    size_t fill_array_data_elements{0};
     size_t remaining_wide_arrays{0};
     size_t remaining_wide_array_elements{0};
     size_t remaining_unimplemented_arrays{0};
@@ -39,6 +41,12 @@ class ReduceArrayLiterals {
   void patch();
 
  private:
+  // Replaces the aput instructions of a primitive array literal with a
+  // fill-array-data instruction, if they all store literals and that is
+  // cheaper. Returns whether it did.
+  bool patch_fill_array_data(
+      const IRInstruction* new_array_insn,
+      const std::vector<const IRInstruction*>& aput_insns);
   void patch_new_array(const IRInstruction* new_array_insn,
                        const std::vector<const IRInstruction*>& aput_insns);
   size_t patch_new_array_chunk(
@@ -52,6 +60,7 @@ class ReduceArrayLiterals {
   size_t m_max_filled_elements;
   int32_t m_min_sdk;
   std::vector<reg_t> m_local_temp_regs;
+  std::unordered_map<const IRInstruction*, int32_t> m_aput_literals;
   Stats m_stats;
   std::vector<
       std::pair<const IRInstruction*, std::vector<const IRInstruction*>>>
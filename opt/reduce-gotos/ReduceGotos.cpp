@@ -444,11 +444,16 @@ void ReduceGotosPass::run_pass(DexStoresVector& stores,
                                PassManager& mgr) {
   auto scope = build_class_scope(stores);
 
-  Stats stats = walk::parallel::methods<Stats>(scope, [](DexMethod* method) {
+  auto previous_epoch =
+      m_only_modified_methods ? mgr.get_previous_run_epoch() : boost::none;
+  Stats stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* method) {
     const auto code = method->get_code();
     if (!code) {
       return Stats{};
     }
+    if (previous_epoch && code->modified_epoch() <= *previous_epoch) {
+      return Stats{};
+    }
 
     Stats stats = ReduceGotosPass::process_code(code);
     if (stats.replaced_gotos_with_returns ||
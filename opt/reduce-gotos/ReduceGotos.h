@@ -29,12 +29,22 @@ class ReduceGotosPass : public Pass {
 
   ReduceGotosPass() : Pass("ReduceGotosPass") {}
 
+  void bind_config() override {
+    bind("only_modified_methods", false, m_only_modified_methods);
+  }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_cfg_friendly() const override { return true; }
+
   static Stats process_code(IRCode*);
   static void process_code_switches(cfg::ControlFlowGraph&, Stats&);
   static void process_code_ifs(cfg::ControlFlowGraph&, Stats&);
 
  private:
   static void shift_registers(cfg::ControlFlowGraph* cfg, uint32_t* reg);
+
+  // Skip the methods that weren't modified since the previous run of the
+  // pass, which has nothing left to do in them.
+  bool m_only_modified_methods{false};
 };
@@ -314,6 +314,7 @@ Allocator::Stats& Allocator::Stats::operator+=(const Allocator::Stats& that) {
   split_moves += that.split_moves;
   moves_coalesced += that.moves_coalesced;
   params_spill_early += that.params_spill_early;
+  linear_scan_methods += that.linear_scan_methods;
   return *this;
 }
 
@@ -848,7 +849,7 @@ std::unordered_map<reg_t, IRList::iterator> Allocator::find_param_splits(
 
   auto& cfg = code->cfg();
   cfg::Block* start_block = cfg.entry_block();
-  auto doms = dominators::SimpleFastDominators<cfg::GraphInterface>(cfg);
+  dominators::SemiNCADominators<cfg::GraphInterface> doms(cfg);
   for (auto param : params) {
     auto block_uses = find_first_uses(param, start_block);
     // Since this function only gets called for param regs that need to be
@@ -1081,6 +1082,7 @@ void Allocator::allocate(DexMethod* method) {
     dedicate_this_register(method);
   }
   bool first{true};
+  size_t split_iterations{0};
   while (true) {
     SplitCosts split_costs;
     SpillPlan spill_plan;
@@ -1146,7 +1148,9 @@ void Allocator::allocate(DexMethod* method) {
 
     if (!spill_plan.empty()) {
       TRACE(REG, 5, "Spill plan:\n%s", SHOW(spill_plan));
-      if (m_config.use_splitting) {
+      if (m_config.use_splitting &&
+          (m_config.max_split_iterations == 0 ||
+           split_iterations++ < m_config.max_split_iterations)) {
         calc_split_costs(fixpoint_iter, code, &split_costs);
         find_split(ig, split_costs, &reg_transform, &spill_plan, &split_plan);
       }
@@ -83,6 +83,9 @@ class Allocator {
   struct Config {
     bool no_overwrite_this{false};
     bool use_splitting{false};
+    // The number of allocation rounds that may split live ranges; later
+    // rounds only spill, so that large methods converge. Zero means no limit.
+    size_t max_split_iterations{10};
   };
 
   struct Stats {
@@ -93,6 +96,8 @@ class Allocator {
     size_t split_moves{0};
     size_t moves_coalesced{0};
     size_t params_spill_early{0};
+    // Methods allocated by linear_scan::allocate instead.
+    size_t linear_scan_methods{0};
     size_t moves_inserted() const {
       return param_spill_moves + range_spill_moves + global_spill_moves +
              split_moves;
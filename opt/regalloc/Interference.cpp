@@ -87,8 +87,7 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   //
   // then the final state of the edge between s0 and s1 must be
   // non-coalesceable.
-  m_adj_matrix[build_edge(u, v)] =
-      m_adj_matrix[build_edge(u, v)] || !can_coalesce;
+  m_adj_matrix.add(u, v, can_coalesce);
 }
 
 uint32_t Node::colorable_limit() const {
@@ -222,6 +221,15 @@ void GraphBuilder::update_node_constraints(const IRList::iterator& it,
   }
 }
 
+Graph GraphBuilder::build_nodes(IRCode* code, const RangeSet& range_set) {
+  Graph graph;
+  auto ii = InstructionIterable(code);
+  for (auto it = ii.begin(); it != ii.end(); ++it) {
+    GraphBuilder::update_node_constraints(it.unwrap(), range_set, &graph);
+  }
+  return graph;
+}
+
 /*
  * Build the interference graph by adding edges between nodes that are
  * simultaneously live.
@@ -269,10 +277,13 @@ Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
                           IRCode* code,
                           reg_t initial_regs,
                           const RangeSet& range_set) {
-  Graph graph;
-  auto ii = InstructionIterable(code);
-  for (auto it = ii.begin(); it != ii.end(); ++it) {
-    GraphBuilder::update_node_constraints(it.unwrap(), range_set, &graph);
+  Graph graph = build_nodes(code, range_set);
+  // Past this many registers, the bit matrix would take more memory than the
+  // edges in a hash map typically do.
+  constexpr reg_t kMaxDenseRegs = 1 << 13;
+  auto regs = code->get_registers_size();
+  if (regs <= kMaxDenseRegs) {
+    graph.m_adj_matrix.use_dense_storage(regs);
   }
 
   auto& cfg = code->cfg();
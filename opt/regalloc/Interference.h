@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <boost/dynamic_bitset.hpp>
 #include <boost/functional/hash.hpp>
 #include <boost/range/adaptor/filtered.hpp>
 #include <unordered_map>
@@ -88,6 +89,69 @@ inline reg_pair_t build_edge(reg_t u, reg_t v) {
   return (hi << (sizeof(reg_t) * 8)) | lo;
 }
 
+/*
+ * The interference edges, and whether they may be coalesced. Edges between
+ * registers below the size given to use_dense_storage() live in a triangular
+ * bit matrix, so that the very frequent adjacency checks of graph building
+ * and coalescing are a bit test instead of a hash lookup. Other edges, e.g.
+ * those of graphs built by hand, live in a hash map.
+ */
+class AdjacencyMatrix {
+ public:
+  void use_dense_storage(reg_t size) {
+    m_dense_size = size;
+    auto num_pairs = static_cast<size_t>(size) * (size - 1) / 2;
+    m_adjacent.resize(num_pairs);
+    m_not_coalesceable.resize(num_pairs);
+  }
+
+  bool contains(reg_t u, reg_t v) const {
+    if (is_dense(u, v)) {
+      return m_adjacent.test(dense_index(u, v));
+    }
+    return m_sparse.count(build_edge(u, v)) != 0;
+  }
+
+  // Only meaningful for adjacent nodes.
+  bool is_coalesceable(reg_t u, reg_t v) const {
+    if (is_dense(u, v)) {
+      return !m_not_coalesceable.test(dense_index(u, v));
+    }
+    return !m_sparse.at(build_edge(u, v));
+  }
+
+  // Once an edge isn't coalesceable, it stays so.
+  void add(reg_t u, reg_t v, bool can_coalesce) {
+    if (is_dense(u, v)) {
+      auto index = dense_index(u, v);
+      m_adjacent.set(index);
+      if (!can_coalesce) {
+        m_not_coalesceable.set(index);
+      }
+      return;
+    }
+    auto& not_coalesceable = m_sparse[build_edge(u, v)];
+    not_coalesceable = not_coalesceable || !can_coalesce;
+  }
+
+ private:
+  bool is_dense(reg_t u, reg_t v) const {
+    return u < m_dense_size && v < m_dense_size;
+  }
+
+  static size_t dense_index(reg_t u, reg_t v) {
+    if (u > v) {
+      std::swap(u, v);
+    }
+    return static_cast<size_t>(v) * (v - 1) / 2 + u;
+  }
+
+  reg_t m_dense_size{0};
+  boost::dynamic_bitset<> m_adjacent;
+  boost::dynamic_bitset<> m_not_coalesceable;
+  std::unordered_map<reg_pair_t, bool> m_sparse;
+};
+
 } // namespace impl
 
 class Node {
@@ -191,11 +255,11 @@ class Graph {
   }
 
   bool is_adjacent(reg_t u, reg_t v) const {
-    return m_adj_matrix.find(impl::build_edge(u, v)) != m_adj_matrix.end();
+    return m_adj_matrix.contains(u, v);
   }
 
   bool is_coalesceable(reg_t u, reg_t v) const {
-    return !is_adjacent(u, v) || !m_adj_matrix.at(impl::build_edge(u, v));
+    return !is_adjacent(u, v) || m_adj_matrix.is_coalesceable(u, v);
   }
 
   bool has_containment_edge(reg_t u, reg_t v) const {
@@ -238,7 +302,7 @@ class Graph {
 
  private:
   std::unordered_map<reg_t, Node> m_nodes;
-  std::unordered_map<reg_pair_t, bool> m_adj_matrix;
+  impl::AdjacencyMatrix m_adj_matrix;
   std::unordered_set<reg_pair_t> m_containment_graph;
   // This map contains the LivenessDomains for all instructions which could
   // potentialy take on the /range format.
@@ -282,6 +346,11 @@ class GraphBuilder {
                      reg_t initial_regs,
                      const RangeSet&);
 
+  /*
+   * The nodes of the graph with their constraints, but without any edges.
+   */
+  static Graph build_nodes(IRCode*, const RangeSet&);
+
   // For unit tests
   static Graph create_empty() { return Graph(); }
   static void make_node(Graph*, reg_t, RegisterType, vreg_t max_vreg);
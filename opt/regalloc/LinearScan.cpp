@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LinearScan.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "BitVectorDataflow.h"
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "Interference.h"
+#include "Transform.h"
+#include "VirtualRegistersFile.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+namespace {
+
+/*
+ * The positions from the first to the last one where a symreg is live. The
+ * srcs of the instruction numbered i are read at position 2i and its dest is
+ * written at 2i + 1, so that a src that dies at an instruction can share its
+ * register with the dest.
+ */
+struct Interval {
+  size_t start{std::numeric_limits<size_t>::max()};
+  size_t end{0};
+
+  bool empty() const { return start > end; }
+
+  void extend(size_t pos) {
+    start = std::min(start, pos);
+    end = std::max(end, pos);
+  }
+};
+
+void extend_live_regs(const bitvector_dataflow::BitVector& live,
+                      size_t pos,
+                      std::vector<Interval>* intervals) {
+  for (auto reg = live.find_first(); reg != live.npos;
+       reg = live.find_next(reg)) {
+    (*intervals)[reg].extend(pos);
+  }
+}
+
+/*
+ * Also records in `hints` the symregs that would rather share the register of
+ * another one, which makes the move between them redundant.
+ */
+std::vector<Interval> build_intervals(
+    const cfg::ControlFlowGraph& cfg,
+    std::unordered_map<reg_t, reg_t>* hints) {
+  bitvector_dataflow::Liveness liveness(cfg);
+  liveness.run();
+
+  std::vector<Interval> intervals(cfg.get_registers_size());
+  size_t pos = 0;
+  const IRInstruction* prev_insn = nullptr;
+  for (auto b : cfg.blocks()) {
+    auto block_start = pos;
+    for (const auto& mie : InstructionIterable(b)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      auto use_pos = pos;
+      auto def_pos = pos + 1;
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        auto& interval = intervals[insn->src(i)];
+        interval.extend(use_pos);
+        // Keep the wide srcs of an instruction apart from its dest, as
+        // GraphBuilder::build does.
+        if (insn->has_dest() && insn->src_is_wide(i)) {
+          interval.extend(def_pos);
+        }
+      }
+      if (insn->has_dest()) {
+        auto dest = insn->dest();
+        intervals[dest].extend(def_pos);
+        if (is_move(op)) {
+          hints->emplace(dest, insn->src(0));
+        } else if (opcode::is_move_result_pseudo(op) &&
+                   prev_insn->opcode() == OPCODE_CHECK_CAST) {
+          // The check-cast gets lowered to a move into this register followed
+          // by a check-cast of it, so the register must not be live at the
+          // check-cast. Its own src is best, as it makes the move redundant.
+          intervals[dest].extend(def_pos - 2);
+          hints->emplace(dest, prev_insn->src(0));
+        }
+      }
+      prev_insn = insn;
+      pos += 2;
+    }
+    // The positions of an empty block overlap with the ones of the next
+    // block, which is conservative.
+    auto block_end = pos == block_start ? pos + 1 : pos - 1;
+    extend_live_regs(liveness.get_live_in_vars_at(b), block_start, &intervals);
+    extend_live_regs(liveness.get_live_out_vars_at(b), block_end, &intervals);
+  }
+  return intervals;
+}
+
+} // namespace
+
+bool allocate(const graph_coloring::Allocator::Config& config,
+              DexMethod* method,
+              graph_coloring::Allocator::Stats* stats) {
+  auto code = method->get_code();
+  if (config.no_overwrite_this && !is_static(method)) {
+    return false;
+  }
+  auto range_set = init_range_set(code);
+  if (range_set.size() != 0) {
+    return false;
+  }
+  const auto& cfg = code->cfg();
+  always_assert(!cfg.editable());
+  for (auto b : cfg.blocks()) {
+    if (b != cfg.entry_block() && b->preds().empty()) {
+      return false;
+    }
+  }
+
+  auto ig = interference::impl::GraphBuilder::build_nodes(code, range_set);
+  std::unordered_map<reg_t, reg_t> hints;
+  auto intervals = build_intervals(cfg, &hints);
+
+  std::vector<reg_t> params;
+  std::unordered_set<reg_t> param_set;
+  for (const auto& mie : InstructionIterable(code->get_param_instructions())) {
+    params.push_back(mie.insn->dest());
+    param_set.insert(mie.insn->dest());
+  }
+
+  std::vector<reg_t> order;
+  for (reg_t reg = 0; reg < intervals.size(); ++reg) {
+    if (!intervals[reg].empty() && !param_set.count(reg)) {
+      order.push_back(reg);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](reg_t r1, reg_t r2) {
+    return intervals[r1].start != intervals[r2].start
+               ? intervals[r1].start < intervals[r2].start
+               : r1 < r2;
+  });
+
+  transform::RegMap reg_map;
+  VirtualRegistersFile vreg_file;
+  // The symregs holding a register, by the end of their interval.
+  using ActiveReg = std::pair<size_t, reg_t>;
+  std::priority_queue<ActiveReg, std::vector<ActiveReg>,
+                      std::greater<ActiveReg>>
+      active;
+  for (auto reg : order) {
+    const auto& interval = intervals[reg];
+    while (!active.empty() && active.top().first < interval.start) {
+      auto expired = active.top().second;
+      vreg_file.free(reg_map.at(expired), ig.get_node(expired).width());
+      active.pop();
+    }
+    const auto& node = ig.get_node(reg);
+    vreg_t vreg;
+    auto hint_it = hints.find(reg);
+    auto hinted = hint_it == hints.end() ? reg_map.end()
+                                         : reg_map.find(hint_it->second);
+    if (hinted != reg_map.end() && hinted->second <= node.max_vreg() &&
+        vreg_file.is_free(hinted->second, node.width())) {
+      vreg = hinted->second;
+      vreg_file.alloc_at(vreg, node.width());
+    } else {
+      vreg = vreg_file.alloc(node.width());
+    }
+    if (vreg > node.max_vreg()) {
+      return false;
+    }
+    reg_map.emplace(reg, vreg);
+    active.emplace(interval.end, reg);
+  }
+
+  vreg_t next_vreg = vreg_file.size();
+  for (auto reg : params) {
+    const auto& node = ig.get_node(reg);
+    if (next_vreg > node.max_vreg()) {
+      return false;
+    }
+    reg_map.emplace(reg, next_vreg);
+    next_vreg += node.width();
+  }
+
+  transform::remap_registers(code, reg_map);
+  code->set_registers_size(next_vreg);
+  auto ii = InstructionIterable(code);
+  for (auto it = ii.begin(); it != ii.end(); ++it) {
+    auto insn = it->insn;
+    if (is_move(insn->opcode()) && insn->dest() == insn->src(0)) {
+      code->remove_opcode(it.unwrap());
+      ++stats->moves_coalesced;
+    }
+  }
+  ++stats->linear_scan_methods;
+  return true;
+}
+
+} // namespace linear_scan
+
+} // namespace regalloc
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "GraphColoring.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+/*
+ * A cheaper allocator for the methods where the quality of the allocation
+ * matters little, e.g. the ones that never run. Instead of building and
+ * coloring an interference graph, it numbers the instructions, turns the
+ * liveness of each symreg into a single interval over these numbers, and
+ * assigns registers to the intervals in one pass, freeing the registers of
+ * the intervals that have ended.
+ *
+ * Intervals are conservative, so the allocation is correct but may use more
+ * registers than graph coloring. Moves whose src and dest end up in the same
+ * register are removed. The params get the registers at the end of the
+ * frame, in order, and are never shared with other symregs.
+ *
+ * This never spills: it gives up on the methods that need it, namely the
+ * ones with range instructions or with a symreg whose encoding constraints
+ * the interval allocation doesn't meet. It also gives up on the methods whose
+ * `this` must not be overwritten and on the ones with unreachable blocks.
+ * The code is left untouched when giving up, and the caller should fall back
+ * to graph coloring.
+ *
+ * The code must have had its registers renumbered, and have a non-editable
+ * CFG.
+ */
+bool allocate(const graph_coloring::Allocator::Config&,
+              DexMethod*,
+              graph_coloring::Allocator::Stats*);
+
+} // namespace linear_scan
+
+} // namespace regalloc
@@ -15,6 +15,7 @@
 #include "IRAssembler.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
+#include "LinearScan.h"
 #include "LiveRange.h"
 #include "Show.h"
 #include "Transform.h"
@@ -27,7 +28,9 @@ namespace regalloc {
 using Stats = graph_coloring::Allocator::Stats;
 
 Stats RegAllocPass::allocate(
-    const graph_coloring::Allocator::Config& allocator_config, DexMethod* m) {
+    const graph_coloring::Allocator::Config& allocator_config,
+    DexMethod* m,
+    bool try_linear_scan) {
   if (m->get_code() == nullptr) {
     return Stats();
   }
@@ -38,6 +41,14 @@ Stats RegAllocPass::allocate(
     // The transformations below all require a CFG. Build it once
     // here instead of requiring each transform to build it.
     code.build_cfg(/* editable */ false);
+    if (try_linear_scan) {
+      Stats stats;
+      if (linear_scan::allocate(allocator_config, m, &stats)) {
+        TRACE(REG, 5, "After linear scan: regs:%d code:\n%s",
+              code.get_registers_size(), SHOW(&code));
+        return stats;
+      }
+    }
     graph_coloring::Allocator allocator(allocator_config);
     allocator.allocate(m);
     TRACE(REG, 5, "After alloc: regs:%d code:\n%s", code.get_registers_size(),
@@ -62,17 +73,49 @@ Stats RegAllocPass::allocate(
 }
 
 void RegAllocPass::run_pass(DexStoresVector& stores,
-                            ConfigFiles&,
+                            ConfigFiles& conf,
                             PassManager& mgr) {
   graph_coloring::Allocator::Config allocator_config;
   const auto& jw = mgr.get_current_pass_info()->config;
   jw.get("live_range_splitting", false, allocator_config.use_splitting);
+  jw.get("live_range_splitting_max_iterations", size_t(10),
+         allocator_config.max_split_iterations);
   allocator_config.no_overwrite_this =
       mgr.get_redex_options().no_overwrite_this();
+  bool linear_scan_cold_methods;
+  size_t linear_scan_max_instructions;
+  jw.get("linear_scan_cold_methods", false, linear_scan_cold_methods);
+  jw.get("linear_scan_max_instructions", size_t(0),
+         linear_scan_max_instructions);
+
+  // Graph coloring pays off for the methods that run. When profiles are
+  // available, the cold methods are the ones they don't mention; otherwise we
+  // have to make do with the small ones.
+  const auto& method_profiles = conf.get_method_profiles();
+  auto is_cold = [&](DexMethod* m) {
+    if (!linear_scan_cold_methods || m->get_code() == nullptr) {
+      return false;
+    }
+    if (method_profiles.has_stats() &&
+        method_profiles.method_stats().count(m)) {
+      return false;
+    }
+    if (linear_scan_max_instructions == 0) {
+      return method_profiles.has_stats();
+    }
+    return m->get_code()->count_opcodes() <= linear_scan_max_instructions;
+  };
 
   auto scope = build_class_scope(stores);
+  // Allocation time grows superlinearly with method size; schedule the
+  // largest methods first so that they don't end up as the long tail.
   auto stats = walk::parallel::methods<Stats>(
-      scope, [&](DexMethod* m) { return allocate(allocator_config, m); });
+      scope,
+      [&](DexMethod* m) {
+        return allocate(allocator_config, m, is_cold(m));
+      },
+      redex_parallel::default_num_threads(), Stats(),
+      walk::parallel::Schedule::BY_COST);
 
   TRACE(REG, 1, "Total reiteration count: %lu", stats.reiteration_count);
   TRACE(REG, 1, "Total Params spilled early: %lu", stats.params_spill_early);
@@ -83,12 +126,14 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
   TRACE(REG, 1, "  Total splits: %lu", stats.split_moves);
   TRACE(REG, 1, "Total coalesce count: %lu", stats.moves_coalesced);
   TRACE(REG, 1, "Total net moves: %ld", stats.net_moves());
+  TRACE(REG, 1, "Linear scan methods: %lu", stats.linear_scan_methods);
 
   mgr.incr_metric("param spilled too early", stats.params_spill_early);
   mgr.incr_metric("reiteration_count", stats.reiteration_count);
   mgr.incr_metric("spill_count", stats.moves_inserted());
   mgr.incr_metric("coalesce_count", stats.moves_coalesced);
   mgr.incr_metric("net_moves", stats.net_moves());
+  mgr.incr_metric("linear_scan_methods", stats.linear_scan_methods);
 
   mgr.record_running_regalloc();
 }
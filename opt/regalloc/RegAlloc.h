@@ -21,13 +21,20 @@ class RegAllocPass : public Pass {
   void bind_config() override {
     bool unused;
     bind("live_range_splitting", false, unused);
+    size_t unused_size;
+    bind("live_range_splitting_max_iterations", size_t(10), unused_size);
+    bind("linear_scan_cold_methods", false, unused);
+    bind("linear_scan_max_instructions", size_t(0), unused_size);
   }
 
   /*
-   * Allocate the code in a single method; exposed for unit tests.
+   * Allocate the code in a single method; exposed for unit tests. With
+   * `try_linear_scan`, the cheaper linear_scan::allocate gets a go first.
    */
   static graph_coloring::Allocator::Stats allocate(
-      const graph_coloring::Allocator::Config&, DexMethod*);
+      const graph_coloring::Allocator::Config&,
+      DexMethod*,
+      bool try_linear_scan = false);
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 };
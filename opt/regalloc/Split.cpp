@@ -9,6 +9,25 @@
 
 namespace regalloc {
 
+namespace {
+
+// The registers that die on the edge into a block with the given live-in
+// registers, i.e. LiveOut(pred) - LiveIn(succ). The liveness sets of
+// neighboring blocks share most of their structure, which the difference
+// skips, so this is much cheaper than checking every live-out register.
+sparta::PatriciaTreeSet<reg_t> get_deaths_on_edge(
+    const LivenessDomain& live_out, const LivenessDomain& live_in) {
+  if (live_in.is_bottom()) {
+    return live_out.elements();
+  }
+  if (live_in.is_top()) {
+    return sparta::PatriciaTreeSet<reg_t>();
+  }
+  return live_out.elements().get_difference_with(live_in.elements());
+}
+
+} // namespace
+
 // Calculate potential split costs for each live range. Also store information
 // of catch block and move-result for later use.
 void calc_split_costs(const LivenessFixpointIterator& fixpoint_iter,
@@ -22,16 +41,14 @@ void calc_split_costs(const LivenessFixpointIterator& fixpoint_iter,
     for (auto& succ : block->succs()) {
       LivenessDomain live_in =
           fixpoint_iter.get_live_in_vars_at(succ->target());
-      for (auto reg : live_out.elements()) {
-        if (!live_in.contains(reg)) {
-          split_costs->increase_load(reg);
-          // Record how many death on edge occured at certain catch block.
-          if (succ->type() == cfg::EDGE_THROW) {
-            split_costs->add_catch_block(reg, succ->target());
-          } else {
-            // Record death on edge to non-catch block;
-            split_costs->add_other_block(reg, succ->target());
-          }
+      for (auto reg : get_deaths_on_edge(live_out, live_in)) {
+        split_costs->increase_load(reg);
+        // Record how many death on edge occured at certain catch block.
+        if (succ->type() == cfg::EDGE_THROW) {
+          split_costs->add_catch_block(reg, succ->target());
+        } else {
+          // Record death on edge to non-catch block;
+          split_costs->add_other_block(reg, succ->target());
         }
       }
     }
@@ -147,10 +164,7 @@ size_t split_for_block(const SplitPlan& split_plan,
   size_t split_move = 0;
   for (auto& succ : block->succs()) {
     LivenessDomain live_in = fixpoint_iter.get_live_in_vars_at(succ->target());
-    for (auto reg : live_out.elements()) {
-      if (live_in.contains(reg)) {
-        continue;
-      }
+    for (auto reg : get_deaths_on_edge(live_out, live_in)) {
       auto split_it = split_plan.split_around.find(reg);
       if (split_it == split_plan.split_around.end()) {
         continue;
@@ -12,16 +12,17 @@
 #include <unordered_map>
 #include <vector>
 
+#include "BitVectorDataflow.h"
 #include "CallGraph.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
-#include "Liveness.h"
 #include "Match.h"
 #include "MethodOverrideGraph.h"
 #include "OptData.h"
 #include "OptDataDefs.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace mog = method_override_graph;
 
@@ -50,6 +51,97 @@ static LocalDce::Stats add_dce_stats(LocalDce::Stats a, LocalDce::Stats b) {
           a.unreachable_instruction_count + b.unreachable_instruction_count};
 };
 
+/**
+ * Inspects all invoke instructions of the caller, and whether they are
+ * followed by move-result instructions.
+ */
+CallIndex::Calls CallIndex::scan(DexMethod* caller) {
+  Calls calls;
+  auto code = caller->get_code();
+  if (code == nullptr) {
+    return calls;
+  }
+  const auto ii = InstructionIterable(code);
+  for (auto it = ii.begin(); it != ii.end(); it++) {
+    auto insn = it->insn;
+    if (!is_invoke(insn->opcode())) {
+      continue;
+    }
+    auto method = insn->get_method()->as_def();
+    if (!method) {
+      // TODO: T31388603 -- Remove unused results for true virtuals.
+      continue;
+    }
+    calls.callees.push_back(method);
+    const auto next = std::next(it);
+    always_assert(next != ii.end());
+    if (opcode::is_move_result(next->insn->opcode())) {
+      calls.results_used.push_back(method);
+    }
+  }
+  return calls;
+}
+
+void CallIndex::add(DexMethod* caller, Calls calls) {
+  for (auto callee : calls.callees) {
+    m_callers[callee].insert(caller);
+  }
+  for (auto callee : calls.results_used) {
+    ++m_result_uses[callee];
+  }
+  m_calls[caller] = std::move(calls);
+}
+
+CallIndex::CallIndex(const Scope& scope) {
+  std::vector<DexMethod*> methods;
+  walk::code(scope, [&](DexMethod* method, IRCode&) {
+    methods.push_back(method);
+  });
+  std::vector<Calls> calls(methods.size());
+  redex_parallel::parallel_for(
+      0, methods.size(), [&](size_t i) { calls[i] = scan(methods[i]); });
+  for (size_t i = 0; i < methods.size(); ++i) {
+    add(methods[i], std::move(calls[i]));
+  }
+}
+
+std::vector<DexMethod*> CallIndex::update(
+    const std::vector<DexMethod*>& changed) {
+  std::vector<Calls> calls(changed.size());
+  redex_parallel::parallel_for(
+      0, changed.size(), [&](size_t i) { calls[i] = scan(changed[i]); });
+
+  std::vector<DexMethod*> updatable(changed);
+  for (size_t i = 0; i < changed.size(); ++i) {
+    auto it = m_calls.find(changed[i]);
+    if (it != m_calls.end()) {
+      for (auto callee : it->second.results_used) {
+        if (--m_result_uses.at(callee) == 0) {
+          updatable.push_back(callee);
+        }
+      }
+    }
+    add(changed[i], std::move(calls[i]));
+  }
+  sort_unique(updatable, compare_dexmethods);
+  // Callees whose results got used again by the same callers are not
+  // updatable after all, but looking at them again is harmless.
+  return updatable;
+}
+
+std::vector<DexMethod*> CallIndex::get_callers(
+    const std::vector<DexMethod*>& callees) const {
+  std::vector<DexMethod*> callers;
+  for (auto callee : callees) {
+    auto it = m_callers.find(callee);
+    if (it != m_callers.end()) {
+      callers.insert(callers.end(), it->second.begin(), it->second.end());
+    }
+  }
+  sort_unique(callers, compare_dexmethods);
+  return callers;
+}
+
 /**
  * Returns metrics as listed above from running RemoveArgs:
  * run() removes unused params from method signatures and param loads, then
@@ -57,7 +149,11 @@ static LocalDce::Stats add_dce_stats(LocalDce::Stats a, LocalDce::Stats b) {
  */
 RemoveArgs::PassStats RemoveArgs::run() {
   RemoveArgs::PassStats pass_stats;
-  gather_results_used();
+  if (m_call_index == nullptr) {
+    m_own_call_index = std::make_unique<CallIndex>(m_scope);
+    m_call_index = m_own_call_index.get();
+  }
+  m_changed_methods.clear();
   auto method_stats = update_meths_with_unused_args_or_results();
   pass_stats.method_params_removed_count =
       method_stats.method_params_removed_count;
@@ -69,35 +165,6 @@ RemoveArgs::PassStats RemoveArgs::run() {
   return pass_stats;
 }
 
-/**
- * Inspects all invoke instructions, and whether they are followed by
- * move-result instructions, and record this information for each method.
- */
-void RemoveArgs::gather_results_used() {
-  walk::parallel::code(
-      m_scope, [& result_used = m_result_used](DexMethod*, IRCode& code) {
-        const auto ii = InstructionIterable(code);
-        for (auto it = ii.begin(); it != ii.end(); it++) {
-          auto insn = it->insn;
-          if (!is_invoke(insn->opcode())) {
-            continue;
-          }
-          const auto next = std::next(it);
-          always_assert(next != ii.end());
-          const auto peek = next->insn;
-          if (!opcode::is_move_result(peek->opcode())) {
-            continue;
-          }
-          auto method = insn->get_method()->as_def();
-          if (!method) {
-            // TODO: T31388603 -- Remove unused results for true virtuals.
-            continue;
-          }
-          result_used.insert(method);
-        }
-      });
-}
-
 /**
  * Returns a vector of live argument indices.
  * Updates dead_insns with the load_params that await removal.
@@ -114,9 +181,8 @@ std::deque<uint16_t> RemoveArgs::compute_live_args(
   auto code = method->get_code();
   code->build_cfg(/* editable */ false);
   auto& cfg = code->cfg();
-  cfg.calculate_exit_block();
-  LivenessFixpointIterator fixpoint_iter(cfg);
-  fixpoint_iter.run(LivenessDomain());
+  bitvector_dataflow::Liveness fixpoint_iter(cfg);
+  fixpoint_iter.run();
   auto entry_block = cfg.entry_block();
 
   std::deque<uint16_t> live_arg_idxs;
@@ -132,7 +198,7 @@ std::deque<uint16_t> RemoveArgs::compute_live_args(
     }
     auto insn = it->insn;
     if (opcode::is_load_param(insn->opcode())) {
-      if (live_vars.contains(insn->dest()) ||
+      if (live_vars.test(insn->dest()) ||
           (is_instance_method && it->insn == first_insn)) {
         // Mark live args live, and always mark the "this" arg live.
         live_arg_idxs.push_front(last_arg_idx);
@@ -252,12 +318,19 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
   };
   ConcurrentMap<DexMethod*, Entry> unordered_entries;
   auto override_graph = mog::build_graph(m_scope);
-  walk::parallel::methods(m_scope, [&](DexMethod* method) {
+  std::vector<DexMethod*> all_methods;
+  if (m_candidates == nullptr) {
+    walk::methods(m_scope,
+                  [&](DexMethod* method) { all_methods.push_back(method); });
+  }
+  const auto& candidates = m_candidates ? *m_candidates : all_methods;
+  redex_parallel::parallel_for(0, candidates.size(), [&](size_t i) {
+    auto method = candidates[i];
     if (method->get_code() == nullptr) {
       return;
     }
     auto proto = method->get_proto();
-    bool result_used = !!m_result_used.count_unsafe(method);
+    bool result_used = m_call_index->is_result_used(method);
     auto num_args = proto->get_args()->size();
     bool remove_result = !proto->is_void() && !result_used;
     // For instance methods, num_args does not count the 'this' argument.
@@ -323,6 +396,7 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
     method_stats.methods_updated_count++;
     method_stats.method_params_removed_count += entry.dead_insns.size();
     method_stats.method_results_removed_count += entry.remove_result ? 1 : 0;
+    m_changed_methods.push_back(method);
   }
   sort_unique(classes);
 
@@ -400,26 +474,40 @@ size_t RemoveArgs::update_callsite(IRInstruction* instr) {
  * removed.
  */
 size_t RemoveArgs::update_callsites() {
-  // Walk through all methods to look for and edit callsites.
-  return walk::parallel::methods<size_t>(
-      m_scope, [&](DexMethod* method) -> size_t {
-        auto code = method->get_code();
-        if (code == nullptr) {
-          return 0;
-        }
-        size_t callsite_args_removed = 0;
-        for (const auto& mie : InstructionIterable(code)) {
-          auto insn = mie.insn;
-          if (is_invoke(insn->opcode())) {
-            size_t insn_args_removed = update_callsite(insn);
-            if (insn_args_removed > 0) {
-              log_opt(CALLSITE_ARGS_REMOVED, method, insn);
-              callsite_args_removed += insn_args_removed;
-            }
-          }
+  // Only the callers of the methods that lost arguments have callsites to
+  // edit.
+  std::vector<DexMethod*> callees;
+  for (const auto& pair : m_live_arg_idxs_map) {
+    callees.push_back(pair.first);
+  }
+  auto callers = m_call_index->get_callers(callees);
+  std::vector<size_t> args_removed(callers.size());
+  redex_parallel::parallel_for(0, callers.size(), [&](size_t i) {
+    auto method = callers[i];
+    auto code = method->get_code();
+    if (code == nullptr) {
+      return;
+    }
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (is_invoke(insn->opcode())) {
+        size_t insn_args_removed = update_callsite(insn);
+        if (insn_args_removed > 0) {
+          log_opt(CALLSITE_ARGS_REMOVED, method, insn);
+          args_removed[i] += insn_args_removed;
         }
-        return callsite_args_removed;
-      });
+      }
+    }
+  });
+  size_t callsite_args_removed = 0;
+  for (size_t i = 0; i < callers.size(); ++i) {
+    if (args_removed[i] > 0) {
+      callsite_args_removed += args_removed[i];
+      m_changed_methods.push_back(callers[i]);
+    }
+  }
+  sort_unique(m_changed_methods, compare_dexmethods);
+  return callsite_args_removed;
 }
 
 void RemoveUnusedArgsPass::run_pass(DexStoresVector& stores,
@@ -433,13 +521,22 @@ void RemoveUnusedArgsPass::run_pass(DexStoresVector& stores,
   size_t num_method_results_removed_count = 0;
   size_t num_iterations = 0;
   LocalDce::Stats local_dce_stats{0, 0};
-  while (true) {
+  // The first iteration looks at all methods; the following ones only at those
+  // that the previous iteration may have made updatable, e.g. the callers that
+  // passed arguments along to removed parameters.
+  CallIndex call_index(scope);
+  std::vector<DexMethod*> candidates;
+  walk::methods(scope,
+                [&](DexMethod* method) { candidates.push_back(method); });
+  while (!candidates.empty()) {
     num_iterations++;
-    RemoveArgs rm_args(scope, m_black_list, m_total_iterations++);
+    RemoveArgs rm_args(scope, m_black_list, m_total_iterations++, &call_index,
+                       &candidates);
     auto pass_stats = rm_args.run();
     if (pass_stats.methods_updated_count == 0) {
       break;
     }
+    candidates = call_index.update(rm_args.get_changed_methods());
     num_callsite_args_removed += pass_stats.callsite_args_removed_count;
     num_method_params_removed += pass_stats.method_params_removed_count;
     num_methods_updated += pass_stats.methods_updated_count;
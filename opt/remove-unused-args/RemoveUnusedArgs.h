@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <memory>
 #include <mutex>
 
 #include "ConcurrentContainers.h"
@@ -15,6 +16,51 @@
 
 namespace remove_unused_args {
 
+/*
+ * The invokes of the methods of a scope, by caller and by callee. It is built
+ * once and then kept up to date across the iterations of the pass by
+ * rescanning only the methods whose code changed, so that each iteration only
+ * looks at the methods that the previous one may have made updatable.
+ *
+ * Like the rest of the pass, it only knows about invokes of method
+ * definitions.
+ */
+class CallIndex {
+ public:
+  explicit CallIndex(const Scope& scope);
+
+  // Rescans the code of `changed`, and returns the methods that may have
+  // become updatable: the changed methods, which may pass along fewer
+  // arguments, and the callees whose results are no longer used.
+  std::vector<DexMethod*> update(const std::vector<DexMethod*>& changed);
+
+  // Whether some invoke of `callee` is followed by a move-result.
+  bool is_result_used(const DexMethod* callee) const {
+    auto it = m_result_uses.find(callee);
+    return it != m_result_uses.end() && it->second > 0;
+  }
+
+  // The methods that invoke any of `callees`, in a deterministic order.
+  std::vector<DexMethod*> get_callers(
+      const std::vector<DexMethod*>& callees) const;
+
+ private:
+  struct Calls {
+    std::vector<DexMethod*> callees;
+    // The callees whose results are moved, once per invoke.
+    std::vector<DexMethod*> results_used;
+  };
+
+  static Calls scan(DexMethod* caller);
+  void add(DexMethod* caller, Calls calls);
+
+  std::unordered_map<const DexMethod*, Calls> m_calls;
+  // May keep callers that don't invoke the callee anymore.
+  std::unordered_map<const DexMethod*, std::unordered_set<DexMethod*>>
+      m_callers;
+  std::unordered_map<const DexMethod*, size_t> m_result_uses;
+};
+
 class RemoveArgs {
  public:
   struct MethodStats {
@@ -31,11 +77,23 @@ class RemoveArgs {
     LocalDce::Stats local_dce_stats{0, 0};
   };
 
+  // Only `candidates` are considered for updates, all the methods of the
+  // scope if null. Without a shared `call_index`, one is built for the scope.
   RemoveArgs(const Scope& scope,
              const std::vector<std::string>& black_list,
-             size_t iteration = 0)
-      : m_scope(scope), m_black_list(black_list), m_iteration(iteration){};
+             size_t iteration = 0,
+             CallIndex* call_index = nullptr,
+             const std::vector<DexMethod*>* candidates = nullptr)
+      : m_scope(scope),
+        m_black_list(black_list),
+        m_iteration(iteration),
+        m_call_index(call_index),
+        m_candidates(candidates){};
   RemoveArgs::PassStats run();
+  // The methods whose signature or code the last run changed.
+  const std::vector<DexMethod*>& get_changed_methods() const {
+    return m_changed_methods;
+  }
   std::deque<uint16_t> compute_live_args(
       DexMethod* method,
       size_t num_args,
@@ -46,9 +104,12 @@ class RemoveArgs {
   ConcurrentMap<DexMethod*, std::deque<uint16_t>> m_live_arg_idxs_map;
   std::unordered_map<DexString*, std::unordered_map<DexTypeList*, size_t>>
       m_renamed_indices;
-  ConcurrentSet<DexMethod*> m_result_used;
   const std::vector<std::string>& m_black_list;
   size_t m_iteration;
+  CallIndex* m_call_index;
+  std::unique_ptr<CallIndex> m_own_call_index;
+  const std::vector<DexMethod*>* m_candidates;
+  std::vector<DexMethod*> m_changed_methods;
 
   std::deque<DexType*> get_live_arg_type_list(
       DexMethod* method, const std::deque<uint16_t>& live_arg_idxs);
@@ -58,7 +119,6 @@ class RemoveArgs {
   MethodStats update_meths_with_unused_args_or_results();
   size_t update_callsite(IRInstruction* instr);
   size_t update_callsites();
-  void gather_results_used();
 };
 
 class RemoveUnusedArgsPass : public Pass {
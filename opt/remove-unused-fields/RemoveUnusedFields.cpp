@@ -11,6 +11,7 @@
 #include "DexClass.h"
 #include "FieldOpTracker.h"
 #include "IRCode.h"
+#include "LocalDce.h"
 #include "Resolver.h"
 #include "Walkers.h"
 
@@ -31,10 +32,22 @@ bool has_non_zero_static_value(DexField* field) {
 
 class RemoveUnusedFields final {
  public:
-  RemoveUnusedFields(const Config& config, const Scope& scope)
-      : m_config(config), m_scope(scope) {
-    analyze();
-    transform();
+  RemoveUnusedFields(const Config& config,
+                     const Scope& scope,
+                     const std::unordered_set<DexMethodRef*>& pure_methods)
+      : m_config(config), m_scope(scope), m_pure_methods(pure_methods) {
+    // analyze_non_zero_writes, analyze_read_uses and transform() need
+    // (editable) cfg
+    walk::parallel::code(m_scope, [&](const DexMethod*, IRCode& code) {
+      code.build_cfg(/* editable = true*/);
+    });
+    // Removing the writes to some fields may leave the reads of others dead.
+    while (analyze()) {
+      ++m_iterations;
+      transform();
+    }
+    walk::parallel::code(
+        m_scope, [&](const DexMethod*, IRCode& code) { code.clear_cfg(); });
   }
 
   const std::unordered_set<const DexField*>& unread_fields() const {
@@ -49,7 +62,26 @@ class RemoveUnusedFields final {
     return m_zero_written_fields;
   }
 
+  const std::unordered_set<const DexField*>& write_only_fields() const {
+    return m_write_only_fields;
+  }
+
+  size_t iterations() const { return m_iterations; }
+
+  const LocalDce::Stats& local_dce_stats() const { return m_local_dce_stats; }
+
  private:
+  enum class Action {
+    REMOVE_WRITES,
+    REPLACE_READS,
+    REMOVE_WRITES_AND_REPLACE_READS,
+  };
+
+  size_t num_fields() const {
+    return m_unread_fields.size() + m_unwritten_fields.size() +
+           m_zero_written_fields.size() + m_write_only_fields.size();
+  }
+
   bool is_blacklisted(const DexField* field) const {
     return m_config.blacklist_types.count(field->get_type()) != 0 ||
            m_config.blacklist_classes.count(field->get_class()) != 0;
@@ -59,20 +91,33 @@ class RemoveUnusedFields final {
     return !m_config.whitelist || m_config.whitelist->count(field) != 0;
   }
 
-  void analyze() {
+  // Finds the fields to remove in this iteration, and returns whether any of
+  // them are new.
+  bool analyze() {
+    m_iteration_fields.clear();
+    auto num_previous_fields = num_fields();
     field_op_tracker::FieldStatsMap field_stats =
         field_op_tracker::analyze(m_scope);
 
-    // analyze_non_zero_writes and the later transform() need (editable) cfg
-    walk::parallel::code(m_scope, [&](const DexMethod*, IRCode& code) {
-      code.build_cfg(/* editable = true*/);
-    });
-
     boost::optional<field_op_tracker::NonZeroWrittenFields> non_zero_writes;
     if (m_config.remove_zero_written_fields) {
       non_zero_writes = field_op_tracker::analyze_non_zero_writes(m_scope);
     }
 
+    std::unordered_set<DexField*> write_only_fields;
+    if (m_config.remove_write_only_fields) {
+      std::unordered_set<DexField*> candidates;
+      for (auto& pair : field_stats) {
+        auto* field = pair.first;
+        if (can_remove(field) && !is_blacklisted(field) &&
+            is_whitelisted(field)) {
+          candidates.emplace(field);
+        }
+      }
+      write_only_fields = field_op_tracker::get_write_only_fields(
+          field_op_tracker::analyze_read_uses(m_scope), candidates);
+    }
+
     for (auto& pair : field_stats) {
       auto* field = pair.first;
       auto& stats = pair.second;
@@ -88,26 +133,39 @@ class RemoveUnusedFields final {
           is_whitelisted(field)) {
         if (m_config.remove_unread_fields && stats.reads == 0) {
           m_unread_fields.emplace(field);
+          m_iteration_fields.emplace(field, Action::REMOVE_WRITES);
+        } else if (write_only_fields.count(field)) {
+          m_write_only_fields.emplace(field);
+          m_iteration_fields.emplace(field, Action::REMOVE_WRITES);
         } else if (m_config.remove_unwritten_fields && stats.writes == 0 &&
                    !has_non_zero_static_value(field)) {
           m_unwritten_fields.emplace(field);
+          m_iteration_fields.emplace(field, Action::REPLACE_READS);
         } else if (m_config.remove_zero_written_fields &&
                    !non_zero_writes->count(field) &&
                    !has_non_zero_static_value(field)) {
           m_zero_written_fields.emplace(field);
+          m_iteration_fields.emplace(field,
+                                     Action::REMOVE_WRITES_AND_REPLACE_READS);
         }
       }
     }
     TRACE(RMUF, 2, "unread_fields %u", m_unread_fields.size());
     TRACE(RMUF, 2, "unwritten_fields %u", m_unwritten_fields.size());
     TRACE(RMUF, 2, "zero written_fields %u", m_zero_written_fields.size());
+    TRACE(RMUF, 2, "write_only_fields %u", m_write_only_fields.size());
+    return num_fields() > num_previous_fields;
   }
 
-  void transform() const {
+  void transform() {
     // Replace reads to unwritten fields with appropriate const-0 instructions,
-    // and remove the writes to unread fields.
+    // and remove the writes to unread fields. The reads of write-only fields
+    // are left to LocalDce, which also removes the computations of the values
+    // that were written.
+    std::mutex local_dce_stats_mutex;
     walk::parallel::code(m_scope, [&](const DexMethod*, IRCode& code) {
       auto& cfg = code.cfg();
+      bool removed_writes = false;
       cfg::CFGMutation m(cfg);
       auto iterable = cfg::InstructionIterable(cfg);
       for (auto insn_it = iterable.begin(); insn_it != iterable.end();
@@ -117,25 +175,33 @@ class RemoveUnusedFields final {
           continue;
         }
         auto field = resolve_field(insn->get_field());
+        auto action_it = m_iteration_fields.find(field);
+        if (action_it == m_iteration_fields.end()) {
+          continue;
+        }
+        auto action = action_it->second;
+        bool is_write = is_iput(insn->opcode()) || is_sput(insn->opcode());
         bool replace_insn = false;
         bool remove_insn = false;
-        if (m_unread_fields.count(field)) {
-          always_assert(is_iput(insn->opcode()) || is_sput(insn->opcode()));
+        if (action == Action::REMOVE_WRITES) {
+          always_assert(is_write || m_write_only_fields.count(field));
+          if (is_write) {
+            TRACE(RMUF, 5, "Removing %s", SHOW(insn));
+            remove_insn = true;
+            removed_writes = true;
+          }
+        } else if (action == Action::REPLACE_READS) {
+          always_assert(!is_write);
+          TRACE(RMUF, 5, "Replacing %s with const 0", SHOW(insn));
+          replace_insn = true;
+        } else if (is_write) {
           TRACE(RMUF, 5, "Removing %s", SHOW(insn));
           remove_insn = true;
-        } else if (m_unwritten_fields.count(field)) {
+          removed_writes = true;
+        } else {
           always_assert(is_iget(insn->opcode()) || is_sget(insn->opcode()));
           TRACE(RMUF, 5, "Replacing %s with const 0", SHOW(insn));
           replace_insn = true;
-        } else if (m_zero_written_fields.count(field)) {
-          if (is_iput(insn->opcode()) || is_sput(insn->opcode())) {
-            TRACE(RMUF, 5, "Removing %s", SHOW(insn));
-            remove_insn = true;
-          } else {
-            always_assert(is_iget(insn->opcode()) || is_sget(insn->opcode()));
-            TRACE(RMUF, 5, "Replacing %s with const 0", SHOW(insn));
-            replace_insn = true;
-          }
         }
         if (replace_insn) {
           auto move_result = cfg.move_result_of(insn_it);
@@ -152,15 +218,29 @@ class RemoveUnusedFields final {
         }
       }
       m.flush();
-      code.clear_cfg();
+      if (removed_writes) {
+        LocalDce local_dce(m_pure_methods);
+        local_dce.dce(&code);
+        std::lock_guard<std::mutex> lock(local_dce_stats_mutex);
+        m_local_dce_stats.dead_instruction_count +=
+            local_dce.get_stats().dead_instruction_count;
+        m_local_dce_stats.unreachable_instruction_count +=
+            local_dce.get_stats().unreachable_instruction_count;
+      }
     });
   }
 
   const Config& m_config;
   const Scope& m_scope;
+  const std::unordered_set<DexMethodRef*>& m_pure_methods;
+  // The fields to remove in the current iteration.
+  std::unordered_map<const DexField*, Action> m_iteration_fields;
+  size_t m_iterations{0};
+  LocalDce::Stats m_local_dce_stats{0, 0};
   std::unordered_set<const DexField*> m_unread_fields;
   std::unordered_set<const DexField*> m_unwritten_fields;
   std::unordered_set<const DexField*> m_zero_written_fields;
+  std::unordered_set<const DexField*> m_write_only_fields;
 };
 
 } // namespace
@@ -171,10 +251,14 @@ void PassImpl::run_pass(DexStoresVector& stores,
                         ConfigFiles& conf,
                         PassManager& mgr) {
   auto scope = build_class_scope(stores);
-  RemoveUnusedFields rmuf(m_config, scope);
+  RemoveUnusedFields rmuf(m_config, scope, conf.get_pure_methods());
   mgr.set_metric("unread_fields", rmuf.unread_fields().size());
   mgr.set_metric("unwritten_fields", rmuf.unwritten_fields().size());
   mgr.set_metric("zero written_fields", rmuf.zero_written_fields().size());
+  mgr.set_metric("write_only_fields", rmuf.write_only_fields().size());
+  mgr.set_metric("iterations", rmuf.iterations());
+  mgr.set_metric("dead_instructions",
+                 rmuf.local_dce_stats().dead_instruction_count);
 
   if (m_export_removed) {
     std::vector<const DexField*> removed_fields(rmuf.unread_fields().begin(),
@@ -182,6 +266,9 @@ void PassImpl::run_pass(DexStoresVector& stores,
     removed_fields.insert(removed_fields.end(),
                           rmuf.unwritten_fields().begin(),
                           rmuf.unwritten_fields().end());
+    removed_fields.insert(removed_fields.end(),
+                          rmuf.write_only_fields().begin(),
+                          rmuf.write_only_fields().end());
     sort_unique(removed_fields, compare_dexfields);
     auto path = conf.metafile(REMOVED_FIELDS_FILENAME);
     std::ofstream ofs(path, std::ofstream::out | std::ofstream::trunc);
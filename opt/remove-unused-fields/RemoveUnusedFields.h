@@ -15,12 +15,15 @@
  * a non-zero static value get all of their read instructions replaced by
  * const 0 instructions.
  *
+ * Fields whose read values are only ever written back to such write-only
+ * fields, as in `this.count = this.count + 1`, are treated as unread too: all
+ * writes to them get removed, and LocalDce then removes their reads along with
+ * the computations of the values that were written. As that may leave more
+ * fields unread, the pass iterates until it finds no more fields to remove.
+ *
  * This pass relies on RemoveUnreachablePass running afterward to remove the
  * definitions of those fields entirely.
  *
- * Possible future work: This could be extended to eliminate fields that are
- * only used in non-escaping contexts.
- *
  * NOTE: Removing writes to fields may affect the life-time of an object, if all
  * other references to it are weak. Thus, this is a somewhat unsafe, or at least
  * potentially behavior altering optimization.
@@ -33,6 +36,7 @@ struct Config {
   bool remove_unread_fields;
   bool remove_unwritten_fields;
   bool remove_zero_written_fields;
+  bool remove_write_only_fields;
   std::unordered_set<const DexType*> blacklist_types;
   std::unordered_set<const DexType*> blacklist_classes;
   boost::optional<std::unordered_set<DexField*>> whitelist;
@@ -48,6 +52,11 @@ class PassImpl : public Pass {
     bind("remove_zero_written_fields",
          true,
          m_config.remove_zero_written_fields);
+    bind("remove_write_only_fields",
+         true,
+         m_config.remove_write_only_fields,
+         "Also remove fields whose read values only get written to fields "
+         "that are removed.");
     bind("blacklist_types",
          {},
          m_config.blacklist_types,
@@ -104,6 +104,21 @@ ssize_t find_matching_package(
   return -1;
 }
 
+// Returns the strings referenced by the classes, sorted and unique.
+std::vector<DexString*> gather_strings(const Scope& scope) {
+  ConcurrentSet<DexString*> strings;
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
+    std::vector<DexString*> class_strings;
+    clazz->gather_strings(class_strings);
+    for (auto str : class_strings) {
+      strings.insert(str);
+    }
+  });
+  std::vector<DexString*> all_strings(strings.begin(), strings.end());
+  std::sort(all_strings.begin(), all_strings.end());
+  return all_strings;
+}
+
 bool referenced_by_layouts(const DexClass* clazz) {
   return clazz->rstate.is_referenced_by_resource_xml();
 }
@@ -121,34 +136,36 @@ bool is_allowed_layout_class(
 std::unordered_set<std::string>
 RenameClassesPassV2::build_dont_rename_class_name_literals(Scope& scope) {
   using namespace boost::algorithm;
-  std::vector<DexString*> all_strings;
-  for (auto clazz : scope) {
-    clazz->gather_strings(all_strings);
-  }
-  sort_unique(all_strings);
-  std::unordered_set<std::string> result;
-  boost::regex external_name_regex{
+  auto all_strings = gather_strings(scope);
+  ConcurrentSet<std::string> result;
+  const boost::regex external_name_regex{
       "((org)|(com)|(android(x|\\.support)))\\."
       "([a-zA-Z][a-zA-Z\\d_$]*\\.)*"
       "[a-zA-Z][a-zA-Z\\d_$]*"};
-  for (auto dex_str : all_strings) {
-    const std::string& s = dex_str->str();
-    if (!ends_with(s, ".java") && boost::regex_match(s, external_name_regex)) {
-      const std::string& internal_name = java_names::external_to_internal(s);
-      auto cls = type_class(DexType::get_type(internal_name));
-      if (cls != nullptr && !cls->is_external()) {
-        result.insert(internal_name);
-        TRACE(RENAME, 4, "Found %s in string pool before renaming", s.c_str());
-      }
-    }
-  }
-  return result;
+  redex_parallel::parallel_for(
+      0, all_strings.size(),
+      [&](size_t i) {
+        const std::string& s = all_strings[i]->str();
+        if (!ends_with(s, ".java") &&
+            boost::regex_match(s, external_name_regex)) {
+          const std::string& internal_name =
+              java_names::external_to_internal(s);
+          auto cls = type_class(DexType::get_type(internal_name));
+          if (cls != nullptr && !cls->is_external()) {
+            result.insert(internal_name);
+            TRACE(RENAME, 4, "Found %s in string pool before renaming",
+                  s.c_str());
+          }
+        }
+      },
+      redex_parallel::default_num_threads(), /* chunk_size */ 256);
+  return std::unordered_set<std::string>(result.begin(), result.end());
 }
 
 std::unordered_set<std::string>
 RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
     Scope& scope, const ProguardMap& pg_map) {
-  std::unordered_set<std::string> dont_rename_class_for_types_with_reflection;
+  ConcurrentSet<std::string> dont_rename_class_for_types_with_reflection;
   std::unordered_set<DexType*> refl_map;
   for (auto const& refl_type_str : m_dont_rename_types_with_reflection) {
     auto deobf_cls_string = pg_map.translate_class(refl_type_str);
@@ -167,7 +184,7 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
     }
   }
 
-  walk::opcodes(
+  walk::parallel::opcodes(
       scope,
       [](DexMethod*) { return true; },
       [&](DexMethod* m, IRInstruction* insn) {
@@ -183,7 +200,9 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
           dont_rename_class_for_types_with_reflection.insert(classname);
         }
       });
-  return dont_rename_class_for_types_with_reflection;
+  return std::unordered_set<std::string>(
+      dont_rename_class_for_types_with_reflection.begin(),
+      dont_rename_class_for_types_with_reflection.end());
 }
 
 std::unordered_set<std::string> RenameClassesPassV2::build_dont_rename_canaries(
@@ -379,19 +398,20 @@ static void sanity_check(const Scope& scope,
   for (const auto& it : name_mapping.get_class_map()) {
     external_names.emplace(java_names::internal_to_external(it.first->c_str()));
   }
-  std::vector<DexString*> all_strings;
-  for (auto clazz : scope) {
-    clazz->gather_strings(all_strings);
-  }
-  sort_unique(all_strings);
-  int sketchy_strings = 0;
-  for (auto s : all_strings) {
-    if (external_names.find(s->str()) != external_names.end() ||
-        name_mapping.get_new_type_name(s)) {
-      TRACE(RENAME, 2, "Found %s in string pool after renaming", s->c_str());
-      sketchy_strings++;
-    }
-  }
+  auto all_strings = gather_strings(scope);
+  std::atomic<int> sketchy_strings{0};
+  redex_parallel::parallel_for(
+      0, all_strings.size(),
+      [&](size_t i) {
+        auto s = all_strings[i];
+        if (external_names.find(s->str()) != external_names.end() ||
+            name_mapping.get_new_type_name(s)) {
+          TRACE(RENAME, 2, "Found %s in string pool after renaming",
+                s->c_str());
+          sketchy_strings++;
+        }
+      },
+      redex_parallel::default_num_threads(), /* chunk_size */ 256);
   if (sketchy_strings > 0) {
     fprintf(stderr,
             "WARNING: Found a number of sketchy class-like strings after class "
@@ -435,31 +455,37 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
 
   std::string norule = "";
 
-  for (auto clazz : scope) {
+  // The classes are independent of each other, so decide about them in
+  // parallel.
+  ConcurrentSet<const DexClass*> force_rename_classes;
+  ConcurrentMap<const DexClass*, DontRenameReason> dont_rename_reasons;
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
+    auto dont_rename = [&](DontRenameReasonCode code, const std::string& rule) {
+      dont_rename_reasons.emplace(clazz, DontRenameReason{code, rule});
+    };
+
     // Short circuit force renames
     if (force_rename_hierarchies.count(clazz->get_type())) {
-      m_force_rename_classes.insert(clazz);
-      continue;
+      force_rename_classes.insert(clazz);
+      return;
     }
 
     // Don't rename annotations
     if (!rename_annotations && is_annotation(clazz)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Annotations,
-                                      norule};
-      continue;
+      dont_rename(DontRenameReasonCode::Annotations, norule);
+      return;
     }
 
     // Don't rename types annotated with anything in dont_rename_annotated
     bool annotated = false;
     for (const auto& anno : dont_rename_annotated) {
       if (has_anno(clazz, anno)) {
-        m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Annotated,
-                                        anno->str()};
+        dont_rename(DontRenameReasonCode::Annotated, anno->str());
         annotated = true;
         break;
       }
     }
-    if (annotated) continue;
+    if (annotated) return;
 
     const char* clsname = clazz->get_name()->c_str();
     std::string strname = std::string(clsname);
@@ -469,14 +495,14 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
     // compute resource reachability, or we're doing it ourselves).
     if (referenced_by_layouts(clazz) &&
         !is_allowed_layout_class(clazz, m_allow_layout_rename_packages)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Resources, norule};
-      continue;
+      dont_rename(DontRenameReasonCode::Resources, norule);
+      return;
     }
 
     // Don't rename anythings in the direct name blacklist (hierarchy ignored)
     if (m_dont_rename_specific.count(clsname)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Specific, strname};
-      continue;
+      dont_rename(DontRenameReasonCode::Specific, strname);
+      return;
     }
 
     // Don't rename anything if it falls in a blacklisted package
@@ -484,56 +510,56 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
     for (const auto& pkg : m_dont_rename_packages) {
       if (strname.rfind("L" + pkg) == 0) {
         TRACE(RENAME, 2, "%s blacklisted by pkg rule %s", clsname, pkg.c_str());
-        m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Packages, pkg};
+        dont_rename(DontRenameReasonCode::Packages, pkg);
         package_blacklisted = true;
         break;
       }
     }
-    if (package_blacklisted) continue;
+    if (package_blacklisted) return;
 
     if (dont_rename_class_name_literals.count(clsname)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::ClassNameLiterals,
-                                      norule};
-      continue;
+      dont_rename(DontRenameReasonCode::ClassNameLiterals, norule);
+      return;
     }
 
     if (dont_rename_class_for_types_with_reflection.count(clsname)) {
-      m_dont_rename_reasons[clazz] = {
-          DontRenameReasonCode::ClassForTypesWithReflection, norule};
-      continue;
+      dont_rename(DontRenameReasonCode::ClassForTypesWithReflection, norule);
+      return;
     }
 
     if (dont_rename_canaries.count(clsname)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Canaries, norule};
-      continue;
+      dont_rename(DontRenameReasonCode::Canaries, norule);
+      return;
     }
 
     if (dont_rename_native_bindings.count(clazz->get_type())) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::NativeBindings,
-                                      norule};
-      continue;
+      dont_rename(DontRenameReasonCode::NativeBindings, norule);
+      return;
     }
 
     if (dont_rename_hierarchies.count(clazz->get_type())) {
-      std::string rule = dont_rename_hierarchies[clazz->get_type()];
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Hierarchy, rule};
-      continue;
+      std::string rule = dont_rename_hierarchies.at(clazz->get_type());
+      dont_rename(DontRenameReasonCode::Hierarchy, rule);
+      return;
     }
 
     if (dont_rename_serde_relationships.count(clazz->get_type())) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::SerdeRelationships,
-                                      norule};
-      continue;
+      dont_rename(DontRenameReasonCode::SerdeRelationships, norule);
+      return;
     }
 
     if (!can_rename_if_also_renaming_xml(clazz)) {
       const auto& keep_reasons = clazz->rstate.keep_reasons();
       auto rule = keep_reasons.size() > 0 ? show(*keep_reasons.begin()) : "";
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::ProguardCantRename,
-                                      get_keep_rule(clazz)};
-      continue;
-    }
-  }
+      dont_rename(DontRenameReasonCode::ProguardCantRename,
+                  get_keep_rule(clazz));
+      return;
+    }
+  });
+  m_force_rename_classes.insert(force_rename_classes.begin(),
+                                force_rename_classes.end());
+  m_dont_rename_reasons.insert(dont_rename_reasons.begin(),
+                               dont_rename_reasons.end());
 }
 
 /**
@@ -545,18 +571,22 @@ void RenameClassesPassV2::eval_classes_post(
     Scope& scope, const ClassHierarchy& class_hierarchy, PassManager& mgr) {
   auto dont_rename_hierarchies =
       build_dont_rename_hierarchies(mgr, scope, class_hierarchy);
-  for (auto clazz : scope) {
+  ConcurrentMap<const DexClass*, DontRenameReason> dont_rename_reasons;
+  walk::parallel::classes(scope, [&](DexClass* clazz) {
     if (m_dont_rename_reasons.find(clazz) != m_dont_rename_reasons.end()) {
-      continue;
+      return;
     }
+    auto dont_rename = [&](DontRenameReasonCode code, const std::string& rule) {
+      dont_rename_reasons.emplace(clazz, DontRenameReason{code, rule});
+    };
 
     const char* clsname = clazz->get_name()->c_str();
     std::string strname = std::string(clsname);
 
     // Don't rename anythings in the direct name blacklist (hierarchy ignored)
     if (m_dont_rename_specific.count(clsname)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Specific, strname};
-      continue;
+      dont_rename(DontRenameReasonCode::Specific, strname);
+      return;
     }
 
     // Don't rename anything if it falls in a blacklisted package
@@ -564,32 +594,34 @@ void RenameClassesPassV2::eval_classes_post(
     for (const auto& pkg : m_dont_rename_packages) {
       if (strname.rfind("L" + pkg) == 0) {
         TRACE(RENAME, 2, "%s blacklisted by pkg rule %s", clsname, pkg.c_str());
-        m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Packages, pkg};
+        dont_rename(DontRenameReasonCode::Packages, pkg);
         package_blacklisted = true;
         break;
       }
     }
-    if (package_blacklisted) continue;
+    if (package_blacklisted) return;
 
     if (dont_rename_hierarchies.count(clazz->get_type())) {
-      std::string rule = dont_rename_hierarchies[clazz->get_type()];
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Hierarchy, rule};
-      continue;
+      std::string rule = dont_rename_hierarchies.at(clazz->get_type());
+      dont_rename(DontRenameReasonCode::Hierarchy, rule);
+      return;
     }
 
     // Don't rename anything if something changed and the class cannot be
     // renamed anymore.
     if (!can_rename_if_also_renaming_xml(clazz)) {
-      m_dont_rename_reasons[clazz] = {DontRenameReasonCode::ProguardCantRename,
-                                      get_keep_rule(clazz)};
+      dont_rename(DontRenameReasonCode::ProguardCantRename,
+                  get_keep_rule(clazz));
     }
-  }
+  });
+  m_dont_rename_reasons.insert(dont_rename_reasons.begin(),
+                               dont_rename_reasons.end());
 }
 
 void RenameClassesPassV2::eval_pass(DexStoresVector& stores,
                                     ConfigFiles& conf,
                                     PassManager& mgr) {
-  auto json = conf.get_json_config();
+  const auto& json = conf.get_json_config();
   json.get("apk_dir", "", m_apk_dir);
   TRACE(RENAME, 3, "APK Dir: %s", m_apk_dir.c_str());
   auto scope = build_class_scope(stores);
@@ -601,11 +633,12 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
                                          ConfigFiles& conf,
                                          bool rename_annotations,
                                          PassManager& mgr) {
-  rewriter::TypeStringMap name_mapping;
-  uint32_t sequence = 0;
-  for (auto clazz : scope) {
-    auto dtype = clazz->get_type();
-    auto oldname = dtype->get_name();
+  // Every class takes up a sequence number, its index in the scope, whether
+  // it's renamed or not. Decide which ones are renamed first.
+  std::vector<uint32_t> renamed_sequences;
+  for (uint32_t sequence = 0; sequence < scope.size(); ++sequence) {
+    auto clazz = scope[sequence];
+    auto oldname = clazz->get_type()->get_name();
 
     if (m_force_rename_classes.count(clazz)) {
       mgr.incr_metric(METRIC_FORCE_RENAMED_CLASSES, 1);
@@ -624,58 +657,76 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
         TRACE(RENAME, 2, "'%s' NOT RENAMED due to %s'", oldname->c_str(),
               metric.c_str());
       }
-      sequence++;
       continue;
     }
 
     mgr.incr_metric(METRIC_RENAMED_CLASSES, 1);
+    renamed_sequences.push_back(sequence);
+  }
 
-    char descriptor[Locator::encoded_global_class_index_max];
-    always_assert(sequence != Locator::invalid_global_class_index);
-    Locator::encodeGlobalClassIndex(sequence, m_digits, descriptor);
-    always_assert_log(facebook::Locator::decodeGlobalClassIndex(descriptor) ==
-                          sequence,
-                      "global class index didn't roundtrip; %s generated from "
-                      "%u parsed to %u",
-                      descriptor, sequence,
-                      facebook::Locator::decodeGlobalClassIndex(descriptor));
-
-    sequence++;
-
-    std::string prefixed_descriptor = prepend_package_prefix(descriptor);
-
-    TRACE(RENAME, 2, "'%s' ->  %s (%u)'", oldname->c_str(),
-          prefixed_descriptor.c_str(), sequence);
-
-    auto exists = DexString::get_string(prefixed_descriptor);
-    always_assert_log(!exists, "Collision on class %s (%s)", oldname->c_str(),
-                      prefixed_descriptor.c_str());
-
-    auto dstring = DexString::make_string(prefixed_descriptor);
-    name_mapping.add_type_name(clazz->get_name(), dstring);
-    dtype->set_name(dstring);
-    std::string old_str(oldname->c_str());
-    // std::string new_str(descriptor);
-    // proguard_map.update_class_mapping(old_str, new_str);
-    m_base_strings_size += strlen(oldname->c_str());
-    m_ren_strings_size += strlen(dstring->c_str());
-
-    while (1) {
-      std::string arrayop("[");
-      arrayop += oldname->c_str();
-      oldname = DexString::get_string(arrayop);
-      if (oldname == nullptr) {
-        break;
-      }
-      auto arraytype = DexType::get_type(oldname);
-      if (arraytype == nullptr) {
-        break;
-      }
-      std::string newarraytype("[");
-      newarraytype += dstring->c_str();
-      dstring = DexString::make_string(newarraytype);
-      arraytype->set_name(dstring);
-    }
+  // Then make up the new names and rename the types, and the array types of
+  // them, in parallel. Strings and types are interned concurrently, and the
+  // names are distinct, so the classes don't get in each other's way.
+  std::vector<std::pair<DexString*, DexString*>> renames(
+      renamed_sequences.size());
+  std::atomic<int> base_strings_size{0};
+  std::atomic<int> ren_strings_size{0};
+  redex_parallel::parallel_for(
+      0, renamed_sequences.size(),
+      [&](size_t i) {
+        auto sequence = renamed_sequences[i];
+        auto dtype = scope[sequence]->get_type();
+        auto oldname = dtype->get_name();
+
+        char descriptor[Locator::encoded_global_class_index_max];
+        always_assert(sequence != Locator::invalid_global_class_index);
+        Locator::encodeGlobalClassIndex(sequence, m_digits, descriptor);
+        always_assert_log(
+            facebook::Locator::decodeGlobalClassIndex(descriptor) == sequence,
+            "global class index didn't roundtrip; %s generated from %u parsed "
+            "to %u",
+            descriptor, sequence,
+            facebook::Locator::decodeGlobalClassIndex(descriptor));
+
+        std::string prefixed_descriptor = prepend_package_prefix(descriptor);
+
+        TRACE(RENAME, 2, "'%s' ->  %s (%u)'", oldname->c_str(),
+              prefixed_descriptor.c_str(), sequence);
+
+        auto exists = DexString::get_string(prefixed_descriptor);
+        always_assert_log(!exists, "Collision on class %s (%s)",
+                          oldname->c_str(), prefixed_descriptor.c_str());
+
+        auto dstring = DexString::make_string(prefixed_descriptor);
+        renames[i] = std::make_pair(oldname, dstring);
+        dtype->set_name(dstring);
+        base_strings_size += strlen(oldname->c_str());
+        ren_strings_size += strlen(dstring->c_str());
+
+        while (1) {
+          std::string arrayop("[");
+          arrayop += oldname->c_str();
+          oldname = DexString::get_string(arrayop);
+          if (oldname == nullptr) {
+            break;
+          }
+          auto arraytype = DexType::get_type(oldname);
+          if (arraytype == nullptr) {
+            break;
+          }
+          std::string newarraytype("[");
+          newarraytype += dstring->c_str();
+          dstring = DexString::make_string(newarraytype);
+          arraytype->set_name(dstring);
+        }
+      },
+      redex_parallel::default_num_threads(), /* chunk_size */ 64);
+  m_base_strings_size += base_strings_size;
+  m_ren_strings_size += ren_strings_size;
+
+  rewriter::TypeStringMap name_mapping;
+  for (const auto& pair : renames) {
+    name_mapping.add_type_name(pair.first, pair.second);
   }
 
   /* Now rewrite all const-string strings for force renamed classes. */
@@ -709,32 +760,19 @@ void RenameClassesPassV2::rename_classes_in_layouts(
     const rewriter::TypeStringMap& name_mapping, PassManager& mgr) {
   // Sync up ResStringPool entries in XML layouts. Class names should appear in
   // their "external" name, i.e. java.lang.String instead of Ljava/lang/String;
-  std::map<std::string, std::string> aliases_for_layouts;
+  XmlFileEdits edits;
   for (const auto& apair : name_mapping.get_class_map()) {
-    aliases_for_layouts.emplace(
+    edits.class_renames.emplace(
         java_names::internal_to_external(apair.first->str()),
         java_names::internal_to_external(apair.second->str()));
   }
-  ssize_t layout_bytes_delta = 0;
-  size_t num_layout_renamed = 0;
   auto xml_files = get_xml_files(m_apk_dir + "/res");
-  for (const auto& path : xml_files) {
-    if (is_raw_resource(path)) {
-      continue;
-    }
-    size_t num_renamed = 0;
-    ssize_t out_delta = 0;
-    TRACE(RENAME, 6, "Begin rename Views in layout %s", path.c_str());
-    rename_classes_in_layout(path, aliases_for_layouts, &num_renamed,
-                             &out_delta);
-    TRACE(RENAME, 3, "Renamed %zu ResStringPool entries in layout %s",
-          num_renamed, path.c_str());
-    layout_bytes_delta += out_delta;
-    num_layout_renamed += num_renamed;
-  }
-  mgr.incr_metric("layout_bytes_delta", layout_bytes_delta);
-  TRACE(RENAME, 2, "Renamed %zu ResStringPool entries, delta %zi bytes",
-        num_layout_renamed, layout_bytes_delta);
+  std::vector<std::string> paths(xml_files.begin(), xml_files.end());
+  auto stats = rewrite_xml_files(paths, edits);
+  mgr.incr_metric("layout_bytes_delta", stats.size_delta);
+  TRACE(RENAME, 2,
+        "Renamed %zu ResStringPool entries in %zu layouts, delta %zi bytes",
+        stats.strings_renamed, stats.files_changed, stats.size_delta);
 }
 
 std::string RenameClassesPassV2::prepend_package_prefix(
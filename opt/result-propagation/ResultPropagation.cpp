@@ -465,45 +465,11 @@ void ResultPropagation::patch(PassManager& mgr, IRCode* code) {
   }
 }
 
-void ResultPropagationPass::run_pass(DexStoresVector& stores,
-                                     ConfigFiles& /* conf */,
-                                     PassManager& mgr) {
-  const auto scope = build_class_scope(stores);
-  const auto method_override_graph = method_override_graph::build_graph(scope);
-  ReturnParamResolver resolver(*method_override_graph);
-  const auto methods_which_return_parameter =
-      find_methods_which_return_parameter(mgr, scope, resolver);
-
-  const auto stats = walk::parallel::methods<ResultPropagation::Stats>(
-      scope, [&](DexMethod* m) {
-        const auto code = m->get_code();
-        if (code == nullptr) {
-          return ResultPropagation::Stats();
-        }
-
-        ResultPropagation rp(methods_which_return_parameter, resolver);
-        rp.patch(mgr, code);
-        return rp.get_stats();
-      });
-  mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER,
-                  methods_which_return_parameter.size());
-  mgr.incr_metric(METRIC_ERASED_MOVE_RESULTS, stats.erased_move_results);
-  mgr.incr_metric(METRIC_PATCHED_MOVE_RESULTS, stats.patched_move_results);
-  mgr.incr_metric(METRIC_UNVERIFIABLE_MOVE_RESULTS,
-                  stats.unverifiable_move_results);
-  TRACE(RP, 1,
-        "result propagation --- potential methods: %d, erased moves: %d, "
-        "patched moves: %d, "
-        "unverifiable moves: %d",
-        methods_which_return_parameter.size(), stats.erased_move_results,
-        stats.patched_move_results, stats.unverifiable_move_results);
-}
-
 using ParamIndexMap = std::unordered_map<const DexMethod*, ParamIndex>;
 
-const std::unordered_map<const DexMethod*, ParamIndex>
-ResultPropagationPass::find_methods_which_return_parameter(
-    PassManager& mgr, const Scope& scope, const ReturnParamResolver& resolver) {
+ReturnParamSummaries::ReturnParamSummaries(const Scope& scope) {
+  const auto method_override_graph = method_override_graph::build_graph(scope);
+  ReturnParamResolver resolver(*method_override_graph);
   walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
     const auto proto = method->get_proto();
     if (!proto->is_void()) {
@@ -512,8 +478,6 @@ ResultPropagationPass::find_methods_which_return_parameter(
     }
   });
 
-  std::unordered_map<const DexMethod*, ParamIndex>
-      methods_which_return_parameter;
   // We iterate a few times to capture chains of method calls that all
   // eventually return `this`.
   // TODO(perf): Add flag to limit number of iterations
@@ -521,8 +485,8 @@ ResultPropagationPass::find_methods_which_return_parameter(
   // methods) why the call resolution gave up, and use that "dependency"
   // information to limit what needs to be processed in subsequent iterations
   while (true) {
-    mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER_ITERATIONS, 1);
-    const auto next_methods_which_return_parameter =
+    ++iterations;
+    auto next_methods_which_return_parameter =
         walk::parallel::methods<ParamIndexMap, MergeContainers<ParamIndexMap>>(
             scope, [&](DexMethod* method) {
               std::unordered_map<const DexMethod*, ParamIndex> res;
@@ -558,17 +522,64 @@ ResultPropagationPass::find_methods_which_return_parameter(
 
     if (next_methods_which_return_parameter.size() ==
         methods_which_return_parameter.size()) {
+      break;
+    }
+    methods_which_return_parameter =
+        std::move(next_methods_which_return_parameter);
+  }
 
-      walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
-        const auto proto = method->get_proto();
-        if (!proto->is_void()) {
-          code.clear_cfg();
+  walk::parallel::code(scope, [](DexMethod* method, IRCode& code) {
+    const auto proto = method->get_proto();
+    if (!proto->is_void()) {
+      code.clear_cfg();
+    }
+  });
+}
+
+PreservedAnalyses ResultPropagationPass::get_preserved_analyses() const {
+  // Only move-result instructions get rewritten, which doesn't change what
+  // any method returns.
+  return PreservedAnalyses::none()
+      .preserve<method_override_graph::Graph>()
+      .preserve<ReturnParamSummaries>();
+}
+
+void ResultPropagationPass::run_pass(DexStoresVector& stores,
+                                     ConfigFiles& /* conf */,
+                                     PassManager& mgr) {
+  const auto scope = build_class_scope(stores);
+  const auto method_override_graph =
+      mgr.get_analysis<method_override_graph::Graph>(stores);
+  ReturnParamResolver resolver(*method_override_graph);
+  const auto summaries = mgr.get_analysis<ReturnParamSummaries>(stores);
+  const auto& methods_which_return_parameter =
+      summaries->methods_which_return_parameter;
+  mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER_ITERATIONS,
+                  summaries->iterations);
+
+  const auto stats = walk::parallel::methods<ResultPropagation::Stats>(
+      scope, [&](DexMethod* m) {
+        const auto code = m->get_code();
+        if (code == nullptr) {
+          return ResultPropagation::Stats();
         }
+
+        ResultPropagation rp(methods_which_return_parameter, resolver);
+        rp.patch(mgr, code);
+        return rp.get_stats();
       });
-      return methods_which_return_parameter;
-    }
-    methods_which_return_parameter = next_methods_which_return_parameter;
-  }
+  mgr.incr_metric(METRIC_METHODS_WHICH_RETURN_PARAMETER,
+                  methods_which_return_parameter.size());
+  mgr.incr_metric(METRIC_ERASED_MOVE_RESULTS, stats.erased_move_results);
+  mgr.incr_metric(METRIC_PATCHED_MOVE_RESULTS, stats.patched_move_results);
+  mgr.incr_metric(METRIC_UNVERIFIABLE_MOVE_RESULTS,
+                  stats.unverifiable_move_results);
+  TRACE(RP, 1,
+        "result propagation --- potential methods: %d, erased moves: %d, "
+        "patched moves: %d, "
+        "unverifiable moves: %d",
+        methods_which_return_parameter.size(), stats.erased_move_results,
+        stats.patched_move_results, stats.unverifiable_move_results);
 }
 
 static ResultPropagationPass s_pass;
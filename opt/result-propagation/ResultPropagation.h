@@ -86,6 +86,24 @@ class ReturnParamResolver {
   const DexMethodRef* m_string_to_string_method;
 };
 
+/*
+ * The methods which always return one of their incoming parameters, with the
+ * index of that parameter, taking into account deep call chains.
+ *
+ * This is a whole-program analysis cached by the PassManager (see
+ * PassManager::get_analysis()), so that passes which keep what every method
+ * returns the same can preserve it, and a later ResultPropagationPass (or any
+ * other pass reading it) only looks it up.
+ */
+struct ReturnParamSummaries {
+  explicit ReturnParamSummaries(const Scope& scope);
+
+  std::unordered_map<const DexMethod*, ParamIndex>
+      methods_which_return_parameter;
+  // The number of iterations of the fixed point computation.
+  size_t iterations{0};
+};
+
 /*
  * Helper class that patches code based on analysis results.
  */
@@ -139,14 +157,5 @@ class ResultPropagationPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
- private:
-  /*
-   * Via a fixed point computation that repeatedly inspects all methods,
-   * figure out all methods which return an incoming parameter, taking into
-   * account deep call chains.
-   */
-  static const std::unordered_map<const DexMethod*, ParamIndex>
-  find_methods_which_return_parameter(PassManager& mgr,
-                                      const Scope& scope,
-                                      const ReturnParamResolver& resolver);
+  PreservedAnalyses get_preserved_analyses() const override;
 };
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * For example, once the methods of a small holder class have been inlined,
+ *
+ *   NEW_INSTANCE LPair;
+ *   MOVE_RESULT_PSEUDO_OBJECT v0
+ *   INVOKE_DIRECT v0, v1, v2, LPair;.<init>:(II)V
+ *   IGET v0, LPair;.first:I
+ *   MOVE_RESULT_PSEUDO v3
+ *
+ * becomes
+ *
+ *   CONST v0, 0
+ *   CONST v10, 0  ; first
+ *   CONST v11, 0  ; second
+ *   MOVE v10, v1
+ *   MOVE v11, v2
+ *   MOVE v3, v10
+ *
+ * which copy propagation and dead code elimination then clean up.
+ */
+
+#include "ScalarReplacement.h"
+
+#include <unordered_set>
+
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "Liveness.h"
+#include "LocalPointersAnalysis.h"
+#include "MethodUtil.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Walkers.h"
+
+namespace ptrs = local_pointers;
+
+namespace {
+
+constexpr const char* METRIC_ALLOCATIONS_REMOVED = "num_allocations_removed";
+constexpr const char* METRIC_FIELD_ACCESSES_REPLACED =
+    "num_field_accesses_replaced";
+constexpr const char* METRIC_CONSTRUCTOR_CALLS_REPLACED =
+    "num_constructor_calls_replaced";
+
+using FieldAssignment = ScalarReplacementPass::FieldAssignment;
+using SimpleConstructors = ScalarReplacementPass::SimpleConstructors;
+
+// Whether allocating an object of this type or not is unobservable, except
+// through the object itself.
+bool is_replaceable_class(const DexType* type) {
+  auto cls = type_class(type);
+  if (cls == nullptr || cls->is_external() || is_interface(cls) ||
+      is_abstract(cls) || cls->get_super_class() != type::java_lang_Object() ||
+      cls->get_clinit() != nullptr) {
+    return false;
+  }
+  for (auto method : cls->get_vmethods()) {
+    if (method->get_name()->str() == "finalize" &&
+        method::has_no_args(method)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+DexField* resolve_own_field(const IRInstruction* insn, const DexType* type) {
+  auto field = resolve_field(insn->get_field(), FieldSearch::Instance);
+  return field != nullptr && field->get_class() == type ? field : nullptr;
+}
+
+// The field assignments of the constructor, if it does nothing else.
+boost::optional<std::vector<FieldAssignment>> get_field_assignments(
+    const DexMethod* ctor) {
+  auto code = ctor->get_code();
+  if (code == nullptr) {
+    return boost::none;
+  }
+  auto type = ctor->get_class();
+  // What the registers of the constructor hold
+  enum Kind { THIS, PARAM, LITERAL };
+  struct Value {
+    Kind kind;
+    size_t param;
+    int64_t literal;
+  };
+  std::unordered_map<reg_t, Value> values;
+  size_t param_idx = 0;
+  std::vector<FieldAssignment> assignments;
+  for (auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    auto op = insn->opcode();
+    if (opcode::is_load_param(op)) {
+      values[insn->dest()] =
+          param_idx == 0 ? Value{THIS, 0, 0} : Value{PARAM, param_idx, 0};
+      ++param_idx;
+    } else if (op == OPCODE_CONST || op == OPCODE_CONST_WIDE) {
+      values[insn->dest()] = Value{LITERAL, 0, insn->get_literal()};
+      if (insn->dest_is_wide()) {
+        values.erase(insn->dest() + 1);
+      }
+    } else if (op == OPCODE_INVOKE_DIRECT) {
+      auto callee = insn->get_method();
+      auto it = values.find(insn->src(0));
+      if (callee->get_class() != type::java_lang_Object() ||
+          !method::is_init(callee) || it == values.end() ||
+          it->second.kind != THIS) {
+        return boost::none;
+      }
+    } else if (is_iput(op)) {
+      auto obj = values.find(insn->src(1));
+      auto value = values.find(insn->src(0));
+      auto field = resolve_own_field(insn, type);
+      if (field == nullptr || obj == values.end() ||
+          obj->second.kind != THIS || value == values.end() ||
+          value->second.kind == THIS) {
+        return boost::none;
+      }
+      if (value->second.kind == PARAM) {
+        assignments.push_back({op, field, value->second.param, 0});
+      } else {
+        assignments.push_back({op, field, boost::none, value->second.literal});
+      }
+    } else if (op != OPCODE_RETURN_VOID) {
+      return boost::none;
+    }
+  }
+  return assignments;
+}
+
+bool holds_only(const ptrs::PointerSet& pointers, const IRInstruction* ptr) {
+  return pointers.is_value() && pointers.size() == 1 &&
+         pointers.contains(ptr);
+}
+
+// Whether the instruction may use the candidate object in its i-th operand.
+bool is_replaceable_use(const IRInstruction* insn,
+                        size_t i,
+                        const IRInstruction* allocation,
+                        const SimpleConstructors& constructors) {
+  auto op = insn->opcode();
+  auto type = allocation->get_type();
+  if (opcode::is_move(op)) {
+    return true;
+  }
+  if (is_iget(op)) {
+    return i == 0 && resolve_own_field(insn, type) != nullptr;
+  }
+  if (is_iput(op)) {
+    return i == 1 && resolve_own_field(insn, type) != nullptr;
+  }
+  if (op == OPCODE_INVOKE_DIRECT && i == 0) {
+    auto ctor = resolve_method(insn->get_method(), MethodSearch::Direct);
+    return ctor != nullptr && ctor->get_class() == type &&
+           constructors.count(ctor);
+  }
+  return false;
+}
+
+// The live registers right before each of the allocations
+std::unordered_map<const IRInstruction*, LivenessDomain>
+get_live_before_allocations(
+    const cfg::ControlFlowGraph& cfg,
+    const LivenessFixpointIterator& liveness,
+    const std::unordered_map<const IRInstruction*, cfg::Block*>& allocations) {
+  std::unordered_map<const IRInstruction*, LivenessDomain> live_before;
+  std::unordered_set<cfg::Block*> blocks;
+  for (auto& pair : allocations) {
+    blocks.insert(pair.second);
+  }
+  for (auto block : blocks) {
+    auto live = liveness.get_live_out_vars_at(block);
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      liveness.analyze_instruction(it->insn, &live);
+      if (allocations.count(it->insn)) {
+        live_before.emplace(it->insn, live);
+      }
+    }
+  }
+  return live_before;
+}
+
+IRInstruction* make_move(IROpcode op, reg_t dest, reg_t src) {
+  return (new IRInstruction(op))->set_dest(dest)->set_src(0, src);
+}
+
+IRInstruction* make_const(reg_t dest, bool wide, int64_t literal) {
+  return (new IRInstruction(wide ? OPCODE_CONST_WIDE : OPCODE_CONST))
+      ->set_dest(dest)
+      ->set_literal(literal);
+}
+
+} // namespace
+
+ScalarReplacementPass::SimpleConstructors
+ScalarReplacementPass::find_simple_constructors(const Scope& scope) {
+  SimpleConstructors constructors;
+  walk::classes(scope, [&](DexClass* cls) {
+    if (!is_replaceable_class(cls->get_type())) {
+      return;
+    }
+    for (auto method : cls->get_dmethods()) {
+      if (!method::is_init(method)) {
+        continue;
+      }
+      auto assignments = get_field_assignments(method);
+      if (assignments) {
+        constructors.emplace(method, std::move(*assignments));
+      }
+    }
+  });
+  return constructors;
+}
+
+ScalarReplacementPass::Stats ScalarReplacementPass::process_code(
+    IRCode* code, const SimpleConstructors& constructors) {
+  Stats stats;
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  std::unordered_map<const IRInstruction*, cfg::Block*> allocations;
+  for (auto block : cfg.blocks()) {
+    for (auto& mie : InstructionIterable(block)) {
+      if (mie.insn->opcode() == OPCODE_NEW_INSTANCE &&
+          is_replaceable_class(mie.insn->get_type())) {
+        allocations.emplace(mie.insn, block);
+      }
+    }
+  }
+  if (allocations.empty()) {
+    code->clear_cfg();
+    return stats;
+  }
+
+  cfg.calculate_exit_block();
+  ptrs::FixpointIterator fp_iter(cfg);
+  fp_iter.run(ptrs::Environment());
+  LivenessFixpointIterator liveness(cfg);
+  liveness.run(LivenessDomain());
+  auto live_before_allocations =
+      get_live_before_allocations(cfg, liveness, allocations);
+
+  std::unordered_set<const IRInstruction*> rejected;
+  std::unordered_set<const IRInstruction*> reached;
+  // The field accesses and constructor calls of each allocation
+  std::unordered_map<const IRInstruction*,
+                     std::vector<std::pair<cfg::Block*, IRInstruction*>>>
+      uses;
+  const auto for_each_allocation = [&](const ptrs::PointerSet& pointers,
+                                       const std::function<void(
+                                           const IRInstruction*)>& f) {
+    if (!pointers.is_value()) {
+      return;
+    }
+    for (auto pointer : pointers.elements()) {
+      if (allocations.count(pointer)) {
+        f(pointer);
+      }
+    }
+  };
+
+  for (auto block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    // A live register that holds an allocation on some incoming path must
+    // hold just that allocation on all of them.
+    auto live_in = liveness.get_live_in_vars_at(block);
+    for (auto edge : block->preds()) {
+      auto pred_env = fp_iter.get_exit_state_at(edge->src());
+      if (pred_env.is_bottom()) {
+        continue;
+      }
+      for (auto reg : live_in.elements()) {
+        const auto& pointers = env.get_pointers(reg);
+        for_each_allocation(pred_env.get_pointers(reg),
+                            [&](const IRInstruction* allocation) {
+                              if (!holds_only(pointers, allocation)) {
+                                rejected.insert(allocation);
+                              }
+                            });
+      }
+    }
+
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        const auto& pointers = env.get_pointers(insn->src(i));
+        for_each_allocation(pointers, [&](const IRInstruction* allocation) {
+          if (!holds_only(pointers, allocation) ||
+              !is_replaceable_use(insn, i, allocation, constructors)) {
+            rejected.insert(allocation);
+          } else if (!opcode::is_move(insn->opcode())) {
+            uses[allocation].emplace_back(block, insn);
+          }
+        });
+      }
+      if (allocations.count(insn)) {
+        reached.insert(insn);
+        // The object of an earlier execution of the allocation must be dead
+        // by now, as its fields are about to be reset.
+        for (auto reg : live_before_allocations.at(insn).elements()) {
+          auto pointers = env.get_pointers(reg);
+          if (pointers.is_value() && pointers.contains(insn)) {
+            rejected.insert(insn);
+          }
+        }
+      }
+      fp_iter.analyze_instruction(insn, &env);
+    }
+  }
+
+  for (auto& pair : allocations) {
+    auto allocation = const_cast<IRInstruction*>(pair.first);
+    if (rejected.count(allocation) || !reached.count(allocation)) {
+      continue;
+    }
+    auto type = allocation->get_type();
+    std::unordered_map<DexField*, reg_t> field_regs;
+    std::vector<DexField*> fields;
+    const auto get_field_reg = [&](DexField* field) {
+      auto it = field_regs.find(field);
+      if (it != field_regs.end()) {
+        return it->second;
+      }
+      auto reg = type::is_wide_type(field->get_type())
+                     ? cfg.allocate_wide_temp()
+                     : cfg.allocate_temp();
+      field_regs.emplace(field, reg);
+      fields.push_back(field);
+      return reg;
+    };
+
+    for (auto& use : uses[allocation]) {
+      auto insn = use.second;
+      auto op = insn->opcode();
+      auto it = cfg.find_insn(insn, use.first);
+      if (is_iget(op)) {
+        auto reg = get_field_reg(resolve_own_field(insn, type));
+        auto move_result = cfg.move_result_of(it);
+        if (move_result.is_end()) {
+          cfg.remove_insn(it);
+        } else {
+          cfg.replace_insn(it, make_move(opcode::iget_to_move(op),
+                                         move_result->insn->dest(), reg));
+        }
+        ++stats.field_accesses_replaced;
+      } else if (is_iput(op)) {
+        auto reg = get_field_reg(resolve_own_field(insn, type));
+        cfg.replace_insn(
+            it, make_move(opcode::iput_to_move(op), reg, insn->src(0)));
+        ++stats.field_accesses_replaced;
+      } else {
+        auto ctor = resolve_method(insn->get_method(), MethodSearch::Direct);
+        std::vector<IRInstruction*> assignments;
+        for (auto& assignment : constructors.at(ctor)) {
+          auto reg = get_field_reg(assignment.field);
+          if (assignment.param) {
+            assignments.push_back(
+                make_move(opcode::iput_to_move(assignment.iput_opcode), reg,
+                          insn->src(*assignment.param)));
+          } else {
+            assignments.push_back(make_const(reg,
+                                             assignment.iput_opcode ==
+                                                 OPCODE_IPUT_WIDE,
+                                             assignment.literal));
+          }
+        }
+        if (assignments.empty()) {
+          cfg.remove_insn(it);
+        } else {
+          cfg.replace_insns(it, assignments);
+        }
+        ++stats.constructor_calls_replaced;
+      }
+    }
+
+    // The object's register is only copied around now. We keep it defined
+    // until dead code elimination removes it.
+    auto it = cfg.find_insn(allocation, pair.second);
+    auto move_result = cfg.move_result_of(it);
+    always_assert(!move_result.is_end());
+    std::vector<IRInstruction*> inits{
+        make_const(move_result->insn->dest(), false, 0)};
+    for (auto field : fields) {
+      inits.push_back(make_const(field_regs.at(field),
+                                 type::is_wide_type(field->get_type()), 0));
+    }
+    TRACE(OSDCE, 3, "[scalar-replacement] replacing %s by %zu registers",
+          SHOW(allocation), fields.size());
+    cfg.replace_insns(it, inits);
+    ++stats.allocations_removed;
+  }
+
+  code->clear_cfg();
+  return stats;
+}
+
+void ScalarReplacementPass::run_pass(DexStoresVector& stores,
+                                     ConfigFiles&,
+                                     PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  auto constructors = find_simple_constructors(scope);
+
+  auto stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* method) {
+    auto code = method->get_code();
+    if (code == nullptr || method->rstate.no_optimizations()) {
+      return Stats{};
+    }
+    return process_code(code, constructors);
+  });
+
+  mgr.incr_metric(METRIC_ALLOCATIONS_REMOVED, stats.allocations_removed);
+  mgr.incr_metric(METRIC_FIELD_ACCESSES_REPLACED,
+                  stats.field_accesses_replaced);
+  mgr.incr_metric(METRIC_CONSTRUCTOR_CALLS_REPLACED,
+                  stats.constructor_calls_replaced);
+  TRACE(OSDCE, 1,
+        "[scalar-replacement] Removed %zu allocations, replaced %zu field "
+        "accesses and %zu constructor calls",
+        stats.allocations_removed, stats.field_accesses_replaced,
+        stats.constructor_calls_replaced);
+}
+
+static ScalarReplacementPass s_pass;
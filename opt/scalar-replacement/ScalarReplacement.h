@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/optional.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "IROpcode.h"
+#include "Pass.h"
+
+/*
+ * Replaces the objects that are allocated in a method and never leave it by
+ * their fields, kept in registers. This is meant to run after inlining, when
+ * the methods of builders, iterators and small tuples have been inlined into
+ * the methods that allocate them, and only field accesses and constructor
+ * calls remain.
+ *
+ * An allocation of `T` is replaced when, according to LocalPointersAnalysis,
+ * every use of a register that may hold it
+ *   - is a move, a read or a write of one of T's fields, or a call to one of
+ *     T's constructors that only assigns parameters or constants to fields;
+ *   - and sees no other value in that register.
+ * T must extend java.lang.Object directly and have neither a static
+ * initializer nor a finalizer, so that removing the allocation and the
+ * constructor call has no observable effect. An allocation is also left alone
+ * when it runs again while an earlier object it created is still live, e.g.
+ * when a loop keeps the object of the previous iteration.
+ */
+class ScalarReplacementPass : public Pass {
+ public:
+  struct Stats {
+    size_t allocations_removed{0};
+    size_t field_accesses_replaced{0};
+    size_t constructor_calls_replaced{0};
+
+    Stats& operator+=(const Stats& that) {
+      allocations_removed += that.allocations_removed;
+      field_accesses_replaced += that.field_accesses_replaced;
+      constructor_calls_replaced += that.constructor_calls_replaced;
+      return *this;
+    }
+  };
+
+  // An iput of a simple constructor, which writes either the parameter of the
+  // given index or a literal into a field of the object under construction.
+  struct FieldAssignment {
+    IROpcode iput_opcode;
+    DexField* field;
+    boost::optional<size_t> param;
+    int64_t literal;
+  };
+
+  using SimpleConstructors =
+      std::unordered_map<const DexMethod*, std::vector<FieldAssignment>>;
+
+  ScalarReplacementPass() : Pass("ScalarReplacementPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  // The constructors of the classes in scope whose allocations may be
+  // replaced, and that do nothing but call Object's constructor and assign
+  // their parameters or constants to fields of their class.
+  static SimpleConstructors find_simple_constructors(const Scope& scope);
+
+  static Stats process_code(IRCode* code,
+                            const SimpleConstructors& constructors);
+};
@@ -9,6 +9,9 @@
 
 #include "ApiLevelChecker.h"
 #include "ClassHierarchy.h"
+#include "ConfigFiles.h"
+#include "DexStore.h"
+#include "PassManager.h"
 #include "Resolver.h"
 #include "Walkers.h"
 
@@ -25,7 +28,10 @@
  *       color
  *    b. If a static method has no color, relocate it if it has only one caller,
  *       log it if it has no caller ( should be deleted by other pass ).
- *    c. If a static method has multiple colors, keep it unchanged.
+ *    c. If a static method has multiple colors, relocate it to the class whose
+ *       methods call it most frequently according to the method profiles, if
+ *       that class can host it for all the callers. Otherwise, keep it
+ *       unchanged.
  */
 
 namespace {
@@ -71,6 +77,11 @@ struct StaticCallGraph {
   std::vector<std::unordered_set<int>> callees;
   // The direction of the edge points from the callee to caller
   std::vector<std::unordered_set<int>> callers;
+  // The classes outside the graph with methods that call the vertex
+  std::vector<std::unordered_set<const DexType*>> caller_classes;
+  // The profiled number of calls of the vertex by the methods of each of
+  // these classes
+  std::vector<std::unordered_map<const DexType*, double>> caller_heat;
 
   // push into static methods to construct call graph
   void add_vertex(DexMethod* method) {
@@ -95,6 +106,8 @@ void build_call_graph(const std::vector<DexClass*>& candidate_classes,
 
   graph.callers.resize(graph.vertices.size());
   graph.callees.resize(graph.vertices.size());
+  graph.caller_classes.resize(graph.vertices.size());
+  graph.caller_heat.resize(graph.vertices.size());
 
   for (auto& meth_id : graph.method_id_map) {
     DexMethod* caller = meth_id.first;
@@ -150,12 +163,22 @@ void color_vertex(StaticCallGraph& graph, DexMethod* method, int color) {
  * For private static method, should color all the caller within the class to
  * the same color
  */
-void color_from_a_class(StaticCallGraph& graph, DexClass* cls, int color) {
+void color_from_a_class(StaticCallGraph& graph,
+                        DexClass* cls,
+                        int color,
+                        const method_profiles::StatsMap* stats) {
   auto process_method = [&](DexMethod* caller) {
     IRCode* code = caller->get_code();
     if (code == nullptr) {
       return;
     }
+    double call_count = 0;
+    if (stats != nullptr) {
+      auto it = stats->find(caller);
+      if (it != stats->end()) {
+        call_count = it->second.call_count;
+      }
+    }
     for (const auto& mie : InstructionIterable(code)) {
       if (mie.insn->has_method()) {
         if (mie.insn->opcode() != OPCODE_INVOKE_STATIC) {
@@ -163,7 +186,12 @@ void color_from_a_class(StaticCallGraph& graph, DexClass* cls, int color) {
         }
         DexMethod* callee =
             resolve_method(mie.insn->get_method(), MethodSearch::Static);
-        if (graph.method_id_map.find(callee) != graph.method_id_map.end()) {
+        auto it = graph.method_id_map.find(callee);
+        if (it != graph.method_id_map.end()) {
+          graph.caller_classes[it->second].insert(cls->get_type());
+          if (call_count > 0) {
+            graph.caller_heat[it->second][cls->get_type()] += call_count;
+          }
           color_vertex(graph, callee, color);
         }
       }
@@ -177,10 +205,114 @@ void color_from_a_class(StaticCallGraph& graph, DexClass* cls, int color) {
   }
 }
 
+/**
+ * Whether invoking a static method of the class may run no class initializers
+ * besides the ones that its callers would run anyway
+ */
+bool is_init_free(const DexClass* cls) {
+  while (cls != type_class(type::java_lang_Object())) {
+    if (cls == nullptr || cls->is_external() || cls->get_clinit() != nullptr) {
+      return false;
+    }
+    cls = type_class(cls->get_super_class());
+  }
+  return true;
+}
+
+bool is_public_internal(const DexClass* cls) {
+  return cls == nullptr || cls->is_external() || is_public(cls);
+}
+
+/**
+ * Whether the method only refers to classes and members that are accessible
+ * from any package
+ */
+bool only_refs_public(const DexMethod* method) {
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    auto insn = mie.insn;
+    if (insn->has_type() &&
+        !is_public_internal(
+            type_class(type::get_element_type_if_array(insn->get_type())))) {
+      return false;
+    }
+    if (insn->has_field()) {
+      auto field = resolve_field(insn->get_field());
+      if (field != nullptr && !field->is_external() &&
+          (!is_public(field) ||
+           !is_public_internal(type_class(field->get_class())))) {
+        return false;
+      }
+    }
+    if (insn->has_method()) {
+      auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (callee != nullptr && !callee->is_external() &&
+          (!is_public(callee) ||
+           !is_public_internal(type_class(callee->get_class())))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * The class whose methods call the multi colored vertex most frequently, if
+ * the method can be relocated there
+ */
+DexClass* find_hot_caller_class(const StaticCallGraph& graph,
+                                const StaticCallGraph::Vertex& vertex,
+                                const XStoreRefs* xstores) {
+  const auto& heat = graph.caller_heat[vertex.id];
+  const DexType* hottest = nullptr;
+  for (const auto& pair : heat) {
+    if (hottest == nullptr || pair.second > heat.at(hottest) ||
+        (pair.second == heat.at(hottest) &&
+         compare_dextypes(pair.first, hottest))) {
+      hottest = pair.first;
+    }
+  }
+  if (hottest == nullptr) {
+    return nullptr;
+  }
+  auto to_class = type_class(hottest);
+  // Callers in other classes and packages must still be able to call the
+  // method without initializing any other classes.
+  if (to_class == nullptr || is_interface(to_class) || !is_public(to_class) ||
+      !is_init_free(to_class) || !only_refs_public(vertex.method) ||
+      to_class->rstate.get_api_level() <
+          api::LevelChecker::get_method_level(vertex.method)) {
+    return nullptr;
+  }
+  if (xstores != nullptr) {
+    std::vector<const DexType*> caller_classes(
+        graph.caller_classes[vertex.id].begin(),
+        graph.caller_classes[vertex.id].end());
+    for (int caller_id : graph.callers[vertex.id]) {
+      caller_classes.push_back(graph.vertices[caller_id].method->get_class());
+    }
+    for (auto caller_class : caller_classes) {
+      if (xstores->illegal_ref(caller_class, to_class->get_type())) {
+        return nullptr;
+      }
+    }
+    std::vector<DexType*> types;
+    vertex.method->gather_types(types);
+    for (auto type : types) {
+      if (xstores->illegal_ref(to_class->get_type(), type)) {
+        return nullptr;
+      }
+    }
+  }
+  return to_class;
+}
+
 /**
  * Relocate static methods in the graph to their callers
  */
-int relocate_clusters(const StaticCallGraph& graph, const Scope& scope) {
+int relocate_clusters(const StaticCallGraph& graph,
+                      const Scope& scope,
+                      const XStoreRefs* xstores,
+                      int* relocated_to_hot_callers) {
   int relocated_methods = 0;
   for (const StaticCallGraph::Vertex& vertex : graph.vertices) {
     // Vertex is not colored, which means the method is unreachable outside the
@@ -213,8 +345,16 @@ int relocate_clusters(const StaticCallGraph& graph, const Scope& scope) {
         relocated_methods++;
       }
       set_public(vertex.method);
+    } else if (auto to_class = find_hot_caller_class(graph, vertex, xstores)) {
+      // multiple colors, with a hottest caller class that can host it
+      TRACE(STATIC_RELO, 4, "relocate %s to hot caller class %s",
+            SHOW(vertex.method), SHOW(to_class));
+      relocate_method(vertex.method, to_class->get_type());
+      relocated_methods++;
+      (*relocated_to_hot_callers)++;
+      set_public(vertex.method);
     }
-    // keep multiple colored vertices untouched
+    // keep other multiple colored vertices untouched
   }
   return relocated_methods;
 }
@@ -249,8 +389,10 @@ std::vector<DexClass*> StaticReloPassV2::gen_candidates(const Scope& scope) {
   return candidate_classes;
 }
 
-int StaticReloPassV2::run_relocation(
-    const Scope& scope, std::vector<DexClass*>& candidate_classes) {
+int StaticReloPassV2::run_relocation(const Scope& scope,
+                                     std::vector<DexClass*>& candidate_classes,
+                                     const method_profiles::StatsMap* stats,
+                                     const XStoreRefs* xstores) {
   StaticCallGraph graph;
   build_call_graph(candidate_classes, graph);
   std::unordered_set<DexClass*> set(candidate_classes.begin(),
@@ -259,20 +401,35 @@ int StaticReloPassV2::run_relocation(
     if (set.find(scope[color]) != set.end()) {
       continue;
     }
-    color_from_a_class(graph, scope[color], color);
+    color_from_a_class(graph, scope[color], color, stats);
   }
 
-  return relocate_clusters(graph, scope);
+  int relocated_to_hot_callers = 0;
+  int relocated_methods =
+      relocate_clusters(graph, scope, xstores, &relocated_to_hot_callers);
+  TRACE(STATIC_RELO, 2, "\trelocate %d static methods to hot callers",
+        relocated_to_hot_callers);
+  return relocated_methods;
 }
 
 void StaticReloPassV2::run_pass(DexStoresVector& stores,
-                                ConfigFiles& /* unused */,
+                                ConfigFiles& conf,
                                 PassManager& mgr) {
   Scope scope = build_class_scope(stores);
   std::vector<DexClass*> candidate_classes = gen_candidates(scope);
   TRACE(STATIC_RELO, 2, "candidate_classes %d", candidate_classes.size());
 
-  int relocated_methods = run_relocation(scope, candidate_classes);
+  const method_profiles::StatsMap* stats = nullptr;
+  if (m_relocate_to_hot_callers) {
+    stats = &conf.get_method_profiles().method_stats(m_interaction);
+    if (stats->empty()) {
+      TRACE(STATIC_RELO, 2, "no profiles for %s", m_interaction.c_str());
+      stats = nullptr;
+    }
+  }
+  XStoreRefs xstores(stores);
+  int relocated_methods =
+      run_relocation(scope, candidate_classes, stats, &xstores);
   int empty_classes = 0;
   TRACE(STATIC_RELO, 4, "\tEmpty classes after relocation:");
   for (DexClass* cls : candidate_classes) {
@@ -7,15 +7,38 @@
 
 #pragma once
 
+#include "MethodProfiles.h"
 #include "Pass.h"
 
+class XStoreRefs;
+
 namespace static_relo_v2 {
 
 class StaticReloPassV2 : public Pass {
  public:
   StaticReloPassV2() : Pass("StaticReloPassV2") {}
+
+  void bind_config() override {
+    bind("interaction", method_profiles::COLD_START, m_interaction);
+    bind("relocate_to_hot_callers", true, m_relocate_to_hot_callers,
+         "Relocate static methods called from several classes to the class "
+         "of their most frequent profiled callers.");
+  }
+
   static std::vector<DexClass*> gen_candidates(const Scope&);
-  static int run_relocation(const Scope&, std::vector<DexClass*>&);
+  /*
+   * With `stats`, static methods that are called from several classes are
+   * relocated to the class whose methods call them most frequently, if all
+   * their callers in `xstores` can still reach them there.
+   */
+  static int run_relocation(const Scope&,
+                            std::vector<DexClass*>&,
+                            const method_profiles::StatsMap* stats = nullptr,
+                            const XStoreRefs* xstores = nullptr);
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  std::string m_interaction;
+  bool m_relocate_to_hot_callers;
 };
 } // namespace static_relo_v2
@@ -9,6 +9,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "DexClass.h"
@@ -19,6 +20,8 @@ namespace {
 
 constexpr const char* METRIC_NUM_MATCHES = "num_method_matches";
 constexpr const char* METRIC_POS_DROPPED = "num_pos_dropped";
+constexpr const char* METRIC_NON_THROWING_POS_DROPPED =
+    "num_non_throwing_pos_dropped";
 constexpr const char* METRIC_VAR_DROPPED = "num_var_dropped";
 constexpr const char* METRIC_PROLOGUE_DROPPED = "num_prologue_dropped";
 constexpr const char* METRIC_EPILOGUE_DROPPED = "num_epilogue_dropped";
@@ -29,6 +32,30 @@ bool is_debug_entry(const MethodItemEntry& mie) {
   return mie.type == MFLOW_DEBUG || mie.type == MFLOW_POSITION;
 }
 
+/*
+ * A position only ends up in a stack trace if an instruction that it covers
+ * throws or calls out, or if it is the parent of such a position. Everything
+ * else only matters for stepping through the code in a debugger.
+ */
+std::unordered_set<const DexPosition*> positions_of_throwing_insns(
+    IRCode& code) {
+  std::unordered_set<const DexPosition*> positions;
+  const DexPosition* current{nullptr};
+  for (const auto& mie : code) {
+    if (mie.type == MFLOW_POSITION) {
+      current = mie.pos.get();
+    } else if (mie.type == MFLOW_OPCODE &&
+               opcode::can_throw(mie.insn->opcode())) {
+      for (auto pos = current; pos != nullptr; pos = pos->parent) {
+        if (!positions.insert(pos).second) {
+          break;
+        }
+      }
+    }
+  }
+  return positions;
+}
+
 } // namespace
 
 namespace strip_debug_info_impl {
@@ -36,6 +63,7 @@ namespace strip_debug_info_impl {
 Stats& Stats::operator+=(const Stats& other) {
   num_matches += other.num_matches;
   num_pos_dropped += other.num_pos_dropped;
+  num_non_throwing_pos_dropped += other.num_non_throwing_pos_dropped;
   num_var_dropped += other.num_var_dropped;
   num_prologue_dropped += other.num_prologue_dropped;
   num_epilogue_dropped += other.num_epilogue_dropped;
@@ -122,10 +150,21 @@ Stats StripDebugInfo::run(IRCode& code, bool should_drop_synth) {
   ++stats.num_matches;
   bool debug_info_empty = true;
   bool force_discard = m_config.drop_all_dbg_info || should_drop_synth;
+  bool drop_non_throwing = m_config.drop_non_throwing_positions &&
+                           !drop_line_numbers() && !force_discard;
+  std::unordered_set<const DexPosition*> throwing_positions;
+  if (drop_non_throwing) {
+    throwing_positions = positions_of_throwing_insns(code);
+  }
 
   for (auto it = code.begin(); it != code.end();) {
     const auto& mie = *it;
-    if (should_remove(mie, stats) || (force_discard && is_debug_entry(mie))) {
+    if (drop_non_throwing && mie.type == MFLOW_POSITION &&
+        !throwing_positions.count(mie.pos.get())) {
+      ++stats.num_non_throwing_pos_dropped;
+      it = code.erase(it);
+    } else if (should_remove(mie, stats) ||
+               (force_discard && is_debug_entry(mie))) {
       // Even though force_discard will drop the debug item below, preventing
       // any of the debug entries for :meth to be output, we still want to
       // erase those entries here so that transformations like inlining won't
@@ -168,12 +207,14 @@ void StripDebugInfoPass::run_pass(DexStoresVector& stores,
   auto stats = impl.run(scope);
   TRACE(DBGSTRIP,
         1,
-        "Matched on %d methods. Removed %d dbg line entries, %d dbg local var "
+        "Matched on %d methods. Removed %d dbg line entries, %d non-throwing "
+        "dbg line entries, %d dbg local var "
         "entries, %d dbg prologue start entries, %d "
         "epilogue end entries, %u empty dbg tables, "
         "%d skipped due to inlining",
         stats.num_matches,
         stats.num_pos_dropped,
+        stats.num_non_throwing_pos_dropped,
         stats.num_var_dropped,
         stats.num_prologue_dropped,
         stats.num_epilogue_dropped,
@@ -182,6 +223,8 @@ void StripDebugInfoPass::run_pass(DexStoresVector& stores,
 
   mgr.incr_metric(METRIC_NUM_MATCHES, stats.num_matches);
   mgr.incr_metric(METRIC_POS_DROPPED, stats.num_pos_dropped);
+  mgr.incr_metric(METRIC_NON_THROWING_POS_DROPPED,
+                  stats.num_non_throwing_pos_dropped);
   mgr.incr_metric(METRIC_VAR_DROPPED, stats.num_var_dropped);
   mgr.incr_metric(METRIC_PROLOGUE_DROPPED, stats.num_prologue_dropped);
   mgr.incr_metric(METRIC_EPILOGUE_DROPPED, stats.num_epilogue_dropped);
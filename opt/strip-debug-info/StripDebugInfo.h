@@ -19,6 +19,9 @@ class StripDebugInfoPass : public Pass {
     bind("drop_all_dbg_info", false, m_config.drop_all_dbg_info);
     bind("drop_local_variables", true, m_config.drop_local_variables);
     bind("drop_line_numbers", false, m_config.drop_line_nrs);
+    bind("drop_non_throwing_positions",
+         false,
+         m_config.drop_non_throwing_positions);
     bind("drop_src_files", true, m_config.drop_src_files);
     bind("drop_prologue_end", true, m_config.drop_prologue_end);
     bind("drop_epilogue_begin", true, m_config.drop_epilogue_begin);
@@ -41,6 +44,9 @@ class StripDebugInfoPass : public Pass {
     bool drop_all_dbg_info{false};
     bool drop_local_variables{false};
     bool drop_line_nrs{false};
+    // Only keep the positions that some throwing instruction, invokes
+    // included, would be symbolicated with.
+    bool drop_non_throwing_positions{false};
     bool drop_src_files{false};
     bool drop_prologue_end{false};
     bool drop_epilogue_begin{false};
@@ -58,6 +64,7 @@ namespace strip_debug_info_impl {
 struct Stats {
   int num_matches{0};
   int num_pos_dropped{0};
+  int num_non_throwing_pos_dropped{0};
   int num_var_dropped{0};
   int num_prologue_dropped{0};
   int num_epilogue_dropped{0};
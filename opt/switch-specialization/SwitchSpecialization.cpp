@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SwitchSpecialization.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "ConfigFiles.h"
+#include "ConstantPropagationAnalysis.h"
+#include "ConstantPropagationTransform.h"
+#include "ConstantPropagationWholeProgramState.h"
+#include "ControlFlow.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "PatriciaTreeArena.h"
+#include "Resolver.h"
+#include "Show.h"
+#include "Trace.h"
+#include "Walkers.h"
+
+using namespace constant_propagation;
+
+namespace switch_specialization {
+
+namespace {
+
+constexpr const char* METRIC_CALL_SITES = "num_specialized_call_sites";
+constexpr const char* METRIC_CLONES = "num_clones";
+constexpr const char* METRIC_REMOVED_INSTRUCTIONS = "num_removed_instructions";
+
+bool is_candidate(DexMethod* method, const Config& config) {
+  auto code = method->get_code();
+  if (code == nullptr || method->is_virtual() || is_native(method) ||
+      method::is_init(method) || method::is_clinit(method) ||
+      code->count_opcodes() < config.min_callee_size) {
+    return false;
+  }
+  for (auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == OPCODE_SWITCH) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// An approximation of the constant arguments as a string, which keys the
+// clones.
+std::string get_key(const ConstantArguments& args) {
+  std::ostringstream oss;
+  for (auto& pair : args.bindings()) {
+    auto c = pair.second.maybe_get<SignedConstantDomain>();
+    if (c && c->get_constant()) {
+      oss << pair.first << ":" << *c->get_constant() << ",";
+    }
+  }
+  return oss.str();
+}
+
+struct CallSite {
+  IRInstruction* insn;
+  DexMethod* callee;
+  ConstantArguments args;
+};
+
+// The invokes of candidate callees in the method that have constant
+// arguments.
+std::vector<CallSite> find_call_sites(
+    IRCode& code, const std::unordered_set<DexMethod*>& candidates) {
+  std::vector<CallSite> call_sites;
+  code.build_cfg(/* editable */ false);
+  auto& cfg = code.cfg();
+  // None of the abstract states outlive the analysis of the method.
+  sparta::PatriciaTreeArena arena;
+  intraprocedural::FixpointIterator fp_iter(cfg, ConstantPrimitiveAnalyzer());
+  fp_iter.run(ConstantEnvironment());
+  for (auto block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      if (op == OPCODE_INVOKE_STATIC || op == OPCODE_INVOKE_DIRECT) {
+        auto callee =
+            resolve_method(insn->get_method(), opcode_to_search(insn));
+        if (callee != nullptr && candidates.count(callee)) {
+          ConstantArguments args;
+          bool any_constant = false;
+          for (size_t i = 0; i < insn->srcs_size(); ++i) {
+            auto c = env.get(insn->src(i)).maybe_get<SignedConstantDomain>();
+            if (c && c->get_constant()) {
+              args.set(i, *c);
+              any_constant = true;
+            }
+          }
+          if (any_constant) {
+            call_sites.push_back(CallSite{insn, callee, args});
+          }
+        }
+      }
+      fp_iter.analyze_instruction(insn, &env);
+    }
+  }
+  code.clear_cfg();
+  return call_sites;
+}
+
+DexMethod* make_clone(DexMethod* callee) {
+  for (size_t i = 0;; ++i) {
+    auto name = DexString::make_string(callee->str() + "$spec$" +
+                                       std::to_string(i));
+    if (DexMethod::get_method(callee->get_class(), name,
+                              callee->get_proto()) == nullptr) {
+      auto clone =
+          DexMethod::make_method_from(callee, callee->get_class(), name);
+      type_class(callee->get_class())->add_method(clone);
+      return clone;
+    }
+  }
+}
+
+} // namespace
+
+size_t count_dead_instructions(IRCode* code, const ConstantArguments& args) {
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  sparta::PatriciaTreeArena arena;
+  intraprocedural::FixpointIterator fp_iter(cfg, ConstantPrimitiveAnalyzer());
+  fp_iter.run(interprocedural::env_with_params(code, args));
+  size_t dead = 0;
+  for (auto block : cfg.blocks()) {
+    if (fp_iter.get_entry_state_at(block).is_bottom()) {
+      dead += block->num_opcodes();
+    }
+  }
+  code->clear_cfg();
+  return dead;
+}
+
+void specialize_code(IRCode* code, const ConstantArguments& args) {
+  code->build_cfg(/* editable */ false);
+  {
+    auto& cfg = code->cfg();
+    sparta::PatriciaTreeArena arena;
+    intraprocedural::FixpointIterator fp_iter(cfg,
+                                              ConstantPrimitiveAnalyzer());
+    fp_iter.run(interprocedural::env_with_params(code, args));
+    Transform tf;
+    tf.apply(fp_iter, WholeProgramState(), code);
+  }
+  code->clear_cfg();
+  // The transform only turns the decided branches into gotos.
+  code->build_cfg(/* editable */ true);
+  code->cfg().simplify();
+  code->clear_cfg();
+}
+
+Stats specialize_call_sites(
+    const Scope& scope,
+    const std::function<bool(const DexMethod*)>& is_hot_caller,
+    const Config& config) {
+  std::unordered_set<DexMethod*> candidates;
+  walk::methods(scope, [&](DexMethod* method) {
+    if (is_candidate(method, config)) {
+      candidates.insert(method);
+    }
+  });
+  if (candidates.empty()) {
+    return Stats();
+  }
+
+  std::mutex mutex;
+  std::vector<CallSite> call_sites;
+  walk::parallel::code(scope, [&](DexMethod* caller, IRCode& code) {
+    if (!is_hot_caller(caller)) {
+      return;
+    }
+    auto method_call_sites = find_call_sites(code, candidates);
+    std::lock_guard<std::mutex> lock(mutex);
+    call_sites.insert(call_sites.end(), method_call_sites.begin(),
+                      method_call_sites.end());
+  });
+
+  // The call sites by callee and by constant arguments, in a deterministic
+  // order.
+  std::map<DexMethod*,
+           std::map<std::string, std::vector<const CallSite*>>,
+           dexmethods_comparator>
+      grouped;
+  for (auto& call_site : call_sites) {
+    grouped[call_site.callee][get_key(call_site.args)].push_back(&call_site);
+  }
+
+  Stats stats;
+  for (auto& pair : grouped) {
+    auto callee = pair.first;
+    // The most common constant arguments first.
+    std::vector<const std::vector<const CallSite*>*> groups;
+    for (auto& key_and_group : pair.second) {
+      groups.push_back(&key_and_group.second);
+    }
+    std::stable_sort(groups.begin(), groups.end(),
+                     [](const std::vector<const CallSite*>* a,
+                        const std::vector<const CallSite*>* b) {
+                       return a->size() > b->size();
+                     });
+    size_t clones = 0;
+    for (auto group : groups) {
+      if (clones >= config.max_clones_per_method) {
+        break;
+      }
+      const auto& args = group->front()->args;
+      auto dead = count_dead_instructions(callee->get_code(), args);
+      if (dead < config.min_dead_instructions) {
+        continue;
+      }
+      auto clone = make_clone(callee);
+      auto size_before = clone->get_code()->count_opcodes();
+      specialize_code(clone->get_code(), args);
+      auto size_after = clone->get_code()->count_opcodes();
+      TRACE(SWSPEC, 2, "Specialized %s for %s into %s: %zu -> %zu instructions",
+            SHOW(callee), get_key(args).c_str(), SHOW(clone), size_before,
+            size_after);
+      for (auto call_site : *group) {
+        call_site->insn->set_method(clone);
+      }
+      ++clones;
+      stats.call_sites += group->size();
+      stats.removed_instructions += size_before - std::min(size_before,
+                                                           size_after);
+    }
+    stats.clones += clones;
+  }
+  return stats;
+}
+
+void SwitchSpecializationPass::run_pass(DexStoresVector& stores,
+                                        ConfigFiles& conf,
+                                        PassManager& mgr) {
+  const auto& method_stats =
+      conf.get_method_profiles().method_stats(m_config.interaction);
+  if (method_stats.empty()) {
+    TRACE(SWSPEC, 1, "No profiles for %s", m_config.interaction.c_str());
+    return;
+  }
+  auto scope = build_class_scope(stores);
+  auto is_hot_caller = [&](const DexMethod* method) {
+    auto it = method_stats.find(method);
+    return it != method_stats.end() &&
+           it->second.appear_percent >= m_config.min_appear_percent;
+  };
+  auto stats = specialize_call_sites(scope, is_hot_caller, m_config);
+  TRACE(SWSPEC, 1,
+        "Specialized %zu call sites with %zu clones, removing %zu "
+        "instructions",
+        stats.call_sites, stats.clones, stats.removed_instructions);
+  mgr.set_metric(METRIC_CALL_SITES, stats.call_sites);
+  mgr.set_metric(METRIC_CLONES, stats.clones);
+  mgr.set_metric(METRIC_REMOVED_INSTRUCTIONS, stats.removed_instructions);
+}
+
+static SwitchSpecializationPass s_pass;
+
+} // namespace switch_specialization
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "IPConstantPropagationAnalysis.h"
+#include "MethodProfiles.h"
+#include "Pass.h"
+
+/*
+ * This pass specializes methods that switch on an argument for the constant
+ * arguments that hot call sites pass them.
+ *
+ * The inliner already accounts for the cases that constant arguments prune
+ * when it estimates the cost of a callee, but callees that remain too big for
+ * its budget stay calls that execute the whole switch dispatch. Here, for each
+ * hot call site (i.e. in a method that the profiles show to be hot) of a
+ * static or direct method containing a switch, with some constant arguments,
+ * the callee gets cloned. Constant propagation then materializes the constant
+ * arguments in the clone and removes the branches they decide, and the call
+ * site invokes the clone instead. Call sites passing the same constants share
+ * their clone.
+ *
+ * The clones keep the signature of the original methods, so the call sites
+ * only change the method they invoke.
+ */
+namespace switch_specialization {
+
+struct Config {
+  // The profiled interaction that tells which call sites are hot.
+  std::string interaction;
+  // The minimum appear100 of the callers whose call sites get specialized.
+  float min_appear_percent{10.0};
+  // The minimum number of instructions of the callees, so that methods small
+  // enough to be inlined are left to the inliner.
+  size_t min_callee_size{40};
+  // The minimum number of instructions that constant propagation must prove
+  // dead in a callee for the constant arguments to be worth a clone.
+  size_t min_dead_instructions{10};
+  // The maximum number of clones per callee.
+  size_t max_clones_per_method{4};
+};
+
+using ConstantArguments = constant_propagation::interprocedural::ArgumentDomain;
+
+// The number of instructions of the code that the constant arguments make
+// unreachable.
+size_t count_dead_instructions(IRCode* code, const ConstantArguments& args);
+
+// Removes the branches that the constant arguments decide and the code that
+// becomes unreachable.
+void specialize_code(IRCode* code, const ConstantArguments& args);
+
+struct Stats {
+  size_t call_sites{0};
+  size_t clones{0};
+  size_t removed_instructions{0};
+};
+
+// Specializes the callees of the call sites in the methods for which
+// is_hot_caller holds.
+Stats specialize_call_sites(
+    const Scope& scope,
+    const std::function<bool(const DexMethod*)>& is_hot_caller,
+    const Config& config);
+
+class SwitchSpecializationPass : public Pass {
+ public:
+  SwitchSpecializationPass() : Pass("SwitchSpecializationPass") {}
+
+  void bind_config() override {
+    bind("interaction", method_profiles::COLD_START, m_config.interaction);
+    bind("min_appear_percent", 10.0f, m_config.min_appear_percent);
+    bind("min_callee_size", size_t(40), m_config.min_callee_size);
+    bind("min_dead_instructions", size_t(10), m_config.min_dead_instructions);
+    bind("max_clones_per_method", size_t(4), m_config.max_clones_per_method);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  Config m_config;
+};
+
+} // namespace switch_specialization
@@ -16,6 +16,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 #include "ClassHierarchy.h"
 #include "Debug.h"
 #include "DexClass.h"
@@ -34,17 +36,26 @@
 constexpr const char* METRIC_GETTERS_REMOVED = "getter_methods_removed_count";
 constexpr const char* METRIC_WRAPPERS_REMOVED = "wrapper_methods_removed_count";
 constexpr const char* METRIC_CTORS_REMOVED = "constructors_removed_count";
+constexpr const char* METRIC_SETTERS_REMOVED = "setter_methods_removed_count";
 
 namespace {
 struct SynthMetrics {
   SynthMetrics()
       : getters_removed_count(0),
         wrappers_removed_count(0),
-        ctors_removed_count(0) {}
+        ctors_removed_count(0),
+        setters_removed_count(0) {}
 
   size_t getters_removed_count;
   size_t wrappers_removed_count;
   size_t ctors_removed_count;
+  size_t setters_removed_count;
+};
+
+// The field that a trivial setter writes, and how.
+struct FieldSetter {
+  DexField* field;
+  IROpcode put_opcode;
 };
 } // anonymous namespace
 
@@ -142,6 +153,65 @@ DexField* trivial_get_static_field_wrapper(DexMethod* m) {
   return def;
 }
 
+/*
+ * Matches the patterns that javac emits for access$NNN setters:
+ *   iput-TYPE vB, vA, FIELD
+ *   ( return-TYPE vB | return-void )
+ * where vA and vB are the two parameters, and:
+ *   sput-TYPE vA, FIELD
+ *   ( return-TYPE vA | return-void )
+ * where vA is the only parameter.
+ */
+boost::optional<FieldSetter> trivial_set_field_wrapper(DexMethod* m) {
+  auto code = m->get_code();
+  if (code == nullptr) return boost::none;
+
+  auto ii = InstructionIterable(code);
+  auto it = ii.begin();
+  auto end = ii.end();
+  std::vector<reg_t> params;
+  while (it != end && opcode::is_load_param(it->insn->opcode())) {
+    params.push_back(it->insn->dest());
+    ++it;
+  }
+  if (it == end) return boost::none;
+
+  auto put = it->insn;
+  auto op = put->opcode();
+  if (is_iput(op)) {
+    if (params.size() != 2 || put->src(1) != params[0] ||
+        put->src(0) != params[1]) {
+      return boost::none;
+    }
+  } else if (is_sput(op)) {
+    if (params.size() != 1 || put->src(0) != params[0]) {
+      return boost::none;
+    }
+  } else {
+    return boost::none;
+  }
+  ++it;
+  if (it == end) return boost::none;
+
+  if (is_return_value(it->insn->opcode())) {
+    if (it->insn->src(0) != put->src(0)) return boost::none;
+  } else if (it->insn->opcode() != OPCODE_RETURN_VOID) {
+    return boost::none;
+  }
+  ++it;
+  if (it != end) return boost::none;
+
+  // Check to make sure we have a concrete field reference.
+  auto search = is_iput(op) ? FieldSearch::Instance : FieldSearch::Static;
+  auto def = resolve_field(put->get_field(), search);
+  if (def == nullptr || !def->is_concrete()) return boost::none;
+  // Only the declaring class may write a final field, so the write can't
+  // move into the callers.
+  if (is_final(def)) return boost::none;
+
+  return FieldSetter{def, op};
+}
+
 /*
  * Matches the pattern:
  *   invoke-(direct|static) {vA, ..., vB} METHOD
@@ -246,6 +316,7 @@ DexMethod* trivial_ctor_wrapper(DexMethod* m) {
 
 struct WrapperMethods {
   std::unordered_map<DexMethod*, DexField*> getters;
+  std::unordered_map<DexMethod*, FieldSetter> setters;
   std::unordered_map<DexMethod*, DexMethod*> wrappers;
   std::unordered_map<DexMethod*, DexMethod*> ctors;
   std::unordered_map<DexMethod*, std::pair<DexMethod*, int>> wrapped;
@@ -272,6 +343,11 @@ void purge_wrapped_wrappers(WrapperMethods& ssms) {
       ssms.getters.erase(p.second);
       ssms.next_pass = true;
     }
+    if (ssms.setters.count(p.second)) {
+      TRACE(SYNT, 5, "Removing wrapped setter: %s", SHOW(p.second));
+      ssms.setters.erase(p.second);
+      ssms.next_pass = true;
+    }
   }
   for (auto meth : remove) {
     auto wrapped = ssms.wrapped.find(ssms.wrappers[meth]);
@@ -326,6 +402,13 @@ WrapperMethods analyze(const ClassHierarchy& ch,
           ssms.getters.emplace(dmethod, sfield);
           continue;
         }
+        auto setter = trivial_set_field_wrapper(dmethod);
+        if (setter) {
+          TRACE(SYNT, 2, "Static trivial setter: %s", SHOW(dmethod));
+          TRACE(SYNT, 2, "  Sets field: %s", SHOW(setter->field));
+          ssms.setters.emplace(dmethod, *setter);
+          continue;
+        }
       }
 
       if (can_optimize(dmethod, synthConfig)) {
@@ -416,6 +499,37 @@ void replace_getter_wrapper(IRCode* transform,
   transform->remove_opcode(move_result);
 }
 
+// The setter call's move-result, if any, becomes a move of the stored value.
+void replace_setter_wrapper(IRCode* transform,
+                            IRInstruction* insn,
+                            IRInstruction* move_result,
+                            const FieldSetter& setter) {
+  TRACE(SYNT, 2, "Optimizing setter wrapper call: %s", SHOW(insn));
+  auto field = setter.field;
+  redex_assert(field->is_concrete());
+  set_public(field);
+
+  auto new_put = (new IRInstruction(setter.put_opcode))->set_field(field);
+  if (is_static(field)) {
+    new_put->set_src(0, insn->src(0));
+  } else {
+    new_put->set_src(0, insn->src(1))->set_src(1, insn->src(0));
+  }
+  TRACE(SYNT, 2, "Created instruction: %s", SHOW(new_put));
+  std::vector<IRInstruction*> replacement{new_put};
+  if (move_result != nullptr) {
+    replacement.push_back(
+        (new IRInstruction(opcode::move_result_to_move(move_result->opcode())))
+            ->set_src(0, new_put->src(0))
+            ->set_dest(move_result->dest()));
+  }
+
+  transform->replace_opcode(insn, replacement);
+  if (move_result != nullptr) {
+    transform->remove_opcode(move_result);
+  }
+}
+
 void update_invoke(IRCode* transform, IRInstruction* insn, DexMethod* method) {
   auto op = insn->opcode();
   auto new_invoke = [&] {
@@ -518,6 +632,8 @@ void replace_wrappers(const ClassHierarchy& ch,
                       WrapperMethods& ssms) {
   std::vector<std::tuple<IRInstruction*, IRInstruction*, DexField*>>
       getter_calls;
+  std::vector<std::tuple<IRInstruction*, IRInstruction*, FieldSetter>>
+      setter_calls;
   std::vector<std::pair<IRInstruction*, DexMethod*>> wrapper_calls;
   std::vector<std::pair<IRInstruction*, DexMethod*>> wrapped_calls;
   std::vector<std::pair<IRInstruction*, DexMethod*>> ctor_calls;
@@ -545,6 +661,15 @@ void replace_wrappers(const ClassHierarchy& ch,
         continue;
       }
 
+      auto const found_set = ssms.setters.find(callee);
+      if (found_set != ssms.setters.end()) {
+        auto const next_insn = std::next(it)->insn;
+        auto const move_result =
+            opcode::is_move_result(next_insn->opcode()) ? next_insn : nullptr;
+        setter_calls.emplace_back(insn, move_result, found_set->second);
+        continue;
+      }
+
       auto const found_wrap = ssms.wrappers.find(callee);
       if (found_wrap != ssms.wrappers.end()) {
         auto method = found_wrap->second;
@@ -637,8 +762,8 @@ void replace_wrappers(const ClassHierarchy& ch,
                      }),
       wrapped_calls.end());
   // Fix up everything left.
-  if (getter_calls.empty() && wrapper_calls.empty() && ctor_calls.empty() &&
-      wrapped_calls.empty()) {
+  if (getter_calls.empty() && setter_calls.empty() && wrapper_calls.empty() &&
+      ctor_calls.empty() && wrapped_calls.empty()) {
     return;
   }
   auto code = caller_method->get_code();
@@ -646,6 +771,10 @@ void replace_wrappers(const ClassHierarchy& ch,
     using std::get;
     replace_getter_wrapper(code, get<0>(g), get<1>(g), get<2>(g));
   }
+  for (auto s : setter_calls) {
+    using std::get;
+    replace_setter_wrapper(code, get<0>(s), get<1>(s), get<2>(s));
+  }
   for (auto wpair : wrapper_calls) {
     auto call_inst = wpair.first;
     auto wrapper = static_cast<DexMethod*>(call_inst->get_method());
@@ -718,6 +847,25 @@ void remove_dead_methods(WrapperMethods& ssms,
 
   metrics.getters_removed_count += (synth_removed + other_removed + pub_meth);
 
+  synth_removed = 0;
+  other_removed = 0;
+  pub_meth = 0;
+  for (auto const sp : ssms.setters) {
+    remove_meth(sp.first);
+  }
+  any_remove = any_remove || (synth_removed && other_removed);
+  if (synth_removed) {
+    TRACE(SYNT, 1, "Synthetic setters removed %ld", synth_removed);
+  }
+  if (other_removed) {
+    TRACE(SYNT, 1, "Other setters removed %ld", other_removed);
+  }
+  if (pub_meth) {
+    TRACE(SYNT, 1, "Public setters removed %ld", pub_meth);
+  }
+
+  metrics.setters_removed_count += (synth_removed + other_removed + pub_meth);
+
   synth_removed = 0;
   other_removed = 0;
   pub_meth = 0;
@@ -810,6 +958,15 @@ bool trace_analysis(WrapperMethods& ssms) {
   TRACE(SYNT, 3, "synth getters %ld", synth);
   TRACE(SYNT, 3, "other getters %ld", others);
 
+  synth = 0;
+  others = 0;
+  for (auto it : ssms.setters) {
+    auto meth = it.first;
+    is_synthetic(meth) ? synth++ : others++;
+  }
+  TRACE(SYNT, 3, "synth setters %ld", synth);
+  TRACE(SYNT, 3, "other setters %ld", others);
+
   synth = 0;
   others = 0;
   for (auto it : ssms.ctors) {
@@ -865,6 +1022,7 @@ void SynthPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_GETTERS_REMOVED, metrics.getters_removed_count);
   mgr.incr_metric(METRIC_WRAPPERS_REMOVED, metrics.wrappers_removed_count);
   mgr.incr_metric(METRIC_CTORS_REMOVED, metrics.ctors_removed_count);
+  mgr.incr_metric(METRIC_SETTERS_REMOVED, metrics.setters_removed_count);
 }
 
 static SynthPass s_pass;
@@ -19,6 +19,8 @@ class TrackResourcesPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_analysis_only() const override { return true; }
+
   static void find_accessed_fields(
       Scope& fullscope,
       ConfigFiles& conf,
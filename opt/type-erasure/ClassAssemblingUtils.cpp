@@ -164,9 +164,7 @@ DexClass* create_class(const DexType* type,
   for (const auto& itf : interfaces) {
     creator.add_interface(const_cast<DexType*>(itf));
   }
-  for (const auto& field : fields) {
-    creator.add_field(field);
-  }
+  creator.add_fields(fields);
   auto cls = creator.create();
   // Keeping type-erasure generated classes from being renamed.
   cls->rstate.set_keepnames();
@@ -176,6 +174,8 @@ DexClass* create_class(const DexType* type,
   }
   // Create ctor.
   auto super_ctors = type_class(super_type)->get_ctors();
+  std::vector<DexMethod*> ctors;
+  ctors.reserve(super_ctors.size());
   for (auto super_ctor : super_ctors) {
     auto mc = new MethodCreator(t,
                                 DexString::make_string("<init>"),
@@ -192,8 +192,9 @@ DexClass* create_class(const DexType* type,
     mb->ret_void();
     auto ctor = mc->create();
     TRACE(TERA, 4, " default ctor created %s", SHOW(ctor));
-    cls->add_method(ctor);
+    ctors.push_back(ctor);
   }
+  cls->add_methods(ctors);
   return cls;
 }
 
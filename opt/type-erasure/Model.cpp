@@ -21,6 +21,7 @@
 #include "IRCode.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 size_t Model::s_shape_count = 0;
 size_t Model::s_dex_count = 0;
@@ -31,6 +32,18 @@ namespace {
 
 constexpr const char* CLASS_MARKER_DELIMITER = "DexEndMarker";
 
+struct TypeSetPtrHash {
+  size_t operator()(const TypeSet* types) const {
+    return boost::hash_range(types->begin(), types->end());
+  }
+};
+
+struct TypeSetPtrEq {
+  bool operator()(const TypeSet* left, const TypeSet* right) const {
+    return *left == *right;
+  }
+};
+
 std::string to_string(const ModelSpec& spec) {
   std::ostringstream ss;
   ss << spec.name << "(roots: ";
@@ -641,6 +654,34 @@ void Model::find_non_mergeables(const Scope& scope, const TypeSet& generated) {
                                      m_types, m_non_mergeables);
   }
 
+  if (m_spec.stateless_only || m_spec.max_mergeable_instructions) {
+    for (const auto& type : m_types) {
+      const auto& cls = type_class(type);
+      if (m_spec.stateless_only && !cls->get_ifields().empty()) {
+        TRACE(TERA, 5, "[non mergeable] %s as it has instance fields",
+              SHOW(type));
+        m_non_mergeables.insert(type);
+        continue;
+      }
+      if (m_spec.max_mergeable_instructions) {
+        size_t num_instructions = 0;
+        for (const auto* methods : {&cls->get_dmethods(),
+                                    &cls->get_vmethods()}) {
+          for (auto method : *methods) {
+            if (method->get_code() != nullptr) {
+              num_instructions += method->get_code()->count_opcodes();
+            }
+          }
+        }
+        if (num_instructions > *m_spec.max_mergeable_instructions) {
+          TRACE(TERA, 5, "[non mergeable] %s as it has %zu instructions",
+                SHOW(type), num_instructions);
+          m_non_mergeables.insert(type);
+        }
+      }
+    }
+  }
+
   m_metric.non_mergeables = m_non_mergeables.size();
   TRACE(TERA, 3, "Non mergeables %ld", m_non_mergeables.size());
 }
@@ -679,10 +720,36 @@ void Model::shape_model() {
     mergers.emplace_back(&m_mergers[type]);
   }
 
-  for (auto merger : mergers) {
-    TRACE(TERA, 6, "Build shapes from %s", SHOW(merger->type));
-    MergerType::ShapeCollector shapes;
-    shape_merger(*merger, shapes);
+  // Creating the shapes of a merger only changes the hierarchy under that
+  // merger, so the children of all mergers can be shaped upfront, and in
+  // parallel.
+  std::vector<std::pair<size_t, const DexType*>> children;
+  for (size_t i = 0; i < mergers.size(); ++i) {
+    TRACE(TERA, 6, "Build shapes from %s", SHOW(mergers[i]->type));
+    for (const auto& child : shapeable_children(*mergers[i])) {
+      children.emplace_back(i, child);
+    }
+  }
+  std::vector<MergerType::Shape> child_shapes(children.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    child_shapes[i] = compute_shape(type_class(children[i].second));
+  });
+  for (size_t i = 0; i < children.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  std::vector<MergerType::ShapeCollector> merger_shapes(mergers.size());
+  for (size_t i = 0; i < children.size(); ++i) {
+    const auto& child = children[i].second;
+    TRACE(TERA, 9, "Shape of %s [%ld]: %s", SHOW(child),
+          type_class(child)->get_ifields().size(),
+          child_shapes[i].to_string().c_str());
+    merger_shapes[children[i].first][child_shapes[i]].types.insert(child);
+  }
+
+  for (size_t i = 0; i < mergers.size(); ++i) {
+    auto merger = mergers[i];
+    auto& shapes = merger_shapes[i];
     approximate_shapes(shapes);
     m_metric.dropped += trim_shapes(shapes, m_spec.min_count);
     for (auto& shape_it : shapes) {
@@ -697,15 +764,15 @@ void Model::shape_model() {
   TRACE(TERA, 4, "Excluded types total %ld", m_excluded.size());
 }
 
-void Model::shape_merger(const MergerType& merger,
-                         MergerType::ShapeCollector& shapes) {
+std::vector<const DexType*> Model::shapeable_children(
+    const MergerType& merger) {
   // if the root has got no children there is nothing to "shape"
+  std::vector<const DexType*> res;
   const auto& children = m_hierarchy.find(merger.type);
   if (children == m_hierarchy.end()) {
-    return;
+    return res;
   }
 
-  // build a map from shape to types with that shape
   for (const auto& child : children->second) {
     if (m_hierarchy.find(child) != m_hierarchy.end()) {
       continue;
@@ -717,52 +784,51 @@ void Model::shape_merger(const MergerType& merger,
     if (m_non_mergeables.count(child)) {
       continue;
     }
-    const auto& cls = type_class(child);
-    if (cls == nullptr) {
+    if (type_class(child) == nullptr) {
       continue;
     }
+    res.push_back(child);
+  }
+  return res;
+}
 
-    MergerType::Shape shape{0, 0, 0, 0, 0, 0, 0};
-    for (const auto& field : cls->get_ifields()) {
-      const auto field_type = field->get_type();
-      if (field_type == type::java_lang_String()) {
-        shape.string_fields++;
-        continue;
-      }
-      switch (type::type_shorty(field_type)) {
-      case 'L':
-      case '[':
-        shape.reference_fields++;
-        break;
-      case 'J':
-        shape.long_fields++;
-        break;
-      case 'D':
-        shape.double_fields++;
-        break;
-      case 'F':
-        shape.float_fields++;
-        break;
-      case 'Z':
-        shape.bool_fields++;
-        break;
-      case 'B':
-      case 'S':
-      case 'C':
-      case 'I':
-        shape.int_fields++;
-        break;
-      default:
-        always_assert(false);
-        break;
-      }
+MergerType::Shape Model::compute_shape(const DexClass* cls) {
+  MergerType::Shape shape{0, 0, 0, 0, 0, 0, 0};
+  for (const auto& field : cls->get_ifields()) {
+    const auto field_type = field->get_type();
+    if (field_type == type::java_lang_String()) {
+      shape.string_fields++;
+      continue;
+    }
+    switch (type::type_shorty(field_type)) {
+    case 'L':
+    case '[':
+      shape.reference_fields++;
+      break;
+    case 'J':
+      shape.long_fields++;
+      break;
+    case 'D':
+      shape.double_fields++;
+      break;
+    case 'F':
+      shape.float_fields++;
+      break;
+    case 'Z':
+      shape.bool_fields++;
+      break;
+    case 'B':
+    case 'S':
+    case 'C':
+    case 'I':
+      shape.int_fields++;
+      break;
+    default:
+      always_assert(false);
+      break;
     }
-
-    TRACE(TERA, 9, "Shape of %s [%ld]: %s", SHOW(child),
-          cls->get_ifields().size(), shape.to_string().c_str());
-
-    shapes[shape].types.insert(child);
   }
+  return shape;
 }
 
 /**
@@ -837,14 +903,22 @@ void Model::break_by_interface(const MergerType& merger,
   // group classes by interfaces implemented
   TRACE(TERA, 7, "Break up shape %s parent %s", shape.to_string().c_str(),
         SHOW(merger.type));
+  // The groups are keyed by ordered sets of types, whose comparisons compare
+  // type names. Bucket the types by their interfaces with pointer hashing and
+  // equality first, so that each distinct set only goes through the ordered
+  // map once.
+  std::unordered_map<const TypeSet*, std::vector<const DexType*>,
+                     TypeSetPtrHash, TypeSetPtrEq>
+      buckets;
   for (const auto& type : hier.types) {
     const auto& cls_intfs = m_class_to_intfs.find(type);
-    if (cls_intfs == m_class_to_intfs.end()) {
-      hier.groups[Model::empty_set].insert(type);
-      continue;
-    }
-    auto& intfs = cls_intfs->second;
-    hier.groups[intfs].insert(type);
+    buckets[cls_intfs == m_class_to_intfs.end() ? &Model::empty_set
+                                                : &cls_intfs->second]
+        .push_back(type);
+  }
+  for (const auto& bucket : buckets) {
+    hier.groups[*bucket.first].insert(bucket.second.begin(),
+                                      bucket.second.end());
   }
   TRACE(TERA, 7, "%ld groups created for shape %s (%ld)", hier.groups.size(),
         shape.to_string().c_str(), hier.types.size());
@@ -852,7 +926,8 @@ void Model::break_by_interface(const MergerType& merger,
 
 namespace {
 
-DexType* check_current_instance(const TypeSet& types, IRInstruction* insn) {
+DexType* check_current_instance(const std::unordered_set<const DexType*>& types,
+                                IRInstruction* insn) {
   DexType* type = nullptr;
   if (insn->has_type()) {
     type = insn->get_type();
@@ -870,7 +945,7 @@ DexType* check_current_instance(const TypeSet& types, IRInstruction* insn) {
 }
 
 ConcurrentMap<DexType*, std::unordered_set<DexType*>> get_type_usages(
-    const TypeSet& types, const Scope& scope) {
+    const std::unordered_set<const DexType*>& types, const Scope& scope) {
   ConcurrentMap<DexType*, std::unordered_set<DexType*>> res;
 
   walk::parallel::opcodes(scope, [&](DexMethod* method, IRInstruction* insn) {
@@ -924,17 +999,35 @@ size_t get_interdex_group(
 } // namespace
 
 std::vector<TypeSet> Model::group_per_interdex_set(const TypeSet& types) {
-  const auto& type_to_usages = get_type_usages(types, m_scope);
+  if (!m_type_usages) {
+    // The code doesn't change while the model is built, so the usages of all
+    // the types of the model are gathered at once rather than with a walk of
+    // the scope per group.
+    std::unordered_set<const DexType*> model_types(m_types.begin(),
+                                                   m_types.end());
+    m_type_usages.emplace();
+    for (const auto& pair : get_type_usages(model_types, m_scope)) {
+      m_type_usages->emplace(pair.first, pair.second);
+    }
+  }
   std::vector<TypeSet> new_groups(s_num_interdex_groups);
-  for (const auto& pair : type_to_usages) {
-    auto index = get_interdex_group(pair.second, s_cls_to_interdex_group,
+  for (const auto& type : types) {
+    auto usages = m_type_usages->find(type);
+    if (usages == m_type_usages->end()) {
+      continue;
+    }
+    auto index = get_interdex_group(usages->second, s_cls_to_interdex_group,
                                     s_num_interdex_groups);
-    new_groups[index].emplace(pair.first);
+    new_groups[index].emplace(type);
   }
 
   if (m_spec.merge_per_interdex_set == InterDexGroupingType::NON_HOT_SET) {
     // Drop mergeables that are in the hot set.
     new_groups[0].clear();
+  } else if (m_spec.merge_per_interdex_set ==
+             InterDexGroupingType::HOT_SET_ONLY) {
+    // Drop mergeables that are not in the hot set.
+    new_groups.resize(1);
   }
 
   return new_groups;
@@ -1002,6 +1095,10 @@ void Model::flatten_shapes(const MergerType& merger,
                                 new_groups[gindex], boost::none, gindex,
                                 m_spec.max_count, m_spec.min_count);
         }
+      } else if (m_spec.merge_per_interdex_set ==
+                 InterDexGroupingType::HOT_SET_ONLY) {
+        // Without an interdex order, there is no hot set to merge in.
+        continue;
       } else {
         create_mergers_helper(merger.type, *shape, *group_key, group_values,
                               dex_num, boost::none, m_spec.max_count,
@@ -12,6 +12,7 @@
 #include "ApproximateShapeMerging.h"
 #include "DexClass.h"
 #include "MergerType.h"
+#include "MethodProfiles.h"
 #include "TypeSystem.h"
 
 using TypeToTypeSet = std::unordered_map<const DexType*, TypeSet>;
@@ -20,6 +21,7 @@ enum InterDexGroupingType {
   DISABLED = 0, // No interdex grouping.
   NON_HOT_SET = 1, // Exclude hot set.
   FULL = 2, // Apply interdex grouping on the entire input.
+  HOT_SET_ONLY = 3, // Only merge within the hot set, e.g. for startup.
 };
 
 enum TypeTagConfig {
@@ -137,6 +139,16 @@ struct ModelSpec {
   bool merge_types_with_static_fields{false};
   // Preserve debug info like line numbers.
   bool keep_debug_info{false};
+  // Only merge types without instance fields.
+  bool stateless_only{false};
+  // Only merge types whose methods have at most this many instructions in
+  // total.
+  boost::optional<size_t> max_mergeable_instructions{boost::none};
+  // Test for the hot targets of sparse dispatches ahead of the switch, as
+  // found in the method profiles.
+  bool profile_guided_dispatch{false};
+  const std::unordered_map<const DexMethodRef*, method_profiles::Stats>*
+      method_profile_stats{nullptr};
   // Replace string literals matching a merged type.
   bool replace_type_like_const_strings{true};
   // Exclude types with references to Android SDK types. The referenced type may
@@ -341,6 +353,12 @@ class Model {
 
   const Scope& m_scope;
 
+  // The classes whose code references each type of the model, computed the
+  // first time mergers are grouped per interdex set.
+  boost::optional<
+      std::unordered_map<const DexType*, std::unordered_set<DexType*>>>
+      m_type_usages;
+
   static std::unordered_map<DexType*, size_t> s_cls_to_interdex_group;
   static size_t s_num_interdex_groups;
 
@@ -400,7 +418,8 @@ class Model {
 
   // make shapes out of the model classes
   void shape_model();
-  void shape_merger(const MergerType& root, MergerType::ShapeCollector& shapes);
+  std::vector<const DexType*> shapeable_children(const MergerType& merger);
+  static MergerType::Shape compute_shape(const DexClass* cls);
   void approximate_shapes(MergerType::ShapeCollector& shapes);
   void break_by_interface(const MergerType& merger,
                           const MergerType::Shape& shape,
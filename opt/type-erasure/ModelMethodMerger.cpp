@@ -50,16 +50,21 @@ void update_call_refs(
     const MethodTypeTags& type_tags,
     const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee,
     bool with_type_tag = false) {
+  std::unordered_map<DexMethod*, method_reference::NewCallee> new_callees;
   for (const auto& callsite : call_sites) {
     auto callee = callsite.callee;
     always_assert(callee != nullptr && type_tags.count(callee) > 0);
+    if (new_callees.count(callee)) {
+      continue;
+    }
     auto new_callee_method = old_to_new_callee.at(callee);
     auto type_tag_arg = with_type_tag
                             ? boost::optional<uint32_t>(type_tags.at(callee))
                             : boost::none;
-    method_reference::NewCallee new_callee(new_callee_method, type_tag_arg);
-    patch_callsite(callsite, new_callee);
+    new_callees.emplace(
+        callee, method_reference::NewCallee(new_callee_method, type_tag_arg));
   }
+  method_reference::patch_callsites(call_sites, new_callees);
 }
 
 void replace_method_args_head(DexMethod* meth, DexType* new_head) {
@@ -602,6 +607,7 @@ void ModelMethodMerger::merge_virtual_methods(
                         m_max_num_dispatch_target,
                         boost::none,
                         m_model_spec.keep_debug_info};
+    spec.method_stats = m_model_spec.method_profile_stats;
     dispatch::DispatchMethod dispatch = create_dispatch_method(spec, meth_lst);
     dispatch_methods.emplace_back(target_cls, dispatch.main_dispatch);
     for (const auto sub_dispatch : dispatch.sub_dispatches) {
@@ -702,6 +708,7 @@ void ModelMethodMerger::merge_ctors() {
           nullptr, // overridden_meth
           get_ctor_type_tag_param_idx(pass_type_tag_param, ctor_proto),
           m_model_spec.keep_debug_info};
+      spec.method_stats = m_model_spec.method_profile_stats;
       auto indices_to_callee = get_dedupped_indices_map(ctors);
       if (indices_to_callee.size() > 1) {
         always_assert_log(
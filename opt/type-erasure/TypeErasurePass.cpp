@@ -121,7 +121,9 @@ InterDexGroupingType get_merge_per_interdex_type(
   const static std::unordered_map<std::string, InterDexGroupingType>
       string_to_grouping = {{"disabled", InterDexGroupingType::DISABLED},
                             {"non-hot-set", InterDexGroupingType::NON_HOT_SET},
-                            {"full", InterDexGroupingType::FULL}};
+                            {"full", InterDexGroupingType::FULL},
+                            {"hot-set-only",
+                             InterDexGroupingType::HOT_SET_ONLY}};
 
   always_assert_log(string_to_grouping.count(merge_per_interdex_set) > 0,
                     "InterDex Grouping Type %s not found. Please check the list"
@@ -251,6 +253,15 @@ void TypeErasurePass::bind_config() {
       model_spec.get("merge_types_with_static_fields", false,
                      model.merge_types_with_static_fields);
       model_spec.get("keep_debug_info", false, model.keep_debug_info);
+      model_spec.get("stateless_only", false, model.stateless_only);
+      size_t max_mergeable_instructions;
+      model_spec.get("max_mergeable_instructions", 0,
+                     max_mergeable_instructions);
+      if (max_mergeable_instructions > 0) {
+        model.max_mergeable_instructions = max_mergeable_instructions;
+      }
+      model_spec.get("profile_guided_dispatch", false,
+                     model.profile_guided_dispatch);
       model_spec.get("replace_type_like_const_strings", true,
                      model.replace_type_like_const_strings);
       model_spec.get("exclude_reference_to_android_sdk", Json::Value(),
@@ -316,6 +327,10 @@ void TypeErasurePass::run_pass(DexStoresVector& stores,
     if (!model_spec.enabled) {
       continue;
     }
+    if (model_spec.profile_guided_dispatch) {
+      model_spec.method_profile_stats =
+          &conf.get_method_profiles().method_stats();
+    }
     handle_interface_as_root(model_spec, scope, stores);
     erase_model(model_spec, scope, mgr, stores, conf);
   }
@@ -30,7 +30,8 @@ void unmark_keep(const Scope& scope,
       }
     }
   }
-  TypeSystem ts(scope);
+  auto type_system = g_redex->get_type_system(scope);
+  const auto& ts = *type_system;
   // Unmark proguard keep rule for interface implementors like
   // "-keep class * extend xxx".
   for (const DexType* intf_type : interface_list) {
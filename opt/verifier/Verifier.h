@@ -14,4 +14,6 @@ class VerifierPass : public Pass {
   VerifierPass() : Pass("VerifierPass") {}
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  bool is_analysis_only() const override { return true; }
 };
@@ -486,11 +486,38 @@ def move_dexen_to_directories(root, dexpaths):
     return res
 
 
-def unzip_apk(apk, destination_directory):
+def find_apk_repack_binary(args):
+    """Find the native apk-repack tool, next to the redex binary if one was
+    given, or else the way run_redex_binary finds redex-all. Returns None when
+    it is not available, or when the Python implementation was requested."""
+    if args.legacy_apk_repack:
+        return None
+    candidates = []
+    if args.redex_binary is not None:
+        candidates.append(join(dirname(abspath(args.redex_binary)), "apk-repack"))
+    candidates.append(shutil.which("apk-repack"))
+    dir_name = dirname(abspath(__file__))
+    while not isdir(dir_name):
+        dir_name = dirname(dir_name)
+    candidates.append(join(dir_name, "apk-repack"))
+    for candidate in candidates:
+        if (
+            candidate is not None
+            and isfile(candidate)
+            and os.access(candidate, os.X_OK)
+        ):
+            return candidate
+    return None
+
+
+def unzip_apk(apk, destination_directory, apk_repack=None):
     with zipfile.ZipFile(apk) as z:
         for info in z.infolist():
             per_file_compression[info.filename] = info.compress_type
-        z.extractall(destination_directory)
+        if apk_repack is None:
+            z.extractall(destination_directory)
+    if apk_repack is not None:
+        subprocess.check_call([apk_repack, "unpack", apk, destination_directory])
 
 
 def zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align):
@@ -534,6 +561,8 @@ def create_output_apk(
     key_password,
     ignore_zipalign,
     page_align,
+    input_apk=None,
+    apk_repack=None,
 ):
 
     # Remove old signature files
@@ -548,6 +577,28 @@ def create_output_apk(
     if isfile(unaligned_apk_path):
         os.remove(unaligned_apk_path)
 
+    if apk_repack is not None:
+        # The native tool copies unchanged entries from the input as-is, and
+        # aligns its output, so zipalign is only needed after jarsigner.
+        if isfile(output_apk_path):
+            os.remove(output_apk_path)
+        try:
+            os.makedirs(dirname(output_apk_path))
+        except OSError as e:
+            if e.errno != errno.EEXIST:
+                raise
+        repack_args = [apk_repack, "repack"]
+        if input_apk is not None:
+            repack_args += ["--original", input_apk]
+        if page_align:
+            repack_args += ["--page-align-libs"]
+        target = unaligned_apk_path if sign else output_apk_path
+        subprocess.check_call(repack_args + [extracted_apk_dir, target])
+        if sign:
+            sign_apk(keystore, key_password, key_alias, unaligned_apk_path)
+            zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align)
+        return
+
     # Create new zip file
     with zipfile.ZipFile(unaligned_apk_path, "w") as unaligned_apk:
         # Need sorted output for deterministic zip file. Sorting `dirnames` will
@@ -738,6 +789,12 @@ Given an APK, produce a better APK!
     parser.add_argument(
         "--ignore-zipalign", action="store_true", help="Ignore if zipalign is not found"
     )
+    parser.add_argument(
+        "--legacy-apk-repack",
+        action="store_true",
+        help="Unpack and repack the apk with zipfile and zipalign, even if the "
+        "native apk-repack tool is available",
+    )
     parser.add_argument(
         "--verify-none-mode",
         action="store_true",
@@ -935,7 +992,7 @@ def prepare_redex(args):
         extracted_apk_dir = make_temp_dir(".redex_extracted_apk", debug_mode)
 
     log("Extracting apk...")
-    unzip_apk(args.input_apk, extracted_apk_dir)
+    unzip_apk(args.input_apk, extracted_apk_dir, find_apk_repack_binary(args))
 
     dex_file_path = get_dex_file_path(args, extracted_apk_dir)
 
@@ -1104,6 +1161,8 @@ def finalize_redex(state):
         state.args.keypass,
         state.args.ignore_zipalign,
         state.args.page_align_libs,
+        state.args.input_apk,
+        find_apk_repack_binary(state.args),
     )
     log(
         "Creating output APK finished in {:.2f} seconds".format(
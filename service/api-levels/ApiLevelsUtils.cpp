@@ -10,11 +10,13 @@
 #include <boost/algorithm/string.hpp>
 #include <fstream>
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "MethodOverrideGraph.h"
 #include "Trace.h"
 #include "TypeReference.h"
 #include "TypeSystem.h"
+#include "Walkers.h"
 
 namespace api {
 
@@ -345,8 +347,9 @@ void ApiLevelsUtils::gather_non_private_members(const Scope& scope) {
 
   const auto& override_graph = method_override_graph::build_graph(scope);
 
-  // TODO(emmasevastian): parallelize.
-  for (DexClass* cls : scope) {
+  ConcurrentSet<DexMethodRef*> methods_non_private;
+  ConcurrentSet<DexFieldRef*> fields_non_private;
+  walk::parallel::classes(scope, [&](DexClass* cls) {
     std::vector<DexMethodRef*> current_methods;
     std::vector<DexFieldRef*> current_fields;
 
@@ -354,7 +357,7 @@ void ApiLevelsUtils::gather_non_private_members(const Scope& scope) {
     for (DexMethodRef* mref : current_methods) {
       if (m_types_to_framework_api.count(mref->get_class())) {
         if (mref->get_class() != cls->get_type()) {
-          m_methods_non_private.emplace(mref);
+          methods_non_private.insert(mref);
         } else {
           auto* mdef = mref->as_def();
 
@@ -362,7 +365,7 @@ void ApiLevelsUtils::gather_non_private_members(const Scope& scope) {
           // NOTE: Whatever we add to the list we will need to replace.
           if (!mdef ||
               method_override_graph::is_true_virtual(*override_graph, mdef)) {
-            m_methods_non_private.emplace(mref);
+            methods_non_private.insert(mref);
           }
         }
       }
@@ -372,10 +375,14 @@ void ApiLevelsUtils::gather_non_private_members(const Scope& scope) {
     for (DexFieldRef* fref : current_fields) {
       if (m_types_to_framework_api.count(fref->get_class()) &&
           fref->get_class() != cls->get_type()) {
-        m_fields_non_private.emplace(fref);
+        fields_non_private.insert(fref);
       }
     }
-  }
+  });
+  m_methods_non_private.insert(methods_non_private.begin(),
+                               methods_non_private.end());
+  m_fields_non_private.insert(fields_non_private.begin(),
+                              fields_non_private.end());
 
   TRACE(API_UTILS, 4, "We have %d methods that are actually non private",
         m_methods_non_private.size());
@@ -384,11 +391,10 @@ void ApiLevelsUtils::gather_non_private_members(const Scope& scope) {
 }
 
 void ApiLevelsUtils::load_framework_api(const Scope& scope) {
-  std::unordered_map<DexType*, FrameworkAPI> framework_cls_to_api =
-      get_framework_classes();
-  for (auto it = framework_cls_to_api.begin();
-       it != framework_cls_to_api.end();) {
-    auto* framework_cls = it->first;
+  // Only the candidates for replacement are copied out of the SDK's table.
+  std::unordered_map<DexType*, FrameworkAPI> framework_cls_to_api;
+  for (const auto& pair : get_framework_classes()) {
+    auto* framework_cls = pair.first;
     m_framework_classes.emplace(framework_cls);
 
     // NOTE: We are currently excluding classes outside of
@@ -397,9 +403,8 @@ void ApiLevelsUtils::load_framework_api(const Scope& scope) {
     if (!boost::starts_with(framework_cls_str, "Landroid")) {
       TRACE(API_UTILS, 5, "Excluding %s from possible replacement.",
             framework_cls_str.c_str());
-      it = framework_cls_to_api.erase(it);
     } else {
-      ++it;
+      framework_cls_to_api.emplace(pair);
     }
   }
 
@@ -30,7 +30,8 @@ class ApiLevelsUtils {
     return m_types_to_framework_api;
   }
 
-  std::unordered_map<DexType*, FrameworkAPI> get_framework_classes() {
+  const std::unordered_map<DexType*, FrameworkAPI>& get_framework_classes()
+      const {
     return m_sdk_api.get_framework_classes();
   }
 
@@ -7,12 +7,14 @@
 
 #include "ClassInitCounter.h"
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
 #include "BaseIRAnalyzer.h"
 #include "ControlFlow.h"
 #include "IRCode.h"
+#include "WorkQueue.h"
 
 using namespace cic;
 
@@ -149,18 +151,14 @@ std::string show(const InitLocation& init) {
   std::stringstream out;
   out << "{\"Init\" : { \"type\" : " << SHOW(init.m_typ)
       << ", \"count\" : " << init.get_count() << ", \"data\" : [";
-  for (const auto& class_inits : init.get_inits()) {
-    for (const auto& method_inits : class_inits.second) {
-      for (const auto& instr_inits : method_inits.second) {
-        for (const auto& use : instr_inits.second) {
-          out << "{\"class\" : \"" << class_inits.first->get_name()->c_str()
-              << "\", "
-              << "\"method\" : \"" << method_inits.first->get_name()->c_str()
-              << "\", "
-              << "\"instr\" : \"" << show(instr_inits.first) << "\", "
-              << "\"usage\" : " << show(*use) << "}, ";
-        }
-      }
+  for (const auto& init_entry : init.get_inits()) {
+    for (const auto& use : init_entry.uses) {
+      out << "{\"class\" : \"" << init_entry.container->get_name()->c_str()
+          << "\", "
+          << "\"method\" : \"" << init_entry.caller->get_name()->c_str()
+          << "\", "
+          << "\"instr\" : \"" << show(init_entry.instr) << "\", "
+          << "\"usage\" : " << show(*use) << "}, ";
     }
   }
   out << "]}";
@@ -1065,26 +1063,25 @@ void RegisterSet::merge_registers(const RegisterSet& comes_after,
   }
 }
 
-std::shared_ptr<ObjectUses> InitLocation::add_init(DexClass* container,
-                                                   DexMethod* caller,
-                                                   IRInstruction* instr) {
-  if (m_inits[container][caller].count(instr) == 0) {
-    // We've not seen this instruction initializing our class before
-    // So increase count of the number of initializations
-    m_count++;
-  }
+void InitLocation::add_init(DexClass* container,
+                            DexMethod* caller,
+                            IRInstruction* instr,
+                            std::vector<std::shared_ptr<ObjectUses>> uses) {
   TRACE(CIC, 8, "Adding init to %s, from instruction %s", SHOW(m_typ),
         SHOW(instr));
-  auto usage = std::make_shared<ObjectUses>(m_typ, instr);
-  m_inits[container][caller][instr].emplace_back(usage);
-  return usage;
+  m_inits.push_back({container, caller, instr, std::move(uses)});
 }
 
-void InitLocation::update_object(DexClass* container,
-                                 DexMethod* caller,
-                                 const ObjectUses& obj) {
-  m_inits[container][caller][obj.get_instr()] = {
-      std::make_shared<ObjectUses>(obj)};
+void InitLocation::sort_inits() {
+  std::sort(m_inits.begin(), m_inits.end(), [](const Init& a, const Init& b) {
+    if (a.container != b.container) {
+      return dexclasses_comparator()(a.container, b.container);
+    }
+    if (a.caller != b.caller) {
+      return dexmethods_comparator()(a.caller, b.caller);
+    }
+    return a.instr < b.instr;
+  });
 }
 
 ClassInitCounter::ClassInitCounter(
@@ -1100,14 +1097,47 @@ ClassInitCounter::ClassInitCounter(
         "Found %zu children of parent %s",
         m_type_to_inits.size(),
         SHOW(parent_class));
+  std::vector<MethodAnalysis> analyses;
   for (DexClass* current : classes) {
     for (DexMethod* method : current->get_vmethods()) {
-      inits_any_children(current, method);
+      analyses.push_back({current, method});
     }
     for (DexMethod* method : current->get_dmethods()) {
-      inits_any_children(current, method);
+      analyses.push_back({current, method});
     }
   }
+  // The tracked types are all known by now, so the methods can be analyzed
+  // independently.
+  redex_parallel::parallel_for(0, analyses.size(), [&](size_t i) {
+    inits_any_children(&analyses[i]);
+  });
+
+  for (auto& analysis : analyses) {
+    if (!analysis.analyzed) {
+      continue;
+    }
+    for (auto& init : analysis.inits) {
+      m_type_to_inits.at(init.first.first)
+          .add_init(analysis.container, analysis.method, init.first.second,
+                    std::move(init.second));
+    }
+    m_stored_mergeds[analysis.container->get_type()][analysis.method] =
+        std::move(analysis.merged);
+  }
+  std::vector<InitLocation*> locations;
+  for (auto& type_inits : m_type_to_inits) {
+    locations.push_back(&type_inits.second);
+  }
+  redex_parallel::parallel_for(0, locations.size(), [&](size_t i) {
+    locations[i]->sort_inits();
+  });
+}
+
+std::shared_ptr<ObjectUses> ClassInitCounter::add_init(
+    MethodAnalysis* analysis, DexType* typ, IRInstruction* instr) const {
+  auto usage = std::make_shared<ObjectUses>(typ, instr);
+  analysis->inits[std::make_pair(typ, instr)].emplace_back(usage);
+  return usage;
 }
 
 void ClassInitCounter::find_children(
@@ -1121,10 +1151,10 @@ void ClassInitCounter::find_children(
   return;
 }
 
-void ClassInitCounter::analyze_block(DexClass* container,
-                                     DexMethod* method,
+void ClassInitCounter::analyze_block(MethodAnalysis* analysis,
                                      cfg::Block* prev_block,
-                                     cfg::Block* block) {
+                                     cfg::Block* block) const {
+  auto& visited_blocks = analysis->visited_blocks;
   bool first_visit = true;
 
   if (visited_blocks.count(prev_block) && visited_blocks.count(block)) {
@@ -1146,7 +1176,7 @@ void ClassInitCounter::analyze_block(DexClass* container,
     TRACE(CIC, 8, "Repeat visit, with inconsistent input, merge registers");
     visited_blocks[block]->input_registers.merge_registers(
         visited_blocks[prev_block]->basic_block_registers,
-        m_stored_mergeds[container->get_type()][method]);
+        analysis->merged);
   } else if (visited_blocks.count(prev_block)) {
     TRACE(CIC, 8,
           "First visit to %zu, setup visited blocks with input registers",
@@ -1189,8 +1219,7 @@ void ClassInitCounter::analyze_block(DexClass* container,
       registers.clear(ir_analyzer::RESULT_REGISTER);
       if (m_type_to_inits.count(typ) != 0) {
         TRACE(CIC, 5, "Adding an init for type %s", SHOW(typ));
-        std::shared_ptr<ObjectUses> use =
-            m_type_to_inits[typ].add_init(container, method, i);
+        std::shared_ptr<ObjectUses> use = add_init(analysis, typ, i);
         registers.insert(ir_analyzer::RESULT_REGISTER, use);
       }
     } else if (is_iput(opcode)) {
@@ -1227,8 +1256,7 @@ void ClassInitCounter::analyze_block(DexClass* container,
       if (m_optional_method && curr_method->get_name() == m_optional_method) {
         auto ret_typ = curr_method->get_proto()->get_rtype();
         if (m_type_to_inits.count(ret_typ) != 0) {
-          std::shared_ptr<ObjectUses> use =
-              m_type_to_inits[ret_typ].add_init(container, method, i);
+          std::shared_ptr<ObjectUses> use = add_init(analysis, ret_typ, i);
           registers.insert(ir_analyzer::RESULT_REGISTER, use);
         }
       }
@@ -1283,7 +1311,7 @@ void ClassInitCounter::analyze_block(DexClass* container,
     } else {
       TRACE(CIC, 8, "Basic blocks were inconsistent, update registers");
       visited_blocks[block]->basic_block_registers.merge_registers(
-          registers, m_stored_mergeds[container->get_type()][method]);
+          registers, analysis->merged);
     }
   } else {
     TRACE(CIC, 8, "Our first visit, move in our registers");
@@ -1304,7 +1332,7 @@ void ClassInitCounter::analyze_block(DexClass* container,
   for (auto edge : block->succs()) {
     cfg::Block* next = edge->target();
     TRACE(CIC, 8, "making call from %zu to block %zu", block->id(), next->id());
-    analyze_block(container, method, block, next);
+    analyze_block(analysis, block, next);
     assert(visited_blocks[next]->final_result_registers);
 
     TRACE(CIC, 8, "Combining paths after looking at block %zu from %zu",
@@ -1323,8 +1351,9 @@ void ClassInitCounter::analyze_block(DexClass* container,
   visited_blocks[block]->final_result_registers.value().merge_effects(paths);
 }
 
-void ClassInitCounter::inits_any_children(DexClass* container,
-                                          DexMethod* method) {
+void ClassInitCounter::inits_any_children(MethodAnalysis* analysis) const {
+  auto* container = analysis->container;
+  auto* method = analysis->method;
   IRCode* instructions = method->get_code();
   if (instructions == nullptr) {
     return;
@@ -1333,7 +1362,7 @@ void ClassInitCounter::inits_any_children(DexClass* container,
   instructions->build_cfg(true);
   const cfg::ControlFlowGraph& graph = instructions->cfg();
 
-  if (graph.blocks().size() > 9000) {
+  if (graph.num_blocks() > 9000) {
     TRACE(CIC, 4, "Skipping analysis for method %s.%s",
           container->get_name()->c_str(), method->get_name()->c_str());
     instructions->clear_cfg();
@@ -1341,15 +1370,15 @@ void ClassInitCounter::inits_any_children(DexClass* container,
   }
 
   cfg::Block* block = graph.entry_block();
-  visited_blocks =
-      std::unordered_map<cfg::Block*, std::shared_ptr<RegistersPerBlock>>();
+  auto& visited_blocks = analysis->visited_blocks;
 
   TRACE(CIC, 5, "starting analysis for method %s.%s with %zu blocks\n",
         container->get_name()->c_str(), method->get_name()->c_str(),
         graph.num_blocks());
 
-  analyze_block(container, method, nullptr, block);
-  auto& merged_set = m_stored_mergeds[container->get_type()][method];
+  analyze_block(analysis, nullptr, block);
+  analysis->analyzed = true;
+  auto& merged_set = analysis->merged;
   // This loop collects the results of all ObjectUses and MergedUses encountered
   // in the forwards analysis, which has been merged bottom up to coalesce the
   // final full possible results from this method across all encountered tracked
@@ -1360,14 +1389,17 @@ void ClassInitCounter::inits_any_children(DexClass* container,
   for (const auto& use :
        visited_blocks[block]->final_result_registers.value().m_all_uses) {
     if (use->m_tracked_kind == Object) {
-      m_type_to_inits[static_cast<ObjectUses&>(*use).get_represents_typ()]
-          .update_object(container, method, static_cast<ObjectUses&>(*use));
+      const auto& obj = static_cast<ObjectUses&>(*use);
+      analysis->inits[std::make_pair(obj.get_represents_typ(),
+                                     obj.get_instr())] = {
+          std::make_shared<ObjectUses>(obj)};
     } else {
       merged_set.insert(
           std::make_shared<MergedUses>(static_cast<MergedUses&>(*use)));
     }
   }
 
+  visited_blocks.clear();
   instructions->clear_cfg();
 }
 
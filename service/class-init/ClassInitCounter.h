@@ -10,7 +10,10 @@
 #include "DexClass.h"
 #include "IRInstruction.h"
 #include <map>
+#include <memory>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 /**
  * This analysis identifies class initializations descended from a base type
@@ -369,33 +372,33 @@ class RegisterSet {
  * data on where a class is constructed and how the object is subsequently used
  */
 class InitLocation final {
-  using InitMap =
-      std::map<DexClass*,
-               std::map<DexMethod*,
-                        std::map<IRInstruction*,
-                                 std::vector<std::shared_ptr<ObjectUses>>>,
-                        dexmethods_comparator>,
-               dexclasses_comparator>;
-
  public:
+  // One instruction initializing the type, and the uses of what it creates.
+  struct Init {
+    DexClass* container;
+    DexMethod* caller;
+    IRInstruction* instr;
+    std::vector<std::shared_ptr<ObjectUses>> uses;
+  };
+  // Sorted by container, then caller, then instruction.
+  using InitTable = std::vector<Init>;
+
   InitLocation(DexType* typ) : m_typ(typ) {}
   InitLocation() = default;
-  uint32_t get_count() const { return m_count; }
+  uint32_t get_count() const { return m_inits.size(); }
 
-  // adds the data structure for this initialization, returning a ref to it
-  std::shared_ptr<ObjectUses> add_init(DexClass* container,
-                                       DexMethod* caller,
-                                       IRInstruction* instr);
-  void update_object(DexClass* container,
-                     DexMethod* caller,
-                     const ObjectUses& obj);
-  const InitMap& get_inits() const { return m_inits; }
+  // Adds an initialization; sort_inits() must be called once all are added.
+  void add_init(DexClass* container,
+                DexMethod* caller,
+                IRInstruction* instr,
+                std::vector<std::shared_ptr<ObjectUses>> uses);
+  void sort_inits();
+  const InitTable& get_inits() const { return m_inits; }
 
   DexType* m_typ = nullptr;
 
  private:
-  InitMap m_inits;
-  uint32_t m_count = 0;
+  InitTable m_inits;
 };
 
 struct RegistersPerBlock {
@@ -425,22 +428,40 @@ class ClassInitCounter final {
   std::string debug_show_table();
 
  private:
+  // What the analysis of one method finds. Methods are analyzed in parallel,
+  // each into its own MethodAnalysis, which are then merged into the tables.
+  struct MethodAnalysis {
+    DexClass* container;
+    DexMethod* method;
+    bool analyzed{false};
+    // The uses of the objects created by each tracked instruction, by the
+    // tracked type that it creates.
+    std::map<std::pair<DexType*, IRInstruction*>,
+             std::vector<std::shared_ptr<ObjectUses>>>
+        inits;
+    MergedUsedSet merged;
+    // These registers are the storage for registers during analysis, they
+    // are accessed and modified across recursive calls to analyze_block
+    std::unordered_map<cfg::Block*, std::shared_ptr<RegistersPerBlock>>
+        visited_blocks;
+  };
+
   // Identifies and stores in type_to_inits all classes that extend parent
   void find_children(DexType* parent,
                      const std::unordered_set<DexClass*>& classes);
 
-  // Walks all of the methods of the apk, updating type_to_inits
-  void walk_methods(DexClass* container,
-                    const std::vector<DexMethod*>& methods);
-
   // Walks the instructions of method, populating the relevant init types
-  void inits_any_children(DexClass* container, DexMethod* method);
+  void inits_any_children(MethodAnalysis* analysis) const;
 
   // Walks block by block the method code that might instantiate a tracked type
-  void analyze_block(DexClass* container,
-                     DexMethod* method,
+  void analyze_block(MethodAnalysis* analysis,
                      cfg::Block* prev_block,
-                     cfg::Block* block);
+                     cfg::Block* block) const;
+
+  // Records that the analyzed method creates a tracked object at `instr`
+  std::shared_ptr<ObjectUses> add_init(MethodAnalysis* analysis,
+                                       DexType* typ,
+                                       IRInstruction* instr) const;
 
   TypeToInit m_type_to_inits;
 
@@ -448,11 +469,6 @@ class ClassInitCounter final {
 
   boost::optional<DexString*> m_optional_method;
   std::set<DexMethodRef*, dexmethods_comparator> m_safe_escapes;
-
-  // These registers are the storage for registers during analysis, they
-  // are accessed and modified across recursive calls to analyze_block
-  std::unordered_map<cfg::Block*, std::shared_ptr<RegistersPerBlock>>
-      visited_blocks;
 };
 
 } // namespace cic
@@ -191,6 +191,16 @@ bool LocalArrayAnalyzer::analyze_aput(const IRInstruction* insn,
   return true;
 }
 
+bool LocalArrayAnalyzer::analyze_array_length(const IRInstruction* insn,
+                                              ConstantEnvironment* env) {
+  auto arr = env->get_pointee<ConstantPrimitiveArrayDomain>(insn->src(0));
+  if (!arr.is_value()) {
+    return false;
+  }
+  env->set(RESULT_REGISTER, SignedConstantDomain(arr.length()));
+  return true;
+}
+
 bool LocalArrayAnalyzer::analyze_fill_array_data(const IRInstruction* insn,
                                                  ConstantEnvironment* env) {
   // We currently don't analyze fill-array-data properly; we simply
@@ -211,6 +221,10 @@ bool PrimitiveAnalyzer::analyze_default(const IRInstruction* insn,
     env->set(RESULT_REGISTER, SignedConstantDomain(sign_domain::Interval::NEZ));
     return true;
   }
+  case OPCODE_ARRAY_LENGTH: {
+    env->set(RESULT_REGISTER, SignedConstantDomain(sign_domain::Interval::GEZ));
+    return true;
+  }
   default:
     break;
   }
@@ -849,6 +863,11 @@ static void analyze_if(const IRInstruction* insn,
 
 ConstantEnvironment FixpointIterator::analyze_edge(
     const EdgeId& edge, const ConstantEnvironment& exit_state_at_source) const {
+  return analyze_edge_condition(edge, exit_state_at_source);
+}
+
+ConstantEnvironment analyze_edge_condition(
+    const cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source) {
   auto env = exit_state_at_source;
   auto last_insn_it = edge->src()->get_last_insn();
   if (last_insn_it == edge->src()->end()) {
@@ -9,6 +9,7 @@
 
 #include <utility>
 
+#include "BaseIRAnalyzer.h"
 #include "ConstantEnvironment.h"
 #include "IRCode.h"
 #include "InstructionAnalyzer.h"
@@ -30,7 +31,11 @@ class FixpointIterator final
       const cfg::ControlFlowGraph& cfg,
       InstructionAnalyzer<ConstantEnvironment> insn_analyzer)
       : MonotonicFixpointIterator(cfg),
-        m_insn_analyzer(std::move(insn_analyzer)) {}
+        m_insn_analyzer(std::move(insn_analyzer)) {
+    // The analyzers only read the state they share, so the giant methods can
+    // be analyzed by several threads.
+    set_parallel_threshold(ir_analyzer::kParallelAnalysisMinBlocks);
+  }
 
   ConstantEnvironment analyze_edge(
       const EdgeId&,
@@ -46,6 +51,13 @@ class FixpointIterator final
   InstructionAnalyzer<ConstantEnvironment> m_insn_analyzer;
 };
 
+/*
+ * Refines the exit state of the source of an edge with the condition under
+ * which a branch takes the edge. The result is bottom if it is never taken.
+ */
+ConstantEnvironment analyze_edge_condition(
+    const cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source);
+
 } // namespace intraprocedural
 
 /*
@@ -122,6 +134,9 @@ class LocalArrayAnalyzer final
 
   static bool analyze_aput(const IRInstruction* insn, ConstantEnvironment* env);
 
+  static bool analyze_array_length(const IRInstruction* insn,
+                                   ConstantEnvironment* env);
+
   static bool analyze_fill_array_data(const IRInstruction* insn,
                                       ConstantEnvironment* env);
 };
@@ -231,6 +246,17 @@ class StringAnalyzer
   }
 };
 
+class ConstantClassObjectAnalyzer
+    : public InstructionAnalyzerBase<ConstantClassObjectAnalyzer,
+                                     ConstantEnvironment> {
+ public:
+  static bool analyze_const_class(const IRInstruction* insn,
+                                  ConstantEnvironment* env) {
+    env->set(RESULT_REGISTER, ConstantClassObjectDomain(insn->get_type()));
+    return true;
+  }
+};
+
 /*
  * Utility methods.
  */
@@ -256,13 +282,14 @@ class runtime_equals_visitor : public boost::static_visitor<bool> {
     return *cst_left == *cst_right;
   }
 
-  // SingletonObjectDomain and StringDomains are equal iff their respective
-  // constants are equal.
-  template <
-      typename Constant,
-      typename = typename std::enable_if_t<
-          template_util::contains<Constant, const DexField*, const DexString*>::
-              value>>
+  // SingletonObjectDomain, StringDomains and ConstantClassObjectDomains are
+  // equal iff their respective constants are equal.
+  template <typename Constant,
+            typename = typename std::enable_if_t<
+                template_util::contains<Constant,
+                                        const DexField*,
+                                        const DexString*,
+                                        const DexType*>::value>>
   bool operator()(const sparta::ConstantAbstractDomain<Constant>& d1,
                   const sparta::ConstantAbstractDomain<Constant>& d2) const {
     if (!(d1.is_value() && d2.is_value())) {
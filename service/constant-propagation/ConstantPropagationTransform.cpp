@@ -7,6 +7,7 @@
 
 #include "ConstantPropagationTransform.h"
 
+#include "SparseConstantPropagation.h"
 #include "Transform.h"
 
 namespace constant_propagation {
@@ -283,8 +284,9 @@ void Transform::remove_dead_switch(const ConstantEnvironment& env,
  * whether it is dead (i.e. whether the branch always taken or never taken).
  * If it is, we can replace it with either a nop or a goto.
  */
+template <class FixpointIterator>
 void Transform::eliminate_dead_branch(
-    const intraprocedural::FixpointIterator& intra_cp,
+    const FixpointIterator& intra_cp,
     const ConstantEnvironment& env,
     cfg::ControlFlowGraph& cfg,
     cfg::Block* block) {
@@ -440,10 +442,10 @@ void Transform::apply_changes(IRCode* code) {
   }
 }
 
-Transform::Stats Transform::apply(
-    const intraprocedural::FixpointIterator& intra_cp,
-    const WholeProgramState& wps,
-    IRCode* code) {
+template <class FixpointIterator>
+Transform::Stats Transform::apply(const FixpointIterator& intra_cp,
+                                  const WholeProgramState& wps,
+                                  IRCode* code) {
   auto& cfg = code->cfg();
   boost::optional<int32_t> temp_reg;
   for (const auto& block : cfg.blocks()) {
@@ -468,4 +470,13 @@ Transform::Stats Transform::apply(
   return m_stats;
 }
 
+template Transform::Stats Transform::apply(
+    const intraprocedural::FixpointIterator&,
+    const WholeProgramState&,
+    IRCode*);
+template Transform::Stats Transform::apply(
+    const intraprocedural::SparseFixpointIterator&,
+    const WholeProgramState&,
+    IRCode*);
+
 } // namespace constant_propagation
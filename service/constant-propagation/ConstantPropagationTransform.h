@@ -46,9 +46,12 @@ class Transform final {
 
   explicit Transform(Config config = Config()) : m_config(config) {}
 
-  Stats apply(const intraprocedural::FixpointIterator&,
-              const WholeProgramState&,
-              IRCode*);
+  /*
+   * Instantiated for intraprocedural::FixpointIterator and
+   * intraprocedural::SparseFixpointIterator.
+   */
+  template <class FixpointIterator>
+  Stats apply(const FixpointIterator&, const WholeProgramState&, IRCode*);
 
  private:
   /*
@@ -78,7 +81,8 @@ class Transform final {
                           cfg::ControlFlowGraph&,
                           cfg::Block*);
 
-  void eliminate_dead_branch(const intraprocedural::FixpointIterator&,
+  template <class FixpointIterator>
+  void eliminate_dead_branch(const FixpointIterator&,
                              const ConstantEnvironment&,
                              cfg::ControlFlowGraph&,
                              cfg::Block*);
@@ -163,20 +163,35 @@ void WholeProgramState::collect(
     if (code == nullptr) {
       return;
     }
+    auto collect_values = [&](const StoredValues& stored_values) {
+      for (const auto& pair : stored_values) {
+        collect_field_values(pair.first, pair.second,
+                             method::is_clinit(method) ? method->get_class()
+                                                       : nullptr,
+                             &fields_value_tmp);
+        collect_return_values(pair.first, pair.second, method,
+                              &methods_value_tmp);
+      }
+    };
+    // Only the methods whose inputs changed since the iterator last analyzed
+    // them need to be analyzed again.
+    auto summary = fp_iter.get_valid_summary(method);
+    if (summary != nullptr) {
+      collect_values(summary->stored_values);
+      return;
+    }
     auto& cfg = code->cfg();
     auto intra_cp = fp_iter.get_intraprocedural_analysis(method);
+    StoredValues stored_values;
     for (cfg::Block* b : cfg.blocks()) {
       auto env = intra_cp->get_entry_state_at(b);
       for (auto& mie : InstructionIterable(b)) {
         auto* insn = mie.insn;
         intra_cp->analyze_instruction(insn, &env);
-        collect_field_values(insn, env,
-                             method::is_clinit(method) ? method->get_class()
-                                                       : nullptr,
-                             &fields_value_tmp);
-        collect_return_values(insn, env, method, &methods_value_tmp);
+        record_stored_value(insn, env, &stored_values);
       }
     }
+    collect_values(stored_values);
   });
   for (const auto& pair : fields_value_tmp) {
     for (auto& value : pair.second) {
@@ -205,7 +220,7 @@ void WholeProgramState::collect(
  */
 void WholeProgramState::collect_field_values(
     const IRInstruction* insn,
-    const ConstantEnvironment& env,
+    const ConstantValue& value,
     const DexType* clinit_cls,
     ConcurrentMap<const DexField*, std::vector<ConstantValue>>*
         fields_value_tmp) {
@@ -217,7 +232,6 @@ void WholeProgramState::collect_field_values(
     if (is_sput(insn->opcode()) && field->get_class() == clinit_cls) {
       return;
     }
-    auto value = env.get(insn->src(0));
     fields_value_tmp->update(
         field,
         [value](const DexField*,
@@ -234,27 +248,13 @@ void WholeProgramState::collect_field_values(
  */
 void WholeProgramState::collect_return_values(
     const IRInstruction* insn,
-    const ConstantEnvironment& env,
+    const ConstantValue& value,
     const DexMethod* method,
     ConcurrentMap<const DexMethod*, std::vector<ConstantValue>>*
         methods_value_tmp) {
-  auto op = insn->opcode();
-  if (!is_return(op)) {
+  if (!is_return(insn->opcode())) {
     return;
   }
-  if (op == OPCODE_RETURN_VOID) {
-    // We must set the binding to Top here to record the fact that this method
-    // does indeed return -- even though `void` is not actually a return value,
-    // this tells us that the code following any invoke of this method is
-    // reachable.
-    methods_value_tmp->update(
-        method,
-        [](const DexMethod*, std::vector<ConstantValue>& s, bool /* exists */) {
-          s.emplace_back(ConstantValue::top());
-        });
-    return;
-  }
-  auto value = env.get(insn->src(0));
   methods_value_tmp->update(
       method,
       [value](const DexMethod*,
@@ -262,6 +262,20 @@ void WholeProgramState::collect_return_values(
               bool /* exists */) { s.emplace_back(value); });
 }
 
+void record_stored_value(const IRInstruction* insn,
+                         const ConstantEnvironment& env,
+                         StoredValues* stored_values) {
+  auto op = insn->opcode();
+  if (op == OPCODE_RETURN_VOID) {
+    // We must record Top here to note the fact that this method does indeed
+    // return -- even though `void` is not actually a return value, this tells
+    // us that the code following any invoke of this method is reachable.
+    stored_values->emplace_back(insn, ConstantValue::top());
+  } else if (is_return(op) || is_sput(op) || is_iput(op)) {
+    stored_values->emplace_back(insn, env.get(insn->src(0)));
+  }
+}
+
 void WholeProgramState::collect_static_finals(const DexClass* cls,
                                               FieldEnvironment field_env) {
   for (auto* field : cls->get_sfields()) {
@@ -30,6 +30,21 @@ using ConstantFieldPartition =
 using ConstantMethodPartition =
     sparta::HashedAbstractPartition<const DexMethod*, ConstantValue>;
 
+/*
+ * The values written by the field puts and the return instructions of a
+ * method, i.e. what the method contributes to the WholeProgramState.
+ */
+using StoredValues =
+    std::vector<std::pair<const IRInstruction*, ConstantValue>>;
+
+/*
+ * Records the value that `insn` stores, if any, given the environment right
+ * after it.
+ */
+void record_stored_value(const IRInstruction* insn,
+                         const ConstantEnvironment& env,
+                         StoredValues* stored_values);
+
 /*
  * This class contains flow-insensitive information about fields and method
  * return values, i.e. it can tells us if a field or a return value is constant
@@ -111,13 +126,13 @@ class WholeProgramState {
 
   void collect_field_values(
       const IRInstruction* insn,
-      const ConstantEnvironment& env,
+      const ConstantValue& value,
       const DexType* clinit_cls,
       ConcurrentMap<const DexField*, std::vector<ConstantValue>>* field_tmp);
 
   void collect_return_values(
       const IRInstruction* insn,
-      const ConstantEnvironment& env,
+      const ConstantValue& value,
       const DexMethod* method,
       ConcurrentMap<const DexMethod*, std::vector<ConstantValue>>* method_tmp);
 
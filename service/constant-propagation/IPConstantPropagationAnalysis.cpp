@@ -7,6 +7,8 @@
 
 #include "IPConstantPropagationAnalysis.h"
 
+#include "Resolver.h"
+
 namespace constant_propagation {
 
 namespace interprocedural {
@@ -24,6 +26,30 @@ ConstantEnvironment env_with_params(const IRCode* code,
   return env;
 }
 
+std::vector<ConstantValue> FixpointIterator::get_whole_program_inputs(
+    const IRCode* code) const {
+  // These are the reads done by WholeProgramAwareAnalyzer.
+  std::vector<ConstantValue> inputs;
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    auto op = insn->opcode();
+    if (is_sget(op) || is_iget(op)) {
+      auto field = resolve_field(insn->get_field());
+      if (field != nullptr) {
+        inputs.push_back(m_wps->get_field_value(field));
+      }
+    } else if (op == OPCODE_INVOKE_DIRECT || op == OPCODE_INVOKE_STATIC ||
+               op == OPCODE_INVOKE_VIRTUAL) {
+      auto callee =
+          resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (callee != nullptr) {
+        inputs.push_back(m_wps->get_return_value(callee));
+      }
+    }
+  }
+  return inputs;
+}
+
 void FixpointIterator::analyze_node(const DexMethod* const& method,
                                     Domain* current_state) const {
   // The entry node has no associated method.
@@ -34,33 +60,76 @@ void FixpointIterator::analyze_node(const DexMethod* const& method,
   if (code == nullptr) {
     return;
   }
-  auto& cfg = code->cfg();
-  auto intra_cp = get_intraprocedural_analysis(method);
-  const auto outgoing_edges =
-      call_graph::GraphInterface::successors(m_call_graph, method);
-  std::unordered_set<IRInstruction*> outgoing_insns;
-  for (const auto& edge : outgoing_edges) {
-    outgoing_insns.emplace(edge->invoke_iterator()->insn);
-  }
-  for (auto* block : cfg.blocks()) {
-    auto state = intra_cp->get_entry_state_at(block);
-    for (auto& mie : InstructionIterable(block)) {
-      auto* insn = mie.insn;
-      auto op = insn->opcode();
-      if (insn->has_method()) {
-        if (outgoing_insns.count(insn)) {
-          ArgumentDomain out_args;
-          for (size_t i = 0; i < insn->srcs_size(); ++i) {
-            out_args.set(i, state.get(insn->src(i)));
+  auto args = this->get_entry_state_at(const_cast<DexMethod*>(method))
+                  .get(CURRENT_PARTITION_LABEL);
+  auto inputs = get_whole_program_inputs(code);
+  auto summary = find_summary(method, args, inputs);
+  if (summary == nullptr) {
+    auto new_summary = std::make_shared<MethodSummary>();
+    auto& cfg = code->cfg();
+    auto intra_cp = m_proc_analysis_factory(method, *m_wps, args);
+    const auto outgoing_edges =
+        call_graph::GraphInterface::successors(m_call_graph, method);
+    std::unordered_set<IRInstruction*> outgoing_insns;
+    for (const auto& edge : outgoing_edges) {
+      outgoing_insns.emplace(edge->invoke_iterator()->insn);
+    }
+    for (auto* block : cfg.blocks()) {
+      auto state = intra_cp->get_entry_state_at(block);
+      for (auto& mie : InstructionIterable(block)) {
+        auto* insn = mie.insn;
+        if (insn->has_method()) {
+          if (outgoing_insns.count(insn)) {
+            ArgumentDomain out_args;
+            for (size_t i = 0; i < insn->srcs_size(); ++i) {
+              out_args.set(i, state.get(insn->src(i)));
+            }
+            new_summary->out_args.emplace_back(insn, out_args);
           }
-          current_state->set(insn, out_args);
         }
+        intra_cp->analyze_instruction(insn, &state);
+        record_stored_value(insn, state, &new_summary->stored_values);
       }
-      intra_cp->analyze_instruction(insn, &state);
     }
+    new_summary->args = std::move(args);
+    new_summary->inputs = std::move(inputs);
+    summary = std::move(new_summary);
+    m_summaries.insert_or_assign(std::make_pair(method, summary));
+  }
+  for (const auto& pair : summary->out_args) {
+    current_state->set(pair.first, pair.second);
   }
 }
 
+std::shared_ptr<const FixpointIterator::MethodSummary>
+FixpointIterator::find_summary(const DexMethod* method,
+                               const ArgumentDomain& args,
+                               const std::vector<ConstantValue>& inputs) const {
+  auto summary = m_summaries.get(method, nullptr);
+  if (summary == nullptr || !summary->args.equals(args) ||
+      summary->inputs.size() != inputs.size()) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!summary->inputs[i].equals(inputs[i])) {
+      return nullptr;
+    }
+  }
+  ++m_reused_analyses;
+  return summary;
+}
+
+std::shared_ptr<const FixpointIterator::MethodSummary>
+FixpointIterator::get_valid_summary(const DexMethod* method) const {
+  auto code = method->get_code();
+  if (code == nullptr) {
+    return nullptr;
+  }
+  auto args = this->get_entry_state_at(const_cast<DexMethod*>(method))
+                  .get(CURRENT_PARTITION_LABEL);
+  return find_summary(method, args, get_whole_program_inputs(code));
+}
+
 Domain FixpointIterator::analyze_edge(
     const std::shared_ptr<call_graph::Edge>& edge,
     const Domain& exit_state_at_source) const {
@@ -76,6 +145,13 @@ Domain FixpointIterator::analyze_edge(
   return entry_state_at_dest;
 }
 
+uint64_t FixpointIterator::node_weight(const DexMethod* const& method) const {
+  if (method == nullptr || method->get_code() == nullptr) {
+    return 1;
+  }
+  return 1 + method->get_code()->sum_opcode_sizes();
+}
+
 std::unique_ptr<intraprocedural::FixpointIterator>
 FixpointIterator::get_intraprocedural_analysis(const DexMethod* method) const {
   auto args = this->get_entry_state_at(const_cast<DexMethod*>(method));
@@ -101,6 +177,11 @@ void set_encoded_values(const DexClass* cls, ConstantEnvironment* env) {
       env->set(
           sfield,
           StringDomain(static_cast<DexEncodedValueString*>(value)->string()));
+    } else if (sfield->get_type() == type::java_lang_Class() &&
+               value->evtype() == DEVT_TYPE) {
+      env->set(sfield,
+               ConstantClassObjectDomain(
+                   static_cast<DexEncodedValueType*>(value)->type()));
     } else {
       env->set(sfield, ConstantValue::top());
     }
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "CallGraph.h"
+#include "ConcurrentContainers.h"
 #include "ConstantEnvironment.h"
 #include "ConstantPropagationAnalysis.h"
 #include "ConstantPropagationWholeProgramState.h"
@@ -62,7 +65,11 @@ using ProcedureAnalysisFactory =
  * Performs interprocedural constant propagation of stack / register values.
  *
  * The intraprocedural propagation logic is delegated to the
- * ProcedureAnalysisFactory.
+ * ProcedureAnalysisFactory, whose results must only depend on the method, its
+ * arguments, and the field and return values that it reads from the
+ * WholeProgramState. This lets the iterator reuse the last analysis of a
+ * method when none of these inputs changed, e.g. across the rounds that
+ * refine the WholeProgramState.
  */
 class FixpointIterator : public sparta::ParallelMonotonicFixpointIterator<
                              call_graph::GraphInterface,
@@ -93,10 +100,43 @@ class FixpointIterator : public sparta::ParallelMonotonicFixpointIterator<
     m_wps = std::move(wps);
   }
 
+  // The outcome of the last analysis of a method, along with its inputs.
+  struct MethodSummary {
+    ArgumentDomain args;
+    std::vector<ConstantValue> inputs;
+    std::vector<std::pair<const IRInstruction*, ArgumentDomain>> out_args;
+    StoredValues stored_values;
+  };
+
+  /*
+   * Returns the last analysis of `method`, provided that it was done with the
+   * current entry state of the method and the current WholeProgramState.
+   * Returns nullptr otherwise.
+   */
+  std::shared_ptr<const MethodSummary> get_valid_summary(
+      const DexMethod* method) const;
+
+  // The number of method analyses that were skipped by reusing a previous one.
+  size_t get_reused_analyses() const { return m_reused_analyses; }
+
+ protected:
+  uint64_t node_weight(const DexMethod* const& method) const override;
+
  private:
+  // The values that the analysis of `code` reads from the WholeProgramState.
+  std::vector<ConstantValue> get_whole_program_inputs(const IRCode* code) const;
+
+  std::shared_ptr<const MethodSummary> find_summary(
+      const DexMethod* method,
+      const ArgumentDomain& args,
+      const std::vector<ConstantValue>& inputs) const;
+
   std::unique_ptr<const WholeProgramState> m_wps;
   ProcedureAnalysisFactory m_proc_analysis_factory;
   call_graph::Graph m_call_graph;
+  mutable ConcurrentMap<const DexMethod*, std::shared_ptr<const MethodSummary>>
+      m_summaries;
+  mutable std::atomic<size_t> m_reused_analyses{0};
 };
 
 } // namespace interprocedural
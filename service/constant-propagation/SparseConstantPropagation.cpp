@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SparseConstantPropagation.h"
+
+#include <algorithm>
+
+#include "ConstantPropagationAnalysis.h"
+#include "IRCode.h"
+
+namespace constant_propagation {
+
+namespace intraprocedural {
+
+namespace {
+
+bool is_branch_or_switch(IROpcode op) {
+  return is_conditional_branch(op) || is_switch(op);
+}
+
+// The instruction that writes the result register read by the move-result at
+// the start of `block`, when the two ended up in different blocks.
+const IRInstruction* find_primary_in_pred(const cfg::Block* block) {
+  for (auto edge : block->preds()) {
+    if (edge->type() != cfg::EDGE_GOTO) {
+      continue;
+    }
+    auto last = edge->src()->get_last_insn();
+    if (last != edge->src()->end() && last->insn->has_move_result_any()) {
+      return last->insn;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+SparseFixpointIterator::SparseFixpointIterator(
+    const cfg::ControlFlowGraph& cfg,
+    InstructionAnalyzer<ConstantEnvironment> insn_analyzer)
+    : m_cfg(cfg),
+      m_insn_analyzer(std::move(insn_analyzer)),
+      m_reaching_defs(cfg) {
+  m_reaching_defs.run();
+  cfg::BlockId max_id = 0;
+  for (auto b : cfg.block_range()) {
+    max_id = std::max(max_id, b->id());
+    auto defs = m_reaching_defs.get_entry_state_at(b);
+    const IRInstruction* prev = nullptr;
+    for (const auto& mie : InstructionIterable(b)) {
+      auto insn = mie.insn;
+      m_blocks.emplace(insn, b);
+      if (opcode::is_move_result_any(insn->opcode())) {
+        auto primary = prev != nullptr ? prev : find_primary_in_pred(b);
+        if (primary != nullptr && primary->has_move_result_any()) {
+          m_primaries.emplace(insn, primary);
+          m_move_results.emplace(primary, insn);
+        }
+      }
+      if (insn->srcs_size() > 0) {
+        auto& src_defs = m_src_defs[insn];
+        src_defs.reserve(insn->srcs_size());
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          src_defs.push_back(m_reaching_defs.get_defs(defs, insn->src(i)));
+          for (auto def : src_defs.back()) {
+            m_users[def].push_back(insn);
+          }
+        }
+      }
+      m_reaching_defs.analyze_instruction(insn, &defs);
+      prev = insn;
+    }
+  }
+  m_executable.resize(cfg.num_blocks() == 0 ? 0 : max_id + 1);
+}
+
+void SparseFixpointIterator::run(const ConstantEnvironment& init) {
+  m_init = init;
+  m_values.clear();
+  std::fill(m_executable.begin(), m_executable.end(), false);
+  mark_executable(m_cfg.entry_block());
+  while (!m_block_worklist.empty() || !m_insn_worklist.empty()) {
+    if (!m_block_worklist.empty()) {
+      auto block = m_block_worklist.back();
+      m_block_worklist.pop_back();
+      for (const auto& mie : InstructionIterable(block)) {
+        visit(mie.insn);
+      }
+      visit_block_end(block);
+      continue;
+    }
+    auto insn = m_insn_worklist.back();
+    m_insn_worklist.pop_back();
+    auto block = m_blocks.at(insn);
+    if (!m_executable[block->id()]) {
+      continue;
+    }
+    visit(insn);
+    if (is_branch_or_switch(insn->opcode())) {
+      visit_block_end(block);
+    }
+  }
+}
+
+ConstantValue SparseFixpointIterator::join_values(
+    const std::vector<IRInstruction*>& defs) const {
+  auto value = ConstantValue::bottom();
+  for (auto def : defs) {
+    auto it = m_values.find(def);
+    if (it != m_values.end()) {
+      value.join_with(it->second);
+    }
+  }
+  return value;
+}
+
+bool SparseFixpointIterator::evaluate(const IRInstruction* insn,
+                                      ConstantEnvironment* env) const {
+  auto primary_it = m_primaries.find(insn);
+  if (primary_it != m_primaries.end() &&
+      !evaluate(primary_it->second, env)) {
+    return false;
+  }
+  auto it = m_src_defs.find(insn);
+  if (it != m_src_defs.end()) {
+    const auto& src_defs = it->second;
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      if (src_defs[i].empty()) {
+        // Not defined in the method, so it keeps its initial value.
+        continue;
+      }
+      auto value = join_values(src_defs[i]);
+      if (value.is_bottom()) {
+        return false;
+      }
+      env->set(insn->src(i), value);
+    }
+  }
+  analyze_instruction(insn, env);
+  return true;
+}
+
+void SparseFixpointIterator::mark_executable(cfg::Block* block) {
+  if (m_executable[block->id()]) {
+    return;
+  }
+  m_executable[block->id()] = true;
+  m_block_worklist.push_back(block);
+}
+
+void SparseFixpointIterator::visit(const IRInstruction* insn) {
+  if (!insn->has_dest()) {
+    // The inputs of a move-result are the ones of its primary instruction.
+    auto it = m_move_results.find(insn);
+    if (it != m_move_results.end()) {
+      m_insn_worklist.push_back(it->second);
+    }
+    return;
+  }
+  auto env = m_init;
+  if (!evaluate(insn, &env)) {
+    return;
+  }
+  auto value =
+      env.is_bottom() ? ConstantValue::bottom() : env.get(insn->dest());
+  auto& current = m_values.emplace(insn, ConstantValue::bottom()).first->second;
+  if (value.leq(current)) {
+    return;
+  }
+  current.join_with(value);
+  auto users = m_users.find(insn);
+  if (users != m_users.end()) {
+    m_insn_worklist.insert(
+        m_insn_worklist.end(), users->second.begin(), users->second.end());
+  }
+}
+
+void SparseFixpointIterator::visit_block_end(cfg::Block* block) {
+  auto last = block->get_last_insn();
+  if (last == block->end() || !is_branch_or_switch(last->insn->opcode())) {
+    for (auto edge : block->succs()) {
+      mark_executable(edge->target());
+    }
+    return;
+  }
+  auto env = m_init;
+  if (!evaluate(last->insn, &env)) {
+    return;
+  }
+  for (auto edge : block->succs()) {
+    if (!analyze_edge(edge, env).is_bottom()) {
+      mark_executable(edge->target());
+    }
+  }
+}
+
+ConstantEnvironment SparseFixpointIterator::get_entry_state_at(
+    cfg::Block* block) const {
+  if (!m_executable[block->id()]) {
+    return ConstantEnvironment::bottom();
+  }
+  auto env = m_init;
+  const auto& defs = m_reaching_defs.get_entry_state_at(block);
+  for (reg_t reg = 0; reg < m_cfg.get_registers_size(); ++reg) {
+    auto reg_defs = m_reaching_defs.get_defs(defs, reg);
+    if (reg_defs.empty()) {
+      continue;
+    }
+    auto value = join_values(reg_defs);
+    if (!value.is_bottom()) {
+      env.set(reg, value);
+    }
+  }
+  auto first = block->get_first_insn();
+  if (first != block->end()) {
+    auto it = m_primaries.find(first->insn);
+    if (it != m_primaries.end()) {
+      auto primary_env = m_init;
+      if (evaluate(it->second, &primary_env) && !primary_env.is_bottom()) {
+        env.set(RESULT_REGISTER, primary_env.get(RESULT_REGISTER));
+      }
+    }
+  }
+  return env;
+}
+
+ConstantValue SparseFixpointIterator::get_value_of(
+    const IRInstruction* insn) const {
+  auto it = m_values.find(insn);
+  return it == m_values.end() ? ConstantValue::bottom() : it->second;
+}
+
+ConstantEnvironment SparseFixpointIterator::analyze_edge(
+    cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source) const {
+  return analyze_edge_condition(edge, exit_state_at_source);
+}
+
+} // namespace intraprocedural
+
+} // namespace constant_propagation
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "BitVectorDataflow.h"
+#include "ConstantEnvironment.h"
+#include "ControlFlow.h"
+#include "InstructionAnalyzer.h"
+
+namespace constant_propagation {
+
+namespace intraprocedural {
+
+/*
+ * A sparse conditional constant propagation over the def-use chains of a
+ * method, as described in:
+ *
+ *   M. N. Wegman, F. K. Zadeck. Constant Propagation with Conditional
+ *   Branches. In TOPLAS 13(2), pp 181-210 (1991).
+ *
+ * Instead of an environment per block, this keeps one value per definition,
+ * and only reevaluates the instructions whose inputs have changed. The blocks
+ * only become reachable once a branch that leads to them may be taken. The
+ * def-use chains are derived from the bit-vector reaching definitions.
+ *
+ * This exposes the same queries as FixpointIterator, so that the constant
+ * propagation Transform can run on either. The analysis is approximate: it is
+ * sound, but it may find fewer constants than FixpointIterator, in two ways:
+ *
+ * - The values of a use are joined over all its reaching definitions, even
+ *   those that only reach it through branches that are never taken;
+ * - Branch conditions don't refine the values of the registers they test on
+ *   the paths that follow them.
+ *
+ * Only the register environment is propagated, so this is meant for the
+ * analyzers that don't track fields or arrays, like ConstantPrimitiveAnalyzer.
+ * It trades this precision for speed on large methods, which is why
+ * ConstantPropagationPass only uses it when "sparse" is set.
+ */
+class SparseFixpointIterator final {
+ public:
+  SparseFixpointIterator(
+      const cfg::ControlFlowGraph& cfg,
+      InstructionAnalyzer<ConstantEnvironment> insn_analyzer);
+
+  void run(const ConstantEnvironment& init);
+
+  // Bottom for the blocks that are unreachable.
+  ConstantEnvironment get_entry_state_at(cfg::Block* block) const;
+
+  // The value of the register that `insn` defines, right after it.
+  ConstantValue get_value_of(const IRInstruction* insn) const;
+
+  void analyze_instruction(const IRInstruction* insn,
+                           ConstantEnvironment* current_state) const {
+    m_insn_analyzer(insn, current_state);
+  }
+
+  ConstantEnvironment analyze_edge(
+      cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source) const;
+
+ private:
+  // Sets the srcs of `insn` in `env` and analyzes it. Returns false if some
+  // of them have no value yet.
+  bool evaluate(const IRInstruction* insn, ConstantEnvironment* env) const;
+
+  ConstantValue join_values(const std::vector<IRInstruction*>& defs) const;
+
+  void mark_executable(cfg::Block* block);
+
+  void visit(const IRInstruction* insn);
+
+  void visit_block_end(cfg::Block* block);
+
+  const cfg::ControlFlowGraph& m_cfg;
+  InstructionAnalyzer<ConstantEnvironment> m_insn_analyzer;
+  bitvector_dataflow::ReachingDefinitions m_reaching_defs;
+  // The reaching definitions of each src of each instruction.
+  std::unordered_map<const IRInstruction*,
+                     std::vector<std::vector<IRInstruction*>>>
+      m_src_defs;
+  std::unordered_map<const IRInstruction*, std::vector<const IRInstruction*>>
+      m_users;
+  // The instructions that write the result register, by their move-result,
+  // and conversely.
+  std::unordered_map<const IRInstruction*, const IRInstruction*> m_primaries;
+  std::unordered_map<const IRInstruction*, const IRInstruction*>
+      m_move_results;
+  std::unordered_map<const IRInstruction*, cfg::Block*> m_blocks;
+
+  ConstantEnvironment m_init;
+  std::unordered_map<const IRInstruction*, ConstantValue> m_values;
+  // Indexed by block id.
+  std::vector<bool> m_executable;
+  std::vector<cfg::Block*> m_block_worklist;
+  std::vector<const IRInstruction*> m_insn_worklist;
+};
+
+} // namespace intraprocedural
+
+} // namespace constant_propagation
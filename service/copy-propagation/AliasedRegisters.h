@@ -7,17 +7,9 @@
 
 #pragma once
 
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wshadow"
-#endif
-#include <boost/graph/adjacency_list.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
 #include <boost/optional.hpp>
-#include <boost/range/iterator_range.hpp>
 #include <limits>
+#include <vector>
 
 #include "AbstractDomain.h"
 #include "ConstantUses.h"
@@ -181,63 +173,27 @@ class AliasedRegisters final : public sparta::AbstractValue<AliasedRegisters> {
   sparta::AbstractValueKind narrow_with(const AliasedRegisters& other) override;
 
  private:
-  // An undirected graph where register values are vertices
-  // and an edge means they are aliased.
-  // Using a set for the edge container makes sure we can't have parallel edges
-  using Graph = boost::adjacency_list<boost::setS, // out edge container
-                                      boost::vecS, // vertex container
-                                      boost::undirectedS, // undirected graph
-                                      Value>; // node property
-  using vertex_t = boost::graph_traits<Graph>::vertex_descriptor;
-  Graph m_graph;
-
-  // For keeping track of the oldest representative.
-  //
-  // When adding a vertex to a group, it gets 1 + the max insertion number of
-  // the group. When choosing a representative, we prefer lower insertion
-  // numbers. Vertices in a group are guaranteed to have an entry in this map.
-  // Do not query this map if the vertex is not in a group.
+  struct Member {
+    Value value;
+    // Members of the same group have the same number. The numbers themselves
+    // carry no meaning.
+    uint32_t group;
+  };
+
+  // The members of all alias groups of at least two values. The members of a
+  // group are in the order they joined it, oldest first, which is the order
+  // in which we prefer registers as representatives. A value is a member of at
+  // most one group.
   //
-  // We only track the insertion for registers because they're the only type
-  // that could be chosen as a representative.
-  using InsertionOrder = std::unordered_map<vertex_t, size_t>;
-  InsertionOrder m_insert_order;
-
-  const boost::range_detail::integer_iterator<vertex_t> find(
-      const Value& r) const;
-
-  vertex_t find_or_create(const Value& r);
-
-  bool has_edge_between(const Value& r1, const Value& r2) const;
-  bool are_adjacent(vertex_t v1, vertex_t v2) const;
-
-  // return a vector of all vertices in v's alias group (including v itself)
-  std::vector<vertex_t> vertices_in_group(vertex_t v) const;
-
-  // merge r1's group with r2. This operation is symmetric
-  void merge_groups_of(const Value& r1,
-                       const Value& r2,
-                       const AliasedRegisters& other);
-
-  // return all groups (not including singletons)
-  std::vector<std::vector<vertex_t>> all_groups();
-
-  void track_insert_order(const Value& moving,
-                          vertex_t v_moving,
-                          const Value& group,
-                          vertex_t v_group,
-                          const std::vector<vertex_t>& grp);
-  void clear_insert_number(vertex_t v);
-  void handle_edge_intersection_insert_order(const AliasedRegisters& other);
-  void handle_insert_order_at_merge(const std::vector<vertex_t>& group,
-                                    const AliasedRegisters& other);
-
-  void renumber_insert_order(
-      std::vector<vertex_t> group,
-      const std::function<bool(vertex_t, vertex_t)>& less_than);
-
-  // return true if v has any neighboring vertices
-  bool has_neighbors(vertex_t v);
+  // Being flat, this is cheap to copy, which the fixpoint iteration does at
+  // every join.
+  std::vector<Member> m_members;
+  uint32_t m_next_group{0};
+
+  // The index of `r` in m_members, or m_members.size().
+  size_t find(const Value& r) const;
+
+  size_t group_size(uint32_t group) const;
 };
 
 class AliasDomain final
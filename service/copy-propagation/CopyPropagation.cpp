@@ -88,7 +88,7 @@ class AliasFixpointIterator final
       const std::unordered_set<const IRInstruction*>& range_set,
       Stats& stats)
       : MonotonicFixpointIterator<cfg::GraphInterface, AliasDomain>(
-            cfg, cfg.blocks().size()),
+            cfg, cfg.num_blocks()),
         m_cfg(cfg),
         m_method(method),
         m_config(config),
@@ -441,7 +441,8 @@ Stats CopyPropagation::run(const Scope& scope) {
 
         return result;
       },
-      m_config.debug ? 1 : redex_parallel::default_num_threads());
+      m_config.debug ? 1 : redex_parallel::default_num_threads(), Stats(),
+      walk::parallel::Schedule::BY_COST);
 }
 
 Stats CopyPropagation::run(IRCode* code, DexMethod* method) {
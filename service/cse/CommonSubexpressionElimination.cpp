@@ -253,6 +253,53 @@ const CseUnorderedLocationSet general_memory_barrier_locations =
     CseUnorderedLocationSet{
         CseLocation(CseSpecialLocations::GENERAL_MEMORY_BARRIER)};
 
+// The value numbering tables of an Analyzer. CSE runs on all the methods of
+// a scope, so the tables are recycled through a per-thread pool instead of
+// being reallocated for each method.
+struct ValueTables {
+  std::unordered_map<IRValue, value_id_t, IRValueHasher> value_ids;
+  std::unordered_set<value_id_t> pre_state_value_ids;
+  std::unordered_map<value_id_t, const IRInstruction*> positional_insns;
+};
+
+class PooledValueTables {
+ public:
+  PooledValueTables() {
+    auto& pool = get_pool();
+    if (pool.empty()) {
+      m_tables = std::make_unique<ValueTables>();
+    } else {
+      m_tables = std::move(pool.back());
+      pool.pop_back();
+    }
+  }
+
+  ~PooledValueTables() {
+    // Don't hold on to the memory of unusually large methods.
+    if (m_tables->value_ids.bucket_count() > MAX_POOLED_BUCKETS) {
+      return;
+    }
+    m_tables->value_ids.clear();
+    m_tables->pre_state_value_ids.clear();
+    m_tables->positional_insns.clear();
+    get_pool().push_back(std::move(m_tables));
+  }
+
+  ValueTables* operator->() const { return m_tables.get(); }
+
+ private:
+  static constexpr size_t MAX_POOLED_BUCKETS = 1 << 16;
+
+  static std::vector<std::unique_ptr<ValueTables>>& get_pool() {
+    // Nothing prevents several analyzers from being alive on the same thread,
+    // hence a pool rather than a single set of tables.
+    static thread_local std::vector<std::unique_ptr<ValueTables>> pool;
+    return pool;
+  }
+
+  std::unique_ptr<ValueTables> m_tables;
+};
+
 class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
  public:
   Analyzer(SharedState* shared_state, cfg::ControlFlowGraph& cfg)
@@ -483,10 +530,10 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   }
 
   bool is_pre_state_src(value_id_t value_id) const {
-    return !!m_pre_state_value_ids.count(value_id);
+    return !!m_tables->pre_state_value_ids.count(value_id);
   }
 
-  size_t get_value_ids_size() { return m_value_ids.size(); }
+  size_t get_value_ids_size() { return m_tables->value_ids.size(); }
 
   bool using_other_tracked_location_bit() {
     return m_using_other_tracked_location_bit;
@@ -524,12 +571,12 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   }
 
   boost::optional<value_id_t> get_value_id(const IRValue& value) const {
-    auto it = m_value_ids.find(value);
-    if (it != m_value_ids.end()) {
+    auto it = m_tables->value_ids.find(value);
+    if (it != m_tables->value_ids.end()) {
       return boost::optional<value_id_t>(it->second);
     }
-    value_id_t id = m_value_ids.size() * ValueIdFlags::BASE;
-    always_assert(id / ValueIdFlags::BASE == m_value_ids.size());
+    value_id_t id = m_tables->value_ids.size() * ValueIdFlags::BASE;
+    always_assert(id / ValueIdFlags::BASE == m_tables->value_ids.size());
     if (is_aget(value.opcode)) {
       id |= get_location_value_id_mask(get_read_array_location(value.opcode));
     } else if (is_iget(value.opcode) || is_sget(value.opcode)) {
@@ -547,11 +594,11 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
         id |= (src & ValueIdFlags::IS_TRACKED_LOCATION_MASK);
       }
     }
-    m_value_ids.emplace(value, id);
+    m_tables->value_ids.emplace(value, id);
     if (value.opcode == IOPCODE_POSITIONAL) {
-      m_positional_insns.emplace(id, value.positional_insn);
+      m_tables->positional_insns.emplace(id, value.positional_insn);
     } else if (value.opcode == IOPCODE_PRE_STATE_SRC) {
-      m_pre_state_value_ids.insert(id);
+      m_tables->pre_state_value_ids.insert(id);
     }
     return boost::optional<value_id_t>(id);
   }
@@ -711,8 +758,8 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   }
 
   DexType* get_exact_type(value_id_t value_id) const {
-    auto it = m_positional_insns.find(value_id);
-    if (it == m_positional_insns.end()) {
+    auto it = m_tables->positional_insns.find(value_id);
+    if (it == m_tables->positional_insns.end()) {
       return nullptr;
     }
     auto insn = it->second;
@@ -731,10 +778,7 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   std::unordered_map<CseLocation, value_id_t, CseLocationHasher>
       m_tracked_locations;
   SharedState* m_shared_state;
-  mutable std::unordered_map<IRValue, value_id_t, IRValueHasher> m_value_ids;
-  mutable std::unordered_set<value_id_t> m_pre_state_value_ids;
-  mutable std::unordered_map<value_id_t, const IRInstruction*>
-      m_positional_insns;
+  PooledValueTables m_tables;
 };
 
 } // namespace
@@ -956,6 +1000,48 @@ void SharedState::init_scope(const Scope& scope) {
   }
 
   init_method_barriers(scope);
+  init_invoke_written_locations(scope);
+}
+
+void SharedState::init_invoke_written_locations(const Scope& scope) {
+  Timer t("init_invoke_written_locations");
+  ConcurrentMap<const DexMethod*, CseUnorderedLocationSet> written_locations;
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
+    for (auto& mie : cfg::InstructionIterable(code.cfg())) {
+      auto insn = mie.insn;
+      if (!is_invoke(insn->opcode()) ||
+          insn->opcode() == OPCODE_INVOKE_SUPER) {
+        continue;
+      }
+      auto method =
+          resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (method == nullptr || written_locations.count(method)) {
+        continue;
+      }
+      CseUnorderedLocationSet locations;
+      if (!get_invoke_written_locations(method, &locations)) {
+        locations = general_memory_barrier_locations;
+      }
+      written_locations.emplace(method, std::move(locations));
+    }
+  });
+  m_invoke_written_locations.insert(written_locations.begin(),
+                                    written_locations.end());
+}
+
+bool SharedState::get_invoke_written_locations(
+    const DexMethod* method, CseUnorderedLocationSet* locations) const {
+  return process_base_and_overriding_methods(
+      m_method_override_graph.get(), method,
+      /* ignore_methods_with_assumenosideeffects */ true,
+      [&](DexMethod* other_method) {
+        auto it = m_method_written_locations.find(other_method);
+        if (it == m_method_written_locations.end()) {
+          return false;
+        }
+        locations->insert(it->second.begin(), it->second.end());
+        return true;
+      });
 }
 
 CseUnorderedLocationSet SharedState::get_relevant_written_locations(
@@ -1049,27 +1135,27 @@ CseUnorderedLocationSet SharedState::get_relevant_written_locations(
 
   auto method_ref = insn->get_method();
   DexMethod* method = resolve_method(method_ref, opcode_to_search(insn));
-  CseUnorderedLocationSet written_locations;
-  if (!process_base_and_overriding_methods(
-          m_method_override_graph.get(), method,
-          /* ignore_methods_with_assumenosideeffects */ true,
-          [&](DexMethod* other_method) {
-            auto it = m_method_written_locations.find(other_method);
-            if (it == m_method_written_locations.end()) {
-              return false;
-            }
-            written_locations.insert(it->second.begin(), it->second.end());
-            return true;
-          })) {
+  // Methods invoked from code that was not in the scope at init_scope time,
+  // e.g. code being inlined, are not in the precomputed table.
+  auto it = m_invoke_written_locations.find(method);
+  CseUnorderedLocationSet all_written_locations;
+  if (it == m_invoke_written_locations.end()) {
+    if (!get_invoke_written_locations(method, &all_written_locations)) {
+      return general_memory_barrier_locations;
+    }
+  } else if (it->second.count(
+                 CseLocation(CseSpecialLocations::GENERAL_MEMORY_BARRIER))) {
     return general_memory_barrier_locations;
   }
+  const auto& candidates =
+      it == m_invoke_written_locations.end() ? all_written_locations
+                                             : it->second;
 
   // Remove written locations that are not read
-  for (auto it = written_locations.begin(); it != written_locations.end();) {
-    if (!read_locations.count(*it)) {
-      it = written_locations.erase(it);
-    } else {
-      it++;
+  CseUnorderedLocationSet written_locations;
+  for (const auto& location : candidates) {
+    if (read_locations.count(location)) {
+      written_locations.insert(location);
     }
   }
 
@@ -76,6 +76,9 @@ class SharedState {
 
  private:
   void init_method_barriers(const Scope& scope);
+  void init_invoke_written_locations(const Scope& scope);
+  bool get_invoke_written_locations(const DexMethod* method,
+                                    CseUnorderedLocationSet* locations) const;
   bool may_be_barrier(const IRInstruction* insn, DexType* exact_virtual_scope);
   bool is_invoke_safe(const IRInstruction* insn, DexType* exact_virtual_scope);
   CseUnorderedLocationSet get_relevant_written_locations(
@@ -88,6 +91,12 @@ class SharedState {
       m_method_written_locations;
   std::unordered_map<const DexMethod*, CseUnorderedLocationSet>
       m_conditionally_pure_methods;
+  // The locations that an invoke of a method may write to, over all its
+  // overriding methods, computed once for all the invoked methods of the
+  // scope before the methods are processed in parallel. General memory
+  // barriers are represented by general_memory_barrier_locations.
+  std::unordered_map<const DexMethod*, CseUnorderedLocationSet>
+      m_invoke_written_locations;
   std::unique_ptr<const method_override_graph::Graph> m_method_override_graph;
   SharedStateStats m_stats;
 };
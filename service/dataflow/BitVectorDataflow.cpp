@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BitVectorDataflow.h"
+
+#include <algorithm>
+
+#include "GraphUtil.h"
+
+namespace bitvector_dataflow {
+
+GenKillSolver::GenKillSolver(const cfg::ControlFlowGraph& cfg,
+                             Direction direction,
+                             size_t num_facts)
+    : m_cfg(cfg), m_direction(direction), m_num_facts(num_facts) {
+  cfg::BlockId max_id = 0;
+  for (auto b : cfg.block_range()) {
+    max_id = std::max(max_id, b->id());
+  }
+  m_states.resize(cfg.num_blocks() == 0 ? 0 : max_id + 1);
+  for (auto b : cfg.block_range()) {
+    auto& s = state(b);
+    s.gen.resize(num_facts);
+    s.kill.resize(num_facts);
+    s.in.resize(num_facts);
+    s.out.resize(num_facts);
+  }
+}
+
+void GenKillSolver::solve() {
+  // Visiting the blocks in reverse postorder for forward problems, and in
+  // postorder for backwards ones, makes most states final after one round.
+  auto order = graph::postorder_sort<cfg::GraphInterface>(m_cfg);
+  bool forward = m_direction == Direction::FORWARD;
+  if (forward) {
+    std::reverse(order.begin(), order.end());
+  }
+  // Unreachable blocks keep empty states, and so don't contribute to their
+  // neighbours.
+  for (auto b : order) {
+    auto& s = state(b);
+    s.out = s.gen;
+  }
+
+  BitVector out(m_num_facts);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b : order) {
+      auto& s = state(b);
+      s.in.reset();
+      for (auto e : forward ? b->preds() : b->succs()) {
+        s.in |= state(forward ? e->src() : e->target()).out;
+      }
+      out = s.in;
+      out -= s.kill;
+      out |= s.gen;
+      if (out != s.out) {
+        s.out.swap(out);
+        changed = true;
+      }
+    }
+  }
+}
+
+Liveness::Liveness(const cfg::ControlFlowGraph& cfg)
+    : m_solver(cfg, Direction::BACKWARD, cfg.get_registers_size()) {
+  for (auto b : cfg.blocks()) {
+    auto& gen = m_solver.gen(b);
+    auto& kill = m_solver.kill(b);
+    for (auto it = b->rbegin(); it != b->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = it->insn;
+      if (insn->has_dest()) {
+        gen.reset(insn->dest());
+        kill.set(insn->dest());
+      }
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        gen.set(insn->src(i));
+      }
+    }
+  }
+}
+
+namespace {
+
+size_t count_defs(const cfg::ControlFlowGraph& cfg,
+                  std::vector<size_t>* reg_starts) {
+  reg_starts->assign(cfg.get_registers_size() + 1, 0);
+  size_t num_defs = 0;
+  for (auto b : cfg.blocks()) {
+    for (const auto& mie : InstructionIterable(b)) {
+      if (mie.insn->has_dest()) {
+        ++(*reg_starts)[mie.insn->dest() + 1];
+        ++num_defs;
+      }
+    }
+  }
+  for (size_t r = 1; r < reg_starts->size(); ++r) {
+    (*reg_starts)[r] += (*reg_starts)[r - 1];
+  }
+  return num_defs;
+}
+
+} // namespace
+
+ReachingDefinitions::ReachingDefinitions(const cfg::ControlFlowGraph& cfg)
+    : m_solver(cfg, Direction::FORWARD, count_defs(cfg, &m_reg_starts)) {
+  m_defs.resize(m_solver.num_facts());
+  m_def_indices.reserve(m_solver.num_facts());
+  auto next_def = m_reg_starts;
+  for (auto b : cfg.blocks()) {
+    auto& gen = m_solver.gen(b);
+    auto& kill = m_solver.kill(b);
+    for (const auto& mie : InstructionIterable(b)) {
+      auto insn = mie.insn;
+      if (!insn->has_dest()) {
+        continue;
+      }
+      auto reg = insn->dest();
+      auto def = next_def[reg]++;
+      m_defs[def] = insn;
+      m_def_indices.emplace(insn, def);
+      kill_and_gen(def, &gen);
+      kill.set(m_reg_starts[reg], m_reg_starts[reg + 1] - m_reg_starts[reg]);
+    }
+  }
+}
+
+void ReachingDefinitions::kill_and_gen(size_t def, BitVector* defs) const {
+  auto reg = m_defs[def]->dest();
+  defs->reset(m_reg_starts[reg], m_reg_starts[reg + 1] - m_reg_starts[reg]);
+  defs->set(def);
+}
+
+void ReachingDefinitions::analyze_instruction(const IRInstruction* insn,
+                                              BitVector* defs) const {
+  if (insn->has_dest()) {
+    kill_and_gen(m_def_indices.at(insn), defs);
+  }
+}
+
+std::vector<IRInstruction*> ReachingDefinitions::get_defs(
+    const BitVector& defs, reg_t reg) const {
+  std::vector<IRInstruction*> result;
+  auto end = m_reg_starts[reg + 1];
+  auto def = m_reg_starts[reg] == 0 ? defs.find_first()
+                                    : defs.find_next(m_reg_starts[reg] - 1);
+  for (; def < end; def = defs.find_next(def)) {
+    result.push_back(m_defs[def]);
+  }
+  return result;
+}
+
+} // namespace bitvector_dataflow
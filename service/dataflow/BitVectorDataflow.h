@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/dynamic_bitset.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+
+namespace bitvector_dataflow {
+
+using BitVector = boost::dynamic_bitset<>;
+
+enum class Direction { FORWARD, BACKWARD };
+
+/*
+ * A solver for gen/kill dataflow problems over facts that can be numbered
+ * densely, like the registers of a method or its definitions. The state of a
+ * block is a bit vector, so that both the transfer function of a block
+ *
+ *   out = gen | (in & ~kill)
+ *
+ * and the union of the states of its neighbours are word-wide operations,
+ * instead of the tree operations of the sparta set domains.
+ *
+ * `in` and `out` follow the direction of the analysis: the `in` state of a
+ * block in a backwards analysis is its state at the end of the block. The
+ * get_*_state_at() accessors are in program order.
+ */
+class GenKillSolver {
+ public:
+  GenKillSolver(const cfg::ControlFlowGraph& cfg,
+                Direction direction,
+                size_t num_facts);
+
+  // The summary of each block; to be filled in before solve().
+  BitVector& gen(const cfg::Block* block) { return state(block).gen; }
+  BitVector& kill(const cfg::Block* block) { return state(block).kill; }
+
+  void solve();
+
+  const BitVector& get_entry_state_at(const cfg::Block* block) const {
+    const auto& s = state(block);
+    return m_direction == Direction::FORWARD ? s.in : s.out;
+  }
+
+  const BitVector& get_exit_state_at(const cfg::Block* block) const {
+    const auto& s = state(block);
+    return m_direction == Direction::FORWARD ? s.out : s.in;
+  }
+
+  size_t num_facts() const { return m_num_facts; }
+
+ private:
+  struct BlockState {
+    BitVector gen;
+    BitVector kill;
+    BitVector in;
+    BitVector out;
+  };
+
+  BlockState& state(const cfg::Block* block) { return m_states[block->id()]; }
+  const BlockState& state(const cfg::Block* block) const {
+    return m_states[block->id()];
+  }
+
+  const cfg::ControlFlowGraph& m_cfg;
+  Direction m_direction;
+  size_t m_num_facts;
+  // Indexed by block id, which are dense.
+  std::vector<BlockState> m_states;
+};
+
+/*
+ * The analysis of LivenessFixpointIterator on bit vectors indexed by register,
+ * for the methods where the dense representation pays off, i.e. the ones with
+ * many registers and blocks.
+ */
+class Liveness {
+ public:
+  explicit Liveness(const cfg::ControlFlowGraph& cfg);
+
+  void run() { m_solver.solve(); }
+
+  static void analyze_instruction(const IRInstruction* insn,
+                                  BitVector* live) {
+    if (insn->has_dest()) {
+      live->reset(insn->dest());
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      live->set(insn->src(i));
+    }
+  }
+
+  const BitVector& get_live_in_vars_at(const cfg::Block* block) const {
+    return m_solver.get_entry_state_at(block);
+  }
+
+  const BitVector& get_live_out_vars_at(const cfg::Block* block) const {
+    return m_solver.get_exit_state_at(block);
+  }
+
+ private:
+  GenKillSolver m_solver;
+};
+
+/*
+ * The analysis of reaching_defs::FixpointIterator on bit vectors indexed by
+ * definition. The definitions of each register are numbered consecutively, so
+ * that both killing them and looking them up only touch the words of their
+ * own range.
+ */
+class ReachingDefinitions {
+ public:
+  explicit ReachingDefinitions(const cfg::ControlFlowGraph& cfg);
+
+  void run() { m_solver.solve(); }
+
+  void analyze_instruction(const IRInstruction* insn, BitVector* defs) const;
+
+  const BitVector& get_entry_state_at(const cfg::Block* block) const {
+    return m_solver.get_entry_state_at(block);
+  }
+
+  const BitVector& get_exit_state_at(const cfg::Block* block) const {
+    return m_solver.get_exit_state_at(block);
+  }
+
+  // The definitions of `reg` in the state `defs`.
+  std::vector<IRInstruction*> get_defs(const BitVector& defs, reg_t reg) const;
+
+ private:
+  // A definition, by the index of its fact, kills the range of its register.
+  void kill_and_gen(size_t def, BitVector* defs) const;
+
+  std::vector<IRInstruction*> m_defs;
+  std::unordered_map<const IRInstruction*, size_t> m_def_indices;
+  // The definitions of register r are in [m_reg_starts[r],
+  // m_reg_starts[r + 1]).
+  std::vector<size_t> m_reg_starts;
+  GenKillSolver m_solver;
+};
+
+} // namespace bitvector_dataflow
@@ -10,9 +10,10 @@
 #include <boost/pending/disjoint_sets.hpp>
 #include <boost/property_map/property_map.hpp>
 
+#include "BitVectorDataflow.h"
 #include "ControlFlow.h"
 #include "IRCode.h"
-#include "ReachingDefinitions.h"
+#include "PatriciaTreeSet.h"
 
 namespace {
 
@@ -75,22 +76,26 @@ void unify_defs(const UDChains& chains, DefSets* def_sets) {
 }
 
 UDChains calculate_ud_chains(const cfg::ControlFlowGraph& cfg) {
-  reaching_defs::FixpointIterator fixpoint_iter{cfg};
-  fixpoint_iter.run(reaching_defs::Environment());
+  // This runs on every method during register allocation, so it uses the
+  // dense reaching definitions.
+  bitvector_dataflow::ReachingDefinitions fixpoint_iter{cfg};
+  fixpoint_iter.run();
   UDChains chains;
   for (cfg::Block* block : cfg.blocks()) {
-    reaching_defs::Environment defs_in =
-        fixpoint_iter.get_entry_state_at(block);
+    auto defs_in = fixpoint_iter.get_entry_state_at(block);
     for (const auto& mie : InstructionIterable(block)) {
       auto insn = mie.insn;
       for (size_t i = 0; i < insn->srcs_size(); ++i) {
         auto src = insn->src(i);
         Use use{insn, src};
-        auto defs = defs_in.get(src);
-        always_assert_log(!defs.is_top() && defs.size() > 0,
+        auto defs = fixpoint_iter.get_defs(defs_in, src);
+        always_assert_log(!defs.empty(),
                           "Found use without def when processing [0x%lx]%s",
                           &mie, SHOW(insn));
-        chains[use] = defs.elements();
+        auto& chain = chains[use];
+        for (auto def : defs) {
+          chain.insert(def);
+        }
       }
       fixpoint_iter.analyze_instruction(insn, &defs_in);
     }
@@ -47,6 +47,8 @@
 
 #include "DedupBlocks.h"
 
+#include <boost/functional/hash.hpp>
+
 #include "Liveness.h"
 #include "ReachingDefinitions.h"
 #include "TypeInference.h"
@@ -95,12 +97,30 @@ struct BlocksInSameGroup {
   }
 };
 
+using CodeHashes = std::unordered_map<cfg::Block*, hash_t>;
+
+// Hashes the code of a block along with the shape of its successors, which
+// is what BlocksInSameGroup compares. The code hash is memoized, as it is
+// needed again in every round of deduplication while most blocks don't
+// change.
 struct BlockHasher {
+  CodeHashes* code_hashes;
+
   hash_t operator()(cfg::Block* b) const {
-    hash_t result = 0;
-    for (auto& mie : InstructionIterable(b)) {
-      result ^= mie.insn->hash();
+    auto it = code_hashes->find(b);
+    if (it == code_hashes->end()) {
+      it = code_hashes->emplace(b, dedup_blocks_impl::hash_block_code(b)).first;
     }
+    hash_t result = it->second;
+    // Successors are compared as a set, so combine them commutatively.
+    hash_t succs = 0;
+    for (const auto& succ : b->succs()) {
+      hash_t edge = succ->target()->id();
+      boost::hash_combine(edge, succ->type());
+      succs += edge;
+    }
+    boost::hash_combine(result, succs);
+    boost::hash_combine(result, b->is_catch());
     return result;
   }
 };
@@ -157,8 +177,8 @@ namespace dedup_blocks_impl {
 
 class DedupBlocksImpl {
  public:
-  DedupBlocksImpl(const Config& config, Stats& stats)
-      : m_config(config), m_stats(stats) {}
+  DedupBlocksImpl(const Config& config, Stats& stats, CodeHashes& code_hashes)
+      : m_config(config), m_stats(stats), m_code_hashes(code_hashes) {}
 
   // Dedup blocks that are exactly the same
   bool dedup(DexMethod* method, cfg::ControlFlowGraph& cfg) {
@@ -226,11 +246,12 @@ class DedupBlocksImpl {
                                                   SuccBlocksInSameGroup>;
   const Config& m_config;
   Stats& m_stats;
+  CodeHashes& m_code_hashes;
 
   // Find blocks with the same exact code
   Duplicates collect_duplicates(DexMethod* method, cfg::ControlFlowGraph& cfg) {
     const auto& blocks = cfg.blocks();
-    Duplicates duplicates;
+    Duplicates duplicates(blocks.size(), BlockHasher{&m_code_hashes});
 
     for (cfg::Block* block : blocks) {
       if (is_eligible(block)) {
@@ -270,6 +291,7 @@ class DedupBlocksImpl {
       if (block != canon) {
         always_assert(canon->id() < block->id());
 
+        m_code_hashes.erase(block);
         cfg.replace_block(block, canon);
         ++m_stats.blocks_removed;
       }
@@ -580,6 +602,7 @@ class DedupBlocksImpl {
         }
 
         // Split the block
+        m_code_hashes.erase(block);
         auto split_block =
             cfg.split_block(block->to_cfg_instruction_iterator(fwd_it));
         TRACE(DEDUP_BLOCKS, 4,
@@ -953,7 +976,8 @@ class DedupBlocksImpl {
   static void print_dups(const Duplicates& dups) {
     TRACE(DEDUP_BLOCKS, 4, "duplicate blocks set: {");
     for (const auto& entry : dups) {
-      TRACE(DEDUP_BLOCKS, 4, "  hash = %lu", BlockHasher{}(entry.first));
+      TRACE(DEDUP_BLOCKS, 4, "  hash = %lu",
+            dups.hash_function()(entry.first));
       for (cfg::Block* b : entry.second) {
         TRACE(DEDUP_BLOCKS, 4, "    block %d", b->id());
         for (const MethodItemEntry& mie : *b) {
@@ -968,8 +992,16 @@ class DedupBlocksImpl {
 DedupBlocks::DedupBlocks(const Config& config, DexMethod* method)
     : m_config(config), m_method(method) {}
 
+size_t hash_block_code(cfg::Block* block) {
+  hash_t result = 0;
+  for (auto& mie : InstructionIterable(block)) {
+    boost::hash_combine(result, mie.insn->hash());
+  }
+  return result;
+}
+
 void DedupBlocks::run() {
-  DedupBlocksImpl impl(m_config, m_stats);
+  DedupBlocksImpl impl(m_config, m_stats, m_code_hashes);
   auto& cfg = m_method->get_code()->cfg();
   do {
     if (m_config.split_postfix) {
@@ -978,6 +1010,22 @@ void DedupBlocks::run() {
   } while (impl.dedup(m_method, cfg));
 }
 
+std::vector<std::pair<size_t, size_t>> DedupBlocks::get_block_hashes(
+    size_t min_opcode_count) {
+  std::vector<std::pair<size_t, size_t>> hashes;
+  for (cfg::Block* block : m_method->get_code()->cfg().blocks()) {
+    auto opcodes = block->num_opcodes();
+    if (opcodes < min_opcode_count) {
+      continue;
+    }
+    auto it = m_code_hashes.find(block);
+    hashes.emplace_back(
+        it != m_code_hashes.end() ? it->second : hash_block_code(block),
+        opcodes);
+  }
+  return hashes;
+}
+
 Stats& Stats::operator+=(const Stats& that) {
   eligible_blocks += that.eligible_blocks;
   blocks_removed += that.blocks_removed;
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ControlFlow.h"
 #include "DexClass.h"
 
 namespace dedup_blocks_impl {
@@ -29,6 +30,13 @@ struct Stats {
   Stats& operator+=(const Stats& that);
 };
 
+/*
+ * A hash of the instructions of a block that only depends on their opcodes
+ * and operands, in order. Blocks with the same code have the same hash no
+ * matter which method they are in.
+ */
+size_t hash_block_code(cfg::Block* block);
+
 class DedupBlocks {
  public:
   DedupBlocks(const Config& config, DexMethod* method);
@@ -37,10 +45,21 @@ class DedupBlocks {
 
   void run();
 
+  /*
+   * The code hashes and opcode counts of the blocks of the method with at
+   * least `min_opcode_count` opcodes, for finding duplicates across methods.
+   * Must be called before the CFG of the method is cleared.
+   */
+  std::vector<std::pair<size_t, size_t>> get_block_hashes(
+      size_t min_opcode_count);
+
  private:
   const Config& m_config;
   DexMethod* m_method;
   Stats m_stats;
+  // The code hashes of the blocks, kept across the rounds of run() and
+  // dropped whenever the instructions of a block change.
+  std::unordered_map<cfg::Block*, size_t> m_code_hashes;
 };
 
 } // namespace dedup_blocks_impl
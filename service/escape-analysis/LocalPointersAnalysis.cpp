@@ -7,8 +7,12 @@
 
 #include "LocalPointersAnalysis.h"
 
+#include <atomic>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
 #include "DexUtil.h"
-#include "PatriciaTreeSet.h"
 #include "Resolver.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
@@ -384,43 +388,186 @@ void FixpointIteratorMapDeleter::operator()(FixpointIteratorMap* map) {
   wq.run_all();
 }
 
-static void analyze_method_recursive(
-    const DexMethod* method,
-    const call_graph::Graph& call_graph,
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting,
-    FixpointIteratorMap* fp_iter_map,
-    SummaryCMap* summary_map) {
-  if (summary_map->count(method) != 0 || visiting.contains(method) ||
-      method->get_code() == nullptr) {
-    return;
-  }
-  visiting.insert(method);
+namespace {
 
-  std::unordered_map<const IRInstruction*, EscapeSummary> invoke_to_summary_map;
+/*
+ * The methods to analyze, grouped by the strongly connected components of the
+ * call graph that they belong to, callees first.
+ */
+struct CallGraphSCCs {
+  std::vector<std::vector<const DexMethod*>> sccs;
+  std::unordered_map<const DexMethod*, size_t> scc_of;
+};
+
+std::vector<std::pair<const call_graph::Edge*, const DexMethod*>>
+get_callee_edges(const call_graph::Graph& call_graph, const DexMethod* method) {
+  std::vector<std::pair<const call_graph::Edge*, const DexMethod*>> edges;
   if (call_graph.has_node(method)) {
-    const auto& callee_edges = call_graph.node(method).callees();
-    for (const auto& edge : callee_edges) {
-      auto* callee = edge->callee();
-      analyze_method_recursive(callee, call_graph, visiting, fp_iter_map,
-                               summary_map);
-      if (summary_map->count(callee) != 0) {
-        invoke_to_summary_map.emplace(edge->invoke_iterator()->insn,
-                                      summary_map->at(callee));
+    for (const auto& edge : call_graph.node(method).callees()) {
+      edges.emplace_back(edge.get(), edge->callee());
+    }
+  }
+  return edges;
+}
+
+/*
+ * Tarjan's algorithm, over the methods that are reachable from `roots`, have
+ * code, and don't already have a summary. It emits the SCCs of a graph in
+ * reverse topological order.
+ */
+CallGraphSCCs find_sccs(const std::vector<const DexMethod*>& roots,
+                        const call_graph::Graph& call_graph,
+                        const SummaryCMap& summary_map) {
+  CallGraphSCCs result;
+  auto needs_analysis = [&](const DexMethod* method) {
+    return method != nullptr && method->get_code() != nullptr &&
+           summary_map.count(method) == 0;
+  };
+  struct Frame {
+    const DexMethod* method;
+    std::vector<std::pair<const call_graph::Edge*, const DexMethod*>> callees;
+    size_t next_callee;
+  };
+  std::unordered_map<const DexMethod*, size_t> index;
+  std::unordered_map<const DexMethod*, size_t> low_link;
+  std::unordered_set<const DexMethod*> on_stack;
+  std::vector<const DexMethod*> stack;
+  std::vector<Frame> frames;
+  auto visit = [&](const DexMethod* method) {
+    index.emplace(method, index.size());
+    low_link.emplace(method, index.at(method));
+    stack.push_back(method);
+    on_stack.insert(method);
+    frames.push_back(Frame{method, get_callee_edges(call_graph, method), 0});
+  };
+  for (auto* root : roots) {
+    if (!needs_analysis(root) || index.count(root)) {
+      continue;
+    }
+    visit(root);
+    while (!frames.empty()) {
+      auto& frame = frames.back();
+      if (frame.next_callee < frame.callees.size()) {
+        auto* callee = frame.callees[frame.next_callee++].second;
+        if (!needs_analysis(callee)) {
+          continue;
+        }
+        if (!index.count(callee)) {
+          visit(callee);
+        } else if (on_stack.count(callee)) {
+          auto& link = low_link.at(frame.method);
+          link = std::min(link, index.at(callee));
+        }
+        continue;
+      }
+      auto* method = frame.method;
+      frames.pop_back();
+      if (!frames.empty()) {
+        auto& link = low_link.at(frames.back().method);
+        link = std::min(link, low_link.at(method));
       }
+      if (low_link.at(method) != index.at(method)) {
+        continue;
+      }
+      std::vector<const DexMethod*> scc;
+      const DexMethod* member;
+      do {
+        member = stack.back();
+        stack.pop_back();
+        on_stack.erase(member);
+        result.scc_of.emplace(member, result.sccs.size());
+        scc.push_back(member);
+      } while (member != method);
+      result.sccs.push_back(std::move(scc));
     }
   }
+  return result;
+}
+
+// Returns whether `into` changed.
+bool join_summary(const EscapeSummary& from, EscapeSummary* into) {
+  bool changed = false;
+  for (auto idx : from.escaping_parameters) {
+    changed |= into->escaping_parameters.insert(idx).second;
+  }
+  if (!from.returned_parameters.leq(into->returned_parameters)) {
+    into->returned_parameters.join_with(from.returned_parameters);
+    changed = true;
+  }
+  return changed;
+}
 
-  auto* code = method->get_code();
-  auto& cfg = code->cfg();
-  auto fp_iter = new FixpointIterator(cfg, std::move(invoke_to_summary_map));
-  fp_iter->run(Environment());
-  fp_iter_map->emplace(method, fp_iter);
-  summary_map->emplace(method, get_escape_summary(*fp_iter, *code));
+/*
+ * Analyzes the methods of an SCC, once the summaries of all the SCCs that it
+ * calls are available. The summaries of the methods of the SCC start at
+ * bottom, and the methods are analyzed again whenever the summary of one of
+ * their callees in the SCC grows, until they are all stable.
+ */
+void analyze_scc(const std::vector<const DexMethod*>& scc,
+                 const CallGraphSCCs& sccs,
+                 size_t scc_idx,
+                 const call_graph::Graph& call_graph,
+                 FixpointIteratorMap* fp_iter_map,
+                 SummaryCMap* summary_map,
+                 bool escape_check_cast) {
+  std::unordered_map<const DexMethod*, EscapeSummary> scc_summaries;
+  std::unordered_map<const DexMethod*, std::unique_ptr<FixpointIterator>>
+      fp_iters;
+  for (auto* method : scc) {
+    scc_summaries[method].returned_parameters.set_to_bottom();
+  }
+  auto in_scc = [&](const DexMethod* method) {
+    auto it = sccs.scc_of.find(method);
+    return it != sccs.scc_of.end() && it->second == scc_idx;
+  };
+  std::vector<const DexMethod*> worklist(scc.rbegin(), scc.rend());
+  std::unordered_set<const DexMethod*> in_worklist(scc.begin(), scc.end());
+  while (!worklist.empty()) {
+    auto* method = worklist.back();
+    worklist.pop_back();
+    in_worklist.erase(method);
+
+    InvokeToSummaryMap invoke_to_summary_map;
+    for (const auto& pair : get_callee_edges(call_graph, method)) {
+      auto* callee = pair.second;
+      auto insn = pair.first->invoke_iterator()->insn;
+      if (in_scc(callee)) {
+        invoke_to_summary_map.emplace(insn, scc_summaries.at(callee));
+      } else if (summary_map->count(callee) != 0) {
+        invoke_to_summary_map.emplace(insn, summary_map->at(callee));
+      }
+    }
+    auto* code = method->get_code();
+    auto fp_iter = std::make_unique<FixpointIterator>(
+        code->cfg(), std::move(invoke_to_summary_map), escape_check_cast);
+    fp_iter->run(Environment());
+    auto summary = get_escape_summary(*fp_iter, *code);
+    fp_iters[method] = std::move(fp_iter);
+    if (!join_summary(summary, &scc_summaries.at(method))) {
+      continue;
+    }
+    if (!call_graph.has_node(method)) {
+      continue;
+    }
+    for (const auto& edge : call_graph.node(method).callers()) {
+      auto* caller = edge->caller();
+      if (in_scc(caller) && in_worklist.insert(caller).second) {
+        worklist.push_back(caller);
+      }
+    }
+  }
+  for (auto* method : scc) {
+    fp_iter_map->emplace(method, fp_iters.at(method).release());
+    summary_map->emplace(method, scc_summaries.at(method));
+  }
 }
 
+} // namespace
+
 FixpointIteratorMapPtr analyze_scope(const Scope& scope,
                                      const call_graph::Graph& call_graph,
-                                     SummaryCMap* summary_map_ptr) {
+                                     SummaryCMap* summary_map_ptr,
+                                     bool escape_check_cast) {
   FixpointIteratorMapPtr fp_iter_map(new FixpointIteratorMap());
   SummaryCMap summary_map;
   if (summary_map_ptr == nullptr) {
@@ -429,11 +576,47 @@ FixpointIteratorMapPtr analyze_scope(const Scope& scope,
   summary_map_ptr->emplace(
       DexMethod::get_method("Ljava/lang/Object;.<init>:()V"), EscapeSummary{});
 
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting;
-    analyze_method_recursive(method, call_graph, visiting, fp_iter_map.get(),
-                             summary_map_ptr);
+  std::vector<const DexMethod*> roots;
+  walk::code(scope, [&](const DexMethod* method, IRCode&) {
+    roots.push_back(method);
   });
+  auto sccs = find_sccs(roots, call_graph, *summary_map_ptr);
+
+  // An SCC is ready to be analyzed once all the SCCs it calls are done.
+  std::vector<std::atomic<size_t>> num_pending_callees(sccs.sccs.size());
+  std::vector<std::vector<size_t>> caller_sccs(sccs.sccs.size());
+  for (size_t i = 0; i < sccs.sccs.size(); ++i) {
+    std::unordered_set<size_t> callee_sccs;
+    for (auto* method : sccs.sccs[i]) {
+      for (const auto& pair : get_callee_edges(call_graph, method)) {
+        auto it = sccs.scc_of.find(pair.second);
+        if (it != sccs.scc_of.end() && it->second != i) {
+          callee_sccs.insert(it->second);
+        }
+      }
+    }
+    num_pending_callees[i] = callee_sccs.size();
+    for (auto callee_scc : callee_sccs) {
+      caller_sccs[callee_scc].push_back(i);
+    }
+  }
+  auto wq = WorkQueue<size_t>(
+      [&](WorkerState<size_t>* worker_state, size_t scc_idx) {
+        analyze_scc(sccs.sccs[scc_idx], sccs, scc_idx, call_graph,
+                    fp_iter_map.get(), summary_map_ptr, escape_check_cast);
+        for (auto caller_scc : caller_sccs[scc_idx]) {
+          if (--num_pending_callees[caller_scc] == 0) {
+            worker_state->push_task(caller_scc);
+          }
+        }
+      },
+      redex_parallel::default_num_threads());
+  for (size_t i = 0; i < sccs.sccs.size(); ++i) {
+    if (num_pending_callees[i] == 0) {
+      wq.add_item(i);
+    }
+  }
+  wq.run_all();
   return fp_iter_map;
 }
 
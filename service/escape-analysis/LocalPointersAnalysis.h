@@ -283,14 +283,23 @@ using SummaryCMap = ConcurrentMap<const DexMethodRef*, EscapeSummary>;
 
 /*
  * Analyze all methods in scope, making sure to analyze the callees before
- * their callers.
+ * their callers. The strongly connected components of the call graph are
+ * analyzed in parallel once all the components they call are done; the
+ * methods within a component are analyzed until their summaries are stable.
+ *
+ * Methods that already have a summary in the SummaryCMap are not analyzed
+ * again, so summaries computed by an earlier run can be passed back in.
  *
  * If a non-null SummaryCMap pointer is passed in, it will get populated
  * with the escape summaries of the methods in scope.
+ *
+ * The methods are analyzed with `escape_check_cast` as described for the
+ * FixpointIterator above.
  */
 FixpointIteratorMapPtr analyze_scope(const Scope&,
                                      const call_graph::Graph&,
-                                     SummaryCMap* = nullptr);
+                                     SummaryCMap* = nullptr,
+                                     bool escape_check_cast = false);
 
 /*
  * Join over all possible returned and thrown values.
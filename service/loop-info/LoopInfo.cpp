@@ -112,18 +112,13 @@ Loop::subloop_iterator Loop::subloop_end() { return m_subloops.end(); }
  */
 LoopInfo::LoopInfo(cfg::ControlFlowGraph& cfg) {
 
-  sparta::WeakTopologicalOrdering<cfg::Block*> wto(
-      cfg.entry_block(), [&](const cfg::Block* block) {
-        std::vector<cfg::Block*> blocks;
-        for (auto edge : block->succs()) {
-          blocks.emplace_back(edge->target());
-        }
-        return blocks;
-      });
+  // Adding the preheaders below drops the cached WTO from the CFG, but not
+  // while we hold on to it.
+  auto wto = cfg.wto();
 
   // construct a level order traversal of a weak topological ordering
   std::vector<ComponentWrapper<cfg::Block*>> level_order;
-  construct_level_order_traversal<cfg::Block*>(level_order, wto);
+  construct_level_order_traversal<cfg::Block*>(level_order, *wto);
 
   // Mapping from all blocks that are loop headers and their respective Loop
   // object
@@ -7,40 +7,68 @@
 
 #include "MethodDedup.h"
 
+#include <boost/functional/hash.hpp>
+
 #include "IRCode.h"
 #include "MethodReference.h"
+#include "WorkQueue.h"
 
 namespace {
 
+// Below this many methods, hashing in parallel costs more than it saves.
+constexpr size_t MIN_METHODS_TO_HASH_IN_PARALLEL = 1000;
+
 struct CodeAsKey {
   IRCode* code;
+  size_t hash;
 
-  explicit CodeAsKey(IRCode* c) : code(c) {}
+  CodeAsKey(IRCode* c, size_t h) : code(c), hash(h) {}
 
   bool operator==(const CodeAsKey& other) const {
-    return code->structural_equals(*other.code);
+    return hash == other.hash && code->structural_equals(*other.code);
   }
 };
 
 struct CodeHasher {
-  size_t operator()(const CodeAsKey& key) const {
-    size_t result = 0;
-    for (auto& mie : InstructionIterable(key.code)) {
-      result ^= mie.insn->hash();
-    }
-    return result;
-  }
+  size_t operator()(const CodeAsKey& key) const { return key.hash; }
 };
 
 using DuplicateMethods =
     std::unordered_map<CodeAsKey, MethodOrderedSet, CodeHasher>;
+using CodeHashes = std::unordered_map<const DexMethod*, size_t>;
+
+CodeHashes hash_methods(const std::vector<DexMethod*>& methods) {
+  std::vector<size_t> hashes(methods.size());
+  auto hash_method = [&](size_t i) {
+    always_assert(methods[i]->get_code());
+    hashes[i] = method_dedup::hash_code(methods[i]->get_code());
+  };
+  if (methods.size() < MIN_METHODS_TO_HASH_IN_PARALLEL) {
+    for (size_t i = 0; i < methods.size(); ++i) {
+      hash_method(i);
+    }
+  } else {
+    auto wq = workqueue_foreach<size_t>(hash_method);
+    for (size_t i = 0; i < methods.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+  CodeHashes result;
+  result.reserve(methods.size());
+  for (size_t i = 0; i < methods.size(); ++i) {
+    result.emplace(methods[i], hashes[i]);
+  }
+  return result;
+}
 
 std::vector<MethodOrderedSet> get_duplicate_methods_simple(
-    const MethodOrderedSet& methods) {
+    const MethodOrderedSet& methods, const CodeHashes& hashes) {
   DuplicateMethods duplicates;
   for (DexMethod* method : methods) {
     always_assert(method->get_code());
-    duplicates[CodeAsKey(method->get_code())].emplace(method);
+    duplicates[CodeAsKey(method->get_code(), hashes.at(method))].emplace(
+        method);
   }
 
   std::vector<MethodOrderedSet> result;
@@ -55,6 +83,14 @@ std::vector<MethodOrderedSet> get_duplicate_methods_simple(
 
 namespace method_dedup {
 
+size_t hash_code(IRCode* code) {
+  size_t result = 0;
+  for (auto& mie : InstructionIterable(code)) {
+    boost::hash_combine(result, mie.insn->hash());
+  }
+  return result;
+}
+
 std::vector<MethodOrderedSet> group_similar_methods(
     const std::vector<DexMethod*>& methods) {
 
@@ -88,11 +124,12 @@ std::vector<MethodOrderedSet> group_identical_methods(
     const std::vector<DexMethod*>& methods) {
   std::vector<MethodOrderedSet> result;
   std::vector<MethodOrderedSet> same_protos = group_similar_methods(methods);
+  auto hashes = hash_methods(methods);
 
   // Find actual duplicates.
   for (const auto& same_proto : same_protos) {
     std::vector<MethodOrderedSet> duplicates =
-        get_duplicate_methods_simple(same_proto);
+        get_duplicate_methods_simple(same_proto, hashes);
 
     result.insert(result.end(), duplicates.begin(), duplicates.end());
   }
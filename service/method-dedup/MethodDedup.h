@@ -26,9 +26,17 @@ namespace method_dedup {
 std::vector<MethodOrderedSet> group_similar_methods(
     const std::vector<DexMethod*>&);
 
+/**
+ * A hash of the opcodes and operands of the code, in order. Code that is
+ * structurally equal has the same hash, debug info and positions aside.
+ */
+size_t hash_code(IRCode* code);
+
 /**
  * Group methods that are identical in that they share the same signature and
  * identical code. We ignore non-opcodes like debug info.
+ * The code of each method is hashed once, in parallel for large inputs, and
+ * the code is only compared when the hashes match.
  * Note that there's no side affects other than the grouping here.
  */
 std::vector<MethodOrderedSet> group_identical_methods(
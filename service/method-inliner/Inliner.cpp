@@ -179,6 +179,10 @@ MultiMethodInliner::MultiMethodInliner(
     }
   }
 
+  if (budgeted_for_speed()) {
+    m_budget_method_profile_stats = method_profile_stats;
+  }
+
   m_shrinking_enabled = m_config.run_const_prop || m_config.run_cse ||
                         m_config.run_copy_prop || m_config.run_local_dce ||
                         m_config.run_dedup_blocks;
@@ -189,6 +193,44 @@ MultiMethodInliner::MultiMethodInliner(
   }
 }
 
+void MultiMethodInliner::select_callsites_within_budget() {
+  Timer t("select_callsites_within_budget");
+  std::vector<inline_for_speed::CallsiteCandidate> candidates;
+  for (const auto& p : caller_callee) {
+    auto caller = p.first;
+    if (!m_budget_method_profile_stats.count(caller)) {
+      continue;
+    }
+    std::unordered_map<const DexMethod*, size_t> calls;
+    for (auto callee : p.second) {
+      ++calls[callee];
+    }
+    for (const auto& q : calls) {
+      auto callee = q.first;
+      if (!m_budget_method_profile_stats.count(callee) ||
+          !inline_for_speed::can_inline_for_speed(caller, callee)) {
+        continue;
+      }
+      candidates.push_back({caller, callee, q.second,
+                            get_inlined_cost(callee) * q.second});
+    }
+  }
+  // The candidates are gathered in the order of caller_callee, but the calls
+  // map isn't ordered. Sort them so that ties are broken deterministically.
+  std::sort(candidates.begin(), candidates.end(),
+            [](const inline_for_speed::CallsiteCandidate& a,
+               const inline_for_speed::CallsiteCandidate& b) {
+              if (a.caller != b.caller) {
+                return compare_dexmethods(a.caller, b.caller);
+              }
+              return compare_dexmethods(a.callee, b.callee);
+            });
+  m_budget_selection = inline_for_speed::select_within_budget(
+      candidates, m_budget_method_profile_stats, m_config.speed_inline_budget,
+      &info.speed_budget_spent);
+  info.speed_budget_callers = m_budget_selection.size();
+}
+
 /*
  * The key of a constant-arguments data structure is a string representation
  * that approximates the constant arguments.
@@ -265,18 +307,17 @@ void MultiMethodInliner::compute_callee_constant_arguments() {
 }
 
 void MultiMethodInliner::inline_methods() {
+  ScopedTraceEvent trace_event("MultiMethodInliner::inline_methods");
   compute_callee_constant_arguments();
+  if (budgeted_for_speed()) {
+    select_callsites_within_budget();
+  }
 
   // Inlining and shrinking initiated from within this method will be done
   // in parallel.
   m_async_method_executor.set_num_threads(
       m_config.debug ? 1 : redex_parallel::default_num_threads());
 
-  // The order in which we inline is such that once a callee is considered to
-  // be inlined, it's code will no longer change. So we can cache its size.
-  m_callee_insn_sizes =
-      std::make_unique<ConcurrentMap<const DexMethod*, size_t>>();
-
   // Instead of changing visibility as we inline, blocking other work on the
   // critical path, we do it all in parallel at the end.
   m_delayed_change_visibilities = std::make_unique<
@@ -417,6 +458,11 @@ size_t MultiMethodInliner::compute_caller_nonrecursive_callees_by_stack_depth(
 
     if (!for_speed()) {
       nonrecursive_callees.push_back(callee);
+    } else if (budgeted_for_speed()) {
+      auto it = m_budget_selection.find(caller);
+      if (it != m_budget_selection.end() && it->second.count(callee)) {
+        nonrecursive_callees.push_back(callee);
+      }
     } else if (inline_for_speed::should_inline(caller, callee, m_hot_methods)) {
       TRACE(METH_PROF, 3, "%s, %s", SHOW(caller), SHOW(callee));
       nonrecursive_callees.push_back(callee);
@@ -435,6 +481,7 @@ size_t MultiMethodInliner::compute_caller_nonrecursive_callees_by_stack_depth(
 
 void MultiMethodInliner::caller_inline(
     DexMethod* caller, const std::vector<DexMethod*>& nonrecursive_callees) {
+  ScopedTraceEvent trace_event("MultiMethodInliner::caller_inline");
   // We select callees to inline into this caller
   std::vector<DexMethod*> selected_callees;
   selected_callees.reserve(nonrecursive_callees.size());
@@ -584,6 +631,7 @@ bool MultiMethodInliner::inline_inlinables_need_deconstruct(DexMethod* method) {
 void MultiMethodInliner::inline_inlinables(
     DexMethod* caller_method,
     const std::vector<std::pair<DexMethod*, IRList::iterator>>& inlinables) {
+  ScopedTraceEvent trace_event("MultiMethodInliner::inline_inlinables");
 
   auto caller = caller_method->get_code();
   std::unordered_set<IRCode*> need_deconstruct;
@@ -616,14 +664,30 @@ void MultiMethodInliner::inline_inlinables(
                             get_callee_insn_size(b.first);
                    });
 
+  bool caller_hot = m_hot_methods.count(caller_method) != 0;
+  std::vector<inliner::InlineDecision> decisions;
+  auto record_decision = [&](DexMethod* callee_method,
+                             inliner::RejectReason reject_reason) {
+    if (reject_reason != inliner::RejectReason::NONE) {
+      info.rejected[(size_t)reject_reason]++;
+    }
+    if (m_config.log_inline_decisions) {
+      decisions.push_back({caller_method, callee_method,
+                           get_callee_insn_size(callee_method), caller_hot,
+                           reject_reason});
+    }
+  };
+
   std::vector<DexMethod*> inlined_callees;
   for (const auto& inlinable : ordered_inlinables) {
     auto callee_method = inlinable.first;
     auto callee = callee_method->get_code();
     auto callsite = inlinable.second;
 
+    auto reject_reason = inliner::RejectReason::NONE;
     if (!is_inlinable(caller_method, callee_method, callsite->insn,
-                      estimated_insn_size)) {
+                      estimated_insn_size, &reject_reason)) {
+      record_decision(callee_method, reject_reason);
       continue;
     }
 
@@ -635,6 +699,8 @@ void MultiMethodInliner::inline_inlinables(
       bool success = inliner::inline_with_cfg(caller_method, callee_method,
                                               callsite->insn);
       if (!success) {
+        record_decision(callee_method,
+                        inliner::RejectReason::CFG_INLINER_FAILED);
         continue;
       }
     } else {
@@ -646,12 +712,25 @@ void MultiMethodInliner::inline_inlinables(
       inliner::inline_method_unsafe(caller, callee, callsite);
     }
     TRACE(INL, 2, "caller: %s\tcallee: %s", SHOW(caller), SHOW(callee));
-    estimated_insn_size += get_callee_insn_size(callee_method);
+    auto size_delta = get_callee_insn_size(callee_method);
+    estimated_insn_size += size_delta;
+    info.inlined_size_delta += size_delta;
+    if (caller_hot) {
+      info.hot_calls_inlined++;
+    }
+    record_decision(callee_method, inliner::RejectReason::NONE);
 
     inlined_callees.push_back(callee_method);
   }
 
+  if (!decisions.empty()) {
+    std::lock_guard<std::mutex> guard(m_inline_decisions_mutex);
+    m_inline_decisions.insert(m_inline_decisions.end(), decisions.begin(),
+                              decisions.end());
+  }
+
   if (inlined_callees.size() > 0) {
+    invalidate_callee_costs(caller_method);
     for (auto callee_method : inlined_callees) {
       if (m_delayed_change_visibilities) {
         m_delayed_change_visibilities->update(
@@ -696,6 +775,7 @@ void MultiMethodInliner::async_postprocess_method(DexMethod* method) {
 }
 
 void MultiMethodInliner::shrink_method(DexMethod* method) {
+  ScopedTraceEvent trace_event("MultiMethodInliner::shrink_method");
   auto code = method->get_code();
   bool editable_cfg_built = code->editable_cfg_built();
 
@@ -775,6 +855,8 @@ void MultiMethodInliner::shrink_method(DexMethod* method) {
     code->clear_cfg();
   }
 
+  invalidate_callee_costs(method);
+
   std::lock_guard<std::mutex> guard(m_stats_mutex);
   m_const_prop_stats += const_prop_stats;
   m_cse_stats += cse_stats;
@@ -804,7 +886,8 @@ void MultiMethodInliner::postprocess_method(DexMethod* method) {
     return;
   }
 
-  // This pre-populates the m_should_inline and m_callee_insn_sizes caches.
+  // This pre-populates the m_should_inline and m_callee_costs caches, now that
+  // the code of the callee is final.
   if (should_inline(method)) {
     get_callee_insn_size(method);
   }
@@ -874,34 +957,42 @@ void MultiMethodInliner::decrement_delayed_shrinking_callee_wait_counts(
 bool MultiMethodInliner::is_inlinable(DexMethod* caller,
                                       DexMethod* callee,
                                       const IRInstruction* insn,
-                                      size_t estimated_insn_size) {
+                                      size_t estimated_insn_size,
+                                      inliner::RejectReason* reject_reason) {
+  auto reject = [reject_reason](inliner::RejectReason reason) {
+    if (reject_reason) {
+      *reject_reason = reason;
+    }
+    return false;
+  };
   // don't inline cross store references
   if (cross_store_reference(caller, callee)) {
     if (insn) {
       log_nopt(INL_CROSS_STORE_REFS, caller, insn);
     }
-    return false;
+    return reject(inliner::RejectReason::CROSS_STORE);
   }
   if (is_blacklisted(callee)) {
     if (insn) {
       log_nopt(INL_BLACKLISTED_CALLEE, callee);
     }
-    return false;
+    return reject(inliner::RejectReason::BLACKLISTED_CALLEE);
   }
   if (caller_is_blacklisted(caller)) {
     if (insn) {
       log_nopt(INL_BLACKLISTED_CALLER, caller);
     }
-    return false;
+    return reject(inliner::RejectReason::BLACKLISTED_CALLER);
   }
   if (has_external_catch(callee)) {
     if (insn) {
       log_nopt(INL_EXTERN_CATCH, callee);
     }
-    return false;
+    return reject(inliner::RejectReason::EXTERNAL_CATCH);
   }
   std::vector<DexMethod*> make_static;
-  if (cannot_inline_opcodes(caller, callee, insn, &make_static)) {
+  if (cannot_inline_opcodes(caller, callee, insn, &make_static,
+                            reject_reason)) {
     return false;
   }
   if (!callee->rstate.force_inline()) {
@@ -909,7 +1000,7 @@ bool MultiMethodInliner::is_inlinable(DexMethod* caller,
       if (insn) {
         log_nopt(INL_TOO_BIG, caller, insn);
       }
-      return false;
+      return reject(inliner::RejectReason::CALLER_TOO_LARGE);
     }
 
     // Don't inline code into a method that doesn't have the same (or higher)
@@ -928,14 +1019,14 @@ bool MultiMethodInliner::is_inlinable(DexMethod* caller,
             "              into %s\n because of API boundaries.",
             show_deobfuscated(callee).c_str(),
             show_deobfuscated(caller).c_str());
-      return false;
+      return reject(inliner::RejectReason::REQUIRES_API);
     }
 
     if (callee->rstate.dont_inline()) {
       if (insn) {
         log_nopt(INL_DO_NOT_INLINE, caller, insn);
       }
-      return false;
+      return reject(inliner::RejectReason::DONT_INLINE);
     }
   }
 
@@ -1058,23 +1149,33 @@ bool MultiMethodInliner::should_inline(const DexMethod* callee) {
 }
 
 size_t MultiMethodInliner::get_callee_insn_size(const DexMethod* callee) {
-  if (m_callee_insn_sizes) {
-    auto size = m_callee_insn_sizes->get(callee, 0);
-    if (size != 0) {
-      return size;
-    }
+  auto costs = m_callee_costs.get(callee, CalleeCosts());
+  if (costs.insn_size != 0) {
+    return costs.insn_size;
   }
 
   const IRCode* code = callee->get_code();
   auto size = code->editable_cfg_built() ? code->cfg().sum_opcode_sizes()
                                          : code->sum_opcode_sizes();
   always_assert(size > 0);
-  if (m_callee_insn_sizes) {
-    m_callee_insn_sizes->emplace(callee, size);
-  }
+  m_callee_costs.update(
+      callee, [&](const DexMethod*, CalleeCosts& value, bool /* exists */) {
+        if (value.version == costs.version) {
+          value.insn_size = size;
+        }
+      });
   return size;
 }
 
+void MultiMethodInliner::invalidate_callee_costs(const DexMethod* method) {
+  m_callee_costs.update(
+      method, [](const DexMethod*, CalleeCosts& value, bool /* exists */) {
+        ++value.version;
+        value.insn_size = 0;
+        value.inlined_cost = boost::none;
+      });
+}
+
 /*
  * Estimate additional costs if an instruction takes many source registers.
  */
@@ -1239,9 +1340,9 @@ static InlinedCostAndDeadBlocks get_inlined_cost(
 }
 
 size_t MultiMethodInliner::get_inlined_cost(const DexMethod* callee) {
-  auto opt_inlined_cost = m_inlined_costs.get(callee, boost::none);
-  if (opt_inlined_cost) {
-    return *opt_inlined_cost;
+  auto costs = m_callee_costs.get(callee, CalleeCosts());
+  if (costs.inlined_cost) {
+    return *costs.inlined_cost;
   }
 
   std::atomic<size_t> callees_analyzed{0};
@@ -1296,15 +1397,18 @@ size_t MultiMethodInliner::get_inlined_cost(const DexMethod* callee) {
   }
   TRACE(INLINE, 4, "[too_many_callers] get_inlined_cost %s: %u", SHOW(callee),
         (size_t)inlined_cost);
-  m_inlined_costs.update(
-      callee,
-      [&](const DexMethod*, boost::optional<size_t>& value, bool exists) {
-        if (exists) {
+  m_callee_costs.update(
+      callee, [&](const DexMethod*, CalleeCosts& value, bool /* exists */) {
+        if (value.version != costs.version) {
+          // The code changed while we were computing its cost.
+          return;
+        }
+        if (value.inlined_cost) {
           // We wasted some work, and some other thread beat us. Oh well...
-          always_assert(*value == inlined_cost);
+          always_assert(*value.inlined_cost == inlined_cost);
           return;
         }
-        value = inlined_cost;
+        value.inlined_cost = inlined_cost;
         if (callees_analyzed == 0) {
           return;
         }
@@ -1482,9 +1586,17 @@ bool MultiMethodInliner::cannot_inline_opcodes(
     const DexMethod* caller,
     const DexMethod* callee,
     const IRInstruction* invk_insn,
-    std::vector<DexMethod*>* make_static) {
+    std::vector<DexMethod*>* make_static,
+    inliner::RejectReason* reject_reason) {
   int ret_count = 0;
   bool can_inline = true;
+  auto reject = [reject_reason, &can_inline](inliner::RejectReason reason) {
+    if (reject_reason) {
+      *reject_reason = reason;
+    }
+    can_inline = false;
+    return editable_cfg_adapter::LOOP_BREAK;
+  };
   editable_cfg_adapter::iterate(
       callee->get_code(), [&](const MethodItemEntry& mie) {
         auto insn = mie.insn;
@@ -1492,8 +1604,7 @@ bool MultiMethodInliner::cannot_inline_opcodes(
           if (invk_insn) {
             log_nopt(INL_CREATE_VMETH, caller, invk_insn);
           }
-          can_inline = false;
-          return editable_cfg_adapter::LOOP_BREAK;
+          return reject(inliner::RejectReason::CREATE_VMETHOD);
         }
         // if the caller and callee are in the same class, we don't have to
         // worry about invoke supers, or unknown virtuals -- private /
@@ -1503,32 +1614,27 @@ bool MultiMethodInliner::cannot_inline_opcodes(
             if (invk_insn) {
               log_nopt(INL_HAS_INVOKE_SUPER, caller, invk_insn);
             }
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(inliner::RejectReason::INVOKE_SUPER);
           }
           if (unknown_virtual(insn)) {
             if (invk_insn) {
               log_nopt(INL_UNKNOWN_VIRTUAL, caller, invk_insn);
             }
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(inliner::RejectReason::UNKNOWN_VIRTUAL);
           }
           if (unknown_field(insn)) {
             if (invk_insn) {
               log_nopt(INL_UNKNOWN_FIELD, caller, invk_insn);
             }
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(inliner::RejectReason::UNKNOWN_FIELD);
           }
           if (check_android_os_version(insn)) {
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(inliner::RejectReason::ANDROID_OS_VERSION);
           }
         }
         if (!m_config.throws_inline && insn->opcode() == OPCODE_THROW) {
           info.throws++;
-          can_inline = false;
-          return editable_cfg_adapter::LOOP_BREAK;
+          return reject(inliner::RejectReason::THROWS);
         }
         if (is_return(insn->opcode())) {
           ++ret_count;
@@ -1547,7 +1653,7 @@ bool MultiMethodInliner::cannot_inline_opcodes(
     if (invk_insn) {
       log_nopt(INL_MULTIPLE_RETURNS, callee);
     }
-    can_inline = false;
+    reject(inliner::RejectReason::MULTIPLE_RETURNS);
   }
   return !can_inline;
 }
@@ -2028,6 +2134,46 @@ class MethodSplicer {
 
 namespace inliner {
 
+const char* reject_reason_name(RejectReason reason) {
+  switch (reason) {
+  case RejectReason::NONE:
+    return "none";
+  case RejectReason::CROSS_STORE:
+    return "cross_store";
+  case RejectReason::BLACKLISTED_CALLEE:
+    return "blacklisted_callee";
+  case RejectReason::BLACKLISTED_CALLER:
+    return "blacklisted_caller";
+  case RejectReason::EXTERNAL_CATCH:
+    return "external_catch";
+  case RejectReason::CREATE_VMETHOD:
+    return "create_vmethod";
+  case RejectReason::INVOKE_SUPER:
+    return "invoke_super";
+  case RejectReason::UNKNOWN_VIRTUAL:
+    return "unknown_virtual";
+  case RejectReason::UNKNOWN_FIELD:
+    return "unknown_field";
+  case RejectReason::ANDROID_OS_VERSION:
+    return "android_os_version";
+  case RejectReason::THROWS:
+    return "throws";
+  case RejectReason::MULTIPLE_RETURNS:
+    return "multiple_returns";
+  case RejectReason::CALLER_TOO_LARGE:
+    return "caller_too_large";
+  case RejectReason::REQUIRES_API:
+    return "requires_api";
+  case RejectReason::DONT_INLINE:
+    return "dont_inline";
+  case RejectReason::CFG_INLINER_FAILED:
+    return "cfg_inliner_failed";
+  case RejectReason::NUM_REJECT_REASONS:
+    break;
+  }
+  not_reached();
+}
+
 DexPosition* last_position_before(const IRList::const_iterator& it,
                                   const IRCode* code) {
   // we need to decrement the reverse iterator because it gets constructed
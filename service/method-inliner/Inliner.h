@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <functional>
 #include <map>
@@ -22,6 +23,7 @@
 #include "DexStore.h"
 #include "IPConstantPropagationAnalysis.h"
 #include "IRCode.h"
+#include "InlineForSpeed.h"
 #include "LocalDce.h"
 #include "MethodProfiles.h"
 #include "PatriciaTreeSet.h"
@@ -73,6 +75,46 @@ bool inline_with_cfg(DexMethod* caller_method,
                      DexMethod* callee_method,
                      IRInstruction* callsite);
 
+/*
+ * Why a candidate callsite was not inlined.
+ */
+enum class RejectReason {
+  NONE,
+  CROSS_STORE,
+  BLACKLISTED_CALLEE,
+  BLACKLISTED_CALLER,
+  EXTERNAL_CATCH,
+  CREATE_VMETHOD,
+  INVOKE_SUPER,
+  UNKNOWN_VIRTUAL,
+  UNKNOWN_FIELD,
+  ANDROID_OS_VERSION,
+  THROWS,
+  MULTIPLE_RETURNS,
+  CALLER_TOO_LARGE,
+  REQUIRES_API,
+  DONT_INLINE,
+  CFG_INLINER_FAILED,
+  NUM_REJECT_REASONS,
+};
+
+const char* reject_reason_name(RejectReason reason);
+
+/*
+ * One decision of MultiMethodInliner::inline_inlinables, recorded when
+ * InlinerConfig::log_inline_decisions is set.
+ */
+struct InlineDecision {
+  const DexMethod* caller;
+  const DexMethod* callee;
+  // The estimated number of code units that inlining adds to the caller.
+  size_t size_delta;
+  // Whether the caller is hot according to the method profiles.
+  bool hot;
+  // NONE if the callsite was inlined.
+  RejectReason reject_reason;
+};
+
 } // namespace inliner
 
 /**
@@ -147,6 +189,14 @@ class MultiMethodInliner {
 
   bool for_speed() const { return !m_hot_methods.empty(); }
 
+  /**
+   * Whether inlining for speed is limited by a code size budget, see
+   * InlinerConfig::speed_inline_budget.
+   */
+  bool budgeted_for_speed() const {
+    return for_speed() && m_config.speed_inline_budget > 0;
+  }
+
   /**
    * Inline callees in the caller if is_inlinable below returns true.
    */
@@ -168,7 +218,8 @@ class MultiMethodInliner {
   bool is_inlinable(DexMethod* caller,
                     DexMethod* callee,
                     const IRInstruction* insn,
-                    size_t estimated_insn_size);
+                    size_t estimated_insn_size,
+                    inliner::RejectReason* reject_reason = nullptr);
 
   ConcurrentSet<DexMethod*>& get_delayed_make_static() {
     return m_delayed_make_static;
@@ -223,7 +274,8 @@ class MultiMethodInliner {
   bool cannot_inline_opcodes(const DexMethod* caller,
                              const DexMethod* callee,
                              const IRInstruction* invk_insn,
-                             std::vector<DexMethod*>* make_static);
+                             std::vector<DexMethod*>* make_static,
+                             inliner::RejectReason* reject_reason);
 
   bool noninlinable_same_class_init_invoke(IRInstruction* insn,
                                            const DexMethod* callee,
@@ -316,6 +368,11 @@ class MultiMethodInliner {
    */
   size_t get_callee_insn_size(const DexMethod* callee);
 
+  /**
+   * Drop the cached costs of a method whose code changed.
+   */
+  void invalidate_callee_costs(const DexMethod* method);
+
   /**
    * We want to avoid inlining a large method with many callers as that would
    * bloat the bytecode.
@@ -356,6 +413,11 @@ class MultiMethodInliner {
    */
   void compute_callee_constant_arguments();
 
+  /**
+   * Choose the callsites to inline for speed within the configured budget.
+   */
+  void select_callsites_within_budget();
+
   /**
    * Initiate post-processing a method asynchronously.
    */
@@ -437,10 +499,19 @@ class MultiMethodInliner {
   std::unordered_map<DexMethod*, std::unordered_map<IRInstruction*, DexMethod*>>
       caller_virtual_callee;
 
-  // Cache of the inlined costs of each method after all its eligible callsites
-  // have been inlined.
-  mutable ConcurrentMap<const DexMethod*, boost::optional<size_t>>
-      m_inlined_costs;
+  // The code size and inlined cost of a method, computed for a given version
+  // of its code. A zero insn_size means that it wasn't computed yet.
+  struct CalleeCosts {
+    size_t version{0};
+    size_t insn_size{0};
+    boost::optional<size_t> inlined_cost;
+  };
+
+  // Cache of the costs of each method, shared by all the workers. Whenever
+  // the code of a method changes, invalidate_callee_costs() bumps its version,
+  // so that figures computed concurrently from the old code are dropped
+  // instead of being stored.
+  ConcurrentMap<const DexMethod*, CalleeCosts> m_callee_costs;
 
   /**
    * For all (reachable) invoked methods, list of constant arguments
@@ -495,12 +566,14 @@ class MultiMethodInliner {
   // When calling change_visibility eagerly
   std::mutex m_change_visibility_mutex;
 
+  // The decisions of inline_inlinables, if InlinerConfig::log_inline_decisions
+  // is set.
+  std::vector<inliner::InlineDecision> m_inline_decisions;
+  std::mutex m_inline_decisions_mutex;
+
   // Cache for should_inline function
   ConcurrentMap<const DexMethod*, boost::optional<bool>> m_should_inline;
 
-  // Optional cache for get_callee_insn_size function
-  std::unique_ptr<ConcurrentMap<const DexMethod*, size_t>> m_callee_insn_sizes;
-
   // Cache of whether a constructor can be unconditionally inlined.
   mutable ConcurrentMap<const DexMethod*, boost::optional<bool>>
       m_can_inline_init;
@@ -525,6 +598,8 @@ class MultiMethodInliner {
     size_t max_call_stack_depth{0};
     size_t waited_seconds{0};
     int critical_path_length{0};
+    size_t speed_budget_callers{0};
+    size_t speed_budget_spent{0};
 
     // statistics that may be incremented concurrently
     std::atomic<size_t> calls_inlined{0};
@@ -547,6 +622,11 @@ class MultiMethodInliner {
     std::atomic<size_t> constant_invoke_callers_unreachable_blocks{0};
     std::atomic<size_t> constant_invoke_callees_analyzed{0};
     std::atomic<size_t> constant_invoke_callees_unreachable_blocks{0};
+    std::atomic<size_t> hot_calls_inlined{0};
+    std::atomic<size_t> inlined_size_delta{0};
+    std::array<std::atomic<size_t>,
+               (size_t)inliner::RejectReason::NUM_REJECT_REASONS>
+        rejected{};
   };
   InliningInfo info;
 
@@ -558,6 +638,13 @@ class MultiMethodInliner {
 
   const std::unordered_set<const DexMethodRef*> m_hot_methods;
 
+  // The profiles, only kept when inlining for speed within a budget.
+  std::unordered_map<const DexMethodRef*, method_profiles::Stats>
+      m_budget_method_profile_stats;
+
+  // The callees that were chosen for each caller within the budget.
+  inline_for_speed::CalleesByCaller m_budget_selection;
+
   // Represents the size of the largest same-method-implementation group that a
   // method belongs in; the default value is 1.
   const std::unordered_map<const DexMethod*, size_t>&
@@ -574,6 +661,10 @@ class MultiMethodInliner {
  public:
   const InliningInfo& get_info() { return info; }
 
+  const std::vector<inliner::InlineDecision>& get_inline_decisions() {
+    return m_inline_decisions;
+  }
+
   const constant_propagation::Transform::Stats& get_const_prop_stats() {
     return m_const_prop_stats;
   }
@@ -8,8 +8,10 @@
 #include "MethodInliner.h"
 
 #include <algorithm>
+#include <fstream>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -18,6 +20,7 @@
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "IOUtil.h"
 #include "IRInstruction.h"
 #include "Inliner.h"
 #include "MethodOverrideGraph.h"
@@ -292,6 +295,35 @@ void gather_true_virtual_methods(
   });
 }
 
+/*
+ * Write one tab-separated line per decision of the inliner, sorted so that the
+ * logs of different builds can be diffed.
+ */
+void write_inline_decisions(
+    const std::string& path,
+    const std::vector<inliner::InlineDecision>& decisions) {
+  std::vector<std::string> lines;
+  lines.reserve(decisions.size());
+  for (const auto& decision : decisions) {
+    std::ostringstream line;
+    line << show_deobfuscated(decision.caller) << "\t"
+         << show_deobfuscated(decision.callee) << "\t"
+         << (decision.reject_reason == inliner::RejectReason::NONE
+                 ? "inlined"
+                 : inliner::reject_reason_name(decision.reject_reason))
+         << "\t" << decision.size_delta << "\t"
+         << (decision.hot ? "hot" : "cold");
+    lines.push_back(line.str());
+  }
+  std::sort(lines.begin(), lines.end());
+  std::ofstream os;
+  open_or_die(path, &os);
+  os << "caller\tcallee\tdecision\tsize_delta\thotness\n";
+  for (const auto& line : lines) {
+    os << line << "\n";
+  }
+}
+
 } // namespace
 
 namespace inliner {
@@ -299,7 +331,8 @@ void run_inliner(DexStoresVector& stores,
                  PassManager& mgr,
                  ConfigFiles& conf,
                  bool intra_dex /* false */,
-                 bool use_method_profiles /* false */) {
+                 bool use_method_profiles /* false */,
+                 const std::string& method_profiles_interaction) {
   if (mgr.no_proguard_rules()) {
     TRACE(INLINE, 1,
           "MethodInlinePass not run because no ProGuard configuration was "
@@ -311,11 +344,11 @@ void run_inliner(DexStoresVector& stores,
   // Gather all inlinable candidates.
   auto inliner_config = conf.get_inliner_config();
 
-  using MethodStats =
-      const std::unordered_map<const DexMethodRef*, method_profiles::Stats>;
-  MethodStats method_profile_stats =
-      use_method_profiles ? conf.get_method_profiles().method_stats()
-                          : MethodStats{};
+  const method_profiles::StatsMap no_stats;
+  const auto& method_profile_stats =
+      use_method_profiles
+          ? conf.get_method_profiles().method_stats(method_profiles_interaction)
+          : no_stats;
   if (use_method_profiles && method_profile_stats.empty()) {
     // PerfMethodInline is enabled, but there are no profiles available. Bail,
     // don't run a regular inline pass.
@@ -439,6 +472,17 @@ void run_inliner(DexStoresVector& stores,
       inliner.get_info().constant_invoke_callees_unreachable_blocks);
   mgr.incr_metric("critical_path_length",
                   inliner.get_info().critical_path_length);
+  mgr.incr_metric("speed_budget_callers",
+                  inliner.get_info().speed_budget_callers);
+  mgr.incr_metric("speed_budget_spent", inliner.get_info().speed_budget_spent);
+  mgr.incr_metric("hot_calls_inlined", inliner.get_info().hot_calls_inlined);
+  mgr.incr_metric("inlined_size_delta", inliner.get_info().inlined_size_delta);
+  for (size_t i = 1; i < inliner.get_info().rejected.size(); ++i) {
+    auto reason = static_cast<inliner::RejectReason>(i);
+    mgr.incr_metric(std::string("rejected_") +
+                        inliner::reject_reason_name(reason),
+                    inliner.get_info().rejected[i]);
+  }
   mgr.incr_metric("methods_shrunk", inliner.get_methods_shrunk());
   mgr.incr_metric("callers", inliner.get_callers());
   mgr.incr_metric("delayed_shrinking_callees",
@@ -458,5 +502,16 @@ void run_inliner(DexStoresVector& stores,
           inliner.get_local_dce_stats().unreachable_instruction_count);
   mgr.incr_metric("blocks_eliminated_by_dedup_blocks",
                   inliner.get_dedup_blocks_stats().blocks_removed);
+
+  if (inliner_config.log_inline_decisions) {
+    auto pass_info = mgr.get_current_pass_info();
+    std::string basename = "redex-inline-decisions";
+    if (pass_info != nullptr) {
+      basename +=
+          "-" + pass_info->name + "-" + std::to_string(pass_info->repeat);
+    }
+    write_inline_decisions(conf.metafile(basename + ".txt"),
+                           inliner.get_inline_decisions());
+  }
 }
 } // namespace inliner
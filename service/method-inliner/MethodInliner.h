@@ -6,6 +6,7 @@
  */
 
 #include "InlinerConfig.h"
+#include "MethodProfiles.h"
 #include "PassManager.h"
 
 namespace inliner {
@@ -18,5 +19,7 @@ void run_inliner(DexStoresVector& stores,
                  PassManager& mgr,
                  ConfigFiles& inliner_config,
                  bool intra_dex = false,
-                 bool use_method_profiles = false);
+                 bool use_method_profiles = false,
+                 const std::string& method_profiles_interaction =
+                     method_profiles::COLD_START);
 } // namespace inliner
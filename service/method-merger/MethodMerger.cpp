@@ -169,16 +169,13 @@ Stats merge_methods(const MethodGroups& method_groups,
   if (old_to_new.empty()) {
     return stats;
   }
-  for (auto& callsite : callsites) {
-    auto old_callee = callsite.callee;
-    if (!old_to_new.count(old_callee)) {
-      continue;
+  if (traceEnabled(METH_MERGER, 9)) {
+    for (const auto& pair : old_to_new) {
+      TRACE(METH_MERGER, 9, "\t%s => %d %s", SHOW(pair.first),
+            pair.second.additional_args.get()[0], SHOW(pair.second.method));
     }
-    auto& new_callee = old_to_new.at(old_callee);
-    method_reference::patch_callsite(callsite, new_callee);
-    TRACE(METH_MERGER, 9, "\t%s => %d %s", SHOW(old_callee),
-          new_callee.additional_args.get()[0], SHOW(new_callee.method));
   }
+  method_reference::patch_callsites(callsites, old_to_new);
   if (traceEnabled(METH_MERGER, 3)) {
     TRACE(METH_MERGER, 3, "merged static methods : %u",
           stats.num_merged_static_methods);
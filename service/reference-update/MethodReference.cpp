@@ -7,31 +7,21 @@
 
 #include "MethodReference.h"
 
+#include <array>
+
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace method_reference {
 
-IRInstruction* make_load_const(reg_t dest, size_t val) {
-  auto load = new IRInstruction(OPCODE_CONST);
-  load->set_dest(dest);
-  load->set_literal(static_cast<int32_t>(val));
-  return load;
-}
-
-IRInstruction* make_invoke(DexMethod* callee,
-                           IROpcode opcode,
-                           std::vector<reg_t> args) {
-  always_assert(callee->is_def() && is_public(callee));
-  auto invoke = (new IRInstruction(opcode))->set_method(callee);
-  invoke->set_srcs_size(args.size());
-  for (size_t i = 0; i < args.size(); i++) {
-    invoke->set_src(i, args.at(i));
-  }
-  return invoke;
-}
+namespace {
 
-void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
+// Makes `new_callee` accessible from the caller of `callsite`. This changes
+// the access flags of the new callee, which is shared by many callsites, so
+// it is done before patching callsites in parallel.
+void make_callee_accessible(const CallSite& callsite,
+                            const NewCallee& new_callee) {
   if (is_static(new_callee.method) || method::is_any_init(new_callee.method) ||
       new_callee.method->is_virtual()) {
     set_public(new_callee.method);
@@ -41,7 +31,10 @@ void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
                             callsite.caller->get_class(),
                     "\tUpdating a callsite of %s when not accessible from %s\n",
                     SHOW(new_callee.method), SHOW(callsite.caller));
+}
 
+// Only changes the code of the caller of `callsite`.
+void rewrite_callsite(const CallSite& callsite, const NewCallee& new_callee) {
   auto code = callsite.caller->get_code();
   auto iterator = code->iterator_to(*callsite.mie);
   auto insn = callsite.mie->insn;
@@ -63,6 +56,107 @@ void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
   // Assuming the following move-result is there and good.
 }
 
+struct IndexedCall {
+  DexMethod* caller;
+  IRInstruction* insn;
+  DexMethod* callee;
+};
+
+// The invokes in `index` that resolve to a method for which `is_callee`
+// holds. Each method reference is resolved once per kind of invoke rather
+// than once per invoke, and only the references, not the code, are walked.
+template <typename IsCallee>
+std::vector<IndexedCall> find_indexed_calls(const InstructionIndex& index,
+                                            const IsCallee& is_callee) {
+  std::vector<const std::pair<const DexMethodRef* const,
+                              InstructionIndex::Uses>*>
+      refs;
+  refs.reserve(index.methods().size());
+  for (const auto& pair : index.methods()) {
+    refs.push_back(&pair);
+  }
+  std::vector<std::vector<IndexedCall>> calls(refs.size());
+  redex_parallel::parallel_for(0, refs.size(), [&](size_t i) {
+    auto ref = const_cast<DexMethodRef*>(refs[i]->first);
+    constexpr size_t kNumSearches =
+        static_cast<size_t>(MethodSearch::Interface) + 1;
+    std::array<boost::optional<DexMethod*>, kNumSearches> resolved;
+    for (const auto& use : refs[i]->second) {
+      auto search = opcode_to_search(use.insn);
+      auto& callee = resolved[static_cast<size_t>(search)];
+      if (!callee) {
+        auto method = resolve_method(ref, search);
+        callee = method != nullptr && is_callee(method) ? method : nullptr;
+      }
+      if (*callee != nullptr) {
+        calls[i].push_back(IndexedCall{use.method, use.insn, *callee});
+      }
+    }
+  });
+  std::vector<IndexedCall> result;
+  for (auto& ref_calls : calls) {
+    result.insert(result.end(), ref_calls.begin(), ref_calls.end());
+  }
+  return result;
+}
+
+} // namespace
+
+IRInstruction* make_load_const(reg_t dest, size_t val) {
+  auto load = new IRInstruction(OPCODE_CONST);
+  load->set_dest(dest);
+  load->set_literal(static_cast<int32_t>(val));
+  return load;
+}
+
+IRInstruction* make_invoke(DexMethod* callee,
+                           IROpcode opcode,
+                           std::vector<reg_t> args) {
+  always_assert(callee->is_def() && is_public(callee));
+  auto invoke = (new IRInstruction(opcode))->set_method(callee);
+  invoke->set_srcs_size(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    invoke->set_src(i, args.at(i));
+  }
+  return invoke;
+}
+
+void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
+  make_callee_accessible(callsite, new_callee);
+  rewrite_callsite(callsite, new_callee);
+}
+
+void patch_callsites(
+    const CallSites& callsites,
+    const std::unordered_map<DexMethod*, NewCallee>& old_to_new_callee) {
+  // Patching a callsite may add registers and instructions to its caller, so
+  // all the callsites of a caller are patched by the same thread, in order.
+  std::unordered_map<DexMethod*, std::vector<size_t>> callsites_by_caller;
+  std::vector<DexMethod*> callers;
+  for (size_t i = 0; i < callsites.size(); ++i) {
+    const auto& callsite = callsites[i];
+    auto it = old_to_new_callee.find(callsite.callee);
+    if (it == old_to_new_callee.end()) {
+      continue;
+    }
+    make_callee_accessible(callsite, it->second);
+    auto& caller_callsites = callsites_by_caller[callsite.caller];
+    if (caller_callsites.empty()) {
+      callers.push_back(callsite.caller);
+    }
+    caller_callsites.push_back(i);
+  }
+  redex_parallel::parallel_for(0, callers.size(), [&](size_t i) {
+    for (auto j : callsites_by_caller.at(callers[i])) {
+      const auto& callsite = callsites[j];
+      const auto& new_callee = old_to_new_callee.at(callsite.callee);
+      TRACE(REFU, 9, " Patched call %s to %s", SHOW(callsite.mie->insn),
+            SHOW(new_callee.method));
+      rewrite_callsite(callsite, new_callee);
+    }
+  });
+}
+
 void update_call_refs_simple(
     const Scope& scope,
     const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee) {
@@ -102,6 +196,41 @@ void update_call_refs_simple(
   walk::parallel::code(scope, patcher);
 }
 
+void update_call_refs_simple(
+    const InstructionIndex& index,
+    const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee) {
+  if (old_to_new_callee.empty()) {
+    return;
+  }
+  auto calls = find_indexed_calls(index, [&](DexMethod* method) {
+    return old_to_new_callee.count(method) != 0;
+  });
+  // Only the method of each invoke changes, so the invokes can be patched in
+  // any order.
+  redex_parallel::parallel_for(
+      0, calls.size(),
+      [&](size_t i) {
+        auto insn = calls[i].insn;
+        auto new_callee = old_to_new_callee.at(calls[i].callee);
+        always_assert_log(!is_private(new_callee) || is_static(new_callee),
+                          "%s\n",
+                          vshow(new_callee).c_str());
+        TRACE(REFU, 9, " Updated call %s to %s", SHOW(insn), SHOW(new_callee));
+        insn->set_method(new_callee);
+        if (new_callee->is_virtual()) {
+          always_assert_log(is_invoke_virtual(insn->opcode()),
+                            "invalid callsite %s\n",
+                            SHOW(insn));
+        } else if (is_static(new_callee)) {
+          always_assert_log(is_invoke_static(insn->opcode()),
+                            "invalid callsite %s\n",
+                            SHOW(insn));
+        }
+      },
+      redex_parallel::default_num_threads(),
+      /* chunk_size */ 64);
+}
+
 template <typename T>
 CallSites collect_call_refs(const Scope& scope, const T& callees) {
   if (callees.empty()) {
@@ -146,11 +275,60 @@ CallSites collect_call_refs(const Scope& scope, const T& callees) {
   return call_sites;
 }
 
+template <typename T>
+CallSites collect_call_refs(const InstructionIndex& index, const T& callees) {
+  if (callees.empty()) {
+    return CallSites();
+  }
+  auto calls = find_indexed_calls(
+      index, [&](DexMethod* method) { return callees.count(method) != 0; });
+
+  std::unordered_map<DexMethod*, std::unordered_map<IRInstruction*, DexMethod*>>
+      calls_by_caller;
+  for (const auto& call : calls) {
+    calls_by_caller[call.caller].emplace(call.insn, call.callee);
+  }
+  std::vector<DexMethod*> callers;
+  callers.reserve(calls_by_caller.size());
+  for (const auto& pair : calls_by_caller) {
+    callers.push_back(pair.first);
+  }
+  std::sort(callers.begin(), callers.end(), compare_dexmethods);
+
+  // The index only knows the instructions; only the code of the callers is
+  // walked to find their entries.
+  std::vector<CallSites> caller_call_sites(callers.size());
+  redex_parallel::parallel_for(0, callers.size(), [&](size_t i) {
+    auto caller = callers[i];
+    const auto& caller_calls = calls_by_caller.at(caller);
+    for (auto& mie : InstructionIterable(caller->get_code())) {
+      auto it = caller_calls.find(mie.insn);
+      if (it == caller_calls.end()) {
+        continue;
+      }
+      caller_call_sites[i].emplace_back(caller, &mie, it->second);
+      TRACE(REFU, 9, "  Found call %s from %s", SHOW(mie.insn), SHOW(caller));
+    }
+  });
+
+  CallSites call_sites;
+  call_sites.reserve(calls.size());
+  for (const auto& sites : caller_call_sites) {
+    call_sites.insert(call_sites.end(), sites.begin(), sites.end());
+  }
+  return call_sites;
+}
+
 using MethodOrderedSet = std::set<DexMethod*, dexmethods_comparator>;
 template CallSites collect_call_refs<MethodOrderedSet>(
     const Scope& scope, const MethodOrderedSet& callees);
 template CallSites collect_call_refs<std::unordered_set<DexMethod*>>(
     const Scope& scope, const std::unordered_set<DexMethod*>& callees);
+template CallSites collect_call_refs<MethodOrderedSet>(
+    const InstructionIndex& index, const MethodOrderedSet& callees);
+template CallSites collect_call_refs<std::unordered_set<DexMethod*>>(
+    const InstructionIndex& index,
+    const std::unordered_set<DexMethod*>& callees);
 
 int wrap_instance_call_with_static(
     DexStoresVector& stores,
@@ -12,6 +12,7 @@
 #include "DexClass.h"
 #include "DexStore.h"
 #include "IRInstruction.h"
+#include "InstructionIndex.h"
 
 namespace method_reference {
 
@@ -59,15 +60,45 @@ IRInstruction* make_invoke(DexMethod* callee,
  */
 void patch_callsite(const CallSite& callsite, const NewCallee& new_callee);
 
+/**
+ * Patch each of the callsites whose callee is in old_to_new_callee with its
+ * new callee; the other callsites are left alone. The callsites of different
+ * callers are patched in parallel.
+ */
+void patch_callsites(
+    const CallSites& callsites,
+    const std::unordered_map<DexMethod*, NewCallee>& old_to_new_callee);
+
 void update_call_refs_simple(
     const Scope& scope,
     const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee);
 
+/**
+ * Same as above, but only the invokes in `index` are looked at, so the cost is
+ * proportional to the number of distinct method references and of updated
+ * callsites rather than to the size of the code. The index must be up to date,
+ * and is stale afterwards.
+ *
+ * This is meant for passes that update the callsites before changing any
+ * other code, with PassManager::get_instruction_index(). The type erasure
+ * merger, say, sticks to the scope overloads: by the time it updates its
+ * callsites it has already rewritten method refs and created the dispatches,
+ * whose invokes a snapshot taken at the start of the pass doesn't have.
+ */
+void update_call_refs_simple(
+    const InstructionIndex& index,
+    const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee);
+
 // Allowed types: * std::set<DexMethod*, dexmethods_comparator>
 //                * std::unordered_set<DexMethod*>
 template <typename T>
 CallSites collect_call_refs(const Scope& scope, const T& callees);
 
+// Same as above, finding the callsites through `index`; only the code of the
+// callers is walked. The callsites are grouped by caller.
+template <typename T>
+CallSites collect_call_refs(const InstructionIndex& index, const T& callees);
+
 /**
  * Replace instance method call with static method call.
  * obj.instance_method(arg1, ...) => XX.static_method(obj, arg1, ...)
@@ -10,6 +10,7 @@
 #include "MethodReference.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -199,10 +200,9 @@ void add_vmethod_to_group(DexType* old_type_ref,
 void add_vmethod_to_groups(
     const std::unordered_map<const DexType*, DexType*>& old_to_new,
     DexMethod* method,
+    size_t org_signature_hash,
+    DexString* possible_new_name,
     VMethodsGroups* groups) {
-  size_t org_signature_hash = hash_signature(method);
-  auto possible_new_name = gen_new_name(method->str(), org_signature_hash);
-
   auto proto = method->get_proto();
   auto rtype =
       const_cast<DexType*>(type::get_element_type_if_array(proto->get_rtype()));
@@ -281,6 +281,169 @@ void update_vmethods_group_one_type_ref(const VMethodGroup& group,
         spec, false /* rename on collision */, true /* update deob name */);
   }
 }
+/**
+ * What updating the type references of a method signature needs, computed for
+ * all the methods at once and in parallel before any of them is changed.
+ */
+struct SignatureUpdate {
+  DexMethod* method{nullptr};
+  // The original signature, for the method debug map.
+  std::string debug_signature;
+  // For direct methods.
+  DexProto* new_proto{nullptr};
+  // For virtual methods.
+  size_t signature_hash{0};
+  DexString* possible_new_name{nullptr};
+};
+
+void update_method_signatures(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new,
+    const UnorderedTypeSet& old_types,
+    const ClassHierarchy& ch,
+    boost::optional<std::unordered_map<DexMethod*, std::string>&>
+        method_debug_map) {
+  std::vector<DexMethod*> methods;
+  walk::methods(scope, [&methods](DexMethod* method) {
+    methods.push_back(method);
+  });
+  std::vector<SignatureUpdate> updates(methods.size());
+  redex_parallel::parallel_for(0, methods.size(), [&](size_t i) {
+    auto method = methods[i];
+    auto proto = method->get_proto();
+    if (!type_reference::proto_has_reference_to(proto, old_types)) {
+      return;
+    }
+    auto& update = updates[i];
+    update.method = method;
+    if (method_debug_map != boost::none) {
+      update.debug_signature = type_reference::get_method_signature(method);
+    }
+    if (!method->is_virtual()) {
+      update.new_proto = type_reference::get_new_proto(proto, old_to_new);
+    } else {
+      update.signature_hash = hash_signature(method);
+      update.possible_new_name =
+          gen_new_name(method->str(), update.signature_hash);
+    }
+  });
+
+  // Virtual methods.
+  // The key is the hash of signature and an old type reference. Group the
+  // methods by key.
+  VMethodsGroups vmethods_groups;
+  // Direct methods.
+  std::map<DexMethod*, DexProto*, dexmethods_comparator> colliding_directs;
+
+  // Changing a method can make a later one collide, so apply the updates in
+  // order.
+  for (auto& update : updates) {
+    auto method = update.method;
+    if (method == nullptr) {
+      continue;
+    }
+    if (method_debug_map != boost::none) {
+      method_debug_map.get()[method] = std::move(update.debug_signature);
+    }
+    if (!method->is_virtual()) {
+      auto new_proto = update.new_proto;
+      /// A. For direct methods:
+      // If there is no collision, update spec directly.
+      // If it's not constructor and renamable, rename on collision.
+      // Otherwise, add it to colliding_directs.
+      auto collision = DexMethod::get_method(
+          method->get_class(), method->get_name(), new_proto);
+      if (!collision || (!method::is_init(method) && can_rename(method))) {
+        TRACE(REFU, 8, "sig: updating direct method %s", SHOW(method));
+        DexMethodSpec spec;
+        spec.proto = new_proto;
+        method->change(spec,
+                       true /* rename on collision */,
+                       true /* update deobfuscated name */);
+      } else {
+        colliding_directs[method] = new_proto;
+      }
+      continue;
+    }
+    // B. For virtual methods: Collect the methods that reference the old
+    // types to oldtype_to_vmethods. Calculate new proto for each method and
+    // store to method_to_new_proto.
+    add_vmethod_to_groups(old_to_new, method, update.signature_hash,
+                          update.possible_new_name, &vmethods_groups);
+  }
+
+  // Solve updating collision for direct methods by appending primitive
+  // arguments.
+  fix_colliding_dmethods(scope, colliding_directs);
+
+  // Update virtual methods group by group.
+  for (auto& key_and_group : vmethods_groups) {
+    auto& group = key_and_group.second;
+    update_vmethods_group_one_type_ref(group, ch);
+  }
+}
+
+void update_field_types(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new) {
+  TRACE(REFU, 4, " updating field refs");
+  const auto update_field = [&](DexFieldRef* field) {
+    const auto ref_type = field->get_type();
+    const auto type = type::get_element_type_if_array(ref_type);
+    if (old_to_new.count(type) == 0) {
+      return;
+    }
+    DexFieldSpec spec;
+    auto new_type = old_to_new.at(type);
+    auto level = type::get_array_level(ref_type);
+    auto new_type_incl_array = type::make_array_type(new_type, level);
+    spec.type = new_type_incl_array;
+    field->change(spec);
+    TRACE(REFU, 9, " updating field ref to %s", SHOW(type));
+  };
+  walk::parallel::fields(scope, update_field);
+}
+
+/**
+ * Ensure that no method references (if `methods`) and no field references (if
+ * `fields`) are left that still refer to old types.
+ */
+void assert_no_old_type_references(const Scope& scope,
+                                   const UnorderedTypeSet& old_types,
+                                   bool methods,
+                                   bool fields) {
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
+    for (auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (methods && insn->has_method()) {
+        auto proto = insn->get_method()->get_proto();
+        always_assert_log(
+            !type_reference::proto_has_reference_to(proto, old_types),
+            "Find old type in method reference %s, please make sure that "
+            "ReBindRefsPass is enabled before the crashed pass.\n",
+            SHOW(insn));
+      } else if (fields && insn->has_field()) {
+        const auto ref_type = insn->get_field()->get_type();
+        const auto type = type::get_element_type_if_array(ref_type);
+        always_assert_log(
+            old_types.count(type) == 0,
+            "Find old type in field reference %s, please make sure that "
+            "ReBindRefsPass is enabled before TypeErasurePass\n",
+            SHOW(insn));
+      }
+    }
+  });
+}
+
+UnorderedTypeSet get_old_types(
+    const std::unordered_map<const DexType*, DexType*>& old_to_new) {
+  UnorderedTypeSet old_types;
+  for (auto& pair : old_to_new) {
+    old_types.insert(pair.first);
+  }
+  return old_types;
+}
+
 } // namespace
 
 namespace type_reference {
@@ -552,118 +715,31 @@ void update_method_signature_type_references(
     const ClassHierarchy& ch,
     boost::optional<std::unordered_map<DexMethod*, std::string>&>
         method_debug_map) {
-  // Virtual methods.
-  // The key is the hash of signature and an old type reference. Group the
-  // methods by key.
-  VMethodsGroups vmethods_groups;
-  // Direct methods.
-  std::map<DexMethod*, DexProto*, dexmethods_comparator> colliding_directs;
-
-  // Callback for updating method debug map.
-  std::function<void(DexMethod*)> update_method_debug_map = [](DexMethod*) {};
-  if (method_debug_map != boost::none) {
-    update_method_debug_map = [&method_debug_map](DexMethod* method) {
-      method_debug_map.get()[method] = get_method_signature(method);
-    };
-  }
-
-  UnorderedTypeSet old_types;
-  for (auto& pair : old_to_new) {
-    old_types.insert(pair.first);
-  }
-
-  walk::methods(scope, [&](DexMethod* method) {
-    auto proto = method->get_proto();
-    if (!proto_has_reference_to(proto, old_types)) {
-      return;
-    }
-    update_method_debug_map(method);
-    if (!method->is_virtual()) {
-      auto new_proto = get_new_proto(proto, old_to_new);
-      /// A. For direct methods:
-      // If there is no collision, update spec directly.
-      // If it's not constructor and renamable, rename on collision.
-      // Otherwise, add it to colliding_directs.
-      auto collision = DexMethod::get_method(
-          method->get_class(), method->get_name(), new_proto);
-      if (!collision || (!method::is_init(method) && can_rename(method))) {
-        TRACE(REFU, 8, "sig: updating direct method %s", SHOW(method));
-        DexMethodSpec spec;
-        spec.proto = new_proto;
-        method->change(spec,
-                       true /* rename on collision */,
-                       true /* update deobfuscated name */);
-      } else {
-        colliding_directs[method] = new_proto;
-      }
-      return;
-    }
-    // B. For virtual methods: Collect the methods that reference the old
-    // types to oldtype_to_vmethods. Calculate new proto for each method and
-    // store to method_to_new_proto.
-    add_vmethod_to_groups(old_to_new, method, &vmethods_groups);
-  });
-
-  // Solve updating collision for direct methods by appending primitive
-  // arguments.
-  fix_colliding_dmethods(scope, colliding_directs);
-
-  // Update virtual methods group by group.
-  for (auto& key_and_group : vmethods_groups) {
-    auto& group = key_and_group.second;
-    update_vmethods_group_one_type_ref(group, ch);
-  }
-
-  // Ensure that no method references left that still refer old types.
-  walk::parallel::code(scope, [&old_types](DexMethod*, IRCode& code) {
-    for (auto& mie : InstructionIterable(code)) {
-      auto insn = mie.insn;
-      if (insn->has_method()) {
-        auto proto = insn->get_method()->get_proto();
-        always_assert_log(
-            !proto_has_reference_to(proto, old_types),
-            "Find old type in method reference %s, please make sure that "
-            "ReBindRefsPass is enabled before the crashed pass.\n",
-            SHOW(insn));
-      }
-    }
-  });
+  auto old_types = get_old_types(old_to_new);
+  update_method_signatures(scope, old_to_new, old_types, ch, method_debug_map);
+  assert_no_old_type_references(scope, old_types, /* methods */ true,
+                                /* fields */ false);
 }
 
 void update_field_type_references(
     const Scope& scope,
     const std::unordered_map<const DexType*, DexType*>& old_to_new) {
-  TRACE(REFU, 4, " updating field refs");
-  const auto update_field = [&](DexFieldRef* field) {
-    const auto ref_type = field->get_type();
-    const auto type = type::get_element_type_if_array(ref_type);
-    if (old_to_new.count(type) == 0) {
-      return;
-    }
-    DexFieldSpec spec;
-    auto new_type = old_to_new.at(type);
-    auto level = type::get_array_level(ref_type);
-    auto new_type_incl_array = type::make_array_type(new_type, level);
-    spec.type = new_type_incl_array;
-    field->change(spec);
-    TRACE(REFU, 9, " updating field ref to %s", SHOW(type));
-  };
-  walk::parallel::fields(scope, update_field);
+  update_field_types(scope, old_to_new);
+  assert_no_old_type_references(scope, get_old_types(old_to_new),
+                                /* methods */ false, /* fields */ true);
+}
 
-  walk::parallel::code(scope, [&old_to_new](DexMethod*, IRCode& code) {
-    for (auto& mie : InstructionIterable(code)) {
-      auto insn = mie.insn;
-      if (insn->has_field()) {
-        const auto ref_type = insn->get_field()->get_type();
-        const auto type = type::get_element_type_if_array(ref_type);
-        always_assert_log(
-            old_to_new.count(type) == 0,
-            "Find old type in field reference %s, please make sure that "
-            "ReBindRefsPass is enabled before TypeErasurePass\n",
-            SHOW(insn));
-      }
-    }
-  });
+void update_type_references(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new,
+    const ClassHierarchy& ch,
+    boost::optional<std::unordered_map<DexMethod*, std::string>&>
+        method_debug_map) {
+  auto old_types = get_old_types(old_to_new);
+  update_method_signatures(scope, old_to_new, old_types, ch, method_debug_map);
+  update_field_types(scope, old_to_new);
+  assert_no_old_type_references(scope, old_types, /* methods */ true,
+                                /* fields */ true);
 }
 
 } // namespace type_reference
@@ -122,4 +122,16 @@ void update_field_type_references(
     const Scope& scope,
     const std::unordered_map<const DexType*, DexType*>& old_to_new);
 
+/**
+ * Both of the above in one go: the whole mapping is applied to all the method
+ * signatures and field types of the scope, and the code is only checked once
+ * for leftover references to old types.
+ */
+void update_type_references(
+    const Scope& scope,
+    const std::unordered_map<const DexType*, DexType*>& old_to_new,
+    const ClassHierarchy& ch,
+    boost::optional<std::unordered_map<DexMethod*, std::string>&>
+        method_debug_map = boost::none);
+
 } // namespace type_reference
@@ -10,6 +10,7 @@
 #include <cmath>
 
 #include "Creators.h"
+#include "InstructionLowering.h"
 #include "TypeReference.h"
 
 using namespace type_reference;
@@ -34,6 +35,16 @@ constexpr uint64_t MAX_NUM_DISPATCH_TARGET = 500;
  */
 constexpr uint64_t MAX_NUM_DISPATCH_INSTRUCTION = 40000;
 
+/**
+ * The interpreter looks up the key of a sparse-switch with a binary search on
+ * every execution, which is what startup code pays for a large dispatch. With
+ * profiles, the few cases that take a good share of the calls are tested for
+ * one by one ahead of the switch instead; hottest first.
+ */
+constexpr size_t MAX_NUM_HOT_CASES = 4;
+// A case is hot if it takes at least 1/HOT_CASE_SHARE_DIVISOR of the calls.
+constexpr double HOT_CASE_SHARE_DIVISOR = 8;
+
 MethodCreator* init_method_creator(const dispatch::Spec& spec,
                                    DexMethod* orig_method) {
   return new MethodCreator(spec.owner_type,
@@ -156,6 +167,98 @@ std::map<SwitchIndices, MethodBlock*> get_switch_cases(
   return cases;
 }
 
+std::vector<SwitchIndices> get_hot_cases(
+    const dispatch::Spec& spec,
+    const std::map<SwitchIndices, DexMethod*>& indices_to_callee,
+    const std::map<SwitchIndices, MethodBlock*>& cases) {
+  std::vector<SwitchIndices> hot_cases;
+  if (spec.method_stats == nullptr || cases.empty()) {
+    return hot_cases;
+  }
+  std::vector<int32_t> keys;
+  for (const auto& case_it : cases) {
+    keys.insert(keys.end(), case_it.first.begin(), case_it.first.end());
+  }
+  std::sort(keys.begin(), keys.end());
+  if (!instruction_lowering::sufficiently_sparse(keys)) {
+    // A packed-switch is a bounds check and a table lookup.
+    return hot_cases;
+  }
+
+  std::vector<std::pair<double, SwitchIndices>> weighted_cases;
+  double total = 0;
+  for (const auto& case_it : cases) {
+    auto stats = spec.method_stats->find(indices_to_callee.at(case_it.first));
+    double weight =
+        stats == spec.method_stats->end() ? 0 : stats->second.call_count;
+    total += weight;
+    // A case with several keys would need a test for each.
+    if (weight > 0 && case_it.first.size() == 1) {
+      weighted_cases.emplace_back(weight, case_it.first);
+    }
+  }
+  std::stable_sort(
+      weighted_cases.begin(), weighted_cases.end(),
+      [](const auto& left, const auto& right) {
+        return left.first > right.first;
+      });
+  for (const auto& weighted_case : weighted_cases) {
+    if (hot_cases.size() == MAX_NUM_HOT_CASES ||
+        weighted_case.first * HOT_CASE_SHARE_DIVISOR < total) {
+      break;
+    }
+    hot_cases.push_back(weighted_case.second);
+  }
+  return hot_cases;
+}
+
+/**
+ * Emit the dispatch on the type tag: tests for the hot cases if any, followed
+ * by a switch on the others. Like switch_op(), it fills in the MethodBlocks of
+ * the cases and returns the default block. The hot cases, which aren't part
+ * of the switch, are returned in `hot_cases`.
+ */
+MethodBlock* emit_dispatch(
+    const dispatch::Spec& spec,
+    const std::map<SwitchIndices, DexMethod*>& indices_to_callee,
+    MethodCreator* mc,
+    MethodBlock* mb,
+    Location type_tag_loc,
+    std::map<SwitchIndices, MethodBlock*>& cases,
+    std::vector<SwitchIndices>& hot_cases) {
+  hot_cases = get_hot_cases(spec, indices_to_callee, cases);
+  if (hot_cases.empty()) {
+    return mb->switch_op(type_tag_loc, cases);
+  }
+  TRACE(SDIS, 5, "testing for %zu hot cases of %zu in %s.%s",
+        hot_cases.size(), cases.size(), SHOW(spec.owner_type),
+        spec.name.c_str());
+
+  auto key_loc = mc->make_local(type::_int());
+  MethodBlock* block = mb;
+  for (const auto& indices : hot_cases) {
+    block->load_const(key_loc, *indices.begin());
+    MethodBlock* case_block = nullptr;
+    block = block->if_else_test(OPCODE_IF_EQ, type_tag_loc, key_loc,
+                                &case_block);
+    cases[indices] = case_block;
+  }
+  std::map<SwitchIndices, MethodBlock*> switch_cases;
+  for (const auto& case_it : cases) {
+    if (case_it.second == nullptr) {
+      switch_cases.emplace(case_it.first, nullptr);
+    }
+  }
+  if (switch_cases.empty()) {
+    return block;
+  }
+  auto def_block = block->switch_op(type_tag_loc, switch_cases);
+  for (const auto& case_it : switch_cases) {
+    cases[case_it.first] = case_it.second;
+  }
+  return def_block;
+}
+
 DexMethod* materialize_dispatch(DexMethod* orig_method, MethodCreator* mc) {
   auto dispatch = mc->create();
   dispatch->rstate = orig_method->rstate;
@@ -246,7 +349,9 @@ DexMethod* create_simple_switch_dispatch(
   auto cases = get_switch_cases(indices_to_callee);
 
   // default case and return
-  auto def_block = mb->switch_op(type_tag_loc, cases);
+  std::vector<SwitchIndices> hot_cases;
+  auto def_block = emit_dispatch(spec, indices_to_callee, mc, mb, type_tag_loc,
+                                 cases, hot_cases);
   handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
@@ -278,13 +383,26 @@ dispatch::DispatchMethod create_two_level_switch_dispatch(
   std::vector<Location> args = get_args_from(orig_method, mc);
 
   mb->iget(spec.type_tag_field, self_loc, type_tag_loc);
-  auto cases = get_switch_cases(indices_to_callee);
+  auto all_cases = get_switch_cases(indices_to_callee);
 
   // default case and return
-  auto def_block = mb->switch_op(type_tag_loc, cases);
+  std::vector<SwitchIndices> hot_cases;
+  auto def_block = emit_dispatch(spec, indices_to_callee, mc, mb, type_tag_loc,
+                                 all_cases, hot_cases);
   handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
+  // The hot cases stay in the first tier and call their targets directly; the
+  // others are split across the second tier dispatches.
+  for (const auto& indices : hot_cases) {
+    auto case_block = all_cases.at(indices);
+    auto callee = indices_to_callee.at(indices);
+    emit_check_cast(spec, args, callee, case_block);
+    invoke_static(spec, args, ret_loc, callee, case_block);
+    all_cases.erase(indices);
+  }
+  const auto& cases = all_cases;
+
   size_t max_num_leaf_switch = cases.size() / num_switch_needed + 1;
   std::map<SwitchIndices, DexMethod*> sub_indices_to_callee;
   std::vector<DexMethod*> sub_dispatches;
@@ -574,7 +692,9 @@ DexMethod* create_ctor_or_static_dispatch(
 
   auto cases = get_switch_cases(indices_to_callee, is_ctor(spec));
 
-  auto def_block = mb->switch_op(type_tag_loc, cases);
+  std::vector<SwitchIndices> hot_cases;
+  auto def_block = emit_dispatch(spec, indices_to_callee, mc, mb, type_tag_loc,
+                                 cases, hot_cases);
   handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
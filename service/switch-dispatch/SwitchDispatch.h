@@ -11,6 +11,7 @@
 #include <utility>
 
 #include "DexClass.h"
+#include "MethodProfiles.h"
 
 struct Location;
 
@@ -46,6 +47,10 @@ struct Spec {
   boost::optional<size_t> max_num_dispatch_target;
   boost::optional<size_t> type_tag_param_idx;
   bool keep_debug_info;
+  // Profiled call counts of the targets, if any. The hot targets of a sparse
+  // dispatch are then tested for ahead of the switch.
+  const std::unordered_map<const DexMethodRef*, method_profiles::Stats>*
+      method_stats{nullptr};
 
   Spec(DexType* owner_type,
        Type type,
@@ -7,6 +7,9 @@
 
 #include "GlobalTypeAnalyzer.h"
 
+#include "DexHasher.h"
+#include "Resolver.h"
+
 namespace type_analyzer {
 
 namespace global {
@@ -32,27 +35,88 @@ void GlobalTypeAnalyzer::analyze_node(
   if (code == nullptr) {
     return;
   }
-  auto& cfg = code->cfg();
-  auto intra_ta = get_local_analysis(method);
+  auto args = this->get_entry_state_at(const_cast<DexMethod*>(method))
+                  .get(CURRENT_PARTITION_LABEL);
+  std::vector<IRInstruction*> insns;
+  // These are the reads done by WholeProgramAwareAnalyzer.
+  std::vector<DexTypeDomain> inputs;
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    auto op = insn->opcode();
+    insns.push_back(insn);
+    if (is_sget(op) || is_iget(op)) {
+      auto field = resolve_field(insn->get_field());
+      if (field != nullptr) {
+        inputs.push_back(m_wps->get_field_type(field));
+      }
+    } else if (op == OPCODE_INVOKE_DIRECT || op == OPCODE_INVOKE_STATIC ||
+               op == OPCODE_INVOKE_VIRTUAL) {
+      auto callee =
+          resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (callee != nullptr) {
+        inputs.push_back(m_wps->get_return_type(callee));
+      }
+    }
+  }
   const auto outgoing_edges =
       call_graph::GraphInterface::successors(m_call_graph, method);
   std::unordered_set<IRInstruction*> outgoing_insns;
   for (const auto& edge : outgoing_edges) {
     outgoing_insns.emplace(edge->invoke_iterator()->insn);
   }
-  for (auto* block : cfg.blocks()) {
-    auto state = intra_ta->get_entry_state_at(block);
-    for (auto& mie : InstructionIterable(block)) {
-      auto* insn = mie.insn;
-      if (insn->has_method() && outgoing_insns.count(insn)) {
-        ArgumentTypeEnvironment out_args;
-        for (size_t i = 0; i < insn->srcs_size(); ++i) {
-          out_args.set(i, state.get(insn->src(i)));
+  auto code_hash = hashing::hash_code(code);
+  auto summary = m_summaries->get(method);
+  auto is_valid = [&]() {
+    if (summary->code_hash != code_hash || !summary->args.equals(args) ||
+        summary->inputs.size() != inputs.size() ||
+        summary->out_args.size() != outgoing_insns.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (!summary->inputs[i].equals(inputs[i])) {
+        return false;
+      }
+    }
+    // The call graph may have changed even if the code didn't.
+    for (const auto& pair : summary->out_args) {
+      if (!outgoing_insns.count(insns.at(pair.first))) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (summary != nullptr && is_valid()) {
+    ++m_reused_analyses;
+  } else {
+    auto new_summary = std::make_shared<MethodSummary>();
+    std::unordered_map<const IRInstruction*, uint32_t> positions;
+    for (uint32_t i = 0; i < insns.size(); ++i) {
+      positions.emplace(insns[i], i);
+    }
+    auto& cfg = code->cfg();
+    auto intra_ta = analyze_method(method, *m_wps, args);
+    for (auto* block : cfg.blocks()) {
+      auto state = intra_ta->get_entry_state_at(block);
+      for (auto& mie : InstructionIterable(block)) {
+        auto* insn = mie.insn;
+        if (insn->has_method() && outgoing_insns.count(insn)) {
+          ArgumentTypeEnvironment out_args;
+          for (size_t i = 0; i < insn->srcs_size(); ++i) {
+            out_args.set(i, state.get(insn->src(i)));
+          }
+          new_summary->out_args.emplace_back(positions.at(insn), out_args);
         }
-        current_partition->set(insn, out_args);
+        intra_ta->analyze_instruction(insn, &state);
       }
-      intra_ta->analyze_instruction(insn, &state);
     }
+    new_summary->code_hash = code_hash;
+    new_summary->args = std::move(args);
+    new_summary->inputs = std::move(inputs);
+    summary = std::move(new_summary);
+    m_summaries->set(method, summary);
+  }
+  for (const auto& pair : summary->out_args) {
+    current_partition->set(insns.at(pair.first), pair.second);
   }
 }
 
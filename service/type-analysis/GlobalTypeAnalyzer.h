@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "CallGraph.h"
+#include "ConcurrentContainers.h"
 #include "DexTypeDomain.h"
 #include "HashedAbstractPartition.h"
 #include "LocalTypeAnalyzer.h"
@@ -57,6 +60,43 @@ constexpr const IRInstruction* CURRENT_PARTITION_LABEL = nullptr;
 DexTypeEnvironment env_with_params(const IRCode* code,
                                    const ArgumentTypeEnvironment& args);
 
+/*
+ * The outcome of the local analysis of a method in the global fixpoint, along
+ * with everything it depends on.
+ */
+struct MethodSummary {
+  size_t code_hash;
+  ArgumentTypeEnvironment args;
+  // The types that the analysis read from the WholeProgramState.
+  std::vector<DexTypeDomain> inputs;
+  // The arguments passed at the outgoing callsites, keyed by the position of
+  // the invoke in the method.
+  std::vector<std::pair<uint32_t, ArgumentTypeEnvironment>> out_args;
+};
+
+/*
+ * Keeps the summaries computed by GlobalTypeAnalyzers. When the passes of a
+ * pipeline share a cache, each analysis only redoes the local analyses of the
+ * methods whose code or inputs changed since the previous one, e.g. the
+ * methods that were edited, and then their callees and the callers of those
+ * whose return types changed.
+ */
+class SummaryCache final {
+ public:
+  std::shared_ptr<const MethodSummary> get(const DexMethod* method) const {
+    return m_summaries.get(method, nullptr);
+  }
+
+  void set(const DexMethod* method,
+           std::shared_ptr<const MethodSummary> summary) {
+    m_summaries.insert_or_assign(std::make_pair(method, std::move(summary)));
+  }
+
+ private:
+  mutable ConcurrentMap<const DexMethod*, std::shared_ptr<const MethodSummary>>
+      m_summaries;
+};
+
 /*
  * Performs interprocedural DexType analysis of stack / register values.
  * The intraprocedural propagation logic is delegated to the LocalTypeAnalyzer.
@@ -65,9 +105,12 @@ class GlobalTypeAnalyzer : public sparta::ParallelMonotonicFixpointIterator<
                                call_graph::GraphInterface,
                                ArgumentTypePartition> {
  public:
-  explicit GlobalTypeAnalyzer(const call_graph::Graph& call_graph)
+  explicit GlobalTypeAnalyzer(const call_graph::Graph& call_graph,
+                              std::shared_ptr<SummaryCache> summaries =
+                                  std::make_shared<SummaryCache>())
       : ParallelMonotonicFixpointIterator(call_graph),
-        m_call_graph(call_graph) {
+        m_call_graph(call_graph),
+        m_summaries(std::move(summaries)) {
     auto wps = new WholeProgramState();
     wps->set_to_top();
     m_wps.reset(wps);
@@ -93,9 +136,14 @@ class GlobalTypeAnalyzer : public sparta::ParallelMonotonicFixpointIterator<
     m_wps = std::move(wps);
   }
 
+  // The number of local analyses that were skipped by reusing a summary.
+  size_t get_reused_analyses() const { return m_reused_analyses; }
+
  private:
   std::unique_ptr<const WholeProgramState> m_wps;
   call_graph::Graph m_call_graph;
+  std::shared_ptr<SummaryCache> m_summaries;
+  mutable std::atomic<size_t> m_reused_analyses{0};
 
   std::unique_ptr<local::LocalTypeAnalyzer> analyze_method(
       const DexMethod* method,
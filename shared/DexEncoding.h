@@ -11,6 +11,7 @@
 #include <stdexcept>
 
 #include <stdint.h>
+#include <string.h>
 #include <string>
 
 /*
@@ -180,18 +181,52 @@ inline uint32_t mutf8_next_code_point(const char*& s) {
   throw std::invalid_argument("Invalid size encoding mutf8 string");
 }
 
-inline uint32_t length_of_utf8_string(const char* s) {
-  if (s == nullptr) {
-    return 0;
+/*
+ * The number of leading ASCII bytes among the first `size` bytes of s. Most
+ * strings are ASCII only, so they get checked a word at a time.
+ */
+inline size_t length_of_ascii_prefix(const char* s, size_t size) {
+  constexpr uint64_t kHighBits = 0x8080808080808080ull;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, s + i, sizeof(word));
+    if (word & kHighBits) {
+      break;
+    }
+  }
+  while (i < size && !(static_cast<uint8_t>(s[i]) & 0x80)) {
+    ++i;
   }
+  return i;
+}
+
+/*
+ * The UTF-16 length of the MUTF-8 string of `size` bytes at s, which must be
+ * null-terminated.
+ */
+inline uint32_t length_of_utf8_string(const char* s, size_t size) {
+  const char* end = s + size;
   uint32_t len = 0;
-  while (*s != '\0') {
-    ++len;
-    mutf8_next_code_point(s);
+  while (s < end) {
+    auto ascii = length_of_ascii_prefix(s, end - s);
+    len += ascii;
+    s += ascii;
+    if (s < end) {
+      ++len;
+      mutf8_next_code_point(s);
+    }
   }
   return len;
 }
 
+inline uint32_t length_of_utf8_string(const char* s) {
+  if (s == nullptr) {
+    return 0;
+  }
+  return length_of_utf8_string(s, strlen(s));
+}
+
 // https://docs.oracle.com/javase/8/docs/api/java/lang/String.html#hashCode--
 inline int32_t java_hashcode_of_utf8_string(const char* s) {
   if (s == nullptr) {
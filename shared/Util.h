@@ -44,6 +44,23 @@ void insert_sorted(Container& c, const T& e, Compare comp) {
   c.insert(std::lower_bound(c.begin(), c.end(), e, comp), e);
 }
 
+/**
+ * Insert a range into a sorted random-access container. The new elements are
+ * appended at once, sorted and merged in, rather than each shifting the tail
+ * of the container.
+ */
+template <class Container, class InputIt, class Compare>
+void insert_all_sorted(Container& c,
+                       InputIt first,
+                       InputIt last,
+                       Compare comp) {
+  auto old_size = c.size();
+  c.insert(c.end(), first, last);
+  auto mid = c.begin() + old_size;
+  std::sort(mid, c.end(), comp);
+  std::inplace_merge(c.begin(), mid, c.end(), comp);
+}
+
 template <class T>
 struct MergeContainers {
   void operator()(const T& addend, T* accumulator) {
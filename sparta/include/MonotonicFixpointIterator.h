@@ -8,10 +8,16 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stack>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "AbstractDomain.h"
@@ -128,20 +134,51 @@ class MonotonicFixpointIteratorBase
    * very significant impact on the precision of the final result. This method
    * gives the user a way to parameterize the application of the widening
    * operator. A default widening strategy is provided, which applies the join
-   * at the first iteration and then the widening at all subsequent iterations
-   * until the limit is reached.
+   * for the first iterations (see `set_widening_delay()`) and then the
+   * widening at all subsequent iterations until the limit is reached.
    */
   virtual void extrapolate(const Context& context,
                            const NodeId& node,
                            Domain* current_state,
                            const Domain& new_state) const {
-    if (context.get_local_iterations_for(node) == 0) {
+    if (context.get_local_iterations_for(node) < m_widening_delay) {
       current_state->join_with(new_state);
     } else {
       current_state->widen_with(new_state);
     }
   }
 
+  /*
+   * The number of iterations at each SCC head during which the default
+   * extrapolation joins the states before it starts widening. Delaying the
+   * widening lets the short loops stabilize on their own, at the cost of more
+   * iterations. The default is 1.
+   */
+  void set_widening_delay(uint32_t delay) { m_widening_delay = delay; }
+
+  /*
+   * Bounds the number of times the SCC heads may fail to stabilize over a
+   * run. There is no bound by default. Once the budget is spent, the entry
+   * state of a head that doesn't stabilize is set to top instead of being
+   * extrapolated, so that its component converges at the next iteration. This
+   * is sound, but it may lose all the precision at the head and after it,
+   * which is why this is meant to cap the pathological cases rather than to
+   * tune the analysis.
+   */
+  void set_iteration_budget(uint32_t budget) { m_iteration_budget = budget; }
+
+  /*
+   * The number of times the SCC heads failed to stabilize during the last run,
+   * i.e., the number of extrapolation steps it performed.
+   */
+  uint32_t get_iteration_count() const { return m_iteration_count; }
+
+  /*
+   * Whether the last run had to give up on some SCC heads because it ran out
+   * of its iteration budget.
+   */
+  bool budget_exhausted() const { return m_budget_exhausted; }
+
   /*
    * Returns the invariant computed by the fixpoint iterator at a node entry.
    */
@@ -175,6 +212,8 @@ class MonotonicFixpointIteratorBase
   void clear() {
     m_entry_states.clear();
     m_exit_states.clear();
+    m_iteration_count = 0;
+    m_budget_exhausted = false;
   }
 
   void set_all_to_bottom(std::unordered_set<NodeId>& all_nodes) {
@@ -214,9 +253,29 @@ class MonotonicFixpointIteratorBase
     this->analyze_node(node, &exit_state);
   }
 
+  // Called by the iteration strategies whenever the current state at an SCC
+  // head is not a post-fixpoint.
+  void extrapolate_within_budget(const Context& context,
+                                 const NodeId& node,
+                                 Domain* current_state,
+                                 const Domain& new_state) {
+    auto count = ++m_iteration_count;
+    if (count > m_iteration_budget) {
+      m_budget_exhausted = true;
+      current_state->set_to_top();
+      return;
+    }
+    this->extrapolate(context, node, current_state, new_state);
+  }
+
   const Graph& m_graph;
   std::unordered_map<NodeId, Domain, NodeHash> m_entry_states;
   std::unordered_map<NodeId, Domain, NodeHash> m_exit_states;
+  uint32_t m_widening_delay{1};
+  uint32_t m_iteration_budget{std::numeric_limits<uint32_t>::max()};
+  // The parallel iterator extrapolates from several threads.
+  std::atomic<uint32_t> m_iteration_count{0};
+  std::atomic<bool> m_budget_exhausted{false};
 };
 
 } // namespace fp_impl
@@ -312,7 +371,8 @@ class WTOMonotonicFixpointIterator
         *current_state = std::move(new_state);
         iterate = false;
       } else {
-        this->extrapolate(*context, head, current_state, new_state);
+        this->extrapolate_within_budget(
+            *context, head, current_state, new_state);
       }
     }
   }
@@ -335,6 +395,8 @@ class WPOCounter {
   std::unordered_map<uint32_t, std::atomic<uint32_t>> m_counter;
 };
 
+namespace fp_impl {
+
 /*
  * Implementation of a deterministic concurrent fixpoint algorithm for weak
  * partial ordering (WPO) of a rooted directed graph, as described in the paper:
@@ -345,89 +407,57 @@ class WPOCounter {
  *   Preprint: https://arxiv.org/abs/1909.05951
  *
  * Authors: Sung Kook Kim, Aditya V. Thakur.
+ *
+ * The nodes that are ready to be analyzed are scheduled by decreasing length
+ * of the longest path that starts from them, as weighted by the node weights.
+ * This only affects the order in which the work is done, not the result.
+ *
+ * This is the iteration strategy of ParallelMonotonicFixpointIterator, which
+ * MonotonicFixpointIterator also uses on large graphs, do not use directly.
  */
-template <typename GraphInterface,
-          typename Domain,
-          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
-class ParallelMonotonicFixpointIterator
-    : public fp_impl::
-          MonotonicFixpointIteratorBase<GraphInterface, Domain, NodeHash> {
+template <typename GraphInterface, typename Domain, typename NodeHash>
+class ParallelWpoIteration {
  public:
-  using Graph = typename GraphInterface::Graph;
   using NodeId = typename GraphInterface::NodeId;
-  using EdgeId = typename GraphInterface::EdgeId;
-  using Context =
-      fp_impl::MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
+  using Base = MonotonicFixpointIteratorBase<GraphInterface, Domain, NodeHash>;
+  using Context = MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
   using WPOWorkQueue = SpartaWorkQueue<uint32_t>;
   using WPOWorkerState = SpartaWorkerState<uint32_t>;
-
-  ParallelMonotonicFixpointIterator(
-      const Graph& graph, size_t num_thread = parallel::default_num_threads())
-      : fp_impl::
-            MonotonicFixpointIteratorBase<GraphInterface, Domain, NodeHash>(
-                graph, /*cfg_size_hint*/ 4),
-        m_wpo(GraphInterface::entry(graph),
-              [=, &graph](const NodeId& x) {
-                const auto& succ_edges = GraphInterface::successors(graph, x);
-                std::vector<NodeId> succ_nodes_tmp;
-                std::transform(succ_edges.begin(),
-                               succ_edges.end(),
-                               std::back_inserter(succ_nodes_tmp),
-                               std::bind(&GraphInterface::target,
-                                         std::ref(graph),
-                                         std::placeholders::_1));
-                // Filter out duplicate succ nodes.
-                std::vector<NodeId> succ_nodes;
-                std::unordered_set<NodeId> succ_nodes_set;
-                for (auto node : succ_nodes_tmp) {
-                  if (!succ_nodes_set.count(node)) {
-                    succ_nodes_set.emplace(node);
-                    succ_nodes.emplace_back(node);
-                  }
-                }
-                return succ_nodes;
-              },
-              false),
-        m_num_thread(num_thread) {
-    // Gathering all reachable nodes in graph.
-    std::stack<NodeId> node_queue;
-    node_queue.push(GraphInterface::entry(graph));
-    m_all_nodes.emplace(GraphInterface::entry(graph));
-    while (!node_queue.empty()) {
-      auto node = node_queue.top();
-      node_queue.pop();
-      for (auto& edge : GraphInterface::successors(graph, node)) {
-        auto target = GraphInterface::target(graph, edge);
-        if (!m_all_nodes.count(target)) {
-          m_all_nodes.emplace(target);
-          node_queue.push(target);
-        }
+  using NodeWeight = std::function<uint64_t(const NodeId&)>;
+
+  ParallelWpoIteration(WeakPartialOrdering<NodeId, NodeHash>* wpo,
+                       size_t num_thread)
+      : m_wpo(*wpo), m_num_thread(num_thread) {
+    for (uint32_t idx = 0; idx < m_wpo.size(); ++idx) {
+      if (!m_wpo.is_exit(idx)) {
+        m_all_nodes.emplace(m_wpo.get_node(idx));
       }
     }
   }
 
-  /*
-   * Executes the fixpoint iterator given an abstract value describing the
-   * initial program configuration. This method can be invoked multiple times
-   * with different values in order to analyze the program under different
-   * initial conditions.
-   */
-  void run(const Domain& init) {
-    this->set_all_to_bottom(m_all_nodes);
+  // All the nodes reachable from the entry of the graph.
+  const std::unordered_set<NodeId>& all_nodes() const { return m_all_nodes; }
+
+  void run(Base* fp, const Domain& init, const NodeWeight& node_weight) {
+    fp->clear();
+    fp->set_all_to_bottom(m_all_nodes);
     Context context(init, m_all_nodes);
     m_wpo_counter.init(m_wpo.size());
+    if (m_priorities.empty()) {
+      compute_priorities(node_weight);
+    }
     auto entry_idx = m_wpo.get_entry();
     assert(m_wpo.get_num_preds(entry_idx) == 0);
     // Prepare work queue.
     WPOWorkQueue wq(
-        [&context, &entry_idx, this](WPOWorkerState* worker_state,
-                                     uint32_t wpo_idx) {
+        [&context, &entry_idx, fp, this](WPOWorkerState* worker_state,
+                                         uint32_t wpo_idx) {
           std::atomic<uint32_t>& current_counter =
               m_wpo_counter.value_at(wpo_idx);
           current_counter = 0;
           // NonExit node
           if (!m_wpo.is_exit(wpo_idx)) {
-            this->analyze_vertex(&context, m_wpo.get_node(wpo_idx));
+            fp->analyze_vertex(&context, m_wpo.get_node(wpo_idx));
             for (auto succ_idx : m_wpo.get_successors(wpo_idx)) {
               std::atomic<uint32_t>& succ_counter =
                   m_wpo_counter.value_at(succ_idx);
@@ -443,9 +473,9 @@ class ParallelMonotonicFixpointIterator
           // Check if component of the exit node has stablized.
           auto head_idx = m_wpo.get_head_of_exit(wpo_idx);
           NodeId head = m_wpo.get_node(head_idx);
-          Domain* current_state = &this->m_entry_states[head];
+          Domain* current_state = &fp->m_entry_states[head];
           Domain new_state;
-          this->compute_entry_state(&context, head, &new_state);
+          fp->compute_entry_state(&context, head, &new_state);
           if (new_state.leq(*current_state)) {
             // Component stablized.
             context.reset_local_iteration_count_for(head);
@@ -461,7 +491,8 @@ class ParallelMonotonicFixpointIterator
             }
           } else {
             // Component didn't stablize.
-            this->extrapolate(context, head, current_state, new_state);
+            fp->extrapolate_within_budget(
+                context, head, current_state, new_state);
             context.increase_iteration_count_for(head);
             // Set component nodes v's counter to their
             // NumOuterSchedPreds(v, wpo_idx)
@@ -489,16 +520,128 @@ class ParallelMonotonicFixpointIterator
           }
           return nullptr;
         },
-        m_num_thread);
+        m_num_thread,
+        [this](uint32_t wpo_idx) { return m_priorities[wpo_idx]; });
     wq.add_item(m_wpo.get_entry());
     wq.run_all();
   }
 
  private:
-  WeakPartialOrdering<NodeId, NodeHash> m_wpo;
-  WPOCounter m_wpo_counter;
+  // The priority of a WPO node is the weight of the heaviest path from it in
+  // the (acyclic) scheduling graph of the WPO.
+  void compute_priorities(const NodeWeight& node_weight) {
+    std::vector<uint32_t> num_preds(m_wpo.size());
+    std::vector<uint32_t> topological_order;
+    topological_order.reserve(m_wpo.size());
+    topological_order.push_back(m_wpo.get_entry());
+    for (size_t i = 0; i < topological_order.size(); ++i) {
+      for (auto succ_idx : m_wpo.get_successors(topological_order[i])) {
+        if (++num_preds[succ_idx] == m_wpo.get_num_preds(succ_idx)) {
+          topological_order.push_back(succ_idx);
+        }
+      }
+    }
+    m_priorities.assign(m_wpo.size(), 0);
+    for (auto it = topological_order.rbegin(); it != topological_order.rend();
+         ++it) {
+      uint64_t max_succ = 0;
+      for (auto succ_idx : m_wpo.get_successors(*it)) {
+        max_succ = std::max(max_succ, m_priorities[succ_idx]);
+      }
+      auto weight = m_wpo.is_exit(*it) ? 0 : node_weight(m_wpo.get_node(*it));
+      m_priorities[*it] = max_succ + weight;
+    }
+  }
+
+  WeakPartialOrdering<NodeId, NodeHash>& m_wpo;
   size_t m_num_thread;
+  WPOCounter m_wpo_counter;
   std::unordered_set<NodeId> m_all_nodes;
+  // Indexed by WPO node.
+  std::vector<uint64_t> m_priorities;
+};
+
+// The successors of a node without duplicates, as the WPO construction
+// requires.
+template <typename GraphInterface>
+std::vector<typename GraphInterface::NodeId> wpo_successors(
+    const typename GraphInterface::Graph& graph,
+    const typename GraphInterface::NodeId& x) {
+  using NodeId = typename GraphInterface::NodeId;
+  const auto& succ_edges = GraphInterface::successors(graph, x);
+  std::vector<NodeId> succ_nodes_tmp;
+  std::transform(succ_edges.begin(),
+                 succ_edges.end(),
+                 std::back_inserter(succ_nodes_tmp),
+                 std::bind(&GraphInterface::target,
+                           std::ref(graph),
+                           std::placeholders::_1));
+  // Filter out duplicate succ nodes.
+  std::vector<NodeId> succ_nodes;
+  std::unordered_set<NodeId> succ_nodes_set;
+  for (auto node : succ_nodes_tmp) {
+    if (!succ_nodes_set.count(node)) {
+      succ_nodes_set.emplace(node);
+      succ_nodes.emplace_back(node);
+    }
+  }
+  return succ_nodes;
+}
+
+} // namespace fp_impl
+
+/*
+ * The deterministic concurrent fixpoint algorithm for weak partial ordering
+ * (WPO) of Kim, Venet and Thakur, see fp_impl::ParallelWpoIteration.
+ */
+template <typename GraphInterface,
+          typename Domain,
+          typename NodeHash = std::hash<typename GraphInterface::NodeId>>
+class ParallelMonotonicFixpointIterator
+    : public fp_impl::
+          MonotonicFixpointIteratorBase<GraphInterface, Domain, NodeHash> {
+ public:
+  using Graph = typename GraphInterface::Graph;
+  using NodeId = typename GraphInterface::NodeId;
+  using EdgeId = typename GraphInterface::EdgeId;
+  using Context =
+      fp_impl::MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
+
+  ParallelMonotonicFixpointIterator(
+      const Graph& graph, size_t num_thread = parallel::default_num_threads())
+      : fp_impl::
+            MonotonicFixpointIteratorBase<GraphInterface, Domain, NodeHash>(
+                graph, /*cfg_size_hint*/ 4),
+        m_wpo(GraphInterface::entry(graph),
+              [&graph](const NodeId& x) {
+                return fp_impl::wpo_successors<GraphInterface>(graph, x);
+              },
+              false),
+        m_iteration(&m_wpo, num_thread) {}
+
+  /*
+   * Executes the fixpoint iterator given an abstract value describing the
+   * initial program configuration. This method can be invoked multiple times
+   * with different values in order to analyze the program under different
+   * initial conditions.
+   */
+  void run(const Domain& init) {
+    m_iteration.run(
+        this, init, [this](const NodeId& node) { return node_weight(node); });
+  }
+
+ protected:
+  /*
+   * The relative cost of analyzing a node. When several nodes are ready to be
+   * analyzed, the ones that start the costliest chains of dependent nodes are
+   * scheduled first, so that the critical path of the iteration isn't left to
+   * the end.
+   */
+  virtual uint64_t node_weight(const NodeId&) const { return 1; }
+
+ private:
+  WeakPartialOrdering<NodeId, NodeHash> m_wpo;
+  fp_impl::ParallelWpoIteration<GraphInterface, Domain, NodeHash> m_iteration;
 };
 
 /*
@@ -524,28 +667,31 @@ class MonotonicFixpointIterator
                                                Domain,
                                                NodeHash>(graph, cfg_size_hint),
         m_wpo(GraphInterface::entry(graph),
-              [=, &graph](const NodeId& x) {
-                const auto& succ_edges = GraphInterface::successors(graph, x);
-                std::vector<NodeId> succ_nodes_tmp;
-                std::transform(succ_edges.begin(),
-                               succ_edges.end(),
-                               std::back_inserter(succ_nodes_tmp),
-                               std::bind(&GraphInterface::target,
-                                         std::ref(graph),
-                                         std::placeholders::_1));
-                // Filter out duplicate succ nodes.
-                std::vector<NodeId> succ_nodes;
-                std::unordered_set<NodeId> succ_nodes_set;
-                for (auto node : succ_nodes_tmp) {
-                  if (!succ_nodes_set.count(node)) {
-                    succ_nodes_set.emplace(node);
-                    succ_nodes.emplace_back(node);
-                  }
-                }
-                return succ_nodes;
+              [&graph](const NodeId& x) {
+                return fp_impl::wpo_successors<GraphInterface>(graph, x);
               },
               false) {}
 
+  /*
+   * Graphs with at least `min_nodes` reachable nodes are analyzed by
+   * `num_thread` threads, with the iteration strategy of
+   * ParallelMonotonicFixpointIterator. That strategy is deterministic and
+   * computes the same invariants, but the node and edge transformers must then
+   * be safe to call on different nodes at the same time. All graphs are
+   * analyzed sequentially by default.
+   */
+  void set_parallel_threshold(
+      size_t min_nodes, size_t num_thread = parallel::default_num_threads()) {
+    m_parallel_threshold = min_nodes;
+    m_num_thread = num_thread;
+    m_parallel_iteration.reset();
+  }
+
+  /*
+   * Whether the last run analyzed the graph concurrently.
+   */
+  bool ran_in_parallel() const { return m_parallel_iteration != nullptr; }
+
   /*
    * Executes the fixpoint iterator given an abstract value describing the
    * initial program configuration. This method can be invoked multiple times
@@ -553,6 +699,22 @@ class MonotonicFixpointIterator
    * initial conditions.
    */
   void run(const Domain& init) {
+    // The size of the WPO bounds the number of nodes, which spares counting
+    // them for the small graphs.
+    if (m_num_thread > 1 && m_wpo.size() >= m_parallel_threshold) {
+      if (m_parallel_iteration == nullptr) {
+        auto iteration = std::make_unique<ParallelIteration>(&m_wpo,
+                                                             m_num_thread);
+        if (iteration->all_nodes().size() >= m_parallel_threshold) {
+          m_parallel_iteration = std::move(iteration);
+        }
+      }
+      if (m_parallel_iteration != nullptr) {
+        m_parallel_iteration->run(
+            this, init, [](const NodeId&) -> uint64_t { return 1; });
+        return;
+      }
+    }
     this->clear();
     Context context(init);
     std::unordered_map<uint32_t, uint32_t> wpo_counter;
@@ -594,7 +756,8 @@ class MonotonicFixpointIterator
         }
       } else {
         // Component didn't stablize.
-        this->extrapolate(context, head, current_state, new_state);
+        this->extrapolate_within_budget(
+            context, head, current_state, new_state);
         context.increase_iteration_count_for(head);
         // Set component nodes v's counter to their
         // NumOuterSchedPreds(v, wpo_idx)
@@ -629,7 +792,13 @@ class MonotonicFixpointIterator
   }
 
  private:
+  using ParallelIteration =
+      fp_impl::ParallelWpoIteration<GraphInterface, Domain, NodeHash>;
+
   WeakPartialOrdering<NodeId, NodeHash> m_wpo;
+  size_t m_parallel_threshold{std::numeric_limits<size_t>::max()};
+  size_t m_num_thread{1};
+  std::unique_ptr<ParallelIteration> m_parallel_iteration;
 };
 
 /*
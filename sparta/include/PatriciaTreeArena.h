@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace sparta {
+
+namespace pt_util {
+
+/*
+ * A bump allocator for the nodes of Patricia trees. Only the thread that owns
+ * the arena allocates from it, but the nodes may be freed by any thread, since
+ * the trees can outlive the scope in which they were built. Individual nodes
+ * are never reclaimed: the arena counts its live nodes and frees all its memory
+ * at once when the last of them is gone and its scope has ended.
+ */
+class Arena final {
+ public:
+  explicit Arena(size_t capacity) : m_capacity(capacity) {}
+
+  Arena(const Arena&) = delete;
+
+  Arena& operator=(const Arena&) = delete;
+
+  // The arena that the nodes created by the current thread are allocated from,
+  // if any.
+  static Arena*& current() {
+    static thread_local Arena* arena = nullptr;
+    return arena;
+  }
+
+  bool full() const { return m_reserved >= m_capacity; }
+
+  void* allocate(size_t size, size_t alignment) {
+    m_live.fetch_add(1, std::memory_order_relaxed);
+    size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+    if (m_chunks.empty() || offset + size > m_chunk_size) {
+      m_chunk_size = size > kChunkSize ? size : kChunkSize;
+      m_chunks.emplace_back(new char[m_chunk_size]);
+      m_reserved += m_chunk_size;
+      offset = 0;
+    }
+    m_offset = offset + size;
+    return m_chunks.back().get() + offset;
+  }
+
+  // Called once per allocated node, and once by the owner of the arena when
+  // its scope ends.
+  void release() {
+    if (m_live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  ~Arena() = default;
+
+  const size_t m_capacity;
+  std::vector<std::unique_ptr<char[]>> m_chunks;
+  size_t m_chunk_size{0};
+  size_t m_offset{0};
+  size_t m_reserved{0};
+  std::atomic<size_t> m_live{1};
+};
+
+template <typename T>
+class ArenaAllocator final {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) : m_arena(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "Over-aligned nodes are not supported");
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) { m_arena->release(); }
+
+  Arena* arena() const { return m_arena; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return m_arena == other.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return m_arena != other.arena();
+  }
+
+ private:
+  Arena* m_arena;
+};
+
+// Creates a node of a Patricia tree, in the arena of the current thread when
+// there is one with some capacity left, on the heap otherwise.
+template <typename Node, typename... Args>
+std::shared_ptr<Node> allocate_node(Args&&... args) {
+  Arena* arena = Arena::current();
+  if (arena == nullptr || arena->full()) {
+    return std::make_shared<Node>(std::forward<Args>(args)...);
+  }
+  return std::allocate_shared<Node>(ArenaAllocator<Node>(arena),
+                                    std::forward<Args>(args)...);
+}
+
+} // namespace pt_util
+
+/*
+ * While an instance of this class is alive, the nodes of the Patricia-tree
+ * sets and maps that the current thread creates are allocated from a common
+ * arena instead of the heap. This is meant for the analyses whose abstract
+ * states mostly die together, e.g. an intraprocedural fixpoint iteration over
+ * a method: building the nodes then takes a pointer bump, and their memory is
+ * given back all at once.
+ *
+ * The nodes are never reclaimed individually, so the arena only grows until
+ * it reaches its capacity, after which nodes are allocated from the heap
+ * again. Trees that outlive the scope remain valid, but they keep the whole
+ * arena alive, which makes it a poor fit for the analyses that hold on to
+ * their results. Scopes can be nested on the same thread.
+ *
+ * Example:
+ *
+ *   {
+ *     PatriciaTreeArena arena;
+ *     FixpointIterator fp_iter(cfg);
+ *     fp_iter.run(Environment());
+ *     ...
+ *   }
+ */
+class PatriciaTreeArena final {
+ public:
+  static constexpr size_t kDefaultCapacity = 32 * 1024 * 1024;
+
+  explicit PatriciaTreeArena(size_t capacity = kDefaultCapacity)
+      : m_arena(new pt_util::Arena(capacity)),
+        m_previous(pt_util::Arena::current()) {
+    pt_util::Arena::current() = m_arena;
+  }
+
+  PatriciaTreeArena(const PatriciaTreeArena&) = delete;
+
+  PatriciaTreeArena& operator=(const PatriciaTreeArena&) = delete;
+
+  ~PatriciaTreeArena() {
+    pt_util::Arena::current() = m_previous;
+    m_arena->release();
+  }
+
+ private:
+  pt_util::Arena* m_arena;
+  pt_util::Arena* m_previous;
+};
+
+} // namespace sparta
@@ -19,6 +19,7 @@
 #include <utility>
 
 #include "AbstractDomain.h"
+#include "PatriciaTreeArena.h"
 #include "PatriciaTreeUtil.h"
 
 // Forward declarations
@@ -496,10 +497,10 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
     const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -518,7 +519,7 @@ std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+  return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -810,7 +811,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -820,14 +821,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(combine, s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
           p, m, s0, new_right);
     }
   }
@@ -838,14 +839,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(combine, s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return allocate_node<PatriciaTreeBranch<IntegerType, Value>>(
           q, n, t0, new_right);
     }
   }
@@ -864,7 +865,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_leaf(
     return nullptr;
   }
   if (!Value::equals(combined_value, leaf->value())) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
+    return allocate_node<PatriciaTreeLeaf<IntegerType, Value>>(
         leaf->key(), combined_value);
   }
   return leaf;
@@ -876,7 +877,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value) {
-  auto new_leaf = std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
+  auto new_leaf = allocate_node<PatriciaTreeLeaf<IntegerType, Value>>(
       key, Value::default_value());
   return combine_leaf(combine, value, new_leaf);
 }
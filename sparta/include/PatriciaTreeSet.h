@@ -8,20 +8,25 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <stack>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 #include <boost/functional/hash.hpp>
 
 #include "Exceptions.h"
+#include "PatriciaTreeArena.h"
 #include "PatriciaTreeUtil.h"
 
 namespace sparta {
@@ -38,6 +43,9 @@ class PatriciaTreeLeaf;
 template <typename IntegerType>
 class PatriciaTreeIterator;
 
+template <typename IntegerType>
+class NodeTable;
+
 template <typename IntegerType>
 inline bool contains(IntegerType key,
                      const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
@@ -256,6 +264,24 @@ class PatriciaTreeSet final {
 
   void clear() { m_tree.reset(); }
 
+  /*
+   * When hash-consing is enabled, the nodes of the Patricia trees are looked
+   * up in a global table before being created, so that the sets that are
+   * constructed independently but contain the same elements are represented by
+   * the same tree. The equality, inclusion, union and intersection tests then
+   * short-circuit on them, at the cost of a table lookup per node creation.
+   * This is a property of the representation only: the semantics of all the
+   * operations are the same either way. The setting is shared by all the sets
+   * with the same IntegerType, and it is off by default.
+   */
+  static void set_hash_consing(bool enabled) {
+    pt_impl::NodeTable<IntegerType>::get().set_enabled(enabled);
+  }
+
+  static bool hash_consing() {
+    return pt_impl::NodeTable<IntegerType>::get().enabled();
+  }
+
   friend std::ostream& operator<<(std::ostream& o,
                                   const PatriciaTreeSet<Element>& s) {
     o << "{";
@@ -409,18 +435,137 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
   IntegerType m_key;
 };
 
+// The table of the nodes that are shared when hash-consing is enabled. It only
+// holds weak references, so that the nodes that are no longer part of any tree
+// get freed, and it is split into shards to limit the contention among the
+// threads that build trees concurrently. Two nodes are only equated when their
+// subtrees are themselves the same objects, so that a lookup takes constant
+// time: this is enough to share all the nodes built while the table is enabled,
+// since their subtrees have been looked up first.
+template <typename IntegerType>
+class NodeTable final {
+ public:
+  static NodeTable& get() {
+    static NodeTable table;
+    return table;
+  }
+
+  bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+  void set_enabled(bool enabled) {
+    m_enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  std::shared_ptr<PatriciaTree<IntegerType>> intern(
+      std::shared_ptr<PatriciaTree<IntegerType>> tree) {
+    auto& shard = m_shards[tree->hash() % kNumShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.nodes.equal_range(tree->hash());
+    for (auto it = range.first; it != range.second; ++it) {
+      auto node = it->second.lock();
+      if (node != nullptr && same_node(node, tree)) {
+        return node;
+      }
+    }
+    shard.nodes.emplace(tree->hash(), tree);
+    if (shard.nodes.size() >= shard.purge_threshold) {
+      purge(&shard);
+    }
+    return tree;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_multimap<size_t, std::weak_ptr<PatriciaTree<IntegerType>>>
+        nodes;
+    size_t purge_threshold{kMinPurgeThreshold};
+  };
+
+  static constexpr size_t kNumShards = 31;
+  static constexpr size_t kMinPurgeThreshold = 1024;
+
+  NodeTable() = default;
+
+  static bool same_node(const std::shared_ptr<PatriciaTree<IntegerType>>& t1,
+                        const std::shared_ptr<PatriciaTree<IntegerType>>& t2) {
+    if (t1->is_leaf() != t2->is_leaf()) {
+      return false;
+    }
+    if (t1->is_leaf()) {
+      return std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t1)
+                 ->key() ==
+             std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t2)
+                 ->key();
+    }
+    const auto& b1 =
+        std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t1);
+    const auto& b2 =
+        std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t2);
+    return b1->prefix() == b2->prefix() &&
+           b1->branching_bit() == b2->branching_bit() &&
+           b1->left_tree() == b2->left_tree() &&
+           b1->right_tree() == b2->right_tree();
+  }
+
+  // Drops the references to the nodes that have been freed. The threshold
+  // grows with the number of live nodes, so that purging takes amortized
+  // constant time per insertion.
+  static void purge(Shard* shard) {
+    for (auto it = shard->nodes.begin(); it != shard->nodes.end();) {
+      if (it->second.expired()) {
+        it = shard->nodes.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    shard->purge_threshold =
+        std::max(kMinPurgeThreshold, 2 * shard->nodes.size());
+  }
+
+  std::atomic<bool> m_enabled{false};
+  std::array<Shard, kNumShards> m_shards;
+};
+
+template <typename IntegerType>
+constexpr size_t NodeTable<IntegerType>::kNumShards;
+
+template <typename IntegerType>
+constexpr size_t NodeTable<IntegerType>::kMinPurgeThreshold;
+
+template <typename IntegerType>
+std::shared_ptr<PatriciaTree<IntegerType>> make_leaf(IntegerType key) {
+  std::shared_ptr<PatriciaTree<IntegerType>> leaf =
+      allocate_node<PatriciaTreeLeaf<IntegerType>>(key);
+  auto& table = NodeTable<IntegerType>::get();
+  return table.enabled() ? table.intern(std::move(leaf)) : leaf;
+}
+
+template <typename IntegerType>
+std::shared_ptr<PatriciaTree<IntegerType>> make_branch_node(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    const std::shared_ptr<PatriciaTree<IntegerType>>& left_tree,
+    const std::shared_ptr<PatriciaTree<IntegerType>>& right_tree) {
+  std::shared_ptr<PatriciaTree<IntegerType>> branch =
+      allocate_node<PatriciaTreeBranch<IntegerType>>(
+          prefix, branching_bit, left_tree, right_tree);
+  auto& table = NodeTable<IntegerType>::get();
+  return table.enabled() ? table.intern(std::move(branch)) : branch;
+}
+
 template <typename IntegerType>
-std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
+std::shared_ptr<PatriciaTree<IntegerType>> join(
     IntegerType prefix0,
     const std::shared_ptr<PatriciaTree<IntegerType>>& tree0,
     IntegerType prefix1,
     const std::shared_ptr<PatriciaTree<IntegerType>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return make_branch_node<IntegerType>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return make_branch_node<IntegerType>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -439,7 +584,7 @@ std::shared_ptr<PatriciaTree<IntegerType>> make_branch(
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+  return make_branch_node<IntegerType>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -557,7 +702,7 @@ template <typename IntegerType>
 inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType>>(key);
+    return make_leaf<IntegerType>(key);
   }
   if (tree->is_leaf()) {
     const auto& leaf =
@@ -567,7 +712,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
     return join<IntegerType>(
         key,
-        std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+        make_leaf<IntegerType>(key),
         leaf->key(),
         leaf);
   }
@@ -579,7 +724,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_left_tree == branch->left_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           new_left_tree,
@@ -589,7 +734,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_right_tree == branch->right_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           branch->left_tree(),
@@ -597,7 +742,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
   }
   return join<IntegerType>(key,
-                           std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+                           make_leaf<IntegerType>(key),
                            branch->prefix(),
                            branch);
 }
@@ -721,7 +866,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return make_branch_node<IntegerType>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -731,14 +876,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           p, m, s0, new_right);
     }
   }
@@ -749,14 +894,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return make_branch_node<IntegerType>(
           q, n, t0, new_right);
     }
   }
@@ -15,6 +15,7 @@
 #include <iomanip>
 #include <istream>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <ostream>
 #include <sstream>
@@ -25,8 +26,10 @@
 #include <boost/functional/hash.hpp>
 #include <boost/functional/hash_fwd.hpp>
 #include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include "Exceptions.h"
+#include "PatriciaTreeArena.h"
 
 namespace sparta {
 
@@ -183,6 +186,9 @@ class s_expr final {
   friend size_t hash_value(const s_expr& e) { return e.hash_value(); }
 
  private:
+  explicit s_expr(std::shared_ptr<s_expr_impl::Component> component)
+      : m_component(std::move(component)) {}
+
   // Appends an element to a list. This operation is used during parsing.
   void add_element(const s_expr& element);
 
@@ -190,6 +196,7 @@ class s_expr final {
   std::shared_ptr<s_expr_impl::Component> m_component;
 
   friend class s_expr_istream;
+  friend class s_expr_parser;
 };
 
 } // namespace sparta
@@ -267,6 +274,74 @@ class s_expr_istream final {
   std::string m_what;
 };
 
+/*
+ * Parses S-expressions directly out of a character buffer, with the same
+ * syntax and status interface as s_expr_istream. This is several times faster
+ * than going through a stream: the buffer is scanned in place, and the
+ * components of the S-expressions are allocated from an arena, which is freed
+ * when the last of them is gone. The buffer must outlive the parser, but not
+ * the S-expressions it returns.
+ *
+ * Example usage:
+ *   s_expr_parser parser("(a b) (c)");
+ *   s_expr e1, e2;
+ *   parser >> e1 >> e2;
+ */
+class s_expr_parser final {
+ public:
+  explicit s_expr_parser(boost::string_view text)
+      : m_text(text),
+        m_arena(new pt_util::Arena(kArenaCapacity)),
+        m_line_number(1),
+        m_status(Status::Good),
+        m_what("OK") {}
+
+  s_expr_parser(const s_expr_parser&) = delete;
+
+  s_expr_parser& operator=(const s_expr_parser&) = delete;
+
+  ~s_expr_parser() { m_arena->release(); }
+
+  s_expr_parser& operator>>(s_expr& expr);
+
+  bool good() const { return m_status == Status::Good; }
+
+  bool fail() const { return m_status != Status::Good; }
+
+  bool eoi() const { return m_status == Status::EOI; }
+
+  const std::string& what() const { return m_what; }
+
+ private:
+  enum class Status { EOI, Good, Fail };
+
+  // Past this, the components are allocated on the heap so that the arena
+  // doesn't pin too much memory when a few of them are kept around.
+  static constexpr size_t kArenaCapacity = 1024 * 1024;
+
+  template <typename Component, typename... Args>
+  s_expr make(Args&&... args);
+
+  void skip_white_spaces();
+
+  bool parse_int32(int32_t* n);
+
+  bool parse_quoted(std::string* s);
+
+  void set_status(Status status, const std::string& what_arg);
+
+  boost::string_view m_text;
+  size_t m_pos{0};
+  pt_util::Arena* m_arena;
+  // The elements of the lists being parsed, by depth. The vectors are reused
+  // from one list to the next.
+  std::vector<std::vector<s_expr>> m_stack;
+  size_t m_depth{0};
+  size_t m_line_number;
+  Status m_status;
+  std::string m_what;
+};
+
 /*
  * S-expressions are primarily intended to be used as a serialization format for
  * complex data structures. When deserializing an S-expression, it would be very
@@ -857,6 +932,174 @@ inline void s_expr_istream::set_status(Status status,
   m_what = ss.str();
 }
 
+template <typename Component, typename... Args>
+inline s_expr s_expr_parser::make(Args&&... args) {
+  if (m_arena->full()) {
+    return s_expr(std::make_shared<Component>(std::forward<Args>(args)...));
+  }
+  return s_expr(
+      std::allocate_shared<Component>(pt_util::ArenaAllocator<Component>(m_arena),
+                                      std::forward<Args>(args)...));
+}
+
+inline s_expr_parser& s_expr_parser::operator>>(s_expr& expr) {
+  for (;;) {
+    skip_white_spaces();
+    if (m_pos >= m_text.size()) {
+      if (m_depth > 0) {
+        set_status(Status::Fail, "Incomplete S-expression");
+      } else {
+        set_status(Status::EOI, "End of input");
+      }
+      return *this;
+    }
+    char next_char = m_text[m_pos];
+    // Not default-constructed, which would allocate an empty list.
+    s_expr atom{std::shared_ptr<s_expr_impl::Component>()};
+    switch (next_char) {
+    case '(': {
+      ++m_pos;
+      if (m_depth == m_stack.size()) {
+        m_stack.emplace_back();
+      }
+      m_stack[m_depth++].clear();
+      continue;
+    }
+    case ')': {
+      if (m_depth == 0) {
+        set_status(Status::Fail, "Extra ')' encountered");
+        return *this;
+      }
+      ++m_pos;
+      auto& elements = m_stack[--m_depth];
+      atom = make<s_expr_impl::List>(std::make_move_iterator(elements.begin()),
+                                     std::make_move_iterator(elements.end()));
+      elements.clear();
+      break;
+    }
+    case '#': {
+      ++m_pos;
+      int32_t n;
+      if (!parse_int32(&n)) {
+        set_status(Status::Fail, "Error parsing int32_t literal");
+        return *this;
+      }
+      atom = make<s_expr_impl::Int32Atom>(n);
+      break;
+    }
+    case '"': {
+      std::string s;
+      if (!parse_quoted(&s)) {
+        set_status(Status::Fail, "Error parsing string literal");
+        return *this;
+      }
+      atom = make<s_expr_impl::StringAtom>(s);
+      break;
+    }
+    case ';': {
+      auto end = m_text.find('\n', m_pos);
+      m_pos = end == boost::string_view::npos ? m_text.size() : end + 1;
+      ++m_line_number;
+      continue;
+    }
+    default: {
+      // The next S-expression is necessary a symbol, i.e., an unquoted string.
+      if (!s_expr_impl::is_symbol_char(next_char)) {
+        std::ostringstream out;
+        out << "Unexpected character encountered: '" << next_char << "'";
+        set_status(Status::Fail, out.str());
+        return *this;
+      }
+      size_t begin = m_pos;
+      while (m_pos < m_text.size() &&
+             s_expr_impl::is_symbol_char(m_text[m_pos])) {
+        ++m_pos;
+      }
+      atom = make<s_expr_impl::StringAtom>(
+          m_text.substr(begin, m_pos - begin).to_string());
+    }
+    }
+    if (m_depth == 0) {
+      expr = std::move(atom);
+      return *this;
+    }
+    m_stack[m_depth - 1].push_back(std::move(atom));
+  }
+}
+
+inline void s_expr_parser::skip_white_spaces() {
+  while (m_pos < m_text.size() && std::isspace(m_text[m_pos])) {
+    if (m_text[m_pos] == '\n') {
+      ++m_line_number;
+    }
+    ++m_pos;
+  }
+}
+
+// Accepts what `std::istream >> int32_t` does.
+inline bool s_expr_parser::parse_int32(int32_t* n) {
+  skip_white_spaces();
+  bool negative = false;
+  if (m_pos < m_text.size() && (m_text[m_pos] == '-' || m_text[m_pos] == '+')) {
+    negative = m_text[m_pos++] == '-';
+  }
+  int64_t value = 0;
+  size_t begin = m_pos;
+  while (m_pos < m_text.size() && std::isdigit(m_text[m_pos])) {
+    value = value * 10 + (m_text[m_pos++] - '0');
+    if (value > static_cast<int64_t>(std::numeric_limits<int32_t>::max()) + 1) {
+      return false;
+    }
+  }
+  if (m_pos == begin) {
+    return false;
+  }
+  value = negative ? -value : value;
+  if (value > std::numeric_limits<int32_t>::max()) {
+    return false;
+  }
+  *n = static_cast<int32_t>(value);
+  return true;
+}
+
+// Accepts what `std::istream >> std::quoted(s)` does: a backslash escapes the
+// character that follows it.
+inline bool s_expr_parser::parse_quoted(std::string* s) {
+  ++m_pos;
+  size_t begin = m_pos;
+  while (m_pos < m_text.size() && m_text[m_pos] != '"' &&
+         m_text[m_pos] != '\\') {
+    ++m_pos;
+  }
+  s->assign(m_text.data() + begin, m_pos - begin);
+  m_line_number += std::count(s->begin(), s->end(), '\n');
+  while (m_pos < m_text.size()) {
+    char c = m_text[m_pos++];
+    if (c == '"') {
+      return true;
+    }
+    if (c == '\\') {
+      if (m_pos == m_text.size()) {
+        return false;
+      }
+      c = m_text[m_pos++];
+    }
+    if (c == '\n') {
+      ++m_line_number;
+    }
+    s->push_back(c);
+  }
+  return false;
+}
+
+inline void s_expr_parser::set_status(Status status,
+                                      const std::string& what_arg) {
+  m_status = status;
+  std::ostringstream ss;
+  ss << "On line " << m_line_number << ": " << what_arg;
+  m_what = ss.str();
+}
+
 inline s_patn::s_patn()
     : m_pattern(std::make_shared<s_expr_impl::WildcardPattern>()) {}
 
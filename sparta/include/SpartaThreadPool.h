@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+namespace sparta {
+
+namespace parallel {
+
+/*
+ * A process-wide pool of persistent worker threads.
+ *
+ * Work queues used to spawn (and join) a fresh set of threads every time they
+ * were run. With many short parallel phases in a row, the thread creation and
+ * the associated stack allocations dominate. Instead, work queues now borrow
+ * threads from this pool, which keeps them parked between runs.
+ *
+ * `run(n, f)` executes `f(0)`, ..., `f(n - 1)` concurrently, each on its own
+ * pool thread, and blocks until all of them have returned. If fewer than `n`
+ * threads are idle (e.g. because `run` is called from within a pool thread, or
+ * from several threads at once), the pool grows; threads are never retired
+ * before the pool is destroyed at process exit.
+ *
+ * When `run` is called from one of the pool's own threads (i.e. from within
+ * another parallel region), the calling thread executes `f(0)` itself instead
+ * of blocking idly. Use `available_width` to size such nested regions to the
+ * threads that are actually idle, rather than growing the pool.
+ *
+ * If any invocation throws, the first exception is rethrown by `run` once all
+ * invocations are done.
+ */
+class ThreadPool {
+ public:
+  // Matches the stack size Redex has always used for its worker threads.
+  static constexpr size_t kStackSize = 8 * 1024 * 1024;
+
+  static ThreadPool& get() {
+    static ThreadPool s_pool;
+    return s_pool;
+  }
+
+  ThreadPool() = default;
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_shutdown = true;
+    }
+    for (auto& worker : m_workers) {
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        worker->cv.notify_one();
+      }
+      worker->thread.join();
+    }
+  }
+
+  void run(size_t n, const std::function<void(size_t)>& f) {
+    if (n == 0) {
+      return;
+    }
+    bool nested = is_pool_thread();
+    size_t first = nested ? 1 : 0;
+    Batch batch(n - first);
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      for (size_t i = first; i < n; ++i) {
+        Worker* worker;
+        if (m_idle.empty()) {
+          m_workers.emplace_back(new Worker());
+          worker = m_workers.back().get();
+          boost::thread::attributes attrs;
+          attrs.set_stack_size(kStackSize);
+          worker->thread =
+              boost::thread(attrs, [this, worker]() { worker_loop(worker); });
+        } else {
+          worker = m_idle.back();
+          m_idle.pop_back();
+        }
+        worker->fn = &f;
+        worker->index = i;
+        worker->batch = &batch;
+        worker->cv.notify_one();
+      }
+    }
+    if (nested) {
+      try {
+        f(0);
+      } catch (...) {
+        batch.set_exception(std::current_exception());
+      }
+    }
+    batch.wait();
+    if (batch.exception) {
+      std::rethrow_exception(batch.exception);
+    }
+  }
+
+  /*
+   * The number of threads a parallel region asking for `requested` threads
+   * should use. Outside of the pool, that is all of them. From within a pool
+   * thread, it is the calling thread plus the currently idle ones, so that
+   * nested regions reuse parked threads instead of oversubscribing the
+   * machine. This is only a snapshot; `run` remains correct (if slower) when
+   * the idle threads get taken in the meantime.
+   */
+  size_t available_width(size_t requested) const {
+    if (!is_pool_thread() || requested <= 1) {
+      return requested;
+    }
+    return std::min(requested, 1 + num_idle());
+  }
+
+  // Whether the calling thread belongs to a ThreadPool.
+  static bool is_pool_thread() { return pool_thread_flag(); }
+
+  // Total number of threads owned by the pool, idle or not.
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_workers.size();
+  }
+
+  // Number of threads currently parked and ready to accept work.
+  size_t num_idle() const {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_idle.size();
+  }
+
+ private:
+  // Tracks completion of the n invocations submitted by one `run` call.
+  struct Batch {
+    explicit Batch(size_t n) : remaining(n) {}
+
+    void count_down() {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (--remaining == 0) {
+        cv.notify_one();
+      }
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this]() { return remaining == 0; });
+    }
+
+    void set_exception(std::exception_ptr e) {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (!exception) {
+        exception = e;
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t remaining;
+    std::exception_ptr exception;
+  };
+
+  struct Worker {
+    boost::thread thread;
+    std::condition_variable cv;
+    // The pending invocation, if any. Guarded by the pool's mutex.
+    const std::function<void(size_t)>* fn{nullptr};
+    size_t index{0};
+    Batch* batch{nullptr};
+  };
+
+  static bool& pool_thread_flag() {
+    static thread_local bool s_is_pool_thread{false};
+    return s_is_pool_thread;
+  }
+
+  void worker_loop(Worker* worker) {
+    pool_thread_flag() = true;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      worker->cv.wait(lock, [this, worker]() {
+        return m_shutdown || worker->fn != nullptr;
+      });
+      if (worker->fn == nullptr) {
+        assert(m_shutdown);
+        return;
+      }
+      auto fn = worker->fn;
+      auto index = worker->index;
+      auto batch = worker->batch;
+      worker->fn = nullptr;
+      worker->batch = nullptr;
+      lock.unlock();
+      try {
+        (*fn)(index);
+      } catch (...) {
+        batch->set_exception(std::current_exception());
+      }
+      lock.lock();
+      // Park before signalling completion, so that a `run` call issued right
+      // after this batch finishes finds this thread idle instead of spawning
+      // a new one.
+      m_idle.push_back(worker);
+      lock.unlock();
+      batch->count_down();
+      lock.lock();
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<Worker*> m_idle;
+  bool m_shutdown{false};
+};
+
+} // namespace parallel
+
+} // namespace sparta
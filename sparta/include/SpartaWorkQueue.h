@@ -11,12 +11,15 @@
 #include <atomic>
 #include <boost/optional/optional.hpp>
 #include <chrono>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <numeric>
-#include <queue>
 #include <random>
 #include <thread>
 
+#include "SpartaThreadPool.h"
+
 namespace sparta {
 
 namespace parallel {
@@ -33,8 +36,15 @@ static inline unsigned int default_num_threads() {
 
 namespace workqueue_impl {
 
-static std::atomic_uint num_non_empty{0};
-static std::atomic_uint num_running{0};
+/*
+ * Bookkeeping shared by all the workers of one SpartaWorkQueue, used to detect
+ * termination. Each queue has its own, so that several queues can run
+ * concurrently or nested within one another.
+ */
+struct Counters {
+  std::atomic_uint num_non_empty{0};
+  std::atomic_uint num_running{0};
+};
 
 /**
  * Creates a random ordering of which threads to visit.  This prevents threads
@@ -60,7 +70,12 @@ inline std::vector<unsigned int> create_permutation(unsigned int num,
 template <class Input>
 class SpartaWorkerState {
  public:
-  SpartaWorkerState(size_t id) : m_id(id) {}
+  using Priority = std::function<uint64_t(const Input&)>;
+
+  SpartaWorkerState(size_t id,
+                    workqueue_impl::Counters* counters,
+                    Priority priority = nullptr)
+      : m_id(id), m_counters(counters), m_priority(std::move(priority)) {}
 
   /*
    * Add more items to the queue of the currently-running worker. When a
@@ -70,19 +85,19 @@ class SpartaWorkerState {
   void push_task(Input task) {
     std::lock_guard<std::mutex> guard(m_queue_mtx);
     if (m_queue.empty()) {
-      ++workqueue_impl::num_non_empty;
+      ++m_counters->num_non_empty;
     }
-    m_queue.push(task);
+    push(std::move(task));
   }
 
   size_t worker_id() const { return m_id; }
 
   void set_running(bool running) {
     if (m_running && !running) {
-      assert(workqueue_impl::num_running > 0);
-      --workqueue_impl::num_running;
+      assert(m_counters->num_running > 0);
+      --m_counters->num_running;
     } else if (!m_running && running) {
-      ++workqueue_impl::num_running;
+      ++m_counters->num_running;
     }
     m_running = running;
   };
@@ -93,19 +108,47 @@ class SpartaWorkerState {
     if (!m_queue.empty()) {
       other->set_running(true);
       if (m_queue.size() == 1) {
-        assert(workqueue_impl::num_non_empty > 0);
-        --workqueue_impl::num_non_empty;
+        assert(m_counters->num_non_empty > 0);
+        --m_counters->num_non_empty;
       }
+      return pop();
+    }
+    return boost::none;
+  }
+
+  // Without a priority, the tasks are processed in FIFO order. Otherwise, the
+  // queue is a max-heap.
+  void push(Input task) {
+    m_queue.push_back(std::move(task));
+    if (m_priority) {
+      std::push_heap(m_queue.begin(), m_queue.end(), LowerPriority{m_priority});
+    }
+  }
+
+  Input pop() {
+    if (!m_priority) {
       auto task = std::move(m_queue.front());
-      m_queue.pop();
+      m_queue.pop_front();
       return task;
     }
-    return boost::none;
+    std::pop_heap(m_queue.begin(), m_queue.end(), LowerPriority{m_priority});
+    auto task = std::move(m_queue.back());
+    m_queue.pop_back();
+    return task;
   }
 
+  struct LowerPriority {
+    const Priority& priority;
+    bool operator()(const Input& a, const Input& b) const {
+      return priority(a) < priority(b);
+    }
+  };
+
   size_t m_id;
+  workqueue_impl::Counters* m_counters;
+  Priority m_priority;
   bool m_running{false};
-  std::queue<Input> m_queue;
+  std::deque<Input> m_queue;
   std::mutex m_queue_mtx;
 
   template <class>
@@ -119,6 +162,8 @@ class SpartaWorkQueue {
   Executor m_executor;
 
   std::vector<std::unique_ptr<SpartaWorkerState<Input>>> m_states;
+  // Heap-allocated so that SpartaWorkQueue stays movable.
+  std::unique_ptr<workqueue_impl::Counters> m_counters;
 
   const size_t m_num_threads{1};
   size_t m_insert_idx{0};
@@ -128,12 +173,22 @@ class SpartaWorkQueue {
   }
 
  public:
+  using Priority = typename SpartaWorkerState<Input>::Priority;
+
   SpartaWorkQueue(Executor, unsigned int num_threads);
 
+  /*
+   * Each worker processes the tasks in its queue by decreasing priority. The
+   * order is only best-effort across workers, since the idle ones steal from
+   * the others regardless of the priorities.
+   */
+  SpartaWorkQueue(Executor, unsigned int num_threads, Priority priority);
+
   void add_item(Input task);
 
   /**
-   * Spawn threads and evaluate function.  This method blocks.
+   * Run the executor on threads borrowed from the process-wide ThreadPool.
+   * This method blocks.
    */
   void run_all();
 };
@@ -141,10 +196,19 @@ class SpartaWorkQueue {
 template <class Input>
 SpartaWorkQueue<Input>::SpartaWorkQueue(SpartaWorkQueue::Executor executor,
                                         unsigned int num_threads)
-    : m_executor(executor), m_num_threads(num_threads) {
+    : SpartaWorkQueue(executor, num_threads, nullptr) {}
+
+template <class Input>
+SpartaWorkQueue<Input>::SpartaWorkQueue(SpartaWorkQueue::Executor executor,
+                                        unsigned int num_threads,
+                                        SpartaWorkQueue::Priority priority)
+    : m_executor(executor),
+      m_counters(std::make_unique<workqueue_impl::Counters>()),
+      m_num_threads(num_threads) {
   assert(num_threads >= 1);
   for (unsigned int i = 0; i < m_num_threads; ++i) {
-    m_states.emplace_back(std::make_unique<SpartaWorkerState<Input>>(i));
+    m_states.emplace_back(std::make_unique<SpartaWorkerState<Input>>(
+        i, m_counters.get(), priority));
   }
 }
 
@@ -164,7 +228,7 @@ template <class Input>
 void SpartaWorkQueue<Input>::add_item(Input task) {
   m_insert_idx = (m_insert_idx + 1) % m_num_threads;
   assert(m_insert_idx < m_states.size());
-  m_states[m_insert_idx]->m_queue.push(task);
+  m_states[m_insert_idx]->push(std::move(task));
 }
 
 /*
@@ -173,9 +237,9 @@ void SpartaWorkQueue<Input>::add_item(Input task) {
  */
 template <class Input>
 void SpartaWorkQueue<Input>::run_all() {
-  std::vector<std::thread> all_threads;
-  workqueue_impl::num_non_empty = 0;
-  workqueue_impl::num_running = 0;
+  auto& counters = *m_counters;
+  counters.num_non_empty = 0;
+  counters.num_running = 0;
   auto worker = [&](SpartaWorkerState<Input>* state, size_t state_idx) {
     auto attempts =
         workqueue_impl::create_permutation(m_num_threads, state_idx);
@@ -195,8 +259,7 @@ void SpartaWorkQueue<Input>::run_all() {
       }
       // Let the thread quit if all the threads are not running and there
       // is no task in any queue.
-      if (workqueue_impl::num_running == 0 &&
-          workqueue_impl::num_non_empty == 0) {
+      if (counters.num_running == 0 && counters.num_non_empty == 0) {
         return;
       }
     }
@@ -204,16 +267,14 @@ void SpartaWorkQueue<Input>::run_all() {
 
   for (size_t i = 0; i < m_num_threads; ++i) {
     if (!m_states[i]->m_queue.empty()) {
-      ++workqueue_impl::num_non_empty;
+      ++counters.num_non_empty;
     }
   }
-  for (size_t i = 0; i < m_num_threads; ++i) {
-    all_threads.emplace_back(std::bind<void>(worker, m_states[i].get(), i));
-  }
-
-  for (auto& thread : all_threads) {
-    thread.join();
-  }
+  // Every worker visits all the queues, so running fewer workers than there
+  // are queues (when nested within another parallel region) is fine.
+  auto& pool = parallel::ThreadPool::get();
+  pool.run(pool.available_width(m_num_threads),
+           [&](size_t i) { worker(m_states[i].get(), i); });
 }
 
 } // namespace sparta
@@ -8,13 +8,16 @@
 #pragma once
 
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <future>
 #include <iterator>
 #include <limits>
 #include <ostream>
 #include <stack>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Exceptions.h"
@@ -30,10 +33,16 @@ class WeakTopologicalOrdering;
 
 namespace wto_impl {
 
-// Forward declaration
-template <typename NodeId, typename NodeHash, typename SuccFn>
+// Forward declarations
+template <typename NodeId, typename SuccFn, typename DfnMap>
 class WtoBuilder;
 
+template <typename NodeId, typename NodeHash>
+class HashedDfnMap;
+
+template <typename NodeId, typename IndexFn>
+class IndexedDfnMap;
+
 /*
  * Iterator over the subcomponents of a strongly connected component (head
  * node excluded). This is a regular C++ iterator meant for traversing a
@@ -194,20 +203,32 @@ class WeakTopologicalOrdering final {
    */
   template <typename SuccFn>
   WeakTopologicalOrdering(const NodeId& root, SuccFn successors) {
-    if (successors(root).empty()) {
-      // If the CFG consists of a single node with no control-flow edges, we
-      // don't need to run the general algorithm. This avoids building all the
-      // auxiliary data structures required by Bourdoncle's algorithm.
-      // This optimization benefits the simple parallel fixpoint iterator, which
-      // computes a WTO for each toplevel component of the CFG, most of them
-      // single nodes in practice.
-      m_components.emplace_back(root, WtoComponent<NodeId>::Kind::Vertex,
-                                /* position */ 0,
-                                /* next_component_position */ -1);
+    if (is_single_node(root, successors)) {
+      return;
+    }
+    wto_impl::WtoBuilder<NodeId, SuccFn,
+                         wto_impl::HashedDfnMap<NodeId, NodeHash>>
+        builder(successors, &m_components, {});
+    builder.build(root);
+  }
+
+  /*
+   * The same, for graphs whose nodes have dense indices, like the blocks of a
+   * control-flow graph: `index(node)` must be distinct for each node and lower
+   * than `num_nodes`. The depth-first numbers of the nodes are then kept in a
+   * vector rather than in a hash table.
+   */
+  template <typename SuccFn, typename IndexFn>
+  WeakTopologicalOrdering(const NodeId& root,
+                          SuccFn successors,
+                          size_t num_nodes,
+                          IndexFn index) {
+    if (is_single_node(root, successors)) {
       return;
     }
-    wto_impl::WtoBuilder<NodeId, NodeHash, SuccFn> builder(successors,
-                                                           &m_components);
+    wto_impl::WtoBuilder<NodeId, SuccFn,
+                         wto_impl::IndexedDfnMap<NodeId, IndexFn>>
+        builder(successors, &m_components, {num_nodes, index});
     builder.build(root);
   }
 
@@ -238,6 +259,23 @@ class WeakTopologicalOrdering final {
   }
 
  private:
+  template <typename SuccFn>
+  bool is_single_node(const NodeId& root, SuccFn& successors) {
+    if (!successors(root).empty()) {
+      return false;
+    }
+    // If the CFG consists of a single node with no control-flow edges, we
+    // don't need to run the general algorithm. This avoids building all the
+    // auxiliary data structures required by Bourdoncle's algorithm.
+    // This optimization benefits the simple parallel fixpoint iterator, which
+    // computes a WTO for each toplevel component of the CFG, most of them
+    // single nodes in practice.
+    m_components.emplace_back(root, WtoComponent<NodeId>::Kind::Vertex,
+                              /* position */ 0,
+                              /* next_component_position */ -1);
+    return true;
+  }
+
   // We store all the components of a WTO inside a vector. This is more
   // efficient than allocating each component individually on the heap.
   // It's also more cache-friendly when repeatedly traversing the WTO during
@@ -247,96 +285,183 @@ class WeakTopologicalOrdering final {
 
 namespace wto_impl {
 
-template <typename NodeId, typename NodeHash, typename SuccFn>
+// The depth-first numbers of the nodes, 0 for nodes not numbered (yet).
+template <typename NodeId, typename NodeHash>
+class HashedDfnMap final {
+ public:
+  uint32_t get(const NodeId& node) const {
+    auto it = m_dfn.find(node);
+    return it == m_dfn.end() ? 0 : it->second;
+  }
+
+  void set(const NodeId& node, uint32_t number) {
+    if (number == 0) {
+      m_dfn.erase(node);
+    } else {
+      m_dfn[node] = number;
+    }
+  }
+
+ private:
+  std::unordered_map<NodeId, uint32_t, NodeHash> m_dfn;
+};
+
+template <typename NodeId, typename IndexFn>
+class IndexedDfnMap final {
+ public:
+  IndexedDfnMap(size_t num_nodes, IndexFn index)
+      : m_dfn(num_nodes, 0), m_index(index) {}
+
+  uint32_t get(const NodeId& node) const { return m_dfn[m_index(node)]; }
+
+  void set(const NodeId& node, uint32_t number) {
+    m_dfn[m_index(node)] = number;
+  }
+
+ private:
+  std::vector<uint32_t> m_dfn;
+  IndexFn m_index;
+};
+
+/*
+ * Bourdoncle's recursive algorithm, run with an explicit stack of frames so
+ * that deep graphs can't overflow the call stack. A frame stands for either a
+ * call to visit() or a call to component() (see the paper).
+ */
+template <typename NodeId, typename SuccFn, typename DfnMap>
 class WtoBuilder final {
  public:
-  WtoBuilder(SuccFn successors, std::vector<WtoComponent<NodeId>>* wto_space)
+  WtoBuilder(SuccFn successors,
+             std::vector<WtoComponent<NodeId>>* wto_space,
+             DfnMap dfn)
       : m_successors(successors),
         m_wto_space(wto_space),
         m_free_position(0),
+        m_dfn(std::move(dfn)),
         m_num(0) {}
 
   void build(const NodeId& root) {
     int32_t partition = -1;
-    visit(root, &partition);
+    push_visit(root, &partition);
+    while (!m_frames.empty()) {
+      auto& frame = m_frames.back();
+      if (frame.next_succ < frame.succs.size()) {
+        NodeId succ = frame.succs[frame.next_succ++];
+        uint32_t succ_dfn = m_dfn.get(succ);
+        if (frame.kind == Frame::Kind::Component) {
+          if (succ_dfn == 0) {
+            push_visit(succ, &frame.partition);
+          }
+        } else if (succ_dfn == 0) {
+          push_visit(succ, frame.partition_ptr);
+        } else {
+          frame.update_head(succ_dfn);
+        }
+        continue;
+      }
+      if (frame.kind == Frame::Kind::Component) {
+        // The component's successors are done; finish the visit of its head.
+        m_frames.pop_back();
+        finish_visit(/* after_component */ true);
+      } else {
+        finish_visit(/* after_component */ false);
+      }
+    }
   }
 
-  // We keep the notations used by Bourdoncle in the paper to describe the
-  // algorithm.
+ private:
+  using Successors = typename std::decay<decltype(
+      std::declval<SuccFn&>()(std::declval<const NodeId&>()))>::type;
 
-  uint32_t visit(const NodeId& vertex, int32_t* partition) {
-    m_stack.push(vertex);
-    uint32_t head = set_dfn(vertex, ++m_num);
-    bool loop = false;
-    for (const NodeId& succ : m_successors(vertex)) {
-      uint32_t succ_dfn = get_dfn(succ);
-      uint32_t min;
-      if (succ_dfn == 0) {
-        min = visit(succ, partition);
-      } else {
-        min = succ_dfn;
-      };
+  struct Frame {
+    enum class Kind { Visit, Component };
+
+    Frame(Kind kind, const NodeId& vertex, Successors succs)
+        : kind(kind), vertex(vertex), succs(std::move(succs)) {}
+
+    void update_head(uint32_t min) {
       if (min <= head) {
         head = min;
         loop = true;
       }
     }
-    if (head == get_dfn(vertex)) {
+
+    Kind kind;
+    NodeId vertex;
+    Successors succs;
+    size_t next_succ{0};
+    // Visit frames: the partition of the caller, which outlives the frame.
+    int32_t* partition_ptr{nullptr};
+    uint32_t head{0};
+    bool loop{false};
+    // Component frames: their own copy of the partition.
+    int32_t partition{0};
+  };
+
+  // We keep the notations used by Bourdoncle in the paper to describe the
+  // algorithm.
+
+  void push_visit(const NodeId& vertex, int32_t* partition) {
+    m_stack.push(vertex);
+    m_dfn.set(vertex, ++m_num);
+    m_frames.emplace_back(Frame::Kind::Visit, vertex, m_successors(vertex));
+    auto& frame = m_frames.back();
+    frame.partition_ptr = partition;
+    frame.head = m_num;
+  }
+
+  // The end of visit(), once all successors of the vertex have been walked
+  // (and the component of the vertex, if it heads a loop).
+  void finish_visit(bool after_component) {
+    auto& frame = m_frames.back();
+    const NodeId vertex = frame.vertex;
+    int32_t* partition = frame.partition_ptr;
+    uint32_t head = frame.head;
+    bool loop = frame.loop;
+    if (!after_component && head == m_dfn.get(vertex)) {
       // We encode the special value +oo used in the paper with UINT32_MAX.
-      set_dfn(vertex, std::numeric_limits<uint32_t>::max());
+      m_dfn.set(vertex, std::numeric_limits<uint32_t>::max());
       NodeId element = m_stack.top();
       m_stack.pop();
       if (loop) {
         // Nodes are required to be comparable using `operator==()`. We don't
         // assume `operator!=()` to be defined on nodes.
         while (!(element == vertex)) {
-          set_dfn(element, 0);
+          m_dfn.set(element, 0);
           element = m_stack.top();
           m_stack.pop();
         }
-        push_component(vertex, *partition);
+        // Walk the component, then come back here.
+        m_frames.emplace_back(Frame::Kind::Component, vertex,
+                              m_successors(vertex));
+        m_frames.back().partition = *partition;
+        return;
       }
+      after_component = true;
+    }
+    if (after_component) {
       auto kind = loop ? WtoComponent<NodeId>::Kind::Scc
                        : WtoComponent<NodeId>::Kind::Vertex;
       m_wto_space->emplace_back(vertex, kind, m_free_position, *partition);
       *partition = m_free_position++;
     }
-    return head;
-  }
-
-  void push_component(const NodeId& vertex, int32_t partition) {
-    for (const NodeId& succ : m_successors(vertex)) {
-      if (get_dfn(succ) == 0) {
-        visit(succ, &partition);
-      }
+    m_frames.pop_back();
+    if (!m_frames.empty() && m_frames.back().kind == Frame::Kind::Visit) {
+      m_frames.back().update_head(head);
     }
   }
 
-  uint32_t get_dfn(const NodeId& node) {
-    auto it = m_dfn.find(node);
-    if (it != m_dfn.end()) {
-      return it->second;
-    }
-    return 0;
-  }
-
-  uint32_t set_dfn(const NodeId& node, uint32_t number) {
-    if (number == 0) {
-      m_dfn.erase(node);
-    } else {
-      m_dfn[node] = number;
-    }
-    return number;
-  }
-
   SuccFn m_successors;
   std::vector<WtoComponent<NodeId>>* m_wto_space;
   // The next available position at the end of the vector of components.
   int32_t m_free_position;
   // These are auxiliary data structures used by Bourdoncle's algorithm.
-  std::unordered_map<NodeId, uint32_t, NodeHash> m_dfn;
+  DfnMap m_dfn;
   std::stack<NodeId> m_stack;
   uint32_t m_num;
+  // The frames of the calls to visit() and component() being run. A deque,
+  // since frames point to the partitions of the frames below them.
+  std::deque<Frame> m_frames;
 };
 
 } // namespace wto_impl
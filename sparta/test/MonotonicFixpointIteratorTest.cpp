@@ -360,3 +360,40 @@ TEST_F(MonotonicFixpointIteratorTest, program2) {
   ASSERT_TRUE(fp.get_live_in_vars_at("7").is_bottom());
   ASSERT_TRUE(fp.get_live_out_vars_at("7").is_bottom());
 }
+
+TEST_F(MonotonicFixpointIteratorTest, iterationBudget) {
+  FixpointEngine unbounded(this->m_program2);
+  unbounded.run(LivenessDomain());
+  EXPECT_FALSE(unbounded.budget_exhausted());
+  uint32_t iterations = unbounded.get_iteration_count();
+  ASSERT_LE(1, iterations);
+
+  FixpointEngine exact(this->m_program2);
+  exact.set_iteration_budget(iterations);
+  exact.run(LivenessDomain());
+  EXPECT_FALSE(exact.budget_exhausted());
+  EXPECT_EQ(iterations, exact.get_iteration_count());
+  for (const char* node : {"1", "2", "3", "4", "5", "6", "7"}) {
+    EXPECT_TRUE(unbounded.get_live_in_vars_at(node).equals(
+        exact.get_live_in_vars_at(node)));
+  }
+
+  // Running out of budget gives up on the loop head, which is conservative.
+  FixpointEngine bounded(this->m_program2);
+  bounded.set_iteration_budget(0);
+  bounded.run(LivenessDomain());
+  EXPECT_TRUE(bounded.budget_exhausted());
+  for (const char* node : {"1", "2", "3", "4", "5", "6", "7"}) {
+    EXPECT_TRUE(unbounded.get_live_in_vars_at(node).leq(
+        bounded.get_live_in_vars_at(node)));
+  }
+
+  // Delaying the widening doesn't change the result of a finite domain.
+  FixpointEngine delayed(this->m_program2);
+  delayed.set_widening_delay(3);
+  delayed.run(LivenessDomain());
+  for (const char* node : {"1", "2", "3", "4", "5", "6", "7"}) {
+    EXPECT_TRUE(unbounded.get_live_in_vars_at(node).equals(
+        delayed.get_live_in_vars_at(node)));
+  }
+}
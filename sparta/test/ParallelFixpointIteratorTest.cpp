@@ -158,6 +158,35 @@ class FixpointEngine final
   const Program& m_program;
 };
 
+/*
+ * The same analysis with the sequential iterator, which switches to the
+ * parallel strategy on graphs above a threshold.
+ */
+class SequentialFixpointEngine final
+    : public MonotonicFixpointIterator<
+          BackwardsFixpointIterationAdaptor<ProgramInterface>,
+          LivenessDomain> {
+ public:
+  explicit SequentialFixpointEngine(const Program& program)
+      : MonotonicFixpointIterator(program), m_program(program) {}
+
+  void analyze_node(const uint32_t& node,
+                    LivenessDomain* current_state) const override {
+    const Statement& stmt = m_program.statement_at(node);
+    current_state->remove(stmt.def.begin(), stmt.def.end());
+    current_state->add(stmt.use.begin(), stmt.use.end());
+  }
+
+  LivenessDomain analyze_edge(
+      const EdgeId&,
+      const LivenessDomain& exit_state_at_source) const override {
+    return exit_state_at_source;
+  }
+
+ private:
+  const Program& m_program;
+};
+
 class ParallelFixpointIteratorTest : public ::testing::Test {
  protected:
   ParallelFixpointIteratorTest()
@@ -431,3 +460,29 @@ TEST_F(ParallelFixpointIteratorTest, program3) {
   EXPECT_THAT(fp.get_live_out_vars_at(8).elements(),
               ::testing::UnorderedElementsAre("z", "c", "b", "y"));
 }
+
+TEST_F(ParallelFixpointIteratorTest, parallelThreshold) {
+  FixpointEngine parallel(this->m_program3);
+  parallel.run(LivenessDomain());
+
+  SequentialFixpointEngine sequential(this->m_program3);
+  sequential.set_parallel_threshold(9, 4);
+  sequential.run(LivenessDomain());
+  EXPECT_FALSE(sequential.ran_in_parallel());
+
+  SequentialFixpointEngine large(this->m_program3);
+  large.set_parallel_threshold(8, 4);
+  large.run(LivenessDomain());
+  EXPECT_TRUE(large.ran_in_parallel());
+  // Running again starts over from the initial state.
+  large.run(LivenessDomain());
+
+  for (uint32_t node = 1; node <= 8; ++node) {
+    EXPECT_TRUE(parallel.get_live_in_vars_at(node).equals(
+        sequential.get_exit_state_at(node)));
+    EXPECT_TRUE(parallel.get_live_in_vars_at(node).equals(
+        large.get_exit_state_at(node)));
+    EXPECT_TRUE(parallel.get_live_out_vars_at(node).equals(
+        large.get_entry_state_at(node)));
+  }
+}
@@ -114,3 +114,30 @@ TEST(PatriciaTreeMapTest, mapOfUnsignedInt64) {
     EXPECT_EQ(it->second, e.second);
   }
 }
+
+TEST(PatriciaTreeMapTest, arenaAllocation) {
+  pt_map outlives_arena;
+  {
+    PatriciaTreeArena arena;
+    pt_map m;
+    for (uint32_t i = 0; i < 1000; ++i) {
+      m.insert_or_assign(i, i + 1);
+    }
+    {
+      // A nested scope that runs out of capacity right away.
+      PatriciaTreeArena tiny_arena(/* capacity */ 1);
+      for (uint32_t i = 1000; i < 2000; ++i) {
+        m.insert_or_assign(i, i + 1);
+      }
+    }
+    EXPECT_EQ(2000, m.size());
+    outlives_arena = m;
+    outlives_arena.map([](uint32_t x) { return x * 2; });
+  }
+  // The nodes created in the arena remain valid after its scope has ended.
+  EXPECT_EQ(2000, outlives_arena.size());
+  EXPECT_EQ(2, outlives_arena.at(0));
+  EXPECT_EQ(4000, outlives_arena.at(1999));
+  outlives_arena.insert_or_assign(2000, 1);
+  EXPECT_EQ(2001, outlives_arena.size());
+}
@@ -309,3 +309,33 @@ TEST_F(PatriciaTreeSetTest, setOfUnsignedInt64) {
     EXPECT_EQ(1, values.count(x));
   }
 }
+
+TEST_F(PatriciaTreeSetTest, hashConsing) {
+  EXPECT_FALSE(pt_set::hash_consing());
+  pt_set::set_hash_consing(true);
+  for (size_t k = 0; k < 10; ++k) {
+    pt_set s = this->generate_random_set();
+    // The same elements, inserted in reverse order.
+    std::vector<uint32_t> elements(s.begin(), s.end());
+    pt_set t(elements.rbegin(), elements.rend());
+    EXPECT_TRUE(s.reference_equals(t)) << s << " != " << t;
+    EXPECT_TRUE(s.equals(t));
+
+    pt_set u = s;
+    u.insert(1).insert(std::numeric_limits<uint32_t>::max());
+    u.remove(1).remove(std::numeric_limits<uint32_t>::max());
+    pt_set v = s;
+    v.filter([](uint32_t) { return true; });
+    if (!s.contains(1) && !s.contains(std::numeric_limits<uint32_t>::max())) {
+      EXPECT_TRUE(s.reference_equals(u)) << s << " != " << u;
+    }
+    EXPECT_TRUE(s.reference_equals(v));
+  }
+  pt_set::set_hash_consing(false);
+
+  // Without hash-consing, independently built sets are equal but distinct.
+  pt_set s{1, 2, 3};
+  pt_set t{3, 2, 1};
+  EXPECT_TRUE(s.equals(t));
+  EXPECT_FALSE(s.reference_equals(t));
+}
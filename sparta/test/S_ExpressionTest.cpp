@@ -254,3 +254,47 @@ TEST(S_ExpressionTest, patternMatching) {
   EXPECT_TRUE(y.is_nil());
   EXPECT_EQ(parse("((c d) e)"), z);
 }
+
+TEST(S_ExpressionTest, parser) {
+  // The parser behaves like the stream, on well-formed inputs and errors.
+  std::vector<std::string> inputs = {
+      "(cons a (cons b (cons c ())))",
+      "(#0 #-1 #-2147483648 #2147483647) \"a \\\"quoted\\\" \\\\string\"",
+      "(A \"\") ; a comment\n (.pos:dbg_0 \"LFoo;.bar:()V\" Foo.java 12)",
+      "((a) b ()",
+      "(\n(a)\nb\n()\n",
+      "((a) b c))",
+      "(a b #9999999999999)",
+      "(a b #-9999999999999)",
+      "(a b \"abcdef)",
+      "123, (a b c)",
+      "(;comment\n(const-string \"foo\\n\\bar\")\n123, (a b c)\n)",
+  };
+  for (const auto& text : inputs) {
+    std::istringstream str_input(text);
+    s_expr_istream stream(str_input);
+    s_expr_parser parser(text);
+    for (;;) {
+      s_expr expected, actual;
+      stream >> expected;
+      parser >> actual;
+      EXPECT_EQ(stream.good(), parser.good()) << text;
+      EXPECT_EQ(stream.eoi(), parser.eoi()) << text;
+      EXPECT_EQ(stream.what(), parser.what()) << text;
+      if (!stream.good() || !parser.good()) {
+        break;
+      }
+      EXPECT_EQ(expected, actual) << text;
+    }
+  }
+
+  // The S-expressions outlive the parser and its arena.
+  s_expr e;
+  {
+    std::string text = "(a (#1 \"b c\") d)";
+    s_expr_parser parser(text);
+    parser >> e;
+  }
+  EXPECT_EQ("(a (#1 \"b c\") d)", e.str());
+  EXPECT_EQ("b c", e[1][1].get_string());
+}
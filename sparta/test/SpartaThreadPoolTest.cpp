@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SpartaThreadPool.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+#include "SpartaWorkQueue.h"
+
+using namespace sparta::parallel;
+
+TEST(SpartaThreadPoolTest, runsEveryIndexOnce) {
+  ThreadPool pool;
+  std::vector<std::atomic<int>> hits(8);
+  pool.run(hits.size(), [&](size_t i) { ++hits[i]; });
+  for (auto& h : hits) {
+    EXPECT_EQ(1, h.load());
+  }
+}
+
+TEST(SpartaThreadPoolTest, threadsAreReused) {
+  ThreadPool pool;
+  for (int round = 0; round < 10; ++round) {
+    pool.run(4, [](size_t) {});
+  }
+  EXPECT_EQ(4, pool.size());
+  EXPECT_EQ(4, pool.num_idle());
+}
+
+TEST(SpartaThreadPoolTest, nestedRunGrowsPool) {
+  ThreadPool pool;
+  std::atomic<int> count{0};
+  pool.run(2, [&](size_t) { pool.run(2, [&](size_t) { ++count; }); });
+  EXPECT_EQ(4, count.load());
+  // The nested runs execute their first invocation on the calling thread.
+  EXPECT_LE(pool.size(), 4);
+}
+
+TEST(SpartaThreadPoolTest, exceptionIsRethrown) {
+  ThreadPool pool;
+  EXPECT_THROW(pool.run(3,
+                        [](size_t i) {
+                          if (i == 1) {
+                            throw std::runtime_error("boom");
+                          }
+                        }),
+               std::runtime_error);
+  // The pool remains usable afterwards.
+  std::atomic<int> count{0};
+  pool.run(3, [&](size_t) { ++count; });
+  EXPECT_EQ(3, count.load());
+}
+
+TEST(SpartaThreadPoolTest, workQueuesShareGlobalPool) {
+  auto wq = sparta::WorkQueue_foreach<size_t>([](size_t) {}, 3);
+  for (size_t i = 0; i < 100; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  auto size = ThreadPool::get().size();
+  wq.run_all();
+  EXPECT_EQ(size, ThreadPool::get().size());
+}
+
+TEST(SpartaThreadPoolTest, nestedRunUsesCallingThread) {
+  ThreadPool pool;
+  std::atomic<int> count{0};
+  pool.run(2, [&](size_t) { pool.run(3, [&](size_t) { ++count; }); });
+  EXPECT_EQ(6, count.load());
+  // At most 2 outer threads, plus 2 more for each nested run.
+  EXPECT_LE(pool.size(), 6);
+}
+
+TEST(SpartaThreadPoolTest, concurrentWorkQueues) {
+  std::atomic<size_t> total{0};
+  auto outer = sparta::WorkQueue_foreach<size_t>(
+      [&](size_t n) {
+        auto inner = sparta::WorkQueue_foreach<size_t>(
+            [&](size_t i) { total += i; }, 2);
+        for (size_t i = 0; i < n; ++i) {
+          inner.add_item(i);
+        }
+        inner.run_all();
+      },
+      4);
+  for (size_t n = 0; n < 20; ++n) {
+    outer.add_item(n);
+  }
+  outer.run_all();
+  size_t expected = 0;
+  for (size_t n = 0; n < 20; ++n) {
+    for (size_t i = 0; i < n; ++i) {
+      expected += i;
+    }
+  }
+  EXPECT_EQ(expected, total.load());
+}
@@ -84,3 +84,23 @@ TEST(SpartaWorkQueueTest, checkDynamicallyAddingTasks) {
   // 10 + 9 + ... + 1 + 0 = 55
   EXPECT_EQ(55, result);
 }
+
+TEST(SpartaWorkQueueTest, priorityTest) {
+  std::vector<int> order;
+  sparta::SpartaWorkQueue<int> wq(
+      [&](sparta::SpartaWorkerState<int>* worker_state, int a) {
+        order.push_back(a);
+        if (a == 5) {
+          worker_state->push_task(7);
+          worker_state->push_task(1);
+        }
+      },
+      /* num_threads */ 1,
+      [](int a) { return a % 10; });
+  for (int a : {3, 5, 12, 4, 9}) {
+    wq.add_item(a);
+  }
+  wq.run_all();
+
+  EXPECT_EQ(std::vector<int>({9, 5, 7, 4, 3, 12, 1}), order);
+}
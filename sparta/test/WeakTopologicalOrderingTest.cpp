@@ -251,3 +251,35 @@ TEST(WeakTopologicalOrderingTest, InvalidIteratorDeref) {
   EXPECT_ANY_THROW(wto.end()->head_node());
   EXPECT_ANY_THROW(wto.end()++);
 }
+
+TEST(WeakTopologicalOrderingTest, denseIndices) {
+  // The example from the paper, with nodes numbered from 0.
+  std::vector<std::vector<uint32_t>> succs = {
+      {1}, {2, 7}, {3}, {4, 6}, {5}, {4, 6}, {2, 7}, {}};
+  WeakTopologicalOrdering<uint32_t> wto(
+      0,
+      [&succs](const uint32_t& n) { return succs[n]; },
+      succs.size(),
+      [](const uint32_t& n) { return n; });
+  std::ostringstream s;
+  s << wto;
+  EXPECT_EQ("0 1 (2 3 (4 5) 6) 7", s.str());
+}
+
+TEST(WeakTopologicalOrderingTest, deepGraph) {
+  // A loop far too deep for a recursive construction.
+  const uint32_t size = 1000000;
+  WeakTopologicalOrdering<uint32_t> wto(
+      0,
+      [size](const uint32_t& n) {
+        return std::vector<uint32_t>{(n + 1) % size};
+      },
+      size,
+      [](const uint32_t& n) { return n; });
+  auto it = wto.begin();
+  EXPECT_EQ(0, it->head_node());
+  EXPECT_TRUE(it->is_scc());
+  EXPECT_EQ(size - 1, std::distance(it->begin(), it->end()));
+  ++it;
+  EXPECT_TRUE(it == wto.end());
+}
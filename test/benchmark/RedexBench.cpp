@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+//==========
+// Benchmarks for the hot paths of libredex, built as `redex-bench`.
+//
+// Cases that need real code read the dex file given by the `dexfile`
+// environment variable, and are skipped without one; the others run on
+// synthetic inputs. Results of different builds can be compared with
+// Google Benchmark's own tooling by running e.g.
+//
+//   dexfile=classes.dex redex-bench --benchmark_out=results.json \
+//     --benchmark_out_format=json
+//==========
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "InstructionLowering.h"
+#include "Liveness.h"
+#include "RedexContext.h"
+#include "Walkers.h"
+
+namespace {
+
+const char* get_dexfile() { return std::getenv("dexfile"); }
+
+// Starts every benchmark with an empty context, so that they don't see each
+// other's interned entities.
+void reset_redex_context() {
+  delete g_redex;
+  g_redex = new RedexContext();
+}
+
+std::vector<DexMethod*> methods_with_code(const DexClasses& classes) {
+  std::vector<DexMethod*> methods;
+  for (auto cls : classes) {
+    for (auto methods_of_kind : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto m : *methods_of_kind) {
+        if (m->get_code() != nullptr || m->get_dex_code() != nullptr) {
+          methods.push_back(m);
+        }
+      }
+    }
+  }
+  return methods;
+}
+
+/*
+ * A method made of `n` diamonds in a row, each of them writing to a register
+ * that is read by the next one.
+ */
+std::unique_ptr<IRCode> make_diamonds(size_t n) {
+  std::ostringstream ss;
+  ss << "((load-param v0) (const v1 0)";
+  for (size_t i = 0; i < n; ++i) {
+    ss << " (if-eqz v1 :else" << i << ")"
+       << " (add-int v1 v1 v0) (goto :join" << i << ")"
+       << " (:else" << i << ") (mul-int v1 v1 v0)"
+       << " (:join" << i << ")";
+  }
+  ss << " (return v1))";
+  return assembler::ircode_from_string(ss.str());
+}
+
+void BM_LoadClassesFromDex(benchmark::State& state) {
+  auto dexfile = get_dexfile();
+  if (dexfile == nullptr) {
+    state.SkipWithError("Set `dexfile` to run this benchmark");
+    return;
+  }
+  size_t num_classes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    reset_redex_context();
+    state.ResumeTiming();
+    num_classes = load_classes_from_dex(dexfile).size();
+  }
+  state.counters["classes"] = num_classes;
+}
+BENCHMARK(BM_LoadClassesFromDex)->Unit(benchmark::kMillisecond);
+
+// One round-trip of all the code of a dex between its Dex and IR forms.
+void BM_BalloonAndSync(benchmark::State& state) {
+  auto dexfile = get_dexfile();
+  if (dexfile == nullptr) {
+    state.SkipWithError("Set `dexfile` to run this benchmark");
+    return;
+  }
+  reset_redex_context();
+  auto classes = load_classes_from_dex(dexfile, /* balloon */ false);
+  auto methods = methods_with_code(classes);
+  for (auto _ : state) {
+    for (auto m : methods) {
+      m->balloon();
+      instruction_lowering::lower(m);
+      m->sync();
+    }
+  }
+  state.counters["methods"] = methods.size();
+}
+BENCHMARK(BM_BalloonAndSync)->Unit(benchmark::kMillisecond);
+
+void BM_CfgBuildAndLinearize(benchmark::State& state) {
+  reset_redex_context();
+  auto code = make_diamonds(state.range(0));
+  for (auto _ : state) {
+    code->build_cfg(/* editable */ true);
+    code->clear_cfg();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CfgBuildAndLinearize)->Range(8, 4096);
+
+void BM_CfgBuildAndLinearizeDex(benchmark::State& state) {
+  auto dexfile = get_dexfile();
+  if (dexfile == nullptr) {
+    state.SkipWithError("Set `dexfile` to run this benchmark");
+    return;
+  }
+  reset_redex_context();
+  auto classes = load_classes_from_dex(dexfile);
+  auto methods = methods_with_code(classes);
+  for (auto _ : state) {
+    for (auto m : methods) {
+      m->get_code()->build_cfg(/* editable */ true);
+      m->get_code()->clear_cfg();
+    }
+  }
+  state.counters["methods"] = methods.size();
+}
+BENCHMARK(BM_CfgBuildAndLinearizeDex)->Unit(benchmark::kMillisecond);
+
+void BM_LivenessFixpoint(benchmark::State& state) {
+  reset_redex_context();
+  auto code = make_diamonds(state.range(0));
+  code->build_cfg(/* editable */ false);
+  for (auto _ : state) {
+    LivenessFixpointIterator fixpoint(code->cfg());
+    fixpoint.run(LivenessDomain());
+    benchmark::DoNotOptimize(
+        fixpoint.get_live_in_vars_at(code->cfg().entry_block()));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LivenessFixpoint)->Range(8, 4096);
+
+// All threads intern the same entities, which is the worst case for the
+// interning tables of RedexContext.
+constexpr size_t kNumInternedClasses = 10000;
+std::vector<std::string> s_class_names;
+
+void BM_RedexContextMakeUnderContention(benchmark::State& state) {
+  for (auto _ : state) {
+    for (const auto& name : s_class_names) {
+      auto type = DexType::make_type(name.c_str());
+      auto proto = DexProto::make_proto(type, DexTypeList::make_type_list({}));
+      DexMethod::make_method(type, DexString::make_string("<init>"), proto);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * s_class_names.size());
+}
+BENCHMARK(BM_RedexContextMakeUnderContention)
+    ->Setup([](const benchmark::State&) { reset_redex_context(); })
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+void BM_DexOutput(benchmark::State& state) {
+  auto dexfile = get_dexfile();
+  if (dexfile == nullptr) {
+    state.SkipWithError("Set `dexfile` to run this benchmark");
+    return;
+  }
+  reset_redex_context();
+  auto classes = load_classes_from_dex(dexfile);
+  auto methods = methods_with_code(classes);
+
+  char tmpdir_template[] = "/tmp/redex_bench_XXXXXX";
+  std::string tmpdir = mkdtemp(tmpdir_template);
+  mkdir((tmpdir + "/meta").c_str(), 0755);
+  ConfigFiles conf(Json::nullValue, tmpdir);
+  RedexOptions options;
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+  for (auto _ : state) {
+    state.PauseTiming();
+    // Emission syncs the code back to its Dex form.
+    for (auto m : methods) {
+      if (m->get_code() == nullptr) {
+        m->balloon();
+      }
+      instruction_lowering::lower(m);
+    }
+    std::unordered_map<DexMethod*, uint64_t> method_to_id;
+    std::unordered_map<DexCode*, std::vector<DebugLineItem>> code_debug_lines;
+    state.ResumeTiming();
+    write_classes_to_dex(options, tmpdir + "/classes.dex", &classes, nullptr,
+                         0, 0, conf, pos_mapper.get(), &method_to_id,
+                         &code_debug_lines, nullptr, "dex\n035\0");
+  }
+  state.counters["classes"] = classes.size();
+}
+BENCHMARK(BM_DexOutput)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  for (size_t i = 0; i < kNumInternedClasses; ++i) {
+    s_class_names.push_back("Lcom/facebook/redex/bench/Class" +
+                            std::to_string(i) + ";");
+  }
+  auto dexfile = get_dexfile();
+  benchmark::AddCustomContext("dexfile", dexfile ? dexfile : "");
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  delete g_redex;
+  return 0;
+}
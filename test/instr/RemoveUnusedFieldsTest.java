@@ -15,9 +15,16 @@ class RemoveUnusedFieldsTest {
   // Removal of Strings are blacklisted in the test Redex config
   // CHECK: redex.RemoveUnusedFieldsTest.unusedString:java.lang.String
   String unusedString;
+  // Only read to be written back, so just as unused
+  // CHECK-NOT: redex.RemoveUnusedFieldsTest.writeOnlyCount:int
+  int writeOnlyCount;
 
   public void init() {
     unusedInt = 1;
     unusedString = "foo";
   }
+
+  public void increment() {
+    writeOnlyCount = writeOnlyCount + 1;
+  }
 }
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+package com.facebook.redex.test.instr;
+
+import static org.fest.assertions.api.Assertions.*;
+
+import org.junit.Test;
+
+public class SynthSetterTest {
+
+    /**
+     * javac generates access$NNN setters for the writes to the private fields
+     * of Inner below, some of which return the value written. Synth replaces
+     * their calls with the field writes themselves, so the values written,
+     * read and chained must stay the same.
+     */
+    @Test
+    public void test() {
+        Inner inner = new Inner();
+        inner.mInt = 3;
+        long chained = inner.mLong = 5L;
+        Inner.sObject = "six";
+        assertThat(inner.mInt).isEqualTo(3);
+        assertThat(inner.mLong).isEqualTo(5L);
+        assertThat(chained).isEqualTo(5L);
+        assertThat(Inner.sObject).isEqualTo("six");
+    }
+
+    private static class Inner {
+        private int mInt;
+        private long mLong;
+        private static String sObject;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <regex>
+#include <unordered_map>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "IRCode.h"
+#include "IRCodeIO.h"
+#include "RedexContext.h"
+#include "Show.h"
+#include "Walkers.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// The entries refer to each other by address, which differs across loads.
+std::unordered_map<std::string, std::string> show_all_code(
+    const DexClasses& classes) {
+  std::regex address("0x[0-9a-f]+");
+  std::unordered_map<std::string, std::string> code;
+  walk::code(classes, [&](DexMethod* m, IRCode& c) {
+    code.emplace(show(m), std::regex_replace(show(&c), address, "_"));
+  });
+  return code;
+}
+
+} // namespace
+
+TEST(IRCodeIOTest, roundTrip) {
+  const char* dexfile = std::getenv("dexfile");
+  ASSERT_NE(nullptr, dexfile);
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(dir);
+
+  g_redex = new RedexContext();
+  auto classes = load_classes_from_dex(dexfile);
+  // One of the methods is dumped with its editable CFG built.
+  DexMethod* with_cfg = nullptr;
+  walk::code(classes, [&](DexMethod* m, IRCode& c) {
+    if (with_cfg == nullptr) {
+      with_cfg = m;
+      c.build_cfg(/* editable */ true);
+    }
+  });
+  ASSERT_NE(nullptr, with_cfg);
+  ir_code_io::dump(classes, dir.string());
+  with_cfg->get_code()->clear_cfg();
+  auto expected = show_all_code(classes);
+  delete g_redex;
+
+  // The loaded code replaces what was ballooned from the dex.
+  g_redex = new RedexContext();
+  classes = load_classes_from_dex(dexfile);
+  EXPECT_TRUE(ir_code_io::load(dir.string()));
+  EXPECT_EQ(expected, show_all_code(classes));
+  delete g_redex;
+
+  EXPECT_FALSE(ir_code_io::load((dir / "missing").string()));
+  fs::remove_all(dir);
+}
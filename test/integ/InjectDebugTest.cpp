@@ -122,3 +122,34 @@ TEST_F(InjectDebugTest, TestCodeItems) {
     return instructions;
   });
 }
+
+// Check that the methods that don't match the filter are written back with
+// their original code and debug info
+TEST_F(InjectDebugTest, TestMethodFilter) {
+  std::string filtered_dir = make_tmp_dir();
+  {
+    InjectDebug inject_debug(filtered_dir, {m_dex_path}, {"LNoSuchClass;"});
+    inject_debug.run();
+  }
+  auto get_code = [](const DexClasses& classes) {
+    std::vector<std::string> code;
+    for (DexClass* dex_class : classes) {
+      for (auto* methods :
+           {&dex_class->get_dmethods(), &dex_class->get_vmethods()}) {
+        for (DexMethod* dex_method : *methods) {
+          auto dex_code = dex_method->get_dex_code();
+          if (dex_code == nullptr) {
+            continue;
+          }
+          code.push_back(show(dex_code));
+          auto dbg = dex_code->get_debug_item();
+          code.push_back(dbg ? std::to_string(dbg->get_line_start()) : "-");
+        }
+      }
+    }
+    return code;
+  };
+  auto original = get_code(load_classes(m_dex_path));
+  auto filtered = get_code(load_classes(filtered_dir + "/classes.dex"));
+  EXPECT_EQ(original, filtered);
+}
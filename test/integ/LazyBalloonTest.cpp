@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "IRCode.h"
+#include "RedexContext.h"
+#include "Walkers.h"
+
+namespace {
+
+std::vector<std::string> show_all_code(const DexClasses& classes) {
+  std::vector<std::string> code;
+  walk::code(classes, [&](DexMethod* m, IRCode& c) {
+    code.push_back(show(m) + "\n" + show(&c));
+  });
+  return code;
+}
+
+} // namespace
+
+TEST(LazyBalloonTest, codeIsBalloonedOnFirstAccess) {
+  const char* dexfile = std::getenv("dexfile");
+  ASSERT_NE(nullptr, dexfile);
+
+  g_redex = new RedexContext();
+  auto expected = show_all_code(load_classes_from_dex(dexfile));
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  RedexContext::set_lazy_balloon(true);
+  auto classes = load_classes_from_dex(dexfile);
+  size_t num_pending = 0;
+  walk::methods(classes, [&](DexMethod* m) {
+    if (m->is_balloon_pending()) {
+      EXPECT_NE(nullptr, m->get_dex_code());
+      ++num_pending;
+    }
+  });
+  EXPECT_EQ(expected.size(), num_pending);
+
+  // Accessing the code of one method leaves the others alone.
+  DexMethod* first = nullptr;
+  walk::methods(classes, [&](DexMethod* m) {
+    if (first == nullptr && m->is_balloon_pending()) {
+      first = m;
+    }
+  });
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, first->get_code());
+  EXPECT_FALSE(first->is_balloon_pending());
+  EXPECT_EQ(nullptr, first->get_dex_code());
+  walk::methods(classes, [&](DexMethod* m) {
+    if (m != first && m->get_dex_code() != nullptr) {
+      EXPECT_TRUE(m->is_balloon_pending());
+    }
+  });
+
+  walk::parallel::methods(classes, [](DexMethod* m) { m->get_code(); });
+  EXPECT_EQ(expected, show_all_code(classes));
+  delete g_redex;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "RedexContext.h"
+
+class LoadDexesTest : public ::testing::Test {
+ protected:
+  void SetUp() override { g_redex = new RedexContext(); }
+
+  void TearDown() override { delete g_redex; }
+};
+
+TEST_F(LoadDexesTest, sameResultAsSequentialLoading) {
+  const char* dexfile = std::getenv("dexfile");
+  ASSERT_NE(nullptr, dexfile);
+
+  dex_stats_t stats{0};
+  auto expected = load_classes_from_dex(dexfile, &stats, false);
+  std::vector<std::string> names;
+  for (auto cls : expected) {
+    names.push_back(show(cls));
+  }
+  delete g_redex;
+  g_redex = new RedexContext();
+
+  // Loading the same file several times makes every class of the later copies
+  // a benign duplicate: only the first copy gets to define them.
+  std::vector<dex_stats_t> dexes_stats;
+  auto dexes =
+      load_classes_from_dexes({dexfile, dexfile, dexfile}, &dexes_stats, false);
+  ASSERT_EQ(3, dexes.size());
+  ASSERT_EQ(3, dexes_stats.size());
+  ASSERT_EQ(expected.size(), dexes[0].size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    EXPECT_EQ(names[i], show(dexes[0][i]));
+    EXPECT_EQ(dexes[0][i], type_class(dexes[0][i]->get_type()));
+  }
+  EXPECT_TRUE(dexes[1].empty());
+  EXPECT_TRUE(dexes[2].empty());
+  for (const auto& dex_stats : dexes_stats) {
+    EXPECT_EQ(stats.num_classes, dex_stats.num_classes);
+  }
+}
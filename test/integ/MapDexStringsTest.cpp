@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "RedexContext.h"
+#include "Walkers.h"
+
+namespace {
+
+std::vector<std::string> show_all_methods(const DexClasses& classes) {
+  std::vector<std::string> methods;
+  walk::methods(classes, [&](DexMethod* m) { methods.push_back(show(m)); });
+  return methods;
+}
+
+} // namespace
+
+TEST(MapDexStringsTest, stringsAreCopiedOnDemand) {
+  const char* dexfile = std::getenv("dexfile");
+  ASSERT_NE(nullptr, dexfile);
+
+  g_redex = new RedexContext();
+  auto expected = show_all_methods(load_classes_from_dex(dexfile));
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  RedexContext::set_map_dex_strings(true);
+  auto classes = load_classes_from_dex(dexfile);
+  ASSERT_FALSE(classes.empty());
+
+  // The name of a class that no one asked about is still mapped, but its
+  // contents are available without a copy.
+  auto cls = classes.back();
+  auto name = cls->get_name();
+  EXPECT_TRUE(name->is_mapped());
+  std::string c_str = name->c_str();
+  EXPECT_EQ(c_str.size(), name->size());
+  EXPECT_TRUE(name->is_mapped());
+
+  // Asking for a std::string copies it, from however many threads.
+  walk::parallel::methods(classes, [&](DexMethod*) {
+    EXPECT_EQ(c_str, name->str());
+  });
+  EXPECT_FALSE(name->is_mapped());
+  EXPECT_EQ(c_str, name->c_str());
+
+  // Mapped strings are interned like the others.
+  EXPECT_EQ(name, DexString::get_string(c_str));
+  EXPECT_EQ(name, DexString::make_string(c_str));
+  EXPECT_EQ(expected, show_all_methods(classes));
+  delete g_redex;
+}
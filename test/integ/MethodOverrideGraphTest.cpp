@@ -88,4 +88,12 @@ TEST_F(MethodOverrideGraphTest, verify) {
               ::testing::UnorderedElementsAre(A_M));
   EXPECT_THAT(get_overridden_methods(*graph, DexMethod::get_method(B_M), true),
               ::testing::UnorderedElementsAre(A_M, IA_M, IB_M, IC_M));
+
+  // The direct edges of a method
+  auto a_n = static_cast<const DexMethod*>(DexMethod::get_method(A_N));
+  const auto& a_n_node = graph->get_node(a_n);
+  ASSERT_EQ(1, a_n_node.parents.size());
+  EXPECT_EQ(DexMethod::get_method(IB_N), *a_n_node.parents.begin());
+  EXPECT_TRUE(a_n_node.children.empty());
+  EXPECT_TRUE(mog::is_true_virtual(*graph, a_n));
 }
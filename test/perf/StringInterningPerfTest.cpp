@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/functional/hash.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
+#include "DexIdx.h"
+#include "DexLoader.h"
+#include "RedexContext.h"
+
+//==========
+// Compares the hashed string interning table of RedexContext against the
+// strcmp-ordered std::map it replaced, on the strings of the dex file given by
+// the `dexfile` environment variable.
+//==========
+
+namespace {
+
+// The previous string interning table, as it was in RedexContext.
+struct Strcmp {
+  bool operator()(const char* a, const char* b) const {
+    return strcmp(a, b) < 0;
+  }
+};
+
+struct TruncatedStringHash {
+  size_t operator()(const char* s) {
+    constexpr size_t hash_prefix_len = 8;
+    constexpr size_t offset = 32;
+    size_t len = strnlen(s, offset + hash_prefix_len);
+    size_t start = std::max<int64_t>(0, int64_t(len - hash_prefix_len));
+    return boost::hash_range(s + start, s + len);
+  }
+};
+
+using LegacyStringMap =
+    ConcurrentMapContainer<std::map<const char*, std::string*, Strcmp>,
+                           const char*,
+                           std::string*,
+                           TruncatedStringHash,
+                           1021>;
+
+std::string* legacy_make_string(LegacyStringMap& map,
+                                const char* str,
+                                std::vector<std::unique_ptr<std::string>>& pool) {
+  auto value = map.get(str, nullptr);
+  if (value != nullptr) {
+    return value;
+  }
+  pool.emplace_back(new std::string(str));
+  auto candidate = pool.back().get();
+  if (map.emplace(candidate->c_str(), candidate)) {
+    return candidate;
+  }
+  return map.at(str);
+}
+
+template <typename Fn>
+double time_ms(const Fn& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::vector<std::string> read_dex_strings(const char* location) {
+  boost::iostreams::mapped_file file;
+  file.open(location, boost::iostreams::mapped_file::readonly);
+  auto dh = reinterpret_cast<const dex_header*>(file.const_data());
+  std::vector<std::string> strings;
+  DexIdx idx(dh);
+  for (uint32_t i = 0; i < dh->string_ids_size; ++i) {
+    strings.push_back(idx.get_stringidx(i)->str());
+  }
+  return strings;
+}
+
+} // namespace
+
+TEST(StringInterningPerfTest, hashedVsOrdered) {
+  const char* dexfile = std::getenv("dexfile");
+  if (dexfile == nullptr) {
+    printf("Set `dexfile` to the dex file to benchmark\n");
+    return;
+  }
+  g_redex = new RedexContext();
+  auto strings = read_dex_strings(dexfile);
+  delete g_redex;
+
+  // Every string of a dex gets interned once when it is loaded, and looked up
+  // many times afterwards, so we time both a cold and a warm pass.
+  LegacyStringMap legacy;
+  std::vector<std::unique_ptr<std::string>> pool;
+  double legacy_ms = time_ms([&]() {
+    for (int pass = 0; pass < 2; ++pass) {
+      for (const auto& s : strings) {
+        legacy_make_string(legacy, s.c_str(), pool);
+      }
+    }
+  });
+
+  g_redex = new RedexContext();
+  double hashed_ms = time_ms([&]() {
+    for (int pass = 0; pass < 2; ++pass) {
+      for (const auto& s : strings) {
+        DexString::make_string(s);
+      }
+    }
+  });
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  double load_ms = time_ms([&]() { load_classes_from_dex(dexfile); });
+  delete g_redex;
+
+  printf("%zu strings: ordered map %.1f ms, hashed table %.1f ms\n",
+         strings.size(), legacy_ms, hashed_ms);
+  printf("load_classes_from_dex with the hashed table: %.1f ms\n", load_ms);
+  EXPECT_EQ(legacy.size(), pool.size());
+}
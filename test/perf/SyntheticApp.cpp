@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SyntheticApp.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "Show.h"
+
+namespace synthetic_app {
+
+namespace {
+
+const char* STRING_LENGTH = "Ljava/lang/String;.length:()I";
+
+std::string class_name(size_t idx) {
+  return "Lcom/facebook/redex/synthetic/C" + std::to_string(idx) + ";";
+}
+
+std::string annotation_name(size_t idx) {
+  return "Lcom/facebook/redex/synthetic/Anno" + std::to_string(idx) + ";";
+}
+
+class Generator {
+ public:
+  explicit Generator(const Config& config) : m_config(config) {}
+
+  DexClassesVector generate() {
+    const size_t depth = std::max<size_t>(m_config.hierarchy_depth, 1);
+    // The callees of every dex besides its own methods, i.e. Object.<init>
+    // and String.length.
+    const size_t shared_refs = 2;
+    DexClassesVector dexen(1);
+    size_t dex_refs = shared_refs;
+    for (size_t i = 0; i < m_config.num_annotation_types; ++i) {
+      dexen.back().push_back(make_annotation_type(i));
+      ++dex_refs;
+    }
+    for (size_t first = 0; first < m_config.num_classes; first += depth) {
+      size_t last = std::min(first + depth, m_config.num_classes);
+      // The methods of the classes of the chain, including their constructor
+      // and the giant methods they host.
+      size_t chain_refs = (last - first) * (m_config.methods_per_class + 1);
+      for (size_t i = first; i < last; ++i) {
+        chain_refs += num_giant_methods_of(i);
+      }
+      if (!dexen.back().empty() &&
+          dex_refs + chain_refs > m_config.max_methods_per_dex) {
+        dexen.emplace_back();
+        dex_refs = shared_refs;
+      }
+      for (size_t i = first; i < last; ++i) {
+        dexen.back().push_back(make_class(i, i == first));
+      }
+      dex_refs += chain_refs;
+    }
+    return dexen;
+  }
+
+ private:
+  const std::string& string_at(size_t idx) {
+    auto num_strings = std::max<size_t>(m_config.num_strings, 1);
+    idx %= num_strings;
+    auto it = m_strings.find(idx);
+    if (it == m_strings.end()) {
+      it = m_strings
+               .emplace(idx, "com.facebook.redex.synthetic.string" +
+                                 std::to_string(idx))
+               .first;
+    }
+    return it->second;
+  }
+
+  // The giant methods are spread over the first classes.
+  size_t num_giant_methods_of(size_t cls_idx) const {
+    auto n = m_config.num_giant_methods;
+    return n / m_config.num_classes + (cls_idx < n % m_config.num_classes);
+  }
+
+  DexAnnotationSet* make_annotations(size_t member_idx) {
+    auto num = std::min(m_config.annotations_per_member,
+                        m_config.num_annotation_types);
+    if (num == 0) {
+      return nullptr;
+    }
+    auto aset = new DexAnnotationSet();
+    for (size_t i = 0; i < num; ++i) {
+      auto type_idx = (member_idx + i) % m_config.num_annotation_types;
+      auto anno = new DexAnnotation(
+          DexType::make_type(annotation_name(type_idx).c_str()), DAV_RUNTIME);
+      anno->add_element("value",
+                        new DexEncodedValueString(DexString::make_string(
+                            string_at(member_idx + i))));
+      aset->add_annotation(anno);
+    }
+    return aset;
+  }
+
+  DexClass* make_annotation_type(size_t idx) {
+    auto type = DexType::make_type(annotation_name(idx).c_str());
+    ClassCreator creator(type);
+    creator.set_super(type::java_lang_Object());
+    creator.set_access(ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT |
+                       ACC_ANNOTATION);
+    creator.add_interface(
+        DexType::make_type("Ljava/lang/annotation/Annotation;"));
+    auto value = static_cast<DexMethod*>(DexMethod::make_method(
+        show(type) + ".value:()Ljava/lang/String;"));
+    value->make_concrete(ACC_PUBLIC | ACC_ABSTRACT, /* is_virtual */ true);
+    creator.add_method(value);
+    return creator.create();
+  }
+
+  // Adds the given number of strings, starting at `string_idx`, to the
+  // accumulator v0, using v1 and v2.
+  void load_strings(std::ostringstream& ss, size_t string_idx, size_t num) {
+    for (size_t i = 0; i < num; ++i) {
+      ss << " (const-string \"" << string_at(string_idx + i) << "\")"
+         << " (move-result-pseudo-object v1)"
+         << " (invoke-virtual (v1) \"" << STRING_LENGTH << "\")"
+         << " (move-result v2) (add-int v0 v0 v2)";
+    }
+  }
+
+  DexMethod* make_method(const std::string& descriptor,
+                         DexAccessFlags access,
+                         const std::string& body,
+                         DexAnnotationSet* aset) {
+    auto method = static_cast<DexMethod*>(DexMethod::make_method(descriptor));
+    if (aset != nullptr) {
+      method->attach_annotation_set(aset);
+    }
+    method->make_concrete(access, assembler::ircode_from_string(body),
+                          !(access & (ACC_STATIC | ACC_CONSTRUCTOR)));
+    method->set_deobfuscated_name(show(method));
+    return method;
+  }
+
+  DexMethod* make_giant_method(const std::string& cls, size_t idx) {
+    std::ostringstream ss;
+    ss << "((load-param v3) (move v0 v3)";
+    for (size_t i = 0; i < m_config.giant_method_size; ++i) {
+      ss << " (if-eqz v0 :else" << i << ") (add-int/lit8 v0 v0 1)"
+         << " (goto :join" << i << ") (:else" << i << ")";
+      load_strings(ss, m_next_string++, 1);
+      ss << " (:join" << i << ")";
+    }
+    ss << " (return v0))";
+    return make_method(cls + ".giant" + std::to_string(idx) + ":(I)I",
+                       ACC_PUBLIC | ACC_STATIC, ss.str(), nullptr);
+  }
+
+  DexClass* make_class(size_t idx, bool is_chain_root) {
+    auto name = class_name(idx);
+    auto super = is_chain_root
+                     ? type::java_lang_Object()
+                     : DexType::make_type(class_name(idx - 1).c_str());
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(super);
+    creator.set_access(ACC_PUBLIC);
+
+    creator.add_method(make_method(
+        name + ".<init>:()V", ACC_PUBLIC | ACC_CONSTRUCTOR,
+        "((load-param-object v0) (invoke-direct (v0) \"" + show(super) +
+            ".<init>:()V\") (return-void))",
+        nullptr));
+
+    std::vector<std::string> giant_methods;
+    auto num_giant_methods = num_giant_methods_of(idx);
+    for (size_t i = 0; i < num_giant_methods; ++i) {
+      auto giant = make_giant_method(name, i);
+      giant_methods.push_back(show(giant));
+      creator.add_method(giant);
+    }
+
+    auto num_methods = m_config.methods_per_class;
+    for (size_t j = 0; j < num_methods; ++j) {
+      std::ostringstream ss;
+      ss << "((load-param-object v4) (load-param v5) (move v0 v5)";
+      load_strings(ss, m_next_string, m_config.strings_per_method);
+      m_next_string += m_config.strings_per_method;
+      if (j + 1 < num_methods) {
+        ss << " (invoke-virtual (v4 v0) \"" << name << ".m" << j + 1
+           << ":(I)I\") (move-result v0)";
+      } else {
+        for (const auto& giant : giant_methods) {
+          ss << " (invoke-static (v0) \"" << giant << "\") (move-result v0)";
+        }
+      }
+      ss << " (return v0))";
+      creator.add_method(make_method(name + ".m" + std::to_string(j) + ":(I)I",
+                                     ACC_PUBLIC, ss.str(),
+                                     make_annotations(m_next_member++)));
+    }
+
+    auto cls = creator.create();
+    auto aset = make_annotations(m_next_member++);
+    if (aset != nullptr) {
+      cls->attach_annotation_set(aset);
+    }
+    return cls;
+  }
+
+  const Config& m_config;
+  std::unordered_map<size_t, std::string> m_strings;
+  size_t m_next_string{0};
+  size_t m_next_member{0};
+};
+
+} // namespace
+
+DexClassesVector generate(const Config& config) {
+  always_assert(config.num_classes > 0);
+  return Generator(config).generate();
+}
+
+void write_dexes(const std::string& dir, DexClassesVector& dexen) {
+  ConfigFiles conf(Json::nullValue, dir);
+  RedexOptions options;
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+  for (size_t i = 0; i < dexen.size(); ++i) {
+    for (auto cls : dexen[i]) {
+      for (auto methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+        for (auto method : *methods) {
+          if (method->get_code() != nullptr) {
+            instruction_lowering::lower(method);
+          }
+        }
+      }
+    }
+    // Named like the dexes of an APK: classes.dex, classes2.dex, ...
+    auto filename =
+        dir + "/classes" + (i > 0 ? std::to_string(i + 1) : "") + ".dex";
+    write_classes_to_dex(options, filename, &dexen[i], nullptr, 0, i, conf,
+                         pos_mapper.get(), nullptr, nullptr, nullptr,
+                         "dex\n035\0");
+  }
+}
+
+void write_keep_rules(const std::string& path) {
+  std::ofstream out(path);
+  out << "-keepattributes *Annotation*\n"
+      << "-keep class " << PACKAGE << ".** {\n"
+      << "  public <init>();\n"
+      << "  public int m0(int);\n"
+      << "}\n";
+}
+
+} // namespace synthetic_app
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "DexClass.h"
+
+/*
+ * Synthesizes apps of a given scale, as inputs for measuring the throughput of
+ * the whole pipeline (see pipeline_bench.py).
+ *
+ * The classes form chains of subclasses of the given depth, whose members all
+ * override the virtual methods of their super class. Each virtual method
+ * loads some strings of a shared pool and calls the next method of its class,
+ * so that keeping the first one (see write_keep_rules) keeps the rest of them
+ * reachable. The giant methods are static methods of the first classes, made
+ * of branches in a row, and the last virtual method of their class calls them.
+ *
+ * The output is deterministic: the same config always makes the same dexes.
+ */
+namespace synthetic_app {
+
+struct Config {
+  size_t num_classes{1000};
+  size_t methods_per_class{10};
+  // The number of classes of each chain of subclasses.
+  size_t hierarchy_depth{4};
+  // The number of distinct strings, which the methods load in turn.
+  size_t num_strings{10000};
+  size_t strings_per_method{2};
+  // The number of distinct annotation types, of which each class and each
+  // virtual method gets `annotations_per_member`.
+  size_t num_annotation_types{16};
+  size_t annotations_per_member{1};
+  size_t num_giant_methods{0};
+  // The number of branches of each giant method, of about 8 code units each.
+  size_t giant_method_size{5000};
+  // The dexes get split at the chain boundaries before their method
+  // references would exceed this.
+  size_t max_methods_per_dex{60000};
+};
+
+// The package of all the generated classes.
+constexpr const char* PACKAGE = "com.facebook.redex.synthetic";
+
+DexClassesVector generate(const Config& config);
+
+/*
+ * Writes the dexes as `classes.dex`, `classes2.dex`, etc. into the given
+ * directory, which must contain a `meta` directory.
+ */
+void write_dexes(const std::string& dir, DexClassesVector& dexen);
+
+/*
+ * Writes the ProGuard rules that keep the entry points of the generated
+ * classes, i.e. their constructors and their first method.
+ */
+void write_keep_rules(const std::string& path);
+
+} // namespace synthetic_app
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h> // mkdir
+
+#include <boost/program_options.hpp>
+
+#include "RedexContext.h"
+#include "SyntheticApp.h"
+#include "ToolsCommon.h" // redex::dir_is_writable
+
+/*
+ * Writes a synthetic app of the given scale into the output directory, i.e.
+ * its dexes and the ProGuard rules that keep its entry points, e.g.
+ *
+ *   synthetic-app-gen -o out --classes 20000 --giant-methods 10
+ *   redex-all -c config/default.config -p out/keep.pro -o redex-out \
+ *     out/classes*.dex
+ *
+ * See pipeline_bench.py, which runs both of them.
+ */
+
+namespace {
+
+const std::string USAGE_HEADER =
+    "usage: synthetic-app-gen -o out-dir [options]";
+
+synthetic_app::Config parse_args(int argc, char* argv[], std::string* out_dir) {
+  synthetic_app::Config config;
+
+  namespace po = boost::program_options;
+  po::options_description od(USAGE_HEADER);
+  od.add_options()("help,h", "print this help message");
+  od.add_options()("outdir,o", po::value<std::string>(out_dir)->required(),
+                   "output directory for the dexes and keep.pro");
+  od.add_options()("classes",
+                   po::value<size_t>(&config.num_classes)
+                       ->default_value(config.num_classes),
+                   "number of classes");
+  od.add_options()("methods-per-class",
+                   po::value<size_t>(&config.methods_per_class)
+                       ->default_value(config.methods_per_class),
+                   "number of virtual methods of each class");
+  od.add_options()("depth",
+                   po::value<size_t>(&config.hierarchy_depth)
+                       ->default_value(config.hierarchy_depth),
+                   "number of classes of each chain of subclasses");
+  od.add_options()("strings",
+                   po::value<size_t>(&config.num_strings)
+                       ->default_value(config.num_strings),
+                   "number of distinct strings");
+  od.add_options()("strings-per-method",
+                   po::value<size_t>(&config.strings_per_method)
+                       ->default_value(config.strings_per_method),
+                   "number of strings that each virtual method loads");
+  od.add_options()("annotation-types",
+                   po::value<size_t>(&config.num_annotation_types)
+                       ->default_value(config.num_annotation_types),
+                   "number of distinct annotation types");
+  od.add_options()("annotations-per-member",
+                   po::value<size_t>(&config.annotations_per_member)
+                       ->default_value(config.annotations_per_member),
+                   "number of annotations of each class and virtual method");
+  od.add_options()("giant-methods",
+                   po::value<size_t>(&config.num_giant_methods)
+                       ->default_value(config.num_giant_methods),
+                   "number of giant methods");
+  od.add_options()("giant-method-size",
+                   po::value<size_t>(&config.giant_method_size)
+                       ->default_value(config.giant_method_size),
+                   "number of branches of each giant method");
+  od.add_options()("max-methods-per-dex",
+                   po::value<size_t>(&config.max_methods_per_dex)
+                       ->default_value(config.max_methods_per_dex),
+                   "number of method references after which to start a new "
+                   "dex");
+  po::variables_map vm;
+
+  try {
+    po::store(po::command_line_parser(argc, argv).options(od).run(), vm);
+    if (vm.count("help")) {
+      od.print(std::cout);
+      exit(EXIT_SUCCESS);
+    }
+    po::notify(vm);
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl << std::endl;
+    od.print(std::cerr);
+    exit(EXIT_FAILURE);
+  }
+
+  if (config.num_classes == 0) {
+    std::cerr << "error: --classes must be positive" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!redex::dir_is_writable(*out_dir)) {
+    std::cerr << "error: outdir is not a writable directory: " << *out_dir
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // The dex writer puts its metadata there.
+  std::string metafiles = *out_dir + "/meta/";
+  if (mkdir(metafiles.c_str(), 0755) != 0 && errno != EEXIST) {
+    int errsv = errno;
+    std::cerr << "error: cannot mkdir meta in outdir. errno = " << errsv
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return config;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::string out_dir;
+  auto config = parse_args(argc, argv, &out_dir);
+
+  g_redex = new RedexContext();
+  auto dexen = synthetic_app::generate(config);
+  synthetic_app::write_dexes(out_dir, dexen);
+  synthetic_app::write_keep_rules(out_dir + "/keep.pro");
+  std::cout << "Wrote " << dexen.size() << " dexes to " << out_dir
+            << std::endl;
+  delete g_redex;
+  return 0;
+}
@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+r"""
+Measures the latency of the whole redex-all pipeline on a synthetic app.
+
+The app is made by synthetic-app-gen (see SyntheticApp.h) at the given scale,
+then optimized with a standard pass list (config/default.config by default)
+a few times. The total and per-pass wall time, CPU time and peak RSS are the
+medians of these runs; the per-pass ones come from the pass perf stats that
+redex-all writes (see `pass_perf_output`).
+
+With --baseline, the results are compared to those of a previous run, and the
+script fails when any of them regressed by more than the threshold:
+
+  pipeline_bench.py --redex-all build/redex-all \
+    --generator build/synthetic-app-gen --scale medium --output base.json
+  ... (rebuild)
+  pipeline_bench.py --redex-all build/redex-all \
+    --generator build/synthetic-app-gen --scale medium --baseline base.json
+"""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+REPO_ROOT = os.path.dirname(
+    os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+)
+
+# The options of synthetic-app-gen for each scale, besides its defaults.
+SCALES = {
+    "small": {"classes": 2000, "strings": 5000},
+    "medium": {"classes": 20000, "strings": 50000, "giant-methods": 10},
+    "large": {
+        "classes": 100000,
+        "depth": 6,
+        "strings": 300000,
+        "annotations-per-member": 2,
+        "giant-methods": 50,
+        "giant-method-size": 8000,
+    },
+}
+
+METRICS = ["wall_s", "cpu_s", "peak_rss"]
+
+# Differences below these are noise, whatever the threshold.
+MIN_DELTAS = {"wall_s": 0.1, "cpu_s": 0.1, "peak_rss": 64 * 1024 * 1024}
+
+
+def generator_options(args):
+    options = dict(SCALES[args.scale])
+    for option in args.gen_option:
+        name, _, value = option.partition("=")
+        options[name] = value
+    return options
+
+
+def run_generator(args, app_dir):
+    cmd = [args.generator, "-o", app_dir]
+    for name, value in generator_options(args).items():
+        cmd += ["--" + name, str(value)]
+    print("Generating: " + " ".join(cmd))
+    start = time.monotonic()
+    subprocess.check_call(cmd)
+    return time.monotonic() - start
+
+
+def run_redex(args, app_dir, out_dir, log_path):
+    dexes = sorted(
+        os.path.join(app_dir, f) for f in os.listdir(app_dir) if f.endswith(".dex")
+    )
+    cmd = [
+        args.redex_all,
+        "--config",
+        args.config,
+        "--proguard-config",
+        os.path.join(app_dir, "keep.pro"),
+        "--outdir",
+        out_dir,
+    ]
+    for jar in args.jar:
+        cmd += ["--jarpath", jar]
+    cmd += dexes
+
+    with open(log_path, "w") as log:
+        start = time.monotonic()
+        proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+        # Unlike getrusage(RUSAGE_CHILDREN), this only accounts for this run.
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall_s = time.monotonic() - start
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        sys.exit("redex-all failed with status %d, see %s" % (status, log_path))
+
+    total = {
+        "wall_s": wall_s,
+        "cpu_s": rusage.ru_utime + rusage.ru_stime,
+        # In kilobytes on Linux.
+        "peak_rss": rusage.ru_maxrss * 1024,
+    }
+    passes = {}
+    with open(os.path.join(out_dir, "meta", "redex-pass-perf.json")) as f:
+        for p in json.load(f):
+            passes[p["name"]] = {
+                "wall_s": p["wall_s"],
+                "cpu_s": p["user_cpu_s"] + p["sys_cpu_s"],
+                "peak_rss": p["peak_rss"],
+            }
+    return total, passes
+
+
+def median_of(samples):
+    return {m: statistics.median(s[m] for s in samples) for m in METRICS}
+
+
+def measure(args, work_dir):
+    app_dir = os.path.join(work_dir, "app")
+    os.makedirs(app_dir)
+    generate_s = run_generator(args, app_dir)
+
+    totals = []
+    pass_samples = {}
+    pass_order = []
+    for i in range(args.runs):
+        out_dir = os.path.join(work_dir, "out%d" % i)
+        os.makedirs(out_dir)
+        print("Running redex-all (%d/%d)" % (i + 1, args.runs))
+        total, passes = run_redex(
+            args, app_dir, out_dir, os.path.join(work_dir, "redex%d.log" % i)
+        )
+        totals.append(total)
+        for name, sample in passes.items():
+            if name not in pass_samples:
+                pass_order.append(name)
+            pass_samples.setdefault(name, []).append(sample)
+        if not args.keep_outputs:
+            shutil.rmtree(out_dir)
+
+    return {
+        "scale": args.scale,
+        "generator_options": generator_options(args),
+        "config": args.config,
+        "runs": args.runs,
+        "generate_s": generate_s,
+        "total": median_of(totals),
+        "passes": {name: median_of(pass_samples[name]) for name in pass_order},
+    }
+
+
+def format_value(metric, value):
+    if metric == "peak_rss":
+        return "%.0fMB" % (value / (1024 * 1024))
+    return "%.2fs" % value
+
+
+def print_results(results):
+    rows = [("(total)", results["total"])] + list(results["passes"].items())
+    width = max(len(name) for name, _ in rows)
+    print("%-*s %10s %10s %10s" % (width, "", "wall", "cpu", "peak rss"))
+    for name, values in rows:
+        print(
+            "%-*s %10s %10s %10s"
+            % ((width, name) + tuple(format_value(m, values[m]) for m in METRICS))
+        )
+
+
+def find_regressions(results, baseline, threshold):
+    regressions = []
+    rows = [("(total)", results["total"], baseline["total"])]
+    for name, values in results["passes"].items():
+        if name in baseline["passes"]:
+            rows.append((name, values, baseline["passes"][name]))
+    for name, values, base_values in rows:
+        for m in METRICS:
+            new, old = values[m], base_values[m]
+            if new - old > max(old * threshold, MIN_DELTAS[m]):
+                regressions.append(
+                    "%s %s: %s -> %s (%+.0f%%)"
+                    % (
+                        name,
+                        m,
+                        format_value(m, old),
+                        format_value(m, new),
+                        100.0 * (new - old) / old if old else float("inf"),
+                    )
+                )
+    return regressions
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument(
+        "--redex-all", default=shutil.which("redex-all"), help="redex-all binary"
+    )
+    parser.add_argument(
+        "--generator",
+        default=shutil.which("synthetic-app-gen"),
+        help="synthetic-app-gen binary",
+    )
+    parser.add_argument("--scale", choices=sorted(SCALES), default="medium")
+    parser.add_argument(
+        "--gen-option",
+        action="append",
+        default=[],
+        help="option of synthetic-app-gen that overrides the scale's, e.g. "
+        "classes=5000 (may be repeated)",
+    )
+    parser.add_argument(
+        "--config",
+        default=os.path.join(REPO_ROOT, "config", "default.config"),
+        help="redex-all config with the pass list to run",
+    )
+    parser.add_argument(
+        "--jar",
+        action="append",
+        default=[],
+        help="library jar, e.g. android.jar (may be repeated)",
+    )
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--work-dir", help="defaults to a temporary directory")
+    parser.add_argument(
+        "--keep-outputs", action="store_true", help="keep the outputs of redex-all"
+    )
+    parser.add_argument("--output", help="file to write the results to, as JSON")
+    parser.add_argument("--baseline", help="results of a previous run to compare to")
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=0.1,
+        help="relative increase of any metric that counts as a regression",
+    )
+    args = parser.parse_args()
+
+    if not args.redex_all or not args.generator:
+        parser.error("redex-all and synthetic-app-gen must be given or on PATH")
+
+    if args.work_dir:
+        os.makedirs(args.work_dir)
+        results = measure(args, args.work_dir)
+    else:
+        with tempfile.TemporaryDirectory(prefix="redex_pipeline_bench_") as d:
+            results = measure(args, d)
+
+    print_results(results)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = find_regressions(results, baseline, args.threshold)
+        if regressions:
+            print("REGRESSIONS:")
+            for r in regressions:
+                print("  " + r)
+            sys.exit(1)
+        print("No regressions over %.0f%%" % (100 * args.threshold))
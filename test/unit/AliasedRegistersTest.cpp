@@ -374,6 +374,49 @@ TEST(AliasedRegistersTest, AbstractValueJoin) {
   EXPECT_FALSE(a.are_aliases(four, three));
 }
 
+TEST(AliasedRegistersTest, AbstractValueMeetMergesGroups) {
+  AliasedRegisters a;
+  AliasedRegisters b;
+
+  a.move(zero, one);
+  a.move(two, three);
+  b.move(one, two);
+  b.move(int_one_lit, two);
+
+  a.meet_with(b);
+
+  EXPECT_TRUE(a.are_aliases(zero, three));
+  EXPECT_TRUE(a.are_aliases(int_one_lit, zero));
+  EXPECT_TRUE(a.leq(b));
+  EXPECT_FALSE(b.leq(a));
+  EXPECT_EQ(1, a.get_representative(three));
+}
+
+TEST(AliasedRegistersTest, AbstractValueJoinKeepsOrder) {
+  AliasedRegisters a;
+  AliasedRegisters b;
+
+  a.move(one, two);
+  a.move(zero, one);
+  a.move(three, zero);
+  b.move(zero, two);
+  b.move(one, zero);
+
+  a.join_with(b);
+
+  EXPECT_TRUE(a.are_aliases(zero, one));
+  EXPECT_TRUE(a.are_aliases(one, two));
+  EXPECT_FALSE(a.are_aliases(two, three));
+  EXPECT_EQ(2, a.get_representative(zero));
+  // a and b disagree on whether zero or one is older, so the lower one is.
+  EXPECT_EQ(0, a.get_representative(zero, 1));
+  EXPECT_TRUE(a.equals(b));
+
+  a.break_alias(two);
+  a.break_alias(one);
+  EXPECT_EQ(AbstractValueKind::Top, a.kind());
+}
+
 TEST(AliasedRegistersTest, CopyOnWriteDomain) {
   AliasDomain x(AbstractValueKind::Top);
   AliasDomain y = x; // take a reference
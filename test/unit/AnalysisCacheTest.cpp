@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisCache.h"
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+namespace {
+
+struct Summary {
+  int32_t value;
+
+  static Summary from_s_expr(const sparta::s_expr& expr) {
+    return Summary{expr.get_int32()};
+  }
+};
+
+sparta::s_expr to_s_expr(const Summary& summary) {
+  return sparta::s_expr(summary.value);
+}
+
+using SummaryMap = std::unordered_map<const DexMethodRef*, Summary>;
+
+} // namespace
+
+class AnalysisCacheTest : public RedexTest {};
+
+TEST_F(AnalysisCacheTest, reuseUnchangedSummaries) {
+  auto clinit = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.<clinit>:()V"
+     (
+      (invoke-static () "LBar;.bar:()V")
+      (invoke-static () "LBaz;.baz:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto bar = assembler::method_from_string(R"(
+    (method (public static) "LBar;.bar:()V"
+     (
+      (invoke-static () "LBar;.qux:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto qux = assembler::method_from_string(R"(
+    (method (public static) "LBar;.qux:()V"
+     (
+      (return-void)
+     )
+    )
+  )");
+  auto baz = assembler::method_from_string(R"(
+    (method (public static) "LBaz;.baz:()V"
+     (
+      (return-void)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {clinit}),
+              assembler::class_with_methods("LBar;", {bar, qux}),
+              assembler::class_with_methods("LBaz;", {baz})};
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+
+  auto cg = call_graph::single_callee_graph(scope);
+  analysis_cache::MethodSummaryCache cache(path, scope, cg, /* salt */ 1);
+  SummaryMap summaries;
+  EXPECT_EQ(0, cache.read(&summaries));
+  cache.write(SummaryMap{{clinit, Summary{1}},
+                         {bar, Summary{2}},
+                         {qux, Summary{3}},
+                         {baz, Summary{4}}});
+
+  // Nothing changed.
+  EXPECT_EQ(4, cache.read(&summaries));
+  EXPECT_EQ(2, summaries.at(bar).value);
+
+  // A different salt invalidates the whole cache.
+  summaries.clear();
+  analysis_cache::MethodSummaryCache other_cache(path, scope, cg,
+                                                 /* salt */ 2);
+  EXPECT_EQ(0, other_cache.read(&summaries));
+
+  // Changing LBar; invalidates its methods, and their callers.
+  bar->get_code()->push_back(new IRInstruction(OPCODE_NOP));
+  analysis_cache::MethodSummaryCache new_cache(path, scope, cg, /* salt */ 1);
+  EXPECT_EQ(1, new_cache.read(&summaries));
+  EXPECT_EQ(4, summaries.at(baz).value);
+
+  boost::filesystem::remove(path);
+}
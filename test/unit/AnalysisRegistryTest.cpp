@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "AnalysisRegistry.h"
+
+#include <gtest/gtest.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+namespace {
+
+struct ClassCount {
+  static size_t s_num_built;
+
+  explicit ClassCount(const Scope& scope) : value(scope.size()) {
+    ++s_num_built;
+  }
+
+  size_t value;
+};
+
+size_t ClassCount::s_num_built = 0;
+
+struct OtherAnalysis {
+  explicit OtherAnalysis(const Scope&) {}
+};
+
+// Reads ClassCount, and preserves it or not.
+class ReaderPass : public Pass {
+ public:
+  ReaderPass(const std::string& name, bool preserves)
+      : Pass(name), m_preserves(preserves) {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    mgr.set_metric("classes", mgr.get_analysis<ClassCount>(stores)->value);
+  }
+
+  PreservedAnalyses get_preserved_analyses() const override {
+    return m_preserves ? PreservedAnalyses::none().preserve<ClassCount>()
+                       : PreservedAnalyses::none();
+  }
+
+ private:
+  bool m_preserves;
+};
+
+DexStoresVector make_stores() {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(type::java_lang_Object());
+  DexStore store("classes");
+  store.add_classes({creator.create()});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+} // namespace
+
+class AnalysisRegistryTest : public RedexTest {
+ protected:
+  AnalysisRegistryTest() { ClassCount::s_num_built = 0; }
+};
+
+TEST_F(AnalysisRegistryTest, invalidateUnlessPreserved) {
+  auto stores = make_stores();
+  AnalysisRegistry registry;
+  auto count = registry.get<ClassCount>(stores);
+  EXPECT_EQ(1, count->value);
+  EXPECT_EQ(count, registry.get<ClassCount>(stores));
+  registry.get<OtherAnalysis>(stores);
+  EXPECT_EQ(2, registry.size());
+  EXPECT_EQ(2, registry.num_builds());
+
+  registry.invalidate(PreservedAnalyses::all());
+  EXPECT_EQ(2, registry.size());
+  registry.invalidate(PreservedAnalyses::none().preserve<ClassCount>());
+  EXPECT_EQ(1, registry.size());
+  EXPECT_EQ(count, registry.get<ClassCount>(stores));
+  registry.invalidate(PreservedAnalyses::none());
+  EXPECT_EQ(0, registry.size());
+
+  // The invalidated analysis outlives the registry's copy.
+  EXPECT_EQ(1, count->value);
+  EXPECT_NE(count, registry.get<ClassCount>(stores));
+  EXPECT_EQ(2, ClassCount::s_num_built);
+}
+
+TEST_F(AnalysisRegistryTest, sharedAcrossPasses) {
+  auto stores = make_stores();
+  ReaderPass first("FirstPass", /* preserves */ true);
+  ReaderPass second("SecondPass", /* preserves */ false);
+  ReaderPass third("ThirdPass", /* preserves */ true);
+  PassManager manager({&first, &second, &third});
+  manager.set_testing_mode();
+  Json::Value json_conf(Json::objectValue);
+  ConfigFiles conf(json_conf);
+  manager.run_passes(stores, conf);
+
+  // The second pass reuses the analysis of the first one, and the third one
+  // recomputes it.
+  EXPECT_EQ(2, ClassCount::s_num_built);
+  for (const auto& info : manager.get_pass_info()) {
+    EXPECT_EQ(1, info.metrics.at("classes"));
+  }
+}
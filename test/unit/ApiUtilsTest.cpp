@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 
 #include "ApiLevelsUtils.h"
@@ -241,3 +242,47 @@ TEST(ApiUtilsTest, testHasMethod) {
 
   EXPECT_TRUE(sdk.has_method(method));
 }
+
+TEST(ApiUtilsTest, testSdkCache) {
+  g_redex = new RedexContext();
+
+  auto cache_dir = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path();
+  boost::filesystem::create_directories(cache_dir);
+  auto api_file =
+      boost::optional<std::string>(std::getenv("api_utils_easy_input_path"));
+
+  // The first SDK parses the file and writes the cache, the second one only
+  // reads the cache.
+  api::AndroidSDK parsed(api_file, cache_dir.string());
+  api::AndroidSDK cached(api_file, cache_dir.string());
+
+  auto android_view = DexType::make_type("Landroid/view/View;");
+  auto void_empty =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  auto method = static_cast<DexMethod*>(DexMethod::make_method(
+      android_view, DexString::make_string("clearFocus"), void_empty));
+  method->set_access(ACC_PUBLIC);
+  method->set_virtual(true);
+  method->set_external();
+  auto missing = static_cast<DexMethod*>(DexMethod::make_method(
+      android_view, DexString::make_string("joJo"), void_empty));
+  missing->set_access(ACC_PUBLIC);
+  missing->set_external();
+
+  EXPECT_TRUE(cached.has_method(method));
+  EXPECT_FALSE(cached.has_method(missing));
+
+  const auto& expected = parsed.get_framework_classes();
+  const auto& actual = cached.get_framework_classes();
+  EXPECT_EQ(actual.size(), expected.size());
+  for (const auto& pair : expected) {
+    const auto& api = actual.at(pair.first);
+    EXPECT_EQ(api.super_cls, pair.second.super_cls);
+    EXPECT_EQ(api.access_flags, pair.second.access_flags);
+    EXPECT_EQ(api.mrefs_info.size(), pair.second.mrefs_info.size());
+    EXPECT_EQ(api.frefs_info.size(), pair.second.frefs_info.size());
+  }
+
+  boost::filesystem::remove_all(cache_dir);
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <zlib.h>
+
+#include "ApkRepack.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void put16(std::string& out, uint16_t v) {
+  out.push_back(v & 0xff);
+  out.push_back(v >> 8);
+}
+
+void put32(std::string& out, uint32_t v) {
+  put16(out, v & 0xffff);
+  put16(out, v >> 16);
+}
+
+/*
+ * A zip with stored entries only, which the zip tools we could rely on
+ * wouldn't produce.
+ */
+void write_stored_zip(
+    const std::string& path,
+    const std::vector<std::pair<std::string, std::string>>& files) {
+  std::string zip;
+  std::string cdir;
+  for (const auto& file : files) {
+    const auto& name = file.first;
+    const auto& data = file.second;
+    uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                         data.size());
+    uint32_t offset = zip.size();
+    put32(zip, 0x04034b50);
+    put16(zip, 10);
+    put16(zip, 0);
+    put16(zip, 0);
+    put32(zip, 0);
+    put32(zip, crc);
+    put32(zip, data.size());
+    put32(zip, data.size());
+    put16(zip, name.size());
+    put16(zip, 0);
+    zip += name + data;
+
+    put32(cdir, 0x02014b50);
+    put16(cdir, 10);
+    put16(cdir, 10);
+    put16(cdir, 0);
+    put16(cdir, 0);
+    put32(cdir, 0);
+    put32(cdir, crc);
+    put32(cdir, data.size());
+    put32(cdir, data.size());
+    put16(cdir, name.size());
+    put32(cdir, 0);
+    put32(cdir, 0);
+    put32(cdir, 0);
+    put32(cdir, offset);
+    cdir += name;
+  }
+  uint32_t cdir_offset = zip.size();
+  zip += cdir;
+  put32(zip, 0x06054b50);
+  put32(zip, 0);
+  put16(zip, files.size());
+  put16(zip, files.size());
+  put32(zip, cdir.size());
+  put32(zip, cdir_offset);
+  put16(zip, 0);
+  std::ofstream(path, std::ios::binary) << zip;
+}
+
+std::string read(const fs::path& path) {
+  std::ifstream in(path.string(), std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+void write(const fs::path& path, const std::string& contents) {
+  std::ofstream(path.string(), std::ios::binary) << contents;
+}
+
+} // namespace
+
+class ApkRepackTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    m_root = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(m_root);
+  }
+
+  void TearDown() override { fs::remove_all(m_root); }
+
+  fs::path m_root;
+};
+
+TEST_F(ApkRepackTest, repackAligned) {
+  auto original = (m_root / "original.apk").string();
+  std::string lib = "library contents";
+  write_stored_zip(original, {{"res/raw/a.bin", "old resource"},
+                              {"lib/arm64/libfoo.so", lib}});
+
+  auto extracted = m_root / "extracted";
+  apk_repack::unpack(original, extracted.string());
+  EXPECT_EQ("old resource", read(extracted / "res/raw/a.bin"));
+  EXPECT_EQ(lib, read(extracted / "lib/arm64/libfoo.so"));
+
+  std::string dex(10000, 'x');
+  write(extracted / "classes.dex", dex);
+  std::string resource = "new resource";
+  write(extracted / "res/raw/a.bin", resource);
+
+  auto output = (m_root / "output.apk").string();
+  apk_repack::Options options;
+  options.page_align_libs = true;
+  auto stats = apk_repack::repack(original, extracted.string(), output,
+                                  options);
+  EXPECT_EQ(1, stats.copied);
+  EXPECT_EQ(1, stats.compressed);
+  EXPECT_EQ(1, stats.stored);
+
+  // Stored entries are aligned, and the new file is compressed.
+  auto bytes = read(output);
+  auto lib_offset = bytes.find(lib);
+  ASSERT_NE(std::string::npos, lib_offset);
+  EXPECT_EQ(0, lib_offset % 4096);
+  auto resource_offset = bytes.find(resource);
+  ASSERT_NE(std::string::npos, resource_offset);
+  EXPECT_EQ(0, resource_offset % 4);
+  EXPECT_LT(bytes.size(), dex.size());
+
+  auto roundtrip = m_root / "roundtrip";
+  apk_repack::unpack(output, roundtrip.string());
+  EXPECT_EQ(dex, read(roundtrip / "classes.dex"));
+  EXPECT_EQ(resource, read(roundtrip / "res/raw/a.bin"));
+  EXPECT_EQ(lib, read(roundtrip / "lib/arm64/libfoo.so"));
+
+  // Nothing changed, so every entry is copied, and the output is the same.
+  auto again = (m_root / "again.apk").string();
+  stats = apk_repack::repack(output, roundtrip.string(), again, options);
+  EXPECT_EQ(3, stats.copied);
+  EXPECT_EQ(bytes, read(again));
+}
+
+TEST_F(ApkRepackTest, repackWithoutOriginal) {
+  auto extracted = m_root / "extracted";
+  fs::create_directories(extracted / "b");
+  write(extracted / "z.txt", "z");
+  write(extracted / "b" / "y.txt", "y");
+  write(extracted / "a.txt", "");
+
+  auto output = (m_root / "output.apk").string();
+  apk_repack::Options options;
+  // Write and compress the entries one at a time.
+  options.window_size = 1;
+  auto stats = apk_repack::repack("", extracted.string(), output, options);
+  EXPECT_EQ(3, stats.compressed);
+
+  auto bytes = read(output);
+  // Files come before subdirectories.
+  auto a = bytes.find("a.txt");
+  auto z = bytes.find("z.txt");
+  auto y = bytes.find("b/y.txt");
+  EXPECT_LT(a, z);
+  EXPECT_LT(z, y);
+
+  auto roundtrip = m_root / "roundtrip";
+  apk_repack::unpack(output, roundtrip.string());
+  EXPECT_EQ("", read(roundtrip / "a.txt"));
+  EXPECT_EQ("y", read(roundtrip / "b" / "y.txt"));
+  EXPECT_EQ("z", read(roundtrip / "z.txt"));
+}
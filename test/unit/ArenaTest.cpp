@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+namespace {
+
+struct Point {
+  Point(uint32_t x, uint64_t y) : x(x), y(y) {}
+  uint32_t x;
+  uint64_t y;
+};
+
+} // namespace
+
+TEST(ArenaTest, allocationsAreAlignedAndPacked) {
+  Arena arena;
+  auto c = static_cast<char*>(arena.allocate(1, 1));
+  auto p1 = arena.make<Point>(1, 2);
+  auto p2 = arena.make<Point>(3, 4);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p1) % alignof(Point));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p2) % alignof(Point));
+  EXPECT_GT(reinterpret_cast<char*>(p1), c);
+  EXPECT_EQ(p1 + 1, p2);
+  EXPECT_EQ(1, p1->x);
+  EXPECT_EQ(4, p2->y);
+  EXPECT_EQ(1, arena.num_blocks());
+  EXPECT_EQ(1 + 2 * sizeof(Point), arena.bytes_allocated());
+}
+
+TEST(ArenaTest, growsAndHandlesLargeAllocations) {
+  Arena arena;
+  std::vector<Point*> points;
+  for (uint32_t i = 0; i < 3 * Arena::kBlockSize / sizeof(Point); ++i) {
+    points.push_back(arena.make<Point>(i, i));
+  }
+  EXPECT_GE(arena.num_blocks(), 3);
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(i, points[i]->x);
+  }
+
+  auto last = arena.make<Point>(0, 0);
+  auto blocks = arena.num_blocks();
+  // A large allocation gets its own block, and does not retire the current
+  // one.
+  arena.allocate(Arena::kBlockSize * 2, 1);
+  EXPECT_EQ(blocks + 1, arena.num_blocks());
+  EXPECT_EQ(last + 1, arena.make<Point>(0, 0));
+}
+
+TEST(ArenaTest, concurrentAllocations) {
+  constexpr size_t kThreads = 8;
+  constexpr size_t kPerThread = 10000;
+  ConcurrentArena<> arena;
+  std::vector<std::vector<Point*>> points(kThreads);
+  std::vector<boost::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < kPerThread; ++i) {
+        points[t].push_back(arena.make<Point>(t, i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::vector<Point*> all;
+  for (size_t t = 0; t < kThreads; ++t) {
+    for (size_t i = 0; i < kPerThread; ++i) {
+      EXPECT_EQ(t, points[t][i]->x);
+      EXPECT_EQ(i, points[t][i]->y);
+      all.push_back(points[t][i]);
+    }
+  }
+  std::sort(all.begin(), all.end());
+  EXPECT_EQ(all.end(), std::adjacent_find(all.begin(), all.end()));
+  EXPECT_EQ(kThreads * kPerThread * sizeof(Point), arena.bytes_allocated());
+}
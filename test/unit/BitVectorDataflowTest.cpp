@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BitVectorDataflow.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "Liveness.h"
+#include "ReachingDefinitions.h"
+#include "RedexTest.h"
+
+namespace {
+
+class BitVectorDataflowTest : public RedexTest {};
+
+// A loop, so that the fixpoint takes more than one round.
+const char* kLoop = R"((
+  (load-param v0)
+  (const v1 0)
+  (const v2 0)
+  (:loop)
+  (if-ge v1 v0 :end)
+  (add-int v2 v2 v1)
+  (add-int/lit8 v1 v1 1)
+  (goto :loop)
+  (:end)
+  (return v2)
+))";
+
+TEST_F(BitVectorDataflowTest, livenessMatchesSparseAnalysis) {
+  auto code = assembler::ircode_from_string(kLoop);
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+
+  LivenessFixpointIterator sparse(cfg);
+  sparse.run(LivenessDomain());
+  bitvector_dataflow::Liveness dense(cfg);
+  dense.run();
+
+  for (auto b : cfg.blocks()) {
+    auto live_in = sparse.get_live_in_vars_at(b);
+    auto live_out = sparse.get_live_out_vars_at(b);
+    for (reg_t reg = 0; reg < cfg.get_registers_size(); ++reg) {
+      EXPECT_EQ(live_in.contains(reg), dense.get_live_in_vars_at(b).test(reg))
+          << "v" << reg << " in B" << b->id();
+      EXPECT_EQ(live_out.contains(reg),
+                dense.get_live_out_vars_at(b).test(reg))
+          << "v" << reg << " in B" << b->id();
+    }
+  }
+  code->clear_cfg();
+}
+
+TEST_F(BitVectorDataflowTest, reachingDefinitionsMatchSparseAnalysis) {
+  auto code = assembler::ircode_from_string(kLoop);
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+
+  reaching_defs::FixpointIterator sparse(cfg);
+  sparse.run(reaching_defs::Environment());
+  bitvector_dataflow::ReachingDefinitions dense(cfg);
+  dense.run();
+
+  size_t num_checked = 0;
+  for (auto b : cfg.blocks()) {
+    auto sparse_defs = sparse.get_entry_state_at(b);
+    auto dense_defs = dense.get_entry_state_at(b);
+    for (const auto& mie : InstructionIterable(b)) {
+      for (size_t i = 0; i < mie.insn->srcs_size(); ++i) {
+        auto reg = mie.insn->src(i);
+        auto expected = sparse_defs.get(reg);
+        auto actual = dense.get_defs(dense_defs, reg);
+        ASSERT_FALSE(expected.is_top());
+        EXPECT_EQ(expected.size(), actual.size());
+        for (auto def : actual) {
+          EXPECT_TRUE(expected.contains(def));
+        }
+        ++num_checked;
+      }
+      sparse.analyze_instruction(mie.insn, &sparse_defs);
+      dense.analyze_instruction(mie.insn, &dense_defs);
+    }
+  }
+  // Every use of the loop.
+  EXPECT_EQ(6, num_checked);
+  code->clear_cfg();
+}
+
+} // namespace
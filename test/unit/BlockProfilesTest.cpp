@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "BlockProfiles.h"
+#include "RedexTest.h"
+
+class BlockProfilesTest : public RedexTest {};
+
+TEST_F(BlockProfilesTest, parse) {
+  auto method = DexMethod::make_method("LFoo;.bar:(I)V");
+  std::istringstream in(
+      "name,num_opcodes,block_counts\n"
+      "LFoo;.bar:(I)V,12,100 98 2 0\n"
+      "LFoo;.missing:()V,3,1\n");
+  block_profiles::BlockProfiles profiles;
+  ASSERT_TRUE(profiles.parse(in));
+  EXPECT_TRUE(profiles.has_stats());
+
+  auto blocks = profiles.get(method);
+  ASSERT_NE(nullptr, blocks);
+  EXPECT_EQ(12, blocks->num_opcodes);
+  EXPECT_EQ((std::vector<uint64_t>{100, 98, 2, 0}), blocks->counts);
+  EXPECT_EQ(nullptr, profiles.get(DexMethod::make_method("LFoo;.baz:()V")));
+}
+
+TEST_F(BlockProfilesTest, parseErrors) {
+  DexMethod::make_method("LFoo;.bar:(I)V");
+  block_profiles::BlockProfiles profiles;
+  std::istringstream bad_header("name,blocks\nLFoo;.bar:(I)V,12,1\n");
+  EXPECT_FALSE(profiles.parse(bad_header));
+
+  std::istringstream bad_counts(
+      "name,num_opcodes,block_counts\nLFoo;.bar:(I)V,12,1 x\n");
+  EXPECT_FALSE(profiles.parse(bad_counts));
+  EXPECT_FALSE(profiles.has_stats());
+}
@@ -382,4 +382,45 @@ TEST_F(CFGMutationTest, Clear) {
       ))");
 }
 
+TEST_F(CFGMutationTest, Retarget) {
+  EXPECT_MUTATION(
+      [](ControlFlowGraph& cfg) {
+        CFGMutation m(cfg);
+
+        auto const_3 = nth_insn(cfg, 7);
+        EXPECT_EQ(const_3->insn->opcode(), OPCODE_CONST);
+        EXPECT_EQ(const_3->insn->get_literal(), 3);
+
+        auto branch =
+            cfg.get_succ_edge_of_type(cfg.entry_block(), EDGE_BRANCH);
+        m.retarget(branch, const_3.block());
+        m.insert_before(const_3, {dasm(OPCODE_CONST, {4_v, 4_L})});
+        m.flush();
+      },
+      /* ACTUAL */ R"((
+        (const v0 0)
+        (if-eqz v0 :l1)
+        (const v1 1)
+        (if-nez v1 :l2)
+        (return-void)
+        (:l1)
+        (const v2 2)
+        (return-void)
+        (:l2)
+        (const v3 3)
+        (return-void)
+      ))",
+      /* EXPECTED */ R"((
+        (const v0 0)
+        (if-eqz v0 :l2)
+        (const v1 1)
+        (if-nez v1 :l2)
+        (return-void)
+        (:l2)
+        (const v4 4)
+        (const v3 3)
+        (return-void)
+      ))");
+}
+
 } // namespace
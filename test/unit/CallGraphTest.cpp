@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CallGraph.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class CallGraphTest : public RedexTest {};
+
+TEST_F(CallGraphTest, editEdgesAndNodes) {
+  auto clinit = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.<clinit>:()V"
+     (
+      (invoke-static () "LFoo;.bar:()V")
+      (invoke-static () "LFoo;.baz:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto bar = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (invoke-static () "LFoo;.bar:()V")
+      (invoke-static () "LFoo;.baz:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto baz = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.baz:()V"
+     (
+      (return-void)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {clinit, bar, baz})};
+
+  auto cg = call_graph::single_callee_graph(scope);
+  EXPECT_EQ(2, cg.node(clinit).callees().size());
+  EXPECT_EQ(2, cg.node(bar).callees().size());
+  EXPECT_EQ(2, cg.node(baz).callers().size());
+
+  // Drop the call of baz by clinit.
+  auto invoke_baz = cg.node(clinit).callees()[1]->invoke_iterator();
+  EXPECT_TRUE(cg.remove_edge(clinit, invoke_baz));
+  EXPECT_FALSE(cg.remove_edge(clinit, invoke_baz));
+  ASSERT_EQ(1, cg.node(clinit).callees().size());
+  EXPECT_EQ(bar, cg.node(clinit).callees()[0]->callee());
+  ASSERT_EQ(1, cg.node(baz).callers().size());
+  EXPECT_EQ(bar, cg.node(baz).callers()[0]->caller());
+
+  cg.remove_node(bar);
+  EXPECT_FALSE(cg.has_node(bar));
+  EXPECT_TRUE(cg.node(clinit).callees().empty());
+  EXPECT_TRUE(cg.node(baz).callers().empty());
+
+  cg.add_edge(clinit, baz, invoke_baz);
+  EXPECT_EQ(1, cg.node(baz).callers().size());
+}
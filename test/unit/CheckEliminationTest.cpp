@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "CheckElimination.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+class CheckEliminationTest : public RedexTest {};
+
+void test(DexMethod* method,
+          const std::string& expected_str,
+          size_t expected_branches_removed,
+          size_t expected_null_checks_removed,
+          size_t expected_check_casts_removed) {
+  auto expected = assembler::ircode_from_string(expected_str);
+  auto stats = CheckEliminationPass::process_method(
+      method, CheckEliminationPass::get_null_check_methods());
+  EXPECT_EQ(expected_branches_removed, stats.branches_removed);
+  EXPECT_EQ(expected_null_checks_removed, stats.null_checks_removed);
+  EXPECT_EQ(expected_check_casts_removed, stats.check_casts_removed);
+
+  printf("%s\n", assembler::to_string(method->get_code()).c_str());
+  EXPECT_CODE_EQ(method->get_code(), expected.get());
+}
+
+TEST_F(CheckEliminationTest, this_is_not_null) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.bar:()I"
+     (
+      (load-param-object v0)
+      (if-eqz v0 :null)
+      (const v1 1)
+      (return v1)
+
+      (:null)
+      (const v1 0)
+      (return v1)
+     )
+    )
+  )");
+  const auto& expected_str = R"(
+    (
+      (load-param-object v0)
+      (const v1 1)
+      (return v1)
+    )
+  )";
+  test(method, expected_str, 1, 0, 0);
+}
+
+TEST_F(CheckEliminationTest, parameter_may_be_null) {
+  const auto& code_str = R"(
+    (
+      (load-param-object v0)
+      (if-eqz v0 :null)
+      (const v1 1)
+      (return v1)
+
+      (:null)
+      (const v1 0)
+      (return v1)
+    )
+  )";
+  auto method = assembler::method_from_string(
+      std::string(R"((method (public static) "LFoo;.bar:(LFoo;)I" )") +
+      code_str + ")");
+  test(method, code_str, 0, 0, 0);
+}
+
+TEST_F(CheckEliminationTest, null_checks_of_new_instance) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()Ljava/lang/Object;"
+     (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "LFoo;.<init>:()V")
+      (invoke-virtual (v0) "Ljava/lang/Object;.getClass:()Ljava/lang/Class;")
+      (invoke-static (v0) "Ljava/util/Objects;.requireNonNull:(Ljava/lang/Object;)Ljava/lang/Object;")
+      (move-result-object v1)
+      (return-object v1)
+     )
+    )
+  )");
+  const auto& expected_str = R"(
+    (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "LFoo;.<init>:()V")
+      (move-object v1 v0)
+      (return-object v1)
+    )
+  )";
+  test(method, expected_str, 0, 2, 0);
+}
+
+TEST_F(CheckEliminationTest, get_class_with_used_result) {
+  const auto& code_str = R"(
+    (
+      (load-param-object v0)
+      (invoke-virtual (v0) "Ljava/lang/Object;.getClass:()Ljava/lang/Class;")
+      (move-result-object v1)
+      (return-object v1)
+    )
+  )";
+  auto method = assembler::method_from_string(
+      std::string(R"((method (public) "LFoo;.bar:()Ljava/lang/Class;" )") +
+      code_str + ")");
+  test(method, code_str, 0, 0, 0);
+}
+
+TEST_F(CheckEliminationTest, array_length_is_not_negative) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:([I)I"
+     (
+      (load-param-object v0)
+      (array-length v0)
+      (move-result-pseudo v1)
+      (if-ltz v1 :negative)
+      (return v1)
+
+      (:negative)
+      (const v1 0)
+      (return v1)
+     )
+    )
+  )");
+  const auto& expected_str = R"(
+    (
+      (load-param-object v0)
+      (array-length v0)
+      (move-result-pseudo v1)
+      (return v1)
+    )
+  )";
+  test(method, expected_str, 1, 0, 0);
+}
+
+TEST_F(CheckEliminationTest, index_within_array_length) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+     (
+      (load-param v0)
+      (const v1 2)
+      (new-array v1 "[I")
+      (move-result-pseudo-object v2)
+      (const v3 1)
+      (aput v0 v2 v3)
+      (array-length v2)
+      (move-result-pseudo v4)
+      (if-ge v3 v4 :out_of_bounds)
+      (aget v2 v3)
+      (move-result-pseudo v5)
+      (return v5)
+
+      (:out_of_bounds)
+      (const v5 -1)
+      (return v5)
+     )
+    )
+  )");
+  const auto& expected_str = R"(
+    (
+      (load-param v0)
+      (const v1 2)
+      (new-array v1 "[I")
+      (move-result-pseudo-object v2)
+      (const v3 1)
+      (aput v0 v2 v3)
+      (array-length v2)
+      (move-result-pseudo v4)
+      (aget v2 v3)
+      (move-result-pseudo v5)
+      (return v5)
+    )
+  )";
+  test(method, expected_str, 1, 0, 0);
+}
+
+TEST_F(CheckEliminationTest, check_cast_of_new_instance) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()LFoo;"
+     (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "LFoo;.<init>:()V")
+      (check-cast v0 "LFoo;")
+      (move-result-pseudo-object v1)
+      (return-object v1)
+     )
+    )
+  )");
+  const auto& expected_str = R"(
+    (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "LFoo;.<init>:()V")
+      (move-object v1 v0)
+      (return-object v1)
+    )
+  )";
+  test(method, expected_str, 0, 0, 1);
+}
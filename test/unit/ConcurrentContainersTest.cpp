@@ -8,6 +8,7 @@
 #include "ConcurrentContainers.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <gtest/gtest.h>
@@ -232,3 +233,144 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
   map.clear();
   EXPECT_EQ(0, map.size());
 }
+
+TEST_F(ConcurrentContainersTest, getOrEmplaceTest) {
+  ConcurrentMap<uint32_t, std::string> map;
+  ConcurrentContainerStats stats;
+  std::atomic<size_t> num_created{0};
+  // Every thread tries to intern every element; each value must be created
+  // exactly once, and all threads must observe the same one.
+  run_on_samples([&](const std::vector<uint32_t>&) {
+    for (auto x : m_data) {
+      auto value = map.get_or_emplace(
+          x,
+          [&]() {
+            ++num_created;
+            return std::make_pair(x, std::to_string(x));
+          },
+          &stats);
+      EXPECT_EQ(std::to_string(x), value);
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  EXPECT_EQ(m_data_set.size(), num_created.load());
+  EXPECT_EQ(m_data_set.size(), stats.num_insertions.load());
+  EXPECT_EQ(kThreads * m_data.size(), stats.num_operations.load());
+  EXPECT_LE(stats.num_contended.load(), stats.num_operations.load());
+}
+
+TEST_F(ConcurrentContainersTest, concurrentHashMapTest) {
+  // Start small so that the table grows while other threads read it.
+  ConcurrentHashMap<std::string, uint32_t> map;
+
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      std::string s = std::to_string(sample[i]);
+      map.insert({s, sample[i]});
+      auto value = map.get(s);
+      ASSERT_NE(nullptr, value);
+      EXPECT_EQ(sample[i], *value);
+      // Lookups of keys that other threads may be inserting
+      auto other = std::to_string(m_data[(i * kThreads) % m_data.size()]);
+      if (auto other_value = map.get(other)) {
+        EXPECT_EQ(other, std::to_string(*other_value));
+      }
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  for (uint32_t x : m_data) {
+    std::string s = std::to_string(x);
+    EXPECT_EQ(1, map.count(s));
+    EXPECT_EQ(x, map.at(s));
+  }
+  EXPECT_EQ(0, map.count("not a number"));
+  EXPECT_EQ(nullptr, map.get("not a number"));
+  EXPECT_THROW(map.at("not a number"), std::out_of_range);
+
+  std::unordered_map<uint32_t, size_t> occurrences;
+  for (uint32_t x : m_data) {
+    ++occurrences[x];
+  }
+  // Updates of existing keys, mixed with insertions of new ones and lookups
+  std::atomic<size_t> num_created{0};
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (size_t i = 0; i < sample.size(); ++i) {
+      std::string s = std::to_string(sample[i]);
+      map.update(
+          s, [&s](const std::string& key, uint32_t& value, bool key_exists) {
+            EXPECT_EQ(s, key);
+            EXPECT_TRUE(key_exists);
+            ++value;
+          });
+      map.update("#" + s,
+                 [&](const std::string&, uint32_t& value, bool key_exists) {
+                   if (!key_exists) {
+                     ++num_created;
+                   }
+                   ++value;
+                 });
+      EXPECT_LT(sample[i], map.at(s));
+    }
+  });
+  EXPECT_EQ(2 * m_data_set.size(), map.size());
+  EXPECT_EQ(m_data_set.size(), num_created.load());
+  size_t num_entries = 0;
+  for (const auto& pair : map) {
+    ++num_entries;
+    if (pair.first[0] == '#') {
+      EXPECT_EQ(occurrences[std::stoul(pair.first.substr(1))], pair.second);
+    } else {
+      uint32_t x = std::stoul(pair.first);
+      EXPECT_EQ(x + occurrences[x], pair.second);
+    }
+  }
+  EXPECT_EQ(map.size(), num_entries);
+
+  EXPECT_FALSE(map.emplace("#" + std::to_string(m_data[0]), 0).second);
+  auto result = map.emplace("a", 1);
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(1, *result.first);
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.end(), map.begin());
+  EXPECT_EQ(0, map.count("a"));
+}
+
+TEST_F(ConcurrentContainersTest, parallelForEachTest) {
+  ConcurrentMap<uint32_t, uint32_t> map;
+  EXPECT_EQ(cc_impl::default_num_slots(), map.slot_count());
+  EXPECT_LE(2 * redex_parallel::default_num_threads(), map.slot_count());
+  ConcurrentSet<uint32_t, std::hash<uint32_t>, std::equal_to<uint32_t>, 7> set;
+  EXPECT_EQ(7, set.slot_count());
+
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (auto x : sample) {
+      map.insert({x, x});
+      set.insert(x);
+    }
+  });
+  map.parallel_for_each([](std::pair<const uint32_t, uint32_t>& entry) {
+    entry.second = entry.first / 2;
+  });
+  std::atomic<uint64_t> sum{0};
+  std::atomic<size_t> num_elements{0};
+  const auto& const_set = set;
+  const_set.parallel_for_each([&](uint32_t x) {
+    sum += x / 2;
+    ++num_elements;
+  });
+  EXPECT_EQ(m_data_set.size(), num_elements.load());
+  uint64_t expected_sum = 0;
+  for (auto x : m_data_set) {
+    expected_sum += x / 2;
+    EXPECT_EQ(x / 2, map.at(x));
+  }
+  EXPECT_EQ(expected_sum, sum.load());
+
+  // A moved-from container remains usable.
+  auto moved = std::move(map);
+  EXPECT_EQ(m_data_set.size(), moved.size());
+  EXPECT_EQ(0, map.size());
+  map.insert({1, 2});
+  EXPECT_EQ(1, map.size());
+}
@@ -2143,3 +2143,209 @@ TEST_F(ControlFlowTest, get_param_instructions_empty) {
 
   EXPECT_TRUE(cfg.get_param_instructions().empty());
 }
+
+TEST_F(ControlFlowTest, blockMapSkipsDeletedBlocks) {
+  // Only the ids matter here, so any distinct non-null pointers will do.
+  std::vector<Block*> blocks;
+  for (size_t i = 0; i < 4; ++i) {
+    blocks.push_back(reinterpret_cast<Block*>(0x10 * (i + 1)));
+  }
+  BlockMap map;
+  for (BlockId id = 0; id < blocks.size(); ++id) {
+    map.emplace(id, blocks[id]);
+  }
+  auto it = map.find(2);
+  EXPECT_EQ(1, map.erase(1));
+  EXPECT_EQ(0, map.erase(1));
+  EXPECT_EQ(3, map.size());
+  EXPECT_EQ(4, map.end_id());
+  // Adding a block leaves existing iterators valid.
+  map.emplace(5, blocks[0]);
+  EXPECT_EQ(blocks[2], it->second);
+
+  std::vector<BlockId> ids;
+  for (const auto& entry : map) {
+    ids.push_back(entry.first);
+  }
+  EXPECT_THAT(ids, ::testing::ElementsAre(0, 2, 3, 5));
+  EXPECT_EQ(5, map.rbegin()->first);
+  EXPECT_EQ(map.end(), map.find(4));
+
+  it = map.erase(map.find(3));
+  EXPECT_EQ(5, it->first);
+  it = map.erase(it);
+  EXPECT_EQ(map.end(), it);
+  // Trailing holes are trimmed, so that block ids get reused.
+  EXPECT_EQ(3, map.end_id());
+}
+
+TEST_F(ControlFlowTest, blockRangeMatchesBlocks) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :true)
+      (const v0 1)
+      (:true)
+      (return v0)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  std::vector<Block*> range(cfg.block_range().begin(),
+                            cfg.block_range().end());
+  EXPECT_EQ(cfg.blocks(), range);
+
+  // Blocks created while iterating don't invalidate the range, but they are
+  // past its end.
+  std::vector<Block*> seen;
+  for (auto b : cfg.block_range()) {
+    if (seen.empty()) {
+      cfg.create_block();
+    }
+    seen.push_back(b);
+  }
+  EXPECT_EQ(range, seen);
+  EXPECT_EQ(range.size() + 1, cfg.num_blocks());
+}
+
+TEST_F(ControlFlowTest, cachedAnalysisIsDroppedOnChange) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :true)
+      (const v0 1)
+      (:true)
+      (return v0)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  size_t num_computed = 0;
+  auto count_blocks = [&]() {
+    ++num_computed;
+    return std::make_unique<size_t>(cfg.blocks().size());
+  };
+  EXPECT_EQ(3, cfg.get_cached_analysis<size_t>(count_blocks));
+  EXPECT_EQ(3, cfg.get_cached_analysis<size_t>(count_blocks));
+  EXPECT_EQ(1, num_computed);
+
+  auto block = cfg.create_block();
+  EXPECT_EQ(4, cfg.get_cached_analysis<size_t>(count_blocks));
+  EXPECT_EQ(2, num_computed);
+
+  block->push_back(dasm(OPCODE_CONST, {0_v, 2_L}));
+  cfg.get_cached_analysis<size_t>(count_blocks);
+  EXPECT_EQ(3, num_computed);
+  code->clear_cfg();
+}
+
+TEST_F(ControlFlowTest, cachedWto) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (:loop)
+      (if-eqz v0 :end)
+      (add-int/lit8 v0 v0 -1)
+      (goto :loop)
+      (:end)
+      (return v0)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  auto wto = cfg.wto();
+  EXPECT_EQ(wto, cfg.wto());
+  size_t num_sccs = 0;
+  for (const auto& comp : *wto) {
+    num_sccs += comp.is_scc();
+  }
+  EXPECT_EQ(1, num_sccs);
+
+  cfg.create_block();
+  EXPECT_NE(wto, cfg.wto());
+  code->clear_cfg();
+}
+
+TEST_F(ControlFlowTest, retainedCfgIsReused) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (return v0)
+    )
+  )");
+  code->retain_cfg();
+  auto cfg = &code->cfg();
+  code->clear_cfg();
+  code->build_cfg(/* editable */ true);
+  EXPECT_EQ(cfg, &code->cfg());
+
+  // Copies see the instructions of the retained CFG.
+  cfg->entry_block()->push_front(dasm(OPCODE_CONST, {1_v, 1_L}));
+  cfg->set_registers_size(2);
+  IRCode copy(*code);
+  EXPECT_FALSE(copy.cfg_built());
+
+  code->release_cfg();
+  EXPECT_FALSE(code->cfg_built());
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (const v1 1)
+      (const v0 0)
+      (return v0)
+    )
+  )");
+  EXPECT_CODE_EQ(expected.get(), code.get());
+  EXPECT_CODE_EQ(expected.get(), &copy);
+}
+
+TEST_F(ControlFlowTest, blockWeightsLayOutHotPathFirst) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :hot)
+      (const v1 1)
+      (return v1)
+
+      (:hot)
+      (const v1 2)
+      (add-int v1 v1 v0)
+      (if-gtz v1 :done)
+      (const v1 3)
+
+      (:done)
+      (return v1)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  // The blocks are numbered in order: the fallthrough of the first branch
+  // never runs, and the second branch is taken 9 times out of 10.
+  ASSERT_EQ(5, cfg.blocks().size());
+  cfg.set_block_weights({{0, 10}, {1, 0}, {2, 10}, {3, 1}, {4, 10}});
+  code->clear_cfg();
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-nez v0 :cold)
+      (const v1 2)
+      (add-int v1 v1 v0)
+      (if-lez v1 :rare)
+
+      (:done)
+      (return v1)
+
+      (:rare)
+      (const v1 3)
+      (goto :done)
+
+      (:cold)
+      (const v1 1)
+      (return v1)
+    )
+  )");
+  EXPECT_CODE_EQ(expected.get(), code.get());
+}
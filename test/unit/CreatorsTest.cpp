@@ -129,3 +129,32 @@ TEST_F(CreatorsTest, ClassCreator) {
   EXPECT_EQ(foo_type, cls->get_type());
   EXPECT_EQ(bar_type, cls->get_type());
 }
+
+TEST_F(CreatorsTest, CreateAll) {
+  std::vector<ClassCreator> creators;
+  for (int i = 0; i < 3; ++i) {
+    auto type = DexType::make_type(("LBulk" + std::to_string(i) + ";").c_str());
+    creators.emplace_back(type);
+    creators.back().set_super(type::java_lang_Object());
+  }
+  auto* cls_type = creators[0].get_type();
+  std::vector<DexMethod*> methods;
+  for (const char* name : {"c", "a", "b"}) {
+    auto method = static_cast<DexMethod*>(DexMethod::make_method(
+        cls_type, DexString::make_string(name),
+        DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}))));
+    method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    methods.push_back(method);
+  }
+  creators[0].add_method(methods[1]);
+  creators[0].add_methods({methods[0], methods[2]});
+
+  auto classes = ClassCreator::create_all(creators);
+  ASSERT_EQ(classes.size(), 3);
+  for (auto* cls : classes) {
+    EXPECT_EQ(type_class(cls->get_type()), cls);
+  }
+  // The methods are kept sorted whichever way they were added.
+  EXPECT_EQ(classes[0]->get_dmethods(),
+            (std::vector<DexMethod*>{methods[1], methods[2], methods[0]}));
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CrossDexRefMinimizer.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+
+namespace {
+
+// Creates a class with a static field for each of the given types.
+DexClass* create_class(const std::string& name,
+                       const std::vector<DexType*>& field_types) {
+  auto type = DexType::make_type(DexString::make_string(name));
+  ClassCreator creator(type);
+  creator.set_super(type::java_lang_Object());
+  for (size_t i = 0; i < field_types.size(); ++i) {
+    auto field = static_cast<DexField*>(DexField::make_field(
+        type, DexString::make_string("f" + std::to_string(i)),
+        field_types[i]));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    creator.add_field(field);
+  }
+  return creator.create();
+}
+
+interdex::CrossDexRefMinimizerConfig make_config() {
+  interdex::CrossDexRefMinimizerConfig config;
+  config.method_ref_weight = 100;
+  config.field_ref_weight = 90;
+  config.type_ref_weight = 100;
+  config.string_ref_weight = 90;
+  config.method_seed_weight = 100;
+  config.field_seed_weight = 20;
+  config.type_seed_weight = 30;
+  config.string_seed_weight = 20;
+  return config;
+}
+
+} // namespace
+
+class CrossDexRefMinimizerTest : public RedexTest {};
+
+TEST_F(CrossDexRefMinimizerTest, prefersClassesSharingAppliedRefs) {
+  std::vector<DexType*> shared;
+  std::vector<DexType*> other;
+  for (int i = 0; i < 4; ++i) {
+    shared.push_back(DexType::make_type(
+        DexString::make_string("LShared" + std::to_string(i) + ";")));
+    other.push_back(DexType::make_type(
+        DexString::make_string("LOther" + std::to_string(i) + ";")));
+  }
+  std::vector<DexClass*> classes;
+  // The seed has the most refs; A shares them, B and C share other refs.
+  classes.push_back(create_class("LSeed;", shared));
+  classes.push_back(create_class("LB;", other));
+  classes.push_back(create_class("LA;", {shared[0], shared[1], shared[2]}));
+  classes.push_back(create_class("LC;", {other[0], other[1]}));
+  // Make sure that no ref looks too frequent to be worth tracking.
+  for (int i = 0; i < 40; ++i) {
+    classes.push_back(create_class("LFiller" + std::to_string(i) + ";", {}));
+  }
+
+  interdex::CrossDexRefMinimizer minimizer(make_config());
+  minimizer.precompute_refs(classes);
+  for (auto cls : classes) {
+    minimizer.sample(cls);
+  }
+  for (auto cls : classes) {
+    minimizer.insert(cls);
+  }
+
+  auto seed = minimizer.worst();
+  EXPECT_EQ("LSeed;", seed->get_name()->str());
+  minimizer.erase(seed, /* emitted */ true, /* reset */ false);
+  EXPECT_EQ("LA;", minimizer.front()->get_name()->str());
+  minimizer.erase(minimizer.front(), /* emitted */ true, /* reset */ false);
+
+  // After a reset, nothing is applied anymore, and B has the largest seed.
+  auto b = minimizer.worst();
+  EXPECT_EQ("LB;", b->get_name()->str());
+  minimizer.erase(b, /* emitted */ true, /* reset */ true);
+  EXPECT_EQ("LC;", minimizer.front()->get_name()->str());
+
+  size_t remaining = 0;
+  while (!minimizer.empty()) {
+    minimizer.erase(minimizer.front(), /* emitted */ true, /* reset */ false);
+    ++remaining;
+  }
+  EXPECT_EQ(classes.size() - 3, remaining);
+  EXPECT_EQ(classes.size(), minimizer.stats().classes);
+  EXPECT_EQ(1, minimizer.stats().resets);
+}
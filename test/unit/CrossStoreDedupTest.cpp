@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "CrossStoreDedup.h"
+
+#include "ApiLevelChecker.h"
+#include "Creators.h"
+#include "DexStore.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace cross_store_dedup;
+
+struct CrossStoreDedupTest : public RedexTest {
+  DexStoresVector m_stores;
+
+  DexClass* create_class(const char* name,
+                         const std::vector<const char*>& methods) {
+    ClassCreator creator(DexType::make_type(name));
+    creator.set_super(type::java_lang_Object());
+    creator.set_access(ACC_PUBLIC);
+    for (auto method : methods) {
+      creator.add_method(assembler::method_from_string(method));
+    }
+    return creator.create();
+  }
+
+  void add_store(const char* name, DexClasses classes) {
+    DexStore store(name);
+    store.add_classes(std::move(classes));
+    m_stores.push_back(std::move(store));
+  }
+
+  DexMethodRef* callee_of(const char* caller) {
+    auto method = DexMethod::get_method(caller)->as_def();
+    for (auto& mie : InstructionIterable(method->get_code())) {
+      if (mie.insn->opcode() == OPCODE_INVOKE_STATIC) {
+        return mie.insn->get_method();
+      }
+    }
+    return nullptr;
+  }
+};
+
+TEST_F(CrossStoreDedupTest, hoistDuplicatesIntoRootStore) {
+  auto host = create_class("LHost;", {});
+  add_store("classes", {host});
+
+  auto body = R"(
+     (
+      (load-param v0)
+      (add-int/lit8 v0 v0 1)
+      (mul-int/lit8 v0 v0 3)
+      (add-int/lit8 v0 v0 5)
+      (return v0)
+     )
+    ))";
+  // The copies of the other store differ in their last constant.
+  auto other_body = std::string(body);
+  other_body.replace(other_body.find("5)"), 1, "7");
+  auto method = [](const std::string& name, const std::string& body) {
+    return "(method (public static) \"" + name + ":(I)I\"" + body;
+  };
+  auto a_f = method("LA;.f", body);
+  auto b_g = method("LB;.g", body);
+  auto c_h = method("LC;.h", other_body);
+  auto d_k = method("LD;.k", other_body);
+  add_store("A", {create_class("LA;", {a_f.c_str(), R"(
+      (method (public static) "LA;.caller:()I"
+       (
+        (const v0 1)
+        (invoke-static (v0) "LA;.f:(I)I")
+        (move-result v0)
+        (return v0)
+       )
+      )
+    )"})});
+  add_store("B", {create_class("LB;", {b_g.c_str(), R"(
+      (method (public static) "LB;.caller:()I"
+       (
+        (const v0 1)
+        (invoke-static (v0) "LB;.g:(I)I")
+        (move-result v0)
+        (return v0)
+       )
+      )
+    )"})});
+  // Two copies within a single store stay where they are.
+  add_store("C", {create_class("LC;", {c_h.c_str()}),
+                  create_class("LD;", {d_k.c_str()})});
+
+  api::LevelChecker::init(0, build_class_scope(m_stores));
+  Config config;
+  config.min_method_size = 1;
+  auto stats = dedup_methods(m_stores, config);
+  EXPECT_EQ(stats.candidates, 4);
+  EXPECT_EQ(stats.hoisted_methods, 1);
+  EXPECT_EQ(stats.removed_methods, 1);
+  EXPECT_EQ(stats.rewritten_invokes, 1);
+
+  auto hoisted = callee_of("LA;.caller:()I");
+  EXPECT_EQ(hoisted->get_class(), host->get_type());
+  EXPECT_EQ(callee_of("LB;.caller:()I"), hoisted);
+  EXPECT_EQ(host->get_dmethods().size(), 1);
+  EXPECT_EQ(type_class(DexType::get_type("LA;"))->get_dmethods().size(), 1);
+  EXPECT_EQ(type_class(DexType::get_type("LB;"))->get_dmethods().size(), 1);
+  EXPECT_EQ(type_class(DexType::get_type("LC;"))->get_dmethods().size(), 1);
+  EXPECT_EQ(type_class(DexType::get_type("LD;"))->get_dmethods().size(), 1);
+}
+
+TEST_F(CrossStoreDedupTest, keepMethodsReferencingTheirStore) {
+  add_store("classes", {create_class("LHost;", {})});
+  auto method = [](const char* cls, const char* name) {
+    return std::string("(method (public static) \"") + cls + "." + name +
+           ":()I\" ((sget \"" + cls + ".x:I\") (move-result-pseudo v0)" +
+           " (add-int/lit8 v0 v0 1) (return v0)))";
+  };
+  for (auto cls : {"LA;", "LB;"}) {
+    ClassCreator creator(DexType::make_type(cls));
+    creator.set_super(type::java_lang_Object());
+    creator.add_method(assembler::method_from_string(method(cls, "f")));
+    // Each copy reads a field of its own class.
+    creator.add_field(
+        DexField::make_field(std::string(cls) + ".x:I")
+            ->make_concrete(ACC_PUBLIC | ACC_STATIC));
+    add_store(cls, {creator.create()});
+  }
+
+  api::LevelChecker::init(0, build_class_scope(m_stores));
+  Config config;
+  config.min_method_size = 1;
+  auto stats = dedup_methods(m_stores, config);
+  EXPECT_EQ(stats.candidates, 0);
+  EXPECT_EQ(stats.hoisted_methods, 0);
+}
+
+TEST_F(CrossStoreDedupTest, keepMethodsOfClassesWithClinit) {
+  add_store("classes", {create_class("LHost;", {})});
+  auto method = [](const char* cls) {
+    return std::string("(method (public static) \"") + cls +
+           ".f:(I)I\" ((load-param v0) (add-int/lit8 v0 v0 1)" +
+           " (return v0)))";
+  };
+  auto a_f = method("LA;");
+  auto b_f = method("LB;");
+  // Calling LA;.f runs the static initializer of LA;, which must still
+  // happen.
+  add_store("A", {create_class("LA;", {a_f.c_str(), R"(
+      (method (public static) "LA;.<clinit>:()V"
+       (
+        (const v0 1)
+        (sput v0 "LA;.x:I")
+        (return-void)
+       )
+      )
+    )"})});
+  add_store("B", {create_class("LB;", {b_f.c_str()})});
+
+  api::LevelChecker::init(0, build_class_scope(m_stores));
+  Config config;
+  config.min_method_size = 1;
+  auto stats = dedup_methods(m_stores, config);
+  EXPECT_EQ(stats.candidates, 1);
+  EXPECT_EQ(stats.hoisted_methods, 0);
+}
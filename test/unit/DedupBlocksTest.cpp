@@ -924,3 +924,60 @@ TEST_F(DedupBlocksTest, respectTypes) {
   auto expected_code = assembler::ircode_from_string(expected_str);
   EXPECT_CODE_EQ(expected_code.get(), method->get_code());
 }
+
+TEST_F(DedupBlocksTest, blockHashesAcrossMethods) {
+  auto str = R"(
+    (
+      (const v0 1)
+      (if-eqz v0 :B)
+
+      (const v0 2)
+      (add-int v0 v0 v0)
+      (return-void)
+
+      (:B)
+      (const v0 3)
+      (return-void)
+    )
+  )";
+  DexMethod* method1 = get_fresh_method("m1");
+  method1->set_code(assembler::ircode_from_string(str));
+  DexMethod* method2 = get_fresh_method("m2");
+  method2->set_code(assembler::ircode_from_string(str));
+
+  auto get_hashes = [](DexMethod* method) {
+    method->get_code()->build_cfg(/* editable */ true);
+    dedup_blocks_impl::Config config;
+    dedup_blocks_impl::DedupBlocks dedup_blocks(config, method);
+    dedup_blocks.run();
+    auto hashes = dedup_blocks.get_block_hashes(2);
+    method->get_code()->clear_cfg();
+    std::sort(hashes.begin(), hashes.end());
+    return hashes;
+  };
+  auto hashes1 = get_hashes(method1);
+  auto hashes2 = get_hashes(method2);
+  EXPECT_EQ(3, hashes1.size());
+  EXPECT_EQ(hashes1, hashes2);
+
+  // The order of the instructions matters.
+  auto block = assembler::ircode_from_string(R"(
+    (
+      (const v0 2)
+      (add-int v0 v0 v0)
+      (return-void)
+    )
+  )");
+  auto reordered = assembler::ircode_from_string(R"(
+    (
+      (add-int v0 v0 v0)
+      (const v0 2)
+      (return-void)
+    )
+  )");
+  block->build_cfg(/* editable */ true);
+  reordered->build_cfg(/* editable */ true);
+  EXPECT_NE(dedup_blocks_impl::hash_block_code(block->cfg().entry_block()),
+            dedup_blocks_impl::hash_block_code(
+                reordered->cfg().entry_block()));
+}
@@ -53,3 +53,121 @@ TEST_F(DexClassTest, testUniqueFieldName) {
       type, DexString::make_string("bar"), DexType::make_type("I"));
   EXPECT_EQ(newname->str(), "barr$1");
 }
+
+TEST_F(DexClassTest, testStringInterning) {
+  // Strings sharing long prefixes, differing only in their last character or
+  // in their length, must all be interned separately.
+  std::string prefix(100, 'x');
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 20; ++i) {
+    names.push_back(prefix.substr(0, 80 + i));
+    names.push_back(prefix + std::to_string(i));
+  }
+  std::vector<DexString*> strings;
+  for (const auto& name : names) {
+    EXPECT_EQ(nullptr, DexString::get_string(name));
+    strings.push_back(DexString::make_string(name));
+    EXPECT_EQ(name, strings.back()->str());
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    EXPECT_EQ(strings[i], DexString::make_string(names[i]));
+    EXPECT_EQ(strings[i], DexString::get_string(names[i]));
+    EXPECT_EQ(strings[i], DexString::make_string(names[i].c_str()));
+  }
+  EXPECT_EQ(nullptr, DexString::get_string(prefix + "x"));
+}
+
+TEST_F(DexClassTest, testFindMembers) {
+  auto type = DexType::make_type("LFoo;");
+  ClassCreator creator(type);
+  creator.set_super(type::java_lang_Object());
+  // Enough members for the lookups to go through the index.
+  for (int i = 0; i < 40; ++i) {
+    auto name = "m" + std::to_string(i);
+    auto method = DexMethod::make_method("LFoo;." + name + ":()V")
+                      ->make_concrete(ACC_PUBLIC, i % 2 == 0);
+    creator.add_method(method);
+    auto field = DexField::make_field("LFoo;.f" + std::to_string(i) + ":I")
+                     ->make_concrete(i % 2 == 0 ? ACC_PUBLIC
+                                                : ACC_PUBLIC | ACC_STATIC);
+    creator.add_field(field);
+  }
+  auto cls = creator.create();
+  auto void_proto =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  auto int_type = type::_int();
+
+  auto m0 = cls->find_vmethod(DexString::make_string("m0"), void_proto);
+  ASSERT_NE(m0, nullptr);
+  EXPECT_EQ(m0->str(), "m0");
+  EXPECT_EQ(cls->find_dmethod(DexString::make_string("m0"), void_proto),
+            nullptr);
+  auto m39 = cls->find_dmethod(DexString::make_string("m39"), void_proto);
+  ASSERT_NE(m39, nullptr);
+  EXPECT_EQ(m39->str(), "m39");
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("m40"), void_proto),
+            nullptr);
+  EXPECT_NE(cls->find_ifield(DexString::make_string("f2"), int_type), nullptr);
+  EXPECT_EQ(cls->find_sfield(DexString::make_string("f2"), int_type), nullptr);
+  EXPECT_NE(cls->find_sfield(DexString::make_string("f3"), int_type), nullptr);
+
+  // The index follows additions and renames.
+  auto added = DexMethod::make_method("LFoo;.added:()V")
+                   ->make_concrete(ACC_PUBLIC, true);
+  cls->add_method(added);
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("added"), void_proto),
+            added);
+  DexMethodSpec spec;
+  spec.name = DexString::make_string("renamed");
+  m0->change(spec, false /* rename_on_collision */,
+             false /* update_deobfuscated_name */);
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("m0"), void_proto),
+            nullptr);
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("renamed"), void_proto),
+            m0);
+}
+
+TEST_F(DexClassTest, testFindMembersAfterDirectEdits) {
+  auto type = DexType::make_type("LBar;");
+  ClassCreator creator(type);
+  creator.set_super(type::java_lang_Object());
+  for (int i = 0; i < 20; ++i) {
+    creator.add_method(
+        DexMethod::make_method("LBar;.m" + std::to_string(i) + ":()V")
+            ->make_concrete(ACC_PUBLIC, true));
+    creator.add_field(
+        DexField::make_field("LBar;.f" + std::to_string(i) + ":I")
+            ->make_concrete(ACC_PUBLIC));
+  }
+  auto cls = creator.create();
+  auto void_proto =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  auto int_type = type::_int();
+  // Builds the index.
+  ASSERT_NE(cls->find_vmethod(DexString::make_string("m0"), void_proto),
+            nullptr);
+
+  // Members swapped in the vectors, which keeps their sizes and doesn't
+  // change the class hierarchy version, are still found.
+  auto swapped_method = DexMethod::make_method("LBar;.swapped:()V")
+                            ->make_concrete(ACC_PUBLIC, true);
+  cls->get_vmethods().back() = swapped_method;
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("swapped"), void_proto),
+            swapped_method);
+  // The member that was swapped out isn't found anymore, and neither is one
+  // that was swapped for another of the same name and proto.
+  EXPECT_EQ(cls->find_vmethod(DexString::make_string("m9"), void_proto),
+            nullptr);
+  auto& slot = cls->get_vmethods()[5];
+  auto other_method =
+      DexMethod::make_method("LOther;." + slot->str() + ":()V")
+          ->make_concrete(ACC_PUBLIC, true);
+  slot = other_method;
+  EXPECT_EQ(cls->find_vmethod(other_method->get_name(), void_proto),
+            other_method);
+  auto swapped_field =
+      DexField::make_field("LBar;.swapped:I")->make_concrete(ACC_PUBLIC);
+  cls->get_ifields().back() = swapped_field;
+  EXPECT_EQ(cls->find_ifield(DexString::make_string("swapped"), int_type),
+            swapped_field);
+}
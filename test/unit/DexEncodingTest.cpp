@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexEncoding.h"
+
+TEST(DexEncodingTest, lengthOfAsciiPrefix) {
+  EXPECT_EQ(length_of_ascii_prefix("", 0), 0);
+  EXPECT_EQ(length_of_ascii_prefix("Lcom/facebook/Foo;", 18), 18);
+  EXPECT_EQ(length_of_ascii_prefix("Lcom/facebook/Foo;", 5), 5);
+  // Non-ASCII bytes within the first word and after it.
+  EXPECT_EQ(length_of_ascii_prefix("ab\xc3\xa9", 4), 2);
+  EXPECT_EQ(length_of_ascii_prefix("abcdefghij\xc3\xa9", 12), 10);
+}
+
+TEST(DexEncodingTest, lengthOfUtf8String) {
+  EXPECT_EQ(length_of_utf8_string(nullptr), 0);
+  EXPECT_EQ(length_of_utf8_string(""), 0);
+  EXPECT_EQ(length_of_utf8_string("Lcom/facebook/Foo;"), 18);
+  // \u0000 takes two bytes in MUTF-8.
+  EXPECT_EQ(length_of_utf8_string("a\xc0\x80"), 2);
+  // Code points of two and three bytes between runs of ASCII characters.
+  EXPECT_EQ(length_of_utf8_string("caf\xc3\xa9 au lait"), 12);
+  EXPECT_EQ(length_of_utf8_string("\xe2\x82\xac 1234567890 \xe2\x82\xac"), 14);
+  EXPECT_EQ(length_of_utf8_string("abcdefgh\xc3\xa9", 10), 9);
+}
+
+TEST(DexEncodingTest, lengthOfInvalidUtf8String) {
+  EXPECT_THROW(length_of_utf8_string("abcdefgh\xc3"), std::invalid_argument);
+  EXPECT_THROW(length_of_utf8_string("\xf0\x90\x80\x80"),
+               std::invalid_argument);
+}
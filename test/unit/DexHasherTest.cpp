@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexHasher.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class DexHasherTest : public RedexTest {};
+
+namespace {
+
+uint64_t hash_in_chunks(const std::string& data, size_t chunk_size) {
+  hashing::StreamingHash hash;
+  for (size_t i = 0; i < data.size(); i += chunk_size) {
+    hash.update(data.data() + i, std::min(chunk_size, data.size() - i));
+  }
+  return hash.digest();
+}
+
+DexClass* make_class(const std::string& name, int literal) {
+  ClassCreator creator(DexType::make_type(DexString::make_string(name)));
+  creator.set_super(type::java_lang_Object());
+  creator.add_method(assembler::method_from_string(
+      "(method (public static) \"" + name + ".m:()I\" ((const v0 " +
+      std::to_string(literal) + ") (return v0)))"));
+  return creator.create();
+}
+
+} // namespace
+
+TEST_F(DexHasherTest, streamingHashMatchesXXH64) {
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, hash_in_chunks("", 1));
+  EXPECT_EQ(0x44BC2CF5AD770999ULL, hash_in_chunks("abc", 1));
+
+  std::string data;
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<char>(i * 7));
+  }
+  auto expected = hash_in_chunks(data, data.size());
+  for (size_t chunk_size : {1, 3, 8, 31, 32, 33, 100}) {
+    EXPECT_EQ(expected, hash_in_chunks(data, chunk_size)) << chunk_size;
+  }
+}
+
+TEST_F(DexHasherTest, scopeHash) {
+  Scope scope;
+  for (int i = 0; i < 100; ++i) {
+    scope.push_back(make_class("LFoo" + std::to_string(i) + ";", i));
+  }
+  auto hash = hashing::DexScopeHasher(scope).run();
+  auto again = hashing::DexScopeHasher(scope).run();
+  EXPECT_EQ(hash.registers_hash, again.registers_hash);
+  EXPECT_EQ(hash.code_hash, again.code_hash);
+  EXPECT_EQ(hash.signature_hash, again.signature_hash);
+
+  // The order of the classes is part of the scope.
+  std::swap(scope.front(), scope.back());
+  auto swapped = hashing::DexScopeHasher(scope).run();
+  EXPECT_NE(hash.code_hash, swapped.code_hash);
+  EXPECT_NE(hash.signature_hash, swapped.signature_hash);
+}
+
+TEST_F(DexHasherTest, hashCode) {
+  auto a = make_class("LA;", 1)->get_dmethods()[0];
+  auto b = make_class("LB;", 1)->get_dmethods()[0];
+  auto c = make_class("LC;", 2)->get_dmethods()[0];
+  EXPECT_EQ(hashing::hash_code(a->get_code()),
+            hashing::hash_code(b->get_code()));
+  EXPECT_NE(hashing::hash_code(a->get_code()),
+            hashing::hash_code(c->get_code()));
+}
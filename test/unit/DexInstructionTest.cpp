@@ -63,3 +63,31 @@ TEST_F(DexInstructionTest, test_encode_fill_array_data_payload_32) {
   EXPECT_EQ(data32[4], 4);
   EXPECT_EQ(data32[5], 5);
 }
+
+TEST_F(DexInstructionTest, pool) {
+  DexInstructionPool pool(2);
+  auto* type = DexType::make_type("LFoo;");
+  std::vector<DexInstruction*> insns;
+  // More than fits in the first chunk.
+  for (int i = 0; i < 100; ++i) {
+    auto* insn = pool.make<DexOpcodeType>(DOPCODE_CHECK_CAST, type);
+    insn->set_src(0, i);
+    insns.push_back(insn);
+    insns.push_back(pool.make<DexInstruction>(DOPCODE_NOP));
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto* insn = static_cast<DexOpcodeType*>(insns[2 * i]);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(insn) % alignof(DexOpcodeType), 0);
+    EXPECT_EQ(insn->get_type(), type);
+    EXPECT_EQ(insn->src(0), i);
+    EXPECT_EQ(insns[2 * i + 1]->opcode(), DOPCODE_NOP);
+  }
+
+  // Clones of pooled instructions are on the heap.
+  auto* clone = insns[0]->clone();
+  EXPECT_EQ(*clone, *insns[0]);
+  DexInstruction::destroy(clone);
+  for (auto* insn : insns) {
+    DexInstruction::destroy(insn);
+  }
+}
@@ -6,7 +6,13 @@
  */
 
 #include "DexLoader.h"
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
 #include "RedexTest.h"
+#include "Show.h"
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 #include <stdint.h>
 
@@ -58,3 +64,68 @@ TEST_F(DexLoaderTest, align_ptr) {
     }
   }
 }
+
+TEST_F(DexLoaderTest, load_dexes_in_load_order) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir / "meta");
+
+  // Besides classes of their own, the later dexes define LDup; again, and one
+  // of the classes of the first dex.
+  std::vector<std::vector<std::string>> defs(3);
+  for (size_t i = 0; i < defs.size(); ++i) {
+    for (size_t j = 0; j < 100; ++j) {
+      defs[i].push_back("LC" + std::to_string(i) + "_" + std::to_string(j) +
+                        ";");
+    }
+  }
+  defs[0].push_back("LDup;");
+  defs[1].insert(defs[1].begin() + 50, "LDup;");
+  defs[1].push_back("LC0_10;");
+  defs[2].insert(defs[2].begin(), "LDup;");
+
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < defs.size(); ++i) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    DexClasses classes;
+    for (const auto& name : defs[i]) {
+      ClassCreator creator(DexType::make_type(name.c_str()));
+      creator.set_super(type::java_lang_Object());
+      creator.set_access(ACC_PUBLIC);
+      creator.add_field(DexField::make_field(name + ".f:I")
+                            ->make_concrete(ACC_PUBLIC | ACC_STATIC));
+      classes.push_back(creator.create());
+    }
+    paths.push_back((dir / ("classes" + std::to_string(i) + ".dex")).string());
+    ConfigFiles conf(Json::nullValue, dir.string());
+    std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+    write_classes_to_dex(RedexOptions(), paths.back(), &classes, nullptr, 0, i,
+                         conf, pos_mapper.get(), nullptr, nullptr, nullptr,
+                         "dex\n035\0");
+  }
+
+  // Whichever thread loads them, the classes are the first definitions of
+  // each type in load order, in the order of their dexes.
+  std::vector<std::vector<std::string>> expected(defs);
+  expected[1].erase(expected[1].begin() + 50);
+  expected[1].pop_back();
+  expected[2].erase(expected[2].begin());
+  for (size_t run = 0; run < 3; ++run) {
+    delete g_redex;
+    g_redex = new RedexContext(/* allow_class_duplicates */ true);
+    std::vector<dex_stats_t> stats;
+    auto dexes = load_classes_from_dexes(paths, &stats);
+    ASSERT_EQ(dexes.size(), expected.size());
+    for (size_t i = 0; i < dexes.size(); ++i) {
+      std::vector<std::string> names;
+      for (auto cls : dexes[i]) {
+        names.push_back(show(cls));
+        EXPECT_EQ(cls->get_location(), paths[i]);
+      }
+      EXPECT_EQ(names, expected[i]);
+    }
+  }
+
+  boost::filesystem::remove_all(dir);
+}
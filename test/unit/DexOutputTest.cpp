@@ -6,8 +6,16 @@
  */
 
 #include "DexOutput.h"
+#include <atomic>
 #include <gtest/gtest.h>
 #include <json/json.h>
+#include <mutex>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
 
 TEST(DexOutput, checkMethodInstructionSizeLimit) {
 
@@ -24,3 +32,95 @@ TEST(DexOutput, checkMethodInstructionSizeLimit) {
       DexOutput::check_method_instruction_size_limit(conf, 65537, "method"),
       RedexException);
 }
+
+TEST(DexOutput, emissionOrderSerializesSectionsInOrder) {
+  using Section = DexEmissionOrder::Section;
+  constexpr size_t kNumDexes = 32;
+  constexpr size_t kNumThreads = 4;
+  DexEmissionOrder order;
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::vector<size_t> debug_info_order;
+  std::vector<size_t> metrics_order;
+  std::vector<boost::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&]() {
+      for (size_t seq = next++; seq < kNumDexes; seq = next++) {
+        order.run_in_order(Section::DEBUG_INFO, seq, [&]() {
+          std::lock_guard<std::mutex> guard(mutex);
+          debug_info_order.push_back(seq);
+        });
+        order.run_in_order(Section::METRICS, seq, [&]() {
+          std::lock_guard<std::mutex> guard(mutex);
+          metrics_order.push_back(seq);
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(kNumDexes, debug_info_order.size());
+  ASSERT_EQ(kNumDexes, metrics_order.size());
+  for (size_t i = 0; i < kNumDexes; ++i) {
+    EXPECT_EQ(i, debug_info_order[i]);
+    EXPECT_EQ(i, metrics_order[i]);
+  }
+}
+
+TEST(DexOutput, emissionOrderAbortReleasesWaiters) {
+  DexEmissionOrder order;
+  bool threw = false;
+  boost::thread waiter([&]() {
+    try {
+      order.run_in_order(DexEmissionOrder::Section::METRICS, 1, []() {});
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+  });
+  order.abort();
+  waiter.join();
+  EXPECT_TRUE(threw);
+}
+
+class DexOutputTest : public RedexTest {};
+
+TEST_F(DexOutputTest, methodAccessOrder) {
+  auto make_method = [](const std::string& name, const std::string& str) {
+    return assembler::method_from_string(
+        "(method (public static) \"LFoo;." + name + ":()V\"\n"
+        " ((const-string \"" + str + "\")\n"
+        "  (move-result-pseudo-object v0)\n"
+        "  (return-void)))");
+  };
+  auto a = make_method("a", "string_a");
+  auto b = make_method("b", "string_b");
+  auto c = make_method("c", "string_c");
+  DexClasses classes{assembler::class_with_methods("LFoo;", {a, b, c})};
+  GatheredTypes gtypes(&classes);
+
+  method_profiles::Stats early;
+  early.appear_percent = 100;
+  early.order_percent = 10;
+  method_profiles::Stats late;
+  late.appear_percent = 50;
+  late.order_percent = 60;
+  gtypes.set_method_access_order({{c, early}, {a, late}});
+
+  EXPECT_TRUE(gtypes.is_startup_method(a));
+  EXPECT_FALSE(gtypes.is_startup_method(b));
+  EXPECT_TRUE(gtypes.is_startup_string(DexString::get_string("string_c")));
+  EXPECT_FALSE(gtypes.is_startup_string(DexString::get_string("string_b")));
+
+  std::vector<DexMethod*> methods{b, a, c};
+  gtypes.sort_dexmethod_emitlist_access_order(methods);
+  EXPECT_EQ((std::vector<DexMethod*>{c, a, b}), methods);
+
+  auto strings = gtypes.get_access_order_dexstring_emitlist();
+  auto pos = [&](const char* s) {
+    return std::find(strings.begin(), strings.end(), DexString::get_string(s)) -
+           strings.begin();
+  };
+  EXPECT_LT(pos("string_c"), pos("string_a"));
+  EXPECT_LT(pos("string_a"), pos("string_b"));
+}
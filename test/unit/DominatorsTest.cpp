@@ -99,3 +99,62 @@ TEST(GraphUtilTest, doubleLoop) {
     EXPECT_EQ(doms.get_idom(5), 1);
   }
 }
+
+TEST(DominatorsTest, semiNCAMatchesSimpleFast) {
+  GraphInterface::Graph graph;
+  graph.add_edge(0, 1);
+  graph.add_edge(1, 2);
+  graph.add_edge(2, 1);
+  graph.add_edge(1, 3);
+  graph.add_edge(3, 4);
+  graph.add_edge(4, 3);
+  graph.add_edge(4, 5);
+  graph.add_edge(2, 5);
+  graph.add_edge(0, 6);
+  graph.add_edge(6, 5);
+  // Unreachable from the entry.
+  graph.add_edge(7, 5);
+  dominators::SimpleFastDominators<GraphInterface> simple_fast(graph);
+  dominators::SemiNCADominators<GraphInterface> semi_nca(graph);
+  for (uint32_t node = 0; node <= 6; ++node) {
+    EXPECT_EQ(simple_fast.get_idom(node), semi_nca.get_idom(node));
+  }
+  EXPECT_FALSE(semi_nca.is_reachable(7));
+  EXPECT_TRUE(semi_nca.dominates(1, 4));
+  EXPECT_TRUE(semi_nca.dominates(4, 4));
+  EXPECT_FALSE(semi_nca.dominates(4, 5));
+  EXPECT_EQ(1, semi_nca.intersect(2, 4));
+  EXPECT_EQ(0, semi_nca.intersect(4, 6));
+}
+
+TEST(DominatorsTest, dominanceFrontier) {
+  //  0 -> 1 -> 2 -> 4
+  //  |         ^    |
+  //  +--> 3 ---+    |
+  //       ^         |
+  //       +---------+
+  GraphInterface::Graph graph;
+  graph.add_edge(0, 1);
+  graph.add_edge(1, 2);
+  graph.add_edge(0, 3);
+  graph.add_edge(3, 2);
+  graph.add_edge(2, 4);
+  graph.add_edge(4, 3);
+  // Reuse the scratch buffers of a previous computation.
+  GraphInterface::Graph other_graph;
+  other_graph.add_edge(0, 1);
+  dominators::SemiNCADominators<GraphInterface>::Workspace workspace;
+  dominators::SemiNCADominators<GraphInterface> other_doms(other_graph,
+                                                           &workspace);
+  EXPECT_EQ(0, other_doms.get_idom(1));
+  dominators::SemiNCADominators<GraphInterface> doms(graph, &workspace);
+  EXPECT_EQ(0, doms.get_idom(2));
+  EXPECT_EQ(2, doms.get_idom(4));
+  EXPECT_EQ(0, doms.get_idom(3));
+  using Frontier = std::vector<uint32_t>;
+  EXPECT_EQ(Frontier{}, doms.get_dominance_frontier(0));
+  EXPECT_EQ(Frontier{2}, doms.get_dominance_frontier(1));
+  EXPECT_EQ(Frontier{3}, doms.get_dominance_frontier(2));
+  EXPECT_EQ(Frontier{2}, doms.get_dominance_frontier(3));
+  EXPECT_EQ(Frontier{3}, doms.get_dominance_frontier(4));
+}
@@ -52,6 +52,37 @@ TEST_F(FinalInlineTest, encodeValues) {
   EXPECT_EQ(field->get_static_value()->value(), 1);
 }
 
+TEST_F(FinalInlineTest, encodeClassObjects) {
+  auto field = static_cast<DexField*>(
+      DexField::make_field("LFoo;.bar:Ljava/lang/Class;"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL);
+  m_cc->add_field(field);
+  m_cc->add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.<clinit>:()V"
+     (
+      (const-class "LBar;")
+      (move-result-pseudo-object v0)
+      (sput-object v0 "LFoo;.bar:Ljava/lang/Class;")
+      (return-void)
+     )
+    )
+  )"));
+  auto cls = m_cc->create();
+
+  FinalInlinePassV2::run({cls});
+  EXPECT_NE(cls->get_clinit(), nullptr);
+  EXPECT_EQ(field->get_static_value()->evtype(), DEVT_NULL);
+
+  FinalInlinePassV2::Config config;
+  config.encode_class_objects = true;
+  FinalInlinePassV2::run({cls}, config);
+  EXPECT_EQ(cls->get_clinit(), nullptr);
+  auto value = field->get_static_value();
+  ASSERT_EQ(value->evtype(), DEVT_TYPE);
+  EXPECT_EQ(static_cast<DexEncodedValueType*>(value)->type(),
+            DexType::make_type("LBar;"));
+}
+
 TEST_F(FinalInlineTest, fieldSetInLoop) {
   auto field_bar = create_field_with_value("LFoo;.bar:I", 0);
   m_cc->add_method(assembler::method_from_string(R"(
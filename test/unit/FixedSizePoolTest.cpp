@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FixedSizePool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Entry {
+  uint64_t a;
+  uint32_t b;
+};
+
+using Pool = FixedSizePool<sizeof(Entry), alignof(Entry)>;
+
+} // namespace
+
+TEST(FixedSizePoolTest, consecutiveAllocationsAreAdjacent) {
+  auto first = static_cast<char*>(Pool::allocate());
+  auto second = static_cast<char*>(Pool::allocate());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % alignof(Entry));
+  EXPECT_EQ(first + sizeof(Entry), second);
+  Pool::deallocate(second);
+  Pool::deallocate(first);
+}
+
+TEST(FixedSizePoolTest, freedObjectsAreReused) {
+  auto p = Pool::allocate();
+  Pool::deallocate(p);
+  EXPECT_EQ(p, Pool::allocate());
+  Pool::deallocate(p);
+}
+
+TEST(FixedSizePoolTest, objectsOfExitedThreadsAreReused) {
+  std::vector<void*> freed;
+  std::thread t([&]() {
+    for (size_t i = 0; i < 10; ++i) {
+      freed.push_back(Pool::allocate());
+    }
+    for (auto p : freed) {
+      Pool::deallocate(p);
+    }
+  });
+  t.join();
+
+  // The main thread may still have objects of its own to hand out before it
+  // falls back to the orphaned ones.
+  std::vector<void*> allocated;
+  for (size_t i = 0; i < 2 * Pool::kSlabSize / sizeof(Entry); ++i) {
+    allocated.push_back(Pool::allocate());
+  }
+  std::sort(allocated.begin(), allocated.end());
+  for (auto p : freed) {
+    EXPECT_TRUE(std::binary_search(allocated.begin(), allocated.end(), p));
+  }
+  for (auto p : allocated) {
+    Pool::deallocate(p);
+  }
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "GuardedDevirtualization.h"
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "TypeSystem.h"
+
+using namespace guarded_devirtualization;
+
+struct GuardedDevirtualizationTest : public RedexTest {
+  Scope m_scope;
+  DexMethod* m_base_m;
+  DexMethod* m_a_m;
+  DexMethod* m_b_m;
+
+  GuardedDevirtualizationTest() {
+    m_base_m = make_class("LBase;", type::java_lang_Object());
+    m_a_m = make_class("LA;", DexType::make_type("LBase;"));
+    m_b_m = make_class("LB;", DexType::make_type("LBase;"));
+  }
+
+  // Makes a public class with a public method m.
+  DexMethod* make_class(const std::string& name, DexType* super) {
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(super);
+    creator.set_access(ACC_PUBLIC);
+    auto method = assembler::method_from_string("(method (public) \"" + name +
+                                                ".m:()I\" ("
+                                                " (load-param-object v0)"
+                                                " (const v1 0)"
+                                                " (return v1)"
+                                                "))");
+    creator.add_method(method);
+    m_scope.push_back(creator.create());
+    return method;
+  }
+};
+
+TEST_F(GuardedDevirtualizationTest, findGuards) {
+  method_profiles::StatsMap stats;
+  stats[m_a_m].appear_percent = 90;
+  stats[m_a_m].call_count = 10;
+  stats[m_b_m].appear_percent = 90;
+  stats[m_b_m].call_count = 20;
+  Config config;
+  config.min_appear_percent = 50;
+  config.max_guards = 2;
+
+  TypeSystem type_system(m_scope);
+  IRInstruction invoke(OPCODE_INVOKE_VIRTUAL);
+  invoke.set_method(m_base_m)->set_srcs_size(1)->set_src(0, 0);
+  auto guards = find_guards(type_system, &invoke,
+                            DexType::make_type("LBase;"), stats, config);
+  // The most called implementation first; LBase; is the fallback.
+  ASSERT_EQ(guards.size(), 2);
+  EXPECT_EQ(guards[0].method, m_b_m);
+  EXPECT_EQ(guards[1].method, m_a_m);
+
+  // A cold implementation isn't guarded for.
+  stats[m_a_m].appear_percent = 10;
+  guards = find_guards(type_system, &invoke, DexType::make_type("LBase;"),
+                       stats, config);
+  ASSERT_EQ(guards.size(), 1);
+  EXPECT_EQ(guards[0].type, DexType::make_type("LB;"));
+
+  // A monomorphic call needs no guard.
+  guards = find_guards(type_system, &invoke, DexType::make_type("LA;"), stats,
+                       config);
+  EXPECT_TRUE(guards.empty());
+}
+
+TEST_F(GuardedDevirtualizationTest, guardCall) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param-object v0)
+      (invoke-virtual (v0) "LBase;.m:()I")
+      (move-result v1)
+      (return v1)
+    )
+  )");
+  IRInstruction* invoke = nullptr;
+  for (auto& mie : InstructionIterable(code.get())) {
+    if (mie.insn->opcode() == OPCODE_INVOKE_VIRTUAL) {
+      invoke = mie.insn;
+    }
+  }
+  code->build_cfg(/* editable */ true);
+  EXPECT_TRUE(guard_call(code->cfg(), invoke,
+                         {Guard{DexType::make_type("LB;"), m_b_m}}));
+  code->clear_cfg();
+
+  // The order of the blocks is up to the linearization, so only check what
+  // the code contains.
+  std::vector<IRInstruction*> invokes;
+  size_t num_instance_ofs = 0;
+  size_t num_check_casts = 0;
+  size_t num_move_results = 0;
+  for (auto& mie : InstructionIterable(code.get())) {
+    auto insn = mie.insn;
+    switch (insn->opcode()) {
+    case OPCODE_INVOKE_VIRTUAL:
+      invokes.push_back(insn);
+      break;
+    case OPCODE_INSTANCE_OF:
+      EXPECT_EQ(insn->get_type(), DexType::make_type("LB;"));
+      ++num_instance_ofs;
+      break;
+    case OPCODE_CHECK_CAST:
+      EXPECT_EQ(insn->get_type(), DexType::make_type("LB;"));
+      ++num_check_casts;
+      break;
+    case OPCODE_MOVE_RESULT:
+      EXPECT_EQ(insn->dest(), 1);
+      ++num_move_results;
+      break;
+    default:
+      break;
+    }
+  }
+  EXPECT_EQ(num_instance_ofs, 1);
+  EXPECT_EQ(num_check_casts, 1);
+  EXPECT_EQ(num_move_results, 2);
+  ASSERT_EQ(invokes.size(), 2);
+  EXPECT_NE(invokes[0]->get_method(), invokes[1]->get_method());
+  for (auto insn : invokes) {
+    if (insn == invoke) {
+      EXPECT_EQ(insn->get_method(), m_base_m);
+      EXPECT_EQ(insn->src(0), 0);
+    } else {
+      EXPECT_EQ(insn->get_method(), m_b_m);
+      EXPECT_NE(insn->src(0), 0);
+    }
+  }
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Hprof.h"
+#include "RedexException.h"
+
+namespace {
+
+// Writes the big-endian values of a heap dump with 4-byte ids.
+class DumpWriter {
+ public:
+  explicit DumpWriter(bool with_header = true) {
+    if (with_header) {
+      m_os << "JAVA PROFILE 1.0.3" << '\0';
+      u4(4);
+      u4(0);
+      u4(0);
+    }
+  }
+
+  void string(uint32_t id, const std::string& str) {
+    record(0x01, 4 + str.size());
+    u4(id);
+    m_os << str;
+  }
+
+  void load_class(uint32_t serial, uint32_t class_id, uint32_t name_id) {
+    record(0x02, 16);
+    u4(serial);
+    u4(class_id);
+    u4(0);
+    u4(name_id);
+  }
+
+  void record(uint8_t tag, uint32_t length) {
+    u1(tag);
+    u4(0);
+    u4(length);
+  }
+
+  void bytes(const std::string& bytes) { m_os << bytes; }
+
+  void u1(uint8_t value) { m_os.put(value); }
+
+  void u2(uint16_t value) {
+    u1(value >> 8);
+    u1(value);
+  }
+
+  void u4(uint32_t value) {
+    u2(value >> 16);
+    u2(value);
+  }
+
+  std::string str() const { return m_os.str(); }
+
+ private:
+  std::ostringstream m_os;
+};
+
+// A heap dump segment with a root, the class dumps of the given classes, with
+// a static int field each, an instance and a primitive array.
+std::string heap_dump_segment(const std::vector<uint32_t>& class_ids) {
+  DumpWriter w(/* with_header */ false);
+  w.u1(0x05); // ROOT_STICKY_CLASS
+  w.u4(1);
+  for (auto class_id : class_ids) {
+    w.u1(0x20); // CLASS_DUMP
+    w.u4(class_id);
+    w.u4(0);
+    for (int i = 0; i < 6; ++i) {
+      w.u4(0);
+    }
+    w.u4(8); // The instance size.
+    w.u2(0); // The constant pool.
+    w.u2(1); // A static int field.
+    w.u4(1);
+    w.u1(10);
+    w.u4(42);
+    w.u2(1); // An instance field.
+    w.u4(1);
+    w.u1(2);
+  }
+  w.u1(0x21); // INSTANCE_DUMP
+  w.u4(100);
+  w.u4(0);
+  w.u4(class_ids.front());
+  w.u4(3);
+  w.u1(1);
+  w.u1(2);
+  w.u1(3);
+  w.u1(0x23); // PRIMITIVE_ARRAY_DUMP of 2 longs.
+  w.u4(101);
+  w.u4(0);
+  w.u4(2);
+  w.u1(11);
+  for (int i = 0; i < 4; ++i) {
+    w.u4(0);
+  }
+  return w.str();
+}
+
+} // namespace
+
+TEST(HprofTest, readLoadedClasses) {
+  DumpWriter w;
+  w.string(1, "com.facebook.Foo");
+  w.string(2, "com.facebook.Bar");
+  w.string(3, "int[]");
+  w.string(4, "com.facebook.NotDumped");
+  w.load_class(/* serial */ 2, /* class_id */ 10, /* name_id */ 1);
+  w.load_class(1, 11, 2);
+  w.load_class(3, 12, 3);
+  w.load_class(4, 13, 4);
+  // The same class, from another class loader.
+  w.load_class(5, 14, 1);
+  // An unrelated record that is skipped.
+  w.record(0x04, 3);
+  w.u1(0);
+  w.u1(0);
+  w.u1(0);
+
+  auto segment = heap_dump_segment({10, 11, 12, 14});
+  w.record(0x1C, segment.size());
+  w.bytes(segment);
+  w.record(0x2C, 0);
+
+  std::istringstream is(w.str());
+  auto classes = hprof::read_loaded_classes(is);
+  ASSERT_EQ(classes.size(), 2);
+  EXPECT_EQ(classes[0].name, "com.facebook.Bar");
+  EXPECT_EQ(classes[0].serial, 1);
+  EXPECT_EQ(classes[1].name, "com.facebook.Foo");
+  EXPECT_EQ(classes[1].serial, 2);
+}
+
+TEST(HprofTest, truncatedDump) {
+  DumpWriter w;
+  w.string(1, "com.facebook.Foo");
+  auto data = w.str();
+  std::istringstream is(data.substr(0, data.size() - 3));
+  EXPECT_THROW(hprof::read_loaded_classes(is), RedexException);
+}
+
+TEST(HprofTest, javaNameToDescriptor) {
+  EXPECT_EQ(hprof::java_name_to_descriptor("com.facebook.Foo$Bar"),
+            "Lcom/facebook/Foo$Bar;");
+}
@@ -151,3 +151,39 @@ TEST_F(IRCodeTest, try_region) {
   EXPECT_EQ(split, second->m_start_addr);
   EXPECT_EQ(num * op->size() - split, second->m_insn_count);
 }
+
+TEST_F(IRCodeTest, modifiedEpoch) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()I"
+      (
+        (const v0 0)
+        (return v0)
+      )
+    )
+  )");
+  auto code = method->get_code();
+  EXPECT_EQ(IRCode::current_epoch(), code->modified_epoch());
+  auto epoch = code->modified_epoch();
+
+  // Reading the code or keeping its CFG around doesn't modify it.
+  IRCode::advance_epoch();
+  const IRCode* const_code = code;
+  EXPECT_EQ(2, const_code->count_opcodes());
+  for (const auto& mie : *const_code) {
+    EXPECT_NE(MFLOW_DEX_OPCODE, mie.type);
+  }
+  code->retain_cfg();
+  code->release_cfg();
+  EXPECT_EQ(epoch, code->modified_epoch());
+
+  // Code that gets synced and ballooned again keeps its epoch.
+  method->sync();
+  method->balloon_lazily();
+  IRCode::advance_epoch();
+  EXPECT_EQ(epoch, method->get_code()->modified_epoch());
+
+  code = method->get_code();
+  code->push_back(new IRInstruction(OPCODE_NOP));
+  EXPECT_EQ(IRCode::current_epoch(), code->modified_epoch());
+  EXPECT_LT(epoch, code->modified_epoch());
+}
@@ -395,3 +395,32 @@ TEST_F(IRInstructionTest, InvokeSourceIsWideComplex2) {
   EXPECT_FALSE(insn->invoke_src_is_wide(3));
   EXPECT_TRUE(insn->invoke_src_is_wide(4));
 }
+
+TEST_F(IRInstructionTest, ResizeSrcsKeepsRegisters) {
+  IRInstruction insn(OPCODE_INVOKE_STATIC);
+  insn.set_srcs_size(1);
+  insn.set_src(0, 7);
+  // inline -> out-of-line
+  insn.set_srcs_size(4);
+  EXPECT_EQ(4, insn.srcs_size());
+  EXPECT_EQ(7, insn.src(0));
+  EXPECT_EQ(0, insn.src(3));
+  insn.set_src(1, 8);
+  insn.set_src(2, 9);
+  insn.set_src(3, 10);
+
+  IRInstruction copy(insn);
+  EXPECT_EQ(insn, copy);
+  EXPECT_EQ(std::vector<reg_t>({7, 8, 9, 10}), copy.srcs_vec());
+
+  // out-of-line -> out-of-line
+  insn.set_srcs_size(3);
+  EXPECT_EQ(std::vector<reg_t>({7, 8, 9}), insn.srcs_vec());
+  EXPECT_NE(insn, copy);
+
+  // out-of-line -> inline
+  insn.set_srcs_size(2);
+  EXPECT_EQ(std::vector<reg_t>({7, 8}), insn.srcs_vec());
+  copy.set_srcs_size(2);
+  EXPECT_EQ(insn, copy);
+}
@@ -52,3 +52,38 @@ TEST_F(IRListTest, method_item_entry_equality) {
 
   always_assert(code_it == code->end() && clone_it == code_clone->end());
 }
+
+TEST_F(IRListTest, opcode_index) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (.dbg DBG_SET_PROLOGUE_END)
+      (if-gtz v0 :tru)
+      (const v1 1)
+      (return v1)
+      (:tru)
+      (return v0)
+    )
+  )");
+
+  auto expected_index = [&]() {
+    std::vector<IRInstruction*> insns;
+    for (const auto& mie : InstructionIterable(code.get())) {
+      insns.push_back(mie.insn);
+    }
+    return insns;
+  };
+  EXPECT_EQ(code->opcode_index(), expected_index());
+  EXPECT_EQ(5, code->opcode_index().size());
+
+  auto it = std::next(code->begin(), 3);
+  ASSERT_EQ(it->insn->opcode(), OPCODE_CONST);
+  code->insert_before(it, new IRInstruction(OPCODE_NOP));
+  EXPECT_FALSE(code->opcode_index_valid());
+  EXPECT_EQ(code->opcode_index(), expected_index());
+
+  code->remove_opcode(it);
+  EXPECT_FALSE(code->opcode_index_valid());
+  EXPECT_EQ(code->opcode_index(), expected_index());
+  EXPECT_EQ(5, code->opcode_index().size());
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IdMap.h"
+
+#include "RedexTest.h"
+
+class IdMapTest : public RedexTest {};
+
+TEST_F(IdMapTest, denseIds) {
+  auto num_type_ids = g_redex->num_type_ids();
+  auto foo = DexType::make_type("LFoo;");
+  auto bar = DexType::make_type("LBar;");
+  EXPECT_EQ(foo->get_id(), num_type_ids);
+  EXPECT_EQ(bar->get_id(), num_type_ids + 1);
+  // Interning the same type again doesn't give out an id.
+  EXPECT_EQ(DexType::make_type("LFoo;"), foo);
+  EXPECT_EQ(g_redex->num_type_ids(), num_type_ids + 2);
+
+  auto field = DexField::make_field("LFoo;.f:I");
+  auto method = DexMethod::make_method("LFoo;.m:()V");
+  EXPECT_EQ(field->get_id(), g_redex->num_field_ids() - 1);
+  EXPECT_EQ(method->get_id(), g_redex->num_method_ids() - 1);
+}
+
+TEST_F(IdMapTest, sideTable) {
+  auto foo = DexType::make_type("LFoo;");
+  IdMap<DexType, int> map;
+  EXPECT_EQ(map.get(foo), 0);
+  map[foo] = 42;
+  EXPECT_EQ(map.get(foo), 42);
+
+  // Keys created after the table.
+  auto bar = DexType::make_type("LBar;");
+  EXPECT_EQ(map.get(bar), 0);
+  map[bar] = 7;
+  EXPECT_EQ(map.get(bar), 7);
+  EXPECT_EQ(map.get(foo), 42);
+
+  map.clear();
+  EXPECT_EQ(map.get(foo), 0);
+  EXPECT_EQ(map.get(bar), 0);
+}
+
+TEST_F(IdMapTest, methodSideTable) {
+  auto method = DexMethod::make_method("LFoo;.m:()V")
+                    ->make_concrete(ACC_PUBLIC, /* is_virtual */ false);
+  IdMap<DexMethod, uint8_t> map;
+  map[method] = 1;
+  EXPECT_EQ(map.get(method), 1);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "IncrementalState.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::string read(const fs::path& path) {
+  std::ifstream in(path.string(), std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+void write(const fs::path& path, const std::string& contents) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path.string(), std::ios::binary) << contents;
+}
+
+} // namespace
+
+class IncrementalStateTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    m_root = fs::temp_directory_path() / fs::unique_path();
+    write(m_root / "apk" / "res" / "layout.xml", "layout");
+    write(m_root / "apk" / "classes.dex", "input dex");
+  }
+
+  void TearDown() override { fs::remove_all(m_root); }
+
+  incremental::State make_state() {
+    incremental::State state((m_root / "state").string());
+    state.add_input("config", "{}");
+    state.add_directory("apk", (m_root / "apk").string(),
+                        [](const std::string& path) {
+                          return fs::path(path).extension() == ".dex";
+                        });
+    return state;
+  }
+
+  fs::path m_root;
+};
+
+TEST_F(IncrementalStateTest, reuseOutputs) {
+  auto first_out = m_root / "out1";
+  EXPECT_FALSE(make_state().restore(first_out.string()));
+  write(first_out / "classes.dex", "output dex");
+  write(first_out / "classes2.dex", "output dex 2");
+  write(first_out / "meta" / "redex-stats.txt", "stats");
+  write(first_out / "unrelated.txt", "unrelated");
+  make_state().save(first_out.string());
+
+  // Dexes aren't part of the fingerprint.
+  write(m_root / "apk" / "classes.dex", "another input dex");
+  auto second_out = m_root / "out2";
+  EXPECT_TRUE(make_state().restore(second_out.string()));
+  EXPECT_EQ("output dex", read(second_out / "classes.dex"));
+  EXPECT_EQ("output dex 2", read(second_out / "classes2.dex"));
+  EXPECT_EQ("stats", read(second_out / "meta" / "redex-stats.txt"));
+  EXPECT_FALSE(fs::exists(second_out / "unrelated.txt"));
+
+  write(m_root / "apk" / "res" / "layout.xml", "changed layout");
+  EXPECT_FALSE(make_state().restore((m_root / "out3").string()));
+  EXPECT_FALSE(fs::exists(m_root / "out3" / "classes.dex"));
+}
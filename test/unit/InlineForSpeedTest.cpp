@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InlineForSpeed.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace inline_for_speed;
+
+class InlineForSpeedTest : public RedexTest {};
+
+namespace {
+
+DexMethod* make_method(const std::string& name) {
+  return assembler::method_from_string(
+      "(method (public static) \"LFoo;." + name +
+      ":()V\" ((return-void)))");
+}
+
+Stats make_stats(double call_count) {
+  Stats stats;
+  stats.call_count = call_count;
+  return stats;
+}
+
+} // namespace
+
+TEST_F(InlineForSpeedTest, selectWithinBudget) {
+  auto main = make_method("main");
+  auto hot = make_method("hot");
+  auto big = make_method("big");
+  auto warm = make_method("warm");
+  auto cold = make_method("cold");
+  std::unordered_map<const DexMethodRef*, Stats> stats{
+      {main, make_stats(1)},
+      {hot, make_stats(1000)},
+      {big, make_stats(1000)},
+      {warm, make_stats(10)},
+  };
+  std::vector<CallsiteCandidate> candidates{
+      {main, hot, 1, 10},
+      // The same number of calls, but ten times the cost.
+      {main, big, 1, 100},
+      {main, warm, 2, 4},
+      // Not in the profiles.
+      {main, cold, 1, 1},
+  };
+
+  size_t spent;
+  auto selected = select_within_budget(candidates, stats, 50, &spent);
+  // `big` doesn't fit after `hot` is selected, but `warm` still does.
+  EXPECT_EQ(14, spent);
+  EXPECT_EQ((std::unordered_set<const DexMethod*>{hot, warm}),
+            selected.at(main));
+
+  selected = select_within_budget(candidates, stats, 0, &spent);
+  EXPECT_EQ(0, spent);
+  EXPECT_TRUE(selected.empty());
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstructionIndex.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class InstructionIndexTest : public RedexTest {};
+
+TEST_F(InstructionIndexTest, indexesReferencesByOpcodeAndEntity) {
+  auto foo = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.foo:()V"
+     (
+      (sget "LFoo;.x:I")
+      (move-result-pseudo v0)
+      (sput v0 "LFoo;.y:I")
+      (invoke-static () "LFoo;.bar:()V")
+      (return-void)
+     )
+    )
+  )");
+  auto bar = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (sget "LFoo;.x:I")
+      (move-result-pseudo v1)
+      (return-void)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {foo, bar})};
+
+  InstructionIndex index(scope);
+  EXPECT_EQ(5, index.size());
+
+  auto x = DexField::get_field("LFoo;.x:I");
+  ASSERT_NE(nullptr, x);
+  const auto& x_uses = index.get(x);
+  ASSERT_EQ(2, x_uses.size());
+  EXPECT_EQ(foo, x_uses[0].method);
+  EXPECT_EQ(bar, x_uses[1].method);
+  for (const auto& use : x_uses) {
+    EXPECT_EQ(OPCODE_SGET, use.insn->opcode());
+  }
+
+  const auto& sputs = index.get(OPCODE_SPUT);
+  ASSERT_EQ(1, sputs.size());
+  EXPECT_EQ(DexField::get_field("LFoo;.y:I"), sputs[0].insn->get_field());
+
+  ASSERT_EQ(1, index.get(static_cast<DexMethodRef*>(bar)).size());
+  EXPECT_EQ(1, index.get(DexType::get_type("LFoo;")).size());
+  EXPECT_TRUE(index.get(static_cast<DexMethodRef*>(foo)).empty());
+  EXPECT_TRUE(index.get(OPCODE_IGET).empty());
+}
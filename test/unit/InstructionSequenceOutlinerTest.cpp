@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "InstructionSequenceOutliner.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+class InstructionSequenceOutlinerTest : public RedexTest {
+ public:
+  std::vector<DexMethod*> make_methods(const std::string& cls_name,
+                                       size_t count,
+                                       const std::string& body,
+                                       const std::string& proto = "(II)I") {
+    std::vector<DexMethod*> methods;
+    for (size_t i = 0; i < count; ++i) {
+      methods.push_back(assembler::method_from_string(
+          "(method (public static) \"" + cls_name + ".m" + std::to_string(i) +
+          ":" + proto + "\" " + body + ")"));
+    }
+    return methods;
+  }
+
+  static bool has_opcode(const DexMethod* method, IROpcode op) {
+    for (const auto& mie : InstructionIterable(method->get_code())) {
+      if (mie.insn->opcode() == op) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  DexClasses run_pass(std::vector<DexClass*> classes,
+                      const Json::Value& conf_obj = Json::nullValue) {
+    std::vector<DexStore> stores;
+    DexMetadata dm;
+    dm.set_id("classes");
+    DexStore store(dm);
+    store.add_classes(std::move(classes));
+    stores.emplace_back(std::move(store));
+
+    auto pass = new InstructionSequenceOutlinerPass();
+    PassManager manager({pass});
+    manager.set_testing_mode();
+    ConfigFiles config(conf_obj);
+    manager.run_passes(stores, config);
+    return stores[0].get_dexen()[0];
+  }
+};
+
+TEST_F(InstructionSequenceOutlinerTest, outlineArithmetic) {
+  auto methods = make_methods("LFoo;", 6, R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (add-int v2 v0 v1)
+      (mul-int v3 v2 v0)
+      (sub-int v4 v3 v1)
+      (mul-int v2 v4 v4)
+      (add-int v2 v2 v0)
+      (return v2)
+    )
+  )");
+  auto cls = assembler::class_with_methods("LFoo;", methods);
+  auto dex = run_pass({cls});
+
+  ASSERT_EQ(2, dex.size());
+  auto host = dex[1];
+  ASSERT_EQ(1, host->get_dmethods().size());
+  auto helper = host->get_dmethods()[0];
+  EXPECT_TRUE(is_static(helper));
+  EXPECT_EQ("(II)I", show(helper->get_proto()));
+
+  auto expected_helper = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (add-int v2 v0 v1)
+      (mul-int v3 v2 v0)
+      (sub-int v4 v3 v1)
+      (mul-int v2 v4 v4)
+      (add-int v2 v2 v0)
+      (return v2)
+    )
+  )");
+  EXPECT_CODE_EQ(helper->get_code(), expected_helper.get());
+
+  for (auto method : methods) {
+    auto code = method->get_code();
+    std::vector<IROpcode> opcodes;
+    for (const auto& mie : InstructionIterable(code)) {
+      opcodes.push_back(mie.insn->opcode());
+    }
+    std::vector<IROpcode> expected{IOPCODE_LOAD_PARAM, IOPCODE_LOAD_PARAM,
+                                   OPCODE_INVOKE_STATIC, OPCODE_MOVE_RESULT,
+                                   OPCODE_RETURN};
+    EXPECT_EQ(expected, opcodes);
+    auto invoke = std::next(InstructionIterable(code).begin(), 2)->insn;
+    EXPECT_EQ(helper, invoke->get_method());
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, tooFewOccurrences) {
+  auto methods = make_methods("LBar;", 2, R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (add-int v2 v0 v1)
+      (mul-int v3 v2 v0)
+      (sub-int v4 v3 v1)
+      (return v4)
+    )
+  )");
+  auto cls = assembler::class_with_methods("LBar;", methods);
+  auto dex = run_pass({cls});
+
+  EXPECT_EQ(1, dex.size());
+  for (auto method : methods) {
+    EXPECT_EQ(4, method->get_code()->count_opcodes());
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, finalFieldWritesStay) {
+  // Only the declaring class may write a final field, and the helpers live
+  // in another class.
+  for (auto access : {ACC_PUBLIC | ACC_STATIC,
+                      ACC_PUBLIC | ACC_STATIC | ACC_FINAL}) {
+    std::string cls_name = is_final(access) ? "LFinal;" : "LNonFinal;";
+    auto methods = make_methods(cls_name, 6, R"(
+      (
+        (load-param v0)
+        (load-param v1)
+        (add-int v2 v0 v1)
+        (mul-int v3 v2 v0)
+        (sub-int v4 v3 v1)
+        (mul-int v2 v4 v4)
+        (sput v2 ")" + cls_name + R"(.f:I")
+        (return v1)
+      )
+    )");
+    auto cls = assembler::class_with_methods(cls_name, methods);
+    cls->set_access(ACC_PUBLIC);
+    cls->add_field(
+        DexField::make_field(cls_name + ".f:I")->make_concrete(access));
+    run_pass({cls});
+
+    for (auto method : methods) {
+      bool has_sput = false;
+      for (const auto& mie : InstructionIterable(method->get_code())) {
+        has_sput |= mie.insn->opcode() == OPCODE_SPUT;
+      }
+      EXPECT_EQ(is_final(access), has_sput) << show(method);
+    }
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, outlineWideResult) {
+  auto methods = make_methods("LWide;", 6, R"(
+    (
+      (load-param-wide v0)
+      (load-param-wide v2)
+      (add-long v4 v0 v2)
+      (mul-long v6 v4 v0)
+      (sub-long v8 v6 v2)
+      (mul-long v4 v8 v8)
+      (add-long v4 v4 v0)
+      (return-wide v4)
+    )
+  )",
+                              "(JJ)J");
+  auto cls = assembler::class_with_methods("LWide;", methods);
+  auto dex = run_pass({cls});
+
+  ASSERT_EQ(2, dex.size());
+  ASSERT_EQ(1, dex[1]->get_dmethods().size());
+  auto helper = dex[1]->get_dmethods()[0];
+  EXPECT_EQ("(JJ)J", show(helper->get_proto()));
+  for (auto method : methods) {
+    std::vector<IROpcode> opcodes;
+    for (const auto& mie : InstructionIterable(method->get_code())) {
+      opcodes.push_back(mie.insn->opcode());
+    }
+    std::vector<IROpcode> expected{
+        IOPCODE_LOAD_PARAM_WIDE, IOPCODE_LOAD_PARAM_WIDE, OPCODE_INVOKE_STATIC,
+        OPCODE_MOVE_RESULT_WIDE, OPCODE_RETURN_WIDE};
+    EXPECT_EQ(expected, opcodes);
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, outlineResultInTheMiddle) {
+  // The sequence computes v2, which the rest of the method keeps using.
+  auto methods = make_methods("LMiddle;", 6, R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (add-int v2 v0 v1)
+      (mul-int v3 v2 v0)
+      (sub-int v4 v3 v1)
+      (mul-int v5 v4 v4)
+      (add-int v2 v5 v0)
+      (if-eqz v2 :zero)
+      (return v2)
+      (:zero)
+      (return v1)
+    )
+  )");
+  auto cls = assembler::class_with_methods("LMiddle;", methods);
+  auto dex = run_pass({cls});
+
+  ASSERT_EQ(2, dex.size());
+  auto helper = dex[1]->get_dmethods()[0];
+  EXPECT_EQ("(II)I", show(helper->get_proto()));
+  for (auto method : methods) {
+    auto it = InstructionIterable(method->get_code()).begin();
+    std::advance(it, 2);
+    EXPECT_EQ(OPCODE_INVOKE_STATIC, it->insn->opcode());
+    EXPECT_EQ(helper, it->insn->get_method());
+    ++it;
+    ASSERT_EQ(OPCODE_MOVE_RESULT, it->insn->opcode());
+    EXPECT_EQ(2, it->insn->dest());
+    ++it;
+    EXPECT_EQ(OPCODE_IF_EQZ, it->insn->opcode());
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, narrowArgumentsStay) {
+  // The byte field can't be written with an int argument of a helper.
+  for (std::string type : {"I", "B"}) {
+    auto cls_name = "LNarrow" + type + ";";
+    auto put = std::string(type == "B" ? "sput-byte" : "sput") + " v0 \"" +
+               cls_name + ".f:" + type + "\"";
+    auto methods = make_methods(cls_name, 6, R"(
+      (
+        (load-param v0)
+        (load-param v1)
+        (add-int v2 v0 v1)
+        (mul-int v3 v2 v0)
+        (sub-int v4 v3 v1)
+        (mul-int v2 v4 v4)
+        ()" + put + R"()
+        (return v2)
+      )
+    )",
+                                "(" + type + "I)I");
+    auto cls = assembler::class_with_methods(cls_name, methods);
+    cls->set_access(ACC_PUBLIC);
+    cls->add_field(DexField::make_field(cls_name + ".f:" + type)
+                       ->make_concrete(ACC_PUBLIC | ACC_STATIC));
+    run_pass({cls});
+
+    for (auto method : methods) {
+      EXPECT_EQ(type == "B", has_opcode(method, OPCODE_SPUT_BYTE))
+          << show(method);
+      EXPECT_FALSE(has_opcode(method, OPCODE_SPUT)) << show(method);
+    }
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, uninitializedArgumentsStay) {
+  ClassCreator creator(DexType::make_type("LObj;"));
+  creator.set_super(type::java_lang_Object());
+  creator.set_access(ACC_PUBLIC);
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public constructor) "LObj;.<init>:()V"
+      ((load-param-object v0) (return-void)))
+  )"));
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LObj;.make:()LObj;"
+      ((const v0 0) (return-object v0)))
+  )"));
+  creator.add_field(
+      DexField::make_field("LObj;.s:I")->make_concrete(ACC_PUBLIC |
+                                                       ACC_STATIC));
+  creator.create();
+
+  // Passes the object that v2 holds through the sequence, before or after
+  // the constructor call.
+  for (bool uninitialized : {false, true}) {
+    std::string cls_name = uninitialized ? "LUninit;" : "LInit;";
+    std::string make =
+        uninitialized
+            ? R"((new-instance "LObj;") (move-result-pseudo-object v2))"
+            : R"((invoke-static () "LObj;.make:()LObj;")
+                 (move-result-object v2))";
+    std::string init =
+        uninitialized ? R"((invoke-direct (v2) "LObj;.<init>:()V"))" : "";
+    auto methods = make_methods(cls_name, 6, R"(
+      (
+        (load-param v0)
+        (load-param v1)
+        )" + make + R"(
+        (add-int v3 v0 v1)
+        (mul-int v3 v3 v0)
+        (move-object v2 v2)
+        (sub-int v3 v3 v1)
+        (mul-int v3 v3 v3)
+        (sput v3 "LObj;.s:I")
+        )" + init + R"(
+        (return-object v2)
+      )
+    )",
+                                "(II)LObj;");
+    auto cls = assembler::class_with_methods(cls_name, methods);
+    run_pass({cls});
+
+    for (auto method : methods) {
+      EXPECT_EQ(uninitialized, has_opcode(method, OPCODE_MOVE_OBJECT))
+          << show(method);
+    }
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, liveOutRegistersStay) {
+  // The sequence writes v2 and v3. When both are read after it, the helper
+  // can't return them both.
+  for (bool both_live : {false, true}) {
+    std::string cls_name = both_live ? "LBothLive;" : "LOneLive;";
+    std::string live = both_live ? "v2 v3" : "v2 v2";
+    auto methods = make_methods(cls_name, 6, R"(
+      (
+        (load-param v0)
+        (load-param v1)
+        (add-int v2 v0 v1)
+        (mul-int v3 v2 v0)
+        (sub-int v4 v3 v1)
+        (mul-int v5 v4 v4)
+        (add-int v2 v5 v0)
+        (invoke-static ()" + live + R"() "LExternal;.use:(II)I")
+        (move-result v2)
+        (return v2)
+      )
+    )");
+    auto cls = assembler::class_with_methods(cls_name, methods);
+    run_pass({cls});
+
+    for (auto method : methods) {
+      EXPECT_EQ(both_live, has_opcode(method, OPCODE_MUL_INT)) << show(method);
+    }
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerTest, hotMethodsStay) {
+  auto methods = make_methods("LHot;", 8, R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (add-int v2 v0 v1)
+      (mul-int v3 v2 v0)
+      (sub-int v4 v3 v1)
+      (mul-int v2 v4 v4)
+      (add-int v2 v2 v0)
+      (return v2)
+    )
+  )");
+  auto cls = assembler::class_with_methods("LHot;", methods);
+
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+  std::ofstream(path)
+      << "index,name,appear100,appear#,avg_call,avg_order,avg_rank100,"
+         "min_api_level\n"
+      << "0," << show(methods[0]) << ",100.0,10,1.0,1.0,1.0,21\n"
+      << "1," << show(methods[1]) << ",90.0,9,1.0,1.0,1.0,21\n"
+      << "2," << show(methods[2]) << ",50.0,5,1.0,1.0,1.0,21\n";
+  Json::Value conf_obj;
+  conf_obj["agg_method_stats_file"] = path;
+  run_pass({cls}, conf_obj);
+  boost::filesystem::remove(path);
+
+  // The hot methods are left alone. The profile drops the methods that appear
+  // in less than 80% of the samples, so m2 isn't hot.
+  for (size_t i = 0; i < methods.size(); ++i) {
+    EXPECT_EQ(i < 2, has_opcode(methods[i], OPCODE_MUL_INT))
+        << show(methods[i]);
+  }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LineMapReader.h"
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexPosition.h"
+#include "RedexTest.h"
+
+class LineMapReaderTest : public RedexTest {
+ public:
+  // Writes a map with two lines in a method inlined into LBar;.caller, and
+  // one line whose stack is a copy of the first one.
+  std::string write_map(uint32_t version) {
+    auto path = (boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path())
+                    .string();
+    auto callee = DexString::make_string("LFoo;.callee:()V");
+    auto caller = DexString::make_string("LBar;.caller:()V");
+    auto foo_file = DexString::make_string("Foo.java");
+    auto bar_file = DexString::make_string("Bar.java");
+
+    m_positions.emplace_back(new DexPosition(caller, bar_file, 10));
+    auto callsite = m_positions.back().get();
+    m_positions.emplace_back(new DexPosition(caller, bar_file, 10));
+    auto callsite_copy = m_positions.back().get();
+    m_positions.emplace_back(new DexPosition(callee, foo_file, 1));
+    auto first = m_positions.back().get();
+    first->parent = callsite;
+    m_positions.emplace_back(new DexPosition(callee, foo_file, 2));
+    auto second = m_positions.back().get();
+    second->parent = callsite;
+    m_positions.emplace_back(new DexPosition(callee, foo_file, 1));
+    auto first_copy = m_positions.back().get();
+    first_copy->parent = callsite_copy;
+
+    std::unique_ptr<PositionMapper> mapper(
+        PositionMapper::make(path, version));
+    for (auto& pos : m_positions) {
+      mapper->register_position(pos.get());
+    }
+    EXPECT_EQ(mapper->position_to_line(first), 1);
+    EXPECT_EQ(mapper->position_to_line(second), 2);
+    EXPECT_EQ(mapper->position_to_line(first_copy), 3);
+    mapper->write_map();
+    return path;
+  }
+
+  void expect_stacks(LineMapReader& reader) {
+    auto first = reader.get_stack(1);
+    ASSERT_EQ(first.size(), 2);
+    EXPECT_EQ(first[0].class_name, "Foo");
+    EXPECT_EQ(first[0].method_name, "callee");
+    EXPECT_EQ(first[0].file, "Foo.java");
+    EXPECT_EQ(first[0].line, 1);
+    EXPECT_EQ(first[1].class_name, "Bar");
+    EXPECT_EQ(first[1].method_name, "caller");
+    EXPECT_EQ(first[1].file, "Bar.java");
+    EXPECT_EQ(first[1].line, 10);
+
+    auto second = reader.get_stack(2);
+    ASSERT_EQ(second.size(), 2);
+    EXPECT_EQ(second[0].line, 2);
+    EXPECT_EQ(second[1].line, 10);
+
+    auto third = reader.get_stack(3);
+    ASSERT_EQ(third.size(), 2);
+    EXPECT_EQ(third[0].line, 1);
+    EXPECT_EQ(third[1].method_name, "caller");
+
+    EXPECT_TRUE(reader.get_stack(0).empty());
+    EXPECT_TRUE(reader.get_stack(reader.line_count() + 1).empty());
+  }
+
+ private:
+  std::vector<std::unique_ptr<DexPosition>> m_positions;
+};
+
+TEST_F(LineMapReaderTest, readV2) {
+  auto path = write_map(2);
+  LineMapReader reader(path);
+  EXPECT_EQ(reader.version(), 2);
+  // The callsites are not emitted, but still get lines at the end.
+  EXPECT_EQ(reader.line_count(), 5);
+  expect_stacks(reader);
+  boost::filesystem::remove(path);
+}
+
+TEST_F(LineMapReaderTest, readV3) {
+  auto path = write_map(3);
+  LineMapReader reader(path);
+  EXPECT_EQ(reader.version(), 3);
+  EXPECT_EQ(reader.line_count(), 3);
+  expect_stacks(reader);
+  boost::filesystem::remove(path);
+}
+
+TEST_F(LineMapReaderTest, v3SharesIdenticalStacks) {
+  auto path = write_map(3);
+  // Three frames: the callsite and the two lines of the callee. The copies
+  // of the callsite and of the first line are not stored again.
+  std::ifstream in(path, std::ifstream::binary);
+  uint32_t header[6];
+  in.read((char*)header, sizeof(header));
+  EXPECT_EQ(header[1], 3);
+  EXPECT_EQ(header[3], 3);
+  boost::filesystem::remove(path);
+}
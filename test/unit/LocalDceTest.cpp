@@ -7,12 +7,14 @@
 
 #include <gtest/gtest.h>
 
+#include "ConfigFiles.h"
 #include "DexAsm.h"
 #include "DexUtil.h"
 #include "IRAssembler.h"
 #include "IRCode.h"
 #include "InstructionLowering.h"
 #include "LocalDcePass.h"
+#include "PassManager.h"
 #include "RedexTest.h"
 #include "ScopeHelper.h"
 
@@ -376,3 +378,45 @@ TEST_F(LocalDceEnhanceTest, HaveImplementorIntfTest) {
   ldce.dce(ircode);
   EXPECT_CODE_EQ(ircode, expected_code.get());
 }
+
+TEST_F(LocalDceTryTest, onlyModifiedMethods) {
+  auto cls = create_internal_class(DexType::make_type("LFoo;"),
+                                   type::java_lang_Object(), {});
+  auto make = [&](const std::string& name) {
+    auto method = assembler::method_from_string(
+        "(method (public static) \"LFoo;." + name +
+        ":()V\" ((const v0 0) (return-void)))");
+    cls->add_method(method);
+    return method;
+  };
+  auto dead = make("dead");
+  make("other");
+
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({cls});
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+
+  Json::Value config(Json::objectValue);
+  config["redex"]["passes"].append("LocalDcePass");
+  config["redex"]["passes"].append("LocalDcePass");
+  config["LocalDcePass"]["only_modified_methods"] = true;
+  config["ir_type_checker"]["run_after_each_pass"] = true;
+  config["ir_type_checker"]["only_modified_methods"] = true;
+  LocalDcePass pass;
+  PassManager manager({&pass}, config);
+  manager.set_testing_mode();
+  ConfigFiles conf(config);
+  manager.run_passes(stores, conf);
+
+  // Nothing modified the methods after the first run, the hasher and the type
+  // checker that run in between only read them.
+  const auto& info = manager.get_pass_info();
+  ASSERT_EQ(2, info.size());
+  EXPECT_EQ(2, info[0].metrics.at("num_dead_instructions"));
+  EXPECT_EQ(0, info[0].metrics.at("num_unmodified_methods"));
+  EXPECT_EQ(2, info[1].metrics.at("num_unmodified_methods"));
+  EXPECT_EQ(1, dead->get_code()->count_opcodes());
+}
@@ -397,3 +397,52 @@ TEST_F(LocalPointersTest, returnEscapedValue) {
     EXPECT_TRUE(exit_env.may_have_escaped(invoke_insn));
   }
 }
+
+/*
+ * Check that the summaries of mutually recursive methods are computed until
+ * they are stable, and that their callers see the final summaries.
+ */
+TEST_F(LocalPointersTest, analyzeScopeWithCycle) {
+  auto even = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.even:(LBar;)V"
+     (
+      (load-param-object v0)
+      (invoke-static (v0) "LFoo;.odd:(LBar;)V")
+      (return-void)
+     )
+    )
+  )");
+  auto odd = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.odd:(LBar;)V"
+     (
+      (load-param-object v0)
+      (invoke-static (v0) "LFoo;.even:(LBar;)V")
+      (sput-object v0 "LFoo;.bar:LBar;")
+      (return-void)
+     )
+    )
+  )");
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.caller:(LBar;LBar;)V"
+     (
+      (load-param-object v0)
+      (load-param-object v1)
+      (invoke-static (v1) "LFoo;.even:(LBar;)V")
+      (return-void)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {even, odd, caller})};
+  for (auto* method : {even, odd, caller}) {
+    method->get_code()->build_cfg(/* editable */ false);
+    method->get_code()->cfg().calculate_exit_block();
+  }
+
+  ptrs::SummaryCMap summaries;
+  ptrs::analyze_scope(scope, call_graph::single_callee_graph(scope),
+                      &summaries);
+  EXPECT_THAT(summaries.at(even).escaping_parameters, UnorderedElementsAre(0));
+  EXPECT_THAT(summaries.at(odd).escaping_parameters, UnorderedElementsAre(0));
+  EXPECT_THAT(summaries.at(caller).escaping_parameters,
+              UnorderedElementsAre(1));
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "locator_index.h"
+
+using facebook::ClassLocatorIndex;
+using facebook::Locator;
+
+TEST(LocatorIndexTest, findsEveryClass) {
+  std::vector<std::pair<std::string, Locator>> classes;
+  for (uint32_t i = 0; i < 50000; ++i) {
+    classes.emplace_back("Lcom/foo/Bar" + std::to_string(i) + ";",
+                         Locator::make(i % 3, i % 40 + 1, i));
+  }
+  auto data = ClassLocatorIndex::build(classes);
+  ClassLocatorIndex index;
+  ASSERT_TRUE(index.init(data.data(), data.size()));
+  EXPECT_EQ(classes.size(), index.size());
+  for (const auto& pair : classes) {
+    auto locator = index.find(pair.first.c_str());
+    EXPECT_EQ(pair.second.strnr, locator.strnr);
+    EXPECT_EQ(pair.second.dexnr, locator.dexnr);
+    EXPECT_EQ(pair.second.clsnr, locator.clsnr);
+  }
+
+  auto missing = index.find("Ljava/lang/Object;");
+  EXPECT_EQ(0, missing.strnr);
+  EXPECT_EQ(0, missing.dexnr);
+  EXPECT_EQ(0, missing.clsnr);
+}
+
+TEST(LocatorIndexTest, emptyAndInvalid) {
+  auto data = ClassLocatorIndex::build({});
+  ClassLocatorIndex index;
+  ASSERT_TRUE(index.init(data.data(), data.size()));
+  EXPECT_EQ(0, index.find("LFoo;").dexnr);
+
+  data = ClassLocatorIndex::build({{"LFoo;", Locator::make(0, 1, 2)}});
+  EXPECT_FALSE(index.init(data.data(), data.size() - 1));
+  EXPECT_FALSE(index.init(data.data(), 3));
+
+  EXPECT_THROW(ClassLocatorIndex::build({{"LFoo;", Locator::make(0, 1, 2)},
+                                         {"LFoo;", Locator::make(0, 1, 3)}}),
+               std::runtime_error);
+}
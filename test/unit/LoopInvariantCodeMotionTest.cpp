@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "LoopInvariantCodeMotion.h"
+#include "RedexTest.h"
+
+class LoopInvariantCodeMotionTest : public RedexTest {};
+
+void test(const std::string& code_str,
+          const std::string& expected_str,
+          size_t expected_instructions_hoisted,
+          size_t expected_throwing_instructions_hoisted,
+          const std::unordered_set<DexMethodRef*>& pure_methods = {}) {
+  auto code = assembler::ircode_from_string(code_str);
+  auto expected = assembler::ircode_from_string(expected_str);
+
+  auto stats = LoopInvariantCodeMotionPass::process_code(
+      code.get(), pure_methods, /* hoist_final_field_reads */ true);
+  EXPECT_EQ(expected_instructions_hoisted, stats.instructions_hoisted);
+  EXPECT_EQ(expected_throwing_instructions_hoisted,
+            stats.throwing_instructions_hoisted);
+
+  printf("%s\n", assembler::to_string(code.get()).c_str());
+  EXPECT_CODE_EQ(code.get(), expected.get());
+}
+
+TEST_F(LoopInvariantCodeMotionTest, hoist_from_header_and_body) {
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:loop)
+      (array-length v0)
+      (move-result-pseudo v2)
+      (if-ge v1 v2 :end)
+
+      (const v3 1)
+      (add-int v1 v1 v3)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  const auto& expected_str = R"(
+    (
+      (const v1 0)
+      (array-length v0)
+      (move-result-pseudo v2)
+      (const v3 1)
+
+      (:loop)
+      (if-ge v1 v2 :end)
+
+      (add-int v1 v1 v3)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, expected_str, 2, 1);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, dependent_instructions) {
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:loop)
+      (if-gez v1 :end)
+
+      (const v2 3)
+      (mul-int v3 v2 v2)
+      (add-int v1 v1 v3)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  const auto& expected_str = R"(
+    (
+      (const v1 0)
+      (const v2 3)
+      (mul-int v3 v2 v2)
+
+      (:loop)
+      (if-gez v1 :end)
+
+      (add-int v1 v1 v3)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, expected_str, 2, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, live_into_header) {
+  // v2 is read before it is written in the loop, so its first iteration sees
+  // the value from before the loop.
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+      (const v2 5)
+
+      (:loop)
+      (if-ge v1 v2 :end)
+
+      (const v2 1)
+      (add-int v1 v1 v2)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, code_str, 0, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, live_out_of_body) {
+  // v2 is only defined once the loop runs its body, so it can't be hoisted
+  // while it is read after the loop.
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+      (const v2 0)
+
+      (:loop)
+      (if-gez v1 :end)
+
+      (const v2 1)
+      (add-int v1 v1 v2)
+      (goto :loop)
+
+      (:end)
+      (return v2)
+    )
+  )";
+  test(code_str, code_str, 0, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, may_throw_outside_of_header) {
+  // The array-length may throw, and did not run before the first check of
+  // the loop condition.
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:loop)
+      (if-gez v1 :end)
+
+      (array-length v0)
+      (move-result-pseudo v2)
+      (add-int v1 v1 v2)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, code_str, 0, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, may_throw_after_side_effect) {
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:loop)
+      (invoke-static () "LFoo;.bar:()V")
+      (array-length v0)
+      (move-result-pseudo v2)
+      (if-ge v1 v2 :end)
+
+      (add-int/lit8 v1 v1 1)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, code_str, 0, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, pure_invoke) {
+  auto abs = DexMethod::make_method("Ljava/lang/Math;.abs:(I)I");
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:loop)
+      (invoke-static (v0) "Ljava/lang/Math;.abs:(I)I")
+      (move-result v2)
+      (if-ge v1 v2 :end)
+
+      (add-int/lit8 v1 v1 1)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  const auto& expected_str = R"(
+    (
+      (const v1 0)
+      (invoke-static (v0) "Ljava/lang/Math;.abs:(I)I")
+      (move-result v2)
+
+      (:loop)
+      (if-ge v1 v2 :end)
+
+      (add-int/lit8 v1 v1 1)
+      (goto :loop)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, expected_str, 1, 1, {abs});
+  // Not hoisted when the method isn't known to be pure
+  test(code_str, code_str, 0, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, nested_loops) {
+  // The constant is hoisted out of the inner loop, and then out of the outer
+  // one.
+  const auto& code_str = R"(
+    (
+      (const v1 0)
+
+      (:outer)
+      (if-gez v1 :end)
+      (const v2 0)
+
+      (:inner)
+      (if-gez v2 :inner_end)
+      (const v3 1)
+      (add-int v2 v2 v3)
+      (goto :inner)
+
+      (:inner_end)
+      (add-int v1 v1 v2)
+      (goto :outer)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  const auto& expected_str = R"(
+    (
+      (const v1 0)
+      (const v3 1)
+
+      (:outer)
+      (if-gez v1 :end)
+      (const v2 0)
+
+      (:inner)
+      (if-gez v2 :inner_end)
+      (add-int v2 v2 v3)
+      (goto :inner)
+
+      (:inner_end)
+      (add-int v1 v1 v2)
+      (goto :outer)
+
+      (:end)
+      (return v1)
+    )
+  )";
+  test(code_str, expected_str, 2, 0);
+}
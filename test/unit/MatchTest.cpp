@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Match.h"
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Walkers.h"
+
+class MatchTest : public RedexTest {};
+
+TEST_F(MatchTest, opcodeFilters) {
+  auto invoke = m::invoke();
+  EXPECT_TRUE(invoke.opcodes.may_match(OPCODE_INVOKE_INTERFACE));
+  EXPECT_FALSE(invoke.opcodes.may_match(OPCODE_CONST_STRING));
+
+  auto either = m::invoke_static() || m::throwex();
+  EXPECT_TRUE(either.opcodes.may_match(OPCODE_INVOKE_STATIC));
+  EXPECT_TRUE(either.opcodes.may_match(OPCODE_THROW));
+  EXPECT_FALSE(either.opcodes.may_match(OPCODE_INVOKE_VIRTUAL));
+
+  auto both = m::invoke() && m::is_opcode(OPCODE_INVOKE_STATIC);
+  EXPECT_TRUE(both.opcodes.may_match(OPCODE_INVOKE_STATIC));
+  EXPECT_FALSE(both.opcodes.may_match(OPCODE_INVOKE_DIRECT));
+
+  // Negations and opcode-independent matchers may match anything.
+  EXPECT_TRUE((!m::const_string()).opcodes.may_match(OPCODE_CONST_STRING));
+  EXPECT_TRUE(m::has_n_args(0).opcodes.may_match(OPCODE_NOP));
+}
+
+TEST_F(MatchTest, matchingOpcodes) {
+  auto method = assembler::class_with_method("LFoo;",
+                                             R"(
+      (method (public static) "LFoo;.bar:()V"
+       (
+        (const-string "hello")
+        (move-result-pseudo-object v0)
+        (invoke-static (v0) "LFoo;.baz:(Ljava/lang/String;)V")
+        (invoke-static (v0) "LFoo;.baz:(Ljava/lang/String;)V")
+        (return-void)
+       )
+      )
+    )");
+  auto cls = type_class(method->get_class());
+  std::vector<DexClass*> scope{cls};
+
+  std::atomic<size_t> pairs{0};
+  walk::parallel::matching_opcodes(
+      scope,
+      std::make_tuple(m::invoke_static(),
+                      m::invoke_static() || m::return_void()),
+      [&](DexMethod*, const std::vector<IRInstruction*>& insns) {
+        EXPECT_EQ(insns.size(), 2);
+        ++pairs;
+      });
+  EXPECT_EQ(pairs, 2);
+
+  size_t throws = 0;
+  walk::matching_opcodes_in_block(
+      scope,
+      std::make_tuple(m::throwex()),
+      [&](DexMethod*, cfg::Block*, const std::vector<IRInstruction*>&) {
+        ++throws;
+      });
+  EXPECT_EQ(throws, 0);
+}
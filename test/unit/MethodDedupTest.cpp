@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "MethodDedup.h"
+#include "RedexTest.h"
+
+class MethodDedupTest : public RedexTest {};
+
+static DexMethod* make_method(const std::string& name, int literal) {
+  return assembler::method_from_string(
+      "(method (public static) \"LFoo;." + name + ":()I\" ((const v0 " +
+      std::to_string(literal) + ") (return v0)))");
+}
+
+TEST_F(MethodDedupTest, groupIdenticalMethods) {
+  auto a = make_method("a", 1);
+  auto b = make_method("b", 1);
+  auto c = make_method("c", 2);
+  auto groups = method_dedup::group_identical_methods({a, b, c});
+  ASSERT_EQ(2, groups.size());
+  for (const auto& group : groups) {
+    if (group.count(c)) {
+      EXPECT_EQ(1, group.size());
+    } else {
+      EXPECT_EQ(MethodOrderedSet({a, b}), group);
+    }
+  }
+  EXPECT_EQ(method_dedup::hash_code(a->get_code()),
+            method_dedup::hash_code(b->get_code()));
+  EXPECT_TRUE(method_dedup::are_methods_identical({a, b}));
+  EXPECT_FALSE(method_dedup::are_methods_identical({a, c}));
+}
+
+TEST_F(MethodDedupTest, groupManyMethods) {
+  // Enough methods for the code to be hashed in parallel.
+  std::vector<DexMethod*> methods;
+  for (int i = 0; i < 2000; ++i) {
+    methods.push_back(make_method("m" + std::to_string(i), i % 10));
+  }
+  auto groups = method_dedup::group_identical_methods(methods);
+  ASSERT_EQ(10, groups.size());
+  for (const auto& group : groups) {
+    EXPECT_EQ(200, group.size());
+  }
+}
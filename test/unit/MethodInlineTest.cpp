@@ -253,3 +253,51 @@ TEST_F(MethodInlineTest, test_intra_dex_inlining) {
     EXPECT_EQ(inlined.count(method), 1);
   }
 }
+
+TEST_F(MethodInlineTest, inline_decisions) {
+  MethodRefCache resolve_cache;
+  auto resolver = [&resolve_cache](DexMethodRef* method, MethodSearch search) {
+    return resolve_method(method, search, resolve_cache);
+  };
+
+  DexStoresVector stores;
+  auto foo_cls = create_a_class("Lfoo;");
+  auto bar_cls = create_a_class("Lbar;");
+  DexStore store("root");
+  store.add_classes({foo_cls, bar_cls});
+  stores.push_back(std::move(store));
+
+  auto foo_m1 = make_a_method(foo_cls, "foo_m1", 1);
+  auto bar_m1 = make_a_method(bar_cls, "bar_m1", 2);
+  auto foo_main =
+      make_a_method_calls_others(foo_cls, "foo_main", {foo_m1, bar_m1});
+  std::unordered_set<DexMethod*> candidates{foo_m1, bar_m1};
+  auto scope = build_class_scope(stores);
+  api::LevelChecker::init(0, scope);
+
+  inliner::InlinerConfig inliner_config;
+  inliner_config.log_inline_decisions = true;
+  inliner_config.m_black_list = {"Lbar;"};
+  inliner_config.populate(scope);
+  MultiMethodInliner inliner(
+      scope, stores, candidates, resolver, inliner_config, InterDex);
+  inliner.inline_methods();
+
+  const auto& decisions = inliner.get_inline_decisions();
+  ASSERT_EQ(2, decisions.size());
+  for (const auto& decision : decisions) {
+    EXPECT_EQ(foo_main, decision.caller);
+    EXPECT_FALSE(decision.hot);
+    if (decision.callee == foo_m1) {
+      EXPECT_EQ(inliner::RejectReason::NONE, decision.reject_reason);
+    } else {
+      EXPECT_EQ(bar_m1, decision.callee);
+      EXPECT_EQ(inliner::RejectReason::BLACKLISTED_CALLEE,
+                decision.reject_reason);
+    }
+  }
+  const auto& info = inliner.get_info();
+  EXPECT_EQ(1,
+            info.rejected[(size_t)inliner::RejectReason::BLACKLISTED_CALLEE]);
+  EXPECT_EQ(1, info.calls_inlined);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodProfiles.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "RedexTest.h"
+
+using namespace method_profiles;
+
+class MethodProfilesTest : public RedexTest {
+ protected:
+  void SetUp() override {
+    m_foo = DexMethod::make_method("LFoo;.foo:()V");
+    m_bar = DexMethod::make_method("LFoo;.bar:()V");
+    m_path = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path())
+                 .string();
+  }
+
+  void TearDown() override { boost::filesystem::remove(m_path); }
+
+  std::string write(const std::string& contents) {
+    std::ofstream(m_path) << contents;
+    return m_path;
+  }
+
+  DexMethodRef* m_foo;
+  DexMethodRef* m_bar;
+  std::string m_path;
+};
+
+TEST_F(MethodProfilesTest, interactions) {
+  MethodProfiles profiles;
+  ASSERT_TRUE(profiles.initialize(write(
+      "interaction,name,index,appear100,appear#,avg_call,avg_order,"
+      "avg_rank100,min_api_level\n"
+      "ColdStart,LFoo;.foo:()V,0,100.0,10,2.0,1.0,5.0,21\n"
+      "Scroll,LFoo;.foo:()V,1,90.0,9,7.0,3.0,50.0,21\n"
+      "Scroll,LFoo;.bar:()V,2,10.0,1,1.0,1.0,9.0,21\n")));
+
+  EXPECT_EQ(profiles.all_interactions().size(), 2);
+  const auto& cold_start = profiles.method_stats();
+  ASSERT_EQ(cold_start.count(m_foo), 1);
+  EXPECT_EQ(cold_start.at(m_foo).call_count, 2.0);
+  EXPECT_EQ(cold_start.at(m_foo).min_api_level, 21);
+
+  // bar appears too rarely to be kept.
+  const auto& scroll = profiles.method_stats("Scroll");
+  EXPECT_EQ(scroll.size(), 1);
+  EXPECT_EQ(scroll.at(m_foo).order_percent, 50.0);
+
+  EXPECT_TRUE(profiles.method_stats("Missing").empty());
+}
+
+TEST_F(MethodProfilesTest, missingColumn) {
+  MethodProfiles profiles;
+  EXPECT_FALSE(profiles.initialize(
+      write("index,name,appear100,appear#,avg_call,avg_order,avg_rank100\n")));
+  EXPECT_FALSE(profiles.has_stats());
+}
+
+TEST_F(MethodProfilesTest, binaryRoundTrip) {
+  MethodProfiles profiles;
+  ASSERT_TRUE(profiles.initialize(write(
+      "index,name,appear100,appear#,avg_call,avg_order,avg_rank100,"
+      "min_api_level\n"
+      "0,LFoo;.foo:()V,100.0,10,2.0,1.0,5.0,21\n"
+      "1,LFoo;.bar:()V,85.5,8,3.0,2.0,25.0,23\n")));
+  auto binary_path = m_path + ".bin";
+  ASSERT_TRUE(profiles.write_binary(binary_path));
+
+  MethodProfiles binary;
+  ASSERT_TRUE(binary.initialize(binary_path));
+  boost::filesystem::remove(binary_path);
+  const auto& stats = binary.method_stats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats.at(m_bar).appear_percent, 85.5);
+  EXPECT_EQ(stats.at(m_bar).call_count, 3.0);
+  EXPECT_EQ(stats.at(m_bar).order_percent, 25.0);
+  EXPECT_EQ(stats.at(m_bar).min_api_level, 23);
+  EXPECT_EQ(stats.at(m_foo).appear_percent, 100.0);
+}
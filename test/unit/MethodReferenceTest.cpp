@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "MethodReference.h"
+
+#include "IRAssembler.h"
+#include "InstructionIndex.h"
+#include "RedexTest.h"
+
+using namespace method_reference;
+
+struct MethodReferenceTest : public RedexTest {
+  Scope m_scope;
+  DexMethod* m_foo;
+  DexMethod* m_bar;
+  DexMethod* m_caller;
+
+  MethodReferenceTest() {
+    m_foo = assembler::method_from_string(R"(
+      (method (public static) "LA;.foo:()V"
+       ((return-void)))
+    )");
+    m_bar = assembler::method_from_string(R"(
+      (method (public static) "LA;.bar:(I)V"
+       ((return-void)))
+    )");
+    m_caller = assembler::method_from_string(R"(
+      (method (public static) "LA;.caller:()V"
+       (
+        (invoke-static () "LA;.foo:()V")
+        (invoke-static () "LA;.foo:()V")
+        (return-void)
+       )
+      )
+    )");
+    m_scope.push_back(
+        assembler::class_with_methods("LA;", {m_foo, m_bar, m_caller}));
+  }
+};
+
+TEST_F(MethodReferenceTest, collectAndPatchThroughIndex) {
+  InstructionIndex index(m_scope);
+  std::unordered_set<DexMethod*> callees{m_foo};
+  auto callsites = collect_call_refs(index, callees);
+  ASSERT_EQ(callsites.size(), 2);
+  EXPECT_EQ(callsites[0].caller, m_caller);
+  EXPECT_EQ(callsites[0].callee, m_foo);
+
+  std::unordered_map<DexMethod*, NewCallee> old_to_new{
+      {m_foo, NewCallee(m_bar, boost::optional<uint32_t>(7))}};
+  patch_callsites(callsites, old_to_new);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (const v0 7)
+      (invoke-static (v0) "LA;.bar:(I)V")
+      (const v1 7)
+      (invoke-static (v1) "LA;.bar:(I)V")
+      (return-void)
+    )
+  )");
+  EXPECT_CODE_EQ(m_caller->get_code(), expected.get());
+}
+
+TEST_F(MethodReferenceTest, updateCallRefsThroughIndex) {
+  auto baz = assembler::method_from_string(R"(
+    (method (public static) "LA;.baz:()V"
+     ((return-void)))
+  )");
+  m_scope.front()->add_method(baz);
+
+  InstructionIndex index(m_scope);
+  update_call_refs_simple(index, {{m_foo, baz}});
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (invoke-static () "LA;.baz:()V")
+      (invoke-static () "LA;.baz:()V")
+      (return-void)
+    )
+  )");
+  EXPECT_CODE_EQ(m_caller->get_code(), expected.get());
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "MethodSplitting.h"
+#include "RedexTest.h"
+
+class MethodSplittingTest : public RedexTest {};
+
+namespace {
+
+// Checks its argument, and builds the message of the exception it throws.
+const char* CHECK_BODY = R"(
+  (
+    (load-param v0)
+    (if-ltz v0 :bad)
+    (return v0)
+
+    (:bad)
+    (new-instance "Ljava/lang/IllegalArgumentException;")
+    (move-result-pseudo-object v1)
+    (new-instance "Ljava/lang/StringBuilder;")
+    (move-result-pseudo-object v2)
+    (invoke-direct (v2) "Ljava/lang/StringBuilder;.<init>:()V")
+    (const-string "negative: ")
+    (move-result-pseudo-object v3)
+    (invoke-virtual (v2 v3) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+    (invoke-virtual (v2 v0) "Ljava/lang/StringBuilder;.append:(I)Ljava/lang/StringBuilder;")
+    (invoke-virtual (v2) "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;")
+    (move-result-object v3)
+    (invoke-direct (v1 v3) "Ljava/lang/IllegalArgumentException;.<init>:(Ljava/lang/String;)V")
+    (throw v1)
+  )
+)";
+
+} // namespace
+
+TEST_F(MethodSplittingTest, splitThrowingPath) {
+  auto method = assembler::method_from_string(
+      std::string("(method (public static) \"LFoo;.check:(I)I\" ") +
+      CHECK_BODY + ")");
+  auto cold_methods = method_splitting::split_cold_blocks(method, 8);
+
+  ASSERT_EQ(1, cold_methods.size());
+  auto cold = cold_methods[0];
+  EXPECT_TRUE(is_static(cold));
+  EXPECT_TRUE(is_public(cold));
+  EXPECT_EQ("LFoo;.check$cold0:(I)Ljava/lang/Throwable;", show(cold));
+
+  auto expected_hot = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-ltz v0 :bad)
+      (return v0)
+
+      (:bad)
+      (invoke-static (v0) "LFoo;.check$cold0:(I)Ljava/lang/Throwable;")
+      (move-result-object v4)
+      (throw v4)
+    )
+  )");
+  EXPECT_CODE_EQ(method->get_code(), expected_hot.get());
+
+  auto expected_cold = assembler::ircode_from_string(R"(
+    (
+      (load-param v4)
+      (move v0 v4)
+      (new-instance "Ljava/lang/IllegalArgumentException;")
+      (move-result-pseudo-object v1)
+      (new-instance "Ljava/lang/StringBuilder;")
+      (move-result-pseudo-object v2)
+      (invoke-direct (v2) "Ljava/lang/StringBuilder;.<init>:()V")
+      (const-string "negative: ")
+      (move-result-pseudo-object v3)
+      (invoke-virtual (v2 v3) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v2 v0) "Ljava/lang/StringBuilder;.append:(I)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v2) "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;")
+      (move-result-object v3)
+      (invoke-direct (v1 v3) "Ljava/lang/IllegalArgumentException;.<init>:(Ljava/lang/String;)V")
+      (throw v1)
+    )
+  )");
+  EXPECT_CODE_EQ(cold->get_code(), expected_cold.get());
+}
+
+TEST_F(MethodSplittingTest, keepSmallOrCaughtPaths) {
+  auto method = assembler::method_from_string(
+      std::string("(method (public static) \"LBar;.check:(I)I\" ") +
+      CHECK_BODY + ")");
+  EXPECT_TRUE(method_splitting::split_cold_blocks(method, 100).empty());
+
+  // Whatever the handler catches goes back to the hot code.
+  method = assembler::method_from_string(R"(
+    (method (public static) "LBaz;.check:(I)I"
+      (
+        (load-param v0)
+        (if-ltz v0 :bad)
+        (return v0)
+
+        (:bad)
+        (.try_start a)
+        (new-instance "Ljava/lang/IllegalArgumentException;")
+        (move-result-pseudo-object v1)
+        (invoke-direct (v1) "Ljava/lang/IllegalArgumentException;.<init>:()V")
+        (const v2 0)
+        (const v2 1)
+        (const v2 2)
+        (const v2 3)
+        (const v2 4)
+        (throw v1)
+        (.try_end a)
+
+        (.catch (a))
+        (const v0 0)
+        (return v0)
+      )
+    )
+  )");
+  EXPECT_TRUE(method_splitting::split_cold_blocks(method, 1).empty());
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Obfuscate.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Resolver.h"
+#include "Show.h"
+
+namespace {
+
+constexpr size_t NUM_HIERARCHIES = 20;
+constexpr size_t DEPTH = 5;
+
+} // namespace
+
+class ObfuscateTest : public RedexTest {
+ protected:
+  /*
+   * Obfuscates chains of subclasses in a fresh context, and returns the
+   * members of all the classes, in scope order. Each class has fields and
+   * direct methods of its own, and overrides the virtual method of its
+   * superclass. The last class reads the fields of its chain through refs
+   * to itself, which get rewritten to the renamed defs.
+   */
+  std::vector<std::string> obfuscate_members(RenameStats* stats) {
+    delete g_redex;
+    g_redex = new RedexContext();
+
+    Scope scope;
+    for (size_t h = 0; h < NUM_HIERARCHIES; ++h) {
+      auto super = type::java_lang_Object();
+      for (size_t d = 0; d < DEPTH; ++d) {
+        auto name = "LH" + std::to_string(h) + "_" + std::to_string(d) + ";";
+        ClassCreator creator(DexType::make_type(name.c_str()));
+        creator.set_super(super);
+        creator.set_access(ACC_PUBLIC);
+        for (size_t f = 0; f < 3; ++f) {
+          auto fname = "field" + std::to_string(d) + "_" + std::to_string(f);
+          creator.add_field(DexField::make_field(name + "." + fname + ":I")
+                                ->make_concrete(ACC_PUBLIC));
+        }
+        creator.add_field(DexField::make_field(name + ".count:I")
+                              ->make_concrete(ACC_PUBLIC | ACC_STATIC));
+        for (size_t m = 0; m < 2; ++m) {
+          creator.add_method(assembler::method_from_string(
+              "(method (private) \"" + name + ".helper" + std::to_string(m) +
+              ":()V\" ((load-param-object v0) (return-void)))"));
+        }
+        std::string body;
+        if (d == DEPTH - 1) {
+          for (size_t i = 0; i < DEPTH; ++i) {
+            body += " (iget v0 \"" + name + ".field" + std::to_string(i) +
+                    "_0:I\") (move-result-pseudo v1)";
+          }
+        }
+        creator.add_method(assembler::method_from_string(
+            "(method (public) \"" + name +
+            ".run:()V\" ((load-param-object v0)" + body + " (return-void)))"));
+        scope.push_back(creator.create());
+        super = scope.back()->get_type();
+      }
+    }
+
+    obfuscate(scope, *stats, ObfuscatePass::Config());
+
+    std::vector<std::string> members;
+    for (auto cls : scope) {
+      for (auto field : cls->get_ifields()) {
+        members.push_back(show(field));
+      }
+      for (auto field : cls->get_sfields()) {
+        members.push_back(show(field));
+      }
+      for (auto method : cls->get_dmethods()) {
+        members.push_back(show(method));
+      }
+      for (auto method : cls->get_vmethods()) {
+        members.push_back(show(method));
+        for (const auto& mie : InstructionIterable(method->get_code())) {
+          if (mie.insn->has_field()) {
+            members.push_back(show(mie.insn));
+          }
+        }
+      }
+    }
+    return members;
+  }
+};
+
+TEST_F(ObfuscateTest, namesAreDeterministic) {
+  RenameStats stats;
+  auto members = obfuscate_members(&stats);
+  EXPECT_EQ(stats.fields_renamed, stats.fields_total);
+  EXPECT_EQ(stats.dmethods_renamed, stats.dmethods_total);
+  EXPECT_GT(stats.vmethods_renamed, 0);
+
+  // The refs to the fields of the superclasses now refer to their renamed
+  // defs.
+  auto last = type_class(DexType::get_type("LH0_4;"));
+  for (const auto& mie :
+       InstructionIterable(last->get_vmethods().front()->get_code())) {
+    if (mie.insn->has_field()) {
+      auto field = resolve_field(mie.insn->get_field());
+      ASSERT_NE(field, nullptr);
+      EXPECT_EQ(field, mie.insn->get_field());
+    }
+  }
+
+  RenameStats other_stats;
+  EXPECT_EQ(obfuscate_members(&other_stats), members);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ObjectLayout.h"
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace object_layout;
+
+struct ObjectLayoutTest : public RedexTest {
+  Scope m_scope;
+  DexField* m_small;
+  DexField* m_medium;
+  DexField* m_unknown;
+
+  ObjectLayoutTest() {
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(type::java_lang_Object());
+    m_small = DexField::make_field("LFoo;.small:I")->make_concrete(ACC_PUBLIC);
+    m_medium =
+        DexField::make_field("LFoo;.medium:I")->make_concrete(ACC_PUBLIC);
+    m_unknown =
+        DexField::make_field("LFoo;.unknown:I")->make_concrete(ACC_PUBLIC);
+    for (auto field : {m_small, m_medium, m_unknown}) {
+      creator.add_field(field);
+    }
+    creator.add_method(assembler::method_from_string(R"(
+      (method (public) "LFoo;.set:(I)V"
+       (
+        (load-param-object v0)
+        (load-param v1)
+        (const v2 100)
+        (iput v2 v0 "LFoo;.small:I")
+        (const v2 1000)
+        (iput v2 v0 "LFoo;.medium:I")
+        (iput v1 v0 "LFoo;.unknown:I")
+        (iget v0 "LFoo;.small:I")
+        (move-result-pseudo v2)
+        (return-void)
+       )
+      )
+    )"));
+    m_scope.push_back(creator.create());
+  }
+};
+
+TEST_F(ObjectLayoutTest, narrowFields) {
+  auto narrowable = find_narrowable_fields(m_scope);
+  ASSERT_EQ(narrowable.size(), 2);
+  EXPECT_EQ(narrowable.at(m_small), type::_byte());
+  EXPECT_EQ(narrowable.at(m_medium), type::_short());
+
+  narrow_fields(m_scope, narrowable);
+  EXPECT_EQ(m_small->get_type(), type::_byte());
+  EXPECT_EQ(m_medium->get_type(), type::_short());
+  EXPECT_EQ(m_unknown->get_type(), type::_int());
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param-object v0)
+      (load-param v1)
+      (const v2 100)
+      (iput-byte v2 v0 "LFoo;.small:B")
+      (const v2 1000)
+      (iput-short v2 v0 "LFoo;.medium:S")
+      (iput v1 v0 "LFoo;.unknown:I")
+      (iget-byte v0 "LFoo;.small:B")
+      (move-result-pseudo v2)
+      (return-void)
+    )
+  )");
+  auto method = m_scope.front()->get_vmethods().front();
+  EXPECT_CODE_EQ(method->get_code(), expected.get());
+}
+
+TEST_F(ObjectLayoutTest, onlyNarrowValuesTypedNarrower) {
+  ClassCreator creator(DexType::make_type("LBar;"));
+  creator.set_super(type::java_lang_Object());
+  std::vector<DexField*> fields;
+  for (auto name : {"folded", "refined", "converted", "moved"}) {
+    fields.push_back(
+        DexField::make_field(std::string("LBar;.") + name + ":I")
+            ->make_concrete(ACC_PUBLIC));
+    creator.add_field(fields.back());
+  }
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public) "LBar;.set:(I)V"
+     (
+      (load-param-object v0)
+      (load-param v1)
+      (const v2 1)
+      (add-int/lit8 v2 v2 1)
+      (iput v2 v0 "LBar;.folded:I")
+      (if-nez v1 :skip)
+      (iput v1 v0 "LBar;.refined:I")
+      (:skip)
+      (int-to-byte v2 v1)
+      (iput v2 v0 "LBar;.converted:I")
+      (const v2 7)
+      (move v3 v2)
+      (iput v3 v0 "LBar;.moved:I")
+      (return-void)
+     )
+    )
+  )"));
+  Scope scope{creator.create()};
+
+  // The verifier types the results of arithmetic and the values of refined
+  // registers as int, whatever their range.
+  auto narrowable = find_narrowable_fields(scope);
+  EXPECT_EQ(narrowable.size(), 2);
+  EXPECT_EQ(narrowable.count(fields[0]), 0);
+  EXPECT_EQ(narrowable.count(fields[1]), 0);
+  EXPECT_EQ(narrowable.at(fields[2]), type::_byte());
+  EXPECT_EQ(narrowable.at(fields[3]), type::_byte());
+}
+
+TEST_F(ObjectLayoutTest, orderHotFields) {
+  // In field id order: medium, small, unknown.
+  std::unordered_map<DexField*, double> heat{{m_unknown, 10}, {m_small, 5}};
+  EXPECT_EQ(order_hot_fields(m_scope, heat), 2);
+  EXPECT_EQ(m_unknown->str(), "$0$unknown");
+  EXPECT_EQ(m_small->str(), "$1$small");
+  EXPECT_EQ(m_medium->str(), "medium");
+
+  // The hot fields come first now, so there's nothing left to do.
+  EXPECT_EQ(order_hot_fields(m_scope, heat), 0);
+}
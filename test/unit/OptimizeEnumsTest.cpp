@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/optional/optional_io.hpp>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -659,3 +660,47 @@ TEST_F(OptimizeEnumsTest, test_param_summary_generating) {
   EXPECT_EQ(summary4.returned_param, boost::none);
   EXPECT_TRUE(summary4.safe_params.empty());
 }
+
+TEST_F(OptimizeEnumsTest, test_param_summaries_of_callers) {
+  auto sink = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.sink:(Ljava/lang/Object;)V"
+      (
+        (load-param-object v0)
+        (return-void)
+      )
+    )
+  )");
+  auto forward = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.forward:(Ljava/lang/Object;)Ljava/lang/Object;"
+      (
+        (load-param-object v0)
+        (invoke-static (v0) "LFoo;.sink:(Ljava/lang/Object;)V")
+        (return-object v0)
+      )
+    )
+  )");
+  auto leak = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.leak:(Ljava/lang/Object;)V"
+      (
+        (load-param-object v0)
+        (invoke-static (v0) "LFoo;.forward:(Ljava/lang/Object;)Ljava/lang/Object;")
+        (move-result-object v0)
+        (check-cast v0 "Ljava/lang/Enum;")
+        (move-result-pseudo-object v0)
+        (return-void)
+      )
+    )
+  )");
+  // The call graph is built from the roots.
+  leak->rstate.set_root();
+  Scope scope{assembler::class_with_methods("LFoo;", {sink, forward, leak})};
+  auto override_graph = method_override_graph::build_graph(scope);
+  optimize_enums::SummaryMap summaries;
+  optimize_enums::calculate_param_summaries(scope, *override_graph,
+                                            &summaries);
+
+  EXPECT_THAT(summaries.at(sink).safe_params, UnorderedElementsAre(0));
+  EXPECT_THAT(summaries.at(forward).safe_params, UnorderedElementsAre(0));
+  EXPECT_EQ(summaries.at(forward).returned_param, boost::optional<uint16_t>(0));
+  EXPECT_EQ(summaries.count(leak), 0);
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointsToSolver.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace testing;
+
+namespace {
+
+PointsToVariable get_returned_variable(PointsToSemantics* semantics,
+                                       DexMethodRef* method) {
+  auto method_semantics = semantics->get_method_semantics(method);
+  EXPECT_TRUE(method_semantics);
+  for (const auto& action : (*method_semantics)->get_points_to_actions()) {
+    if (action.operation().is_return()) {
+      return action.src();
+    }
+  }
+  ADD_FAILURE() << "No return in " << show(method);
+  return PointsToVariable();
+}
+
+size_t get_invoke_index(PointsToSemantics* semantics, DexMethodRef* method) {
+  auto method_semantics = semantics->get_method_semantics(method);
+  EXPECT_TRUE(method_semantics);
+  const auto& actions = (*method_semantics)->get_points_to_actions();
+  for (size_t i = 0; i < actions.size(); ++i) {
+    if (actions[i].operation().is_invoke()) {
+      return i;
+    }
+  }
+  ADD_FAILURE() << "No invoke in " << show(method);
+  return 0;
+}
+
+std::vector<std::string> get_strings(
+    const std::vector<const points_to::AbstractObject*>& objects) {
+  std::vector<std::string> strings;
+  for (const auto* object : objects) {
+    EXPECT_EQ(points_to::PTS_OBJECT_STRING, object->kind);
+    strings.push_back(object->string->str());
+  }
+  return strings;
+}
+
+} // namespace
+
+class PointsToSolverTest : public RedexTest {};
+
+TEST_F(PointsToSolverTest, fieldsAndArrays) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.run:()Ljava/lang/Object;"
+     (
+      (new-instance "LBox;")
+      (move-result-pseudo-object v0)
+      (new-instance "LBox;")
+      (move-result-pseudo-object v1)
+      (const-string "a")
+      (move-result-pseudo-object v2)
+      (iput-object v2 v0 "LBox;.val:Ljava/lang/Object;")
+      (const-string "b")
+      (move-result-pseudo-object v2)
+      (iput-object v2 v1 "LBox;.val:Ljava/lang/Object;")
+      (const v3 1)
+      (new-array v3 "[Ljava/lang/Object;")
+      (move-result-pseudo-object v4)
+      (const v3 0)
+      (iget-object v0 "LBox;.val:Ljava/lang/Object;")
+      (move-result-pseudo-object v5)
+      (aput-object v5 v4 v3)
+      (aget-object v4 v3)
+      (move-result-pseudo-object v6)
+      (return-object v6)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {method})};
+  PointsToSemantics semantics(scope);
+  points_to::PointsToSolver solver(&semantics);
+  solver.run();
+
+  EXPECT_TRUE(solver.is_complete());
+  // Both boxes are allocated in the same method, so they are the same
+  // abstract object.
+  EXPECT_THAT(get_strings(solver.get_points_to_set(
+                  method, get_returned_variable(&semantics, method))),
+              UnorderedElementsAre("a", "b"));
+}
+
+TEST_F(PointsToSolverTest, virtualDispatch) {
+  auto base_make = assembler::method_from_string(R"(
+    (method (public) "LBase;.make:()Ljava/lang/Object;"
+     (
+      (load-param-object v0)
+      (const-string "base")
+      (move-result-pseudo-object v1)
+      (return-object v1)
+     )
+    )
+  )");
+  auto derived_make = assembler::method_from_string(R"(
+    (method (public) "LDerived;.make:()Ljava/lang/Object;"
+     (
+      (load-param-object v0)
+      (const-string "derived")
+      (move-result-pseudo-object v1)
+      (return-object v1)
+     )
+    )
+  )");
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.run:()Ljava/lang/Object;"
+     (
+      (new-instance "LDerived;")
+      (move-result-pseudo-object v0)
+      (check-cast v0 "LBase;")
+      (move-result-pseudo-object v0)
+      (invoke-virtual (v0) "LBase;.make:()Ljava/lang/Object;")
+      (move-result-object v1)
+      (return-object v1)
+     )
+    )
+  )");
+  auto base = assembler::class_with_methods("LBase;", {base_make});
+  ClassCreator creator(DexType::make_type("LDerived;"));
+  creator.set_super(base->get_type());
+  creator.add_method(derived_make);
+  Scope scope{base, creator.create(),
+              assembler::class_with_methods("LFoo;", {caller})};
+  PointsToSemantics semantics(scope);
+  points_to::PointsToSolver solver(&semantics);
+  solver.run();
+
+  EXPECT_TRUE(solver.is_complete());
+  EXPECT_THAT(get_strings(solver.get_points_to_set(
+                  caller, get_returned_variable(&semantics, caller))),
+              UnorderedElementsAre("derived"));
+  EXPECT_THAT(solver.get_callees(caller, get_invoke_index(&semantics, caller)),
+              UnorderedElementsAre(derived_make));
+  EXPECT_THAT(solver.get_dynamic_types(
+                  derived_make, PointsToVariable::this_variable()),
+              UnorderedElementsAre(DexType::get_type("LDerived;")));
+}
+
+TEST_F(PointsToSolverTest, memoryCap) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.run:()Ljava/lang/Object;"
+     (
+      (const-string "a")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LFoo;", {method})};
+  PointsToSemantics semantics(scope);
+  points_to::PointsToSolver::Config config;
+  config.max_points_to_facts = 0;
+  points_to::PointsToSolver solver(&semantics, config);
+  solver.run();
+
+  EXPECT_FALSE(solver.is_complete());
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PriorityThreadPool.h"
+
+#include <atomic>
+#include <future>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <vector>
+
+TEST(PriorityThreadPoolTest, highestPriorityFirst) {
+  PriorityThreadPool pool(1);
+  std::promise<void> posted;
+  auto posted_future = posted.get_future().share();
+  std::mutex order_mutex;
+  std::vector<int> order;
+  // Keep the only thread busy until everything is posted.
+  pool.post(0, [posted_future]() { posted_future.wait(); });
+  for (int priority : {1, 5, -3, 5, 2}) {
+    pool.post(priority, [&, priority]() {
+      std::lock_guard<std::mutex> lock(order_mutex);
+      order.push_back(priority);
+    });
+  }
+  posted.set_value();
+  pool.join();
+
+  EXPECT_EQ((std::vector<int>{5, 5, 2, 1, -3}), order);
+  auto stats = pool.get_stats();
+  EXPECT_EQ(6, stats.work_items);
+  EXPECT_GE(stats.total_queue_seconds, stats.max_queue_seconds);
+}
+
+TEST(PriorityThreadPoolTest, postFromWorkItems) {
+  PriorityThreadPool pool(4);
+  std::atomic<size_t> count{0};
+  for (int i = 0; i < 100; ++i) {
+    pool.post(i % 7, [&pool, &count, i]() {
+      ++count;
+      if (i % 10 == 0) {
+        pool.post(-i, [&count]() { ++count; });
+      }
+    });
+  }
+  pool.join();
+  EXPECT_EQ(110, count);
+}
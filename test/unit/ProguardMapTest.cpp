@@ -7,6 +7,8 @@
 
 #include "ProguardMap.h"
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <sstream>
@@ -77,6 +79,42 @@ TEST_F(ProguardMapTest, empty) {
   EXPECT_EQ(false, pm.is_special_interface("Lcom/not/Found;"));
 }
 
+TEST_F(ProguardMapTest, MappedFile) {
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+  {
+    std::ofstream os(path);
+    // The last line has no newline.
+    os << "com.foo.bar -> A:\n"
+          "    int do1 -> a\n"
+          "    int do2 -> a\n"
+          "    3:3:void <init>() -> <init>\n"
+          "    1:1:com.foo.bar copy(com.foo.bar) -> b";
+  }
+  {
+    ProguardMap pm(path);
+    EXPECT_FALSE(pm.empty());
+    EXPECT_EQ("LA;", pm.translate_class("Lcom/foo/bar;"));
+    EXPECT_EQ("LA;.a:I", pm.translate_field("Lcom/foo/bar;.do1:I"));
+    // The last mapping of a name wins.
+    EXPECT_EQ("Lcom/foo/bar;.do2:I", pm.deobfuscate_field("LA;.a:I"));
+    EXPECT_EQ("LA;.b:(LA;)LA;",
+              pm.translate_method("Lcom/foo/bar;.copy:(Lcom/foo/bar;)Lcom/foo/"
+                                  "bar;"));
+    EXPECT_EQ("Lcom/foo/bar;.copy:(Lcom/foo/bar;)Lcom/foo/bar;",
+              pm.deobfuscate_method("LA;.b:(LA;)LA;"));
+    EXPECT_EQ("Lcom/foo/bar;.copy:(Lcom/foo/bar;)Lcom/foo/bar;",
+              pm.deobfuscate_method("LA;.b:(LA;)"));
+    EXPECT_EQ("LA;.c:()V", pm.deobfuscate_method("LA;.c:()V"));
+    EXPECT_THAT(pm.method_lines("LA;.<init>:()V"),
+                AllOf(SizeIs(1),
+                      UnorderedElementsAre(Pointee(ProguardLineRange(
+                          3, 3, 0, 0, "Lcom/foo/bar;.<init>:()V")))));
+  }
+  boost::filesystem::remove(path);
+}
+
 TEST_F(ProguardMapTest, HandlesGeneratedComments) {
   std::stringstream ss(
       "# compiler: R8\n"
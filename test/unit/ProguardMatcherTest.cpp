@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "ProguardConfiguration.h"
+#include "ProguardMap.h"
+#include "ProguardMatcher.h"
+#include "ProguardParser.h"
+#include "RedexTest.h"
+#include "ReachableClasses.h"
+
+using namespace keep_rules;
+
+class ProguardMatcherTest : public RedexTest {
+ public:
+  DexClass* make_class(const std::string& name) {
+    auto type = DexType::make_type(name.c_str());
+    ClassCreator creator(type);
+    creator.set_super(type::java_lang_Object());
+    creator.set_access(ACC_PUBLIC);
+    auto method =
+        DexMethod::make_method(name + ".run:()V")
+            ->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+    method->set_deobfuscated_name(show(method));
+    creator.add_method(method);
+    auto field = DexField::make_field(name + ".count:I")
+                     ->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    field->set_deobfuscated_name(show(field));
+    creator.add_field(field);
+    auto cls = creator.create();
+    cls->set_deobfuscated_name(name);
+    return cls;
+  }
+
+  void process(const std::string& rules, const Scope& scope) {
+    ProguardConfiguration pg_config;
+    std::istringstream config(rules);
+    proguard_parser::parse(config, &pg_config);
+    ASSERT_TRUE(pg_config.ok);
+    std::istringstream empty_map("");
+    ProguardMap pg_map(empty_map);
+    process_proguard_rules(pg_map, scope, {}, pg_config,
+                           /* keep_all_annotation_classes */ false);
+  }
+};
+
+TEST_F(ProguardMatcherTest, wildcardClassNames) {
+  auto a = make_class("Lcom/foo/A;");
+  auto b = make_class("Lcom/foo/bar/B;");
+  auto c = make_class("Lcom/other/C;");
+  auto d = make_class("Lcom/other/sub/D;");
+  auto e = make_class("Lorg/E;");
+  process(R"(
+    -keep class com.foo.* { public void run(); }
+    -keep class com.other.** { int count; }
+  )",
+          {a, b, c, d, e});
+
+  EXPECT_TRUE(impl::KeepState::has_keep(a));
+  EXPECT_TRUE(impl::KeepState::has_keep(a->get_dmethods()[0]));
+  EXPECT_FALSE(impl::KeepState::has_keep(a->get_sfields()[0]));
+  // A single * does not cross packages.
+  EXPECT_FALSE(impl::KeepState::has_keep(b));
+  EXPECT_FALSE(impl::KeepState::has_keep(b->get_dmethods()[0]));
+
+  for (auto cls : {c, d}) {
+    EXPECT_TRUE(impl::KeepState::has_keep(cls));
+    EXPECT_FALSE(impl::KeepState::has_keep(cls->get_dmethods()[0]));
+    EXPECT_TRUE(impl::KeepState::has_keep(cls->get_sfields()[0]));
+  }
+  EXPECT_FALSE(impl::KeepState::has_keep(e));
+}
+
+TEST_F(ProguardMatcherTest, wildcardMembers) {
+  auto a = make_class("Lcom/foo/A;");
+  auto b = make_class("Lorg/B;");
+  process(R"(
+    -keepclasseswithmembers class ** { *** ru?(...); }
+    -keep class org.* { ** count; }
+  )",
+          {a, b});
+
+  for (auto cls : {a, b}) {
+    EXPECT_TRUE(impl::KeepState::has_keep(cls));
+    EXPECT_TRUE(impl::KeepState::has_keep(cls->get_dmethods()[0]));
+  }
+  EXPECT_FALSE(impl::KeepState::has_keep(a->get_sfields()[0]));
+  // ** does not match primitive types.
+  EXPECT_FALSE(impl::KeepState::has_keep(b->get_sfields()[0]));
+}
+
+TEST_F(ProguardMatcherTest, manyClasses) {
+  // Enough classes for a rule to be split across several work items.
+  Scope scope;
+  for (size_t i = 0; i < 3000; ++i) {
+    scope.push_back(make_class("Lcom/many/C" + std::to_string(i) + ";"));
+  }
+  auto other = make_class("Lcom/other/C;");
+  scope.push_back(other);
+  process("-keep class com.many.** { int count; }", scope);
+
+  for (size_t i = 0; i < 3000; ++i) {
+    EXPECT_TRUE(impl::KeepState::has_keep(scope[i]));
+    EXPECT_TRUE(impl::KeepState::has_keep(scope[i]->get_sfields()[0]));
+  }
+  EXPECT_FALSE(impl::KeepState::has_keep(other));
+}
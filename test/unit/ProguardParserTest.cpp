@@ -7,6 +7,8 @@
 
 #include <gtest/gtest.h>
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <istream>
 #include <vector>
 
@@ -795,3 +797,31 @@ TEST(ProguardParserTest, remove_blacklisted_rules) {
     EXPECT_EQ(config.keep_rules.size(), 2);
   }
 }
+
+// The included files get parsed in the order in which they are first included.
+TEST(ProguardParserTest, include_files) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directory(dir);
+  auto write = [&](const std::string& name, const std::string& contents) {
+    std::ofstream os((dir / name).string());
+    os << contents;
+    return (dir / name).string();
+  };
+  auto c = write("c.pro", "-libraryjars /c.jar\n");
+  auto b = write("b.pro", "-libraryjars /b.jar\n");
+  auto a = write(
+      "a.pro", "-include " + c + "\n-include " + b + "\n-libraryjars /a.jar\n");
+  auto main = write("main.pro",
+                    "-include " + a + "\n-include " + b +
+                        "\n-libraryjars /main.jar\n");
+
+  ProguardConfiguration config;
+  proguard_parser::parse_file(main, &config);
+  boost::filesystem::remove_all(dir);
+  ASSERT_TRUE(config.ok);
+  EXPECT_EQ(config.libraryjars,
+            std::vector<std::string>(
+                {"/main.jar", "/a.jar", "/b.jar", "/c.jar"}));
+  EXPECT_EQ(config.already_included, std::set<std::string>({a, b, c}));
+}
@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 #include <map>
 #include <string>
@@ -46,3 +48,59 @@ TEST(RedexResources, ReadXmlTagsAndAttributes) {
   auto no_ns_vals = multimap_values_to_set(attribute_values, "onClick");
   EXPECT_EQ(no_ns_vals.size(), 0);
 }
+
+TEST(RedexResources, CollectLayoutsWithCache) {
+  namespace fs = boost::filesystem;
+  auto apk_dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(apk_dir / "res" / "layout");
+  fs::create_directories(apk_dir / "res" / "layout-land");
+  fs::copy_file(std::getenv("test_layout_path"),
+                apk_dir / "res" / "layout" / "test.xml");
+  fs::copy_file(std::getenv("test_layout_path"),
+                apk_dir / "res" / "layout-land" / "test.xml");
+  auto cache_path = (apk_dir / "layouts.cache").string();
+
+  std::unordered_set<std::string> attributes_to_find{"android:onClick"};
+  auto num_values = [&]() {
+    std::unordered_set<std::string> classes;
+    std::unordered_multimap<std::string, std::string> attribute_values;
+    collect_layout_classes_and_attributes_for_file(
+        std::getenv("test_layout_path"), attributes_to_find, classes,
+        attribute_values);
+    return attribute_values.size();
+  };
+  auto expected_values = num_values();
+  auto collect = [&](std::unordered_set<std::string>* classes) {
+    std::unordered_multimap<std::string, std::string> attribute_values;
+    collect_layout_classes_and_attributes(apk_dir.string(), attributes_to_find,
+                                          *classes, attribute_values,
+                                          cache_path);
+    // Both layouts contribute their values.
+    EXPECT_EQ(2 * expected_values, attribute_values.size());
+  };
+
+  std::unordered_set<std::string> classes;
+  collect(&classes);
+  EXPECT_EQ(3, classes.size());
+
+  // Tamper with the cache: the layouts didn't change, so the scans of the
+  // previous run get reused.
+  auto cache = read_entire_file(cache_path);
+  boost::replace_all(cache, "CustomButton", "CachedButton");
+  write_entire_file(cache_path, cache);
+  classes.clear();
+  collect(&classes);
+  EXPECT_EQ(1, classes.count("Lcom/example/test/CachedButton;"));
+  EXPECT_EQ(0, classes.count("Lcom/example/test/CustomButton;"));
+
+  // A cache for other attributes is ignored.
+  attributes_to_find.emplace("android:text");
+  classes.clear();
+  std::unordered_multimap<std::string, std::string> attribute_values;
+  collect_layout_classes_and_attributes(apk_dir.string(), attributes_to_find,
+                                        classes, attribute_values, cache_path);
+  EXPECT_EQ(1, classes.count("Lcom/example/test/CustomButton;"));
+  EXPECT_EQ(2 * num_values(), attribute_values.size());
+
+  fs::remove_all(apk_dir);
+}
@@ -338,3 +338,149 @@ TEST_F(ReduceArrayLiteralsTest, conditional_escape) {
   const auto& expected_str = code_str;
   test(code_str, expected_str, 0, 0);
 }
+
+// The assembler doesn't support fill-array-data, so these tests look at the
+// instructions directly.
+std::unique_ptr<IRCode> test_fill_array_data(const std::string& code_str,
+                                             size_t expected_arrays,
+                                             size_t expected_elements) {
+  auto code = assembler::ircode_from_string(code_str);
+  code->build_cfg(/* editable */ true);
+  ReduceArrayLiterals ral(code->cfg(), 222, 24, Architecture::UNKNOWN);
+  ral.patch();
+  code->clear_cfg();
+  auto stats = ral.get_stats();
+
+  EXPECT_EQ(expected_arrays, stats.fill_array_data_arrays);
+  EXPECT_EQ(expected_elements, stats.fill_array_data_elements);
+  EXPECT_EQ(0, stats.filled_arrays);
+  return code;
+}
+
+std::vector<IRInstruction*> get_insns(IRCode* code) {
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(code)) {
+    insns.push_back(mie.insn);
+  }
+  return insns;
+}
+
+TEST_F(ReduceArrayLiteralsTest, int_array_fill_array_data) {
+  auto code = test_fill_array_data(R"(
+    (
+      (const v0 4)
+      (new-array v0 "[I")
+      (move-result-pseudo-object v1)
+      (const v0 0)
+      (const v2 100000)
+      (aput v2 v1 v0)
+      (const v0 1)
+      (const v2 -1)
+      (aput v2 v1 v0)
+      (const v0 2)
+      (const v2 7)
+      (aput v2 v1 v0)
+      (const v0 3)
+      (const v2 42)
+      (aput v2 v1 v0)
+      (return-object v1)
+    )
+  )",
+                                   1, 4);
+  auto insns = get_insns(code.get());
+  size_t aputs = 0;
+  IRInstruction* fill_array_data = nullptr;
+  for (auto insn : insns) {
+    if (is_aput(insn->opcode())) {
+      aputs++;
+    } else if (insn->opcode() == OPCODE_FILL_ARRAY_DATA) {
+      fill_array_data = insn;
+    }
+  }
+  EXPECT_EQ(0, aputs);
+  ASSERT_NE(nullptr, fill_array_data);
+  EXPECT_EQ(1, fill_array_data->src(0));
+  auto data = fill_array_data->get_data()->data();
+  EXPECT_EQ(4, data[0]); // element width
+  EXPECT_EQ(4, *(uint32_t*)(data + 1));
+  auto elements = (const int32_t*)(data + 3);
+  EXPECT_EQ(100000, elements[0]);
+  EXPECT_EQ(-1, elements[1]);
+  EXPECT_EQ(7, elements[2]);
+  EXPECT_EQ(42, elements[3]);
+  EXPECT_EQ(OPCODE_RETURN_OBJECT, insns.back()->opcode());
+}
+
+TEST_F(ReduceArrayLiteralsTest, byte_array_fill_array_data) {
+  auto code = test_fill_array_data(R"(
+    (
+      (const v0 4)
+      (new-array v0 "[B")
+      (move-result-pseudo-object v1)
+      (const v0 0)
+      (const v2 1)
+      (aput-byte v2 v1 v0)
+      (const v0 1)
+      (const v2 200)
+      (aput-byte v2 v1 v0)
+      (const v0 2)
+      (const v2 3)
+      (aput-byte v2 v1 v0)
+      (const v0 3)
+      (const v2 -4)
+      (aput-byte v2 v1 v0)
+      (return-object v1)
+    )
+  )",
+                                   1, 4);
+  auto insns = get_insns(code.get());
+  IRInstruction* fill_array_data = nullptr;
+  for (auto insn : insns) {
+    EXPECT_FALSE(is_aput(insn->opcode()));
+    if (insn->opcode() == OPCODE_FILL_ARRAY_DATA) {
+      fill_array_data = insn;
+    }
+  }
+  ASSERT_NE(nullptr, fill_array_data);
+  auto data = fill_array_data->get_data()->data();
+  EXPECT_EQ(1, data[0]);
+  EXPECT_EQ(4, *(uint32_t*)(data + 1));
+  auto elements = (const int8_t*)(data + 3);
+  EXPECT_EQ(1, elements[0]);
+  EXPECT_EQ((int8_t)200, elements[1]);
+  EXPECT_EQ(3, elements[2]);
+  EXPECT_EQ(-4, elements[3]);
+}
+
+TEST_F(ReduceArrayLiteralsTest, fill_array_data_needs_literals) {
+  // the second value isn't known, and a single element isn't worth a payload
+  auto code = test_fill_array_data(R"(
+    (
+      (load-param v3)
+      (const v0 2)
+      (new-array v0 "[S")
+      (move-result-pseudo-object v1)
+      (const v0 0)
+      (const v2 1)
+      (aput-short v2 v1 v0)
+      (const v0 1)
+      (aput-short v3 v1 v0)
+      (const v0 1)
+      (new-array v0 "[C")
+      (move-result-pseudo-object v4)
+      (const v0 0)
+      (aput-char v2 v4 v0)
+      (return-object v1)
+    )
+  )",
+                                   0, 0);
+  auto insns = get_insns(code.get());
+  size_t aputs = 0;
+  for (auto insn : insns) {
+    EXPECT_NE(OPCODE_FILL_ARRAY_DATA, insn->opcode());
+    if (is_aput(insn->opcode())) {
+      aputs++;
+    }
+  }
+  EXPECT_EQ(3, aputs);
+}
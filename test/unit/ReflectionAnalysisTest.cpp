@@ -225,3 +225,32 @@ IOPCODE_MOVE_RESULT_PSEUDO_OBJECT v3 {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLEC
 INVOKE_VIRTUAL v2, v3, Ljava/lang/Class;.getField:(Ljava/lang/String;)Ljava/lang/reflect/Field; {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLECTION)}\n\
 MOVE_RESULT_OBJECT v4 {2, CLASS{Ljava/lang/Object;(LFoo;)}(REFLECTION);4294967294, FIELD{Ljava/lang/Object;(LFoo;):bar}}\n");
 }
+
+TEST_F(ReflectionAnalysisTest, sharedCache) {
+  auto insns = assembler::ircode_from_string(R"(
+    (
+      (const-string "S1")
+      (move-result-pseudo-object v1)
+    )
+  )");
+  add_code(insns);
+  ReflectionAnalysisCache cache;
+  auto analysis = cache.get(m_method);
+  EXPECT_FALSE(analysis->has_found_reflection());
+  EXPECT_EQ(1, cache.skipped());
+  EXPECT_EQ(analysis, cache.get(m_method));
+  EXPECT_EQ(1, cache.hits());
+
+  // Changing the code invalidates the entry.
+  auto more_insns = assembler::ircode_from_string(R"(
+    (
+      (const-class "LFoo;")
+      (move-result-pseudo-object v1)
+    )
+  )");
+  add_code(more_insns);
+  auto new_analysis = cache.get(m_method);
+  EXPECT_NE(analysis, new_analysis);
+  EXPECT_TRUE(new_analysis->has_found_reflection());
+  EXPECT_EQ(1, cache.misses());
+}
@@ -315,6 +315,26 @@ TEST_F(RegAllocTest, BuildInterferenceGraph) {
   }
 }
 
+TEST_F(RegAllocTest, AdjacencyMatrix) {
+  using namespace interference::impl;
+  AdjacencyMatrix matrix;
+  matrix.use_dense_storage(4);
+  // Both the dense part and the sparse spill-over behave the same.
+  for (auto pair : {std::make_pair(1u, 3u), std::make_pair(2u, 7u)}) {
+    auto u = pair.first;
+    auto v = pair.second;
+    EXPECT_FALSE(matrix.contains(u, v));
+    matrix.add(u, v, /* can_coalesce */ true);
+    EXPECT_TRUE(matrix.contains(v, u));
+    EXPECT_TRUE(matrix.is_coalesceable(v, u));
+    matrix.add(v, u, /* can_coalesce */ false);
+    matrix.add(u, v, /* can_coalesce */ true);
+    EXPECT_FALSE(matrix.is_coalesceable(u, v));
+  }
+  EXPECT_FALSE(matrix.contains(0, 3));
+  EXPECT_FALSE(matrix.contains(1, 2));
+}
+
 TEST_F(RegAllocTest, CombineNonAdjacentNodes) {
   using namespace interference::impl;
   auto ig = GraphBuilder::create_empty();
@@ -1017,3 +1037,90 @@ TEST_F(RegAllocTest, NoOverwriteThis) {
 )");
   EXPECT_CODE_EQ(expected_code.get(), method->get_code());
 }
+
+TEST_F(RegAllocTest, LinearScan) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)Z"
+     (
+      (load-param v4)
+      (const-wide v0 0)
+      (move-wide v2 v0)
+      (cmp-long v1 v0 v2)
+      (add-int v1 v1 v4)
+      (return v1)
+     )
+    )
+)");
+  method->get_code()->set_registers_size(5);
+
+  graph_coloring::Allocator::Config config;
+  auto stats = RegAllocPass::allocate(config, method, /* try_linear_scan */
+                                      true);
+  EXPECT_EQ(1, stats.linear_scan_methods);
+  EXPECT_EQ(0, stats.moves_coalesced);
+
+  // The dest of the cmp-long can't reuse the wide srcs, and the param gets
+  // its own register at the end of the frame.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (load-param v5)
+     (const-wide v0 0)
+     (move-wide v2 v0)
+     (cmp-long v4 v0 v2)
+     (add-int v0 v4 v5)
+     (return v0)
+    )
+)");
+  EXPECT_CODE_EQ(expected_code.get(), method->get_code());
+  EXPECT_EQ(6, method->get_code()->get_registers_size());
+}
+
+TEST_F(RegAllocTest, LinearScanCoalescesMoves) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()I"
+     (
+      (const v0 1)
+      (move v1 v0)
+      (return v1)
+     )
+    )
+)");
+  method->get_code()->set_registers_size(2);
+
+  graph_coloring::Allocator::Config config;
+  auto stats = RegAllocPass::allocate(config, method, /* try_linear_scan */
+                                      true);
+  EXPECT_EQ(1, stats.linear_scan_methods);
+  EXPECT_EQ(1, stats.moves_coalesced);
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 1)
+     (return v0)
+    )
+)");
+  EXPECT_CODE_EQ(expected_code.get(), method->get_code());
+}
+
+TEST_F(RegAllocTest, LinearScanFallsBackOnRanges) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (const v0 0)
+      (const v1 1)
+      (const v2 2)
+      (const v3 3)
+      (const v4 4)
+      (const v5 5)
+      (invoke-static (v0 v1 v2 v3 v4 v5) "LFoo;.baz:(IIIIII)V")
+      (return-void)
+     )
+    )
+)");
+  method->get_code()->set_registers_size(6);
+
+  graph_coloring::Allocator::Config config;
+  auto stats = RegAllocPass::allocate(config, method, /* try_linear_scan */
+                                      true);
+  EXPECT_EQ(0, stats.linear_scan_methods);
+}
@@ -245,3 +245,43 @@ TEST_F(RemoveUnusedArgsTest, multipleBlocksMixedArgs) {
   EXPECT_THAT(live_arg_idxs, ::testing::ElementsAre(0, 1, 2, 3));
   EXPECT_THAT(dead_insns.size(), 0);
 }
+
+// Checks that the call index tells which callees lose their result uses
+TEST_F(RemoveUnusedArgsTest, callIndexUpdate) {
+  auto callee = assembler::method_from_string(R"(
+    (method (public static) "LB;.callee:()I"
+      (
+        (const v0 0)
+        (return v0)
+      )
+    )
+  )");
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LB;.caller:()V"
+      (
+        (invoke-static () "LB;.callee:()I")
+        (move-result v0)
+        (return-void)
+      )
+    )
+  )");
+  Scope scope{assembler::class_with_methods("LB;", {callee, caller})};
+
+  remove_unused_args::CallIndex call_index(scope);
+  EXPECT_TRUE(call_index.is_result_used(callee));
+  EXPECT_THAT(call_index.get_callers({callee}),
+              ::testing::ElementsAre(caller));
+
+  // Drop the move-result, as the caller's own iteration would.
+  auto code = caller->get_code();
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type == MFLOW_OPCODE &&
+        it->insn->opcode() == OPCODE_MOVE_RESULT) {
+      code->remove_opcode(it);
+      break;
+    }
+  }
+  auto updatable = call_index.update({caller});
+  EXPECT_FALSE(call_index.is_result_used(callee));
+  EXPECT_THAT(updatable, ::testing::UnorderedElementsAre(callee, caller));
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RenameClassesV2.h"
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Show.h"
+#include "locator.h"
+
+using facebook::Locator;
+
+namespace {
+
+constexpr size_t NUM_CLASSES = 300;
+
+std::string class_name(size_t i) {
+  // Every tenth class is in a package that isn't renamed.
+  return std::string(i % 10 == 9 ? "Lcom/test/keep/C" : "Lcom/test/C") +
+         std::to_string(i) + ";";
+}
+
+} // namespace
+
+class RenameClassesV2Test : public RedexTest {
+ protected:
+  /*
+   * Runs the pass on a fresh context and returns the names of the classes, in
+   * scope order. Every seventh class has its name in a string literal, which
+   * also keeps it from being renamed.
+   */
+  std::vector<std::string> rename() {
+    delete g_redex;
+    g_redex = new RedexContext();
+
+    DexStore store("classes");
+    std::vector<DexClass*> classes;
+    for (size_t i = 0; i < NUM_CLASSES; ++i) {
+      auto name = class_name(i);
+      ClassCreator creator(DexType::make_type(name.c_str()));
+      creator.set_super(type::java_lang_Object());
+      creator.set_access(ACC_PUBLIC);
+      if (i % 7 == 0) {
+        auto literal = java_names::internal_to_external(name);
+        creator.add_method(assembler::method_from_string(
+            "(method (public static) \"" + name +
+            ".name:()Ljava/lang/String;\" ((const-string \"" + literal +
+            "\") (move-result-pseudo-object v0) (return-object v0)))"));
+      }
+      classes.push_back(creator.create());
+    }
+    store.add_classes(classes);
+    DexStoresVector stores;
+    stores.emplace_back(std::move(store));
+
+    Json::Value pass_config;
+    pass_config["dont_rename_packages"].append("com/test/keep/");
+    RenameClassesPassV2 pass;
+    pass.parse_config(JsonWrapper(pass_config));
+    PassManager manager({&pass});
+    manager.set_testing_mode();
+    ConfigFiles conf(Json::nullValue);
+    manager.run_passes(stores, conf);
+
+    std::vector<std::string> names;
+    for (auto cls : classes) {
+      names.push_back(show(cls->get_type()));
+    }
+    return names;
+  }
+};
+
+TEST_F(RenameClassesV2Test, namesAreDeterministic) {
+  auto names = rename();
+  ASSERT_EQ(names.size(), NUM_CLASSES);
+  for (size_t i = 0; i < NUM_CLASSES; ++i) {
+    if (i % 10 == 9 || i % 7 == 0) {
+      EXPECT_EQ(names[i], class_name(i));
+    } else {
+      // Each renamed class is named after its index in the scope, whichever
+      // thread renamed it.
+      EXPECT_EQ(Locator::decodeGlobalClassIndex(names[i].c_str()), i)
+          << names[i];
+    }
+  }
+
+  EXPECT_EQ(rename(), names);
+}
@@ -184,6 +184,27 @@ TEST_F(RenamerTest, Override) {
   print_scope(scope);
 }
 
+/**
+ * Same hierarchy as above, where B.g() and E.g() are referenced the most,
+ * so they take the name of A.f() that B.f() would get otherwise.
+ */
+TEST_F(RenamerTest, OverrideWeighted) {
+  std::vector<DexClass*> scope = create_scope_2();
+  auto get_def = [](const char* name) {
+    return static_cast<DexMethod*>(DexMethod::get_method(name));
+  };
+  auto a_f = get_def("LA;.f:()V");
+  auto b_f = get_def("LB;.f:()V");
+  auto b_g = get_def("LB;.g:()V");
+  auto e_g = get_def("LE;.g:()V");
+  MemberWeights<DexMethod*> weights{{b_g, 1}, {e_g, 2}, {b_f, 2}};
+
+  EXPECT_EQ(5, rename_virtuals(scope, false, {}, &weights));
+  EXPECT_EQ(a_f->get_name(), b_g->get_name());
+  EXPECT_EQ(b_g->get_name(), e_g->get_name());
+  EXPECT_NE(b_f->get_name(), b_g->get_name());
+}
+
 /**
  * Simple class hierarchy with override and overload
  *
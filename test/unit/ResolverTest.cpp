@@ -225,3 +225,22 @@ TEST_F(ResolverTest, ResolveField) {
                             DexString::get_string("f1"),
                             DexType::get_type("I")) == nullptr);
 }
+
+TEST_F(ResolverTest, CachedResolutionFollowsChanges) {
+  create_scope();
+
+  auto b = DexType::get_type("B");
+  auto int_t = DexType::get_type("I");
+  auto fref = make_field_ref(DexType::get_type("C"), "f1", int_t);
+  auto a_f1 = resolve_field(fref);
+  ASSERT_NE(nullptr, a_f1);
+  EXPECT_EQ(DexType::get_type("A"), a_f1->get_class());
+  auto hits = g_redex->resolver_cache().hits();
+  EXPECT_EQ(a_f1, resolve_field(fref));
+  EXPECT_EQ(hits + 1, g_redex->resolver_cache().hits());
+
+  // A field of B now hides the one of A.
+  auto b_f1 = make_field_def(b, "f1", int_t);
+  type_class(b)->add_field(b_f1);
+  EXPECT_EQ(b_f1, resolve_field(fref));
+}
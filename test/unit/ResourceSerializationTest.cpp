@@ -6,6 +6,7 @@
  */
 
 #include <array>
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 
 #include "Debug.h"
@@ -188,6 +189,66 @@ TEST(ResStringPool, ReplaceStringsInXmlLayout) {
   unmap_and_close(file_descriptor, fp, length);
 }
 
+TEST(ResStringPool, RewriteXmlFiles) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  std::vector<std::string> paths;
+  for (const auto& name : {"a.xml", "b.xml"}) {
+    auto path = dir / name;
+    boost::filesystem::copy_file(std::getenv("test_layout_path"), path);
+    paths.push_back(path.string());
+  }
+
+  XmlFileEdits edits;
+  edits.class_renames.emplace("com.example.test.CustomViewGroup", "Z.a");
+  edits.class_renames.emplace("com.example.test.CustomButton", "Z.c");
+  android::Res_value inlined;
+  inlined.size = sizeof(android::Res_value);
+  inlined.res0 = 0;
+  inlined.dataType = android::Res_value::TYPE_INT_DEC;
+  inlined.data = 42;
+  edits.inline_values.emplace(0x7f0b005e, inlined);
+
+  auto stats = rewrite_xml_files(paths, edits);
+  EXPECT_EQ(2, stats.files_changed);
+  EXPECT_EQ(4, stats.strings_renamed);
+  EXPECT_EQ(2, stats.values_inlined);
+  EXPECT_LT(stats.size_delta, 0);
+
+  for (const auto& path : paths) {
+    std::vector<std::string> tags;
+    size_t num_inlined = 0;
+    auto contents = read_entire_file(path);
+    android::ResXMLTree parser;
+    parser.setTo(contents.data(), contents.size());
+    ASSERT_EQ(android::NO_ERROR, parser.getError());
+    android::ResXMLParser::event_code_t type;
+    do {
+      type = parser.next();
+      if (type == android::ResXMLParser::START_TAG) {
+        size_t len;
+        android::String8 tag(parser.getElementName(&len));
+        tags.emplace_back(tag.string());
+        for (size_t i = 0; i < parser.getAttributeCount(); ++i) {
+          android::Res_value value;
+          parser.getAttributeValue(i, &value);
+          if (value.dataType == android::Res_value::TYPE_INT_DEC &&
+              value.data == 42) {
+            num_inlined++;
+          }
+        }
+      }
+    } while (type != android::ResXMLParser::BAD_DOCUMENT &&
+             type != android::ResXMLParser::END_DOCUMENT);
+    std::vector<std::string> expected_tags{
+        "Z.a", "TextView", "com.example.test.CustomTextView", "Z.c", "Button"};
+    EXPECT_EQ(expected_tags, tags);
+    EXPECT_EQ(1, num_inlined);
+  }
+  boost::filesystem::remove_all(dir);
+}
+
 void assert_serialized_data(void* original,
                             size_t length,
                             android::Vector<char>& serialized) {
@@ -280,3 +341,39 @@ TEST(ResTable, AppendNewType) {
 
   unmap_and_close(file_descriptor, fp, length);
 }
+
+TEST(ResourcesArscFile, IndexAndGrow) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto path = (dir / "resources.arsc").string();
+  boost::filesystem::copy_file(std::getenv("test_arsc_path"), path);
+
+  size_t original_length;
+  {
+    ResourcesArscFile arsc(path);
+    EXPECT_EQ("test_value1", arsc.id_to_name.at(0x7f010000));
+    EXPECT_EQ(std::vector<uint32_t>{0x7f010001},
+              arsc.name_to_ids.at("test_value2"));
+    std::unordered_set<uint32_t> expected_ids{0x7f010000, 0x7f010001};
+    EXPECT_EQ(expected_ids,
+              get_resources_by_name_prefix({"test_", "test_value"},
+                                           arsc.name_to_ids));
+
+    // Serializing a bigger table grows the file past its mapping.
+    original_length = arsc.get_length();
+    android::ResTable_config config = {sizeof(android::ResTable_config)};
+    android::Vector<android::ResTable_config> config_vec;
+    config_vec.push(config);
+    android::Vector<uint32_t> source_ids;
+    source_ids.push_back(0x7f010000);
+    arsc.res_table.defineNewType(
+        android::String8("foo"), 3, config_vec, source_ids);
+    EXPECT_LT(original_length, arsc.serialize());
+  }
+
+  ResourcesArscFile grown(path);
+  EXPECT_LT(original_length, grown.get_length());
+  EXPECT_EQ("test_value1", grown.id_to_name.at(0x7f030000));
+  boost::filesystem::remove_all(dir);
+}
@@ -8,6 +8,7 @@
 #include <gtest/gtest.h>
 
 #include "ControlFlow.h"
+#include "Creators.h"
 #include "IRAssembler.h"
 #include "IRCode.h"
 #include "RedexTest.h"
@@ -176,3 +177,49 @@ TEST_F(ResultPropagationTest, return_receiver_of_framework_method) {
   )";
   test_get_return_param_index(code_str, 0);
 }
+
+TEST_F(ResultPropagationTest, summaries_follow_call_chains) {
+  ClassCreator creator(DexType::make_type("LCls;"));
+  creator.set_super(type::java_lang_Object());
+  auto identity = assembler::method_from_string(R"(
+    (method (public static) "LCls;.identity:(I)I"
+     (
+      (load-param v0)
+      (return v0)
+     )
+    )
+  )");
+  auto second = assembler::method_from_string(R"(
+    (method (public static) "LCls;.second:(II)I"
+     (
+      (load-param v0)
+      (load-param v1)
+      (invoke-static (v1) "LCls;.identity:(I)I")
+      (move-result v2)
+      (return v2)
+     )
+    )
+  )");
+  auto none = assembler::method_from_string(R"(
+    (method (public static) "LCls;.none:(I)I"
+     (
+      (load-param v0)
+      (const v0 1)
+      (return v0)
+     )
+    )
+  )");
+  for (auto method : {identity, second, none}) {
+    creator.add_method(method);
+  }
+  Scope scope{creator.create()};
+
+  ReturnParamSummaries summaries(scope);
+  const auto& returned = summaries.methods_which_return_parameter;
+  EXPECT_EQ(returned.size(), 2);
+  EXPECT_EQ(returned.at(identity), 0);
+  EXPECT_EQ(returned.at(second), 1);
+  EXPECT_EQ(returned.count(none), 0);
+  // One more iteration for the call chain, one to find nothing new.
+  EXPECT_EQ(summaries.iterations, 3);
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "ScalarReplacement.h"
+
+class ScalarReplacementTest : public RedexTest {
+ public:
+  void SetUp() override {
+    auto ctor = assembler::method_from_string(R"(
+      (method (public constructor) "LFoo;.<init>:(I)V"
+       (
+        (load-param-object v0)
+        (load-param v1)
+        (invoke-direct (v0) "Ljava/lang/Object;.<init>:()V")
+        (iput v1 v0 "LFoo;.x:I")
+        (const-wide v2 7)
+        (iput-wide v2 v0 "LFoo;.y:J")
+        (return-void)
+       )
+      )
+    )");
+    // The assembler makes all non-private instance methods virtual.
+    ctor->set_virtual(false);
+    auto cls = assembler::class_with_methods("LFoo;", {ctor});
+    for (const char* name : {"LFoo;.x:I", "LFoo;.y:J"}) {
+      auto field = DexField::make_field(name)->make_concrete(ACC_PUBLIC);
+      cls->add_field(field);
+    }
+    m_constructors = ScalarReplacementPass::find_simple_constructors({cls});
+  }
+
+  void test(const std::string& code_str,
+            const std::string& expected_str,
+            size_t expected_allocations_removed,
+            size_t expected_field_accesses_replaced,
+            size_t expected_constructor_calls_replaced) {
+    auto code = assembler::ircode_from_string(code_str);
+    auto expected = assembler::ircode_from_string(expected_str);
+
+    auto stats =
+        ScalarReplacementPass::process_code(code.get(), m_constructors);
+    EXPECT_EQ(expected_allocations_removed, stats.allocations_removed);
+    EXPECT_EQ(expected_field_accesses_replaced, stats.field_accesses_replaced);
+    EXPECT_EQ(expected_constructor_calls_replaced,
+              stats.constructor_calls_replaced);
+
+    printf("%s\n", assembler::to_string(code.get()).c_str());
+    EXPECT_CODE_EQ(code.get(), expected.get());
+  }
+
+ private:
+  ScalarReplacementPass::SimpleConstructors m_constructors;
+};
+
+TEST_F(ScalarReplacementTest, simple_constructor) {
+  const auto& code_str = R"(
+    (
+      (load-param v0)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+      (move-object v2 v1)
+      (iget v2 "LFoo;.x:I")
+      (move-result-pseudo v3)
+      (add-int/lit8 v3 v3 1)
+      (iput v3 v2 "LFoo;.x:I")
+      (iget v1 "LFoo;.x:I")
+      (move-result-pseudo v4)
+      (iget-wide v1 "LFoo;.y:J")
+      (move-result-pseudo-wide v5)
+      (return v4)
+    )
+  )";
+  const auto& expected_str = R"(
+    (
+      (load-param v0)
+      (const v1 0)
+      (const v7 0)
+      (const-wide v8 0)
+      (move v7 v0)
+      (const-wide v8 7)
+      (move-object v2 v1)
+      (move v3 v7)
+      (add-int/lit8 v3 v3 1)
+      (move v7 v3)
+      (move v4 v7)
+      (move-wide v5 v8)
+      (return v4)
+    )
+  )";
+  test(code_str, expected_str, 1, 4, 1);
+}
+
+TEST_F(ScalarReplacementTest, escapes_through_invoke) {
+  const auto& code_str = R"(
+    (
+      (load-param v0)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+      (invoke-static (v1) "LBar;.baz:(LFoo;)V")
+      (iget v1 "LFoo;.x:I")
+      (move-result-pseudo v2)
+      (return v2)
+    )
+  )";
+  test(code_str, code_str, 0, 0, 0);
+}
+
+TEST_F(ScalarReplacementTest, escapes_through_return) {
+  const auto& code_str = R"(
+    (
+      (load-param v0)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+      (return-object v1)
+    )
+  )";
+  test(code_str, code_str, 0, 0, 0);
+}
+
+TEST_F(ScalarReplacementTest, may_alias_other_object) {
+  const auto& code_str = R"(
+    (
+      (load-param v0)
+      (load-param-object v1)
+      (if-eqz v0 :skip)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+
+      (:skip)
+      (iget v1 "LFoo;.x:I")
+      (move-result-pseudo v2)
+      (return v2)
+    )
+  )";
+  test(code_str, code_str, 0, 0, 0);
+}
+
+TEST_F(ScalarReplacementTest, previous_object_is_live_in_loop) {
+  // The object of the previous iteration is still read after the next one is
+  // allocated.
+  const auto& code_str = R"(
+    (
+      (load-param v0)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+
+      (:loop)
+      (move-object v2 v1)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v1 v0) "LFoo;.<init>:(I)V")
+      (iget v2 "LFoo;.x:I")
+      (move-result-pseudo v3)
+      (if-eqz v3 :loop)
+      (return v3)
+    )
+  )";
+  test(code_str, code_str, 0, 0, 0);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "ScopeDelta.h"
+
+class ScopeDeltaTest : public RedexTest {};
+
+namespace {
+
+DexClass* make_class(const std::string& name) {
+  ClassCreator creator(DexType::make_type(DexString::make_string(name)));
+  creator.set_super(type::java_lang_Object());
+  creator.add_method(assembler::method_from_string(
+      "(method (public static) \"" + name +
+      ".m:()I\" ((const v0 1) (return v0)))"));
+  return creator.create();
+}
+
+} // namespace
+
+TEST_F(ScopeDeltaTest, diff) {
+  Scope scope{make_class("LA;"), make_class("LB;"), make_class("LC;")};
+  auto before = scope_delta::take_snapshot(scope, nullptr);
+  EXPECT_EQ(3, before.methods.size());
+
+  // Nothing changed.
+  auto delta = scope_delta::diff(
+      before, scope_delta::take_snapshot(scope, &before));
+  EXPECT_EQ(0, delta.methods_changed);
+  EXPECT_EQ(0, delta.instructions_added);
+  EXPECT_EQ(3, delta.registers);
+
+  // A changes, C is removed.
+  scope[0]->get_dmethods()[0]->set_code(assembler::ircode_from_string(
+      "((const v0 1) (const v1 2) (return v0))"));
+  scope.pop_back();
+  delta = scope_delta::diff(before, scope_delta::take_snapshot(scope, &before));
+  EXPECT_EQ(1, delta.methods_changed);
+  EXPECT_EQ(0, delta.methods_added);
+  EXPECT_EQ(1, delta.methods_removed);
+  EXPECT_EQ(1, delta.classes_removed);
+  EXPECT_EQ(1, delta.instructions_added);
+  EXPECT_EQ(2, delta.instructions_removed);
+  EXPECT_EQ(3, delta.registers);
+}
+
+TEST_F(ScopeDeltaTest, pendingCodeIsCarriedOver) {
+  Scope scope{make_class("LA;")};
+  auto method = scope[0]->get_dmethods()[0];
+  auto before = scope_delta::take_snapshot(scope, nullptr);
+
+  method->sync();
+  method->balloon_lazily();
+  ASSERT_TRUE(method->is_balloon_pending());
+  auto after = scope_delta::take_snapshot(scope, &before);
+  EXPECT_EQ(before.methods.at(method).code_hash,
+            after.methods.at(method).code_hash);
+
+  // There's nothing to compare to when the code was never ballooned.
+  auto fresh = scope_delta::take_snapshot(scope, nullptr);
+  EXPECT_TRUE(fresh.methods.at(method).unknown);
+  method->get_code();
+  EXPECT_EQ(0,
+            scope_delta::diff(fresh, scope_delta::take_snapshot(scope, &fresh))
+                .methods_changed);
+}
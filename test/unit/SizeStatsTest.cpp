@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "SizeStats.h"
+
+class SizeStatsTest : public RedexTest {};
+
+namespace {
+
+DexClass* make_class(const std::string& name) {
+  ClassCreator creator(DexType::make_type(DexString::make_string(name)));
+  creator.set_super(type::java_lang_Object());
+  creator.add_method(assembler::method_from_string(
+      "(method (public static) \"" + name +
+      ".m:()Ljava/lang/String;\" ((const-string \"hello\") "
+      "(move-result-pseudo-object v0) (return-object v0)))"));
+  return creator.create();
+}
+
+} // namespace
+
+TEST_F(SizeStatsTest, sample) {
+  Scope scope{make_class("LA;"), make_class("LB;")};
+  size_stats::Tracker tracker;
+  auto before = tracker.sample(scope);
+  EXPECT_EQ(2, before.classes);
+  EXPECT_EQ(2, before.methods);
+  EXPECT_EQ(0, before.fields);
+  EXPECT_EQ(4, before.instructions);
+  // Both methods load the same string.
+  EXPECT_EQ(1, before.code_strings);
+  EXPECT_GT(before.estimated_dex_bytes, 0);
+
+  // A new version of the code of A gets measured again, B is removed.
+  scope[0]->get_dmethods()[0]->set_code(assembler::ircode_from_string(
+      "((const-string \"bye\") (move-result-pseudo-object v0) "
+      "(const v1 0) (return-object v0))"));
+  scope.pop_back();
+  auto after = tracker.sample(scope);
+  EXPECT_EQ(1, after.classes);
+  EXPECT_EQ(1, after.methods);
+  EXPECT_EQ(3, after.instructions);
+  EXPECT_EQ(1, after.code_strings);
+  EXPECT_LT(after.estimated_dex_bytes, before.estimated_dex_bytes);
+}
+
+TEST_F(SizeStatsTest, pendingCodeIsMeasuredFromDexCode) {
+  Scope scope{make_class("LA;")};
+  auto method = scope[0]->get_dmethods()[0];
+  auto ballooned = size_stats::Tracker().sample(scope);
+
+  method->sync();
+  method->balloon_lazily();
+  ASSERT_TRUE(method->is_balloon_pending());
+  auto pending = size_stats::Tracker().sample(scope);
+  EXPECT_TRUE(method->is_balloon_pending());
+  EXPECT_EQ(ballooned.instructions, pending.instructions);
+  EXPECT_EQ(ballooned.code_strings, pending.code_strings);
+}
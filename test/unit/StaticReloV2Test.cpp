@@ -286,4 +286,42 @@ TEST_F(StaticReloV2Test, relocatePrivateStaticMethod) {
   EXPECT_EQ(method_b->get_class(), classOuter->get_type());
   EXPECT_EQ(method_c->get_class(), classInner->get_type());
 }
+
+/**
+ * With profiles, a static method referenced by multiple other classes is
+ * relocated to the class that calls it most frequently.
+ *
+ * Input:
+ * A.a -> Other1.b (called once)
+ * A.a -> Other2.c (called 10 times)
+ *
+ * Output:
+ * a is relocated to Other2.
+ */
+TEST_F(StaticReloV2Test, staticMethodRefedByManyRelocatedToHottest) {
+  DexClass* classA = create_class("A");
+  DexMethod* method_a = create_method(classA, "a", ACC_PUBLIC | ACC_STATIC);
+  DexClass* classOther1 = create_class("Other1");
+  DexMethod* method_b = create_method(classOther1, "b", ACC_PUBLIC);
+  DexClass* classOther2 = create_class("Other2");
+  classOther2->set_access(ACC_PUBLIC);
+  DexMethod* method_c = create_method(classOther2, "c", ACC_PUBLIC);
+
+  call(method_b, method_a);
+  call(method_c, method_a);
+
+  method_profiles::StatsMap stats;
+  stats[method_b].call_count = 1;
+  stats[method_c].call_count = 10;
+
+  Scope scope({classA, classOther1, classOther2});
+  api::LevelChecker::init(0, scope);
+  std::vector<DexClass*> candidate_classes =
+      StaticReloPassV2::gen_candidates(scope);
+  EXPECT_EQ(candidate_classes.size(), 1);
+  int relocated_methods =
+      StaticReloPassV2::run_relocation(scope, candidate_classes, &stats);
+  EXPECT_EQ(relocated_methods, 1);
+  EXPECT_EQ(method_a->get_class(), classOther2->get_type());
+}
 } // namespace static_relo_v2
@@ -94,3 +94,42 @@ TEST_F(StripDebugInfoTest, dropLineNumbersWithNonThrowing) {
     )
 )");
 }
+
+TEST_F(StripDebugInfoTest, dropNonThrowingPositions) {
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;.bar:()V"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  auto field = static_cast<DexField*>(DexField::make_field("LFoo;.baz:I"));
+  field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  test(
+      {
+          .drop_non_throwing_positions = true,
+      },
+      R"(
+    (
+     (.pos "LFoo;.bar:()V" "Foo.java" "1")
+     (const v0 1)
+     (.pos "LFoo;.bar:()V" "Foo.java" "2")
+     (sget "LFoo;.baz:I")
+     (move-result-pseudo v0)
+     (.pos "LFoo;.bar:()V" "Foo.java" "3")
+     (add-int v0 v0 v0)
+     (.pos "LFoo;.bar:()V" "Foo.java" "4")
+     (invoke-static () "LFoo;.bar:()V")
+     (return-void)
+    )
+)",
+      R"(
+    (
+     (const v0 1)
+     (.pos "LFoo;.bar:()V" "Foo.java" "2")
+     (sget "LFoo;.baz:I")
+     (move-result-pseudo v0)
+     (add-int v0 v0 v0)
+     (.pos "LFoo;.bar:()V" "Foo.java" "4")
+     (invoke-static () "LFoo;.bar:()V")
+     (return-void)
+    )
+)");
+}
@@ -71,3 +71,124 @@ TEST_F(SwitchDispatchTest, create_simple_dispatch) {
     ASSERT_EQ(method, nullptr);
   }
 }
+
+TEST_F(SwitchDispatchTest, hot_cases_of_sparse_dispatch_are_tested_first) {
+  auto type = DexType::make_type("Lbar;");
+  auto type_tag_field = static_cast<DexField*>(
+      DexField::make_field("Lbar;.$t:I"));
+  type_tag_field->make_concrete(ACC_PUBLIC);
+  ClassCreator cc(type);
+  cc.set_super(type::java_lang_Object());
+  cc.add_field(type_tag_field);
+  cc.create();
+  std::map<SwitchIndices, DexMethod*> indices_to_callee;
+  for (int i = 0; i < 4; ++i) {
+    indices_to_callee[{i * 100}] = make_a_method(
+        "Lbar;.m" + std::to_string(i) + ":(Lbar;)V", ACC_PUBLIC | ACC_STATIC);
+  }
+  std::unordered_map<const DexMethodRef*, method_profiles::Stats> stats;
+  stats[indices_to_callee.at({200})].call_count = 90;
+  stats[indices_to_callee.at({0})].call_count = 10;
+
+  auto count_if_eqs = [](DexMethod* dispatch,
+                         std::vector<int64_t>* tested_keys) {
+    size_t if_eqs = 0;
+    int64_t last_const = -1;
+    for (const auto& mie : InstructionIterable(dispatch->get_code())) {
+      auto insn = mie.insn;
+      if (insn->opcode() == OPCODE_CONST) {
+        last_const = insn->get_literal();
+      } else if (insn->opcode() == OPCODE_IF_EQ) {
+        ++if_eqs;
+        tested_keys->push_back(last_const);
+      }
+    }
+    return if_eqs;
+  };
+
+  auto make_spec = [&](const std::string& name) {
+    return dispatch::Spec{type,
+                          dispatch::Type::VIRTUAL,
+                          name,
+                          DexProto::make_proto(type::_void(),
+                                               DexTypeList::make_type_list({})),
+                          ACC_PUBLIC,
+                          type_tag_field,
+                          nullptr,
+                          false};
+  };
+  std::vector<int64_t> tested_keys;
+  auto plain = dispatch::create_virtual_dispatch(make_spec("plain"),
+                                                 indices_to_callee);
+  EXPECT_EQ(0, count_if_eqs(plain.main_dispatch, &tested_keys));
+
+  // Only the case taking most of the calls is tested for ahead of the switch.
+  auto spec = make_spec("profiled");
+  spec.method_stats = &stats;
+  auto profiled = dispatch::create_virtual_dispatch(spec, indices_to_callee);
+  EXPECT_EQ(1, count_if_eqs(profiled.main_dispatch, &tested_keys));
+  EXPECT_EQ(std::vector<int64_t>{200}, tested_keys);
+  EXPECT_TRUE(profiled.main_dispatch->get_code()->count_opcodes() >
+              plain.main_dispatch->get_code()->count_opcodes());
+}
+
+TEST_F(SwitchDispatchTest, hot_cases_of_split_dispatch_stay_in_first_level) {
+  auto type = DexType::make_type("Lbaz;");
+  auto type_tag_field =
+      static_cast<DexField*>(DexField::make_field("Lbaz;.$t:I"));
+  type_tag_field->make_concrete(ACC_PUBLIC);
+  ClassCreator cc(type);
+  cc.set_super(type::java_lang_Object());
+  cc.add_field(type_tag_field);
+  cc.create();
+  std::map<SwitchIndices, DexMethod*> indices_to_callee;
+  for (int i = 0; i < 8; ++i) {
+    indices_to_callee[{i * 100}] = make_a_method(
+        "Lbaz;.m" + std::to_string(i) + ":(Lbaz;)V", ACC_PUBLIC | ACC_STATIC);
+  }
+  auto hot = indices_to_callee.at({300});
+  std::unordered_map<const DexMethodRef*, method_profiles::Stats> stats;
+  stats[hot].call_count = 90;
+  stats[indices_to_callee.at({0})].call_count = 10;
+
+  dispatch::Spec spec{type,
+                      dispatch::Type::VIRTUAL,
+                      "split",
+                      DexProto::make_proto(type::_void(),
+                                           DexTypeList::make_type_list({})),
+                      ACC_PUBLIC,
+                      type_tag_field,
+                      nullptr,
+                      false};
+  spec.max_num_dispatch_target = 2;
+  spec.method_stats = &stats;
+  auto dispatch = dispatch::create_virtual_dispatch(spec, indices_to_callee);
+  ASSERT_FALSE(dispatch.sub_dispatches.empty());
+
+  auto invoked = [](DexMethod* method) {
+    std::vector<DexMethodRef*> callees;
+    for (const auto& mie : InstructionIterable(method->get_code())) {
+      if (mie.insn->opcode() == OPCODE_INVOKE_STATIC) {
+        callees.push_back(mie.insn->get_method());
+      }
+    }
+    return callees;
+  };
+  // The hot case is tested for and called from the first level, and none of
+  // the second level dispatches handles it.
+  auto main_callees = invoked(dispatch.main_dispatch);
+  EXPECT_EQ(1, std::count(main_callees.begin(), main_callees.end(), hot));
+  auto main_insns = InstructionIterable(dispatch.main_dispatch->get_code());
+  EXPECT_EQ(1, std::count_if(main_insns.begin(), main_insns.end(),
+                             [](const MethodItemEntry& mie) {
+                               return mie.insn->opcode() == OPCODE_IF_EQ;
+                             }));
+  size_t sub_callees = 0;
+  for (auto sub : dispatch.sub_dispatches) {
+    auto callees = invoked(sub);
+    EXPECT_EQ(0, std::count(callees.begin(), callees.end(), hot));
+    sub_callees += callees.size();
+  }
+  // Each other case is called from a single second level dispatch.
+  EXPECT_EQ(indices_to_callee.size() - 1, sub_callees);
+}
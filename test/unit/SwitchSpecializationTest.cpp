@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "SwitchSpecialization.h"
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+using namespace switch_specialization;
+
+struct SwitchSpecializationTest : public RedexTest {
+  Scope m_scope;
+  DexMethod* m_callee;
+  DexMethod* m_caller;
+
+  SwitchSpecializationTest() {
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(type::java_lang_Object());
+    m_callee = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.select:(I)I"
+       (
+        (load-param v0)
+        (switch v0 (:a :b))
+        (const v1 0)
+        (return v1)
+        (:a 0)
+        (const v1 10)
+        (add-int v1 v1 v1)
+        (add-int v1 v1 v1)
+        (return v1)
+        (:b 1)
+        (const v1 20)
+        (mul-int v1 v1 v1)
+        (mul-int v1 v1 v1)
+        (return v1)
+       )
+      )
+    )");
+    m_caller = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.caller:()I"
+       (
+        (const v0 1)
+        (invoke-static (v0) "LFoo;.select:(I)I")
+        (move-result v1)
+        (return v1)
+       )
+      )
+    )");
+    creator.add_method(m_callee);
+    creator.add_method(m_caller);
+    m_scope.push_back(creator.create());
+  }
+};
+
+TEST_F(SwitchSpecializationTest, countDeadInstructions) {
+  ConstantArguments args;
+  args.set(0, SignedConstantDomain(1));
+  // The default case and case 0.
+  EXPECT_EQ(count_dead_instructions(m_callee->get_code(), args), 6);
+  EXPECT_EQ(count_dead_instructions(m_callee->get_code(), ConstantArguments()),
+            0);
+}
+
+TEST_F(SwitchSpecializationTest, specializeCallSites) {
+  Config config;
+  config.min_callee_size = 0;
+  config.min_dead_instructions = 1;
+  auto stats = specialize_call_sites(
+      m_scope, [&](const DexMethod* method) { return method == m_caller; },
+      config);
+  EXPECT_EQ(stats.call_sites, 1);
+  EXPECT_EQ(stats.clones, 1);
+
+  DexMethod* clone = nullptr;
+  for (auto& mie : InstructionIterable(m_caller->get_code())) {
+    if (mie.insn->opcode() == OPCODE_INVOKE_STATIC) {
+      clone = static_cast<DexMethod*>(mie.insn->get_method());
+    }
+  }
+  ASSERT_NE(clone, nullptr);
+  EXPECT_EQ(clone->str(), "select$spec$0");
+  EXPECT_TRUE(clone->is_def());
+
+  size_t num_switches = 0;
+  size_t num_muls = 0;
+  size_t num_adds = 0;
+  for (auto& mie : InstructionIterable(clone->get_code())) {
+    switch (mie.insn->opcode()) {
+    case OPCODE_SWITCH:
+      ++num_switches;
+      break;
+    case OPCODE_MUL_INT:
+      ++num_muls;
+      break;
+    case OPCODE_ADD_INT:
+      ++num_adds;
+      break;
+    default:
+      break;
+    }
+  }
+  EXPECT_EQ(num_switches, 0);
+  EXPECT_EQ(num_muls, 2);
+  EXPECT_EQ(num_adds, 0);
+
+  // The original method is left alone for the other call sites.
+  EXPECT_EQ(m_scope.front()->get_dmethods().size(), 3);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TextTokenizer.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace text;
+
+TEST(TextTokenizerTest, lines) {
+  Tokenizer tokens("a b\r\n\nc");
+  std::vector<std::string> lines;
+  boost::string_view line;
+  while (tokens.next_line(&line)) {
+    lines.push_back(line.to_string());
+  }
+  EXPECT_EQ(lines, (std::vector<std::string>{"a b", "", "c"}));
+}
+
+TEST(TextTokenizerTest, words) {
+  Tokenizer tokens("  LFoo; 1\n\tM  LFoo;.bar:()V 9\n");
+  std::vector<std::string> words;
+  boost::string_view word;
+  while (tokens.next_word(&word)) {
+    words.push_back(word.to_string());
+  }
+  EXPECT_EQ(words,
+            (std::vector<std::string>{"LFoo;", "1", "M", "LFoo;.bar:()V", "9"}));
+  EXPECT_TRUE(tokens.at_end());
+}
+
+TEST(TextTokenizerTest, fields) {
+  std::vector<std::string> fields;
+  EXPECT_TRUE(for_each_field("0,,x,", ',', [&](boost::string_view f, uint32_t) {
+    fields.push_back(f.to_string());
+    return true;
+  }));
+  EXPECT_EQ(fields, (std::vector<std::string>{"0", "", "x", ""}));
+
+  uint32_t calls = 0;
+  EXPECT_FALSE(for_each_field("a,b,c", ',', [&](boost::string_view, uint32_t i) {
+    ++calls;
+    return i < 1;
+  }));
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(TextTokenizerTest, numbers) {
+  uint32_t u;
+  EXPECT_TRUE(parse_uint32("4294967295", &u));
+  EXPECT_EQ(u, 4294967295u);
+  EXPECT_FALSE(parse_uint32("4294967296", &u));
+  EXPECT_FALSE(parse_uint32("12a", &u));
+  EXPECT_FALSE(parse_uint32("", &u));
+
+  double d;
+  EXPECT_TRUE(parse_double("99.5", &d));
+  EXPECT_EQ(d, 99.5);
+  EXPECT_FALSE(parse_double("99.5 ", &d));
+  EXPECT_FALSE(parse_double("", &d));
+}
+
+TEST(TextTokenizerTest, mappedFile) {
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+  EXPECT_FALSE(MappedTextFile(path).is_open());
+
+  std::ofstream(path).close();
+  MappedTextFile empty(path);
+  EXPECT_TRUE(empty.is_open());
+  EXPECT_TRUE(empty.contents().empty());
+
+  std::ofstream(path) << "hello\n";
+  MappedTextFile file(path);
+  EXPECT_TRUE(file.is_open());
+  EXPECT_EQ(file.contents(), "hello\n");
+  boost::filesystem::remove(path);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Timer.h"
+
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <map>
+#include <sstream>
+#include <thread>
+
+TEST(TraceEventsTest, eventsNestPerThread) {
+  {
+    // Nothing is recorded until tracing is enabled.
+    ScopedTraceEvent ignored("ignored");
+  }
+  trace_events::enable();
+  {
+    ScopedTraceEvent outer("outer");
+    std::thread worker([]() {
+      ScopedTraceEvent worker_outer("worker_outer");
+      ScopedTraceEvent worker_inner(std::string("worker_inner"));
+    });
+    worker.join();
+    ScopedTraceEvent inner("inner");
+  }
+
+  std::stringstream ss;
+  trace_events::write_json(ss);
+  Json::Value trace;
+  ss >> trace;
+  const auto& events = trace["traceEvents"];
+  ASSERT_EQ(4, events.size());
+  std::map<std::string, Json::Value> by_name;
+  for (const auto& event : events) {
+    EXPECT_EQ("X", event["ph"].asString());
+    by_name[event["name"].asString()] = event;
+  }
+  EXPECT_EQ(0, by_name.count("ignored"));
+  auto tid = [&](const char* name) { return by_name.at(name)["tid"]; };
+  auto start = [&](const char* name) { return by_name.at(name)["ts"]; };
+  auto end = [&](const char* name) {
+    return by_name.at(name)["ts"].asInt64() + by_name.at(name)["dur"].asInt64();
+  };
+  EXPECT_EQ(tid("outer"), tid("inner"));
+  EXPECT_EQ(tid("worker_outer"), tid("worker_inner"));
+  EXPECT_NE(tid("outer"), tid("worker_outer"));
+  EXPECT_LE(start("outer").asInt64(), start("inner").asInt64());
+  EXPECT_LE(end("inner"), end("outer"));
+  EXPECT_LE(start("worker_outer").asInt64(), start("worker_inner").asInt64());
+  EXPECT_LE(end("worker_inner"), end("worker_outer"));
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Model.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <set>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Show.h"
+
+/*
+ * The mergeables are children of the abstract class LBase;, with a
+ * constructor, and optionally an instance field and a method of a given size.
+ */
+class TypeErasureModelTest : public RedexTest {
+ protected:
+  void SetUp() override {
+    ClassCreator creator(DexType::make_type("LBase;"));
+    creator.set_super(type::java_lang_Object());
+    creator.set_access(ACC_PUBLIC | ACC_ABSTRACT);
+    creator.add_method(make_ctor("LBase;", "Ljava/lang/Object;"));
+    m_base = creator.create();
+    m_scope.push_back(m_base);
+    m_spec.roots.insert(m_base->get_type());
+    m_spec.class_name_prefix = "Test";
+  }
+
+  void TearDown() override {
+    // The interdex groups are static, so don't leak them to other tests.
+    ConfigFiles conf(Json::nullValue);
+    Model::build_interdex_groups(&conf);
+  }
+
+  static DexMethod* make_ctor(const std::string& cls,
+                              const std::string& super) {
+    auto method = assembler::method_from_string(
+        "(method (public constructor) \"" + cls + ".<init>:()V\"" +
+        " ((load-param-object v0)" + " (invoke-direct (v0) \"" + super +
+        ".<init>:()V\")" + " (return-void)))");
+    return method;
+  }
+
+  void make_child(const std::string& name,
+                  bool has_field = false,
+                  size_t method_size = 0) {
+    auto type = DexType::make_type(name.c_str());
+    ClassCreator creator(type);
+    creator.set_super(m_base->get_type());
+    creator.set_access(ACC_PUBLIC);
+    creator.add_method(make_ctor(name, "LBase;"));
+    if (has_field) {
+      creator.add_field(
+          DexField::make_field(name + ".f:I")->make_concrete(ACC_PUBLIC));
+    }
+    if (method_size > 0) {
+      std::string body;
+      for (size_t i = 0; i < method_size; ++i) {
+        body += " (const v0 " + std::to_string(i) + ")";
+      }
+      creator.add_method(assembler::method_from_string(
+          "(method (public) \"" + name + ".run:()V\" (" + body +
+          " (return-void)))"));
+    }
+    m_scope.push_back(creator.create());
+    m_types.insert(type);
+  }
+
+  // Makes a class that instantiates the given types.
+  void make_user(const std::string& name,
+                 const std::vector<std::string>& types) {
+    ClassCreator creator(DexType::make_type(name.c_str()));
+    creator.set_super(type::java_lang_Object());
+    creator.set_access(ACC_PUBLIC);
+    std::string body;
+    for (const auto& type : types) {
+      body += " (new-instance \"" + type + "\")";
+      body += " (move-result-pseudo-object v0)";
+    }
+    creator.add_method(assembler::method_from_string(
+        "(method (public static) \"" + name + ".use:()V\" (" + body +
+        " (return-void)))"));
+    m_scope.push_back(creator.create());
+  }
+
+  std::set<std::string> build_and_get_merged() {
+    TypeSystem type_system(m_scope);
+    auto model = Model::build_model(m_scope, m_spec, m_types, type_system);
+    std::set<std::string> merged;
+    model.walk_hierarchy([&](const MergerType& merger) {
+      for (const auto type : merger.mergeables) {
+        merged.insert(show(type));
+      }
+    });
+    return merged;
+  }
+
+  DexClass* m_base;
+  Scope m_scope;
+  TypeSet m_types;
+  ModelSpec m_spec;
+};
+
+TEST_F(TypeErasureModelTest, statelessOnly) {
+  make_child("LA;");
+  make_child("LB;");
+  make_child("LC;", /* has_field */ true);
+  make_child("LD;", /* has_field */ true);
+
+  EXPECT_EQ(build_and_get_merged(),
+            std::set<std::string>({"LA;", "LB;", "LC;", "LD;"}));
+
+  m_spec.stateless_only = true;
+  EXPECT_EQ(build_and_get_merged(), std::set<std::string>({"LA;", "LB;"}));
+}
+
+TEST_F(TypeErasureModelTest, maxMergeableInstructions) {
+  make_child("LA;");
+  make_child("LB;", /* has_field */ false, /* method_size */ 2);
+  make_child("LC;", /* has_field */ false, /* method_size */ 20);
+  make_child("LD;", /* has_field */ false, /* method_size */ 20);
+
+  EXPECT_EQ(build_and_get_merged(),
+            std::set<std::string>({"LA;", "LB;", "LC;", "LD;"}));
+
+  // The constructors have 2 instructions, besides their load-param.
+  m_spec.max_mergeable_instructions = 10;
+  EXPECT_EQ(build_and_get_merged(), std::set<std::string>({"LA;", "LB;"}));
+}
+
+TEST_F(TypeErasureModelTest, hotSetOnly) {
+  make_child("LA;");
+  make_child("LB;");
+  make_child("LC;");
+  make_child("LD;");
+  make_child("LE;");
+  make_child("LF;");
+  // A and B are in the hot set, C and D only in the second interdex group,
+  // and E and F in none of them.
+  make_user("LHot;", {"LA;", "LB;"});
+  make_user("LWarm;", {"LB;", "LC;", "LD;"});
+  make_user("LCold;", {"LE;", "LF;"});
+  m_spec.merge_per_interdex_set = InterDexGroupingType::HOT_SET_ONLY;
+
+  // Without an interdex order, there is no hot set.
+  EXPECT_TRUE(build_and_get_merged().empty());
+
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+  std::ofstream(path) << "Hot.class\nDexEndMarker0.class\nWarm.class\n";
+  Json::Value config;
+  config["coldstart_classes"] = path;
+  ConfigFiles conf(config);
+  Model::build_interdex_groups(&conf);
+  boost::filesystem::remove(path);
+
+  EXPECT_EQ(build_and_get_merged(), std::set<std::string>({"LA;", "LB;"}));
+
+  m_spec.merge_per_interdex_set = InterDexGroupingType::FULL;
+  EXPECT_EQ(build_and_get_merged(),
+            std::set<std::string>({"LA;", "LB;", "LC;", "LD;", "LE;", "LF;"}));
+}
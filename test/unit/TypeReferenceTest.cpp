@@ -109,3 +109,31 @@ TEST_F(TypeReferenceTest, update_field_type_references) {
             type::make_array_type(
                 type::make_array_type(type::make_array_type(type::_int()))));
 }
+
+TEST_F(TypeReferenceTest, update_type_references) {
+  auto f_e = make_a_field("f_e", type::java_lang_Enum());
+  auto m_e = DexMethod::make_method("Lcom/TestClass;.m:(Ljava/lang/Enum;)V")
+                 ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  auto m_c = DexMethod::make_method("Lcom/TestClass;.m:()C")
+                 ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  m_class->add_method(m_e);
+  m_class->add_method(m_c);
+  auto old_proto_c = m_c->get_proto();
+
+  std::unordered_map<DexMethod*, std::string> debug_map;
+  update_type_references(
+      m_scope, m_old_to_new, build_type_hierarchy(m_scope),
+      boost::optional<std::unordered_map<DexMethod*, std::string>&>(
+          debug_map));
+  // f:E; => f:I
+  EXPECT_EQ(f_e->get_type(), type::_int());
+  // m:(E;)V => m:(I)V
+  EXPECT_EQ(m_e->get_proto(),
+            DexProto::make_proto(type::_void(),
+                                 DexTypeList::make_type_list({type::_int()})));
+  // m:()C => m:()Object;
+  EXPECT_NE(m_c->get_proto(), old_proto_c);
+  EXPECT_EQ(m_c->get_proto()->get_rtype(), type::java_lang_Object());
+  EXPECT_EQ(debug_map.size(), 2);
+  EXPECT_EQ(debug_map.at(m_c), "C m");
+}
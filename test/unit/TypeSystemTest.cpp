@@ -374,3 +374,63 @@ TEST_F(TypeSystemTest, empty) {
               ::testing::UnorderedElementsAre(iout1_t));
   EXPECT_THAT(type_system.get_implemented_interfaces(odd_t).size(), 0);
 }
+
+TEST_F(TypeSystemTest, sharedUntilHierarchyChanges) {
+  Scope scope = create_empty_scope();
+  auto obj_t = type::java_lang_Object();
+  auto a_t = DexType::make_type("LA;");
+  auto a_cls = create_internal_class(a_t, obj_t, {});
+  scope.push_back(a_cls);
+  auto b_t = DexType::make_type("LB;");
+  auto b_cls = create_internal_class(b_t, obj_t, {});
+  scope.push_back(b_cls);
+
+  auto ts = g_redex->get_type_system(scope);
+  EXPECT_EQ(ts, g_redex->get_type_system(scope));
+  EXPECT_FALSE(ts->is_subtype(a_t, b_t));
+
+  b_cls->set_super_class(a_t);
+  auto updated_ts = g_redex->get_type_system(scope);
+  EXPECT_NE(ts, updated_ts);
+  EXPECT_TRUE(updated_ts->is_subtype(a_t, b_t));
+  // The holders of the previous one keep their snapshot.
+  EXPECT_FALSE(ts->is_subtype(a_t, b_t));
+
+  Scope smaller_scope{a_cls};
+  EXPECT_NE(updated_ts, g_redex->get_type_system(smaller_scope));
+}
+
+TEST_F(TypeSystemTest, subtypesThroughClassesOutsideTheScope) {
+  Scope scope = create_empty_scope();
+  auto obj_t = type::java_lang_Object();
+  auto i_t = DexType::make_type("LI;");
+  auto i_cls =
+      create_internal_class(i_t, obj_t, {}, ACC_PUBLIC | ACC_INTERFACE);
+  scope.push_back(i_cls);
+  // A is internal but left out of the scope.
+  auto a_t = DexType::make_type("LA;");
+  create_internal_class(a_t, obj_t, {i_t});
+  auto b_t = DexType::make_type("LB;");
+  scope.push_back(create_internal_class(b_t, a_t, {}));
+  auto c_t = DexType::make_type("LC;");
+  scope.push_back(create_internal_class(c_t, b_t, {}));
+  auto d_t = DexType::make_type("LD;");
+  scope.push_back(create_internal_class(d_t, obj_t, {}));
+
+  TypeSystem type_system(scope);
+  EXPECT_TRUE(type_system.is_subtype(b_t, c_t));
+  EXPECT_TRUE(type_system.is_subtype(a_t, c_t));
+  EXPECT_TRUE(type_system.is_subtype(obj_t, c_t));
+  EXPECT_TRUE(type_system.is_subtype(c_t, c_t));
+  EXPECT_FALSE(type_system.is_subtype(c_t, b_t));
+  EXPECT_FALSE(type_system.is_subtype(d_t, c_t));
+
+  TypeSet children;
+  type_system.get_all_children(a_t, children);
+  EXPECT_THAT(children, ::testing::UnorderedElementsAre(b_t, c_t));
+  children.clear();
+  type_system.get_all_children(obj_t, children);
+  EXPECT_THAT(children, ::testing::UnorderedElementsAre(i_t, d_t));
+
+  EXPECT_FALSE(type_system.implements(d_t, i_t));
+}
@@ -10,6 +10,7 @@
 #include <gmock/gmock.h>
 
 #include "DexUtil.h"
+#include "IRAssembler.h"
 #include "RedexTest.h"
 
 struct WalkersTest : public RedexTest {};
@@ -36,3 +37,57 @@ TEST_F(WalkersTest, accumlate) {
       ::testing::UnorderedElementsAre(
           "LFoo;.bar:()V", "LFoo;.baz:()V", "LFoo;.qux:()V", "LFoo;.quux:()V"));
 }
+
+namespace {
+
+DexClass* make_class_with_code(const std::string& name,
+                               const std::vector<size_t>& method_sizes) {
+  ClassCreator cc(DexType::make_type(name.c_str()));
+  cc.set_super(type::java_lang_Object());
+  for (size_t i = 0; i < method_sizes.size(); ++i) {
+    std::string body = "(";
+    for (size_t j = 0; j < method_sizes[i]; ++j) {
+      body += "(const v0 0)";
+    }
+    body += "(return-void))";
+    auto method =
+        DexMethod::make_method(name + ".m" + std::to_string(i) + ":()V")
+            ->make_concrete(ACC_PUBLIC | ACC_STATIC,
+                            assembler::ircode_from_string(body), false);
+    cc.add_method(method);
+  }
+  return cc.create();
+}
+
+} // namespace
+
+TEST_F(WalkersTest, scheduleByCost) {
+  auto small = make_class_with_code("LSmall;", {1});
+  auto medium = make_class_with_code("LMedium;", {5, 5});
+  auto huge = make_class_with_code("LHuge;", {100, 50});
+  Scope scope{small, medium, huge};
+
+  auto tasks = walk::parallel::schedule_by_cost(scope, 2);
+  // The huge class exceeds a fourth of a worker's fair share, and is thus
+  // split into per-method tasks; everything is ordered by decreasing cost.
+  ASSERT_EQ(4, tasks.size());
+  EXPECT_EQ(huge, tasks[0].cls);
+  EXPECT_EQ(huge->get_dmethods()[0], tasks[0].method);
+  EXPECT_EQ(huge, tasks[1].cls);
+  EXPECT_EQ(huge->get_dmethods()[1], tasks[1].method);
+  EXPECT_EQ(medium, tasks[2].cls);
+  EXPECT_EQ(nullptr, tasks[2].method);
+  EXPECT_EQ(small, tasks[3].cls);
+  EXPECT_EQ(nullptr, tasks[3].method);
+
+  std::atomic<size_t> num_methods{0};
+  walk::parallel::methods(
+      scope, [&](DexMethod*) { ++num_methods; }, 2,
+      walk::parallel::Schedule::BY_COST);
+  EXPECT_EQ(5, num_methods.load());
+
+  auto num_insns = walk::parallel::methods<size_t>(
+      scope, [](DexMethod* m) { return m->get_code()->count_opcodes(); }, 2,
+      0, walk::parallel::Schedule::BY_COST);
+  EXPECT_EQ(1 + 5 + 5 + 100 + 50 + 5, num_insns);
+}
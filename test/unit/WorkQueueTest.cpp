@@ -7,9 +7,11 @@
 
 #include "WorkQueue.h"
 
+#include <atomic>
 #include <chrono>
 #include <gtest/gtest.h>
 #include <random>
+#include <thread>
 
 constexpr unsigned int NUM_STRINGS = 100'000;
 constexpr unsigned int NUM_INTS = 1000;
@@ -75,3 +77,193 @@ TEST(WorkQueueTest, checkDynamicallyAddingTasks) {
   // 10 + 9 + ... + 1 + 0 = 55
   EXPECT_EQ(55, result);
 }
+
+// Check that consecutive runs borrow the same persistent threads.
+TEST(WorkQueueTest, reusesPooledThreads) {
+  constexpr size_t num_threads{4};
+  auto run = [&]() {
+    auto wq = workqueue_foreach<int>([](int) {}, num_threads);
+    for (int i = 0; i < 100; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  };
+  run();
+  auto pool_size = sparta::parallel::ThreadPool::get().size();
+  EXPECT_GE(pool_size, num_threads);
+  for (int i = 0; i < 10; ++i) {
+    run();
+  }
+  EXPECT_EQ(pool_size, sparta::parallel::ThreadPool::get().size());
+}
+
+// Non-trivially-copyable inputs are boxed on the work-stealing deques.
+TEST(WorkQueueTest, nonTriviallyCopyableInputs) {
+  std::atomic<size_t> total_length{0};
+  WorkQueue<std::string> wq(
+      [&](WorkerState<std::string>* worker_state, const std::string& s) {
+        total_length += s.size();
+        if (s.size() > 1) {
+          worker_state->push_task(s.substr(1));
+        }
+      },
+      4);
+  wq.add_item(std::string(100, 'x'));
+  wq.add_item(std::string(50, 'y'));
+  wq.run_all();
+  // 100 + 99 + ... + 1 and 50 + ... + 1
+  EXPECT_EQ(5050 + 1275, total_length.load());
+}
+
+// Tasks pushed while other workers are idle must still all be processed.
+TEST(WorkQueueTest, stealsDynamicallyAddedTasks) {
+  constexpr size_t num_threads{4};
+  std::atomic<size_t> count{0};
+  WorkQueue<int> wq(
+      [&](WorkerState<int>* worker_state, int depth) {
+        ++count;
+        if (depth > 0) {
+          worker_state->push_task(depth - 1);
+          worker_state->push_task(depth - 1);
+        }
+      },
+      num_threads);
+  wq.add_item(14);
+  wq.run_all();
+  EXPECT_EQ((1u << 15) - 1, count.load());
+}
+
+// Workers that run out of tasks park instead of spinning through a long tail
+// task, and wake up for the tasks it pushes at the end.
+TEST(WorkQueueTest, idleWorkersPark) {
+  constexpr size_t num_threads{8};
+  std::atomic<size_t> count{0};
+  bool all_parked{false};
+  WorkQueue<int>* wq_ptr{nullptr};
+  WorkQueue<int> wq(
+      [&](WorkerState<int>* worker_state, int task) {
+        ++count;
+        if (task == 0) {
+          // Through this tail task, all the other workers run out of work.
+          auto deadline =
+              std::chrono::steady_clock::now() + std::chrono::seconds(30);
+          while (!all_parked && std::chrono::steady_clock::now() < deadline) {
+            all_parked = wq_ptr->num_parked_workers() == num_threads - 1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+          for (int i = 0; i < 100; ++i) {
+            worker_state->push_task(1);
+          }
+        }
+      },
+      num_threads);
+  wq_ptr = &wq;
+  wq.add_item(0);
+  wq.run_all();
+  EXPECT_TRUE(all_parked);
+  // Parked workers were woken up for the pushed tasks, and at the end.
+  EXPECT_EQ(101, count.load());
+  EXPECT_EQ(0, wq.num_parked_workers());
+}
+
+// An executor may itself run a WorkQueue; the nested run reuses the pool and
+// restores the outer worker ID afterwards.
+TEST(WorkQueueTest, nestedWorkQueues) {
+  constexpr size_t num_threads{3};
+  WorkerLocal<size_t> outer_sums(num_threads, 0);
+  std::atomic<size_t> inner_total{0};
+  auto wq = workqueue_foreach<int>(
+      [&](int a) {
+        auto outer_id = redex_parallel::get_worker_id();
+        auto inner = workqueue_foreach<int>(
+            [&](int b) {
+              EXPECT_LT(redex_parallel::get_worker_id(), num_threads);
+              inner_total += b;
+            },
+            num_threads);
+        for (int b = 0; b < 10; ++b) {
+          inner.add_item(b);
+        }
+        inner.run_all();
+        EXPECT_EQ(outer_id, redex_parallel::get_worker_id());
+        outer_sums.get() += a;
+      },
+      num_threads);
+  for (int a = 1; a <= 20; ++a) {
+    wq.add_item(a);
+  }
+  wq.run_all();
+
+  size_t outer_total = 0;
+  outer_sums.for_each([&](size_t sum) { outer_total += sum; });
+  EXPECT_EQ(210, outer_total);
+  EXPECT_EQ(20 * 45, inner_total.load());
+  EXPECT_EQ(redex_parallel::INVALID_ID, redex_parallel::get_worker_id());
+}
+
+TEST(WorkQueueTest, parallelFor) {
+  constexpr size_t N = 1000;
+  std::vector<int> hits(N, 0);
+  WorkerLocal<size_t> counts(4, 0);
+  redex_parallel::parallel_for(
+      0, N,
+      [&](size_t i) {
+        ++hits[i];
+        ++counts.get();
+      },
+      4, 7);
+  for (size_t i = 0; i < N; ++i) {
+    ASSERT_EQ(1, hits[i]);
+  }
+  size_t total = 0;
+  counts.for_each([&](size_t c) { total += c; });
+  EXPECT_EQ(N, total);
+}
+
+TEST(WorkQueueTest, parallelSort) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  // Large enough to be split into runs, with a ragged last run.
+  std::vector<int> values(100003);
+  for (auto& v : values) {
+    v = dist(gen);
+  }
+  auto expected = values;
+  std::sort(expected.begin(), expected.end(), std::greater<int>());
+  redex_parallel::sort(values.begin(), values.end(), std::greater<int>(), 3);
+  EXPECT_EQ(expected, values);
+}
+
+TEST(WorkQueueTest, parallelForNestedInWorkQueue) {
+  constexpr size_t num_threads{4};
+  std::atomic<size_t> total{0};
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t n) {
+        redex_parallel::parallel_for(
+            0, n, [&](size_t i) { total += i; }, num_threads);
+      },
+      num_threads);
+  for (size_t n = 0; n < 50; ++n) {
+    wq.add_item(n);
+  }
+  wq.run_all();
+  size_t expected = 0;
+  for (size_t n = 0; n < 50; ++n) {
+    expected += n * (n - (n > 0 ? 1 : 0)) / 2;
+  }
+  EXPECT_EQ(expected, total.load());
+}
+
+TEST(WorkQueueTest, workerLocalNonCopyable) {
+  auto locals = WorkerLocal<std::unique_ptr<int>>::create(
+      3, []() { return std::make_unique<int>(0); });
+  WorkQueue<int> wq(
+      [&](WorkerState<int>* state, int a) { *locals.get(*state) += a; }, 3);
+  for (int a = 1; a <= 100; ++a) {
+    wq.add_item(a);
+  }
+  wq.run_all();
+  int total = 0;
+  locals.for_each([&](std::unique_ptr<int>& p) { total += *p; });
+  EXPECT_EQ(5050, total);
+}
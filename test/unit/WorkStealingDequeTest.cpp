@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "WorkStealingDeque.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(WorkStealingDequeTest, ownerIsLifoThiefIsFifo) {
+  WorkStealingDeque<int> deque(2);
+  for (int i = 0; i < 10; ++i) {
+    deque.push(i);
+  }
+  EXPECT_EQ(10, deque.size());
+  EXPECT_EQ(9, *deque.pop());
+  EXPECT_EQ(0, *deque.steal());
+  EXPECT_EQ(8, *deque.pop());
+  EXPECT_EQ(1, *deque.steal());
+  EXPECT_EQ(6, deque.size());
+  while (deque.pop()) {
+  }
+  EXPECT_TRUE(deque.empty());
+  EXPECT_FALSE(deque.pop());
+  EXPECT_FALSE(deque.steal());
+}
+
+TEST(WorkStealingDequeTest, largeElements) {
+  struct Triple {
+    uint64_t a, b, c;
+  };
+  WorkStealingDeque<Triple> deque(1);
+  for (uint64_t i = 0; i < 100; ++i) {
+    deque.push({i, i + 1, i + 2});
+  }
+  auto t = *deque.steal();
+  EXPECT_EQ(0, t.a);
+  EXPECT_EQ(2, t.c);
+  t = *deque.pop();
+  EXPECT_EQ(99, t.a);
+  EXPECT_EQ(101, t.c);
+}
+
+// Every pushed element must be taken exactly once, by either the owner or one
+// of the thieves.
+TEST(WorkStealingDequeTest, concurrentStealing) {
+  constexpr int N = 100000;
+  constexpr int NUM_THIEVES = 3;
+  WorkStealingDeque<int> deque;
+  std::vector<std::atomic<int>> taken(N);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < NUM_THIEVES; ++i) {
+    thieves.emplace_back([&]() {
+      while (!done || !deque.empty()) {
+        if (auto x = deque.steal()) {
+          ++taken[*x];
+        }
+      }
+    });
+  }
+  for (int i = 0; i < N; ++i) {
+    deque.push(i);
+    if (i % 3 == 0) {
+      if (auto x = deque.pop()) {
+        ++taken[*x];
+      }
+    }
+  }
+  while (auto x = deque.pop()) {
+    ++taken[*x];
+  }
+  done = true;
+  for (auto& thread : thieves) {
+    thread.join();
+  }
+  for (int i = 0; i < N; ++i) {
+    EXPECT_EQ(1, taken[i].load()) << i;
+  }
+}
@@ -244,6 +244,76 @@ TEST_F(ConstantPropagationTest, PrimitiveArrayEscapesViaFilledNewArray) {
   EXPECT_EQ(assembler::to_s_expr(code.get()), expected);
 }
 
+TEST_F(ConstantPropagationTest, PrimitiveArrayLength) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 3)
+     (new-array v0 "[I") ; create an array of length 3
+     (move-result-pseudo-object v1)
+     (array-length v1)
+     (move-result-pseudo v2)
+
+     (if-eq v0 v2 :if-true-label)
+     (const v3 0)
+
+     (:if-true-label)
+     (const v3 1)
+    )
+)");
+
+  do_const_prop(code.get(), ArrayAnalyzer());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 3)
+     (new-array v0 "[I")
+     (move-result-pseudo-object v1)
+     (array-length v1)
+     (move-result-pseudo v2)
+
+     (goto :if-true-label)
+     (const v3 0)
+
+     (:if-true-label)
+     (const v3 1)
+    )
+)");
+  EXPECT_CODE_EQ(code.get(), expected_code.get());
+}
+
+TEST_F(ConstantPropagationTest, ArrayLengthIsNotNegative) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (array-length v0)
+     (move-result-pseudo v1)
+
+     (if-gez v1 :if-true-label)
+     (const v2 0)
+
+     (:if-true-label)
+     (const v2 1)
+    )
+)");
+
+  do_const_prop(code.get(), ArrayAnalyzer());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (array-length v0)
+     (move-result-pseudo v1)
+
+     (goto :if-true-label)
+     (const v2 0)
+
+     (:if-true-label)
+     (const v2 1)
+    )
+)");
+  EXPECT_CODE_EQ(code.get(), expected_code.get());
+}
+
 TEST_F(ConstantPropagationTest, OutOfBoundsWrite) {
   auto code = assembler::ircode_from_string(R"( (
      (const v0 1)
@@ -342,6 +342,74 @@ TEST_F(InterproceduralConstantPropagationTest, unreachableInvoke) {
   EXPECT_TRUE(fp_iter.get_entry_state_at(m3).is_bottom());
 }
 
+TEST_F(InterproceduralConstantPropagationTest, reuseUnchangedAnalyses) {
+  Scope scope;
+  auto cls_ty = DexType::make_type("LFoo;");
+  ClassCreator creator(cls_ty);
+  creator.set_super(type::java_lang_Object());
+
+  auto m1 = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+     (
+      (const v0 1)
+      (invoke-static (v0) "LFoo;.baz:(I)V")
+      (return-void)
+     )
+    )
+  )");
+  m1->rstate.set_root();
+  creator.add_method(m1);
+
+  auto m2 = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.baz:(I)V"
+     (
+      (load-param v0)
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(m2);
+
+  auto cls = creator.create();
+  scope.push_back(cls);
+
+  call_graph::Graph cg = call_graph::single_callee_graph(scope);
+  walk::code(scope, [](DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+  });
+  std::atomic<size_t> num_analyses{0};
+  FixpointIterator fp_iter(
+      cg,
+      [&num_analyses](const DexMethod* method,
+                      const WholeProgramState&,
+                      const ArgumentDomain& args) {
+        ++num_analyses;
+        auto& code = *method->get_code();
+        auto env = env_with_params(&code, args);
+        auto intra_cp = std::make_unique<intraprocedural::FixpointIterator>(
+            code.cfg(), ConstantPrimitiveAnalyzer());
+        intra_cp->run(env);
+        return intra_cp;
+      });
+
+  fp_iter.run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+  EXPECT_EQ(2, num_analyses);
+  EXPECT_EQ(0, fp_iter.get_reused_analyses());
+
+  // Nothing changed, so the second run doesn't analyze any method again.
+  fp_iter.run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+  EXPECT_EQ(2, num_analyses);
+  EXPECT_EQ(2, fp_iter.get_reused_analyses());
+  EXPECT_EQ(fp_iter.get_entry_state_at(m2).get(CURRENT_PARTITION_LABEL),
+            ArgumentDomain({{0, SignedConstantDomain(1)}}));
+
+  // Neither does collecting the values that they return.
+  WholeProgramState wps(scope, fp_iter, {}, {});
+  EXPECT_EQ(2, num_analyses);
+  EXPECT_EQ(4, fp_iter.get_reused_analyses());
+  EXPECT_EQ(ConstantValue::top(), wps.get_return_value(m2));
+}
+
 struct RuntimeAssertTest : public InterproceduralConstantPropagationTest {
   DexMethodRef* m_fail_handler;
 
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SparseConstantPropagation.h"
+
+#include <gtest/gtest.h>
+
+#include "ConstantPropagationTestUtil.h"
+#include "IRAssembler.h"
+
+namespace {
+
+void do_sparse_const_prop(IRCode* code) {
+  code->build_cfg(/* editable */ false);
+  cp::intraprocedural::SparseFixpointIterator intra_cp(
+      code->cfg(), cp::ConstantPrimitiveAnalyzer());
+  intra_cp.run(ConstantEnvironment());
+  cp::Transform::Config transform_config;
+  cp::Transform tf(transform_config);
+  tf.apply(intra_cp, cp::WholeProgramState(), code);
+}
+
+// Runs both analyses on `input` and checks that they transform it the same
+// way.
+void expect_same_results(const std::string& input) {
+  auto dense = assembler::ircode_from_string(input);
+  do_const_prop(dense.get());
+  auto sparse = assembler::ircode_from_string(input);
+  do_sparse_const_prop(sparse.get());
+  EXPECT_CODE_EQ(dense.get(), sparse.get());
+}
+
+} // namespace
+
+TEST_F(ConstantPropagationTest, SparseDeadBranches) {
+  expect_same_results(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (if-eqz v1 :dead)
+     (const v2 2)
+     (add-int v3 v1 v2)
+     (if-ne v3 v2 :end)
+     (:dead)
+     (const v3 0)
+     (:end)
+     (return v3)
+    )
+  )");
+}
+
+TEST_F(ConstantPropagationTest, SparseLoop) {
+  expect_same_results(R"(
+    (
+     (load-param v0)
+     (const v1 0)
+     (const v2 5)
+     (:loop)
+     (if-ge v1 v0 :end)
+     (add-int/lit8 v1 v1 1)
+     (move v3 v2)
+     (goto :loop)
+     (:end)
+     (if-eqz v2 :never)
+     (return v2)
+     (:never)
+     (return v1)
+    )
+  )");
+}
+
+TEST_F(ConstantPropagationTest, SparseMoveResultAndSwitch) {
+  expect_same_results(R"(
+    (
+     (const v0 0)
+     (instance-of v0 "Ljava/lang/String;")
+     (move-result-pseudo v1)
+     (switch v1 (:a :b))
+     (const v2 3)
+     (return v2)
+     (:a 0)
+     (const v2 1)
+     (return v2)
+     (:b 1)
+     (const v2 2)
+     (return v2)
+    )
+  )");
+}
+
+TEST_F(ConstantPropagationTest, SparseUnknownValues) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (add-int v2 v0 v1)
+     (return v2)
+    )
+  )");
+  code->build_cfg(/* editable */ false);
+  cp::intraprocedural::SparseFixpointIterator intra_cp(
+      code->cfg(), cp::ConstantPrimitiveAnalyzer());
+  intra_cp.run(ConstantEnvironment());
+  auto insns = InstructionIterable(code.get());
+  auto it = insns.begin();
+  EXPECT_TRUE(intra_cp.get_value_of((it++)->insn).is_top());
+  EXPECT_EQ(SignedConstantDomain(1),
+            intra_cp.get_value_of((it++)->insn)
+                .maybe_get<SignedConstantDomain>()
+                .value_or(SignedConstantDomain::bottom()));
+  EXPECT_TRUE(intra_cp.get_value_of(it->insn).is_top());
+  code->clear_cfg();
+}
+
+// The sparse analysis is approximate: it never finds more constants than the
+// dense one, and it misses those that only the paths taken imply.
+TEST_F(ConstantPropagationTest, SparseIgnoresBranchConditions) {
+  auto input = R"(
+    (
+     (load-param v0)
+     (if-nez v0 :end)
+     (add-int/lit8 v1 v0 1)
+     (return v1)
+     (:end)
+     (return v0)
+    )
+  )";
+  auto dense = assembler::ircode_from_string(input);
+  do_const_prop(dense.get());
+  auto expected_dense = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (if-nez v0 :end)
+     (const v1 1)
+     (return v1)
+     (:end)
+     (return v0)
+    )
+  )");
+  EXPECT_CODE_EQ(dense.get(), expected_dense.get());
+
+  auto sparse = assembler::ircode_from_string(input);
+  do_sparse_const_prop(sparse.get());
+  auto expected_sparse = assembler::ircode_from_string(input);
+  EXPECT_CODE_EQ(sparse.get(), expected_sparse.get());
+}
+
+TEST_F(ConstantPropagationTest, SparseJoinsDefsOfDeadEdges) {
+  // The second definition of v1 is executable, but never reaches :use.
+  auto input = R"(
+    (
+     (load-param v2)
+     (const v0 1)
+     (const v1 2)
+     (if-eqz v2 :use)
+     (const v1 3)
+     (if-eqz v0 :use)
+     (return v0)
+     (:use)
+     (add-int/lit8 v3 v1 1)
+     (return v3)
+    )
+  )";
+  auto dense = assembler::ircode_from_string(input);
+  do_const_prop(dense.get());
+  auto expected_dense = assembler::ircode_from_string(R"(
+    (
+     (load-param v2)
+     (const v0 1)
+     (const v1 2)
+     (if-eqz v2 :use)
+     (const v1 3)
+     (return v0)
+     (:use)
+     (const v3 3)
+     (return v3)
+    )
+  )");
+  EXPECT_CODE_EQ(dense.get(), expected_dense.get());
+
+  auto sparse = assembler::ircode_from_string(input);
+  do_sparse_const_prop(sparse.get());
+  auto expected_sparse = assembler::ircode_from_string(R"(
+    (
+     (load-param v2)
+     (const v0 1)
+     (const v1 2)
+     (if-eqz v2 :use)
+     (const v1 3)
+     (return v0)
+     (:use)
+     (add-int/lit8 v3 v1 1)
+     (return v3)
+    )
+  )");
+  EXPECT_CODE_EQ(sparse.get(), expected_sparse.get());
+}
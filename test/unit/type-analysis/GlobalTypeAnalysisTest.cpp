@@ -89,3 +89,70 @@ TEST_F(GlobalTypeAnalysisTest, SimpleTest) {
   EXPECT_EQ(bar_arg_env,
             ArgumentTypeEnvironment({{0, get_type_domain("LO;")}}));
 }
+
+TEST_F(GlobalTypeAnalysisTest, SummaryCacheTest) {
+  Scope scope;
+  prepare_scope(scope);
+
+  auto cls_a = DexType::make_type("LA;");
+  ClassCreator creator(cls_a);
+  creator.set_super(type::java_lang_Object());
+
+  auto m_bar = assembler::method_from_string(R"(
+    (method (public static) "LA;.bar:(LO;)V"
+     (
+      (load-param-object v0)
+      (return-void)
+     )
+    )
+  )");
+  creator.add_method(m_bar);
+
+  auto m_foo = assembler::method_from_string(R"(
+    (method (public static) "LA;.foo:()V"
+     (
+      (new-instance "LO;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "LO;.<init>:()V")
+      (invoke-static (v0) "LA;.bar:(LO;)V")
+      (return-void)
+     )
+    )
+  )");
+  m_foo->rstate.set_root();
+  creator.add_method(m_foo);
+  scope.push_back(creator.create());
+
+  call_graph::Graph cg = call_graph::single_callee_graph(scope);
+  walk::code(scope, [](DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+  });
+  auto summaries = std::make_shared<SummaryCache>();
+  GlobalTypeAnalyzer gta1(cg, summaries);
+  gta1.run({{CURRENT_PARTITION_LABEL, ArgumentTypeEnvironment()}});
+  EXPECT_EQ(0, gta1.get_reused_analyses());
+
+  // A later analysis of the same code reuses all the summaries.
+  GlobalTypeAnalyzer gta2(cg, summaries);
+  gta2.run({{CURRENT_PARTITION_LABEL, ArgumentTypeEnvironment()}});
+  auto num_methods = gta2.get_reused_analyses();
+  EXPECT_GT(num_methods, 0);
+  auto bar_arg_env =
+      gta2.get_entry_state_at(m_bar).get(CURRENT_PARTITION_LABEL);
+  EXPECT_EQ(bar_arg_env,
+            ArgumentTypeEnvironment({{0, get_type_domain("LO;")}}));
+
+  // Only the method whose code changed is analyzed again.
+  m_bar->get_code()->clear_cfg();
+  m_bar->set_code(assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (const v1 0)
+     (return-void)
+    )
+  )"));
+  m_bar->get_code()->build_cfg(/* editable */ false);
+  GlobalTypeAnalyzer gta3(cg, summaries);
+  gta3.run({{CURRENT_PARTITION_LABEL, ArgumentTypeEnvironment()}});
+  EXPECT_EQ(num_methods - 1, gta3.get_reused_analyses());
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/program_options.hpp>
+#include <iostream>
+
+#include "ApkRepack.h"
+#include "Timer.h"
+
+/*
+ * Unpacks and repacks APKs for redex.py:
+ *
+ *   apk-repack unpack <apk> <directory>
+ *   apk-repack repack [--original <apk>] [--page-align-libs]
+ *       <directory> <output apk>
+ */
+namespace {
+
+namespace po = boost::program_options;
+
+void print_usage(const po::options_description& desc) {
+  std::cerr << "usage: apk-repack unpack <apk> <directory>\n"
+            << "       apk-repack repack [options] <directory> <output apk>\n"
+            << desc;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  po::options_description desc("repack options");
+  desc.add_options()("help,h", "produce help message");
+  desc.add_options()("original", po::value<std::string>(),
+                     "the APK the directory was unpacked from; unchanged "
+                     "entries are copied from it as-is");
+  desc.add_options()("page-align-libs", "align stored .so files to pages");
+  desc.add_options()("compression-level", po::value<int>(),
+                     "zlib compression level of the changed entries");
+  po::options_description hidden;
+  hidden.add_options()("args", po::value<std::vector<std::string>>());
+  po::options_description all;
+  all.add(desc).add(hidden);
+  po::positional_options_description positional;
+  positional.add("args", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv)
+                  .options(all)
+                  .positional(positional)
+                  .run(),
+              vm);
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    print_usage(desc);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> args;
+  if (vm.count("args")) {
+    args = vm["args"].as<std::vector<std::string>>();
+  }
+  if (vm.count("help") || args.size() != 3) {
+    print_usage(desc);
+    return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  const auto& command = args[0];
+  if (command == "unpack") {
+    Timer t("Unpacking " + args[1]);
+    apk_repack::unpack(args[1], args[2]);
+  } else if (command == "repack") {
+    apk_repack::Options options;
+    options.page_align_libs = vm.count("page-align-libs") != 0;
+    if (vm.count("compression-level")) {
+      options.compression_level = vm["compression-level"].as<int>();
+    }
+    std::string original;
+    if (vm.count("original")) {
+      original = vm["original"].as<std::string>();
+    }
+    Timer t("Repacking " + args[2]);
+    auto stats = apk_repack::repack(original, args[1], args[2], options);
+    std::cerr << "Copied " << stats.copied << " entries, compressed "
+              << stats.compressed << ", stored " << stats.stored << "\n";
+  } else {
+    print_usage(desc);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -10,13 +10,18 @@
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
+#include "IRCode.h"
 #include "InstructionLowering.h"
 #include "RedexContext.h"
+#include "Show.h"
+#include "Walkers.h"
 
 InjectDebug::InjectDebug(const std::string& outdir,
-                         const std::vector<std::string>& dex_files)
+                         const std::vector<std::string>& dex_files,
+                         const std::vector<std::string>& method_filters)
     : m_conf(Json::Value(), outdir),
       m_dex_files(dex_files),
+      m_method_filters(method_filters),
       m_store("classes") {
   if (!g_redex) {
     g_redex = new RedexContext();
@@ -30,26 +35,78 @@ InjectDebug::~InjectDebug() {
 
 void InjectDebug::run() {
   load_dex();
+  inject_debug_info();
   write_dex();
 }
 
 void InjectDebug::load_dex() {
   m_store.set_dex_magic(load_dex_magic_from_dex(m_dex_files[0].c_str()));
 
+  // The code is only ballooned for the methods that get instrumented.
   for (const auto& filename : m_dex_files) {
-    m_store.add_classes(load_classes_from_dex(filename.c_str()));
+    m_store.add_classes(
+        load_classes_from_dex(filename.c_str(), /* balloon */ false));
   }
 }
 
+bool InjectDebug::should_inject(const DexMethod* method) const {
+  if (method->get_dex_code() == nullptr) {
+    return false;
+  }
+  if (m_method_filters.empty()) {
+    return true;
+  }
+  auto name = show(method);
+  for (const auto& filter : m_method_filters) {
+    if (name.compare(0, filter.size(), filter) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void InjectDebug::inject_debug_info() {
+  auto scope = build_class_scope(DexStoresVector{m_store});
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    if (!should_inject(method)) {
+      return;
+    }
+    method->balloon();
+    auto code = method->get_code();
+    if (code->get_debug_item() == nullptr) {
+      code->set_debug_item(std::make_unique<DexDebugItem>());
+    }
+    // Replace the source positions with one per instruction, numbered in
+    // order, so that a debugger steps through the bytecode. A move-result
+    // stays right after its invoke.
+    auto method_name = DexString::make_string(show(method));
+    auto file = type_class(method->get_class())->get_source_file();
+    uint32_t line = 0;
+    for (auto it = code->begin(); it != code->end();) {
+      if (it->type == MFLOW_POSITION) {
+        it = code->erase_and_dispose(it);
+        continue;
+      }
+      if (it->type == MFLOW_OPCODE &&
+          !opcode::is_internal(it->insn->opcode()) &&
+          !opcode::is_move_result(it->insn->opcode())) {
+        code->insert_before(
+            it, std::make_unique<DexPosition>(method_name, file, ++line));
+      }
+      ++it;
+    }
+    instruction_lowering::lower(method, /* lower_with_cfg */ true);
+  });
+}
+
 void InjectDebug::write_dex() {
-  const std::string filename =
-      m_conf.get_outdir() + "/" + m_store.get_name() + ".dex";
-  DexStoresVector stores{m_store};
   std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
 
-  instruction_lowering::run(stores, true);
-
   for (size_t i = 0; i < m_store.get_dexen().size(); i++) {
+    // Named like the dexes of an APK: classes.dex, classes2.dex, ...
+    const std::string filename =
+        m_conf.get_outdir() + "/" + m_store.get_name() +
+        (i > 0 ? std::to_string(i + 1) : "") + ".dex";
     DexOutput dout = DexOutput(filename.c_str(), // filename
                                &m_store.get_dexen()[i], // classes
                                nullptr, // locator_index
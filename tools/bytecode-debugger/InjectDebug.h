@@ -16,20 +16,31 @@
  * Uses Redex libraries to load a dex file into memory and output a new
  * dex file. IODI will be used to add the required debug info items into the
  * dex file.
+ *
+ * Only the methods that match one of the method filters (all of them when
+ * there are none) get ballooned to IR and instrumented. The code of the other
+ * methods is written back as it was loaded, which keeps instrumenting a few
+ * classes of a large app quick.
  */
 
 class InjectDebug {
  public:
   InjectDebug(const std::string& outdir,
-              const std::vector<std::string>& dex_files);
+              const std::vector<std::string>& dex_files,
+              const std::vector<std::string>& method_filters = {});
   ~InjectDebug();
   void run();
 
  private:
   const ConfigFiles m_conf;
   const std::vector<std::string> m_dex_files;
+  // Prefixes of the methods to instrument, like "Lcom/foo/Bar;" for all the
+  // methods of a class, or "Lcom/foo/Bar;.baz:" for some of them.
+  const std::vector<std::string> m_method_filters;
   DexStore m_store;
 
   void load_dex();
+  bool should_inject(const DexMethod* method) const;
+  void inject_debug_info();
   void write_dex();
 };
@@ -38,6 +38,7 @@ void print_usage() {
 struct Arguments {
   std::string out_dir;
   std::vector<std::string> dex_files;
+  std::vector<std::string> method_filters;
 };
 
 Arguments parse_args(int argc, char* argv[]) {
@@ -51,6 +52,10 @@ Arguments parse_args(int argc, char* argv[]) {
                    "output directory for dexes");
   od.add_options()("dex-files", po::value<std::vector<std::string>>(),
                    "dex files");
+  od.add_options()(
+      "method-filter", po::value<std::vector<std::string>>(),
+      "only instrument the methods whose names start with this prefix, e.g. "
+      "Lcom/foo/Bar; (may be repeated; defaults to all methods)");
   po::variables_map vm;
 
   try {
@@ -75,6 +80,10 @@ Arguments parse_args(int argc, char* argv[]) {
     exit(EXIT_SUCCESS);
   }
 
+  if (vm.count("method-filter")) {
+    args.method_filters = vm["method-filter"].as<std::vector<std::string>>();
+  }
+
   if (vm.count("outdir")) {
     args.out_dir = vm["outdir"].as<std::string>();
     if (!redex::dir_is_writable(args.out_dir)) {
@@ -102,7 +111,7 @@ Arguments parse_args(int argc, char* argv[]) {
 int main(int argc, char* argv[]) {
   Arguments args = parse_args(argc, argv);
 
-  InjectDebug inject_debug(args.out_dir, args.dex_files);
+  InjectDebug inject_debug(args.out_dir, args.dex_files, args.method_filters);
   inject_debug.run();
 
   return 0;
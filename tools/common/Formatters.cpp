@@ -9,9 +9,11 @@
 
 #include "DexEncoding.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <ios>
 #include <sstream>
+#include <vector>
 
 struct type_to_string {
   uint16_t type;
@@ -72,6 +74,33 @@ std::string format_map(ddump_data* rd) {
   return ss.str();
 }
 
+std::string format_map_summary(ddump_data* rd) {
+  unsigned int count;
+  dex_map_item* maps;
+  get_dex_map_items(rd, &count, &maps);
+  // The sections are laid out in map order, but don't rely on it: a section
+  // ends where the next one by offset starts, or at the end of the file.
+  std::vector<uint32_t> offsets;
+  offsets.reserve(count);
+  for (unsigned int i = 0; i < count; i++) {
+    offsets.push_back(maps[i].offset);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  std::ostringstream ss;
+  ss << "Type                             Items       Bytes\n";
+  for (unsigned int i = 0; i < count; i++) {
+    auto next =
+        std::upper_bound(offsets.begin(), offsets.end(), maps[i].offset);
+    uint32_t end = next == offsets.end() ? rd->dex_size : *next;
+    ss << std::left << std::setw(30) << maptype_to_string(maps[i].type)
+       << std::right << std::setw(8) << maps[i].size << std::setw(12)
+       << end - maps[i].offset << "\n";
+  }
+  ss << std::left << std::setw(38) << "TOTAL" << std::right << std::setw(12)
+     << rd->dex_size << "\n";
+  return ss.str();
+}
+
 namespace {
 const char* viz_to_string(uint8_t viz) {
   switch (viz) {
@@ -12,6 +12,8 @@
 #include <string>
 
 std::string format_map(ddump_data* rd);
+// The number of items and bytes in each section of the map, and in the file.
+std::string format_map_summary(ddump_data* rd);
 std::string format_annotation(ddump_data* rd, const uint8_t** _aitem);
 std::string format_annotation_item(ddump_data* rd, const uint8_t** _aitem);
 std::string format_encoded_value(ddump_data* rd, const uint8_t** _aitem);
@@ -22,6 +22,8 @@
 #include "DexLoader.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
+#include "IRCodeIO.h"
+#include "IRInstruction.h"
 #include "IRMetaIO.h"
 #include "InstructionLowering.h"
 #include "JarLoader.h"
@@ -78,6 +80,25 @@ void write_ir_meta(const std::string& output_ir_dir, DexStoresVector& stores) {
   ir_meta_io::dump(classes, output_ir_dir);
 }
 
+/**
+ * Write the IR code of every method to file, and leave stubs behind, so that
+ * the intermediate dexes can be written without register allocation.
+ * Development usage only
+ */
+void write_ir_code(const std::string& output_ir_dir, DexStoresVector& stores) {
+  Timer t("Dumping IR code");
+  Scope classes = build_class_scope(stores);
+  ir_code_io::dump(classes, output_ir_dir);
+  walk::parallel::methods(classes, [](DexMethod* method) {
+    if (method->get_code() == nullptr) {
+      return;
+    }
+    auto stub = std::make_unique<IRCode>(method, 0);
+    stub->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+    method->set_code(std::move(stub));
+  });
+}
+
 /**
  * Write intermediate dex to files.
  * Development usage only
@@ -208,6 +229,7 @@ void write_all_intermediate(const ConfigFiles& conf,
   redex_options.serialize(entry_data);
   entry_data["dex_list"] = Json::arrayValue;
   write_ir_meta(output_ir_dir, stores);
+  write_ir_code(output_ir_dir, stores);
   write_intermediate_dex(redex_options, conf, output_ir_dir, stores,
                          entry_data["dex_list"]);
   write_entry_file(output_ir_dir, entry_data);
@@ -241,5 +263,14 @@ void load_all_intermediate(const std::string& input_ir_dir,
     std::cerr << error;
     TRACE_NO_LINE(MAIN, 1, "%s", error.c_str());
   }
+
+  Timer t_code("Loading IR code");
+  if (!ir_code_io::load(input_ir_dir)) {
+    std::string error =
+        "Use the code of the intermediate dexes instead, it went through "
+        "register allocation\n";
+    std::cerr << error;
+    TRACE_NO_LINE(MAIN, 1, "%s", error.c_str());
+  }
 }
 } // namespace redex
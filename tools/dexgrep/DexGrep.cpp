@@ -9,24 +9,110 @@
 #include <cstdlib>
 #include <getopt.h>
 #include <regex>
+#include <string>
+#include <vector>
 
 #include "DexCommon.h"
+#include "DexIndex.h"
+
+namespace {
 
 void print_usage() {
-  fprintf(stderr, "Usage: dexgrep <classname> <dexfile 1> <dexfile 2> ...\n");
+  fprintf(stderr,
+          "Usage: dexgrep [-l] [-r] [--index=<file>] <regex> <dexfile 1> "
+          "<dexfile 2> ...\n"
+          "\n"
+          "Prints the classes whose name matches <regex>.\n"
+          "\n"
+          "-l, --files-with-matches: only print the dex files that match\n"
+          "-r, --refs: match the strings, types, fields and methods that the "
+          "classes refer to instead of their names\n"
+          "-i, --index=<file>: answer from the index in <file>, building it "
+          "first if it's missing or the dex files have changed since\n");
+}
+
+void grep_class_names(const std::regex& re,
+                      const std::vector<std::string>& dexfiles,
+                      bool files_only) {
+  for (const auto& dexfile : dexfiles) {
+    ddump_data rd;
+    open_dex_file(dexfile.c_str(), &rd);
+
+    auto size = rd.dexh->class_defs_size;
+    for (uint32_t j = 0; j < size; j++) {
+      dex_class_def* cls_def = rd.dex_class_defs + j;
+      char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
+      if (std::regex_search(name, re)) {
+        if (files_only) {
+          printf("%s\n", dexfile.c_str());
+          break;
+        } else {
+          printf("%s: %s\n", dexfile.c_str(), name);
+        }
+      }
+    }
+  }
 }
 
+void grep_index(const std::regex& re,
+                const std::vector<std::string>& dexfiles,
+                const char* index_file,
+                bool refs,
+                bool files_only) {
+  dexgrep::DexIndex index;
+  if (index_file == nullptr || !index.load(index_file, dexfiles)) {
+    index = dexgrep::DexIndex::build(dexfiles);
+    if (index_file != nullptr) {
+      index.save(index_file);
+    }
+  }
+
+  const uint32_t NONE = -1;
+  uint32_t last_dex = NONE;
+  for (const auto& match : index.query(re, refs)) {
+    const auto& dexfile = index.dex_path(match.dex);
+    if (files_only) {
+      if (match.dex != last_dex) {
+        printf("%s\n", dexfile.c_str());
+      }
+    } else if (refs) {
+      printf("%s: %s: %c %s\n",
+             dexfile.c_str(),
+             index.class_name(match.cls).c_str(),
+             char(match.kind),
+             match.ref->c_str());
+    } else {
+      printf("%s: %s\n", dexfile.c_str(), match.ref->c_str());
+    }
+    last_dex = match.dex;
+  }
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
   bool files_only = false;
+  bool refs = false;
+  const char* index_file = nullptr;
   char c;
   static const struct option options[] = {
-      {"files-without-match", no_argument, nullptr, 'l'},
+      {"files-with-matches", no_argument, nullptr, 'l'},
+      {"refs", no_argument, nullptr, 'r'},
+      {"index", required_argument, nullptr, 'i'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
   };
-  while ((c = getopt_long(argc, argv, "hl", &options[0], nullptr)) != -1) {
+  while ((c = getopt_long(argc, argv, "hlri:", &options[0], nullptr)) != -1) {
     switch (c) {
     case 'l':
       files_only = true;
       break;
+    case 'r':
+      refs = true;
+      break;
+    case 'i':
+      index_file = optarg;
+      break;
     case 'h':
       print_usage();
       return 0;
@@ -36,7 +122,7 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  if (optind == argc) {
+  if (optind + 1 >= argc) {
     fprintf(stderr, "%s: no dex files given\n", argv[0]);
     print_usage();
     return 1;
@@ -44,23 +130,13 @@ int main(int argc, char* argv[]) {
 
   const char* search_str = argv[optind];
   std::regex re(search_str);
+  std::vector<std::string> dexfiles(argv + optind + 1, argv + argc);
 
-  for (int i = optind + 1; i < argc; ++i) {
-    const char* dexfile = argv[i];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-
-    auto size = rd.dexh->class_defs_size;
-    for (uint32_t j = 0; j < size; j++) {
-      dex_class_def* cls_def = rd.dex_class_defs + j;
-      char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
-      if (std::regex_search(name, re)) {
-        if (files_only) {
-          printf("%s\n", dexfile);
-        } else {
-          printf("%s: %s\n", dexfile, name);
-        }
-      }
-    }
+  // Without an index, the names of the classes are found without loading
+  // any of their code.
+  if (refs || index_file != nullptr) {
+    grep_index(re, dexfiles, index_file, refs, files_only);
+  } else {
+    grep_class_names(re, dexfiles, files_only);
   }
 }
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DexIndex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <tuple>
+
+#include "DexClass.h"
+#include "DexLoader.h"
+#include "RedexContext.h"
+#include "Show.h"
+
+namespace dexgrep {
+
+namespace {
+
+constexpr char MAGIC[] = "dexgrep1";
+
+template <typename T>
+void write_value(std::ofstream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void write_string(std::ofstream& out, const std::string& s) {
+  write_value<uint32_t>(out, s.size());
+  out.write(s.data(), s.size());
+}
+
+template <typename T>
+bool read_value(std::ifstream& in, T* value) {
+  return bool(in.read(reinterpret_cast<char*>(value), sizeof(*value)));
+}
+
+bool read_string(std::ifstream& in, std::string* s) {
+  uint32_t size;
+  if (!read_value(in, &size)) {
+    return false;
+  }
+  s->resize(size);
+  return bool(in.read(&(*s)[0], size));
+}
+
+template <typename T>
+void add_refs(const std::vector<T*>& refs,
+              RefKind kind,
+              uint32_t cls,
+              std::map<std::pair<RefKind, std::string>, std::vector<uint32_t>>*
+                  index) {
+  std::vector<std::string> names;
+  names.reserve(refs.size());
+  for (auto ref : refs) {
+    names.push_back(show(ref));
+  }
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  for (auto& name : names) {
+    (*index)[std::make_pair(kind, std::move(name))].push_back(cls);
+  }
+}
+
+} // namespace
+
+DexIndex::DexStamp DexIndex::stamp(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return DexStamp{path, 0, -1};
+  }
+  return DexStamp{path, uint64_t(st.st_size), int64_t(st.st_mtime)};
+}
+
+DexIndex DexIndex::build(const std::vector<std::string>& dexfiles) {
+  DexIndex index;
+  for (uint32_t dex = 0; dex < dexfiles.size(); ++dex) {
+    const auto& path = dexfiles[dex];
+    index.m_dexes.push_back(stamp(path));
+    // Each dex gets a context of its own, so that a class defined in several
+    // dexes is indexed in each of them.
+    g_redex = new RedexContext();
+    auto classes = load_classes_from_dex(path.c_str(),
+                                         /* balloon */ true,
+                                         /* support_dex_version */ 38);
+    for (auto cls : classes) {
+      uint32_t id = index.m_classes.size();
+      auto name = show(cls->get_type());
+      index.m_classes.emplace_back(dex, name);
+      index.m_refs[std::make_pair(RefKind::CLASS, name)].push_back(id);
+
+      std::vector<DexString*> strings;
+      cls->gather_strings(strings);
+      add_refs(strings, RefKind::STRING, id, &index.m_refs);
+      std::vector<DexType*> types;
+      cls->gather_types(types);
+      add_refs(types, RefKind::TYPE, id, &index.m_refs);
+      std::vector<DexFieldRef*> fields;
+      cls->gather_fields(fields);
+      add_refs(fields, RefKind::FIELD, id, &index.m_refs);
+      std::vector<DexMethodRef*> methods;
+      cls->gather_methods(methods);
+      add_refs(methods, RefKind::METHOD, id, &index.m_refs);
+    }
+    delete g_redex;
+    g_redex = nullptr;
+  }
+  return index;
+}
+
+bool DexIndex::load(const std::string& path,
+                    const std::vector<std::string>& dexfiles) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  if (!in.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), MAGIC)) {
+    return false;
+  }
+
+  uint32_t count;
+  if (!read_value(in, &count) || count != dexfiles.size()) {
+    return false;
+  }
+  std::vector<DexStamp> dexes(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    auto& dex = dexes[i];
+    if (!read_string(in, &dex.path) || !read_value(in, &dex.size) ||
+        !read_value(in, &dex.mtime) || !(dex == stamp(dexfiles[i]))) {
+      return false;
+    }
+  }
+
+  if (!read_value(in, &count)) {
+    return false;
+  }
+  std::vector<std::pair<uint32_t, std::string>> classes(count);
+  for (auto& cls : classes) {
+    if (!read_value(in, &cls.first) || cls.first >= dexes.size() ||
+        !read_string(in, &cls.second)) {
+      return false;
+    }
+  }
+
+  if (!read_value(in, &count)) {
+    return false;
+  }
+  decltype(m_refs) refs;
+  for (uint32_t i = 0; i < count; ++i) {
+    char kind;
+    std::string ref;
+    uint32_t size;
+    if (!read_value(in, &kind) || !read_string(in, &ref) ||
+        !read_value(in, &size)) {
+      return false;
+    }
+    auto& ids = refs[std::make_pair(RefKind(kind), std::move(ref))];
+    ids.resize(size);
+    for (auto& id : ids) {
+      if (!read_value(in, &id) || id >= classes.size()) {
+        return false;
+      }
+    }
+  }
+
+  m_dexes = std::move(dexes);
+  m_classes = std::move(classes);
+  m_refs = std::move(refs);
+  return true;
+}
+
+void DexIndex::save(const std::string& path) const {
+  // Written aside and renamed, so an interrupted save doesn't leave an index
+  // that's truncated behind.
+  auto tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(MAGIC, sizeof(MAGIC));
+    write_value<uint32_t>(out, m_dexes.size());
+    for (const auto& dex : m_dexes) {
+      write_string(out, dex.path);
+      write_value(out, dex.size);
+      write_value(out, dex.mtime);
+    }
+    write_value<uint32_t>(out, m_classes.size());
+    for (const auto& cls : m_classes) {
+      write_value(out, cls.first);
+      write_string(out, cls.second);
+    }
+    write_value<uint32_t>(out, m_refs.size());
+    for (const auto& pair : m_refs) {
+      write_value(out, char(pair.first.first));
+      write_string(out, pair.first.second);
+      write_value<uint32_t>(out, pair.second.size());
+      for (auto id : pair.second) {
+        write_value(out, id);
+      }
+    }
+    if (!out) {
+      fprintf(stderr, "Cannot write index %s\n", tmp.c_str());
+      return;
+    }
+  }
+  if (rename(tmp.c_str(), path.c_str()) != 0) {
+    fprintf(stderr, "Cannot write index %s\n", path.c_str());
+    remove(tmp.c_str());
+  }
+}
+
+std::vector<DexIndex::Match> DexIndex::query(const std::regex& re,
+                                             bool refs) const {
+  std::vector<Match> matches;
+  for (const auto& pair : m_refs) {
+    auto kind = pair.first.first;
+    const auto& ref = pair.first.second;
+    if ((kind == RefKind::CLASS) == refs || !std::regex_search(ref, re)) {
+      continue;
+    }
+    for (auto cls : pair.second) {
+      matches.push_back(Match{m_classes[cls].first, cls, kind, &ref});
+    }
+  }
+  // Classes are numbered in the order of the dexes.
+  std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+    return std::tie(a.cls, a.kind, *a.ref) <
+           std::tie(b.cls, b.kind, *b.ref);
+  });
+  return matches;
+}
+
+} // namespace dexgrep
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * An inverted index over a set of dexes: for each class name, and for each
+ * string, type, field and method referenced anywhere in a class (its
+ * signatures, annotations and code), the classes it appears in.
+ *
+ * Building it means loading the code of every dex, which is what makes a
+ * linear scan slow. It's saved next to the sizes and modification times of
+ * the dexes, and reused as long as those haven't changed.
+ */
+namespace dexgrep {
+
+enum class RefKind : char {
+  CLASS = 'c',
+  STRING = 's',
+  TYPE = 't',
+  FIELD = 'f',
+  METHOD = 'm',
+};
+
+class DexIndex {
+ public:
+  struct Match {
+    uint32_t dex;
+    uint32_t cls;
+    RefKind kind;
+    const std::string* ref;
+  };
+
+  static DexIndex build(const std::vector<std::string>& dexfiles);
+
+  /*
+   * Returns false if there's no index at `path`, or if it wasn't built from
+   * exactly `dexfiles` as they currently are on disk.
+   */
+  bool load(const std::string& path, const std::vector<std::string>& dexfiles);
+  void save(const std::string& path) const;
+
+  /*
+   * The classes whose name matches `re` or, if `refs` is set, the strings,
+   * types, fields and methods matching `re` with the classes they appear
+   * in. Matches are sorted by dex, then by class in class def order.
+   */
+  std::vector<Match> query(const std::regex& re, bool refs) const;
+
+  const std::string& dex_path(uint32_t dex) const {
+    return m_dexes.at(dex).path;
+  }
+  const std::string& class_name(uint32_t cls) const {
+    return m_classes.at(cls).second;
+  }
+
+ private:
+  struct DexStamp {
+    std::string path;
+    uint64_t size;
+    int64_t mtime;
+    bool operator==(const DexStamp& other) const {
+      return path == other.path && size == other.size && mtime == other.mtime;
+    }
+  };
+
+  static DexStamp stamp(const std::string& path);
+
+  std::vector<DexStamp> m_dexes;
+  // The dex each class is defined in, and its name, in class def order.
+  std::vector<std::pair<uint32_t, std::string>> m_classes;
+  // Each ref and the classes referencing it. Class names are refs of kind
+  // CLASS that only point to their own class.
+  std::map<std::pair<RefKind, std::string>, std::vector<uint32_t>> m_refs;
+};
+
+} // namespace dexgrep
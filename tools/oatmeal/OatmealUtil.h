@@ -11,9 +11,12 @@
 #include "DexOpcodeDefs.h"
 #include "file-utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -54,6 +57,34 @@ static void foreach_pair(const T1& t1, const T2& t2, const L& fn) {
   }
 }
 
+// Like foreach_pair, but calls fn(i, t1[i], t2[i]) for several i at once. fn
+// must only write to state of its own i; the memory accounter is safe to use.
+template <typename T1, typename T2, typename L>
+static void parallel_foreach_pair(const T1& t1, const T2& t2, const L& fn) {
+  CHECK(t1.size() == t2.size());
+  size_t size = t1.size();
+  size_t num_threads =
+      std::min<size_t>(size, std::max(1u, std::thread::hardware_concurrency()));
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < size; i++) {
+      fn(i, t1[i], t2[i]);
+    }
+    return;
+  }
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([&]() {
+      for (size_t i = next++; i < size; i = next++) {
+        fn(i, t1[i], t2[i]);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 template <uint32_t Width>
 uint32_t align(uint32_t in) {
   return (in + (Width - 1)) & -Width;
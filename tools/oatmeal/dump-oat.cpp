@@ -999,6 +999,10 @@ class DexFileListing_064 : public DexFileListing {
     std::vector<uint32_t> class_offsets;
     std::vector<ClassInfo> class_info;
     std::vector<std::string> class_names;
+    // Bytes of the ClassInfo structs and their bitmaps, and of the method
+    // offsets that follow them.
+    uint32_t class_info_size = 0;
+    uint32_t method_offsets_size = 0;
   };
 
   DexFileListing_064(bool dex_files_only,
@@ -1084,6 +1088,8 @@ class DexFileListing_064 : public DexFileListing {
             auto methods_ptr = bitmap_ptr;
             cur_ma()->markRangeConsumed(methods_ptr,
                                         method_count * oat_method_offset_size);
+            file.class_info_size += sizeof(uint32_t) + bitmap_size;
+            file.method_offsets_size += method_count * oat_method_offset_size;
 
           } else if (class_info.type ==
                      static_cast<uint16_t>(
@@ -1093,7 +1099,9 @@ class DexFileListing_064 : public DexFileListing {
                 oat_buf.ptr + class_info_offset + sizeof(ClassInfo);
             cur_ma()->markRangeConsumed(methods_ptr,
                                         method_count * oat_method_offset_size);
+            file.method_offsets_size += method_count * oat_method_offset_size;
           }
+          file.class_info_size += sizeof(ClassInfo);
 
           file.class_info.push_back(class_info);
           file.class_names.push_back(id_bufs.get_class_name(i));
@@ -1303,6 +1311,8 @@ class OatClasses_079 : public OatClasses {
   static void write(const std::vector<DexFileType>& dex_files,
                     FileHandle& cksum_fh);
 
+  const std::vector<DexClasses>& dex_classes() const { return classes_; }
+
  protected:
   std::vector<DexClasses> classes_;
 };
@@ -1320,38 +1330,39 @@ OatClasses_124::OatClasses_124(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf,
                                ConstBuffer dex_buf) {
-  foreach_pair(dex_file_listing.dex_files(),
-               dex_files.headers(),
-               [&](const DexFileListing_079::DexFile_079& listing,
-                   const DexFileHeader& header) {
-                 auto classes_offset = listing.classes_offset;
-
-                 DexClasses dex_classes;
-                 dex_classes.dex_file = listing.location;
-
-                 DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
-
-                 // classes_offset points to an array of pointers (offsets) to
-                 // ClassInfo
-                 for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-                   ClassInfo info;
-                   uint32_t info_offset;
-                   cur_ma()->memcpyAndMark(
-                       &info_offset,
-                       oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-                       sizeof(uint32_t));
-                   cur_ma()->memcpyAndMark(&info,
-                                           oat_buf.slice(info_offset).ptr,
-                                           sizeof(ClassInfo));
-
-                   // TODO: Handle compiled classes. Need to read method bitmap
-                   // size, and method bitmap.
-                   dex_classes.class_info.push_back(info);
-                   dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-                 }
-                 classes_.push_back(dex_classes);
-               });
+  classes_.resize(dex_files.headers().size());
+  parallel_foreach_pair(
+      dex_file_listing.dex_files(),
+      dex_files.headers(),
+      [&](size_t dex_index,
+          const DexFileListing_079::DexFile_079& listing,
+          const DexFileHeader& header) {
+        auto classes_offset = listing.classes_offset;
+
+        auto& dex_classes = classes_[dex_index];
+        dex_classes.dex_file = listing.location;
+
+        DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
+
+        // classes_offset points to an array of pointers (offsets) to
+        // ClassInfo
+        for (unsigned int i = 0; i < header.class_defs_size; i++) {
+
+          ClassInfo info;
+          uint32_t info_offset;
+          cur_ma()->memcpyAndMark(
+              &info_offset,
+              oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
+              sizeof(uint32_t));
+          cur_ma()->memcpyAndMark(
+              &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+
+          // TODO: Handle compiled classes. Need to read method bitmap size,
+          // and method bitmap.
+          dex_classes.class_info.push_back(info);
+          dex_classes.class_names.push_back(id_bufs.get_class_name(i));
+        }
+      });
 }
 
 class OatClasses_064 : public OatClasses {
@@ -1375,14 +1386,16 @@ class OatClasses_064 : public OatClasses {
 OatClasses_079::OatClasses_079(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf) {
-  foreach_pair(
+  classes_.resize(dex_files.headers().size());
+  parallel_foreach_pair(
       dex_file_listing.dex_files(),
       dex_files.headers(),
-      [&](const DexFileListing_079::DexFile_079& listing,
+      [&](size_t dex_index,
+          const DexFileListing_079::DexFile_079& listing,
           const DexFileHeader& header) {
         auto classes_offset = listing.classes_offset;
 
-        DexClasses dex_classes;
+        auto& dex_classes = classes_[dex_index];
         dex_classes.dex_file = listing.location;
 
         DexIdBufs id_bufs(oat_buf, listing.file_offset, header);
@@ -1408,7 +1421,6 @@ OatClasses_079::OatClasses_079(const DexFileListing_079& dex_file_listing,
           dex_classes.class_info.push_back(info);
           dex_classes.class_names.push_back(id_bufs.get_class_name(i));
         }
-        classes_.push_back(dex_classes);
       });
 }
 
@@ -1768,6 +1780,8 @@ class LookupTables {
     }
   }
 
+  const std::vector<LookupTable>& tables() const { return tables_; }
+
   static uint32_t numEntries(uint32_t num_classes) {
     return supportedSize(num_classes) ? roundUpToPowerOfTwo(num_classes) : 0u;
   }
@@ -1971,6 +1985,38 @@ class LookupTables_Nil : public LookupTables {
 };
 
 // Handles version 064 and 045.
+// Only verified classes are parsed from 7.0 on, so there's no method code in
+// those oat files.
+OatMemoryReport memory_report_079(const OatHeader& header,
+                                  const DexFiles& dex_files,
+                                  const LookupTables& lookup_tables,
+                                  const OatClasses_079& oat_classes,
+                                  bool dex_in_oat) {
+  OatMemoryReport report;
+  report.header = header.size();
+  report.key_value_store = header.key_value_store_size;
+  const auto& tables = lookup_tables.tables();
+  const auto& classes = oat_classes.dex_classes();
+  if (tables.size() != dex_files.headers().size() ||
+      classes.size() != dex_files.headers().size()) {
+    return report;
+  }
+  for (size_t i = 0; i < classes.size(); i++) {
+    OatDexMemory dex;
+    dex.location = classes[i].dex_file;
+    if (dex_in_oat) {
+      dex.dex_file = dex_files.headers()[i].file_size;
+    }
+    dex.type_lookup_table =
+        tables[i].num_entries * sizeof(LookupTables::LookupTableEntry);
+    dex.class_offsets = classes[i].class_info.size() * sizeof(uint32_t);
+    dex.class_info =
+        classes[i].class_info.size() * sizeof(OatClasses::ClassInfo);
+    report.dexes.push_back(std::move(dex));
+  }
+  return report;
+}
+
 class OatFile_064 : public OatFile {
  public:
   UNCOPYABLE(OatFile_064);
@@ -2021,6 +2067,30 @@ class OatFile_064 : public OatFile {
 
   Status status() override { return Status::PARSE_SUCCESS; }
 
+  OatMemoryReport memory_report() const override {
+    OatMemoryReport report;
+    report.header = header_.size();
+    report.key_value_store = header_.key_value_store_size;
+    foreach_pair(dex_file_listing_.dex_files(),
+                 dex_files_.headers(),
+                 [&](const DexFileListing_064::DexFile_064& dex_file,
+                     const DexFileHeader& header) {
+                   OatDexMemory dex;
+                   dex.location = dex_file.location;
+                   dex.dex_file = header.file_size;
+                   if (dex_file.lookup_table_offset != 0) {
+                     dex.type_lookup_table =
+                         SamsungLookupTables::rawSize(header.class_defs_size);
+                   }
+                   dex.class_offsets =
+                       dex_file.class_info.size() * sizeof(uint32_t);
+                   dex.class_info = dex_file.class_info_size;
+                   dex.method_offsets = dex_file.method_offsets_size;
+                   report.dexes.push_back(std::move(dex));
+                 });
+    return report;
+  }
+
   std::vector<OatDexFile> get_oat_dexfiles() override {
     std::vector<OatDexFile> ret;
     ret.reserve(dex_file_listing_.dex_files().size());
@@ -2152,6 +2222,14 @@ class OatFile_079 : public OatFile {
 
   Status status() override { return Status::PARSE_SUCCESS; }
 
+  OatMemoryReport memory_report() const override {
+    return memory_report_079(header_,
+                             dex_files_,
+                             lookup_tables_,
+                             oat_classes_,
+                             /* dex_in_oat */ true);
+  }
+
   static Status build(const std::string& oat_file_name,
                       const std::vector<DexInput>& dex_input,
                       const OatVersion oat_version,
@@ -2345,6 +2423,14 @@ class OatFile_124 : public OatFile {
 
   Status status() override { return Status::PARSE_SUCCESS; }
 
+  OatMemoryReport memory_report() const override {
+    return memory_report_079(header_,
+                             dex_files_,
+                             lookup_tables_,
+                             oat_classes_,
+                             /* dex_in_oat */ false);
+  }
+
   static Status build(const std::string& oat_file_name,
                       const std::vector<DexInput>& dex_input,
                       const OatVersion oat_version,
@@ -2627,6 +2713,51 @@ class OatFile_Bad : public OatFile {
 
 OatFile::~OatFile() = default;
 
+namespace {
+
+std::string json_escape(const std::string& str) {
+  std::string ret;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      ret += buf;
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+void OatFile::print_memory_report(size_t file_size) const {
+  auto report = memory_report();
+  printf("{\"version\": \"%s\", \"file_size\": %zu, \"header\": %u, "
+         "\"key_value_store\": %u, \"dexes\": [",
+         json_escape(version_string()).c_str(),
+         file_size,
+         report.header,
+         report.key_value_store);
+  for (size_t i = 0; i < report.dexes.size(); i++) {
+    const auto& dex = report.dexes[i];
+    printf("%s\n  {\"location\": \"%s\", \"dex_file\": %u, "
+           "\"type_lookup_table\": %u, \"class_offsets\": %u, "
+           "\"class_info\": %u, \"method_offsets\": %u}",
+           i == 0 ? "" : ",",
+           json_escape(dex.location).c_str(),
+           dex.dex_file,
+           dex.type_lookup_table,
+           dex.class_offsets,
+           dex.class_info,
+           dex.method_offsets);
+  }
+  printf("]}\n");
+}
+
 static std::unique_ptr<OatFile> parse_oatfile_impl(
     bool dex_files_only,
     ConstBuffer oatfile_buffer,
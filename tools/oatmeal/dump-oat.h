@@ -49,6 +49,26 @@ struct OatDexFile {
   uint32_t file_size;
 };
 
+// Bytes of an oat file spent on each of its dex files, by what they hold.
+struct OatDexMemory {
+  std::string location;
+  // Zero from 8.0 on, where the dex files are in the vdex.
+  uint32_t dex_file = 0;
+  uint32_t type_lookup_table = 0;
+  // The offsets of the ClassInfo of each class.
+  uint32_t class_offsets = 0;
+  // The ClassInfo of each class, with the bitmaps of its compiled methods.
+  uint32_t class_info = 0;
+  // The offsets of the code of the compiled methods.
+  uint32_t method_offsets = 0;
+};
+
+struct OatMemoryReport {
+  uint32_t header = 0;
+  uint32_t key_value_store = 0;
+  std::vector<OatDexMemory> dexes;
+};
+
 class OatFile {
  public:
   enum class Status {
@@ -86,6 +106,12 @@ class OatFile {
 
   virtual Status status() = 0;
 
+  // Empty when the version isn't known, or only the dex files were parsed.
+  virtual OatMemoryReport memory_report() const { return OatMemoryReport(); }
+
+  // Prints memory_report() as JSON.
+  void print_memory_report(size_t file_size) const;
+
   // Return the version number as a string, e.g. "039", "079", etc.
   virtual std::string version_string() const = 0;
 
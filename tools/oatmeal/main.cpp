@@ -48,6 +48,7 @@ struct Arguments {
   bool dump_code = false;
   bool dump_tables = false;
   bool dump_memory_usage = false;
+  bool memory_report = false;
 
   bool print_unverified_classes = false;
 
@@ -101,6 +102,7 @@ Arguments parse_args(int argc, char* argv[]) {
       {"samsung-oatformat", no_argument, nullptr, 2},
       {"one-oat-per-dex", no_argument, nullptr, 3},
       {"quickening-data", required_argument, nullptr, 'q'},
+      {"memory-report", no_argument, nullptr, 4},
       {nullptr, 0, nullptr, 0}};
 
   Arguments ret;
@@ -187,6 +189,10 @@ Arguments parse_args(int argc, char* argv[]) {
       ret.one_oat_per_dex = true;
       break;
 
+    case 4:
+      ret.memory_report = true;
+      break;
+
     case 'q':
       ret.quick_data_location = expand(optarg);
       break;
@@ -269,7 +275,11 @@ int dump(const Arguments& args) {
   if (*(reinterpret_cast<const uint32_t*>(oatfile_buffer.ptr)) ==
       kVdexMagicNum) {
     auto vdexfile = VdexFile::parse(oatfile_buffer);
-    vdexfile->print();
+    if (args.memory_report) {
+      vdexfile->print_memory_report(oat_file_size);
+    } else {
+      vdexfile->print();
+    }
     return 0;
   }
   auto oatfile =
@@ -284,6 +294,11 @@ int dump(const Arguments& args) {
     return oatfile->created_by_oatmeal();
   }
 
+  if (args.memory_report) {
+    oatfile->print_memory_report(oat_file_size);
+    return oatfile->status() == OatFile::Status::PARSE_SUCCESS ? 0 : 1;
+  }
+
   oatfile->print(
       args.dump_classes, args.dump_tables, args.print_unverified_classes);
 
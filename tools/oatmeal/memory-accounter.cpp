@@ -10,10 +10,15 @@
 
 #include <algorithm>
 #include <cstring>
+#include <mutex>
 #include <vector>
 
 namespace {
 
+// The dex files of an oat file are parsed in parallel, and all mark ranges of
+// the same buffer.
+std::mutex consumed_ranges_mutex;
+
 // This class is a bit of a wart - the oat parsing code was initially written
 // only for exploratory purposes, and MemoryAccounter exists so that we can
 // make sure we've parsed and therefore understood all the bytes in an oat file.
@@ -129,6 +134,7 @@ class MemoryAccounterImpl : public MemoryAccounter {
   void markRangeImpl(uint32_t begin, uint32_t end) {
     CHECK(begin <= end);
     CHECK(end <= buf_.len);
+    std::lock_guard<std::mutex> lock(consumed_ranges_mutex);
     consumed_ranges_.emplace_back(begin, end);
   }
 };
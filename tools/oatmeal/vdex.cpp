@@ -26,7 +26,6 @@ VdexFile::VdexFile(VdexFileHeader& header, ConstBuffer buf) : header_(header) {
       fprintf(stderr, "Bad dex magic\n");
       return;
     }
-    printf("Version %s\n", reinterpret_cast<char*>(&(dex_header.version)));
 
     auto dex_buf = remaining_dexes_buf.truncate(dex_header.file_size);
     dexes_.push_back(dex_buf);
@@ -36,7 +35,6 @@ VdexFile::VdexFile(VdexFileHeader& header, ConstBuffer buf) : header_(header) {
 
 std::unique_ptr<VdexFile> VdexFile::parse(ConstBuffer buf) {
   auto header = VdexFileHeader::parse(buf);
-  header.print();
 
   return std::unique_ptr<VdexFile>(new VdexFile(header, buf));
 }
@@ -44,6 +42,7 @@ std::unique_ptr<VdexFile> VdexFile::parse(ConstBuffer buf) {
 void VdexFile::print() const {
   header_.print();
   for (const auto& e : dex_headers_) {
+    printf("Version %s\n", reinterpret_cast<const char*>(&e.version));
     printf(
         "DexFile: { \
     file_size: 0x%08x(%u), \
@@ -60,3 +59,19 @@ void VdexFile::print() const {
     index++;
   }
 }
+
+void VdexFile::print_memory_report(size_t file_size) const {
+  printf(
+      "{\"file_size\": %zu, \"header\": %zu, \"verifier_deps\": %u, "
+      "\"quickening_info\": %u, \"dexes\": [",
+      file_size,
+      sizeof(VdexFileHeader) + size_of_checksums_section(header_),
+      header_.verifier_deps_size_,
+      header_.quickening_info_size_);
+  for (size_t i = 0; i < dex_headers_.size(); i++) {
+    printf("%s\n  {\"dex_file\": %u}",
+           i == 0 ? "" : ",",
+           dex_headers_[i].file_size);
+  }
+  printf("]}\n");
+}
@@ -66,6 +66,10 @@ class VdexFile {
   static std::unique_ptr<VdexFile> parse(ConstBuffer buf);
   void print() const;
 
+  // Prints the bytes spent on the dex files, the verifier dependencies and
+  // the quickening info as JSON. The last two aren't split by dex file.
+  void print_memory_report(size_t file_size) const;
+
  private:
   VdexFile(VdexFileHeader& header, ConstBuffer buf);
 
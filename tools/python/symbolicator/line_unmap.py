@@ -19,6 +19,9 @@ class PositionMap(object):
     def __init__(self):
         self.string_pool = []
         self.positions = []
+        # Version 3 maps each line to an index into positions; older versions
+        # have one position per line.
+        self.lines = None
 
     @staticmethod
     def read_from(filename):
@@ -28,6 +31,8 @@ class PositionMap(object):
             if magic != 0xFACEB000:
                 raise Exception("Magic number mismatch")
             version = struct.unpack("<L", mapping.read(4))[0]
+            if version == 3:
+                return PositionMap.read_v3(mapping)
             if version not in [1, 2]:
                 raise Exception("Version mismatch")
             spool_count = struct.unpack("<L", mapping.read(4))[0]
@@ -54,8 +59,32 @@ class PositionMap(object):
             logging.info("Unpacked %d map entries from line map", pos_count)
             return pmap
 
+    @staticmethod
+    def read_v3(mapping):
+        spool_count, frame_count, line_count, data_size = struct.unpack(
+            "<LLLL", mapping.read(16)
+        )
+        offsets = struct.unpack(
+            "<%dL" % (spool_count + 1), mapping.read(4 * (spool_count + 1))
+        )
+        data = mapping.read((data_size + 3) & ~3)
+        pmap = PositionMap()
+        for i in range(0, spool_count):
+            pmap.string_pool.append(data[offsets[i] : offsets[i + 1]].decode("ascii"))
+        logging.info("Unpacked %d strings from line map", spool_count)
+        frames = struct.unpack("<%dL" % (5 * frame_count), mapping.read(20 * frame_count))
+        for i in range(0, frame_count):
+            pmap.positions.append(MapEntry._make(frames[5 * i : 5 * i + 5]))
+        pmap.lines = struct.unpack("<%dL" % line_count, mapping.read(4 * line_count))
+        logging.info(
+            "Unpacked %d frames for %d lines from line map", frame_count, line_count
+        )
+        return pmap
+
     def get_stack(self, idx):
         stack = []
+        if self.lines is not None:
+            idx = self.lines[idx] if 0 <= idx < len(self.lines) else -1
         while idx >= 0 and idx < len(self.positions):
             pi = self.positions[idx]
             if pi.class_id is not None:
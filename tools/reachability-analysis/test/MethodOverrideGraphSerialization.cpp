@@ -32,6 +32,7 @@ std::unique_ptr<mog::Graph> generate_graph() {
   graph->add_edge(m1, m3);
   graph->add_edge(m2, m4);
   graph->add_edge(m3, m4);
+  graph->finalize();
 
   return graph;
 }
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "JobServer.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace job_server {
+
+namespace {
+
+[[noreturn]] void fail(const std::string& what) {
+  std::cerr << "error: " << what << ": " << strerror(errno) << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+int listen_on(const std::string& socket_path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "error: socket path is too long: " << socket_path
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fail("cannot create socket");
+  }
+  // A server that went away leaves its socket behind.
+  unlink(socket_path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    fail("cannot bind to " + socket_path);
+  }
+  if (listen(fd, SOMAXCONN) < 0) {
+    fail("cannot listen on " + socket_path);
+  }
+  return fd;
+}
+
+// The arguments of the job, one per line, up to an empty line or the end of
+// the client's writes.
+std::vector<std::string> read_job(int fd) {
+  std::string data;
+  char buffer[4096];
+  while (data.find("\n\n") == std::string::npos) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    data.append(buffer, n);
+  }
+  std::vector<std::string> args;
+  std::istringstream lines(data);
+  std::string line;
+  while (std::getline(lines, line) && !line.empty()) {
+    args.push_back(line);
+  }
+  return args;
+}
+
+void write_all(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    written += n;
+  }
+}
+
+void write_exit_status(int fd, int status) {
+  write_all(fd, "redex-all exit status: " + std::to_string(status) + "\n");
+}
+
+// Runs in a child of the server, so that the server never waits on a job.
+// Returns the arguments of the job in the worker that it forks.
+std::vector<std::string> supervise(int conn) {
+  auto args = read_job(conn);
+  if (args.empty()) {
+    write_all(conn, "error: no arguments\n");
+    write_exit_status(conn, EXIT_FAILURE);
+    _exit(EXIT_FAILURE);
+  }
+
+  pid_t worker = fork();
+  if (worker < 0) {
+    write_all(conn, "error: cannot fork a worker\n");
+    write_exit_status(conn, EXIT_FAILURE);
+    _exit(EXIT_FAILURE);
+  }
+  if (worker == 0) {
+    dup2(conn, STDOUT_FILENO);
+    dup2(conn, STDERR_FILENO);
+    close(conn);
+    return args;
+  }
+
+  int status;
+  while (waitpid(worker, &status, 0) < 0) {
+    if (errno != EINTR) {
+      _exit(EXIT_FAILURE);
+    }
+  }
+  // Like a shell reports the status of a command.
+  write_exit_status(conn, WIFEXITED(status) ? WEXITSTATUS(status)
+                                            : 128 + WTERMSIG(status));
+  close(conn);
+  _exit(EXIT_SUCCESS);
+}
+
+} // namespace
+
+std::vector<std::string> serve(const std::string& socket_path) {
+  int server_fd = listen_on(socket_path);
+  std::cerr << "redex-all: serving jobs on " << socket_path << std::endl;
+  // The supervisors get reaped without waiting for them.
+  signal(SIGCHLD, SIG_IGN);
+  while (true) {
+    int conn = accept(server_fd, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("cannot accept a job");
+    }
+    // Nothing buffered before the fork must get written twice.
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t supervisor = fork();
+    if (supervisor < 0) {
+      fail("cannot fork a supervisor");
+    }
+    if (supervisor == 0) {
+      close(server_fd);
+      signal(SIGCHLD, SIG_DFL);
+      return supervise(conn);
+    }
+    close(conn);
+  }
+}
+
+} // namespace job_server
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * A job server runs many redex-all jobs from a single process, so that the
+ * state that it loads before serving, e.g. the library jars, is loaded once
+ * for all of them.
+ *
+ * Clients connect to a Unix domain socket and send the command-line arguments
+ * of their job, one per line, up to an empty line or the end of their writes.
+ * For each job, the server forks a worker, which inherits the state of the
+ * server copy-on-write, so that nothing the job does leaks into the server or
+ * into other jobs. The output of the worker goes to the client, followed by a
+ * last line "redex-all exit status: <status>" once the worker is done.
+ */
+namespace job_server {
+
+// Listens on the socket at the given path. This only returns in the worker
+// processes, with the arguments of their job.
+std::vector<std::string> serve(const std::string& socket_path);
+
+} // namespace job_server
@@ -5,10 +5,14 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <regex>
 #include <set>
@@ -41,8 +45,11 @@
 #include "DuplicateClasses.h"
 #include "GlobalConfig.h"
 #include "IODIMetadata.h"
+#include "IncrementalState.h"
 #include "InstructionLowering.h"
 #include "JarLoader.h"
+#include "JemallocUtil.h"
+#include "JobServer.h"
 #include "MonitorCount.h"
 #include "NoOptimizationsMatcher.h"
 #include "OptData.h"
@@ -59,11 +66,13 @@
 #include "ToolsCommon.h"
 #include "Walkers.h"
 #include "Warning.h"
+#include "WorkQueue.h"
 
 namespace {
 
 // Do *not* change these values. Many services will break.
 constexpr const char* LINE_NUMBER_MAP = "redex-line-number-map-v2";
+constexpr const char* LINE_NUMBER_MAP_V3 = "redex-line-number-map-v3";
 constexpr const char* DEBUG_LINE_MAP = "redex-debug-line-map-v2";
 constexpr const char* IODI_METADATA = "iodi-metadata";
 constexpr const char* OPT_DECISIONS = "redex-opt-decisions.json";
@@ -87,6 +96,11 @@ struct Arguments {
   Json::Value entry_data;
   boost::optional<int> stop_pass_idx;
   RedexOptions redex_options;
+  // The socket on which to serve jobs, if any.
+  std::string server_socket;
+  // The library jars that a job server loaded before forking the worker of
+  // the job, by path, with their classes.
+  std::map<std::string, Scope> preloaded_jars;
 };
 
 UNUSED void dump_args(const Arguments& args) {
@@ -303,6 +317,12 @@ Arguments parse_args(int argc, char* argv[]) {
       "Note: Be careful to properly escape JSON parameters, e.g., strings must "
       "be quoted.");
   od.add_options()("show-passes", "show registered passes");
+  od.add_options()(
+      "server", po::value<std::string>(),
+      "serve jobs on the given Unix domain socket\n"
+      "  \tThe library jars of the -j and -p options are loaded once, and "
+      "shared by the jobs. A job is the command-line arguments of a run, one "
+      "per line, and gets run in a process of its own.");
   od.add_options()("dex-files", po::value<std::vector<std::string>>(),
                    "dex files");
 
@@ -361,9 +381,13 @@ Arguments parse_args(int argc, char* argv[]) {
     exit(EXIT_SUCCESS);
   }
 
+  if (vm.count("server")) {
+    args.server_socket = vm["server"].as<std::string>();
+  }
+
   if (vm.count("dex-files")) {
     args.dex_files = vm["dex-files"].as<std::vector<std::string>>();
-  } else {
+  } else if (args.server_socket.empty()) {
     std::cerr << "error: no input dex files" << std::endl << std::endl;
     print_usage();
     exit(EXIT_SUCCESS);
@@ -474,8 +498,8 @@ Arguments parse_args(int argc, char* argv[]) {
   }
 
   if (args.stop_pass_idx != boost::none) {
-    // Resize the passes list and append an additional RegAllocPass if its final
-    // pass is not RegAllocPass.
+    // Resize the passes list. The IR code is dumped along with the
+    // intermediate dexes, so nothing needs to run after the last pass.
     auto& passes_list = args.config["redex"]["passes"];
     int idx = *args.stop_pass_idx;
     if (idx < 0 || (size_t)idx > passes_list.size()) {
@@ -485,9 +509,6 @@ Arguments parse_args(int argc, char* argv[]) {
     if (passes_list.size() > (size_t)idx) {
       passes_list.resize(idx);
     }
-    // Append the two passes when `--stop-pass` is enabled.
-    passes_list.append("MakePublicPass");
-    passes_list.append("RegAllocPass");
     if (args.out_dir.empty() || !redex::dir_is_writable(args.out_dir)) {
       std::cerr << "output-ir is empty or not writable" << std::endl;
       exit(EXIT_FAILURE);
@@ -548,6 +569,17 @@ Json::Value get_stats(const dex_stats_t& stats) {
 
   val["instruction_bytes"] = stats.instruction_bytes;
 
+  val["startup_code_items"] = stats.startup_code_items;
+  val["startup_code_bytes"] = stats.startup_code_bytes;
+  val["startup_code_pages"] = stats.startup_code_pages;
+  val["startup_strings"] = stats.startup_strings;
+  val["startup_string_bytes"] = stats.startup_string_bytes;
+  val["startup_string_pages"] = stats.startup_string_pages;
+
+  val["compressed_bytes"] = stats.compressed_bytes;
+  val["code_compressed_bytes"] = stats.code_compressed_bytes;
+  val["string_data_compressed_bytes"] = stats.string_data_compressed_bytes;
+
   val["header_item_count"] = stats.header_item_count;
   val["header_item_bytes"] = stats.header_item_bytes;
   val["string_id_count"] = stats.string_id_count;
@@ -607,6 +639,75 @@ Json::Value get_pass_stats(const PassManager& mgr) {
   return all;
 }
 
+Json::Value get_heap_stats(const jemalloc_util::HeapStats& stats) {
+  Json::Value val;
+  val["allocated"] = (Json::UInt64)stats.allocated;
+  val["active"] = (Json::UInt64)stats.active;
+  val["resident"] = (Json::UInt64)stats.resident;
+  val["mapped"] = (Json::UInt64)stats.mapped;
+  val["retained"] = (Json::UInt64)stats.retained;
+  Json::Value arenas(Json::ValueType::arrayValue);
+  for (const auto& arena : stats.arenas) {
+    Json::Value arena_val;
+    arena_val["index"] = arena.index;
+    arena_val["allocated"] = (Json::UInt64)arena.allocated;
+    arena_val["active"] = (Json::UInt64)arena.active;
+    arena_val["resident"] = (Json::UInt64)arena.resident;
+    arenas.append(arena_val);
+  }
+  val["arenas"] = arenas;
+  return val;
+}
+
+Json::Value get_size_stats(const size_stats::Sample& sample,
+                           const size_stats::Sample& previous) {
+  Json::Value val;
+  auto add = [&](const char* key, size_t value, size_t previous_value) {
+    val[key] = (Json::UInt64)value;
+    val[std::string(key) + "_delta"] =
+        (Json::Int64)value - (Json::Int64)previous_value;
+  };
+  add("classes", sample.classes, previous.classes);
+  add("methods", sample.methods, previous.methods);
+  add("fields", sample.fields, previous.fields);
+  add("instructions", sample.instructions, previous.instructions);
+  add("code_units", sample.code_units, previous.code_units);
+  add("code_strings", sample.code_strings, previous.code_strings);
+  add("estimated_dex_bytes", sample.estimated_dex_bytes,
+      previous.estimated_dex_bytes);
+  return val;
+}
+
+Json::Value get_pass_perf_stats(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::arrayValue);
+  // The changes in size of each pass are relative to the size after the
+  // previous one.
+  auto previous_size = mgr.get_initial_size();
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    const auto& perf = pass_info.perf;
+    Json::Value pass;
+    pass["name"] = pass_info.name;
+    pass["wall_s"] = perf.wall_s;
+    pass["user_cpu_s"] = perf.user_cpu_s;
+    pass["sys_cpu_s"] = perf.sys_cpu_s;
+    pass["parallel_efficiency"] = perf.parallel_efficiency;
+    pass["rss_delta"] = (Json::Int64)perf.rss_delta;
+    pass["peak_rss"] = (Json::UInt64)perf.peak_rss;
+    pass["jemalloc_allocated_delta"] =
+        (Json::Int64)perf.jemalloc_allocated_delta;
+    if (perf.heap_before && perf.heap_after) {
+      pass["jemalloc_before"] = get_heap_stats(*perf.heap_before);
+      pass["jemalloc_after"] = get_heap_stats(*perf.heap_after);
+    }
+    if (pass_info.size && previous_size) {
+      pass["size"] = get_size_stats(*pass_info.size, *previous_size);
+      previous_size = pass_info.size;
+    }
+    all.append(pass);
+  }
+  return all;
+}
+
 Json::Value get_pass_hashes(const PassManager& mgr) {
   Json::Value all(Json::ValueType::objectValue);
   auto initial_hash = mgr.get_initial_hash();
@@ -656,6 +757,24 @@ Json::Value get_times() {
   return list;
 }
 
+Json::Value get_interning_stats(const RedexContext::InterningStats& stats) {
+  Json::Value d;
+  auto add = [&](const char* name, const ConcurrentContainerStats& s) {
+    Json::Value v;
+    v["operations"] = (Json::UInt64)s.num_operations.load();
+    v["contended"] = (Json::UInt64)s.num_contended.load();
+    v["insertions"] = (Json::UInt64)s.num_insertions.load();
+    d[name] = v;
+  };
+  add("strings", stats.strings);
+  add("types", stats.types);
+  add("fields", stats.fields);
+  add("type_lists", stats.type_lists);
+  add("protos", stats.protos);
+  add("methods", stats.methods);
+  return d;
+}
+
 Json::Value get_input_stats(const dex_stats_t& stats,
                             const std::vector<dex_stats_t>& dexes_stats) {
   Json::Value d;
@@ -759,6 +878,50 @@ static void assert_dex_magic_consistency(const std::string& source,
                     source.c_str(), target.c_str());
 }
 
+// The jar paths may each be a colon-separated list of jars.
+std::set<std::string> get_library_jars(const std::set<std::string>& jar_paths) {
+  std::set<std::string> library_jars;
+  for (const auto& jar_path : jar_paths) {
+    std::istringstream jar_stream(jar_path);
+    std::string dependent_jar_path;
+    while (std::getline(jar_stream, dependent_jar_path, ':')) {
+      TRACE(MAIN,
+            2,
+            "Dependent JAR specified on command-line: %s",
+            dependent_jar_path.c_str());
+      library_jars.emplace(dependent_jar_path);
+    }
+  }
+  return library_jars;
+}
+
+/**
+ * Loads the library jars of a job server, which its jobs then share. The
+ * jars that fail to load here are left to the jobs, which load them as usual.
+ */
+void preload_library_jars(Arguments& args) {
+  Timer t("Preload library jars");
+  keep_rules::ProguardConfiguration pg_config;
+  for (const auto& pg_config_path : args.proguard_config_paths) {
+    // The server forks its workers, so it must not start the threads of the
+    // pool, which the workers wouldn't have.
+    keep_rules::proguard_parser::parse_file(pg_config_path, &pg_config,
+                                            /* num_threads */ 1);
+  }
+  const auto& pg_libs = pg_config.libraryjars;
+  args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
+  for (const auto& library_jar : get_library_jars(args.jar_paths)) {
+    TRACE(MAIN, 1, "PRELOADED LIBRARY JAR: %s", library_jar.c_str());
+    Scope classes;
+    if (!load_jar_file(library_jar.c_str(), &classes)) {
+      std::cerr << "warning: library jar could not be preloaded: "
+                << library_jar << std::endl;
+      continue;
+    }
+    args.preloaded_jars.emplace(library_jar, std::move(classes));
+  }
+}
+
 /**
  * Pre processing steps: load dex and configurations
  */
@@ -776,19 +939,7 @@ void redex_frontend(ConfigFiles& conf, /* input */
 
   const auto& pg_libs = pg_config.libraryjars;
   args.jar_paths.insert(pg_libs.begin(), pg_libs.end());
-
-  std::set<std::string> library_jars;
-  for (const auto& jar_path : args.jar_paths) {
-    std::istringstream jar_stream(jar_path);
-    std::string dependent_jar_path;
-    while (std::getline(jar_stream, dependent_jar_path, ':')) {
-      TRACE(MAIN,
-            2,
-            "Dependent JAR specified on command-line: %s",
-            dependent_jar_path.c_str());
-      library_jars.emplace(dependent_jar_path);
-    }
-  }
+  auto library_jars = get_library_jars(args.jar_paths);
 
   DexStore root_store("classes");
   // Only set dex magic to root DexStore since all dex magic
@@ -801,38 +952,36 @@ void redex_frontend(ConfigFiles& conf, /* input */
 
   {
     Timer t("Load classes from dexes");
-    dex_stats_t input_totals;
-    std::vector<dex_stats_t> input_dexes_stats;
+    // The dexes of all stores are loaded together, as a single parallel job.
+    std::vector<std::string> dex_paths;
+    std::vector<size_t> dex_store_indices;
     for (const auto& filename : args.dex_files) {
       if (filename.size() >= 5 &&
           filename.compare(filename.size() - 4, 4, ".dex") == 0) {
         assert_dex_magic_consistency(stores[0].get_dex_magic(),
                                      load_dex_magic_from_dex(filename.c_str()));
-        dex_stats_t dex_stats;
-        DexClasses classes =
-            load_classes_from_dex(filename.c_str(), &dex_stats);
-        input_totals += dex_stats;
-        input_dexes_stats.push_back(dex_stats);
-        stores[0].add_classes(std::move(classes));
+        dex_paths.push_back(filename);
+        dex_store_indices.push_back(0);
       } else {
         DexMetadata store_metadata;
         store_metadata.parse(filename);
-        DexStore store(store_metadata);
+        stores.emplace_back(store_metadata);
         for (const auto& file_path : store_metadata.get_files()) {
           assert_dex_magic_consistency(
               stores[0].get_dex_magic(),
               load_dex_magic_from_dex(file_path.c_str()));
-          dex_stats_t dex_stats;
-          DexClasses classes =
-              load_classes_from_dex(file_path.c_str(), &dex_stats);
-
-          input_totals += dex_stats;
-          input_dexes_stats.push_back(dex_stats);
-          store.add_classes(std::move(classes));
+          dex_paths.push_back(file_path);
+          dex_store_indices.push_back(stores.size() - 1);
         }
-        stores.emplace_back(std::move(store));
       }
     }
+    dex_stats_t input_totals;
+    std::vector<dex_stats_t> input_dexes_stats;
+    auto dexes = load_classes_from_dexes(dex_paths, &input_dexes_stats);
+    for (size_t i = 0; i < dexes.size(); ++i) {
+      input_totals += input_dexes_stats[i];
+      stores[dex_store_indices[i]].add_classes(std::move(dexes[i]));
+    }
     stats["input_stats"] = get_input_stats(input_totals, input_dexes_stats);
   }
 
@@ -843,7 +992,14 @@ void redex_frontend(ConfigFiles& conf, /* input */
 
     for (const auto& library_jar : library_jars) {
       TRACE(MAIN, 1, "LIBRARY JAR: %s", library_jar.c_str());
-      if (!load_jar_file(library_jar.c_str(), &external_classes)) {
+      auto preloaded = args.preloaded_jars.find(library_jar);
+      if (preloaded != args.preloaded_jars.end()) {
+        external_classes.insert(external_classes.end(),
+                                preloaded->second.begin(),
+                                preloaded->second.end());
+        auto abs_path = boost::filesystem::absolute(library_jar);
+        args.entry_data["jars"].append(abs_path.string());
+      } else if (!load_jar_file(library_jar.c_str(), &external_classes)) {
         // Try again with the basedir
         std::string basedir_path =
             pg_config.basedirectory + "/" + library_jar.c_str();
@@ -921,10 +1077,29 @@ void redex_backend(const std::string& output_dir,
     locator_index = new LocatorIndex(make_locator_index(stores));
   }
 
+  // Relative to the output directory, so that it's packaged with the dexes.
+  auto class_locator_index_path =
+      json_config.get("emit_class_locator_index", std::string());
+  if (!class_locator_index_path.empty()) {
+    Timer t("Writing class locator index");
+    boost::filesystem::path path(output_dir);
+    path /= class_locator_index_path;
+    boost::filesystem::create_directories(path.parent_path());
+    std::ofstream out(path.string(), std::ofstream::binary);
+    out << make_class_locator_index(stores);
+    always_assert_log(out, "Cannot write %s", path.string().c_str());
+  }
+
   dex_stats_t output_totals;
   std::vector<dex_stats_t> output_dexes_stats;
 
-  const std::string& line_number_map_filename = conf.metafile(LINE_NUMBER_MAP);
+  // Version 3 of the line map is indexed and shares inlined stacks, but
+  // consumers have to opt into it, so it gets its own file name.
+  size_t line_number_map_version = 2;
+  json_config.get("line_number_map_version", 2, line_number_map_version);
+  const std::string& line_number_map_filename =
+      conf.metafile(line_number_map_version == 3 ? LINE_NUMBER_MAP_V3
+                                                 : LINE_NUMBER_MAP);
   const std::string& debug_line_map_filename = conf.metafile(DEBUG_LINE_MAP);
   const std::string& iodi_metadata_filename = conf.metafile(IODI_METADATA);
 
@@ -933,7 +1108,8 @@ void redex_backend(const std::string& output_dir,
 
   std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(
       dik == DebugInfoKind::NoCustomSymbolication ? ""
-                                                  : line_number_map_filename));
+                                                  : line_number_map_filename,
+      line_number_map_version));
   std::unordered_map<DexMethod*, uint64_t> method_to_id;
   std::unordered_map<DexCode*, std::vector<DebugLineItem>> code_debug_lines;
   IODIMetadata iodi_metadata;
@@ -945,9 +1121,14 @@ void redex_backend(const std::string& output_dir,
     Timer t("Compute initial IODI metadata");
     iodi_metadata.mark_methods(stores);
   }
+  struct DexToWrite {
+    size_t store_number;
+    size_t dex_number;
+    std::string filename;
+  };
+  std::vector<DexToWrite> dexes_to_write;
   for (size_t store_number = 0; store_number < stores.size(); ++store_number) {
     auto& store = stores[store_number];
-    Timer t("Writing optimized dexes");
     for (size_t i = 0; i < store.get_dexen().size(); i++) {
       std::ostringstream ss;
       ss << output_dir << "/" << store.get_name();
@@ -963,27 +1144,71 @@ void redex_backend(const std::string& output_dir,
         ss << (i + 2);
       }
       ss << ".dex";
+      dexes_to_write.push_back({store_number, i, ss.str()});
+    }
+  }
 
-      auto this_dex_stats =
-          write_classes_to_dex(redex_options,
-                               ss.str(),
-                               &store.get_dexen()[i],
-                               locator_index,
-                               store_number,
-                               i,
-                               conf,
-                               pos_mapper.get(),
-                               needs_addresses ? &method_to_id : nullptr,
-                               needs_addresses ? &code_debug_lines : nullptr,
-                               is_iodi(dik) ? &iodi_metadata : nullptr,
-                               stores[0].get_dex_magic(),
-                               post_lowering.get());
-
-      // Excluding primary from post lowering processing.
-      if (post_lowering && !(store.is_root_store() && i == 0)) {
-        post_lowering->run(store.get_dexen()[i]);
-      }
+  {
+    Timer t("Writing optimized dexes");
+    // Every dex being written holds its whole image in memory, so only a few
+    // of them are written at a time. Post-lowering expects them one by one.
+    size_t num_jobs = 4;
+    json_config.get("dex_output_jobs", num_jobs, num_jobs);
+    if (post_lowering) {
+      num_jobs = 1;
+    }
+    num_jobs = std::max<size_t>(
+        1,
+        std::min<size_t>({num_jobs, dexes_to_write.size(),
+                          redex_parallel::default_num_threads()}));
+
+    // Dexes are claimed in order, as DexEmissionOrder requires.
+    DexEmissionOrder emission_order;
+    std::atomic<size_t> next_dex{0};
+    std::vector<dex_stats_t> dexes_stats(dexes_to_write.size());
+    auto wq = workqueue_foreach<size_t>(
+        [&](size_t) {
+          for (size_t seq = next_dex++; seq < dexes_to_write.size();
+               seq = next_dex++) {
+            const auto& dex = dexes_to_write[seq];
+            auto& store = stores[dex.store_number];
+            auto& classes = store.get_dexen()[dex.dex_number];
+            try {
+              dexes_stats[seq] = write_classes_to_dex(
+                  redex_options,
+                  dex.filename,
+                  &classes,
+                  locator_index,
+                  dex.store_number,
+                  dex.dex_number,
+                  conf,
+                  pos_mapper.get(),
+                  needs_addresses ? &method_to_id : nullptr,
+                  needs_addresses ? &code_debug_lines : nullptr,
+                  is_iodi(dik) ? &iodi_metadata : nullptr,
+                  stores[0].get_dex_magic(),
+                  post_lowering.get(),
+                  &emission_order,
+                  seq);
+            } catch (...) {
+              emission_order.abort();
+              throw;
+            }
+
+            // Excluding primary from post lowering processing.
+            if (post_lowering &&
+                !(store.is_root_store() && dex.dex_number == 0)) {
+              post_lowering->run(classes);
+            }
+          }
+        },
+        num_jobs);
+    for (size_t i = 0; i < num_jobs; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
 
+    for (const auto& this_dex_stats : dexes_stats) {
       output_totals += this_dex_stats;
       output_dexes_stats.push_back(this_dex_stats);
     }
@@ -1026,9 +1251,8 @@ void redex_backend(const std::string& output_dir,
 }
 
 void dump_class_method_info_map(const std::string& file_path,
-                                DexStoresVector& stores) {
-  std::ofstream ofs(file_path, std::ofstream::out | std::ofstream::trunc);
-
+                                DexStoresVector& stores,
+                                bool compress) {
   static const char* header =
       "# This map enumerates all class and method sizes and some properties.\n"
       "# To minimize the size, dex location strings are interned.\n"
@@ -1044,8 +1268,7 @@ void dump_class_method_info_map(const std::string& file_path,
       "#   <dex location string index>\n"
       "# M,<class index>,<obfuscated method name>,<deobfuscated method name>,\n"
       "#   <size>,<virtual>,<external>,<concrete>\n"
-      "# I,DEXLOC,<index>,<string>";
-  ofs << header << std::endl;
+      "# I,DEXLOC,<index>,<string>\n";
 
   auto exclude_class_name = [&](const std::string& full_name) {
     const auto dot_pos = full_name.find('.');
@@ -1054,39 +1277,151 @@ void dump_class_method_info_map(const std::string& file_path,
     return full_name.substr(dot_pos + 1);
   };
 
-  auto print = [&](const int cls_idx, const DexMethod* method) {
-    ofs << "M," << cls_idx << "," << exclude_class_name(show(method)) << ","
-        << exclude_class_name(method->get_fully_deobfuscated_name()) << ","
-        << (method->get_dex_code() ? method->get_dex_code()->size() : 0) << ","
-        << method->is_virtual() << "," << method->is_external() << ","
-        << method->is_concrete() << std::endl;
+  auto print = [&](std::string& out, const int cls_idx,
+                   const DexMethod* method) {
+    out += "M,";
+    out += std::to_string(cls_idx);
+    out += ',';
+    out += exclude_class_name(show(method));
+    out += ',';
+    out += exclude_class_name(method->get_fully_deobfuscated_name());
+    out += ',';
+    out += std::to_string(
+        method->get_dex_code() ? method->get_dex_code()->size() : 0);
+    out += ',';
+    out += method->is_virtual() ? '1' : '0';
+    out += ',';
+    out += method->is_external() ? '1' : '0';
+    out += ',';
+    out += method->is_concrete() ? '1' : '0';
+    out += '\n';
   };
 
-  // Interning
-  std::unordered_map<const DexClass*, int /*index*/> class_map;
+  // Interning. The classes are numbered in order, and each dex location gets
+  // printed right before the first class from it.
+  auto scope = build_class_scope(stores);
   std::unordered_map<std::string /*location*/, int /*index*/> dexloc_map;
+  std::vector<int> dexloc_idxs(scope.size());
+  std::vector<bool> first_of_dexloc(scope.size());
+  for (size_t i = 0; i < scope.size(); ++i) {
+    auto it = dexloc_map.emplace(scope[i]->get_location(), dexloc_map.size());
+    dexloc_idxs[i] = it.first->second;
+    first_of_dexloc[i] = it.second;
+  }
 
-  walk::classes(build_class_scope(stores), [&](const DexClass* cls) {
-    const auto& dexloc = cls->get_location();
-    if (!dexloc_map.count(dexloc)) {
-      dexloc_map[dexloc] = dexloc_map.size();
-      ofs << "I,DEXLOC," << dexloc_map[dexloc] << "," << dexloc << std::endl;
+  // Format the classes in parallel, a batch of them per buffer.
+  size_t num_batches = std::min<size_t>(
+      scope.size(), redex_parallel::default_num_threads() * 4);
+  std::vector<std::string> buffers(num_batches);
+  redex_parallel::parallel_for(0, num_batches, [&](size_t batch) {
+    auto& out = buffers[batch];
+    size_t begin = batch * scope.size() / num_batches;
+    size_t end = (batch + 1) * scope.size() / num_batches;
+    // Most classes take less than this.
+    out.reserve((end - begin) * 512);
+    for (size_t cls_idx = begin; cls_idx < end; ++cls_idx) {
+      const DexClass* cls = scope[cls_idx];
+      const auto& dexloc = cls->get_location();
+      if (first_of_dexloc[cls_idx]) {
+        out += "I,DEXLOC,";
+        out += std::to_string(dexloc_idxs[cls_idx]);
+        out += ',';
+        out += dexloc;
+        out += '\n';
+      }
+      out += "C,";
+      out += std::to_string(cls_idx);
+      out += ',';
+      out += show(cls);
+      out += ',';
+      out += show_deobfuscated(cls);
+      out += ',';
+      out += std::to_string(cls->get_dmethods().size() +
+                            cls->get_vmethods().size());
+      out += ',';
+      out += std::to_string(cls->get_vmethods().size());
+      out += ',';
+      out += std::to_string(dexloc_idxs[cls_idx]);
+      out += '\n';
+
+      for (auto dmethod : cls->get_dmethods()) {
+        print(out, cls_idx, dmethod);
+      }
+      for (auto vmethod : cls->get_vmethods()) {
+        print(out, cls_idx, vmethod);
+      }
     }
+  });
 
-    redex_assert(!class_map.count(cls));
-    const int cls_idx = (class_map[cls] = class_map.size());
-    ofs << "C," << cls_idx << "," << show(cls) << "," << show_deobfuscated(cls)
-        << "," << (cls->get_dmethods().size() + cls->get_vmethods().size())
-        << "," << cls->get_vmethods().size() << "," << dexloc_map[dexloc]
-        << std::endl;
+  write_symbol_file(file_path, header, /* append */ false, compress);
+  for (auto& buffer : buffers) {
+    write_symbol_file(file_path, buffer, /* append */ true, compress);
+    std::string().swap(buffer);
+  }
+}
 
-    for (auto dmethod : cls->get_dmethods()) {
-      print(cls_idx, dmethod);
-    }
-    for (auto vmethod : cls->get_vmethods()) {
-      print(cls_idx, vmethod);
-    }
-  });
+/*
+ * With an incremental_state_dir, fingerprints everything the run depends on,
+ * so that the outputs of an earlier run with the same inputs can be reused.
+ */
+std::unique_ptr<incremental::State> make_incremental_state(
+    const Arguments& args, const DexStoresVector& stores, const char* argv0) {
+  auto state_dir = args.config.get("incremental_state_dir", "").asString();
+  if (state_dir.empty()) {
+    return nullptr;
+  }
+  namespace fs = boost::filesystem;
+  fs::path binary("/proc/self/exe");
+  if (!fs::exists(binary)) {
+    binary = argv0;
+  }
+  if (!fs::exists(binary)) {
+    fprintf(stderr,
+            "[incremental] Cannot find the redex-all binary, so its outputs "
+            "are never reused\n");
+    return nullptr;
+  }
+
+  Timer t("Fingerprinting the inputs");
+  auto state = std::make_unique<incremental::State>(state_dir);
+  state->add_input("redex-all",
+                   std::to_string(fs::file_size(binary)) + ":" +
+                       std::to_string(fs::last_write_time(binary)));
+  // The APK directory changes from run to run, its contents are added below.
+  Json::Value config = args.config;
+  config.removeMember("apk_dir");
+  Json::Value options;
+  args.redex_options.serialize(options);
+  std::ostringstream config_stream;
+  config_stream << config << options;
+  state->add_input("config", config_stream.str());
+  for (const auto& path : args.proguard_config_paths) {
+    state->add_file("proguard:" + path, path);
+  }
+  for (const auto& jar : args.entry_data["jars"]) {
+    state->add_file("jar:" + jar.asString(), jar.asString());
+  }
+
+  // The input dexes are covered by the hashes of their classes, and the
+  // output directory may be inside the APK directory.
+  auto apk_dir = args.config.get("apk_dir", "").asString();
+  if (!apk_dir.empty()) {
+    auto normalized = [](const std::string& path) {
+      return fs::absolute(path).lexically_normal().generic_string();
+    };
+    auto meta_dir = normalized(args.out_dir + "/meta") + "/";
+    auto normalized_state_dir = normalized(state_dir) + "/";
+    state->add_directory(
+        "apk", normalized(apk_dir), [&](const std::string& path) {
+          auto file = fs::path(path).lexically_normal().generic_string();
+          return fs::path(file).extension() == ".dex" ||
+                 file.compare(0, meta_dir.size(), meta_dir) == 0 ||
+                 file.compare(0, normalized_state_dir.size(),
+                              normalized_state_dir) == 0;
+        });
+  }
+  state->add_classes(stores);
+  return state;
 }
 
 } // namespace
@@ -1125,6 +1460,39 @@ __asan_default_options() {
   return kAsanDefaultOptions;
 }
 
+// Defined by MallocDebug.cpp when it is linked in.
+extern "C" __attribute__((__weak__)) bool redex_malloc_debug_is_active();
+
+#if !defined(__has_feature)
+#define __has_feature(x) 0
+#endif
+
+namespace {
+
+/*
+ * Freeing the Redex heap at exit takes seconds on large apps, and the OS
+ * reclaims it anyway. A leak checker needs to see it freed though, so this
+ * is only allowed when none is active.
+ */
+bool can_skip_heap_teardown() {
+#if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
+  return false;
+#else
+  return redex_malloc_debug_is_active == nullptr;
+#endif
+}
+
+// Ends the process without running destructors or atexit handlers, after
+// flushing everything buffered in the standard streams.
+[[noreturn]] void exit_without_teardown() {
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(nullptr);
+  std::_Exit(0);
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
   signal(SIGSEGV, crash_backtrace_handler);
   signal(SIGABRT, crash_backtrace_handler);
@@ -1134,10 +1502,38 @@ int main(int argc, char* argv[]) {
 #endif
 
   std::string stats_output_path;
+  std::string trace_events_output_path;
   Json::Value stats;
-  {
-    Timer redex_all_main_timer("redex-all main()");
+  std::unique_ptr<incremental::State> incremental_state;
+  std::string output_dir;
+  bool fast_exit = false;
+  // Written last, so that the time and memory stats cover the whole run.
+  auto write_final_outputs = [&]() {
+    stats["output_stats"]["time_stats"] = get_times();
+    auto vm_stats = get_mem_stats();
+    stats["output_stats"]["mem_stats"]["vm_peak"] =
+        (Json::UInt64)vm_stats.vm_peak;
+    stats["output_stats"]["mem_stats"]["vm_hwm"] =
+        (Json::UInt64)vm_stats.vm_peak;
+    {
+      std::ofstream out(stats_output_path);
+      out << stats;
+    }
+    if (!trace_events_output_path.empty()) {
+      std::ofstream out(trace_events_output_path);
+      trace_events::write_json(out);
+    }
+    if (incremental_state) {
+      Timer t("Saving the incremental state");
+      incremental_state->save(output_dir);
+    }
 
+    TRACE(MAIN, 1, "Done.");
+    TRACE(MAIN, 1, "Memory stats: VmPeak=%s VmHWM=%s",
+          pretty_bytes(vm_stats.vm_peak).c_str(),
+          pretty_bytes(vm_stats.vm_hwm).c_str());
+  };
+  {
     g_redex = new RedexContext();
 
     // Currently there are two sources that specify the library jars:
@@ -1151,14 +1547,62 @@ int main(int argc, char* argv[]) {
     // TODO: Make the command line -jarpath option like a colon separated
     //       list of library JARS.
     Arguments args = parse_args(argc, argv);
+    if (!args.server_socket.empty()) {
+#ifdef _MSC_VER
+      std::cerr << "error: --server is not supported on Windows" << std::endl;
+      return EXIT_FAILURE;
+#else
+      preload_library_jars(args);
+      // Only the workers get back here, each with the arguments of its job.
+      auto job = job_server::serve(args.server_socket);
+      std::vector<char*> job_argv{argv[0]};
+      for (auto& arg : job) {
+        job_argv.push_back(&arg[0]);
+      }
+      auto preloaded_jars = std::move(args.preloaded_jars);
+      args = parse_args(job_argv.size(), job_argv.data());
+      if (!args.server_socket.empty()) {
+        std::cerr << "error: a job cannot serve jobs" << std::endl;
+        return EXIT_FAILURE;
+      }
+      args.preloaded_jars = std::move(preloaded_jars);
+#endif
+    }
+    // The time of a job starts in its worker.
+    auto redex_all_main_timer = std::make_unique<Timer>("redex-all main()");
 
     RedexContext::set_record_keep_reasons(
         args.config.get("record_keep_reasons", false).asBool());
+    RedexContext::set_record_interning_stats(
+        args.config.get("record_interning_stats", false).asBool());
+    RedexContext::set_lazy_balloon(
+        args.config.get("lazy_balloon", false).asBool());
+    RedexContext::set_map_dex_strings(
+        args.config.get("map_dex_strings", false).asBool());
+    fast_exit =
+        args.config.get("fast_exit", false).asBool() && can_skip_heap_teardown();
+    // Tracing starts as early as possible; the output path is only resolved
+    // once the output directory is known.
+    if (!args.config.get("trace_events_output", "").asString().empty()) {
+      trace_events::enable();
+    }
 
     auto pg_config = std::make_unique<keep_rules::ProguardConfiguration>();
     DexStoresVector stores;
     ConfigFiles conf(args.config, args.out_dir);
 
+    if (conf.get_json_config().contains("jemalloc_arenas")) {
+      JsonWrapper arenas_config(conf.get_json_config()["jemalloc_arenas"]);
+      jemalloc_util::ArenaConfig arena_config;
+      arenas_config.get("background_thread", false,
+                        arena_config.background_thread);
+      arenas_config.get("dirty_decay_ms", arena_config.dirty_decay_ms,
+                        arena_config.dirty_decay_ms);
+      arenas_config.get("muzzy_decay_ms", arena_config.muzzy_decay_ms,
+                        arena_config.muzzy_decay_ms);
+      jemalloc_util::configure_arenas(arena_config);
+    }
+
     std::string apk_dir;
     conf.get_json_config().get("apk_dir", "", apk_dir);
     const std::string& manifest_filename = apk_dir + "/AndroidManifest.xml";
@@ -1169,6 +1613,15 @@ int main(int argc, char* argv[]) {
 
     redex_frontend(conf, args, *pg_config, stores, stats);
 
+    output_dir = args.out_dir;
+    if (args.stop_pass_idx == boost::none) {
+      incremental_state = make_incremental_state(args, stores, argv[0]);
+      if (incremental_state && incremental_state->restore(args.out_dir)) {
+        delete g_redex;
+        return 0;
+      }
+    }
+
     auto const& passes = PassRegistry::get().get_passes();
     PassManager manager(passes, std::move(pg_config), args.config,
                         args.redex_options);
@@ -1181,8 +1634,12 @@ int main(int argc, char* argv[]) {
       // Call redex_backend by default
       redex_backend(args.out_dir, conf, manager, stores, stats);
       if (args.config.get("emit_class_method_info_map", false).asBool()) {
-        dump_class_method_info_map(conf.metafile(CLASS_METHOD_INFO_MAP),
-                                   stores);
+        Timer t("Writing class method info map");
+        bool compress =
+            args.config.get("compress_symbol_files", false).asBool();
+        dump_class_method_info_map(
+            conf.metafile(CLASS_METHOD_INFO_MAP) + (compress ? ".gz" : ""),
+            stores, compress);
       }
     } else {
       redex::write_all_intermediate(conf, args.out_dir, args.redex_options,
@@ -1191,26 +1648,33 @@ int main(int argc, char* argv[]) {
 
     stats_output_path = conf.metafile(
         args.config.get("stats_output", "redex-stats.txt").asString());
+    if (trace_events::is_enabled()) {
+      trace_events_output_path =
+          conf.metafile(args.config["trace_events_output"].asString());
+    }
+    {
+      std::ofstream out(conf.metafile(
+          args.config.get("pass_perf_output", "redex-pass-perf.json")
+              .asString()));
+      out << get_pass_perf_stats(manager);
+    }
+    if (RedexContext::record_interning_stats()) {
+      stats["output_stats"]["interning_stats"] =
+          get_interning_stats(g_redex->interning_stats());
+    }
+    if (fast_exit) {
+      // Neither g_redex nor the stores, the pass manager and the rest of this
+      // scope are destroyed.
+      redex_all_main_timer.reset();
+      write_final_outputs();
+      exit_without_teardown();
+    }
     {
       Timer t("Freeing global memory");
       delete g_redex;
     }
   }
   // now that all the timers are done running, we can collect the data
-  stats["output_stats"]["time_stats"] = get_times();
-  auto vm_stats = get_mem_stats();
-  stats["output_stats"]["mem_stats"]["vm_peak"] =
-      (Json::UInt64)vm_stats.vm_peak;
-  stats["output_stats"]["mem_stats"]["vm_hwm"] = (Json::UInt64)vm_stats.vm_peak;
-  {
-    std::ofstream out(stats_output_path);
-    out << stats;
-  }
-
-  TRACE(MAIN, 1, "Done.");
-  TRACE(MAIN, 1, "Memory stats: VmPeak=%s VmHWM=%s",
-        pretty_bytes(vm_stats.vm_peak).c_str(),
-        pretty_bytes(vm_stats.vm_hwm).c_str());
-
+  write_final_outputs();
   return 0;
 }
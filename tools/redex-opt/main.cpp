@@ -86,10 +86,6 @@ Json::Value process_entry_data(const Json::Value& entry_data,
   for (const std::string& pass_name : args.pass_names) {
     passes_list.append(pass_name);
   }
-  int len = config_data["redex"]["passes"].size();
-  if (len == 0 || passes_list[len - 1].asString() != "RegAllocPass") {
-    passes_list.append("RegAllocPass");
-  }
 
   // apk_dir
   if (entry_data.isMember("apk_dir")) {
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include "Hprof.h"
+#include "Tool.h"
+
+/*
+ * This tool lists the classes that were loaded when a heap dump was taken, in
+ * the order in which they were loaded. It prints the same list as
+ * tools/hprof/dump_classes_from_hprof.py, but streams the dump instead of
+ * loading all of its objects:
+ *
+ * com/facebook/Foo.class
+ * com/facebook/Bar.class
+ * ...
+ *
+ * With --descriptors, it prints the classes as type descriptors instead, as
+ * they appear in the reachability graphs of Redex:
+ *
+ * Lcom/facebook/Foo;
+ * Lcom/facebook/Bar;
+ * ...
+ */
+namespace {
+
+void dump_classes(std::ostream& os,
+                  const std::vector<hprof::LoadedClass>& classes,
+                  bool descriptors) {
+  for (const auto& cls : classes) {
+    if (descriptors) {
+      os << hprof::java_name_to_descriptor(cls.name) << "\n";
+    } else {
+      for (auto c : cls.name) {
+        os << (c == '.' ? '/' : c);
+      }
+      os << ".class\n";
+    }
+  }
+}
+
+class HprofClasses : public Tool {
+ public:
+  HprofClasses()
+      : Tool("hprof-classes", "list the classes loaded in a heap dump") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "hprof",
+        po::value<std::string>()->value_name("heap.hprof")->required(),
+        "path to the heap dump")(
+        "descriptors", "print type descriptors rather than class file names")(
+        "output,o",
+        po::value<std::string>()->value_name("classes.txt"),
+        "path to output class list file (defaults to stdout)");
+  }
+
+  void run(const po::variables_map& options) override {
+    std::ifstream hprof(options["hprof"].as<std::string>(), std::ios::binary);
+    if (!hprof.is_open()) {
+      std::cerr << "error: cannot open " << options["hprof"].as<std::string>()
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    auto classes = hprof::read_loaded_classes(hprof);
+    bool descriptors = options.count("descriptors");
+
+    if (options.count("output")) {
+      std::ofstream ofs(options["output"].as<std::string>(),
+                        std::ofstream::out | std::ofstream::trunc);
+      dump_classes(ofs, classes, descriptors);
+    } else {
+      dump_classes(std::cout, classes, descriptors);
+    }
+  }
+};
+
+static HprofClasses s_tool;
+
+} // namespace
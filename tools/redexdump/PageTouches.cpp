@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DexEncoding.h"
+#include "PrintUtil.h"
+#include "RedexDump.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Replays a coldstart trace against the layout of a dex file and counts the
+ * distinct pages of each data section the trace touches. Each line of the
+ * trace names either a class ("Lcom/Foo;") or a method
+ * ("Lcom/Foo;.bar:(I)V"); empty lines and lines starting with '#' are
+ * ignored.
+ *
+ * Loading a class touches its class_data_item and the string_data of its
+ * descriptor; running a method touches its whole code_item (instructions,
+ * tries and handlers) and the string_data of its name.
+ */
+
+namespace {
+
+constexpr uint32_t PAGE_SIZE = 4096;
+
+struct Section {
+  const char* name;
+  uint16_t type;
+  std::unordered_set<uint32_t> pages;
+};
+
+struct TracedMethod {
+  uint32_t code_off;
+  uint32_t name_idx;
+};
+
+struct TracedClass {
+  uint32_t class_data_begin;
+  uint32_t class_data_end;
+  uint32_t name_idx;
+};
+
+void touch(Section* section, uint32_t begin, uint32_t end) {
+  if (begin >= end) {
+    return;
+  }
+  for (uint32_t page = begin / PAGE_SIZE; page <= (end - 1) / PAGE_SIZE;
+       ++page) {
+    section->pages.insert(page);
+  }
+}
+
+std::string method_descriptor(ddump_data* rd, uint32_t idx) {
+  std::ostringstream ss;
+  const dex_method_id* method = rd->dex_method_ids + idx;
+  const dex_proto_id* proto = rd->dex_proto_ids + method->protoidx;
+  ss << dex_string_by_type_idx(rd, method->classidx) << "."
+     << dex_string_by_idx(rd, method->nameidx) << ":(";
+  if (proto->param_off) {
+    const uint32_t* tl = (const uint32_t*)(rd->dexmmap + proto->param_off);
+    uint32_t count = *tl++;
+    const uint16_t* types = (const uint16_t*)tl;
+    for (uint32_t i = 0; i < count; i++) {
+      ss << dex_string_by_type_idx(rd, types[i]);
+    }
+  }
+  ss << ")" << dex_string_by_type_idx(rd, proto->rtypeidx);
+  return ss.str();
+}
+
+uint32_t type_string_idx(ddump_data* rd, uint16_t typeidx) {
+  const uint32_t* tptr =
+      (const uint32_t*)(rd->dexmmap + rd->dexh->type_ids_off);
+  return tptr[typeidx];
+}
+
+// The end of a string_data_item: its uleb128 length, then the MUTF-8 bytes
+// up to and including the terminating NUL.
+uint32_t string_data_end(ddump_data* rd, uint32_t idx) {
+  const char* begin = dex_raw_string_by_idx(rd, idx);
+  const char* data = dex_string_by_idx(rd, idx);
+  return (begin - rd->dexmmap) + (data - begin) + strlen(data) + 1;
+}
+
+uint32_t code_item_end(ddump_data* rd, uint32_t code_off) {
+  const dex_code_item* code_item =
+      (const dex_code_item*)(rd->dexmmap + code_off);
+  const uint16_t* insns = (const uint16_t*)(code_item + 1);
+  const uint8_t* end = (const uint8_t*)(insns + code_item->insns_size);
+  if (code_item->tries_size) {
+    if (code_item->insns_size & 1) end += sizeof(uint16_t);
+    const dex_tries_item* tries = (const dex_tries_item*)end;
+    const uint8_t* handlers = (const uint8_t*)(tries + code_item->tries_size);
+    // The handler list is a count followed by the handlers themselves.
+    const uint8_t* cur = handlers;
+    uint32_t handlers_size = read_uleb128(&cur);
+    for (uint32_t i = 0; i < handlers_size; i++) {
+      int32_t size = read_sleb128(&cur);
+      for (int32_t j = 0; j < abs(size); j++) {
+        read_uleb128(&cur); // type_idx
+        read_uleb128(&cur); // addr
+      }
+      if (size <= 0) {
+        read_uleb128(&cur); // catch_all_addr
+      }
+    }
+    end = cur;
+  }
+  return end - (const uint8_t*)rd->dexmmap;
+}
+
+void read_methods(ddump_data* rd,
+                  const uint8_t** class_data,
+                  uint32_t count,
+                  std::unordered_map<std::string, TracedMethod>* methods) {
+  uint32_t meth_idx = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    meth_idx += read_uleb128(class_data);
+    read_uleb128(class_data); // access_flags
+    auto code_off = read_uleb128(class_data);
+    (*methods)[method_descriptor(rd, meth_idx)] = {
+        code_off, rd->dex_method_ids[meth_idx].nameidx};
+  }
+}
+
+} // namespace
+
+void dump_page_touches(ddump_data* rd, const char* trace_file) {
+  std::unordered_map<std::string, TracedClass> classes;
+  std::unordered_map<std::string, TracedMethod> methods;
+  const dex_class_def* class_defs =
+      (const dex_class_def*)(rd->dexmmap + rd->dexh->class_defs_off);
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    const auto& class_def = class_defs[i];
+    TracedClass traced{0, 0, type_string_idx(rd, class_def.typeidx)};
+    if (class_def.class_data_offset) {
+      const uint8_t* class_data =
+          (const uint8_t*)(rd->dexmmap + class_def.class_data_offset);
+      uint32_t sfield_count = read_uleb128(&class_data);
+      uint32_t ifield_count = read_uleb128(&class_data);
+      uint32_t dmethod_count = read_uleb128(&class_data);
+      uint32_t vmethod_count = read_uleb128(&class_data);
+      for (uint32_t j = 0; j < 2 * (sfield_count + ifield_count); j++) {
+        read_uleb128(&class_data);
+      }
+      read_methods(rd, &class_data, dmethod_count, &methods);
+      read_methods(rd, &class_data, vmethod_count, &methods);
+      traced.class_data_begin = class_def.class_data_offset;
+      traced.class_data_end = class_data - (const uint8_t*)rd->dexmmap;
+    }
+    classes[dex_string_by_type_idx(rd, class_def.typeidx)] = traced;
+  }
+
+  Section code{"code_item", TYPE_CODE_ITEM, {}};
+  Section strings{"string_data", TYPE_STRING_DATA_ITEM, {}};
+  Section class_data{"class_data", TYPE_CLASS_DATA_ITEM, {}};
+  size_t traced_classes = 0;
+  size_t traced_methods = 0;
+  size_t unknown = 0;
+  std::ifstream trace(trace_file);
+  if (!trace) {
+    fprintf(stderr, "cannot open trace file %s\n", trace_file);
+    return;
+  }
+  std::string line;
+  while (std::getline(trace, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    auto cls_it = classes.find(line);
+    if (cls_it != classes.end()) {
+      const auto& traced = cls_it->second;
+      touch(&class_data, traced.class_data_begin, traced.class_data_end);
+      touch(&strings,
+            rd->dex_string_ids[traced.name_idx].offset,
+            string_data_end(rd, traced.name_idx));
+      ++traced_classes;
+      continue;
+    }
+    auto meth_it = methods.find(line);
+    if (meth_it != methods.end()) {
+      const auto& traced = meth_it->second;
+      if (traced.code_off) {
+        touch(&code, traced.code_off, code_item_end(rd, traced.code_off));
+      }
+      touch(&strings,
+            rd->dex_string_ids[traced.name_idx].offset,
+            string_data_end(rd, traced.name_idx));
+      ++traced_methods;
+      continue;
+    }
+    ++unknown;
+  }
+
+  redump("\nPAGE TOUCHES: %s\n", trace_file);
+  redump("classes: %zu, methods: %zu, not in this dex: %zu\n",
+         traced_classes,
+         traced_methods,
+         unknown);
+  for (const auto* section : {&code, &strings, &class_data}) {
+    uint32_t total = 0;
+    if (get_dex_map_item(rd, section->type) != nullptr) {
+      uint32_t start = 0;
+      uint32_t end = 0;
+      get_type_extent(rd, section->type, start, end);
+      if (end == 0) {
+        end = rd->dex_size;
+      }
+      total = (end - 1) / PAGE_SIZE - start / PAGE_SIZE + 1;
+    }
+    redump("%s: %zu of %u pages touched\n",
+           section->name,
+           section->pages.size(),
+           total);
+  }
+}
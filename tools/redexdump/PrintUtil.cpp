@@ -13,25 +13,59 @@ bool clean = false;
 bool raw = false;
 bool escape = false;
 
+namespace {
+
+thread_local std::string* t_sink = nullptr;
+
+void vredump(const char* format, va_list va) {
+  if (t_sink == nullptr) {
+    vprintf(format, va);
+    return;
+  }
+  va_list copy;
+  va_copy(copy, va);
+  int size = vsnprintf(nullptr, 0, format, copy);
+  va_end(copy);
+  if (size <= 0) {
+    return;
+  }
+  auto old_size = t_sink->size();
+  // vsnprintf always writes the terminating NUL, make room for it.
+  t_sink->resize(old_size + size + 1);
+  vsnprintf(&(*t_sink)[old_size], size + 1, format, va);
+  t_sink->resize(old_size + size);
+}
+
+void predump(const char* format, ...) {
+  va_list va;
+  va_start(va, format);
+  vredump(format, va);
+  va_end(va);
+}
+
+} // namespace
+
+void redump_to(std::string* sink) { t_sink = sink; }
+
 void redump(const char* format, ...) {
   va_list va;
   va_start(va, format);
-  vprintf(format, va);
+  vredump(format, va);
   va_end(va);
 }
 
 void redump(uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("[0x%x] ", off);
-  vprintf(format, va);
+  if (!clean) predump("[0x%x] ", off);
+  vredump(format, va);
   va_end(va);
 }
 
 void redump(uint32_t pos, uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("(0x%x) [0x%x] ", pos, off);
-  vprintf(format, va);
+  if (!clean) predump("(0x%x) [0x%x] ", pos, off);
+  vredump(format, va);
   va_end(va);
 }
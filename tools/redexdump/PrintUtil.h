@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 
 extern bool clean;
 extern bool raw;
@@ -16,3 +17,10 @@ extern bool escape;
 void redump(const char* format, ...);
 void redump(uint32_t off, const char* format, ...);
 void redump(uint32_t pos, uint32_t off, const char* format, ...);
+
+/*
+ * Send the output of redump on the calling thread to `sink` rather than to
+ * stdout, until it's called again with nullptr. redexdump uses this to dump
+ * several dexes at once and still print them in the order they were given.
+ */
+void redump_to(std::string* sink);
@@ -6,10 +6,17 @@
  */
 
 #include "RedexDump.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <getopt.h>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "Formatters.h"
 #include "PrintUtil.h"
@@ -43,14 +50,20 @@ static const char ddump_usage_string[] =
     "-A, --anno: print items in the annotation section\n"
     "-d, --debug: print debug info items in the data section\n"
     "-D, --ddebug=<addr>: disassemble debug info item at <addr>\n"
+    "-P, --page-touches=<trace>: count the pages of code, string data and "
+    "class data touched by the classes and methods listed in <trace>\n"
+    "--summary: print the number of items and bytes in each section\n"
     "\n"
     "printing options:\n"
+    "-j, --jobs=<n>: dump up to <n> dex files at once, the output is still "
+    "in the order the files are given (default: number of cores)\n"
     "--clean: suppress indices and offsets\n"
     "--no-headers: suppress headers\n"
     "--raw: print all bytes, even control characters\n";
 
-int main(int argc, char* argv[]) {
+namespace {
 
+struct DumpOptions {
   bool all = false;
   bool string = false;
   bool stringdata = false;
@@ -67,7 +80,130 @@ int main(int argc, char* argv[]) {
   bool anno = false;
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
+  const char* page_touches_trace = nullptr;
+  int summary = 0;
   int no_headers = 0;
+};
+
+void dump_dex(const char* dexfile, const DumpOptions& opts) {
+  ddump_data rd;
+  open_dex_file(dexfile, &rd);
+  bool print_headers = !opts.no_headers;
+  if (opts.summary) {
+    redump("\nSUMMARY: %s\n", dexfile);
+    redump("%s", format_map_summary(&rd).c_str());
+  } else if (print_headers) {
+    redump(format_map(&rd).c_str());
+  }
+  if (opts.string || opts.all) {
+    dump_strings(&rd, print_headers);
+  }
+  if (opts.stringdata || opts.all) {
+    dump_stringdata(&rd, print_headers);
+  }
+  if (opts.type || opts.all) {
+    dump_types(&rd);
+  }
+  if (opts.proto || opts.all) {
+    dump_protos(&rd, print_headers);
+  }
+  if (opts.field || opts.all) {
+    dump_fields(&rd, print_headers);
+  }
+  if (opts.meth || opts.all) {
+    dump_methods(&rd, print_headers);
+  }
+  if (opts.methodhandle || opts.all) {
+    dump_methodhandles(&rd, print_headers);
+  }
+  if (opts.callsite || opts.all) {
+    dump_callsites(&rd, print_headers);
+  }
+  if (opts.clsdef || opts.all) {
+    dump_clsdefs(&rd, print_headers);
+  }
+  if (opts.clsdata || opts.all) {
+    dump_clsdata(&rd, print_headers);
+  }
+  if (opts.code || opts.all) {
+    dump_code(&rd);
+  }
+  if (opts.enarr || opts.all) {
+    dump_enarr(&rd);
+  }
+  if (opts.anno || opts.all) {
+    dump_anno(&rd);
+  }
+
+  if (opts.redexdump_debug || opts.all) {
+    dump_debug(&rd);
+  }
+  if (opts.ddebug_offset != 0) {
+    disassemble_debug(&rd, opts.ddebug_offset);
+  }
+  if (opts.page_touches_trace != nullptr) {
+    dump_page_touches(&rd, opts.page_touches_trace);
+  }
+  redump("\n");
+}
+
+/*
+ * Each worker dumps the next dex that nobody has picked up yet into its own
+ * buffer, while the main thread prints the buffers in order as soon as they
+ * are complete, so the output is the same as when dumping one at a time.
+ */
+void dump_dexes(const std::vector<const char*>& dexfiles,
+                const DumpOptions& opts,
+                size_t jobs) {
+  if (jobs <= 1 || dexfiles.size() <= 1) {
+    for (auto dexfile : dexfiles) {
+      dump_dex(dexfile, opts);
+      fflush(stdout);
+    }
+    return;
+  }
+
+  std::vector<std::string> outputs(dexfiles.size());
+  std::vector<bool> done(dexfiles.size(), false);
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::thread> workers;
+  jobs = std::min(jobs, dexfiles.size());
+  for (size_t j = 0; j < jobs; ++j) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < dexfiles.size(); i = next++) {
+        std::string output;
+        redump_to(&output);
+        dump_dex(dexfiles[i], opts);
+        redump_to(nullptr);
+        std::lock_guard<std::mutex> lock(mutex);
+        outputs[i] = std::move(output);
+        done[i] = true;
+        cv.notify_all();
+      }
+    });
+  }
+  for (size_t i = 0; i < dexfiles.size(); ++i) {
+    std::string output;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() { return done[i]; });
+      output = std::move(outputs[i]);
+    }
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  DumpOptions opts;
+  size_t jobs = std::max(1u, std::thread::hardware_concurrency());
 
   char c;
   static const struct option options[] = {
@@ -87,64 +223,73 @@ int main(int argc, char* argv[]) {
       {"anno", no_argument, nullptr, 'A'},
       {"debug", no_argument, nullptr, 'd'},
       {"ddebug", required_argument, nullptr, 'D'},
+      {"page-touches", required_argument, nullptr, 'P'},
       {"clean", no_argument, (int*)&clean, 1},
       {"raw", no_argument, (int*)&raw, 1},
       {"escape", no_argument, (int*)&escape, 1},
-      {"no-headers", no_argument, &no_headers, 1},
+      {"summary", no_argument, &opts.summary, 1},
+      {"jobs", required_argument, nullptr, 'j'},
+      {"no-headers", no_argument, &opts.no_headers, 1},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, 0, nullptr, 0},
   };
 
-  while ((c = getopt_long(argc, argv, "asStpfmcCxeAdDh", &options[0],
+  while ((c = getopt_long(argc, argv, "asStpfmcCxeAdDP:j:h", &options[0],
                           nullptr)) != -1) {
     switch (c) {
       case 'a':
-        all = true;
+        opts.all = true;
         break;
       case 's':
-        string = true;
+        opts.string = true;
         break;
       case 'S':
-        stringdata = true;
+        opts.stringdata = true;
         break;
       case 't':
-        type = true;
+        opts.type = true;
         break;
       case 'p':
-        proto = true;
+        opts.proto = true;
         break;
       case 'f':
-        field = true;
+        opts.field = true;
         break;
       case 'm':
-        meth = true;
+        opts.meth = true;
         break;
       case 'H':
-        methodhandle = true;
+        opts.methodhandle = true;
         break;
       case 'k':
-        callsite = true;
+        opts.callsite = true;
         break;
       case 'c':
-        clsdef = true;
+        opts.clsdef = true;
         break;
       case 'C':
-        clsdata = true;
+        opts.clsdata = true;
         break;
       case 'x':
-        code = true;
+        opts.code = true;
         break;
       case 'e':
-        enarr = true;
+        opts.enarr = true;
         break;
       case 'A':
-        anno = true;
+        opts.anno = true;
         break;
       case 'd':
-        redexdump_debug = true;
+        opts.redexdump_debug = true;
         break;
       case 'D':
-        sscanf(optarg, "%x", &ddebug_offset);
+        sscanf(optarg, "%x", &opts.ddebug_offset);
+        break;
+      case 'P':
+        opts.page_touches_trace = optarg;
+        break;
+      case 'j':
+        jobs = std::max(1, atoi(optarg));
         break;
       case 'h':
         puts(ddump_usage_string);
@@ -164,62 +309,8 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  while (optind < argc) {
-    const char* dexfile = argv[optind++];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-    if (!no_headers) {
-      redump(format_map(&rd).c_str());
-    }
-    if (string || all) {
-      dump_strings(&rd, !no_headers);
-    }
-    if (stringdata || all) {
-      dump_stringdata(&rd, !no_headers);
-    }
-    if (type || all) {
-      dump_types(&rd);
-    }
-    if (proto || all) {
-      dump_protos(&rd, !no_headers);
-    }
-    if (field || all) {
-      dump_fields(&rd, !no_headers);
-    }
-    if (meth || all) {
-      dump_methods(&rd, !no_headers);
-    }
-    if (methodhandle || all) {
-      dump_methodhandles(&rd, !no_headers);
-    }
-    if (callsite || all) {
-      dump_callsites(&rd, !no_headers);
-    }
-    if (clsdef || all) {
-      dump_clsdefs(&rd, !no_headers);
-    }
-    if (clsdata || all) {
-      dump_clsdata(&rd, !no_headers);
-    }
-    if (code || all) {
-      dump_code(&rd);
-    }
-    if (enarr || all) {
-      dump_enarr(&rd);
-    }
-    if (anno || all) {
-      dump_anno(&rd);
-    }
-
-    if (redexdump_debug || all) {
-      dump_debug(&rd);
-    }
-    if (ddebug_offset != 0) {
-      disassemble_debug(&rd, ddebug_offset);
-    }
-    fprintf(stdout, "\n");
-    fflush(stdout);
-  }
+  std::vector<const char*> dexfiles(argv + optind, argv + argc);
+  dump_dexes(dexfiles, opts, jobs);
 
   return 0;
 }
@@ -9,7 +9,12 @@
 #include <dlfcn.h>
 #endif
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
 #include "Debug.h"
+#include "JemallocUtil.h"
 
 extern "C" {
 
@@ -36,6 +41,29 @@ void set_profile_active(bool active) {
   always_assert_log(err == 0, "mallctl failed with: %d", err);
 }
 
+// The stats are a snapshot taken at the last epoch; bump it to refresh them.
+bool refresh_stats() {
+  uint64_t epoch = 1;
+  size_t epoch_len = sizeof(epoch);
+  return mallctl("epoch", &epoch, &epoch_len, &epoch, epoch_len) == 0;
+}
+
+template <typename T>
+bool read_value(const std::string& name, T* value) {
+  size_t len = sizeof(T);
+  return mallctl(name.c_str(), value, &len, nullptr, 0) == 0;
+}
+
+template <typename T>
+void write_value(const std::string& name, T value) {
+  int err = mallctl(name.c_str(), nullptr, nullptr, (void*)&value, sizeof(T));
+  always_assert_log(err == 0, "mallctl %s failed with: %d", name.c_str(), err);
+}
+
+// Stands for all arenas in "arena.<i>.*" names. This is MALLCTL_ARENAS_ALL,
+// which we cannot include as jemalloc is not a build dependency.
+constexpr unsigned ALL_ARENAS = 4096;
+
 } // namespace
 
 namespace jemalloc_util {
@@ -44,4 +72,82 @@ void enable_profiling() { set_profile_active(true); }
 
 void disable_profiling() { set_profile_active(false); }
 
+size_t get_allocated_bytes() {
+  if (mallctl == nullptr || !refresh_stats()) {
+    return 0;
+  }
+  size_t allocated = 0;
+  if (!read_value("stats.allocated", &allocated)) {
+    return 0;
+  }
+  return allocated;
+}
+
+bool get_heap_stats(HeapStats* stats) {
+  if (mallctl == nullptr || !refresh_stats()) {
+    return false;
+  }
+  if (!read_value("stats.allocated", &stats->allocated) ||
+      !read_value("stats.active", &stats->active) ||
+      !read_value("stats.resident", &stats->resident) ||
+      !read_value("stats.mapped", &stats->mapped)) {
+    return false;
+  }
+  // Not available before jemalloc 5.
+  read_value("stats.retained", &stats->retained);
+  unsigned narenas = 0;
+  size_t page = 0;
+  if (!read_value("arenas.narenas", &narenas) ||
+      !read_value("arenas.page", &page)) {
+    return false;
+  }
+  stats->arenas.clear();
+  for (unsigned i = 0; i < narenas; ++i) {
+    auto prefix = "stats.arenas." + std::to_string(i) + ".";
+    size_t pactive = 0;
+    ArenaStats arena{i, 0, 0, 0};
+    size_t small = 0, large = 0;
+    // Arenas that were never initialized have no stats.
+    if (!read_value(prefix + "pactive", &pactive) || pactive == 0) {
+      continue;
+    }
+    read_value(prefix + "small.allocated", &small);
+    read_value(prefix + "large.allocated", &large);
+    read_value(prefix + "resident", &arena.resident);
+    arena.allocated = small + large;
+    arena.active = pactive * page;
+    stats->arenas.push_back(arena);
+  }
+  return true;
+}
+
+void purge_arenas() {
+  if (mallctl == nullptr) {
+    return;
+  }
+  auto name = "arena." + std::to_string(ALL_ARENAS) + ".purge";
+  mallctl(name.c_str(), nullptr, nullptr, nullptr, 0);
+}
+
+void configure_arenas(const ArenaConfig& config) {
+  if (mallctl == nullptr) {
+    return;
+  }
+  if (config.background_thread) {
+    write_value("background_thread", true);
+  }
+  auto all_arenas = "arena." + std::to_string(ALL_ARENAS) + ".";
+  if (config.dirty_decay_ms >= -1) {
+    // jemalloc takes an ssize_t.
+    ptrdiff_t decay_ms = config.dirty_decay_ms;
+    write_value("arenas.dirty_decay_ms", decay_ms);
+    write_value(all_arenas + "dirty_decay_ms", decay_ms);
+  }
+  if (config.muzzy_decay_ms >= -1) {
+    ptrdiff_t decay_ms = config.muzzy_decay_ms;
+    write_value("arenas.muzzy_decay_ms", decay_ms);
+    write_value(all_arenas + "muzzy_decay_ms", decay_ms);
+  }
+}
+
 } // namespace jemalloc_util
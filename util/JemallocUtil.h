@@ -5,7 +5,12 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace jemalloc_util {
 
@@ -13,6 +18,54 @@ void enable_profiling();
 
 void disable_profiling();
 
+// Bytes currently allocated by the application, as tracked by jemalloc. Zero
+// when we are not running on top of jemalloc, or it was built without stats.
+size_t get_allocated_bytes();
+
+struct ArenaStats {
+  unsigned index;
+  size_t allocated;
+  size_t active;
+  size_t resident;
+};
+
+struct HeapStats {
+  size_t allocated{0};
+  size_t active{0};
+  size_t resident{0};
+  size_t mapped{0};
+  size_t retained{0};
+  // Only the arenas that hold any active pages.
+  std::vector<ArenaStats> arenas;
+};
+
+// Returns false when we are not running on top of jemalloc, or it was built
+// without stats.
+bool get_heap_stats(HeapStats* stats);
+
+/*
+ * Tuning of the arenas that can be changed while running. The number of
+ * arenas and per-CPU arenas can only be set when jemalloc starts, through
+ * MALLOC_CONF.
+ */
+struct ArenaConfig {
+  // Purge unused pages from background threads instead of from the
+  // allocating threads. Left as is when false.
+  bool background_thread{false};
+  // How long unused pages are kept before being purged, in milliseconds, or
+  // -1 to keep them forever. Negative values below -1 leave jemalloc's own
+  // settings untouched.
+  int64_t dirty_decay_ms{-2};
+  int64_t muzzy_decay_ms{-2};
+};
+
+// Returns the unused dirty pages of all arenas to the OS.
+void purge_arenas();
+
+// Applies the config to every existing and future arena. Does nothing when we
+// are not running on top of jemalloc.
+void configure_arenas(const ArenaConfig& config);
+
 class ScopedProfiling final {
  public:
   ScopedProfiling(bool enable) {
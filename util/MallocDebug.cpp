@@ -275,6 +275,9 @@ thread_local MallocDebug<true> malloc_debug;
 
 extern "C" {
 
+// Lets redex-all know that it must not skip freeing its heap at exit.
+bool redex_malloc_debug_is_active() { return true; }
+
 void* malloc(size_t sz) { return malloc_debug.malloc(sz); }
 
 void* calloc(size_t nelem, size_t elsize) {